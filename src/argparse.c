@@ -28,6 +28,7 @@
 #include "mcell_structs.h" /* for struct volume */
 #include "logging.h"
 #include "version_info.h" /* for print_version, print_full_version */
+#include "output_journal.h" /* for output_journal_recover */
 
 #include <stdarg.h>       /* for va_start, va_end, va_list */
 #include <string.h>       /* for strdup */
@@ -69,6 +70,21 @@ static struct option long_options[] = { { "help", 0, 0, 'h' },
                                         { "quiet", 0, 0, 'q' },
                                         { "with_checks", 1, 0, 'w' },
                                         { "rules", 1, 0, 'r'},
+                                        { "rules_cache_mb", 1, 0, 'M'},
+                                        { "threads", 1, 0, 't' },
+                                        { "rebalance", 1, 0, 'B' },
+                                        { "sort_interval", 1, 0, 'R' },
+                                        { "sort_slots", 0, 0, 'T' },
+                                        { "seeds", 1, 0, 'S' },
+                                        { "huge_pages", 0, 0, 'H' },
+                                        { "shortest_floats", 0, 0, 'F' },
+                                        { "output_journal", 0, 0, 'J' },
+                                        { "recover_output", 1, 0, 'u' },
+                                        { "metrics_file", 1, 0, 'o' },
+                                        { "metrics_interval", 1, 0, 'O' },
+                                        { "bench_json", 1, 0, 'j' },
+                                        { "page_idle_storages", 1, 0, 'P' },
+                                        { "page_dir", 1, 0, 'D' },
                                         { NULL, 0, 0, 0 } };
 
 /* print_usage: Write the usage message for mcell to a file handle.
@@ -97,6 +113,21 @@ void print_usage(FILE *f, char const *argv0) {
       "     [-quiet]                 suppress all unrequested output except for errors\n"
       "     [-with_checks ('yes'/'no', default 'yes')]   performs check of the geometry for coincident walls\n"
       "     [-rules rules_file_name] run in MCell-R mode\n"
+      "     [-rules_cache_mb n]      evict cached MCell-R reactions beyond n MB (default: no limit)\n"
+      "     [-threads n]             use n threads for initialization, memory partitions and output (default: 1)\n"
+      "     [-rebalance n]           rebalance threaded memory partitions every n iterations\n"
+      "     [-sort_interval n]       sort volume molecules in memory by position every n iterations\n"
+      "     [-sort_slots]            run the molecules of each timestep in subvolume order\n"
+      "     [-seeds n]               run seeds seed to seed+n-1, sharing one initialization\n"
+      "     [-huge_pages]            allocate large memory pools on huge pages where available\n"
+      "     [-shortest_floats]       write text output numbers with the fewest digits that read back exactly\n"
+      "     [-output_journal]        keep buffered counts in journal files that survive the process being killed\n"
+      "     [-recover_output journal] write out the counts left in an output journal and exit\n"
+      "     [-metrics_file file]     rewrite live metrics to file, as JSON or as Prometheus text if it ends in .prom\n"
+      "     [-metrics_interval s]    seconds between metrics updates (default: 10)\n"
+      "     [-bench_json file]       write build, timing and memory figures of the run to file as JSON\n"
+      "     [-page_idle_storages n]  page out the memory of storages idle for n iterations to a scratch file\n"
+      "     [-page_dir dir]          directory of that scratch file (default: $TMPDIR or /tmp)\n"
       "\n");
 }
 
@@ -139,6 +170,7 @@ int argparse_init(int argc, char *const argv[], struct volume *vol) {
   FILE *fhandle = NULL;
   char *with_checks_option;
   char *rules_xml_file = NULL; // for nfsim
+  long cache_mb;
   //argerror('whats up');
   /* Loop over all arguments */
   while (1) {
@@ -165,6 +197,86 @@ int argparse_init(int argc, char *const argv[], struct volume *vol) {
       vol->quiet_flag = 1;
       break;
 
+    case 'H': /* -huge_pages */
+      vol->use_huge_pages = 1;
+      break;
+
+    case 'F': /* -shortest_floats */
+      vol->shortest_floats = 1;
+      break;
+
+    case 'J': /* -output_journal */
+      vol->output_journal = 1;
+      break;
+
+    case 'u': /* -recover_output */
+      exit(output_journal_recover(optarg) ? EXIT_FAILURE : EXIT_SUCCESS);
+
+    case 'T': /* -sort_slots */
+      vol->sort_slots = 1;
+      break;
+
+    case 'o': /* -metrics_file */
+      free(vol->metrics_file);
+      vol->metrics_file = strdup(optarg);
+      if (vol->metrics_file == NULL) {
+        argerror("File '%s', Line %u: Out of memory while parsing "
+                 "command-line arguments: %s\n",
+                 __FILE__, __LINE__, optarg);
+        return 1;
+      }
+      break;
+
+    case 'j': /* -bench_json */
+      free(vol->bench_json_file);
+      vol->bench_json_file = strdup(optarg);
+      if (vol->bench_json_file == NULL) {
+        argerror("File '%s', Line %u: Out of memory while parsing "
+                 "command-line arguments: %s\n",
+                 __FILE__, __LINE__, optarg);
+        return 1;
+      }
+      break;
+
+    case 'D': /* -page_dir */
+      free(vol->page_dir);
+      vol->page_dir = strdup(optarg);
+      if (vol->page_dir == NULL) {
+        argerror("File '%s', Line %u: Out of memory while parsing "
+                 "command-line arguments: %s\n",
+                 __FILE__, __LINE__, optarg);
+        return 1;
+      }
+      break;
+
+    case 'P': /* -page_idle_storages */
+      vol->page_idle_storages = (int)strtol(optarg, &endptr, 0);
+      if (endptr == optarg || *endptr != '\0') {
+        argerror("Idle iterations before paging out must be an integer: %s",
+                 optarg);
+        return 1;
+      }
+
+      if (vol->page_idle_storages < 0) {
+        argerror("Idle iterations before paging out %d is negative",
+                 vol->page_idle_storages);
+        return 1;
+      }
+      break;
+
+    case 'O': /* -metrics_interval */
+      vol->metrics_interval = strtod(optarg, &endptr);
+      if (endptr == optarg || *endptr != '\0') {
+        argerror("Metrics interval must be a number: %s", optarg);
+        return 1;
+      }
+
+      if (!(vol->metrics_interval > 0)) {
+        argerror("Metrics interval %g is not positive", vol->metrics_interval);
+        return 1;
+      }
+      break;
+
     case 'd': /* -dump */
       vol->dump_level = strtol(optarg, &endptr, 0);
       if (endptr == optarg || *endptr != '\0') {
@@ -229,6 +341,58 @@ int argparse_init(int argc, char *const argv[], struct volume *vol) {
       }
       break;
 
+    case 't': /* -threads */
+      vol->num_threads = (int)strtol(optarg, &endptr, 0);
+      if (endptr == optarg || *endptr != '\0') {
+        argerror("Thread count must be an integer: %s", optarg);
+        return 1;
+      }
+
+      if (vol->num_threads < 1) {
+        argerror("Thread count %d is less than 1", vol->num_threads);
+        return 1;
+      }
+      break;
+
+    case 'B': /* -rebalance */
+      vol->rebalance_interval = (int)strtol(optarg, &endptr, 0);
+      if (endptr == optarg || *endptr != '\0') {
+        argerror("Rebalance interval must be an integer: %s", optarg);
+        return 1;
+      }
+
+      if (vol->rebalance_interval < 0) {
+        argerror("Rebalance interval %d is negative", vol->rebalance_interval);
+        return 1;
+      }
+      break;
+
+    case 'R': /* -sort_interval */
+      vol->sort_interval = (int)strtol(optarg, &endptr, 0);
+      if (endptr == optarg || *endptr != '\0') {
+        argerror("Sort interval must be an integer: %s", optarg);
+        return 1;
+      }
+
+      if (vol->sort_interval < 0) {
+        argerror("Sort interval %d is negative", vol->sort_interval);
+        return 1;
+      }
+      break;
+
+    case 'S': /* -seeds */
+      vol->n_seeds = (int)strtol(optarg, &endptr, 0);
+      if (endptr == optarg || *endptr != '\0') {
+        argerror("Seed count must be an integer: %s", optarg);
+        return 1;
+      }
+
+      if (vol->n_seeds < 1) {
+        argerror("Seed count %d is less than 1", vol->n_seeds);
+        return 1;
+      }
+      break;
+
     case 'i': /* -iterations */
       vol->iterations = strtoll(optarg, &endptr, 0);
       if (endptr == optarg || *endptr != '\0') {
@@ -282,6 +446,20 @@ int argparse_init(int argc, char *const argv[], struct volume *vol) {
       rules_xml_file = strdup(optarg);
       break;
 
+    case 'M': /* -rules_cache_mb */
+      cache_mb = strtol(optarg, &endptr, 0);
+      if (endptr == optarg || *endptr != '\0') {
+        argerror("Reaction cache size must be an integer: %s", optarg);
+        return 1;
+      }
+
+      if (cache_mb < 1) {
+        argerror("Reaction cache size %ld MB is less than 1", cache_mb);
+        return 1;
+      }
+      vol->nfsim_cache_bytes = (size_t)cache_mb << 20;
+      break;
+
     case 'l': /* -logfile */
       if (log_file_specified) {
         argerror("-logfile argument specified more than once: %s", optarg);
@@ -37,6 +37,11 @@
 #include <signal.h>
 #include <sys/stat.h>
 #include <string.h>
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
 
 #include "mcell_structs.h"
 #include "mcell_reactions.h"
@@ -44,29 +49,44 @@
 #include "logging.h"
 #include "vol_util.h"
 #include "chkpt.h"
+#include "chkpt_format.h"
 #include "grid_util.h"
 #include "count_util.h"
 #include "react.h"
 #include "strfunc.h"
+#include "react_output.h"
+#include "thread_util.h"
+#include "init.h"
+
+/* Molecule chunks held in memory at once, per thread, while writing or
+ * reading a checkpoint */
+#define CHKPT_CHUNKS_PER_THREAD 4
+
+/* One molecule of the last full checkpoint, as far as it survives a
+ * restart: scheduling times are recomputed on reading */
+struct chkpt_base_entry {
+  u_long id;
+  unsigned long long index; /* position among the base's molecules */
+  struct species *properties;
+  struct vector3 where;
+  double birthday;
+  short orient;
+  byte act_newbie_flag;
+};
+
+/* The last full checkpoint, which differential checkpoints refer to */
+struct chkpt_base {
+  char *filename;
+  long long iteration;
+  int write_base;       /* set if this checkpoint writes a new base */
+  char *stale_filename; /* previous base, removed once replaced */
+  int n_deltas;         /* differential checkpoints since the base */
+  unsigned long long n_entries;
+  struct chkpt_base_entry *entries; /* sorted by id */
+};
 
-/* MCell checkpoint API version */
-#define CHECKPOINT_API 1
-
-/* Endian-ness markers */
-#define MCELL_BIG_ENDIAN 16
-#define MCELL_LITTLE_ENDIAN 17
-
-/* Checkpoint section commands */
-#define CURRENT_TIME_CMD 1
-#define CURRENT_ITERATION_CMD 2
-#define CHKPT_SEQ_NUM_CMD 3
-#define RNG_STATE_CMD 4
-#define MCELL_VERSION_CMD 5
-#define SPECIES_TABLE_CMD 6
-#define MOL_SCHEDULER_STATE_CMD 7
-#define BYTE_ORDER_CMD 8
-#define NUM_CHKPT_CMDS 9
-#define CHECKPOINT_API_CMD 10
+/* Molecule records written or decoded at once when a mapping isn't used */
+#define CHKPT_FIXED_BLOCK 4096
 
 /* Newbie flags */
 #define HAS_ACT_NEWBIE 1
@@ -203,6 +223,22 @@ enum checkpoint_request_type_t *chkpt_checkpoint_requested;
  */
 struct chkpt_read_state {
   byte byte_order_mismatch;
+  struct chkpt_periodic_images *periodic_images; /* NULL if not present */
+};
+
+/* The periodic boxes of the molecules in a checkpoint, in file order, as
+ * runs of consecutive molecules in the same box */
+struct chkpt_periodic_images {
+  unsigned int n_boxes;
+  struct periodic_image *boxes;
+  unsigned long long n_runs;
+  unsigned int *run_box;
+  unsigned long long *run_length;
+
+  /* position of the next molecule */
+  unsigned long long run;
+  unsigned long long in_run;
+  unsigned long long n_missing; /* molecules beyond the last run */
 };
 
 /* Handlers for individual checkpoint commands */
@@ -214,6 +250,8 @@ static int read_chkpt_seq_num(struct volume *world, FILE *fs,
                               struct chkpt_read_state *state);
 static int read_rng_state(struct volume *world, FILE *fs,
                           struct chkpt_read_state *state);
+static int read_storage_rng_states(struct volume *world, FILE *fs,
+                                   struct chkpt_read_state *state, int apply);
 static int read_byte_order(FILE *fs, struct chkpt_read_state *state);
 static int read_mcell_version(FILE *fs, struct chkpt_read_state *state);
 static int read_api_version(FILE *fs, struct chkpt_read_state *state,
@@ -228,16 +266,35 @@ static int write_current_iteration(FILE *fs, long long current_iterations,
                                    double current_time_seconds);
 static int write_chkpt_seq_num(FILE *fs, u_int chkpt_seq_num);
 static int write_rng_state(FILE *fs, u_int seed_seq, struct rng_state *rng);
+static int write_storage_rng_states(FILE *fs, struct volume *world);
 static int write_species_table(FILE *fs, int n_species,
                                struct species **species_list);
-static int write_mol_scheduler_state_real(FILE *fs,
-                                          struct storage_list *storage_head,
-                                          double simulation_start_seconds,
-                                          double start_iterations,
-                                          double time_unit);
+static int write_mol_scheduler_state_real(FILE *fs, struct volume *world);
+static int write_mol_scheduler_delta(FILE *fs, struct volume *world);
+static int write_mol_scheduler_fixed(FILE *fs, struct volume *world);
+static int write_periodic_images(FILE *fs, struct volume *world);
+static int read_periodic_images(FILE *fs, struct chkpt_read_state *state);
+static void free_periodic_images(struct chkpt_periodic_images *images);
+static int read_mol_scheduler_delta(struct volume *world, FILE *fs,
+                                    struct chkpt_read_state *state,
+                                    uint32_t api_version);
+static int read_mol_scheduler_state_fixed(struct volume *world, FILE *fs,
+                                          struct chkpt_read_state *state,
+                                          uint32_t api_version);
+struct chkpt_molecule_sink;
+static int read_fixed_molecules(FILE *fs, struct chkpt_read_state *state,
+                                struct species **species_table,
+                                unsigned int n_species_ids,
+                                struct chkpt_molecule_sink *sink);
+static void prepare_chkpt_base(struct volume *world, char const *filename);
+static int replace_chkpt_file(struct volume *world, char const *filename,
+                              int delta, int keep);
+static int write_chkpt_sections(struct volume *world, FILE *fs, int delta);
 static int write_byte_order(FILE *fs);
 
 static int write_api_version(FILE *fs);
+static void update_chkpt_times(struct volume *world);
+static int write_chkpt_file(struct volume *world, char const *filename);
 
 static int create_molecule_scheduler(struct storage_list *storage_head,
                                      long long start_iterations);
@@ -300,6 +357,63 @@ void chkpt_signal_handler(int signo) {
       is left unmolested.
 ***************************************************************************/
 int create_chkpt(struct volume *world, char const *filename) {
+  update_chkpt_times(world);
+  prepare_chkpt_base(world, filename);
+  return write_chkpt_file(world, filename);
+}
+
+/***************************************************************************
+ update_chkpt_times:
+ In:  world - the simulation state
+ Out: The simulation start time is moved up to the current iteration, as
+      it is when a checkpoint is read back in.
+***************************************************************************/
+static void update_chkpt_times(struct volume *world) {
+  world->current_time_seconds = world->current_time_seconds +
+      (world->current_iterations - world->start_iterations) * world->time_unit;
+  // These are normally set when reading a checkpoint. They need to be set here
+  // in case we checkpoint without exiting (i.e. using NOEXIT). Otherwise,
+  // world->current_time_seconds will be set incorrectly upon subsequent calls
+  // to create_chkpt
+  world->start_iterations = world->current_iterations;
+  world->simulation_start_seconds = world->current_time_seconds;
+}
+
+/***************************************************************************
+ write_chkpt_file:
+ In:  filename - the name of the checkpoint file to create
+ Out: returns 1 on failure, 0 on success.  For differential checkpoints,
+      the base checkpoint is written first if it is due to be replaced,
+      and the previous base is removed once nothing refers to it any more.
+***************************************************************************/
+static int write_chkpt_file(struct volume *world, char const *filename) {
+  struct chkpt_base *base =
+      (world->chkpt_differential > 0) ? world->chkpt_base : NULL;
+
+  if (base != NULL && base->write_base &&
+      replace_chkpt_file(world, base->filename, 0, 0))
+    return 1;
+
+  if (replace_chkpt_file(world, filename, base != NULL, world->keep_chkpts))
+    return 1;
+
+  if (base != NULL && base->stale_filename != NULL &&
+      remove(base->stale_filename) != 0)
+    mcell_perror_nodie(errno, "Failed to remove old base checkpoint '%s'",
+                       base->stale_filename);
+  return 0;
+}
+
+/***************************************************************************
+ replace_chkpt_file:
+ In:  filename - the name of the checkpoint file to create
+      delta - write the molecules relative to the base checkpoint
+      keep - keep the previous file, named after the current iteration
+ Out: returns 1 on failure, 0 on success.  The checkpoint is written to a
+      temporary file which then replaces filename.
+***************************************************************************/
+static int replace_chkpt_file(struct volume *world, char const *filename,
+                              int delta, int keep) {
   FILE *outfs = NULL;
 
   /* Create temporary filename */
@@ -314,21 +428,13 @@ int create_chkpt(struct volume *world, char const *filename) {
     mcell_perror(errno, "Failed to write checkpoint file '%s'", tmpname);
 
   /* Write checkpoint */
-  world->current_time_seconds = world->current_time_seconds +
-      (world->current_iterations - world->start_iterations) * world->time_unit;
-  // These are normally set when reading a checkpoint. They need to be set here
-  // in case we checkpoint without exiting (i.e. using NOEXIT). Otherwise,
-  // world->current_time_seconds will be set incorrectly upon subsequent calls
-  // to create_chkpt
-  world->start_iterations = world->current_iterations;
-  world->simulation_start_seconds = world->current_time_seconds;
-  if (write_chkpt(world, outfs))
+  if (write_chkpt_sections(world, outfs, delta))
     mcell_error("Failed to write checkpoint file %s\n", filename);
   fclose(outfs);
 
   /* keep previous checkpoint file if requested by appending the current
    * iteration */
-  if (world->keep_chkpts) {
+  if (keep) {
     /* check if previous checkpoint file exists - may not exist initially */
     struct stat buf;
     if (stat(filename, &buf) == 0) {
@@ -357,25 +463,117 @@ int create_chkpt(struct volume *world, char const *filename) {
 }
 
 /***************************************************************************
- write_varintl: Size- and endian-agnostic saving of unsigned long long values.
- In:  fs - file handle to which to write
-      val - value to write to file
- Out: returns 1 on failure, 0 on success.  On success, value is written to file.
+ create_chkpt_background:
+ In:  filename - the name of the checkpoint file to create
+ Out: returns 1 on failure, 0 on success.  The checkpoint is written by a
+      forked copy of the process, so the caller can carry on with the
+      simulation while it is written; the child's copy-on-write snapshot of
+      the world is unaffected.  Any previous background checkpoint is waited
+      for first.  Where fork() is unavailable or fails, the checkpoint is
+      written in the foreground.
 ***************************************************************************/
-static int write_varintl(FILE *fs, unsigned long long val) {
-  unsigned char buffer[40];
+int create_chkpt_background(struct volume *world, char const *filename) {
+  int failure = wait_background_chkpt(world);
+  update_chkpt_times(world);
+  prepare_chkpt_base(world, filename);
+
+#ifndef _WIN32
+  /* Don't let the child write out our buffered output a second time */
+  fflush(NULL);
+
+  pid_t pid = fork();
+  if (pid == 0) {
+    /* Only this thread exists in the child, so the pool can't be used */
+    world->thread_pool = NULL;
+    disable_emergency_output_hooks();
+    signal(SIGALRM, SIG_IGN);
+    signal(SIGUSR1, SIG_IGN);
+    signal(SIGUSR2, SIG_IGN);
+
+    int status = write_chkpt_file(world, filename);
+    fflush(NULL);
+    _exit(status ? EXIT_FAILURE : EXIT_SUCCESS);
+  } else if (pid > 0) {
+    world->chkpt_child_pid = pid;
+    return failure;
+  }
+
+  mcell_perror_nodie(errno, "Failed to fork checkpoint writer; writing "
+                            "checkpoint '%s' in the foreground", filename);
+#endif
+
+  return write_chkpt_file(world, filename) || failure;
+}
+
+/***************************************************************************
+ wait_background_chkpt:
+ In:  world - the simulation state
+ Out: returns 1 if the last background checkpoint failed, 0 if it
+      succeeded or there was none.  Waits for it to be written.
+***************************************************************************/
+int wait_background_chkpt(struct volume *world) {
+#ifndef _WIN32
+  if (world->chkpt_child_pid <= 0)
+    return 0;
+
+  int status;
+  pid_t pid;
+  do {
+    pid = waitpid(world->chkpt_child_pid, &status, 0);
+  } while (pid < 0 && errno == EINTR);
+  world->chkpt_child_pid = 0;
+
+  if (pid < 0) {
+    mcell_perror_nodie(errno, "Failed to wait for background checkpoint");
+    return 1;
+  }
+  if (!WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS) {
+    mcell_warn("Background checkpoint to file '%s' failed.",
+               world->chkpt_outfile);
+    return 1;
+  }
+#endif
+  return 0;
+}
+
+/* Longest encoding of an unsigned long long by encode_varintl */
+#define VARINT_MAX_BYTES 40
+
+/***************************************************************************
+ encode_varintl: Size- and endian-agnostic encoding of unsigned long long
+                 values: 7 bits per byte, most significant first, with the
+                 top bit set on all but the last byte.
+ In:  buffer - VARINT_MAX_BYTES bytes to encode into
+      val - value to encode
+ Out: returns the length of the encoding, which is placed at the end of
+      buffer.
+***************************************************************************/
+static size_t encode_varintl(unsigned char *buffer, unsigned long long val) {
   size_t len = 0;
 
-  buffer[sizeof(buffer) - 1 - len] = val & 0x7f;
+  buffer[VARINT_MAX_BYTES - 1 - len] = val & 0x7f;
   val >>= 7;
   ++len;
 
   while (val != 0) {
-    buffer[sizeof(buffer) - 1 - len] = (val & 0x7f) | 0x80;
+    buffer[VARINT_MAX_BYTES - 1 - len] = (val & 0x7f) | 0x80;
     val >>= 7;
     ++len;
   }
 
+  return len;
+}
+
+/***************************************************************************
+ write_varintl: Size- and endian-agnostic saving of unsigned long long values.
+ In:  fs - file handle to which to write
+      val - value to write to file
+ Out: returns 1 on failure, 0 on success.  On success, value is written to file.
+***************************************************************************/
+static int write_varintl(FILE *fs, unsigned long long val) {
+  unsigned char buffer[VARINT_MAX_BYTES];
+  size_t len = encode_varintl(buffer, val);
+
   if (fwrite(buffer + sizeof(buffer) - len, 1, len, fs) != len)
     return 1;
   return 0;
@@ -496,6 +694,17 @@ static int read_svarint(FILE *fs, int *dest) {
       Returns 1 on error, and 0 - on success.
 ***************************************************************************/
 int write_chkpt(struct volume *world, FILE *fs) {
+  return write_chkpt_sections(world, fs, 0);
+}
+
+/***************************************************************************
+ write_chkpt_sections:
+ In:  fs - checkpoint file to write to.
+      delta - write the molecules relative to the base checkpoint
+ Out: Writes the checkpoint data to the file.
+      Returns 1 on error, and 0 - on success.
+***************************************************************************/
+static int write_chkpt_sections(struct volume *world, FILE *fs, int delta) {
   return (write_byte_order(fs) ||
           write_api_version(fs) ||
           write_mcell_version(fs, world->mcell_version) ||
@@ -504,10 +713,16 @@ int write_chkpt(struct volume *world, FILE *fs) {
                                   world->current_time_seconds) ||
           write_chkpt_seq_num(fs, world->chkpt_seq_num) ||
           write_rng_state(fs, world->seed_seq, world->rng) ||
+          (world->storage_head != NULL &&
+           world->storage_head->store->rng != NULL &&
+           write_storage_rng_states(fs, world)) ||
           write_species_table(fs, world->n_species, world->species_list) ||
-          write_mol_scheduler_state_real(fs, world->storage_head,
-              world->simulation_start_seconds, world->start_iterations,
-              world->time_unit));
+          (world->periodic_box_obj != NULL &&
+           write_periodic_images(fs, world)) ||
+          (delta ? write_mol_scheduler_delta(fs, world)
+                 : world->chkpt_fixed_width
+                       ? write_mol_scheduler_fixed(fs, world)
+                       : write_mol_scheduler_state_real(fs, world)));
 }
 
 /***************************************************************************
@@ -571,6 +786,7 @@ int read_chkpt(struct volume *world, FILE *fs, bool only_time_and_iter) {
 
   struct chkpt_read_state state;
   state.byte_order_mismatch = 0;
+  state.periodic_images = NULL;
 
   /* Read the required pre-amble sections */
   uint32_t api_version;
@@ -593,7 +809,7 @@ int read_chkpt(struct volume *world, FILE *fs, bool only_time_and_iter) {
     }
 
     /* Check that it's a valid command-type */
-    DATACHECK(cmd < 1 || cmd >= NUM_CHKPT_CMDS,
+    DATACHECK(cmd < 1 || cmd >= NUM_CHKPT_CMDS || cmd == CHECKPOINT_API_CMD,
               "Unrecognized command-type in checkpoint file.  "
               "Checkpoint file cannot be loaded.");
 
@@ -639,6 +855,11 @@ int read_chkpt(struct volume *world, FILE *fs, bool only_time_and_iter) {
         return 1;
       break;
 
+    case STORAGE_RNG_STATE_CMD:
+      if (read_storage_rng_states(world, fs, &state, 1))
+        return 1;
+      break;
+
     case SPECIES_TABLE_CMD:
       if (read_species_table(world, fs))
         return 1;
@@ -651,10 +872,42 @@ int read_chkpt(struct volume *world, FILE *fs, bool only_time_and_iter) {
       DATACHECK(
           !seen_section[SPECIES_TABLE_CMD],
           "Species table command must precede molecule scheduler command.");
+      DATACHECK(seen_section[MOL_SCHEDULER_DELTA_CMD] ||
+                    seen_section[MOL_SCHEDULER_FIXED_CMD],
+                "Duplicate molecule scheduler command in checkpoint file.");
       if (read_mol_scheduler_state_real(world, fs, &state, api_version))
         return 1;
       break;
 
+    case PERIODIC_IMAGES_CMD:
+      DATACHECK(seen_section[MOL_SCHEDULER_STATE_CMD] ||
+                    seen_section[MOL_SCHEDULER_DELTA_CMD] ||
+                    seen_section[MOL_SCHEDULER_FIXED_CMD],
+                "Periodic images command must precede molecule scheduler "
+                "command.");
+      if (read_periodic_images(fs, &state))
+        return 1;
+      break;
+
+    case MOL_SCHEDULER_FIXED_CMD:
+    case MOL_SCHEDULER_DELTA_CMD:
+      DATACHECK(
+          !seen_section[CURRENT_ITERATION_CMD],
+          "Current iteration command must precede molecule scheduler command.");
+      DATACHECK(
+          !seen_section[SPECIES_TABLE_CMD],
+          "Species table command must precede molecule scheduler command.");
+      DATACHECK(seen_section[MOL_SCHEDULER_STATE_CMD] +
+                        seen_section[MOL_SCHEDULER_DELTA_CMD] +
+                        seen_section[MOL_SCHEDULER_FIXED_CMD] > 1,
+                "Duplicate molecule scheduler command in checkpoint file.");
+      if (cmd == MOL_SCHEDULER_FIXED_CMD) {
+        if (read_mol_scheduler_state_fixed(world, fs, &state, api_version))
+          return 1;
+      } else if (read_mol_scheduler_delta(world, fs, &state, api_version))
+        return 1;
+      break;
+
     case BYTE_ORDER_CMD:
     case MCELL_VERSION_CMD:
     default:
@@ -671,9 +924,21 @@ int read_chkpt(struct volume *world, FILE *fs, bool only_time_and_iter) {
   DATACHECK(!seen_section[CHKPT_SEQ_NUM_CMD],
             "Checkpoint sequence number command is not present.");
   DATACHECK(!seen_section[RNG_STATE_CMD], "RNG state command is not present.");
-  DATACHECK(!seen_section[MOL_SCHEDULER_STATE_CMD],
+  DATACHECK(!seen_section[MOL_SCHEDULER_STATE_CMD] &&
+                !seen_section[MOL_SCHEDULER_DELTA_CMD] &&
+                !seen_section[MOL_SCHEDULER_FIXED_CMD],
             " Molecule scheduler state command is not present.");
 
+  if (state.periodic_images != NULL) {
+    if (state.periodic_images->n_missing > 0 ||
+        state.periodic_images->run < state.periodic_images->n_runs)
+      mcell_warn("The periodic images in the checkpoint file do not match "
+                 "its molecules.");
+    free_periodic_images(state.periodic_images);
+  } else if (world->periodic_box_obj != NULL && !world->periodic_traditional)
+    mcell_warn("Checkpoint file has no periodic images; all molecules are "
+               "restored to the central periodic box.");
+
   return 0;
 }
 
@@ -921,6 +1186,14 @@ static int write_an_rng_state(FILE *fs, struct rng_state *rng) {
   WRITEFIELD(rng->b);
   WRITEFIELD(rng->c);
   WRITEFIELD(rng->d);
+#elif defined(USE_COUNTER_RNG)
+  static const char RNG_PHILOX = 'P';
+  WRITEFIELD(RNG_PHILOX);
+  WRITEUINT(rng->key[0]);
+  WRITEUINT(rng->key[1]);
+  WRITEUINT64(rng->counter);
+  WRITEUINT(rng->randcnt);
+  WRITEARRAY(rng->out, 4);
 #else
   static const char RNG_ISAAC = 'I';
   WRITEFIELD(RNG_ISAAC);
@@ -975,6 +1248,20 @@ static int read_an_rng_state(FILE *fs, struct chkpt_read_state *state,
   READFIELD(rng->c);
   READFIELD(rng->d);
 
+#elif defined(USE_COUNTER_RNG)
+  static const char RNG_PHILOX = 'P';
+  char rngtype;
+  READFIELD(rngtype);
+  DATACHECK(rngtype != RNG_PHILOX, "Invalid RNG type stored in checkpoint file "
+                                   "(this version of MCell was built with the "
+                                   "counter-based Philox generator).");
+  READUINT(rng->key[0]);
+  READUINT(rng->key[1]);
+  READUINT64(rng->counter);
+  READUINT(rng->randcnt);
+  DATACHECK(rng->randcnt > 4, "Corrupted checkpoint data: invalid RNG state.");
+  READARRAY(rng->out, 4);
+
 #else
   static const char RNG_ISAAC = 'I';
   char rngtype;
@@ -1025,6 +1312,82 @@ static int read_rng_state(struct volume *world, FILE *fs,
   return 0;
 }
 
+/***************************************************************************
+ write_storage_rng_states:
+ In:  fs - checkpoint file to write to.
+ Out: Writes the random number generator state of every storage, in the
+      order of the storage list, to the checkpoint file.  Only storages of
+      threaded runs have their own generators.
+      Returns 1 on error, and 0 - on success.
+***************************************************************************/
+static int write_storage_rng_states(FILE *fs, struct volume *world) {
+  static const char SECTNAME[] = "storage RNG state";
+  static const byte cmd = STORAGE_RNG_STATE_CMD;
+
+  unsigned int n_storages = 0;
+  for (struct storage_list *slp = world->storage_head; slp != NULL;
+       slp = slp->next)
+    ++n_storages;
+
+  WRITEFIELD(cmd);
+  WRITEUINT(world->seed_seq);
+  WRITEUINT(n_storages);
+  for (struct storage_list *slp = world->storage_head; slp != NULL;
+       slp = slp->next) {
+    if (write_an_rng_state(fs, slp->store->rng))
+      return 1;
+  }
+  return 0;
+}
+
+/***************************************************************************
+ read_storage_rng_states:
+ In:  fs - checkpoint file to read from.
+      apply - whether to restore the states, or just skip the section
+ Out: Reads the random number generator states of the storages from the
+      checkpoint file.  They are restored if the seed and the number of
+      storages are the same as in the checkpointed run and the storages
+      have their own generators; otherwise the storages keep the streams
+      they started with.
+      Returns 1 on error, and 0 - on success.
+***************************************************************************/
+static int read_storage_rng_states(struct volume *world, FILE *fs,
+                                   struct chkpt_read_state *state, int apply) {
+  static const char SECTNAME[] = "storage RNG state";
+
+  unsigned int old_seed, n_storages;
+  READUINT(old_seed);
+  READUINT(n_storages);
+
+  unsigned int n_world_storages = 0;
+  for (struct storage_list *slp = world->storage_head; slp != NULL;
+       slp = slp->next)
+    ++n_world_storages;
+  if (apply && (old_seed != world->seed_seq || world->storage_head == NULL ||
+                world->storage_head->store->rng == NULL))
+    apply = 0;
+  if (apply && n_storages != n_world_storages) {
+    mcell_warn("Checkpoint file has random number states for %u memory "
+               "partitions, but the model has %u.  The partitions' random "
+               "number streams are restarted.",
+               n_storages, n_world_storages);
+    apply = 0;
+  }
+
+  struct rng_state *scratch = NULL;
+  if (!apply)
+    scratch = CHECKED_MALLOC_STRUCT(struct rng_state, "storage RNG state");
+  struct storage_list *slp = world->storage_head;
+  int failure = 0;
+  for (unsigned int i = 0; i < n_storages && !failure; ++i) {
+    failure = read_an_rng_state(fs, state, apply ? slp->store->rng : scratch);
+    if (apply)
+      slp = slp->next;
+  }
+  free(scratch);
+  return failure;
+}
+
 /***************************************************************************
  write_species_table:
  In:  fs - checkpoint file to write to.
@@ -1149,99 +1512,215 @@ count_items_in_scheduler(struct storage_list *storage_head) {
   return total_items;
 }
 
+/* Growable in-memory copy of one checkpoint chunk */
+struct chkpt_buffer {
+  unsigned char *data;
+  size_t size;
+  size_t capacity;
+};
+
 /***************************************************************************
- write_mol_scheduler_state_real:
- In:  fs - checkpoint file to write to.
- Out: Writes molecule scheduler data to the checkpoint file.
-      Returns 1 on error, and 0 - on success.
+ buffer_append:
+ In:  buf - buffer to add to
+      src - bytes to add
+      len - number of bytes
+ Out: returns 1 if memory runs out, 0 on success.
 ***************************************************************************/
-static int write_mol_scheduler_state_real(FILE *fs,
-                                          struct storage_list *storage_head,
-                                          double simulation_start_seconds,
-                                          double start_iterations,
-                                          double time_unit) {
-  static const char SECTNAME[] = "molecule scheduler state";
-  static const byte cmd = MOL_SCHEDULER_STATE_CMD;
+static int buffer_append(struct chkpt_buffer *buf, void const *src,
+                         size_t len) {
+  if (buf->size + len > buf->capacity) {
+    size_t capacity = (buf->capacity == 0) ? 4096 : 2 * buf->capacity;
+    while (capacity < buf->size + len)
+      capacity *= 2;
+    unsigned char *data = (unsigned char *)realloc(buf->data, capacity);
+
+    if (data == NULL)
+      return 1;
+    buf->data = data;
+    buf->capacity = capacity;
+  }
+  memcpy(buf->data + buf->size, src, len);
+  buf->size += len;
+  return 0;
+}
 
-  WRITEFIELD(cmd);
+/***************************************************************************
+ buffer_append_varintl:
+ In:  buf - buffer to add to
+      val - value to add, encoded as by write_varintl
+ Out: returns 1 if memory runs out, 0 on success.
+***************************************************************************/
+static int buffer_append_varintl(struct chkpt_buffer *buf,
+                                 unsigned long long val) {
+  unsigned char buffer[VARINT_MAX_BYTES];
+  size_t len = encode_varintl(buffer, val);
+  return buffer_append(buf, buffer + sizeof(buffer) - len, len);
+}
 
-  /* write total number of items in the scheduler */
-  unsigned long long total_items = count_items_in_scheduler(storage_head);
-  WRITEUINT64(total_items);
+/***************************************************************************
+ buffer_append_svarintl:
+ In:  buf - buffer to add to
+      val - value to add, encoded as by write_svarintl
+ Out: returns 1 if memory runs out, 0 on success.
+***************************************************************************/
+static int buffer_append_svarintl(struct chkpt_buffer *buf, long long val) {
+  if (val < 0)
+    return buffer_append_varintl(buf, (unsigned long long)(((-val) << 1) | 1));
+  else
+    return buffer_append_varintl(buf, (unsigned long long)(((val) << 1)));
+}
 
-  /* Iterate over all molecules in the scheduler to produce checkpoint */
-  for (struct storage_list *slp = storage_head; slp != NULL; slp = slp->next) {
-    for (struct schedule_helper *shp = slp->store->timer; shp != NULL;
-         shp = shp->next_scale) {
-      for (int i = -1; i < shp->buf_len; i++) {
-        for (struct abstract_element *aep = (i < 0) ? shp->current
-                                                    : shp->circ_buf_head[i];
-             aep != NULL; aep = aep->next) {
-          struct abstract_molecule *amp = (struct abstract_molecule *)aep;
-          if (amp->properties == NULL)
-            continue;
+/* Write a raw field to a chunk buffer */
+#define BUFFERFIELD(f)                                                         \
+  INTERNALCHECK(buffer_append(buf, &(f), sizeof(f)),                           \
+                "Out of memory writing checkpoint chunk.")
+
+/* Write an integer to a chunk buffer in the same format as WRITEUINT and
+ * WRITEINT */
+#define BUFFERUINT(f)                                                          \
+  INTERNALCHECK(buffer_append_varintl(buf, (f)),                               \
+                "Out of memory writing checkpoint chunk.")
+#define BUFFERINT(f)                                                           \
+  INTERNALCHECK(buffer_append_svarintl(buf, (f)),                              \
+                "Out of memory writing checkpoint chunk.")
+
+/* One storage's share of the molecule scheduler state */
+struct chkpt_write_chunk {
+  struct storage *store;
+  struct chkpt_buffer buf;
+  unsigned long long n_mols;
+  int status;
+};
 
-          /* Grab the location and orientation for this molecule */
-          struct vector3 where;
-          short orient = 0;
-          byte act_newbie_flag =
-              (amp->flags & ACT_NEWBIE) ? HAS_ACT_NEWBIE : HAS_NOT_ACT_NEWBIE;
-          byte act_change_flag =
-              (amp->flags & ACT_CHANGE) ? HAS_ACT_CHANGE : HAS_NOT_ACT_CHANGE;
-          if ((amp->properties->flags & NOT_FREE) == 0) {
-            struct volume_molecule *vmp = (struct volume_molecule *)amp;
-            INTERNALCHECK(vmp->previous_wall != NULL && vmp->index >= 0,
-                          "The value of 'previous_grid' is not NULL.");
-            where.x = vmp->pos.x;
-            where.y = vmp->pos.y;
-            where.z = vmp->pos.z;
-            orient = 0;
-          } else if ((amp->properties->flags & ON_GRID) != 0) {
-            struct surface_molecule *smp = (struct surface_molecule *)amp;
-            uv2xyz(&smp->s_pos, smp->grid->surface, &where);
-            orient = smp->orient;
-          } else
-            continue;
+/* Shared state for serializing storages on the thread pool */
+struct chkpt_write_pass {
+  struct chkpt_write_chunk *chunks;
+  double simulation_start_seconds;
+  double start_iterations;
+  double time_unit;
+};
 
-          /* Check for valid chkpt_species ID. */
-          INTERNALCHECK(amp->properties->chkpt_species_id == UINT_MAX,
-                        "Attempted to write out a molecule of species '%s', "
-                        "which has not been assigned a checkpoint species id.",
-                        amp->properties->sym->name);
-
-          /* write molecule fields */
-          WRITEUINT(amp->properties->chkpt_species_id);
-          WRITEFIELD(act_newbie_flag);
-          WRITEFIELD(act_change_flag);
-
-          // NOTE: we write all times as real times (seconds) *not* as
-          // "iterations" (or "scaled times") in order to be able to
-          // re-schedule them properly upon restart
-
-          // The scheduling time (t) is essentially iterations, and since time
-          // steps can change when checkpointing, we can't directly convert
-          // iterations to real time (seconds). We need to correct for this by
-          // only converting the iterations of the current simulation
-          // [(t-start_iterations)*time_unit] and adding the real time at the
-          // start of the simulation (simulation_start_seconds).
-          double t = convert_iterations_to_seconds(
-              start_iterations, time_unit, simulation_start_seconds, amp->t);
-          WRITEFIELD(t);
-          // We do a simple conversion for the lifetime t2, since this
-          // corresponds to some event in the future and can be directly
-          // computed without using an offset.
-          double t2 = amp->t2 * time_unit;
-          WRITEFIELD(t2);
-          // Birthday is now always treated as real time in seconds, not
-          // "scaled" time or iterations.
-          double bday = amp->birthday;
-          WRITEFIELD(bday);
-          WRITEFIELD(where);
-          WRITEINT(orient);
+/***************************************************************************
+ chkpt_molecule_location:
+ In:  amp - a scheduled molecule
+      where - receives its position
+      orient - receives its orientation
+ Out: returns 0 if the molecule is saved in checkpoints, 1 if it is not.
+***************************************************************************/
+static int chkpt_molecule_location(struct abstract_molecule *amp,
+                                   struct vector3 *where, short *orient) {
+  if (amp->properties == NULL)
+    return 1;
 
-          static const unsigned char NON_COMPLEX = '\0';
-          WRITEFIELD(NON_COMPLEX);
-        }
+  if ((amp->properties->flags & NOT_FREE) == 0) {
+    struct volume_molecule *vmp = (struct volume_molecule *)amp;
+    where->x = vmp->pos.x;
+    where->y = vmp->pos.y;
+    where->z = vmp->pos.z;
+    *orient = 0;
+  } else if ((amp->properties->flags & ON_GRID) != 0) {
+    struct surface_molecule *smp = (struct surface_molecule *)amp;
+    uv2xyz(&smp->s_pos, smp->grid->surface, where);
+    *orient = smp->orient;
+  } else
+    return 1;
+
+  return 0;
+}
+
+/***************************************************************************
+ buffer_chkpt_molecule:
+ In:  buf - buffer to add to
+      pass - time conversion parameters
+      amp - molecule to add
+      where, orient - its location, from chkpt_molecule_location
+ Out: The molecule is encoded exactly as in the unchunked molecule scheduler
+      state.  Returns 1 on error, and 0 - on success.
+***************************************************************************/
+static int buffer_chkpt_molecule(struct chkpt_buffer *buf,
+                                 struct chkpt_write_pass const *pass,
+                                 struct abstract_molecule *amp,
+                                 struct vector3 where, short orient) {
+  byte act_newbie_flag =
+      (amp->flags & ACT_NEWBIE) ? HAS_ACT_NEWBIE : HAS_NOT_ACT_NEWBIE;
+  byte act_change_flag =
+      ((amp->flags & ACT_CHANGE) || lifetime_is_stale(amp))
+          ? HAS_ACT_CHANGE : HAS_NOT_ACT_CHANGE;
+  if ((amp->properties->flags & NOT_FREE) == 0) {
+    struct volume_molecule *vmp = (struct volume_molecule *)amp;
+    INTERNALCHECK(vmp->previous_wall != NULL && vmp->index >= 0,
+                  "The value of 'previous_grid' is not NULL.");
+  }
+
+  /* Check for valid chkpt_species ID. */
+  INTERNALCHECK(amp->properties->chkpt_species_id == UINT_MAX,
+                "Attempted to write out a molecule of species '%s', "
+                "which has not been assigned a checkpoint species id.",
+                amp->properties->sym->name);
+
+  /* write molecule fields */
+  BUFFERUINT(amp->properties->chkpt_species_id);
+  BUFFERFIELD(act_newbie_flag);
+  BUFFERFIELD(act_change_flag);
+
+  // NOTE: we write all times as real times (seconds) *not* as
+  // "iterations" (or "scaled times") in order to be able to
+  // re-schedule them properly upon restart
+
+  // The scheduling time (t) is essentially iterations, and since time
+  // steps can change when checkpointing, we can't directly convert
+  // iterations to real time (seconds). We need to correct for this by
+  // only converting the iterations of the current simulation
+  // [(t-start_iterations)*time_unit] and adding the real time at the
+  // start of the simulation (simulation_start_seconds).
+  double t = convert_iterations_to_seconds(
+      pass->start_iterations, pass->time_unit,
+      pass->simulation_start_seconds, amp->t);
+  BUFFERFIELD(t);
+  // We do a simple conversion for the lifetime t2, since this
+  // corresponds to some event in the future and can be directly
+  // computed without using an offset.
+  double t2 = amp->t2 * pass->time_unit;
+  BUFFERFIELD(t2);
+  // Birthday is now always treated as real time in seconds, not
+  // "scaled" time or iterations.
+  double bday = amp->birthday;
+  BUFFERFIELD(bday);
+  BUFFERFIELD(where);
+  BUFFERINT(orient);
+
+  static const unsigned char NON_COMPLEX = '\0';
+  BUFFERFIELD(NON_COMPLEX);
+  return 0;
+}
+
+/***************************************************************************
+ serialize_storage_molecules:
+ In:  pass - shared serialization parameters
+      chunk - the storage to serialize
+ Out: The storage's scheduled molecules are encoded into chunk->buf, each
+      exactly as in the unchunked molecule scheduler state, and counted in
+      chunk->n_mols.  Returns 1 on error, and 0 - on success.
+***************************************************************************/
+static int serialize_storage_molecules(struct chkpt_write_pass *pass,
+                                       struct chkpt_write_chunk *chunk) {
+  for (struct schedule_helper *shp = chunk->store->timer; shp != NULL;
+       shp = shp->next_scale) {
+    for (int i = -1; i < shp->buf_len; i++) {
+      for (struct abstract_element *aep = (i < 0) ? shp->current
+                                                  : shp->circ_buf_head[i];
+           aep != NULL; aep = aep->next) {
+        struct abstract_molecule *amp = (struct abstract_molecule *)aep;
+
+        /* Grab the location and orientation for this molecule */
+        struct vector3 where;
+        short orient = 0;
+        if (chkpt_molecule_location(amp, &where, &orient))
+          continue;
+
+        if (buffer_chkpt_molecule(&chunk->buf, pass, amp, where, orient))
+          return 1;
+        ++chunk->n_mols;
       }
     }
   }
@@ -1250,155 +1729,1678 @@ static int write_mol_scheduler_state_real(FILE *fs,
 }
 
 /***************************************************************************
- read_mol_scheduler_state_real:
- In:  fs - checkpoint file to read from.
- Out: Reads molecule scheduler data from the checkpoint file.
-      Returns 0 on success. Error message and exit on failure.
+ serialize_storage_task:
+    Thread pool task serializing one storage of a chunked checkpoint.
 ***************************************************************************/
-static int read_mol_scheduler_state_real(struct volume *world, FILE *fs,
-                                         struct chkpt_read_state *state,
-                                         uint32_t api_version) {
-  static const char SECTNAME[] = "molecule scheduler state";
-
-  struct volume_molecule vm;
-  struct volume_molecule *vmp = NULL;
-  struct abstract_molecule *amp = NULL;
-  struct volume_molecule *guess = NULL;
+static void serialize_storage_task(void *ctx, int task) {
+  struct chkpt_write_pass *pass = (struct chkpt_write_pass *)ctx;
+  pass->chunks[task].status =
+      serialize_storage_molecules(pass, &pass->chunks[task]);
+}
 
-  /* Clear template vol mol structure */
-  memset(&vm, 0, sizeof(struct volume_molecule));
-  vmp = &vm;
-  amp = (struct abstract_molecule *)vmp;
+/***************************************************************************
+ write_mol_scheduler_state_real:
+ In:  fs - checkpoint file to write to.
+ Out: Writes molecule scheduler data to the checkpoint file.
+      Returns 1 on error, and 0 - on success.
+ Note: The section holds the number of chunks, then for each storage a
+       chunk: the number of molecules, the number of bytes that follow and
+       the molecules themselves, encoded as in API version 1.  Storages are
+       serialized in batches on the thread pool, if there is one, and
+       written out in order.
+***************************************************************************/
+static int write_mol_scheduler_state_real(FILE *fs, struct volume *world) {
+  static const char SECTNAME[] = "molecule scheduler state";
+  static const byte cmd = MOL_SCHEDULER_STATE_CMD;
 
-  /* read total number of items in the scheduler. */
-  unsigned long long total_items;
-  READUINT64(total_items);
+  WRITEFIELD(cmd);
 
-  for (unsigned long long n_mol = 0; n_mol < total_items; n_mol++) {
-    /* Normal molecule fields */
-    unsigned int external_species_id;
-    byte act_newbie_flag;
-    byte act_change_flag;
-    double sched_time;
-    double lifetime;
-    double birthday;
-    double x_coord, y_coord, z_coord;
-    int orient;
-
-    /* read molecule fields */
-    READUINT(external_species_id);
-    READFIELDRAW(act_newbie_flag);
-    READFIELDRAW(act_change_flag);
-    READFIELD(sched_time);
-    READFIELD(lifetime);
-    READFIELD(birthday);
-    READFIELD(x_coord);
-    READFIELD(y_coord);
-    READFIELD(z_coord);
-    READINT(orient);
-
-    // starting with API version 1, convert the sched_time, lifetime and
-    // birthday into scaled time based on the current timestep
-    if (api_version >= 1) {
-      // This will force lifetimes to be recomputed. This is necessary if
-      // unimolecular rate constants change between checkpoints.
-      lifetime = 0;
-      sched_time = world->start_iterations;
-      act_change_flag = HAS_ACT_CHANGE;
+  unsigned int n_chunks = 0;
+  for (struct storage_list *slp = world->storage_head; slp != NULL;
+       slp = slp->next)
+    ++n_chunks;
+  WRITEUINT(n_chunks);
+
+  int batch_size =
+      (world->thread_pool != NULL)
+          ? world->num_threads * CHKPT_CHUNKS_PER_THREAD : 1;
+  struct chkpt_write_chunk *chunks =
+      CHECKED_MALLOC_ARRAY(struct chkpt_write_chunk, batch_size,
+                           "checkpoint chunks");
+  struct chkpt_write_pass pass;
+  pass.chunks = chunks;
+  pass.simulation_start_seconds = world->simulation_start_seconds;
+  pass.start_iterations = world->start_iterations;
+  pass.time_unit = world->time_unit;
+
+  int failure = 0;
+  struct storage_list *slp = world->storage_head;
+  while (slp != NULL && !failure) {
+    int n = 0;
+    for (; slp != NULL && n < batch_size; slp = slp->next, ++n) {
+      chunks[n].store = slp->store;
+      chunks[n].buf.data = NULL;
+      chunks[n].buf.size = chunks[n].buf.capacity = 0;
+      chunks[n].n_mols = 0;
+      chunks[n].status = 0;
     }
 
-    unsigned int complex_no = 0;
-    READUINT(complex_no);
+    if (world->thread_pool != NULL)
+      thread_pool_run(world->thread_pool, n, serialize_storage_task, &pass);
+    else {
+      for (int i = 0; i < n; ++i)
+        serialize_storage_task(&pass, i);
+    }
 
-    /* Find this species by its external species id */
-    struct species *properties = NULL;
-    for (int species_idx = 0; species_idx < world->n_species; species_idx++) {
-      if (world->species_list[species_idx]->chkpt_species_id ==
-          external_species_id) {
-        properties = world->species_list[species_idx];
-        break;
+    for (int i = 0; i < n; ++i) {
+      if (!failure && chunks[i].status)
+        failure = 1;
+      if (!failure &&
+          (write_varintl(fs, chunks[i].n_mols) ||
+           write_varintl(fs, chunks[i].buf.size) ||
+           fwrite(chunks[i].buf.data, 1, chunks[i].buf.size, fs) !=
+               chunks[i].buf.size)) {
+        mcell_perror_nodie(errno, "Error while writing '%s' to checkpoint file",
+                           SECTNAME);
+        failure = 1;
       }
+      free(chunks[i].buf.data);
     }
-    DATACHECK(properties == NULL,
-              "Found molecule with unknown species id (%d).",
-              external_species_id);
-
-    /* Create and add molecule to scheduler */
-    struct periodic_image periodic_box = { .x = 0,
-                                           .y = 0,
-                                           .z = 0
-                                         };
-    if ((properties->flags & NOT_FREE) == 0) { /* 3D molecule */
-
-      /* set molecule characteristics */
-      amp->t = sched_time;
-      amp->t2 = lifetime;
-      amp->birthday = birthday;
-      amp->properties = properties;
-      initialize_diffusion_function(amp);
-      if(amp->properties->flags & EXTERNAL_SPECIES)
-        properties_nfsim(world, amp);
-      vmp->previous_wall = NULL;
-      vmp->index = -1;
-      vmp->pos.x = x_coord;
-      vmp->pos.y = y_coord;
-      vmp->pos.z = z_coord;
-      amp->periodic_box = &periodic_box;
-
-      /* Set molecule flags */
-      amp->flags = TYPE_VOL | IN_VOLUME;
-      if (act_newbie_flag == HAS_ACT_NEWBIE)
-        amp->flags |= ACT_NEWBIE;
-
-      if (act_change_flag == HAS_ACT_CHANGE)
-        amp->flags |= ACT_CHANGE;
-
-      amp->flags |= IN_SCHEDULE;
-      if ((amp->properties->flags & CAN_SURFWALL) != 0 ||
-          trigger_unimolecular(world->reaction_hash, world->rx_hashsize,
-                               amp->properties->hashval, amp) != NULL)
-        amp->flags |= ACT_REACT;
-      if (amp->get_space_step(amp) > 0.0)
-        amp->flags |= ACT_DIFFUSE;
-
-      /* Insert copy of vm into world */
-      guess = insert_volume_molecule(world, vmp, guess);
-      if (guess == NULL) {
-        mcell_error("Cannot insert copy of molecule of species '%s' into "
-                    "world.\nThis may be caused by a shortage of memory.",
-                    vmp->properties->sym->name);
-      }
+  }
 
-    } else { /* surface_molecule */
-      struct vector3 where;
+  free(chunks);
+  return failure;
+}
 
-      where.x = x_coord;
-      where.y = y_coord;
-      where.z = z_coord;
+/***************************************************************************
+ compare_base_entries:
+    qsort/bsearch comparison of base entries by molecule id.
+***************************************************************************/
+static int compare_base_entries(void const *a, void const *b) {
+  u_long ia = ((struct chkpt_base_entry const *)a)->id;
+  u_long ib = ((struct chkpt_base_entry const *)b)->id;
+  return (ia < ib) ? -1 : (ia > ib);
+}
 
+/***************************************************************************
+ set_base_entry:
+ In:  entry - entry to fill in
+      amp - a molecule to be checkpointed
+      where, orient - its location, from chkpt_molecule_location
+ Out: None
+***************************************************************************/
+static void set_base_entry(struct chkpt_base_entry *entry,
+                           struct abstract_molecule *amp,
+                           struct vector3 where, short orient) {
+  entry->id = amp->id;
+  entry->properties = amp->properties;
+  entry->where = where;
+  entry->birthday = amp->birthday;
+  entry->orient = orient;
+  entry->act_newbie_flag =
+      (amp->flags & ACT_NEWBIE) ? HAS_ACT_NEWBIE : HAS_NOT_ACT_NEWBIE;
+}
 
-      struct surface_molecule *smp = insert_surface_molecule(
-          world, properties, &where, orient, CHKPT_GRID_TOLERANCE, sched_time,
-          NULL, NULL, NULL, &periodic_box);
+/***************************************************************************
+ prepare_chkpt_base:
+ In:  world - the simulation state
+      filename - the name of the checkpoint file about to be written
+ Out: For differential checkpoints, decides whether this checkpoint writes
+      a new base checkpoint.  If it does, the molecules as they will be
+      saved in it are recorded, in file order, for comparison by later
+      differential checkpoints.  Runs in the simulating process even when
+      the checkpoint itself is written in the background.
+***************************************************************************/
+static void prepare_chkpt_base(struct volume *world, char const *filename) {
+  if (world->chkpt_differential <= 0)
+    return;
+
+  struct chkpt_base *base = world->chkpt_base;
+  if (base == NULL) {
+    base = CHECKED_MALLOC_STRUCT(struct chkpt_base, "checkpoint base");
+    memset(base, 0, sizeof(struct chkpt_base));
+    world->chkpt_base = base;
+  }
 
-      if (smp == NULL) {
-        mcell_warn("Could not place molecule %s at (%f,%f,%f).",
-                   properties->sym->name, where.x * world->length_unit,
-                   where.y * world->length_unit,
-                   where.z * world->length_unit);
-        continue;
-      }
+  free(base->stale_filename);
+  base->stale_filename = NULL;
+  if (base->filename != NULL && base->n_deltas < world->chkpt_differential) {
+    base->write_base = 0;
+    ++base->n_deltas;
+    return;
+  }
 
-      smp->t2 = lifetime;
-      smp->birthday = birthday;
-      if (act_newbie_flag == HAS_NOT_ACT_NEWBIE)
-        smp->flags &= ~ACT_NEWBIE;
+  /* Start a new base; the old one goes once the new one is in place, unless
+   * the checkpoints referring to it are being kept */
+  if (world->keep_chkpts)
+    free(base->filename);
+  else
+    base->stale_filename = base->filename;
+  base->filename =
+      CHECKED_SPRINTF("%s.base.%lld", filename, world->current_iterations);
+  base->iteration = world->current_iterations;
+  base->write_base = 1;
+  base->n_deltas = 0;
+
+  unsigned long long n_entries = 0;
+  for (int pass = 0; pass < 2; ++pass) {
+    if (pass == 1) {
+      free(base->entries);
+      base->entries = CHECKED_MALLOC_ARRAY(struct chkpt_base_entry,
+                                           n_entries ? n_entries : 1,
+                                           "checkpoint base molecules");
+      base->n_entries = n_entries;
+      n_entries = 0;
+    }
 
-      if (act_change_flag == HAS_ACT_CHANGE) {
-        smp->flags |= ACT_CHANGE;
+    for (struct storage_list *slp = world->storage_head; slp != NULL;
+         slp = slp->next) {
+      for (struct schedule_helper *shp = slp->store->timer; shp != NULL;
+           shp = shp->next_scale) {
+        for (int i = -1; i < shp->buf_len; i++) {
+          for (struct abstract_element *aep = (i < 0) ? shp->current
+                                                      : shp->circ_buf_head[i];
+               aep != NULL; aep = aep->next) {
+            struct abstract_molecule *amp = (struct abstract_molecule *)aep;
+            struct vector3 where;
+            short orient = 0;
+            if (chkpt_molecule_location(amp, &where, &orient))
+              continue;
+
+            if (pass == 1) {
+              struct chkpt_base_entry *entry = &base->entries[n_entries];
+              set_base_entry(entry, amp, where, orient);
+              entry->index = n_entries;
+            }
+            ++n_entries;
+          }
+        }
       }
     }
   }
 
+  qsort(base->entries, base->n_entries, sizeof(struct chkpt_base_entry),
+        compare_base_entries);
+}
+
+struct chkpt_delta_run {
+  int kind; /* CHKPT_DELTA_COPY, CHKPT_DELTA_LITERAL or -1 for none */
+  unsigned long long start; /* first base molecule of a copy */
+  unsigned long long length;
+  struct chkpt_buffer literals;
+};
+
+/***************************************************************************
+ flush_delta_run:
+ In:  buf - the delta being built
+      run - the run to add to it
+      n_runs - counts the runs added
+ Out: The run is appended to the delta, as its length and kind followed by
+      the first base molecule of a copy or the molecules of a literal.
+      Returns 1 if memory runs out, 0 on success.
+***************************************************************************/
+static int flush_delta_run(struct chkpt_buffer *buf,
+                           struct chkpt_delta_run *run,
+                           unsigned long long *n_runs) {
+  if (run->kind < 0)
+    return 0;
+
+  BUFFERUINT((run->length << 1) | (unsigned long long)run->kind);
+  if (run->kind == CHKPT_DELTA_COPY)
+    BUFFERUINT(run->start);
+  else
+    INTERNALCHECK(
+        buffer_append(buf, run->literals.data, run->literals.size),
+        "Out of memory writing checkpoint chunk.");
+
+  ++*n_runs;
+  run->kind = -1;
+  run->length = 0;
+  run->literals.size = 0;
   return 0;
 }
+
+/***************************************************************************
+ write_mol_scheduler_delta:
+ In:  fs - checkpoint file to write to.
+ Out: Writes the molecule scheduler state relative to the base checkpoint.
+      Returns 1 on error, and 0 - on success.
+ Note: The section names the base file and the iteration it was written
+       at, followed by the runs that rebuild the full molecule sequence
+       from it: unchanged molecules, matched to the base by their id, are
+       copied from the base and all others are stored as in a full
+       checkpoint.  Molecules that are no longer present are left out.
+***************************************************************************/
+static int write_mol_scheduler_delta(FILE *fs, struct volume *world) {
+  static const char SECTNAME[] = "molecule scheduler delta";
+  static const byte cmd = MOL_SCHEDULER_DELTA_CMD;
+  struct chkpt_base *base = world->chkpt_base;
+
+  WRITEFIELD(cmd);
+  WRITESTRING(base->filename);
+  WRITEFIELD(base->iteration);
+
+  struct chkpt_write_pass pass;
+  pass.chunks = NULL;
+  pass.simulation_start_seconds = world->simulation_start_seconds;
+  pass.start_iterations = world->start_iterations;
+  pass.time_unit = world->time_unit;
+
+  struct chkpt_buffer runs = { NULL, 0, 0 };
+  struct chkpt_delta_run run;
+  memset(&run, 0, sizeof(struct chkpt_delta_run));
+  run.kind = -1;
+  unsigned long long n_runs = 0;
+
+  int failure = 0;
+  for (struct storage_list *slp = world->storage_head;
+       slp != NULL && !failure; slp = slp->next) {
+    for (struct schedule_helper *shp = slp->store->timer;
+         shp != NULL && !failure; shp = shp->next_scale) {
+      for (int i = -1; i < shp->buf_len && !failure; i++) {
+        for (struct abstract_element *aep = (i < 0) ? shp->current
+                                                    : shp->circ_buf_head[i];
+             aep != NULL && !failure; aep = aep->next) {
+          struct abstract_molecule *amp = (struct abstract_molecule *)aep;
+          struct vector3 where;
+          short orient = 0;
+          if (chkpt_molecule_location(amp, &where, &orient))
+            continue;
+
+          /* Is the molecule in the base, and unchanged since? */
+          struct chkpt_base_entry now;
+          set_base_entry(&now, amp, where, orient);
+          struct chkpt_base_entry const *then =
+              (struct chkpt_base_entry const *)bsearch(
+                  &now, base->entries, base->n_entries,
+                  sizeof(struct chkpt_base_entry), compare_base_entries);
+
+          if (then != NULL &&
+              (then->properties != now.properties ||
+               then->where.x != now.where.x || then->where.y != now.where.y ||
+               then->where.z != now.where.z ||
+               then->birthday != now.birthday ||
+               then->orient != now.orient ||
+               then->act_newbie_flag != now.act_newbie_flag))
+            then = NULL;
+
+          if (then != NULL) {
+            if (run.kind != CHKPT_DELTA_COPY ||
+                then->index != run.start + run.length) {
+              failure = flush_delta_run(&runs, &run, &n_runs);
+              run.kind = CHKPT_DELTA_COPY;
+              run.start = then->index;
+            }
+          } else {
+            if (run.kind != CHKPT_DELTA_LITERAL) {
+              failure = flush_delta_run(&runs, &run, &n_runs);
+              run.kind = CHKPT_DELTA_LITERAL;
+            }
+            failure = failure || buffer_chkpt_molecule(&run.literals, &pass,
+                                                       amp, where, orient);
+          }
+          ++run.length;
+        }
+      }
+    }
+  }
+  failure = failure || flush_delta_run(&runs, &run, &n_runs);
+
+  if (!failure &&
+      (write_varintl(fs, n_runs) ||
+       fwrite(runs.data, 1, runs.size, fs) != runs.size)) {
+    mcell_perror_nodie(errno, "Error while writing '%s' to checkpoint file",
+                       SECTNAME);
+    failure = 1;
+  }
+
+  free(runs.data);
+  free(run.literals.data);
+  return failure;
+}
+
+/***************************************************************************
+ write_mol_scheduler_fixed:
+ In:  fs - checkpoint file to write to.
+ Out: Writes the molecule scheduler state as fixed-width records.
+      Returns 1 on error, and 0 - on success.
+ Note: The section holds a pad length byte and padding up to an 8 byte
+       boundary, the number of molecules and the record size as uint64,
+       then one CHKPT_FIXED_RECORD_SIZE record per molecule with the fields
+       at the CHKPT_FIXED_* offsets.  Times are converted as in the varint
+       molecule scheduler state.
+***************************************************************************/
+static int write_mol_scheduler_fixed(FILE *fs, struct volume *world) {
+  static const char SECTNAME[] = "molecule scheduler state";
+  static const byte cmd = MOL_SCHEDULER_FIXED_CMD;
+
+  WRITEFIELD(cmd);
+
+  long pos = ftell(fs);
+  WRITECHECK(pos < 0, SECTNAME);
+  byte pad_length = (byte)((CHKPT_FIXED_ALIGN -
+                            (pos + 1) % CHKPT_FIXED_ALIGN) % CHKPT_FIXED_ALIGN);
+  static const byte PAD[CHKPT_FIXED_ALIGN] = { 0 };
+  WRITEFIELD(pad_length);
+  WRITECHECK(fwrite(PAD, 1, pad_length, fs) != pad_length, SECTNAME);
+
+  uint64_t n_mols = 0;
+  struct vector3 where;
+  short orient;
+  for (struct storage_list *slp = world->storage_head; slp != NULL;
+       slp = slp->next) {
+    for (struct schedule_helper *shp = slp->store->timer; shp != NULL;
+         shp = shp->next_scale) {
+      for (int i = -1; i < shp->buf_len; i++) {
+        for (struct abstract_element *aep = (i < 0) ? shp->current
+                                                    : shp->circ_buf_head[i];
+             aep != NULL; aep = aep->next) {
+          if (!chkpt_molecule_location((struct abstract_molecule *)aep,
+                                       &where, &orient))
+            ++n_mols;
+        }
+      }
+    }
+  }
+  uint64_t record_size = CHKPT_FIXED_RECORD_SIZE;
+  WRITEFIELD(n_mols);
+  WRITEFIELD(record_size);
+
+  unsigned char *block = CHECKED_MALLOC_ARRAY(
+      unsigned char, CHKPT_FIXED_BLOCK * CHKPT_FIXED_RECORD_SIZE,
+      "checkpoint molecule records");
+  int n_block = 0;
+  int failure = 0;
+  for (struct storage_list *slp = world->storage_head;
+       slp != NULL && !failure; slp = slp->next) {
+    for (struct schedule_helper *shp = slp->store->timer;
+         shp != NULL && !failure; shp = shp->next_scale) {
+      for (int i = -1; i < shp->buf_len && !failure; i++) {
+        for (struct abstract_element *aep = (i < 0) ? shp->current
+                                                    : shp->circ_buf_head[i];
+             aep != NULL && !failure; aep = aep->next) {
+          struct abstract_molecule *amp = (struct abstract_molecule *)aep;
+          if (chkpt_molecule_location(amp, &where, &orient))
+            continue;
+
+          if ((amp->properties->flags & NOT_FREE) == 0) {
+            struct volume_molecule *vmp = (struct volume_molecule *)amp;
+            if (vmp->previous_wall != NULL && vmp->index >= 0) {
+              mcell_warn("%s internal: The value of 'previous_grid' is not "
+                         "NULL.", __func__);
+              failure = 1;
+              break;
+            }
+          }
+          if (amp->properties->chkpt_species_id == UINT_MAX) {
+            mcell_warn("%s internal: Attempted to write out a molecule of "
+                       "species '%s', which has not been assigned a "
+                       "checkpoint species id.",
+                       __func__, amp->properties->sym->name);
+            failure = 1;
+            break;
+          }
+
+          /* See buffer_chkpt_molecule for the conversion of the times */
+          unsigned char *rec = block + n_block * CHKPT_FIXED_RECORD_SIZE;
+          double t = convert_iterations_to_seconds(
+              world->start_iterations, world->time_unit,
+              world->simulation_start_seconds, amp->t);
+          double t2 = amp->t2 * world->time_unit;
+          double bday = amp->birthday;
+          uint32_t species_id = amp->properties->chkpt_species_id;
+          int16_t orient16 = orient;
+          byte act_newbie_flag =
+              (amp->flags & ACT_NEWBIE) ? HAS_ACT_NEWBIE : HAS_NOT_ACT_NEWBIE;
+          byte act_change_flag =
+              ((amp->flags & ACT_CHANGE) || lifetime_is_stale(amp))
+                  ? HAS_ACT_CHANGE : HAS_NOT_ACT_CHANGE;
+          memcpy(rec + CHKPT_FIXED_SCHED_TIME, &t, sizeof(double));
+          memcpy(rec + CHKPT_FIXED_LIFETIME, &t2, sizeof(double));
+          memcpy(rec + CHKPT_FIXED_BIRTHDAY, &bday, sizeof(double));
+          memcpy(rec + CHKPT_FIXED_WHERE, &where.x, sizeof(double));
+          memcpy(rec + CHKPT_FIXED_WHERE + 8, &where.y, sizeof(double));
+          memcpy(rec + CHKPT_FIXED_WHERE + 16, &where.z, sizeof(double));
+          memcpy(rec + CHKPT_FIXED_SPECIES, &species_id, sizeof(uint32_t));
+          memcpy(rec + CHKPT_FIXED_ORIENT, &orient16, sizeof(int16_t));
+          rec[CHKPT_FIXED_NEWBIE] = act_newbie_flag;
+          rec[CHKPT_FIXED_CHANGE] = act_change_flag;
+
+          if (++n_block == CHKPT_FIXED_BLOCK) {
+            failure = fwrite(block, CHKPT_FIXED_RECORD_SIZE, n_block, fs) !=
+                      (size_t)n_block;
+            n_block = 0;
+          }
+        }
+      }
+    }
+  }
+  if (!failure && n_block > 0)
+    failure = fwrite(block, CHKPT_FIXED_RECORD_SIZE, n_block, fs) !=
+              (size_t)n_block;
+  free(block);
+
+  WRITECHECK(failure, SECTNAME);
+  return 0;
+}
+
+/***************************************************************************
+ write_periodic_images:
+ In:  fs - checkpoint file to write to.
+ Out: Writes the periodic box of every molecule, in the order of the
+      molecule scheduler state, to the checkpoint file.
+      Returns 1 on error, and 0 - on success.
+ Note: The section holds the distinct boxes, followed by runs of
+       consecutive molecules in the same box as the box's index in that
+       list and the number of molecules.
+***************************************************************************/
+static int write_periodic_images(FILE *fs, struct volume *world) {
+  static const char SECTNAME[] = "periodic images";
+  static const byte cmd = PERIODIC_IMAGES_CMD;
+
+  /* Distinct boxes, found through an open-addressing table of indices */
+  unsigned int n_boxes = 0, boxes_capacity = 16;
+  struct periodic_image *boxes = CHECKED_MALLOC_ARRAY(
+      struct periodic_image, boxes_capacity, "checkpoint periodic boxes");
+  unsigned int table_size = 2 * boxes_capacity;
+  unsigned int *table = CHECKED_MALLOC_ARRAY(unsigned int, table_size,
+                                             "checkpoint periodic boxes");
+  memset(table, 0xff, table_size * sizeof(unsigned int));
+
+  struct chkpt_buffer runs = { NULL, 0, 0 };
+  struct chkpt_buffer *buf = &runs;
+  unsigned long long n_runs = 0, run_length = 0;
+  unsigned int run_box = 0;
+  int failure = 0;
+
+  for (struct storage_list *slp = world->storage_head;
+       slp != NULL && !failure; slp = slp->next) {
+    for (struct schedule_helper *shp = slp->store->timer;
+         shp != NULL && !failure; shp = shp->next_scale) {
+      for (int i = -1; i < shp->buf_len && !failure; i++) {
+        for (struct abstract_element *aep = (i < 0) ? shp->current
+                                                    : shp->circ_buf_head[i];
+             aep != NULL && !failure; aep = aep->next) {
+          struct abstract_molecule *amp = (struct abstract_molecule *)aep;
+          struct vector3 where;
+          short orient;
+          if (chkpt_molecule_location(amp, &where, &orient))
+            continue;
+
+          struct periodic_image box = amp->periodic_box;
+
+          /* Look the box up, adding it if it is new */
+          uint64_t key = ((uint64_t)(uint16_t)box.x << 32) |
+                         ((uint64_t)(uint16_t)box.y << 16) |
+                         (uint64_t)(uint16_t)box.z;
+          unsigned int slot =
+              (unsigned int)((key * 0x9E3779B97F4A7C15ULL) >> 40) &
+              (table_size - 1);
+          while (table[slot] != UINT_MAX &&
+                 (boxes[table[slot]].x != box.x ||
+                  boxes[table[slot]].y != box.y ||
+                  boxes[table[slot]].z != box.z))
+            slot = (slot + 1) & (table_size - 1);
+          if (table[slot] == UINT_MAX) {
+            if (n_boxes == boxes_capacity) {
+              boxes_capacity *= 2;
+              struct periodic_image *grown = (struct periodic_image *)realloc(
+                  boxes, boxes_capacity * sizeof(struct periodic_image));
+              unsigned int *grown_table = (unsigned int *)malloc(
+                  2 * boxes_capacity * sizeof(unsigned int));
+              if (grown == NULL || grown_table == NULL) {
+                mcell_allocfailed("Failed to allocate checkpoint periodic "
+                                  "boxes.");
+              }
+              boxes = grown;
+              free(table);
+              table = grown_table;
+              table_size = 2 * boxes_capacity;
+              memset(table, 0xff, table_size * sizeof(unsigned int));
+              for (unsigned int b = 0; b < n_boxes; ++b) {
+                uint64_t k = ((uint64_t)(uint16_t)boxes[b].x << 32) |
+                             ((uint64_t)(uint16_t)boxes[b].y << 16) |
+                             (uint64_t)(uint16_t)boxes[b].z;
+                unsigned int s2 =
+                    (unsigned int)((k * 0x9E3779B97F4A7C15ULL) >> 40) &
+                    (table_size - 1);
+                while (table[s2] != UINT_MAX)
+                  s2 = (s2 + 1) & (table_size - 1);
+                table[s2] = b;
+              }
+              slot = (unsigned int)((key * 0x9E3779B97F4A7C15ULL) >> 40) &
+                     (table_size - 1);
+              while (table[slot] != UINT_MAX)
+                slot = (slot + 1) & (table_size - 1);
+            }
+            boxes[n_boxes] = box;
+            table[slot] = n_boxes++;
+          }
+
+          unsigned int box_index = table[slot];
+          if (run_length > 0 && box_index != run_box) {
+            if (buffer_append_varintl(buf, run_box) ||
+                buffer_append_varintl(buf, run_length))
+              failure = 1;
+            ++n_runs;
+            run_length = 0;
+          }
+          run_box = box_index;
+          ++run_length;
+        }
+      }
+    }
+  }
+  if (!failure && run_length > 0) {
+    if (buffer_append_varintl(buf, run_box) ||
+        buffer_append_varintl(buf, run_length))
+      failure = 1;
+    ++n_runs;
+  }
+  free(table);
+
+  if (failure) {
+    mcell_warn("%s internal: Out of memory writing checkpoint periodic "
+               "images.", __func__);
+  } else if (fwrite(&cmd, sizeof(cmd), 1, fs) != 1 ||
+             write_varint(fs, n_boxes)) {
+    failure = 1;
+  } else {
+    for (unsigned int b = 0; b < n_boxes && !failure; ++b)
+      failure = write_svarint(fs, boxes[b].x) ||
+                write_svarint(fs, boxes[b].y) ||
+                write_svarint(fs, boxes[b].z);
+    failure = failure || write_varintl(fs, n_runs) ||
+              fwrite(runs.data, 1, runs.size, fs) != runs.size;
+  }
+  if (failure)
+    mcell_perror_nodie(errno, "Error while writing '%s' to checkpoint file",
+                       SECTNAME);
+
+  free(boxes);
+  free(runs.data);
+  return failure;
+}
+
+/* One molecule of the molecule scheduler state, as read from a checkpoint */
+struct chkpt_molecule {
+  struct species *properties;
+  byte act_newbie_flag;
+  byte act_change_flag;
+  double sched_time;
+  double lifetime;
+  double birthday;
+  struct vector3 where;
+  int orient;
+};
+
+/***************************************************************************
+ build_chkpt_species_table:
+ In:  world - the simulation state, with checkpoint species ids assigned
+      n_ids - receives the length of the table
+ Out: Returns an array mapping each checkpoint species id to its species,
+      or NULL if there are no species.
+***************************************************************************/
+static struct species **build_chkpt_species_table(struct volume *world,
+                                                  unsigned int *n_ids) {
+  unsigned int max_id = 0;
+  int found = 0;
+  for (int i = 0; i < world->n_species; i++) {
+    unsigned int id = world->species_list[i]->chkpt_species_id;
+    if (id == UINT_MAX)
+      continue;
+    if (!found || id > max_id)
+      max_id = id;
+    found = 1;
+  }
+
+  *n_ids = found ? max_id + 1 : 0;
+  if (!found)
+    return NULL;
+
+  struct species **table = CHECKED_MALLOC_ARRAY(struct species *, *n_ids,
+                                                "checkpoint species table");
+  memset(table, 0, *n_ids * sizeof(struct species *));
+  /* Keep the first species with each id, as the linear search used to */
+  for (int i = world->n_species - 1; i >= 0; i--) {
+    unsigned int id = world->species_list[i]->chkpt_species_id;
+    if (id != UINT_MAX)
+      table[id] = world->species_list[i];
+  }
+  return table;
+}
+
+/***************************************************************************
+ insert_chkpt_molecule:
+ In:  world - the simulation state
+      rec - molecule read from the checkpoint
+      periodic_box - the periodic box the molecule is in
+      vm - template volume molecule, reused between calls
+      guess - the last inserted volume molecule, updated on return
+      batch - volume molecules waiting to be scheduled
+ Out: The molecule is placed into the world and scheduled, volume molecules
+      through the batch.  Volume molecules that cannot be inserted are
+      fatal; surface molecules that cannot be placed are skipped with a
+      warning.
+***************************************************************************/
+static void insert_chkpt_molecule(struct volume *world,
+                                  struct chkpt_molecule const *rec,
+                                  struct periodic_image *periodic_box,
+                                  struct volume_molecule *vm,
+                                  struct volume_molecule **guess,
+                                  struct release_batch *batch) {
+  struct volume_molecule *vmp = vm;
+  struct abstract_molecule *amp = (struct abstract_molecule *)vmp;
+  struct species *properties = rec->properties;
+
+  /* Create and add molecule to scheduler */
+  if ((properties->flags & NOT_FREE) == 0) { /* 3D molecule */
+
+    /* set molecule characteristics */
+    amp->t = rec->sched_time;
+    amp->t2 = rec->lifetime;
+    amp->birthday = rec->birthday;
+    amp->properties = properties;
+    if(amp->properties->flags & EXTERNAL_SPECIES)
+      properties_nfsim(world, amp);
+    vmp->previous_wall = NULL;
+    vmp->index = -1;
+    vmp->pos.x = rec->where.x;
+    vmp->pos.y = rec->where.y;
+    vmp->pos.z = rec->where.z;
+    amp->periodic_box = *periodic_box;
+
+    /* Set molecule flags */
+    amp->flags = TYPE_VOL | IN_VOLUME;
+    if (rec->act_newbie_flag == HAS_ACT_NEWBIE)
+      amp->flags |= ACT_NEWBIE;
+
+    if (rec->act_change_flag == HAS_ACT_CHANGE)
+      amp->flags |= ACT_CHANGE;
+
+    amp->flags |= IN_SCHEDULE;
+    amp->lifetime_epoch = amp->properties->lifetime_epoch;
+    if ((amp->properties->flags & CAN_SURFWALL) != 0 ||
+        trigger_unimolecular(world->reaction_hash, world->rx_hashsize,
+                             amp->properties->hashval, amp) != NULL)
+      amp->flags |= ACT_REACT;
+    if (get_space_step(amp) > 0.0)
+      amp->flags |= ACT_DIFFUSE;
+
+    /* Insert copy of vm into world */
+    *guess = release_volume_molecule(world, vmp, *guess, batch);
+    if (*guess == NULL) {
+      mcell_error("Cannot insert copy of molecule of species '%s' into "
+                  "world.\nThis may be caused by a shortage of memory.",
+                  vmp->properties->sym->name);
+    }
+
+  } else { /* surface_molecule */
+    struct vector3 where = rec->where;
+
+    /* Keep the scheduling order the same as inserting one at a time */
+    flush_release_batch(batch);
+
+    struct surface_molecule *smp = insert_surface_molecule(
+        world, properties, &where, rec->orient, CHKPT_GRID_TOLERANCE,
+        rec->sched_time, NULL, NULL, NULL, periodic_box);
+
+    if (smp == NULL) {
+      mcell_warn("Could not place molecule %s at (%f,%f,%f).",
+                 properties->sym->name, where.x * world->length_unit,
+                 where.y * world->length_unit,
+                 where.z * world->length_unit);
+      return;
+    }
+
+    smp->t2 = rec->lifetime;
+    smp->birthday = rec->birthday;
+    if (rec->act_newbie_flag == HAS_NOT_ACT_NEWBIE)
+      smp->flags &= ~ACT_NEWBIE;
+
+    if (rec->act_change_flag == HAS_ACT_CHANGE) {
+      smp->flags |= ACT_CHANGE;
+    }
+  }
+}
+
+/***************************************************************************
+ adjust_chkpt_molecule:
+ In:  world - the simulation state
+      rec - molecule read from the checkpoint
+      api_version - API version of the checkpoint
+ Out: starting with API version 1, convert the sched_time, lifetime and
+      birthday into scaled time based on the current timestep
+***************************************************************************/
+static void adjust_chkpt_molecule(struct volume *world,
+                                  struct chkpt_molecule *rec,
+                                  uint32_t api_version) {
+  if (api_version >= 1) {
+    // This will force lifetimes to be recomputed. This is necessary if
+    // unimolecular rate constants change between checkpoints.
+    rec->lifetime = 0;
+    rec->sched_time = world->start_iterations;
+    rec->act_change_flag = HAS_ACT_CHANGE;
+  }
+}
+
+/* Receives the molecules read from a checkpoint, in file order */
+struct chkpt_molecule_sink {
+  struct volume *world;
+  uint32_t api_version;
+  struct volume_molecule vm; /* template for inserting volume molecules */
+  struct volume_molecule *guess;
+  struct release_batch batch;
+  struct chkpt_periodic_images *images; /* NULL if not present */
+
+  /* If keep is set, molecules are collected here rather than inserted */
+  int keep;
+  struct chkpt_molecule *kept;
+  unsigned long long n_kept;
+  unsigned long long kept_capacity;
+};
+
+/***************************************************************************
+ init_chkpt_molecule_sink:
+ In:  sink - sink to initialize
+      world - the simulation state
+      api_version - API version of the checkpoint being read
+      keep - collect the molecules instead of inserting them
+      images - periodic boxes of the molecules inserted, or NULL
+ Out: None
+***************************************************************************/
+static void init_chkpt_molecule_sink(struct chkpt_molecule_sink *sink,
+                                     struct volume *world,
+                                     uint32_t api_version, int keep,
+                                     struct chkpt_periodic_images *images) {
+  memset(sink, 0, sizeof(struct chkpt_molecule_sink));
+  sink->world = world;
+  sink->api_version = api_version;
+  sink->keep = keep;
+  sink->images = images;
+}
+
+/***************************************************************************
+ next_periodic_image:
+ In:  images - periodic boxes of the molecules, or NULL
+      box - receives the box of the next molecule
+ Out: None.  Molecules without a recorded box are in the central box.
+***************************************************************************/
+static void next_periodic_image(struct chkpt_periodic_images *images,
+                                struct periodic_image *box) {
+  box->x = box->y = box->z = box->pad = 0;
+  if (images == NULL)
+    return;
+
+  while (images->run < images->n_runs &&
+         images->in_run == images->run_length[images->run]) {
+    ++images->run;
+    images->in_run = 0;
+  }
+  if (images->run == images->n_runs) {
+    ++images->n_missing;
+    return;
+  }
+
+  *box = images->boxes[images->run_box[images->run]];
+  ++images->in_run;
+}
+
+/***************************************************************************
+ add_chkpt_molecule:
+ In:  sink - where the molecule goes
+      rec - molecule read from the checkpoint
+ Out: The molecule is inserted into the world or collected.
+***************************************************************************/
+static void add_chkpt_molecule(struct chkpt_molecule_sink *sink,
+                               struct chkpt_molecule *rec) {
+  if (sink->keep) {
+    if (sink->n_kept == sink->kept_capacity) {
+      unsigned long long capacity =
+          sink->kept_capacity ? 2 * sink->kept_capacity : 1024;
+      struct chkpt_molecule *kept = (struct chkpt_molecule *)realloc(
+          sink->kept, capacity * sizeof(struct chkpt_molecule));
+
+      if (kept == NULL)
+        mcell_allocfailed("Failed to allocate checkpoint molecules.");
+      sink->kept = kept;
+      sink->kept_capacity = capacity;
+    }
+    sink->kept[sink->n_kept++] = *rec;
+    return;
+  }
+
+  struct periodic_image periodic_box;
+  next_periodic_image(sink->images, &periodic_box);
+  adjust_chkpt_molecule(sink->world, rec, sink->api_version);
+  insert_chkpt_molecule(sink->world, rec, &periodic_box, &sink->vm,
+                        &sink->guess, &sink->batch);
+}
+
+/***************************************************************************
+ finish_chkpt_molecule_sink:
+ In:  sink - sink that has received all of its molecules
+ Out: Any volume molecules still waiting are scheduled.
+***************************************************************************/
+static void finish_chkpt_molecule_sink(struct chkpt_molecule_sink *sink) {
+  flush_release_batch(&sink->batch);
+}
+
+/***************************************************************************
+ read_chkpt_molecule:
+ In:  fs - checkpoint file to read from.
+      species_table, n_species_ids - species by checkpoint species id
+      rec - receives the molecule
+ Out: Reads one molecule in the format of the molecule scheduler state.
+      Returns 1 on error, and 0 - on success.
+***************************************************************************/
+static int read_chkpt_molecule(FILE *fs, struct chkpt_read_state *state,
+                               struct species **species_table,
+                               unsigned int n_species_ids,
+                               struct chkpt_molecule *rec) {
+  static const char SECTNAME[] = "molecule scheduler state";
+  unsigned int external_species_id;
+
+  /* read molecule fields */
+  READUINT(external_species_id);
+  READFIELDRAW(rec->act_newbie_flag);
+  READFIELDRAW(rec->act_change_flag);
+  READFIELD(rec->sched_time);
+  READFIELD(rec->lifetime);
+  READFIELD(rec->birthday);
+  READFIELD(rec->where.x);
+  READFIELD(rec->where.y);
+  READFIELD(rec->where.z);
+  READINT(rec->orient);
+
+  unsigned int complex_no = 0;
+  READUINT(complex_no);
+
+  /* Find this species by its external species id */
+  rec->properties = (external_species_id < n_species_ids)
+                        ? species_table[external_species_id] : NULL;
+  DATACHECK(rec->properties == NULL,
+            "Found molecule with unknown species id (%d).",
+            external_species_id);
+  return 0;
+}
+
+/***************************************************************************
+ read_unchunked_mol_scheduler_state:
+ In:  fs - checkpoint file to read from.
+ Out: Reads molecule scheduler data written before API version 2, a single
+      count followed by all of the molecules, from the checkpoint file.
+      Returns 0 on success. Error message and exit on failure.
+***************************************************************************/
+static int read_unchunked_mol_scheduler_state(FILE *fs,
+                                              struct chkpt_read_state *state,
+                                              struct species **species_table,
+                                              unsigned int n_species_ids,
+                                              struct chkpt_molecule_sink *sink) {
+  static const char SECTNAME[] = "molecule scheduler state";
+
+  /* read total number of items in the scheduler. */
+  unsigned long long total_items;
+  READUINT64(total_items);
+
+  for (unsigned long long n_mol = 0; n_mol < total_items; n_mol++) {
+    struct chkpt_molecule rec;
+    if (read_chkpt_molecule(fs, state, species_table, n_species_ids, &rec))
+      return 1;
+    add_chkpt_molecule(sink, &rec);
+  }
+
+  return 0;
+}
+
+/* Read position within an in-memory checkpoint chunk */
+struct chkpt_cursor {
+  unsigned char const *pos;
+  unsigned char const *end;
+  byte byte_order_mismatch;
+};
+
+/***************************************************************************
+ decode_varintl:
+ In:  cur - chunk to read from
+      dest - receives the value, encoded as by write_varintl
+ Out: returns 1 if the chunk ends first, 0 on success.
+***************************************************************************/
+static int decode_varintl(struct chkpt_cursor *cur, unsigned long long *dest) {
+  unsigned long long accum = 0;
+  unsigned char ch;
+  do {
+    if (cur->pos == cur->end)
+      return 1;
+    ch = *cur->pos++;
+    accum <<= 7;
+    accum |= ch & 0x7f;
+  } while (ch & 0x80);
+
+  *dest = accum;
+  return 0;
+}
+
+/***************************************************************************
+ decode_field:
+ In:  cur - chunk to read from
+      dest - receives the raw field
+      size - size of the field
+      swap - byteswap the field if the byte order differs
+ Out: returns 1 if the chunk ends first, 0 on success.
+***************************************************************************/
+static int decode_field(struct chkpt_cursor *cur, void *dest, size_t size,
+                        int swap) {
+  if ((size_t)(cur->end - cur->pos) < size)
+    return 1;
+  memcpy(dest, cur->pos, size);
+  cur->pos += size;
+  if (swap && cur->byte_order_mismatch)
+    byte_swap(dest, (int)size);
+  return 0;
+}
+
+/* One storage's share of the molecule scheduler state, as read */
+struct chkpt_read_chunk {
+  unsigned char *data;
+  size_t n_bytes;
+  unsigned long long n_mols;
+  struct chkpt_molecule *mols;
+  unsigned int bad_species_id; /* set if status is 2 */
+  int status;                  /* 0 - ok, 1 - truncated, 2 - bad species */
+};
+
+/* Shared state for decoding chunks on the thread pool */
+struct chkpt_read_pass {
+  struct chkpt_read_chunk *chunks;
+  struct species **species_table;
+  unsigned int n_species_ids;
+  byte byte_order_mismatch;
+};
+
+/***************************************************************************
+ decode_chunk_molecules:
+ In:  pass - shared decoding parameters
+      chunk - a chunk read from the checkpoint file
+ Out: Returns 0 if the chunk's molecules were decoded into chunk->mols, 1
+      if the chunk is truncated and 2 if it names an unknown species.
+***************************************************************************/
+static int decode_chunk_molecules(struct chkpt_read_pass *pass,
+                                  struct chkpt_read_chunk *chunk) {
+  struct chkpt_cursor cur;
+  cur.pos = chunk->data;
+  cur.end = chunk->data + chunk->n_bytes;
+  cur.byte_order_mismatch = pass->byte_order_mismatch;
+
+  for (unsigned long long n_mol = 0; n_mol < chunk->n_mols; n_mol++) {
+    struct chkpt_molecule *rec = &chunk->mols[n_mol];
+    unsigned long long external_species_id, orient, complex_no;
+
+    if (decode_varintl(&cur, &external_species_id) ||
+        decode_field(&cur, &rec->act_newbie_flag, sizeof(byte), 0) ||
+        decode_field(&cur, &rec->act_change_flag, sizeof(byte), 0) ||
+        decode_field(&cur, &rec->sched_time, sizeof(double), 1) ||
+        decode_field(&cur, &rec->lifetime, sizeof(double), 1) ||
+        decode_field(&cur, &rec->birthday, sizeof(double), 1) ||
+        decode_field(&cur, &rec->where.x, sizeof(double), 1) ||
+        decode_field(&cur, &rec->where.y, sizeof(double), 1) ||
+        decode_field(&cur, &rec->where.z, sizeof(double), 1) ||
+        decode_varintl(&cur, &orient) || decode_varintl(&cur, &complex_no))
+      return 1;
+
+    /* signed values are stored as by write_svarintl */
+    rec->orient = (orient & 1) ? -(int)(orient >> 1) : (int)(orient >> 1);
+
+    rec->properties = (external_species_id < pass->n_species_ids)
+                          ? pass->species_table[external_species_id] : NULL;
+    if (rec->properties == NULL) {
+      chunk->bad_species_id = (unsigned int)external_species_id;
+      return 2;
+    }
+  }
+
+  return 0;
+}
+
+/***************************************************************************
+ decode_chunk_task:
+    Thread pool task decoding one chunk of a chunked checkpoint.
+***************************************************************************/
+static void decode_chunk_task(void *ctx, int task) {
+  struct chkpt_read_pass *pass = (struct chkpt_read_pass *)ctx;
+  pass->chunks[task].status =
+      decode_chunk_molecules(pass, &pass->chunks[task]);
+}
+
+/***************************************************************************
+ read_chunked_mol_scheduler_state:
+ In:  fs - checkpoint file to read from.
+ Out: Reads molecule scheduler data written as per-storage chunks (API
+      version 2 and later) from the checkpoint file.  Batches of chunks are
+      read into memory and decoded on the thread pool, if there is one; the
+      molecules are then passed to the sink in file order.
+      Returns 0 on success. Error message and exit on failure.
+***************************************************************************/
+static int read_chunked_mol_scheduler_state(struct volume *world, FILE *fs,
+                                            struct chkpt_read_state *state,
+                                            struct species **species_table,
+                                            unsigned int n_species_ids,
+                                            struct chkpt_molecule_sink *sink) {
+  static const char SECTNAME[] = "molecule scheduler state";
+
+  unsigned int n_chunks;
+  READUINT(n_chunks);
+
+  struct thread_pool *pool = (n_chunks > 1) ? world_thread_pool(world) : NULL;
+  int batch_size = (pool != NULL)
+                       ? world->num_threads * CHKPT_CHUNKS_PER_THREAD : 1;
+
+  struct chkpt_read_chunk *chunks = CHECKED_MALLOC_ARRAY(
+      struct chkpt_read_chunk, batch_size, "checkpoint chunks");
+  struct chkpt_read_pass pass;
+  pass.chunks = chunks;
+  pass.species_table = species_table;
+  pass.n_species_ids = n_species_ids;
+  pass.byte_order_mismatch = state->byte_order_mismatch;
+
+  int failure = 0;
+  unsigned int n_read = 0;
+  while (n_read < n_chunks && !failure) {
+    /* read the next batch of chunks */
+    int n = 0;
+    for (; n_read < n_chunks && n < batch_size && !failure; ++n_read) {
+      unsigned long long n_mols, n_bytes;
+      if (read_varintl(fs, &n_mols) || read_varintl(fs, &n_bytes)) {
+        mcell_perror_nodie(
+            errno, "Error while reading '%s' from checkpoint file", SECTNAME);
+        failure = 1;
+        break;
+      }
+      /* every molecule takes well over one byte */
+      if (n_mols > n_bytes) {
+        mcell_warn("Corrupted checkpoint data: molecule chunk %u is shorter "
+                   "than its %llu molecules.", n_read, n_mols);
+        failure = 1;
+        break;
+      }
+
+      struct chkpt_read_chunk *chunk = &chunks[n];
+      chunk->n_mols = n_mols;
+      chunk->n_bytes = n_bytes;
+      chunk->status = 0;
+      chunk->data = CHECKED_MALLOC_ARRAY_NODIE(unsigned char,
+                                               n_bytes ? n_bytes : 1,
+                                               "checkpoint chunk");
+      chunk->mols = CHECKED_MALLOC_ARRAY_NODIE(struct chkpt_molecule,
+                                               n_mols ? n_mols : 1,
+                                               "checkpoint chunk molecules");
+      ++n;
+      if (chunk->data == NULL || chunk->mols == NULL) {
+        failure = 1;
+        break;
+      }
+      if (fread(chunk->data, 1, n_bytes, fs) != n_bytes) {
+        mcell_perror_nodie(
+            errno, "Error while reading '%s' from checkpoint file", SECTNAME);
+        failure = 1;
+        break;
+      }
+    }
+
+    if (!failure) {
+      if (pool != NULL)
+        thread_pool_run(pool, n, decode_chunk_task, &pass);
+      else {
+        for (int i = 0; i < n; ++i)
+          decode_chunk_task(&pass, i);
+      }
+    }
+
+    /* hand on the molecules in the order they were written */
+    for (int i = 0; i < n; ++i) {
+      struct chkpt_read_chunk *chunk = &chunks[i];
+      if (!failure && chunk->status == 1) {
+        mcell_warn("Corrupted checkpoint data: molecule chunk is truncated.");
+        failure = 1;
+      } else if (!failure && chunk->status == 2) {
+        mcell_warn("Corrupted checkpoint data: Found molecule with unknown "
+                   "species id (%d).", chunk->bad_species_id);
+        failure = 1;
+      }
+      for (unsigned long long n_mol = 0; !failure && n_mol < chunk->n_mols;
+           ++n_mol)
+        add_chkpt_molecule(sink, &chunk->mols[n_mol]);
+      free(chunk->data);
+      free(chunk->mols);
+    }
+  }
+
+  free(chunks);
+  return failure;
+}
+
+/***************************************************************************
+ read_molecules:
+ In:  fs - checkpoint file to read from.
+      api_version - API version of the checkpoint
+      species_table, n_species_ids - species by checkpoint species id
+      sink - receives the molecules
+ Out: Reads the molecules of the molecule scheduler state section in the
+      format of the given API version.
+      Returns 1 on error, and 0 - on success.
+***************************************************************************/
+static int read_molecules(struct volume *world, FILE *fs,
+                          struct chkpt_read_state *state,
+                          uint32_t api_version,
+                          struct species **species_table,
+                          unsigned int n_species_ids,
+                          struct chkpt_molecule_sink *sink) {
+  if (api_version >= 2)
+    return read_chunked_mol_scheduler_state(world, fs, state, species_table,
+                                            n_species_ids, sink);
+  return read_unchunked_mol_scheduler_state(fs, state, species_table,
+                                            n_species_ids, sink);
+}
+
+/***************************************************************************
+ read_mol_scheduler_state_real:
+ In:  fs - checkpoint file to read from.
+ Out: Reads molecule scheduler data from the checkpoint file.
+      Returns 0 on success. Error message and exit on failure.
+***************************************************************************/
+static int read_mol_scheduler_state_real(struct volume *world, FILE *fs,
+                                         struct chkpt_read_state *state,
+                                         uint32_t api_version) {
+  unsigned int n_species_ids;
+  struct species **species_table =
+      build_chkpt_species_table(world, &n_species_ids);
+  struct chkpt_molecule_sink sink;
+  init_chkpt_molecule_sink(&sink, world, api_version, 0,
+                           state->periodic_images);
+
+  int failure = read_molecules(world, fs, state, api_version, species_table,
+                               n_species_ids, &sink);
+  finish_chkpt_molecule_sink(&sink);
+
+  free(species_table);
+  return failure;
+}
+
+/***************************************************************************
+ read_chkpt_base:
+ In:  filename - the base checkpoint to read
+      iteration - the iteration the base must have been written at
+      sink - collects the base's molecules
+ Out: Reads the molecules of a full checkpoint, skipping over the other
+      sections without changing the simulation state.
+      Returns 1 on error, and 0 - on success.
+***************************************************************************/
+static int read_chkpt_base(struct volume *world, char const *filename,
+                           long long iteration,
+                           struct chkpt_molecule_sink *sink) {
+  FILE *fs = fopen(filename, "rb");
+  if (fs == NULL) {
+    mcell_perror_nodie(errno, "Failed to open base checkpoint file '%s'",
+                       filename);
+    return 1;
+  }
+
+  struct chkpt_read_state read_state;
+  read_state.byte_order_mismatch = 0;
+  read_state.periodic_images = NULL;
+  struct chkpt_read_state *state = &read_state;
+  uint32_t api_version;
+  struct rng_state *rng =
+      CHECKED_MALLOC_STRUCT(struct rng_state, "base checkpoint RNG state");
+  struct species **species_table = NULL;
+  unsigned int n_species_ids = 0;
+
+  int failure = read_preamble(fs, state, &api_version);
+  int found = 0;
+  while (!failure && !found) {
+    byte cmd;
+    if (fread(&cmd, sizeof(cmd), 1, fs) != 1) {
+      mcell_warn("Base checkpoint file '%s' has no molecule scheduler state.",
+                 filename);
+      failure = 1;
+      break;
+    }
+
+    switch (cmd) {
+    case CURRENT_TIME_CMD: {
+      static const char SECTNAME[] = "current real time";
+      double seconds;
+      failure = fread(&seconds, sizeof(seconds), 1, fs) != 1;
+      if (failure)
+        mcell_perror_nodie(errno,
+                           "Error while reading '%s' from checkpoint file",
+                           SECTNAME);
+    } break;
+
+    case CURRENT_ITERATION_CMD: {
+      static const char SECTNAME[] = "current iteration";
+      long long base_iteration;
+      double seconds;
+      if (fread(&base_iteration, sizeof(base_iteration), 1, fs) != 1 ||
+          fread(&seconds, sizeof(seconds), 1, fs) != 1) {
+        mcell_perror_nodie(errno,
+                           "Error while reading '%s' from checkpoint file",
+                           SECTNAME);
+        failure = 1;
+        break;
+      }
+      if (state->byte_order_mismatch)
+        byte_swap(&base_iteration, sizeof(base_iteration));
+      if (base_iteration != iteration) {
+        mcell_warn("Base checkpoint file '%s' was written at iteration %lld, "
+                   "not at iteration %lld as expected.",
+                   filename, base_iteration, iteration);
+        failure = 1;
+      }
+    } break;
+
+    case CHKPT_SEQ_NUM_CMD: {
+      static const char SECTNAME[] = "checkpoint sequence number";
+      u_int seq_num;
+      failure = fread(&seq_num, sizeof(seq_num), 1, fs) != 1;
+      if (failure)
+        mcell_perror_nodie(errno,
+                           "Error while reading '%s' from checkpoint file",
+                           SECTNAME);
+    } break;
+
+    case RNG_STATE_CMD: {
+      unsigned int old_seed;
+      failure = read_varint(fs, &old_seed) ||
+                read_an_rng_state(fs, state, rng);
+    } break;
+
+    case STORAGE_RNG_STATE_CMD:
+      failure = read_storage_rng_states(world, fs, state, 0);
+      break;
+
+    case SPECIES_TABLE_CMD:
+      /* The base numbers its species independently */
+      for (int i = 0; i < world->n_species; i++)
+        world->species_list[i]->chkpt_species_id = UINT_MAX;
+      failure = read_species_table(world, fs);
+      if (!failure)
+        species_table = build_chkpt_species_table(world, &n_species_ids);
+      break;
+
+    case MOL_SCHEDULER_STATE_CMD:
+      failure = read_molecules(world, fs, state, api_version, species_table,
+                               n_species_ids, sink);
+      found = 1;
+      break;
+
+    case MOL_SCHEDULER_FIXED_CMD:
+      failure = read_fixed_molecules(fs, state, species_table, n_species_ids,
+                                     sink);
+      found = 1;
+      break;
+
+    case PERIODIC_IMAGES_CMD:
+      /* The differential checkpoint has the images of all its molecules */
+      failure = read_periodic_images(fs, state);
+      free_periodic_images(state->periodic_images);
+      state->periodic_images = NULL;
+      break;
+
+    case MOL_SCHEDULER_DELTA_CMD:
+      mcell_warn("Base checkpoint file '%s' is itself a differential "
+                 "checkpoint.", filename);
+      failure = 1;
+      break;
+
+    default:
+      mcell_warn("Corrupted checkpoint data: Unrecognized command-type in "
+                 "base checkpoint file '%s'.", filename);
+      failure = 1;
+      break;
+    }
+  }
+
+  free(species_table);
+  free(rng);
+  fclose(fs);
+  return failure;
+}
+
+/***************************************************************************
+ read_mol_scheduler_delta:
+ In:  fs - checkpoint file to read from.
+ Out: Reads a differential molecule scheduler state, rebuilding the full
+      sequence of molecules from the base checkpoint it refers to, and
+      inserts the molecules into the world.
+      Returns 0 on success. Error message and exit on failure.
+***************************************************************************/
+static int read_mol_scheduler_delta(struct volume *world, FILE *fs,
+                                    struct chkpt_read_state *state,
+                                    uint32_t api_version) {
+  static const char SECTNAME[] = "molecule scheduler delta";
+
+  unsigned int base_name_length;
+  READUINT(base_name_length);
+  DATACHECK(base_name_length >= 100000,
+            "Base checkpoint file name is longer than 100000 characters (%u).",
+            base_name_length);
+  char base_name[base_name_length + 1];
+  READSTRING(base_name, base_name_length);
+  long long base_iteration;
+  READFIELD(base_iteration);
+
+  /* Our own species table must be taken before the base replaces it */
+  unsigned int n_species_ids;
+  struct species **species_table =
+      build_chkpt_species_table(world, &n_species_ids);
+
+  struct chkpt_molecule_sink base;
+  init_chkpt_molecule_sink(&base, world, api_version, 1, NULL);
+  struct chkpt_molecule_sink sink;
+  init_chkpt_molecule_sink(&sink, world, api_version, 0,
+                           state->periodic_images);
+
+  int failure = read_chkpt_base(world, base_name, base_iteration, &base);
+
+  unsigned long long n_runs = 0;
+  if (!failure && read_varintl(fs, &n_runs)) {
+    mcell_perror_nodie(errno, "Error while reading '%s' from checkpoint file",
+                       SECTNAME);
+    failure = 1;
+  }
+
+  for (unsigned long long n_run = 0; !failure && n_run < n_runs; ++n_run) {
+    unsigned long long run, start = 0;
+    if (read_varintl(fs, &run) ||
+        ((run & 1) == CHKPT_DELTA_COPY && read_varintl(fs, &start))) {
+      mcell_perror_nodie(
+          errno, "Error while reading '%s' from checkpoint file", SECTNAME);
+      failure = 1;
+      break;
+    }
+
+    unsigned long long length = run >> 1;
+    if ((run & 1) == CHKPT_DELTA_COPY) {
+      if (start > base.n_kept || length > base.n_kept - start) {
+        mcell_warn("Corrupted checkpoint data: differential checkpoint refers "
+                   "to molecules missing from base checkpoint '%s'.",
+                   base_name);
+        failure = 1;
+        break;
+      }
+      for (unsigned long long k = 0; k < length; ++k)
+        add_chkpt_molecule(&sink, &base.kept[start + k]);
+    } else {
+      for (unsigned long long k = 0; !failure && k < length; ++k) {
+        struct chkpt_molecule rec;
+        failure =
+            read_chkpt_molecule(fs, state, species_table, n_species_ids, &rec);
+        if (!failure)
+          add_chkpt_molecule(&sink, &rec);
+      }
+    }
+  }
+
+  finish_chkpt_molecule_sink(&sink);
+
+  free(base.kept);
+  free(species_table);
+  return failure;
+}
+
+/***************************************************************************
+ decode_fixed_molecule:
+ In:  rec - a fixed-width molecule record
+      byte_order_mismatch - set if the record is in the other byte order
+      species_table, n_species_ids - species by checkpoint species id
+      mol - receives the molecule
+ Out: returns 0 on success, 1 if the record names an unknown species.
+***************************************************************************/
+static int decode_fixed_molecule(unsigned char const *rec,
+                                 byte byte_order_mismatch,
+                                 struct species **species_table,
+                                 unsigned int n_species_ids,
+                                 struct chkpt_molecule *mol) {
+  uint32_t species_id;
+  int16_t orient;
+  memcpy(&mol->sched_time, rec + CHKPT_FIXED_SCHED_TIME, sizeof(double));
+  memcpy(&mol->lifetime, rec + CHKPT_FIXED_LIFETIME, sizeof(double));
+  memcpy(&mol->birthday, rec + CHKPT_FIXED_BIRTHDAY, sizeof(double));
+  memcpy(&mol->where.x, rec + CHKPT_FIXED_WHERE, sizeof(double));
+  memcpy(&mol->where.y, rec + CHKPT_FIXED_WHERE + 8, sizeof(double));
+  memcpy(&mol->where.z, rec + CHKPT_FIXED_WHERE + 16, sizeof(double));
+  memcpy(&species_id, rec + CHKPT_FIXED_SPECIES, sizeof(uint32_t));
+  memcpy(&orient, rec + CHKPT_FIXED_ORIENT, sizeof(int16_t));
+  if (byte_order_mismatch) {
+    byte_swap(&mol->sched_time, sizeof(double));
+    byte_swap(&mol->lifetime, sizeof(double));
+    byte_swap(&mol->birthday, sizeof(double));
+    byte_swap(&mol->where.x, sizeof(double));
+    byte_swap(&mol->where.y, sizeof(double));
+    byte_swap(&mol->where.z, sizeof(double));
+    byte_swap(&species_id, sizeof(uint32_t));
+    byte_swap(&orient, sizeof(int16_t));
+  }
+  mol->orient = orient;
+  mol->act_newbie_flag = rec[CHKPT_FIXED_NEWBIE];
+  mol->act_change_flag = rec[CHKPT_FIXED_CHANGE];
+
+  mol->properties =
+      (species_id < n_species_ids) ? species_table[species_id] : NULL;
+  DATACHECK(mol->properties == NULL,
+            "Found molecule with unknown species id (%u).", species_id);
+  return 0;
+}
+
+/***************************************************************************
+ read_fixed_molecules:
+ In:  fs - checkpoint file to read from, just after the section command.
+      species_table, n_species_ids - species by checkpoint species id
+      sink - receives the molecules
+ Out: Reads the fixed-width molecule records written by
+      write_mol_scheduler_fixed.  Where possible the records are used in
+      place from a read-only mapping of the file; otherwise they are read in
+      blocks.  Returns 1 on error, and 0 - on success.
+***************************************************************************/
+static int read_fixed_molecules(FILE *fs, struct chkpt_read_state *state,
+                                struct species **species_table,
+                                unsigned int n_species_ids,
+                                struct chkpt_molecule_sink *sink) {
+  static const char SECTNAME[] = "molecule scheduler state";
+
+  byte pad_length;
+  READFIELDRAW(pad_length);
+  DATACHECK(pad_length >= CHKPT_FIXED_ALIGN,
+            "Invalid padding before fixed-width molecule records.");
+  byte pad[CHKPT_FIXED_ALIGN];
+  READCHECK(fread(pad, 1, pad_length, fs) != pad_length, SECTNAME);
+
+  uint64_t n_mols, record_size;
+  READFIELD(n_mols);
+  READFIELD(record_size);
+  DATACHECK(record_size < CHKPT_FIXED_RECORD_SIZE,
+            "Fixed-width molecule records are too short (%llu bytes).",
+            (unsigned long long)record_size);
+
+  long start = ftell(fs);
+  READCHECK(start < 0, SECTNAME);
+  DATACHECK(n_mols != 0 && record_size > (uint64_t)LONG_MAX / n_mols,
+            "Fixed-width molecule records are too large.");
+  uint64_t length = n_mols * record_size;
+
+  unsigned char const *records = NULL;
+#ifndef _WIN32
+  /* Map the records, if the file really is long enough to hold them */
+  struct stat st;
+  void *map = MAP_FAILED;
+  size_t map_length = 0;
+  long page = sysconf(_SC_PAGESIZE);
+  DATACHECK(fstat(fileno(fs), &st) == 0 &&
+                (uint64_t)st.st_size < (uint64_t)start + length,
+            "Checkpoint file is too short for its %llu molecules.",
+            (unsigned long long)n_mols);
+  if (length > 0 && page > 0) {
+    off_t map_start = start - start % page;
+    map_length = (size_t)(start - map_start) + length;
+    map = mmap(NULL, map_length, PROT_READ, MAP_PRIVATE, fileno(fs),
+               map_start);
+    if (map != MAP_FAILED) {
+#ifdef MADV_SEQUENTIAL
+      madvise(map, map_length, MADV_SEQUENTIAL);
+#endif
+      records = (unsigned char const *)map + (start - map_start);
+    }
+  }
+#endif
+
+  int failure = 0;
+  if (records != NULL) {
+    for (uint64_t n_mol = 0; n_mol < n_mols && !failure; ++n_mol) {
+      struct chkpt_molecule mol;
+      failure = decode_fixed_molecule(records + n_mol * record_size,
+                                      state->byte_order_mismatch,
+                                      species_table, n_species_ids, &mol);
+      if (!failure)
+        add_chkpt_molecule(sink, &mol);
+    }
+    if (!failure && fseek(fs, start + (long)length, SEEK_SET) != 0) {
+      mcell_perror_nodie(
+          errno, "Error while reading '%s' from checkpoint file", SECTNAME);
+      failure = 1;
+    }
+  } else {
+    unsigned char *block = CHECKED_MALLOC_ARRAY(
+        unsigned char, CHKPT_FIXED_BLOCK * record_size,
+        "checkpoint molecule records");
+    for (uint64_t n_mol = 0; n_mol < n_mols && !failure;) {
+      size_t n = (n_mols - n_mol < CHKPT_FIXED_BLOCK)
+                     ? (size_t)(n_mols - n_mol) : CHKPT_FIXED_BLOCK;
+      if (fread(block, record_size, n, fs) != n) {
+        mcell_perror_nodie(
+            errno, "Error while reading '%s' from checkpoint file", SECTNAME);
+        failure = 1;
+        break;
+      }
+      for (size_t i = 0; i < n && !failure; ++i, ++n_mol) {
+        struct chkpt_molecule mol;
+        failure = decode_fixed_molecule(block + i * record_size,
+                                        state->byte_order_mismatch,
+                                        species_table, n_species_ids, &mol);
+        if (!failure)
+          add_chkpt_molecule(sink, &mol);
+      }
+    }
+    free(block);
+  }
+
+#ifndef _WIN32
+  if (map != MAP_FAILED)
+    munmap(map, map_length);
+#endif
+  return failure;
+}
+
+/***************************************************************************
+ read_mol_scheduler_state_fixed:
+ In:  fs - checkpoint file to read from.
+ Out: Reads fixed-width molecule scheduler data from the checkpoint file.
+      Returns 0 on success. Error message and exit on failure.
+***************************************************************************/
+static int read_mol_scheduler_state_fixed(struct volume *world, FILE *fs,
+                                          struct chkpt_read_state *state,
+                                          uint32_t api_version) {
+  unsigned int n_species_ids;
+  struct species **species_table =
+      build_chkpt_species_table(world, &n_species_ids);
+  struct chkpt_molecule_sink sink;
+  init_chkpt_molecule_sink(&sink, world, api_version, 0,
+                           state->periodic_images);
+
+  int failure =
+      read_fixed_molecules(fs, state, species_table, n_species_ids, &sink);
+  finish_chkpt_molecule_sink(&sink);
+
+  free(species_table);
+  return failure;
+}
+
+/***************************************************************************
+ read_periodic_images:
+ In:  fs - checkpoint file to read from.
+ Out: Reads the periodic boxes of the molecules in the checkpoint into
+      state->periodic_images.  Returns 1 on error, and 0 - on success.
+***************************************************************************/
+static int read_periodic_images(FILE *fs, struct chkpt_read_state *state) {
+  static const char SECTNAME[] = "periodic images";
+
+  unsigned int n_boxes;
+  READUINT(n_boxes);
+  DATACHECK(n_boxes > 0x7fffffff / sizeof(struct periodic_image),
+            "Checkpoint file has too many periodic boxes (%u).", n_boxes);
+
+  struct chkpt_periodic_images *images = CHECKED_MALLOC_STRUCT(
+      struct chkpt_periodic_images, "checkpoint periodic images");
+  memset(images, 0, sizeof(struct chkpt_periodic_images));
+  state->periodic_images = images;
+  images->n_boxes = n_boxes;
+  images->boxes = CHECKED_MALLOC_ARRAY(struct periodic_image,
+                                       n_boxes ? n_boxes : 1,
+                                       "checkpoint periodic boxes");
+  for (unsigned int b = 0; b < n_boxes; ++b) {
+    int x, y, z;
+    READINT(x);
+    READINT(y);
+    READINT(z);
+    images->boxes[b].x = x;
+    images->boxes[b].y = y;
+    images->boxes[b].z = z;
+    images->boxes[b].pad = 0;
+  }
+
+  unsigned long long n_runs;
+  READUINT64(n_runs);
+  unsigned long long capacity = 0;
+  for (unsigned long long r = 0; r < n_runs; ++r) {
+    unsigned int box;
+    unsigned long long length;
+    READUINT(box);
+    READUINT64(length);
+    DATACHECK(box >= n_boxes, "Periodic image run refers to unknown box %u.",
+              box);
+
+    if (images->n_runs == capacity) {
+      capacity = capacity ? 2 * capacity : 64;
+      unsigned int *run_box = (unsigned int *)realloc(
+          images->run_box, capacity * sizeof(unsigned int));
+      if (run_box != NULL)
+        images->run_box = run_box;
+      unsigned long long *run_length = (unsigned long long *)realloc(
+          images->run_length, capacity * sizeof(unsigned long long));
+
+      if (run_length != NULL)
+        images->run_length = run_length;
+      if (run_box == NULL || run_length == NULL)
+        mcell_allocfailed("Failed to allocate checkpoint periodic images.");
+    }
+    images->run_box[images->n_runs] = box;
+    images->run_length[images->n_runs] = length;
+    ++images->n_runs;
+  }
+
+  return 0;
+}
+
+/***************************************************************************
+ free_periodic_images:
+ In:  images - periodic images read from a checkpoint, or NULL
+ Out: None
+***************************************************************************/
+static void free_periodic_images(struct chkpt_periodic_images *images) {
+  if (images == NULL)
+    return;
+  free(images->boxes);
+  free(images->run_box);
+  free(images->run_length);
+  free(images);
+}
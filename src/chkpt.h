@@ -30,6 +30,8 @@
 /* header file for chkpt.c, MCell checkpointing functions */
 
 int create_chkpt(struct volume *world, char const *filename);
+int create_chkpt_background(struct volume *world, char const *filename);
+int wait_background_chkpt(struct volume *world);
 int write_chkpt(struct volume *world, FILE *fs);
 int read_chkpt(struct volume *world, FILE *fs, bool only_time_and_iter);
 void chkpt_signal_handler(int signo);
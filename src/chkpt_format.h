@@ -0,0 +1,74 @@
+/******************************************************************************
+ *
+ * Copyright (C) 2006-2017 by
+ * The Salk Institute for Biological Studies and
+ * Pittsburgh Supercomputing Center, Carnegie Mellon University
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ *
+******************************************************************************/
+
+#pragma once
+
+/* Layout of MCell checkpoint files, shared by the simulation (chkpt.c) and
+ * the standalone reader (chkpt_reader.c).  A file is a sequence of
+ * sections, each a command byte followed by its data; integers other than
+ * fixed-size fields are stored as varints, big-endian 7 bit groups with the
+ * high bit set on all but the last group, and signed ones as the magnitude
+ * shifted left by one with the sign in the low bit. */
+
+/* MCell checkpoint API version.  Version 2 stores the molecules of each
+ * storage as a separate chunk (see write_mol_scheduler_state_real) */
+#define CHECKPOINT_API 2
+
+/* Endian-ness markers */
+#define MCELL_BIG_ENDIAN 16
+#define MCELL_LITTLE_ENDIAN 17
+
+/* Checkpoint section commands */
+#define CURRENT_TIME_CMD 1
+#define CURRENT_ITERATION_CMD 2
+#define CHKPT_SEQ_NUM_CMD 3
+#define RNG_STATE_CMD 4
+#define MCELL_VERSION_CMD 5
+#define SPECIES_TABLE_CMD 6
+#define MOL_SCHEDULER_STATE_CMD 7
+#define BYTE_ORDER_CMD 8
+#define MOL_SCHEDULER_DELTA_CMD 9
+#define CHECKPOINT_API_CMD 10
+#define MOL_SCHEDULER_FIXED_CMD 11
+#define PERIODIC_IMAGES_CMD 12
+#define STORAGE_RNG_STATE_CMD 13
+#define NUM_CHKPT_CMDS 14
+
+/* Fixed-width molecule records of the MOL_SCHEDULER_FIXED section, in the
+ * byte order of the writing machine.  The records start on an 8 byte
+ * boundary of the file so that they can be used straight from a mapping of
+ * it. */
+#define CHKPT_FIXED_ALIGN 8
+#define CHKPT_FIXED_RECORD_SIZE 56
+#define CHKPT_FIXED_SCHED_TIME 0
+#define CHKPT_FIXED_LIFETIME 8
+#define CHKPT_FIXED_BIRTHDAY 16
+#define CHKPT_FIXED_WHERE 24
+#define CHKPT_FIXED_SPECIES 48
+#define CHKPT_FIXED_ORIENT 52
+#define CHKPT_FIXED_NEWBIE 54
+#define CHKPT_FIXED_CHANGE 55
+
+/* A run of molecules in a differential checkpoint */
+#define CHKPT_DELTA_COPY 0    /* consecutive molecules of the base */
+#define CHKPT_DELTA_LITERAL 1 /* molecules stored in the delta itself */
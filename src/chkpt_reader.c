@@ -0,0 +1,1053 @@
+/******************************************************************************
+ *
+ * Copyright (C) 2006-2017 by
+ * The Salk Institute for Biological Studies and
+ * Pittsburgh Supercomputing Center, Carnegie Mellon University
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ *
+******************************************************************************/
+
+/**************************************************************************\
+** File: chkpt_reader.c
+**
+** Purpose: Reads the molecules of MCell checkpoint files without a
+**          simulation, for offline analysis.
+**
+*/
+
+#include "config.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "chkpt_format.h"
+#include "chkpt_reader.h"
+#include "logging.h"
+#include "mem_util.h"
+#include "util.h"
+
+/* Molecules per chunk of a fixed-width molecule scheduler state */
+#define CHKPT_READER_FIXED_SLICE 65536
+
+/* Buffer of a chunk iterator, and the largest varint-encoded molecule */
+#define CHKPT_READER_BUFFER 65536
+#define CHKPT_READER_MAX_RECORD 128
+
+/* Longest string the reader accepts, as in read_species_table */
+#define CHKPT_READER_MAX_STRING 100000
+
+struct chkpt_chunk_iter {
+  struct chkpt_reader const *rd;
+  struct chkpt_reader_chunk const *chunk;
+  FILE *fs;
+  unsigned long long next_mol;  /* index within the chunk */
+  unsigned long long n_unread;  /* bytes of the chunk not yet buffered */
+  unsigned char *buf;
+  size_t pos, len;              /* unread part of the buffer */
+  unsigned long long run;       /* periodic image run of the next molecule */
+};
+
+/***************************************************************************
+ read_raw:
+ In:  fs - file to read from
+      dest - receives size bytes
+ Out: returns 1 if the file ends first, 0 on success.
+***************************************************************************/
+static int read_raw(FILE *fs, void *dest, size_t size) {
+  return fread(dest, 1, size, fs) != size;
+}
+
+/***************************************************************************
+ read_swapped:
+ In:  rd - the checkpoint
+      fs - file to read from
+      dest - receives a field of size bytes
+ Out: As read_raw, but byteswaps the field if the checkpoint was written on
+      a machine of the other byte order.
+***************************************************************************/
+static int read_swapped(struct chkpt_reader const *rd, FILE *fs, void *dest,
+                        size_t size) {
+  if (read_raw(fs, dest, size))
+    return 1;
+  if (rd->byte_order_mismatch)
+    byte_swap(dest, (int)size);
+  return 0;
+}
+
+/***************************************************************************
+ read_uvarint:
+ In:  fs - file to read from
+      dest - receives the value, encoded as by write_varintl in chkpt.c
+ Out: returns 1 if the file ends first, 0 on success.
+***************************************************************************/
+static int read_uvarint(FILE *fs, unsigned long long *dest) {
+  unsigned long long accum = 0;
+  int ch;
+  do {
+    if ((ch = getc(fs)) == EOF)
+      return 1;
+    accum <<= 7;
+    accum |= ch & 0x7f;
+  } while (ch & 0x80);
+
+  *dest = accum;
+  return 0;
+}
+
+/***************************************************************************
+ read_svarint:
+ In:  fs - file to read from
+      dest - receives the value, encoded as by write_svarintl in chkpt.c
+ Out: returns 1 if the file ends first, 0 on success.
+***************************************************************************/
+static int read_svarint(FILE *fs, long long *dest) {
+  unsigned long long val;
+  if (read_uvarint(fs, &val))
+    return 1;
+  *dest = (val & 1) ? -(long long)(val >> 1) : (long long)(val >> 1);
+  return 0;
+}
+
+/***************************************************************************
+ read_string:
+ In:  fs - file to read from
+      length - length of the string, or UINT_MAX if it is stored as a
+               varint in front of it
+ Out: Returns the string, or NULL if the file ends first or the string is
+      implausibly long.
+***************************************************************************/
+static char *read_string(FILE *fs, unsigned int length) {
+  unsigned long long len = length;
+  if (length == UINT_MAX && read_uvarint(fs, &len))
+    return NULL;
+  if (len >= CHKPT_READER_MAX_STRING)
+    return NULL;
+  char *str = CHECKED_MALLOC_ARRAY_NODIE(char, len + 1, "checkpoint string");
+  if (str == NULL)
+    return NULL;
+  if (read_raw(fs, str, (size_t)len)) {
+    free(str);
+    return NULL;
+  }
+  str[len] = '\0';
+  return str;
+}
+
+/***************************************************************************
+ skip_rng_state:
+ In:  fs - file to read from, at a random number generator state
+ Out: Skips the state, whichever generator it is for.  Returns 1 on error,
+      0 on success.
+***************************************************************************/
+static int skip_rng_state(FILE *fs) {
+  unsigned long long val;
+  int type = getc(fs);
+  switch (type) {
+  case 'I': /* ISAAC64: count, aa, bb, cc, results and memory */
+    return read_uvarint(fs, &val) ||
+           fseeko(fs, (3 + 2 * 256) * sizeof(uint64_t), SEEK_CUR) != 0;
+  case 'M': /* Bob Jenkins' small PRNG */
+    return fseeko(fs, 4 * sizeof(uint32_t), SEEK_CUR) != 0;
+  case 'P': /* Philox: key, counter, count and current block */
+    for (int i = 0; i < 4; ++i) {
+      if (read_uvarint(fs, &val))
+        return 1;
+    }
+    return fseeko(fs, 4 * sizeof(uint32_t), SEEK_CUR) != 0;
+  default:
+    return 1;
+  }
+}
+
+/***************************************************************************
+ add_chunk:
+ In:  rd - the checkpoint
+      kind, offset, n_bytes, n_mols - the new chunk
+ Out: Appends a chunk following the previous ones.  Returns 1 if out of
+      memory, 0 on success.
+***************************************************************************/
+static int add_chunk(struct chkpt_reader *rd, int kind, long long offset,
+                     unsigned long long n_bytes, unsigned long long n_mols) {
+  /* capacities are powers of two */
+  if ((rd->n_chunks & (rd->n_chunks - 1)) == 0) {
+    unsigned int capacity = rd->n_chunks ? 2 * rd->n_chunks : 1;
+    struct chkpt_reader_chunk *chunks = (struct chkpt_reader_chunk *)realloc(
+        rd->chunks, capacity * sizeof(struct chkpt_reader_chunk));
+    if (chunks == NULL) {
+      mcell_allocfailed_nodie("Failed to allocate checkpoint chunks.");
+      return 1;
+    }
+    rd->chunks = chunks;
+  }
+  struct chkpt_reader_chunk *chunk = &rd->chunks[rd->n_chunks++];
+  chunk->kind = kind;
+  chunk->offset = offset;
+  chunk->n_bytes = n_bytes;
+  chunk->first_mol = rd->n_mols;
+  chunk->n_mols = n_mols;
+  rd->n_mols += n_mols;
+  return 0;
+}
+
+/***************************************************************************
+ read_reader_preamble:
+ In:  rd - the checkpoint
+      fs - file to read from, at its start
+ Out: Reads the byte order, API version and MCell version sections, which
+      come first in every checkpoint.  Returns 1 on error, 0 on success.
+***************************************************************************/
+static int read_reader_preamble(struct chkpt_reader *rd, FILE *fs) {
+#ifdef WORDS_BIGENDIAN
+  static const uint32_t byte_order_present = MCELL_BIG_ENDIAN;
+#else
+  static const uint32_t byte_order_present = MCELL_LITTLE_ENDIAN;
+#endif
+
+  unsigned char cmd;
+  uint32_t byte_order;
+  if (read_raw(fs, &cmd, 1) || cmd != BYTE_ORDER_CMD ||
+      read_raw(fs, &byte_order, sizeof(byte_order)))
+    return 1;
+  rd->byte_order_mismatch = (byte_order != byte_order_present);
+
+  if (read_raw(fs, &cmd, 1))
+    return 1;
+  rd->api_version = 0;
+  if (cmd == CHECKPOINT_API_CMD) {
+    uint32_t api_version;
+    if (read_swapped(rd, fs, &api_version, sizeof(api_version)) ||
+        read_raw(fs, &cmd, 1))
+      return 1;
+    rd->api_version = api_version;
+  }
+
+  uint32_t version_length;
+  if (cmd != MCELL_VERSION_CMD ||
+      read_swapped(rd, fs, &version_length, sizeof(version_length)) ||
+      version_length == UINT_MAX)
+    return 1;
+  rd->mcell_version = read_string(fs, version_length);
+  return rd->mcell_version == NULL;
+}
+
+/***************************************************************************
+ read_reader_species:
+ In:  rd - the checkpoint
+      fs - file to read from, just after the section command
+ Out: Reads the species table into rd->species_names.  Returns 1 on error,
+      0 on success.
+***************************************************************************/
+static int read_reader_species(struct chkpt_reader *rd, FILE *fs) {
+  unsigned long long n;
+  if (read_uvarint(fs, &n) || n >= INT_MAX)
+    return 1;
+
+  /* ids are handed out densely by write_species_table */
+  rd->species_names = CHECKED_MALLOC_ARRAY_NODIE(char *, n + 1,
+                                                 "checkpoint species");
+  if (rd->species_names == NULL)
+    return 1;
+  memset(rd->species_names, 0, (n + 1) * sizeof(char *));
+  rd->n_species = (unsigned int)n;
+
+  for (unsigned long long i = 0; i < n; ++i) {
+    unsigned long long id;
+    char *name = read_string(fs, UINT_MAX);
+    if (name == NULL || read_uvarint(fs, &id) || id >= n ||
+        rd->species_names[id] != NULL) {
+      free(name);
+      return 1;
+    }
+    rd->species_names[id] = name;
+  }
+  return 0;
+}
+
+/***************************************************************************
+ read_reader_periodic_images:
+ In:  rd - the checkpoint
+      fs - file to read from, just after the section command
+ Out: Reads the periodic boxes of the molecules.  Returns 1 on error, 0 on
+      success.
+***************************************************************************/
+static int read_reader_periodic_images(struct chkpt_reader *rd, FILE *fs) {
+  unsigned long long n_boxes;
+  if (read_uvarint(fs, &n_boxes) || n_boxes > INT_MAX / 3)
+    return 1;
+  rd->n_boxes = (unsigned int)n_boxes;
+  rd->boxes = CHECKED_MALLOC_ARRAY_NODIE(int, 3 * n_boxes + 1,
+                                         "checkpoint periodic boxes");
+  if (rd->boxes == NULL)
+    return 1;
+  for (unsigned long long i = 0; i < 3 * n_boxes; ++i) {
+    long long coord;
+    if (read_svarint(fs, &coord))
+      return 1;
+    rd->boxes[i] = (int)coord;
+  }
+
+  unsigned long long n_runs, end = 0;
+  if (read_uvarint(fs, &n_runs) || n_runs > (1ULL << 40))
+    return 1;
+  rd->run_box = CHECKED_MALLOC_ARRAY_NODIE(unsigned int, n_runs + 1,
+                                           "checkpoint periodic images");
+  rd->run_end = CHECKED_MALLOC_ARRAY_NODIE(unsigned long long, n_runs + 1,
+                                           "checkpoint periodic images");
+  if (rd->run_box == NULL || rd->run_end == NULL)
+    return 1;
+  for (rd->n_runs = 0; rd->n_runs < n_runs; ++rd->n_runs) {
+    unsigned long long box, length;
+    if (read_uvarint(fs, &box) || read_uvarint(fs, &length) ||
+        box >= n_boxes)
+      return 1;
+    end += length;
+    rd->run_box[rd->n_runs] = (unsigned int)box;
+    rd->run_end[rd->n_runs] = end;
+  }
+  return 0;
+}
+
+/***************************************************************************
+ index_chunked_molecules:
+ In:  rd - the checkpoint
+      fs - file to read from, just after the section command
+ Out: Adds a chunk for each storage's molecules, skipping over their data.
+      Before API version 2 the molecules are a single chunk, which reaches
+      to the end of the file.  Returns 1 on error, 0 on success.
+***************************************************************************/
+static int index_chunked_molecules(struct chkpt_reader *rd, FILE *fs) {
+  if (rd->api_version < 2) {
+    unsigned long long n_mols;
+    struct stat st;
+    long long offset;
+    if (read_uvarint(fs, &n_mols) || (offset = ftello(fs)) < 0 ||
+        fstat(fileno(fs), &st) != 0 || st.st_size < offset)
+      return 1;
+    return add_chunk(rd, CHKPT_CHUNK_VARINT, offset,
+                     (unsigned long long)(st.st_size - offset), n_mols);
+  }
+
+  unsigned long long n_chunks;
+  if (read_uvarint(fs, &n_chunks) || n_chunks > UINT_MAX / 2)
+    return 1;
+  for (unsigned long long i = 0; i < n_chunks; ++i) {
+    unsigned long long n_mols, n_bytes;
+    long long offset;
+    /* every molecule takes well over one byte */
+    if (read_uvarint(fs, &n_mols) || read_uvarint(fs, &n_bytes) ||
+        n_mols > n_bytes || n_bytes > LLONG_MAX ||
+        (offset = ftello(fs)) < 0 ||
+        fseeko(fs, (off_t)n_bytes, SEEK_CUR) != 0 ||
+        add_chunk(rd, CHKPT_CHUNK_VARINT, offset, n_bytes, n_mols))
+      return 1;
+  }
+  return 0;
+}
+
+/***************************************************************************
+ index_fixed_molecules:
+ In:  rd - the checkpoint
+      fs - file to read from, just after the section command
+ Out: Adds chunks of CHKPT_READER_FIXED_SLICE fixed-width records each (see
+      write_mol_scheduler_fixed in chkpt.c).  Returns 1 on error, 0 on
+      success.
+***************************************************************************/
+static int index_fixed_molecules(struct chkpt_reader *rd, FILE *fs) {
+  unsigned char pad_length, pad[CHKPT_FIXED_ALIGN];
+  uint64_t n_mols, record_size;
+  struct stat st;
+  long long offset;
+  if (read_raw(fs, &pad_length, 1) || pad_length >= CHKPT_FIXED_ALIGN ||
+      read_raw(fs, pad, pad_length) ||
+      read_swapped(rd, fs, &n_mols, sizeof(n_mols)) ||
+      read_swapped(rd, fs, &record_size, sizeof(record_size)) ||
+      record_size < CHKPT_FIXED_RECORD_SIZE ||
+      record_size > CHKPT_READER_BUFFER || (offset = ftello(fs)) < 0 ||
+      fstat(fileno(fs), &st) != 0 ||
+      (uint64_t)(st.st_size - offset) / record_size < n_mols)
+    return 1;
+
+  rd->record_size = record_size;
+  for (uint64_t first = 0; first < n_mols;
+       first += CHKPT_READER_FIXED_SLICE) {
+    uint64_t n = (n_mols - first < CHKPT_READER_FIXED_SLICE)
+                     ? n_mols - first : CHKPT_READER_FIXED_SLICE;
+    if (add_chunk(rd, CHKPT_CHUNK_FIXED,
+                  offset + (long long)(first * record_size),
+                  n * record_size, n))
+      return 1;
+  }
+  return 0;
+}
+
+/***************************************************************************
+ skip_varint_molecule:
+ In:  fs - file to read from, at a varint-encoded molecule
+ Out: Skips the molecule.  Returns 1 if the file ends first, 0 on success.
+***************************************************************************/
+static int skip_varint_molecule(FILE *fs) {
+  unsigned long long val;
+  return read_uvarint(fs, &val) ||
+         fseeko(fs, 2 + 6 * sizeof(double), SEEK_CUR) != 0 ||
+         read_uvarint(fs, &val) || read_uvarint(fs, &val);
+}
+
+/***************************************************************************
+ read_base_molecules:
+ In:  rd - a differential checkpoint
+      base - its base checkpoint
+ Out: Reads all of the base's molecules into rd->base, with their species
+      renumbered to the species ids of rd.  Returns 1 on error, 0 on
+      success.
+***************************************************************************/
+static int read_base_molecules(struct chkpt_reader *rd,
+                               struct chkpt_reader const *base) {
+  rd->base = CHECKED_MALLOC_STRUCT_NODIE(struct chkpt_molecules,
+                                         "base checkpoint molecules");
+  if (rd->base == NULL)
+    return 1;
+  if (init_chkpt_molecules(rd->base, base->n_mols)) {
+    free(rd->base);
+    rd->base = NULL;
+    return 1;
+  }
+
+  /* read every chunk into its place in the arrays */
+  struct chkpt_molecules *all = rd->base;
+  for (unsigned int i = 0; i < base->n_chunks; ++i) {
+    unsigned long long first = base->chunks[i].first_mol;
+    struct chkpt_molecules part = *all;
+    part.n_mols = 0;
+    part.max_mols = base->chunks[i].n_mols;
+    part.species += first;
+    part.positions += 3 * first;
+    part.sched_times += first;
+    part.lifetimes += first;
+    part.birthdays += first;
+    part.orients += first;
+    part.flags += first;
+    part.boxes += 3 * first;
+
+    struct chkpt_chunk_iter *it = open_chkpt_chunk(base, i);
+    int failure = (it == NULL) || read_chkpt_chunk(it, &part) ||
+                  part.n_mols != base->chunks[i].n_mols;
+    close_chkpt_chunk(it);
+    if (failure)
+      return 1;
+  }
+  all->n_mols = base->n_mols;
+
+  /* the base numbers its species independently */
+  int *species_map = CHECKED_MALLOC_ARRAY_NODIE(int, base->n_species + 1,
+                                                "base checkpoint species");
+  if (species_map == NULL)
+    return 1;
+  for (unsigned int i = 0; i < base->n_species; ++i)
+    species_map[i] = (base->species_names[i] != NULL)
+                         ? chkpt_reader_species_id(rd, base->species_names[i])
+                         : -1;
+  int failure = 0;
+  for (unsigned long long n = 0; n < all->n_mols && !failure; ++n) {
+    unsigned int id = all->species[n];
+    failure = (id >= base->n_species || species_map[id] < 0);
+    if (!failure)
+      all->species[n] = (unsigned int)species_map[id];
+  }
+  free(species_map);
+  return failure;
+}
+
+/***************************************************************************
+ open_base_checkpoint:
+ In:  rd - a differential checkpoint
+ Out: Opens the base checkpoint it refers to.  The base is looked for where
+      the simulation wrote it and, failing that, next to the differential
+      checkpoint.  Returns the base, or NULL on failure.
+***************************************************************************/
+static struct chkpt_reader *open_base_checkpoint(struct chkpt_reader *rd) {
+  FILE *fs = fopen(rd->base_filename, "rb");
+  if (fs != NULL) {
+    fclose(fs);
+    return open_chkpt_reader(rd->base_filename);
+  }
+
+  char const *slash = strrchr(rd->filename, '/');
+  char const *name = strrchr(rd->base_filename, '/');
+  name = (name != NULL) ? name + 1 : rd->base_filename;
+  if (slash == NULL)
+    return open_chkpt_reader(name);
+  char *path = CHECKED_SPRINTF_NODIE("%.*s/%s", (int)(slash - rd->filename),
+                                     rd->filename, name);
+  if (path == NULL)
+    return NULL;
+  struct chkpt_reader *base = open_chkpt_reader(path);
+  free(path);
+  return base;
+}
+
+/***************************************************************************
+ index_delta_molecules:
+ In:  rd - the checkpoint
+      fs - file to read from, just after the section command
+ Out: Reads the base checkpoint of a differential checkpoint and adds a
+      chunk for each run, skipping over the molecules stored in the
+      differential checkpoint itself.  Returns 1 on error, 0 on success.
+***************************************************************************/
+static int index_delta_molecules(struct chkpt_reader *rd, FILE *fs) {
+  rd->base_filename = read_string(fs, UINT_MAX);
+  if (rd->base_filename == NULL ||
+      read_swapped(rd, fs, &rd->base_iteration, sizeof(long long)))
+    return 1;
+
+  struct chkpt_reader *base = open_base_checkpoint(rd);
+  if (base == NULL) {
+    mcell_warn("Failed to read base checkpoint file '%s' of differential "
+               "checkpoint file '%s'.", rd->base_filename, rd->filename);
+    return 1;
+  }
+  int failure = 0;
+  if (base->iteration != rd->base_iteration || base->base_filename != NULL) {
+    mcell_warn("Base checkpoint file '%s' does not match differential "
+               "checkpoint file '%s'.", rd->base_filename, rd->filename);
+    failure = 1;
+  }
+  failure = failure || read_base_molecules(rd, base);
+  close_chkpt_reader(base);
+  if (failure)
+    return 1;
+
+  unsigned long long n_runs;
+  if (read_uvarint(fs, &n_runs))
+    return 1;
+  for (unsigned long long n_run = 0; n_run < n_runs; ++n_run) {
+    unsigned long long run, length, start = 0;
+    long long offset;
+    if (read_uvarint(fs, &run))
+      return 1;
+    length = run >> 1;
+    if ((run & 1) == CHKPT_DELTA_COPY) {
+      if (read_uvarint(fs, &start) || start > rd->base->n_mols ||
+          length > rd->base->n_mols - start ||
+          add_chunk(rd, CHKPT_CHUNK_BASE, (long long)start, 0, length))
+        return 1;
+      continue;
+    }
+
+    if ((offset = ftello(fs)) < 0)
+      return 1;
+    for (unsigned long long k = 0; k < length; ++k) {
+      if (skip_varint_molecule(fs))
+        return 1;
+    }
+    long long end = ftello(fs);
+    if (end < 0 || add_chunk(rd, CHKPT_CHUNK_VARINT, offset,
+                             (unsigned long long)(end - offset), length))
+      return 1;
+  }
+  return 0;
+}
+
+/***************************************************************************
+ read_reader_sections:
+ In:  rd - the checkpoint
+      fs - file to read from, just after the preamble
+ Out: Reads the header sections and indexes the molecules of the molecule
+      scheduler state, which is the last section.  Returns 1 on error, 0 on
+      success.
+***************************************************************************/
+static int read_reader_sections(struct chkpt_reader *rd, FILE *fs) {
+  while (1) {
+    unsigned char cmd;
+    unsigned long long val;
+    if (read_raw(fs, &cmd, 1)) {
+      mcell_warn("Checkpoint file '%s' has no molecule scheduler state.",
+                 rd->filename);
+      return 1;
+    }
+
+    int failure = 0;
+    switch (cmd) {
+    case CURRENT_TIME_CMD:
+      failure = read_swapped(rd, fs, &rd->time_seconds, sizeof(double));
+      break;
+
+    case CURRENT_ITERATION_CMD: {
+      double seconds;
+      failure = read_swapped(rd, fs, &rd->iteration, sizeof(long long)) ||
+                read_swapped(rd, fs, &seconds, sizeof(double));
+    } break;
+
+    case CHKPT_SEQ_NUM_CMD:
+      failure = read_swapped(rd, fs, &rd->seq_num, sizeof(unsigned int));
+      break;
+
+    case RNG_STATE_CMD:
+      failure = read_uvarint(fs, &val) || skip_rng_state(fs);
+      break;
+
+    case STORAGE_RNG_STATE_CMD: {
+      unsigned long long n_storages = 0;
+      failure = read_uvarint(fs, &val) || read_uvarint(fs, &n_storages);
+      for (unsigned long long i = 0; i < n_storages && !failure; ++i)
+        failure = skip_rng_state(fs);
+    } break;
+
+    case SPECIES_TABLE_CMD:
+      failure = read_reader_species(rd, fs);
+      break;
+
+    case PERIODIC_IMAGES_CMD:
+      failure = read_reader_periodic_images(rd, fs);
+      break;
+
+    case MOL_SCHEDULER_STATE_CMD:
+      return index_chunked_molecules(rd, fs);
+
+    case MOL_SCHEDULER_FIXED_CMD:
+      return index_fixed_molecules(rd, fs);
+
+    case MOL_SCHEDULER_DELTA_CMD:
+      return index_delta_molecules(rd, fs);
+
+    default:
+      mcell_warn("Corrupted checkpoint data: Unrecognized command-type in "
+                 "checkpoint file '%s'.", rd->filename);
+      return 1;
+    }
+    if (failure)
+      return 1;
+  }
+}
+
+/***************************************************************************
+ open_chkpt_reader:
+ In:  filename - the checkpoint file
+ Out: Reads the checkpoint's header sections and indexes its molecules.
+      Returns the reader, or NULL with a message on failure.
+***************************************************************************/
+struct chkpt_reader *open_chkpt_reader(char const *filename) {
+  FILE *fs = fopen(filename, "rb");
+  if (fs == NULL) {
+    mcell_perror_nodie(errno, "Failed to open checkpoint file '%s'",
+                       filename);
+    return NULL;
+  }
+
+  struct chkpt_reader *rd =
+      CHECKED_MALLOC_STRUCT_NODIE(struct chkpt_reader, "checkpoint reader");
+  if (rd == NULL) {
+    fclose(fs);
+    return NULL;
+  }
+  memset(rd, 0, sizeof(struct chkpt_reader));
+  rd->filename = CHECKED_STRDUP_NODIE(filename, "checkpoint file name");
+
+  int failure = (rd->filename == NULL);
+  if (!failure && read_reader_preamble(rd, fs)) {
+    mcell_warn("File '%s' is not an MCell checkpoint file.", filename);
+    failure = 1;
+  } else if (!failure && read_reader_sections(rd, fs)) {
+    mcell_warn("Corrupted checkpoint data in file '%s'.", filename);
+    failure = 1;
+  }
+  fclose(fs);
+  if (failure) {
+    close_chkpt_reader(rd);
+    return NULL;
+  }
+  return rd;
+}
+
+/***************************************************************************
+ close_chkpt_reader:
+ In:  rd - a checkpoint reader, or NULL
+ Out: None.  The reader is freed; its chunk iterators must be closed first.
+***************************************************************************/
+void close_chkpt_reader(struct chkpt_reader *rd) {
+  if (rd == NULL)
+    return;
+  for (unsigned int i = 0; i < rd->n_species; ++i)
+    free(rd->species_names[i]);
+  free(rd->species_names);
+  if (rd->base != NULL)
+    free_chkpt_molecules(rd->base);
+  free(rd->base);
+  free(rd->chunks);
+  free(rd->boxes);
+  free(rd->run_box);
+  free(rd->run_end);
+  free(rd->base_filename);
+  free(rd->mcell_version);
+  free(rd->filename);
+  free(rd);
+}
+
+/***************************************************************************
+ chkpt_reader_species_id:
+ In:  rd - the checkpoint
+      name - name of a species
+ Out: Returns the checkpoint species id of the species, or -1 if the
+      checkpoint has no molecules of it.
+***************************************************************************/
+int chkpt_reader_species_id(struct chkpt_reader const *rd, char const *name) {
+  for (unsigned int i = 0; i < rd->n_species; ++i) {
+    if (rd->species_names[i] != NULL && strcmp(rd->species_names[i], name) == 0)
+      return (int)i;
+  }
+  return -1;
+}
+
+/***************************************************************************
+ init_chkpt_molecules:
+ In:  mols - batch to set up
+      max_mols - its capacity
+ Out: Allocates the arrays of the batch.  Returns 1 if out of memory, 0 on
+      success.
+***************************************************************************/
+int init_chkpt_molecules(struct chkpt_molecules *mols,
+                         unsigned long long max_mols) {
+  size_t n = (max_mols > 0) ? (size_t)max_mols : 1;
+  mols->n_mols = 0;
+  mols->max_mols = max_mols;
+  mols->species = (unsigned int *)malloc(n * sizeof(unsigned int));
+  mols->positions = (double *)malloc(3 * n * sizeof(double));
+  mols->sched_times = (double *)malloc(n * sizeof(double));
+  mols->lifetimes = (double *)malloc(n * sizeof(double));
+  mols->birthdays = (double *)malloc(n * sizeof(double));
+  mols->orients = (short *)malloc(n * sizeof(short));
+  mols->flags = (unsigned char *)malloc(n * sizeof(unsigned char));
+  mols->boxes = (int *)malloc(3 * n * sizeof(int));
+
+  if (mols->species == NULL || mols->positions == NULL ||
+      mols->sched_times == NULL || mols->lifetimes == NULL ||
+      mols->birthdays == NULL || mols->orients == NULL ||
+      mols->flags == NULL || mols->boxes == NULL) {
+    free_chkpt_molecules(mols);
+    mcell_allocfailed_nodie("Failed to allocate %llu checkpoint molecules.",
+                            max_mols);
+    return 1;
+  }
+  return 0;
+}
+
+/***************************************************************************
+ free_chkpt_molecules:
+ In:  mols - batch set up by init_chkpt_molecules
+ Out: None.  The arrays of the batch are freed.
+***************************************************************************/
+void free_chkpt_molecules(struct chkpt_molecules *mols) {
+  free(mols->species);
+  free(mols->positions);
+  free(mols->sched_times);
+  free(mols->lifetimes);
+  free(mols->birthdays);
+  free(mols->orients);
+  free(mols->flags);
+  free(mols->boxes);
+  memset(mols, 0, sizeof(struct chkpt_molecules));
+}
+
+/***************************************************************************
+ open_chkpt_chunk:
+ In:  rd - the checkpoint
+      chunk - index of one of its chunks
+ Out: Returns an iterator over the molecules of the chunk, or NULL on
+      failure.  Iterators have their own file handles and don't change the
+      reader, so that chunks can be read concurrently.
+***************************************************************************/
+struct chkpt_chunk_iter *open_chkpt_chunk(struct chkpt_reader const *rd,
+                                          unsigned int chunk) {
+  if (chunk >= rd->n_chunks)
+    return NULL;
+
+  struct chkpt_chunk_iter *it = CHECKED_MALLOC_STRUCT_NODIE(
+      struct chkpt_chunk_iter, "checkpoint chunk iterator");
+  if (it == NULL)
+    return NULL;
+  memset(it, 0, sizeof(struct chkpt_chunk_iter));
+  it->rd = rd;
+  it->chunk = &rd->chunks[chunk];
+  it->n_unread = it->chunk->n_bytes;
+
+  /* first run of periodic images reaching past the chunk's start */
+  unsigned long long lo = 0, hi = rd->n_runs;
+  while (lo < hi) {
+    unsigned long long mid = lo + (hi - lo) / 2;
+    if (rd->run_end[mid] <= it->chunk->first_mol)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  it->run = lo;
+
+  if (it->chunk->kind == CHKPT_CHUNK_BASE)
+    return it;
+  it->buf = CHECKED_MALLOC_ARRAY_NODIE(unsigned char, CHKPT_READER_BUFFER,
+                                       "checkpoint chunk buffer");
+  it->fs = fopen(rd->filename, "rb");
+  if (it->buf == NULL || it->fs == NULL ||
+      fseeko(it->fs, (off_t)it->chunk->offset, SEEK_SET) != 0) {
+    if (it->fs == NULL)
+      mcell_perror_nodie(errno, "Failed to open checkpoint file '%s'",
+                         rd->filename);
+    close_chkpt_chunk(it);
+    return NULL;
+  }
+  return it;
+}
+
+/***************************************************************************
+ close_chkpt_chunk:
+ In:  it - a chunk iterator, or NULL
+ Out: None.  The iterator is freed.
+***************************************************************************/
+void close_chkpt_chunk(struct chkpt_chunk_iter *it) {
+  if (it == NULL)
+    return;
+  if (it->fs != NULL)
+    fclose(it->fs);
+  free(it->buf);
+  free(it);
+}
+
+/***************************************************************************
+ fill_chunk_buffer:
+ In:  it - a chunk iterator
+      want - number of bytes needed in the buffer
+ Out: Reads more of the chunk into the buffer, until it holds want bytes or
+      the rest of the chunk.  Returns 1 on a read error, 0 on success.
+***************************************************************************/
+static int fill_chunk_buffer(struct chkpt_chunk_iter *it, size_t want) {
+  if (it->len - it->pos >= want || it->n_unread == 0)
+    return 0;
+  memmove(it->buf, it->buf + it->pos, it->len - it->pos);
+  it->len -= it->pos;
+  it->pos = 0;
+  size_t n = CHKPT_READER_BUFFER - it->len;
+  if (n > it->n_unread)
+    n = (size_t)it->n_unread;
+  if (fread(it->buf + it->len, 1, n, it->fs) != n) {
+    mcell_perror_nodie(errno, "Error while reading checkpoint file '%s'",
+                       it->rd->filename);
+    return 1;
+  }
+  it->len += n;
+  it->n_unread -= n;
+  return 0;
+}
+
+/***************************************************************************
+ decode_uvarint:
+ In:  it - a chunk iterator
+      dest - receives the next varint of its buffer
+ Out: returns 1 if the buffer ends first, 0 on success.
+***************************************************************************/
+static int decode_uvarint(struct chkpt_chunk_iter *it,
+                          unsigned long long *dest) {
+  unsigned long long accum = 0;
+  unsigned char ch;
+  do {
+    if (it->pos == it->len)
+      return 1;
+    ch = it->buf[it->pos++];
+    accum <<= 7;
+    accum |= ch & 0x7f;
+  } while (ch & 0x80);
+
+  *dest = accum;
+  return 0;
+}
+
+/***************************************************************************
+ decode_double:
+ In:  it - a chunk iterator
+      dest - receives the next double of its buffer
+ Out: returns 1 if the buffer ends first, 0 on success.
+***************************************************************************/
+static int decode_double(struct chkpt_chunk_iter *it, double *dest) {
+  if (it->len - it->pos < sizeof(double))
+    return 1;
+  memcpy(dest, it->buf + it->pos, sizeof(double));
+  it->pos += sizeof(double);
+  if (it->rd->byte_order_mismatch)
+    byte_swap(dest, sizeof(double));
+  return 0;
+}
+
+/***************************************************************************
+ decode_varint_molecule:
+ In:  it - a chunk iterator, with the next molecule in its buffer
+      mols - batch to add the molecule to
+      n - its index in the batch
+ Out: Decodes a molecule encoded as by buffer_chkpt_molecule in chkpt.c.
+      Returns 1 if it is truncated, 0 on success.
+***************************************************************************/
+static int decode_varint_molecule(struct chkpt_chunk_iter *it,
+                                  struct chkpt_molecules *mols,
+                                  unsigned long long n) {
+  unsigned long long species, orient, complex_no;
+  if (decode_uvarint(it, &species) || it->len - it->pos < 2)
+    return 1;
+  unsigned char newbie = it->buf[it->pos++];
+  unsigned char change = it->buf[it->pos++];
+  if (decode_double(it, &mols->sched_times[n]) ||
+      decode_double(it, &mols->lifetimes[n]) ||
+      decode_double(it, &mols->birthdays[n]) ||
+      decode_double(it, &mols->positions[3 * n]) ||
+      decode_double(it, &mols->positions[3 * n + 1]) ||
+      decode_double(it, &mols->positions[3 * n + 2]) ||
+      decode_uvarint(it, &orient) || decode_uvarint(it, &complex_no))
+    return 1;
+
+  mols->species[n] = (unsigned int)species;
+  mols->orients[n] =
+      (short)((orient & 1) ? -(long long)(orient >> 1) : (long long)(orient >> 1));
+  mols->flags[n] = (newbie ? CHKPT_MOL_NEWBIE : 0) |
+                   (change ? CHKPT_MOL_CHANGE : 0);
+  return 0;
+}
+
+/***************************************************************************
+ decode_fixed_record:
+ In:  it - a chunk iterator
+      rec - a fixed-width molecule record
+      mols - batch to add the molecule to
+      n - its index in the batch
+ Out: None.  Decodes a record written by write_mol_scheduler_fixed in
+      chkpt.c.
+***************************************************************************/
+static void decode_fixed_record(struct chkpt_chunk_iter *it,
+                                unsigned char const *rec,
+                                struct chkpt_molecules *mols,
+                                unsigned long long n) {
+  uint32_t species;
+  int16_t orient;
+  memcpy(&mols->sched_times[n], rec + CHKPT_FIXED_SCHED_TIME, sizeof(double));
+  memcpy(&mols->lifetimes[n], rec + CHKPT_FIXED_LIFETIME, sizeof(double));
+  memcpy(&mols->birthdays[n], rec + CHKPT_FIXED_BIRTHDAY, sizeof(double));
+  memcpy(&mols->positions[3 * n], rec + CHKPT_FIXED_WHERE, 3 * sizeof(double));
+  memcpy(&species, rec + CHKPT_FIXED_SPECIES, sizeof(uint32_t));
+  memcpy(&orient, rec + CHKPT_FIXED_ORIENT, sizeof(int16_t));
+  if (it->rd->byte_order_mismatch) {
+    byte_swap(&mols->sched_times[n], sizeof(double));
+    byte_swap(&mols->lifetimes[n], sizeof(double));
+    byte_swap(&mols->birthdays[n], sizeof(double));
+    for (int k = 0; k < 3; ++k)
+      byte_swap(&mols->positions[3 * n + k], sizeof(double));
+    byte_swap(&species, sizeof(uint32_t));
+    byte_swap(&orient, sizeof(int16_t));
+  }
+  mols->species[n] = species;
+  mols->orients[n] = orient;
+  mols->flags[n] = (rec[CHKPT_FIXED_NEWBIE] ? CHKPT_MOL_NEWBIE : 0) |
+                   (rec[CHKPT_FIXED_CHANGE] ? CHKPT_MOL_CHANGE : 0);
+}
+
+/***************************************************************************
+ copy_base_molecule:
+ In:  it - a chunk iterator over molecules of the base checkpoint
+      mols - batch to add the molecule to
+      n - its index in the batch
+ Out: None.  Copies the next molecule from the base.
+***************************************************************************/
+static void copy_base_molecule(struct chkpt_chunk_iter *it,
+                               struct chkpt_molecules *mols,
+                               unsigned long long n) {
+  struct chkpt_molecules const *base = it->rd->base;
+  unsigned long long k = (unsigned long long)it->chunk->offset + it->next_mol;
+  mols->species[n] = base->species[k];
+  memcpy(&mols->positions[3 * n], &base->positions[3 * k], 3 * sizeof(double));
+  mols->sched_times[n] = base->sched_times[k];
+  mols->lifetimes[n] = base->lifetimes[k];
+  mols->birthdays[n] = base->birthdays[k];
+  mols->orients[n] = base->orients[k];
+  mols->flags[n] = base->flags[k];
+}
+
+/***************************************************************************
+ read_chkpt_chunk:
+ In:  it - a chunk iterator
+      mols - batch to fill
+ Out: Decodes the next molecules of the chunk, up to the capacity of the
+      batch; mols->n_mols is 0 once the chunk is exhausted.  Returns 1 on
+      error, 0 on success.
+***************************************************************************/
+int read_chkpt_chunk(struct chkpt_chunk_iter *it,
+                     struct chkpt_molecules *mols) {
+  struct chkpt_reader const *rd = it->rd;
+  struct chkpt_reader_chunk const *chunk = it->chunk;
+  unsigned long long n_mols = chunk->n_mols - it->next_mol;
+  if (n_mols > mols->max_mols)
+    n_mols = mols->max_mols;
+
+  mols->n_mols = 0;
+  for (unsigned long long n = 0; n < n_mols; ++n) {
+    switch (chunk->kind) {
+    case CHKPT_CHUNK_VARINT:
+      if (fill_chunk_buffer(it, CHKPT_READER_MAX_RECORD))
+        return 1;
+      if (decode_varint_molecule(it, mols, n)) {
+        mcell_warn("Corrupted checkpoint data: molecule chunk of checkpoint "
+                   "file '%s' is truncated.", rd->filename);
+        return 1;
+      }
+      break;
+
+    case CHKPT_CHUNK_FIXED:
+      if (fill_chunk_buffer(it, (size_t)rd->record_size))
+        return 1;
+      if (it->len - it->pos < rd->record_size) {
+        mcell_warn("Checkpoint file '%s' is too short for its molecules.",
+                   rd->filename);
+        return 1;
+      }
+      decode_fixed_record(it, it->buf + it->pos, mols, n);
+      it->pos += (size_t)rd->record_size;
+      break;
+
+    default:
+      copy_base_molecule(it, mols, n);
+      break;
+    }
+
+    if (mols->species[n] >= rd->n_species ||
+        rd->species_names[mols->species[n]] == NULL) {
+      mcell_warn("Corrupted checkpoint data: Found molecule with unknown "
+                 "species id (%u) in checkpoint file '%s'.",
+                 mols->species[n], rd->filename);
+      return 1;
+    }
+
+    /* molecules beyond the last run are in the central box */
+    unsigned long long index = chunk->first_mol + it->next_mol;
+    while (it->run < rd->n_runs && rd->run_end[it->run] <= index)
+      ++it->run;
+    int const *box = (it->run < rd->n_runs)
+                         ? &rd->boxes[3 * rd->run_box[it->run]] : NULL;
+    for (int k = 0; k < 3; ++k)
+      mols->boxes[3 * n + k] = (box != NULL) ? box[k] : 0;
+
+    ++it->next_mol;
+    ++mols->n_mols;
+  }
+  return 0;
+}
@@ -0,0 +1,112 @@
+/******************************************************************************
+ *
+ * Copyright (C) 2006-2017 by
+ * The Salk Institute for Biological Studies and
+ * Pittsburgh Supercomputing Center, Carnegie Mellon University
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ *
+******************************************************************************/
+
+#pragma once
+
+/* Standalone reader of checkpoint files for offline analysis.  It needs
+ * neither the model nor a simulation: opening a checkpoint reads its header
+ * sections and indexes its molecules as a list of chunks, which are the
+ * per-storage chunks of the molecule scheduler state, slices of the
+ * fixed-width records, or the runs of a differential checkpoint.  The
+ * molecules of a chunk are decoded in batches by an iterator with its own
+ * file handle, so that different chunks can be read from different threads
+ * at the same time.  Molecules keep the checkpoint species ids, positions
+ * are in the internal length units of the model, and times are in seconds.
+ */
+
+/* Molecule flags */
+#define CHKPT_MOL_NEWBIE 1 /* not yet scheduled for unimolecular reactions */
+#define CHKPT_MOL_CHANGE 2 /* lifetime to be recomputed on restart */
+
+/* Kinds of chunks */
+#define CHKPT_CHUNK_VARINT 0 /* varint-encoded molecules */
+#define CHKPT_CHUNK_FIXED 1  /* fixed-width molecule records */
+#define CHKPT_CHUNK_BASE 2   /* molecules copied from the base checkpoint */
+
+/* A batch of molecules, as parallel arrays */
+struct chkpt_molecules {
+  unsigned long long n_mols;
+  unsigned long long max_mols; /* capacity of the arrays */
+  unsigned int *species;       /* checkpoint species id */
+  double *positions;           /* x, y, z of each molecule */
+  double *sched_times;         /* time of the next scheduled event */
+  double *lifetimes;           /* time to the next unimolecular reaction */
+  double *birthdays;
+  short *orients;              /* 0 for volume molecules */
+  unsigned char *flags;        /* CHKPT_MOL_* */
+  int *boxes; /* periodic box x, y, z; all 0 without periodic images */
+};
+
+/* A part of the molecules of a checkpoint that is read on its own */
+struct chkpt_reader_chunk {
+  int kind;           /* CHKPT_CHUNK_* */
+  long long offset;   /* file offset, or index among the base's molecules */
+  unsigned long long n_bytes;   /* encoded size in the file */
+  unsigned long long first_mol; /* index of the first molecule */
+  unsigned long long n_mols;
+};
+
+struct chkpt_reader {
+  char *filename;
+  int byte_order_mismatch;
+  unsigned int api_version;
+  char *mcell_version;
+  double time_seconds;   /* simulation time of the checkpoint */
+  long long iteration;   /* iteration of the checkpoint */
+  unsigned int seq_num;  /* checkpoint sequence number */
+  unsigned int n_species;
+  char **species_names;  /* by checkpoint species id, NULL if unused */
+  char *base_filename;   /* base of a differential checkpoint, or NULL */
+  long long base_iteration;
+
+  unsigned long long n_mols;
+  unsigned int n_chunks;
+  struct chkpt_reader_chunk *chunks;
+  unsigned long long record_size; /* of fixed-width records */
+
+  /* Periodic box of every molecule, as runs of consecutive molecules in
+   * the same box; none if the checkpoint has no periodic images */
+  unsigned int n_boxes;
+  int *boxes;                   /* x, y, z of each box */
+  unsigned long long n_runs;
+  unsigned int *run_box;
+  unsigned long long *run_end;  /* index past the last molecule of a run */
+
+  struct chkpt_molecules *base; /* molecules of the base checkpoint */
+};
+
+struct chkpt_chunk_iter;
+
+struct chkpt_reader *open_chkpt_reader(char const *filename);
+void close_chkpt_reader(struct chkpt_reader *rd);
+int chkpt_reader_species_id(struct chkpt_reader const *rd, char const *name);
+
+int init_chkpt_molecules(struct chkpt_molecules *mols,
+                         unsigned long long max_mols);
+void free_chkpt_molecules(struct chkpt_molecules *mols);
+
+struct chkpt_chunk_iter *open_chkpt_chunk(struct chkpt_reader const *rd,
+                                          unsigned int chunk);
+int read_chkpt_chunk(struct chkpt_chunk_iter *it,
+                     struct chkpt_molecules *mols);
+void close_chkpt_chunk(struct chkpt_chunk_iter *it);
@@ -0,0 +1,129 @@
+/******************************************************************************
+ *
+ * Copyright (C) 2006-2017 by
+ * The Salk Institute for Biological Studies and
+ * Pittsburgh Supercomputing Center, Carnegie Mellon University
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ *
+******************************************************************************/
+%include "typemaps.i"
+
+// Standalone reader of checkpoint files, see chkpt_reader.h.  Only the
+// header fields of a reader are exposed; molecules are read through chunk
+// iterators into batches.
+
+%immutable;
+
+struct chkpt_reader {
+  char *filename;
+  unsigned int api_version;
+  char *mcell_version;
+  double time_seconds;
+  long long iteration;
+  unsigned int seq_num;
+  unsigned int n_species;
+  char *base_filename;
+  unsigned long long n_mols;
+  unsigned int n_chunks;
+};
+
+struct chkpt_molecules {
+  unsigned long long n_mols;
+  unsigned long long max_mols;
+};
+
+%mutable;
+
+%extend chkpt_molecules {
+  chkpt_molecules(unsigned long long max_mols) {
+    struct chkpt_molecules *mols = malloc(sizeof(struct chkpt_molecules));
+    if (mols != NULL && init_chkpt_molecules(mols, max_mols)) {
+      free(mols);
+      mols = NULL;
+    }
+    return mols;
+  }
+
+  ~chkpt_molecules() {
+    free_chkpt_molecules($self);
+    free($self);
+  }
+}
+
+struct chkpt_reader *open_chkpt_reader(char const *filename);
+void close_chkpt_reader(struct chkpt_reader *rd);
+int chkpt_reader_species_id(struct chkpt_reader const *rd, char const *name);
+
+struct chkpt_chunk_iter *open_chkpt_chunk(struct chkpt_reader const *rd,
+                                          unsigned int chunk);
+int read_chkpt_chunk(struct chkpt_chunk_iter *it,
+                     struct chkpt_molecules *mols);
+void close_chkpt_chunk(struct chkpt_chunk_iter *it);
+
+// Views share memory with the batch and are only valid until it is refilled
+// by the next read_chkpt_chunk call
+%inline %{
+const char *chkpt_reader_species_name(struct chkpt_reader *rd,
+                                      unsigned int id) {
+  return (id < rd->n_species) ? rd->species_names[id] : NULL;
+}
+
+unsigned long long chkpt_reader_chunk_mols(struct chkpt_reader *rd,
+                                           unsigned int chunk) {
+  return (chunk < rd->n_chunks) ? rd->chunks[chunk].n_mols : 0;
+}
+
+PyObject *chkpt_species_view(struct chkpt_molecules *mols) {
+  return pymcell_memoryview(mols->species, mols->n_mols, 1,
+                            sizeof(unsigned int), sizeof(unsigned int), "I");
+}
+
+PyObject *chkpt_positions_view(struct chkpt_molecules *mols) {
+  return pymcell_memoryview(mols->positions, mols->n_mols, 3, sizeof(double),
+                            3 * sizeof(double), "d");
+}
+
+PyObject *chkpt_sched_times_view(struct chkpt_molecules *mols) {
+  return pymcell_memoryview(mols->sched_times, mols->n_mols, 1,
+                            sizeof(double), sizeof(double), "d");
+}
+
+PyObject *chkpt_lifetimes_view(struct chkpt_molecules *mols) {
+  return pymcell_memoryview(mols->lifetimes, mols->n_mols, 1, sizeof(double),
+                            sizeof(double), "d");
+}
+
+PyObject *chkpt_birthdays_view(struct chkpt_molecules *mols) {
+  return pymcell_memoryview(mols->birthdays, mols->n_mols, 1, sizeof(double),
+                            sizeof(double), "d");
+}
+
+PyObject *chkpt_orients_view(struct chkpt_molecules *mols) {
+  return pymcell_memoryview(mols->orients, mols->n_mols, 1, sizeof(short),
+                            sizeof(short), "h");
+}
+
+PyObject *chkpt_flags_view(struct chkpt_molecules *mols) {
+  return pymcell_memoryview(mols->flags, mols->n_mols, 1,
+                            sizeof(unsigned char), sizeof(unsigned char), "B");
+}
+
+PyObject *chkpt_boxes_view(struct chkpt_molecules *mols) {
+  return pymcell_memoryview(mols->boxes, mols->n_mols, 3, sizeof(int),
+                            3 * sizeof(int), "i");
+}
+%}
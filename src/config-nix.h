@@ -52,4 +52,18 @@
   __attribute__((__format__(printf, arg, 0))) /* same but with va_list         \
                                                  argument */
 
+/* With USE_TARGET_CLONES, marks a hot kernel that is compiled once per
+ * instruction set; the copy for the best one the CPU supports is picked
+ * when the program is loaded, so one binary runs well on core2 through
+ * AVX-512 machines.  avx512f enables FMA, so every copy only produces the
+ * same results because contraction is off (-ffp-contract=off, added with
+ * USE_TARGET_CLONES and also implied by -std=c11). */
+#if defined(MCELL_TARGET_CLONES) && defined(__x86_64__) && \
+    defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 6
+#define TARGET_CLONES                                                          \
+  __attribute__((target_clones("avx512f", "avx2", "default")))
+#else
+#define TARGET_CLONES
+#endif
+
 #endif
@@ -64,6 +64,9 @@ of sigaction
                                      arguments this corrects warnings */
 #define PRINTF_FORMAT_V(arg) __attribute__((__format__(gnu_printf, arg, 0)))
 
+/* Windows has no load-time function selection (see config-nix.h) */
+#define TARGET_CLONES
+
 #define WIN32_LEAN_AND_MEAN /* removes many unneeded Windows definitions */
 #undef _WIN32_WINNT
 #define _WIN32_WINNT 0x0502
@@ -54,6 +54,32 @@ static int instantiate_count_request(
   struct counter **count_hash, struct mem_helper *trig_request_mem,
   double *elapsed_time, struct mem_helper *counter_mem);
 
+/* Index the molecule counters of each region by species */
+static void index_region_counters(struct volume *world);
+
+/* Find the first/next counter on a region for a species */
+static struct counter *first_region_counter(struct volume *world,
+                                            struct region *reg,
+                                            struct species *sp);
+static struct counter *next_region_counter(struct counter *c,
+                                           struct region *reg,
+                                           struct species *sp);
+
+/* Check whether any counter on a region counts a particular target */
+static int region_counts_target(struct volume *world, struct region *reg,
+                                struct species *sp, void *target,
+                                int hashval);
+
+/* Find where a move counter update should go */
+static struct move_counter_data *counter_move_data(struct volume *world,
+                                                   struct counter *c);
+
+/* Fire a trigger from a wall crossing, or record it for later */
+static void fire_region_count_event(struct volume *world, struct counter *c,
+                                    double t_event, int n,
+                                    struct vector3 *where, byte what,
+                                    u_long id);
+
 /* Create a new counter data structure */
 static struct counter *create_new_counter(struct region *where, void *who,
   byte what, struct periodic_image *img, struct mem_helper *counter_mem);
@@ -148,6 +174,197 @@ int region_listed(struct region_list *rl, struct region *r) {
   return 0;
 }
 
+/*************************************************************************
+first_region_counter:
+   In: world: simulation state
+       reg: region we are counting on
+       sp: species we are counting
+   Out: The first counter on reg whose target is sp, or NULL if there is
+        none. Uses the region's per-species index when it has one and falls
+        back to the counter hash table otherwise.
+*************************************************************************/
+static struct counter *first_region_counter(struct volume *world,
+                                            struct region *reg,
+                                            struct species *sp) {
+  if (reg->species_counters != NULL) {
+    if (sp->species_id < (u_int)world->n_species)
+      return reg->species_counters[sp->species_id];
+    return NULL;
+  }
+
+  int hash_bin = (reg->hashval + sp->hashval) & world->count_hashmask;
+  struct counter *c = world->count_hash[hash_bin];
+  while (c != NULL && !(c->reg_type == reg && c->target == sp))
+    c = c->next;
+  return c;
+}
+
+/*************************************************************************
+next_region_counter:
+   In: c: counter returned by first_region_counter or next_region_counter
+       reg: region we are counting on
+       sp: species we are counting
+   Out: The next counter on reg whose target is sp, or NULL if there is none.
+        Counters are visited in the same order as in the counter hash table.
+*************************************************************************/
+static struct counter *next_region_counter(struct counter *c,
+                                           struct region *reg,
+                                           struct species *sp) {
+  if (reg->species_counters != NULL)
+    return c->next_same;
+
+  for (c = c->next; c != NULL; c = c->next) {
+    if (c->reg_type == reg && c->target == sp)
+      break;
+  }
+  return c;
+}
+
+/*************************************************************************
+region_counts_target:
+   In: world: simulation state
+       reg: region to check
+       sp: species being counted, or NULL for a reaction pathname
+       target: species or reaction pathname being counted
+       hashval: hash value of target
+   Out: 1 if some counter on reg has target as its target, 0 otherwise.
+*************************************************************************/
+static int region_counts_target(struct volume *world, struct region *reg,
+                                struct species *sp, void *target,
+                                int hashval) {
+  if (sp != NULL)
+    return first_region_counter(world, reg, sp) != NULL;
+
+  int hash_bin = (hashval + reg->hashval) & world->count_hashmask;
+  for (struct counter *c = world->count_hash[hash_bin]; c != NULL;
+       c = c->next) {
+    if (c->reg_type == reg && c->target == target)
+      return 1;
+  }
+  return 0;
+}
+
+/*************************************************************************
+counter_move_data:
+   In: world: simulation state
+       c: molecule counter about to be updated
+   Out: The move data to update: that of the counter itself, or when running
+        on a per-thread copy of the world, that of the counter's slot in the
+        storage's counter shard.
+*************************************************************************/
+static struct move_counter_data *counter_move_data(struct volume *world,
+                                                   struct counter *c) {
+  struct counter_shard *shard = world->count_shard;
+  if (shard == NULL || c->shard_slot < 0)
+    return &c->data.move;
+
+  if (!shard->touched[c->shard_slot]) {
+    shard->touched[c->shard_slot] = 1;
+    shard->touched_slots[shard->n_touched++] = c->shard_slot;
+  }
+  return &shard->move[c->shard_slot];
+}
+
+/*************************************************************************
+fire_region_count_event:
+   In: world: simulation state
+       c: trigger counter that fired
+       t_event: time of the event
+       n, where, what, id: as for fire_count_event
+   Out: No return value. The event is passed on to fire_count_event, or when
+        running on a per-thread copy of the world, recorded in the storage's
+        counter shard to be fired by merge_counter_shard.
+*************************************************************************/
+static void fire_region_count_event(struct volume *world, struct counter *c,
+                                    double t_event, int n,
+                                    struct vector3 *where, byte what,
+                                    u_long id) {
+  struct counter_shard *shard = world->count_shard;
+  if (shard == NULL) {
+    c->data.trig.t_event = t_event;
+    c->data.trig.orient = 0;
+    fire_count_event(world, c, n, where, what, id);
+    return;
+  }
+
+  struct shard_trigger *st = (struct shard_trigger *)CHECKED_MEM_GET(
+      shard->trig_mem, "recorded trigger event");
+  st->next = NULL;
+  st->c = c;
+  st->t_event = t_event;
+  st->loc = *where;
+  st->id = id;
+  st->n = n;
+  st->what = what;
+  if (shard->trig_tail == NULL)
+    shard->trig_head = st;
+  else
+    shard->trig_tail->next = st;
+  shard->trig_tail = st;
+}
+
+/*************************************************************************
+create_counter_shard:
+   In: world: simulation state, with counters already prepared
+   Out: An empty counter shard with room for every counter slot.
+*************************************************************************/
+struct counter_shard *create_counter_shard(struct volume *world) {
+  struct counter_shard *shard =
+      CHECKED_MALLOC_STRUCT(struct counter_shard, "counter shard");
+  int n = (world->n_counter_slots > 0) ? world->n_counter_slots : 1;
+  shard->move = CHECKED_MALLOC_ARRAY(struct move_counter_data, n,
+                                     "counter shard deltas");
+  memset(shard->move, 0, n * sizeof(struct move_counter_data));
+  shard->touched = CHECKED_MALLOC_ARRAY(byte, n, "counter shard flags");
+  memset(shard->touched, 0, n * sizeof(byte));
+  shard->touched_slots =
+      CHECKED_MALLOC_ARRAY(int, n, "counter shard slot list");
+  shard->n_touched = 0;
+  if ((shard->trig_mem = create_mem_named(sizeof(struct shard_trigger), 64,
+                                          "recorded trigger event")) == NULL)
+    mcell_allocfailed("Failed to create memory pool for trigger events.");
+  shard->trig_head = NULL;
+  shard->trig_tail = NULL;
+  return shard;
+}
+
+/*************************************************************************
+merge_counter_shard:
+   In: world: simulation state
+       shard: counter updates made by one storage during a threaded pass
+   Out: No return value. The deltas are added to the counters and the
+        recorded triggers are fired in the order they happened. The shard
+        is left empty.
+*************************************************************************/
+void merge_counter_shard(struct volume *world, struct counter_shard *shard) {
+  for (int i = 0; i < shard->n_touched; i++) {
+    int slot = shard->touched_slots[i];
+    struct move_counter_data *delta = &shard->move[slot];
+    struct move_counter_data *move = &world->counter_slots[slot]->data.move;
+    move->front_hits += delta->front_hits;
+    move->back_hits += delta->back_hits;
+    move->front_to_back += delta->front_to_back;
+    move->back_to_front += delta->back_to_front;
+    move->scaled_hits += delta->scaled_hits;
+    move->n_at += delta->n_at;
+    move->n_enclosed += delta->n_enclosed;
+    memset(delta, 0, sizeof(struct move_counter_data));
+    shard->touched[slot] = 0;
+  }
+  shard->n_touched = 0;
+
+  for (struct shard_trigger *st = shard->trig_head; st != NULL;
+       st = st->next) {
+    st->c->data.trig.t_event = st->t_event;
+    st->c->data.trig.orient = 0;
+    fire_count_event(world, st->c, st->n, &st->loc, st->what, st->id);
+  }
+  if (shard->trig_head != NULL)
+    mem_put_list(shard->trig_mem, shard->trig_head);
+  shard->trig_head = NULL;
+  shard->trig_tail = NULL;
+}
+
 /*************************************************************************
 count_region_update:
    In: world: simulation state 
@@ -199,13 +416,9 @@ void count_region_update(
       continue;
     }
 
-    int hash_bin = (rl->reg->hashval + sp->hashval) & world->count_hashmask;
-    for (hit_count = world->count_hash[hash_bin]; hit_count != NULL;
-         hit_count = hit_count->next) {
-
-      if (!(hit_count->reg_type == rl->reg && hit_count->target == sp)) {
-        continue;
-      }
+    for (hit_count = first_region_counter(world, rl->reg, sp);
+         hit_count != NULL;
+         hit_count = next_region_counter(hit_count, rl->reg, sp)) {
 
       // count only in the relevant periodic box
       if (world->periodic_box_obj && !world->periodic_traditional) {
@@ -226,83 +439,69 @@ void count_region_update(
         }
       }
 
+      double t_event = (double)world->current_iterations + t;
+      if (hit_count->counter_type & TRIG_COUNTER) {
+        if (crossed) {
+          if (rl->reg->flags & sp->flags & COUNT_HITS) {
+            if (direction == 1) {
+              fire_region_count_event(world, hit_count, t_event, 1, loc,
+                                      REPORT_FRONT_HITS | REPORT_TRIGGER, id);
+              fire_region_count_event(world, hit_count, t_event, 1, loc,
+                                      REPORT_FRONT_CROSSINGS | REPORT_TRIGGER,
+                                      id);
+            } else {
+              fire_region_count_event(world, hit_count, t_event, 1, loc,
+                                      REPORT_BACK_HITS | REPORT_TRIGGER, id);
+              fire_region_count_event(world, hit_count, t_event, 1, loc,
+                                      REPORT_BACK_CROSSINGS | REPORT_TRIGGER,
+                                      id);
+            }
+          }
+          if (rl->reg->flags & sp->flags & COUNT_CONTENTS) {
+            fire_region_count_event(
+                world, hit_count, t_event, (direction == 1) ? 1 : -1, loc,
+                REPORT_ENCLOSED | REPORT_CONTENTS | REPORT_TRIGGER, id);
+          }
+        } else if (rl->reg->flags & sp->flags & COUNT_HITS) {
+          /* Didn't cross, only hits might update */
+          fire_region_count_event(
+              world, hit_count, t_event, 1, loc,
+              ((direction == 1) ? REPORT_FRONT_HITS : REPORT_BACK_HITS) |
+                  REPORT_TRIGGER, id);
+        }
+        continue;
+      }
+
+      struct move_counter_data *move = counter_move_data(world, hit_count);
       if (crossed) {
         if (direction == 1) {
-          if (hit_count->counter_type & TRIG_COUNTER) {
-            hit_count->data.trig.t_event = (double)world->current_iterations + t;
-            hit_count->data.trig.orient = 0;
-            if (rl->reg->flags & sp->flags & COUNT_HITS) {
-              fire_count_event(world, hit_count, 1, loc,
-                               REPORT_FRONT_HITS | REPORT_TRIGGER, id);
-
-              fire_count_event(world, hit_count, 1, loc,
-                               REPORT_FRONT_CROSSINGS | REPORT_TRIGGER, id);
-            }
-            if (rl->reg->flags & sp->flags & COUNT_CONTENTS) {
-              fire_count_event(world, hit_count, 1, loc,
-                               REPORT_ENCLOSED | REPORT_CONTENTS |
-                                   REPORT_TRIGGER, id);
-            }
-          } else {
-            if (rl->reg->flags & sp->flags & COUNT_HITS) {
-              hit_count->data.move.front_hits++;
-              hit_count->data.move.front_to_back++;
-            }
-            if (rl->reg->flags & sp->flags & COUNT_CONTENTS) {
-              hit_count->data.move.n_enclosed++;
-            }
+          if (rl->reg->flags & sp->flags & COUNT_HITS) {
+            move->front_hits++;
+            move->front_to_back++;
+          }
+          if (rl->reg->flags & sp->flags & COUNT_CONTENTS) {
+            move->n_enclosed++;
           }
         } else {
-          if (hit_count->counter_type & TRIG_COUNTER) {
-            hit_count->data.trig.t_event = (double)world->current_iterations + t;
-            hit_count->data.trig.orient = 0;
-            if (rl->reg->flags & sp->flags & COUNT_HITS) {
-              fire_count_event(world, hit_count, 1, loc,
-                               REPORT_BACK_HITS | REPORT_TRIGGER, id);
-              fire_count_event(world, hit_count, 1, loc,
-                               REPORT_BACK_CROSSINGS | REPORT_TRIGGER, id);
-            }
-            if (rl->reg->flags & sp->flags & COUNT_CONTENTS) {
-              fire_count_event(
-                  world, hit_count, -1, loc,
-                  REPORT_ENCLOSED | REPORT_CONTENTS | REPORT_TRIGGER, id);
-            }
-          } else {
-            if (rl->reg->flags & sp->flags & COUNT_HITS) {
-              hit_count->data.move.back_hits++;
-              hit_count->data.move.back_to_front++;
-            }
-            if (rl->reg->flags & sp->flags & COUNT_CONTENTS) {
-              hit_count->data.move.n_enclosed--;
-            }
+          if (rl->reg->flags & sp->flags & COUNT_HITS) {
+            move->back_hits++;
+            move->back_to_front++;
+          }
+          if (rl->reg->flags & sp->flags & COUNT_CONTENTS) {
+            move->n_enclosed--;
           }
         }
       } else if (rl->reg->flags & sp->flags & COUNT_HITS) {
-      /* Didn't cross, only hits might update */
+        /* Didn't cross, only hits might update */
         if (direction == 1) {
-          if (hit_count->counter_type & TRIG_COUNTER) {
-            hit_count->data.trig.t_event = (double)world->current_iterations + t;
-            hit_count->data.trig.orient = 0;
-            fire_count_event(world, hit_count, 1, loc,
-                             REPORT_FRONT_HITS | REPORT_TRIGGER, id);
-          } else {
-            hit_count->data.move.front_hits++;
-          }
+          move->front_hits++;
         } else {
-          if (hit_count->counter_type & TRIG_COUNTER) {
-            hit_count->data.trig.t_event = (double)world->current_iterations + t;
-            hit_count->data.trig.orient = 0;
-            fire_count_event(world, hit_count, 1, loc,
-                             REPORT_BACK_HITS | REPORT_TRIGGER, id);
-          } else
-            hit_count->data.move.back_hits++;
+          move->back_hits++;
         }
       }
       if ((count_hits && rl->reg->area != 0.0) &&
           ((sp->flags & NOT_FREE) == 0)) {
-        if ((hit_count->counter_type & TRIG_COUNTER) == 0) {
-          hit_count->data.move.scaled_hits += hits_to_ccn / rl->reg->area;
-        }
+        move->scaled_hits += hits_to_ccn / rl->reg->area;
       }
     }
   }
@@ -331,14 +530,9 @@ void count_region_border_update(struct volume *world, struct species *sp,
       if ((rl->reg->flags & COUNT_SOME_MASK) &&
           (rl->reg->flags & sp->flags & COUNT_HITS)) {
 
-        int hash_bin = (rl->reg->hashval + sp->hashval) & world->count_hashmask;
-
-        for (struct counter *hit_count = world->count_hash[hash_bin];
-          hit_count != NULL; hit_count = hit_count->next) {
-
-          if (((hit_count->reg_type != rl->reg) || (hit_count->target != sp))) {
-            continue;
-          }
+        for (struct counter *hit_count = first_region_counter(world, rl->reg, sp);
+          hit_count != NULL;
+          hit_count = next_region_counter(hit_count, rl->reg, sp)) {
 
           if ((hit_count->orientation != ORIENT_NOT_SET) &&
               (hit_count->orientation != hd->orientation) &&
@@ -473,7 +667,7 @@ void count_region_from_scratch(struct volume *world,
               if ((c->orientation == ORIENT_NOT_SET) ||
                   (c->orientation == orient) || (c->orientation == 0)) {
                 // count only in the relevant periodic box
-                if (periodic_boxes_are_identical(am->periodic_box, c->periodic_box)) {
+                if (periodic_boxes_are_identical(&am->periodic_box, c->periodic_box)) {
                   c->data.move.n_at += n;
                 }
               }
@@ -499,9 +693,12 @@ void count_region_from_scratch(struct volume *world,
    * enclosed--hard!!*/
   if (am == NULL || (am->properties->flags & COUNT_ENCLOSED) != 0 ||
       (am->properties->flags & NOT_FREE) == 0) {
-    const int px = bisect(world->x_partitions, world->nx_parts, loc->x);
-    const int py = bisect(world->y_partitions, world->ny_parts, loc->y);
-    const int pz = bisect(world->z_partitions, world->nz_parts, loc->z);
+    const int px = partition_index(&world->x_lookup, world->x_partitions,
+                                   world->nx_parts, loc->x);
+    const int py = partition_index(&world->y_lookup, world->y_partitions,
+                                   world->ny_parts, loc->y);
+    const int pz = partition_index(&world->z_lookup, world->z_partitions,
+                                   world->nz_parts, loc->z);
     const int this_sv =
         pz + (world->nz_parts - 1) * (py + (world->ny_parts - 1) * px);
     struct waypoint *wp = &(world->waypoints[this_sv]);
@@ -511,13 +708,13 @@ void count_region_from_scratch(struct volume *world,
 
     struct region_list *all_regs = NULL;
     struct region_list *all_antiregs = NULL;
+    struct species *count_sp = (rxpn == NULL) ? am->properties : NULL;
 
     /* Copy all the potentially relevant regions from the nearest waypoint */
     for (rl = wp->regions; rl != NULL; rl = rl->next) {
       if (rl->reg == NULL)
         continue;
-      int hash_bin = (hashval + rl->reg->hashval) & world->count_hashmask;
-      if (world->count_hash[hash_bin] == NULL)
+      if (!region_counts_target(world, rl->reg, count_sp, target, hashval))
         continue; /* Won't count on this region so ignore it */
 
       nrl = (struct region_list *)CHECKED_MEM_GET(
@@ -529,8 +726,7 @@ void count_region_from_scratch(struct volume *world,
 
     /* And all the antiregions (regions crossed from inside to outside only) */
     for (arl = wp->antiregions; arl != NULL; arl = arl->next) {
-      int hash_bin = (hashval + arl->reg->hashval) & world->count_hashmask;
-      if (world->count_hash[hash_bin] == NULL)
+      if (!region_counts_target(world, arl->reg, count_sp, target, hashval))
         continue; /* Won't count on this region so ignore it */
 
       narl = (struct region_list *)CHECKED_MEM_GET(
@@ -562,22 +758,31 @@ void count_region_from_scratch(struct volume *world,
         }
 
         if (wl->this_wall->flags & (COUNT_CONTENTS | COUNT_ENCLOSED)) {
+          /* Only walls of regions counting this target can change the
+           * result, so don't bother raytracing against the others */
+          for (rl = wl->this_wall->counting_regions; rl != NULL;
+               rl = rl->next) {
+            if ((rl->reg->flags & (COUNT_CONTENTS | COUNT_ENCLOSED)) != 0 &&
+                region_counts_target(world, rl->reg, count_sp, target, hashval))
+              break;
+          }
+          if (rl == NULL)
+            continue;
+
           int hit_code = collide_wall(&here, &delta, wl->this_wall, &t_hit,
                                       &hit, 0, world->rng, world->notify,
-                                      &(world->ray_polygon_tests));
+                                      &(world->stats.ray_polygon_tests));
           if (hit_code == COLLIDE_MISS) {
             continue;
           }
 
-          world->ray_polygon_colls++;
+          world->stats.ray_polygon_colls++;
           if (t_hit <= t_sv_hit && (hit.x - loc->x) * delta.x +
             (hit.y - loc->y) * delta.y + (hit.z - loc->z) * delta.z < 0) {
             for (rl = wl->this_wall->counting_regions; rl != NULL;
                  rl = rl->next) {
               if ((rl->reg->flags & (COUNT_CONTENTS | COUNT_ENCLOSED)) != 0) {
-                int hash_bin =
-                    (hashval + rl->reg->hashval) & world->count_hashmask;
-                if (world->count_hash[hash_bin] == NULL) {
+                if (!region_counts_target(world, rl->reg, count_sp, target, hashval)) {
                   continue; /* Won't count on this region so ignore it */
                 }
                 nrl = (struct region_list *)CHECKED_MEM_GET(
@@ -696,10 +901,17 @@ void count_moved_surface_mol(
   struct region_list *rl = NULL;
   struct region_list *rl2 = NULL;
   struct storage *stor = sm->grid->surface->birthplace;
+  // Leaving and entering the same regions in the same periodic box changes
+  // no counts
+  int same_regions =
+      sm->grid->surface->counting_set == sg->surface->counting_set &&
+      previous_box != NULL &&
+      periodic_boxes_are_identical(previous_box, &sm->periodic_box);
+
   // Different grids implies different walls, so we might have changed regions 
   /*if (sm->grid != sg) {*/
-  if ((sm->grid != sg) ||
-      (world->periodic_box_obj && !world->periodic_traditional)) {
+  if (!same_regions && ((sm->grid != sg) ||
+      (world->periodic_box_obj && !world->periodic_traditional))) {
     int delete_me = 0;
     if ((sm->grid->surface->flags & COUNT_CONTENTS) != 0 &&
       (sg->surface->flags & COUNT_CONTENTS) != 0) {
@@ -792,7 +1004,7 @@ void count_moved_surface_mol(
   uv2xyz(&(sm->s_pos), sm->grid->surface, &origin);
   uv2xyz(loc, sg->surface, &target);
   if ((sm->properties->flags & COUNT_ENCLOSED) &&
-      (periodic_boxes_are_identical(previous_box, sm->periodic_box))) {
+      (periodic_boxes_are_identical(previous_box, &sm->periodic_box))) {
 
     pos_regs = neg_regs = NULL;
     struct vector3 delta = {target.x - origin.x, target.y - origin.y, target.z - origin.z};
@@ -812,7 +1024,7 @@ void count_moved_surface_mol(
         struct vector3 hit = {0.0, 0.0, 0.0};
         double t = 0.0;
         j = collide_wall(&here, &delta, wl->this_wall, &t, &hit, 0, world->rng,
-          world->notify, &(world->ray_polygon_tests));
+          world->notify, &(world->stats.ray_polygon_tests));
 
         /* we only consider the collision if it happens in the current subvolume.
            Otherwise we may double count collision for walls that span multiple
@@ -909,7 +1121,7 @@ void count_moved_surface_mol(
                      (c->orientation == sm->orient) ||
                      (c->orientation == 0)) {
             /*c->data.move.n_enclosed += n;*/
-            if (periodic_boxes_are_identical(c->periodic_box, sm->periodic_box)) {
+            if (periodic_boxes_are_identical(c->periodic_box, &sm->periodic_box)) {
               c->data.move.n_enclosed += n;
             }
           }
@@ -923,9 +1135,9 @@ void count_moved_surface_mol(
       mem_put_list(stor->regl, neg_regs);
   }
   else if ((sm->properties->flags & COUNT_ENCLOSED) &&
-      (!periodic_boxes_are_identical(previous_box, sm->periodic_box))) {
+      (!periodic_boxes_are_identical(previous_box, &sm->periodic_box))) {
     // Increment count of where we are going now (target)
-    count_region_from_scratch(world, (struct abstract_molecule *)sm, NULL, 1, &target, NULL, 1.0, sm->periodic_box);
+    count_region_from_scratch(world, (struct abstract_molecule *)sm, NULL, 1, &target, NULL, 1.0, &sm->periodic_box);
     // Decrement count of where we were before (origin)
     count_region_from_scratch(world, (struct abstract_molecule *)sm, NULL, -1, &origin, NULL, 1.0, previous_box);
   }
@@ -938,10 +1150,12 @@ fire_count_event:
        n: number of times that thing happened (or hit direction for triggers)
        where: location where it happened
        what: what happened (Report Type Flags)
-   Out: None
+   Out: None.  Nothing is recorded during the equilibration phase.
 *************************************************************************/
 void fire_count_event(struct volume *world, struct counter *event, int n,
                       struct vector3 *where, byte what, u_long id) {
+  if (world->equilibrating)
+    return;
 
   short flags;
   if ((what & REPORT_TYPE_MASK) == REPORT_RXNS)
@@ -1042,11 +1256,11 @@ static int find_enclosing_regions(struct volume *world,
     for (wl = sv->wall_head; wl != NULL; wl = wl->next) {
       int hit_code =
           collide_wall(&outside, &delta, wl->this_wall, &t, &hit, 0, world->rng,
-                       world->notify, &(world->ray_polygon_tests));
+                       world->notify, &(world->stats.ray_polygon_tests));
 
       if ((hit_code != COLLIDE_MISS) &&
           (world->notify->final_summary == NOTIFY_FULL)) {
-        world->ray_polygon_colls++;
+        world->stats.ray_polygon_colls++;
       }
 
       if (hit_code == COLLIDE_REDO) {
@@ -1382,9 +1596,76 @@ int prepare_counters(struct volume *world) {
     }
   }
 
+  index_region_counters(world);
+
   return 0;
 }
 
+/******************************************************************
+index_region_counters:
+  In: world: simulation state
+  Out: No return value. Every region with molecule counters gets an array,
+       indexed by species_id, of the first counter on that region for each
+       species, with the remaining ones chained through next_same in counter
+       hash table order. Wall crossings then find their counters without
+       searching the hash table. Each of these counters also gets a
+       shard_slot, listed in world->counter_slots.
+********************************************************************/
+static void index_region_counters(struct volume *world) {
+  /* Counters may have been added since the last call, so start over */
+  for (int i = 0; i <= world->count_hashmask; i++) {
+    for (struct counter *c = world->count_hash[i]; c != NULL; c = c->next) {
+      c->next_same = NULL;
+      c->shard_slot = -1;
+      if ((c->counter_type & MOL_COUNTER) == 0 || c->reg_type == NULL)
+        continue;
+      if (c->reg_type->species_counters != NULL)
+        memset(c->reg_type->species_counters, 0,
+               world->n_species * sizeof(struct counter *));
+    }
+  }
+
+  int n_slots = 0;
+  for (int i = 0; i <= world->count_hashmask; i++) {
+    for (struct counter *c = world->count_hash[i]; c != NULL; c = c->next) {
+      if ((c->counter_type & MOL_COUNTER) == 0 || c->reg_type == NULL)
+        continue;
+      n_slots++;
+    }
+  }
+
+  free(world->counter_slots);
+  world->counter_slots = NULL;
+  if (n_slots > 0)
+    world->counter_slots = CHECKED_MALLOC_ARRAY(struct counter *, n_slots,
+                                                "counter shard slots");
+  world->n_counter_slots = 0;
+
+  for (int i = 0; i <= world->count_hashmask; i++) {
+    for (struct counter *c = world->count_hash[i]; c != NULL; c = c->next) {
+      if ((c->counter_type & MOL_COUNTER) == 0 || c->reg_type == NULL)
+        continue;
+
+      c->shard_slot = world->n_counter_slots;
+      world->counter_slots[world->n_counter_slots++] = c;
+
+      struct region *reg = c->reg_type;
+      if (reg->species_counters == NULL) {
+        reg->species_counters = CHECKED_MALLOC_ARRAY(
+            struct counter *, world->n_species, "region counter index");
+        memset(reg->species_counters, 0,
+               world->n_species * sizeof(struct counter *));
+      }
+
+      struct counter **tail =
+          &reg->species_counters[((struct species *)c->target)->species_id];
+      while (*tail != NULL)
+        tail = &(*tail)->next_same;
+      *tail = c;
+    }
+  }
+}
+
 /******************************************************************
 is_object_instantiated:
   In: entry: symbol table entry to check
@@ -1908,6 +2189,8 @@ static struct counter *create_new_counter(struct region *where, void *who,
   c->orientation = ORIENT_NOT_SET;
   c->counter_type = what;
   c->periodic_box = img;
+  c->next_same = NULL;
+  c->shard_slot = -1;
   if (what & TRIG_COUNTER) {
     c->data.trig.t_event = 0.0;
     c->data.trig.loc.x = c->data.trig.loc.y = c->data.trig.loc.z = 0.0;
@@ -2059,7 +2342,7 @@ void count_region_list(
         else if ((c->orientation == ORIENT_NOT_SET) ||
                  (c->orientation == sm->orient) || (c->orientation == 0)) {
           if ((inc == 1) && (periodic_boxes_are_identical(
-              sm->periodic_box, c->periodic_box))) {
+              &sm->periodic_box, c->periodic_box))) {
             c->data.move.n_at++;
           }
           else if ((inc == -1) && (previous_box != NULL) &&
@@ -58,6 +58,10 @@ void count_moved_surface_mol(struct volume *world, struct surface_molecule *sm,
 void fire_count_event(struct volume *world, struct counter *event, int n,
                       struct vector3 *where, byte what, u_long id);
 
+struct counter_shard *create_counter_shard(struct volume *world);
+
+void merge_counter_shard(struct volume *world, struct counter_shard *shard);
+
 int place_waypoints(struct volume *world);
 
 int prepare_counters(struct volume *world);
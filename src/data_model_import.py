@@ -2,6 +2,9 @@ import pymcell as m
 import json
 import pickle
 import logging
+import os
+import array
+import struct
 from typing import List, Dict, Tuple, Any
 
 
@@ -21,6 +24,71 @@ def read_pickle_data_model(file_name) -> Dict[str, Any]:
     return pickle_model
 
 
+# Layout of binary mesh files, as read by read_binary_mesh in mcell_objects.c
+BINARY_MESH_MAGIC = b'MCELLPLY'
+BINARY_MESH_VERSION = 1
+# Bump when the layout of the compiled data model cache changes
+DM_CACHE_VERSION = 1
+
+
+def write_binary_mesh(file_name: str, vert_list, face_list) -> None:
+    """ Write vertices and faces as a binary mesh file """
+    verts = array.array('d', (c for v in vert_list for c in v))
+    faces = array.array('I', (i for f in face_list for i in f))
+    with open(file_name, 'wb') as f:
+        f.write(BINARY_MESH_MAGIC)
+        f.write(struct.pack('=III', BINARY_MESH_VERSION, len(vert_list),
+                            len(face_list)))
+        verts.tofile(f)
+        faces.tofile(f)
+
+
+def compile_data_model(dm: Dict[str, Any], cache_dir: str) -> Dict[str, Any]:
+    """ Move the vertices and faces of the meshes of a data model to binary
+    mesh files in cache_dir, and pickle what is left of the data model there
+    """
+    os.makedirs(cache_dir, exist_ok=True)
+    for i, meshobj_dm in enumerate(
+            dm['mcell']['geometrical_objects']['object_list']):
+        mesh_file = "mesh_%d.mcellply" % i
+        write_binary_mesh(os.path.join(cache_dir, mesh_file),
+                          meshobj_dm.pop('vertex_list'),
+                          meshobj_dm.pop('element_connections'))
+        meshobj_dm['binary_mesh'] = mesh_file
+    dm['dm_cache_version'] = DM_CACHE_VERSION
+    with open(os.path.join(cache_dir, "model.pickle"), 'wb') as f:
+        pickle.dump(dm, f, protocol=pickle.HIGHEST_PROTOCOL)
+    return dm
+
+
+def read_data_model(file_name: str) -> Dict[str, Any]:
+    """ Read a CellBlender data model in JSON format, using the compiled form
+    cached next to it (in <file_name>.cache) if it is newer than the file.
+    The meshes of the returned data model refer to binary mesh files instead
+    of holding vertex and face lists. """
+    cache_dir = file_name + ".cache"
+    cache_file = os.path.join(cache_dir, "model.pickle")
+    dm = None
+    try:
+        if os.path.getmtime(cache_file) >= os.path.getmtime(file_name):
+            dm = read_pickle_data_model(cache_file)
+            if dm.get('dm_cache_version') != DM_CACHE_VERSION:
+                dm = None
+    except (OSError, pickle.UnpicklingError, EOFError):
+        dm = None
+    if dm is None:
+        try:
+            dm = compile_data_model(read_json_data_model(file_name), cache_dir)
+        except OSError:
+            logging.warning("Cannot cache compiled data model in %s" %
+                            cache_dir)
+            return read_json_data_model(file_name)
+    for meshobj_dm in dm['mcell']['geometrical_objects']['object_list']:
+        meshobj_dm['binary_mesh'] = os.path.join(
+            cache_dir, meshobj_dm['binary_mesh'])
+    return dm
+
+
 def create_species_from_dm(
         data_model: Dict[str, Any]) -> Dict[str, m.Species]:
     """ Create a dictionary of Species from a CB data model """
@@ -95,9 +163,13 @@ def create_meshobjs_from_dm(
     meshobj_dict = {}
     for meshobj_dm in meshobj_dm_list:
         name = meshobj_dm['name']
-        vert_list = meshobj_dm['vertex_list']
-        face_list = meshobj_dm['element_connections']
-        meshobj = m.MeshObj(name, vert_list, face_list)
+        if 'binary_mesh' in meshobj_dm:
+            meshobj = m.MeshObj(name, None, None,
+                                binary_mesh=meshobj_dm['binary_mesh'])
+        else:
+            vert_list = meshobj_dm['vertex_list']
+            face_list = meshobj_dm['element_connections']
+            meshobj = m.MeshObj(name, vert_list, face_list)
         try:
             for reg_dm in meshobj_dm['define_surface_regions']:
                 reg_name = reg_dm['name']
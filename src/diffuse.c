@@ -38,6 +38,8 @@
 #include "react.h"
 #include "react_nfsim.h"
 #include "nfsim_func.h"
+#include "phase_profile.h"
+#include "mol_id_index.h"
 
 
 #define FREE_COLLISION_LISTS()                                                 \
@@ -114,9 +116,19 @@ void compute_displacement(
   double* rate_factor, double* r_rate_factor, double* steps, double* t_steps,
   double max_time);
 
-void determine_mol_mol_reactions(
+int determine_mol_mol_reactions(
   struct volume* world, struct volume_molecule* vm, struct collision** shead,
-  struct collision** stail, int interness);
+  struct collision** stail, int interness, int defer_immobile);
+
+static void add_mol_mol_collisions(
+  struct volume* world, struct volume_molecule* m, struct volume_molecule* mp,
+  struct per_species_list* psl, struct collision** shead,
+  struct collision** stail, int inertness);
+
+static void determine_immobile_mol_mol_reactions(
+  struct volume* world, struct volume_molecule* m,
+  struct vector3 const* displacement, struct collision** shead,
+  struct collision** stail, int inertness);
 
 void set_inertness_and_maxtime(
   struct volume* world, struct volume_molecule* vm, double* maxtime,
@@ -188,6 +200,8 @@ void pick_2D_displacement(struct vector2 *v, double scale,
 pick_clamped_displacement:
   In: v: vector3 to store the new displacement
       vm: molecule that just came through the surface
+      r_step_surface: step lengths normal to the surface
+      r_step_surface_erfc: erfc of each of those
       rng:
       radial_subdivisions:
   Out: No return value.  vector is set to a random orientation and a
@@ -198,7 +212,9 @@ pick_clamped_displacement:
         vm->index is the orientation we came off with
 *************************************************************************/
 void pick_clamped_displacement(struct vector3 *v, struct volume_molecule *vm,
-                               double *r_step_surface, struct rng_state *rng,
+                               double *r_step_surface,
+                               double *r_step_surface_erfc,
+                               struct rng_state *rng,
                                u_int radial_subdivisions) {
   static const double one_over_2_to_20th = 9.5367431640625e-7;
   struct wall *w = vm->previous_wall;
@@ -206,14 +222,15 @@ void pick_clamped_displacement(struct vector3 *v, struct volume_molecule *vm,
   unsigned int n = rng_uint(rng);
 
   /* Correct distribution along normal from surface (from lookup table) */
-  double r_n = r_step_surface[n & (radial_subdivisions - 1)];
+  u_int r_idx = n & (radial_subdivisions - 1);
+  double r_n = r_step_surface[r_idx];
 
   double p = one_over_2_to_20th * ((n >> 12) + 0.5);
-  double t = r_n / erfcinv(p * erfc(r_n));
+  double t = r_n / erfcinv(p * r_step_surface_erfc[r_idx]);
   struct vector2 r_uv;
-  pick_2D_displacement(&r_uv, sqrt(t) * vm->get_space_step(vm), rng);
+  pick_2D_displacement(&r_uv, sqrt(t) * get_space_step(vm), rng);
 
-  r_n *= vm->index * vm->get_space_step(vm);
+  r_n *= vm->index * get_space_step(vm);
   v->x = r_n * w->normal.x + r_uv.u * w->unit_u.x + r_uv.v * w->unit_v.x;
   v->y = r_n * w->normal.y + r_uv.u * w->unit_u.y + r_uv.v * w->unit_v.y;
   v->z = r_n * w->normal.z + r_uv.u * w->unit_u.z + r_uv.v * w->unit_v.z;
@@ -323,9 +340,37 @@ pick_displacement:
          3D molecule, scaled by the scaling factor.
 *************************************************************************/
 void pick_displacement(struct vector3 *v, double scale, struct rng_state *rng) {
-  v->x = scale * rng_gauss(rng) * .70710678118654752440;
-  v->y = scale * rng_gauss(rng) * .70710678118654752440;
-  v->z = scale * rng_gauss(rng) * .70710678118654752440;
+  double g[3];
+  rng_gauss_n(rng, g, 3);
+  v->x = scale * g[0] * .70710678118654752440;
+  v->y = scale * g[1] * .70710678118654752440;
+  v->z = scale * g[2] * .70710678118654752440;
+}
+
+/*************************************************************************
+pick_displacement_n:
+  In: array of n vector3s to store the new displacements
+      number of displacements to pick
+      scale factor to apply to the displacements
+  Out: No return value.  The vectors are set as by n calls to
+         pick_displacement, drawing the same random numbers in the same
+         order.
+*************************************************************************/
+TARGET_CLONES
+void pick_displacement_n(struct vector3 *v, int n, double scale,
+                         struct rng_state *rng) {
+  double g[3 * DISPLACEMENT_BATCH];
+  while (n > 0) {
+    int m = (n < DISPLACEMENT_BATCH) ? n : DISPLACEMENT_BATCH;
+    rng_gauss_n(rng, g, 3 * m);
+    for (int i = 0; i < m; i++) {
+      v[i].x = scale * g[3 * i] * .70710678118654752440;
+      v[i].y = scale * g[3 * i + 1] * .70710678118654752440;
+      v[i].z = scale * g[3 * i + 2] * .70710678118654752440;
+    }
+    v += m;
+    n -= m;
+  }
 }
 
 /*************************************************************************
@@ -395,7 +440,7 @@ struct vector3* reflect_periodic_2D(
       double t = 0.0;
       int i = collide_wall(
           &updated_xyz, &delta_xyz, wl->this_wall, &t, hit_xyz, 0, state->rng,
-          state->notify, &(state->ray_polygon_tests));
+          state->notify, &(state->stats.ray_polygon_tests));
       if (i != COLLIDE_MISS &&
           (hit_xyz->x - target_xyz.x) * delta_xyz.x +
           (hit_xyz->y - target_xyz.y) * delta_xyz.y +
@@ -449,9 +494,9 @@ void change_boxes_2D(
   double llz = sb->z[0];
   double urz = sb->z[1];
 
-  int x_inc = (sm->periodic_box->x % 2 == 0) ? 1 : -1;
-  int y_inc = (sm->periodic_box->y % 2 == 0) ? 1 : -1;
-  int z_inc = (sm->periodic_box->z % 2 == 0) ? 1 : -1;
+  int x_inc = (sm->periodic_box.x % 2 == 0) ? 1 : -1;
+  int y_inc = (sm->periodic_box.y % 2 == 0) ? 1 : -1;
+  int z_inc = (sm->periodic_box.z % 2 == 0) ? 1 : -1;
   int box_inc_x = 0;
   int box_inc_y = 0;
   int box_inc_z = 0;
@@ -496,9 +541,9 @@ void change_boxes_2D(
   }
 
   if (!(periodic_traditional) && (box_inc_x || box_inc_y || box_inc_z)) {
-    sm->periodic_box->x += box_inc_x;
-    sm->periodic_box->y += box_inc_y;
-    sm->periodic_box->z += box_inc_z;
+    sm->periodic_box.x += box_inc_x;
+    sm->periodic_box.y += box_inc_y;
+    sm->periodic_box.z += box_inc_z;
   }
 }
 
@@ -723,12 +768,11 @@ struct wall *ray_trace_2D(
   struct vector2 this_disp = { .u = disp->u,
                                .v = disp->v
                              };
-  struct periodic_image orig_box = { .x = sm->periodic_box->x,
-                                     .y = sm->periodic_box->y,
-                                     .z = sm->periodic_box->z
-                                   };
+  struct periodic_image orig_box = sm->periodic_box;
+  /* Only the periodic box code needs to know where we are in space */
   struct vector3 origin_xyz;
-  uv2xyz(&this_pos, this_wall, &origin_xyz);
+  if (world->periodic_box_obj)
+    uv2xyz(&this_pos, this_wall, &origin_xyz);
 
   struct rxn *rx = NULL;
   /* Will break out with return or break when we're done traversing walls */
@@ -811,9 +855,7 @@ struct wall *ray_trace_2D(
     if (index_edge_was_hit == -2) {
       sm->s_pos.u = orig_pos.u;
       sm->s_pos.v = orig_pos.v;
-      sm->periodic_box->x = orig_box.x;
-      sm->periodic_box->y = orig_box.y;
-      sm->periodic_box->z = orig_box.z;
+      sm->periodic_box = orig_box;
       *hit_data_info = hit_data_head;
       return NULL;
     }
@@ -853,8 +895,13 @@ struct wall *ray_trace_2D(
     /* no reflection - keep going */
     struct vector2 new_disp;
     if (!reflect_now) {
+      /* Carry both the start and the end of the displacement over the edge */
+      struct vector2 old_end = {.u = old_pos.u + this_disp.u,
+                                .v = old_pos.v + this_disp.v
+                               };
       struct wall *target_wall =
-          traverse_surface(this_wall, &old_pos, index_edge_was_hit, &this_pos);
+          traverse_surface_pair(this_wall, &old_pos, &old_end,
+                                index_edge_was_hit, &this_pos, &new_disp);
 
       if (target_wall != NULL) {
         if (sm->properties->flags & CAN_REGION_BORDER) {
@@ -878,9 +925,6 @@ struct wall *ray_trace_2D(
         }
 
         if (!reflect_now) {
-          this_disp.u = old_pos.u + this_disp.u;
-          this_disp.v = old_pos.v + this_disp.v;
-          traverse_surface(this_wall, &this_disp, index_edge_was_hit, &new_disp);
           this_disp.u = new_disp.u - this_pos.u;
           this_disp.v = new_disp.v - this_pos.v;
           this_wall = target_wall;
@@ -897,7 +941,7 @@ struct wall *ray_trace_2D(
   /* If we reach this point, assume we reflect off the edge since there is no
    * neighboring wall
    *
-   * NOTE: this_pos has been corrupted by traverse_surface; use old_pos to find
+   * NOTE: this_pos has been corrupted by traverse_surface_pair; use old_pos to find
    * out whether the present wall edge is a region border
    */
     new_disp.u = this_disp.u - (boundary_pos.u - old_pos.u);
@@ -970,33 +1014,34 @@ struct collision *ray_trace(struct volume *world, struct vector3 *init_pos,
      will cross the x,y,z partitions, respectively. */
   double tx, ty, tz;
 
-  world->ray_voxel_tests++;
+  world->stats.ray_voxel_tests++;
 
   struct collision *shead = NULL;
   struct collision *smash = (struct collision *)CHECKED_MEM_GET(
       sv->local_storage->coll, "collision structure");
 
-  struct wall_list fake_wlp;
-  fake_wlp.next = sv->wall_head;
-
-  // Check wall collisions
-  for (struct wall_list *wlp = sv->wall_head; wlp != NULL; wlp = wlp->next) {
-    if (wlp->this_wall == reflectee)
-      continue;
-
-    int i = collide_wall(init_pos, v, wlp->this_wall, &(smash->t), &(smash->loc),
-                     1, world->rng, world->notify, &(world->ray_polygon_tests));
+  // Check wall collisions; walls whose plane we do not cross are skipped
+  // without touching the wall itself
+  int n_planes = sv->wall_planes.n;
+  for (int wi = 0;
+       (wi = next_wall_candidate(&sv->wall_planes, wi, init_pos, v,
+                                 reflectee, world->notify,
+                                 &(world->stats.ray_polygon_tests))) < n_planes;
+       wi++) {
+    struct wall *w = sv->wall_planes.wall[wi];
+    int i = collide_wall(init_pos, v, w, &(smash->t), &(smash->loc),
+                     1, world->rng, world->notify, &(world->stats.ray_polygon_tests));
     if (i == COLLIDE_REDO) {
       if (shead != NULL)
         mem_put_list(sv->local_storage->coll, shead);
       shead = NULL;
-      wlp = &fake_wlp;
+      wi = -1;
       continue;
     } else if (i != COLLIDE_MISS) {
-      world->ray_polygon_colls++;
+      world->stats.ray_polygon_colls++;
 
       smash->what = COLLIDE_WALL + i;
-      smash->target = (void *)wlp->this_wall;
+      smash->target = (void *)w;
       smash->next = shead;
       shead = smash;
       smash = (struct collision *)CHECKED_MEM_GET(sv->local_storage->coll,
@@ -1122,19 +1167,40 @@ struct collision *ray_trace(struct volume *world, struct vector3 *init_pos,
   smash->next = shead;
   shead = smash;
 
-  // Check molecule collisions
-  for (; c != NULL; c = c->next) {
-    struct abstract_molecule *a = (struct abstract_molecule *)c->target;
-    if (a->properties == NULL)
-      continue;
+  // Check molecule collisions, COLLIDE_MOL_BATCH partners at a time
+  while (c != NULL) {
+    struct collision *batch[COLLIDE_MOL_BATCH];
+    double px[COLLIDE_MOL_BATCH], py[COLLIDE_MOL_BATCH], pz[COLLIDE_MOL_BATCH];
+    double t[COLLIDE_MOL_BATCH];
+    int hit[COLLIDE_MOL_BATCH];
+    int n = 0;
+    for (; c != NULL && n < COLLIDE_MOL_BATCH; c = c->next) {
+      struct abstract_molecule *a = (struct abstract_molecule *)c->target;
+      if (a->properties == NULL || (a->properties->flags & ON_GRID) != 0)
+        continue;
+      struct vector3 const *pos = &((struct volume_molecule *)a)->pos;
+      batch[n] = c;
+      px[n] = pos->x;
+      py[n] = pos->y;
+      pz[n] = pos->z;
+      n++;
+    }
+
+    collide_mol_batch(init_pos, v, px, py, pz, n, world->rx_radius_3d, hit, t);
+    for (int k = 0; k < n; k++) {
+      if (!hit[k])
+        continue;
+      struct collision *cand = batch[k];
+      cand->t = t[k];
+      cand->loc.x = init_pos->x + t[k] * v->x;
+      cand->loc.y = init_pos->y + t[k] * v->y;
+      cand->loc.z = init_pos->z + t[k] * v->z;
 
-    i = collide_mol(init_pos, v, a, &(c->t), &(c->loc), world->rx_radius_3d);
-    if (i != COLLIDE_MISS) {
       smash = (struct collision *)CHECKED_MEM_GET(sv->local_storage->coll,
                                                   "collision structure");
-      memcpy(smash, c, sizeof(struct collision));
+      memcpy(smash, cand, sizeof(struct collision));
 
-      smash->what = COLLIDE_VOL + i;
+      smash->what = COLLIDE_VOL + COLLIDE_VOL_M;
 
       smash->next = shead;
       shead = smash;
@@ -1335,7 +1401,6 @@ double exact_disk(struct volume *world, struct vector3 *loc, struct vector3 *mv,
 #define EXD_TIME_CALC(v1, v2, p)                                               \
   ((p)->u *(v1)->v - (p)->v *(v1)->u) /                                        \
       ((p)->v *((v2)->u - (v1)->u) - (p)->u *((v2)->v - (v1)->v))
-  struct wall_list *wl;
   struct wall *w;
   struct vector3 llf, urb;
 
@@ -1351,7 +1416,6 @@ double exact_disk(struct volume *world, struct vector3 *loc, struct vector3 *mv,
   struct exd_vector3 Lmuv;
   struct exd_vertex sm;
   double m2_i;
-  double l_n, m_n;
   double a, b, c, d, r, s, t, A, zeta, last_zeta;
   int i;
   int num_matching_rxns = 0;
@@ -1386,21 +1450,13 @@ double exact_disk(struct volume *world, struct vector3 *loc, struct vector3 *mv,
     sm.zeta = exd_zetize(sm.v, sm.u);
   }
 
-  /* Find walls that occlude the interaction disk (or block the reaction) */
-  for (wl = sv->wall_head; wl != NULL; wl = wl->next) {
-    w = wl->this_wall;
-
-    /* Ignore this wall if it is too far away! */
-
-    /* Find distance from plane of wall to molecule */
-    l_n = loc->x * w->normal.x + loc->y * w->normal.y + loc->z * w->normal.z;
-    d = w->d - l_n;
-
-    /* See if we're within interaction distance of wall */
-    m_n = mv->x * w->normal.x + mv->y * w->normal.y + mv->z * w->normal.z;
-
-    if (d * d >= R2 * (1 - m2_i * m_n * m_n))
-      continue;
+  /* Find walls that occlude the interaction disk (or block the reaction).
+   * Walls too far away are skipped by looking at their planes only. */
+  int n_planes = sv->wall_planes.n;
+  for (int wi = 0; (wi = next_disk_wall_candidate(&sv->wall_planes, wi, loc,
+                                                  mv, R2, m2_i)) < n_planes;
+       wi++) {
+    w = sv->wall_planes.wall[wi];
 
     /* Ignore this wall if no overlap between wall & disk bounding boxes */
 
@@ -2255,7 +2311,7 @@ double safe_diffusion_step(struct volume_molecule *vm, struct collision *shead,
   double steps;
   struct volume_molecule *mp;
 
-  d2_nearmax = vm->get_space_step(vm) *
+  d2_nearmax = get_space_step(vm) *
                r_step[(int)(radial_subdivisions * MULTISTEP_PERCENTILE)];
   d2_nearmax *= d2_nearmax;
 
@@ -2322,6 +2378,157 @@ double safe_diffusion_step(struct volume_molecule *vm, struct collision *shead,
   return steps;
 }
 
+/****************************************************************************
+adaptive_diffusion_step:
+  In: world: simulation state
+      vm: molecule that is moving
+      shead: linked list of potential collisions with molecules from the
+             starting subvolume
+      max_time: the most time the molecule may spend diffusing
+  Out: The estimated number of diffusion steps this molecule can take before
+       something interesting might happen to it, or 1.0 if something might
+       happen within one timestep.
+  Note: Same estimate as safe_diffusion_step, except that the search is not
+        stopped at the faces of the molecule's own subvolume: walls and
+        reaction partners are looked for in up to ADAPTIVE_STEP_RINGS
+        subvolumes on either side along each axis, as far out as max_time
+        could take the molecule.  Subvolumes that belong to a different
+        storage are not read (another thread may be moving their molecules)
+        and count as an obstacle at their nearest point instead.
+****************************************************************************/
+double adaptive_diffusion_step(struct volume *world,
+                               struct volume_molecule *vm,
+                               struct collision *shead, double max_time) {
+  if (vm->properties->flags & EXTERNAL_SPECIES)
+    return safe_diffusion_step(vm, shead, world->radial_subdivisions,
+                               world->r_step, world->x_fineparts,
+                               world->y_fineparts, world->z_fineparts);
+
+  double max_steps = max_time / get_time_step(vm);
+  if (max_steps < MULTISTEP_WORTHWHILE)
+    return 1.0;
+
+  double d2_nearmax =
+      get_space_step(vm) *
+      world->r_step[(int)(world->radial_subdivisions * MULTISTEP_PERCENTILE)];
+  d2_nearmax *= d2_nearmax;
+
+  /* Nothing further away than this can limit the step */
+  double d2min = d2_nearmax * max_steps * max_steps;
+
+  struct subvolume *sv = vm->subvol;
+  const int sv_index = sv - world->subvol;
+  const int n_yz = (world->ny_parts - 1) * (world->nz_parts - 1);
+  int part[3];
+  part[0] = sv_index / n_yz;
+  part[1] = (sv_index - part[0] * n_yz) / (world->nz_parts - 1);
+  part[2] = sv_index - part[0] * n_yz - part[1] * (world->nz_parts - 1);
+
+  double *partitions[3] = { world->x_partitions, world->y_partitions,
+                            world->z_partitions };
+  const int n_parts[3] = { world->nx_parts, world->ny_parts, world->nz_parts };
+  const double pos[3] = { vm->pos.x, vm->pos.y, vm->pos.z };
+
+  /* Grow the searched block of subvolumes along each axis; its faces bound
+   * the step just like the faces of a single subvolume do */
+  int lo[3], hi[3];
+  for (int a = 0; a < 3; a++) {
+    double d2;
+    for (lo[a] = part[a]; lo[a] > 0 && part[a] - lo[a] < ADAPTIVE_STEP_RINGS;
+         lo[a]--) {
+      d2 = pos[a] - partitions[a][lo[a]];
+      if (d2 * d2 >= d2min)
+        break;
+    }
+    d2 = pos[a] - partitions[a][lo[a]];
+    if (d2 * d2 < d2min)
+      d2min = d2 * d2;
+
+    for (hi[a] = part[a];
+         hi[a] < n_parts[a] - 2 && hi[a] - part[a] < ADAPTIVE_STEP_RINGS;
+         hi[a]++) {
+      d2 = partitions[a][hi[a] + 1] - pos[a];
+      if (d2 * d2 >= d2min)
+        break;
+    }
+    d2 = partitions[a][hi[a] + 1] - pos[a];
+    if (d2 * d2 < d2min)
+      d2min = d2 * d2;
+  }
+
+  int check_mols =
+      ((vm->properties->flags & (CAN_VOLVOL | CANT_INITIATE)) == CAN_VOLVOL);
+  for (int px = lo[0]; px <= hi[0]; px++) {
+    for (int py = lo[1]; py <= hi[1]; py++) {
+      for (int pz = lo[2]; pz <= hi[2]; pz++) {
+        struct subvolume *nsv =
+            &world->subvol[pz + (world->nz_parts - 1) *
+                                    (py + (world->ny_parts - 1) * px)];
+
+        if (nsv->local_storage != sv->local_storage) {
+          int np[3] = { px, py, pz };
+          double d2 = 0.0;
+          for (int a = 0; a < 3; a++) {
+            double d = 0.0;
+            if (pos[a] < partitions[a][np[a]])
+              d = partitions[a][np[a]] - pos[a];
+            else if (pos[a] > partitions[a][np[a] + 1])
+              d = pos[a] - partitions[a][np[a] + 1];
+            d2 += d * d;
+          }
+          if (d2 < d2min)
+            d2min = d2;
+          continue;
+        }
+
+        struct wall_planes const *planes = &nsv->wall_planes;
+        for (int wi = 0; wi < planes->n; wi++) {
+          double d = planes->nx[wi] * vm->pos.x + planes->ny[wi] * vm->pos.y +
+                     planes->nz[wi] * vm->pos.z - planes->d[wi];
+          if (d * d < d2min)
+            d2min = d * d;
+        }
+
+        if (!check_mols)
+          continue;
+
+        for (struct per_species_list *psl = nsv->species_head; psl != NULL;
+             psl = psl->next) {
+          if (psl->properties == NULL || psl->n_mols == 0)
+            continue;
+
+          if (!trigger_bimolecular_preliminary(
+                  world->reaction_hash, world->rx_hashsize,
+                  vm->properties->hashval, psl->properties->hashval,
+                  vm->properties, psl->properties))
+            continue;
+
+          for (int mi = psl->n_mols - 1; mi >= 0; mi--) {
+            struct volume_molecule *mp = psl->mols[mi];
+            if (mp == vm ||
+                !periodic_images_equal(&vm->periodic_box, &mp->periodic_box))
+              continue;
+
+            double d2 = (vm->pos.x - mp->pos.x) * (vm->pos.x - mp->pos.x) +
+                        (vm->pos.y - mp->pos.y) * (vm->pos.y - mp->pos.y) +
+                        (vm->pos.z - mp->pos.z) * (vm->pos.z - mp->pos.z);
+            if (d2 < d2min)
+              d2min = d2;
+          }
+        }
+      }
+    }
+  }
+
+  if (d2min < d2_nearmax)
+    return 1.0;
+
+  double steps_sq = d2min / d2_nearmax;
+  if (steps_sq < MULTISTEP_WORTHWHILE * MULTISTEP_WORTHWHILE)
+    return 1.0;
+  return sqrt(steps_sq);
+}
+
 /****************************************************************************
 expand_collision_list_for_neighbor:
   This is a helper function to reduce duplicated code in expand_collision_list.
@@ -2422,17 +2629,17 @@ static struct collision *expand_collision_list_for_neighbor(struct volume *world
     }
 
     /* Garbage collection of empty per-species lists */
-    if (psl->head == NULL) {
+    if (psl->n_mols == 0) {
       *psl_head = psl->next;
-      ht_remove(&new_sv->mol_by_species, psl);
-      mem_put(new_sv->local_storage->pslv, psl);
+      free_species_list(new_sv, psl);
       continue;
     } else
       psl_head = &psl->next;
 
     /* no possible reactions. skip it. */
     if(vm->properties->flags & EXTERNAL_SPECIES){
-      if(!trigger_bimolecular_preliminary_nfsim((struct abstract_molecule *)vm, (struct abstract_molecule *)psl->head))
+      if(!trigger_bimolecular_preliminary_nfsim(world, (struct abstract_molecule *)vm,
+                                                (struct abstract_molecule *)psl->mols[psl->n_mols - 1]))
         continue;
       
     }
@@ -2443,7 +2650,8 @@ static struct collision *expand_collision_list_for_neighbor(struct volume *world
              psl->properties->hashval, vm->properties, psl->properties))
       continue;
     }
-    for (struct volume_molecule *mp = psl->head; mp != NULL; mp = mp->next_v) {
+    for (int mi = psl->n_mols - 1; mi >= 0; mi--) {
+      struct volume_molecule *mp = psl->mols[mi];
       /* Skip defunct molecules */
       if (mp->properties == NULL)
         continue;
@@ -2456,7 +2664,7 @@ static struct collision *expand_collision_list_for_neighbor(struct volume *world
       if (mp->pos.z < z_min || mp->pos.z > z_max)
         continue;
       // count only in the relevant periodic box
-      if (!periodic_boxes_are_identical(vm->periodic_box, mp->periodic_box)) {
+      if (!periodic_images_equal(&vm->periodic_box, &mp->periodic_box)) {
         continue;
       }
 
@@ -2504,8 +2712,6 @@ expand_collision_list:
       mv: displacement to the new location
       sv: subvolume that we start in
       rx_radius_3d:
-      ny_parts:
-      nz_parts:
       x_fineparts:
       y_fineparts:
       z_fineparts:
@@ -2517,8 +2723,8 @@ expand_collision_list:
 static struct collision *
 expand_collision_list(struct volume *world, struct volume_molecule *vm, struct vector3 *mv,
                       struct subvolume *sv, double rx_radius_3d,
-                      int ny_parts, int nz_parts, double *x_fineparts,
-                      double *y_fineparts, double *z_fineparts, int rx_hashsize,
+                      double *x_fineparts, double *y_fineparts,
+                      double *z_fineparts, int rx_hashsize,
                       struct rxn **reaction_hash) {
   struct collision *shead1 = NULL;
   /* neighbors of the current subvolume */
@@ -2528,192 +2734,32 @@ expand_collision_list(struct volume *world, struct volume_molecule *vm, struct v
   /* find the molecule path bounding box. */
   path_bounding_box(&vm->pos, mv, &path_llf, &path_urb, rx_radius_3d);
 
-  /* Decide which directions we need to go */
-  int x_neg = 0, x_pos = 0, y_neg = 0, y_pos = 0, z_neg = 0, z_pos = 0;
-  if (!(sv->world_edge & X_POS_BIT) && path_urb.x + R > x_fineparts[sv->urb.x])
-    x_pos = 1;
-  if (!(sv->world_edge & X_NEG_BIT) && path_llf.x - R < x_fineparts[sv->llf.x])
-    x_neg = 1;
-  if (!(sv->world_edge & Y_POS_BIT) && path_urb.y + R > y_fineparts[sv->urb.y])
-    y_pos = 1;
-  if (!(sv->world_edge & Y_NEG_BIT) && path_llf.y - R < y_fineparts[sv->llf.y])
-    y_neg = 1;
-  if (!(sv->world_edge & Z_POS_BIT) && path_urb.z + R > z_fineparts[sv->urb.z])
-    z_pos = 1;
-  if (!(sv->world_edge & Z_NEG_BIT) && path_llf.z - R < z_fineparts[sv->llf.z])
-    z_neg = 1;
-
-  /* go in the direction X_POS */
-  if (x_pos) {
-    struct subvolume *new_sv = sv + (nz_parts - 1) * (ny_parts - 1);
-    shead1 = expand_collision_list_for_neighbor(world,
-        sv, vm, new_sv, &path_llf, &path_urb, shead1, R, 0.0, 0.0, x_fineparts,
-        y_fineparts, z_fineparts, rx_hashsize, reaction_hash);
-
-    /* go +X, +Y) */
-    if (y_pos) {
-      struct subvolume *new_sv_y = new_sv + (nz_parts - 1);
-      shead1 = expand_collision_list_for_neighbor(world,
-          sv, vm, new_sv_y, &path_llf, &path_urb, shead1, R, R, 0.0, x_fineparts,
-          y_fineparts, z_fineparts, rx_hashsize, reaction_hash);
-
-      /* go +X, +Y, +Z) */
-      if (z_pos)
-        shead1 = expand_collision_list_for_neighbor(world,
-            sv, vm, new_sv_y + 1, &path_llf, &path_urb, shead1, R, R, R,
-            x_fineparts, y_fineparts, z_fineparts, rx_hashsize, reaction_hash);
-
-      /* go +X, +Y, -Z */
-      if (z_neg)
-        shead1 = expand_collision_list_for_neighbor(world,
-            sv, vm, new_sv_y - 1, &path_llf, &path_urb, shead1, R, R, -R,
-            x_fineparts, y_fineparts, z_fineparts, rx_hashsize, reaction_hash);
-    }
-
-    /* go +X, -Y) */
-    if (y_neg) {
-      struct subvolume *new_sv_y = new_sv - (nz_parts - 1);
-      shead1 = expand_collision_list_for_neighbor(world,
-          sv, vm, new_sv_y, &path_llf, &path_urb, shead1, R, -R, 0.0,
-          x_fineparts, y_fineparts, z_fineparts, rx_hashsize, reaction_hash);
-
-      /* go +X, -Y, +Z) */
-      if (z_pos)
-        shead1 = expand_collision_list_for_neighbor(world,
-            sv, vm, new_sv_y + 1, &path_llf, &path_urb, shead1, R, -R, R,
-            x_fineparts, y_fineparts, z_fineparts, rx_hashsize, reaction_hash);
-
-      /* go +X, -Y, -Z */
-      if (z_neg)
-        shead1 = expand_collision_list_for_neighbor(world,
-            sv, vm, new_sv_y - 1, &path_llf, &path_urb, shead1, R, -R, -R,
-            x_fineparts, y_fineparts, z_fineparts, rx_hashsize, reaction_hash);
-    }
-
-    /* go +X, +Z) */
-    if (z_pos)
-      shead1 = expand_collision_list_for_neighbor(world,
-          sv, vm, new_sv + 1, &path_llf, &path_urb, shead1, R, 0.0, R,
-          x_fineparts, y_fineparts, z_fineparts, rx_hashsize, reaction_hash);
-
-    /* go +X, -Z */
-    if (z_neg)
-      shead1 = expand_collision_list_for_neighbor(world,
-          sv, vm, new_sv - 1, &path_llf, &path_urb, shead1, R, 0.0, -R,
-          x_fineparts, y_fineparts, z_fineparts, rx_hashsize, reaction_hash);
-  }
-
-  /* go in the direction X_NEG */
-  if (x_neg) {
-    struct subvolume *new_sv = sv - (nz_parts - 1) * (ny_parts - 1);
-    shead1 = expand_collision_list_for_neighbor(world,
-        sv, vm, new_sv, &path_llf, &path_urb, shead1, -R, 0.0, 0.0, x_fineparts,
-        y_fineparts, z_fineparts, rx_hashsize, reaction_hash);
-
-    /* go -X, +Y) */
-    if (y_pos) {
-      struct subvolume *new_sv_y = new_sv + (nz_parts - 1);
-      shead1 = expand_collision_list_for_neighbor(world,
-          sv, vm, new_sv_y, &path_llf, &path_urb, shead1, -R, R, 0.0,
-          x_fineparts, y_fineparts, z_fineparts, rx_hashsize, reaction_hash);
-
-      /* go -X, +Y, +Z) */
-      if (z_pos)
-        shead1 = expand_collision_list_for_neighbor(world,
-            sv, vm, new_sv_y + 1, &path_llf, &path_urb, shead1, -R, R, R,
-            x_fineparts, y_fineparts, z_fineparts, rx_hashsize, reaction_hash);
-
-      /* go -X, +Y, -Z */
-      if (z_neg)
-        shead1 = expand_collision_list_for_neighbor(world,
-            sv, vm, new_sv_y - 1, &path_llf, &path_urb, shead1, -R, R, -R,
-            x_fineparts, y_fineparts, z_fineparts, rx_hashsize, reaction_hash);
-    }
-
-    /* go -X, -Y) */
-    if (y_neg) {
-      struct subvolume *new_sv_y = new_sv - (nz_parts - 1);
-      shead1 = expand_collision_list_for_neighbor(world,
-          sv, vm, new_sv_y, &path_llf, &path_urb, shead1, -R, -R, 0.0,
-          x_fineparts, y_fineparts, z_fineparts, rx_hashsize, reaction_hash);
-
-      /* go -X, -Y, +Z) */
-      if (z_pos)
-        shead1 = expand_collision_list_for_neighbor(world,
-            sv, vm, new_sv_y + 1, &path_llf, &path_urb, shead1, -R, -R, R,
-            x_fineparts, y_fineparts, z_fineparts, rx_hashsize, reaction_hash);
-
-      /* go -X, -Y, -Z */
-      if (z_neg)
-        shead1 = expand_collision_list_for_neighbor(world,
-            sv, vm, new_sv_y - 1, &path_llf, &path_urb, shead1, -R, -R, -R,
-            x_fineparts, y_fineparts, z_fineparts, rx_hashsize, reaction_hash);
-    }
-
-    /* go -X, +Z) */
-    if (z_pos)
-      shead1 = expand_collision_list_for_neighbor(world,
-          sv, vm, new_sv + 1, &path_llf, &path_urb, shead1, -R, 0.0, R,
-          x_fineparts, y_fineparts, z_fineparts, rx_hashsize, reaction_hash);
-
-    /* go -X, -Z */
-    if (z_neg)
-      shead1 = expand_collision_list_for_neighbor(world,
-          sv, vm, new_sv - 1, &path_llf, &path_urb, shead1, -R, 0.0, -R,
-          x_fineparts, y_fineparts, z_fineparts, rx_hashsize, reaction_hash);
-  }
-
-  /* go in the direction Y_POS */
-  if (y_pos) {
-    struct subvolume *new_sv = sv + (nz_parts - 1);
-    shead1 = expand_collision_list_for_neighbor(world,
-        sv, vm, new_sv, &path_llf, &path_urb, shead1, 0.0, R, 0.0, x_fineparts,
-        y_fineparts, z_fineparts, rx_hashsize, reaction_hash);
-
-    /* go +Y, +Z) */
-    if (z_pos)
-      shead1 = expand_collision_list_for_neighbor(world,
-          sv, vm, new_sv + 1, &path_llf, &path_urb, shead1, 0.0, R, R,
-          x_fineparts, y_fineparts, z_fineparts, rx_hashsize, reaction_hash);
-
-    /* go +Y, -Z */
-    if (z_neg)
-      shead1 = expand_collision_list_for_neighbor(world,
-          sv, vm, new_sv - 1, &path_llf, &path_urb, shead1, 0.0, R, -R,
-          x_fineparts, y_fineparts, z_fineparts, rx_hashsize, reaction_hash);
-  }
-
-  /* go in the direction Y_NEG */
-  if (y_neg) {
-    struct subvolume *new_sv = sv - (nz_parts - 1);
-    shead1 = expand_collision_list_for_neighbor(world,
-        sv, vm, new_sv, &path_llf, &path_urb, shead1, 0.0, -R, 0.0, x_fineparts,
-        y_fineparts, z_fineparts, rx_hashsize, reaction_hash);
-
-    /* go -Y, +Z) */
-    if (z_pos)
-      shead1 = expand_collision_list_for_neighbor(world,
-          sv, vm, new_sv + 1, &path_llf, &path_urb, shead1, 0.0, -R, R,
-          x_fineparts, y_fineparts, z_fineparts, rx_hashsize, reaction_hash);
-
-    /* go -Y, -Z */
-    if (z_neg)
-      shead1 = expand_collision_list_for_neighbor(world,
-          sv, vm, new_sv - 1, &path_llf, &path_urb, shead1, 0.0, -R, -R,
-          x_fineparts, y_fineparts, z_fineparts, rx_hashsize, reaction_hash);
-  }
-
-  /* go in the direction Z_POS */
-  if (z_pos)
-    shead1 = expand_collision_list_for_neighbor(world,
-        sv, vm, sv + 1, &path_llf, &path_urb, shead1, 0.0, 0.0, R, x_fineparts,
-        y_fineparts, z_fineparts, rx_hashsize, reaction_hash);
-
-  /* go in the direction Z_NEG */
-  if (z_neg)
+  /* Decide which directions we need to go; never off the world */
+  int reach = 0;
+  if (path_urb.x + R > x_fineparts[sv->urb.x])
+    reach |= X_POS_BIT;
+  if (path_llf.x - R < x_fineparts[sv->llf.x])
+    reach |= X_NEG_BIT;
+  if (path_urb.y + R > y_fineparts[sv->urb.y])
+    reach |= Y_POS_BIT;
+  if (path_llf.y - R < y_fineparts[sv->llf.y])
+    reach |= Y_NEG_BIT;
+  if (path_urb.z + R > z_fineparts[sv->urb.z])
+    reach |= Z_POS_BIT;
+  if (path_llf.z - R < z_fineparts[sv->llf.z])
+    reach |= Z_NEG_BIT;
+  reach &= ~sv->world_edge;
+
+  /* search the faces, edges and corners of the neighbors reached */
+  struct neighbor_reach const *nr =
+      world->neighbor_reach + world->neighbor_reach_start[reach];
+  struct neighbor_reach const *nr_end =
+      world->neighbor_reach + world->neighbor_reach_start[reach + 1];
+  for (; nr < nr_end; nr++)
     shead1 = expand_collision_list_for_neighbor(world,
-        sv, vm, sv - 1, &path_llf, &path_urb, shead1, 0.0, 0.0, -R, x_fineparts,
-        y_fineparts, z_fineparts, rx_hashsize, reaction_hash);
+        sv, vm, sv + nr->offset, &path_llf, &path_urb, shead1, nr->dir[0] * R,
+        nr->dir[1] * R, nr->dir[2] * R, x_fineparts, y_fineparts, z_fineparts,
+        rx_hashsize, reaction_hash);
 
   return shead1;
 }
@@ -2732,7 +2778,8 @@ expand_collision_partner_list_for_neighbor:
     trim = 0: The subvolume is adjacent along this axis.  Search the entire
               width of this axis of the subvolume.
 
-  In: struct subvolume *sv - the "current" subvolume
+  In: struct volume *world - the simulation state
+      struct subvolume *sv - the "current" subvolume
       struct volume_molecule *vm - the current molecule
       struct vector3 *mv - displacement to the new location
       struct subvolume *new_sv - adjacent subvolume to search
@@ -2749,7 +2796,7 @@ expand_collision_partner_list_for_neighbor:
        bounding box intersects with the subvolume bounding box.
 ****************************************************************************/
 struct sp_collision *expand_collision_partner_list_for_neighbor(
-    struct subvolume *sv, struct volume_molecule *vm, struct vector3 *mv,
+    struct volume *world, struct subvolume *sv, struct volume_molecule *vm, struct vector3 *mv,
     struct subvolume *new_sv, struct vector3 *path_llf,
     struct vector3 *path_urb, struct sp_collision *shead1, double trim_x,
     double trim_y, double trim_z, double *x_fineparts, double *y_fineparts,
@@ -2828,18 +2875,17 @@ struct sp_collision *expand_collision_partner_list_for_neighbor(
     }
 
     /* Garbage collection of empty per-species lists */
-    if (psl->head == NULL) {
+    if (psl->n_mols == 0) {
       *psl_head = psl->next;
-      ht_remove(&new_sv->mol_by_species, psl);
-      mem_put(new_sv->local_storage->pslv, psl);
+      free_species_list(new_sv, psl);
       continue;
     } else
       psl_head = &psl->next;
 
     int preliminary_check = 0;
     if(spec->flags & EXTERNAL_SPECIES){
-        preliminary_check =trigger_bimolecular_preliminary_nfsim((struct abstract_molecule *)vm, 
-                                                                 (struct abstract_molecule *)psl->head);
+        preliminary_check =trigger_bimolecular_preliminary_nfsim(world, (struct abstract_molecule *)vm, 
+                                                                 (struct abstract_molecule *)psl->mols[psl->n_mols - 1]);
 
     }
     else{
@@ -2860,7 +2906,8 @@ struct sp_collision *expand_collision_partner_list_for_neighbor(
     if (col_bi_molecular_flag || col_tri_molecular_flag ||
         col_mol_mol_grid_flag) {
       struct volume_molecule *mp;
-      for (mp = psl->head; mp != NULL; mp = mp->next_v) {
+      for (int mi = psl->n_mols - 1; mi >= 0; mi--) {
+        mp = psl->mols[mi];
         /* Skip defunct molecules */
         if (mp->properties == NULL)
           continue;
@@ -2908,20 +2955,115 @@ struct sp_collision *expand_collision_partner_list_for_neighbor(
 }
 
 /*************************************************************************
-diffuse_3D:
+step_stays_in_subvolume:
+  In: world: simulation state
+      sv: subvolume the molecule is in
+      pos: where the step starts
+      disp: displacement of the step
+      reflectee: wall the step starts from and cannot hit, or NULL
+  Out: 1 if the whole step stays inside sv and crosses the plane of none
+       of its walls other than reflectee, 0 otherwise.  When 1 is
+       returned, ray_trace would find nothing to hit but the subvolume
+       boundary beyond the end of the step, and the ray tracing statistics
+       are updated as ray_trace would update them.
+
+*************************************************************************/
+int step_stays_in_subvolume(struct volume *world, struct subvolume *sv,
+                            struct vector3 *pos, struct vector3 *disp,
+                            struct wall *reflectee) {
+  /* Time at which the step leaves the subvolume along each axis, computed
+   * as in ray_trace */
+  if (disp->x < 0.0 &&
+      (world->x_fineparts[sv->llf.x] - pos->x) / disp->x < 1.0)
+    return 0;
+  if (disp->x > 0.0 &&
+      (world->x_fineparts[sv->urb.x] - pos->x) / disp->x < 1.0)
+    return 0;
+  if (disp->y < 0.0 &&
+      (world->y_fineparts[sv->llf.y] - pos->y) / disp->y < 1.0)
+    return 0;
+  if (disp->y > 0.0 &&
+      (world->y_fineparts[sv->urb.y] - pos->y) / disp->y < 1.0)
+    return 0;
+  if (disp->z < 0.0 &&
+      (world->z_fineparts[sv->llf.z] - pos->z) / disp->z < 1.0)
+    return 0;
+  if (disp->z > 0.0 &&
+      (world->z_fineparts[sv->urb.z] - pos->z) / disp->z < 1.0)
+    return 0;
+
+  long long polygon_tests = 0;
+  if (next_wall_candidate(&sv->wall_planes, 0, pos, disp, reflectee,
+                          world->notify, &polygon_tests) < sv->wall_planes.n)
+    return 0;
+
+  world->stats.ray_voxel_tests++;
+  world->stats.ray_polygon_tests += polygon_tests;
+  return 1;
+}
+
+/*************************************************************************
+reflect_off_wall:
+  In: world: simulation state
+      smash: the wall collision
+      displacement: remaining displacement of the molecule
+      vm: molecule that is moving
+      reflectee: set to the wall the molecule reflected from
+      tentative: tentative collisions that may need counting
+      t_steps: length of the step
+  Out: No return value.  The displacement is reflected about the wall and
+       shortened to what is left of the step, as reflect_or_periodic_bc
+       does for a wall that is not part of a periodic box.
+*************************************************************************/
+static void reflect_off_wall(struct volume *world, struct collision *smash,
+                             struct vector3 *displacement,
+                             struct volume_molecule *vm,
+                             struct wall **reflectee,
+                             struct collision **tentative, double *t_steps) {
+  struct wall *reflect_w = (struct wall *)smash->target;
+  double reflect_t = smash->t;
+  register_hits(world, vm, tentative, &reflect_w, &reflect_t, displacement,
+    smash, t_steps);
+  (*reflectee) = reflect_w;
+
+  double reflectFactor = -2.0 * (displacement->x * reflect_w->normal.x +
+    displacement->y * reflect_w->normal.y + displacement->z *
+    reflect_w->normal.z);
+  displacement->x = (displacement->x + reflectFactor * reflect_w->normal.x) *
+    (1.0 - reflect_t);
+  displacement->y = (displacement->y + reflectFactor * reflect_w->normal.y) *
+    (1.0 - reflect_t);
+  displacement->z = (displacement->z + reflectFactor * reflect_w->normal.z) *
+    (1.0 - reflect_t);
+}
+
+/*************************************************************************
+hits_periodic_boundary:
+  In: smash: the wall collision
+  Out: 1 if the wall is a face of a periodic box hit from the inside, 0
+       otherwise.  Any other wall is a plain reflection, which is all
+       reflect_or_periodic_bc would do with it.
+*************************************************************************/
+static inline int hits_periodic_boundary(struct collision const *smash) {
+  struct object const *o = ((struct wall *)smash->target)->parent_object;
+  return (o->periodic_x || o->periodic_y || o->periodic_z) &&
+         (smash->what & COLLIDE_MASK) != COLLIDE_FRONT;
+}
+
+/*************************************************************************
+diffuse_3D_with:
   In: world: simulation state
       vm: molecule that is moving
       max_time: maximum time we can spend diffusing
-  Out: Pointer to the molecule if it still exists (may have been
-       reallocated), NULL otherwise.
-       Position and time are updated, but molecule is not rescheduled.
-  Note: This version takes into account only 2-way reactions and 3-way
-        reactions of type MOL_GRID_GRID
+      expanded_list: whether collision lists reach into neighbor subvolumes
+      periodic: whether the world has a periodic box
+  Out: As diffuse_3D.
+  Note: This is always inlined, so that callers passing constant features
+        get a copy of the loop with the unused feature code dropped.
 *************************************************************************/
-struct volume_molecule *diffuse_3D(
-    struct volume *world,
-    struct volume_molecule *vm,
-    double max_time) {
+static inline __attribute__((always_inline)) struct volume_molecule *
+diffuse_3D_with(struct volume *world, struct volume_molecule *vm,
+                double max_time, const int expanded_list, const int periodic) {
 
   struct species* spec = vm->properties;
   if (spec == NULL) {
@@ -2934,7 +3076,7 @@ struct volume_molecule *diffuse_3D(
   int mol_grid_flag = ((spec->flags & CAN_VOLSURF) == CAN_VOLSURF);
   int mol_grid_grid_flag = ((spec->flags & CAN_VOLSURFSURF) == CAN_VOLSURFSURF);
 
-  if (vm->get_space_step(vm) <= 0.0) {
+  if (get_space_step(vm) <= 0.0) {
     vm->t += max_time;
     return vm;
   }
@@ -2965,10 +3107,18 @@ pretend_to_call_diffuse_3D: ; /* Label to allow fake recursion */
                                      tail of the collision linked list) */
   struct collision *shead_exp = NULL; /* Things we might hit (can interact with)
                                          from neighbor subvolumes */
-  /* scan subvolume for possible mol-mol reactions with vm */
+  /* scan subvolume for possible mol-mol reactions with vm.  Immobile partners
+   * only matter for the length of the step if it may be shortened, so
+   * otherwise they are looked up once the step is known, near its path */
+  int n_deferred = 0;
   if ((spec->flags & (CAN_VOLVOL | CANT_INITIATE)) == CAN_VOLVOL &&
       inertness < inert_to_all) {
-    determine_mol_mol_reactions(world, vm, &shead, &stail, inertness);
+    int defer_immobile =
+        !(spec->flags & EXTERNAL_SPECIES) &&
+        (!calculate_displacement || max_time <= MULTISTEP_WORTHWHILE ||
+         (vm->flags & ACT_CLAMPED));
+    n_deferred = determine_mol_mol_reactions(world, vm, &shead, &stail,
+                                             inertness, defer_immobile);
   }
 
   if (calculate_displacement) {
@@ -2976,13 +3126,17 @@ pretend_to_call_diffuse_3D: ; /* Label to allow fake recursion */
       &rate_factor, &r_rate_factor, &steps, &t_steps, max_time);
   }
 
-  if (world->use_expanded_list &&
+  if (n_deferred > 0)
+    determine_immobile_mol_mol_reactions(world, vm, &displacement, &shead,
+                                         &stail, inertness);
+
+  if (expanded_list &&
       ((vm->properties->flags & (CAN_VOLVOL | CANT_INITIATE)) == CAN_VOLVOL) &&
       !inertness) {
     shead_exp = expand_collision_list(world,
-      vm, &displacement, sv, world->rx_radius_3d, world->ny_parts,
-      world->nz_parts, world->x_fineparts, world->y_fineparts,
-      world->z_fineparts, world->rx_hashsize, world->reaction_hash);
+      vm, &displacement, sv, world->rx_radius_3d, world->x_fineparts,
+      world->y_fineparts, world->z_fineparts, world->rx_hashsize,
+      world->reaction_hash);
     if (stail != NULL)
       stail->next = shead_exp;
     else {
@@ -2994,11 +3148,26 @@ pretend_to_call_diffuse_3D: ; /* Label to allow fake recursion */
     }
   }
 
+  /* Fast path: nothing to react with, and the step neither leaves the
+   * subvolume nor comes near a wall, so ray tracing would find nothing */
+  if (shead == NULL && inertness != inert_to_all &&
+      !(expanded_list && redo_expand_collision_list_flag) &&
+      step_stays_in_subvolume(world, sv, &(vm->pos), &displacement, NULL)) {
+    world->stats.diffusion_fast_steps++;
+    vm->pos.x += displacement.x;
+    vm->pos.y += displacement.y;
+    vm->pos.z += displacement.z;
+    vm->t += t_steps;
+    vm->index = -1;
+    vm->previous_wall = NULL;
+    return vm;
+  }
+
   struct wall* reflectee = NULL;
   struct collision *smash;      /* Thing we've hit that's under consideration */
   do {
     /* due to redo_expand_collision_list_flag this only happens after reflection */
-    if (world->use_expanded_list && redo_expand_collision_list_flag) {
+    if (expanded_list && redo_expand_collision_list_flag) {
       redo_collision_list(world, &shead, &stail, &shead_exp, vm, &displacement, sv);
     }
 
@@ -3019,7 +3188,7 @@ pretend_to_call_diffuse_3D: ; /* Label to allow fake recursion */
       if (world->notify->molecule_collision_report == NOTIFY_FULL) {
         if (((smash->what & COLLIDE_VOL) != 0) &&
             (world->rxn_flags.vol_vol_reaction_flag)) {
-          world->vol_vol_colls++;
+          world->stats.vol_vol_colls++;
         }
       }
 
@@ -3078,8 +3247,11 @@ pretend_to_call_diffuse_3D: ; /* Label to allow fake recursion */
           }
         }
 
-        if (reflect_or_periodic_bc(world, smash, &displacement, &vm, &reflectee,
-            &tentative, &t_steps) == 1) {
+        if (!periodic || !hits_periodic_boundary(smash)) {
+          reflect_off_wall(world, smash, &displacement, vm, &reflectee,
+            &tentative, &t_steps);
+        } else if (reflect_or_periodic_bc(world, smash, &displacement, &vm,
+                     &reflectee, &tentative, &t_steps) == 1) {
           FREE_COLLISION_LISTS();
           calculate_displacement = 0;
           if (vm->properties == NULL) {
@@ -3099,6 +3271,14 @@ pretend_to_call_diffuse_3D: ; /* Label to allow fake recursion */
         FREE_COLLISION_LISTS();
         calculate_displacement = 0;
 
+        if (vm->flags & IN_HANDOFF) {
+          // waiting at a storage boundary; the rest of the step is taken
+          // by the storage on the other side
+          vm->index = -1;
+          vm->previous_wall = NULL;
+          return vm;
+        }
+
         if (vm->properties == NULL) {
           mcell_internal_error("A defunct molecule is diffusing.");
         }
@@ -3121,7 +3301,7 @@ pretend_to_call_diffuse_3D: ; /* Label to allow fake recursion */
   if (inertness == inert_to_all) 
   {
     inertness = inert_to_mol;
-    t_steps = vm->get_time_step(vm);
+    t_steps = get_time_step(vm);
     displacement = displacement2;
     calculate_displacement = 0;
     goto pretend_to_call_diffuse_3D;
@@ -3136,6 +3316,72 @@ pretend_to_call_diffuse_3D: ; /* Label to allow fake recursion */
   return vm;
 }
 
+/* Copies of the 3D diffusion loop for each combination of the features
+ * that are fixed for a whole run */
+static struct volume_molecule *diffuse_3D_plain(struct volume *world,
+                                                struct volume_molecule *vm,
+                                                double max_time) {
+  return diffuse_3D_with(world, vm, max_time, 0, 0);
+}
+
+static struct volume_molecule *diffuse_3D_expanded(struct volume *world,
+                                                   struct volume_molecule *vm,
+                                                   double max_time) {
+  return diffuse_3D_with(world, vm, max_time, 1, 0);
+}
+
+static struct volume_molecule *diffuse_3D_periodic(struct volume *world,
+                                                   struct volume_molecule *vm,
+                                                   double max_time) {
+  return diffuse_3D_with(world, vm, max_time, 0, 1);
+}
+
+static struct volume_molecule *
+diffuse_3D_expanded_periodic(struct volume *world, struct volume_molecule *vm,
+                             double max_time) {
+  return diffuse_3D_with(world, vm, max_time, 1, 1);
+}
+
+/*************************************************************************
+diffuse_3D:
+  In: world: simulation state
+      vm: molecule that is moving
+      max_time: maximum time we can spend diffusing
+  Out: Pointer to the molecule if it still exists (may have been
+       reallocated), NULL otherwise.
+       Position and time are updated, but molecule is not rescheduled.
+  Note: This version takes into account only 2-way reactions and 3-way
+        reactions of type MOL_GRID_GRID.  It reads the features from world
+        on every call; run_timestep uses the copy picked by
+        select_diffuse_3D_variant instead.
+*************************************************************************/
+struct volume_molecule *diffuse_3D(
+    struct volume *world,
+    struct volume_molecule *vm,
+    double max_time) {
+  return diffuse_3D_with(world, vm, max_time, world->use_expanded_list,
+                         world->periodic_box_obj != NULL);
+}
+
+/*************************************************************************
+select_diffuse_3D_variant:
+  In: world: simulation state
+  Out: No return value.  world->diffuse_3D_variant is set to the copy of
+       the 3D diffusion loop specialized for whether the run uses expanded
+       collision lists and a periodic box.  Walls only take part in
+       periodic boundary conditions when there is a periodic box, so
+       without one every wall a molecule hits reflects it.
+*************************************************************************/
+void select_diffuse_3D_variant(struct volume *world) {
+  int periodic = (world->periodic_box_obj != NULL);
+  if (world->use_expanded_list)
+    world->diffuse_3D_variant =
+        periodic ? diffuse_3D_expanded_periodic : diffuse_3D_expanded;
+  else
+    world->diffuse_3D_variant =
+        periodic ? diffuse_3D_periodic : diffuse_3D_plain;
+}
+
 /*************************************************************************
 move_sm_on_same_triangle:
 
@@ -3167,7 +3413,7 @@ int move_sm_on_same_triangle(
   // We're on a new part of the grid
   struct surface_molecule_list *sm_list = sm->grid->sm_list[new_idx];
   if (new_idx != sm->grid_index) {
-    if ((state->periodic_box_obj && periodicbox_in_surfmol_list(sm->periodic_box, sm_list)) ||
+    if ((state->periodic_box_obj && periodicbox_in_surfmol_list(&sm->periodic_box, sm_list)) ||
         (!state->periodic_box_obj && sm_list && sm_list->sm)) {
       if (hd_info != NULL) {
         delete_void_list((struct void_list *)hd_info);
@@ -3176,20 +3422,20 @@ int move_sm_on_same_triangle(
       return 1; /* Pick again--full here */
     }
 
-    remove_surfmol_from_list(&sm->grid->sm_list[sm->grid_index], sm);
+    struct surface_molecule_list *new_list = move_surfmol_between_lists(
+      &sm->grid->sm_list[sm->grid_index], sm->grid->sm_list[new_idx], sm);
     sm->grid_index = new_idx;
-    sm->grid->sm_list[new_idx] = add_surfmol_with_unique_pb_to_list(
-      sm->grid->sm_list[new_idx], sm);
+    sm->grid->sm_list[new_idx] = new_list;
     assert(sm->grid->sm_list[new_idx] != NULL);
     count_moved_surface_mol(
       state, sm, sm->grid, new_loc, state->count_hashmask,
-      state->count_hash, &state->ray_polygon_colls, previous_box);
+      state->count_hash, &state->stats.ray_polygon_colls, previous_box);
   // We ended up on the same exact grid element! 
   // XXX: do we even need to update counts??
   } else {
     count_moved_surface_mol(
       state, sm, sm->grid, new_loc, state->count_hashmask,
-      state->count_hash, &state->ray_polygon_colls, previous_box);
+      state->count_hash, &state->stats.ray_polygon_colls, previous_box);
   }
 
   sm->s_pos.u = new_loc->u;
@@ -3234,7 +3480,7 @@ int move_sm_to_new_triangle(
   }
 
   struct surface_molecule_list *sm_list = new_wall->grid->sm_list[new_idx];
-  if ((state->periodic_box_obj && periodicbox_in_surfmol_list(sm->periodic_box, sm_list)) ||
+  if ((state->periodic_box_obj && periodicbox_in_surfmol_list(&sm->periodic_box, sm_list)) ||
       (!state->periodic_box_obj && sm_list && sm_list->sm)) {
     if (hd_info != NULL) {
       delete_void_list((struct void_list *)hd_info);
@@ -3245,13 +3491,14 @@ int move_sm_to_new_triangle(
 
   count_moved_surface_mol(
     state, sm, new_wall->grid, new_loc, state->count_hashmask,
-    state->count_hash, &state->ray_polygon_colls, previous_box);
+    state->count_hash, &state->stats.ray_polygon_colls, previous_box);
 
-  remove_surfmol_from_list(&sm->grid->sm_list[sm->grid_index], sm);
+  own_grid_tiles(new_wall->grid);
+  sm_list = move_surfmol_between_lists(
+    &sm->grid->sm_list[sm->grid_index], new_wall->grid->sm_list[new_idx], sm);
   sm->grid->n_occupied--;
   sm->grid = new_wall->grid;
   sm->grid_index = new_idx;
-  sm_list = add_surfmol_with_unique_pb_to_list(sm->grid->sm_list[new_idx], sm);
   assert(sm_list != NULL);
   sm->grid->sm_list[sm->grid_index] = sm_list;
   sm->grid->n_occupied++;
@@ -3288,12 +3535,12 @@ struct surface_molecule *diffuse_2D(
   }
 
   // XXX: When would this ever happen, and shouldn't it just be an error?
-  if (sm->get_space_step(sm) <= 0.0) {
+  if (get_space_step(sm) <= 0.0) {
     sm->t += max_time;
     return sm;
   }
   // Using global SPACE_STEP or per species CUSTOM_SPACE_STEP/CUSTOM_TIME_STEP
-  if (sm->get_time_step(sm) > 1.0) {
+  if (get_time_step(sm) > 1.0) {
     double sched_time = convert_iterations_to_seconds(
         world->start_iterations, world->time_unit,
         world->simulation_start_seconds, sm->t);
@@ -3312,29 +3559,29 @@ struct surface_molecule *diffuse_2D(
   double t_steps = 0.0;
   double space_factor = 0.0;
   /* Where are we going? */
-  if (sm->get_time_step(sm) > max_time) {
+  if (get_time_step(sm) > max_time) {
     t_steps = max_time;
-    steps = max_time / sm->get_time_step(sm);
+    steps = max_time / get_time_step(sm);
   } else {
-    t_steps = sm->get_time_step(sm);
+    t_steps = get_time_step(sm);
     steps = 1.0;
   }
   if (steps < EPS_C) {
     steps = EPS_C;
-    t_steps = EPS_C * sm->get_time_step(sm);
+    t_steps = EPS_C * get_time_step(sm);
   }
 
   if (steps == 1.0)
-    space_factor = sm->get_space_step(sm);
+    space_factor = get_space_step(sm);
   else
-    space_factor = sm->get_space_step(sm) * sqrt(steps);
+    space_factor = get_space_step(sm) * sqrt(steps);
 
-  world->diffusion_number++;
-  world->diffusion_cumtime += steps;
+  world->stats.diffusion_number++;
+  world->stats.diffusion_cumtime += steps;
 
-  struct periodic_image previous_box = { .x = sm->periodic_box->x,
-                                         .y = sm->periodic_box->y,
-                                         .z = sm->periodic_box->z
+  struct periodic_image previous_box = { .x = sm->periodic_box.x,
+                                         .y = sm->periodic_box.y,
+                                         .z = sm->periodic_box.z
                                        };
   struct hit_data *hd_info = NULL;
   for (int find_new_position = (SURFACE_DIFFUSION_RETRIES + 1);
@@ -3446,22 +3693,21 @@ react_2D_all_neighbors(struct volume *world, struct surface_molecule *sm,
   int num_matching_rxns = 0;
   struct rxn *matching_rxns[MAX_MATCHING_RXNS];
 
-  /* linked list of the tile neighbors */
-  struct tile_neighbor *tile_nbr_head = NULL, *curr;
-  int list_length = 0; /* length of the linked lists above */
+  /* the tile neighbors */
+  struct surface_grid **nbr_grid = NULL;
+  int *nbr_idx = NULL;
 
   if ((u_int)sm->grid_index >= sm->grid->n_tiles) {
     mcell_internal_error("tile index %u is greater or equal number_of_tiles %u",
                          (u_int)sm->grid_index, sm->grid->n_tiles);
   }
 
-  find_neighbor_tiles(world, sm, sm->grid, sm->grid_index, 0, 1, &tile_nbr_head,
-                      &list_length);
+  const int num_nbrs = find_neighbor_tiles_cached(
+      world, sm, sm->grid, sm->grid_index, &nbr_grid, &nbr_idx);
 
-  if (tile_nbr_head == NULL)
+  if (num_nbrs == 0)
     return sm; /* no reaction may happen */
 
-  const int num_nbrs = list_length;
   int max_size = num_nbrs * MAX_MATCHING_RXNS;
   struct rxn *rxn_array[max_size]; /* array of reaction objects with neighbor
                                      molecules */
@@ -3484,12 +3730,12 @@ react_2D_all_neighbors(struct volume *world, struct surface_molecule *sm,
   }
 
   /* step through the neighbors */
-  for (curr = tile_nbr_head; curr != NULL; curr = curr->next) {
+  for (int kk = 0; kk < num_nbrs; kk++) {
     /* Neighboring molecule */
-    struct surface_molecule_list *sm_list = curr->grid->sm_list[curr->idx]; 
+    struct surface_molecule_list *sm_list = nbr_grid[kk]->sm_list[nbr_idx[kk]];
     if (sm_list == NULL || sm_list->sm == NULL)
       continue;
-    struct surface_molecule *smp = curr->grid->sm_list[curr->idx]->sm;
+    struct surface_molecule *smp = sm_list->sm;
 
     /* check whether the neighbor molecule is behind
        the restrictive region boundary   */
@@ -3529,7 +3775,7 @@ react_2D_all_neighbors(struct volume *world, struct surface_molecule *sm,
           if (matching_rxns[jj]->prob_t != NULL)
             update_probs(world, matching_rxns[jj], sm->t);
           rxn_array[l] = matching_rxns[jj];
-          cf[l] = t / (curr->grid->binding_factor);
+          cf[l] = t / (nbr_grid[kk]->binding_factor);
           smol[l] = smp;
           l++;
         }
@@ -3539,8 +3785,6 @@ react_2D_all_neighbors(struct volume *world, struct surface_molecule *sm,
     }
   }
 
-  delete_tile_neighbor_list(tile_nbr_head);
-
   if (n == 0) {
     return sm; /* Nobody to react with */
   } else if (n == 1) {
@@ -3575,23 +3819,31 @@ react_2D_all_neighbors(struct volume *world, struct surface_molecule *sm,
 /*************************************************************************
 clean_up_old_molecules:
 
- This function just removes defunct molecules from the scheduler.
+ This function just removes defunct molecules from the scheduler.  Once
+ enough of them have piled up, a cleanup pass is started and then carried
+ on for a bounded number of scheduled items per timestep, so that no single
+ timestep pays for scanning the whole scheduler.
 *************************************************************************/
 void clean_up_old_molecules(struct storage *local) {
-  if (local->timer->defunct_count > MIN_DEFUNCT_FOR_GC &&
-      MAX_DEFUNCT_FRAC * (local->timer->count) < local->timer->defunct_count) {
-    struct abstract_molecule *am;
-    am = (struct abstract_molecule *)schedule_cleanup(local->timer,
-                                                      *is_defunct_molecule);
-    while (am != NULL) {
-      struct abstract_molecule *temp = am;
-      am = am->next;
-      if ((temp->flags & IN_MASK) == IN_SCHEDULE) {
-        temp->next = NULL;
-        mem_put(temp->birthplace, temp);
-      } else {
-        temp->flags &= ~IN_SCHEDULE;
-      }
+  struct schedule_helper *timer = local->timer;
+  if (timer->gc_tier == NULL &&
+      !(timer->defunct_count > MIN_DEFUNCT_FOR_GC &&
+        MAX_DEFUNCT_FRAC * (timer->count) < timer->defunct_count))
+    return;
+
+  int max_items = timer->count / GC_PASS_TIMESTEPS;
+  if (max_items < MIN_GC_ITEMS_PER_TIMESTEP)
+    max_items = MIN_GC_ITEMS_PER_TIMESTEP;
+  struct abstract_molecule *am = (struct abstract_molecule *)
+      schedule_cleanup_step(timer, *is_defunct_molecule, max_items);
+  while (am != NULL) {
+    struct abstract_molecule *temp = am;
+    am = am->next;
+    if ((temp->flags & IN_MASK) == IN_SCHEDULE) {
+      temp->next = NULL;
+      mem_put(temp->birthplace, temp);
+    } else {
+      temp->flags &= ~IN_SCHEDULE;
     }
   }
 }
@@ -3600,7 +3852,8 @@ void clean_up_old_molecules(struct storage *local) {
 reschedule_surface_molecules:
 
  If a surface molecules moves across a memory subdivision boundary, it might
- need to be reallocated and moved to a new scheduler.
+ need to be reallocated and moved to a new scheduler.  Molecules staying in
+ the local storage are only queued, see schedule_insert_deferred.
 *************************************************************************/
 void reschedule_surface_molecules(
     struct volume *state, struct storage *local,
@@ -3617,6 +3870,7 @@ void reschedule_surface_molecules(
     memcpy(sm_new, sm, sizeof(struct surface_molecule));
     sm_new->next = NULL;
     sm_new->birthplace = sv->local_storage->smol;
+    mol_id_index_set(state->mol_id_index, (struct abstract_molecule *)sm_new);
     if (sm->grid->sm_list[sm->grid_index] && 
         (sm->grid->sm_list[sm->grid_index]->sm == sm)) {
       sm->grid->sm_list[sm->grid_index]->sm = sm_new;
@@ -3630,13 +3884,73 @@ void reschedule_surface_molecules(
                         "after migrating to a new memory store.",
                         am->properties->sym->name);
   } else {
-    if (schedule_add(local->timer, am))
+    /* Linked in together with the others at the end of run_timestep */
+    if (schedule_insert_deferred(local->timer, am))
       mcell_allocfailed("Failed to add a '%s' surface molecule to scheduler "
                         "after taking a diffusion step.",
                         am->properties->sym->name);
   }
 }
 
+/* Prefetching by run_timestep, in molecules ahead of the current one in
+ * the scheduler slot: the record itself is fetched RUN_PREFETCH_RECORD
+ * molecules ahead, its species and subvolume or grid RUN_PREFETCH_LINKS
+ * ahead, and the first wall-list and per-species list entries next in
+ * line */
+#define RUN_PREFETCH_RECORD 8
+#define RUN_PREFETCH_LINKS 4
+
+#ifdef __GNUC__
+#define PREFETCH(p) __builtin_prefetch((p))
+#else
+#define PREFETCH(p) ((void)(p))
+#endif
+
+/*************************************************************************
+prefetch_scheduled:
+  In: ahead: the molecule scheduled right after the current one
+  Out: No return value.  Prefetches are issued for the molecules following
+       the current one, one pipeline stage deeper the closer they are, so
+       that by the time run_timestep reaches a molecule the pointers it
+       follows first are in cache.  Only data fetched by earlier stages is
+       read here, so the walk itself rarely misses.
+*************************************************************************/
+static void prefetch_scheduled(struct abstract_molecule *ahead) {
+  for (int k = 1; ahead != NULL && k <= RUN_PREFETCH_RECORD;
+       ++k, ahead = ahead->next) {
+    if (k == RUN_PREFETCH_RECORD) {
+      PREFETCH(ahead);
+    } else if (k == RUN_PREFETCH_LINKS) {
+      if (ahead->properties == NULL)
+        continue;
+      PREFETCH(ahead->properties);
+      if ((ahead->flags & TYPE_VOL) != 0) {
+        struct volume_molecule *vm = (struct volume_molecule *)ahead;
+        PREFETCH(vm->subvol);
+        PREFETCH(vm->species_list);
+      } else if ((ahead->flags & TYPE_SURF) != 0)
+        PREFETCH(((struct surface_molecule *)ahead)->grid);
+    } else if (k == 1) {
+      if (ahead->properties == NULL)
+        continue;
+      if ((ahead->flags & TYPE_VOL) != 0) {
+        struct volume_molecule *vm = (struct volume_molecule *)ahead;
+        if (vm->subvol != NULL && vm->subvol->wall_head != NULL)
+          PREFETCH(vm->subvol->wall_head);
+        if (vm->species_list != NULL)
+          PREFETCH(vm->species_list->mols);
+      } else if ((ahead->flags & TYPE_SURF) != 0) {
+        struct surface_molecule *sm = (struct surface_molecule *)ahead;
+        if (sm->grid != NULL) {
+          PREFETCH(sm->grid->surface);
+          if (sm->grid->sm_list != NULL)
+            PREFETCH(&sm->grid->sm_list[sm->grid_index]);
+        }
+      }
+    }
+  }
+}
+
 /*************************************************************************
 run_timestep:
   In: state: simulation state
@@ -3661,6 +3975,7 @@ void run_timestep(struct volume *state, struct storage *local,
    * by the main loop. */
   while (local->timer->current != NULL) {
     am = (struct abstract_molecule *)schedule_next(local->timer);
+    prefetch_scheduled((struct abstract_molecule *)local->timer->current);
     if (am->properties == NULL) /* Defunct!  Remove molecule. */
     {
       if ((am->flags & IN_MASK) == IN_SCHEDULE) {
@@ -3676,10 +3991,20 @@ void run_timestep(struct volume *state, struct storage *local,
 
     am->flags &= ~IN_SCHEDULE;
 
+    // A rate change since the lifetime was computed makes it stale
+    if (lifetime_is_stale(am)) {
+      am->t2 = 0.0;
+      am->flags |= ACT_CHANGE;
+    }
+
     // Check for unimolecular reactions
     // If molec is new or need rescheduled, this just computes a new lifetime
     if (am->t2 < EPS_C || am->t2 < EPS_C * am->t) {
-      if (!check_for_unimolecular_reaction(state, am)) {
+      int still_alive;
+      PROFILE_SPECIES_PHASE(
+          PHASE_UNIMOLECULAR, state, am->properties,
+          still_alive = check_for_unimolecular_reaction(state, am));
+      if (!still_alive) {
         continue;
       }
     }
@@ -3693,8 +4018,11 @@ void run_timestep(struct volume *state, struct storage *local,
     int can_diffuse = ((am->flags & ACT_DIFFUSE) != 0);
     if (can_diffuse) {
       max_time = checkpt_time - am->t;
-      if (local->max_timestep < max_time)
-        max_time = local->max_timestep;
+      double max_timestep = local->max_timestep;
+      if (state->equilibrating && (am->flags & TYPE_VOL) != 0)
+        max_timestep *= state->equilibration_multiplier;
+      if (max_timestep < max_time)
+        max_time = max_timestep;
       if ((am->flags & (ACT_REACT)) != 0 && am->t2 < max_time)
         max_time = am->t2;
 
@@ -3702,12 +4030,17 @@ void run_timestep(struct volume *state, struct storage *local,
         double save_sched_time = am->t;
         if (max_time > release_time - am->t)
           max_time = release_time - am->t;
-        if (am->properties->flags & (CAN_VOLVOLVOL | CAN_VOLVOLSURF))
-          am = (struct abstract_molecule *)diffuse_3D_big_list(
-              state, (struct volume_molecule *)am, max_time);
-        else
-          am = (struct abstract_molecule *)diffuse_3D(
-              state, (struct volume_molecule *)am, max_time);
+        PROFILE_SPECIES_PHASE(PHASE_DIFFUSE_3D, state, am->properties,
+          if (am->properties->flags & (CAN_VOLVOLVOL | CAN_VOLVOLSURF))
+            am = (struct abstract_molecule *)diffuse_3D_big_list(
+                state, (struct volume_molecule *)am, max_time);
+          else
+            am = (struct abstract_molecule *)state->diffuse_3D_variant(
+                state, (struct volume_molecule *)am, max_time);
+          /* No collision list outlives a move */
+          mem_arena_reset(local->coll);
+          mem_arena_reset(local->sp_coll);
+          mem_arena_reset(local->tri_coll));
         if (am != NULL) /* We still exist */
         {
           // Perform only for unimolecular reactions
@@ -3716,6 +4049,9 @@ void run_timestep(struct volume *state, struct storage *local,
             if (am->t2 < 0)
               am->t2 = 0;
           }
+          // Rescheduled by the storage it is moving into
+          if ((am->flags & IN_HANDOFF) != 0)
+            continue;
         } else
           continue;
       } else {
@@ -3726,9 +4062,10 @@ void run_timestep(struct volume *state, struct storage *local,
         // Remember current wall
         current_wall = ((struct surface_molecule *)am)->grid->surface;
 
-        am = (struct abstract_molecule *)diffuse_2D(
-            state, (struct surface_molecule *)am, max_time,
-            &surface_mol_advance_time);
+        PROFILE_SPECIES_PHASE(PHASE_DIFFUSE_2D, state, am->properties,
+                              am = (struct abstract_molecule *)diffuse_2D(
+                                  state, (struct surface_molecule *)am,
+                                  max_time, &surface_mol_advance_time));
         if (am == NULL) {
           continue;
         }
@@ -3737,7 +4074,7 @@ void run_timestep(struct volume *state, struct storage *local,
 
     //int can_surface_mol_react =
     //    (am->properties->flags & (CAN_SURFSURFSURF | CAN_SURFSURF));
-    int can_surface_mol_react = (am->get_flags(am) & (CAN_SURFSURFSURF | CAN_SURFSURF));
+    int can_surface_mol_react = (get_flags(am) & (CAN_SURFSURFSURF | CAN_SURFSURF));
     if (((am->flags & TYPE_SURF) != 0) && can_surface_mol_react) {
       // Didn't move, so we need to figure out how long to react for
       if (!can_diffuse) 
@@ -3747,8 +4084,8 @@ void run_timestep(struct volume *state, struct storage *local,
           max_time = am->t2;
         if (max_time > release_time - am->t)
           max_time = release_time - am->t;
-        if (am->get_time_step(am) < max_time)
-          max_time = am->get_time_step(am);
+        if (get_time_step(am) < max_time)
+          max_time = get_time_step(am);
         surface_mol_advance_time = max_time;
       } else
         max_time = surface_mol_advance_time;
@@ -3756,22 +4093,24 @@ void run_timestep(struct volume *state, struct storage *local,
       if (can_surface_mol_react) {
         if ((am->properties->flags & (CANT_INITIATE | CAN_SURFSURF)) ==
             CAN_SURFSURF) {
-          am = (struct abstract_molecule *)react_2D_all_neighbors(
-              state, (struct surface_molecule *)am, max_time,
-              state->notify->molecule_collision_report,
-              state->rxn_flags.surf_surf_reaction_flag,
-              &(state->surf_surf_colls));
+          PROFILE_SPECIES_PHASE(PHASE_REACT_2D, state, am->properties,
+            am = (struct abstract_molecule *)react_2D_all_neighbors(
+                state, (struct surface_molecule *)am, max_time,
+                state->notify->molecule_collision_report,
+                state->rxn_flags.surf_surf_reaction_flag,
+                &(state->stats.surf_surf_colls)));
           if (am == NULL)
             continue;
         }
         if ((am->properties->flags & (CANT_INITIATE | CAN_SURFSURFSURF)) ==
             CAN_SURFSURFSURF) {
-          am = (struct abstract_molecule *)react_2D_trimol_all_neighbors(
-              state, (struct surface_molecule *)am, max_time,
-              state->notify->molecule_collision_report,
-              state->notify->final_summary,
-              state->rxn_flags.surf_surf_surf_reaction_flag,
-              &(state->surf_surf_surf_colls));
+          PROFILE_SPECIES_PHASE(PHASE_REACT_2D, state, am->properties,
+            am = (struct abstract_molecule *)react_2D_trimol_all_neighbors(
+                state, (struct surface_molecule *)am, max_time,
+                state->notify->molecule_collision_report,
+                state->notify->final_summary,
+                state->rxn_flags.surf_surf_surf_reaction_flag,
+                &(state->stats.surf_surf_surf_colls)));
           if (am == NULL)
             continue;
         }
@@ -3786,11 +4125,17 @@ void run_timestep(struct volume *state, struct storage *local,
       if ((am->flags & ACT_REACT) != 0) {
         /* This case takes care of newly created surface products A which
          * only have a unimolecular surface reaction defined (A @surf) and
-         * are thus scheduled am->t2 = FOREVER */
+         * are thus scheduled am->t2 = FOREVER.  If no reaction at all was
+         * found for the wall the molecule is on, only a move to another
+         * wall can give it one. */
         int can_surf_react = ((am->properties->flags & CAN_SURFWALL) != 0);
         if (can_surf_react && !distinguishable(am->t2, (double)FOREVER, EPS_C)) {
-          am->t2 = 0;
-          am->flags |= ACT_CHANGE; /* Reschedule reaction time */
+          if ((am->flags & ACT_NO_UNIMOL) == 0 ||
+              (can_diffuse &&
+               current_wall != ((struct surface_molecule *)am)->grid->surface)) {
+            am->t2 = 0;
+            am->flags |= ACT_CHANGE; /* Reschedule reaction time */
+          }
         }
         else {
           am->t2 -= surface_mol_advance_time;
@@ -3829,32 +4174,77 @@ void run_timestep(struct volume *state, struct storage *local,
     if (!distinguishable(t, am->t, EPS_C))
       am->t = t;
 
-    if (am->flags & TYPE_SURF) {
-      reschedule_surface_molecules(state, local, am);
-    } else {
-      if (schedule_add(
-              ((struct volume_molecule *)am)->subvol->local_storage->timer, am))
-        mcell_allocfailed("Failed to add a '%s' volume molecule to scheduler "
-                          "after taking a diffusion step.",
-                          am->properties->sym->name);
-    }
+    PROFILE_PHASE(PHASE_RESCHEDULE,
+      if (am->flags & TYPE_SURF) {
+        reschedule_surface_molecules(state, local, am);
+      } else {
+        if (schedule_add(
+                ((struct volume_molecule *)am)->subvol->local_storage->timer,
+                am))
+          mcell_allocfailed("Failed to add a '%s' volume molecule to "
+                            "scheduler after taking a diffusion step.",
+                            am->properties->sym->name);
+      });
   }
+  if (schedule_flush_deferred(local->timer))
+    mcell_allocfailed("Failed to add surface molecules to scheduler after "
+                      "taking a diffusion step.");
   if (local->timer->error)
     mcell_internal_error("Scheduler reported an out-of-memory error while "
                          "retrieving molecules, but this should never happen.");
 }
 
 
+/* Molecules emitted by a concentration clamp have their random numbers
+ * drawn this many at a time */
+#define CLAMP_BATCH_SIZE 256
+
+/* Scale of a 32-bit random number to [0, 1), as rng_dbl uses */
+#define CLAMP_DBL32 (2.3283064365386962890625e-10)
+
+/*************************************************************************
+pick_clamped_side:
+  In: world: simulation state
+      ccdo: concentration clamp on one object
+      val: point in [0, total clamped area)
+  Out: index of the first clamped wall whose cumulative area exceeds val,
+       the same wall bisect_high would find.  The search starts from the
+       wall the side guide gives for val, so it usually takes a step or
+       two.
+*************************************************************************/
+static int pick_clamped_side(struct volume *world,
+                             struct ccn_clamp_data *ccdo, double val) {
+  int n = ccdo->n_sides;
+  int j = (int)(val * n / ccdo->cum_area[n - 1]);
+  if (j < 0)
+    j = 0;
+  else if (j >= n)
+    j = n - 1;
+
+  int idx = ccdo->side_guide[j];
+  while (idx > 0 && ccdo->cum_area[idx - 1] > val) {
+    idx--;
+    world->clamp_side_steps++;
+  }
+  while (idx < n - 1 && ccdo->cum_area[idx] <= val) {
+    idx++;
+    world->clamp_side_steps++;
+  }
+  return idx;
+}
+
 /*************************************************************************
 run_concentration_clamp:
   In: world: simulation state
       t_now: the current time.
   Out: No return value.  Molecules are released at concentration-clamped
-       surfaces to maintain the desired concentation.
+       surfaces to maintain the desired concentation.  Each molecule uses
+       the same random numbers, in the same order, as drawing them one at
+       a time; for species which are not counted in regions, whose
+       placement draws none, they are drawn for CLAMP_BATCH_SIZE molecules
+       at once.
 *************************************************************************/
 void run_concentration_clamp(struct volume *world, double t_now) {
-  int this_count = 0;
-  static int total_count = 0;
   for (struct ccn_clamp_data *ccd = world->clamp_list; ccd != NULL; ccd = ccd->next) {
     if (ccd->objp == NULL) {
       continue;
@@ -3877,7 +4267,6 @@ void run_concentration_clamp(struct volume *world, double t_now) {
         vm.flags = IN_SCHEDULE | ACT_NEWBIE | TYPE_VOL | IN_VOLUME |
                   ACT_CLAMPED | ACT_DIFFUSE;
         vm.properties = ccdm->mol;
-        initialize_diffusion_function((struct abstract_molecule*)&vm);
 
         vm.mesh_name = NULL;
         vm.birthplace = NULL;
@@ -3889,15 +4278,35 @@ void run_concentration_clamp(struct volume *world, double t_now) {
         vm.index = 0;
         struct volume_molecule *vmp = NULL;
 
-        this_count += n_emitted;
+        world->clamp_mols_emitted += n_emitted;
+
+        /* Wall, two barycentric coordinates and, if needed, side */
+        int n_draws = (ccdm->orient == 0) ? 4 : 3;
+        int batched =
+            (ccdm->mol->flags & (COUNT_CONTENTS | COUNT_ENCLOSED)) == 0;
+        uint32_t draws[4 * CLAMP_BATCH_SIZE];
+        int n_drawn = 0;
+        int next = 0;
+        double total_area = ccdo->cum_area[ccdo->n_sides - 1];
+        struct release_batch batch;
+        init_release_batch(&batch);
         while (n_emitted > 0) {
-          int idx = bisect_high(ccdo->cum_area, ccdo->n_sides,
-                            rng_dbl(world->rng) *
-                                ccdo->cum_area[ccd->n_sides - 1]);
+          if (next == n_drawn) {
+            n_drawn = 1;
+            if (batched)
+              n_drawn = (n_emitted < CLAMP_BATCH_SIZE) ? n_emitted
+                                                       : CLAMP_BATCH_SIZE;
+            rng_uint_n(world->rng, draws, n_draws * n_drawn);
+            next = 0;
+          }
+          uint32_t const *u = &draws[n_draws * next++];
+
+          int idx = pick_clamped_side(world, ccdo,
+                                      CLAMP_DBL32 * u[0] * total_area);
           struct wall *w = ccdo->objp->wall_p[ccdo->side_idx[idx]];
 
-          double s1 = sqrt(rng_dbl(world->rng));
-          double s2 = rng_dbl(world->rng) * s1;
+          double s1 = sqrt(CLAMP_DBL32 * u[1]);
+          double s2 = CLAMP_DBL32 * u[2] * s1;
 
           struct vector3 v;
           v.x = w->vert[0]->x + s1 * (w->vert[1]->x - w->vert[0]->x) +
@@ -3914,7 +4323,7 @@ void run_concentration_clamp(struct volume *world, double t_now) {
             vm.index = -1;
           }
           else {
-            vm.index = (rng_uint(world->rng) & 2) - 1;
+            vm.index = (u[3] & 2) - 1;
           }
 
           double eps = EPS_C * vm.index;
@@ -3938,15 +4347,10 @@ void run_concentration_clamp(struct volume *world, double t_now) {
           vm.previous_wall = w;
           // TODO: This isn't right. We need to figure out what PB these should
           // really be created in.
-          struct periodic_image periodic_box = {.x = 0,
-                                                .y = 0,
-                                                .z = 0
-                                               };
-          
-          vm.periodic_box = &periodic_box;
+          vm.periodic_box = (struct periodic_image){.x = 0, .y = 0, .z = 0};
 
           if (vmp == NULL) {
-            vmp = insert_volume_molecule(world, &vm, vmp);
+            vmp = release_volume_molecule(world, &vm, vmp, &batch);
             if (vmp == NULL)
               mcell_allocfailed("Failed to insert a '%s' volume molecule while "
                                 "concentration clamping.",
@@ -3958,7 +4362,7 @@ void run_concentration_clamp(struct volume *world, double t_now) {
               vmp->flags |= ACT_REACT;
             }
           } else {
-            vmp = insert_volume_molecule(world, &vm, vmp);
+            vmp = release_volume_molecule(world, &vm, vmp, &batch);
             if (vmp == NULL)
               mcell_allocfailed("Failed to insert a '%s' volume molecule while "
                                 "concentration clamping.",
@@ -3967,11 +4371,10 @@ void run_concentration_clamp(struct volume *world, double t_now) {
 
           n_emitted--;
         }
+        flush_release_batch(&batch);
       }
     }
   }
-
-  total_count += this_count;
 }
 
 
@@ -4000,9 +4403,8 @@ void redo_collision_list(struct volume* world, struct collision** shead,
   }
   if ((m->properties->flags & (CAN_VOLVOL | CANT_INITIATE)) == CAN_VOLVOL) {
     sh = expand_collision_list(world, m, displacement, sv, world->rx_radius_3d,
-      world->ny_parts, world->nz_parts, world->x_fineparts,
-      world->y_fineparts, world->z_fineparts, world->rx_hashsize,
-      world->reaction_hash);
+      world->x_fineparts, world->y_fineparts, world->z_fineparts,
+      world->rx_hashsize, world->reaction_hash);
     if (st != NULL)
       st->next = sh;
     else {
@@ -4047,7 +4449,7 @@ static int collide_and_react_with_vol_mol(struct volume* world,
   }
 
   struct species *spec = m->properties;
-  struct periodic_image *periodic_box = m->periodic_box;
+  struct periodic_image *periodic_box = &m->periodic_box;
   int i = test_bimolecular(
     rx, scaling, 0, am, (struct abstract_molecule *)m, world->rng);
 
@@ -4138,7 +4540,7 @@ int collide_and_react_with_surf_mol(struct volume* world, struct collision* smas
   struct rxn *matching_rxns[MAX_MATCHING_RXNS];
   double scaling_coef[MAX_MATCHING_RXNS];
   struct species* spec = m->properties;
-  struct periodic_image *periodic_box = m->periodic_box;
+  struct periodic_image *periodic_box = &m->periodic_box;
   int ii = 0, jj = 0;
   if (mol_grid_flag) {
     if(sm->properties->flags & EXTERNAL_SPECIES){
@@ -4154,7 +4556,7 @@ int collide_and_react_with_surf_mol(struct volume* world, struct collision* smas
     if (num_matching_rxns > 0) {
       if (world->notify->molecule_collision_report == NOTIFY_FULL) {
         if (world->rxn_flags.vol_surf_reaction_flag)
-          world->vol_surf_colls++;
+          world->stats.vol_surf_colls++;
       }
 
       for (int l = 0; l < num_matching_rxns; l++) {
@@ -4272,7 +4674,7 @@ int collide_and_react_with_surf_mol(struct volume* world, struct collision* smas
         if (num_matching_rxns > 0) {
           if (world->notify->molecule_collision_report == NOTIFY_FULL &&
               world->rxn_flags.vol_surf_surf_reaction_flag) {
-              world->vol_surf_surf_colls++;
+              world->stats.vol_surf_surf_colls++;
           }
           for (j = 0; j < num_matching_rxns; j++) {
             if (matching_rxns[j]->prob_t != NULL) {
@@ -4404,10 +4806,10 @@ int collide_and_react_with_walls(struct volume* world, struct collision* smash,
 
   if ((!is_transp_flag) && (world->notify->molecule_collision_report == NOTIFY_FULL) &&
        world->rxn_flags.vol_wall_reaction_flag) {
-    world->vol_wall_colls++;
+    world->stats.vol_wall_colls++;
   }
 
-  struct periodic_image *periodic_box = m->periodic_box;
+  struct periodic_image *periodic_box = &m->periodic_box;
   if (is_transp_flag) {
     transp_rx->n_occurred++;
     if ((m->flags & COUNT_ME) != 0 && (spec->flags & COUNT_SOME_MASK) != 0) {
@@ -4544,7 +4946,7 @@ int reflect_or_periodic_bc(
 
   // X direction: reflect or periodic BC
   if (periodic_x) {
-    int x_inc = (vm->periodic_box->x % 2 == 0) ? 1 : -1;
+    int x_inc = (vm->periodic_box.x % 2 == 0) ? 1 : -1;
     if (!distinguishable(vm->pos.x, llx, EPS_C)) {
       x_pos = urx - EPS_C;
       box_inc_x = -x_inc;
@@ -4571,7 +4973,7 @@ int reflect_or_periodic_bc(
 
   // Y direction: reflect or periodic BC
   if (periodic_y) {
-    int y_inc = (vm->periodic_box->y % 2 == 0) ? 1 : -1;
+    int y_inc = (vm->periodic_box.y % 2 == 0) ? 1 : -1;
     if (!distinguishable(vm->pos.y, lly, EPS_C)) {
       y_pos = ury - EPS_C;
       box_inc_y = -y_inc;
@@ -4599,7 +5001,7 @@ int reflect_or_periodic_bc(
 
   // Z direction: reflect or periodic BC
   if (periodic_z) {
-    int z_inc = (vm->periodic_box->z % 2 == 0) ? 1 : -1;
+    int z_inc = (vm->periodic_box.z % 2 == 0) ? 1 : -1;
     if (!distinguishable(vm->pos.z, llz, EPS_C)) {
       z_pos = urz - EPS_C;
       box_inc_z = -z_inc;
@@ -4655,7 +5057,8 @@ int reflect_or_periodic_bc(
 
   if (!(periodic_traditional) && (box_inc_x || box_inc_y || box_inc_z)) {
     (*reflectee) = NULL;
-    struct subvolume *nsv = find_subvolume(world, &vm->pos, NULL);
+    // Only the image changes here, so the molecule stays in its subvolume
+    struct subvolume *nsv = find_subvolume(world, &vm->pos, vm->subvol);
     if (nsv == NULL) {
       struct species* spec = vm->properties;
       mcell_internal_error(
@@ -4667,17 +5070,17 @@ int reflect_or_periodic_bc(
       if (vm->properties->flags & (COUNT_CONTENTS | COUNT_ENCLOSED)) {
         count_region_from_scratch(world, (struct abstract_molecule *)vm, NULL,
                                   -1, &(orig_pos), NULL, reflect_t,
-                                  vm->periodic_box);
+                                  &vm->periodic_box);
       }
       struct volume_molecule *new_m = migrate_volume_molecule(vm, nsv);
-      vm->periodic_box->x += box_inc_x;
-      vm->periodic_box->y += box_inc_y;
-      vm->periodic_box->z += box_inc_z;
+      new_m->periodic_box.x += box_inc_x;
+      new_m->periodic_box.y += box_inc_y;
+      new_m->periodic_box.z += box_inc_z;
       // increment counts of regions we are entering
       if (new_m->properties->flags & (COUNT_CONTENTS | COUNT_ENCLOSED)) {
         count_region_from_scratch(world, (struct abstract_molecule *)new_m,
                                   NULL, 1, &(new_m->pos), NULL, reflect_t,
-                                  new_m->periodic_box);
+                                  &new_m->periodic_box);
       }
       *mol = new_m;
     }
@@ -4740,7 +5143,7 @@ int reflect_or_periodic_bc(
             COUNT_SOME_MASK)) {
         continue;
       }
-      count_region_update(world, m, m->properties, m->id, m->periodic_box,
+      count_region_update(world, m, m->properties, m->id, &m->periodic_box,
         ((struct wall *)ttv->target)->counting_regions,
         ((ttv->what & COLLIDE_MASK) == COLLIDE_FRONT) ? 1 : -1, 0, &(ttv->loc), ttv->t);
       if (ttv == smash)
@@ -4786,7 +5189,7 @@ void collide_and_react_with_subvol(struct volume* world, struct collision *smash
       if (!(spec->flags & ((struct wall *)ttv->target)->flags & COUNT_SOME_MASK)) {
         continue;
       }
-      count_region_update(world, m, spec, m->id, m->periodic_box,
+      count_region_update(world, m, spec, m->id, &m->periodic_box,
           ((struct wall *)ttv->target)->counting_regions,
           ((ttv->what & COLLIDE_MASK) == COLLIDE_FRONT) ? 1 : -1, 1, &(ttv->loc), ttv->t);
     }
@@ -4809,11 +5212,28 @@ void collide_and_react_with_subvol(struct volume* world, struct collision *smash
   struct subvolume *nsv = traverse_subvol(
     m->subvol, smash->what - COLLIDE_SV_NX - COLLIDE_SUBVOL, world->ny_parts,
     world->nz_parts);
+  PROFILE_SUBVOL_CROSSING();
   if (nsv == NULL) {
     mcell_internal_error(
         "A %s molecule escaped the world at [%.2f, %.2f, %.2f]",
         spec->sym->name, m->pos.x * world->length_unit,
         m->pos.y * world->length_unit, m->pos.z * world->length_unit);
+  } else if (world->threaded_pass &&
+             nsv->local_storage != m->subvol->local_storage) {
+    /* Another thread owns that storage: stop at the boundary and let the
+     * main loop hand the molecule over once this pass is finished. */
+    struct storage *local = m->subvol->local_storage;
+    struct storage_handoff *ho = (struct storage_handoff *)CHECKED_MEM_GET(
+        local->handoff_mem, "storage hand-off");
+    ho->next = NULL;
+    ho->vm = m;
+    ho->new_sv = nsv;
+    if (local->handoff_tail != NULL)
+      local->handoff_tail->next = ho;
+    else
+      local->handoff_head = ho;
+    local->handoff_tail = ho;
+    m->flags |= IN_HANDOFF;
   } else {
     m = migrate_volume_molecule(m, nsv);
   }
@@ -4826,7 +5246,10 @@ void collide_and_react_with_subvol(struct volume* world, struct collision *smash
 /******************************************************************************
  *
  * the compute_displacement helper function is used in diffuse_3D to compute the
- * displacement for the currently diffusing volume molecule
+ * displacement for the currently diffusing volume molecule.  The molecule
+ * takes at least its subvolume's step_multiplier timesteps at once, or the
+ * equilibration_multiplier during the equilibration phase, as far as max_time
+ * allows (see assign_step_multipliers)
  *
  * Return values:
  *
@@ -4841,15 +5264,15 @@ void compute_displacement(struct volume* world, struct collision* shead,
   struct species* spec = m->properties;
   if (m->flags & ACT_CLAMPED) { /* Surface clamping and microscopic reversibility */
     if (m->index <= DISSOCIATION_MAX) { /* Volume microscopic reversibility */
-      pick_release_displacement(displacement, displacement2, m->get_space_step(m),
+      pick_release_displacement(displacement, displacement2, get_space_step(m),
         world->r_step_release, world->d_step, world->radial_subdivisions,
         world->directions_mask, world->num_directions, world->rx_radius_3d,
         world->rng);
       *t_steps = 0;
     } else { /* Clamping or surface microscopic reversibility */
       pick_clamped_displacement(displacement, m, world->r_step_surface,
-        world->rng, world->radial_subdivisions);
-      *t_steps = m->get_time_step(m);
+        world->r_step_surface_erfc, world->rng, world->radial_subdivisions);
+      *t_steps = get_time_step(m);
       m->previous_wall = NULL;
       m->index = -1;
     }
@@ -4858,30 +5281,39 @@ void compute_displacement(struct volume* world, struct collision* shead,
     *r_rate_factor = *rate_factor = 1.0;
     *steps = 1.0;
   } else {
-    if (max_time > MULTISTEP_WORTHWHILE) {
+    if (max_time > MULTISTEP_WORTHWHILE && world->adaptive_time_step) {
+      *steps = adaptive_diffusion_step(world, m, shead, max_time);
+    } else if (max_time > MULTISTEP_WORTHWHILE) {
       *steps = safe_diffusion_step(m, shead, world->radial_subdivisions,
         world->r_step, world->x_fineparts, world->y_fineparts, world->z_fineparts);
     } else {
       *steps = 1.0;
     }
-
-    *t_steps = *steps * m->get_time_step(m);
+    /* The subvolume's multiplier trades accuracy near partners for fewer
+     * events; walls are still ray traced along the whole step */
+    double multiplier = m->subvol->step_multiplier;
+    if (world->equilibrating && multiplier < world->equilibration_multiplier)
+      multiplier = world->equilibration_multiplier;
+    if (max_time > MULTISTEP_WORTHWHILE && *steps < multiplier)
+      *steps = multiplier;
+
+    *t_steps = *steps * get_time_step(m);
     if (*t_steps > max_time) {
       *t_steps = max_time;
-      *steps = max_time / m->get_time_step(m);
+      *steps = max_time / get_time_step(m);
     }
     if (*steps < EPS_C) {
       *steps = EPS_C;
-      *t_steps = EPS_C * m->get_time_step(m);
+      *t_steps = EPS_C * get_time_step(m);
     }
 
     if (*steps == 1.0) {
-      pick_displacement(displacement, m->get_space_step(m), world->rng);
+      pick_displacement(displacement, get_space_step(m), world->rng);
       *r_rate_factor = *rate_factor = 1.0;
     } else {
       *rate_factor = sqrt(*steps);
       *r_rate_factor = 1.0 / *rate_factor;
-      pick_displacement(displacement, *rate_factor * m->get_space_step(m), world->rng);
+      pick_displacement(displacement, *rate_factor * get_space_step(m), world->rng);
     }
   }
 
@@ -4894,29 +5326,86 @@ void compute_displacement(struct volume* world, struct collision* shead,
       displacement->z *= (spec->max_step_length / disp_length);
     }
   }
-  world->diffusion_number++;
-  world->diffusion_cumtime += *steps;
+  world->stats.diffusion_number++;
+  world->stats.diffusion_cumtime += *steps;
 }
 
 
+/******************************************************************************
+ *
+ * the add_mol_mol_collisions helper function adds one collision to the list
+ * shead/stail for each reaction between the diffusing molecule m and the
+ * molecule mp of the species list psl, unless the pair is excluded because mp
+ * is m itself, m just came from a reaction with mp, or they are in different
+ * periodic boxes.
+ *
+ ******************************************************************************/
+static void add_mol_mol_collisions(
+  struct volume* world, struct volume_molecule* m, struct volume_molecule* mp,
+  struct per_species_list* psl, struct collision** shead,
+  struct collision** stail, int inertness) {
+
+  struct rxn *matching_rxns[MAX_MATCHING_RXNS];
+  int num_matching_rxns = 0;
+  if (mp == m) {
+    return;
+  }
+
+  if (inertness == inert_to_mol && m->index == mp->index) {
+    return;
+  }
+
+  // count only in the relevant periodic box
+  if (!periodic_images_equal(&m->periodic_box, &mp->periodic_box)) {
+    return;
+  }
+
+  if(m->properties->flags & EXTERNAL_SPECIES){
+    num_matching_rxns = trigger_bimolecular_nfsim(world, (struct abstract_molecule *)m,
+      (struct abstract_molecule *)mp,0, 0, matching_rxns);
+  } 
+  else{
+    num_matching_rxns = trigger_bimolecular(world->reaction_hash,
+      world->rx_hashsize, m->properties->hashval, psl->properties->hashval,
+      (struct abstract_molecule *)m, (struct abstract_molecule *)mp, 0, 0,
+      matching_rxns);
+  }
+
+  for (int i = 0; i < num_matching_rxns; i++) {
+    struct collision* smash =
+     (struct collision *)CHECKED_MEM_GET(m->subvol->local_storage->coll,
+      "collision data");
+    smash->target = (void *)mp;
+    smash->what = COLLIDE_VOL;
+    smash->intermediate = matching_rxns[i];
+    smash->next = *shead;
+    *shead = smash;
+    if (*stail == NULL)
+      *stail = *shead;
+  }
+}
+
 /******************************************************************************
  *
  * the determine_mol_mol_reactions helper function is used in diffuse_3D to
  * compute all possible molecule molecule reactions between the diffusing
  * molecule m and all other volume molecules in the subvolume.
  *
+ * If defer_immobile is set, the long lists of immobile species (see
+ * species_list_is_immobile) are skipped; once the displacement of m is known,
+ * determine_immobile_mol_mol_reactions adds their molecules near its path.
+ *
  * Return values:
  *
- * this function does not return anything
+ * the number of species lists which were skipped
  *
  ******************************************************************************/
-void determine_mol_mol_reactions(struct volume* world, struct volume_molecule* m,
-  struct collision** shead, struct collision** stail, int inertness) {
+int determine_mol_mol_reactions(struct volume* world, struct volume_molecule* m,
+  struct collision** shead, struct collision** stail, int inertness,
+  int defer_immobile) {
 
   struct subvolume* sv = m->subvol;
-  struct rxn *matching_rxns[MAX_MATCHING_RXNS];
-  int num_matching_rxns = 0;
-  struct species* spec = m->properties;
+  int n_deferred = 0;
   struct per_species_list *psl_next, *psl, **psl_head = &sv->species_head;
   for (psl = sv->species_head; psl != NULL; psl = psl_next) {
     psl_next = psl->next;
@@ -4926,18 +5415,17 @@ void determine_mol_mol_reactions(struct volume* world, struct volume_molecule* m
     }
 
     /* Garbage collection of empty per-species lists */
-    if (psl->head == NULL) {
+    if (psl->n_mols == 0) {
       *psl_head = psl->next;
-      ht_remove(&sv->mol_by_species, psl);
-      mem_put(sv->local_storage->pslv, psl);
+      free_species_list(sv, psl);
       continue;
     } else
       psl_head = &psl->next;
 
     //is this an nfsim external species. if so query whether the 2 reactants can react together
     if(m->properties->flags & EXTERNAL_SPECIES){
-      if(!trigger_bimolecular_preliminary_nfsim((struct abstract_molecule *)m, 
-                                                (struct abstract_molecule *)psl->head)){
+      if(!trigger_bimolecular_preliminary_nfsim(world, (struct abstract_molecule *)m, 
+                                                (struct abstract_molecule *)psl->mols[psl->n_mols - 1])){
         continue;
       }
     }
@@ -4949,43 +5437,67 @@ void determine_mol_mol_reactions(struct volume* world, struct volume_molecule* m
       }
     }
 
-    for (struct volume_molecule* mp = psl->head; mp != NULL; mp = mp->next_v) {
-      if (mp == m) {
-        continue;
-      }
+    if (defer_immobile && species_list_is_immobile(psl)) {
+      n_deferred++;
+      continue;
+    }
 
-      if (inertness == inert_to_mol && m->index == mp->index) {
-        continue;
-      }
+    for (int mi = psl->n_mols - 1; mi >= 0; mi--) {
+      add_mol_mol_collisions(world, m, psl->mols[mi], psl, shead, stail,
+                             inertness);
+    }
+  }
+  return n_deferred;
+}
 
-      // count only in the relevant periodic box
-      if (!periodic_boxes_are_identical(m->periodic_box, mp->periodic_box)) {
-        continue;
-      }
+/******************************************************************************
+ *
+ * the determine_immobile_mol_mol_reactions helper function completes
+ * determine_mol_mol_reactions for the species lists it deferred, looking up
+ * only the molecules within reach of m along its displacement.  Reflections
+ * never lengthen the path, so no partner further than the length of the
+ * displacement plus the reaction radius can be hit during this step.
+ *
+ ******************************************************************************/
+static void determine_immobile_mol_mol_reactions(
+  struct volume* world, struct volume_molecule* m,
+  struct vector3 const* displacement, struct collision** shead,
+  struct collision** stail, int inertness) {
 
-      if(m->properties->flags & EXTERNAL_SPECIES){
-        num_matching_rxns = trigger_bimolecular_nfsim(world, (struct abstract_molecule *)m,
-          (struct abstract_molecule *)mp,0, 0, matching_rxns);
-      } 
-      else{
-        num_matching_rxns = trigger_bimolecular(world->reaction_hash,
-          world->rx_hashsize, spec->hashval, psl->properties->hashval,
-          (struct abstract_molecule *)m, (struct abstract_molecule *)mp, 0, 0,
-          matching_rxns);
-      }
+  struct subvolume* sv = m->subvol;
+  double reach = sqrt(displacement->x * displacement->x +
+                      displacement->y * displacement->y +
+                      displacement->z * displacement->z) +
+                 world->rx_radius_3d;
+  reach += EPS_C * (reach + 1.0);
+  double reach2 = reach * reach;
+  struct vector3 llf = { m->pos.x - reach, m->pos.y - reach, m->pos.z - reach };
+  struct vector3 urb = { m->pos.x + reach, m->pos.y + reach, m->pos.z + reach };
+
+  for (struct per_species_list *psl = sv->species_head; psl != NULL;
+       psl = psl->next) {
+    if (psl->properties == NULL || !species_list_is_immobile(psl))
+      continue;
+    if (!trigger_bimolecular_preliminary(world->reaction_hash, world->rx_hashsize,
+      m->properties->hashval, psl->properties->hashval, m->properties, psl->properties))
+      continue;
 
-      if (num_matching_rxns > 0) {
-        for (int i = 0; i < num_matching_rxns; i++) {
-          struct collision* smash =
-           (struct collision *)CHECKED_MEM_GET(sv->local_storage->coll,
-            "collision data");
-          smash->target = (void *)mp;
-          smash->what = COLLIDE_VOL;
-          smash->intermediate = matching_rxns[i];
-          smash->next = *shead;
-          *shead = smash;
-          if (*stail == NULL)
-            *stail = *shead;
+    struct species_cell_index *ci = species_list_cells(world, sv, psl);
+    int lo[3], hi[3];
+    species_cell_range(ci, &llf, &urb, lo, hi);
+    for (int iz = lo[2]; iz <= hi[2]; iz++) {
+      for (int iy = lo[1]; iy <= hi[1]; iy++) {
+        int row = (iz * ci->n_cells[1] + iy) * ci->n_cells[0];
+        int first = ci->cell_start[row + lo[0]];
+        int last = ci->cell_start[row + hi[0] + 1];
+        for (int k = first; k < last; k++) {
+          struct volume_molecule *mp = ci->mols[k];
+          double dx = mp->pos.x - m->pos.x;
+          double dy = mp->pos.y - m->pos.y;
+          double dz = mp->pos.z - m->pos.z;
+          if (dx * dx + dy * dy + dz * dz > reach2)
+            continue;
+          add_mol_mol_collisions(world, m, mp, psl, shead, stail, inertness);
         }
       }
     }
@@ -5019,16 +5531,16 @@ void set_inertness_and_maxtime(
       }
     } else if (!world->surface_reversibility) {
       if (m->flags & ACT_CLAMPED) { /* Pretend we were already moving */
-        m->birthday -= 5 * m->get_time_step(m); /* Pretend to be old */
+        m->birthday -= 5 * get_time_step(m); /* Pretend to be old */
       }
     }
   } else {
     if (m->flags & ACT_CLAMPED) { /* Pretend we were already moving */
-      m->birthday -= 5 * m->get_time_step(m); /* Pretend to be old */
+      m->birthday -= 5 * get_time_step(m); /* Pretend to be old */
     } else if ((m->flags & MATURE_MOLECULE) == 0) {
       /* Newly created particles that have long time steps gradually increase */
       /* their timestep to the full value */
-      if (m->get_time_step(m) > 1.0) {
+      if (get_time_step(m) > 1.0) {
         double f = 1.0 + 0.2 * (m->t - m->birthday);
         if (f < 1)
           mcell_internal_error("A %s molecule is scheduled to move before it "
@@ -5097,7 +5609,7 @@ bool periodicbox_in_surfmol_list(
        sml_curr != NULL;
        sml_curr = sml_curr->next) {
     struct surface_molecule *sm = sml_curr->sm;
-    if (sm && periodic_boxes_are_identical(periodic_box, sm->periodic_box)) {
+    if (sm && periodic_boxes_are_identical(periodic_box, &sm->periodic_box)) {
       return true;
     }
   }
@@ -28,6 +28,9 @@
 #define MULTISTEP_WORTHWHILE 2
 #define MULTISTEP_PERCENTILE 0.99
 #define MULTISTEP_FRACTION 0.9
+/* How many subvolumes past its own along each axis adaptive_diffusion_step
+ * looks for walls and partners in */
+#define ADAPTIVE_STEP_RINGS 2
 #define MAX_UNI_TIMESKIP 100000
 
 struct vector3* reflect_periodic_2D(
@@ -41,6 +44,9 @@ struct vector3* reflect_periodic_2D(
 
 void pick_displacement(struct vector3 *v, double scale, struct rng_state *rng);
 
+void pick_displacement_n(struct vector3 *v, int n, double scale,
+                         struct rng_state *rng);
+
 void pick_2D_displacement(struct vector2 *v, double scale,
                           struct rng_state *rng);
 
@@ -51,7 +57,9 @@ void pick_release_displacement(struct vector3 *in_disk, struct vector3 *away,
                                double rx_radius_3d, struct rng_state *rng);
 
 void pick_clamped_displacement(struct vector3 *v, struct volume_molecule *m,
-                               double *r_step_surfce, struct rng_state *rng,
+                               double *r_step_surfce,
+                               double *r_step_surface_erfc,
+                               struct rng_state *rng,
                                u_int radial_subdivision);
 
 struct wall *ray_trace_2D(struct volume *world, struct surface_molecule *sm,
@@ -63,6 +71,10 @@ struct collision *ray_trace(struct volume *world, struct vector3 *init_pos,
                             struct collision *c, struct subvolume *sv,
                             struct vector3 *v, struct wall *reflectee);
 
+int step_stays_in_subvolume(struct volume *world, struct subvolume *sv,
+                            struct vector3 *pos, struct vector3 *disp,
+                            struct wall *reflectee);
+
 struct sp_collision *ray_trace_trimol(struct volume *world,
                                       struct volume_molecule *m,
                                       struct sp_collision *c,
@@ -73,6 +85,8 @@ struct sp_collision *ray_trace_trimol(struct volume *world,
 struct volume_molecule *diffuse_3D(struct volume *world,
                                    struct volume_molecule *m, double max_time);
 
+void select_diffuse_3D_variant(struct volume *world);
+
 struct volume_molecule *diffuse_3D_big_list(struct volume *world,
                                             struct volume_molecule *m,
                                             double max_time);
@@ -109,7 +123,7 @@ void run_timestep(struct volume *world, struct storage *local,
 void run_concentration_clamp(struct volume *world, double t_now);
 
 struct sp_collision *expand_collision_partner_list_for_neighbor(
-    struct subvolume *sv, struct volume_molecule *m, struct vector3 *mv,
+    struct volume *world, struct subvolume *sv, struct volume_molecule *m, struct vector3 *mv,
     struct subvolume *new_sv, struct vector3 *path_llf,
     struct vector3 *path_urb, struct sp_collision *shead1, double trim_x,
     double trim_y, double trim_z, double *x_fineparts, double *y_fineparts,
@@ -120,6 +134,10 @@ double safe_diffusion_step(struct volume_molecule *m, struct collision *shead,
                            double *x_fineparts, double *y_fineparts,
                            double *z_fineparts);
 
+double adaptive_diffusion_step(struct volume *world,
+                               struct volume_molecule *vm,
+                               struct collision *shead, double max_time);
+
 double exact_disk(struct volume *world, struct vector3 *loc, struct vector3 *mv,
                   double R, struct subvolume *sv,
                   struct volume_molecule *moving,
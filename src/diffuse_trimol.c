@@ -35,6 +35,7 @@
 #include "util.h"
 #include "logging.h"
 #include "mcell_structs.h"
+#include "phase_profile.h"
 #include "count_util.h"
 #include "grid_util.h"
 #include "vol_util.h"
@@ -67,40 +68,39 @@ struct sp_collision *ray_trace_trimol(struct volume *world,
                                       double walk_start_time) {
   struct sp_collision *smash, *shead;
   struct abstract_molecule *a;
-  struct wall_list *wlp;
-  struct wall_list fake_wlp;
   double dx, dy, dz;
   /* time, in units of of the molecule's time step, at which molecule
      will cross the x,y,z partitions, respectively. */
   double tx, ty, tz;
   int i, j, k;
 
-  world->ray_voxel_tests++;
+  world->stats.ray_voxel_tests++;
 
   shead = NULL;
   smash = (struct sp_collision *)CHECKED_MEM_GET(sv->local_storage->sp_coll,
                                                  "collision structure");
 
-  fake_wlp.next = sv->wall_head;
-
-  for (wlp = sv->wall_head; wlp != NULL; wlp = wlp->next) {
-    if (wlp->this_wall == reflectee)
-      continue;
-
-    i = collide_wall(&(m->pos), v, wlp->this_wall, &(smash->t), &(smash->loc),
-                     1, world->rng, world->notify, &(world->ray_polygon_tests));
+  int n_planes = sv->wall_planes.n;
+  for (int wi = 0;
+       (wi = next_wall_candidate(&sv->wall_planes, wi, &(m->pos), v,
+                                 reflectee, world->notify,
+                                 &(world->stats.ray_polygon_tests))) < n_planes;
+       wi++) {
+    struct wall *w = sv->wall_planes.wall[wi];
+    i = collide_wall(&(m->pos), v, w, &(smash->t), &(smash->loc),
+                     1, world->rng, world->notify, &(world->stats.ray_polygon_tests));
     if (i == COLLIDE_REDO) {
       if (shead != NULL)
         mem_put_list(sv->local_storage->sp_coll, shead);
       shead = NULL;
-      wlp = &fake_wlp;
+      wi = -1;
       continue;
     } else if (i != COLLIDE_MISS) {
-      world->ray_polygon_colls++;
+      world->stats.ray_polygon_colls++;
 
       smash->what = COLLIDE_WALL + i;
       smash->moving = m->properties;
-      smash->target = (void *)wlp->this_wall;
+      smash->target = (void *)w;
       smash->t_start = walk_start_time;
       smash->pos_start.x = m->pos.x;
       smash->pos_start.y = m->pos.y;
@@ -246,16 +246,39 @@ struct sp_collision *ray_trace_trimol(struct volume *world,
   smash->next = shead;
   shead = smash;
 
-  for (; c != NULL; c = c->next) {
-    a = (struct abstract_molecule *)c->target;
-    if (a->properties == NULL)
-      continue;
+  /* Check molecule collisions, COLLIDE_MOL_BATCH partners at a time */
+  while (c != NULL) {
+    struct sp_collision *batch[COLLIDE_MOL_BATCH];
+    double px[COLLIDE_MOL_BATCH], py[COLLIDE_MOL_BATCH], pz[COLLIDE_MOL_BATCH];
+    double t[COLLIDE_MOL_BATCH];
+    int hit[COLLIDE_MOL_BATCH];
+    int n = 0;
+    for (; c != NULL && n < COLLIDE_MOL_BATCH; c = c->next) {
+      a = (struct abstract_molecule *)c->target;
+      if (a->properties == NULL || (a->properties->flags & ON_GRID) != 0)
+        continue;
+      struct vector3 const *pos = &((struct volume_molecule *)a)->pos;
+      batch[n] = c;
+      px[n] = pos->x;
+      py[n] = pos->y;
+      pz[n] = pos->z;
+      n++;
+    }
+
+    collide_mol_batch(&(m->pos), v, px, py, pz, n, world->rx_radius_3d, hit,
+                      t);
+    for (int k = 0; k < n; k++) {
+      if (!hit[k])
+        continue;
+      struct sp_collision *cand = batch[k];
+      cand->t = t[k];
+      cand->loc.x = m->pos.x + t[k] * v->x;
+      cand->loc.y = m->pos.y + t[k] * v->y;
+      cand->loc.z = m->pos.z + t[k] * v->z;
 
-    i = collide_mol(&(m->pos), v, a, &(c->t), &(c->loc), world->rx_radius_3d);
-    if (i != COLLIDE_MISS) {
       smash = (struct sp_collision *)CHECKED_MEM_GET(sv->local_storage->sp_coll,
                                                      "collision structure");
-      memcpy(smash, c, sizeof(struct sp_collision));
+      memcpy(smash, cand, sizeof(struct sp_collision));
 
       smash->t_start = walk_start_time;
       smash->pos_start.x = m->pos.x;
@@ -276,7 +299,8 @@ struct sp_collision *ray_trace_trimol(struct volume *world,
 
 /****************************************************************************
 expand_collision_partner_list:
-  In: molecule that is moving
+  In: simulation state
+      molecule that is moving
       displacement to the new location
       subvolume that we start in
   Out: Returns linked list of molecules from neighbor subvolumes
@@ -289,10 +313,9 @@ expand_collision_partner_list:
         collisions.
 ****************************************************************************/
 static struct sp_collision *expand_collision_partner_list(
-    struct volume_molecule *m, struct vector3 *mv, struct subvolume *sv,
+    struct volume *world, struct volume_molecule *m, struct vector3 *mv, struct subvolume *sv,
     double rx_radius_3d, double *x_fineparts, double *y_fineparts,
-    double *z_fineparts, int nx_parts, int ny_parts, int nz_parts,
-    int rx_hashsize, struct rxn **reaction_hash) {
+    double *z_fineparts, int rx_hashsize, struct rxn **reaction_hash) {
   struct sp_collision *shead1 = NULL;
   /* lower left and upper_right corners of the molecule path
      bounding box expanded by R. */
@@ -303,192 +326,32 @@ static struct sp_collision *expand_collision_partner_list(
   /* find the molecule path bounding box. */
   path_bounding_box(&m->pos, mv, &path_llf, &path_urb, rx_radius_3d);
 
-  /* Decide which directions we need to go */
-  int x_neg = 0, x_pos = 0, y_neg = 0, y_pos = 0, z_neg = 0, z_pos = 0;
-  if (!(sv->world_edge & X_POS_BIT) && path_urb.x + R > x_fineparts[sv->urb.x])
-    x_pos = 1;
-  if (!(sv->world_edge & X_NEG_BIT) && path_llf.x - R < x_fineparts[sv->llf.x])
-    x_neg = 1;
-  if (!(sv->world_edge & Y_POS_BIT) && path_urb.y + R > y_fineparts[sv->urb.y])
-    y_pos = 1;
-  if (!(sv->world_edge & Y_NEG_BIT) && path_llf.y - R < y_fineparts[sv->llf.y])
-    y_neg = 1;
-  if (!(sv->world_edge & Z_POS_BIT) && path_urb.z + R > z_fineparts[sv->urb.z])
-    z_pos = 1;
-  if (!(sv->world_edge & Z_NEG_BIT) && path_llf.z - R < z_fineparts[sv->llf.z])
-    z_neg = 1;
-
-  /* go +X */
-  if (x_pos) {
-    struct subvolume *newsv_x = sv + (nz_parts - 1) * (ny_parts - 1);
-    shead1 = expand_collision_partner_list_for_neighbor(
-        sv, m, mv, newsv_x, &path_llf, &path_urb, shead1, R, 0.0, 0.0,
-        x_fineparts, y_fineparts, z_fineparts, rx_hashsize, reaction_hash);
-
-    /* go +X, +Y */
-    if (y_pos) {
-      struct subvolume *newsv_y = newsv_x + (nz_parts - 1);
-      shead1 = expand_collision_partner_list_for_neighbor(
-          sv, m, mv, newsv_y, &path_llf, &path_urb, shead1, R, R, 0.0,
-          x_fineparts, y_fineparts, z_fineparts, rx_hashsize, reaction_hash);
-
-      /* go +X, +Y, +Z */
-      if (z_pos)
-        shead1 = expand_collision_partner_list_for_neighbor(
-            sv, m, mv, newsv_y + 1, &path_llf, &path_urb, shead1, R, R, R,
-            x_fineparts, y_fineparts, z_fineparts, rx_hashsize, reaction_hash);
-
-      /* go +X, +Y, -Z */
-      if (z_neg)
-        shead1 = expand_collision_partner_list_for_neighbor(
-            sv, m, mv, newsv_y - 1, &path_llf, &path_urb, shead1, R, R, -R,
-            x_fineparts, y_fineparts, z_fineparts, rx_hashsize, reaction_hash);
-    }
-
-    /* go +X, -Y */
-    if (y_neg) {
-      struct subvolume *newsv_y = newsv_x - (nz_parts - 1);
-      shead1 = expand_collision_partner_list_for_neighbor(
-          sv, m, mv, newsv_y, &path_llf, &path_urb, shead1, R, -R, 0.0,
-          x_fineparts, y_fineparts, z_fineparts, rx_hashsize, reaction_hash);
-
-      /* go +X, -Y, +Z */
-      if (z_pos)
-        shead1 = expand_collision_partner_list_for_neighbor(
-            sv, m, mv, newsv_y + 1, &path_llf, &path_urb, shead1, R, -R, R,
-            x_fineparts, y_fineparts, z_fineparts, rx_hashsize, reaction_hash);
-
-      /* go +X, -Y, -Z */
-      if (z_neg)
-        shead1 = expand_collision_partner_list_for_neighbor(
-            sv, m, mv, newsv_y - 1, &path_llf, &path_urb, shead1, R, -R, -R,
-            x_fineparts, y_fineparts, z_fineparts, rx_hashsize, reaction_hash);
-    }
-
-    /* go +X, +Z */
-    if (z_pos)
-      shead1 = expand_collision_partner_list_for_neighbor(
-          sv, m, mv, newsv_x + 1, &path_llf, &path_urb, shead1, R, 0.0, R,
-          x_fineparts, y_fineparts, z_fineparts, rx_hashsize, reaction_hash);
-
-    /* go +X, -Z */
-    if (z_neg)
-      shead1 = expand_collision_partner_list_for_neighbor(
-          sv, m, mv, newsv_x - 1, &path_llf, &path_urb, shead1, R, 0.0, -R,
-          x_fineparts, y_fineparts, z_fineparts, rx_hashsize, reaction_hash);
-  }
-
-  /* go -X */
-  if (x_neg) {
-    struct subvolume *newsv_x = sv - (nz_parts - 1) * (ny_parts - 1);
-    shead1 = expand_collision_partner_list_for_neighbor(
-        sv, m, mv, newsv_x, &path_llf, &path_urb, shead1, -R, 0.0, 0.0,
-        x_fineparts, y_fineparts, z_fineparts, rx_hashsize, reaction_hash);
-
-    /* go -X, +Y */
-    if (y_pos) {
-      struct subvolume *newsv_y = newsv_x + (nz_parts - 1);
-      shead1 = expand_collision_partner_list_for_neighbor(
-          sv, m, mv, newsv_y, &path_llf, &path_urb, shead1, -R, R, 0.0,
-          x_fineparts, y_fineparts, z_fineparts, rx_hashsize, reaction_hash);
-
-      /* go -X, +Y, +Z */
-      if (z_pos)
-        shead1 = expand_collision_partner_list_for_neighbor(
-            sv, m, mv, newsv_y + 1, &path_llf, &path_urb, shead1, -R, R, R,
-            x_fineparts, y_fineparts, z_fineparts, rx_hashsize, reaction_hash);
-
-      /* go -X, +Y, -Z */
-      if (z_neg)
-        shead1 = expand_collision_partner_list_for_neighbor(
-            sv, m, mv, newsv_y - 1, &path_llf, &path_urb, shead1, -R, R, -R,
-            x_fineparts, y_fineparts, z_fineparts, rx_hashsize, reaction_hash);
-    }
-
-    /* go -X, -Y */
-    if (y_neg) {
-      struct subvolume *newsv_y = newsv_x - (nz_parts - 1);
-      shead1 = expand_collision_partner_list_for_neighbor(
-          sv, m, mv, newsv_y, &path_llf, &path_urb, shead1, -R, -R, 0.0,
-          x_fineparts, y_fineparts, z_fineparts, rx_hashsize, reaction_hash);
-
-      /* go -X, -Y, +Z */
-      if (z_pos)
-        shead1 = expand_collision_partner_list_for_neighbor(
-            sv, m, mv, newsv_y + 1, &path_llf, &path_urb, shead1, -R, -R, R,
-            x_fineparts, y_fineparts, z_fineparts, rx_hashsize, reaction_hash);
-
-      /* go -X, -Y, -Z */
-      if (z_neg)
-        shead1 = expand_collision_partner_list_for_neighbor(
-            sv, m, mv, newsv_y - 1, &path_llf, &path_urb, shead1, -R, -R, -R,
-            x_fineparts, y_fineparts, z_fineparts, rx_hashsize, reaction_hash);
-    }
-
-    /* go -X, +Z */
-    if (z_pos)
-      shead1 = expand_collision_partner_list_for_neighbor(
-          sv, m, mv, newsv_x + 1, &path_llf, &path_urb, shead1, -R, 0.0, R,
-          x_fineparts, y_fineparts, z_fineparts, rx_hashsize, reaction_hash);
-
-    /* go -X, -Z */
-    if (z_neg)
-      shead1 = expand_collision_partner_list_for_neighbor(
-          sv, m, mv, newsv_x - 1, &path_llf, &path_urb, shead1, -R, 0.0, -R,
-          x_fineparts, y_fineparts, z_fineparts, rx_hashsize, reaction_hash);
-  }
-
-  /* go +Y */
-  if (y_pos) {
-    struct subvolume *newsv_y = sv + (nz_parts - 1);
-    shead1 = expand_collision_partner_list_for_neighbor(
-        sv, m, mv, newsv_y, &path_llf, &path_urb, shead1, 0.0, R, 0.0,
-        x_fineparts, y_fineparts, z_fineparts, rx_hashsize, reaction_hash);
-
-    /* go +Y, +Z */
-    if (z_pos)
-      shead1 = expand_collision_partner_list_for_neighbor(
-          sv, m, mv, newsv_y + 1, &path_llf, &path_urb, shead1, 0.0, R, R,
-          x_fineparts, y_fineparts, z_fineparts, rx_hashsize, reaction_hash);
-
-    /* go +Y, -Z */
-    if (z_neg)
-      shead1 = expand_collision_partner_list_for_neighbor(
-          sv, m, mv, newsv_y - 1, &path_llf, &path_urb, shead1, 0.0, R, -R,
-          x_fineparts, y_fineparts, z_fineparts, rx_hashsize, reaction_hash);
-  }
-
-  /* go -Y */
-  if (y_pos) {
-    struct subvolume *newsv_y = sv - (nz_parts - 1);
-    shead1 = expand_collision_partner_list_for_neighbor(
-        sv, m, mv, newsv_y, &path_llf, &path_urb, shead1, 0.0, -R, 0.0,
-        x_fineparts, y_fineparts, z_fineparts, rx_hashsize, reaction_hash);
-
-    /* go -Y, +Z */
-    if (z_pos)
-      shead1 = expand_collision_partner_list_for_neighbor(
-          sv, m, mv, newsv_y + 1, &path_llf, &path_urb, shead1, 0.0, -R, R,
-          x_fineparts, y_fineparts, z_fineparts, rx_hashsize, reaction_hash);
-
-    /* go -Y, -Z */
-    if (z_neg)
-      shead1 = expand_collision_partner_list_for_neighbor(
-          sv, m, mv, newsv_y - 1, &path_llf, &path_urb, shead1, 0.0, -R, -R,
-          x_fineparts, y_fineparts, z_fineparts, rx_hashsize, reaction_hash);
-  }
-
-  /* go +Z */
-  if (z_pos)
+  /* Decide which directions we need to go; never off the world */
+  int reach = 0;
+  if (path_urb.x + R > x_fineparts[sv->urb.x])
+    reach |= X_POS_BIT;
+  if (path_llf.x - R < x_fineparts[sv->llf.x])
+    reach |= X_NEG_BIT;
+  if (path_urb.y + R > y_fineparts[sv->urb.y])
+    reach |= Y_POS_BIT;
+  if (path_llf.y - R < y_fineparts[sv->llf.y])
+    reach |= Y_NEG_BIT;
+  if (path_urb.z + R > z_fineparts[sv->urb.z])
+    reach |= Z_POS_BIT;
+  if (path_llf.z - R < z_fineparts[sv->llf.z])
+    reach |= Z_NEG_BIT;
+  reach &= ~sv->world_edge;
+
+  /* search the faces, edges and corners of the neighbors reached */
+  struct neighbor_reach const *nr =
+      world->neighbor_reach + world->neighbor_reach_start[reach];
+  struct neighbor_reach const *nr_end =
+      world->neighbor_reach + world->neighbor_reach_start[reach + 1];
+  for (; nr < nr_end; nr++)
     shead1 = expand_collision_partner_list_for_neighbor(
-        sv, m, mv, sv + 1, &path_llf, &path_urb, shead1, 0.0, 0.0, R,
-        x_fineparts, y_fineparts, z_fineparts, rx_hashsize, reaction_hash);
-
-  /* go -Z */
-  if (z_neg)
-    shead1 = expand_collision_partner_list_for_neighbor(
-        sv, m, mv, sv - 1, &path_llf, &path_urb, shead1, 0.0, 0.0, -R,
-        x_fineparts, y_fineparts, z_fineparts, rx_hashsize, reaction_hash);
+        world, sv, m, mv, sv + nr->offset, &path_llf, &path_urb, shead1,
+        nr->dir[0] * R, nr->dir[1] * R, nr->dir[2] * R, x_fineparts,
+        y_fineparts, z_fineparts, rx_hashsize, reaction_hash);
 
   return shead1;
 }
@@ -564,7 +427,7 @@ struct volume_molecule *diffuse_3D_big_list(struct volume *world,
       col_mol_mol_grid_flag;
 
   struct species *spec = m->properties;
-  struct periodic_image *periodic_box = m->periodic_box;
+  struct periodic_image *periodic_box = &m->periodic_box;
   if (spec == NULL)
     mcell_internal_error(
         "Attempted to take a diffusion step for a defunct molecule.");
@@ -638,7 +501,8 @@ pretend_to_call_diffuse_3D_big_list: /* Label to allow fake recursion */
       } else /* Clamping or surface microscopic reversibility */
       {
         pick_clamped_displacement(&displacement, m, world->r_step_surface,
-                                  world->rng, world->radial_subdivisions);
+                                  world->r_step_surface_erfc, world->rng,
+                                  world->radial_subdivisions);
         t_steps = spec->time_step;
         m->previous_wall = NULL;
         m->index = -1;
@@ -687,8 +551,8 @@ pretend_to_call_diffuse_3D_big_list: /* Label to allow fake recursion */
       }
     }
 
-    world->diffusion_number++;
-    world->diffusion_cumtime += steps;
+    world->stats.diffusion_number++;
+    world->stats.diffusion_cumtime += steps;
   }
 
   moving_bi_molecular_flag =
@@ -702,6 +566,14 @@ pretend_to_call_diffuse_3D_big_list: /* Label to allow fake recursion */
 
   if (moving_tri_molecular_flag || moving_bi_molecular_flag ||
       moving_mol_mol_grid_flag) {
+    /* The list of local partners is kept for the rest of this step, also
+       after reflections, but the molecule never gets further than the
+       length of the displacement from where it is now.  Partners that are
+       further away than that plus the interaction radius can never be hit
+       and are not put in the list. */
+    double reach = vect_length(&displacement) + world->rx_radius_3d;
+    double reach2 = reach * reach * (1.0 + EPS_C);
+
     /* scan molecules from this SV */
     struct per_species_list *psl_next, *psl,
         **psl_head = &m->subvol->species_head;
@@ -713,10 +585,9 @@ pretend_to_call_diffuse_3D_big_list: /* Label to allow fake recursion */
       }
 
       /* Garbage collection of empty per-species lists */
-      if (psl->head == NULL) {
+      if (psl->n_mols == 0) {
         *psl_head = psl->next;
-        ht_remove(&sv->mol_by_species, psl);
-        mem_put(sv->local_storage->pslv, psl);
+        free_species_list(sv, psl);
         continue;
       } else
         psl_head = &psl->next;
@@ -750,10 +621,17 @@ pretend_to_call_diffuse_3D_big_list: /* Label to allow fake recursion */
       /* If we are interested in collisions with this molecule type, add all
        * local molecules to our collision list */
       if (what != 0) {
-        for (mp = psl->head; mp != NULL; mp = mp->next_v) {
+        for (int mi = psl->n_mols - 1; mi >= 0; mi--) {
+          mp = psl->mols[mi];
           if (mp == m)
             continue;
 
+          double dx = mp->pos.x - m->pos.x;
+          double dy = mp->pos.y - m->pos.y;
+          double dz = mp->pos.z - m->pos.z;
+          if (dx * dx + dy * dy + dz * dz > reach2)
+            continue;
+
           smash = (struct sp_collision *)CHECKED_MEM_GET(
               sv->local_storage->sp_coll, "collision data");
           smash->t = 0.0;
@@ -787,9 +665,8 @@ pretend_to_call_diffuse_3D_big_list: /* Label to allow fake recursion */
         (moving_tri_molecular_flag || moving_bi_molecular_flag ||
          moving_mol_mol_grid_flag)) {
       shead_exp = expand_collision_partner_list(
-          m, &displacement, sv, world->rx_radius_3d, world->x_fineparts,
-          world->y_fineparts, world->z_fineparts, world->nx_parts,
-          world->ny_parts, world->nz_parts, world->rx_hashsize,
+          world, m, &displacement, sv, world->rx_radius_3d, world->x_fineparts,
+          world->y_fineparts, world->z_fineparts, world->rx_hashsize,
           world->reaction_hash);
 
       if (stail != NULL)
@@ -834,9 +711,8 @@ pretend_to_call_diffuse_3D_big_list: /* Label to allow fake recursion */
       if (moving_tri_molecular_flag || moving_bi_molecular_flag ||
           moving_mol_mol_grid_flag) {
         shead_exp = expand_collision_partner_list(
-            m, &displacement, sv, world->rx_radius_3d, world->x_fineparts,
-            world->y_fineparts, world->z_fineparts, world->nx_parts,
-            world->ny_parts, world->nz_parts, world->rx_hashsize,
+            world, m, &displacement, sv, world->rx_radius_3d, world->x_fineparts,
+            world->y_fineparts, world->z_fineparts, world->rx_hashsize,
             world->reaction_hash);
 
         /* combine two collision lists */
@@ -1010,6 +886,7 @@ pretend_to_call_diffuse_3D_big_list: /* Label to allow fake recursion */
 
         nsv = traverse_subvol(sv, smash->what - COLLIDE_SV_NX - COLLIDE_SUBVOL,
                               world->ny_parts, world->nz_parts);
+        PROFILE_SUBVOL_CROSSING();
         if (nsv == NULL) {
           mcell_internal_error(
               "A %s molecule escaped the world at [%.2f, %.2f, %.2f]",
@@ -1457,19 +1334,19 @@ pretend_to_call_diffuse_3D_big_list: /* Label to allow fake recursion */
     if (world->notify->molecule_collision_report == NOTIFY_FULL) {
       if (((tri_smash->what & COLLIDE_VOL) != 0) &&
           (world->rxn_flags.vol_vol_reaction_flag)) {
-        world->vol_vol_colls++;
+        world->stats.vol_vol_colls++;
       } else if (((tri_smash->what & COLLIDE_SURF) != 0) &&
                  (world->rxn_flags.vol_surf_reaction_flag)) {
-        world->vol_surf_colls++;
+        world->stats.vol_surf_colls++;
       } else if (((tri_smash->what & COLLIDE_VOL_VOL) != 0) &&
                  (world->rxn_flags.vol_vol_vol_reaction_flag)) {
-        world->vol_vol_vol_colls++;
+        world->stats.vol_vol_vol_colls++;
       } else if (((tri_smash->what & COLLIDE_VOL_SURF) != 0) &&
                  (world->rxn_flags.vol_vol_surf_reaction_flag)) {
-        world->vol_vol_surf_colls++;
+        world->stats.vol_vol_surf_colls++;
       } else if (((tri_smash->what & COLLIDE_SURF_SURF) != 0) &&
                  (world->rxn_flags.vol_surf_surf_reaction_flag)) {
-        world->vol_surf_surf_colls++;
+        world->stats.vol_surf_surf_colls++;
       }
     }
 
@@ -1593,7 +1470,7 @@ pretend_to_call_diffuse_3D_big_list: /* Label to allow fake recursion */
           if ((rx->n_pathways > RX_SPECIAL) &&
               (world->notify->molecule_collision_report == NOTIFY_FULL)) {
             if (world->rxn_flags.vol_wall_reaction_flag)
-              world->vol_wall_colls++;
+              world->stats.vol_wall_colls++;
           }
 
           if (rx->n_pathways == RX_TRANSP) {
@@ -1758,10 +1635,10 @@ struct surface_molecule *react_2D_trimol_all_neighbors(
   int num_matching_rxns = 0;
   struct rxn *matching_rxns[MAX_MATCHING_RXNS];
 
-  /* linked lists of the tile neighbors (first and second level) */
-  struct tile_neighbor *tile_nbr_head_f = NULL, *tile_nbr_head_s = NULL,
-                       *curr_f, *curr_s;
-  int list_length_f, list_length_s; /* length of the linked lists above */
+  /* tile neighbors (first and second level) */
+  struct surface_grid **nbr_grid_s;
+  int *nbr_idx_s;
+  int list_length_f, list_length_s; /* number of neighbors above */
 
   int max_size = 12 * 12 * MAX_MATCHING_RXNS; /* reasonable assumption */
   struct rxn *rxn_array[max_size]; /* array of reaction objects with neighbor
@@ -1775,29 +1652,30 @@ struct surface_molecule *react_2D_trimol_all_neighbors(
   /* points to the second partner in the trimol reaction */
   struct surface_molecule *second_partner[max_size];
 
-  for (kk = 0; kk < max_size; kk++) {
-    rxn_array[kk] = NULL;
-    first_partner[kk] = NULL;
-    second_partner[kk] = NULL;
-    cf[kk] = 0;
-    local_prob_factor[kk] = 0;
-  }
-
-  /* find first level neighbor molecules to react with */
-  find_neighbor_tiles(world, sm, sm->grid, sm->grid_index, 0, 1,
-                      &tile_nbr_head_f, &list_length_f);
-
-  if (tile_nbr_head_f == NULL)
+  /* find first level neighbor molecules to react with; they are copied
+     since the second level lookups may reuse the grid's neighbor index */
+  struct surface_grid **nbr_grid_cached;
+  int *nbr_idx_cached;
+  list_length_f = find_neighbor_tiles_cached(world, sm, sm->grid,
+                                             sm->grid_index, &nbr_grid_cached,
+                                             &nbr_idx_cached);
+  if (list_length_f == 0)
     return sm;
 
+  struct surface_grid *nbr_grid_f[list_length_f];
+  int nbr_idx_f[list_length_f];
+  memcpy(nbr_grid_f, nbr_grid_cached,
+         list_length_f * sizeof(struct surface_grid *));
+  memcpy(nbr_idx_f, nbr_idx_cached, list_length_f * sizeof(int));
+
   /* Calculate local_prob_factor for the reaction probability.
      Here we convert from 3 neighbor tiles (upper probability
      limit) to the real number of neighbor tiles. */
   local_prob_factor_f = 1.0 / list_length_f;
 
   /* step through the neighbors */
-  for (curr_f = tile_nbr_head_f; curr_f != NULL; curr_f = curr_f->next) {
-    struct surface_molecule_list *sm_list = curr_f->grid->sm_list[curr_f->idx]; 
+  for (int n_f = 0; n_f < list_length_f; n_f++) {
+    struct surface_molecule_list *sm_list = nbr_grid_f[n_f]->sm_list[nbr_idx_f[n_f]];
     if (sm_list == NULL || sm_list->sm == NULL)
       continue;
     gm_f = sm_list->sm;
@@ -1819,19 +1697,20 @@ struct surface_molecule *react_2D_trimol_all_neighbors(
     }
 
     /* find nearest neighbor molecules to react with (2nd level) */
-    find_neighbor_tiles(world, gm_f, gm_f->grid, gm_f->grid_index, 0, 1,
-                        &tile_nbr_head_s, &list_length_s);
+    list_length_s = find_neighbor_tiles_cached(world, gm_f, gm_f->grid,
+                                               gm_f->grid_index, &nbr_grid_s,
+                                               &nbr_idx_s);
 
-    if (tile_nbr_head_s == NULL)
+    if (list_length_s == 0)
       continue;
 
     local_prob_factor_s = 1.0 / (list_length_s - 1);
 
-    for (curr_s = tile_nbr_head_s; curr_s != NULL; curr_s = curr_s->next) {
-      sm_list = curr_s->grid->sm_list[curr_s->idx]; 
+    for (int n_s = 0; n_s < list_length_s; n_s++) {
+      sm_list = nbr_grid_s[n_s]->sm_list[nbr_idx_s[n_s]];
       if (sm_list == NULL || sm_list->sm == NULL)
         continue;
-      gm_s = curr_s->grid->sm_list[curr_s->idx]->sm;
+      gm_s = sm_list->sm;
       if (gm_s == NULL)
         continue;
       if (gm_s == gm_f)
@@ -1881,6 +1760,10 @@ struct surface_molecule *react_2D_trimol_all_neighbors(
         }
         for (jj = 0; jj < num_matching_rxns; jj++) {
           if (matching_rxns[jj] != NULL) {
+            if (l >= max_size)
+              mcell_internal_error("The size of the reactions array in the "
+                                   "function 'react_2D_trimol_all_neighbors()' "
+                                   "is not sufficient.");
             rxn_array[l] = matching_rxns[jj];
             cf[l] = (t / (gm_f->grid->binding_factor)) *
                     (t / (gm_s->grid->binding_factor));
@@ -1895,17 +1778,20 @@ struct surface_molecule *react_2D_trimol_all_neighbors(
         n += num_matching_rxns;
       }
     }
-    if (tile_nbr_head_s != NULL)
-      delete_tile_neighbor_list(tile_nbr_head_s);
   }
 
-  if (tile_nbr_head_f != NULL)
-    delete_tile_neighbor_list(tile_nbr_head_f);
-
   if (n > max_size)
     mcell_internal_error("The size of the reactions array in the function "
                          "'react_2D_trimol_all_neighbors()' is not "
                          "sufficient.");
+  /* only the first l slots were filled */
+  for (kk = l; kk < n; kk++) {
+    rxn_array[kk] = NULL;
+    first_partner[kk] = NULL;
+    second_partner[kk] = NULL;
+    cf[kk] = 0;
+    local_prob_factor[kk] = 0;
+  }
 
   if (n == 0) {
     return sm; /* Nobody to react with */
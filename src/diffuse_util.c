@@ -127,6 +127,28 @@ double *init_r_step_surface(int radial_subdivisions) {
   return r_step_s;
 }
 
+/***************************************************************************
+init_r_step_surface_erfc:
+  In: r_step_surface: the table made by init_r_step_surface
+      number of radial subdivisions in it
+  Out: pointer to array of doubles holding erfc of each entry of the table,
+       returns NULL on malloc failure
+  Note: pick_clamped_displacement needs erfc of the step length it drew on
+        each surface crossing of a clamped or reversibly unbound molecule
+***************************************************************************/
+double *init_r_step_surface_erfc(double *r_step_surface,
+                                 int radial_subdivisions) {
+  double *erfc_s = CHECKED_MALLOC_ARRAY_NODIE(
+      double, radial_subdivisions, "radial step length erfc table (surface)");
+  if (erfc_s == NULL)
+    return NULL;
+
+  for (int i = 0; i < radial_subdivisions; i++)
+    erfc_s[i] = erfc(r_step_surface[i]);
+
+  return erfc_s;
+}
+
 /***************************************************************************
  init_r_step_3d_release:
   In: number of desired radial subdivisions
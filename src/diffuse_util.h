@@ -26,5 +26,7 @@
 double r_func(double s);
 double *init_r_step(int radial_subdivisions);
 double *init_r_step_surface(int radial_subdivisions);
+double *init_r_step_surface_erfc(double *r_step_surface,
+                                 int radial_subdivisions);
 double *init_r_step_3d_release(int radial_subdivisions);
 double *init_d_step(int radial_directions, unsigned int *actual_directions);
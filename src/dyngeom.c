@@ -23,9 +23,15 @@
 
 #include "config.h"
 
+#include <errno.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
+#include <sys/stat.h>
+#ifndef _WIN32
+#include <pthread.h>
+#endif
 
 #include "chkpt.h"
 #include "vol_util.h"
@@ -41,19 +47,253 @@
 #include "mdlparse_aux.h"
 #include "react.h"
 #include "nfsim_func.h"
+#include "mol_id_index.h"
 
 #define NO_MESH "\0"
 
+/***************************************************************************
+ get_mesh_signatures:
+
+ In:  obj_ptr: the object to look for meshes in (e.g. root_instance)
+      signatures: the signatures found are added here
+ Out: Nothing. The name, bounding box and a hash of the wall vertices of
+      every instantiated mesh are added to signatures.
+***************************************************************************/
+void get_mesh_signatures(struct object *obj_ptr,
+                         struct mesh_signatures *signatures) {
+  switch (obj_ptr->object_type) {
+  case META_OBJ:
+    for (struct object *child_obj_ptr = obj_ptr->first_child;
+         child_obj_ptr != NULL; child_obj_ptr = child_obj_ptr->next) {
+      get_mesh_signatures(child_obj_ptr, signatures);
+    }
+    break;
+  case BOX_OBJ:
+  case POLY_OBJ: {
+    if (signatures->n_meshes == signatures->capacity) {
+      signatures->capacity =
+          (signatures->capacity == 0) ? 16 : 2 * signatures->capacity;
+      signatures->meshes = (struct mesh_signature *)realloc(
+          signatures->meshes,
+          signatures->capacity * sizeof(struct mesh_signature));
+      if (signatures->meshes == NULL)
+        mcell_allocfailed("Failed to allocate mesh signatures.");
+    }
+    struct mesh_signature *sig = &signatures->meshes[signatures->n_meshes++];
+    sig->name = CHECKED_STRDUP(obj_ptr->sym->name, "mesh name");
+    sig->llf.x = sig->llf.y = sig->llf.z = GIGANTIC;
+    sig->urb.x = sig->urb.y = sig->urb.z = -GIGANTIC;
+
+    /* FNV-1a over the vertex coordinates of the walls, in wall order */
+    unsigned long long hash = 14695981039346656037ULL;
+    for (int i = 0; i < obj_ptr->n_walls; i++) {
+      struct wall *w = obj_ptr->wall_p[i];
+      if (w == NULL) {
+        hash = (hash ^ 0xff) * 1099511628211ULL;
+        continue;
+      }
+      for (int k = 0; k < 3; k++) {
+        struct vector3 const *v = w->vert[k];
+        unsigned char const *bytes = (unsigned char const *)v;
+        for (size_t b = 0; b < sizeof(struct vector3); b++)
+          hash = (hash ^ bytes[b]) * 1099511628211ULL;
+        sig->llf.x = min2d(sig->llf.x, v->x);
+        sig->llf.y = min2d(sig->llf.y, v->y);
+        sig->llf.z = min2d(sig->llf.z, v->z);
+        sig->urb.x = max2d(sig->urb.x, v->x);
+        sig->urb.y = max2d(sig->urb.y, v->y);
+        sig->urb.z = max2d(sig->urb.z, v->z);
+      }
+    }
+    sig->hash = hash;
+    break;
+  }
+
+  // do nothing
+  case REL_SITE_OBJ:
+  case VOXEL_OBJ:
+    break;
+  }
+}
+
+/***************************************************************************
+ find_changed_meshes:
+
+ In:  changed: the signatures of the changed meshes are added here
+      old_meshes: the meshes before a dynamic geometry event
+      new_meshes: the meshes after it
+ Out: Nothing. Meshes that were added, removed, or whose walls differ are
+      added to changed; a changed mesh contributes both its old and its new
+      signature, so that changed covers everywhere the mesh was or is.
+***************************************************************************/
+void find_changed_meshes(struct mesh_signatures *changed,
+                         struct mesh_signatures *old_meshes,
+                         struct mesh_signatures *new_meshes) {
+  struct mesh_signatures *sides[2] = { old_meshes, new_meshes };
+  for (int side = 0; side < 2; side++) {
+    struct mesh_signatures *these = sides[side];
+    struct mesh_signatures *others = sides[1 - side];
+    for (int i = 0; i < these->n_meshes; i++) {
+      struct mesh_signature *sig = &these->meshes[i];
+      int unchanged = 0;
+      for (int j = 0; j < others->n_meshes && !unchanged; j++) {
+        unchanged = (others->meshes[j].hash == sig->hash &&
+                     strcmp(others->meshes[j].name, sig->name) == 0);
+      }
+      if (unchanged)
+        continue;
+
+      if (changed->n_meshes == changed->capacity) {
+        changed->capacity = (changed->capacity == 0) ? 16 : 2 * changed->capacity;
+        changed->meshes = (struct mesh_signature *)realloc(
+            changed->meshes, changed->capacity * sizeof(struct mesh_signature));
+
+        if (changed->meshes == NULL)
+          mcell_allocfailed("Failed to allocate mesh signatures.");
+      }
+      struct mesh_signature *copy = &changed->meshes[changed->n_meshes++];
+      *copy = *sig;
+      copy->name = CHECKED_STRDUP(sig->name, "mesh name");
+    }
+  }
+}
+
+/***************************************************************************
+ free_mesh_signatures:
+
+ In:  signatures: mesh signatures
+ Out: Nothing. The signatures are freed and the list emptied.
+***************************************************************************/
+void free_mesh_signatures(struct mesh_signatures *signatures) {
+  for (int i = 0; i < signatures->n_meshes; i++)
+    free(signatures->meshes[i].name);
+  free(signatures->meshes);
+  signatures->meshes = NULL;
+  signatures->n_meshes = 0;
+  signatures->capacity = 0;
+}
+
+/***************************************************************************
+ ray_misses_meshes:
+
+ In:  pos: the position of a volume molecule
+      signatures: mesh signatures
+ Out: 1 if the ray find_enclosing_meshes casts from pos (along +z) cannot
+      hit any wall of these meshes, 0 otherwise.
+***************************************************************************/
+int ray_misses_meshes(struct vector3 const *pos,
+                      struct mesh_signatures const *signatures) {
+  for (int i = 0; i < signatures->n_meshes; i++) {
+    struct mesh_signature const *sig = &signatures->meshes[i];
+    if (pos->x >= sig->llf.x - EPS_C && pos->x <= sig->urb.x + EPS_C &&
+        pos->y >= sig->llf.y - EPS_C && pos->y <= sig->urb.y + EPS_C &&
+        pos->z <= sig->urb.z + EPS_C)
+      return 0;
+  }
+  return 1;
+}
+
+/***************************************************************************
+ init_nesting_cache:
+
+ In:  cache: the cache to set up
+      n_subvols: number of subvolumes in the world
+ Out: Nothing. The cache holds no meshes yet.
+***************************************************************************/
+void init_nesting_cache(struct nesting_cache *cache, int n_subvols) {
+  cache->n_subvols = n_subvols;
+  cache->mesh_names = CHECKED_MALLOC_ARRAY(struct string_buffer *, n_subvols,
+                                           "enclosing meshes of subvolumes");
+  memset(cache->mesh_names, 0, n_subvols * sizeof(struct string_buffer *));
+}
+
+/***************************************************************************
+ free_nesting_cache:
+
+ In:  cache: a cache set up with init_nesting_cache
+ Out: Nothing. The cached lists of meshes are freed.
+***************************************************************************/
+void free_nesting_cache(struct nesting_cache *cache) {
+  for (int i = 0; i < cache->n_subvols; i++) {
+    if (cache->mesh_names[i] != NULL) {
+      destroy_string_buffer(cache->mesh_names[i]);
+      free(cache->mesh_names[i]);
+    }
+  }
+  free(cache->mesh_names);
+  cache->mesh_names = NULL;
+  cache->n_subvols = 0;
+}
+
+/***************************************************************************
+ copy_mesh_names:
+
+ In:  mesh_names: a list of mesh names
+ Out: A copy of the list, with copies of the names.
+***************************************************************************/
+static struct string_buffer *copy_mesh_names(
+    struct string_buffer const *mesh_names) {
+  struct string_buffer *copy =
+      CHECKED_MALLOC_STRUCT(struct string_buffer, "string buffer");
+  initialize_string_buffer(copy, mesh_names->max_strings);
+  for (int i = 0; i < mesh_names->n_strings; i++) {
+    char *str = CHECKED_STRDUP(mesh_names->strings[i], "mesh name");
+    if (add_string_to_buffer(copy, str)) {
+      free(str);
+      destroy_string_buffer(copy);
+      free(copy);
+      return NULL;
+    }
+  }
+  return copy;
+}
+
+/***************************************************************************
+ find_enclosing_meshes_cached:
+
+ In:  state: MCell state
+      vm: volume molecule (its subvolume must be set)
+      meshes_to_ignore: ignore these meshes, as in find_enclosing_meshes
+      cache: the meshes enclosing the subvolumes looked up so far, or NULL
+ Out: The meshes enclosing vm, as find_enclosing_meshes returns them. No
+      wall crosses a subvolume with an empty wall list, so all of it is
+      inside the same meshes: the ray is traced for the first molecule in
+      such a subvolume only, and the others get a copy of its list.
+***************************************************************************/
+struct string_buffer *find_enclosing_meshes_cached(
+    struct volume *state,
+    struct volume_molecule *vm,
+    struct string_buffer *meshes_to_ignore,
+    struct nesting_cache *cache) {
+  if (cache == NULL || vm->subvol == NULL || vm->subvol->wall_head != NULL)
+    return find_enclosing_meshes(state, vm, meshes_to_ignore);
+
+  int sv_index = vm->subvol - state->subvol;
+  if (cache->mesh_names[sv_index] == NULL) {
+    cache->mesh_names[sv_index] =
+        find_enclosing_meshes(state, vm, meshes_to_ignore);
+    if (cache->mesh_names[sv_index] == NULL)
+      return NULL;
+  }
+  return copy_mesh_names(cache->mesh_names[sv_index]);
+}
+
 /***************************************************************************
  save_all_molecules: Save all the molecules currently in the scheduler.
 
  In:  state: MCell state
       storage_head: we will pull all the molecules out of the scheduler from
         this
+      meshes: the signatures of all current meshes, or NULL
  Out: An array of all the molecules to be saved
 ***************************************************************************/
 struct molecule_info **save_all_molecules(struct volume *state,
-                                          struct storage_list *storage_head) {
+                                          struct storage_list *storage_head,
+                                          struct mesh_signatures *meshes) {
+
+  // Molecules that share a subvolume no wall crosses share their nesting
+  struct nesting_cache nesting;
+  init_nesting_cache(&nesting, state->n_subvols);
 
   // Find total number of molecules in the scheduler.
   unsigned long long num_all_molecules = count_items_in_scheduler(storage_head);
@@ -92,7 +332,8 @@ struct molecule_info **save_all_molecules(struct volume *state,
           char *mesh_name = NULL;
 
           if ((am_ptr->properties->flags & NOT_FREE) == 0) {
-            save_volume_molecule(state, mol_info, am_ptr, &nested_mesh_names);
+            save_volume_molecule(state, mol_info, am_ptr, &nested_mesh_names,
+                                 meshes, &nesting);
           } else if ((am_ptr->properties->flags & ON_GRID) != 0) {
             if (save_surface_molecule(mol_info, am_ptr, &reg_names, &mesh_name))
               return NULL;
@@ -110,6 +351,7 @@ struct molecule_info **save_all_molecules(struct volume *state,
   }
 
   state->num_all_molecules = ctr;
+  free_nesting_cache(&nesting);
 
   return all_molecules;
 }
@@ -155,15 +397,27 @@ void save_common_molecule_properties(struct molecule_info *mol_info,
       mol_info: holds all the information for recreating and placing a molecule
       am_ptr: abstract molecule pointer
       nested_mesh_names: mesh names that molecule is inside of
+      meshes: the signatures of all current meshes, or NULL
+      nesting: the meshes enclosing the subvolumes seen so far, or NULL
  Out: Nothing. Molecule info and mesh name are updated
 ***************************************************************************/
 void save_volume_molecule(struct volume *state,
                           struct molecule_info *mol_info,
                           struct abstract_molecule *am_ptr,
-                          struct string_buffer **nested_mesh_names) {
+                          struct string_buffer **nested_mesh_names,
+                          struct mesh_signatures *meshes,
+                          struct nesting_cache *nesting) {
   struct volume_molecule *vm_ptr = (struct volume_molecule *)am_ptr;
 
-  *nested_mesh_names = find_enclosing_meshes(state, vm_ptr, NULL);
+  // A molecule that no mesh is above can't be inside any of them
+  if (meshes != NULL && ray_misses_meshes(&vm_ptr->pos, meshes)) {
+    *nested_mesh_names =
+        CHECKED_MALLOC_STRUCT(struct string_buffer, "string buffer");
+    initialize_string_buffer(*nested_mesh_names, MAX_NUM_OBJECTS);
+  } else {
+    *nested_mesh_names =
+        find_enclosing_meshes_cached(state, vm_ptr, NULL, nesting);
+  }
   mol_info->pos.x = vm_ptr->pos.x;
   mol_info->pos.y = vm_ptr->pos.y;
   mol_info->pos.z = vm_ptr->pos.z;
@@ -250,12 +504,16 @@ void cleanup_names_molecs(
  In:  state: MCell state
       meshes_to_ignore: don't place molecules on these meshes
       regions_to_ignore: don't place molecules on these regions
- Out: Zero on success. One otherwise.
+      changed_meshes: the meshes the geometry change affected, or NULL if
+        it may have affected any of them
+ Out: Zero on success. One otherwise. Only volume molecules that a changed
+      mesh may have moved past are checked against the new geometry.
 ***************************************************************************/
 int place_all_molecules(
     struct volume *state,
     struct string_buffer *meshes_to_ignore,
-    struct string_buffer *regions_to_ignore) {
+    struct string_buffer *regions_to_ignore,
+    struct mesh_signatures *changed_meshes) {
 
   struct volume_molecule vm;
   memset(&vm, 0, sizeof(struct volume_molecule));
@@ -263,12 +521,13 @@ int place_all_molecules(
   struct volume_molecule *vm_guess = NULL;
 
   int num_all_molecules = state->num_all_molecules;
+  struct nesting_cache nesting;
+  init_nesting_cache(&nesting, state->n_subvols);
 
   for (int n_mol = 0; n_mol < num_all_molecules; n_mol++) {
 
     struct molecule_info *mol_info = state->all_molecules[n_mol];
     struct abstract_molecule *am_ptr = mol_info->molecule;
-    initialize_diffusion_function(am_ptr);
     // Insert volume molecule into world.
     if ((am_ptr->properties->flags & NOT_FREE) == 0) {
       vm_ptr->t = am_ptr->t;
@@ -281,10 +540,12 @@ int place_all_molecules(
       vm_ptr->pos.y = mol_info->pos.y;
       vm_ptr->pos.z = mol_info->pos.z;
       vm_ptr->periodic_box = am_ptr->periodic_box;
-      initialize_diffusion_function((struct abstract_molecule*)vm_ptr);
 
+      int check_nesting = (changed_meshes == NULL ||
+                           !ray_misses_meshes(&vm_ptr->pos, changed_meshes));
       vm_guess = insert_volume_molecule_encl_mesh(
-          state, vm_ptr, vm_guess, mol_info->mesh_names, meshes_to_ignore);
+          state, vm_ptr, vm_guess, mol_info->mesh_names, meshes_to_ignore,
+          check_nesting ? &nesting : NULL);
 
       if (vm_guess == NULL) {
         mcell_error("Cannot insert copy of molecule of species '%s' into "
@@ -298,8 +559,7 @@ int place_all_molecules(
       struct surface_molecule *sm = insert_surface_molecule(
           state, am_ptr->properties, &mol_info->pos, mol_info->orient,
           state->vacancy_search_dist2, am_ptr->t, mesh_name,
-          mol_info->reg_names, regions_to_ignore, am_ptr->periodic_box);
-      free(am_ptr->periodic_box);
+          mol_info->reg_names, regions_to_ignore, &am_ptr->periodic_box);
       if (sm == NULL) {
         mcell_warn("Unable to find surface upon which to place molecule %s.",
                    am_ptr->properties->sym->name);
@@ -307,6 +567,7 @@ int place_all_molecules(
     }
   }
 
+  free_nesting_cache(&nesting);
   cleanup_names_molecs(state->num_all_molecules, state->all_molecules);
 
   return 0;
@@ -570,46 +831,27 @@ const char *check_outin_or_inout(
 }
 
 /*************************************************************************
-insert_volume_molecule_encl_mesh:
+place_volume_molecule_encl_mesh:
   In: state: MCell state
-      vm: pointer to volume_molecule that we're going to place in local storage
-      vm_guess: pointer to a volume_molecule that may be nearby
+      vm: the volume molecule being placed
+      new_vm: its copy in local storage
+      sv: the subvolume new_vm is in
       nested_mesh_names_old: the meshes this molecule was inside of previously
       meshes_to_ignore: the meshes we should ignore when placing this molecule
-  Out: pointer to the new volume_molecule (copies data from volume molecule
-       passed in), or NULL if out of memory.  Molecule is placed in scheduler
-       also.
+      nesting: the meshes enclosing the subvolumes seen so far
+  Out: Nothing. If the new geometry moved a mesh past the molecule, new_vm
+       is moved back to the same side of it and its subvolume updated.
 *************************************************************************/
-struct volume_molecule *insert_volume_molecule_encl_mesh(
+static void place_volume_molecule_encl_mesh(
     struct volume *state,
     struct volume_molecule *vm,
-    struct volume_molecule *vm_guess,
+    struct volume_molecule *new_vm,
+    struct subvolume *sv,
     struct string_buffer *nested_mesh_names_old,
-    struct string_buffer *meshes_to_ignore) {
-  struct subvolume *sv;
-
-  // We should only have to do this the first time this function gets called
-  if (vm_guess == NULL)
-    sv = find_subvolume(state, &(vm->pos), NULL);
-  // This should speed things up if the last molecule was close to this one
-  else if (inside_subvolume(&(vm->pos), vm_guess->subvol, state->x_fineparts,
-                            state->y_fineparts, state->z_fineparts)) {
-    sv = vm_guess->subvol;
-  } else
-    sv = find_subvolume(state, &(vm->pos), vm_guess->subvol);
-
-  struct volume_molecule *new_vm = (struct volume_molecule *)CHECKED_MEM_GET(
-    sv->local_storage->mol, "volume molecule");
-  memcpy(new_vm, vm, sizeof(struct volume_molecule));
-  new_vm->mesh_name = NULL;
-  new_vm->prev_v = NULL;
-  new_vm->next_v = NULL;
-  new_vm->next = NULL;
-  new_vm->subvol = sv;
-  new_vm->periodic_box = vm->periodic_box;
-
-  struct string_buffer *nested_mesh_names_new = find_enclosing_meshes(
-      state, new_vm, meshes_to_ignore);
+    struct string_buffer *meshes_to_ignore,
+    struct nesting_cache *nesting) {
+  struct string_buffer *nested_mesh_names_new = find_enclosing_meshes_cached(
+      state, new_vm, meshes_to_ignore, nesting);
 
   // Make a new string buffer without all the meshes we don't care about (i.e.
   // the ones we *removed* in this dyn_geom_event). We are already ingoring the
@@ -656,11 +898,61 @@ struct volume_molecule *insert_volume_molecule_encl_mesh(
   free(nested_mesh_names_old_filtered);
   destroy_string_buffer(nested_mesh_names_new);
   free(nested_mesh_names_new);
+}
+
+/*************************************************************************
+insert_volume_molecule_encl_mesh:
+  In: state: MCell state
+      vm: pointer to volume_molecule that we're going to place in local storage
+      vm_guess: pointer to a volume_molecule that may be nearby
+      nested_mesh_names_old: the meshes this molecule was inside of previously
+      meshes_to_ignore: the meshes we should ignore when placing this molecule
+      nesting: the meshes enclosing the subvolumes seen so far in the new
+        geometry. If NULL, the meshes around the molecule are known not to
+        have changed, and it stays where it is
+  Out: pointer to the new volume_molecule (copies data from volume molecule
+       passed in), or NULL if out of memory.  Molecule is placed in scheduler
+       also.
+*************************************************************************/
+struct volume_molecule *insert_volume_molecule_encl_mesh(
+    struct volume *state,
+    struct volume_molecule *vm,
+    struct volume_molecule *vm_guess,
+    struct string_buffer *nested_mesh_names_old,
+    struct string_buffer *meshes_to_ignore,
+    struct nesting_cache *nesting) {
+  struct subvolume *sv;
+
+  // We should only have to do this the first time this function gets called
+  if (vm_guess == NULL)
+    sv = find_subvolume(state, &(vm->pos), NULL);
+  // This should speed things up if the last molecule was close to this one
+  else if (inside_subvolume(&(vm->pos), vm_guess->subvol, state->x_fineparts,
+                            state->y_fineparts, state->z_fineparts)) {
+    sv = vm_guess->subvol;
+  } else
+    sv = find_subvolume(state, &(vm->pos), vm_guess->subvol);
+
+  struct volume_molecule *new_vm = (struct volume_molecule *)CHECKED_MEM_GET(
+    sv->local_storage->mol, "volume molecule");
+  memcpy(new_vm, vm, sizeof(struct volume_molecule));
+  new_vm->mesh_name = NULL;
+  new_vm->species_list = NULL;
+  new_vm->next = NULL;
+  new_vm->subvol = sv;
+  new_vm->periodic_box = vm->periodic_box;
+
+  if (nesting != NULL)
+    place_volume_molecule_encl_mesh(state, vm, new_vm, sv,
+                                    nested_mesh_names_old, meshes_to_ignore,
+                                    nesting);
 
   new_vm->birthplace = new_vm->subvol->local_storage->mol;
   ht_add_molecule_to_list(&(new_vm->subvol->mol_by_species), new_vm);
   new_vm->subvol->mol_count++;
+  mol_id_index_set(state->mol_id_index, (struct abstract_molecule *)new_vm);
   new_vm->properties->population++;
+  acquire_molecule_graph((struct abstract_molecule *)new_vm);
 
   if ((new_vm->properties->flags & COUNT_SOME_MASK) != 0) {
     new_vm->flags |= COUNT_ME;
@@ -669,7 +961,7 @@ struct volume_molecule *insert_volume_molecule_encl_mesh(
   if (new_vm->properties->flags & (COUNT_CONTENTS | COUNT_ENCLOSED)) {
     count_region_from_scratch(state, (struct abstract_molecule *)new_vm, NULL,
                               1, &(new_vm->pos), NULL, new_vm->t,
-                              new_vm->periodic_box);
+                              &new_vm->periodic_box);
   }
 
   if (schedule_add(new_vm->subvol->local_storage->timer, new_vm))
@@ -704,10 +996,10 @@ void check_for_large_molecular_displacement(
       break;
 
     case WARN_WARN:
-      mcell_warn("Displacement of '%s' is greater than l_r_bar.\n"
-                 "\tdisplacement = %.9g microns\n"
-                 "\tl_r_bar = %.9g microns\n",
-                 vm->properties->sym->name, displacement, l_r_bar);
+      mcell_warn_limited("Displacement of '%s' is greater than l_r_bar.\n"
+                         "\tdisplacement = %.9g microns\n"
+                         "\tl_r_bar = %.9g microns\n",
+                         vm->properties->sym->name, displacement, l_r_bar);
       break;
 
     case WARN_ERROR:
@@ -861,8 +1153,7 @@ struct string_buffer *find_enclosing_meshes(
   // We create a virtual molecule, so that we don't displace the real one (vm).
   struct volume_molecule virt_mol;
   memcpy(&virt_mol, vm, sizeof(struct volume_molecule));
-  virt_mol.prev_v = NULL;
-  virt_mol.next_v = NULL;
+  virt_mol.species_list = NULL;
   virt_mol.next = NULL;
 
   // This is where we will store the names of the meshes we are nested in.
@@ -894,6 +1185,9 @@ struct string_buffer *find_enclosing_meshes(
   struct subvolume *sv = virt_mol.subvol;
   struct name_hits *nh_head = NULL, *nh_tail = NULL;
   do {
+    // The previous list has been consumed; reclaim it before tracing on
+    mem_arena_reset(sv->local_storage->coll);
+
     // Get collision list for walls and a subvolume. We don't care about
     // colliding with other molecules like we do with reactions
     shead = ray_trace(state, &(virt_mol.pos), NULL, sv, &displace_vector, NULL);
@@ -1205,9 +1499,25 @@ int destroy_everything(struct volume *state) {
   if (state->clamp_list) {
     free(state->clamp_list->side_idx);
     free(state->clamp_list->cum_area);
+    free(state->clamp_list->side_guide);
   }
 
   destroy_walls(state);
+  clear_product_placement_cache(state);
+
+  // Destroy the molecule arrays and cell indices of the per-species lists,
+  // which go away with their memory helpers below, as do the molecules the
+  // id index points to
+  clear_mol_id_index(state->mol_id_index);
+  for (int i = 0; i < state->n_subvols; i++) {
+    struct subvolume *sv = &state->subvol[i];
+    for (struct per_species_list *psl = sv->species_head; psl != NULL;
+         psl = psl->next) {
+      free(psl->mols);
+      free_species_cell_index(psl->cells);
+    }
+    sv->species_head = NULL;
+  }
 
   // Destroy memory helpers
   delete_mem(state->coll_mem);
@@ -1226,6 +1536,7 @@ int destroy_everything(struct volume *state) {
   }
 
   // Destroy subvolumes
+  destroy_wall_planes(state);
   for (int i = 0; i < state->n_subvols; i++) {
     struct subvolume *sv = &state->subvol[i];
     pointer_hash_destroy(&sv->mol_by_species);
@@ -1236,6 +1547,8 @@ int destroy_everything(struct volume *state) {
   }
 
   for (mem = state->storage_head; mem != NULL; mem = mem->next) {
+    // Keep the counts of the storage's threaded passes
+    sim_stats_add(&state->stats, &mem->store->stats);
     delete_scheduler(mem->store->timer);
     free(mem->store);
   }
@@ -1268,13 +1581,10 @@ destroy_walls:
   Out: Free up the memory for the walls and vertices
 ***************************************************************************/
 void destroy_walls(struct volume *state) {
-  if (state->walls_using_vertex) {
-    for (int i = 0; i<state->n_verts; i++) {
-      delete_void_list((struct void_list *)state->walls_using_vertex[i]);
-    }
-  }
-
-  free(state->walls_using_vertex);
+  free(state->vertex_wall_offsets);
+  free(state->vertex_walls);
+  state->vertex_wall_offsets = NULL;
+  state->vertex_walls = NULL;
   free(state->all_vertices);
   state->n_walls = 0;
   state->n_verts = 0;
@@ -1300,6 +1610,13 @@ void destroy_partitions(struct volume *state) {
   state->x_partitions = NULL;
   state->y_partitions = NULL;
   state->z_partitions = NULL;
+
+  free(state->x_lookup.first);
+  free(state->y_lookup.first);
+  free(state->z_lookup.first);
+  memset(&state->x_lookup, 0, sizeof(struct partition_lookup));
+  memset(&state->y_lookup, 0, sizeof(struct partition_lookup));
+  memset(&state->z_lookup, 0, sizeof(struct partition_lookup));
 }
 
 /***************************************************************************
@@ -1352,9 +1669,14 @@ int destroy_poly_object(struct object *obj_ptr, int free_poly_flag) {
       struct wall *w = obj_ptr->wall_p[wall_num];
       if (w->grid) {
         /*free(w->grid->mol);*/
-        delete_void_list((struct void_list *)w->grid->sm_list);
+        destroy_tile_neighbor_index(w->grid);
+        free_bit_array(w->grid->vacant);
+        w->grid->vacant = NULL;
+        if (!w->grid->tiles_shared)
+          delete_void_list((struct void_list *)w->grid->sm_list);
       } 
       delete_void_list((struct void_list *)w->surf_class_head);
+      free_wall_rx_cache(w);
     }
     struct polygon_object *poly_obj_ptr = (struct polygon_object *)obj_ptr->contents;
     free(poly_obj_ptr->side_removed);
@@ -1376,6 +1698,8 @@ int destroy_poly_object(struct object *obj_ptr, int free_poly_flag) {
   obj_ptr->wall_p = NULL;
   free(obj_ptr->vertices);
   obj_ptr->vertices = NULL;
+  free(obj_ptr->world_verts);
+  obj_ptr->world_verts = NULL;
 
   obj_ptr->wall_p = NULL;
   obj_ptr->n_walls = 0;
@@ -1924,9 +2248,12 @@ int add_dynamic_geometry_events(
         }
         // Do the normal DG parsing on every other time
         else {
-          parse_dg_init(dg_parse, full_file_name, state);
-          destroy_objects(state->root_instance, 0);
-          destroy_objects(state->root_object, 0);
+          // Vertex frames keep the meshes there are; only MDL is parsed
+          if (!is_vertex_frame_file(full_file_name)) {
+            parse_dg_init(dg_parse, full_file_name, state);
+            destroy_objects(state->root_instance, 0);
+            destroy_objects(state->root_object, 0);
+          }
 
           struct dg_time_filename *dyn_geom;
           dyn_geom = (struct dg_time_filename *)CHECKED_MEM_GET(dynamic_geometry_events_mem,
@@ -2166,6 +2493,979 @@ int get_reg_names_this_object(
   return 0;
 }
 
+/***************************************************************************
+find_instantiated_mesh:
+
+ In:  obj_ptr: the object to look for the mesh in (e.g. root_instance)
+      mesh_name: fully qualified name of the mesh
+ Out: The instantiated polygon or box object of that name, or NULL.
+***************************************************************************/
+struct object *find_instantiated_mesh(struct object *obj_ptr,
+                                      char const *mesh_name) {
+  switch (obj_ptr->object_type) {
+  case META_OBJ:
+    for (struct object *child_obj_ptr = obj_ptr->first_child;
+         child_obj_ptr != NULL; child_obj_ptr = child_obj_ptr->next) {
+      struct object *found = find_instantiated_mesh(child_obj_ptr, mesh_name);
+      if (found != NULL)
+        return found;
+    }
+    break;
+  case BOX_OBJ:
+  case POLY_OBJ:
+    if (strcmp(obj_ptr->sym->name, mesh_name) == 0)
+      return obj_ptr;
+    break;
+
+  // do nothing
+  case REL_SITE_OBJ:
+  case VOXEL_OBJ:
+    break;
+  }
+  return NULL;
+}
+
+/* A volume molecule near a mesh whose vertices are moving */
+struct moved_mesh_molecule {
+  struct volume_molecule *vm;
+  struct string_buffer *mesh_names; /* Meshes it was nested in */
+};
+
+/***************************************************************************
+check_mesh_vertices:
+
+ In:  state: MCell state
+      obj_ptr: an instantiated mesh
+      new_verts: new positions of all of its vertices, in internal units
+      report: if set, say what is wrong with them
+ Out: Zero if the mesh can be moved there by move_mesh_vertices: every
+      vertex stays within the partitions, and no wall with a grid becomes
+      degenerate. One otherwise.
+***************************************************************************/
+int check_mesh_vertices(struct volume *state, struct object *obj_ptr,
+                        struct vector3 const *new_verts, int report) {
+  for (int i = 0; i < obj_ptr->n_verts; i++) {
+    struct vector3 const *v = &new_verts[i];
+    if (v->x < state->x_partitions[0] ||
+        v->x > state->x_partitions[state->nx_parts - 1] ||
+        v->y < state->y_partitions[0] ||
+        v->y > state->y_partitions[state->ny_parts - 1] ||
+        v->z < state->z_partitions[0] ||
+        v->z > state->z_partitions[state->nz_parts - 1]) {
+      if (report)
+        mcell_error_nodie("Vertex %d of mesh '%s' moves outside of the "
+                          "world.", i, obj_ptr->sym->name);
+      return 1;
+    }
+  }
+  for (int n_wall = 0; n_wall < obj_ptr->n_walls; n_wall++) {
+    struct wall *w = obj_ptr->wall_p[n_wall];
+    if (w == NULL || w->grid == NULL)
+      continue;
+    struct vector3 const *v[3];
+    for (int k = 0; k < 3; k++)
+      v[k] = &new_verts[w->vert[k] - obj_ptr->vertices[0]];
+    struct vector3 vA, vB, vX;
+    vectorize(v[0], v[1], &vA);
+    vectorize(v[0], v[2], &vB);
+    cross_prod(&vA, &vB, &vX);
+    if (!distinguishable(0.5 * vect_length(&vX), 0, EPS_C)) {
+      if (report)
+        mcell_error_nodie("Wall %d of mesh '%s' would become degenerate.",
+                          n_wall, obj_ptr->sym->name);
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/***************************************************************************
+move_mesh_vertices:
+
+ In:  state: MCell state
+      obj_ptr: an instantiated mesh
+      new_verts: the new positions of all of its vertices, in internal units
+ Out: Zero on success. One otherwise, in which case nothing is changed.
+      The mesh keeps its walls, edges, grids and regions; only their
+      geometry is updated, and the walls are moved into the wall lists of
+      the subvolumes they now cross. Surface molecules keep their place on
+      their tiles. Volume molecules that the moving walls pass are moved back
+      to the same side of the mesh, as after a dynamic geometry change.
+***************************************************************************/
+int move_mesh_vertices(struct volume *state, struct object *obj_ptr,
+                       struct vector3 const *new_verts) {
+
+  if (check_mesh_vertices(state, obj_ptr, new_verts, 1))
+    return 1;
+
+  // Everywhere the mesh was or will be
+  struct mesh_signature swept;
+  swept.name = obj_ptr->sym->name;
+  swept.llf.x = swept.llf.y = swept.llf.z = GIGANTIC;
+  swept.urb.x = swept.urb.y = swept.urb.z = -GIGANTIC;
+  for (int i = 0; i < obj_ptr->n_verts; i++) {
+    struct vector3 const *v[2] = { obj_ptr->vertices[i], &new_verts[i] };
+    for (int k = 0; k < 2; k++) {
+      swept.llf.x = min2d(swept.llf.x, v[k]->x);
+      swept.llf.y = min2d(swept.llf.y, v[k]->y);
+      swept.llf.z = min2d(swept.llf.z, v[k]->z);
+      swept.urb.x = max2d(swept.urb.x, v[k]->x);
+      swept.urb.y = max2d(swept.urb.y, v[k]->y);
+      swept.urb.z = max2d(swept.urb.z, v[k]->z);
+    }
+  }
+
+  // Only molecules within reach of the mesh can end up on its other side.
+  // Take them out of the counts while the old geometry still stands.
+  int n_moved = 0, moved_capacity = 0;
+  struct moved_mesh_molecule *moved = NULL;
+  for (struct storage_list *sl_ptr = state->storage_head; sl_ptr != NULL;
+       sl_ptr = sl_ptr->next) {
+    for (struct schedule_helper *sh_ptr = sl_ptr->store->timer; sh_ptr != NULL;
+         sh_ptr = sh_ptr->next_scale) {
+      for (int i = -1; i < sh_ptr->buf_len; i++) {
+        for (struct abstract_element *ae_ptr =
+                 (i < 0) ? sh_ptr->current : sh_ptr->circ_buf_head[i];
+             ae_ptr != NULL; ae_ptr = ae_ptr->next) {
+          struct abstract_molecule *am_ptr = (struct abstract_molecule *)ae_ptr;
+          if (am_ptr->properties == NULL ||
+              (am_ptr->properties->flags & NOT_FREE) != 0)
+            continue;
+          struct volume_molecule *vm_ptr = (struct volume_molecule *)am_ptr;
+          if (vm_ptr->pos.x < swept.llf.x - EPS_C ||
+              vm_ptr->pos.x > swept.urb.x + EPS_C ||
+              vm_ptr->pos.y < swept.llf.y - EPS_C ||
+              vm_ptr->pos.y > swept.urb.y + EPS_C ||
+              vm_ptr->pos.z < swept.llf.z - EPS_C ||
+              vm_ptr->pos.z > swept.urb.z + EPS_C)
+            continue;
+
+          if (n_moved == moved_capacity) {
+            moved_capacity = (moved_capacity == 0) ? 64 : 2 * moved_capacity;
+            moved = (struct moved_mesh_molecule *)realloc(
+                moved, moved_capacity * sizeof(*moved));
+
+            if (moved == NULL)
+              mcell_allocfailed("Failed to allocate list of molecules near "
+                                "a moving mesh.");
+          }
+          moved[n_moved].vm = vm_ptr;
+          moved[n_moved].mesh_names =
+              find_enclosing_meshes(state, vm_ptr, NULL);
+          n_moved++;
+
+          if (vm_ptr->properties->flags & (COUNT_CONTENTS | COUNT_ENCLOSED))
+            count_region_from_scratch(state, am_ptr, NULL, -1, &vm_ptr->pos,
+                                      NULL, vm_ptr->t, &vm_ptr->periodic_box);
+        }
+      }
+    }
+  }
+
+  // Surface molecules on the mesh ride along with their tiles. Hold their
+  // barycentric coordinates in s_pos while the walls change.
+  for (int n_wall = 0; n_wall < obj_ptr->n_walls; n_wall++) {
+    struct wall *w = obj_ptr->wall_p[n_wall];
+    if (w == NULL || w->grid == NULL)
+      continue;
+    struct surface_grid *sg = w->grid;
+    for (unsigned int n_tile = 0; n_tile < sg->n_tiles; n_tile++) {
+      for (struct surface_molecule_list *sml = sg->sm_list[n_tile];
+           sml != NULL; sml = sml->next) {
+        struct surface_molecule *sm = sml->sm;
+        if (sm == NULL || sm->properties == NULL)
+          continue;
+        if (sm->properties->flags & (COUNT_CONTENTS | COUNT_ENCLOSED))
+          count_region_from_scratch(state, (struct abstract_molecule *)sm,
+                                    NULL, -1, NULL, w, sm->t, NULL);
+        double b2 = sm->s_pos.v / w->uv_vert2.v;
+        double b1 = (sm->s_pos.u - b2 * w->uv_vert2.u) / w->uv_vert1_u;
+        sm->s_pos.u = b1;
+        sm->s_pos.v = b2;
+      }
+    }
+  }
+
+  // Take the walls out of the subvolumes they were in
+  for (int i = 0; i < state->n_subvols; i++) {
+    struct subvolume *sv = &state->subvol[i];
+    struct wall_list **wlp = &sv->wall_head;
+    while (*wlp != NULL) {
+      struct wall_list *wl = *wlp;
+      if (wl->this_wall->parent_object == obj_ptr) {
+        *wlp = wl->next;
+        mem_put(sv->local_storage->list, wl);
+      } else
+        wlp = &wl->next;
+    }
+  }
+
+  for (int i = 0; i < obj_ptr->n_verts; i++)
+    *obj_ptr->vertices[i] = new_verts[i];
+
+  // Update the walls, their grids and surface molecules, and put them into
+  // the subvolumes they are in now
+  double total_area = 0;
+  for (int n_wall = 0; n_wall < obj_ptr->n_walls; n_wall++) {
+    struct wall *w = obj_ptr->wall_p[n_wall];
+    if (w == NULL)
+      continue;
+    init_wall_geometry(w);
+    total_area += w->area;
+
+    if (w->grid != NULL) {
+      struct surface_grid *sg = w->grid;
+      sg->binding_factor = ((double)sg->n_tiles) / w->area;
+      init_grid_geometry(sg);
+      destroy_tile_neighbor_index(sg);
+      for (unsigned int n_tile = 0; n_tile < sg->n_tiles; n_tile++) {
+        for (struct surface_molecule_list *sml = sg->sm_list[n_tile];
+             sml != NULL; sml = sml->next) {
+          struct surface_molecule *sm = sml->sm;
+          if (sm == NULL || sm->properties == NULL)
+            continue;
+          double b1 = sm->s_pos.u, b2 = sm->s_pos.v;
+          sm->s_pos.u = b1 * w->uv_vert1_u + b2 * w->uv_vert2.u;
+          sm->s_pos.v = b2 * w->uv_vert2.v;
+        }
+      }
+    }
+
+    if (redistribute_wall(state, w))
+      mcell_allocfailed("Failed to distribute wall %d on object %s.", n_wall,
+                        obj_ptr->sym->name);
+  }
+  obj_ptr->total_area = total_area;
+
+  // Edges between the walls
+  for (int n_wall = 0; n_wall < obj_ptr->n_walls; n_wall++) {
+    struct wall *w = obj_ptr->wall_p[n_wall];
+    if (w == NULL)
+      continue;
+    for (int k = 0; k < 3; k++) {
+      struct edge *e = w->edges[k];
+      if (e != NULL && e->forward == w && e->backward != NULL)
+        init_edge_transform(e, k);
+    }
+  }
+
+  for (struct region_list *rl = obj_ptr->regions; rl != NULL; rl = rl->next) {
+    struct region *rp = rl->reg;
+    if (rp->membership == NULL)
+      continue;
+    rp->area = 0;
+    for (int n_wall = next_set_bit(rp->membership, 0); n_wall >= 0;
+         n_wall = next_set_bit(rp->membership, n_wall + 1)) {
+      if (obj_ptr->wall_p[n_wall] != NULL)
+        rp->area += obj_ptr->wall_p[n_wall]->area;
+    }
+  }
+
+  if (build_wall_planes(state))
+    mcell_allocfailed("Failed to build the planes of the walls.");
+  if (assign_step_multipliers(state))
+    mcell_allocfailed("Failed to assign the time step multipliers.");
+
+  if (state->place_waypoints_flag) {
+    for (int i = 0; i < state->n_waypoints; i++) {
+      struct mem_helper *regl = state->subvol[i].local_storage->regl;
+      if (state->waypoints[i].regions != NULL)
+        mem_put_list(regl, state->waypoints[i].regions);
+      if (state->waypoints[i].antiregions != NULL)
+        mem_put_list(regl, state->waypoints[i].antiregions);
+    }
+    if (place_waypoints(state))
+      mcell_allocfailed("Failed to place waypoints.");
+  }
+
+  for (int n_wall = 0; n_wall < obj_ptr->n_walls; n_wall++) {
+    struct wall *w = obj_ptr->wall_p[n_wall];
+    if (w == NULL || w->grid == NULL)
+      continue;
+    struct surface_grid *sg = w->grid;
+    for (unsigned int n_tile = 0; n_tile < sg->n_tiles; n_tile++) {
+      for (struct surface_molecule_list *sml = sg->sm_list[n_tile];
+           sml != NULL; sml = sml->next) {
+        struct surface_molecule *sm = sml->sm;
+        if (sm != NULL && sm->properties != NULL &&
+            (sm->properties->flags & (COUNT_CONTENTS | COUNT_ENCLOSED)))
+          count_region_from_scratch(state, (struct abstract_molecule *)sm,
+                                    NULL, 1, NULL, w, sm->t, NULL);
+      }
+    }
+  }
+
+  // Move volume molecules back to the side of the mesh they were on
+  for (int n_mol = 0; n_mol < n_moved; n_mol++) {
+    struct volume_molecule *vm_ptr = moved[n_mol].vm;
+    struct string_buffer *mesh_names_new =
+        find_enclosing_meshes(state, vm_ptr, NULL);
+
+    const char *species_name = vm_ptr->properties->sym->name;
+    unsigned int keyhash = (unsigned int)(intptr_t)(species_name);
+    void *key = (void *)(species_name);
+    struct mesh_transparency *mesh_transp = (
+        struct mesh_transparency *)pointer_hash_lookup(state->species_mesh_transp,
+                                                       key, keyhash);
+
+    int move_molecule = 0;
+    int out_to_in = 0;
+    const char *mesh_name = compare_molecule_nesting(
+      &move_molecule, &out_to_in, moved[n_mol].mesh_names, mesh_names_new,
+      mesh_transp);
+
+    if (move_molecule) {
+      struct vector3 new_pos;
+      place_mol_relative_to_mesh(
+          state, &(vm_ptr->pos), vm_ptr->subvol, mesh_name, &new_pos,
+          out_to_in);
+      check_for_large_molecular_displacement(
+          &(vm_ptr->pos), &new_pos, vm_ptr, &(state->time_unit),
+          state->notify->large_molecular_displacement);
+      vm_ptr->pos = new_pos;
+      state->dyngeom_molec_displacements++;
+
+      struct subvolume *new_sv = find_subvolume(state, &new_pos, NULL);
+      if (new_sv != vm_ptr->subvol) {
+        struct storage *old_storage = vm_ptr->subvol->local_storage;
+        struct volume_molecule *new_vm = migrate_volume_molecule(vm_ptr, new_sv);
+        if (new_vm != vm_ptr) {
+          // The old copy is left in its scheduler as a defunct molecule
+          old_storage->timer->defunct_count++;
+          if (schedule_add(new_sv->local_storage->timer, new_vm))
+            mcell_allocfailed("Failed to add volume molecule to scheduler.");
+          vm_ptr = new_vm;
+        }
+      }
+    }
+
+    if (vm_ptr->properties->flags & (COUNT_CONTENTS | COUNT_ENCLOSED))
+      count_region_from_scratch(state, (struct abstract_molecule *)vm_ptr,
+                                NULL, 1, &vm_ptr->pos, NULL, vm_ptr->t,
+                                &vm_ptr->periodic_box);
+
+    destroy_string_buffer(mesh_names_new);
+    free(mesh_names_new);
+    destroy_string_buffer(moved[n_mol].mesh_names);
+    free(moved[n_mol].mesh_names);
+  }
+  free(moved);
+
+  return 0;
+}
+
+/***************************************************************************
+get_mesh_topology:
+
+ In:  obj_ptr: the object to look for meshes in (e.g. root_instance)
+      hash: the hash so far
+ Out: The hash, updated with everything about the instantiated meshes but
+      the positions of their vertices: their names, walls, surface classes
+      and regions. Two geometries with the same topology hash can be turned
+      into one another by moving vertices.
+***************************************************************************/
+unsigned long long get_mesh_topology(struct object *obj_ptr,
+                                     unsigned long long hash) {
+#define TOPOLOGY_MIX(value)                                                    \
+  do {                                                                         \
+    unsigned long long mix_value = (unsigned long long)(value);                \
+    for (size_t b = 0; b < sizeof(mix_value); b++)                             \
+      hash = (hash ^ ((mix_value >> (8 * b)) & 0xff)) * 1099511628211ULL;      \
+  } while (0)
+
+  switch (obj_ptr->object_type) {
+  case META_OBJ:
+    for (struct object *child_obj_ptr = obj_ptr->first_child;
+         child_obj_ptr != NULL; child_obj_ptr = child_obj_ptr->next) {
+      hash = get_mesh_topology(child_obj_ptr, hash);
+    }
+    break;
+  case BOX_OBJ:
+  case POLY_OBJ:
+    for (char const *c = obj_ptr->sym->name; *c != '\0'; c++)
+      TOPOLOGY_MIX(*c);
+    TOPOLOGY_MIX(obj_ptr->n_verts);
+    TOPOLOGY_MIX(obj_ptr->n_walls);
+    for (int i = 0; i < obj_ptr->n_walls; i++) {
+      struct wall *w = obj_ptr->wall_p[i];
+      if (w == NULL) {
+        TOPOLOGY_MIX(-1);
+        continue;
+      }
+      for (int k = 0; k < 3; k++)
+        TOPOLOGY_MIX(w->vert[k] - obj_ptr->vertices[0]);
+      for (struct surf_class_list *scl = w->surf_class_head; scl != NULL;
+           scl = scl->next)
+        TOPOLOGY_MIX((intptr_t)scl->surf_class);
+    }
+    for (struct region_list *rl = obj_ptr->regions; rl != NULL; rl = rl->next) {
+      struct region *rp = rl->reg;
+      for (char const *c = rp->sym->name; *c != '\0'; c++)
+        TOPOLOGY_MIX(*c);
+      TOPOLOGY_MIX((intptr_t)rp->surf_class);
+      TOPOLOGY_MIX(rp->flags);
+      if (rp->membership != NULL) {
+        for (int i = 0; i < rp->membership->nbits; i++)
+          TOPOLOGY_MIX(get_bit(rp->membership, i));
+      }
+    }
+    break;
+
+  // do nothing
+  case REL_SITE_OBJ:
+  case VOXEL_OBJ:
+    break;
+  }
+  return hash;
+#undef TOPOLOGY_MIX
+}
+
+/***************************************************************************
+save_cached_vertices:
+
+ In:  obj_ptr: the object to look for meshes in (e.g. root_instance)
+      frame: the vertices of the instantiated meshes are added here
+ Out: Nothing.
+***************************************************************************/
+static void save_cached_vertices(struct object *obj_ptr,
+                                 struct dg_cached_frame *frame) {
+  switch (obj_ptr->object_type) {
+  case META_OBJ:
+    for (struct object *child_obj_ptr = obj_ptr->first_child;
+         child_obj_ptr != NULL; child_obj_ptr = child_obj_ptr->next) {
+      save_cached_vertices(child_obj_ptr, frame);
+    }
+    break;
+  case BOX_OBJ:
+  case POLY_OBJ: {
+    frame->meshes = (struct dg_cached_mesh *)realloc(
+        frame->meshes, (frame->n_meshes + 1) * sizeof(struct dg_cached_mesh));
+
+    if (frame->meshes == NULL)
+      mcell_allocfailed("Failed to allocate cached dynamic geometry.");
+    struct dg_cached_mesh *mesh = &frame->meshes[frame->n_meshes++];
+    mesh->name = CHECKED_STRDUP(obj_ptr->sym->name, "mesh name");
+    mesh->n_verts = obj_ptr->n_verts;
+    mesh->vertices = CHECKED_MALLOC_ARRAY(struct vector3, obj_ptr->n_verts,
+                                          "cached mesh vertices");
+    for (int i = 0; i < obj_ptr->n_verts; i++)
+      mesh->vertices[i] = *obj_ptr->vertices[i];
+    break;
+  }
+
+  // do nothing
+  case REL_SITE_OBJ:
+  case VOXEL_OBJ:
+    break;
+  }
+}
+
+/***************************************************************************
+free_cached_frame:
+
+ In:  frame: a cached dynamic geometry frame
+ Out: Nothing. The frame is freed.
+***************************************************************************/
+static void free_cached_frame(struct dg_cached_frame *frame) {
+  for (int i = 0; i < frame->n_meshes; i++) {
+    free(frame->meshes[i].name);
+    free(frame->meshes[i].vertices);
+  }
+  free(frame->meshes);
+  free(frame->mdl_file_path);
+  free(frame);
+}
+
+/***************************************************************************
+cache_geometry:
+
+ In:  state: MCell state
+      file_path: the dynamic geometry file that was just parsed
+ Out: Nothing. The vertices of the current meshes are remembered for the
+      file, as long as it is not modified.
+***************************************************************************/
+void cache_geometry(struct volume *state, char const *file_path) {
+  struct stat file_stat;
+  if (stat(file_path, &file_stat) != 0)
+    return;
+
+  struct dg_cached_frame **fpp = &state->dynamic_geometry_cache;
+  while (*fpp != NULL && strcmp((*fpp)->mdl_file_path, file_path) != 0)
+    fpp = &(*fpp)->next;
+  if (*fpp != NULL) {
+    struct dg_cached_frame *stale = *fpp;
+    *fpp = stale->next;
+    free_cached_frame(stale);
+  }
+
+  struct dg_cached_frame *frame =
+      CHECKED_MALLOC_STRUCT(struct dg_cached_frame, "cached dynamic geometry");
+  frame->mdl_file_path = CHECKED_STRDUP(file_path, "file path");
+  frame->mtime = file_stat.st_mtime;
+  frame->size = file_stat.st_size;
+  frame->topology = get_mesh_topology(state->root_instance,
+                                      14695981039346656037ULL);
+  frame->n_meshes = 0;
+  frame->meshes = NULL;
+  save_cached_vertices(state->root_instance, frame);
+  frame->next = state->dynamic_geometry_cache;
+  state->dynamic_geometry_cache = frame;
+}
+
+/***************************************************************************
+apply_cached_geometry:
+
+ In:  state: MCell state
+      file_path: the dynamic geometry file of the next geometry event
+ Out: Zero if the file was parsed before, is unchanged since, and its meshes
+      have the topology of the current ones: the vertices are then moved to
+      where that file put them. One otherwise, in which case nothing is
+      changed and the file has to be parsed.
+***************************************************************************/
+int apply_cached_geometry(struct volume *state, char const *file_path) {
+  struct dg_cached_frame *frame = state->dynamic_geometry_cache;
+  while (frame != NULL && strcmp(frame->mdl_file_path, file_path) != 0)
+    frame = frame->next;
+  if (frame == NULL)
+    return 1;
+
+  struct stat file_stat;
+  if (stat(file_path, &file_stat) != 0 || file_stat.st_mtime != frame->mtime ||
+      file_stat.st_size != frame->size)
+    return 1;
+  if (get_mesh_topology(state->root_instance, 14695981039346656037ULL) !=
+      frame->topology)
+    return 1;
+
+  // The partitions of the current geometry must hold every mesh of the
+  // cached one; check them all before moving any
+  struct object **meshes =
+      CHECKED_MALLOC_ARRAY(struct object *, frame->n_meshes + 1, "meshes");
+  for (int i = 0; i < frame->n_meshes; i++) {
+    meshes[i] = find_instantiated_mesh(state->root_instance,
+                                       frame->meshes[i].name);
+    if (meshes[i] == NULL || meshes[i]->n_verts != frame->meshes[i].n_verts ||
+        check_mesh_vertices(state, meshes[i], frame->meshes[i].vertices, 0)) {
+      free(meshes);
+      return 1;
+    }
+  }
+
+  for (int i = 0; i < frame->n_meshes; i++) {
+    struct dg_cached_mesh *mesh = &frame->meshes[i];
+    int unchanged = 1;
+    for (int k = 0; k < mesh->n_verts && unchanged; k++) {
+      struct vector3 const *v = meshes[i]->vertices[k];
+      unchanged = (v->x == mesh->vertices[k].x &&
+                   v->y == mesh->vertices[k].y &&
+                   v->z == mesh->vertices[k].z);
+    }
+    if (!unchanged && move_mesh_vertices(state, meshes[i], mesh->vertices))
+      mcell_error("Failed to move the vertices of mesh '%s'.", mesh->name);
+  }
+  free(meshes);
+  return 0;
+}
+
+/***************************************************************************
+is_vertex_frame_file:
+
+ In:  file_path: a file named in the dynamic geometry file
+ Out: 1 if the file is a binary vertex frame, 0 if it is (presumably) MDL.
+***************************************************************************/
+int is_vertex_frame_file(char const *file_path) {
+  char magic[sizeof(VERTEX_FRAME_MAGIC) - 1];
+  FILE *f = fopen(file_path, "rb");
+  if (f == NULL)
+    return 0;
+  int is_frame = (fread(magic, sizeof(magic), 1, f) == 1 &&
+                  memcmp(magic, VERTEX_FRAME_MAGIC, sizeof(magic)) == 0);
+  fclose(f);
+  return is_frame;
+}
+
+/* A binary vertex frame read into memory, in internal units */
+struct dg_vertex_frame {
+  time_t mtime; /* The file as it was read */
+  off_t size;
+  int n_meshes;
+  struct dg_cached_mesh *meshes;
+};
+
+static void free_vertex_frame(struct dg_vertex_frame *frame) {
+  if (frame == NULL)
+    return;
+  for (int i = 0; i < frame->n_meshes; i++) {
+    free(frame->meshes[i].name);
+    free(frame->meshes[i].vertices);
+  }
+  free(frame->meshes);
+  free(frame);
+}
+
+/***************************************************************************
+read_vertex_frame:
+
+ In:  file_path: a binary vertex frame
+      r_length_unit: reciprocal of the length unit
+      report: whether to report why the frame could not be read
+ Out: The vertex positions of every mesh in the frame, or NULL if it could
+      not be read. Safe to call from a thread other than the main one when
+      report is 0.
+
+ A vertex frame holds, in the byte order of the machine that wrote it:
+   "MCELLVTX"                                      8 bytes
+   version (currently 1)                           uint32
+   number of meshes                                uint32
+   then, for each mesh:
+     length of its fully qualified name            uint32
+     the name (e.g. "Scene.spine"), no NUL         bytes
+     number of vertices (as in the mesh)           uint32
+     x, y, z of every vertex, in microns, after
+     the instance's transformations                double[3 * n]
+ A version field that reads byte-swapped marks a frame written with the
+ other byte order.
+***************************************************************************/
+static struct dg_vertex_frame *read_vertex_frame(char const *file_path,
+                                                 double r_length_unit,
+                                                 int report) {
+  FILE *f = fopen(file_path, "rb");
+  if (f == NULL) {
+    if (report)
+      mcell_perror_nodie(errno, "Failed to open vertex frame '%s'", file_path);
+    return NULL;
+  }
+
+  struct dg_vertex_frame *frame = (struct dg_vertex_frame *)calloc(
+      1, sizeof(struct dg_vertex_frame));
+  struct stat file_stat;
+  if (frame == NULL || fstat(fileno(f), &file_stat) != 0) {
+    free(frame);
+    fclose(f);
+    return NULL;
+  }
+  frame->mtime = file_stat.st_mtime;
+  frame->size = file_stat.st_size;
+
+  char magic[sizeof(VERTEX_FRAME_MAGIC) - 1];
+  uint32_t version, n_meshes = 0;
+  int swap = 0;
+  int status = 0;
+  if (fread(magic, sizeof(magic), 1, f) != 1 ||
+      fread(&version, sizeof(version), 1, f) != 1 ||
+      fread(&n_meshes, sizeof(n_meshes), 1, f) != 1) {
+    status = 1;
+  } else {
+    if (version != VERTEX_FRAME_VERSION) {
+      byte_swap(&version, sizeof(version));
+      byte_swap(&n_meshes, sizeof(n_meshes));
+      swap = 1;
+    }
+    if (version != VERTEX_FRAME_VERSION) {
+      if (report)
+        mcell_error_nodie("Vertex frame '%s' has unsupported version %u.",
+                          file_path, version);
+      free_vertex_frame(frame);
+      fclose(f);
+      return NULL;
+    }
+  }
+
+  for (uint32_t n_mesh = 0; n_mesh < n_meshes && status == 0; n_mesh++) {
+    uint32_t name_length, n_verts;
+    if (fread(&name_length, sizeof(name_length), 1, f) != 1) {
+      status = 1;
+      break;
+    }
+    if (swap)
+      byte_swap(&name_length, sizeof(name_length));
+    char *mesh_name = (char *)malloc((size_t)name_length + 1);
+    if (mesh_name == NULL || fread(mesh_name, 1, name_length, f) != name_length ||
+        fread(&n_verts, sizeof(n_verts), 1, f) != 1) {
+      free(mesh_name);
+      status = 1;
+      break;
+    }
+    mesh_name[name_length] = '\0';
+    if (swap)
+      byte_swap(&n_verts, sizeof(n_verts));
+
+    struct dg_cached_mesh *meshes = (struct dg_cached_mesh *)realloc(
+        frame->meshes, (frame->n_meshes + 1) * sizeof(struct dg_cached_mesh));
+    struct vector3 *verts =
+        (struct vector3 *)malloc((size_t)n_verts * sizeof(struct vector3) + 1);
+    if (meshes == NULL || verts == NULL) {
+      if (meshes != NULL)
+        frame->meshes = meshes;
+      free(verts);
+      free(mesh_name);
+      status = 1;
+      break;
+    }
+    frame->meshes = meshes;
+    struct dg_cached_mesh *mesh = &frame->meshes[frame->n_meshes++];
+    mesh->name = mesh_name;
+    mesh->n_verts = (int)n_verts;
+    mesh->vertices = verts;
+    for (uint32_t i = 0; i < n_verts; i++) {
+      double xyz[3];
+      if (fread(xyz, sizeof(double), 3, f) != 3) {
+        status = 1;
+        break;
+      }
+      for (int k = 0; k < 3 && swap; k++)
+        byte_swap(&xyz[k], sizeof(double));
+      verts[i].x = xyz[0] * r_length_unit;
+      verts[i].y = xyz[1] * r_length_unit;
+      verts[i].z = xyz[2] * r_length_unit;
+    }
+  }
+  fclose(f);
+
+  if (status) {
+    if (report)
+      mcell_error_nodie("Vertex frame '%s' is truncated.", file_path);
+    free_vertex_frame(frame);
+    return NULL;
+  }
+  return frame;
+}
+
+/***************************************************************************
+apply_frame_meshes:
+
+ In:  state: MCell state
+      file_path: the vertex frame the meshes were read from
+      frame: the vertex frame
+ Out: Zero on success. One otherwise. The vertices of every mesh in the
+      frame are moved to the positions it gives.
+***************************************************************************/
+static int apply_frame_meshes(struct volume *state, char const *file_path,
+                              struct dg_vertex_frame const *frame) {
+  for (int n_mesh = 0; n_mesh < frame->n_meshes; n_mesh++) {
+    struct dg_cached_mesh const *mesh = &frame->meshes[n_mesh];
+    struct object *obj_ptr =
+        find_instantiated_mesh(state->root_instance, mesh->name);
+    if (obj_ptr == NULL || obj_ptr->n_verts != mesh->n_verts) {
+      if (obj_ptr == NULL)
+        mcell_error_nodie("Vertex frame '%s' refers to unknown mesh '%s'.",
+                          file_path, mesh->name);
+      else
+        mcell_error_nodie("Vertex frame '%s' has %d vertices for mesh '%s', "
+                          "which has %d.", file_path, mesh->n_verts,
+                          mesh->name, obj_ptr->n_verts);
+      return 1;
+    }
+    if (move_mesh_vertices(state, obj_ptr, mesh->vertices))
+      return 1;
+  }
+  return 0;
+}
+
+/***************************************************************************
+apply_vertex_frame:
+
+ In:  state: MCell state
+      file_path: a binary vertex frame (see read_vertex_frame)
+ Out: Zero on success. One otherwise. The vertices of every mesh in the
+      frame are moved to the positions it gives.
+***************************************************************************/
+int apply_vertex_frame(struct volume *state, char const *file_path) {
+  struct dg_vertex_frame *frame =
+      read_vertex_frame(file_path, state->r_length_unit, 1);
+  if (frame == NULL)
+    return 1;
+  int status = apply_frame_meshes(state, file_path, frame);
+  free_vertex_frame(frame);
+  return status;
+}
+
+#ifndef _WIN32
+/* Loads the frame of the next dynamic geometry event on a background
+ * thread.  Vertex frames are read and converted, ready to be applied; MDL
+ * files are only read through, so that parsing them on the main thread
+ * does not wait for the disk.  'want' is the event to load next and 'done'
+ * the one whose frame is in 'frame' (NULL unless a readable vertex
+ * frame), both under 'lock'. */
+struct dg_frame_loader {
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t changed;
+  struct dg_time_filename **events;
+  int n_events;
+  double r_length_unit;
+  int want;
+  int done;
+  struct dg_vertex_frame *frame;
+  int shutdown;
+};
+
+/* Read a file through, to bring it into the page cache */
+static void read_through(char const *file_path) {
+  FILE *f = fopen(file_path, "rb");
+  if (f == NULL)
+    return;
+  char buf[65536];
+  while (fread(buf, 1, sizeof(buf), f) == sizeof(buf))
+    ;
+  fclose(f);
+}
+
+static void *frame_loader_main(void *arg) {
+  struct dg_frame_loader *loader = (struct dg_frame_loader *)arg;
+  pthread_mutex_lock(&loader->lock);
+  while (1) {
+    while (!loader->shutdown &&
+           (loader->want == loader->done || loader->want >= loader->n_events))
+      pthread_cond_wait(&loader->changed, &loader->lock);
+    if (loader->shutdown)
+      break;
+    int event = loader->want;
+    char const *file_path = loader->events[event]->mdl_file_path;
+    pthread_mutex_unlock(&loader->lock);
+
+    struct dg_vertex_frame *frame = NULL;
+    if (is_vertex_frame_file(file_path))
+      frame = read_vertex_frame(file_path, loader->r_length_unit, 0);
+    else
+      read_through(file_path);
+
+    pthread_mutex_lock(&loader->lock);
+    free_vertex_frame(loader->frame);
+    loader->frame = frame;
+    loader->done = event;
+    pthread_cond_broadcast(&loader->changed);
+  }
+  pthread_mutex_unlock(&loader->lock);
+  return NULL;
+}
+#endif
+
+/***************************************************************************
+start_geometry_prefetch:
+
+ In:  state: MCell state
+      now: time up to which geometry events have been processed
+ Out: Nothing. If there are geometry events after 'now' and no frame
+      loader yet, one is started on the first of them. Without threads,
+      the frames are only read when their events come.
+***************************************************************************/
+void start_geometry_prefetch(struct volume *state, double now) {
+#ifndef _WIN32
+  if (state->dynamic_geometry_loader != NULL)
+    return;
+  int first = 0;
+  while (first < state->n_dynamic_geometry_events &&
+         state->dynamic_geometry_events[first]->event_time <= now)
+    first++;
+  if (first == state->n_dynamic_geometry_events)
+    return;
+
+  struct dg_frame_loader *loader = (struct dg_frame_loader *)calloc(
+      1, sizeof(struct dg_frame_loader));
+  if (loader == NULL)
+    return;
+  loader->events = state->dynamic_geometry_events;
+  loader->n_events = state->n_dynamic_geometry_events;
+  loader->r_length_unit = state->r_length_unit;
+  loader->want = first;
+  loader->done = -1;
+  pthread_mutex_init(&loader->lock, NULL);
+  pthread_cond_init(&loader->changed, NULL);
+  if (pthread_create(&loader->thread, NULL, frame_loader_main, loader) != 0) {
+    pthread_mutex_destroy(&loader->lock);
+    pthread_cond_destroy(&loader->changed);
+    free(loader);
+    return;
+  }
+  state->dynamic_geometry_loader = loader;
+#else
+  UNUSED(state);
+  UNUSED(now);
+#endif
+}
+
+/***************************************************************************
+stop_geometry_prefetch:
+
+ In:  state: MCell state
+ Out: Nothing. The frame loader, if any, is stopped and freed; it is
+      started again by start_geometry_prefetch.
+***************************************************************************/
+void stop_geometry_prefetch(struct volume *state) {
+#ifndef _WIN32
+  struct dg_frame_loader *loader = state->dynamic_geometry_loader;
+  if (loader == NULL)
+    return;
+  pthread_mutex_lock(&loader->lock);
+  loader->shutdown = 1;
+  pthread_cond_broadcast(&loader->changed);
+  pthread_mutex_unlock(&loader->lock);
+  pthread_join(loader->thread, NULL);
+  free_vertex_frame(loader->frame);
+  pthread_mutex_destroy(&loader->lock);
+  pthread_cond_destroy(&loader->changed);
+  free(loader);
+  state->dynamic_geometry_loader = NULL;
+#else
+  UNUSED(state);
+#endif
+}
+
+/***************************************************************************
+take_prefetched_frame:
+
+ In:  state: MCell state
+      dyn_geom: the geometry event being processed
+ Out: The vertex frame of the event as loaded in the background, waiting
+      for it if needed, or NULL if the event is not a vertex frame, could
+      not be read, or the file changed since it was read. The loader
+      moves on to the next event either way.
+***************************************************************************/
+static struct dg_vertex_frame *
+take_prefetched_frame(struct volume *state, struct dg_time_filename *dyn_geom) {
+#ifndef _WIN32
+  struct dg_frame_loader *loader = state->dynamic_geometry_loader;
+  if (loader == NULL)
+    return NULL;
+
+  pthread_mutex_lock(&loader->lock);
+  int event = loader->want;
+  if (event >= loader->n_events || loader->events[event] != dyn_geom) {
+    for (event = 0; event < loader->n_events; event++) {
+      if (loader->events[event] == dyn_geom)
+        break;
+    }
+    if (event == loader->n_events) {
+      pthread_mutex_unlock(&loader->lock);
+      return NULL;
+    }
+    loader->want = event;
+    pthread_cond_broadcast(&loader->changed);
+  }
+  while (loader->done != event)
+    pthread_cond_wait(&loader->changed, &loader->lock);
+  struct dg_vertex_frame *frame = loader->frame;
+  loader->frame = NULL;
+  loader->want = event + 1;
+  pthread_cond_broadcast(&loader->changed);
+  pthread_mutex_unlock(&loader->lock);
+
+  struct stat file_stat;
+  if (frame != NULL &&
+      (stat(dyn_geom->mdl_file_path, &file_stat) != 0 ||
+       file_stat.st_mtime != frame->mtime || file_stat.st_size != frame->size)) {
+    free_vertex_frame(frame);
+    frame = NULL;
+  }
+  return frame;
+#else
+  UNUSED(state);
+  UNUSED(dyn_geom);
+  return NULL;
+#endif
+}
+
 /***************************************************************************
 update_geometry:
   In:  state: MCell state
@@ -2175,7 +3475,31 @@ update_geometry:
 ***************************************************************************/
 void update_geometry(struct volume *state,
                      struct dg_time_filename *dyn_geom) {
-  state->all_molecules = save_all_molecules(state, state->storage_head);
+  // Frames that only move vertices are applied to the meshes in place,
+  // usually as already read by the frame loader
+  struct dg_vertex_frame *frame = take_prefetched_frame(state, dyn_geom);
+  if (frame != NULL) {
+    if (apply_frame_meshes(state, dyn_geom->mdl_file_path, frame))
+      mcell_error("An error occurred while moving the vertices of meshes.");
+    free_vertex_frame(frame);
+    return;
+  }
+  if (is_vertex_frame_file(dyn_geom->mdl_file_path)) {
+    if (apply_vertex_frame(state, dyn_geom->mdl_file_path))
+      mcell_error("An error occurred while moving the vertices of meshes.");
+    return;
+  }
+
+  // A file seen before may only move the vertices of the current meshes
+  if (state->dynamic_geometry_cache_flag &&
+      apply_cached_geometry(state, dyn_geom->mdl_file_path) == 0)
+    return;
+
+  // Remember the shape of every mesh, to tell which ones change
+  struct mesh_signatures old_meshes = { 0, 0, NULL };
+  get_mesh_signatures(state->root_instance, &old_meshes);
+  state->all_molecules =
+      save_all_molecules(state, state->storage_head, &old_meshes);
 
   // Turn off progress reports to avoid spamming mostly useless info to stdout
   state->notify->progress_report = NOTIFY_NONE;
@@ -2234,7 +3558,20 @@ void update_geometry(struct volume *state,
       new_region_names,
       meshes_to_ignore,
       new_inst_mesh_names);
-  place_all_molecules(state, meshes_to_ignore, regions_to_ignore);
+
+  // Only molecules near meshes that actually changed need to be relocated
+  struct mesh_signatures new_meshes = { 0, 0, NULL };
+  get_mesh_signatures(state->root_instance, &new_meshes);
+  struct mesh_signatures changed_meshes = { 0, 0, NULL };
+  find_changed_meshes(&changed_meshes, &old_meshes, &new_meshes);
+  place_all_molecules(
+      state, meshes_to_ignore, regions_to_ignore, &changed_meshes);
+  free_mesh_signatures(&old_meshes);
+  free_mesh_signatures(&new_meshes);
+  free_mesh_signatures(&changed_meshes);
+
+  if (state->dynamic_geometry_cache_flag)
+    cache_geometry(state, dyn_geom->mdl_file_path);
 
   destroy_string_buffer(old_region_names);
   destroy_string_buffer(new_region_names);
@@ -24,6 +24,8 @@
 #ifndef DYNGEOM_H
 #define DYNGEOM_H
 
+#include <sys/types.h>
+
 #include "mdlparse_aux.h"
 
 #define MAX_NUM_REGIONS 100
@@ -50,8 +52,100 @@ struct n_parts {
   int nz_parts;
 };
 
+/* The shape of an instantiated mesh, used to find the meshes that a dynamic
+ * geometry event actually changes */
+struct mesh_signature {
+  char *name;         /* Fully qualified mesh name */
+  struct vector3 llf; /* Bounding box of the mesh's walls */
+  struct vector3 urb;
+  unsigned long long hash; /* Hash of the mesh's wall vertices */
+};
+
+struct mesh_signatures {
+  int n_meshes;
+  int capacity;
+  struct mesh_signature *meshes;
+};
+
+void get_mesh_signatures(struct object *obj_ptr,
+                         struct mesh_signatures *signatures);
+
+void find_changed_meshes(struct mesh_signatures *changed,
+                         struct mesh_signatures *old_meshes,
+                         struct mesh_signatures *new_meshes);
+
+void free_mesh_signatures(struct mesh_signatures *signatures);
+
+int ray_misses_meshes(struct vector3 const *pos,
+                      struct mesh_signatures const *signatures);
+
+/* The meshes enclosing each subvolume that no wall crosses (NULL until the
+ * first molecule in it is looked up) */
+struct nesting_cache {
+  int n_subvols;
+  struct string_buffer **mesh_names;
+};
+
+void init_nesting_cache(struct nesting_cache *cache, int n_subvols);
+
+void free_nesting_cache(struct nesting_cache *cache);
+
+struct string_buffer *find_enclosing_meshes_cached(
+    struct volume *state, struct volume_molecule *vm,
+    struct string_buffer *names_to_ignore, struct nesting_cache *cache);
+
+/* Binary frames of mesh vertex positions, see apply_vertex_frame */
+#define VERTEX_FRAME_MAGIC "MCELLVTX"
+#define VERTEX_FRAME_VERSION 1
+
+struct object *find_instantiated_mesh(struct object *obj_ptr,
+                                      char const *mesh_name);
+
+int check_mesh_vertices(struct volume *state, struct object *obj_ptr,
+                        struct vector3 const *new_verts, int report);
+
+int move_mesh_vertices(struct volume *state, struct object *obj_ptr,
+                       struct vector3 const *new_verts);
+
+/* The vertices of the meshes a dynamic geometry file yielded when it was
+ * last parsed, and the topology they go with (see get_mesh_topology) */
+struct dg_cached_mesh {
+  char *name;
+  int n_verts;
+  struct vector3 *vertices;
+};
+
+struct dg_cached_frame {
+  struct dg_cached_frame *next;
+  char *mdl_file_path;
+  time_t mtime;                 /* The file as it was parsed */
+  off_t size;
+  unsigned long long topology;
+  int n_meshes;
+  struct dg_cached_mesh *meshes;
+};
+
+unsigned long long get_mesh_topology(struct object *obj_ptr,
+                                     unsigned long long hash);
+
+void cache_geometry(struct volume *state, char const *file_path);
+
+int apply_cached_geometry(struct volume *state, char const *file_path);
+
+int is_vertex_frame_file(char const *file_path);
+
+int apply_vertex_frame(struct volume *state, char const *file_path);
+
+/* Background loading of the frame of the next geometry event */
+struct dg_frame_loader;
+
+void start_geometry_prefetch(struct volume *state, double now);
+
+void stop_geometry_prefetch(struct volume *state);
+
 struct molecule_info ** save_all_molecules(
-    struct volume *state, struct storage_list *storage_head);
+    struct volume *state, struct storage_list *storage_head,
+    struct mesh_signatures *meshes);
 
 void save_common_molecule_properties(struct molecule_info *mol_info,
                                      struct abstract_molecule *am_ptr,
@@ -61,7 +155,9 @@ void save_common_molecule_properties(struct molecule_info *mol_info,
 
 void save_volume_molecule(struct volume *state, struct molecule_info *mol_info,
                           struct abstract_molecule *am_ptr,
-                          struct string_buffer **mesh_names);
+                          struct string_buffer **mesh_names,
+                          struct mesh_signatures *meshes,
+                          struct nesting_cache *nesting);
 
 int save_surface_molecule(struct molecule_info *mol_info,
                           struct abstract_molecule *am_ptr,
@@ -74,7 +170,8 @@ void cleanup_names_molecs(
 int place_all_molecules(
     struct volume *state,
     struct string_buffer *names_to_ignore,
-    struct string_buffer *regions_to_ignore);
+    struct string_buffer *regions_to_ignore,
+    struct mesh_signatures *changed_meshes);
 
 void check_for_large_molecular_displacement(
     struct vector3 *old_pos,
@@ -111,7 +208,8 @@ struct volume_molecule *insert_volume_molecule_encl_mesh(
     struct volume_molecule *vm,
     struct volume_molecule *vm_guess,
     struct string_buffer *mesh_names_old,
-    struct string_buffer *names_to_ignore);
+    struct string_buffer *names_to_ignore,
+    struct nesting_cache *nesting);
 
 int hit_wall(
     struct wall *w, struct name_hits **name_head,
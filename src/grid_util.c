@@ -57,18 +57,18 @@ void xyz2uv(struct vector3 *a, struct wall *w, struct vector2 *b) {
            w->grid->vert0.v;
   } else {
     struct vector3 p;
-    p.x = a->x - w->vert[0]->x;
-    p.y = a->y - w->vert[0]->y;
-    p.z = a->z - w->vert[0]->z;
+    p.x = a->x - w->origin.x;
+    p.y = a->y - w->origin.y;
+    p.z = a->z - w->origin.z;
     b->u = p.x * w->unit_u.x + p.y * w->unit_u.y + p.z * w->unit_u.z;
     b->v = p.x * w->unit_v.x + p.y * w->unit_v.y + p.z * w->unit_v.z;
   }
 }
 
 void uv2xyz(struct vector2 *a, struct wall *w, struct vector3 *b) {
-  b->x = a->u * w->unit_u.x + a->v * w->unit_v.x + w->vert[0]->x;
-  b->y = a->u * w->unit_u.y + a->v * w->unit_v.y + w->vert[0]->y;
-  b->z = a->u * w->unit_u.z + a->v * w->unit_v.z + w->vert[0]->z;
+  b->x = a->u * w->unit_u.x + a->v * w->unit_v.x + w->origin.x;
+  b->y = a->u * w->unit_u.y + a->v * w->unit_v.y + w->origin.y;
+  b->z = a->u * w->unit_u.z + a->v * w->unit_v.z + w->origin.z;
 }
 
 /*************************************************************************
@@ -230,9 +230,9 @@ void grid2xyz(struct surface_grid *g, int idx, struct vector3 *v) {
           ((double)(3 * k + i + 1)) * over3n * g->surface->uv_vert2.u;
   vcoef = ((double)(3 * k + i + 1)) * over3n * g->surface->uv_vert2.v;
 
-  v->x = ucoef * unit_u->x + vcoef * unit_v->x + g->surface->vert[0]->x;
-  v->y = ucoef * unit_u->y + vcoef * unit_v->y + g->surface->vert[0]->y;
-  v->z = ucoef * unit_u->z + vcoef * unit_v->z + g->surface->vert[0]->z;
+  v->x = ucoef * unit_u->x + vcoef * unit_v->x + g->surface->origin.x;
+  v->y = ucoef * unit_u->y + vcoef * unit_v->y + g->surface->origin.y;
+  v->z = ucoef * unit_u->z + vcoef * unit_v->z + g->surface->origin.z;
 }
 
 void grid2uv(struct surface_grid *g, int idx, struct vector2 *v) {
@@ -334,6 +334,7 @@ int create_grid(struct volume *world, struct wall *w, struct subvolume *guess) {
 
   sg->n_tiles = sg->n * sg->n;
   sg->n_occupied = 0;
+  sg->nbr_index = NULL;
 
   sg->binding_factor = ((double)sg->n_tiles) / w->area;
   init_grid_geometry(sg);
@@ -345,6 +346,13 @@ int create_grid(struct volume *world, struct wall *w, struct subvolume *guess) {
     sg->sm_list[i] = NULL;
   }
 
+  sg->tiles_shared = 0;
+
+  sg->vacant = new_bit_array(sg->n_tiles);
+  if (sg->vacant == NULL)
+    mcell_allocfailed("Failed to allocate surface grid vacancy bits.");
+  set_all_bits(sg->vacant, 1);
+
   w->grid = sg;
 
   return 0;
@@ -396,13 +404,13 @@ void grid_neighbors(struct volume *world, struct surface_grid *grid, int idx,
     nb_idx[2] = idx - 1;
   } else /* upright tiles in stripe 0 */
   {
-    if (grid->surface->nb_walls[2] == NULL)
+    if (wall_neighbor(grid->surface, 2) == NULL)
       nb_grid[2] = NULL;
-    else if ((grid->surface->nb_walls[2]->grid == NULL) && (!create_grid_flag))
+    else if ((wall_neighbor(grid->surface, 2)->grid == NULL) && (!create_grid_flag))
       nb_grid[2] = NULL;
     else {
-      if ((grid->surface->nb_walls[2]->grid == NULL) && create_grid_flag) {
-        if (create_grid(world, grid->surface->nb_walls[2], NULL))
+      if ((wall_neighbor(grid->surface, 2)->grid == NULL) && create_grid_flag) {
+        if (create_grid(world, wall_neighbor(grid->surface, 2), NULL))
           mcell_allocfailed("Failed to create grid for wall.");
       }
 
@@ -410,12 +418,12 @@ void grid_neighbors(struct volume *world, struct surface_grid *grid, int idx,
         uv2xyz(&grid->sm_list[idx]->sm->s_pos, grid->surface, &loc_3d);
       else
         grid2xyz(grid, idx, &loc_3d);
-      d = closest_interior_point(&loc_3d, grid->surface->nb_walls[2], &near_2d,
+      d = closest_interior_point(&loc_3d, wall_neighbor(grid->surface, 2), &near_2d,
                                  GIGANTIC);
       if (!distinguishable(d, GIGANTIC, EPS_C))
         nb_grid[2] = NULL;
       else {
-        nb_grid[2] = grid->surface->nb_walls[2]->grid;
+        nb_grid[2] = wall_neighbor(grid->surface, 2)->grid;
         nb_idx[2] = uv2grid(&near_2d, nb_grid[2]);
       }
     }
@@ -428,25 +436,25 @@ void grid_neighbors(struct volume *world, struct surface_grid *grid, int idx,
     nb_idx[1] = idx + 1;
   } else /* upright tiles in last stripe */
   {
-    if (grid->surface->nb_walls[1] == NULL)
+    if (wall_neighbor(grid->surface, 1) == NULL)
       nb_grid[1] = NULL;
-    else if ((grid->surface->nb_walls[1]->grid == NULL) && (!create_grid_flag))
+    else if ((wall_neighbor(grid->surface, 1)->grid == NULL) && (!create_grid_flag))
       nb_grid[1] = NULL;
     else {
-      if ((grid->surface->nb_walls[1]->grid == NULL) && create_grid_flag) {
-        if (create_grid(world, grid->surface->nb_walls[1], NULL))
+      if ((wall_neighbor(grid->surface, 1)->grid == NULL) && create_grid_flag) {
+        if (create_grid(world, wall_neighbor(grid->surface, 1), NULL))
           mcell_allocfailed("Failed to create grid for wall.");
       }
       if (grid->sm_list[idx]->sm != NULL)
         uv2xyz(&grid->sm_list[idx]->sm->s_pos, grid->surface, &loc_3d);
       else
         grid2xyz(grid, idx, &loc_3d);
-      d = closest_interior_point(&loc_3d, grid->surface->nb_walls[1], &near_2d,
+      d = closest_interior_point(&loc_3d, wall_neighbor(grid->surface, 1), &near_2d,
                                  GIGANTIC);
       if (!distinguishable(d, GIGANTIC, EPS_C))
         nb_grid[1] = NULL;
       else {
-        nb_grid[1] = grid->surface->nb_walls[1]->grid;
+        nb_grid[1] = wall_neighbor(grid->surface, 1)->grid;
         nb_idx[1] = uv2grid(&near_2d, nb_grid[1]);
       }
     }
@@ -463,13 +471,13 @@ void grid_neighbors(struct volume *world, struct surface_grid *grid, int idx,
       nb_idx[0] = 1 + 2 * j + (k + 1) * (k + 1); /* flip and goto next strip */
   } else /* upright tiles in last strip */
   {
-    if (grid->surface->nb_walls[0] == NULL)
+    if (wall_neighbor(grid->surface, 0) == NULL)
       nb_grid[0] = NULL;
-    else if ((grid->surface->nb_walls[0]->grid == NULL) && (!create_grid_flag))
+    else if ((wall_neighbor(grid->surface, 0)->grid == NULL) && (!create_grid_flag))
       nb_grid[0] = NULL;
     else {
-      if ((grid->surface->nb_walls[0]->grid == NULL) && create_grid_flag) {
-        if (create_grid(world, grid->surface->nb_walls[0], NULL))
+      if ((wall_neighbor(grid->surface, 0)->grid == NULL) && create_grid_flag) {
+        if (create_grid(world, wall_neighbor(grid->surface, 0), NULL))
           mcell_allocfailed("Failed to create grid for wall.");
       }
 
@@ -477,12 +485,12 @@ void grid_neighbors(struct volume *world, struct surface_grid *grid, int idx,
         uv2xyz(&grid->sm_list[idx]->sm->s_pos, grid->surface, &loc_3d);
       else
         grid2xyz(grid, idx, &loc_3d);
-      d = closest_interior_point(&loc_3d, grid->surface->nb_walls[0], &near_2d,
+      d = closest_interior_point(&loc_3d, wall_neighbor(grid->surface, 0), &near_2d,
                                  GIGANTIC);
       if (!distinguishable(d, GIGANTIC, EPS_C))
         nb_grid[0] = NULL;
       else {
-        nb_grid[0] = grid->surface->nb_walls[0]->grid;
+        nb_grid[0] = wall_neighbor(grid->surface, 0)->grid;
         nb_idx[0] = uv2grid(&near_2d, nb_grid[0]);
       }
     }
@@ -499,7 +507,9 @@ nearest_free:
   Note: we assume you've already checked the grid element that contains
         the point, so we don't bother looking there first.
   Note: if no unoccupied tile is found, found_dist2 contains distance to
-        closest occupied tile.
+        closest occupied tile, unless the grid is more than half full; then
+        only the tiles its vacant bits say may be free are looked at (in the
+        same order of preference), and found_dist2 is left alone.
 *************************************************************************/
 
 int nearest_free(struct surface_grid *g, struct vector2 *v, double max_d2,
@@ -521,6 +531,50 @@ int nearest_free(struct surface_grid *g, struct vector2 *v, double max_d2,
   idx = -1;
   d2 = 2 * max_d2 + 1.0;
 
+  if (g->vacant != NULL && 2 * g->n_occupied > g->n_tiles) {
+    /* Crowded grid: visit the few tiles that may be free.  Ties go to the
+     * tile the strip-by-strip scan below would have found first. */
+    int best_order = 0;
+    for (h = next_set_bit(g->vacant, 0); h >= 0;
+         h = next_set_bit(g->vacant, h + 1)) {
+      if (g->sm_list[h] && g->sm_list[h]->sm) {
+        set_bit(g->vacant, h, 0);
+        continue;
+      }
+
+      int root = (int)sqrt((double)h);
+      while (root * root > h)
+        root--;
+      while ((root + 1) * (root + 1) <= h)
+        root++;
+      k = g->n - root - 1;
+      j = (h - root * root) / 2;
+      i = (h - root * root) - 2 * j;
+
+      /* Same arithmetic as the scan below, so distances compare equal */
+      f = v->v - ((double)(3 * k + 1)) * over3n * g->surface->uv_vert2.v;
+      if (i)
+        f = f - over3n * g->surface->uv_vert2.v;
+      f *= f;
+      fff = v->u - over3n * ((double)(3 * j + i + 1) * g->surface->uv_vert1_u +
+                             (double)(3 * k + i + 1) * g->surface->uv_vert2.u);
+      fff *= fff;
+      fff += f;
+
+      int order = 2 * g->n * k + 2 * j + i;
+      if (fff < max_d2 &&
+          (idx == -1 || fff < d2 || (fff == d2 && order < best_order))) {
+        idx = h;
+        d2 = fff;
+        best_order = order;
+      }
+    }
+
+    if (idx != -1 && found_dist2 != NULL)
+      *found_dist2 = d2;
+    return idx;
+  }
+
   for (k = 0; k < g->n; k++) {
     f = v->v - ((double)(3 * k + 1)) * over3n * g->surface->uv_vert2.v;
     ff = f - over3n * g->surface->uv_vert2.v;
@@ -1396,12 +1450,12 @@ void grid_all_neighbors_across_walls_through_edges(
     rlp_head_own_wall =
         find_restricted_regions_by_wall(world, sm->grid->surface, sm);
 
-    if (sm->grid->surface->nb_walls[0] != NULL) {
+    if (wall_neighbor(sm->grid->surface, 0) != NULL) {
       rlp_head_nbr_wall_0 = find_restricted_regions_by_wall(
-          world, sm->grid->surface->nb_walls[0], sm);
+          world, wall_neighbor(sm->grid->surface, 0), sm);
       if (rlp_head_own_wall != NULL) {
         if (!wall_belongs_to_all_regions_in_region_list(
-                 sm->grid->surface->nb_walls[0], rlp_head_own_wall))
+                 wall_neighbor(sm->grid->surface, 0), rlp_head_own_wall))
           move_thru_border_0 = 0;
       }
       if (rlp_head_nbr_wall_0 != NULL) {
@@ -1416,12 +1470,12 @@ void grid_all_neighbors_across_walls_through_edges(
       move_thru_border_0 = 0;
     }
 
-    if (sm->grid->surface->nb_walls[1] != NULL) {
+    if (wall_neighbor(sm->grid->surface, 1) != NULL) {
       rlp_head_nbr_wall_1 = find_restricted_regions_by_wall(
-          world, sm->grid->surface->nb_walls[1], sm);
+          world, wall_neighbor(sm->grid->surface, 1), sm);
       if (rlp_head_own_wall != NULL) {
         if (!wall_belongs_to_all_regions_in_region_list(
-                 sm->grid->surface->nb_walls[1], rlp_head_own_wall))
+                 wall_neighbor(sm->grid->surface, 1), rlp_head_own_wall))
           move_thru_border_1 = 0;
       }
       if (rlp_head_nbr_wall_1 != NULL) {
@@ -1436,12 +1490,12 @@ void grid_all_neighbors_across_walls_through_edges(
       move_thru_border_1 = 0;
     }
 
-    if (sm->grid->surface->nb_walls[2] != NULL) {
+    if (wall_neighbor(sm->grid->surface, 2) != NULL) {
       rlp_head_nbr_wall_2 = find_restricted_regions_by_wall(
-          world, sm->grid->surface->nb_walls[2], sm);
+          world, wall_neighbor(sm->grid->surface, 2), sm);
       if (rlp_head_own_wall != NULL) {
         if (!wall_belongs_to_all_regions_in_region_list(
-                 sm->grid->surface->nb_walls[2], rlp_head_own_wall))
+                 wall_neighbor(sm->grid->surface, 2), rlp_head_own_wall))
           move_thru_border_2 = 0;
       }
       if (rlp_head_nbr_wall_2 != NULL) {
@@ -1475,9 +1529,9 @@ void grid_all_neighbors_across_walls_through_edges(
 
   if (create_grid_flag) {
     for (kk = 0; kk < 3; kk++) {
-      if ((grid->surface->nb_walls[kk] != NULL) &&
-          (grid->surface->nb_walls[kk]->grid == NULL)) {
-        if (create_grid(world, grid->surface->nb_walls[kk], NULL))
+      if ((wall_neighbor(grid->surface, kk) != NULL) &&
+          (wall_neighbor(grid->surface, kk)->grid == NULL)) {
+        if (create_grid(world, wall_neighbor(grid->surface, kk), NULL))
           mcell_allocfailed("Failed to create grid for wall.");
       }
     }
@@ -1527,35 +1581,35 @@ void grid_all_neighbors_across_walls_through_edges(
       }
 
       /* get the neighbors from the neighbor walls */
-      if ((grid->surface->nb_walls[2] != NULL) &&
-          (grid->surface->nb_walls[2]->grid != NULL)) {
+      if ((wall_neighbor(grid->surface, 2) != NULL) &&
+          (wall_neighbor(grid->surface, 2)->grid != NULL)) {
         if (move_thru_border_2) {
           tiles_added = add_more_tile_neighbors_to_list_fast(
               &tile_nbr_head, grid, strip, stripe, flip, grid->surface->vert[0],
-              grid->surface->vert[2], 2, grid->surface->nb_walls[2]->grid);
+              grid->surface->vert[2], 2, wall_neighbor(grid->surface, 2)->grid);
           tiles_count += tiles_added;
         }
       }
       if (strip == 0) {
-        if ((grid->surface->nb_walls[0] != NULL) &&
-            (grid->surface->nb_walls[0]->grid != NULL)) {
+        if ((wall_neighbor(grid->surface, 0) != NULL) &&
+            (wall_neighbor(grid->surface, 0)->grid != NULL)) {
           if (move_thru_border_0) {
             tiles_added = add_more_tile_neighbors_to_list_fast(
                 &tile_nbr_head, grid, strip, stripe, flip,
                 grid->surface->vert[0], grid->surface->vert[1], 0,
-                grid->surface->nb_walls[0]->grid);
+                wall_neighbor(grid->surface, 0)->grid);
             tiles_count += tiles_added;
           }
         }
       }
       if (strip == (grid->n - 2)) {
-        if ((grid->surface->nb_walls[1] != NULL) &&
-            (grid->surface->nb_walls[1]->grid != NULL)) {
+        if ((wall_neighbor(grid->surface, 1) != NULL) &&
+            (wall_neighbor(grid->surface, 1)->grid != NULL)) {
           if (move_thru_border_1) {
             tiles_added = add_more_tile_neighbors_to_list_fast(
                 &tile_nbr_head, grid, strip, stripe, flip,
                 grid->surface->vert[1], grid->surface->vert[2], 1,
-                grid->surface->nb_walls[1]->grid);
+                wall_neighbor(grid->surface, 1)->grid);
             tiles_count += tiles_added;
           }
         }
@@ -1576,37 +1630,37 @@ void grid_all_neighbors_across_walls_through_edges(
           push_tile_neighbor_to_list(&tile_nbr_head, grid, temp_idx + 1);
           tiles_count++;
         } else {
-          if ((grid->surface->nb_walls[0] != NULL) &&
-              (grid->surface->nb_walls[0]->grid != NULL)) {
+          if ((wall_neighbor(grid->surface, 0) != NULL) &&
+              (wall_neighbor(grid->surface, 0)->grid != NULL)) {
             if (move_thru_border_0) {
               /* get the neighbors from the neighbor walls */
               tiles_added = add_more_tile_neighbors_to_list_fast(
                   &tile_nbr_head, grid, strip, stripe, flip,
                   grid->surface->vert[0], grid->surface->vert[1], 0,
-                  grid->surface->nb_walls[0]->grid);
+                  wall_neighbor(grid->surface, 0)->grid);
               tiles_count += tiles_added;
             }
           }
         }
-        if ((grid->surface->nb_walls[1] != NULL) &&
-            (grid->surface->nb_walls[1]->grid != NULL)) {
+        if ((wall_neighbor(grid->surface, 1) != NULL) &&
+            (wall_neighbor(grid->surface, 1)->grid != NULL)) {
           if (move_thru_border_1) {
             /* get the neighbors from the neighbor walls */
             tiles_added = add_more_tile_neighbors_to_list_fast(
                 &tile_nbr_head, grid, strip, stripe, flip,
                 grid->surface->vert[1], grid->surface->vert[2], 1,
-                grid->surface->nb_walls[1]->grid);
+                wall_neighbor(grid->surface, 1)->grid);
             tiles_count += tiles_added;
           }
         }
-        if ((grid->surface->nb_walls[2] != NULL) &&
-            (grid->surface->nb_walls[2]->grid != NULL)) {
+        if ((wall_neighbor(grid->surface, 2) != NULL) &&
+            (wall_neighbor(grid->surface, 2)->grid != NULL)) {
           if (move_thru_border_2) {
             /* get the neighbors from the neighbor walls */
             tiles_added = add_more_tile_neighbors_to_list_fast(
                 &tile_nbr_head, grid, strip, stripe, flip,
                 grid->surface->vert[0], grid->surface->vert[2], 2,
-                grid->surface->nb_walls[2]->grid);
+                wall_neighbor(grid->surface, 2)->grid);
             tiles_count += tiles_added;
           }
         }
@@ -1645,25 +1699,25 @@ void grid_all_neighbors_across_walls_through_edges(
           /* put in the list tiles that are on the row above the start tile
           but on the different grid */
           /* it is the top left corner - special case */
-          if ((grid->surface->nb_walls[0] != NULL) &&
-              (grid->surface->nb_walls[0]->grid != NULL)) {
+          if ((wall_neighbor(grid->surface, 0) != NULL) &&
+              (wall_neighbor(grid->surface, 0)->grid != NULL)) {
             if (move_thru_border_0) {
               /* get the neighbors from the neighbor walls */
               tiles_added = add_more_tile_neighbors_to_list_fast(
                   &tile_nbr_head, grid, strip, stripe, flip,
                   grid->surface->vert[0], grid->surface->vert[1], 0,
-                  grid->surface->nb_walls[0]->grid);
+                  wall_neighbor(grid->surface, 0)->grid);
               tiles_count += tiles_added;
             }
           }
-          if ((grid->surface->nb_walls[2] != NULL) &&
-              (grid->surface->nb_walls[2]->grid != NULL)) {
+          if ((wall_neighbor(grid->surface, 2) != NULL) &&
+              (wall_neighbor(grid->surface, 2)->grid != NULL)) {
             if (move_thru_border_2) {
               /* get the neighbors from the neighbor walls */
               tiles_added = add_more_tile_neighbors_to_list_fast(
                   &tile_nbr_head, grid, strip, stripe, flip,
                   grid->surface->vert[0], grid->surface->vert[2], 2,
-                  grid->surface->nb_walls[2]->grid);
+                  wall_neighbor(grid->surface, 2)->grid);
               tiles_count += tiles_added;
             }
           }
@@ -1734,26 +1788,26 @@ void grid_all_neighbors_across_walls_through_edges(
     }
 
     /* put in the list tiles that are on the row above */
-    if ((grid->surface->nb_walls[0] != NULL) &&
-        (grid->surface->nb_walls[0]->grid != NULL)) {
+    if ((wall_neighbor(grid->surface, 0) != NULL) &&
+        (wall_neighbor(grid->surface, 0)->grid != NULL)) {
       if (move_thru_border_0) {
         /* get the neighbors from the neighbor walls */
         tiles_added = add_more_tile_neighbors_to_list_fast(
             &tile_nbr_head, grid, strip, stripe, flip, grid->surface->vert[0],
-            grid->surface->vert[1], 0, grid->surface->nb_walls[0]->grid);
+            grid->surface->vert[1], 0, wall_neighbor(grid->surface, 0)->grid);
         tiles_count += tiles_added;
       }
     }
     /* put in the list tiles that are on the side */
     if (((u_int)idx == (grid->n_tiles - 1)) ||
         ((u_int)idx == (grid->n_tiles - 2))) {
-      if ((grid->surface->nb_walls[1] != NULL) &&
-          (grid->surface->nb_walls[1]->grid != NULL)) {
+      if ((wall_neighbor(grid->surface, 1) != NULL) &&
+          (wall_neighbor(grid->surface, 1)->grid != NULL)) {
         if (move_thru_border_1) {
           /* get the neighbors from the neighbor walls */
           tiles_added = add_more_tile_neighbors_to_list_fast(
               &tile_nbr_head, grid, strip, stripe, flip, grid->surface->vert[1],
-              grid->surface->vert[2], 1, grid->surface->nb_walls[1]->grid);
+              grid->surface->vert[2], 1, wall_neighbor(grid->surface, 1)->grid);
           tiles_count += tiles_added;
         }
       }
@@ -1828,13 +1882,13 @@ void grid_all_neighbors_across_walls_through_edges(
       tiles_count++;
     }
     /* put in the list tiles that are on the side */
-    if ((grid->surface->nb_walls[1] != NULL) &&
-        (grid->surface->nb_walls[1]->grid != NULL)) {
+    if ((wall_neighbor(grid->surface, 1) != NULL) &&
+        (wall_neighbor(grid->surface, 1)->grid != NULL)) {
       if (move_thru_border_1) {
         /* get the neighbors from the neighbor walls */
         tiles_added = add_more_tile_neighbors_to_list_fast(
             &tile_nbr_head, grid, strip, stripe, flip, grid->surface->vert[1],
-            grid->surface->vert[2], 1, grid->surface->nb_walls[1]->grid);
+            grid->surface->vert[2], 1, wall_neighbor(grid->surface, 1)->grid);
         tiles_count += tiles_added;
       }
     }
@@ -2681,11 +2735,11 @@ int is_corner_tile(struct surface_grid *g, int idx) {
 find_shared_vertices_corner_tile_parent_wall:
    In: Surface grid
        Index of the tile on that grid
-       3-member array of indices (in the global array "walls_using_vertex"
+       3-member array of indices (in the global array "all_vertices"
             of parent wall vertices that are shared with other walls
             (return value)
    Out: Returns 3-member array of the indices of parent wall vertices
-        in the global "world->walls_using_vertex" array
+        in the global "world->all_vertices" array
         that are shared with other neighbor walls.
         If the wall vertex is not shared the corresponding value
         in the return array is not set.
@@ -2709,7 +2763,8 @@ void find_shared_vertices_corner_tile_parent_wall(struct volume *world,
   if ((u_int)idx == (sg->n_tiles - 2 * (sg->n) + 1)) {
     v = sg->surface->vert[0];
     global_vert_index = (long long)(v - world->all_vertices);
-    if (world->walls_using_vertex[global_vert_index] != NULL) {
+    if (world->vertex_wall_offsets[global_vert_index + 1] >
+        world->vertex_wall_offsets[global_vert_index]) {
       shared_vert[0] = global_vert_index;
     }
   }
@@ -2718,7 +2773,8 @@ void find_shared_vertices_corner_tile_parent_wall(struct volume *world,
   if ((u_int)idx == (sg->n_tiles - 1)) {
     v = sg->surface->vert[1];
     global_vert_index = (long long)(v - world->all_vertices);
-    if (world->walls_using_vertex[global_vert_index] != NULL) {
+    if (world->vertex_wall_offsets[global_vert_index + 1] >
+        world->vertex_wall_offsets[global_vert_index]) {
       shared_vert[1] = global_vert_index;
     }
   }
@@ -2727,7 +2783,8 @@ void find_shared_vertices_corner_tile_parent_wall(struct volume *world,
   if ((u_int)idx == 0) {
     v = sg->surface->vert[2];
     global_vert_index = (long long)(v - world->all_vertices);
-    if (world->walls_using_vertex[global_vert_index] != NULL) {
+    if (world->vertex_wall_offsets[global_vert_index + 1] >
+        world->vertex_wall_offsets[global_vert_index]) {
       shared_vert[2] = global_vert_index;
     }
   }
@@ -3008,7 +3065,7 @@ void find_neighbor_tiles(struct volume *world, struct surface_molecule *sm,
      the wall vertices which can be shared with the neighbor walls */
 
   long long shared_vert[3]; /* indices of the vertices of the parent wall
-                         in the global array "world->walls_using_vertex"
+                         in the global array "world->all_vertices"
                          that are shared with the neighbor walls
                          (used only for the corner tile)  */
 
@@ -3064,4 +3121,290 @@ void find_neighbor_tiles(struct volume *world, struct surface_molecule *sm,
   *list_length = tmp_list_length;
 }
 
+/**************************************************************************
+tile_neighbors_are_final:
+  In: world: simulation state
+      grid: surface grid
+      idx: index of a tile on that grid
+  Out: 1 if every wall find_neighbor_tiles could find neighbors of the tile
+       on already has a grid, so that the neighbors of the tile can never
+       change again, 0 otherwise
+****************************************************************************/
+static int tile_neighbors_are_final(struct volume *world,
+                                    struct surface_grid *grid, int idx) {
+  if (is_inner_tile(grid, idx))
+    return 1;
+
+  for (int kk = 0; kk < 3; kk++) {
+    if (wall_neighbor(grid->surface, kk) != NULL &&
+        wall_neighbor(grid->surface, kk)->grid == NULL)
+      return 0;
+  }
+
+  if (!is_corner_tile(grid, idx))
+    return 1;
+
+  long long shared_vert[3] = { -1, -1, -1 };
+  find_shared_vertices_corner_tile_parent_wall(world, grid, idx, shared_vert);
+  struct wall_list *wall_nbr_head =
+      find_nbr_walls_shared_one_vertex(world, grid->surface, shared_vert);
+  int final = 1;
+  for (struct wall_list *wl = wall_nbr_head; wl != NULL; wl = wl->next) {
+    if (wl->this_wall->grid == NULL) {
+      final = 0;
+      break;
+    }
+  }
+  delete_wall_list(wall_nbr_head);
+  return final;
+}
+
+/**************************************************************************
+find_neighbor_tiles_cached:
+  In: world: simulation state
+      sm: surface molecule looking for reaction partners, or NULL
+      grid: surface grid the molecule sits on
+      idx: index of the tile the molecule sits on
+      nbr_grid: set to the grids of the neighbor tiles
+      nbr_idx: set to the indices of the neighbor tiles
+  Out: The number of neighbor tiles.  The neighbors are the ones
+       find_neighbor_tiles(world, sm, grid, idx, 0, 1, ...) finds, in the
+       same order, but in arrays that belong to the grid and stay valid
+       only until the next call for the same grid.
+  Note: Unless sm can hit region borders, the neighbors of a tile only
+        depend on the mesh and on which neighbor walls have grids, so they
+        are kept in the grid's tile_neighbor_index once all of those walls
+        have grids.  The index goes away with the grid.
+****************************************************************************/
+int find_neighbor_tiles_cached(struct volume *world,
+                               struct surface_molecule *sm,
+                               struct surface_grid *grid, int idx,
+                               struct surface_grid ***nbr_grid, int **nbr_idx) {
+  struct tile_neighbor_index *index = grid->nbr_index;
+  if (index == NULL) {
+    index = CHECKED_MALLOC_STRUCT(struct tile_neighbor_index,
+                                  "tile neighbor index");
+    index->first = CHECKED_MALLOC_ARRAY(int, grid->n_tiles,
+                                        "tile neighbor index");
+    index->count = CHECKED_MALLOC_ARRAY(int, grid->n_tiles,
+                                        "tile neighbor index");
+    for (u_int i = 0; i < grid->n_tiles; i++)
+      index->first[i] = -1;
+    index->nbr_grid = NULL;
+    index->nbr_idx = NULL;
+    index->n_entries = 0;
+    index->max_entries = 0;
+    grid->nbr_index = index;
+  }
+
+  int border = (sm != NULL && (sm->properties->flags & CAN_REGION_BORDER));
+  if (!border && index->first[idx] >= 0) {
+    *nbr_grid = index->nbr_grid + index->first[idx];
+    *nbr_idx = index->nbr_idx + index->first[idx];
+    return index->count[idx];
+  }
+
+  struct tile_neighbor *tile_nbr_head = NULL;
+  int list_length = 0;
+  find_neighbor_tiles(world, sm, grid, idx, 0, 1, &tile_nbr_head,
+                      &list_length);
+
+  /* Results are written past the entries in use; they are only kept if they
+   * can never change */
+  if (index->n_entries + list_length > index->max_entries) {
+    int max_entries = 2 * index->max_entries;
+    if (max_entries < index->n_entries + list_length)
+      max_entries = index->n_entries + list_length + 16;
+    struct surface_grid **grids = (struct surface_grid **)realloc(
+        index->nbr_grid, max_entries * sizeof(struct surface_grid *));
+    if (grids == NULL)
+      mcell_allocfailed("Failed to grow tile neighbor index.");
+    index->nbr_grid = grids;
+    int *idxs = (int *)realloc(index->nbr_idx, max_entries * sizeof(int));
+    if (idxs == NULL)
+      mcell_allocfailed("Failed to grow tile neighbor index.");
+    index->nbr_idx = idxs;
+    index->max_entries = max_entries;
+  }
+
+  int start = index->n_entries;
+  int n = start;
+  for (struct tile_neighbor *tn = tile_nbr_head; tn != NULL; tn = tn->next) {
+    index->nbr_grid[n] = tn->grid;
+    index->nbr_idx[n] = tn->idx;
+    n++;
+  }
+  delete_tile_neighbor_list(tile_nbr_head);
+
+  if (!border && tile_neighbors_are_final(world, grid, idx)) {
+    index->first[idx] = start;
+    index->count[idx] = list_length;
+    index->n_entries = n;
+  }
+
+  *nbr_grid = index->nbr_grid + start;
+  *nbr_idx = index->nbr_idx + start;
+  return list_length;
+}
+
+/**************************************************************************
+find_product_tiles:
+  In: world: simulation state
+      grid: surface grid where a reaction with surface products happens
+      idx: index of the tile of the reaction
+      nbr_grid: set to the grids of the neighbor tiles
+      nbr_idx: set to the indices of the neighbor tiles
+  Out: The number of neighbor tiles.  These are the tiles
+       find_neighbor_tiles(world, sm, grid, idx, 1, 0, ...) finds for
+       product placement, in the same order, and as with
+       find_neighbor_tiles_cached they are only valid until the next
+       lookup on the same grid.
+  Note: Product placement ignores region borders, and it creates the
+        missing neighbor grids.  Once those grids exist, the neighbors are
+        the ones kept in the grid's tile_neighbor_index.
+****************************************************************************/
+int find_product_tiles(struct volume *world, struct surface_grid *grid,
+                       int idx, struct surface_grid ***nbr_grid,
+                       int **nbr_idx) {
+  if (!tile_neighbors_are_final(world, grid, idx)) {
+    /* creates the neighbor grids */
+    struct tile_neighbor *tile_nbr_head = NULL;
+    int list_length = 0;
+    find_neighbor_tiles(world, NULL, grid, idx, 1, 0, &tile_nbr_head,
+                        &list_length);
+    delete_tile_neighbor_list(tile_nbr_head);
+  }
+
+  return find_neighbor_tiles_cached(world, NULL, grid, idx, nbr_grid, nbr_idx);
+}
+
+/**************************************************************************
+destroy_tile_neighbor_index:
+  In: grid: surface grid
+  Out: The grid's tile_neighbor_index, if any, is freed
+****************************************************************************/
+void destroy_tile_neighbor_index(struct surface_grid *grid) {
+  struct tile_neighbor_index *index = grid->nbr_index;
+  if (index == NULL)
+    return;
+
+  free(index->first);
+  free(index->count);
+  free(index->nbr_grid);
+  free(index->nbr_idx);
+  free(index);
+  grid->nbr_index = NULL;
+}
+
+/**************************************************************************
+own_grid_tiles:
+  In: grid: surface grid about to have one of its tiles written to
+  Out: If the grid had given up its tile array (see
+       release_empty_grid_tiles), it gets a fresh, empty one of its own
+****************************************************************************/
+void own_grid_tiles(struct surface_grid *grid) {
+  if (!grid->tiles_shared)
+    return;
+
+  grid->sm_list = CHECKED_MALLOC_ARRAY(struct surface_molecule_list *,
+                                       grid->n_tiles, "surface grid");
+  for (u_int i = 0; i < grid->n_tiles; i++)
+    grid->sm_list[i] = NULL;
+  grid->tiles_shared = 0;
+}
+
+/**************************************************************************
+grid_is_empty:
+  In: grid: surface grid
+  Out: 1 if no tile of the grid holds a surface molecule, 0 otherwise
+****************************************************************************/
+static int grid_is_empty(struct surface_grid *grid) {
+  if (grid->tiles_shared)
+    return 1;
+  if (grid->n_occupied != 0)
+    return 0;
+
+  for (u_int i = 0; i < grid->n_tiles; i++) {
+    for (struct surface_molecule_list *sml = grid->sm_list[i]; sml != NULL;
+         sml = sml->next) {
+      if (sml->sm != NULL)
+        return 0;
+    }
+  }
+  return 1;
+}
+
+/**************************************************************************
+release_empty_grid_tiles:
+  In: world: simulation state
+  Out: Number of bytes released.  Grids without a single surface molecule
+       free their tile arrays (and the empty list entries left in them) and
+       share the world's all-NULL empty_tiles array instead, until a
+       molecule lands on them again.  The grids themselves are kept, since
+       which walls have grids decides which neighbor tiles 2D reactions see.
+  Note: Must not be called while molecules are being moved.
+****************************************************************************/
+long long release_empty_grid_tiles(struct volume *world) {
+  /* Make sure the shared array is big enough for every grid to release */
+  u_int max_tiles = 0;
+  for (struct storage_list *sl = world->storage_head; sl != NULL;
+       sl = sl->next) {
+    for (struct wall *w = sl->store->wall_head; w != NULL; w = w->next) {
+      if (w->grid != NULL && !w->grid->tiles_shared &&
+          w->grid->n_tiles > max_tiles && grid_is_empty(w->grid))
+        max_tiles = w->grid->n_tiles;
+    }
+  }
+  if (max_tiles == 0)
+    return 0;
+
+  if (max_tiles > world->n_empty_tiles) {
+    struct surface_molecule_list **empty_tiles =
+        CHECKED_MALLOC_ARRAY_NODIE(struct surface_molecule_list *, max_tiles,
+                                   "empty surface grid");
+    if (empty_tiles == NULL)
+      return 0;
+    for (u_int i = 0; i < max_tiles; i++)
+      empty_tiles[i] = NULL;
+
+    for (struct storage_list *sl = world->storage_head; sl != NULL;
+         sl = sl->next) {
+      for (struct wall *w = sl->store->wall_head; w != NULL; w = w->next) {
+        if (w->grid != NULL && w->grid->tiles_shared)
+          w->grid->sm_list = empty_tiles;
+      }
+    }
+    free(world->empty_tiles);
+    world->empty_tiles = empty_tiles;
+    world->n_empty_tiles = max_tiles;
+  }
+
+  long long released = 0;
+  for (struct storage_list *sl = world->storage_head; sl != NULL;
+       sl = sl->next) {
+    for (struct wall *w = sl->store->wall_head; w != NULL; w = w->next) {
+      struct surface_grid *grid = w->grid;
+      if (grid == NULL || grid->tiles_shared || !grid_is_empty(grid))
+        continue;
+
+      for (u_int i = 0; i < grid->n_tiles; i++) {
+        struct surface_molecule_list *sml = grid->sm_list[i];
+        while (sml != NULL) {
+          struct surface_molecule_list *next = sml->next;
+          free(sml);
+          released += sizeof(struct surface_molecule_list);
+          sml = next;
+        }
+      }
+      free(grid->sm_list);
+      released += grid->n_tiles * sizeof(struct surface_molecule_list *);
+
+      grid->sm_list = world->empty_tiles;
+      grid->tiles_shared = 1;
+      set_all_bits(grid->vacant, 1);
+    }
+  }
+  return released;
+}
+
 
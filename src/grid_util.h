@@ -36,6 +36,19 @@ struct tile_neighbor {
   struct tile_neighbor *next;
 };
 
+/* Neighbor tiles of the tiles of one grid, filled in one tile at a time as
+ * they are looked up.  The neighbors of tile i are entries first[i] to
+ * first[i] + count[i] - 1 of nbr_grid and nbr_idx; first[i] is -1 until
+ * the neighbors of tile i are known for good. */
+struct tile_neighbor_index {
+  int *first;
+  int *count;
+  struct surface_grid **nbr_grid;
+  int *nbr_idx;
+  int n_entries;   /* Entries in use by tiles that are filled in */
+  int max_entries; /* Room in nbr_grid and nbr_idx */
+};
+
 void xyz2uv(struct vector3 *a, struct wall *w, struct vector2 *b);
 
 void uv2xyz(struct vector2 *a, struct wall *w, struct vector3 *b);
@@ -113,6 +126,21 @@ void find_neighbor_tiles(struct volume *world, struct surface_molecule *sm,
                          struct tile_neighbor **tile_nbr_head,
                          int *list_length);
 
+int find_neighbor_tiles_cached(struct volume *world,
+                               struct surface_molecule *sm,
+                               struct surface_grid *grid, int idx,
+                               struct surface_grid ***nbr_grid, int **nbr_idx);
+
+int find_product_tiles(struct volume *world, struct surface_grid *grid,
+                       int idx, struct surface_grid ***nbr_grid,
+                       int **nbr_idx);
+
+void destroy_tile_neighbor_index(struct surface_grid *grid);
+
+void own_grid_tiles(struct surface_grid *grid);
+
+long long release_empty_grid_tiles(struct volume *world);
+
 void grid_all_neighbors_for_inner_tile(struct volume *world,
                                        struct surface_grid *grid, int idx,
                                        struct vector2 *pos,
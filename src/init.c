@@ -49,13 +49,16 @@
 #include "viz_output.h"
 #include "react.h"
 #include "react_output.h"
+#include "output_journal.h"
 #include "chkpt.h"
 #include "init.h"
 #include "mdlparse_aux.h"
 #include "mcell_objects.h"
 #include "dyngeom.h"
 #include "dyngeom_parse_extras.h"
+#include "diffuse.h"
 #include "triangle_overlap.h"
+#include "thread_util.h"
 
 #define MESH_DISTINCTIVE EPS_C
 
@@ -75,6 +78,8 @@ static int compute_bb_polygon_object(struct volume *world, struct object *objp,
                                      double (*im)[4]);
 
 static int init_species_defaults(struct volume *world);
+static void init_reaction_partners(struct volume *world);
+static void init_unimolecular_lookup(struct volume *world);
 static int init_regions_helper(struct volume *world);
 
 static struct ccn_clamp_data* find_clamped_object_in_list(struct ccn_clamp_data *ccd,
@@ -109,6 +114,7 @@ int init_notifications(struct volume *world) {
     world->notify->volume_output_report = NOTIFY_NONE;
     world->notify->viz_output_report = NOTIFY_NONE;
     world->notify->molecule_collision_report = NOTIFY_NONE;
+    world->notify->memory_usage_report = NOTIFY_NONE;
   } else {
     world->notify->progress_report = NOTIFY_FULL;
     world->notify->diffusion_constants = NOTIFY_BRIEF;
@@ -128,6 +134,7 @@ int init_notifications(struct volume *world) {
     world->notify->volume_output_report = NOTIFY_NONE;
     world->notify->viz_output_report = NOTIFY_NONE;
     world->notify->molecule_collision_report = NOTIFY_NONE;
+    world->notify->memory_usage_report = NOTIFY_NONE;
   }
   /* Warnings */
   world->notify->neg_diffusion = WARN_WARN;
@@ -236,13 +243,18 @@ int init_variables(struct volume *world) {
   // XXX: This is in the wrong place here and should be moved
   //      to a separate function perhaps
   install_emergency_output_hooks(world);
-  emergency_output_hook_enabled = 0;
+  world->emergency_output_hook_enabled = 0;
 
   world->curr_file = world->mdl_infile_name;
   world->chkpt_iterations = 0;
   world->last_checkpoint_iteration = 0;
   world->chkpt_seq_num = 0;
   world->keep_chkpts = 0;
+  world->background_chkpts = 0;
+  world->chkpt_child_pid = 0;
+  world->chkpt_fixed_width = 0;
+  world->chkpt_differential = 0;
+  world->chkpt_base = NULL;
 
   world->last_timing_time = (struct timeval) { 0, 0 };
   world->last_timing_iteration = 0;
@@ -250,26 +262,22 @@ int init_variables(struct volume *world) {
   world->chkpt_flag = 0;
   world->disable_polygon_objects = 0;
   world->viz_blocks = NULL;
-  world->ray_voxel_tests = 0;
-  world->ray_polygon_tests = 0;
-  world->ray_polygon_colls = 0;
   world->dyngeom_molec_displacements = 0;
-  world->vol_vol_colls = 0;
-  world->vol_surf_colls = 0;
-  world->surf_surf_colls = 0;
-  world->vol_wall_colls = 0;
-  world->vol_vol_vol_colls = 0;
-  world->vol_vol_surf_colls = 0;
-  world->vol_surf_surf_colls = 0;
-  world->surf_surf_surf_colls = 0;
+  world->clamp_mols_emitted = 0;
+  world->clamp_side_steps = 0;
   world->chkpt_start_time_seconds = 0;
   world->chkpt_byte_order_mismatch = 0;
-  world->diffusion_number = 0;
-  world->diffusion_cumtime = 0.0;
+  memset(&world->stats, 0, sizeof(world->stats));
   world->current_iterations = 0;
   world->elapsed_time = 0;
   world->time_unit = 0;
   world->time_step_max = 0;
+  world->adaptive_time_step = 0;
+  world->auto_step_multiplier = 1;
+  world->step_multiplier_boxes = NULL;
+  world->equilibration_iterations = 0;
+  world->equilibration_multiplier = 1;
+  world->equilibrating = 0;
   world->start_iterations = 0;
   world->current_time_seconds = 0;
   world->simulation_start_seconds = 0;
@@ -283,6 +291,7 @@ int init_variables(struct volume *world) {
   world->num_directions = world->radial_directions;
   world->r_step = NULL;
   world->r_step_surface = NULL;
+  world->r_step_surface_erfc = NULL;
   world->r_step_release = NULL;
   world->d_step = NULL;
   world->dissociation_index = DISSOCIATION_MAX;
@@ -295,19 +304,28 @@ int init_variables(struct volume *world) {
   world->x_partitions = NULL;
   world->y_partitions = NULL;
   world->z_partitions = NULL;
+  memset(&world->x_lookup, 0, sizeof(struct partition_lookup));
+  memset(&world->y_lookup, 0, sizeof(struct partition_lookup));
+  memset(&world->z_lookup, 0, sizeof(struct partition_lookup));
+  world->empty_tiles = NULL;
+  world->n_empty_tiles = 0;
   world->x_fineparts = NULL;
   world->y_fineparts = NULL;
   world->z_fineparts = NULL;
   world->n_fineparts = 0;
+  world->adaptive_partitions = 0;
   world->mem_part_x = 14;
   world->mem_part_y = 14;
   world->mem_part_z = 14;
   world->mem_part_pool = 0;
+  world->mem_part_auto = 0;
   world->all_vertices = NULL;
-  world->walls_using_vertex = NULL;
+  world->vertex_wall_offsets = NULL;
+  world->vertex_walls = NULL;
   world->periodic_box_obj = NULL;
 
   world->use_expanded_list = 1;
+  world->diffuse_3D_variant = diffuse_3D;
   world->randomize_smol_pos = 1;
   world->vacancy_search_dist2 = 0.1;
   world->surface_reversibility = 0;
@@ -349,6 +367,26 @@ int init_variables(struct volume *world) {
 int init_data_structures(struct volume *world) {
   int i;
 
+  mem_use_huge_pages(world->use_huge_pages);
+  /* The page file is mapped shared, so the processes of a seed sweep would
+   * all page into the same storages */
+  if (world->page_idle_storages > 0 && world->n_seeds > 1) {
+    mcell_warn("Storages are not paged out when running several seeds.");
+    world->page_idle_storages = 0;
+  }
+  if (world->page_idle_storages > 0) {
+
+    char const *dir = world->page_dir;
+    if (dir == NULL && (dir = getenv("TMPDIR")) == NULL)
+      dir = "/tmp";
+    if (mem_use_page_file(dir)) {
+      mcell_warn("Could not create a page file in '%s'; storages will not be "
+                 "paged out.",
+                 dir);
+      world->page_idle_storages = 0;
+    }
+  }
+
   if (!(world->rng = CHECKED_MALLOC_STRUCT_NODIE(
             struct rng_state, "random number generator state"))) {
     return 1;
@@ -370,6 +408,9 @@ int init_data_structures(struct volume *world) {
 
   for (i = 0; i <= world->count_hashmask; i++)
     world->count_hash[i] = NULL;
+  world->n_counter_slots = 0;
+  world->counter_slots = NULL;
+  world->count_shard = NULL;
 
   world->oexpr_mem = create_mem_named(sizeof(struct output_expression), 128,
                                       "output expression");
@@ -526,12 +567,25 @@ int init_data_structures(struct volume *world) {
   world->output_request_head = NULL;
 
   world->dynamic_geometry_head = NULL;
+  world->dynamic_geometry_cache_flag = 0;
+  world->dynamic_geometry_cache = NULL;
+  world->dynamic_geometry_events = NULL;
+  world->n_dynamic_geometry_events = 0;
+  world->dynamic_geometry_loader = NULL;
+  world->product_placement_cache = NULL;
+  world->rate_tables = NULL;
+  world->mol_id_index = NULL;
 
   world->releaser = create_scheduler(1.0, 100.0, 100, 0.0);
   if (world->releaser == NULL) {
     mcell_allocfailed_nodie("Failed to create release scheduler.");
     return 1;
   }
+  world->triggered_releases = CHECKED_MALLOC_STRUCT_NODIE(
+      struct triggered_release_queue, "reaction-triggered releases");
+  if (world->triggered_releases == NULL)
+    return 1;
+  memset(world->triggered_releases, 0, sizeof(struct triggered_release_queue));
 
   init_dynamic_geometry(world);
 
@@ -556,6 +610,9 @@ int init_species(struct volume *world) {
   }
   no_printf("Done setting up species.\n");
 
+  init_reaction_partners(world);
+  init_unimolecular_lookup(world);
+
   /* Create linked lists of volume and surface molecules names */
   struct name_list *vol_species_name_list = NULL;
   struct name_list *surf_species_name_list = NULL;
@@ -612,6 +669,24 @@ int init_species(struct volume *world) {
   return 0;
 }
 
+/***********************************************************************
+ *
+ * get the thread pool shared by all parallel phases of the simulation
+ * (initialization, the run loop, checkpoints and output).  It is started
+ * on first use with world->num_threads threads.  Returns NULL if there is
+ * only one thread, which thread_pool_run takes to mean the caller.
+ *
+ ***********************************************************************/
+struct thread_pool *world_thread_pool(struct volume *world) {
+  if (world->thread_pool == NULL && world->num_threads > 1) {
+    world->thread_pool = thread_pool_create(world->num_threads);
+    if (world->thread_pool == NULL)
+      mcell_allocfailed("Failed to start %d worker threads.",
+                        world->num_threads);
+  }
+  return world->thread_pool;
+}
+
 /***********************************************************************
  *
  * initialize the models' vertices and walls
@@ -651,24 +726,19 @@ int init_vertices_walls(struct volume *world) {
   }
 
   /* Allocate the  global "all_vertices" array */
-  if (!(world->all_vertices = CHECKED_MALLOC_ARRAY_NODIE(
-            struct vector3, num_vertices_this_storage[num_storages - 1],
-            "array of all vertices in the world"))) {
+  int huge;
+  if (!(world->all_vertices = (struct vector3 *)mem_alloc_large(
+            num_vertices_this_storage[num_storages - 1] *
+                sizeof(struct vector3),
+            &huge))) {
+    mcell_allocfailed_nodie("Failed to allocate array of all vertices in the "
+                            "world.");
     return 1;
   }
+  if (world->use_huge_pages && world->notify->progress_report != NOTIFY_NONE)
+    mcell_log("Array of all vertices is %son huge pages.", huge ? "" : "not ");
 
-  /* Allocate the global "walls_using_vertex" array */
-  if (world->create_shared_walls_info_flag) {
-    if (!(world->walls_using_vertex = CHECKED_MALLOC_ARRAY_NODIE(
-              struct wall_list *, num_vertices_this_storage[num_storages - 1],
-              "wall list pointers"))) {
-      return 1;
-    }
-
-    for (int kk = 0; kk < num_vertices_this_storage[num_storages - 1]; kk++) {
-      world->walls_using_vertex[kk] = NULL;
-    }
-  }
+  int num_vertices = num_vertices_this_storage[num_storages - 1];
   init_matrix(tm);
 
   /* Copy vertices into the global array "world->all_vertices"
@@ -679,11 +749,13 @@ int init_vertices_walls(struct volume *world) {
   /* free memory */
   free(num_vertices_this_storage);
 
+  struct thread_pool *pool = world_thread_pool(world);
+
   init_matrix(tm);
   /* Instantiate all objects */
   if (world->notify->progress_report != NOTIFY_NONE)
     mcell_log("Instantiating objects...");
-  if (instance_obj(world, world->root_instance, tm))
+  if (instance_obj(world, world->root_instance, tm, pool))
     return 1;
 
   if (world->notify->progress_report != NOTIFY_NONE)
@@ -694,9 +766,13 @@ int init_vertices_walls(struct volume *world) {
     return 1;
   }
 
+  if (world->create_shared_walls_info_flag &&
+      build_vertex_wall_adjacency(world, num_vertices))
+    return 1;
+
   if (world->notify->progress_report != NOTIFY_NONE)
     mcell_log("Creating edges...");
-  if (sharpen_world(world)) {
+  if (sharpen_world(world, pool)) {
     mcell_error_nodie("Unknown error while adding edges to geometry.");
     return 1;
   }
@@ -850,6 +926,9 @@ int init_reaction_data(struct volume *world) {
     return 1;
   }
 
+  if (size_output_buffers(world))
+    return 1;
+
   /* Schedule the reaction data output events */
   obp = world->output_block_head;
   while (obp != NULL) {
@@ -898,7 +977,8 @@ int init_reaction_data(struct volume *world) {
     }
 
     for (set = obp->data_set_head; set != NULL; set = set->next) {
-      if (set->file_flags == FILE_SUBSTITUTE) {
+      /* Only rank 0 writes reaction data */
+      if (set->file_flags == FILE_SUBSTITUTE && world->procnum == 0) {
         if (world->chkpt_seq_num == 1) {
           FILE *file = fopen(set->outfile_name, "w");
           if (file == NULL) {
@@ -909,10 +989,16 @@ int init_reaction_data(struct volume *world) {
           }
 
           fclose(file);
+
+          /* A fresh file starts a fresh restart index */
+          char *idx_name = CHECKED_SPRINTF("%s%s", set->outfile_name,
+                                           OUTPUT_INDEX_SUFFIX);
+          unlink(idx_name);
+          free(idx_name);
         } else if (obp->timer_type == OUTPUT_BY_ITERATION_LIST) {
           if (obp->time_now == NULL)
             continue;
-          if (truncate_output_file(set->outfile_name, obp->t)) {
+          if (truncate_output_set(set, obp->t)) {
             mcell_error_nodie("Failed to prepare reaction data output file "
                               "'%s' to receive output.",
                               set->outfile_name);
@@ -921,8 +1007,7 @@ int init_reaction_data(struct volume *world) {
         } else if (obp->timer_type == OUTPUT_BY_TIME_LIST) {
           if (obp->time_now == NULL)
             continue;
-          if (truncate_output_file(set->outfile_name,
-                                   obp->t * world->time_unit)) {
+          if (truncate_output_set(set, obp->t * world->time_unit)) {
             mcell_error_nodie("Failed to prepare reaction data output file "
                               "'%s' to receive output.",
                               set->outfile_name);
@@ -933,7 +1018,7 @@ int init_reaction_data(struct volume *world) {
             * simulation plus a single TIMESTEP */
           double startTime =
               world->chkpt_start_time_seconds + world->time_unit;
-          if (truncate_output_file(set->outfile_name, startTime)) {
+          if (truncate_output_set(set, startTime)) {
             mcell_error_nodie("Failed to prepare reaction data output file "
                               "'%s' to receive output.",
                               set->outfile_name);
@@ -943,6 +1028,13 @@ int init_reaction_data(struct volume *world) {
       }
     }
 
+    /* Dynamic geometry re-resolves count requests, so keep the trees */
+    if (!world->dynamic_geometry_flag)
+      compile_output_block(obp);
+
+    if (output_journal_create(world, obp))
+      return 1;
+
     if (schedule_add(world->count_scheduler, obp)) {
       mcell_allocfailed_nodie(
           "Failed to add reaction data output item to scheduler.");
@@ -1127,18 +1219,13 @@ static int init_viz_species_states(int n_species,
   for (int i = 0; i < n_species; ++i)
     vizblk->species_viz_states[i] = EXCLUDE_OBJ;
 
-  int n_entries = vizblk->parser_species_viz_states.num_items;
-  int n_bins = vizblk->parser_species_viz_states.table_size;
-  for (int i = 0; n_entries > 0 && i < n_bins; ++i) {
-    struct species *specp =
-        (struct species *)(vizblk->parser_species_viz_states.keys[i]);
-    if (specp != NULL) {
-      int viz_state =
-          (int)(intptr_t)vizblk->parser_species_viz_states.values[i];
-
-      vizblk->species_viz_states[specp->species_id] = viz_state;
-      --n_entries;
-    }
+  int pos = 0;
+  void const *key;
+  void *value;
+  while (pointer_hash_next(&vizblk->parser_species_viz_states, &pos, &key,
+                           &value)) {
+    struct species const *specp = (struct species const *)key;
+    vizblk->species_viz_states[specp->species_id] = (int)(intptr_t)value;
   }
 
   pointer_hash_destroy(&vizblk->parser_species_viz_states);
@@ -1215,6 +1302,128 @@ static int init_species_defaults(struct volume *world) {
   return 0;
 }
 
+/* Species counts above which partners go in a Bloom filter instead of a
+ * bit row per species */
+#define RX_PARTNER_ROWS_MAX 4096
+
+/********************************************************************
+init_reaction_partner_bloom:
+   Sets up the Bloom filter shared by all species in place of partner bit
+   rows, with about 16 bits per bimolecular reaction.
+
+   In: world: simulation state, with reactions and species ids set up
+   Out: species->rx_partner_bloom is set for all species
+*********************************************************************/
+static void init_reaction_partner_bloom(struct volume *world) {
+  int n_pairs = 0;
+  for (int i = 0; i < world->rx_hashsize; i++) {
+    for (struct rxn *rx = world->reaction_hash[i]; rx != NULL; rx = rx->next) {
+      if (rx->n_reactants >= 2)
+        n_pairs++;
+    }
+  }
+
+  int n_bits = 1024;
+  while (n_bits / 16 < n_pairs && n_bits < (1 << 30))
+    n_bits <<= 1;
+  struct bit_array *bloom = new_bit_array(n_bits);
+  if (bloom == NULL)
+    mcell_allocfailed("Failed to allocate reaction partner filter.");
+  set_all_bits(bloom, 0);
+
+  for (int i = 0; i < world->rx_hashsize; i++) {
+    for (struct rxn *rx = world->reaction_hash[i]; rx != NULL; rx = rx->next) {
+      if (rx->n_reactants < 2)
+        continue;
+      for (int k = 0; k < RX_PARTNER_BLOOM_HASHES; k++)
+        set_bit(bloom, rx_partner_bloom_bit(bloom, rx->players[0]->species_id,
+                                            rx->players[1]->species_id, k),
+                1);
+    }
+  }
+
+  for (int i = 0; i < world->n_species; i++)
+    world->species_list[i]->rx_partner_bloom = bloom;
+}
+
+/********************************************************************
+init_reaction_partners:
+   Marks, for every species taking part in a bimolecular reaction, the
+   species it has at least one such reaction with.  trigger_bimolecular
+   consults these bits before walking the reaction hash chain, so a pair
+   without any reaction is rejected by a single bit test instead of a
+   walk over all unrelated reactions sharing its hash bin.  Species
+   without bimolecular reactions share a row with no bits set.  Above
+   RX_PARTNER_ROWS_MAX species the rows would take too much memory, and
+   a Bloom filter is used instead.
+
+   In: world: simulation state, with reactions and species ids set up
+   Out: species->rx_partners or species->rx_partner_bloom is set for all
+        species
+*********************************************************************/
+static void init_reaction_partners(struct volume *world) {
+  if (world->n_species > RX_PARTNER_ROWS_MAX) {
+    init_reaction_partner_bloom(world);
+    return;
+  }
+
+  for (int i = 0; i < world->rx_hashsize; i++) {
+    for (struct rxn *rx = world->reaction_hash[i]; rx != NULL; rx = rx->next) {
+      if (rx->n_reactants < 2)
+        continue;
+
+      for (int n_player = 0; n_player < 2; n_player++) {
+        struct species *sp = rx->players[n_player];
+        struct species *partner = rx->players[1 - n_player];
+        if (sp->rx_partners == NULL) {
+          sp->rx_partners = new_bit_array(world->n_species);
+          if (sp->rx_partners == NULL)
+            mcell_allocfailed("Failed to allocate reaction partner bits for "
+                              "species '%s'.", sp->sym->name);
+          set_all_bits(sp->rx_partners, 0);
+        }
+        set_bit(sp->rx_partners, partner->species_id, 1);
+      }
+    }
+  }
+
+  struct bit_array *no_partners = new_bit_array(world->n_species);
+  if (no_partners == NULL)
+    mcell_allocfailed("Failed to allocate reaction partner bits.");
+  set_all_bits(no_partners, 0);
+  for (int i = 0; i < world->n_species; i++) {
+    if (world->species_list[i]->rx_partners == NULL)
+      world->species_list[i]->rx_partners = no_partners;
+  }
+}
+
+/********************************************************************
+init_unimolecular_lookup:
+   Looks up the unimolecular reaction of every species once, so that
+   trigger_unimolecular does not have to walk the reaction hash chain
+   each time a molecule's lifetime is computed.  The reaction stored is
+   the one the hash chain walk would find.
+
+   In: world: simulation state, with reactions set up
+   Out: species->unimol_rx and species->unimol_rx_known are set for all
+        species
+*********************************************************************/
+static void init_unimolecular_lookup(struct volume *world) {
+  for (int i = 0; i < world->n_species; i++) {
+    struct species *sp = world->species_list[i];
+    sp->unimol_rx = NULL;
+    for (struct rxn *rx =
+             world->reaction_hash[sp->hashval & (world->rx_hashsize - 1)];
+         rx != NULL; rx = rx->next) {
+      if (rx->n_reactants == 1 && rx->players[0] == sp) {
+        sp->unimol_rx = rx;
+        break;
+      }
+    }
+    sp->unimol_rx_known = 1;
+  }
+}
+
 /********************************************************************
  create_storage:
 
@@ -1264,6 +1473,7 @@ static struct storage *create_storage(struct volume *world, int nsubvols) {
   shared_mem =
       CHECKED_MALLOC_STRUCT(struct storage, "memory storage partition");
   memset(shared_mem, 0, sizeof(struct storage));
+  shared_mem->mol_id_index = world->mol_id_index;
 
   if (world->mem_part_pool != 0)
     nsubvols = world->mem_part_pool;
@@ -1273,35 +1483,69 @@ static struct storage *create_storage(struct volume *world, int nsubvols) {
     nsubvols = 4096;
   /* We should tune the algorithm for selecting allocation block sizes.  */
   /* XXX: Round up to power of 2?  Shouldn't matter, I think. */
-  if ((shared_mem->list = create_mem_named(sizeof(struct wall_list), nsubvols,
-                                           "wall list")) == NULL)
+  if ((shared_mem->list = create_mem_pageable(sizeof(struct wall_list),
+                                              nsubvols, "wall list")) == NULL)
     mcell_allocfailed("Failed to create memory pool for wall list.");
-  if ((shared_mem->mol = create_mem_named(sizeof(struct volume_molecule),
-                                          nsubvols, "vol mol")) == NULL)
+#ifdef MEM_UTIL_SLABS
+  /* Slab records start on a cache line; pad molecules to whole lines so the
+   * hot header of every record shares a line with nothing else. */
+  size_t vm_record_size = CACHE_LINE_ROUND(sizeof(struct volume_molecule));
+  size_t sm_record_size = CACHE_LINE_ROUND(sizeof(struct surface_molecule));
+#else
+  size_t vm_record_size = sizeof(struct volume_molecule);
+  size_t sm_record_size = sizeof(struct surface_molecule);
+#endif
+  if ((shared_mem->mol = create_mem_pageable(vm_record_size, nsubvols,
+                                             "vol mol")) == NULL)
     mcell_allocfailed("Failed to create memory pool for volume molecules.");
-  if ((shared_mem->smol = create_mem_named(sizeof(struct surface_molecule),
-                                           nsubvols, "surface mol")) == NULL)
+  if ((shared_mem->smol = create_mem_pageable(sm_record_size, nsubvols,
+                                              "surface mol")) == NULL)
     mcell_allocfailed("Failed to create memory pool for surface molecules.");
-  if ((shared_mem->face =
-           create_mem_named(sizeof(struct wall), nsubvols, "wall")) == NULL)
+  if ((shared_mem->face = create_mem_pageable(sizeof(struct wall), nsubvols,
+                                              "wall")) == NULL)
     mcell_allocfailed("Failed to create memory pool for walls.");
-  if ((shared_mem->join =
-           create_mem_named(sizeof(struct edge), nsubvols, "edge")) == NULL)
+  if ((shared_mem->join = create_mem_pageable(sizeof(struct edge), nsubvols,
+                                              "edge")) == NULL)
     mcell_allocfailed("Failed to create memory pool for edges.");
-  if ((shared_mem->grids = create_mem_named(sizeof(struct surface_grid),
-                                            nsubvols, "surface grid")) == NULL)
+  if ((shared_mem->grids = create_mem_pageable(
+           sizeof(struct surface_grid), nsubvols, "surface grid")) == NULL)
     mcell_allocfailed("Failed to create memory pool for surface grids.");
-  if ((shared_mem->regl = create_mem_named(sizeof(struct region_list), nsubvols,
-                                           "region list")) == NULL)
+  if ((shared_mem->regl = create_mem_pageable(sizeof(struct region_list),
+                                              nsubvols, "region list")) == NULL)
     mcell_allocfailed("Failed to create memory pool for region lists.");
-  if ((shared_mem->pslv = create_mem_named(sizeof(struct per_species_list), 32,
-                                           "per species list")) == NULL)
+  if ((shared_mem->pslv = create_mem_pageable(
+           sizeof(struct per_species_list), 32, "per species list")) == NULL)
     mcell_allocfailed(
         "Failed to create memory pool for per-species molecule lists.");
-  shared_mem->coll = world->coll_mem;
-  shared_mem->sp_coll = world->sp_coll_mem;
-  shared_mem->tri_coll = world->tri_coll_mem;
-  shared_mem->exdv = world->exdv_mem;
+  if (world->num_threads > 1 || world->n_procs > 1) {
+    /* Storages may be run concurrently or on other ranks, so each one needs
+     * its own scratch pools, random number stream and hand-off queue. */
+    if ((shared_mem->coll = create_arena_named(sizeof(struct collision), 128,
+                                               "collision")) == NULL)
+      mcell_allocfailed("Failed to create memory pool for collisions.");
+    if ((shared_mem->sp_coll = create_arena_named(sizeof(struct sp_collision),
+                                                  128, "sp collision")) == NULL)
+      mcell_allocfailed(
+          "Failed to create memory pool for trimolecular-pathway collisions.");
+    if ((shared_mem->tri_coll = create_arena_named(
+             sizeof(struct tri_collision), 128, "tri collision")) == NULL)
+      mcell_allocfailed(
+          "Failed to create memory pool for trimolecular collisions.");
+    if ((shared_mem->exdv = create_mem_named(sizeof(struct exd_vertex), 64,
+                                             "exact disk vertex")) == NULL)
+      mcell_allocfailed("Failed to create memory pool for exact disk "
+                        "calculation vertices.");
+    if ((shared_mem->handoff_mem = create_mem_named(
+             sizeof(struct storage_handoff), 64, "storage hand-off")) == NULL)
+      mcell_allocfailed("Failed to create memory pool for storage hand-offs.");
+    shared_mem->rng = CHECKED_MALLOC_STRUCT(struct rng_state,
+                                            "storage random number generator");
+  } else {
+    shared_mem->coll = world->coll_mem;
+    shared_mem->sp_coll = world->sp_coll_mem;
+    shared_mem->tri_coll = world->tri_coll_mem;
+    shared_mem->exdv = world->exdv_mem;
+  }
 
   if (world->chkpt_init) {
     if ((shared_mem->timer = create_scheduler(1.0, 100.0, 100, 0.0)) == NULL)
@@ -1321,6 +1565,397 @@ static struct storage *create_storage(struct volume *world, int nsubvols) {
   return shared_mem;
 }
 
+/* Estimated working set of a storage that memory-partition auto-tuning
+ * aims to fit in, when the cache size can't be queried */
+#define AUTO_PARTITION_CACHE_BYTES (1024 * 1024)
+
+/*************************************************************************
+subvolume_index_of:
+  In: world
+      point
+  Out: index of the subvolume containing the point, clamped to the world
+*************************************************************************/
+static int subvolume_index_of(struct volume *world, struct vector3 const *v) {
+  int i = bisect(world->x_partitions, world->nx_parts, v->x);
+  int j = bisect(world->y_partitions, world->ny_parts, v->y);
+  int k = bisect(world->z_partitions, world->nz_parts, v->z);
+  if (i > world->nx_parts - 2)
+    i = world->nx_parts - 2;
+  if (j > world->ny_parts - 2)
+    j = world->ny_parts - 2;
+  if (k > world->nz_parts - 2)
+    k = world->nz_parts - 2;
+  return k + (world->nz_parts - 1) * (j + (world->ny_parts - 1) * i);
+}
+
+/*************************************************************************
+transform_point:
+  In: point in an object's coordinates
+      transformation matrix of the object
+  Out: the point in world coordinates
+*************************************************************************/
+static struct vector3 transform_point(struct vector3 const *pv,
+                                      double (*tm)[4]) {
+  double p[1][4];
+  p[0][0] = pv->x;
+  p[0][1] = pv->y;
+  p[0][2] = pv->z;
+  p[0][3] = 1.0;
+  mult_matrix(p, tm, p, 1, 4, 4);
+  struct vector3 v = { p[0][0], p[0][1], p[0][2] };
+  return v;
+}
+
+/* Minimum number of vertices transformed by one task of
+   object_world_vertices */
+#define VERTS_PER_TRANSFORM_TASK 16384
+
+/* Transformation of one object's parsed vertices, one chunk per task */
+struct vertex_transform_pass {
+  struct vector3 const *in;
+  struct vector3 *out;
+  double (*tm)[4];
+  int n_verts;
+  struct vector3 *llf; /* Bounding box of each chunk */
+  struct vector3 *urb;
+};
+
+static void transform_vertices_task(void *ctx, int task) {
+  struct vertex_transform_pass *pass = (struct vertex_transform_pass *)ctx;
+  double(*tm)[4] = pass->tm;
+  int end = (task + 1) * VERTS_PER_TRANSFORM_TASK;
+  if (end > pass->n_verts)
+    end = pass->n_verts;
+
+  /* Same sums, in the same order, as mult_matrix on (x, y, z, 1) */
+  struct vector3 llf = { DBL_MAX, DBL_MAX, DBL_MAX };
+  struct vector3 urb = { -DBL_MAX, -DBL_MAX, -DBL_MAX };
+  for (int i = task * VERTS_PER_TRANSFORM_TASK; i < end; i++) {
+    struct vector3 const *pv = &pass->in[i];
+    struct vector3 *v = &pass->out[i];
+    v->x = pv->x * tm[0][0] + pv->y * tm[1][0] + pv->z * tm[2][0] + tm[3][0];
+    v->y = pv->x * tm[0][1] + pv->y * tm[1][1] + pv->z * tm[2][1] + tm[3][1];
+    v->z = pv->x * tm[0][2] + pv->y * tm[1][2] + pv->z * tm[2][2] + tm[3][2];
+    if (v->x < llf.x)
+      llf.x = v->x;
+    if (v->y < llf.y)
+      llf.y = v->y;
+    if (v->z < llf.z)
+      llf.z = v->z;
+    if (v->x > urb.x)
+      urb.x = v->x;
+    if (v->y > urb.y)
+      urb.y = v->y;
+    if (v->z > urb.z)
+      urb.z = v->z;
+  }
+  pass->llf[task] = llf;
+  pass->urb[task] = urb;
+}
+
+/*************************************************************************
+object_world_vertices:
+  In: world
+      polygon or box object
+      transformation matrix of the object
+  Out: the parsed vertices of the object in world coordinates, or NULL if
+       they are gone.  The array and its bounding box (objp->world_llf and
+       objp->world_urb) are computed once per transformation, in chunks on
+       the world's thread pool, and reused by the bounding box, partitioning
+       and vertex passes that follow.  They are freed along with the parsed
+       vertices by instance_polygon_object().
+*************************************************************************/
+static struct vector3 const *object_world_vertices(struct volume *world,
+                                                   struct object *objp,
+                                                   double (*tm)[4]) {
+  struct polygon_object *pop = (struct polygon_object *)objp->contents;
+  if (objp->world_verts != NULL &&
+      memcmp(objp->world_verts_matrix, tm, sizeof(objp->world_verts_matrix)) ==
+          0)
+    return objp->world_verts;
+  if (pop->parsed_vertices == NULL)
+    return NULL;
+
+  if (objp->world_verts == NULL)
+    objp->world_verts = CHECKED_MALLOC_ARRAY(
+        struct vector3, pop->n_verts, "polygon vertices in world coordinates");
+  memcpy(objp->world_verts_matrix, tm, sizeof(objp->world_verts_matrix));
+
+  int n_tasks =
+      (pop->n_verts + VERTS_PER_TRANSFORM_TASK - 1) / VERTS_PER_TRANSFORM_TASK;
+  struct vertex_transform_pass pass;
+  pass.in = pop->parsed_vertices;
+  pass.out = objp->world_verts;
+  pass.tm = tm;
+  pass.n_verts = pop->n_verts;
+  pass.llf = CHECKED_MALLOC_ARRAY(struct vector3, n_tasks + 1,
+                                  "vertex transformation bounding boxes");
+  pass.urb = CHECKED_MALLOC_ARRAY(struct vector3, n_tasks + 1,
+                                  "vertex transformation bounding boxes");
+  struct thread_pool *pool = (n_tasks > 1) ? world_thread_pool(world) : NULL;
+  if (pool != NULL)
+    thread_pool_run(pool, n_tasks, transform_vertices_task, &pass);
+  else {
+    for (int task = 0; task < n_tasks; ++task)
+      transform_vertices_task(&pass, task);
+  }
+
+  objp->world_llf = (struct vector3) { DBL_MAX, DBL_MAX, DBL_MAX };
+  objp->world_urb = (struct vector3) { -DBL_MAX, -DBL_MAX, -DBL_MAX };
+  for (int task = 0; task < n_tasks; ++task) {
+    if (pass.llf[task].x < objp->world_llf.x)
+      objp->world_llf.x = pass.llf[task].x;
+    if (pass.llf[task].y < objp->world_llf.y)
+      objp->world_llf.y = pass.llf[task].y;
+    if (pass.llf[task].z < objp->world_llf.z)
+      objp->world_llf.z = pass.llf[task].z;
+    if (pass.urb[task].x > objp->world_urb.x)
+      objp->world_urb.x = pass.urb[task].x;
+    if (pass.urb[task].y > objp->world_urb.y)
+      objp->world_urb.y = pass.urb[task].y;
+    if (pass.urb[task].z > objp->world_urb.z)
+      objp->world_urb.z = pass.urb[task].z;
+  }
+  free(pass.llf);
+  free(pass.urb);
+  return objp->world_verts;
+}
+
+/*************************************************************************
+estimate_release_bytes:
+  In: world
+      release site object
+      transformation matrix of the release site
+      array of estimated bytes per subvolume
+  Out: No return value.  The molecules released by a fixed-number release
+       are added to the subvolumes around the release site, spread evenly
+       over its diameter.  Releases whose size isn't known before the
+       geometry exists (concentrations, regions) are left out.
+*************************************************************************/
+static void estimate_release_bytes(struct volume *world,
+                                   struct release_site_obj *rso,
+                                   double (*tm)[4], double *sv_bytes) {
+  const double mol_bytes = (double)sizeof(struct volume_molecule);
+
+  /* The positions in a list file are only read when it is released */
+  if (rso->mol_list != NULL || rso->mol_file != NULL) {
+    for (struct release_single_molecule *rsm = rso->mol_list; rsm != NULL;
+         rsm = rsm->next) {
+      struct vector3 loc = { rsm->loc.x + rso->location->x,
+                             rsm->loc.y + rso->location->y,
+                             rsm->loc.z + rso->location->z };
+      struct vector3 v = transform_point(&loc, tm);
+      sv_bytes[subvolume_index_of(world, &v)] += mol_bytes;
+    }
+    return;
+  }
+  if (rso->release_number_method != CONSTNUM || rso->location == NULL ||
+      rso->release_shape == SHAPE_REGION || rso->release_number <= 0)
+    return;
+
+  struct vector3 llf = *rso->location, urb = *rso->location;
+  if (rso->diameter != NULL) {
+    llf.x -= 0.5 * rso->diameter->x;
+    llf.y -= 0.5 * rso->diameter->y;
+    llf.z -= 0.5 * rso->diameter->z;
+    urb.x += 0.5 * rso->diameter->x;
+    urb.y += 0.5 * rso->diameter->y;
+    urb.z += 0.5 * rso->diameter->z;
+  }
+  struct vector3 a = transform_point(&llf, tm);
+  struct vector3 b = transform_point(&urb, tm);
+  int lo = subvolume_index_of(world, &a), hi = subvolume_index_of(world, &b);
+
+  /* Unpack the subvolume indices into per-axis ranges */
+  int nyz = (world->ny_parts - 1) * (world->nz_parts - 1);
+  int nz = world->nz_parts - 1;
+  int i0 = lo / nyz, j0 = (lo / nz) % (world->ny_parts - 1), k0 = lo % nz;
+  int i1 = hi / nyz, j1 = (hi / nz) % (world->ny_parts - 1), k1 = hi % nz;
+  if (i1 < i0) {
+    int t = i0;
+    i0 = i1;
+    i1 = t;
+  }
+  if (j1 < j0) {
+    int t = j0;
+    j0 = j1;
+    j1 = t;
+  }
+  if (k1 < k0) {
+    int t = k0;
+    k0 = k1;
+    k1 = t;
+  }
+
+  double share = rso->release_number * mol_bytes /
+                 ((double)(i1 - i0 + 1) * (j1 - j0 + 1) * (k1 - k0 + 1));
+  for (int i = i0; i <= i1; i++)
+    for (int j = j0; j <= j1; j++)
+      for (int k = k0; k <= k1; k++)
+        sv_bytes[k + nz * (j + (world->ny_parts - 1) * i)] += share;
+}
+
+/*************************************************************************
+estimate_subvolume_bytes:
+  In: world
+      object
+      transformation matrix of the object's parent
+      array of estimated bytes per subvolume
+  Out: No return value.  The walls of the object and its children are
+       added to the subvolumes holding their vertices, and the molecules
+       of its release sites to the subvolumes they are released into.
+*************************************************************************/
+static void estimate_subvolume_bytes(struct volume *world,
+                                     struct object *objp, double (*im)[4],
+                                     double *sv_bytes) {
+  double tm[4][4];
+  mult_matrix(objp->t_matrix, im, tm, 4, 4, 4);
+
+  switch (objp->object_type) {
+  case META_OBJ:
+    for (struct object *child_objp = objp->first_child; child_objp != NULL;
+         child_objp = child_objp->next)
+      estimate_subvolume_bytes(world, child_objp, tm, sv_bytes);
+    break;
+
+  case REL_SITE_OBJ:
+    estimate_release_bytes(world, (struct release_site_obj *)objp->contents,
+                           tm, sv_bytes);
+    break;
+
+  case BOX_OBJ:
+  case POLY_OBJ: {
+    struct polygon_object *pop = (struct polygon_object *)objp->contents;
+    if (pop->n_verts == 0)
+      break;
+    struct vector3 const *verts = object_world_vertices(world, objp, tm);
+    if (verts == NULL)
+      break;
+    double vertex_bytes = (double)pop->n_walls / pop->n_verts *
+                          (sizeof(struct wall) + sizeof(struct wall_list));
+    for (int i = 0; i < pop->n_verts; i++)
+      sv_bytes[subvolume_index_of(world, &verts[i])] += vertex_bytes;
+  } break;
+
+  case VOXEL_OBJ:
+  default:
+    break;
+  }
+}
+
+/*************************************************************************
+largest_partition_bytes:
+  In: world
+      summed-volume table of estimated bytes per subvolume
+      memory partition size along each axis, in subvolumes
+  Out: the estimated bytes held by the fullest memory partition
+*************************************************************************/
+static double largest_partition_bytes(struct volume *world, double *sum,
+                                      int px, int py, int pz) {
+  int nx = world->nx_parts - 1, ny = world->ny_parts - 1,
+      nz = world->nz_parts - 1;
+#define SUM(i, j, k) sum[(k) + (nz + 1) * ((j) + (ny + 1) * (i))]
+  double largest = 0;
+  for (int i0 = 0; i0 < nx; i0 += px) {
+    int i1 = (i0 + px < nx) ? i0 + px : nx;
+    for (int j0 = 0; j0 < ny; j0 += py) {
+      int j1 = (j0 + py < ny) ? j0 + py : ny;
+      for (int k0 = 0; k0 < nz; k0 += pz) {
+        int k1 = (k0 + pz < nz) ? k0 + pz : nz;
+        double b = SUM(i1, j1, k1) - SUM(i0, j1, k1) - SUM(i1, j0, k1) -
+                   SUM(i1, j1, k0) + SUM(i0, j0, k1) + SUM(i0, j1, k0) +
+                   SUM(i1, j0, k0) - SUM(i0, j0, k0);
+        if (b > largest)
+          largest = b;
+      }
+    }
+  }
+#undef SUM
+  return largest;
+}
+
+/*************************************************************************
+auto_tune_memory_partitions:
+  In: world, with its spatial partitions set
+  Out: No return value.  mem_part_x/y/z are set to the largest cubic
+       memory partitions whose estimated contents fit in the L2 cache, and
+       small enough that there are a few partitions per worker thread.
+       The estimate counts each subvolume, the walls of the objects in it
+       and the molecules fixed-number releases put there.  The chosen
+       layout is reported.
+*************************************************************************/
+static void auto_tune_memory_partitions(struct volume *world) {
+  int nx = world->nx_parts - 1, ny = world->ny_parts - 1,
+      nz = world->nz_parts - 1;
+  int n_subvols = nx * ny * nz;
+
+  double *sv_bytes = CHECKED_MALLOC_ARRAY(double, n_subvols,
+                                          "subvolume occupancy estimates");
+  for (int h = 0; h < n_subvols; h++)
+    sv_bytes[h] = sizeof(struct subvolume);
+  double tm[4][4];
+  init_matrix(tm);
+  estimate_subvolume_bytes(world, world->root_instance, tm, sv_bytes);
+
+  /* Summed-volume table, so each partition's total is a few lookups */
+  double *sum = CHECKED_MALLOC_ARRAY(double, (nx + 1) * (ny + 1) * (nz + 1),
+                                     "subvolume occupancy sums");
+#define SUM(i, j, k) sum[(k) + (nz + 1) * ((j) + (ny + 1) * (i))]
+  for (int i = 0; i <= nx; i++)
+    for (int j = 0; j <= ny; j++)
+      for (int k = 0; k <= nz; k++) {
+        if (i == 0 || j == 0 || k == 0) {
+          SUM(i, j, k) = 0;
+          continue;
+        }
+        SUM(i, j, k) = sv_bytes[(k - 1) + nz * ((j - 1) + ny * (i - 1))] +
+                       SUM(i - 1, j, k) + SUM(i, j - 1, k) + SUM(i, j, k - 1) -
+                       SUM(i - 1, j - 1, k) - SUM(i - 1, j, k - 1) -
+                       SUM(i, j - 1, k - 1) + SUM(i - 1, j - 1, k - 1);
+      }
+#undef SUM
+  free(sv_bytes);
+
+  double budget = AUTO_PARTITION_CACHE_BYTES;
+#ifdef _SC_LEVEL2_CACHE_SIZE
+  long l2 = sysconf(_SC_LEVEL2_CACHE_SIZE);
+  if (l2 > 0)
+    budget = (double)l2;
+#endif
+  int min_partitions = (world->num_threads > 1) ? 4 * world->num_threads : 1;
+
+  int side = nx;
+  if (ny > side)
+    side = ny;
+  if (nz > side)
+    side = nz;
+  double largest = 0;
+  for (; side > 1; side--) {
+    int px = (side < nx) ? side : nx, py = (side < ny) ? side : ny,
+        pz = (side < nz) ? side : nz;
+    int n_parts = ((nx + px - 1) / px) * ((ny + py - 1) / py) *
+                  ((nz + pz - 1) / pz);
+    if (n_parts < min_partitions)
+      continue;
+    largest = largest_partition_bytes(world, sum, px, py, pz);
+    if (largest <= budget)
+      break;
+  }
+  if (side == 1)
+    largest = largest_partition_bytes(world, sum, 1, 1, 1);
+  free(sum);
+
+  world->mem_part_x = (side < nx) ? side : nx;
+  world->mem_part_y = (side < ny) ? side : ny;
+  world->mem_part_z = (side < nz) ? side : nz;
+  if (world->notify->progress_report != NOTIFY_NONE)
+    mcell_log("Memory partitions chosen automatically: %d,%d,%d subvolumes "
+              "per partition, the fullest holding about %.0f KB of a %.0f KB "
+              "cache.",
+              world->mem_part_x, world->mem_part_y, world->mem_part_z,
+              largest / 1024, budget / 1024);
+}
+
 static void sanity_check_memory_subdivision(struct volume *world) {
   if (world->mem_part_x <= 0) {
     if (world->mem_part_x < 0) {
@@ -1348,6 +1983,124 @@ static void sanity_check_memory_subdivision(struct volume *world) {
   }
 }
 
+/* Bytes at the start of each memory pool of a storage that the thread
+ * creating the storage touches, see create_storage_task */
+#define STORAGE_FIRST_TOUCH_BYTES (256 * 1024)
+
+/* Creation of the storages of init_partitions, one storage per task */
+struct storage_init_pass {
+  struct volume *world;
+  struct storage **stores; /* In creation order */
+  int nx, ny, nz;          /* Storages per axis */
+  int n_stores;
+};
+
+/********************************************************************
+ create_storage_task:
+
+    Create one storage of init_partitions on a thread of the pool, and
+    touch the start of its memory pools so that their pages are local to
+    that thread.  Task t creates the storage that ends up at position t of
+    world->storage_head, which is the task run_storages_threaded hands it
+    to, so that before any work is stolen each storage is run by the thread
+    whose memory node holds it.
+
+    In:  void *ctx - the storage_init_pass
+         int task - position of the storage in the storage list
+    Out: the storage is stored in its creation slot of the pass
+ *******************************************************************/
+static void create_storage_task(void *ctx, int task) {
+  struct storage_init_pass *pass = (struct storage_init_pass *)ctx;
+  struct volume *world = pass->world;
+  int i = pass->n_stores - 1 - task;
+  int cx = i % pass->nx;
+  int cy = (i / pass->nx) % pass->ny;
+  int cz = i / (pass->nx * pass->ny);
+
+  /* Determine the number of subvolumes included in this subdivision */
+  int xd = world->mem_part_x, yd = world->mem_part_y, zd = world->mem_part_z;
+  if (cx == pass->nx - 1)
+    xd = (world->nx_parts - 1) % world->mem_part_x;
+  if (cy == pass->ny - 1)
+    yd = (world->ny_parts - 1) % world->mem_part_y;
+  if (cz == pass->nz - 1)
+    zd = (world->nz_parts - 1) % world->mem_part_z;
+
+  /* Allocate this storage */
+  struct storage *store = create_storage(world, xd * yd * zd);
+  if (store == NULL)
+    mcell_internal_error("Unknown error while creating a storage.");
+  store->home_thread = thread_pool_current_thread();
+  store->home_node = thread_current_node();
+
+  /* Walls, edges and the first molecules are stored by the main thread
+   * during initialization and releases, which would otherwise place the
+   * pages on its node */
+  if (world->num_threads > 1) {
+    struct mem_helper *pools[] = { store->list, store->mol,  store->smol,
+                                   store->face, store->join, store->grids,
+                                   store->regl, store->pslv };
+    for (size_t p = 0; p < COUNT_OF(pools); ++p)
+      mem_first_touch(pools[p], STORAGE_FIRST_TOUCH_BYTES);
+  }
+
+  /* Give each storage its own reproducible random number stream */
+  if (store->rng != NULL)
+    rng_init_stream(store->rng, world->seed_seq, (u_int)(i + 1));
+
+  pass->stores[i] = store;
+}
+
+/********************************************************************
+ init_neighbor_reach:
+
+    Fill in the neighboring subvolumes searched by expand_collision_list and
+    expand_collision_partner_list for each mask of Direction Bit Flags.
+    The offsets within the subvolume array are the same for all subvolumes,
+    and the directions at the edge of the world are masked out with
+    world_edge before the table is used.  The neighbors are listed in the
+    order those functions always searched them: +X, -X and then the
+    current X layer, each as the face, the +Y and -Y edges with their
+    corners, and the +Z and -Z edges.
+
+    In:  struct volume *world - the simulation state
+    Out: world->neighbor_reach and world->neighbor_reach_start are set
+ *******************************************************************/
+static void init_neighbor_reach(struct volume *world) {
+  static const signed char x_order[3] = { 1, -1, 0 };
+  static const signed char yz_order[9][2] = {
+    { 0, 0 }, { 1, 0 }, { 1, 1 }, { 1, -1 }, { -1, 0 },
+    { -1, 1 }, { -1, -1 }, { 0, 1 }, { 0, -1 }
+  };
+  int stride[3] = { (world->nz_parts - 1) * (world->ny_parts - 1),
+                    world->nz_parts - 1, 1 };
+  int n = 0;
+  for (int mask = 0; mask < NEIGHBOR_REACH_MASKS; mask++) {
+    world->neighbor_reach_start[mask] = n;
+    for (int i = 0; i < 3; i++)
+      for (int j = 0; j < 9; j++) {
+        signed char dir[3] = { x_order[i], yz_order[j][0], yz_order[j][1] };
+        if (dir[0] == 0 && dir[1] == 0 && dir[2] == 0)
+          continue;
+        int offset = 0, reached = 1;
+        for (int axis = 0; axis < 3; axis++) {
+          /* X_NEG_BIT, X_POS_BIT, Y_NEG_BIT, ... in this order */
+          int bit = 1 << (2 * axis + (dir[axis] > 0));
+          if (dir[axis] != 0 && !(mask & bit))
+            reached = 0;
+          offset += dir[axis] * stride[axis];
+        }
+        if (!reached)
+          continue;
+        world->neighbor_reach[n].offset = offset;
+        memcpy(world->neighbor_reach[n].dir, dir, sizeof(dir));
+        n++;
+      }
+  }
+  world->neighbor_reach_start[NEIGHBOR_REACH_MASKS] = n;
+  assert(n == NEIGHBOR_REACH_TOTAL);
+}
+
 /********************************************************************
  init_partitions:
 
@@ -1409,22 +2162,29 @@ int init_partitions(struct volume *world) {
   if (world->notify->progress_report != NOTIFY_NONE)
     mcell_log("Creating %d subvolumes (%d,%d,%d per axis).", world->n_subvols,
               world->nx_parts - 1, world->ny_parts - 1, world->nz_parts - 1);
-  world->subvol = CHECKED_MALLOC_ARRAY(struct subvolume, world->n_subvols,
-                                       "spatial subvolumes");
+  int huge;
+  world->subvol = (struct subvolume *)mem_alloc_large(
+      world->n_subvols * sizeof(struct subvolume), &huge);
+  if (world->subvol == NULL)
+    mcell_allocfailed("Failed to allocate spatial subvolumes.");
+  if (world->use_huge_pages && world->notify->progress_report != NOTIFY_NONE)
+    mcell_log("Spatial subvolumes are %son huge pages.", huge ? "" : "not ");
 
   /* Decide how fine-grained to make the memory subdivisions */
+  if (world->mem_part_auto)
+    auto_tune_memory_partitions(world);
   sanity_check_memory_subdivision(world);
 
   /* Allocate the data structures which are shared between storages */
-  if ((world->coll_mem = create_mem_named(sizeof(struct collision), 128,
-                                          "collision")) == NULL)
+  if ((world->coll_mem = create_arena_named(sizeof(struct collision), 128,
+                                            "collision")) == NULL)
     mcell_allocfailed("Failed to create memory pool for collisions.");
-  if ((world->sp_coll_mem = create_mem_named(sizeof(struct sp_collision), 128,
-                                             "sp collision")) == NULL)
+  if ((world->sp_coll_mem = create_arena_named(sizeof(struct sp_collision),
+                                               128, "sp collision")) == NULL)
     mcell_allocfailed(
         "Failed to create memory pool for trimolecular-pathway collisions.");
-  if ((world->tri_coll_mem = create_mem_named(sizeof(struct tri_collision), 128,
-                                              "tri collision")) == NULL)
+  if ((world->tri_coll_mem = create_arena_named(sizeof(struct tri_collision),
+                                                128, "tri collision")) == NULL)
     mcell_allocfailed(
         "Failed to create memory pool for trimolecular collisions.");
   if ((world->exdv_mem = create_mem_named(sizeof(struct exd_vertex), 64,
@@ -1448,28 +2208,17 @@ int init_partitions(struct volume *world) {
 
   /* Allocate the storages */
   struct storage *shared_mem[nx * ny * nz];
-  int cx = 0, cy = 0, cz = 0;
-  for (int i = 0; i < nx * ny * nz; ++i) {
-    /* Determine the number of subvolumes included in this subdivision */
-    int xd = world->mem_part_x, yd = world->mem_part_y, zd = world->mem_part_z;
-    if (cx == nx - 1)
-      xd = (world->nx_parts - 1) % world->mem_part_x;
-    if (cy == ny - 1)
-      yd = (world->ny_parts - 1) % world->mem_part_y;
-    if (cz == nz - 1)
-      zd = (world->nz_parts - 1) % world->mem_part_z;
-    if (++cx == nx) {
-      cx = 0;
-      if (++cy == ny) {
-        cy = 0;
-        ++cz;
-      }
-    }
-
-    /* Allocate this storage */
-    if ((shared_mem[i] = create_storage(world, xd * yd * zd)) == NULL)
-      mcell_internal_error("Unknown error while creating a storage.");
+  struct storage_init_pass pass;
+  pass.world = world;
+  pass.stores = shared_mem;
+  pass.nx = nx;
+  pass.ny = ny;
+  pass.nz = nz;
+  pass.n_stores = nx * ny * nz;
+  thread_pool_run((world->num_threads > 1) ? world_thread_pool(world) : NULL,
+                  pass.n_stores, create_storage_task, &pass);
 
+  for (int i = 0; i < nx * ny * nz; ++i) {
     /* Add to the storage list */
     struct storage_list *l = (struct storage_list *)CHECKED_MEM_GET(
         world->storage_allocator, "storage list item");
@@ -1485,9 +2234,11 @@ int init_partitions(struct volume *world) {
         int h = k + (world->nz_parts - 1) * (j + (world->ny_parts - 1) * i);
         struct subvolume *sv = &(world->subvol[h]);
         sv->wall_head = NULL;
+        memset(&sv->wall_planes, 0, sizeof(struct wall_planes));
         memset(&sv->mol_by_species, 0, sizeof(struct pointer_hash));
         sv->species_head = NULL;
         sv->mol_count = 0;
+        sv->step_multiplier = 1;
 
         sv->llf.x = bisect_near(world->x_fineparts, world->n_fineparts,
                                 world->x_partitions[i]);
@@ -1525,6 +2276,8 @@ int init_partitions(struct volume *world) {
             nx * (j / (world->mem_part_y) + ny * (k / (world->mem_part_z)));
         sv->local_storage = shared_mem[shidx];
       }
+
+  init_neighbor_reach(world);
   return 0;
 }
 
@@ -1591,7 +2344,8 @@ int init_bounding_box(struct volume *world) {
  * instance_polygon_object() to handle the actual instantiation of
  * those objects.
  */
-int instance_obj(struct volume *world, struct object *objp, double (*im)[4]) {
+int instance_obj(struct volume *world, struct object *objp, double (*im)[4],
+                 struct thread_pool *pool) {
   double tm[4][4];
   mult_matrix(objp->t_matrix, im, tm, 4, 4, 4);
 
@@ -1599,7 +2353,7 @@ int instance_obj(struct volume *world, struct object *objp, double (*im)[4]) {
   case META_OBJ:
     for (struct object *child_objp = objp->first_child; child_objp != NULL;
          child_objp = child_objp->next) {
-      if (instance_obj(world, child_objp, tm))
+      if (instance_obj(world, child_objp, tm, pool))
         return 1;
     }
     break;
@@ -1611,7 +2365,7 @@ int instance_obj(struct volume *world, struct object *objp, double (*im)[4]) {
 
   case BOX_OBJ:
   case POLY_OBJ:
-    if (instance_polygon_object(world->notify->degenerate_polys, objp))
+    if (instance_polygon_object(world->notify->degenerate_polys, objp, pool))
       return 1;
     break;
 
@@ -1684,7 +2438,6 @@ accumulate_vertex_counts_per_storage_polygon_object:
 int accumulate_vertex_counts_per_storage_polygon_object(
     struct volume *world, struct object *objp, int *num_vertices_this_storage,
     double (*im)[4]) {
-  struct vertex_list *vl;
   struct vector3 v;
   struct polygon_object *pop;
   /* index in the "simulated" array of storages that follows
@@ -1692,18 +2445,10 @@ int accumulate_vertex_counts_per_storage_polygon_object(
   int idx;
 
   pop = (struct polygon_object *)objp->contents;
+  struct vector3 const *verts = object_world_vertices(world, objp, im);
 
-  for (vl = pop->parsed_vertices; vl != NULL; vl = vl->next) {
-    double p[4][4];
-    p[0][0] = vl->vertex->x;
-    p[0][1] = vl->vertex->y;
-    p[0][2] = vl->vertex->z;
-    p[0][3] = 1.0;
-    mult_matrix(p, im, p, 1, 4, 4);
-
-    v.x = p[0][0];
-    v.y = p[0][1];
-    v.z = p[0][2];
+  for (int i = 0; i < pop->n_verts; i++) {
+    v = verts[i];
 
     idx = which_storage_contains_vertex(world, &v);
     if (idx < 0)
@@ -1802,7 +2547,6 @@ int fill_world_vertices_array_polygon_object(struct volume *world,
                                              double (*im)[4]) {
 
   struct polygon_object *pop;
-  struct vertex_list *vl;
   int cur_vtx = 0; /* index */
   int which_storage, where_in_array;
   struct vector3 *v, vv;
@@ -1812,17 +2556,10 @@ int fill_world_vertices_array_polygon_object(struct volume *world,
   objp->vertices =
       CHECKED_MALLOC_ARRAY(struct vector3 *, objp->n_verts, "polygon vertices");
 
-  for (vl = pop->parsed_vertices; vl != NULL; vl = vl->next) {
-    double p[4][4];
-    p[0][0] = vl->vertex->x;
-    p[0][1] = vl->vertex->y;
-    p[0][2] = vl->vertex->z;
-    p[0][3] = 1.0;
-    mult_matrix(p, im, p, 1, 4, 4);
+  struct vector3 const *verts = object_world_vertices(world, objp, im);
 
-    vv.x = p[0][0];
-    vv.y = p[0][1];
-    vv.z = p[0][2];
+  for (int i = 0; i < pop->n_verts; i++) {
+    vv = verts[i];
 
     which_storage = which_storage_contains_vertex(world, &vv);
     where_in_array = --num_vertices_this_storage[which_storage];
@@ -1999,42 +2736,176 @@ static int compute_bb_polygon_object(struct volume *world, struct object *objp,
                                      double (*im)[4]) {
 
   struct polygon_object *pop = (struct polygon_object *)objp->contents;
+  if (pop->n_verts == 0 || object_world_vertices(world, objp, im) == NULL)
+    return 0;
 
-  for (struct vertex_list *vl = pop->parsed_vertices;
-       vl != NULL;
-       vl = vl->next) {
-    double p[1][4];
-    p[0][0] = vl->vertex->x;
-    p[0][1] = vl->vertex->y;
-    p[0][2] = vl->vertex->z;
-    p[0][3] = 1.0;
-    mult_matrix(p, im, p, 1, 4, 4);
-    if (p[0][0] < world->bb_llf.x)
-      world->bb_llf.x = p[0][0];
-    if (p[0][1] < world->bb_llf.y)
-      world->bb_llf.y = p[0][1];
-    if (p[0][2] < world->bb_llf.z)
-      world->bb_llf.z = p[0][2];
-    if (p[0][0] > world->bb_urb.x)
-      world->bb_urb.x = p[0][0];
-    if (p[0][1] > world->bb_urb.y)
-      world->bb_urb.y = p[0][1];
-    if (p[0][2] > world->bb_urb.z)
-      world->bb_urb.z = p[0][2];
-  }
+  if (objp->world_llf.x < world->bb_llf.x)
+    world->bb_llf.x = objp->world_llf.x;
+  if (objp->world_llf.y < world->bb_llf.y)
+    world->bb_llf.y = objp->world_llf.y;
+  if (objp->world_llf.z < world->bb_llf.z)
+    world->bb_llf.z = objp->world_llf.z;
+  if (objp->world_urb.x > world->bb_urb.x)
+    world->bb_urb.x = objp->world_urb.x;
+  if (objp->world_urb.y > world->bb_urb.y)
+    world->bb_urb.y = objp->world_urb.y;
+  if (objp->world_urb.z > world->bb_urb.z)
+    world->bb_urb.z = objp->world_urb.z;
 
   return 0;
 }
 
+/**
+ * Adds weight w, spread evenly over [a, b], to a histogram of n_bins bins
+ * covering [lo, hi].  The part of [a, b] outside [lo, hi] is dropped.
+ * Used by compute_partition_density().
+ */
+static void add_partition_density(double *hist, int n_bins, double lo,
+                                  double hi, double a, double b, double w) {
+  if (!(hi > lo))
+    return;
+  double bin = (hi - lo) / n_bins;
+  double fa = (a - lo) / bin;
+  double fb = (b - lo) / bin;
+  if (fb - fa < 1.0) {
+    /* Narrower than a bin: treat as a point */
+    int i = (int)floor(0.5 * (fa + fb));
+    if (i >= 0 && i < n_bins)
+      hist[i] += w;
+    return;
+  }
+
+  double w_per_bin = w / (fb - fa);
+  int ia = (fa < 0.0) ? 0 : (int)floor(fa);
+  int ib = (fb > n_bins) ? n_bins : (int)ceil(fb);
+  for (int i = ia; i < ib; i++) {
+    double start = (fa > i) ? fa : i;
+    double end = (fb < i + 1) ? fb : i + 1;
+    hist[i] += w_per_bin * (end - start);
+  }
+}
+
+/**
+ * Adds the walls and geometrical release sites under an object to the
+ * partition density histograms.  Does things recursively in a manner similar
+ * to compute_bb().
+ * Used by compute_partition_density().
+ */
+static void compute_density(struct volume *world, struct object *objp,
+                            double (*im)[4], double *hist[3], int n_bins) {
+  double tm[4][4];
+  mult_matrix(objp->t_matrix, im, tm, 4, 4, 4);
+  double lo[3] = { world->bb_llf.x, world->bb_llf.y, world->bb_llf.z };
+  double hi[3] = { world->bb_urb.x, world->bb_urb.y, world->bb_urb.z };
+
+  switch (objp->object_type) {
+  case META_OBJ:
+    for (struct object *child_objp = objp->first_child; child_objp != NULL;
+         child_objp = child_objp->next)
+      compute_density(world, child_objp, tm, hist, n_bins);
+    break;
+
+  case REL_SITE_OBJ: {
+    /* Region releases follow their walls, which are already counted */
+    struct release_site_obj *rsop = (struct release_site_obj *)objp->contents;
+    if (rsop->release_shape == SHAPE_REGION || rsop->location == NULL)
+      break;
+
+    double p[1][4] = { { rsop->location->x, rsop->location->y,
+                         rsop->location->z, 1.0 } };
+    mult_matrix(p, tm, p, 1, 4, 4);
+    double diam[3] = { 0, 0, 0 };
+    if (rsop->diameter != NULL) {
+      diam[0] = rsop->diameter->x;
+      diam[1] = rsop->diameter->y;
+      diam[2] = rsop->diameter->z;
+    }
+    /* Only a fixed number tells us how many molecules end up here */
+    double w = 1.0;
+    if (rsop->release_number_method == CONSTNUM ||
+        rsop->release_number_method == GAUSSNUM)
+      w = (rsop->release_number > 1.0) ? rsop->release_number : 1.0;
+    for (int k = 0; k < 3; k++)
+      add_partition_density(hist[k], n_bins, lo[k], hi[k],
+                            p[0][k] - diam[k], p[0][k] + diam[k], w);
+  } break;
+
+  case BOX_OBJ:
+  case POLY_OBJ: {
+    struct polygon_object *pop = (struct polygon_object *)objp->contents;
+    struct vector3 const *verts = object_world_vertices(world, objp, tm);
+    if (verts == NULL)
+      break;
+    for (int i = 0; i < pop->n_verts; i++) {
+      double p[3] = { verts[i].x, verts[i].y, verts[i].z };
+      for (int k = 0; k < 3; k++)
+        add_partition_density(hist[k], n_bins, lo[k], hi[k], p[k], p[k], 1.0);
+    }
+  } break;
+
+  default:
+    break;
+  }
+}
+
+/**
+ * Computes, for each axis, a histogram of n_bins bins over the world
+ * bounding box of how crowded the world is: every wall vertex counts once,
+ * and every geometrical release site counts its number of molecules, spread
+ * over its extent.  Must be called after init_bounding_box() and before
+ * init_vertices_walls() frees the parsed vertices.
+ * Used by set_partitions() for adaptive partitioning.
+ */
+void compute_partition_density(struct volume *world, double *x_hist,
+                               double *y_hist, double *z_hist, int n_bins) {
+  double *hist[3] = { x_hist, y_hist, z_hist };
+  for (int k = 0; k < 3; k++)
+    memset(hist[k], 0, n_bins * sizeof(double));
+
+  double tm[4][4];
+  init_matrix(tm);
+  compute_density(world, world->root_instance, tm, hist, n_bins);
+}
+
+/* Minimum number of walls set up by one task of instance_polygon_object */
+#define WALLS_PER_INIT_TASK 4096
+
+/* Wall setup of one polygon object, one chunk of walls per task */
+struct wall_init_pass {
+  struct object *objp;
+  int n_walls;
+};
+
+static void init_walls_task(void *ctx, int task) {
+  struct wall_init_pass *pass = (struct wall_init_pass *)ctx;
+  struct object *objp = pass->objp;
+  struct polygon_object *pop = (struct polygon_object *)objp->contents;
+  int end = (task + 1) * WALLS_PER_INIT_TASK;
+  if (end > pass->n_walls)
+    end = pass->n_walls;
+
+  for (int n_wall = task * WALLS_PER_INIT_TASK; n_wall < end; ++n_wall) {
+    if (objp->wall_p[n_wall] == NULL)
+      continue;
+    int *vertex_index = pop->element[n_wall].vertex_index;
+    init_tri_wall(objp, n_wall, objp->vertices[vertex_index[0]],
+                  objp->vertices[vertex_index[1]],
+                  objp->vertices[vertex_index[2]]);
+  }
+}
+
 /**
  * Instantiates a polygon_object.
  * Creates walls from a template polygon_object or box object
  * as defined in the MDL file after applying the necessary geometric
  * transformations (scaling, rotation and translation).
  * <br>
+ * With a thread pool, the geometry of large objects is computed in chunks
+ * of walls on the pool.  Degenerate walls are then handled and the area is
+ * summed in wall order, as without one.
  */
 int instance_polygon_object(enum warn_level_t degenerate_polys,
-                            struct object *objp) {
+                            struct object *objp, struct thread_pool *pool) {
 
   int index_0, index_1, index_2;
   unsigned int degenerate_count;
@@ -2051,12 +2922,11 @@ int instance_polygon_object(enum warn_level_t degenerate_polys,
   objp->wall_p = wp;
 
   /* we do not need "parsed_vertices" info */
-  if (pop->parsed_vertices != NULL) {
-    free_vertex_list(pop->parsed_vertices);
-    pop->parsed_vertices = NULL;
-  }
+  free(pop->parsed_vertices);
+  pop->parsed_vertices = NULL;
+  free(objp->world_verts);
+  objp->world_verts = NULL;
 
-  degenerate_count = 0;
   for (int n_wall = 0; n_wall < n_walls; ++n_wall) {
     if (!get_bit(pop->side_removed, n_wall)) {
       wp[n_wall] = &w[n_wall];
@@ -2070,44 +2940,61 @@ int instance_polygon_object(enum warn_level_t degenerate_polys,
         mcell_error("object %s has elements with out of bounds vertex indices",
                     objp->sym->name);
       }
-
-      init_tri_wall(objp, n_wall, objp->vertices[index_0],
-                    objp->vertices[index_1], objp->vertices[index_2]);
-      total_area += wp[n_wall]->area;
-
-      if (!distinguishable(wp[n_wall]->area, 0, EPS_C)) {
-        if (degenerate_polys != WARN_COPE) {
-          if (degenerate_polys == WARN_ERROR) {
-            mcell_error("Degenerate polygon found: %s %d\n"
-                        "  Vertex 0: %.5e %.5e %.5e\n"
-                        "  Vertex 1: %.5e %.5e %.5e\n"
-                        "  Vertex 2: %.5e %.5e %.5e",
-                        objp->sym->name, n_wall, objp->vertices[index_0]->x,
-                        objp->vertices[index_0]->y, objp->vertices[index_0]->z,
-                        objp->vertices[index_1]->x, objp->vertices[index_1]->y,
-                        objp->vertices[index_1]->z, objp->vertices[index_2]->x,
-                        objp->vertices[index_2]->y, objp->vertices[index_2]->z);
-          } else
-            mcell_warn(
-                "Degenerate polygon found and automatically removed: %s %d\n"
-                "  Vertex 0: %.5e %.5e %.5e\n"
-                "  Vertex 1: %.5e %.5e %.5e\n"
-                "  Vertex 2: %.5e %.5e %.5e",
-                objp->sym->name, n_wall, objp->vertices[index_0]->x,
-                objp->vertices[index_0]->y, objp->vertices[index_0]->z,
-                objp->vertices[index_1]->x, objp->vertices[index_1]->y,
-                objp->vertices[index_1]->z, objp->vertices[index_2]->x,
-                objp->vertices[index_2]->y, objp->vertices[index_2]->z);
-        }
-        set_bit(pop->side_removed, n_wall, 1);
-        objp->n_walls_actual--;
-        degenerate_count++;
-        wp[n_wall] = NULL;
-      }
     } else {
       wp[n_wall] = NULL;
     }
   }
+
+  struct wall_init_pass pass;
+  pass.objp = objp;
+  pass.n_walls = n_walls;
+  int n_tasks = (n_walls + WALLS_PER_INIT_TASK - 1) / WALLS_PER_INIT_TASK;
+  if (pool != NULL)
+    thread_pool_run(pool, n_tasks, init_walls_task, &pass);
+  else {
+    for (int task = 0; task < n_tasks; ++task)
+      init_walls_task(&pass, task);
+  }
+
+  degenerate_count = 0;
+  for (int n_wall = 0; n_wall < n_walls; ++n_wall) {
+    if (wp[n_wall] == NULL)
+      continue;
+    total_area += wp[n_wall]->area;
+
+    if (!distinguishable(wp[n_wall]->area, 0, EPS_C)) {
+      index_0 = pop->element[n_wall].vertex_index[0];
+      index_1 = pop->element[n_wall].vertex_index[1];
+      index_2 = pop->element[n_wall].vertex_index[2];
+      if (degenerate_polys != WARN_COPE) {
+        if (degenerate_polys == WARN_ERROR) {
+          mcell_error("Degenerate polygon found: %s %d\n"
+                      "  Vertex 0: %.5e %.5e %.5e\n"
+                      "  Vertex 1: %.5e %.5e %.5e\n"
+                      "  Vertex 2: %.5e %.5e %.5e",
+                      objp->sym->name, n_wall, objp->vertices[index_0]->x,
+                      objp->vertices[index_0]->y, objp->vertices[index_0]->z,
+                      objp->vertices[index_1]->x, objp->vertices[index_1]->y,
+                      objp->vertices[index_1]->z, objp->vertices[index_2]->x,
+                      objp->vertices[index_2]->y, objp->vertices[index_2]->z);
+        } else
+          mcell_warn(
+              "Degenerate polygon found and automatically removed: %s %d\n"
+              "  Vertex 0: %.5e %.5e %.5e\n"
+              "  Vertex 1: %.5e %.5e %.5e\n"
+              "  Vertex 2: %.5e %.5e %.5e",
+              objp->sym->name, n_wall, objp->vertices[index_0]->x,
+              objp->vertices[index_0]->y, objp->vertices[index_0]->z,
+              objp->vertices[index_1]->x, objp->vertices[index_1]->y,
+              objp->vertices[index_1]->z, objp->vertices[index_2]->x,
+              objp->vertices[index_2]->y, objp->vertices[index_2]->z);
+      }
+      set_bit(pop->side_removed, n_wall, 1);
+      objp->n_walls_actual--;
+      degenerate_count++;
+      wp[n_wall] = NULL;
+    }
+  }
   if (degenerate_count)
     remove_gaps_from_regions(objp);
 
@@ -2194,6 +3081,119 @@ int instance_obj_regions(struct volume *world, struct object *objp) {
   return 0;
 }
 
+/**
+ * Gives walls of an object that are counted on the same regions the same
+ * counting_set, so that a surface molecule moving between them can be seen
+ * to change no counts with one comparison.  The counting_regions lists must
+ * already be sorted.
+ * Used by init_wall_regions().
+ */
+static void assign_counting_sets(struct object *objp) {
+  unsigned int mask = 1;
+  while (mask < 2 * (unsigned int)objp->n_walls)
+    mask <<= 1;
+  mask--;
+  struct wall **sets = CHECKED_MALLOC_ARRAY(struct wall *, mask + 1,
+                                            "counting region sets");
+  memset(sets, 0, (mask + 1) * sizeof(struct wall *));
+
+  for (int n_wall = 0; n_wall < objp->n_walls; n_wall++) {
+    struct wall *w = objp->wall_p[n_wall];
+    if (w == NULL)
+      continue;
+    w->counting_set = NULL;
+    if (w->counting_regions == NULL)
+      continue;
+
+    uintptr_t hash = 0;
+    for (struct region_list *rl = w->counting_regions; rl != NULL;
+         rl = rl->next)
+      hash = hash * 31 + ((uintptr_t)rl->reg >> 4);
+
+    for (unsigned int i = (unsigned int)hash & mask;; i = (i + 1) & mask) {
+      if (sets[i] == NULL) {
+        sets[i] = w;
+        w->counting_set = w->counting_regions;
+        break;
+      }
+      struct region_list *a = sets[i]->counting_regions;
+      struct region_list *b = w->counting_regions;
+      while (a != NULL && b != NULL && a->reg == b->reg) {
+        a = a->next;
+        b = b->next;
+      }
+      if (a == NULL && b == NULL) {
+        w->counting_set = sets[i]->counting_set;
+        break;
+      }
+    }
+  }
+  free(sets);
+}
+
+/* Whether two walls have the same surface classes, in any order.  A wall
+ * lists each of its classes once. */
+static int same_surface_classes(struct wall *a, struct wall *b) {
+  if (a->num_surf_classes != b->num_surf_classes)
+    return 0;
+  for (struct surf_class_list *sa = a->surf_class_head; sa != NULL;
+       sa = sa->next) {
+    struct surf_class_list *sb = b->surf_class_head;
+    while (sb != NULL && sb->surf_class != sa->surf_class)
+      sb = sb->next;
+    if (sb == NULL)
+      return 0;
+  }
+  return 1;
+}
+
+/**
+ * Checks the walls of an object with several surface classes for
+ * conflicting classes, checking each combination of classes only once.
+ * Walls of one region share its classes, so large meshes have few
+ * combinations.
+ * Used by init_wall_regions().
+ */
+static void check_wall_surface_classes(struct object *objp, int n_species,
+                                       struct species **species_list) {
+  const struct polygon_object *pop = (struct polygon_object *)objp->contents;
+  unsigned int mask = 1;
+  while (mask < 2 * (unsigned int)pop->n_walls)
+    mask <<= 1;
+  mask--;
+  struct wall **checked = NULL;
+
+  for (int n_wall = 0; n_wall < pop->n_walls; n_wall++) {
+    struct wall *w = objp->wall_p[n_wall];
+    if (get_bit(pop->side_removed, n_wall) || w->num_surf_classes <= 1)
+      continue;
+    if (checked == NULL) {
+      checked = CHECKED_MALLOC_ARRAY(struct wall *, mask + 1,
+                                     "surface class combinations");
+      memset(checked, 0, (mask + 1) * sizeof(struct wall *));
+    }
+
+    /* The same for every order of the classes */
+    uintptr_t hash = 0;
+    for (struct surf_class_list *scl = w->surf_class_head; scl != NULL;
+         scl = scl->next) {
+      uintptr_t h = (uintptr_t)scl->surf_class >> 4;
+      hash += h * 0x9E3779B1u ^ (h >> 15);
+    }
+
+    for (unsigned int i = (unsigned int)hash & mask;; i = (i + 1) & mask) {
+      if (checked[i] == NULL) {
+        check_for_conflicting_surface_classes(w, n_species, species_list);
+        checked[i] = w;
+        break;
+      }
+      if (same_surface_classes(checked[i], w))
+        break;
+    }
+  }
+  free(checked);
+}
+
 /**
  * Initialize data associated with wall regions.
  * This function is called during wall instantiation Pass #3
@@ -2274,71 +3274,64 @@ int init_wall_regions(double length_unit, struct ccn_clamp_data *clamp_list,
     }
 
     rp_borders_head = NULL;
-    int count = 0;
-
-    for (int n_wall = 0; n_wall < rp->membership->nbits; ++n_wall) {
-      if (get_bit(rp->membership, n_wall)) {
-        count++;
-      }
-    }
-    if (count == n_walls)
+    if (count_bits(rp->membership) == n_walls)
       rp->region_has_all_elements = 1;
 
-    for (int n_wall = 0; n_wall < rp->membership->nbits; ++n_wall) {
-      if (get_bit(rp->membership, n_wall)) {
-        /* prepend this region to wall region list of i_th wall only if the
-         * region is used in counting */
-        w = objp->wall_p[n_wall];
-
-        rp->area += w->area;
-        if (rp->surf_class != NULL) {
-          /* check whether this region's surface class is already
-             assigned to the wall's surface class list */
-          surf_class_present = 0;
-          for (scl = w->surf_class_head; scl != NULL; scl = scl->next) {
-            if (scl->surf_class == rp->surf_class) {
-              surf_class_present = 1;
-              break;
-            }
-          }
-          if (!surf_class_present) {
-            scl = CHECKED_MALLOC_STRUCT(struct surf_class_list,
-                                        "surf_class_list");
-            scl->surf_class = rp->surf_class;
-            if (w->surf_class_head == NULL) {
-              scl->next = NULL;
-              w->surf_class_head = scl;
-            } else {
-              scl->next = w->surf_class_head;
-              w->surf_class_head = scl;
-            }
-            w->num_surf_classes++;
+    for (int n_wall = next_set_bit(rp->membership, 0); n_wall >= 0;
+         n_wall = next_set_bit(rp->membership, n_wall + 1)) {
+      /* prepend this region to wall region list of i_th wall only if the
+       * region is used in counting */
+      w = objp->wall_p[n_wall];
+
+      rp->area += w->area;
+      if (rp->surf_class != NULL) {
+        /* check whether this region's surface class is already
+           assigned to the wall's surface class list */
+        surf_class_present = 0;
+        for (scl = w->surf_class_head; scl != NULL; scl = scl->next) {
+          if (scl->surf_class == rp->surf_class) {
+            surf_class_present = 1;
+            break;
+          }
+        }
+        if (!surf_class_present) {
+          scl = CHECKED_MALLOC_STRUCT(struct surf_class_list,
+                                      "surf_class_list");
+          scl->surf_class = rp->surf_class;
+          if (w->surf_class_head == NULL) {
+            scl->next = NULL;
+            w->surf_class_head = scl;
+          } else {
+            scl->next = w->surf_class_head;
+            w->surf_class_head = scl;
           }
+          w->num_surf_classes++;
+          free_wall_rx_cache(w);
         }
+      }
 
-        if ((rp->flags & COUNT_SOME_MASK) != 0) {
-          wrlp = (struct region_list *)CHECKED_MEM_GET(w->birthplace->regl,
-                                                       "wall region list");
-          wrlp->reg = rp;
-          wrlp->next = w->counting_regions;
-          w->counting_regions = wrlp;
-          w->flags |= rp->flags;
-        }
+      if ((rp->flags & COUNT_SOME_MASK) != 0) {
+        wrlp = (struct region_list *)CHECKED_MEM_GET(w->birthplace->regl,
+                                                     "wall region list");
+        wrlp->reg = rp;
+        wrlp->next = w->counting_regions;
+        w->counting_regions = wrlp;
+        w->flags |= rp->flags;
+      }
 
-        /* add edges of this wall to the region's edge list */
-        if ((strcmp(rp->region_last_name, "ALL") != 0) &&
-            (!(rp->region_has_all_elements))) {
-          for (int ii = 0; ii < 3; ii++) {
-            if ((el = CHECKED_MALLOC_STRUCT(struct edge_list, "edge_list")) ==
-                NULL) {
-              mcell_internal_error(
-                  "Out of memory while creating edge list for the region '%s'",
-                  rp->sym->name);
-            }
-            el->ed = w->edges[ii];
-            el->next = rp_borders_head;
-            rp_borders_head = el;
+      /* add edges of this wall to the region's edge list */
+      if ((strcmp(rp->region_last_name, "ALL") != 0) &&
+          (!(rp->region_has_all_elements))) {
+        for (int ii = 0; ii < 3; ii++) {
+          if ((el = CHECKED_MALLOC_STRUCT(struct edge_list, "edge_list")) ==
+              NULL) {
+            mcell_internal_error(
+                "Out of memory while creating edge list for the region '%s'",
+                rp->sym->name);
           }
+          el->ed = w->edges[ii];
+          el->next = rp_borders_head;
+          rp_borders_head = el;
         }
       }
     } /* end for */
@@ -2392,9 +3385,9 @@ int init_wall_regions(double length_unit, struct ccn_clamp_data *clamp_list,
       w->counting_regions = (struct region_list *)void_list_sort((
           struct void_list *)w->counting_regions); /* Helpful for comparisons */
     }
-    if (w->num_surf_classes > 1)
-      check_for_conflicting_surface_classes(w, n_species, species_list);
   }
+  check_wall_surface_classes(objp, n_species, species_list);
+  assign_counting_sets(objp);
 
   /* Check to see if we need to generate virtual regions for */
   /* concentration clamps on this object */
@@ -2429,6 +3422,7 @@ int init_wall_regions(double length_unit, struct ccn_clamp_data *clamp_list,
                   temp->n_sides = 0;
                   temp->side_idx = NULL;
                   temp->cum_area = NULL;
+                  temp->side_guide = NULL;
                   ccd->next_obj = temp;
                   ccd = temp;
                 }
@@ -2481,6 +3475,19 @@ int init_wall_regions(double length_unit, struct ccn_clamp_data *clamp_list,
         for (j = 1; j < ccd->n_sides; j++)
           ccd->cum_area[j] += ccd->cum_area[j - 1];
 
+        /* Cut points into the cumulative areas, so emitting a molecule
+         * only steps over a wall or two instead of bisecting them all */
+        ccd->side_guide = CHECKED_MALLOC_ARRAY(
+            int, ccd->n_sides, "concentration clamp polygon side guide");
+        double total_area = ccd->cum_area[ccd->n_sides - 1];
+        int side = 0;
+        for (j = 0; j < ccd->n_sides; j++) {
+          double cut = total_area * j / ccd->n_sides;
+          while (side < ccd->n_sides - 1 && ccd->cum_area[side] <= cut)
+            side++;
+          ccd->side_guide[j] = side;
+        }
+
         ccd->scaling_factor =
             ccd->cum_area[ccd->n_sides - 1] * length_unit *
             length_unit * length_unit /
@@ -2573,22 +3580,21 @@ int init_wall_surf_mols(struct volume *world, struct object *objp) {
     /* all_region = (strcmp(rp->region_last_name, "ALL") == 0); */
 
     /* Place molecules defined through DEFINE_SURFACE_REGIONS */
-    for (int n_wall = 0; n_wall < rp->membership->nbits; n_wall++) {
-      if (get_bit(rp->membership, n_wall)) {
-        /* prepend region sm data for this region to sm_prop for i_th wall */
-        for (smdp = rp->sm_dat_head; smdp != NULL; smdp = smdp->next) {
-          if (smdp->quantity_type == SURFMOLDENS) {
-            dup_smdp =
-                CHECKED_MALLOC_STRUCT(struct sm_dat, "surface molecule data");
-            dup_smdp->sm = smdp->sm;
-            dup_smdp->quantity_type = smdp->quantity_type;
-            dup_smdp->quantity = smdp->quantity;
-            dup_smdp->orientation = smdp->orientation;
-            dup_smdp->next = sm_prop[n_wall];
-            sm_prop[n_wall] = dup_smdp;
-          } else
-            reg_sm_num = 1;
-        }
+    for (int n_wall = next_set_bit(rp->membership, 0); n_wall >= 0;
+         n_wall = next_set_bit(rp->membership, n_wall + 1)) {
+      /* prepend region sm data for this region to sm_prop for i_th wall */
+      for (smdp = rp->sm_dat_head; smdp != NULL; smdp = smdp->next) {
+        if (smdp->quantity_type == SURFMOLDENS) {
+          dup_smdp =
+              CHECKED_MALLOC_STRUCT(struct sm_dat, "surface molecule data");
+          dup_smdp->sm = smdp->sm;
+          dup_smdp->quantity_type = smdp->quantity_type;
+          dup_smdp->quantity = smdp->quantity;
+          dup_smdp->orientation = smdp->orientation;
+          dup_smdp->next = sm_prop[n_wall];
+          sm_prop[n_wall] = dup_smdp;
+        } else
+          reg_sm_num = 1;
       }
     } /* done checking each wall */
 
@@ -2799,6 +3805,61 @@ int init_surf_mols_by_density(struct volume *world, struct wall *w,
   return 0;
 }
 
+/********************************************************************
+ place_surf_mols_on_free_tiles:
+
+    Place n_set molecules of one species on distinct tiles drawn uniformly
+    from the first n_free_sm entries of the free tile arrays.  Each chosen
+    tile is swapped to the end of the free range (a partial Fisher-Yates
+    shuffle), so every molecule costs one random number however full the
+    region already is, and the tiles which stay free are left at the front
+    for the next species.
+
+    In:  struct species *sm - species to place
+         short flags - flags for the new molecules
+         short orientation - orientation of the new molecules
+         tiles, idx, walls - parallel arrays describing the free tiles
+         unsigned int n_free_sm - number of free tiles in the arrays
+         unsigned int n_set - number of molecules to place (<= n_free_sm)
+    Out: the number of tiles that were filled
+ *******************************************************************/
+static unsigned int
+place_surf_mols_on_free_tiles(struct volume *world, struct species *sm,
+                              short flags, short orientation,
+                              struct surface_molecule ***tiles,
+                              unsigned int *idx, struct wall **walls,
+                              unsigned int n_free_sm, unsigned int n_set) {
+  for (unsigned int j = 0; j < n_set; j++) {
+    unsigned int n_left = n_free_sm - j;
+    unsigned int slot_num = (unsigned int)(rng_dbl(world->rng) * n_left);
+    if (slot_num >= n_left)
+      slot_num = n_left - 1;
+
+    struct periodic_image periodic_box = {.x = 0, .y = 0, .z = 0};
+    struct vector3 pos3d = {.x = 0, .y = 0, .z = 0};
+    struct surface_molecule *new_sm = place_single_molecule(
+        world, walls[slot_num], idx[slot_num], sm, 0, flags, orientation, 0, 0,
+        0, &periodic_box, &pos3d);
+    if (trigger_unimolecular(world->reaction_hash, world->rx_hashsize,
+                             sm->hashval,
+                             (struct abstract_molecule *)new_sm) != NULL ||
+        (sm->flags & CAN_SURFWALL) != 0) {
+      new_sm->flags |= ACT_REACT;
+    }
+
+    struct surface_molecule **tile = tiles[slot_num];
+    unsigned int tile_idx = idx[slot_num];
+    struct wall *tile_wall = walls[slot_num];
+    tiles[slot_num] = tiles[n_left - 1];
+    idx[slot_num] = idx[n_left - 1];
+    walls[slot_num] = walls[n_left - 1];
+    tiles[n_left - 1] = tile;
+    idx[n_left - 1] = tile_idx;
+    walls[n_left - 1] = tile_wall;
+  }
+  return n_set;
+}
+
 /********************************************************************
  init_surf_mols_by_number:
 
@@ -2811,9 +3872,6 @@ int init_surf_mols_by_density(struct volume *world, struct wall *w,
  *******************************************************************/
 int init_surf_mols_by_number(struct volume *world, struct object *objp,
                              struct region_list *reg_sm_num_head) {
-  static struct surface_molecule DUMMY_MOLECULE;
-  static struct surface_molecule *bread_crumb = &DUMMY_MOLECULE;
-
   short flags = TYPE_SURF | ACT_NEWBIE | IN_SCHEDULE | IN_SURFACE;
   unsigned int n_free_sm;
   // struct subvolume *gsv = NULL;
@@ -2827,14 +3885,13 @@ int init_surf_mols_by_number(struct volume *world, struct object *objp,
     /* initialize surface molecule grids in region as needed and */
     /* count total number of free surface molecule sites in region */
     n_free_sm = 0;
-    for (int n_wall = 0; n_wall < rp->membership->nbits; n_wall++) {
-      if (get_bit(rp->membership, n_wall)) {
-        struct wall *w = objp->wall_p[n_wall];
-        if (create_grid(world, w, NULL))
-          mcell_allocfailed("Failed to allocate grid for wall.");
-        struct surface_grid *sg = w->grid;
-        n_free_sm = n_free_sm + (sg->n_tiles - sg->n_occupied);
-      }
+    for (int n_wall = next_set_bit(rp->membership, 0); n_wall >= 0;
+         n_wall = next_set_bit(rp->membership, n_wall + 1)) {
+      struct wall *w = objp->wall_p[n_wall];
+      if (create_grid(world, w, NULL))
+        mcell_allocfailed("Failed to allocate grid for wall.");
+      struct surface_grid *sg = w->grid;
+      n_free_sm = n_free_sm + (sg->n_tiles - sg->n_occupied);
     }
     no_printf("Number of free surface molecule tiles in region %s = %d\n",
               rp->sym->name, n_free_sm);
@@ -2860,18 +3917,18 @@ int init_surf_mols_by_number(struct volume *world, struct object *objp,
 
       /* initialize array of pointers to all free tiles */
       int n_slot = 0;
-      for (int n_wall = 0; n_wall < rp->membership->nbits; n_wall++) {
-        if (get_bit(rp->membership, n_wall)) {
-          struct wall *w = objp->wall_p[n_wall];
-          struct surface_grid *sg = w->grid;
-          if (sg != NULL) {
-            for (unsigned int n_tile = 0; n_tile < sg->n_tiles; n_tile++) {
-              if (sg->sm_list[n_tile] == NULL || sg->sm_list[n_tile]->sm == NULL) {
-                sg->sm_list[n_tile] = add_surfmol_with_unique_pb_to_list(sg->sm_list[n_tile], NULL);
-                tiles[n_slot] = &(sg->sm_list[n_tile]->sm);
-                idx[n_slot] = n_tile;
-                walls[n_slot++] = w;
-              }
+      for (int n_wall = next_set_bit(rp->membership, 0); n_wall >= 0;
+           n_wall = next_set_bit(rp->membership, n_wall + 1)) {
+        struct wall *w = objp->wall_p[n_wall];
+        struct surface_grid *sg = w->grid;
+        if (sg != NULL) {
+          own_grid_tiles(sg);
+          for (unsigned int n_tile = 0; n_tile < sg->n_tiles; n_tile++) {
+            if (sg->sm_list[n_tile] == NULL || sg->sm_list[n_tile]->sm == NULL) {
+              sg->sm_list[n_tile] = add_surfmol_with_unique_pb_to_list(sg->sm_list[n_tile], NULL);
+              tiles[n_slot] = &(sg->sm_list[n_tile]->sm);
+              idx[n_slot] = n_tile;
+              walls[n_slot++] = w;
             }
           }
         }
@@ -2887,7 +3944,6 @@ int init_surf_mols_by_number(struct volume *world, struct object *objp,
           struct species *sm = smdp->sm;
           short orientation;
           unsigned int n_set = (unsigned int)smdp->quantity;
-          unsigned int n_clear = n_free_sm - n_set;
 
           /* Compute orientation */
           if (smdp->orientation > 0)
@@ -2907,127 +3963,14 @@ int init_surf_mols_by_number(struct volume *world, struct object *objp,
                 sm->sym->name, n_set, n_free_sm, rp->parent->sym->name,
                 rp->region_last_name, sm->sym->name);
             n_set = n_free_sm;
-            n_clear = 0;
           }
 
           no_printf("distribute %d of surface molecule %s\n", n_set,
                     sm->sym->name);
-          no_printf("n_set = %d  n_clear = %d  n_free_sm = %d\n", n_set,
-                    n_clear, n_free_sm);
-
-          /* if filling more than half the free tiles
-             init all with bread_crumbs
-             choose which tiles to free again
-             and then convert remaining bread_crumbs to actual molecules */
-          if (n_set > n_free_sm / 2) {
-            no_printf("filling more than half the free tiles: init all with "
-                      "bread_crumb\n");
-            for (unsigned int j = 0; j < n_free_sm; j++) {
-              *tiles[j] = bread_crumb;
-            }
-
-            no_printf("choose which tiles to free again\n");
-            for (unsigned int j = 0; j < n_clear; j++) {
-
-              /* Loop until we find a vacant tile. */
-              while (1) {
-                int slot_num = (int)(rng_dbl(world->rng) * n_free_sm);
-                if (*tiles[slot_num] == bread_crumb) {
-                  *tiles[slot_num] = NULL;
-                  break;
-                }
-              }
-            }
+          no_printf("n_set = %d  n_free_sm = %d\n", n_set, n_free_sm);
 
-            no_printf("convert remaining bread_crumbs to actual molecules\n");
-            for (unsigned int j = 0; j < n_free_sm; j++) {
-              if (*tiles[j] == bread_crumb) {
-                struct periodic_image periodic_box = {.x = 0, .y = 0, .z = 0};
-                struct vector3 pos3d = {.x = 0, .y = 0, .z = 0};
-                struct surface_molecule *new_sm = place_single_molecule(
-                    world, walls[j], idx[j], sm, 0, flags, orientation, 0, 0, 0,
-                    &periodic_box, &pos3d);
-                if (trigger_unimolecular(
-                        world->reaction_hash, world->rx_hashsize, sm->hashval,
-                        (struct abstract_molecule *)new_sm) != NULL ||
-                    (sm->flags & CAN_SURFWALL) != 0) {
-                  new_sm->flags |= ACT_REACT;
-                }
-              }
-            }
-          } else { /* just fill only the tiles we need */
-            no_printf("fill only the tiles we need\n");
-            for (unsigned int j = 0; j < n_set; j++) {
-
-              /* Loop until we find a vacant tile. */
-              while (1) {
-                int slot_num = (int)(rng_dbl(world->rng) * n_free_sm);
-                if (*tiles[slot_num] == NULL) {
-                  struct periodic_image periodic_box = {.x = 0, .y = 0, .z = 0};
-                  struct vector3 pos3d = {.x = 0, .y = 0, .z = 0};
-                  struct surface_molecule *new_sm = place_single_molecule(
-                      world, walls[slot_num], idx[slot_num], sm, 0, flags,
-                      orientation, 0, 0, 0, &periodic_box, &pos3d);
-                  if (trigger_unimolecular(
-                          world->reaction_hash, world->rx_hashsize, sm->hashval,
-                          (struct abstract_molecule *)new_sm) != NULL ||
-                      (sm->flags & CAN_SURFWALL) != 0) {
-                    new_sm->flags |= ACT_REACT;
-                  }
-                  break;
-                }
-              }
-            }
-          }
-
-          if (n_clear > 0) {
-            struct surface_molecule ***tiles_tmp;
-            unsigned int *idx_tmp;
-            struct wall **walls_tmp;
-
-            /* allocate memory to hold array of pointers to remaining free tiles
-             */
-            tiles_tmp =
-                CHECKED_MALLOC_ARRAY(struct surface_molecule **, n_clear,
-                                     "surface molecule placement tiles array");
-            idx_tmp = CHECKED_MALLOC_ARRAY(
-                unsigned int, n_clear,
-                "surface molecule placement indices array");
-            walls_tmp =
-                CHECKED_MALLOC_ARRAY(struct wall *, n_clear,
-                                     "surface molecule placement walls array");
-
-            n_slot = 0;
-            for (unsigned int n_sm = 0; n_sm < n_free_sm; n_sm++) {
-              if (*tiles[n_sm] == NULL) {
-                tiles_tmp[n_slot] = tiles[n_sm];
-                idx_tmp[n_slot] = idx[n_sm];
-                walls_tmp[n_slot++] = walls[n_sm];
-              }
-            }
-            /* free original array of pointers to all free tiles */
-            free(tiles);
-            free(idx);
-            free(walls);
-            tiles = tiles_tmp;
-            idx = idx_tmp;
-            walls = walls_tmp;
-            n_free_sm = n_free_sm - n_set;
-          }
-
-          /* update n_occupied for each surface molecule grid */
-          for (int n_wall = 0; n_wall < rp->membership->nbits; n_wall++) {
-            if (get_bit(rp->membership, n_wall)) {
-              struct surface_grid *sg = objp->wall_p[n_wall]->grid;
-              if (sg != NULL) {
-                sg->n_occupied = 0;
-                for (unsigned int n_tile = 0; n_tile < sg->n_tiles; ++n_tile) {
-                  if (sg->sm_list[n_tile]->sm != NULL)
-                    sg->n_occupied++;
-                }
-              }
-            }
-          }
+          n_free_sm -= place_surf_mols_on_free_tiles(
+              world, sm, flags, orientation, tiles, idx, walls, n_free_sm, n_set);
         }
       }
 
@@ -3040,7 +3983,6 @@ int init_surf_mols_by_number(struct volume *world, struct object *objp,
             struct species *sm = smdp->sm;
             short orientation;
             unsigned int n_set = (unsigned int)smdp->quantity;
-            unsigned int n_clear = n_free_sm - n_set;
 
             /* Compute orientation */
             if (smdp->orientation > 0)
@@ -3060,129 +4002,15 @@ int init_surf_mols_by_number(struct volume *world, struct object *objp,
                   sm->sym->name, n_set, n_free_sm, rp->parent->sym->name,
                   rp->region_last_name, sm->sym->name);
               n_set = n_free_sm;
-              n_clear = 0;
             }
 
             no_printf("distribute %d of surface molecule %s\n", n_set,
                       sm->sym->name);
-            no_printf("n_set = %d  n_clear = %d  n_free_sm = %d\n", n_set,
-                      n_clear, n_free_sm);
-
-            /* if filling more than half the free tiles
-               init all with bread_crumbs
-               choose which tiles to free again
-               and then convert remaining bread_crumbs to actual molecules */
-            if (n_set > n_free_sm / 2) {
-              no_printf("filling more than half the free tiles: init all with "
-                        "bread_crumb\n");
-              for (unsigned int j = 0; j < n_free_sm; j++) {
-                *tiles[j] = bread_crumb;
-              }
+            no_printf("n_set = %d  n_free_sm = %d\n", n_set, n_free_sm);
 
-              no_printf("choose which tiles to free again\n");
-              for (unsigned int j = 0; j < n_clear; j++) {
-
-                /* Loop until we find a vacant tile. */
-                while (1) {
-                  int slot_num = (int)(rng_dbl(world->rng) * n_free_sm);
-                  if (*tiles[slot_num] == bread_crumb) {
-                    *tiles[slot_num] = NULL;
-                    break;
-                  }
-                }
-              }
-
-              no_printf("convert remaining bread_crumbs to actual molecules\n");
-              for (unsigned int j = 0; j < n_free_sm; j++) {
-                if (*tiles[j] == bread_crumb) {
-                  struct periodic_image periodic_box = {.x = 0, .y = 0, .z = 0};
-                  struct vector3 pos3d = {.x = 0, .y = 0, .z = 0};
-                  struct surface_molecule *new_sm = place_single_molecule(
-                      world, walls[j], idx[j], sm, 0, flags, orientation, 0, 0, 0,
-                      &periodic_box, &pos3d);
-                  if (trigger_unimolecular(
-                          world->reaction_hash, world->rx_hashsize, sm->hashval,
-                          (struct abstract_molecule *)new_sm) != NULL ||
-                      (sm->flags & CAN_SURFWALL) != 0) {
-                    new_sm->flags |= ACT_REACT;
-                  }
-                }
-              }
-            } else { /* just fill only the tiles we need */
-              no_printf("fill only the tiles we need\n");
-              for (unsigned int j = 0; j < n_set; j++) {
-
-                /* Loop until we find a vacant tile. */
-                while (1) {
-                  int slot_num = (int)(rng_dbl(world->rng) * n_free_sm);
-                  if (*tiles[slot_num] == NULL) {
-                    struct periodic_image periodic_box = {.x = 0, .y = 0, .z = 0};
-                    struct vector3 pos3d = {.x = 0, .y = 0, .z = 0};
-                    struct surface_molecule *new_sm = place_single_molecule(
-                        world, walls[slot_num], idx[slot_num], sm, 0, flags,
-                        orientation, 0, 0, 0, &periodic_box, &pos3d);
-                    if (trigger_unimolecular(
-                            world->reaction_hash, world->rx_hashsize,
-                            sm->hashval,
-                            (struct abstract_molecule *)new_sm) != NULL ||
-                        (sm->flags & CAN_SURFWALL) != 0) {
-                      new_sm->flags |= ACT_REACT;
-                    }
-                    break;
-                  }
-                }
-              }
-            }
-
-            if (n_clear > 0) {
-              struct surface_molecule ***tiles_tmp;
-              unsigned int *idx_tmp;
-              struct wall **walls_tmp;
-
-              /* allocate memory to hold array of pointers to remaining free
-               * tiles */
-              tiles_tmp = CHECKED_MALLOC_ARRAY(
-                  struct surface_molecule **, n_clear,
-                  "surface molecule placement tiles array");
-              idx_tmp = CHECKED_MALLOC_ARRAY(
-                  unsigned int, n_clear,
-                  "surface molecule placement indices array");
-              walls_tmp = CHECKED_MALLOC_ARRAY(
-                  struct wall *, n_clear,
-                  "surface molecule placement walls array");
-
-              n_slot = 0;
-              for (unsigned int n_sm = 0; n_sm < n_free_sm; n_sm++) {
-                if (*tiles[n_sm] == NULL) {
-                  tiles_tmp[n_slot] = tiles[n_sm];
-                  idx_tmp[n_slot] = idx[n_sm];
-                  walls_tmp[n_slot++] = walls[n_sm];
-                }
-              }
-              /* free original array of pointers to all free tiles */
-              free(tiles);
-              free(idx);
-              free(walls);
-              tiles = tiles_tmp;
-              idx = idx_tmp;
-              walls = walls_tmp;
-              n_free_sm = n_free_sm - n_set;
-            }
-
-            /* update n_occupied for each surface molecule grid */
-            for (int n_wall = 0; n_wall < rp->membership->nbits; n_wall++) {
-              if (get_bit(rp->membership, n_wall)) {
-                struct surface_grid *sg = objp->wall_p[n_wall]->grid;
-                if (sg != NULL) {
-                  sg->n_occupied = 0;
-                  for (unsigned int n_tile = 0; n_tile < sg->n_tiles;
-                       ++n_tile) {
-                    if (sg->sm_list[n_tile]->sm != NULL)
-                      sg->n_occupied++;
-                  }
-                }
-              }
-            }
+            n_free_sm -= place_surf_mols_on_free_tiles(
+                world, sm, flags, orientation, tiles, idx, walls, n_free_sm,
+                n_set);
           }
         }
       } /* end of if (rp->surf_clas != NULL) */
@@ -3398,6 +4226,60 @@ static int eval_rel_region_expr(struct release_evaluator *expr, int n,
   return 0;
 }
 
+/***************************************************************************
+build_area_alias_table:
+  In: release data whose cum_area_list holds the area of each included wall
+      (not yet accumulated)
+  Out: 0 on success, 1 on failure.  rrd->alias_prob and rrd->alias_index
+       are filled so that a wall can be drawn proportionally to its area
+       with a single uniform deviate (Walker/Vose alias method), rather than
+       with a bisection of the cumulative area list.
+***************************************************************************/
+static int build_area_alias_table(struct release_region_data *rrd) {
+  int n = rrd->n_walls_included;
+  rrd->alias_prob = CHECKED_MALLOC_ARRAY(double, n,
+                                         "alias table for 2D region release");
+  rrd->alias_index = CHECKED_MALLOC_ARRAY(int, n,
+                                          "alias table for 2D region release");
+  int *small = CHECKED_MALLOC_ARRAY(int, n, "alias table work list");
+  int *large = CHECKED_MALLOC_ARRAY(int, n, "alias table work list");
+
+  double total = 0;
+  for (int k = 0; k < n; k++)
+    total += rrd->cum_area_list[k];
+
+  int n_small = 0, n_large = 0;
+  for (int k = 0; k < n; k++) {
+    rrd->alias_prob[k] = (total > 0) ? rrd->cum_area_list[k] * n / total : 1;
+    rrd->alias_index[k] = k;
+    if (rrd->alias_prob[k] < 1)
+      small[n_small++] = k;
+    else
+      large[n_large++] = k;
+  }
+
+  while (n_small > 0 && n_large > 0) {
+    int s = small[--n_small];
+    int l = large[n_large - 1];
+    rrd->alias_index[s] = l;
+    rrd->alias_prob[l] -= 1 - rrd->alias_prob[s];
+    if (rrd->alias_prob[l] < 1) {
+      --n_large;
+      small[n_small++] = l;
+    }
+  }
+
+  /* Whatever is left over differs from 1 only by rounding */
+  while (n_large > 0)
+    rrd->alias_prob[large[--n_large]] = 1;
+  while (n_small > 0)
+    rrd->alias_prob[small[--n_small]] = 1;
+
+  free(small);
+  free(large);
+  return 0;
+}
+
 /***************************************************************************
 init_rel_region_data_2d:
   In: release data for a release of 2D molecules onto a region
@@ -3476,6 +4358,9 @@ static int init_rel_region_data_2d(struct release_site_obj *rsop,
     }
   }
 
+  if (build_area_alias_table(rrd))
+    return 1;
+
   for (int n_wall = 1; n_wall < rrd->n_walls_included; n_wall++) {
     rrd->cum_area_list[n_wall] += rrd->cum_area_list[n_wall - 1];
   }
@@ -3757,8 +4642,35 @@ int schedule_dynamic_geometry(struct mdlparse_vars *parse_state) {
     return 1;     
   }
 
-  // This is the actual scheduling.
+  // Remember the events in time order, for the frame loader; the list
+  // itself does not survive scheduling
   struct dg_time_filename *dg_time_fname, *dg_time_fname_next;
+  int n_events = 0;
+  for (dg_time_fname = state->dynamic_geometry_head; dg_time_fname != NULL;
+       dg_time_fname = dg_time_fname->next)
+    n_events++;
+  free(state->dynamic_geometry_events);
+  state->dynamic_geometry_events = NULL;
+  state->n_dynamic_geometry_events = 0;
+  if (n_events > 0) {
+    state->dynamic_geometry_events = CHECKED_MALLOC_ARRAY(
+        struct dg_time_filename *, n_events, "dynamic geometry events");
+    state->n_dynamic_geometry_events = n_events;
+    n_events = 0;
+    for (dg_time_fname = state->dynamic_geometry_head; dg_time_fname != NULL;
+         dg_time_fname = dg_time_fname->next) {
+      // Insertion sort, keeping events at the same time in file order
+      int i = n_events++;
+      while (i > 0 && state->dynamic_geometry_events[i - 1]->event_time >
+                          dg_time_fname->event_time) {
+        state->dynamic_geometry_events[i] = state->dynamic_geometry_events[i - 1];
+        i--;
+      }
+      state->dynamic_geometry_events[i] = dg_time_fname;
+    }
+  }
+
+  // This is the actual scheduling.
   for (dg_time_fname = state->dynamic_geometry_head; dg_time_fname != NULL;
        dg_time_fname = dg_time_fname_next) {
     dg_time_fname_next = dg_time_fname->next; /* schedule_add overwrites 'next' */
@@ -3827,7 +4739,8 @@ int init_releases(struct schedule_helper *releaser) {
           break;
 
         case SHAPE_LIST:
-          if (req->release_site->mol_list == NULL)
+          if (req->release_site->mol_list == NULL &&
+              req->release_site->mol_file == NULL)
             mcell_error("Molecule positions for the LIST release site '%s' are "
                         "not specified.",
                         req->release_site->name);
@@ -6665,71 +7578,140 @@ void remove_molecules_name_list(struct name_list **nlist) {
   *nlist = NULL;
 }
 
+/* A wall of a subvolume in check_for_overlapped_walls */
+struct overlap_candidate {
+  struct wall *w;
+  double d_prod;  /* |dot product| of the wall normal and the random vector */
+  int order;      /* position of the wall in the subvolume's wall list */
+  struct vector3 llf, urb; /* bounding box, widened by the comparison eps */
+};
+
+/* Orders the candidates as sorted_insert_wall_aux_list would: by d_prod,
+ * with later walls first among equal ones */
+static int compare_overlap_candidates(const void *a, const void *b) {
+  const struct overlap_candidate *c1 = (const struct overlap_candidate *)a;
+  const struct overlap_candidate *c2 = (const struct overlap_candidate *)b;
+  if (c1->d_prod < c2->d_prod)
+    return -1;
+  if (c1->d_prod > c2->d_prod)
+    return 1;
+  return c2->order - c1->order;
+}
+
+/* Overlap check of all subvolumes, one subvolume per task */
+struct overlap_pass {
+  struct subvolume *subvol;
+  struct vector3 rand_vector;
+  struct wall **overlaps; /* first overlapping pair found in each subvolume */
+};
+
+static void check_subvol_overlaps_task(void *ctx, int task) {
+  struct overlap_pass *pass = (struct overlap_pass *)ctx;
+  struct subvolume *sv = &(pass->subvol[task]);
+  pass->overlaps[2 * task] = pass->overlaps[2 * task + 1] = NULL;
+
+  int n_walls = 0;
+  for (struct wall_list *wlp = sv->wall_head; wlp != NULL; wlp = wlp->next)
+    ++n_walls;
+  if (n_walls < 2)
+    return;
+
+  struct overlap_candidate *cands = CHECKED_MALLOC_ARRAY(
+      struct overlap_candidate, n_walls, "overlapped wall candidates");
+  int n = 0;
+  for (struct wall_list *wlp = sv->wall_head; wlp != NULL; wlp = wlp->next) {
+    struct overlap_candidate *c = &cands[n];
+    c->w = wlp->this_wall;
+    /* we want to place walls with opposite normals into
+       neighboring positions in the sorted array */
+    c->d_prod = fabs(dot_prod(&pass->rand_vector, &(c->w->normal)));
+    c->order = n++;
+
+    wall_bounding_box(c->w, &c->llf, &c->urb);
+    double margin = max3d(fabs(c->llf.x), fabs(c->llf.y), fabs(c->llf.z));
+    margin = max2d(margin, max3d(fabs(c->urb.x), fabs(c->urb.y),
+                                 fabs(c->urb.z)));
+    margin = MESH_DISTINCTIVE * max2d(margin, 1.0);
+    c->llf.x -= margin;
+    c->llf.y -= margin;
+    c->llf.z -= margin;
+    c->urb.x += margin;
+    c->urb.y += margin;
+    c->urb.z += margin;
+  }
+  qsort(cands, n_walls, sizeof(struct overlap_candidate),
+        compare_overlap_candidates);
+
+  for (int i = 0; i < n_walls; i++) {
+    struct overlap_candidate *c1 = &cands[i];
+    /* there may be several walls with the same (or mirror)
+       oriented normals */
+    for (int j = i + 1;
+         j < n_walls && !distinguishable(c1->d_prod, cands[j].d_prod, EPS_C);
+         j++) {
+      struct overlap_candidate *c2 = &cands[j];
+      /* walls whose boxes are apart can neither overlap nor coincide */
+      if (c1->urb.x < c2->llf.x || c2->urb.x < c1->llf.x ||
+          c1->urb.y < c2->llf.y || c2->urb.y < c1->llf.y ||
+          c1->urb.z < c2->llf.z || c2->urb.z < c1->llf.z)
+        continue;
+
+      if (are_walls_coplanar(c1->w, c2->w, MESH_DISTINCTIVE)) {
+        if ((are_walls_coincident(c1->w, c2->w, MESH_DISTINCTIVE) ||
+             coplanar_tri_overlap(c1->w, c2->w))) {
+          pass->overlaps[2 * task] = c1->w;
+          pass->overlaps[2 * task + 1] = c2->w;
+          free(cands);
+          return;
+        }
+      }
+    }
+  }
+
+  free(cands);
+}
+
 /*****************************************************************
 check_for_overlapped_walls:
   In: rng: random number generator
       n_subvols: number of subvolumes
       subvol: a subvolume
+      pool: threads to check the subvolumes on, or NULL
   Out: 0 if no errors, the world geometry is successfully checked for
        overlapped walls.
        1 if there are any overlapped walls.
+  Note: Only walls of the same subvolume whose normals are parallel to
+        each other and whose bounding boxes meet are compared.  The first
+        overlap in subvolume order is reported, whatever the thread count.
 ******************************************************************/
 int check_for_overlapped_walls(
-    struct rng_state *rng, int n_subvols, struct subvolume *subvol) {
+    struct rng_state *rng, int n_subvols, struct subvolume *subvol,
+    struct thread_pool *pool) {
 
   /* pick up a random vector */
-  struct vector3 rand_vector;
-  rand_vector.x = rng_dbl(rng);
-  rand_vector.y = rng_dbl(rng);
-  rand_vector.z = rng_dbl(rng);
+  struct overlap_pass pass;
+  pass.rand_vector.x = rng_dbl(rng);
+  pass.rand_vector.y = rng_dbl(rng);
+  pass.rand_vector.z = rng_dbl(rng);
+  pass.subvol = subvol;
+  pass.overlaps = CHECKED_MALLOC_ARRAY(struct wall *, 2 * n_subvols,
+                                       "overlapped walls");
 
-  for (int i = 0; i < n_subvols; i++) {
-    struct subvolume *sv = &(subvol[i]);
-    struct wall_aux_list *head = NULL;
+  thread_pool_run(pool, n_subvols, check_subvol_overlaps_task, &pass);
 
-    for (struct wall_list *wlp = sv->wall_head; wlp != NULL; wlp = wlp->next) {
-      double d_prod = dot_prod(&rand_vector, &(wlp->this_wall->normal));
-      /* we want to place walls with opposite normals into
-         neighboring positions in the sorted linked list */
-      if (d_prod < 0)
-        d_prod = -d_prod;
-
-      struct wall_aux_list *newNode;
-      newNode = CHECKED_MALLOC_STRUCT(struct wall_aux_list, "wall_aux_list");
-      newNode->this_wall = wlp->this_wall;
-      newNode->d_prod = d_prod;
-
-      sorted_insert_wall_aux_list(&head, newNode);
-    }
-
-    for (struct wall_aux_list *curr = head; curr != NULL; curr = curr->next) {
-      struct wall *w1 = curr->this_wall;
-
-      struct wall_aux_list *next_curr = curr->next;
-      while ((next_curr != NULL) &&
-             (!distinguishable(curr->d_prod, next_curr->d_prod, EPS_C))) {
-        /* there may be several walls with the same (or mirror)
-           oriented normals */
-        struct wall *w2 = next_curr->this_wall;
-
-        if (are_walls_coplanar(w1, w2, MESH_DISTINCTIVE)) {
-          if ((are_walls_coincident(w1, w2, MESH_DISTINCTIVE) ||
-               coplanar_tri_overlap(w1, w2))) {
-            mcell_error(
-                "walls are overlapped: wall %d from '%s' and wall "
-                "%d from '%s'.",
-                w1->side, w1->parent_object->sym->name, w2->side,
-                w2->parent_object->sym->name);
-          }
-        }
-        next_curr = next_curr->next;
-      }
+  for (int i = 0; i < n_subvols; i++) {
+    struct wall *w1 = pass.overlaps[2 * i];
+    struct wall *w2 = pass.overlaps[2 * i + 1];
+    if (w1 != NULL) {
+      mcell_error(
+          "walls are overlapped: wall %d from '%s' and wall "
+          "%d from '%s'.",
+          w1->side, w1->parent_object->sym->name, w2->side,
+          w2->parent_object->sym->name);
     }
-    /* free memory */
-    if (head != NULL)
-      delete_wall_aux_list(head);
   }
 
+  free(pass.overlaps);
   return 0;
 }
 
@@ -32,6 +32,9 @@ int init_data_structures(struct volume *world);
 int init_species(struct volume *world);
 int init_bounding_box(struct volume *world);
 int init_partitions(struct volume *world);
+void compute_partition_density(struct volume *world, double *x_hist,
+                               double *y_hist, double *z_hist, int n_bins);
+struct thread_pool *world_thread_pool(struct volume *world);
 int init_vertices_walls(struct volume *world);
 int init_regions(struct volume *world);
 int init_checkpoint_state(struct volume *world, long long *exec_iterations);
@@ -45,14 +48,15 @@ int parse_input(struct volume *world);
 
 int load_checkpoint(struct volume *world, bool only_time_and_iter);
 
-int instance_obj(struct volume *world, struct object *objp, double (*im)[4]);
+int instance_obj(struct volume *world, struct object *objp, double (*im)[4],
+                 struct thread_pool *pool);
 
 int instance_release_site(struct mem_helper *magic_mem,
                           struct schedule_helper *releaser, struct object *objp,
                           double (*im)[4]);
 
 int instance_polygon_object(enum warn_level_t degenerate_polys,
-                            struct object *objp);
+                            struct object *objp, struct thread_pool *pool);
 
 void init_clamp_lists(struct ccn_clamp_data *clamp_list);
 
@@ -122,5 +126,6 @@ void create_name_lists_of_volume_and_surface_mols(
     struct name_list **surf_species_name_list);
 void remove_molecules_name_list(struct name_list **nlist);
 int check_for_overlapped_walls(
-    struct rng_state *rng, int n_subvols, struct subvolume *subvol);
+    struct rng_state *rng, int n_subvols, struct subvolume *subvol,
+    struct thread_pool *pool);
 struct vector3 *create_region_bbox(struct region *r);
@@ -68,6 +68,7 @@ By Bob Jenkins, 1996.  Public Domain.
     g += h;                                                                    \
   }
 
+TARGET_CLONES
 void isaac64_generate(struct isaac64_state *rng) {
   register ub8 a, b, x, y, *m, *m2, *r, *mend;
 
@@ -26,6 +26,11 @@
 #include "mem_util.h"
 
 #include <stdlib.h>
+#include <time.h>
+#ifndef _WIN32
+#include <pthread.h>
+#include <sched.h>
+#endif
 #undef _XOPEN_SOURCE
 #define _XOPEN_SOURCE 600
 #include <string.h>
@@ -36,30 +41,291 @@ static FILE *mcell_log_file = NULL;
 /* Our warning/error file */
 static FILE *mcell_error_file = NULL;
 
-/* Get the log file. */
-FILE *mcell_get_log_file(void) {
-  if (mcell_log_file == NULL) {
+enum log_stream { LOG_STREAM_LOG, LOG_STREAM_ERROR };
+
+/* Longest queued message, including the terminating NUL; longer messages are
+ * written directly */
+#define LOG_TEXT_SIZE 512
+
+/* A call site passes this many warnings per window... */
+#define LOG_LIMIT_BURST 5
+/* ...of this many seconds (see mcell_warn_limited) */
+#define LOG_LIMIT_WINDOW 1.0
+
+static void log_report_limits(void);
+
+#ifndef _WIN32
+/* Messages and warnings logged while the asynchronous backend runs go into
+ * a bounded lock-free ring (one sequence number per slot, as in Vyukov's
+ * MPMC queue) and are written by a background flusher.  Errors, and
+ * anything that asks for the FILE * directly, first drain the ring, so the
+ * output keeps program order. */
+#define LOG_RING_SLOTS 1024 /* Power of two */
+#define LOG_FLUSH_INTERVAL_NS 50000000L
+
+/* The sequence numbers, positions and flags below are only accessed through
+ * the __atomic builtins, which compile both as C and as C++ */
+struct log_slot {
+  size_t seq; /* == position + 1 once the text is complete */
+  int stream;
+  char text[LOG_TEXT_SIZE];
+};
+
+static struct log_slot log_ring[LOG_RING_SLOTS];
+static size_t log_enqueue_pos;
+static size_t log_dequeue_pos; /* Only advanced under log_drain_lock */
+static int log_async;     /* Producers queue messages */
+static int log_producers; /* Producers between testing log_async and
+                             publishing their message */
+static pthread_mutex_t log_drain_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static pthread_t log_flusher;
+static pthread_mutex_t log_wake_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t log_wake = PTHREAD_COND_INITIALIZER;
+static int log_flusher_stop; /* Protected by log_wake_lock */
+
+static pthread_mutex_t log_limit_lock = PTHREAD_MUTEX_INITIALIZER;
+#define LOCK_LIMITS() pthread_mutex_lock(&log_limit_lock)
+#define UNLOCK_LIMITS() pthread_mutex_unlock(&log_limit_lock)
+#else
+#define LOCK_LIMITS() do { } while (0)
+#define UNLOCK_LIMITS() do { } while (0)
+#endif
+
+/* Sites with suppressed warnings not yet reported; under log_limit_lock */
+static struct mcell_log_limit *log_limited_sites = NULL;
+static int log_atexit_registered = 0;
+
+/* The file for a stream, without draining queued messages. */
+static FILE *log_stream_file(int stream) {
+  if (stream == LOG_STREAM_LOG) {
+    if (mcell_log_file == NULL) {
+#ifdef DEBUG
+      setvbuf(stdout, NULL, _IONBF, 0);
+#endif
+      mcell_log_file = stdout;
+    }
+    return mcell_log_file;
+  } else {
+    if (mcell_error_file == NULL) {
 #ifdef DEBUG
-    setvbuf(stdout, NULL, _IONBF, 0);
+      setvbuf(stderr, NULL, _IONBF, 0);
 #endif
-    mcell_log_file = stdout;
+      mcell_error_file = stderr;
+    }
+    return mcell_error_file;
   }
-  return mcell_log_file;
 }
 
-/* Get the error file. */
-FILE *mcell_get_error_file(void) {
-  if (mcell_error_file == NULL) {
-#ifdef DEBUG
-    setvbuf(stderr, NULL, _IONBF, 0);
+#ifndef _WIN32
+/*************************************************************************
+log_drain:
+  Write every complete message at the head of the ring, in order.  A message
+  another thread is still formatting stops the drain; the flusher picks it
+  and what follows it up next time.
+*************************************************************************/
+static void log_drain(void) {
+  if (__atomic_load_n(&log_dequeue_pos, __ATOMIC_ACQUIRE) ==
+      __atomic_load_n(&log_enqueue_pos, __ATOMIC_ACQUIRE))
+    return;
+
+  pthread_mutex_lock(&log_drain_lock);
+  size_t pos = __atomic_load_n(&log_dequeue_pos, __ATOMIC_RELAXED);
+  int wrote[2] = { 0, 0 };
+  while (1) {
+    struct log_slot *slot = &log_ring[pos & (LOG_RING_SLOTS - 1)];
+    if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != pos + 1)
+      break;
+    fputs(slot->text, log_stream_file(slot->stream));
+    wrote[slot->stream] = 1;
+    __atomic_store_n(&slot->seq, pos + LOG_RING_SLOTS, __ATOMIC_RELEASE);
+    ++pos;
+    __atomic_store_n(&log_dequeue_pos, pos, __ATOMIC_RELEASE);
+  }
+  if (wrote[LOG_STREAM_LOG])
+    fflush(log_stream_file(LOG_STREAM_LOG));
+  if (wrote[LOG_STREAM_ERROR])
+    fflush(log_stream_file(LOG_STREAM_ERROR));
+  pthread_mutex_unlock(&log_drain_lock);
+}
+
+static void log_wake_flusher(void) {
+  pthread_mutex_lock(&log_wake_lock);
+  pthread_cond_signal(&log_wake);
+  pthread_mutex_unlock(&log_wake_lock);
+}
+
+static void *log_flusher_main(void *arg) {
+  (void)arg;
+  pthread_mutex_lock(&log_wake_lock);
+  while (!log_flusher_stop) {
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_nsec += LOG_FLUSH_INTERVAL_NS;
+    if (deadline.tv_nsec >= 1000000000L) {
+      deadline.tv_nsec -= 1000000000L;
+      ++deadline.tv_sec;
+    }
+    pthread_cond_timedwait(&log_wake, &log_wake_lock, &deadline);
+    pthread_mutex_unlock(&log_wake_lock);
+    log_drain();
+    pthread_mutex_lock(&log_wake_lock);
+  }
+  pthread_mutex_unlock(&log_wake_lock);
+  return NULL;
+}
+
+/*************************************************************************
+log_enqueue:
+  In: stream: LOG_STREAM_LOG or LOG_STREAM_ERROR
+      prefix: text to put before the message
+      fmt, args: the message
+      suffix: text to put after the message
+  Out: 1 if the message was queued, 0 if the caller must write it (the
+       asynchronous backend is not running or the message is too long).
+       'args' is left untouched.
+*************************************************************************/
+static int log_enqueue(int stream, char const *prefix, char const *fmt,
+                       va_list args, char const *suffix) {
+  __atomic_fetch_add(&log_producers, 1, __ATOMIC_SEQ_CST);
+  if (!__atomic_load_n(&log_async, __ATOMIC_SEQ_CST)) {
+    __atomic_fetch_sub(&log_producers, 1, __ATOMIC_SEQ_CST);
+    return 0;
+  }
+
+  char text[LOG_TEXT_SIZE];
+  size_t n_prefix = strlen(prefix), n_suffix = strlen(suffix);
+  va_list copy;
+  va_copy(copy, args);
+  int n = (n_prefix < LOG_TEXT_SIZE)
+              ? vsnprintf(text + n_prefix, LOG_TEXT_SIZE - n_prefix, fmt, copy)
+              : -1;
+  va_end(copy);
+  if (n < 0 || n_prefix + n + n_suffix >= LOG_TEXT_SIZE) {
+    __atomic_fetch_sub(&log_producers, 1, __ATOMIC_SEQ_CST);
+    return 0;
+  }
+  memcpy(text, prefix, n_prefix);
+  memcpy(text + n_prefix + n, suffix, n_suffix + 1);
+
+  /* Claim a slot; if the ring is full, help the flusher */
+  struct log_slot *slot;
+  size_t pos = __atomic_load_n(&log_enqueue_pos, __ATOMIC_RELAXED);
+  while (1) {
+    slot = &log_ring[pos & (LOG_RING_SLOTS - 1)];
+    size_t seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+    if (seq == pos) {
+      if (__atomic_compare_exchange_n(&log_enqueue_pos, &pos, pos + 1, 1,
+                                      __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        break;
+    } else if (seq < pos) {
+      log_drain();
+      sched_yield();
+      pos = __atomic_load_n(&log_enqueue_pos, __ATOMIC_RELAXED);
+    } else
+      pos = __atomic_load_n(&log_enqueue_pos, __ATOMIC_RELAXED);
+  }
+
+  slot->stream = stream;
+  memcpy(slot->text, text, n_prefix + n + n_suffix + 1);
+  __atomic_store_n(&slot->seq, pos + 1, __ATOMIC_RELEASE);
+  __atomic_fetch_sub(&log_producers, 1, __ATOMIC_SEQ_CST);
+
+  if (pos - __atomic_load_n(&log_dequeue_pos, __ATOMIC_RELAXED) ==
+      LOG_RING_SLOTS / 2)
+    log_wake_flusher();
+  return 1;
+}
+#else
+static void log_drain(void) {}
+#endif
+
+/* Write a message, through the ring if the asynchronous backend runs. */
+static void log_emit(int stream, char const *prefix, char const *fmt,
+                     va_list args, char const *suffix) {
+#ifndef _WIN32
+  if (log_enqueue(stream, prefix, fmt, args, suffix))
+    return;
+#endif
+  log_drain();
+  FILE *f = log_stream_file(stream);
+  fputs(prefix, f);
+  vfprintf(f, fmt, args);
+  fputs(suffix, f);
+}
+
+static void log_atexit(void) { mcell_log_async_stop(); }
+
+static void log_register_atexit(void) {
+  if (!log_atexit_registered) {
+    log_atexit_registered = 1;
+    atexit(log_atexit);
+  }
+}
+
+/* Start writing log messages and warnings from a background thread. */
+void mcell_log_async_start(void) {
+#ifndef _WIN32
+  if (__atomic_load_n(&log_async, __ATOMIC_SEQ_CST))
+    return;
+
+  log_drain();
+  for (size_t i = 0; i < LOG_RING_SLOTS; ++i)
+    __atomic_store_n(&log_ring[i].seq, i, __ATOMIC_SEQ_CST);
+  __atomic_store_n(&log_enqueue_pos, 0, __ATOMIC_SEQ_CST);
+  __atomic_store_n(&log_dequeue_pos, 0, __ATOMIC_SEQ_CST);
+
+  log_flusher_stop = 0;
+  if (pthread_create(&log_flusher, NULL, log_flusher_main, NULL) != 0)
+    return;
+  LOCK_LIMITS();
+  log_register_atexit();
+  UNLOCK_LIMITS();
+  __atomic_store_n(&log_async, 1, __ATOMIC_SEQ_CST);
 #endif
-    mcell_error_file = stderr;
+}
+
+/* Write out everything queued, report suppressed warnings and go back to
+ * writing directly. */
+void mcell_log_async_stop(void) {
+#ifndef _WIN32
+  if (__atomic_load_n(&log_async, __ATOMIC_SEQ_CST)) {
+    __atomic_store_n(&log_async, 0, __ATOMIC_SEQ_CST);
+    while (__atomic_load_n(&log_producers, __ATOMIC_SEQ_CST) != 0)
+      sched_yield();
+
+    pthread_mutex_lock(&log_wake_lock);
+    log_flusher_stop = 1;
+    pthread_cond_signal(&log_wake);
+    pthread_mutex_unlock(&log_wake_lock);
+    pthread_join(log_flusher, NULL);
+    log_drain();
   }
-  return mcell_error_file;
+#endif
+  log_report_limits();
+}
+
+/* Write out queued messages and report suppressed warnings. */
+void mcell_log_flush(void) {
+  log_drain();
+  log_report_limits();
+}
+
+/* Get the log file. */
+FILE *mcell_get_log_file(void) {
+  log_drain();
+  return log_stream_file(LOG_STREAM_LOG);
+}
+
+/* Get the error file. */
+FILE *mcell_get_error_file(void) {
+  log_drain();
+  return log_stream_file(LOG_STREAM_ERROR);
 }
 
 /* Set the log file. */
 void mcell_set_log_file(FILE *f) {
+  log_drain();
   if (mcell_log_file != NULL && mcell_log_file != stdout &&
       mcell_log_file != stderr)
     fclose(mcell_log_file);
@@ -74,6 +340,7 @@ void mcell_set_log_file(FILE *f) {
 
 /* Set the error file. */
 void mcell_set_error_file(FILE *f) {
+  log_drain();
   if (mcell_error_file != NULL && mcell_error_file != stdout &&
       mcell_error_file != stderr)
     fclose(mcell_error_file);
@@ -95,7 +362,7 @@ void mcell_log_raw(char const *fmt, ...) {
 
 /* Log a message (va_list version). */
 void mcell_logv_raw(char const *fmt, va_list args) {
-  vfprintf(mcell_get_log_file(), fmt, args);
+  log_emit(LOG_STREAM_LOG, "", fmt, args, "");
 }
 
 /* Log a message. */
@@ -121,8 +388,7 @@ void mcell_log(char const *fmt, ...) {
 
 /* Log a message (va_list version). */
 void mcell_logv(char const *fmt, va_list args) {
-  mcell_logv_raw(fmt, args);
-  fprintf(mcell_get_log_file(), "\n");
+  log_emit(LOG_STREAM_LOG, "", fmt, args, "\n");
 }
 
 /* Log a warning. */
@@ -135,9 +401,67 @@ void mcell_warn(char const *fmt, ...) {
 
 /* Log a warning (va_list version). */
 void mcell_warnv(char const *fmt, va_list args) {
-  fprintf(mcell_get_error_file(), "Warning: ");
-  mcell_errorv_raw(fmt, args);
-  fprintf(mcell_get_error_file(), "\n");
+  log_emit(LOG_STREAM_ERROR, "Warning: ", fmt, args, "\n");
+}
+
+/* Log a warning unless its call site is over its rate limit. */
+void mcell_warn_limited_(struct mcell_log_limit *limit, char const *fmt, ...) {
+  struct timespec now_ts;
+#ifndef _WIN32
+  clock_gettime(CLOCK_MONOTONIC, &now_ts);
+#else
+  timespec_get(&now_ts, TIME_UTC);
+#endif
+  double now = now_ts.tv_sec + 1e-9 * now_ts.tv_nsec;
+
+  LOCK_LIMITS();
+  if (limit->n_in_window == 0 || now - limit->window_start >= LOG_LIMIT_WINDOW) {
+    if (limit->n_suppressed > 0)
+      mcell_warn("%llu more warnings like \"%s\" were suppressed.",
+                 limit->n_suppressed, limit->last);
+    limit->n_suppressed = 0;
+    limit->n_in_window = 0;
+    limit->window_start = now;
+  }
+
+  if (limit->n_in_window >= LOG_LIMIT_BURST) {
+    if (limit->n_suppressed++ == 0 && !limit->listed) {
+      limit->listed = 1;
+      limit->next = log_limited_sites;
+      log_limited_sites = limit;
+      log_register_atexit();
+    }
+    UNLOCK_LIMITS();
+    return;
+  }
+  ++limit->n_in_window;
+
+  va_list args;
+  va_start(args, fmt);
+  vsnprintf(limit->last, sizeof(limit->last), fmt, args);
+  va_end(args);
+  limit->last[strcspn(limit->last, "\n")] = '\0';
+
+  va_start(args, fmt);
+  mcell_warnv(fmt, args);
+  va_end(args);
+  UNLOCK_LIMITS();
+}
+
+/* Report warnings suppressed since their site last logged. */
+static void log_report_limits(void) {
+  LOCK_LIMITS();
+  while (log_limited_sites != NULL) {
+    struct mcell_log_limit *limit = log_limited_sites;
+    log_limited_sites = limit->next;
+    limit->next = NULL;
+    limit->listed = 0;
+    if (limit->n_suppressed > 0)
+      mcell_warn("%llu more warnings like \"%s\" were suppressed.",
+                 limit->n_suppressed, limit->last);
+    limit->n_suppressed = 0;
+  }
+  UNLOCK_LIMITS();
 }
 
 /* Log an error and carry on. */
@@ -285,4 +609,7 @@ void mcell_allocfailedv(char const *fmt, va_list args) {
 }
 
 /* Terminate program execution due to an error. */
-void mcell_die(void) { exit(EXIT_FAILURE); }
+void mcell_die(void) {
+  mcell_log_async_stop();
+  exit(EXIT_FAILURE);
+}
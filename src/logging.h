@@ -53,6 +53,17 @@ void mcell_set_log_file(FILE *f);
 /* Set the error file. */
 void mcell_set_error_file(FILE *f);
 
+/* Start writing log messages and warnings from a background thread, so
+ * logging does not stall the caller.  Errors are still written at once. */
+void mcell_log_async_start(void);
+
+/* Write out everything queued, report suppressed warnings and go back to
+ * writing directly. */
+void mcell_log_async_stop(void);
+
+/* Write out queued messages and report suppressed warnings. */
+void mcell_log_flush(void);
+
 /********************************************************
  * Raw I/O to log and error streams
  ********************************************************/
@@ -86,6 +97,27 @@ void mcell_warn(char const *fmt, ...) PRINTF_FORMAT(1);
 /* Log a warning (va_list version). */
 void mcell_warnv(char const *fmt, va_list args) PRINTF_FORMAT_V(1);
 
+/* State of one call site of mcell_warn_limited */
+struct mcell_log_limit {
+  struct mcell_log_limit *next; /* Next site with suppressed warnings */
+  double window_start;          /* When the current window began (s) */
+  unsigned int n_in_window;     /* Warnings logged in the current window */
+  unsigned long long n_suppressed; /* Warnings dropped since the last one */
+  int listed;                   /* On the list of sites to report */
+  char last[128];               /* First line of the last warning logged */
+};
+
+/* Log a warning from a call site that may fire very often.  Each site logs
+ * a few warnings per second; the rest are counted and reported as "N more
+ * warnings like ..." once the site logs again or the log is flushed. */
+#define mcell_warn_limited(fmt, ...)                                           \
+  do {                                                                         \
+    static struct mcell_log_limit mcell_warn_limit_;                           \
+    mcell_warn_limited_(&mcell_warn_limit_, fmt, ##__VA_ARGS__);               \
+  } while (0)
+void mcell_warn_limited_(struct mcell_log_limit *limit, char const *fmt, ...)
+    PRINTF_FORMAT(2);
+
 /* Log an error and carry on. */
 void mcell_error_nodie(char const *fmt, ...) PRINTF_FORMAT(1);
 
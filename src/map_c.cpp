@@ -1,123 +1,244 @@
 
-
-#include <unordered_map>
-#include <boost/container/small_vector.hpp>
-
-#include <iostream>
-#include <vector>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include "map_c.h"
 
 #include <assert.h>
 
-using namespace std;
+/*
+ * Open-addressing hash table with Robin Hood probing.  Every entry
+ * remembers how far it sits from its home slot; an insertion that has
+ * probed further than the entry in its way takes that slot and carries
+ * the displaced entry on.  This keeps probe sequences short and even at
+ * high load, and a lookup can stop as soon as it reaches an entry closer
+ * to home than the key would be.  The table doubles when it is 7/8 full.
+ *
+ * Keys are ordered pairs of words compared in full, so two different
+ * pairs never share an entry.  Single-word keys are stored as (key, 0).
+ */
+
+const unsigned long INITIAL_CAPACITY = 0x100; // must be a power of 2
+
+struct map_entry {
+  unsigned long key;
+  unsigned long key2;
+  any_t value;
+  unsigned long dist; // 1 + distance from the home slot, 0 if empty
+};
+
+struct cpp_map_t {
+  map_entry *slots;
+  unsigned long capacity;
+  unsigned long size;
+};
+
+static inline uint64_t mix(uint64_t h) {
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ULL;
+  h ^= h >> 33;
+  return h;
+}
 
-const unsigned long INITIAL_SIZE = 0x4;
+/*
+ * Keys may be hashes or pointers, so mix them before taking the low bits.
+ * The second word is mixed on its own first so that (a, b) and (b, a)
+ * land in different places.
+ */
+static inline unsigned long home_slot(const cpp_map_t *m, unsigned long key,
+                                      unsigned long key2) {
+  uint64_t h = mix((uint64_t)key ^ mix((uint64_t)key2 + 0x9e3779b97f4a7c15ULL));
+  return (unsigned long)h & (m->capacity - 1);
+}
+
+static bool allocate_slots(cpp_map_t *m, unsigned long capacity) {
+  map_entry *slots = (map_entry *)calloc(capacity, sizeof(map_entry));
+  if (slots == nullptr)
+    return false;
+  m->slots = slots;
+  m->capacity = capacity;
+  m->size = 0;
+  return true;
+}
+
+/* Insert a key known not to be in the table, which has room for it */
+static void insert_new(cpp_map_t *m, unsigned long key, unsigned long key2,
+                       any_t value) {
+  map_entry e = { key, key2, value, 1 };
+  unsigned long mask = m->capacity - 1;
+  for (unsigned long i = home_slot(m, key, key2);; i = (i + 1) & mask) {
+    map_entry &slot = m->slots[i];
+    if (slot.dist == 0) {
+      slot = e;
+      m->size++;
+      return;
+    }
+    if (slot.dist < e.dist) {
+      map_entry displaced = slot;
+      slot = e;
+      e = displaced;
+    }
+    e.dist++;
+  }
+}
 
-const unsigned long BASE_ITEMS = 0x100; // this value might need to be tweaked
-const unsigned long MASK = (BASE_ITEMS -1);
+static bool grow(cpp_map_t *m) {
+  map_entry *old_slots = m->slots;
+  unsigned long old_capacity = m->capacity;
+  if (!allocate_slots(m, 2 * old_capacity)) {
+    m->slots = old_slots;
+    return false;
+  }
+  for (unsigned long i = 0; i < old_capacity; i++) {
+    if (old_slots[i].dist != 0)
+      insert_new(m, old_slots[i].key, old_slots[i].key2,
+                 old_slots[i].value);
+  }
+  free(old_slots);
+  return true;
+}
 
-typedef boost::container::small_vector<boost::container::small_vector<pair<unsigned long, any_t>, INITIAL_SIZE>, BASE_ITEMS> cpp_map_t;
+static map_entry *find(const cpp_map_t *m, unsigned long key,
+                       unsigned long key2) {
+  unsigned long mask = m->capacity - 1;
+  unsigned long dist = 1;
+  for (unsigned long i = home_slot(m, key, key2);; i = (i + 1) & mask, dist++) {
+    map_entry &slot = m->slots[i];
+    if (slot.dist < dist)
+      return nullptr; // empty, or the key would have displaced this entry
+    if (slot.key == key && slot.key2 == key2)
+      return &slot;
+  }
+}
 
 /*
  * Return an empty hashmap, or NULL on failure.
  */
 map_t hashmap_new() {
-  // TODO: free
-  cpp_map_t* vec = new cpp_map_t();
-  vec->resize(BASE_ITEMS);
-  return vec;
+  cpp_map_t *m = (cpp_map_t *)malloc(sizeof(cpp_map_t));
+  if (m == nullptr)
+    return nullptr;
+  if (!allocate_slots(m, INITIAL_CAPACITY)) {
+    free(m);
+    return nullptr;
+  }
+  return m;
 }
 
-// TODO: free after simulation terminates
+/*
+ * Remove all elements, giving back the memory of a grown table.
+ */
 void hashmap_clear(map_t in) {
-  // TODO: free
-  //delete ((cpp_map_t*)in);
-  ((cpp_map_t*)in)->clear();
+  cpp_map_t *m = (cpp_map_t *)in;
+  if (m == nullptr)
+    return;
+  if (m->capacity != INITIAL_CAPACITY) {
+    map_entry *slots = (map_entry *)realloc(
+        m->slots, INITIAL_CAPACITY * sizeof(map_entry));
+    if (slots != nullptr) {
+      m->slots = slots;
+      m->capacity = INITIAL_CAPACITY;
+    }
+  }
+  memset(m->slots, 0, m->capacity * sizeof(map_entry));
+  m->size = 0;
 }
 
-int hashmap_put_nohash(map_t in, unsigned long key, unsigned long key_hash, any_t value) {
-  assert(in != nullptr);
-  assert(key == key_hash);
-
-  cpp_map_t* m = (cpp_map_t*)in;
-
-  ((*m)[key_hash & MASK]).push_back( pair<unsigned long, any_t>(key_hash, value));
-
-  return 0; // ignored
+void hashmap_free(map_t in) {
+  cpp_map_t *m = (cpp_map_t *)in;
+  if (m == nullptr)
+    return;
+  free(m->slots);
+  free(m);
 }
 
-int hashmap_get_nohash(map_t in, unsigned long key, unsigned long key_hash, any_t* value) {
+/*
+ * Add a value under the key (key, key2).  If the key is already present,
+ * its first value is kept, as lookups always returned the first one.
+ */
+int hashmap_put_pair(map_t in, unsigned long key, unsigned long key2, any_t value) {
   assert(in != nullptr);
-  assert(key == key_hash);
-  cpp_map_t* m = (cpp_map_t*)in;
+  cpp_map_t *m = (cpp_map_t *)in;
 
-  const auto& internal_vec = ((*m)[key_hash & MASK]);
+  if (find(m, key, key2) != nullptr)
+    return MAP_OK;
+  if (8 * (m->size + 1) > 7 * m->capacity && !grow(m))
+    return MAP_OMEM;
+  insert_new(m, key, key2, value);
+  return MAP_OK;
+}
 
-  size_t sz = internal_vec.size();
+int hashmap_get_pair(map_t in, unsigned long key, unsigned long key2, any_t* value) {
+  assert(in != nullptr);
+  const cpp_map_t *m = (const cpp_map_t *)in;
 
-  if (sz == 1 && internal_vec[0].first == key_hash) {
-    *value = internal_vec[0].second;
-    return MAP_OK;
-  }
-  else if (sz == 0) {
+  const map_entry *e = find(m, key, key2);
+  if (e == nullptr)
     return MAP_MISSING;
-  }
-  else {
-    for (const auto& item: internal_vec) {
-      if (item.first == key_hash) {
-        *value = item.second;
-        return MAP_OK;
-      }
-    }
-    return MAP_MISSING;
-  }
+  *value = e->value;
+  return MAP_OK;
 }
 
-#if 0
-// the most versatile solution with also good performance
-typedef boost::container::flat_map<unsigned long, any_t> cpp_map_t;
-//typedef boost::container::map<unsigned long, any_t> cpp_map_t;
-
 /*
- * Return an empty hashmap, or NULL on failure.
+ * Remove the key (key, key2).  Entries after it that are away from their
+ * home slot shift back by one, so no tombstones are left behind.
  */
-map_t hashmap_new() {
-  // TODO: free
-  return (map_t) new cpp_map_t();
-}
+int hashmap_remove_pair(map_t in, unsigned long key, unsigned long key2) {
+  assert(in != nullptr);
+  cpp_map_t *m = (cpp_map_t *)in;
 
-void hashmap_clear(map_t in) {
-  // TODO: free
-  //delete ((cpp_map_t*)in);
-  ((cpp_map_t*)in)->clear();
+  map_entry *e = find(m, key, key2);
+  if (e == nullptr)
+    return MAP_MISSING;
+  unsigned long mask = m->capacity - 1;
+  unsigned long i = (unsigned long)(e - m->slots);
+  for (;;) {
+    unsigned long next = (i + 1) & mask;
+    if (m->slots[next].dist <= 1)
+      break;
+    m->slots[i] = m->slots[next];
+    m->slots[i].dist--;
+    i = next;
+  }
+  memset(&m->slots[i], 0, sizeof(map_entry));
+  m->size--;
+  return MAP_OK;
 }
 
 int hashmap_put_nohash(map_t in, unsigned long key, unsigned long key_hash, any_t value) {
-  assert(in != nullptr);
   assert(key == key_hash);
-  cout << "INS 0x" << hex << key_hash << "\n";
-  ((cpp_map_t*)in)->insert( pair<unsigned long, any_t>(key_hash, value));
-  return 0; // ignored
+  return hashmap_put_pair(in, key, 0, value);
 }
 
 int hashmap_get_nohash(map_t in, unsigned long key, unsigned long key_hash, any_t* value) {
-  assert(in != nullptr);
   assert(key == key_hash);
-  cpp_map_t* m = ((cpp_map_t*)in);
+  return hashmap_get_pair(in, key, 0, value);
+}
 
-  auto it = m->find(key);
-  if (it != m->end()) {
-    *value = it->second;
-    return MAP_OK;
-  }
-  else {
-    return MAP_MISSING;
+void hashmap_get_stats(map_t in, struct hashmap_stats *stats) {
+  memset(stats, 0, sizeof(struct hashmap_stats));
+  const cpp_map_t *m = (const cpp_map_t *)in;
+  if (m == nullptr)
+    return;
+
+  stats->n_items = m->size;
+  stats->capacity = m->capacity;
+  unsigned long long total_dist = 0;
+  for (unsigned long i = 0; i < m->capacity; i++) {
+    unsigned long dist = m->slots[i].dist;
+    if (dist == 0)
+      continue;
+    total_dist += dist;
+    if (dist > stats->max_probe)
+      stats->max_probe = dist;
   }
+  if (m->size > 0)
+    stats->mean_probe = (double)total_dist / (double)m->size;
 }
 
-#endif
-
 
 /* The implementation here was originally done by Gary S. Brown.  I have
    borrowed the tables directly, and made some minor changes to the
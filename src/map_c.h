@@ -27,7 +27,7 @@
 
 #define MAP_MISSING -3  /* No such element */
 //#define MAP_FULL -2   /* Hashmap is full */
-//#define MAP_OMEM -1   /* Out of Memory */
+#define MAP_OMEM -1   /* Out of Memory */
 #define MAP_OK 0  /* OK */
 
 /*
@@ -49,6 +49,17 @@ typedef int (*PFany)(any_t, any_t);
  */
 typedef any_t map_t;
 
+/*
+ * Load of a hashmap: mean_probe is the average number of slots a lookup
+ * of a present key examines, max_probe the largest.
+ */
+struct hashmap_stats {
+  unsigned long n_items;
+  unsigned long capacity;
+  unsigned long max_probe;
+  double mean_probe;
+};
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -59,12 +70,23 @@ extern "C" {
 map_t hashmap_new(void);
 
 void hashmap_clear(map_t in);
+void hashmap_free(map_t in);
+void hashmap_get_stats(map_t in, struct hashmap_stats *stats);
 
 
 //JJT: simplified functions without hash calculation (it is precalculated)
 int hashmap_put_nohash(map_t in, unsigned long key, unsigned long key_hash, any_t value);
 int hashmap_get_nohash(map_t in, unsigned long key, unsigned long key_hash, any_t *arg);
 
+/*
+ * Keyed on the ordered pair (key, key2), both compared exactly.  A map
+ * should use either these or the single-key functions, whose keys are
+ * stored as (key, 0).
+ */
+int hashmap_put_pair(map_t in, unsigned long key, unsigned long key2, any_t value);
+int hashmap_get_pair(map_t in, unsigned long key, unsigned long key2, any_t *arg);
+int hashmap_remove_pair(map_t in, unsigned long key, unsigned long key2);
+
 unsigned long crc32(const unsigned char *s, unsigned int len);
 
 #ifdef __cplusplus
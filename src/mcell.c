@@ -25,10 +25,12 @@
 
 #include <stdlib.h>
 
+#include "logging.h"
 #include "mcell_init.h"
 #include "mcell_misc.h"
 #include "mcell_run.h"
 #include "init.h"
+#include "mpi_util.h"
 
 #define CHECKED_CALL_EXIT(function, error_message)                             \
   {                                                                            \
@@ -39,12 +41,14 @@
   }
 
 int main(int argc, char **argv) {
-  u_int procnum = 0;
-
   // initialize the mcell simulation
   MCELL_STATE *state = mcell_create();
   CHECKED_CALL_EXIT(!state, "Failed to initialize MCell simulation.");
 
+  // find out which MPI rank this is, if any
+  mpi_start(state, &argc, &argv);
+  u_int procnum = state->procnum;
+
   // Parse the command line arguments and print out errors if necessary.
   if (mcell_argparse(argc, argv, state)) {
     if (procnum == 0) {
@@ -93,8 +97,11 @@ int main(int argc, char **argv) {
   CHECKED_CALL_EXIT(mcell_init_output(state),
                     "An error occured during setting up of output.");
 
+  // keep warnings from the iterations off the simulation's critical path
+  mcell_log_async_start();
   CHECKED_CALL_EXIT(mcell_run_simulation(state),
                     "Error running mcell simulation.");
+  mcell_log_async_stop();
 
   if (state->notify->progress_report != NOTIFY_NONE) {
     mcell_print("Done running.");
@@ -102,5 +109,6 @@ int main(int argc, char **argv) {
 
   mcell_print_stats();
 
+  mpi_stop();
   exit(0);
 }
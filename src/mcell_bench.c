@@ -0,0 +1,1227 @@
+/******************************************************************************
+ *
+ * Copyright (C) 2006-2017 by
+ * The Salk Institute for Biological Studies and
+ * Pittsburgh Supercomputing Center, Carnegie Mellon University
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ *
+******************************************************************************/
+
+/**************************************************************************\
+** File: mcell_bench.c                                                    **
+**                                                                        **
+** Purpose: Performance benchmarks of the engine on synthetic models that **
+**    are built through the libmcell API.  Every model scales its         **
+**    molecule and wall counts with -s, and reports iterations per        **
+**    second, wall-clock nanoseconds per diffusion step and peak memory,  **
+**    so that regressions can be compared between builds.  With -k, the   **
+**    hottest kernels are timed on their own over randomized inputs.      **
+\**************************************************************************/
+
+#include "config.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#ifdef __linux__
+#include <sched.h>
+#endif
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "mcell_structs.h"
+#include "mcell_init.h"
+#include "mcell_misc.h"
+#include "mcell_objects.h"
+#include "mcell_react_out.h"
+#include "mcell_reactions.h"
+#include "mcell_release.h"
+#include "mcell_species.h"
+#include "mcell_viz.h"
+#include "mcell_dyngeom.h"
+#include "mcell_run.h"
+#include "diffuse.h"
+#include "mem_util.h"
+#include "react.h"
+#include "rng.h"
+#include "vector.h"
+#include "vol_util.h"
+#include "wall_util.h"
+
+#define BENCH_OUTPUT_DIR "mcell_bench_output"
+#define BENCH_TIME_STEP 1e-6
+#define BENCH_HALF_SIDE 1.0 /* half the side of the model box, in microns */
+
+#define CHECKED_CALL_EXIT(function, error_message)                             \
+  {                                                                            \
+    if (function) {                                                            \
+      mcell_print(error_message);                                              \
+      exit(1);                                                                 \
+    }                                                                          \
+  }
+
+/* A box mesh as plain arrays, kept for the models that move it */
+struct bench_mesh {
+  int n_verts;
+  double *verts;
+  int n_faces;
+  int *faces;
+};
+
+struct bench_model {
+  char const *name;
+  char const *description;
+  double partition_step; /* in microns */
+  /* Add the model to a state which has a world object */
+  void (*build)(struct volume *state, struct object *world, double scale);
+  /* Called before every iteration, or NULL */
+  void (*step)(struct volume *state, long long iteration);
+};
+
+static struct bench_mesh box_mesh;
+
+/***************************************************************************
+box_vertex:
+  In: mesh: mesh being built
+      index: lattice index of every vertex so far, -1 if not yet created
+      n: number of divisions of a side
+      i, j, k: lattice coordinates of the vertex
+  Out: index of the vertex at (i, j, k) of the box, created if needed
+***************************************************************************/
+static int box_vertex(struct bench_mesh *mesh, int *index, int n, int i,
+                      int j, int k) {
+  int *slot = &index[(i * (n + 1) + j) * (n + 1) + k];
+  if (*slot < 0) {
+    double *v = &mesh->verts[3 * mesh->n_verts];
+    v[0] = BENCH_HALF_SIDE * (2.0 * i / n - 1.0);
+    v[1] = BENCH_HALF_SIDE * (2.0 * j / n - 1.0);
+    v[2] = BENCH_HALF_SIDE * (2.0 * k / n - 1.0);
+    *slot = mesh->n_verts++;
+  }
+  return *slot;
+}
+
+/***************************************************************************
+make_box_mesh:
+  In: mesh: mesh to fill in
+      n: number of divisions of each side of the box
+  Out: a closed, outward facing box with 12 n^2 walls is stored in mesh
+***************************************************************************/
+static void make_box_mesh(struct bench_mesh *mesh, int n) {
+  int n_lattice = (n + 1) * (n + 1) * (n + 1);
+  int *index = (int *)malloc(n_lattice * sizeof(int));
+  mesh->verts = (double *)malloc(3 * (6 * (n + 1) * (n + 1)) * sizeof(double));
+  mesh->faces = (int *)malloc(3 * 12 * n * n * sizeof(int));
+  if (index == NULL || mesh->verts == NULL || mesh->faces == NULL) {
+    mcell_print("Out of memory while building the benchmark mesh.");
+    exit(1);
+  }
+  memset(index, -1, n_lattice * sizeof(int));
+  mesh->n_verts = 0;
+  mesh->n_faces = 0;
+
+  for (int axis = 0; axis < 3; axis++) {
+    for (int side = 0; side <= n; side += n) {
+      for (int a = 0; a < n; a++) {
+        for (int b = 0; b < n; b++) {
+          /* Corners of the cell; u = axis + 1 and v = axis + 2 (mod 3) make
+           * u x v point along +axis */
+          int corner[4];
+          for (int c = 0; c < 4; c++) {
+            int ijk[3];
+            ijk[axis] = side;
+            ijk[(axis + 1) % 3] = a + (c == 1 || c == 2);
+            ijk[(axis + 2) % 3] = b + (c >= 2);
+            corner[c] = box_vertex(mesh, index, n, ijk[0], ijk[1], ijk[2]);
+          }
+          int order[2][3] = { { 0, 1, 2 }, { 0, 2, 3 } };
+          for (int t = 0; t < 2; t++) {
+            int *f = &mesh->faces[3 * mesh->n_faces++];
+            f[0] = corner[order[t][0]];
+            f[1] = corner[order[t][side == 0 ? 2 : 1]];
+            f[2] = corner[order[t][side == 0 ? 1 : 2]];
+          }
+        }
+      }
+    }
+  }
+  free(index);
+}
+
+/***************************************************************************
+add_box:
+  In: state: simulation state
+      world: world object
+      n: number of divisions of each side
+  Out: the box "world.box" is added and returned; its mesh stays in box_mesh
+***************************************************************************/
+static struct object *add_box(struct volume *state, struct object *world,
+                              int n) {
+  make_box_mesh(&box_mesh, n);
+  struct object *box = NULL;
+  CHECKED_CALL_EXIT(mcell_create_poly_object_from_arrays(
+                        state, world, "box", box_mesh.n_verts, box_mesh.verts,
+                        box_mesh.n_faces, box_mesh.faces, &box),
+                    "Failed to create the benchmark box.");
+  return box;
+}
+
+static mcell_symbol *add_species(struct volume *state, char const *name,
+                                 double D, int is_2d) {
+  struct mcell_species_spec spec = { name, D, is_2d, 0.0, 0, 0.0, 0.0, 0 };
+  mcell_symbol *sym = NULL;
+  CHECKED_CALL_EXIT(mcell_create_species(state, &spec, &sym),
+                    "Failed to create a benchmark species.");
+  return sym;
+}
+
+/***************************************************************************
+add_reaction:
+  In: state: simulation state
+      reactants: reactant list, which is freed
+      products: product list, which is freed
+      forward: forward rate constant
+      backward: backward rate constant, or 0 for an irreversible reaction
+  Out: the reaction is added or the benchmark exits
+***************************************************************************/
+static void add_reaction(struct volume *state, struct mcell_species *reactants,
+                         struct mcell_species *products, double forward,
+                         double backward) {
+  struct mcell_species *surfs = mcell_add_to_species_list(NULL, false, 0, NULL);
+  struct reaction_arrow arrow = { REGULAR_ARROW, { NULL, NULL, 0, 0 } };
+  struct reaction_rates rates =
+      mcell_create_reaction_rates(RATE_CONSTANT, forward, RATE_UNSET, 0.0);
+  if (backward > 0) {
+    arrow.flags = ARROW_BIDIRECTIONAL;
+    rates = mcell_create_reaction_rates(RATE_CONSTANT, forward, RATE_CONSTANT,
+                                        backward);
+  }
+  CHECKED_CALL_EXIT(mcell_add_reaction(state->notify, &state->r_step_release,
+                                       state->rxn_sym_table,
+                                       state->radial_subdivisions,
+                                       state->vacancy_search_dist2, reactants,
+                                       &arrow, surfs, products, NULL, &rates,
+                                       NULL, NULL),
+                    "Failed to create a benchmark reaction.");
+  mcell_delete_species_list(reactants);
+  mcell_delete_species_list(products);
+  mcell_delete_species_list(surfs);
+}
+
+/* Release n volume molecules in a shape of the given size centered in the
+ * box */
+static void release_volume(struct volume *state, struct object *world,
+                           char const *site_name, mcell_symbol *sym, double n,
+                           int shape, double size) {
+  /* The release site keeps the position, so it may not live on the stack */
+  struct vector3 *position =
+      (struct vector3 *)calloc(1, sizeof(struct vector3));
+  if (position == NULL)
+    exit(1);
+  struct vector3 diameter = { size, size, size };
+  struct mcell_species *mol = mcell_add_to_species_list(sym, false, 0, NULL);
+  struct object *site = NULL;
+  CHECKED_CALL_EXIT(mcell_create_geometrical_release_site(
+                        state, world, site_name, shape, position, &diameter,
+                        mol, n, 0, 1, NULL, &site),
+                    "Failed to create a benchmark release site.");
+  mcell_delete_species_list(mol);
+}
+
+/* Release n volume molecules in a sphere filling most of the box */
+static void release_in_box(struct volume *state, struct object *world,
+                           char const *site_name, mcell_symbol *sym,
+                           double n) {
+  release_volume(state, world, site_name, sym, n, SHAPE_SPHERICAL,
+                 1.5 * BENCH_HALF_SIDE);
+}
+
+/* Release n surface molecules facing out of the box */
+static void release_on_box(struct volume *state, struct object *world,
+                           struct object *box, char *site_name,
+                           mcell_symbol *sym, double n) {
+  struct mcell_species *mol = mcell_add_to_species_list(sym, true, 1, NULL);
+  struct object *site = NULL;
+  CHECKED_CALL_EXIT(mcell_create_region_release(state, world, box, site_name,
+                                                "ALL", mol, n, 0, 1, NULL,
+                                                &site),
+                    "Failed to create a benchmark surface release.");
+  mcell_delete_species_list(mol);
+}
+
+/***************************************************************************
+ * Models
+ ***************************************************************************/
+
+/* Free 3D diffusion inside a box */
+static void build_diffusion(struct volume *state, struct object *world,
+                            double scale) {
+  add_box(state, world, 1);
+  mcell_symbol *a = add_species(state, "A", 1e-6, 0);
+  release_in_box(state, world, "A_release", a, 20000 * scale);
+}
+
+/* A dense, reversible A + B <-> C */
+static void build_bimolecular(struct volume *state, struct object *world,
+                              double scale) {
+  add_box(state, world, 1);
+  mcell_symbol *a = add_species(state, "A", 1e-6, 0);
+  mcell_symbol *b = add_species(state, "B", 1e-6, 0);
+  mcell_symbol *c = add_species(state, "C", 5e-7, 0);
+  struct mcell_species *reactants = mcell_add_to_species_list(a, false, 0, NULL);
+  reactants = mcell_add_to_species_list(b, false, 0, reactants);
+  add_reaction(state, reactants, mcell_add_to_species_list(c, false, 0, NULL),
+               1e8, 1e4);
+  release_in_box(state, world, "A_release", a, 10000 * scale);
+  release_in_box(state, world, "B_release", b, 10000 * scale);
+}
+
+/* A crowded field of diffusing receptors binding a ligand from inside */
+static void build_receptors(struct volume *state, struct object *world,
+                            double scale) {
+  struct object *box = add_box(state, world, 4);
+  mcell_symbol *l = add_species(state, "L", 1e-6, 0);
+  mcell_symbol *r = add_species(state, "R", 1e-8, 1);
+  mcell_symbol *lr = add_species(state, "LR", 1e-8, 1);
+  struct mcell_species *reactants = mcell_add_to_species_list(r, true, 1, NULL);
+  reactants = mcell_add_to_species_list(l, true, -1, reactants);
+  add_reaction(state, reactants, mcell_add_to_species_list(lr, true, 1, NULL),
+               1e7, 1e3);
+  release_on_box(state, world, box, "R_release", r, 50000 * scale);
+  release_in_box(state, world, "L_release", l, 5000 * scale);
+}
+
+/* Volume molecules in a finely tessellated box, with coarse partitions so
+ * that the subvolumes on its surface hold many walls each */
+static void build_big_mesh(struct volume *state, struct object *world,
+                           double scale) {
+  add_box(state, world, (int)ceil(32 * sqrt(scale)));
+  mcell_symbol *a = add_species(state, "A", 1e-6, 0);
+  release_in_box(state, world, "A_release", a, 10000 * scale);
+}
+
+/* A reversible A + B + C <-> D */
+static void build_trimolecular(struct volume *state, struct object *world,
+                               double scale) {
+  add_box(state, world, 1);
+  mcell_symbol *a = add_species(state, "A", 1e-6, 0);
+  mcell_symbol *b = add_species(state, "B", 1e-6, 0);
+  mcell_symbol *c = add_species(state, "C", 1e-6, 0);
+  mcell_symbol *d = add_species(state, "D", 5e-7, 0);
+  struct mcell_species *reactants = mcell_add_to_species_list(a, false, 0, NULL);
+  reactants = mcell_add_to_species_list(b, false, 0, reactants);
+  reactants = mcell_add_to_species_list(c, false, 0, reactants);
+  add_reaction(state, reactants, mcell_add_to_species_list(d, false, 0, NULL),
+               1e16, 1e4);
+  release_in_box(state, world, "A_release", a, 5000 * scale);
+  release_in_box(state, world, "B_release", b, 5000 * scale);
+  release_in_box(state, world, "C_release", c, 5000 * scale);
+}
+
+/* Volume molecules in a box that breathes every iteration */
+static void build_dynamic_geometry(struct volume *state, struct object *world,
+                                   double scale) {
+  add_box(state, world, (int)ceil(4 * sqrt(scale)));
+  mcell_symbol *a = add_species(state, "A", 1e-6, 0);
+  release_in_box(state, world, "A_release", a, 10000 * scale);
+}
+
+static void step_dynamic_geometry(struct volume *state, long long iteration) {
+  double f = 1.0 + 0.05 * sin(2.0 * MY_PI * (double)iteration / 50.0);
+  double *xyz = (double *)malloc(3 * box_mesh.n_verts * sizeof(double));
+
+  if (xyz == NULL) {
+    mcell_print("Out of memory while moving the benchmark mesh.");
+    exit(1);
+  }
+  for (int i = 0; i < 3 * box_mesh.n_verts; i++)
+    xyz[i] = f * box_mesh.verts[i];
+  CHECKED_CALL_EXIT(mcell_move_mesh_vertices(state, "world.box",
+                                             box_mesh.n_verts, xyz),
+                    "Failed to move the benchmark mesh.");
+  free(xyz);
+}
+
+#define N_OUTPUT_SPECIES 8
+
+/* A ring of unimolecular conversions, every species counted and visualized
+ * on every iteration */
+static void build_output(struct volume *state, struct object *world,
+                         double scale) {
+  struct object *box = add_box(state, world, 1);
+  mcell_symbol *x[N_OUTPUT_SPECIES];
+  for (int i = 0; i < N_OUTPUT_SPECIES; i++) {
+    char name[16];
+    snprintf(name, sizeof(name), "X%d", i);
+    x[i] = add_species(state, name, 1e-6, 0);
+  }
+
+  struct output_set *sets = NULL;
+  struct mcell_species *viz_list = NULL;
+  for (int i = 0; i < N_OUTPUT_SPECIES; i++) {
+    char site_name[32], file_name[64];
+    add_reaction(state, mcell_add_to_species_list(x[i], false, 0, NULL),
+                 mcell_add_to_species_list(x[(i + 1) % N_OUTPUT_SPECIES], false,
+                                           0, NULL),
+                 1e4, 0);
+    snprintf(site_name, sizeof(site_name), "X%d_release", i);
+    release_in_box(state, world, site_name, x[i], 2500 * scale);
+
+    for (int where = 0; where < 2; where++) {
+      struct output_column_list count_list;
+      int report_flags = REPORT_CONTENTS | (where ? 0 : REPORT_WORLD);
+      CHECKED_CALL_EXIT(mcell_create_count(state, x[i], ORIENT_NOT_SET,
+                                           where ? box->sym : NULL,
+                                           report_flags, NULL, &count_list),
+                        "Failed to create a benchmark count.");
+      snprintf(file_name, sizeof(file_name), "%s/react_data/X%d.%s.dat",
+               BENCH_OUTPUT_DIR, i, where ? "box" : "world");
+      struct output_set *os = mcell_create_new_output_set(
+          NULL, 0, count_list.column_head, FILE_SUBSTITUTE, file_name);
+      if (os == NULL)
+        exit(1);
+      os->next = sets;
+      sets = os;
+    }
+    viz_list = mcell_add_to_species_list(x[i], false, 0, viz_list);
+  }
+
+  struct output_times_inlist times;
+  times.type = OUTPUT_BY_STEP;
+  times.step = BENCH_TIME_STEP;
+  struct output_set_list output = { sets, sets };
+  CHECKED_CALL_EXIT(
+      mcell_add_reaction_output_block(state, &output, 10000, &times),
+      "Failed to create the benchmark reaction output.");
+  CHECKED_CALL_EXIT(mcell_create_viz_output(state,
+                                            BENCH_OUTPUT_DIR "/viz_data/bench",
+                                            viz_list, 0, state->iterations, 1),
+                    "Failed to create the benchmark viz output.");
+  mcell_delete_species_list(viz_list);
+}
+
+static struct bench_model models[] = {
+  { "diffusion", "free 3D diffusion", 0.1, build_diffusion, NULL },
+  { "bimolecular", "dense A + B <-> C", 0.1, build_bimolecular, NULL },
+  { "receptors", "crowded surface receptor field", 0.1, build_receptors,
+    NULL },
+  { "big_mesh", "many walls per subvolume", 0.5, build_big_mesh, NULL },
+  { "trimolecular", "A + B + C <-> D", 0.1, build_trimolecular, NULL },
+  { "dynamic_geometry", "box moved every iteration", 0.1,
+    build_dynamic_geometry, step_dynamic_geometry },
+  { "output", "COUNT and viz output every iteration", 0.1, build_output,
+    NULL },
+};
+#define N_MODELS ((int)(sizeof(models) / sizeof(models[0])))
+
+static double bench_clock(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + 1e-9 * (double)ts.tv_nsec;
+}
+
+/***************************************************************************
+create_model_state:
+  In: model: model to build
+      scale: factor for the molecule and wall counts of the model
+      iterations: number of iterations to run
+      threads: number of threads to run the memory partitions on
+      setup_seconds: set to the time taken to initialize the simulation
+  Out: the initialized simulation state of the model, ready to run its
+       first iteration.  The benchmark exits on failure.
+***************************************************************************/
+static struct volume *create_model_state(struct bench_model *model,
+                                         double scale, long long iterations,
+                                         int threads, double *setup_seconds) {
+  struct volume *state = mcell_create();
+  if (state == NULL)
+    exit(1);
+  state->quiet_flag = 1;
+  state->num_threads = threads;
+  CHECKED_CALL_EXIT(mcell_init_state(state),
+                    "Failed to set up the initial simulation state.");
+  CHECKED_CALL_EXIT(mcell_set_time_step(state, BENCH_TIME_STEP),
+                    "Failed to set the time step.");
+  CHECKED_CALL_EXIT(mcell_set_iterations(state, iterations),
+                    "Failed to set the iterations.");
+
+  struct num_expr_list_head list = { NULL, NULL, 0, 1 };
+  double edge = 1.2 * BENCH_HALF_SIDE;
+  mcell_generate_range(&list, -edge, edge, model->partition_step);
+  list.shared = 1;
+  CHECKED_CALL_EXIT(mcell_set_partition(state, X_PARTS, &list),
+                    "Failed to set the X partitions.");
+  CHECKED_CALL_EXIT(mcell_set_partition(state, Y_PARTS, &list),
+                    "Failed to set the Y partitions.");
+  CHECKED_CALL_EXIT(mcell_set_partition(state, Z_PARTS, &list),
+                    "Failed to set the Z partitions.");
+
+  struct object *world = NULL;
+  CHECKED_CALL_EXIT(mcell_create_instance_object(state, "world", &world),
+                    "Failed to create the world object.");
+  model->build(state, world, scale);
+
+  double setup_start = bench_clock();
+  CHECKED_CALL_EXIT(mcell_init_simulation(state),
+                    "Failed to initialize the simulation.");
+  CHECKED_CALL_EXIT(mcell_init_read_checkpoint(state),
+                    "Failed to initialize the checkpoint state.");
+  CHECKED_CALL_EXIT(mcell_init_output(state), "Failed to set up the output.");
+  *setup_seconds = bench_clock() - setup_start;
+  return state;
+}
+
+/***************************************************************************
+run_model:
+  In: model: model to run
+      scale: factor for the molecule and wall counts of the model
+      iterations: number of iterations to time
+      threads: number of threads to run the memory partitions on
+      sort_interval: iterations between sorting the molecules in memory
+      sort_slots: set to run the molecules of each timestep by subvolume
+  Out: 0 on success, 1 on failure.  One line of results is printed.
+***************************************************************************/
+static int run_model(struct bench_model *model, double scale,
+                     long long iterations, int threads, int sort_interval,
+                     int sort_slots) {
+  double setup_seconds;
+  struct volume *state =
+      create_model_state(model, scale, iterations, threads, &setup_seconds);
+  state->sort_interval = sort_interval;
+  state->sort_slots = sort_slots;
+  double run_start = bench_clock();
+
+  int restarted = 0;
+  while (state->current_iterations <= state->iterations) {
+    if (model->step != NULL && state->current_iterations > 0)
+      model->step(state, state->current_iterations);
+    if (mcell_run_iteration(state, 1, &restarted) == 1)
+      break;
+  }
+  if (mcell_flush_data(state))
+    return 1;
+  double run_end = bench_clock();
+
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  double seconds = run_end - run_start;
+  struct sim_stats stats;
+  mcell_get_statistics(state, &stats);
+  printf("%-18s %6.2f %9d %12lld %10.1f %12.1f %9.2f %9.1f %9.1f\n",
+         model->name, scale, box_mesh.n_faces, stats.diffusion_number,
+         iterations / seconds,
+         stats.diffusion_number > 0
+             ? 1e9 * seconds / (double)stats.diffusion_number
+             : 0.0,
+         setup_seconds, mcell_get_total_pool_memory() / 1048576.0,
+         usage.ru_maxrss / 1024.0);
+  fflush(stdout);
+  return 0;
+}
+
+/***************************************************************************
+ * Kernel micro-benchmarks
+ *
+ * The kernels are called directly on a small world of molecules in a
+ * tessellated box, with inputs drawn beforehand so that only the kernel is
+ * timed.
+ ***************************************************************************/
+
+#define KERNEL_INPUTS 65536 /* power of 2 */
+
+struct kernel_input {
+  struct volume_molecule *a; /* moving molecule */
+  struct volume_molecule *b; /* target molecule */
+  struct wall *w;
+  struct vector3 point;
+  struct vector3 move;
+};
+
+struct bench_kernel {
+  char const *name;
+  char const *description;
+  void (*make_input)(struct volume *state, struct kernel_input *in);
+  /* Run the kernel once, returning nonzero for a hit */
+  int (*run)(struct volume *state, struct kernel_input *in);
+};
+
+/* All volume molecules, and every one of them in a subvolume with walls
+ * first; half of the inputs start from the latter */
+static struct volume_molecule **kernel_mols;
+static int n_kernel_mols;
+static int n_kernel_wall_mols;
+static struct object *kernel_box;
+
+static void build_kernel_world(struct volume *state, struct object *world,
+                               double scale) {
+  kernel_box = add_box(state, world, (int)ceil(8 * sqrt(scale)));
+  mcell_symbol *a = add_species(state, "A", 1e-6, 0);
+  mcell_symbol *b = add_species(state, "B", 1e-6, 0);
+  mcell_symbol *c = add_species(state, "C", 1e-6, 0);
+  struct mcell_species *reactants = mcell_add_to_species_list(a, false, 0, NULL);
+  reactants = mcell_add_to_species_list(b, false, 0, reactants);
+  add_reaction(state, reactants, mcell_add_to_species_list(c, false, 0, NULL),
+               1e8, 0);
+  /* Right up to the walls, so that half of the inputs can start next to
+   * them */
+  release_volume(state, world, "A_release", a, 5000 * scale, SHAPE_CUBIC,
+                 1.98 * BENCH_HALF_SIDE);
+  release_volume(state, world, "B_release", b, 5000 * scale, SHAPE_CUBIC,
+                 1.98 * BENCH_HALF_SIDE);
+}
+
+static struct bench_model kernel_model = { "kernels", "kernel inputs", 0.1,
+                                           build_kernel_world, NULL };
+
+/* Collect every volume molecule of the world */
+static void collect_kernel_mols(struct volume *state) {
+  int n = 0;
+  for (int i = 0; i < state->n_subvols; i++)
+    for (struct per_species_list *psl = state->subvol[i].species_head;
+         psl != NULL; psl = psl->next)
+      n += psl->n_mols;
+  kernel_mols = (struct volume_molecule **)malloc(
+      (n > 0 ? n : 1) * sizeof(struct volume_molecule *));
+  if (kernel_mols == NULL)
+    exit(1);
+
+  n_kernel_mols = 0;
+  for (int with_walls = 1; with_walls >= 0; with_walls--) {
+    for (int i = 0; i < state->n_subvols; i++) {
+      struct subvolume *sv = &state->subvol[i];
+      if ((sv->wall_head != NULL) != with_walls)
+        continue;
+      for (struct per_species_list *psl = sv->species_head; psl != NULL;
+           psl = psl->next)
+        for (int m = 0; m < psl->n_mols; m++)
+          kernel_mols[n_kernel_mols++] = psl->mols[m];
+    }
+    if (with_walls)
+      n_kernel_wall_mols = n_kernel_mols;
+  }
+  if (n_kernel_wall_mols == 0)
+    n_kernel_wall_mols = n_kernel_mols;
+  if (n_kernel_mols < 2) {
+    mcell_print("Too few molecules for the kernel benchmarks.");
+    exit(1);
+  }
+}
+
+static void random_direction(struct volume *state, double length,
+                             struct vector3 *v) {
+  double g[3];
+  rng_gauss_n(state->rng, g, 3);
+  double norm = sqrt(g[0] * g[0] + g[1] * g[1] + g[2] * g[2]);
+  if (norm == 0)
+    norm = 1;
+  v->x = length * g[0] / norm;
+  v->y = length * g[1] / norm;
+  v->z = length * g[2] / norm;
+}
+
+static struct volume_molecule *random_mol(struct volume *state) {
+  u_int r = rng_uint(state->rng);
+  u_int n = (r & 1) ? n_kernel_wall_mols : n_kernel_mols;
+  return kernel_mols[(r >> 1) % n];
+}
+
+/* A molecule and a target molecule of the same subvolume */
+static void random_mol_pair(struct volume *state, struct kernel_input *in) {
+  in->a = random_mol(state);
+  struct per_species_list *psl = in->a->subvol->species_head;
+  int n = 0;
+  for (struct per_species_list *p = psl; p != NULL; p = p->next)
+    n += p->n_mols;
+  int pick = (int)(rng_uint(state->rng) % (u_int)n);
+  for (; psl != NULL && pick >= psl->n_mols; psl = psl->next)
+    pick -= psl->n_mols;
+  in->b = psl->mols[pick];
+}
+
+/* Moves of two to three diffusion steps from where molecules are */
+static void make_ray_input(struct volume *state, struct kernel_input *in) {
+  in->a = random_mol(state);
+  in->point = in->a->pos;
+  random_direction(state,
+                   (2.0 + rng_dbl(state->rng)) * in->a->properties->space_step,
+                   &in->move);
+}
+
+static int run_ray_trace(struct volume *state, struct kernel_input *in) {
+  struct subvolume *sv = in->a->subvol;
+  int hit = 0;
+  for (struct collision *c =
+           ray_trace(state, &in->point, NULL, sv, &in->move, NULL);
+       c != NULL; c = c->next)
+    hit |= ((c->what & COLLIDE_WALL) != 0);
+  mem_arena_reset(sv->local_storage->coll);
+  return hit;
+}
+
+/* Moves toward a point near a wall, from up to a diffusion step away */
+static void make_wall_input(struct volume *state, struct kernel_input *in) {
+  in->w = kernel_box->wall_p[rng_uint(state->rng) % (u_int)kernel_box->n_walls];
+  double u = 1.4 * rng_dbl(state->rng) - 0.2;
+  double v = (1.4 - u) * rng_dbl(state->rng) - 0.2;
+  struct vector3 *v0 = in->w->vert[0], *v1 = in->w->vert[1],
+                 *v2 = in->w->vert[2];
+  struct vector3 target = { v0->x + u * (v1->x - v0->x) + v * (v2->x - v0->x),
+                            v0->y + u * (v1->y - v0->y) + v * (v2->y - v0->y),
+                            v0->z + u * (v1->z - v0->z) + v * (v2->z - v0->z) };
+  struct vector3 offset;
+  random_direction(state, 2e-3 / state->length_unit, &offset);
+  in->point.x = target.x + offset.x;
+  in->point.y = target.y + offset.y;
+  in->point.z = target.z + offset.z;
+  in->move.x = 2.0 * (target.x - in->point.x);
+  in->move.y = 2.0 * (target.y - in->point.y);
+  in->move.z = 2.0 * (target.z - in->point.z);
+}
+
+static int run_collide_wall(struct volume *state, struct kernel_input *in) {
+  double t;
+  struct vector3 hit;
+  return collide_wall(&in->point, &in->move, in->w, &t, &hit, 0, state->rng,
+                      state->notify, &state->stats.ray_polygon_tests) !=
+         COLLIDE_MISS;
+}
+
+/* Moves toward a target molecule, passing within a few interaction radii */
+static void make_mol_input(struct volume *state, struct kernel_input *in) {
+  random_mol_pair(state, in);
+  struct vector3 offset;
+  random_direction(state, 3.0 * state->rx_radius_3d * rng_dbl(state->rng),
+                   &offset);
+  in->point = in->a->pos;
+  in->move.x = 1.5 * (in->b->pos.x + offset.x - in->point.x);
+  in->move.y = 1.5 * (in->b->pos.y + offset.y - in->point.y);
+  in->move.z = 1.5 * (in->b->pos.z + offset.z - in->point.z);
+}
+
+static int run_collide_mol(struct volume *state, struct kernel_input *in) {
+  double t;
+  struct vector3 hit;
+  return collide_mol(&in->point, &in->move, (struct abstract_molecule *)in->b,
+                     &t, &hit, state->rx_radius_3d) != COLLIDE_MISS;
+}
+
+/* Collisions within an interaction radius of the target molecule */
+static void make_disk_input(struct volume *state, struct kernel_input *in) {
+  random_mol_pair(state, in);
+  struct vector3 offset;
+  random_direction(state, state->rx_radius_3d * rng_dbl(state->rng), &offset);
+  in->point.x = in->b->pos.x + offset.x;
+  in->point.y = in->b->pos.y + offset.y;
+  in->point.z = in->b->pos.z + offset.z;
+  random_direction(state, in->a->properties->space_step, &in->move);
+}
+
+static int run_exact_disk(struct volume *state, struct kernel_input *in) {
+  return exact_disk(state, &in->point, &in->move, state->rx_radius_3d,
+                    in->a->subvol, in->a, in->b, state->use_expanded_list,
+                    state->x_fineparts, state->y_fineparts,
+                    state->z_fineparts) < 1.0;
+}
+
+static void make_pair_input(struct volume *state, struct kernel_input *in) {
+  in->a = random_mol(state);
+  in->b = random_mol(state);
+}
+
+static int run_trigger_bimolecular(struct volume *state,
+                                   struct kernel_input *in) {
+  struct rxn *matching_rxns[MAX_MATCHING_RXNS];
+  return trigger_bimolecular(
+             state->reaction_hash, state->rx_hashsize,
+             in->a->properties->hashval, in->b->properties->hashval,
+             (struct abstract_molecule *)in->a,
+             (struct abstract_molecule *)in->b, 0, 0, matching_rxns) > 0;
+}
+
+static struct bench_kernel kernels[] = {
+  { "ray_trace", "move through a subvolume (hit: crosses a wall)",
+    make_ray_input, run_ray_trace },
+  { "collide_wall", "move against one wall (hit: crosses it)",
+    make_wall_input, run_collide_wall },
+  { "collide_mol", "move past one molecule (hit: within reach)",
+    make_mol_input, run_collide_mol },
+  { "exact_disk", "accessible interaction disk (hit: walls clip it)",
+    make_disk_input, run_exact_disk },
+  { "trigger_bimolecular", "reaction lookup (hit: the pair can react)",
+    make_pair_input, run_trigger_bimolecular },
+};
+#define N_KERNELS ((int)(sizeof(kernels) / sizeof(kernels[0])))
+
+static int compare_doubles(void const *a, void const *b) {
+  double x = *(double const *)a, y = *(double const *)b;
+  return (x > y) - (x < y);
+}
+
+/***************************************************************************
+pin_to_cpu:
+  In: cpu: CPU to run on, or -1 for the one the process runs on now
+  Out: the process is bound to that CPU where the platform allows it, so
+       that the kernels are not timed across migrations
+***************************************************************************/
+static void pin_to_cpu(int cpu) {
+#ifdef __linux__
+  if (cpu < 0)
+    cpu = sched_getcpu();
+  if (cpu < 0)
+    return;
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  if (sched_setaffinity(0, sizeof(set), &set) != 0)
+    printf("Could not pin the benchmark to CPU %d.\n", cpu);
+  else
+    printf("Pinned to CPU %d.\n", cpu);
+#else
+  (void)cpu;
+#endif
+}
+
+/***************************************************************************
+run_kernels:
+  In: selected: indices of the kernels to time
+      n_selected: number of kernels to time
+      scale: factor for the molecule and wall counts of the kernel world
+      reps: number of timed passes over the inputs of each kernel
+      cpu: CPU to pin the benchmark to, or -1 for the current one
+  Out: 0 on success.  One line of results is printed per kernel.
+***************************************************************************/
+static int run_kernels(int *selected, int n_selected, double scale, int reps,
+                       int cpu) {
+  pin_to_cpu(cpu);
+
+  double setup_seconds;
+  struct volume *state =
+      create_model_state(&kernel_model, scale, 1, 1, &setup_seconds);
+  int restarted = 0;
+  mcell_run_iteration(state, 1, &restarted);
+  collect_kernel_mols(state);
+
+  struct kernel_input *inputs = (struct kernel_input *)malloc(
+      KERNEL_INPUTS * sizeof(struct kernel_input));
+  double *samples = (double *)malloc(reps * sizeof(double));
+
+  if (inputs == NULL || samples == NULL)
+    exit(1);
+
+  printf("%-20s %9s %9s %12s %12s %8s\n", "kernel", "mols", "walls",
+         "min_ns/call", "med_ns/call", "hits");
+  for (int s = 0; s < n_selected; s++) {
+    struct bench_kernel *kernel = &kernels[selected[s]];
+    for (int i = 0; i < KERNEL_INPUTS; i++)
+      kernel->make_input(state, &inputs[i]);
+
+    /* One untimed pass to warm up caches and branch predictors */
+    long long hits = 0;
+    for (int i = 0; i < KERNEL_INPUTS; i++)
+      hits += kernel->run(state, &inputs[i]);
+
+    for (int rep = 0; rep < reps; rep++) {
+      double start = bench_clock();
+      for (int i = 0; i < KERNEL_INPUTS; i++)
+        kernel->run(state, &inputs[i]);
+      samples[rep] = 1e9 * (bench_clock() - start) / KERNEL_INPUTS;
+    }
+    qsort(samples, reps, sizeof(double), compare_doubles);
+    printf("%-20s %9d %9d %12.1f %12.1f %7.1f%%\n", kernel->name,
+           n_kernel_mols, kernel_box->n_walls, samples[0], samples[reps / 2],
+           100.0 * (double)hits / KERNEL_INPUTS);
+    fflush(stdout);
+  }
+
+  free(samples);
+  free(inputs);
+  return mcell_flush_data(state) ? 1 : 0;
+}
+
+/***************************************************************************
+ * Fixed work replay
+ *
+ * Stochastic models do different work from run to run, and from build to
+ * build as soon as a change draws random numbers differently.  With -w, a
+ * model is run once and the diffusion moves of a sample of its molecules
+ * (where they start, and a displacement drawn from their own stream) are
+ * recorded every iteration.  With -p, a build rebuilds the same geometry and
+ * replays exactly those moves: each is traced through the subvolumes,
+ * reflecting off the walls it hits, without drawing any random numbers.
+ ***************************************************************************/
+
+#define TRACE_MAGIC "MCBTRACE"
+#define TRACE_VERSION 1
+#define TRACE_MOLS_PER_ITERATION 4096
+#define REPLAY_MAX_LEGS 64 /* ray_trace calls allowed for one move */
+
+struct trace_header {
+  char magic[8];
+  u_int version;
+  u_int n_records;
+  double scale;
+  char model[32];
+};
+
+struct trace_record {
+  u_long id;           /* molecule that moved */
+  double t;            /* its scheduling time */
+  struct vector3 pos;  /* where it started */
+  struct vector3 move; /* displacement it was given */
+};
+
+/***************************************************************************
+record_trace:
+  In: model: model to run
+      scale: factor for the molecule and wall counts of the model
+      iterations: number of iterations to record
+      file: trace to write
+  Out: 0 on success, 1 on failure.  Up to TRACE_MOLS_PER_ITERATION
+       diffusing volume molecules are sampled before every iteration.
+***************************************************************************/
+static int record_trace(struct bench_model *model, double scale,
+                        long long iterations, char const *file) {
+  double setup_seconds;
+  struct volume *state =
+      create_model_state(model, scale, iterations, 1, &setup_seconds);
+  FILE *f = fopen(file, "wb");
+  if (f == NULL) {
+    printf("Could not open trace '%s'.\n", file);
+    return 1;
+  }
+
+  struct trace_header header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, TRACE_MAGIC, sizeof(header.magic));
+  header.version = TRACE_VERSION;
+  header.scale = scale;
+  snprintf(header.model, sizeof(header.model), "%s", model->name);
+  fwrite(&header, sizeof(header), 1, f);
+
+  /* Displacements come from a stream of their own, so that recording does
+   * not change the run */
+  static struct rng_state move_rng;
+  rng_init(&move_rng, 12345);
+
+  int restarted = 0;
+  while (state->current_iterations <= state->iterations) {
+    int n_mols = 0;
+    for (int i = 0; i < state->n_subvols; i++)
+      for (struct per_species_list *psl = state->subvol[i].species_head;
+           psl != NULL; psl = psl->next)
+        n_mols += psl->n_mols;
+    int stride = 1 + n_mols / TRACE_MOLS_PER_ITERATION;
+
+    int seen = 0;
+    for (int i = 0; i < state->n_subvols; i++) {
+      for (struct per_species_list *psl = state->subvol[i].species_head;
+           psl != NULL; psl = psl->next) {
+        for (int m = 0; m < psl->n_mols; m++, seen++) {
+          struct volume_molecule *vm = psl->mols[m];
+          if (seen % stride != 0 || vm->properties->space_step <= 0)
+            continue;
+          struct trace_record rec;
+          rec.id = vm->id;
+          rec.t = vm->t;
+          rec.pos = vm->pos;
+          pick_displacement(&rec.move, vm->properties->space_step, &move_rng);
+          fwrite(&rec, sizeof(rec), 1, f);
+          header.n_records++;
+        }
+      }
+    }
+
+    if (mcell_run_iteration(state, 1, &restarted) == 1)
+      break;
+  }
+
+  /* The record count goes into the header once it is known */
+  if (fseek(f, 0, SEEK_SET) != 0 || fwrite(&header, sizeof(header), 1, f) != 1 ||
+      fclose(f) != 0) {
+    printf("Could not write trace '%s'.\n", file);
+    return 1;
+  }
+  printf("Recorded %u moves of model %s (scale %g) over %lld iterations to "
+         "%s.\n",
+         header.n_records, model->name, scale, iterations, file);
+  return mcell_flush_data(state) ? 1 : 0;
+}
+
+/***************************************************************************
+replay_move:
+  In: state: simulation state with the geometry the trace was recorded in
+      rec: move to replay
+      walls: incremented by the number of walls the move reflects off
+      crossings: incremented by the number of subvolumes it crosses into
+  Out: the move is traced until it is used up, leaves the world or takes
+       REPLAY_MAX_LEGS calls to ray_trace
+***************************************************************************/
+static void replay_move(struct volume *state, struct trace_record const *rec,
+                        long long *walls, long long *crossings) {
+  struct vector3 pos = rec->pos;
+  struct vector3 move = rec->move;
+  struct wall *reflectee = NULL;
+  struct subvolume *sv = find_subvolume(state, &pos, NULL);
+  for (int leg = 0; sv != NULL && leg < REPLAY_MAX_LEGS; leg++) {
+    struct collision *first = NULL;
+    for (struct collision *c =
+             ray_trace(state, &pos, NULL, sv, &move, reflectee);
+         c != NULL; c = c->next) {
+      if (c->t >= 0.0 && c->t < 1.0 && (first == NULL || c->t < first->t))
+        first = c;
+    }
+    struct mem_helper *coll = sv->local_storage->coll;
+    if (first == NULL) {
+      mem_arena_reset(coll);
+      return;
+    }
+
+    double left = 1.0 - first->t;
+    pos = first->loc;
+    move.x *= left;
+    move.y *= left;
+    move.z *= left;
+    if (first->what & COLLIDE_WALL) {
+      reflectee = (struct wall *)first->target;
+      double d = 2.0 * dot_prod(&move, &reflectee->normal);
+      move.x -= d * reflectee->normal.x;
+      move.y -= d * reflectee->normal.y;
+      move.z -= d * reflectee->normal.z;
+      ++*walls;
+    } else {
+      reflectee = NULL;
+      sv = traverse_subvol(sv, first->what - COLLIDE_SV_NX - COLLIDE_SUBVOL,
+                           state->ny_parts, state->nz_parts);
+      ++*crossings;
+    }
+    mem_arena_reset(coll);
+  }
+}
+
+/***************************************************************************
+replay_trace:
+  In: file: trace written by record_trace
+      reps: number of timed passes over the trace
+      cpu: CPU to pin the benchmark to, or -1 for the current one
+  Out: 0 on success, 1 on failure.  The time per replayed move is printed,
+       with the walls and crossings it took, which match between builds
+       that do the same work.
+***************************************************************************/
+static int replay_trace(char const *file, int reps, int cpu) {
+  FILE *f = fopen(file, "rb");
+  struct trace_header header;
+  if (f == NULL || fread(&header, sizeof(header), 1, f) != 1 ||
+      memcmp(header.magic, TRACE_MAGIC, sizeof(header.magic)) != 0 ||
+      header.version != TRACE_VERSION) {
+    printf("'%s' is not a benchmark trace.\n", file);
+    return 1;
+  }
+  header.model[sizeof(header.model) - 1] = '\0';
+  struct bench_model *model = NULL;
+  for (int m = 0; m < N_MODELS; m++)
+    if (strcmp(models[m].name, header.model) == 0)
+      model = &models[m];
+  if (model == NULL) {
+    printf("Trace '%s' is of unknown model '%s'.\n", file, header.model);
+    return 1;
+  }
+
+  struct trace_record *recs = (struct trace_record *)malloc(
+      (header.n_records > 0 ? header.n_records : 1) *
+      sizeof(struct trace_record));
+  double *samples = (double *)malloc(reps * sizeof(double));
+
+  if (recs == NULL || samples == NULL)
+    exit(1);
+  if (fread(recs, sizeof(struct trace_record), header.n_records, f) !=
+      header.n_records) {
+    printf("Trace '%s' is truncated.\n", file);
+    return 1;
+  }
+  fclose(f);
+
+  pin_to_cpu(cpu);
+  double setup_seconds;
+  struct volume *state =
+      create_model_state(model, header.scale, 1, 1, &setup_seconds);
+  int restarted = 0;
+  mcell_run_iteration(state, 1, &restarted);
+
+  /* One untimed pass to warm up caches and branch predictors */
+  long long walls = 0, crossings = 0;
+  for (u_int i = 0; i < header.n_records; i++)
+    replay_move(state, &recs[i], &walls, &crossings);
+
+  for (int rep = 0; rep < reps; rep++) {
+    long long w = 0, c = 0;
+    double start = bench_clock();
+    for (u_int i = 0; i < header.n_records; i++)
+      replay_move(state, &recs[i], &w, &c);
+    samples[rep] = 1e9 * (bench_clock() - start) /
+                   (header.n_records > 0 ? header.n_records : 1);
+  }
+  qsort(samples, reps, sizeof(double), compare_doubles);
+
+  printf("%-18s %6s %10s %10s %10s %12s %12s\n", "model", "scale", "moves",
+         "walls", "crossings", "min_ns/move", "med_ns/move");
+  printf("%-18s %6.2f %10u %10lld %10lld %12.1f %12.1f\n", model->name,
+         header.scale, header.n_records, walls, crossings, samples[0],
+         samples[reps / 2]);
+
+  free(samples);
+  free(recs);
+  return mcell_flush_data(state) ? 1 : 0;
+}
+
+static void print_usage(char const *program) {
+  printf("Usage: %s [-s scale] [-i iterations] [-t threads] [-m n] [-g]\n"
+         "          [model ...]\n"
+         "       %s -k [-s scale] [-r repeats] [-c cpu] [kernel ...]\n"
+         "       %s -w trace [-s scale] [-i iterations] model\n"
+         "       %s -p trace [-r repeats] [-c cpu]\n"
+         "  -s scale       factor for the molecule and wall counts (1)\n"
+         "  -i iterations  iterations to run each model for (200)\n"
+         "  -t threads     threads to run the memory partitions on (1)\n"
+         "  -m n           sort the molecules in memory every n iterations (0)\n"
+         "  -g             run the molecules of each timestep by subvolume\n"
+         "  -k             time single kernels instead of whole models\n"
+         "  -r repeats     timed passes over the inputs of a kernel (9)\n"
+         "  -c cpu         CPU to pin the kernel benchmarks to (current)\n"
+         "  -w trace       record the moves of a model run to trace\n"
+         "  -p trace       time replaying the moves recorded in trace\n"
+         "Models (all by default):\n",
+         program, program, program, program);
+  for (int m = 0; m < N_MODELS; m++)
+    printf("  %-20s %s\n", models[m].name, models[m].description);
+  printf("Kernels (all by default):\n");
+  for (int k = 0; k < N_KERNELS; k++)
+    printf("  %-20s %s\n", kernels[k].name, kernels[k].description);
+}
+
+int main(int argc, char **argv) {
+  double scale = 1.0;
+  long long iterations = 200;
+  int threads = 1;
+  int sort_interval = 0;
+  int sort_slots = 0;
+  int kernel_mode = 0;
+  int reps = 9;
+  int cpu = -1;
+  char const *record_file = NULL;
+  char const *replay_file = NULL;
+  int opt;
+  while ((opt = getopt(argc, argv, "s:i:t:m:gkr:c:w:p:h")) != -1) {
+    switch (opt) {
+    case 's':
+      scale = atof(optarg);
+      break;
+    case 'i':
+      iterations = atoll(optarg);
+      break;
+    case 't':
+      threads = atoi(optarg);
+      break;
+    case 'm':
+      sort_interval = atoi(optarg);
+      break;
+    case 'g':
+      sort_slots = 1;
+      break;
+    case 'k':
+      kernel_mode = 1;
+      break;
+    case 'r':
+      reps = atoi(optarg);
+      break;
+    case 'c':
+      cpu = atoi(optarg);
+      break;
+    case 'w':
+      record_file = optarg;
+      break;
+    case 'p':
+      replay_file = optarg;
+      break;
+    default:
+      print_usage(argv[0]);
+      return opt == 'h' ? 0 : 1;
+    }
+  }
+  if (scale <= 0 || iterations < 1 || threads < 1 || sort_interval < 0 ||
+      reps < 1) {
+    print_usage(argv[0]);
+    return 1;
+  }
+  if (replay_file != NULL)
+    return replay_trace(replay_file, reps, cpu);
+
+  int n_choices = kernel_mode ? N_KERNELS : N_MODELS;
+  int selected[N_MODELS > N_KERNELS ? N_MODELS : N_KERNELS];
+  int n_selected = 0;
+  if (optind == argc) {
+    for (int c = 0; c < n_choices; c++)
+      selected[n_selected++] = c;
+  }
+  for (int a = optind; a < argc; a++) {
+    int c = 0;
+    while (c < n_choices &&
+           strcmp(argv[a], kernel_mode ? kernels[c].name : models[c].name) != 0)
+      c++;
+    if (c == n_choices) {
+      printf("Unknown %s '%s'.\n", kernel_mode ? "kernel" : "model", argv[a]);
+      print_usage(argv[0]);
+      return 1;
+    }
+    if (n_selected < n_choices)
+      selected[n_selected++] = c;
+  }
+
+  if (kernel_mode)
+    return run_kernels(selected, n_selected, scale, reps, cpu);
+  if (record_file != NULL) {
+    if (n_selected != 1) {
+      printf("A trace is recorded from exactly one model.\n");
+      return 1;
+    }
+    return record_trace(&models[selected[0]], scale, iterations, record_file);
+  }
+
+  printf("%-18s %6s %9s %12s %10s %12s %9s %9s %9s\n", "model", "scale",
+         "walls", "diff_steps", "iter/s", "ns/diff_step", "setup_s",
+         "pool_MB", "peak_MB");
+  fflush(stdout);
+
+  /* Each model runs in its own process, so that its memory is measured
+   * alone and no state is shared between models */
+  int failed = 0;
+  for (int s = 0; s < n_selected; s++) {
+    pid_t pid = fork();
+    if (pid == 0)
+      _exit(run_model(&models[selected[s]], scale, iterations, threads,
+                      sort_interval, sort_slots));
+    int status = 0;
+    if (pid < 0 || waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) ||
+        WEXITSTATUS(status) != 0) {
+      printf("%-18s failed\n", models[selected[s]].name);
+      failed = 1;
+    }
+  }
+  return failed;
+}
@@ -55,8 +55,175 @@ int mcell_add_dynamic_geometry_file(char *dynamic_geometry_filepath,
   return 0;
 }
 
+/***************************************************************************
+count_instantiated_meshes:
+
+ In:  obj_ptr: the object to look for meshes in (e.g. root_instance)
+ Out: The number of instantiated polygon and box objects.
+***************************************************************************/
+static int count_instantiated_meshes(struct object *obj_ptr) {
+  int n_meshes = 0;
+  switch (obj_ptr->object_type) {
+  case META_OBJ:
+    for (struct object *child_obj_ptr = obj_ptr->first_child;
+         child_obj_ptr != NULL; child_obj_ptr = child_obj_ptr->next) {
+      n_meshes += count_instantiated_meshes(child_obj_ptr);
+    }
+    break;
+  case BOX_OBJ:
+  case POLY_OBJ:
+    n_meshes = 1;
+    break;
+
+  // do nothing
+  case REL_SITE_OBJ:
+  case VOXEL_OBJ:
+    break;
+  }
+  return n_meshes;
+}
+
+/***************************************************************************
+same_mesh_topology:
+
+ In:  obj_ptr: an instantiated mesh
+      pobj: a polygon object that would replace it
+ Out: 1 if pobj has the walls and regions of obj_ptr, so that it can
+      replace obj_ptr by moving vertices. 0 otherwise.
+***************************************************************************/
+static int same_mesh_topology(struct object *obj_ptr,
+                              struct poly_object_list *pobj) {
+  if (obj_ptr->object_type != POLY_OBJ || obj_ptr->n_verts != pobj->num_vert ||
+      obj_ptr->n_walls != pobj->num_conn)
+    return 0;
+
+  // Walls are created in the order of the connection list
+  struct element_connection_list *conn = pobj->connections;
+  for (int i = 0; i < obj_ptr->n_walls; i++, conn = conn->next) {
+    struct wall *w = obj_ptr->wall_p[i];
+    if (w == NULL || conn == NULL || conn->n_verts != 3)
+      return 0;
+    for (int k = 0; k < 3; k++) {
+      if (w->vert[k] - obj_ptr->vertices[0] != conn->indices[k])
+        return 0;
+    }
+  }
+
+  // Besides ALL, the mesh may only have the one region of the replacement,
+  // with the same walls
+  int n_regions = 0;
+  struct region *reg_ptr = NULL;
+  for (struct region_list *rl = obj_ptr->regions; rl != NULL; rl = rl->next) {
+    n_regions++;
+    if (pobj->reg_name != NULL &&
+        strcmp(rl->reg->region_last_name, pobj->reg_name) == 0)
+      reg_ptr = rl->reg;
+  }
+  if (reg_ptr == NULL || n_regions != 2 || reg_ptr->membership == NULL)
+    return 0;
+
+  int n_members = 0;
+  for (struct element_list *el = pobj->surf_reg_faces; el != NULL;
+       el = el->next) {
+    if (el->special != NULL || el->end >= (u_int)obj_ptr->n_walls)
+      return 0;
+    int run_end;
+    if (next_set_range(reg_ptr->membership, el->begin, &run_end) !=
+            (int)el->begin ||
+        run_end <= (int)el->end)
+      return 0;
+    n_members += el->end - el->begin + 1;
+  }
+  return n_members == count_bits(reg_ptr->membership);
+}
+
+/***************************************************************************
+change_geometry_in_place:
+
+ In:  state: MCell state
+      pobj_list: the polygon objects of the new geometry
+ Out: Zero if the new geometry differs from the current one only in the
+      positions of vertices: the meshes are then moved there and the lists
+      of pobj_list are freed, as mcell_change_geometry would. One otherwise,
+      in which case nothing is changed.
+***************************************************************************/
+static int change_geometry_in_place(struct volume *state,
+                                    struct poly_object_list *pobj_list) {
+  int n_meshes = 0;
+  for (struct poly_object_list *p = pobj_list; p != NULL; p = p->next)
+    n_meshes++;
+  if (n_meshes == 0 ||
+      n_meshes != count_instantiated_meshes(state->root_instance))
+    return 1;
+
+  // Check every mesh before moving any
+  struct object **meshes =
+      CHECKED_MALLOC_ARRAY(struct object *, n_meshes, "meshes");
+  struct vector3 **new_verts =
+      CHECKED_MALLOC_ARRAY(struct vector3 *, n_meshes, "mesh vertices");
+  int n_checked = 0;
+  int status = 0;
+  for (struct poly_object_list *p = pobj_list; p != NULL; p = p->next) {
+    char *mesh_name = CHECKED_SPRINTF("Scene.%s", p->obj_name);
+    struct object *obj_ptr =
+        find_instantiated_mesh(state->root_instance, mesh_name);
+    free(mesh_name);
+    if (obj_ptr == NULL || !same_mesh_topology(obj_ptr, p)) {
+      status = 1;
+      break;
+    }
+
+    struct vector3 *verts = CHECKED_MALLOC_ARRAY(
+        struct vector3, p->num_vert, "mesh vertices");
+    struct vertex_list *vl = p->vertices;
+    for (int k = 0; k < p->num_vert; k++, vl = vl->next) {
+      verts[k].x = vl->vertex->x * state->r_length_unit;
+      verts[k].y = vl->vertex->y * state->r_length_unit;
+      verts[k].z = vl->vertex->z * state->r_length_unit;
+    }
+    meshes[n_checked] = obj_ptr;
+    new_verts[n_checked++] = verts;
+    if (check_mesh_vertices(state, obj_ptr, verts, 0)) {
+      status = 1;
+      break;
+    }
+  }
+
+  for (int i = 0; i < n_checked; i++) {
+    if (status == 0 && move_mesh_vertices(state, meshes[i], new_verts[i]))
+      mcell_error("Failed to move the vertices of mesh '%s'.",
+                  meshes[i]->sym->name);
+    free(new_verts[i]);
+  }
+  free(new_verts);
+  free(meshes);
+  if (status)
+    return 1;
+
+  for (struct poly_object_list *p = pobj_list; p != NULL; p = p->next) {
+    free_vertex_list(p->vertices);
+    free_connection_list(p->connections);
+    while (p->surf_reg_faces != NULL) {
+      struct element_list *next = p->surf_reg_faces->next;
+      free(p->surf_reg_faces);
+      p->surf_reg_faces = next;
+    }
+    p->vertices = NULL;
+    p->connections = NULL;
+  }
+  return 0;
+}
+
 int mcell_change_geometry(struct volume *state, struct poly_object_list *pobj_list) {
-  state->all_molecules = save_all_molecules(state, state->storage_head);
+  // Moving the vertices keeps molecules, counts and regions as they are
+  if (change_geometry_in_place(state, pobj_list) == 0)
+    return 0;
+
+  // Remember the shape of every mesh, to tell which ones change
+  struct mesh_signatures old_meshes = { 0, 0, NULL };
+  get_mesh_signatures(state->root_instance, &old_meshes);
+  state->all_molecules =
+      save_all_molecules(state, state->storage_head, &old_meshes);
 
   // Turn off progress reports to avoid spamming mostly useless info to stdout
   state->notify->progress_report = NOTIFY_NONE;
@@ -133,6 +300,7 @@ int mcell_change_geometry(struct volume *state, struct poly_object_list *pobj_li
   CHECKED_CALL(init_partitions(state), "Error initializing partitions.");
   CHECKED_CALL(init_vertices_walls(state),
                "Error initializing vertices and walls.");
+  state->geometry_serial++;
   CHECKED_CALL(init_regions(state), "Error initializing regions.");
 
   if (state->place_waypoints_flag) {
@@ -140,8 +308,9 @@ int mcell_change_geometry(struct volume *state, struct poly_object_list *pobj_li
   }
 
   if (state->with_checks_flag) {
-    CHECKED_CALL(check_for_overlapped_walls(
-        state->rng, state->n_subvols, state->subvol),
+    CHECKED_CALL(check_for_overlapped_walls(state->rng, state->n_subvols,
+                                            state->subvol,
+                                            world_thread_pool(state)),
         "Error while checking for overlapped walls.");
   }
   CHECKED_CALL(init_species_mesh_transp(state),
@@ -181,7 +350,17 @@ int mcell_change_geometry(struct volume *state, struct poly_object_list *pobj_li
       new_region_names,
       meshes_to_ignore,
       new_inst_mesh_names);
-  place_all_molecules(state, meshes_to_ignore, regions_to_ignore);
+
+  // Only molecules near meshes that actually changed need to be relocated
+  struct mesh_signatures new_meshes = { 0, 0, NULL };
+  get_mesh_signatures(state->root_instance, &new_meshes);
+  struct mesh_signatures changed_meshes = { 0, 0, NULL };
+  find_changed_meshes(&changed_meshes, &old_meshes, &new_meshes);
+  place_all_molecules(
+      state, meshes_to_ignore, regions_to_ignore, &changed_meshes);
+  free_mesh_signatures(&old_meshes);
+  free_mesh_signatures(&new_meshes);
+  free_mesh_signatures(&changed_meshes);
 
   destroy_string_buffer(old_region_names);
   destroy_string_buffer(new_region_names);
@@ -198,3 +377,42 @@ int mcell_change_geometry(struct volume *state, struct poly_object_list *pobj_li
 
   return 0;
 }
+
+/***************************************************************************
+mcell_move_mesh_vertices:
+
+ In:  state: MCell state
+      mesh_name: fully qualified name of an instantiated mesh
+      n_verts: number of vertices of the mesh
+      xyz: x, y and z of every vertex in microns, in the order of the mesh's
+           vertex list and after the instance's transformations
+ Out: MCELL_SUCCESS if the mesh was moved, MCELL_FAIL otherwise. Only the
+      vertices move; walls, regions and surface molecules are kept, so no
+      MDL needs to be parsed.
+***************************************************************************/
+int mcell_move_mesh_vertices(struct volume *state, char *mesh_name,
+                             int n_verts, double *xyz) {
+  struct object *obj_ptr =
+      find_instantiated_mesh(state->root_instance, mesh_name);
+  if (obj_ptr == NULL) {
+    mcell_log("Cannot move vertices of unknown mesh '%s'.", mesh_name);
+    return MCELL_FAIL;
+  }
+  if (obj_ptr->n_verts != n_verts) {
+    mcell_log("Mesh '%s' has %d vertices, not %d.", mesh_name,
+              obj_ptr->n_verts, n_verts);
+    return MCELL_FAIL;
+  }
+
+  struct vector3 *new_verts =
+      CHECKED_MALLOC_ARRAY(struct vector3, n_verts, "mesh vertices");
+  for (int i = 0; i < n_verts; i++) {
+    new_verts[i].x = xyz[3 * i] * state->r_length_unit;
+    new_verts[i].y = xyz[3 * i + 1] * state->r_length_unit;
+    new_verts[i].z = xyz[3 * i + 2] * state->r_length_unit;
+  }
+  int status = move_mesh_vertices(state, obj_ptr, new_verts);
+  free(new_verts);
+
+  return status ? MCELL_FAIL : MCELL_SUCCESS;
+}
@@ -26,6 +26,8 @@
 
 #include "mcell_objects.h"
 
+struct mdlparse_vars;
+
 struct mesh_region_string_buffs {
   struct string_buffer *old_inst_mesh_names;
   struct string_buffer *old_region_names;
@@ -36,4 +38,7 @@ int mcell_add_dynamic_geometry_file(char *dynamic_geometry_filepath,
 
 int mcell_change_geometry(struct volume *state, struct poly_object_list *pobj_list);
 
+int mcell_move_mesh_vertices(struct volume *state, char *mesh_name,
+                             int n_verts, double *xyz);
+
 #endif
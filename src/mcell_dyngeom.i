@@ -4,3 +4,27 @@ struct mesh_region_string_buffs {
 };
 
 int mcell_change_geometry(struct volume *state, struct poly_object_list *pobj_list);
+
+int mcell_move_mesh_vertices(struct volume *state, char *mesh_name,
+                             int n_verts, double *xyz);
+
+// Takes any buffer of float64 x, y, z triples (e.g. an (n, 3) numpy array)
+// and releases the GIL while the mesh moves
+%inline %{
+int mcell_move_mesh_vertices_from_array(struct volume *state, char *mesh_name,
+                                        PyObject *xyz) {
+  Py_buffer xyz_buf;
+  Py_ssize_t n_verts;
+  if (pymcell_get_array(xyz, "d", sizeof(double), 3, &xyz_buf, &n_verts))
+    return MCELL_FAIL;
+
+  int status;
+  Py_BEGIN_ALLOW_THREADS
+  status = mcell_move_mesh_vertices(state, mesh_name, (int)n_verts,
+                                    xyz_buf.buf);
+  Py_END_ALLOW_THREADS
+
+  PyBuffer_Release(&xyz_buf);
+  return status;
+}
+%}
@@ -48,6 +48,10 @@
 #include "mcell_misc.h"
 #include "mcell_reactions.h"
 #include "dyngeom.h"
+#include "diffuse.h"
+#include "mpi_util.h"
+#include "mcell_run.h"
+#include "metrics.h"
 #include "chkpt.h"
 
 //for nfsim initialization 
@@ -109,6 +113,7 @@ MCELL_STATE *mcell_create() {
 #endif
 
   state->procnum = 0;
+  state->n_procs = 1;
   state->rx_hashsize = 0;
   state->iterations = INT_MIN; /* indicates iterations not set */
   state->chkpt_infile = NULL;
@@ -118,7 +123,40 @@ MCELL_STATE *mcell_create() {
       ULONG_MAX; /* Indicates that this value has not been set by user */
   state->seed_seq = 1;
   state->with_checks_flag = 1;
+  state->num_threads = 1;
+  state->rebalance_interval = 0;
+  state->sort_interval = 0;
+  state->sort_slots = 0;
+  state->n_seeds = 0;
+  state->nfsim_cache_bytes = 0;
+  state->output_writer = NULL;
+  state->use_huge_pages = 0;
+  state->shortest_floats = 0;
+  state->output_journal = 0;
+  state->metrics_file = NULL;
+  state->metrics_interval = METRICS_DEFAULT_INTERVAL;
+  state->metrics_start_time = (struct timeval) { 0, 0 };
+  state->metrics_start_iteration = 0;
+  state->last_metrics_time = (struct timeval) { 0, 0 };
+  state->last_metrics_iteration = 0;
+  state->last_checkpoint_time = (struct timeval) { 0, 0 };
+  state->bench_json_file = NULL;
+  state->storage_group = NULL;
+  state->active_storages = NULL;
+  state->page_idle_storages = 0;
+  state->page_dir = NULL;
+  state->n_active_storages = 0;
+  state->run_start_time = (struct timeval) { 0, 0 };
+  state->run_start_iteration = 0;
   state->nfsim_flag = 0; //JJT: NFsim flag
+  state->graph_patterns = NULL;
+  state->nfsim_reactions = NULL;
+  state->viz_graph_patterns = NULL;
+  state->viz_next_molcomp_id = 0;
+  state->viz_mol_names = NULL;
+  state->viz_mol_frame = 0;
+  state->rxn_trace = NULL;
+  state->emergency_output_hook_enabled = 1;
 
   time_t begin_time_of_day;
   time(&begin_time_of_day);
@@ -196,11 +234,17 @@ mcell_init_simulation(MCELL_STATE *state) {
   }
 
   if (state->with_checks_flag) {
-    CHECKED_CALL(check_for_overlapped_walls(
-        state->rng, state->n_subvols, state->subvol),
+    CHECKED_CALL(check_for_overlapped_walls(state->rng, state->n_subvols,
+                                            state->subvol,
+                                            world_thread_pool(state)),
         "Error while checking for overlapped walls.");
   }
 
+  /* Everything up to here is the same for every seed, so a sweep shares
+   * it between the seeds' processes */
+  if (state->n_seeds > 1)
+    mcell_sweep_seeds(state);
+
   CHECKED_CALL(init_surf_mols(state),
                "Error while placing surface molecules on regions.");
 
@@ -219,9 +263,14 @@ mcell_init_simulation(MCELL_STATE *state) {
 
   //hashmap where nfsim struct graph_data is stored
   if(state->nfsim_flag){
-    initialize_graph_hashmap();
+    initialize_graph_hashmap(state);
   }
 
+  /* Everything the 3D diffusion copies specialize on is known by now */
+  select_diffuse_3D_variant(state);
+
+  mpi_assign_storages(state);
+
   return MCELL_SUCCESS;
 }
 
@@ -292,8 +341,9 @@ mcell_redo_geom(MCELL_STATE *state) {
   }
 
   if (state->with_checks_flag) {
-    CHECKED_CALL(check_for_overlapped_walls(
-        state->rng, state->n_subvols, state->subvol),
+    CHECKED_CALL(check_for_overlapped_walls(state->rng, state->n_subvols,
+                                            state->subvol,
+                                            world_thread_pool(state)),
         "Error while checking for overlapped walls.");
   }
   CHECKED_CALL(init_species_mesh_transp(state),
@@ -449,6 +499,26 @@ MCELL_STATUS mcell_set_partition(MCELL_STATE *state, int dim,
   return MCELL_SUCCESS;
 }
 
+/*************************************************************************
+ mcell_set_threads:
+    Set the number of threads of the thread pool shared by the parallel
+    phases of the simulation.  Has to be called before the simulation is
+    initialized.
+
+ In: state: the simulation state
+     num_threads: number of threads, counting the main thread
+ Out: 0 on success; 1 on failure.
+      number of threads is set.
+*************************************************************************/
+MCELL_STATUS
+mcell_set_threads(MCELL_STATE *state, int num_threads) {
+  if (num_threads < 1 || state->thread_pool != NULL) {
+    return MCELL_FAIL;
+  }
+  state->num_threads = num_threads;
+  return MCELL_SUCCESS;
+}
+
 /*************************************************************************
  mcell_set_iterations:
     Set the number of iterations for the simulation.
@@ -490,6 +560,84 @@ mcell_set_time_step(MCELL_STATE *state, double step) {
   return MCELL_SUCCESS;
 }
 
+/*************************************************************************
+ mcell_set_auto_time_step_multiplier:
+    Let subvolumes far from any wall give their volume molecules longer
+    diffusion steps (see assign_step_multipliers).
+
+ In: state: the simulation state
+     multiplier: the largest multiplier handed out; 1 turns this off
+ Out: 0 on success; any other integer value is a failure.
+*************************************************************************/
+MCELL_STATUS
+mcell_set_auto_time_step_multiplier(MCELL_STATE *state, double multiplier) {
+  if (!(multiplier >= 1)) {
+    return 2;
+  }
+  state->auto_step_multiplier = multiplier;
+  return MCELL_SUCCESS;
+}
+
+/*************************************************************************
+ mcell_add_time_step_multiplier:
+    Give the subvolumes whose center lies in a box a time step multiplier:
+    their volume molecules take at least that many timesteps per diffusion
+    step.  Boxes added later win over earlier ones and over the automatic
+    multipliers.  Must be called before the geometry is initialized.
+
+ In: state: the simulation state
+     llf: lower left front corner of the box, in microns
+     urb: upper right back corner of the box, in microns
+     multiplier: number of timesteps, at least 1
+ Out: 0 on success; any other integer value is a failure.
+*************************************************************************/
+MCELL_STATUS
+mcell_add_time_step_multiplier(MCELL_STATE *state, struct vector3 *llf,
+                               struct vector3 *urb, double multiplier) {
+  if (!(multiplier >= 1) || llf->x > urb->x || llf->y > urb->y ||
+      llf->z > urb->z) {
+    return 2;
+  }
+  struct step_multiplier_box *b = CHECKED_MALLOC_STRUCT_NODIE(
+      struct step_multiplier_box, "time step multiplier box");
+  if (b == NULL)
+    return MCELL_FAIL;
+  b->next = NULL;
+  b->llf = *llf;
+  b->urb = *urb;
+  b->multiplier = multiplier;
+
+  struct step_multiplier_box **tail = &state->step_multiplier_boxes;
+  while (*tail != NULL)
+    tail = &(*tail)->next;
+  *tail = b;
+  return MCELL_SUCCESS;
+}
+
+/*************************************************************************
+ mcell_set_equilibration:
+    Run the first iterations of the simulation as an equilibration phase:
+    volume molecules take at least multiplier timesteps per diffusion step,
+    TIME_STEP_MAX is stretched by the same factor, and no reaction, volume
+    or viz output is produced.  The run switches to its normal settings
+    when the phase ends.
+
+ In: state: the simulation state
+     iterations: number of iterations in the phase; 0 turns this off
+     multiplier: number of timesteps, at least 1
+ Out: 0 on success; any other integer value is a failure.
+*************************************************************************/
+MCELL_STATUS
+mcell_set_equilibration(MCELL_STATE *state, double iterations,
+                        double multiplier) {
+  if (!(iterations >= 0) || !(multiplier >= 1)) {
+    return 2;
+  }
+  state->equilibration_iterations = (long long)iterations;
+  state->equilibration_multiplier = multiplier;
+  return MCELL_SUCCESS;
+}
+
 /*************************************************************************
  mcell_silence_notifications:
 
@@ -519,6 +667,7 @@ mcell_silence_notifications(MCELL_STATE *state) {
   state->notify->volume_output_report = NOTIFY_NONE;
   state->notify->viz_output_report = NOTIFY_NONE;
   state->notify->molecule_collision_report = NOTIFY_NONE;
+  state->notify->memory_usage_report = NOTIFY_NONE;
   return MCELL_SUCCESS;
 }
 
@@ -550,6 +699,7 @@ mcell_enable_notifications(MCELL_STATE *state) {
   state->notify->volume_output_report = NOTIFY_NONE;
   state->notify->viz_output_report = NOTIFY_NONE;
   state->notify->molecule_collision_report = NOTIFY_NONE;
+  state->notify->memory_usage_report = NOTIFY_NONE;
   return MCELL_SUCCESS;
 }
 
@@ -621,7 +771,8 @@ mcell_silence_warnings(MCELL_STATE *state) {
 /***********************************************************************
  * install_usr_signal_handlers:
  *
- *   Set signal handlers for checkpointing on SIGUSR signals.
+ *   Set signal handlers for checkpointing on SIGUSR signals, and for
+ *   memory layout reports on SIGURG.
  *
  *   In:  None
  *   Out: 0 on success, 1 on failure.
@@ -642,6 +793,11 @@ int install_usr_signal_handlers(void) {
     mcell_error("Failed to install USR2 signal handler.");
     /*return 1;*/
   }
+  sa.sa_handler = &memory_layout_signal_handler;
+  if (sigaction(SIGURG, &sa, &saPrev) != 0) {
+    mcell_error("Failed to install URG signal handler.");
+    /*return 1;*/
+  }
 #endif
 
   return 0;
@@ -55,8 +55,21 @@ MCELL_STATUS mcell_set_partition(MCELL_STATE *state, int dim,
 
 MCELL_STATUS mcell_set_time_step(MCELL_STATE *state, double step);
 
+MCELL_STATUS mcell_set_auto_time_step_multiplier(MCELL_STATE *state,
+                                                 double multiplier);
+
+MCELL_STATUS mcell_add_time_step_multiplier(MCELL_STATE *state,
+                                            struct vector3 *llf,
+                                            struct vector3 *urb,
+                                            double multiplier);
+
+MCELL_STATUS mcell_set_equilibration(MCELL_STATE *state, double iterations,
+                                     double multiplier);
+
 MCELL_STATUS mcell_set_iterations(MCELL_STATE *state, long long iterations);
 
+MCELL_STATUS mcell_set_threads(MCELL_STATE *state, int num_threads);
+
 MCELL_STATUS mcell_silence_notifications(MCELL_STATE *state);
 MCELL_STATUS mcell_enable_notifications(MCELL_STATE *state);
 MCELL_STATUS mcell_silence_warnings(MCELL_STATE *state);
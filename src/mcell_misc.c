@@ -24,15 +24,20 @@
 #include <stdlib.h>
 #include <math.h>
 #include <string.h>
+#include <stdint.h>
+#include <signal.h>
 
 #include "config.h"
 #include "mcell_structs.h"
 
 #include "argparse.h"
+#include "sym_table.h"
 #include "version_info.h"
 #include "logging.h"
 #include "version_info.h"
 #include "mcell_misc.h"
+#include "grid_util.h"
+#include "thread_util.h"
 
 
 /* declaration of static functions */
@@ -61,6 +66,418 @@ void mcell_print_usage(const char *executable_name) {
  ************************************************************************/
 void mcell_print_stats() { mem_dump_stats(mcell_get_log_file()); }
 
+/* Upper bound on the number of distinct pool names we report */
+#define MEMORY_REPORT_MAX_POOLS 128
+
+/* Number of pools named on each iteration report line */
+#define MEMORY_REPORT_TOP_POOLS 4
+
+#define BYTES_TO_MB(b) ((double)(b) / (1024.0 * 1024.0))
+
+/************************************************************************
+ *
+ * molecule_record_size returns the number of bytes one molecule of the
+ * given species occupies in its memory pool
+ *
+ ************************************************************************/
+static size_t molecule_record_size(MCELL_STATE *state, struct species *spec) {
+  struct storage *store =
+      (state->storage_head != NULL) ? state->storage_head->store : NULL;
+  if (spec->flags & ON_GRID)
+    return (store != NULL) ? store->smol->record_size
+                           : sizeof(struct surface_molecule);
+  return (store != NULL) ? store->mol->record_size
+                         : sizeof(struct volume_molecule);
+}
+
+/************************************************************************
+ *
+ * mcell_get_total_pool_memory returns the number of bytes currently held
+ * by all memory pools
+ *
+ ************************************************************************/
+long long mcell_get_total_pool_memory(void) { return mem_usage_total_bytes(); }
+
+/*************************************************************************
+ mcell_get_pool_memory:
+    Get the memory held by all pools created under one name (e.g. "vol mol",
+    "collision", "surface grid"), summed over all memory partitions.
+
+ In:  pool_name: name the pools were created with
+ Out: number of bytes held, or -1 if no live pool has this name
+*************************************************************************/
+long long mcell_get_pool_memory(char const *pool_name) {
+  struct mem_usage_info info[MEMORY_REPORT_MAX_POOLS];
+  int n = mem_usage_collect(info, MEMORY_REPORT_MAX_POOLS);
+  if (n > MEMORY_REPORT_MAX_POOLS)
+    n = MEMORY_REPORT_MAX_POOLS;
+
+  long long bytes = -1;
+  for (int i = 0; i < n; ++i) {
+    if (info[i].name == NULL || strcmp(info[i].name, pool_name) != 0)
+      continue;
+    bytes = (bytes < 0) ? info[i].bytes_reserved : bytes + info[i].bytes_reserved;
+  }
+  return bytes;
+}
+
+/*************************************************************************
+ mcell_get_species_memory:
+    Get the memory used by the molecule records of one species.
+
+ In:  state: the simulation state
+      species_name: name of the species
+ Out: number of bytes in use, or -1 if the species does not exist
+*************************************************************************/
+long long mcell_get_species_memory(MCELL_STATE *state,
+                                   char const *species_name) {
+  struct sym_entry *sym = retrieve_sym(species_name, state->mol_sym_table);
+  if (sym == NULL)
+    return -1;
+
+  struct species *spec = (struct species *)sym->value;
+  return (long long)spec->population *
+         (long long)molecule_record_size(state, spec);
+}
+
+/************************************************************************
+ *
+ * mcell_log_memory_summary appends the total pooled memory and the largest
+ * pools to the current (iteration report) log line
+ *
+ ************************************************************************/
+void mcell_log_memory_summary(void) {
+  struct mem_usage_info info[MEMORY_REPORT_MAX_POOLS];
+  int n = mem_usage_collect(info, MEMORY_REPORT_MAX_POOLS);
+  if (n > MEMORY_REPORT_MAX_POOLS)
+    n = MEMORY_REPORT_MAX_POOLS;
+
+  long long total = 0;
+  for (int i = 0; i < n; ++i)
+    total += info[i].bytes_reserved;
+  mcell_log_raw(" | Memory: %.1f MB [", BYTES_TO_MB(total));
+
+  /* Partial selection sort; n is small */
+  for (int i = 0; i < n && i < MEMORY_REPORT_TOP_POOLS; ++i) {
+    int max = i;
+    for (int j = i + 1; j < n; ++j) {
+      if (info[j].bytes_reserved > info[max].bytes_reserved)
+        max = j;
+    }
+    struct mem_usage_info tmp = info[i];
+    info[i] = info[max];
+    info[max] = tmp;
+    mcell_log_raw("%s%s: %.1f", (i > 0) ? ", " : " ",
+                  info[i].name ? info[i].name : "(unnamed)",
+                  BYTES_TO_MB(info[i].bytes_reserved));
+  }
+  mcell_log_raw(" ]");
+}
+
+/************************************************************************
+ *
+ * mcell_print_memory_usage prints a breakdown of the pooled memory by pool
+ * and by species
+ *
+ ************************************************************************/
+void mcell_print_memory_usage(MCELL_STATE *state) {
+  struct mem_usage_info info[MEMORY_REPORT_MAX_POOLS];
+  int n = mem_usage_collect(info, MEMORY_REPORT_MAX_POOLS);
+  if (n > MEMORY_REPORT_MAX_POOLS) {
+    mcell_warn("Memory report truncated to %d of %d pools.",
+               MEMORY_REPORT_MAX_POOLS, n);
+    n = MEMORY_REPORT_MAX_POOLS;
+  }
+
+  long long total = 0;
+  mcell_log("Memory usage by pool:");
+  long long total_huge = 0;
+  mcell_log("  %-32s %8s %8s %14s %12s %12s", "pool", "record", "pools",
+            "records in use", "MB held", "MB huge");
+  for (int i = 0; i < n; ++i) {
+    mcell_log("  %-32s %8lu %8d %14lld %12.2f %12.2f",
+              info[i].name ? info[i].name : "(unnamed)",
+              (unsigned long)info[i].record_size, info[i].helpers,
+              info[i].records_live, BYTES_TO_MB(info[i].bytes_reserved),
+              BYTES_TO_MB(info[i].bytes_huge));
+    total += info[i].bytes_reserved;
+    total_huge += info[i].bytes_huge;
+  }
+  mcell_log("  %-32s %8s %8s %14s %12.2f %12.2f", "total", "", "", "",
+            BYTES_TO_MB(total), BYTES_TO_MB(total_huge));
+
+  mcell_log("Memory usage by species:");
+  for (int i = 0; i < state->n_species; ++i) {
+    struct species *spec = state->species_list[i];
+    if (spec->population == 0 || (spec->flags & IS_SURFACE))
+      continue;
+    mcell_log("  %-32s %14u %12.2f", spec->sym->name, spec->population,
+              BYTES_TO_MB((long long)spec->population *
+                          (long long)molecule_record_size(state, spec)));
+  }
+}
+
+/*************************************************************************
+ sim_stats_add:
+    Add one set of diffusion and collision counts to another.
+
+ In:  total: the counts to add to
+      part: the counts to add
+ Out: None
+*************************************************************************/
+void sim_stats_add(struct sim_stats *total, struct sim_stats const *part) {
+  total->diffusion_number += part->diffusion_number;
+  total->diffusion_cumtime += part->diffusion_cumtime;
+  total->diffusion_fast_steps += part->diffusion_fast_steps;
+  total->ray_voxel_tests += part->ray_voxel_tests;
+  total->ray_polygon_tests += part->ray_polygon_tests;
+  total->ray_polygon_colls += part->ray_polygon_colls;
+  total->vol_vol_colls += part->vol_vol_colls;
+  total->vol_surf_colls += part->vol_surf_colls;
+  total->surf_surf_colls += part->surf_surf_colls;
+  total->vol_wall_colls += part->vol_wall_colls;
+  total->vol_vol_vol_colls += part->vol_vol_vol_colls;
+  total->vol_vol_surf_colls += part->vol_vol_surf_colls;
+  total->vol_surf_surf_colls += part->vol_surf_surf_colls;
+  total->surf_surf_surf_colls += part->surf_surf_surf_colls;
+}
+
+/*************************************************************************
+ mcell_get_statistics:
+    Add up the diffusion and collision counts of the whole simulation so
+    far: those counted by serial work and those of every storage's
+    threaded passes.
+
+ In:  state: the simulation state
+      stats: where to put the totals
+ Out: None
+*************************************************************************/
+void mcell_get_statistics(MCELL_STATE *state, struct sim_stats *stats) {
+  *stats = state->stats;
+  for (struct storage_list *sl = state->storage_head; sl != NULL;
+       sl = sl->next)
+    sim_stats_add(stats, &sl->store->stats);
+}
+
+/*************************************************************************
+ mcell_compact_memory:
+    Hand idle pool memory back to the system, e.g. after a large part of
+    the molecules has been destroyed.  Only blocks without a single live
+    record are released; molecules are never moved.  Surface grids left
+    without molecules also give up their tile arrays.
+
+ In:  state: the simulation state
+ Out: number of bytes released
+*************************************************************************/
+long long mcell_compact_memory(MCELL_STATE *state) {
+  long long released = 0;
+  for (struct storage_list *sl = state->storage_head; sl != NULL;
+       sl = sl->next) {
+    struct storage *store = sl->store;
+    released += mem_compact(store->list);
+    released += mem_compact(store->mol);
+    released += mem_compact(store->smol);
+    released += mem_compact(store->face);
+    released += mem_compact(store->join);
+    released += mem_compact(store->grids);
+    released += mem_compact(store->regl);
+    released += mem_compact(store->pslv);
+    if (store->exdv != state->exdv_mem)
+      released += mem_compact(store->exdv);
+  }
+  released += mem_compact(state->exdv_mem);
+  released += release_empty_grid_tiles(state);
+
+  if (released > 0 && state->notify->memory_usage_report != NOTIFY_NONE)
+    mcell_log("Released %.2f MB of idle pool memory.", BYTES_TO_MB(released));
+  return released;
+}
+
+/* Locality of the volume molecules of one memory partition */
+struct memory_layout_stats {
+  long long molecules;   /* Live volume molecules */
+  long long chunk_pairs; /* Pairs of them in consecutive pool records */
+  long long same_subvol; /* ... of which both are in one subvolume */
+  long long near_subvol; /* ... or in the same or adjacent subvolumes */
+  double list_distance;  /* Bytes between consecutive per-species entries */
+  long long list_steps;
+  double sched_distance; /* Bytes between consecutive scheduled items */
+  long long sched_steps;
+};
+
+#ifndef _WIN32
+static volatile sig_atomic_t memory_layout_requested = 0;
+#endif
+
+static int compare_addresses(void const *a, void const *b) {
+  uintptr_t x = (uintptr_t) * (void *const *)a;
+  uintptr_t y = (uintptr_t) * (void *const *)b;
+  return (x > y) - (x < y);
+}
+
+static double address_distance(void const *a, void const *b) {
+  uintptr_t x = (uintptr_t)a;
+  uintptr_t y = (uintptr_t)b;
+  return (double)((x > y) ? x - y : y - x);
+}
+
+/* Subvolumes are neighbors when their boxes touch, including at an edge or
+ * a corner */
+static int subvolumes_near(struct subvolume const *a,
+                           struct subvolume const *b) {
+  return a->llf.x <= b->urb.x && b->llf.x <= a->urb.x &&
+         a->llf.y <= b->urb.y && b->llf.y <= a->urb.y &&
+         a->llf.z <= b->urb.z && b->llf.z <= a->urb.z;
+}
+
+/************************************************************************
+ *
+ * collect_memory_layout fills in the locality statistics of one memory
+ * partition: which of its volume molecules sit in consecutive records of
+ * the molecule pool, and how far apart in memory the consecutive entries
+ * of its per-species lists and scheduler slots are
+ *
+ ************************************************************************/
+static void collect_memory_layout(MCELL_STATE *state, struct storage *store,
+                                  struct memory_layout_stats *st) {
+  memset(st, 0, sizeof(*st));
+
+  long long n = 0;
+  for (int i = 0; i < state->n_subvols; ++i) {
+    struct subvolume *sv = &state->subvol[i];
+    if (sv->local_storage != store)
+      continue;
+    for (struct per_species_list *psl = sv->species_head; psl != NULL;
+         psl = psl->next)
+      n += psl->n_mols;
+  }
+
+  struct volume_molecule **mols = NULL;
+  if (n > 0)
+    mols = CHECKED_MALLOC_ARRAY(struct volume_molecule *, n,
+                                "memory layout report");
+  long long n_live = 0;
+  for (int i = 0; i < state->n_subvols; ++i) {
+    struct subvolume *sv = &state->subvol[i];
+    if (sv->local_storage != store)
+      continue;
+    for (struct per_species_list *psl = sv->species_head; psl != NULL;
+         psl = psl->next) {
+      struct volume_molecule *prev = NULL;
+      for (int j = 0; j < psl->n_mols; ++j) {
+        struct volume_molecule *vm = psl->mols[j];
+        if (vm == NULL || vm->properties == NULL)
+          continue;
+        mols[n_live++] = vm;
+        if (prev != NULL) {
+          st->list_distance += address_distance(prev, vm);
+          st->list_steps++;
+        }
+        prev = vm;
+      }
+    }
+  }
+  st->molecules = n_live;
+
+  /* Neighbors in memory are records one record size apart */
+  if (n_live > 1) {
+    qsort(mols, n_live, sizeof(*mols), compare_addresses);
+    uintptr_t record_size = (uintptr_t)store->mol->record_size;
+    for (long long i = 1; i < n_live; ++i) {
+      if ((uintptr_t)mols[i] - (uintptr_t)mols[i - 1] != record_size)
+        continue;
+      st->chunk_pairs++;
+      if (mols[i]->subvol == mols[i - 1]->subvol)
+        st->same_subvol++;
+      if (subvolumes_near(mols[i]->subvol, mols[i - 1]->subvol))
+        st->near_subvol++;
+    }
+  }
+  free(mols);
+
+  for (struct schedule_helper *sh = store->timer; sh != NULL;
+       sh = sh->next_scale) {
+    for (int i = -1; i < sh->buf_len; ++i) {
+      struct abstract_element *ae = (i < 0) ? sh->current : sh->circ_buf_head[i];
+      for (; ae != NULL && ae->next != NULL; ae = ae->next) {
+        st->sched_distance += address_distance(ae, ae->next);
+        st->sched_steps++;
+      }
+    }
+  }
+}
+
+/************************************************************************
+ *
+ * mcell_print_memory_layout prints, for every memory partition, how well
+ * the layout of the volume molecules in memory follows their layout in
+ * space: the share of molecules in consecutive pool records that are in
+ * the same or adjacent subvolumes, and the mean distance, in records,
+ * between consecutive molecules of the per-species lists and between
+ * consecutive items of the scheduler slots.  Also where the partition was
+ * placed: the pool thread that created it, the NUMA node that thread ran
+ * on, and the node that holds the first block of its molecule pool.
+ *
+ ************************************************************************/
+void mcell_print_memory_layout(MCELL_STATE *state) {
+  mcell_log("Memory layout of volume molecules at iteration %lld:",
+            state->current_iterations);
+  mcell_log("  %9s %10s %11s %9s %9s %12s %12s %6s %5s %8s", "partition",
+            "molecules", "chunk pairs", "same sv", "near sv", "list stride",
+            "sched stride", "thread", "node", "mem node");
+
+  int storage_idx = 0;
+  for (struct storage_list *sl = state->storage_head; sl != NULL;
+       sl = sl->next, ++storage_idx) {
+    struct memory_layout_stats st;
+    collect_memory_layout(state, sl->store, &st);
+    if (st.molecules == 0)
+      continue;
+
+    double record_size = (double)sl->store->mol->record_size;
+    double pairs = (st.chunk_pairs > 0) ? (double)st.chunk_pairs : 1.0;
+    mcell_log("  %9d %10lld %11lld %8.1f%% %8.1f%% %12.1f %12.1f %6d %5d %8d",
+              storage_idx, st.molecules, st.chunk_pairs,
+              100.0 * st.same_subvol / pairs, 100.0 * st.near_subvol / pairs,
+              (st.list_steps > 0)
+                  ? st.list_distance / st.list_steps / record_size : 0.0,
+              (st.sched_steps > 0)
+                  ? st.sched_distance / st.sched_steps / record_size : 0.0,
+              sl->store->home_thread, sl->store->home_node,
+              thread_memory_node(sl->store->mol->heap_array));
+  }
+}
+
+/************************************************************************
+ *
+ * memory_layout_signal_handler records a request for a memory layout
+ * report, which mcell_poll_memory_layout prints between iterations
+ *
+ ************************************************************************/
+void memory_layout_signal_handler(int signo) {
+  UNUSED(signo);
+#ifndef _WIN32
+  memory_layout_requested = 1;
+#endif
+}
+
+/************************************************************************
+ *
+ * mcell_poll_memory_layout prints the memory layout report if a signal
+ * asked for one since the last call
+ *
+ ************************************************************************/
+void mcell_poll_memory_layout(MCELL_STATE *state) {
+#ifndef _WIN32
+  if (memory_layout_requested) {
+    memory_layout_requested = 0;
+    mcell_print_memory_layout(state);
+  }
+#else
+  UNUSED(state);
+#endif
+}
+
 /************************************************************************
  *
  * function for printing a string
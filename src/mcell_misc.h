@@ -33,6 +33,29 @@ void mcell_print_usage(const char *executable_name);
 
 void mcell_print_stats(void);
 
+long long mcell_get_total_pool_memory(void);
+
+long long mcell_get_pool_memory(char const *pool_name);
+
+long long mcell_get_species_memory(MCELL_STATE *state,
+                                   char const *species_name);
+
+void mcell_log_memory_summary(void);
+
+void mcell_print_memory_usage(MCELL_STATE *state);
+
+long long mcell_compact_memory(MCELL_STATE *state);
+
+void sim_stats_add(struct sim_stats *total, struct sim_stats const *part);
+
+void mcell_get_statistics(MCELL_STATE *state, struct sim_stats *stats);
+
+void mcell_print_memory_layout(MCELL_STATE *state);
+
+void memory_layout_signal_handler(int signo);
+
+void mcell_poll_memory_layout(MCELL_STATE *state);
+
 int mcell_argparse(int argc, char **argv, MCELL_STATE *state);
 
 struct num_expr_list *mcell_copysort_numeric_list(struct num_expr_list *head);
@@ -27,6 +27,23 @@ void mcell_print_usage(const char *executable_name);
 
 void mcell_print_stats();
 
+long long mcell_get_total_pool_memory();
+
+long long mcell_get_pool_memory(char const *pool_name);
+
+long long mcell_get_species_memory(MCELL_STATE *state,
+                                   char const *species_name);
+
+void mcell_log_memory_summary();
+
+void mcell_print_memory_usage(MCELL_STATE *state);
+
+long long mcell_compact_memory(MCELL_STATE *state);
+
+void mcell_get_statistics(MCELL_STATE *state, struct sim_stats *stats);
+
+void mcell_print_memory_layout(MCELL_STATE *state);
+
 int mcell_argparse(int argc, char **argv, MCELL_STATE *state);
 
 struct num_expr_list *mcell_copysort_numeric_list(struct num_expr_list *head);
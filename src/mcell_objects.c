@@ -25,6 +25,9 @@
 #include <math.h>
 #include <string.h>
 #include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <limits.h>
 
 #include "config.h"
 
@@ -36,6 +39,8 @@
 #include "mcell_objects.h"
 #include "dyngeom_parse_extras.h"
 #include "mem_util.h"
+#include "strfunc.h"
+#include "util.h"
 
 /* static helper functions */
 static int is_region_degenerate(struct region *reg_ptr);
@@ -170,22 +175,19 @@ MCELL_STATUS mcell_create_periodic_box(
 }
 
 /*************************************************************************
- mcell_create_poly_object:
-  Create a new polygon object.
+ start_poly_object:
+  Create the (empty) object that a new polygon object lives in.
 
- In: state:    the simulation state
-     poly_obj: all the information needed to create the polygon object (name,
-               vertices, connections)
- Out: 0 on success; any other integer value is a failure.
-      A mesh is created.
+ In: state: the simulation state
+     parent: object the polygon object will be a child of
+     name: unqualified name of the polygon object
+ Out: the new object, or NULL if the name is taken
 *************************************************************************/
-MCELL_STATUS
-mcell_create_poly_object(MCELL_STATE *state, struct object *parent,
-                         struct poly_object *poly_obj,
-                         struct object **new_obj) {
+static struct object *start_poly_object(MCELL_STATE *state,
+                                        struct object *parent,
+                                        const char *name) {
   // create qualified object name
-  char *qualified_name =
-      CHECKED_SPRINTF("%s.%s", parent->sym->name, poly_obj->obj_name);
+  char *qualified_name = CHECKED_SPRINTF("%s.%s", parent->sym->name, name);
 
   // Create the symbol, if it doesn't exist yet.
   int error_code = 0;
@@ -197,14 +199,23 @@ mcell_create_poly_object(MCELL_STATE *state, struct object *parent,
   /*struct object *obj_ptr = make_new_object(state, qualified_name, &error_code);*/
   if (obj_ptr == NULL) {
     free(qualified_name);
-    return MCELL_FAIL;
+    return NULL;
   }
   obj_ptr->last_name = qualified_name;
+  return obj_ptr;
+}
 
-  // Create the actual polygon object
-  new_polygon_list(state, obj_ptr, poly_obj->num_vert, poly_obj->vertices,
-                   poly_obj->num_conn, poly_obj->connections);
+/*************************************************************************
+ finish_poly_object:
+  Clean up a polygon object whose walls are set and attach it to its
+  parent.
 
+ In: parent: object the polygon object becomes a child of
+     obj_ptr: the polygon object
+ Out: MCELL_SUCCESS, or MCELL_FAIL if the polygon list is degenerate
+*************************************************************************/
+static MCELL_STATUS finish_poly_object(struct object *parent,
+                                       struct object *obj_ptr) {
   // Do some clean-up.
   remove_gaps_from_regions(obj_ptr);
   if (check_degenerate_polygon_list(obj_ptr)) {
@@ -215,12 +226,264 @@ mcell_create_poly_object(MCELL_STATE *state, struct object *parent,
   // add_child_objects is called.
   obj_ptr->parent = parent;
   add_child_objects(parent, obj_ptr, obj_ptr);
+  return MCELL_SUCCESS;
+}
+
+/*************************************************************************
+ mcell_create_poly_object:
+  Create a new polygon object.
+
+ In: state:    the simulation state
+     poly_obj: all the information needed to create the polygon object (name,
+               vertices, connections)
+ Out: 0 on success; any other integer value is a failure.
+      A mesh is created.
+*************************************************************************/
+MCELL_STATUS
+mcell_create_poly_object(MCELL_STATE *state, struct object *parent,
+                         struct poly_object *poly_obj,
+                         struct object **new_obj) {
+  struct object *obj_ptr = start_poly_object(state, parent, poly_obj->obj_name);
+  if (obj_ptr == NULL)
+    return MCELL_FAIL;
+
+  // Create the actual polygon object
+  new_polygon_list(state, obj_ptr, poly_obj->num_vert, poly_obj->vertices,
+                   poly_obj->num_conn, poly_obj->connections);
+
+  if (finish_poly_object(parent, obj_ptr))
+    return MCELL_FAIL;
+
+  *new_obj = obj_ptr;
+
+  return MCELL_SUCCESS;
+}
+
+/*************************************************************************
+ mcell_create_poly_object_from_arrays:
+  Create a new polygon object straight from arrays of vertices and faces,
+  without building vertex and connection lists first.
+
+ In: state:    the simulation state
+     parent:   object the polygon object will be a child of
+     name:     unqualified name of the polygon object
+     n_vertices: count of vertices
+     vertices: x, y, z of each vertex (3 * n_vertices values, in microns)
+     n_faces:  count of triangular faces
+     faces:    vertex indices of each face (3 * n_faces values)
+     new_obj:  receives the new object
+ Out: MCELL_SUCCESS, or MCELL_FAIL if a face refers to a missing vertex,
+      the polygon list is degenerate or memory ran out.  The arrays are
+      copied and stay owned by the caller.
+*************************************************************************/
+MCELL_STATUS
+mcell_create_poly_object_from_arrays(MCELL_STATE *state, struct object *parent,
+                                     const char *name, int n_vertices,
+                                     const double *vertices, int n_faces,
+                                     const int *faces,
+                                     struct object **new_obj) {
+  if (n_vertices <= 0 || n_faces <= 0)
+    return MCELL_FAIL;
+  for (int i = 0; i < 3 * n_faces; i++) {
+    if (faces[i] < 0 || faces[i] >= n_vertices) {
+      mcell_error_nodie("Face %d of polygon object '%s' refers to vertex %d, "
+                        "but the object only has %d vertices.",
+                        i / 3, name, faces[i], n_vertices);
+      return MCELL_FAIL;
+    }
+  }
+
+  struct vector3 *vert_array = CHECKED_MALLOC_ARRAY(
+      struct vector3, n_vertices, "polygon list object vertices");
+  struct element_data *elem_array = CHECKED_MALLOC_ARRAY(
+      struct element_data, n_faces, "polygon list object walls");
+  for (int i = 0; i < n_vertices; i++) {
+    vert_array[i].x = vertices[3 * i];
+    vert_array[i].y = vertices[3 * i + 1];
+    vert_array[i].z = vertices[3 * i + 2];
+  }
+  for (int i = 0; i < n_faces; i++)
+    memcpy(elem_array[i].vertex_index, &faces[3 * i], 3 * sizeof(int));
+
+  struct object *obj_ptr = start_poly_object(state, parent, name);
+  if (obj_ptr == NULL) {
+    free(vert_array);
+    free(elem_array);
+    return MCELL_FAIL;
+  }
+
+  if (new_polygon_list_from_arrays(state, obj_ptr, n_vertices, vert_array,
+                                   n_faces, elem_array) == NULL)
+    return MCELL_FAIL;
+
+  if (finish_poly_object(parent, obj_ptr))
+    return MCELL_FAIL;
+
+  *new_obj = obj_ptr;
+
+  return MCELL_SUCCESS;
+}
+
+/*************************************************************************
+ mcell_create_poly_object_from_binary:
+  Create a new polygon object from a binary mesh file (see
+  read_binary_mesh), e.g. as cached for a data model.
+
+ In: state:    the simulation state
+     parent:   object the polygon object will be a child of
+     name:     unqualified name of the polygon object
+     file_path: the binary mesh file
+     new_obj:  receives the new object
+ Out: MCELL_SUCCESS, or MCELL_FAIL if the file cannot be read or the
+      polygon list is degenerate
+*************************************************************************/
+MCELL_STATUS
+mcell_create_poly_object_from_binary(MCELL_STATE *state, struct object *parent,
+                                     const char *name, const char *file_path,
+                                     struct object **new_obj) {
+  int n_vertices, n_elements;
+  struct vector3 *vertices;
+  struct element_data *elements;
+  char *error = read_binary_mesh(file_path, &n_vertices, &vertices,
+                                 &n_elements, &elements);
+  if (error != NULL) {
+    mcell_error_nodie("%s", error);
+    free(error);
+    return MCELL_FAIL;
+  }
+
+  struct object *obj_ptr = start_poly_object(state, parent, name);
+  if (obj_ptr == NULL) {
+    free(vertices);
+    free(elements);
+    return MCELL_FAIL;
+  }
+
+  if (new_polygon_list_from_arrays(state, obj_ptr, n_vertices, vertices,
+                                   n_elements, elements) == NULL)
+    return MCELL_FAIL;
+
+  if (finish_poly_object(parent, obj_ptr))
+    return MCELL_FAIL;
 
   *new_obj = obj_ptr;
 
   return MCELL_SUCCESS;
 }
 
+/**************************************************************************
+ read_binary_mesh:
+    Read the vertices and elements of a binary mesh file.
+
+ In: file_path: the binary mesh file
+     n_vertices: receives the count of vertices
+     vertices: receives the vertices, as in a VERTEX_LIST
+     n_elements: receives the count of elements
+     elements: receives the elements
+ Out: NULL on success, in which case the caller owns the arrays. Otherwise
+      a description of what is wrong with the file, for the caller to report
+      and free.
+
+ A binary mesh file holds, in the byte order of the machine that wrote it:
+   "MCELLPLY"                                     8 bytes
+   version (currently 1)                          uint32
+   number of vertices                             uint32
+   number of elements                             uint32
+   x, y, z of every vertex, as in a VERTEX_LIST   double[3 * n_vertices]
+   vertex indices of every element                uint32[3 * n_elements]
+**************************************************************************/
+char *read_binary_mesh(char const *file_path, int *n_vertices,
+                       struct vector3 **vertices, int *n_elements,
+                       struct element_data **elements) {
+  FILE *f = fopen(file_path, "rb");
+  if (f == NULL)
+    return CHECKED_SPRINTF("Cannot open binary mesh file '%s'", file_path);
+
+  char *error = NULL;
+  struct vector3 *verts = NULL;
+  struct element_data *elems = NULL;
+  uint32_t *indices = NULL;
+  int swap, n_verts, n_elems; /* declared before the first goto failure */
+
+  char magic[sizeof(BINARY_MESH_MAGIC) - 1];
+  uint32_t header[3]; /* version, vertices, elements */
+  if (fread(magic, sizeof(magic), 1, f) != 1 ||
+      memcmp(magic, BINARY_MESH_MAGIC, sizeof(magic)) != 0 ||
+      fread(header, sizeof(header), 1, f) != 1) {
+    error = CHECKED_SPRINTF("'%s' is not a binary mesh file", file_path);
+    goto failure;
+  }
+  swap = (header[0] != BINARY_MESH_VERSION);
+  if (swap) {
+    for (int i = 0; i < 3; i++)
+      byte_swap(&header[i], sizeof(uint32_t));
+  }
+  if (header[0] != BINARY_MESH_VERSION) {
+    error = CHECKED_SPRINTF("Binary mesh file '%s' has unsupported version %u",
+                            file_path, header[0]);
+    goto failure;
+  }
+  if (header[1] > INT_MAX || header[2] > INT_MAX) {
+    error = CHECKED_SPRINTF("Binary mesh file '%s' is too large", file_path);
+    goto failure;
+  }
+  if (header[1] == 0 || header[2] == 0) {
+    error = CHECKED_SPRINTF("Binary mesh file '%s' has no elements",
+                            file_path);
+    goto failure;
+  }
+  n_verts = (int)header[1];
+  n_elems = (int)header[2];
+
+
+  verts = CHECKED_MALLOC_ARRAY(struct vector3, n_verts, "polygon vertices");
+  elems = CHECKED_MALLOC_ARRAY(struct element_data, n_elems,
+                               "polygon elements");
+  indices = CHECKED_MALLOC_ARRAY(uint32_t, 3 * (size_t)n_elems,
+                                 "polygon elements");
+  if (fread(verts, sizeof(struct vector3), n_verts, f) != (size_t)n_verts ||
+      fread(indices, 3 * sizeof(uint32_t), n_elems, f) != (size_t)n_elems) {
+    error = CHECKED_SPRINTF("Binary mesh file '%s' is truncated", file_path);
+    goto failure;
+  }
+  if (swap) {
+    for (int i = 0; i < n_verts; i++) {
+      byte_swap(&verts[i].x, sizeof(double));
+      byte_swap(&verts[i].y, sizeof(double));
+      byte_swap(&verts[i].z, sizeof(double));
+    }
+  }
+  for (int i = 0; i < n_elems; i++) {
+    for (int k = 0; k < 3; k++) {
+      uint32_t index = indices[3 * i + k];
+      if (swap)
+        byte_swap(&index, sizeof(uint32_t));
+      if (index >= header[1]) {
+        error = CHECKED_SPRINTF("Element %d of binary mesh file '%s' "
+                                "refers to a vertex that does not exist",
+                                i, file_path);
+        goto failure;
+      }
+      elems[i].vertex_index[k] = (int)index;
+    }
+  }
+  free(indices);
+  fclose(f);
+
+  *n_vertices = n_verts;
+  *vertices = verts;
+  *n_elements = n_elems;
+  *elements = elems;
+  return NULL;
+
+failure:
+  free(verts);
+  free(elems);
+  free(indices);
+  fclose(f);
+  return error;
+}
+
 /**************************************************************************
  new_polygon_list:
     Create a new polygon list object.
@@ -231,7 +494,7 @@ mcell_create_poly_object(MCELL_STATE *state, struct object *parent,
      vertices: list of vertices
      n_connections: count of walls
      connections: list of walls
- Out: polygon object, or NULL if there was an error
+ Out: polygon object, or NULL if there was an error. The lists are freed.
  NOTE: This is similar to mdl_new_polygon_list
 **************************************************************************/
 struct polygon_object *
@@ -239,8 +502,55 @@ new_polygon_list(MCELL_STATE *state, struct object *obj_ptr, int n_vertices,
                  struct vertex_list *vertices, int n_connections,
                  struct element_connection_list *connections) {
 
-  struct vertex_list *vert_list = NULL;
-  struct element_data *elem_data_ptr = NULL;
+  struct vector3 *vert_array = CHECKED_MALLOC_ARRAY(
+      struct vector3, n_vertices, "polygon list object vertices");
+  struct element_data *elem_array = CHECKED_MALLOC_ARRAY(
+      struct element_data, n_connections, "polygon list object walls");
+
+  struct vertex_list *vert_list = vertices;
+  for (int i = 0; i < n_vertices; i++) {
+    vert_array[i] = *vert_list->vertex;
+    vert_list = vert_list->next;
+  }
+
+  struct element_connection_list *elem_conn_list = connections;
+  for (int i = 0; i < n_connections; i++) {
+    if (elem_conn_list->n_verts != 3) {
+      // mdlerror(parse_state, "All polygons must have three vertices.");
+      free(vert_array);
+      free(elem_array);
+      free_vertex_list(vertices);
+      free_connection_list(connections);
+      return NULL;
+    }
+    memcpy(elem_array[i].vertex_index, elem_conn_list->indices,
+           3 * sizeof(int));
+    elem_conn_list = elem_conn_list->next;
+  }
+  free_vertex_list(vertices);
+  free_connection_list(connections);
+
+  return new_polygon_list_from_arrays(state, obj_ptr, n_vertices, vert_array,
+                                      n_connections, elem_array);
+}
+
+/**************************************************************************
+ new_polygon_list_from_arrays:
+    Create a new polygon list object.
+
+ In: state: the simulation state
+     obj_ptr: contains information about the object (name, etc)
+     n_vertices: count of vertices
+     vertices: array of vertices, owned by the polygon object from now on
+     n_connections: count of walls
+     elements: array of walls, owned by the polygon object from now on
+ Out: polygon object, or NULL if there was an error
+**************************************************************************/
+struct polygon_object *
+new_polygon_list_from_arrays(MCELL_STATE *state, struct object *obj_ptr,
+                             int n_vertices, struct vector3 *vertices,
+                             int n_connections, struct element_data *elements) {
+
   struct region *reg_ptr = NULL;
 
   struct polygon_object *poly_obj_ptr =
@@ -266,38 +576,14 @@ new_polygon_list(MCELL_STATE *state, struct object *obj_ptr, int n_vertices,
   // "parsed_vertices"
   poly_obj_ptr->parsed_vertices = vertices;
 
-  // Copy in vertices and normals
-  vert_list = poly_obj_ptr->parsed_vertices;
+  // Rescale vertices coordinates
   for (int i = 0; i < poly_obj_ptr->n_verts; i++) {
-    // Rescale vertices coordinates
-    vert_list->vertex->x *= state->r_length_unit;
-    vert_list->vertex->y *= state->r_length_unit;
-    vert_list->vertex->z *= state->r_length_unit;
-    vert_list = vert_list->next;
+    vertices[i].x *= state->r_length_unit;
+    vertices[i].y *= state->r_length_unit;
+    vertices[i].z *= state->r_length_unit;
   }
 
-  // Allocate wall elements
-  if ((elem_data_ptr =
-           CHECKED_MALLOC_ARRAY(struct element_data, poly_obj_ptr->n_walls,
-                                "polygon list object walls")) == NULL) {
-    goto failure;
-  }
-  poly_obj_ptr->element = elem_data_ptr;
-
-  // Copy in wall elements
-  for (int i = 0; i < poly_obj_ptr->n_walls; i++) {
-    if (connections->n_verts != 3) {
-      // mdlerror(parse_state, "All polygons must have three vertices.");
-      goto failure;
-    }
-
-    struct element_connection_list *elem_conn_list_temp = connections;
-    memcpy(elem_data_ptr[i].vertex_index, connections->indices,
-           3 * sizeof(int));
-    connections = connections->next;
-    free(elem_conn_list_temp->indices);
-    free(elem_conn_list_temp);
-  }
+  poly_obj_ptr->element = elements;
 
   // Create object default region on polygon list object:
   if ((reg_ptr = mcell_create_region(state, obj_ptr, "ALL")) == NULL) {
@@ -320,12 +606,9 @@ new_polygon_list(MCELL_STATE *state, struct object *obj_ptr, int n_vertices,
   return poly_obj_ptr;
 
 failure:
-  free_connection_list(connections);
-  free_vertex_list(vertices);
+  free(vertices);
+  free(elements);
   if (poly_obj_ptr) {
-    if (poly_obj_ptr->element) {
-      free(poly_obj_ptr->element);
-    }
     if (poly_obj_ptr->side_removed) {
       free_bit_array(poly_obj_ptr->side_removed);
     }
@@ -1379,6 +1662,38 @@ struct element_list *mcell_add_to_region_list(struct element_list *elements,
   return elem;
 }
 
+/**************************************************************************
+ mcell_region_list_from_array:
+
+ In: elements: indices of the elements of a region
+     n_elements: count of indices
+ Out: the list of elements for a region, with runs of consecutive indices
+      merged into one entry, or NULL if memory ran out
+**************************************************************************/
+struct element_list *mcell_region_list_from_array(const int *elements,
+                                                  int n_elements) {
+  struct element_list *head = NULL;
+  for (int i = 0; i < n_elements;) {
+    int j = i + 1;
+    while (j < n_elements && elements[j] == elements[j - 1] + 1)
+      j++;
+
+    struct element_list *elem = new_element_list(elements[i], elements[j - 1]);
+    if (elem == NULL) {
+      while (head != NULL) {
+        struct element_list *next = head->next;
+        free(head);
+        head = next;
+      }
+      return NULL;
+    }
+    elem->next = head;
+    head = elem;
+    i = j;
+  }
+  return head;
+}
+
 /****************************************************************************
  *
  * static helper functions
@@ -67,11 +67,36 @@ MCELL_STATUS mcell_create_poly_object(MCELL_STATE *state, struct object *parent,
                                       struct poly_object *poly_obj,
                                       struct object **new_object);
 
+MCELL_STATUS
+mcell_create_poly_object_from_arrays(MCELL_STATE *state, struct object *parent,
+                                     const char *name, int n_vertices,
+                                     const double *vertices, int n_faces,
+                                     const int *faces,
+                                     struct object **new_object);
+
+MCELL_STATUS
+mcell_create_poly_object_from_binary(MCELL_STATE *state, struct object *parent,
+                                     const char *name, const char *file_path,
+                                     struct object **new_object);
+
+/* Binary vertex and element lists of a polygon list object */
+#define BINARY_MESH_MAGIC "MCELLPLY"
+#define BINARY_MESH_VERSION 1
+
+char *read_binary_mesh(char const *file_path, int *n_vertices,
+                       struct vector3 **vertices, int *n_elements,
+                       struct element_data **elements);
+
 struct polygon_object *
 new_polygon_list(MCELL_STATE *state, struct object *obj_ptr, int n_vertices,
                  struct vertex_list *vertices, int n_connections,
                  struct element_connection_list *connections);
 
+struct polygon_object *
+new_polygon_list_from_arrays(MCELL_STATE *state, struct object *obj_ptr,
+                             int n_vertices, struct vector3 *vertices,
+                             int n_connections, struct element_data *elements);
+
 struct object *make_new_object(
     struct dyngeom_parse_vars *dg_parse,
     struct sym_table_head *obj_sym_table,
@@ -101,6 +126,9 @@ int mcell_set_region_elements(struct region *rgn, struct element_list *elements,
 struct element_list *mcell_add_to_region_list(struct element_list *elements,
                                               u_int region_idx);
 
+struct element_list *mcell_region_list_from_array(const int *elements,
+                                                  int n_elements);
+
 /* Adds children to a meta-object, aggregating counts of walls and vertices
  * from the children into the specified parent. The children should already
  * have their parent pointers set. */
@@ -63,11 +63,51 @@ MCELL_STATUS mcell_create_poly_object(MCELL_STATE *state, struct object *parent,
                                       struct poly_object *poly_obj,
                                       struct object **new_object);
 
+// Takes any buffer of float64 x, y, z triples and any buffer of int32 vertex
+// index triples (e.g. (n, 3) numpy arrays, or array.array('d') and
+// array.array('i') of the flattened lists)
+%rename(mcell_create_poly_object_from_arrays) pymcell_create_poly_object_from_arrays;
+%inline %{
+MCELL_STATUS
+pymcell_create_poly_object_from_arrays(MCELL_STATE *state,
+                                       struct object *parent, char *name,
+                                       PyObject *vertices, PyObject *faces,
+                                       struct object **new_object) {
+  Py_buffer vert_buf, face_buf;
+  Py_ssize_t n_vertices, n_faces;
+  if (pymcell_get_array(vertices, "d", sizeof(double), 3, &vert_buf,
+                        &n_vertices))
+    return MCELL_FAIL;
+  if (pymcell_get_array(faces, "il", sizeof(int), 3, &face_buf, &n_faces)) {
+    PyBuffer_Release(&vert_buf);
+    return MCELL_FAIL;
+  }
+
+  MCELL_STATUS status = mcell_create_poly_object_from_arrays(
+      state, parent, name, (int)n_vertices, vert_buf.buf, (int)n_faces,
+      face_buf.buf, new_object);
+
+  PyBuffer_Release(&face_buf);
+  PyBuffer_Release(&vert_buf);
+  return status;
+}
+%}
+
+MCELL_STATUS
+mcell_create_poly_object_from_binary(MCELL_STATE *state, struct object *parent,
+                                     char *name, char *file_path,
+                                     struct object **new_object);
+
 struct polygon_object *
 new_polygon_list(MCELL_STATE *state, struct object *obj_ptr, int n_vertices,
                  struct vertex_list *vertices, int n_connections,
                  struct element_connection_list *connections);
 
+struct polygon_object *
+new_polygon_list_from_arrays(MCELL_STATE *state, struct object *obj_ptr,
+                             int n_vertices, struct vector3 *vertices,
+                             int n_connections, struct element_data *elements);
+
 struct object *make_new_object(
     struct dyngeom_parse_vars *dg_parse,
     struct sym_table_head *obj_sym_table,
@@ -97,6 +137,26 @@ int mcell_set_region_elements(struct region *rgn, struct element_list *elements,
 struct element_list *mcell_add_to_region_list(struct element_list *elements,
                                               unsigned int region_idx);
 
+// Takes any buffer of int32 element indices
+%inline %{
+int mcell_set_region_elements_from_array(struct region *rgn,
+                                         PyObject *elements,
+                                         int normalize_now) {
+  Py_buffer elem_buf;
+  Py_ssize_t n_elements;
+  if (pymcell_get_array(elements, "il", sizeof(int), 1, &elem_buf,
+                        &n_elements))
+    return 1;
+
+  struct element_list *elems =
+      mcell_region_list_from_array(elem_buf.buf, (int)n_elements);
+  PyBuffer_Release(&elem_buf);
+  if (elems == NULL && n_elements > 0)
+    return 1;
+  return mcell_set_region_elements(rgn, elems, normalize_now);
+}
+%}
+
 /* Adds children to a meta-object, aggregating counts of walls and vertices
  * from the children into the specified parent. The children should already
  * have their parent pointers set. */
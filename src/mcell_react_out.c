@@ -127,6 +127,72 @@ int mcell_get_count(char *mol_name, char *reg_name, struct volume *world) {
 }
 
 
+/*************************************************************************
+ mcell_resolve_counts:
+  Look up the counters for a batch of (molecule, region) pairs once, so that
+  their values can be fetched repeatedly with mcell_get_counts without any
+  symbol or count hash lookups.
+
+ In:  state - the instance world of the object volume.
+      n_counts - number of pairs
+      mol_names - molecule of each pair
+      reg_names - region of each pair
+      handles - receives the counter of each pair, or NULL where the
+                molecule or region is unknown or is not being counted
+Out: MCELL_SUCCESS if every pair was resolved, MCELL_FAIL otherwise.
+     Counters live as long as the world, so handles stay valid across
+     iterations.
+*************************************************************************/
+MCELL_STATUS
+mcell_resolve_counts(MCELL_STATE *state, int n_counts, char **mol_names,
+                     char **reg_names, struct counter **handles) {
+  MCELL_STATUS status = MCELL_SUCCESS;
+  for (int i = 0; i < n_counts; ++i) {
+    handles[i] = NULL;
+
+    struct sym_entry *mol_sym = retrieve_sym(mol_names[i], state->mol_sym_table);
+    struct sym_entry *reg_sym = retrieve_sym(reg_names[i], state->reg_sym_table);
+    if (mol_sym == NULL || reg_sym == NULL) {
+      status = MCELL_FAIL;
+      continue;
+    }
+
+    struct species *mol = (struct species *)mol_sym->value;
+    struct region *reg = (struct region *)reg_sym->value;
+    int hash_bin = (mol->hashval + reg->hashval) & state->count_hashmask;
+    for (struct counter *c = state->count_hash[hash_bin]; c != NULL;
+         c = c->next) {
+      if ((c->counter_type & MOL_COUNTER) != 0 && c->reg_type == reg &&
+          c->target == mol) {
+        handles[i] = c;
+        break;
+      }
+    }
+    if (handles[i] == NULL)
+      status = MCELL_FAIL;
+  }
+
+  return status;
+}
+
+/*************************************************************************
+ mcell_get_counts:
+  Fetch the current counts for counters resolved by mcell_resolve_counts.
+
+ In:  n_counts - number of handles
+      handles - counters from mcell_resolve_counts
+      counts - receives the count of molecules in and on each region, or
+               -7 (as mcell_get_count) where the handle is NULL
+Out: None
+*************************************************************************/
+void mcell_get_counts(int n_counts, struct counter *const *handles,
+                      int *counts) {
+  for (int i = 0; i < n_counts; ++i) {
+    struct counter *c = handles[i];
+    counts[i] = (c != NULL) ? c->data.move.n_enclosed + c->data.move.n_at : -7;
+  }
+}
+
 /*************************************************************************
  mcell_new_output_request:
     Create a new output request.
@@ -251,7 +317,11 @@ struct output_set *mcell_create_new_output_set(const char *comment, int exact_ti
   os->outfile_name = CHECKED_STRDUP(outfile_name, "count outfile_name");
   os->file_flags = (enum overwrite_policy_t)file_flags;
   os->exact_time_flag = exact_time;
+  os->binary_flag = 0;
   os->chunk_count = 0;
+  os->index_flag = (os->file_flags == FILE_SUBSTITUTE);
+  os->file_offset = 0;
+  os->journal_set = -1;
   os->block = NULL;
   os->next = NULL;
 
@@ -410,6 +480,113 @@ mcell_get_counter_value(MCELL_STATE *state,
   return MCELL_SUCCESS;
 }
 
+/************************************************************************
+ *
+ * function for looking at the buffered values of a given count
+ * expression in place, without copying them
+ *
+ * The call expects:
+ *
+ * - MCELL_STATE
+ * - counter_name and column: as for mcell_get_counter_value
+ * - view: a *mcell_counter_column_view which will receive the address of
+ *   the first buffered value, the distance in bytes between consecutive
+ *   values, the number of rows buffered since the last flush to disk, the
+ *   output time of each row and the data type of the values
+ *
+ * NOTE: The view is only valid until the next reaction output event, which
+ *       may overwrite or flush the buffer.
+ *
+ * Returns 1 on error and 0 on success
+ *
+ ************************************************************************/
+MCELL_STATUS
+mcell_get_counter_column(MCELL_STATE *state,
+                         const char *counter_name,
+                         int column_id,
+                         struct mcell_counter_column_view *view) {
+  struct output_column *column = NULL;
+  if ((column = get_counter_trigger_column(state, counter_name, column_id)) ==
+      NULL) {
+    return MCELL_FAIL;
+  }
+
+  // trigger data has no fixed layout per row
+  struct output_buffer *buffer = column->buffer;
+  if (buffer == NULL || buffer[0].data_type == COUNT_TRIG_STRUCT) {
+    return MCELL_FAIL;
+  }
+
+  struct output_block *block = column->set->block;
+  view->data_type = buffer[0].data_type;
+  if (view->data_type == COUNT_INT) {
+    view->data = &buffer[0].val.ival;
+  } else {
+    view->data = &buffer[0].val.dval;
+  }
+  view->stride = sizeof(struct output_buffer);
+  view->n_rows = block->buf_index;
+  view->times = block->time_array;
+
+  return MCELL_SUCCESS;
+}
+
+/*************************************************************************
+ mcell_trace_reaction:
+  Record every occurrence of a named reaction pathway, with its time and
+  location, in an in-memory buffer drained by mcell_drain_reaction_events.
+
+ In:  state - the instance world of the object volume.
+      pathname - name of the reaction pathway
+      capacity - events the buffer holds between drains; only used by the
+                 first pathway traced
+      rxn_id - receives the id the pathway's events carry
+Out: MCELL_SUCCESS, or MCELL_FAIL if the pathway is unknown or memory ran
+     out
+*************************************************************************/
+MCELL_STATUS
+mcell_trace_reaction(MCELL_STATE *state, const char *pathname, u_int capacity,
+                     int *rxn_id) {
+  struct sym_entry *sym = retrieve_sym(pathname, state->rxpn_sym_table);
+  if (sym == NULL)
+    return MCELL_FAIL;
+
+  *rxn_id = trace_rxn_pathname(state, (struct rxn_pathname *)sym->value,
+                               (capacity > 0) ? capacity : 1);
+  return (*rxn_id < 0) ? MCELL_FAIL : MCELL_SUCCESS;
+}
+
+/*************************************************************************
+ mcell_drain_reaction_events:
+  Move the oldest traced reaction events out of the trace buffer.  May be
+  called from another thread while the simulation runs.
+
+ In:  state - the instance world of the object volume.
+      events - receives the events, times in seconds and locations in
+               microns
+      max_events - room in events
+      dropped - if not NULL, receives the events lost since the last drain
+                because the buffer was full
+Out: the number of events copied
+*************************************************************************/
+u_int mcell_drain_reaction_events(MCELL_STATE *state, struct rxn_event *events,
+                                  u_int max_events,
+                                  unsigned long long *dropped) {
+  return drain_rxn_events(state, events, max_events, dropped);
+}
+
+/*************************************************************************
+ mcell_stop_reaction_traces:
+  Stop tracing all reaction pathways and discard the buffered events.  Must
+  not be called while the simulation runs.
+
+ In:  state - the instance world of the object volume.
+Out: None
+*************************************************************************/
+void mcell_stop_reaction_traces(MCELL_STATE *state) {
+  free_rxn_trace(state);
+}
+
 /******************************************************************************
  *
  * static helper functions
@@ -443,7 +620,8 @@ struct output_column *new_output_column() {
  new_output_block:
     Allocate a new reaction data output block, with a specified buffer size.
 
- In: buffersize: requested buffer size
+ In: buffersize: requested buffer size, or 0 to have size_output_buffers
+                 pick one
  Out: output block, or NULL if an error occurs
 **************************************************************************/
 struct output_block *new_output_block(int buffersize) {
@@ -462,7 +640,13 @@ struct output_block *new_output_block(int buffersize) {
   obp->buffersize = 0;
   obp->trig_bufsize = 0;
   obp->buf_index = 0;
+  obp->rows_needed = 0;
+  obp->auto_buffersize = (buffersize <= 0);
   obp->data_set_head = NULL;
+  obp->program = NULL;
+  obp->journal = NULL;
+  if (obp->auto_buffersize)
+    buffersize = COUNTBUFFERSIZE;
 
   /* COUNT buffer size might get modified later if there isn't that much to
    * output */
@@ -536,16 +720,17 @@ void set_reaction_output_timer_step(MCELL_STATE *state,
  In: parse_state: parser state
      obp:  output block whose buffer_size to set
      n_output: maximum number of outputs expected
- Out: 0 on success, 1 on failure
+ Out: the buffer size; the most rows the block needs to buffer are kept in
+      obp->rows_needed
 **************************************************************************/
 long long pick_buffer_size(MCELL_STATE *state, struct output_block *obp,
                            long long n_output) {
-  if (state->chkpt_iterations)
-    return min3ll(state->chkpt_iterations - state->start_iterations + 1, n_output,
-                  obp->buffersize);
-  else
-    return min3ll(state->iterations - state->start_iterations + 1, n_output,
-                  obp->buffersize);
+  long long n_iterations = (state->chkpt_iterations) ? state->chkpt_iterations
+                                                     : state->iterations;
+  long long needed = min3ll(n_iterations - state->start_iterations + 1,
+                            n_output, UINT_MAX);
+  obp->rows_needed = (u_int)needed;
+  return min3ll(needed, obp->buffersize, UINT_MAX);
 }
 
 /**************************************************************************
@@ -632,46 +817,26 @@ int output_block_finalize(struct output_block *obp) {
       switch (oc->expr->expr_flags & OEXPR_TYPE_MASK) {
       // Counting on meshes that don't exist at the beginning of the sim.
       case OEXPR_TYPE_UNDEF:
-        oc->buffer = CHECKED_MALLOC_ARRAY(struct output_buffer,
-                                          obp->buffersize,
-                                          "reaction data output buffer");
-        for (u_int i = 0; i < obp->buffersize; ++i) {
-          oc->buffer[i].data_type = COUNT_UNSET;
-          oc->buffer[i].val.cval = 'X';
-        }
-        break;
       case OEXPR_TYPE_INT:
-        oc->buffer = CHECKED_MALLOC_ARRAY(struct output_buffer,
-                                          obp->buffersize,
-                                          "reaction data output buffer");
-        for (u_int i = 0; i < obp->buffersize; ++i) {
-          oc->buffer[i].data_type = COUNT_INT;
-          oc->buffer[i].val.ival = 0;
-        }
-        break;
-
       case OEXPR_TYPE_DBL:
-        oc->buffer = CHECKED_MALLOC_ARRAY(struct output_buffer,
-                                          obp->buffersize,
-                                          "reaction data output buffer");
-        for (u_int i = 0; i < obp->buffersize; ++i) {
-          oc->buffer[i].data_type = COUNT_DBL;
-          oc->buffer[i].val.dval = 0.0;
-        }
+        oc->buffer = new_count_buffer(oc, obp->buffersize);
         break;
 
-      case OEXPR_TYPE_TRIG:
+      case OEXPR_TYPE_TRIG: {
+        /* All of a column's trigger records come from one array */
         oc->buffer = CHECKED_MALLOC_ARRAY(struct output_buffer,
                                           obp->trig_bufsize,
                                           "reaction data output buffer");
+        struct output_trigger_data *records =
+            CHECKED_MALLOC_ARRAY(struct output_trigger_data,
+                                 obp->trig_bufsize,
+                                 "reaction data output buffer");
         for (u_int i = 0; i < obp->trig_bufsize; ++i) {
           oc->buffer[i].data_type = COUNT_TRIG_STRUCT;
-          oc->buffer[i].val.tval = CHECKED_MALLOC_STRUCT(
-              struct output_trigger_data,
-              "reaction data output buffer");
+          oc->buffer[i].val.tval = &records[i];
           oc->buffer[i].val.tval->name = NULL;
         }
-        break;
+      } break;
 
       default:
         mcell_error("Could not figure out what type of count data to store");
@@ -35,6 +35,15 @@ struct output_set_list {
   struct output_set *set_tail;
 };
 
+/* In-place view of the buffered values of one count column */
+struct mcell_counter_column_view {
+  void *data;                   /* First buffered value */
+  size_t stride;                /* Bytes from one value to the next */
+  u_int n_rows;                 /* Rows buffered since the last flush */
+  double *times;                /* Output time of each row */
+  enum count_type_t data_type;  /* COUNT_INT or COUNT_DBL */
+};
+
 struct output_times_inlist {
   enum output_timer_type_t type;
   double step;
@@ -43,6 +52,13 @@ struct output_times_inlist {
 
 int mcell_get_count(char *mol_name, char *reg_name, struct volume *world);
 
+MCELL_STATUS
+mcell_resolve_counts(MCELL_STATE *state, int n_counts, char **mol_names,
+                     char **reg_names, struct counter **handles);
+
+void mcell_get_counts(int n_counts, struct counter *const *handles,
+                      int *counts);
+
 struct output_request *mcell_new_output_request(MCELL_STATE *state,
                                                 struct sym_entry *target,
                                                 short orientation,
@@ -73,3 +89,17 @@ MCELL_STATUS mcell_get_counter_value(MCELL_STATE *state,
                                      const char *counter_name, int column,
                                      double *count_data,
                                      enum count_type_t *count_data_type);
+
+MCELL_STATUS mcell_get_counter_column(MCELL_STATE *state,
+                                      const char *counter_name, int column,
+                                      struct mcell_counter_column_view *view);
+
+MCELL_STATUS
+mcell_trace_reaction(MCELL_STATE *state, const char *pathname, u_int capacity,
+                     int *rxn_id);
+
+u_int mcell_drain_reaction_events(MCELL_STATE *state, struct rxn_event *events,
+                                  u_int max_events,
+                                  unsigned long long *dropped);
+
+void mcell_stop_reaction_traces(MCELL_STATE *state);
@@ -32,6 +32,16 @@ struct output_set_list {
   struct output_set *set_tail;
 };
 
+%immutable mcell_counter_column_view::stride;
+%immutable mcell_counter_column_view::n_rows;
+%immutable mcell_counter_column_view::data_type;
+
+struct mcell_counter_column_view {
+  size_t stride;
+  u_int n_rows;
+  enum count_type_t data_type;
+};
+
 struct output_times_inlist {
   enum output_timer_type_t type;
   double step;
@@ -40,6 +50,58 @@ struct output_times_inlist {
 
 int mcell_get_count(char *mol_name, char *reg_name, struct volume *world);
 
+// Batch of (molecule, region) counts resolved once and refreshed in one call.
+// The lists of molecule and region names must have the same length.
+%inline %{
+struct mcell_count_query {
+  int n_counts;
+  struct counter **handles;
+  int *counts;
+};
+
+struct mcell_count_query *mcell_new_count_query(MCELL_STATE *state,
+                                                char **mol_names,
+                                                char **reg_names) {
+  int n_mols = 0, n_regs = 0;
+  while (mol_names[n_mols] != NULL)
+    ++n_mols;
+  while (reg_names[n_regs] != NULL)
+    ++n_regs;
+  if (n_mols != n_regs)
+    return NULL;
+
+  struct mcell_count_query *query = malloc(sizeof(struct mcell_count_query));
+  if (query == NULL)
+    return NULL;
+  query->n_counts = n_mols;
+  query->handles = malloc((n_mols + 1) * sizeof(struct counter *));
+  query->counts = malloc((n_mols + 1) * sizeof(int));
+  if (query->handles == NULL || query->counts == NULL) {
+    free(query->handles);
+    free(query->counts);
+    free(query);
+    return NULL;
+  }
+  mcell_resolve_counts(state, n_mols, mol_names, reg_names, query->handles);
+  return query;
+}
+
+// Refresh the counts; the returned view shares memory with the query
+PyObject *mcell_count_query_update(struct mcell_count_query *query) {
+  mcell_get_counts(query->n_counts, query->handles, query->counts);
+  return pymcell_memoryview(query->counts, query->n_counts, 1, sizeof(int),
+                            sizeof(int), "i");
+}
+
+void mcell_delete_count_query(struct mcell_count_query *query) {
+  if (query == NULL)
+    return;
+  free(query->handles);
+  free(query->counts);
+  free(query);
+}
+%}
+
 struct output_request *mcell_new_output_request(MCELL_STATE *state,
                                                 struct sym_entry *target,
                                                 short orientation,
@@ -75,6 +137,62 @@ MCELL_STATUS mcell_get_counter_value(MCELL_STATE *state,
                                      double *count_data,
                                      enum count_type_t *count_data_type);
 
+MCELL_STATUS mcell_get_counter_column(MCELL_STATE *state,
+                                      const char *counter_name, int column,
+                                      struct mcell_counter_column_view *view);
+
+// Views share memory with the output buffer and are only valid until the
+// next reaction output event
+%inline %{
+PyObject *mcell_counter_values_view(struct mcell_counter_column_view *view) {
+  if (view->data_type == COUNT_INT) {
+    return pymcell_memoryview(view->data, view->n_rows, 1, sizeof(int),
+                              view->stride, "i");
+  }
+  return pymcell_memoryview(view->data, view->n_rows, 1, sizeof(double),
+                            view->stride, "d");
+}
+
+PyObject *mcell_counter_times_view(struct mcell_counter_column_view *view) {
+  return pymcell_memoryview(view->times, view->n_rows, 1, sizeof(double),
+                            sizeof(double), "d");
+}
+%}
+
+// Reaction traces: mcell_trace_reaction returns the id that the pathway's
+// events carry (or -1), and mcell_drain_reaction_events returns up to
+// max_events (rxn_id, t, x, y, z) tuples, oldest first.
+%rename(mcell_trace_reaction) pymcell_trace_reaction;
+%rename(mcell_drain_reaction_events) pymcell_drain_reaction_events;
+%inline %{
+int pymcell_trace_reaction(MCELL_STATE *state, const char *pathname,
+                           u_int capacity) {
+  int rxn_id;
+  if (mcell_trace_reaction(state, pathname, capacity, &rxn_id) != MCELL_SUCCESS)
+    return -1;
+  return rxn_id;
+}
+
+PyObject *pymcell_drain_reaction_events(MCELL_STATE *state,
+                                        u_int max_events) {
+  struct rxn_event *events = malloc((max_events + 1) * sizeof(struct rxn_event));
+  if (events == NULL)
+    return PyErr_NoMemory();
+  u_int n = mcell_drain_reaction_events(state, events, max_events, NULL);
+
+  PyObject *list = PyList_New(n);
+  for (u_int i = 0; list != NULL && i < n; ++i) {
+    PyList_SET_ITEM(list, i, Py_BuildValue("(idddd)", events[i].rxn_id,
+                                           events[i].t, events[i].pos.x,
+                                           events[i].pos.y, events[i].pos.z));
+  }
+  free(events);
+  return list;
+}
+%}
+
+void mcell_stop_reaction_traces(MCELL_STATE *state);
+
 struct output_set *mcell_create_new_output_set(char *comment, int exact_time,
                                                struct output_column *col_head,
                                                int file_flags,
@@ -24,9 +24,11 @@
 #include "config.h"
 
 #include <assert.h>
+#include <limits.h>
 #include <string.h>
 #include <math.h>
 #include <stdlib.h>
+#include <time.h>
 
 #include "nfsim_func.h"
 #include "diffuse_util.h"
@@ -40,7 +42,32 @@
 #include "vol_util.h"
 #include "mcell_structs.h"
 
+/* Stages of init_reactions, timed and reported for large networks */
+enum init_reactions_stage {
+  INIT_RXN_CANONICALIZE, /* Reactant order of the pathways */
+  INIT_RXN_SPLIT,        /* Splitting by geometry */
+  INIT_RXN_DUPLICATES,   /* Pathway sorting and duplicate check */
+  INIT_RXN_ARRAYS,       /* Player arrays and probabilities */
+  INIT_RXN_HASH,         /* Reaction hash table */
+  INIT_RXN_GUIDES,       /* Pathway guides and player flags */
+  INIT_RXN_N_STAGES
+};
+
+static char const *const init_reactions_stage_names[INIT_RXN_N_STAGES] = {
+  "reactant order", "geometry split", "duplicate pathways",
+  "players and rates", "reaction hash table", "pathway guides"
+};
+
+/* Stage times are reported for networks of at least this many pathways */
+#define INIT_RXN_REPORT_MIN_PATHWAYS 10000
+
 /* static helper functions */
+static double init_reactions_clock(void);
+
+static void report_init_reactions(struct volume *state, int num_rx,
+                                  long long num_paths,
+                                  double const *stage_seconds);
+
 static char *concat_rx_name(char *name1, char *name2);
 
 MCELL_STATUS extract_reactants(struct pathway *path,
@@ -99,7 +126,8 @@ static int build_reaction_hash_table(
 
 static void check_reaction_for_duplicate_pathways(struct pathway **head);
 
-static int load_rate_file(struct volume* state, struct rxn *rx, char *fname, int path);
+static struct rate_table *load_rate_file(struct volume *state,
+                                         char const *fname);
 
 static void add_surface_reaction_flags(struct sym_table_head *mol_sym_table,
                                        struct species *all_mols,
@@ -117,221 +145,110 @@ static int sort_product_list_compare(struct product *list_item,
 
 static struct product *sort_product_list(struct product *product_head);
 
+static void set_pathway_rate_constant(struct volume *world,
+                                      struct rxn_pathname *rxpn,
+                                      double rate_constant,
+                                      struct bit_array **fixed);
+
+static void mark_rate_change_reactant(struct volume *world,
+                                      struct rxn *reaction,
+                                      struct bit_array **fixed);
+
+static void reschedule_rate_change_reactants(struct volume *world,
+                                             struct bit_array *fixed);
+
 /*************************************************************************
  *
- * mcell_modify_multiple_rate_constants - modifies the rate constant of multiple reactions with
- * names.
+ * mcell_get_rate_constant_handle - looks up a named reaction pathway once,
+ * so that its rate constant can be changed repeatedly with
+ * mcell_set_rate_constant without going through the symbol table.
+ *
+ * Returns NULL if there is no reaction with this name.
  *
  *************************************************************************/
-MCELL_STATUS
-mcell_modify_multiple_rate_constants(struct volume *world, char **names, double *rate_constants, int n_rxns) {
-
-  // Store what each type of reaction is
-  // diffusing
-  struct rxn **reactions_ud = (struct rxn **)malloc(0 * sizeof(*reactions_ud)); // Empty
-  // unimolecular non-diffusing, volume
-  struct rxn **reactions_undv = (struct rxn **)malloc(0 * sizeof(*reactions_undv));
-  // unimolecular non-diffusing, surface
-  struct rxn **reactions_unds = (struct rxn **)malloc(0 * sizeof(*reactions_unds));
-  // Keep track of the size
-  int n_reactions_ud=0;
-  int n_reactions_undv=0;
-  int n_reactions_unds=0;
-
-  // Go through all the reactions
-  int i_rxn=0;
-  while(i_rxn < n_rxns)
-  {
-
-    // Grab the reaction
-    struct sym_table_head *rxpn_sym_table = world->rxpn_sym_table;
-    struct sym_entry *sym = retrieve_sym(names[i_rxn], rxpn_sym_table);
-
-    // If the reaction couldn't be found by name, return fail
-    if (sym == NULL) 
-    {
-      return MCELL_FAIL;
-    }
-
-    // Found the reaction, now do the changing
-
-    // What is the pathway that needs to be changed?
-    struct rxn_pathname *rxpn = (struct rxn_pathname *)sym->value;
-    // The reaction that owns this pathway
-    struct rxn *reaction = rxpn->rx;  
-    // The index of the pathway in this reaction
-    int j = rxpn->path_num;
-
-    // Check what type of reaction this is; store this to update the scheduler later
-    int can_diffuse = distinguishable(reaction->players[0]->D, 0, EPS_C);
-    if (reaction->n_reactants == 1 && can_diffuse)
-    {
-      // unimolecular reactions w/ diffusable reactants
-      reactions_ud = (struct rxn **) realloc(reactions_ud, (n_reactions_ud + 1)*sizeof(*reactions_ud));
-      reactions_ud[n_reactions_ud] = reaction;
-      n_reactions_ud++;
-    }
-    else if (((!can_diffuse) && (reaction->n_reactants == 1)) || 
-    ((!can_diffuse) && (reaction->n_reactants == 2) && (reaction->players[1]->flags == IS_SURFACE))) 
-    {
-      // unimolecular reactions w/ non-diffusable reactants
-
-      // Surface or volume
-      if ((reaction->players[0]->flags & NOT_FREE) != 0) 
-      {
-        // Surface
-        reactions_unds = (struct rxn **) realloc(reactions_unds, (n_reactions_unds + 1)*sizeof(*reactions_unds));
-        reactions_unds[n_reactions_unds] = reaction;
-        n_reactions_unds++;
-      }
-      else
-      {
-        // Volume
-        reactions_undv = (struct rxn **) realloc(reactions_undv, (n_reactions_undv + 1)*sizeof(*reactions_undv));
-        reactions_undv[n_reactions_undv] = reaction;
-        n_reactions_undv++;
-      }
-    }
-    
-    // From the new rate constant, compute the NEW probability for this pathway
-    double p = rate_constants[i_rxn] * reaction->pb_factor;
-
-    // Find the delta_prob for this pathway
-    double delta_prob;
-    if (j == 0)
-      delta_prob = p - reaction->cum_probs[0];
-    else
-      delta_prob = p - (reaction->cum_probs[j] - reaction->cum_probs[j - 1]);
+struct rxn_pathname *
+mcell_get_rate_constant_handle(struct volume *world, const char *name) {
+  struct sym_entry *sym = retrieve_sym(name, world->rxpn_sym_table);
+  if (sym == NULL)
+    return NULL;
+  return (struct rxn_pathname *)sym->value;
+}
 
-    // Update the prob for this pathway, but ALSO all other pathways above it
-    for (int k = j; k < reaction->n_pathways; k++) 
-    {
-      reaction->cum_probs[k] += delta_prob;
+/*************************************************************************
+ *
+ * mcell_set_multiple_rate_constants - modifies the rate constant of
+ * multiple reaction pathways given by handles from
+ * mcell_get_rate_constant_handle.
+ *
+ *************************************************************************/
+MCELL_STATUS
+mcell_set_multiple_rate_constants(struct volume *world,
+                                  struct rxn_pathname **handles,
+                                  double *rate_constants, int n_rxns) {
+  // Species of non-diffusing molecules which need a new lifetime
+  struct bit_array *fixed = NULL;
+
+  MCELL_STATUS status = MCELL_SUCCESS;
+  for (int i_rxn = 0; i_rxn < n_rxns; i_rxn++) {
+    if (handles[i_rxn] == NULL) {
+      status = MCELL_FAIL;
+      break;
     }
-    reaction->max_fixed_p += delta_prob;
-    reaction->min_noreaction_p += delta_prob;
-
-    // Go to the next reaction that needs to be changed
-    i_rxn++;
+    set_pathway_rate_constant(world, handles[i_rxn], rate_constants[i_rxn],
+                              &fixed);
   }
 
   // Now, reschedule all necessary reactions at once
+  reschedule_rate_change_reactants(world, fixed);
+  if (fixed != NULL)
+    free_bit_array(fixed);
 
-  // Check: are there any reactions with diffusable reactants
-  if (n_reactions_ud > 0) // There is at least one
-  {
-    for (struct storage_list *local = world->storage_head; local != NULL; local = local->next) 
-    {
-      struct abstract_element *head_molecule = local->store->timer->current;
-      while (local->store->timer->current != NULL) 
-      {
-        struct abstract_molecule *am = (struct abstract_molecule *)schedule_peak(local->store->timer);
+  return status;
+}
 
-        // Go through all types of these reactions
-        for (int i_reactions_ud=0; i_reactions_ud<n_reactions_ud; i_reactions_ud++)
-        {
-          // We only want to update molecules involved in this reaction.
-          // Also, skip dead molecs (props=NULL). They'll be cleaned up later.
-          if ((am->properties != NULL) && (am->properties->species_id == reactions_ud[i_reactions_ud]->players[0]->species_id)) 
-          {
-            // Setting t2=0 and ACT_CHANGE will cause the lifetime to be
-            // recomputed during the next timestep
-            am->t2 = 0.0;
-            am->flags |= ACT_CHANGE;
-          }
-        }
-      }
-      // Reset current molecule in scheduler now that we're done "peaking"
-      local->store->timer->current = head_molecule;
-    }
-  }
+/*************************************************************************
+ *
+ * mcell_set_rate_constant - modifies the rate constant of the reaction
+ * pathway given by a handle from mcell_get_rate_constant_handle.
+ *
+ *************************************************************************/
+MCELL_STATUS
+mcell_set_rate_constant(struct volume *world, struct rxn_pathname *handle,
+                        double rate_constant) {
+  return mcell_set_multiple_rate_constants(world, &handle, &rate_constant, 1);
+}
 
-  // Check: are there any reactions with NON-diffusable reagents
-  // Volume case
-  if (n_reactions_undv > 0) // There is at least one
-  {
-    int n_subvols = world->n_subvols;
-    for (int i = 0; i < n_subvols; i++) 
-    {
-      struct subvolume *sv = &(world->subvol[i]);
+/*************************************************************************
+ *
+ * mcell_modify_multiple_rate_constants - modifies the rate constant of multiple reactions with
+ * names.
+ *
+ *************************************************************************/
+MCELL_STATUS
+mcell_modify_multiple_rate_constants(struct volume *world, char **names, double *rate_constants, int n_rxns) {
 
-      for (struct per_species_list *psl = sv->species_head; psl != NULL; psl = psl->next) 
-      {
-        if (psl->properties == NULL) 
-        {
-          continue;
-        }
-        for (struct volume_molecule *vm = psl->head; vm != NULL; vm = vm->next_v) 
-        {
-          if ((vm->properties != NULL) && (vm->t > world->current_iterations)) 
-          {
-            // Go through all types of these reactions
-            for (int i_reactions_undv=0; i_reactions_undv<n_reactions_undv; i_reactions_undv++)
-            {
-              // More efficient here would be a hash table from species_id to reaction
-              if (vm->properties->species_id == reactions_undv[i_reactions_undv]->players[0]->species_id)
-              { 
-                for (struct storage_list *local = world->storage_head; local != NULL; local = local->next) 
-                {
-                  vm->flags |= ACT_CHANGE;
-                  vm->t2 = 0.0;
-                  schedule_reschedule(local->store->timer, vm, world->current_iterations);
-                }
-              }
-            }
-          }
-        }
-      }
-    }
-  }
+  // Species of non-diffusing molecules which need a new lifetime
+  struct bit_array *fixed = NULL;
 
-  // Surface case
-  if (n_reactions_unds > 0) // There is at least one
-  {
-    int n_subvols = world->n_subvols;
-    for (int i = 0; i < n_subvols; i++) 
-    {
-      struct subvolume *sv = &(world->subvol[i]);
+  MCELL_STATUS status = MCELL_SUCCESS;
+  for (int i_rxn = 0; i_rxn < n_rxns; i_rxn++) {
+    struct rxn_pathname *rxpn =
+        mcell_get_rate_constant_handle(world, names[i_rxn]);
 
-      for (struct wall_list *wl = sv->wall_head; wl != NULL; wl = wl->next) 
-      {
-        struct surface_grid *grid = wl->this_wall->grid;
-        if (grid != NULL) 
-        {
-          for (u_int tile_idx = 0; tile_idx < grid->n_tiles; tile_idx++) 
-          {
-            if (grid->sm_list[tile_idx]) 
-            {
-              struct surface_molecule *sm = grid->sm_list[tile_idx]->sm;
-              if ((sm->properties != NULL) && (sm->t > world->current_iterations)) 
-              {
-                // Go through all types of these reactions
-                for (int i_reactions_unds=0; i_reactions_unds<n_reactions_unds; i_reactions_unds++)
-                {
-                  // More efficient here would be a hash table from species_id to reaction
-                  if (sm->properties->species_id == reactions_unds[i_reactions_unds]->players[0]->species_id)
-                  {
-                    for (struct storage_list *local = world->storage_head; local != NULL; local = local->next) 
-                    {
-                      sm->flags |= ACT_CHANGE;
-                      sm->t2 = 0.0;
-                      schedule_reschedule(local->store->timer, sm, world->current_iterations);
-                    }
-                  }
-                } 
-              }
-            }
-          }
-        }
-      }
+    // If the reaction couldn't be found by name, return fail
+    if (rxpn == NULL) {
+      status = MCELL_FAIL;
+      break;
     }
+    set_pathway_rate_constant(world, rxpn, rate_constants[i_rxn], &fixed);
   }
 
-  free(reactions_ud);
-  free(reactions_undv);
-  free(reactions_unds);
+  // Now, reschedule all necessary reactions at once
+  reschedule_rate_change_reactants(world, fixed);
+  if (fixed != NULL)
+    free_bit_array(fixed);
 
-  return MCELL_SUCCESS;
+  return status;
 }
 
 /*************************************************************************
@@ -345,207 +262,204 @@ mcell_modify_multiple_rate_constants(struct volume *world, char **names, double
  *
  * mcell_modify_rate_constant(world, "rxn", 0)
  *
- * NOTE: This is inefficient and needs more extensive testing
+ * When changing the same reaction repeatedly, look it up once with
+ * mcell_get_rate_constant_handle and use mcell_set_rate_constant instead.
  *
  *************************************************************************/
 MCELL_STATUS
 mcell_modify_rate_constant(struct volume *world, char *name, double rate_constant) {
-
-  struct sym_table_head *rxpn_sym_table = world->rxpn_sym_table;
-  struct sym_entry *sym = retrieve_sym(name, rxpn_sym_table);
-  if (sym == NULL) 
-  {
+  struct rxn_pathname *rxpn = mcell_get_rate_constant_handle(world, name);
+  if (rxpn == NULL)
     return MCELL_FAIL;
-  }
-  else 
-  {
-    
-    // What is the pathway that needs to be changed?
-    struct rxn_pathname *rxpn = (struct rxn_pathname *)sym->value;
-    // The reaction that owns this pathway
-    struct rxn *reaction = rxpn->rx;  
-    // The index of the pathway in this reaction
-    int j = rxpn->path_num;
-
-    // From the new rate constant, compute the NEW probability for this pathway
-    double p = rate_constant * reaction->pb_factor;
-
-    // Find the delta_prob for this pathway
-    double delta_prob;
+  return mcell_set_rate_constant(world, rxpn, rate_constant);
+}
+
+/*************************************************************************
+ set_pathway_rate_constant:
+    Changes the probability of one pathway, and the cumulative
+    probabilities of the pathways above it, of the reaction the pathway
+    belongs to; no other reaction is touched.
+
+ In:  world: the simulation state
+      rxpn: the named pathway
+      rate_constant: its new rate constant
+      fixed: bits by species_id for non-diffusing reactants, allocated when
+             the first one is marked
+ Out: none
+*************************************************************************/
+static void set_pathway_rate_constant(struct volume *world,
+                                      struct rxn_pathname *rxpn,
+                                      double rate_constant,
+                                      struct bit_array **fixed) {
+  // The reaction that owns this pathway
+  struct rxn *reaction = rxpn->rx;
+  // The index of the pathway in this reaction
+  int j = rxpn->path_num;
+
+  // From the new rate constant, compute the NEW probability for this pathway
+  double p = rate_constant * reaction->pb_factor;
+
+  // Find the delta_prob for this pathway
+  double delta_prob;
+  if (j == 0)
+    delta_prob = p - reaction->cum_probs[0];
+  else
+    delta_prob = p - (reaction->cum_probs[j] - reaction->cum_probs[j - 1]);
+
+  // Update the prob for this pathway, but ALSO all other pathways above it
+  for (int k = j; k < reaction->n_pathways; k++)
+    reaction->cum_probs[k] += delta_prob;
+  reaction->max_fixed_p += delta_prob;
+  reaction->min_noreaction_p += delta_prob;
+  build_pathway_guide(reaction);
+
+  // Print if the flags are set
+  /*
+  if (world->notify->time_varying_reactions == NOTIFY_FULL &&
+      reaction->cum_probs[j] >= world->notify->reaction_prob_notify) {
+
+    // Print the reaction probabilities
+    double new_prob;
     if (j == 0)
-      delta_prob = p - reaction->cum_probs[0];
+    {
+        new_prob = reaction->cum_probs[0];
+    }
     else
-      delta_prob = p - (reaction->cum_probs[j] - reaction->cum_probs[j - 1]);
-
-    // Update the prob for this pathway, but ALSO all other pathways above it
-    for (int k = j; k < reaction->n_pathways; k++) 
     {
-      reaction->cum_probs[k] += delta_prob;
-    }
-    reaction->max_fixed_p += delta_prob;
-    reaction->min_noreaction_p += delta_prob;
- 
-    // Print if the flags are set
-    /*
-    if (world->notify->time_varying_reactions == NOTIFY_FULL &&
-        reaction->cum_probs[j] >= world->notify->reaction_prob_notify) {
-
-      // Print the reaction probabilities
-      double new_prob;
-      if (j == 0)
-      {
-          new_prob = reaction->cum_probs[0];
-      }
-      else
-      {
-          new_prob = reaction->cum_probs[j] - reaction->cum_probs[j - 1];
-      }
-      // Print the new_prob
-      if (reaction->n_reactants == 1) 
-      {
-        mcell_log_raw("Probability %.4e set for %s[%d] -> ", new_prob,
-          reaction->players[0]->sym->name, reaction->geometries[0]);
-      } 
-      else if (reaction->n_reactants == 2) 
-      {
-        mcell_log_raw("Probability %.4e set for %s[%d] + %s[%d] -> ", new_prob,
-          reaction->players[0]->sym->name, reaction->geometries[0],
-          reaction->players[1]->sym->name, reaction->geometries[1]);
-      } 
-      else 
-      {
-        mcell_log_raw("Probability %.4e set for %s[%d] + %s[%d] + %s[%d] -> ",
-          new_prob, reaction->players[0]->sym->name, reaction->geometries[0],
-          reaction->players[1]->sym->name, reaction->geometries[1],
-          reaction->players[2]->sym->name, reaction->geometries[2]);
-      }
-      for (unsigned int n_product = reaction->product_idx[j]; 
-        n_product < reaction->product_idx[j + 1]; n_product++) 
-      {
-          if (reaction->players[n_product] != NULL)
-          {
-            mcell_log_raw("%s[%d] ", reaction->players[n_product]->sym->name,
-                          reaction->geometries[n_product]);
-          }
-      }
-      mcell_log_raw("\n");
+        new_prob = reaction->cum_probs[j] - reaction->cum_probs[j - 1];
     }
-    */
-
-    // This is the old code as of 01.27.2017. Fixed based on react_cond.c
-    /*
-    int num_path = reaction->n_pathways;
-    double p = rate_constant * reaction->pb_factor;
-
-    double delta_prob = 0;
-    if (num_path > 1) {
-      delta_prob = \
-      p - (reaction->cum_probs[num_path-1] - reaction->cum_probs[num_path-2]);
+    // Print the new_prob
+    if (reaction->n_reactants == 1) 
+    {
+      mcell_log_raw("Probability %.4e set for %s[%d] -> ", new_prob,
+        reaction->players[0]->sym->name, reaction->geometries[0]);
+    } 
+    else if (reaction->n_reactants == 2) 
+    {
+      mcell_log_raw("Probability %.4e set for %s[%d] + %s[%d] -> ", new_prob,
+        reaction->players[0]->sym->name, reaction->geometries[0],
+        reaction->players[1]->sym->name, reaction->geometries[1]);
+    } 
+    else 
+    {
+      mcell_log_raw("Probability %.4e set for %s[%d] + %s[%d] + %s[%d] -> ",
+        new_prob, reaction->players[0]->sym->name, reaction->geometries[0],
+        reaction->players[1]->sym->name, reaction->geometries[1],
+        reaction->players[2]->sym->name, reaction->geometries[2]);
     }
-    else {
-      delta_prob = p - (reaction->cum_probs[num_path-1]);
+    for (unsigned int n_product = reaction->product_idx[j]; 
+      n_product < reaction->product_idx[j + 1]; n_product++) 
+    {
+        if (reaction->players[n_product] != NULL)
+        {
+          mcell_log_raw("%s[%d] ", reaction->players[n_product]->sym->name,
+                        reaction->geometries[n_product]);
+        }
     }
-    reaction->cum_probs[num_path-1] += delta_prob;
-    reaction->max_fixed_p += delta_prob;
-    reaction->min_noreaction_p += delta_prob;
-    */
+    mcell_log_raw("\n");
+  }
+  */
 
-    // Now reschedule all the necessary reactions
+  mark_rate_change_reactant(world, reaction, fixed);
+}
 
-    int can_diffuse = distinguishable(reaction->players[0]->D, 0, EPS_C);
-    // Need to recompute lifetimes for unimolecular reactions w/ diffusable
-    // reactants.
-    if (reaction->n_reactants == 1 && can_diffuse) 
-    {
-      for (struct storage_list *local = world->storage_head; local != NULL; local = local->next) 
-      {
-        struct abstract_element *head_molecule = local->store->timer->current;
-        while (local->store->timer->current != NULL) 
-        {
-          struct abstract_molecule *am = (struct abstract_molecule *)schedule_peak(local->store->timer);
-          // We only want to update molecules involved in this reaction.
-          // Also, skip dead molecs (props=NULL). They'll be cleaned up later.
-          if ((am->properties != NULL) && (am->properties->species_id == reaction->players[0]->species_id)) 
-          {
-            // Setting t2=0 and ACT_CHANGE will cause the lifetime to be
-            // recomputed during the next timestep
-            am->t2 = 0.0;
-          am->flags |= ACT_CHANGE;
-          }
+/*************************************************************************
+ mark_rate_change_reactant:
+    Makes the molecules which depend on the given reaction recompute their
+    lifetime.  Lifetimes only depend on unimolecular reactions (including
+    sm@sc style reactions of surface molecules at a surface class), so
+    only their reactant species are affected.  Diffusing molecules come up
+    in the scheduler every timestep, so bumping the lifetime epoch of
+    their species is enough; non-diffusing ones are marked to be hunted
+    down by reschedule_rate_change_reactants.
+
+ In:  world: the simulation state
+      reaction: the reaction whose rate changed
+      fixed: bits by species_id for non-diffusing reactants, allocated when
+             the first one is marked
+ Out: the reactant's lifetime epoch is bumped or its bit is set, if needed
+*************************************************************************/
+static void mark_rate_change_reactant(struct volume *world,
+                                      struct rxn *reaction,
+                                      struct bit_array **fixed) {
+  int can_diffuse = distinguishable(reaction->players[0]->D, 0, EPS_C);
+  if (reaction->n_reactants == 1 && can_diffuse) {
+    reaction->players[0]->lifetime_epoch++;
+  } else if (((!can_diffuse) && (reaction->n_reactants == 1)) ||
+             ((!can_diffuse) && (reaction->n_reactants == 2) &&
+              (reaction->players[1]->flags == IS_SURFACE))) {
+    if (*fixed == NULL) {
+      *fixed = new_bit_array(world->n_species);
+      if (*fixed == NULL)
+        mcell_allocfailed("Failed to allocate species bits for rate change.");
+      set_all_bits(*fixed, 0);
+    }
+    set_bit(*fixed, reaction->players[0]->species_id, 1);
+  }
+}
+
+/*************************************************************************
+ reschedule_rate_change_reactants:
+    Makes the molecules of the marked non-diffusing species recompute
+    their lifetime.  They may be scheduled far in the future and are moved
+    up to the current iteration.  Volume molecules are found through the
+    per-species lists, so lists of unaffected species are skipped as a
+    whole.
+
+ In:  world: the simulation state
+      fixed: bits by species_id for non-diffusing reactants, or NULL
+ Out: none
+*************************************************************************/
+static void reschedule_rate_change_reactants(struct volume *world,
+                                             struct bit_array *fixed) {
+  // Non-diffusing molecules won't come up next in the scheduler, so we
+  // have to hunt them all down.  Each sits in the scheduler of the memory
+  // partition it lives in.
+  if (fixed == NULL)
+    return;
+
+  for (int i = 0; i < world->n_subvols; i++) {
+    struct subvolume *sv = &(world->subvol[i]);
+
+    for (struct per_species_list *psl = sv->species_head; psl != NULL;
+         psl = psl->next) {
+      if (psl->properties == NULL ||
+          !get_bit(fixed, psl->properties->species_id))
+        continue;
+      for (int mi = psl->n_mols - 1; mi >= 0; mi--) {
+        struct volume_molecule *vm = psl->mols[mi];
+        if ((vm->properties != NULL) && (vm->t > world->current_iterations)) {
+          vm->flags |= ACT_CHANGE;
+          vm->t2 = 0.0;
+          schedule_reschedule(vm->subvol->local_storage->timer, vm,
+                              world->current_iterations);
         }
-        // Reset current molecule in scheduler now that we're done "peaking"
-        local->store->timer->current = head_molecule;
       }
     }
+  }
 
-    // Need to recompute lifetimes for non-diffusing molecules that are
-    // unimolecular or where you have a surface molecule at a surface class
-    // (e.g. sm@sc->whatever). These molecules won't come up next in the
-    // scheduler, so we have to hunt them all down... :(
-    if (((!can_diffuse) && (reaction->n_reactants == 1)) || 
-      ((!can_diffuse) && (reaction->n_reactants == 2) && (reaction->players[1]->flags == IS_SURFACE))) 
-    {
-      for (struct storage_list *local = world->storage_head; local != NULL; local = local->next) 
-      {
-        int n_subvols = world->n_subvols;
-        for (int i = 0; i < n_subvols; i++) 
-        {
-          struct subvolume *sv = &(world->subvol[i]);
-
-          // Reschedule the surface molecules involved in the reaction
-          if ((reaction->players[0]->flags & NOT_FREE) != 0) 
-          {
-            for (struct wall_list *wl = sv->wall_head; wl != NULL; wl = wl->next) 
-            {
-              struct surface_grid *grid = wl->this_wall->grid;
-              if (grid != NULL) 
-              {
-                for (u_int tile_idx = 0; tile_idx < grid->n_tiles; tile_idx++) 
-                {
-                  if (grid->sm_list[tile_idx]) 
-                  {
-                    struct surface_molecule *sm = grid->sm_list[tile_idx]->sm;
-                    if ((sm->properties != NULL) && 
-                      (sm->properties->species_id == reaction->players[0]->species_id) &&
-                      (sm->t > world->current_iterations)) 
-                    {
-                      sm->flags |= ACT_CHANGE;
-                      sm->t2 = 0.0;
-                      schedule_reschedule(local->store->timer, sm, world->current_iterations);
-                    }
-                  }
-                } 
-              }
-            }   
-          }
-          // Reschedule the volume molecules involved in the reaction
-          else 
-          {
-            for (struct per_species_list *psl = sv->species_head; psl != NULL; psl = psl->next) 
-            {
-              if (psl->properties == NULL) 
-              {
-                continue;
-              }
-              for (struct volume_molecule *vm = psl->head; vm != NULL; vm = vm->next_v) 
-              {
-                if ((vm->properties != NULL) && 
-                  (vm->properties->species_id == reaction->players[0]->species_id)  &&
-                  (vm->t > world->current_iterations)) 
-                { 
-                  vm->flags |= ACT_CHANGE;
-                  vm->t2 = 0.0;
-                  schedule_reschedule(local->store->timer, vm, world->current_iterations);
-                }
-              }
-            }
+  for (int i = 0; i < world->n_subvols; i++) {
+    struct subvolume *sv = &(world->subvol[i]);
+
+    for (struct wall_list *wl = sv->wall_head; wl != NULL; wl = wl->next) {
+      struct surface_grid *grid = wl->this_wall->grid;
+      if (grid == NULL || grid->n_occupied == 0)
+        continue;
+      for (u_int tile_idx = 0; tile_idx < grid->n_tiles; tile_idx++) {
+        if (grid->sm_list[tile_idx]) {
+          struct surface_molecule *sm = grid->sm_list[tile_idx]->sm;
+          if ((sm->properties != NULL) &&
+              get_bit(fixed, sm->properties->species_id) &&
+              (sm->t > world->current_iterations)) {
+            sm->flags |= ACT_CHANGE;
+            sm->t2 = 0.0;
+            schedule_reschedule(sm->grid->subvol->local_storage->timer, sm,
+                                world->current_iterations);
           }
         }
       }
     }
   }
-
-  return MCELL_SUCCESS;
 }
 
 MCELL_STATUS
@@ -866,8 +780,6 @@ mcell_add_reaction(struct notifications *notify,
       return MCELL_FAIL;
     }
   }
-  //set diffusion function
-  rxnp->get_reactant_diffusion = rxn_get_standard_diffusion;
   return MCELL_SUCCESS;
 }
 
@@ -1043,7 +955,6 @@ mcell_add_surface_reaction(struct sym_table_head *rxn_sym_table,
   pathp->next = rxnp->pathway_head;
   rxnp->pathway_head = pathp;
 
-  rxnp->get_reactant_diffusion = rxn_get_standard_diffusion;
   return MCELL_SUCCESS;
 }
 
@@ -1150,7 +1061,6 @@ mcell_add_concentration_clamp(struct sym_table_head *rxn_sym_table,
     no->next = surface_class->clamp_conc_mols;
     surface_class->clamp_conc_mols = no;
   }
-  rxnp->get_reactant_diffusion = rxn_get_standard_diffusion;
   return MCELL_SUCCESS;
 }
 
@@ -1269,6 +1179,10 @@ int init_reactions(MCELL_STATE *state) {
   struct product *prod = NULL;
   short geom;
   int num_rx = 0;
+  long long num_paths = 0;
+  double stage_seconds[INIT_RXN_N_STAGES] = { 0.0 };
+  double t_stage = init_reactions_clock();
+  double t_now;
 
   state->vacancy_search_dist2 *= state->r_length_unit; /* Convert units */
   state->vacancy_search_dist2 *= state->vacancy_search_dist2; /* Take square */
@@ -1276,10 +1190,6 @@ int init_reactions(MCELL_STATE *state) {
   if (state->rx_radius_3d <= 0.0) {
     state->rx_radius_3d = 1.0 / sqrt(MY_PI * state->grid_density);
   }
-  state->tv_rxn_mem = create_mem(sizeof(struct t_func), 100);
-  if (state->tv_rxn_mem == NULL)
-    return 1;
-
   for (int n_rxn_bin = 0; n_rxn_bin < state->rxn_sym_table->n_bins;
        n_rxn_bin++) {
     for (struct sym_entry *sym = state->rxn_sym_table->entries[n_rxn_bin];
@@ -1317,11 +1227,17 @@ int init_reactions(MCELL_STATE *state) {
         } /* end if (n_reactants > 1) */
 
       } /* end for (path = reaction->pathway_head; ...) */
+      t_now = init_reactions_clock();
+      stage_seconds[INIT_RXN_CANONICALIZE] += t_now - t_stage;
+      t_stage = t_now;
 
       /* if reaction contains equivalent pathways, split this reaction into a
        * linked list of reactions each containing only equivalent pathways. */
 
       struct rxn *rx = split_reaction(reaction);
+      t_now = init_reactions_clock();
+      stage_seconds[INIT_RXN_SPLIT] += t_now - t_stage;
+      t_stage = t_now;
 
       /* set the symbol value to the head of the linked list of reactions */
       sym->value = (void *)rx;
@@ -1332,8 +1248,12 @@ int init_reactions(MCELL_STATE *state) {
          * lists.  Also sort pathways in alphabetical order according to the
          * "prod_signature" field. */
         check_reaction_for_duplicate_pathways(&rx->pathway_head);
+        t_now = init_reactions_clock();
+        stage_seconds[INIT_RXN_DUPLICATES] += t_now - t_stage;
+        t_stage = t_now;
 
         num_rx++;
+        num_paths += rx->n_pathways;
 
         /* At this point we have reactions of the same geometry and can
          * collapse them and count how many non-reactant products are in each
@@ -1392,6 +1312,7 @@ int init_reactions(MCELL_STATE *state) {
               ccd->n_sides = 0;
               ccd->side_idx = NULL;
               ccd->cum_area = NULL;
+              ccd->side_guide = NULL;
               ccd->scaling_factor = 0.0;
               ccd->next = state->clamp_list;
               state->clamp_list = ccd;
@@ -1474,27 +1395,35 @@ int init_reactions(MCELL_STATE *state) {
         if (rx->players == NULL || rx->geometries == NULL)
           return 1;
 
-        /* Load all the time-varying rates from disk (if any), merge them into
-         * a single sorted list, and pull off any updates for time zero. */
+        /* Look up the time-varying rates (if any), reading each rate file
+         * only once, and pull off any updates for time zero. */
         if (n_prob_t_rxns > 0) {
+          rx->rate_cursors = CHECKED_MALLOC_ARRAY(
+              struct rate_cursor, n_prob_t_rxns, "time-varying rate cursors");
           path = rx->pathway_head;
           for (int n_pathway = 0; path != NULL;
                n_pathway++, path = path->next) {
             if (path->km_filename != NULL) {
-              if (load_rate_file(state, rx, path->km_filename, n_pathway))
+              struct rate_table *table = load_rate_file(state, path->km_filename);
+              if (table == NULL)
                 mcell_error("Failed to load rates from file '%s'.",
                             path->km_filename);
+
+              struct rate_cursor *rc = &rx->rate_cursors[rx->n_rate_cursors++];
+              rc->table = table;
+              rc->path = n_pathway;
+              rc->scale = 1.0;
+              for (rc->next = 0; rc->next < table->n_entries &&
+                                 table->time[rc->next] <= 0.0;
+                   rc->next++)
+                rx->cum_probs[n_pathway] = table->value[rc->next];
+              rc->time = (rc->next < table->n_entries) ? table->time[rc->next]
+                                                       : FOREVER;
             }
             free(path->km_filename);
             path->km_filename = NULL;
           }
-          rx->prob_t = (struct t_func *)ae_list_sort(
-              (struct abstract_element *)rx->prob_t);
-
-          while (rx->prob_t != NULL && rx->prob_t->time <= 0.0) {
-            rx->cum_probs[rx->prob_t->path] = rx->prob_t->value;
-            rx->prob_t = rx->prob_t->next;
-          }
+          select_next_rate_change(rx);
         } /* end if (n_prob_t_rxns > 0) */
 
         /* Set the geometry of the reactants.  These are used for triggering. */
@@ -1512,8 +1441,6 @@ int init_reactions(MCELL_STATE *state) {
           }
         }
 
-        //JJT: once reactants have been initialized we can assign diffusion/space/timestep functions
-        initialize_rxn_diffusion_functions(rx);
         //JJT: initialize nfsim reaction fields to null since they will not be used for this normal reaction
         rx->external_reaction_data = NULL;
         rx->product_graph_data = NULL;
@@ -1537,10 +1464,8 @@ int init_reactions(MCELL_STATE *state) {
                                 path, rx, pb_factor))
           return 1;
 
-        if (n_prob_t_rxns > 0) {
-          for (struct t_func *tp = rx->prob_t; tp != NULL; tp = tp->next)
-            tp->value *= pb_factor;
-        }
+        for (int n_cursor = 0; n_cursor < rx->n_rate_cursors; n_cursor++)
+          rx->rate_cursors[n_cursor].scale = pb_factor;
 
         /* Move counts from list into array */
         if(init_reaction_info(rx) != 0)
@@ -1556,6 +1481,9 @@ int init_reactions(MCELL_STATE *state) {
           rx->min_noreaction_p = rx->max_fixed_p = 1.0;
 
         rx = rx->next;
+        t_now = init_reactions_clock();
+        stage_seconds[INIT_RXN_ARRAYS] += t_now - t_stage;
+        t_stage = t_now;
       }
     }
   }
@@ -1573,6 +1501,9 @@ int init_reactions(MCELL_STATE *state) {
                                 state->rxn_sym_table, &state->rx_hashsize,
                                 num_rx))
     return 1;
+  t_now = init_reactions_clock();
+  stage_seconds[INIT_RXN_HASH] += t_now - t_stage;
+  t_stage = t_now;
 
   state->rx_radius_3d *= state->r_length_unit; /* Convert into length units */
 
@@ -1602,15 +1533,21 @@ int init_reactions(MCELL_STATE *state) {
 
       set_reaction_player_flags(this_rx);
       this_rx->pathway_head = NULL;
+      build_pathway_guide(this_rx);
     }
   }
 
   add_surface_reaction_flags(state->mol_sym_table, state->all_mols, state->all_surface_mols,
                              state->all_volume_mols);
+  stage_seconds[INIT_RXN_GUIDES] += init_reactions_clock() - t_stage;
 
   if (state->notify->reaction_probabilities == NOTIFY_FULL)
     mcell_log_raw("\n");
 
+  if (num_paths >= INIT_RXN_REPORT_MIN_PATHWAYS &&
+      state->notify->progress_report != NOTIFY_NONE)
+    report_init_reactions(state, num_rx, num_paths, stage_seconds);
+
   return 0;
 }
 
@@ -1619,6 +1556,53 @@ int init_reactions(MCELL_STATE *state) {
  * static helper functions
  *
  ******************************************************************************/
+
+/*************************************************************************
+ init_reactions_clock:
+ In:  None
+ Out: Monotonic wall-clock time in seconds
+*************************************************************************/
+static double init_reactions_clock(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + 1e-9 * (double)ts.tv_nsec;
+}
+
+/*************************************************************************
+ report_init_reactions:
+ In:  state: the simulation state, with its reaction hash built
+      num_rx: number of reactions initialized
+      num_paths: number of pathways of these reactions
+      stage_seconds: time spent in each stage of init_reactions
+ Out: None.  The time of each stage and the load of the reaction hash table
+      are logged.
+*************************************************************************/
+static void report_init_reactions(struct volume *state, int num_rx,
+                                  long long num_paths,
+                                  double const *stage_seconds) {
+  int used_bins = 0;
+  int longest_chain = 0;
+  for (int i = 0; i < state->rx_hashsize; i++) {
+    int chain = 0;
+    for (struct rxn *rx = state->reaction_hash[i]; rx != NULL; rx = rx->next)
+      chain++;
+    if (chain > 0)
+      used_bins++;
+    if (chain > longest_chain)
+      longest_chain = chain;
+  }
+
+  double total = 0.0;
+  for (int i = 0; i < INIT_RXN_N_STAGES; i++)
+    total += stage_seconds[i];
+  mcell_log("Initialized %d reactions with %lld pathways in %.2f s:", num_rx,
+            num_paths, total);
+  for (int i = 0; i < INIT_RXN_N_STAGES; i++)
+    mcell_log("  %-24s %8.3f s", init_reactions_stage_names[i],
+              stage_seconds[i]);
+  mcell_log("  reaction hash: %d bins, %d used, longest chain %d",
+            state->rx_hashsize, used_bins, longest_chain);
+}
 /*************************************************************************
  *
  * extract_reactants extracts the reactant info into a pathway structure
@@ -2451,25 +2435,25 @@ char *create_prod_signature(struct product **product_head) {
   if (current == NULL) {
     return NULL;
   }
-  prod_signature = CHECKED_STRDUP(current->prod->sym->name, "product name");
-
-  /* Concatenate to create product signature */
-  char *temp_str = NULL;
-  while (current->next != NULL) {
-    temp_str = prod_signature;
-    prod_signature = CHECKED_SPRINTF("%s+%s", prod_signature,
-                                     current->next->prod->sym->name);
 
-    if (prod_signature == NULL) {
-      if (temp_str != NULL)
-        free(temp_str);
-      return NULL;
-    }
-    if (temp_str != NULL)
-      free(temp_str);
+  /* Concatenate to create product signature, sized up front so that long
+   * product lists are not copied once per product */
+  size_t length = 0;
+  for (struct product *p = current; p != NULL; p = p->next)
+    length += strlen(p->prod->sym->name) + 1;
+  prod_signature = CHECKED_MALLOC_ARRAY(char, length, "product signature");
+  if (prod_signature == NULL)
+    return NULL;
 
-    current = current->next;
+  char *end = prod_signature;
+  for (struct product *p = current; p != NULL; p = p->next) {
+    if (p != current)
+      *end++ = '+';
+    size_t name_length = strlen(p->prod->sym->name);
+    memcpy(end, p->prod->sym->name, name_length);
+    end += name_length;
   }
+  *end = '\0';
 
   return prod_signature;
 }
@@ -3177,21 +3161,26 @@ static struct rxn *create_sibling_reaction(struct rxn *rx) {
   reaction->next = NULL;
   reaction->sym = rx->sym;
   reaction->n_reactants = rx->n_reactants;
-  reaction->get_reactant_diffusion = rx->get_reactant_diffusion;
   reaction->n_pathways = 0;
   reaction->cum_probs = NULL;
   reaction->product_idx = NULL;
   reaction->max_fixed_p = 0.0;
   reaction->min_noreaction_p = 0.0;
   reaction->pb_factor = 0.0;
+  reaction->pathway_guide = NULL;
+  reaction->guide_scale = 0.0;
   reaction->players = NULL;
   reaction->geometries = NULL;
   reaction->n_occurred = 0;
+  reaction->n_failed = 0;
   reaction->n_skipped = 0.0;
+  reaction->rate_cursors = NULL;
+  reaction->n_rate_cursors = 0;
   reaction->prob_t = NULL;
   reaction->pathway_head = NULL;
   reaction->info = NULL;
   reaction->product_graph_data = NULL;
+  reaction->reactant_graph_data = NULL;
   reaction->external_reaction_data = NULL;
   return reaction;
 }
@@ -3260,6 +3249,56 @@ struct rxn *split_reaction(struct rxn *rx) {
   return head;
 }
 
+/* A pathway and its place in the list being sorted */
+struct pathway_sort_key {
+  struct pathway *path;
+  int order;
+};
+
+static int compare_pathway_sort_keys(void const *a, void const *b) {
+  struct pathway_sort_key const *ka = (struct pathway_sort_key const *)a;
+  struct pathway_sort_key const *kb = (struct pathway_sort_key const *)b;
+  int cmp = strcmp(ka->path->prod_signature, kb->path->prod_signature);
+  if (cmp != 0)
+    return cmp;
+  /* Pathways with the same signature keep the reverse of their list order,
+   * as when each was inserted in front of its equals */
+  return (kb->order > ka->order) - (kb->order < ka->order);
+}
+
+/*************************************************************************
+ sort_pathways_by_signature:
+ In:  head: linked list of pathways, all with a prod_signature
+ Out: The list sorted by prod_signature.  Pathways with equal signatures
+      come in the reverse of their original order, which is what inserting
+      each pathway in turn before the first one not less than it gives.
+      The order decides the order of the pathways of the reaction, so it
+      has to stay the same for reproducible runs.
+*************************************************************************/
+static struct pathway *sort_pathways_by_signature(struct pathway *head) {
+  int n = 0;
+  for (struct pathway *p = head; p != NULL; p = p->next)
+    n++;
+  if (n < 2)
+    return head;
+
+  struct pathway_sort_key *keys = CHECKED_MALLOC_ARRAY(
+      struct pathway_sort_key, n, "pathways sorted by product signature");
+  int i = 0;
+  for (struct pathway *p = head; p != NULL; p = p->next, i++) {
+    keys[i].path = p;
+    keys[i].order = i;
+  }
+  qsort(keys, n, sizeof(*keys), compare_pathway_sort_keys);
+
+  for (i = 0; i < n - 1; i++)
+    keys[i].path->next = keys[i + 1].path;
+  keys[n - 1].path->next = NULL;
+  head = keys[0].path;
+  free(keys);
+  return head;
+}
+
 /*************************************************************************
  check_reaction_for_duplicate_pathways:
  In:  head: head of linked list of pathways
@@ -3299,7 +3338,7 @@ void check_reaction_for_duplicate_pathways(struct pathway **head) {
   struct pathway *result = NULL;      /* build the sorted list here */
   struct pathway *null_result = NULL; /* put pathways with NULL
                                          prod_signature field here */
-  struct pathway *current, *next, **pprev;
+  struct pathway *current, **pprev;
   struct product *iter1, *iter2;
   int pathways_equivalent; /* flag */
   int i, j;
@@ -3356,29 +3395,7 @@ void check_reaction_for_duplicate_pathways(struct pathway **head) {
 
   /* now sort the remaining pathway list by "prod_signature" field and check
    * for the duplicates */
-  current = *head;
-
-  while (current != NULL) {
-    next = current->next;
-
-    /* insert in sorted order into the "result" */
-    if (result == NULL ||
-        (strcmp(result->prod_signature, current->prod_signature) >= 0)) {
-      current->next = result;
-      result = current;
-    } else {
-      struct pathway *iter = result;
-      while (iter->next != NULL && (strcmp(iter->next->prod_signature,
-                                           current->prod_signature) < 0)) {
-        iter = iter->next;
-      }
-      current->next = iter->next;
-      iter->next = current;
-    }
-
-    /* move along the original list */
-    current = next;
-  }
+  result = sort_pathways_by_signature(*head);
 
   /* Now check for the duplicate pathways */
   /* Since the list is sorted we can proceed down the list and compare the
@@ -3756,139 +3773,282 @@ struct reaction_rates mcell_create_reaction_rates(int forwardRateType,
   return rates;
 }
 
+/* One line of a rate file, before the times are converted to iterations */
+struct rate_entry {
+  double t;         /* time in seconds */
+  double rate;      /* rate constant */
+  int n_entry;      /* position in the file, to keep ties in file order */
+};
+
+static int compare_rate_entries(void const *a, void const *b) {
+  struct rate_entry const *ea = (struct rate_entry const *)a;
+  struct rate_entry const *eb = (struct rate_entry const *)b;
+  if (ea->t != eb->t)
+    return (ea->t < eb->t) ? -1 : 1;
+  return ea->n_entry - eb->n_entry;
+}
+
 /*************************************************************************
- load_rate_file:
-    Read in a time-varying reaction rate constant file.
+ check_rate_constant:
+    Apply the NEGATIVE_REACTION_RATE policy to a rate constant read from a
+    rate file.
+
+ In:  state: simulation state
+      rate_constant: the rate constant, which is set to zero if negative and
+                     the policy is to warn
+ Out: Returns 1 if negative rates are an error and this one is, 0 otherwise.
+*************************************************************************/
+static int check_rate_constant(struct volume *state, double *rate_constant) {
+  if (*rate_constant < 0.0)
+  {
+    if (state->notify->neg_reaction == WARN_ERROR)
+    {
+      mcell_error("reaction rate constants should be zero or positive.");
+      return 1;
+    }
+    else if (state->notify->neg_reaction == WARN_WARN) {
+      mcell_warn("negative reaction rate constant %f; setting to zero "
+                 "and continuing.", *rate_constant);
+      *rate_constant = 0.0;
+    }
+  }
+  return 0;
+}
 
- In:  time_unit:
-      tv_rxn_mem:
-      rx:    Reaction structure that we'll load the rates into.
-      fname: Filename to read the rates from.
-      path:  Index of the pathway that these rates apply to.
-      neg_reaction: warning or error policy for negative reactions.
+/* Append one entry to a growing array of rate entries */
+static void add_rate_entry(struct rate_entry **entries, int *n_entries,
+                           int *max_entries, double t, double rate) {
+  if (*n_entries == *max_entries) {
+    *max_entries = (*max_entries == 0) ? 64 : 2 * *max_entries;
+    struct rate_entry *grown = (struct rate_entry *)realloc(
+        *entries, *max_entries * sizeof(struct rate_entry));
+    if (grown == NULL)
+      mcell_allocfailed("Failed to grow the time-varying rate constants.");
+    *entries = grown;
+  }
+  struct rate_entry *e = &(*entries)[*n_entries];
+  e->t = t;
+  e->rate = rate;
+  e->n_entry = (*n_entries)++;
+}
+
+/*************************************************************************
+ read_text_rate_file:
+    Read the entries of a text rate file.
+
+ In:  state: simulation state
+      f: the file, positioned at its start
+      fname: name of the file, for messages
+      entries, n_entries, max_entries: array to append the entries to
+      sorted: cleared if the entries are not in order of time
  Out: Returns 1 on error, 0 on success.
-      Rate constants are added to the prob_t linked list. If there is a rate
-      constant given for time <= 0, then this rate constant is stuck into
-      cum_probs and the (time <= 0) entries are not added to the list.  If no
-      initial rate constnat is given in the file, it is assumed to be zero.
  Note: The file format is assumed to be two columns of numbers; the first
        column is time (in seconds) and the other is rate constant (in
        appropriate units) that starts at that time.  Lines that are not numbers
        are ignored.
 *************************************************************************/
-int load_rate_file(struct volume* state, struct rxn *rx, char *fname, int path) {
-
-  struct mem_helper *tv_rxn_mem = state->tv_rxn_mem;
-
+static int read_text_rate_file(struct volume *state, FILE *f,
+                               char const *fname, struct rate_entry **entries,
+                               int *n_entries, int *max_entries, int *sorted) {
   const char *RATE_SEPARATORS = "\f\n\r\t\v ,;";
   const char *FIRST_DIGIT = "+-0123456789";
   int i;
-  FILE *f = fopen(fname, "r");
+  double t, rate_constant;
+  char buf[2048];
+  char *cp;
+  int linecount = 0;
+
+  while (fgets(buf, 2048, f)) {
+    linecount++;
+    for (i = 0; i < 2048; i++) {
+      if (!strchr(RATE_SEPARATORS, buf[i]))
+        break;
+    }
 
-  if (!f)
-    return 1;
-  else {
-    struct t_func *tp, *tp2;
-    double t, rate_constant;
-    char buf[2048];
-    char *cp;
-    int linecount = 0;
-#ifdef DEBUG
-    int valid_linecount = 0;
-#endif
+    if (i < 2048 && strchr(FIRST_DIGIT, buf[i])) {
+      t = strtod((buf + i), &cp);
+      if (cp == (buf + i))
+        continue; /* Conversion error. */
 
-    tp2 = NULL;
-    while (fgets(buf, 2048, f)) {
-      linecount++;
-      for (i = 0; i < 2048; i++) {
+      for (i = cp - buf; i < 2048; i++) {
         if (!strchr(RATE_SEPARATORS, buf[i]))
           break;
       }
+      // This is kind of a silly corner case, but let's check for it to keep
+      // coverity happy.
+      if (i == 2048) {
+        mcell_error(
+          "a time in the rate constant file consists of too many characters "
+          "(it uses 2048 or more characters).");
+        return(1);
+      }
+      rate_constant = strtod((buf + i), &cp);
+      if (cp == (buf + i))
+        continue; /* Conversion error */
 
-      if (i < 2048 && strchr(FIRST_DIGIT, buf[i])) {
-        t = strtod((buf + i), &cp);
-        if (cp == (buf + i))
-          continue; /* Conversion error. */
+      /* at this point we need to handle negative reaction rate constants */
+      if (check_rate_constant(state, &rate_constant))
+        return 1;
 
-        for (i = cp - buf; i < 2048; i++) {
-          if (!strchr(RATE_SEPARATORS, buf[i]))
-            break;
-        }
-        // This is kind of a silly corner case, but let's check for it to keep
-        // coverity happy.
-        if (i == 2048) {
-          mcell_error(
-            "a time in the rate constant file consists of too many characters "
-            "(it uses 2048 or more characters).");
-          return(1);
-        }
-        rate_constant = strtod((buf + i), &cp);
-        if (cp == (buf + i))
-          continue; /* Conversion error */
+      if (*n_entries > 0 && t < (*entries)[*n_entries - 1].t) {
+        if (*sorted)
+          mcell_warn(
+              "In rate constants file '%s', line %d is out of sequence. "
+              "Resorting.", fname, linecount);
+        *sorted = 0;
+      }
+      add_rate_entry(entries, n_entries, max_entries, t, rate_constant);
+    }
+  }
+  return 0;
+}
 
-        /* at this point we need to handle negative reaction rate constants */
-        if (rate_constant < 0.0)
-        {
-          if (state->notify->neg_reaction == WARN_ERROR)
-          {
-            mcell_error("reaction rate constants should be zero or positive.");
-            return 1;
-          }
-          else if (state->notify->neg_reaction == WARN_WARN) {
-            mcell_warn("negative reaction rate constant %f; setting to zero "
-                       "and continuing.", rate_constant);
-            rate_constant = 0.0;
-          }
-        }
+/*************************************************************************
+ read_binary_rate_file:
+    Read the entries of a binary rate file, laid out as described at
+    RATE_FILE_BINARY_MAGIC.
+
+ In:  state: simulation state
+      f: the file, positioned just after its magic number
+      fname: name of the file, for messages
+      entries, n_entries, max_entries: array to append the entries to
+      sorted: cleared if the entries are not in order of time
+ Out: Returns 1 on error, 0 on success.
+*************************************************************************/
+static int read_binary_rate_file(struct volume *state, FILE *f,
+                                 char const *fname,
+                                 struct rate_entry **entries, int *n_entries,
+                                 int *max_entries, int *sorted) {
+  u_int header[2]; /* version, number of entries */
+  if (fread(header, sizeof(u_int), 2, f) != 2) {
+    mcell_error_nodie("Binary rate constants file '%s' is truncated.", fname);
+    return 1;
+  }
+  if (header[0] != RATE_FILE_BINARY_VERSION) {
+    mcell_error_nodie("Binary rate constants file '%s' has version %u, but "
+                      "only version %d is supported.",
+                      fname, header[0], RATE_FILE_BINARY_VERSION);
+    return 1;
+  }
+  if (header[1] > INT_MAX) {
+    mcell_error_nodie("Binary rate constants file '%s' has too many entries.",
+                      fname);
+    return 1;
+  }
 
-        tp = (struct t_func *)CHECKED_MEM_GET(tv_rxn_mem,
-                             "time-varying reaction rate constants");
-        if (tp == NULL) {
-          fclose(f);
-          return 1;
-        }
-        tp->next = NULL;
-        tp->path = path;
+  double pair[2]; /* time, rate constant */
+  for (u_int n = 0; n < header[1]; n++) {
+    if (fread(pair, sizeof(double), 2, f) != 2) {
+      mcell_error_nodie("Binary rate constants file '%s' is truncated after "
+                        "%u of %u entries.", fname, n, header[1]);
+      return 1;
+    }
+    if (check_rate_constant(state, &pair[1]))
+      return 1;
+    if (*n_entries > 0 && pair[0] < (*entries)[*n_entries - 1].t) {
+      if (*sorted)
+        mcell_warn("In rate constants file '%s', entry %u is out of "
+                   "sequence. Resorting.", fname, n + 1);
+      *sorted = 0;
+    }
+    add_rate_entry(entries, n_entries, max_entries, pair[0], pair[1]);
+  }
+  return 0;
+}
 
-        // tp->time is in fact iteration, we need to convert the iteration correctly in case we
-        // are continuing from a checkpoint with a different timestep
-        tp->time = convert_seconds_to_iterations(
-            state->start_iterations, state->time_unit,
-            state->chkpt_start_time_seconds, t);
+/*************************************************************************
+ load_rate_file:
+    Get the table of a time-varying reaction rate constant file.  All
+    pathways naming the same file, or a file with the same contents, share
+    one table, so each file is read only once.
 
-        tp->value = rate_constant;
-#ifdef DEBUG
-        valid_linecount++;
-#endif
+ In:  state: simulation state
+      fname: Filename to read the rates from.
+ Out: Returns the table, or NULL on error.  The table is sorted by time,
+      which is converted to iterations.  Entries for time <= 0 are kept; the
+      caller applies them before the simulation starts.  If no initial rate
+      constant is given in the file, it is assumed to be zero.
+ Note: The file is read as binary if it starts with RATE_FILE_BINARY_MAGIC,
+       and as text otherwise (see read_text_rate_file).
+*************************************************************************/
+struct rate_table *load_rate_file(struct volume *state, char const *fname) {
+  for (struct rate_table *table = state->rate_tables; table != NULL;
+       table = table->next) {
+    if (strcmp(table->filename, fname) == 0)
+      return table;
+  }
 
-        if (rx->prob_t == NULL) {
-          rx->prob_t = tp;
-          tp2 = tp;
-        } else {
-          if (tp2 == NULL) {
-            tp2 = tp;
-            tp->next = rx->prob_t;
-            rx->prob_t = tp;
-          } else {
-            if (tp->time < tp2->time)
-              mcell_warn(
-                  "In rate constants file '%s', line %d is out of sequence. "
-                  "Resorting.", fname, linecount);
-            tp->next = tp2->next;
-            tp2->next = tp;
-            tp2 = tp;
-          }
-        }
-      }
-    }
+  FILE *f = fopen(fname, "rb");
+  if (!f)
+    return NULL;
+
+  struct rate_entry *entries = NULL;
+  int n_entries = 0, max_entries = 0;
+  int sorted = 1;
+  char magic[sizeof(RATE_FILE_BINARY_MAGIC) - 1];
+  int failed;
+  if (fread(magic, 1, sizeof(magic), f) == sizeof(magic) &&
+      memcmp(magic, RATE_FILE_BINARY_MAGIC, sizeof(magic)) == 0)
+    failed = read_binary_rate_file(state, f, fname, &entries, &n_entries,
+                                   &max_entries, &sorted);
+  else {
+    rewind(f);
+    failed = read_text_rate_file(state, f, fname, &entries, &n_entries,
+                                 &max_entries, &sorted);
+  }
+  fclose(f);
+  if (failed) {
+    free(entries);
+    return NULL;
+  }
 
 #ifdef DEBUG
-    mcell_log("Read %d rate constants from file %s.", valid_linecount, fname);
+  mcell_log("Read %d rate constants from file %s.", n_entries, fname);
 #endif
 
-    fclose(f);
+  if (!sorted)
+    qsort(entries, n_entries, sizeof(struct rate_entry), compare_rate_entries);
+
+  struct rate_table *table =
+      CHECKED_MALLOC_STRUCT(struct rate_table, "time-varying rate table");
+  table->filename = CHECKED_STRDUP(fname, "rate constants file name");
+  table->n_entries = n_entries;
+  table->time = CHECKED_MALLOC_ARRAY(double, n_entries + 1,
+                                     "time-varying rate constants");
+  table->value = CHECKED_MALLOC_ARRAY(double, n_entries + 1,
+                                      "time-varying rate constants");
+  for (int i = 0; i < n_entries; i++) {
+    // The time is in fact iteration, we need to convert the iteration
+    // correctly in case we are continuing from a checkpoint with a different
+    // timestep
+    table->time[i] = convert_seconds_to_iterations(
+        state->start_iterations, state->time_unit,
+        state->chkpt_start_time_seconds, entries[i].t);
+    table->value[i] = entries[i].rate;
+  }
+  free(entries);
+
+  ub4 n_bytes = (ub4)(n_entries * sizeof(double));
+  table->hash = jenkins_hash((ub1 *)table->time, n_bytes) +
+                0x9e3779b9u * jenkins_hash((ub1 *)table->value, n_bytes);
+
+  /* Share the arrays of an identical table read from another file */
+  for (struct rate_table *other = state->rate_tables; other != NULL;
+       other = other->next) {
+    if (other->hash == table->hash && other->n_entries == n_entries &&
+        memcmp(other->time, table->time, n_bytes) == 0 &&
+        memcmp(other->value, table->value, n_bytes) == 0) {
+      free(table->time);
+      free(table->value);
+      table->time = other->time;
+      table->value = other->value;
+      break;
+    }
   }
-  return 0;
+
+  table->next = state->rate_tables;
+  state->rate_tables = table;
+  return table;
 }
 
 struct sym_entry *mcell_new_rxn_pathname(struct volume *state, char *name) {
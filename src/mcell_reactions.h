@@ -31,6 +31,12 @@
 
 // typedef struct sym_entry mcell_symbol;
 
+/* Binary rate constants files start with this magic number, followed by a
+ * u_int version and a u_int number of entries, and then one (time in seconds,
+ * rate constant) pair of doubles per entry, all in native byte order */
+#define RATE_FILE_BINARY_MAGIC "MCRT"
+#define RATE_FILE_BINARY_VERSION 1
+
 enum {
   RATE_UNSET = -1,
   RATE_CONSTANT = 0,
@@ -78,6 +84,18 @@ mcell_modify_multiple_rate_constants(struct volume *world, char **names, double
 MCELL_STATUS
 mcell_modify_rate_constant(struct volume *world, char *name, double rate);
 
+struct rxn_pathname *
+mcell_get_rate_constant_handle(struct volume *world, const char *name);
+
+MCELL_STATUS
+mcell_set_multiple_rate_constants(struct volume *world,
+                                  struct rxn_pathname **handles,
+                                  double *rate_constants, int n_rxns);
+
+MCELL_STATUS
+mcell_set_rate_constant(struct volume *world, struct rxn_pathname *handle,
+                        double rate);
+
 MCELL_STATUS
 mcell_add_reaction_simplified(
     struct volume *state, 
@@ -164,5 +182,7 @@ int outcome_nfsim(struct volume *world, struct rxn *rx, int path,
                          struct abstract_molecule *reac, struct abstract_molecule *reac2, double t);
 //get the graph properties for a given graph object
 void properties_nfsim(struct volume*, struct abstract_molecule *reac);
+//free the products an nfsim path has filled in
+void free_reaction_nfsim(struct rxn *rx, int path);
 
 struct sym_entry *mcell_new_rxn_pathname(struct volume *state, char *name);
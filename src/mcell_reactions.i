@@ -74,6 +74,18 @@ mcell_modify_multiple_rate_constants(struct volume *world, char **names, double
 MCELL_STATUS
 mcell_modify_rate_constant(struct volume *world, char *name, double rate);
 
+struct rxn_pathname *
+mcell_get_rate_constant_handle(struct volume *world, const char *name);
+
+MCELL_STATUS
+mcell_set_multiple_rate_constants(struct volume *world,
+                                  struct rxn_pathname **handles,
+                                  double *rate_constants, int n_rxns);
+
+MCELL_STATUS
+mcell_set_rate_constant(struct volume *world, struct rxn_pathname *handle,
+                        double rate);
+
 MCELL_STATUS
 mcell_add_reaction_simplified(
     struct volume *state, 
@@ -31,6 +31,7 @@
 #include "mcell_species.h"
 #include "mcell_release.h"
 #include "mcell_objects.h"
+#include "vol_util.h"
 
 /* static helper functions */
 static struct release_site_obj *new_release_site(
@@ -163,6 +164,36 @@ MCELL_STATUS mcell_create_list_release_site(
   return MCELL_SUCCESS;
 }
 
+/******************************************************************************
+ *
+ * mcell_add_molecules places n molecules of one species straight into the
+ * world, without creating a release site or a list of positions. It is
+ * meant for coupling steps that inject many molecules at once.
+ * INPUT:
+ * state = world
+ * species = the "mol_sym" you get back when you create the species
+ * xyz = x, y, z of each molecule, in microns
+ * orient = orientation of each surface molecule (can be NULL = random)
+ * n = number of molecules
+ * diameter = diameter to search for where to place surface molecules
+ *
+ ******************************************************************************/
+MCELL_STATUS mcell_add_molecules(MCELL_STATE *state,
+                                 struct sym_entry *species, double *xyz,
+                                 int *orient, int n, double diameter) {
+  struct species *spec = (struct species *)species->value;
+
+  // NFSim species need the graph pattern a release site carries
+  if ((spec->flags & EXTERNAL_SPECIES) != 0)
+    return MCELL_FAIL;
+
+  if (release_molecule_array(state, spec, xyz, orient, n,
+                             diameter * state->r_length_unit))
+    return MCELL_FAIL;
+
+  return MCELL_SUCCESS;
+}
+
 /******************************************************************************
  *
  * mcell_create_geometrical_release_site is the main API function for creating
@@ -566,9 +597,17 @@ int mcell_set_release_site_geometry_region(
   rel_reg_data->cum_area_list = NULL;
   rel_reg_data->wall_index = NULL;
   rel_reg_data->obj_index = NULL;
+  rel_reg_data->alias_prob = NULL;
+  rel_reg_data->alias_index = NULL;
   rel_reg_data->n_objects = -1;
   rel_reg_data->owners = NULL;
   rel_reg_data->in_release = NULL;
+  rel_reg_data->sv_inside = NULL;
+  rel_reg_data->sv_serial = 0;
+  rel_reg_data->n_release_svs = -1;
+  rel_reg_data->release_svs = NULL;
+  rel_reg_data->release_sv_volume = NULL;
+  rel_reg_data->release_svs_serial = 0;
   rel_reg_data->self = obj_ptr;
 
   rel_reg_data->expression = rel_eval;
@@ -750,7 +789,8 @@ int is_release_site_valid(struct release_site_obj *rel_site_obj_ptr) {
   if (rel_site_obj_ptr->location == NULL) {
     // Release site is missing location.
     if (rel_site_obj_ptr->release_shape != SHAPE_LIST ||
-      rel_site_obj_ptr->mol_list == NULL) {
+      (rel_site_obj_ptr->mol_list == NULL &&
+       rel_site_obj_ptr->mol_file == NULL)) {
     return 6;
     } else {
     // Give it a default location of (0, 0, 0)
@@ -867,6 +907,7 @@ struct release_site_obj *new_release_site(MCELL_STATE *state, char *name) {
   rel_site_obj_ptr->diameter = NULL;
   rel_site_obj_ptr->region_data = NULL;
   rel_site_obj_ptr->mol_list = NULL;
+  rel_site_obj_ptr->mol_file = NULL;
   rel_site_obj_ptr->release_prob = 1.0;
   rel_site_obj_ptr->pattern = state->default_release_pattern;
   struct periodic_image *periodic_box = CHECKED_MALLOC_STRUCT(
@@ -875,6 +916,7 @@ struct release_site_obj *new_release_site(MCELL_STATE *state, char *name) {
   rel_site_obj_ptr->periodic_box->x = 0;
   rel_site_obj_ptr->periodic_box->y = 0;
   rel_site_obj_ptr->periodic_box->z = 0;
+  rel_site_obj_ptr->periodic_box->pad = 0;
   // if ((rel_site_obj_ptr->name = mdl_strdup(name)) == NULL)
   if ((rel_site_obj_ptr->name = strdup(name)) == NULL) {
   free(rel_site_obj_ptr);
@@ -28,6 +28,10 @@ MCELL_STATUS mcell_create_list_release_site(
   struct mcell_species *mol, double *x_pos, double *y_pos, double *z_pos, int n_site,
   struct vector3 *diameter, struct object **new_object);
 
+MCELL_STATUS mcell_add_molecules(MCELL_STATE *state,
+                                 struct sym_entry *species, double *xyz,
+                                 int *orient, int n, double diameter);
+
 MCELL_STATUS mcell_create_geometrical_release_site(
     MCELL_STATE *state, struct object *parent, const char *site_name, int shape,
     struct vector3 *position, struct vector3 *diameter,
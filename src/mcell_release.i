@@ -26,6 +26,58 @@ MCELL_STATUS mcell_create_list_release_site(
   struct mcell_species *mol, double *x_pos, double *y_pos, double *z_pos, int n_site,
   struct vector3 *diameter, struct object **new_object);
 
+// Takes any buffer of float64 x, y, z triples (e.g. an (n, 3) numpy array)
+// and an optional buffer of int32 orientations, and releases the GIL while
+// the molecules are placed
+%rename(mcell_add_molecules) pymcell_add_molecules;
+%inline %{
+MCELL_STATUS pymcell_add_molecules(MCELL_STATE *state,
+                                   struct sym_entry *species, PyObject *xyz,
+                                   PyObject *orient, double diameter) {
+  Py_buffer xyz_buf, orient_buf;
+  if (PyObject_GetBuffer(xyz, &xyz_buf, PyBUF_C_CONTIGUOUS | PyBUF_FORMAT)) {
+    PyErr_Clear();
+    return MCELL_FAIL;
+  }
+  char code = xyz_buf.format[strlen(xyz_buf.format) - 1];
+  Py_ssize_t n = xyz_buf.len / (3 * sizeof(double));
+  if (code != 'd' || xyz_buf.itemsize != sizeof(double) ||
+      xyz_buf.len != n * 3 * (Py_ssize_t)sizeof(double) || n > INT_MAX) {
+    PyBuffer_Release(&xyz_buf);
+    return MCELL_FAIL;
+  }
+
+  int *orientations = NULL;
+  if (orient != Py_None) {
+    if (PyObject_GetBuffer(orient, &orient_buf,
+                           PyBUF_C_CONTIGUOUS | PyBUF_FORMAT)) {
+      PyErr_Clear();
+      PyBuffer_Release(&xyz_buf);
+      return MCELL_FAIL;
+    }
+    code = orient_buf.format[strlen(orient_buf.format) - 1];
+    if ((code != 'i' && code != 'l') || orient_buf.itemsize != sizeof(int) ||
+        orient_buf.len != n * (Py_ssize_t)sizeof(int)) {
+      PyBuffer_Release(&orient_buf);
+      PyBuffer_Release(&xyz_buf);
+      return MCELL_FAIL;
+    }
+    orientations = orient_buf.buf;
+  }
+
+  MCELL_STATUS status;
+  Py_BEGIN_ALLOW_THREADS
+  status = mcell_add_molecules(state, species, xyz_buf.buf, orientations,
+                               (int)n, diameter);
+  Py_END_ALLOW_THREADS
+
+  if (orientations != NULL)
+    PyBuffer_Release(&orient_buf);
+  PyBuffer_Release(&xyz_buf);
+  return status;
+}
+%}
+
 MCELL_STATUS mcell_create_geometrical_release_site(
     MCELL_STATE *state, struct object *parent, char *site_name, int shape,
     struct vector3 *position, struct vector3 *diameter,
@@ -20,6 +20,7 @@
  * USA.
  *
 ******************************************************************************/
+#include <stdlib.h>
 #include <string.h>
 #include <assert.h>
 #include <float.h>
@@ -27,7 +28,10 @@
 #include <unistd.h>
 
 #ifndef _WIN32
+#include <signal.h>
+#include <errno.h>
 #include <sys/resource.h>
+#include <sys/wait.h>
 #endif
 #if defined(__linux__)
 #include <fenv.h>
@@ -37,6 +41,7 @@
 #include "logging.h"
 #include "vol_util.h"
 #include "react_output.h"
+#include "output_journal.h"
 #include "viz_output.h"
 #include "volume_output.h"
 #include "diffuse.h"
@@ -45,9 +50,19 @@
 #include "argparse.h"
 #include "dyngeom.h"
 #include "mcell_run.h"
+#include "mcell_misc.h"
+#include "thread_util.h"
+#include "mpi_util.h"
+#include "sched_util.h"
 #include <nfsim_c.h>
+#include "nfsim_func.h"
+#include "react_nfsim.h"
 #include "mcell_reactions.h"
 #include "mcell_react_out.h"
+#include "count_util.h"
+#include "metrics.h"
+#include "phase_profile.h"
+#include "strfunc.h"
 
 // static helper functions
 static long long mcell_determine_output_frequency(MCELL_STATE *state);
@@ -145,6 +160,7 @@ void process_molecule_releases(struct volume *wrld, double not_yet) {
       if necessary to keep them in/out of the appropriate compartments).
  ***********************************************************************/
 void process_geometry_changes(struct volume *state, double not_yet) {
+  int changed = 0;
   for (struct dg_time_filename *dg_time_fname = (struct dg_time_filename *)schedule_next(
        state->dynamic_geometry_scheduler);
        dg_time_fname != NULL || not_yet >= state->dynamic_geometry_scheduler->now;
@@ -153,7 +169,13 @@ void process_geometry_changes(struct volume *state, double not_yet) {
     if (dg_time_fname == NULL)
       continue;
     update_geometry(state, dg_time_fname);
+    changed = 1;
   }
+  /* Read the frame of the next event while the coming iterations run */
+  start_geometry_prefetch(state, not_yet);
+  /* Return whatever the geometry update left idle */
+  if (changed)
+    mcell_compact_memory(state);
   if (state->dynamic_geometry_scheduler->error)
     mcell_internal_error("Scheduler reported an out-of-memory error while "
                          "retrieving next scheduled geometry change, but this "
@@ -210,9 +232,26 @@ static int make_checkpoint(struct volume *wrld) {
     return 0;
   }
 
-  /* Make the checkpoint */
-  create_chkpt(wrld, wrld->chkpt_outfile);
+  /* Make the checkpoint.  If the simulation will carry on afterwards it may
+   * be written in the background */
+  int will_continue =
+      wrld->checkpoint_requested == CHKPT_ITERATIONS_CONT ||
+      wrld->checkpoint_requested == CHKPT_SIGNAL_CONT ||
+      (wrld->checkpoint_requested == CHKPT_ALARM_CONT &&
+       wrld->continue_after_checkpoint);
+  if (wrld->background_chkpts && will_continue)
+    create_chkpt_background(wrld, wrld->chkpt_outfile);
+  else {
+    wait_background_chkpt(wrld);
+    create_chkpt(wrld, wrld->chkpt_outfile);
+  }
   wrld->last_checkpoint_iteration = wrld->current_iterations;
+  gettimeofday(&wrld->last_checkpoint_time, NULL);
+#ifdef MCELL_PHASE_PROFILE
+  phase_profile_write_costs(wrld);
+#endif
+  if (wrld->notify->memory_usage_report != NOTIFY_NONE)
+    mcell_print_memory_layout(wrld);
 
   /* Break out of the loop, if appropriate */
   if (wrld->checkpoint_requested == CHKPT_ALARM_EXIT ||
@@ -305,6 +344,561 @@ static int print_molecule_collision_report(
   return 0;
 }
 
+/***********************************************************************
+ storages_are_independent:
+
+    Check whether the memory partitions can be run on separate threads.
+    Each storage only touches its own molecules, walls and memory pools
+    while it is being run, unless the simulation has reactions, surface
+    diffusion, periodic boundaries, dynamic geometries or NFSim-driven
+    molecules, all of which reach into shared state.  Counts on regions
+    are collected per storage in counter shards (see prepare_world_copy).
+
+    In:  struct volume *world - the world
+    Out: NULL if the storages are independent, otherwise a short
+         description of the feature that prevents it.
+ ***********************************************************************/
+char const *storages_are_independent(struct volume *world) {
+  if (world->n_reactions != 0)
+    return "reactions";
+  if (world->nfsim_flag)
+    return "NFSim";
+  if (world->periodic_box_obj != NULL)
+    return "periodic boundary conditions";
+  if (world->dynamic_geometry_flag)
+    return "dynamic geometries";
+  if (world->volume_reversibility || world->surface_reversibility)
+    return "microscopic reversibility";
+
+  for (int i = 0; i < world->n_species; i++) {
+    struct species *spec = world->species_list[i];
+    if ((spec->flags & ON_GRID) && spec->D > 0.0)
+      return "diffusing surface molecules";
+  }
+
+  return NULL;
+}
+
+/***********************************************************************
+ setup_threaded_storages:
+
+    Decide, on the first iteration of a threaded run, whether the storages
+    can be run on the shared thread pool.  If the model cannot be split
+    between threads, warn and run the storages serially; the pool is still
+    used by the other parallel phases.
+
+    In:  struct volume *world - the world
+    Out: none.  world->threaded_storages is set to 1 or -1.
+ ***********************************************************************/
+static void setup_threaded_storages(struct volume *world) {
+  world->threaded_storages = -1;
+  char const *reason = storages_are_independent(world);
+  if (reason != NULL) {
+    mcell_warn("-threads %d: models with %s run their memory partitions on "
+               "a single thread.", world->num_threads, reason);
+    return;
+  }
+  if (world->storage_head == NULL || world->storage_head->next == NULL) {
+    mcell_warn("-threads %d: there is only one memory partition to run.  "
+               "Use the MEMORY_PARTITION settings to create more.",
+               world->num_threads);
+    return;
+  }
+  if (world->storage_head->store->rng == NULL) {
+    /* Storages were created before the thread count was known */
+    return;
+  }
+
+  world_thread_pool(world);
+  world->threaded_storages = 1;
+  if (world->notify->progress_report != NOTIFY_NONE)
+    mcell_log("Running memory partitions on %d threads.", world->num_threads);
+}
+
+/* One threaded pass over all storages whose current list is not empty */
+struct storage_pass {
+  struct storage **stores;  /* Storages to run in this pass */
+  struct volume *copies;    /* Per-storage copy of the world */
+  double release_time;
+  double checkpt_time;
+};
+
+static void run_storage_task(void *ctx, int task) {
+  struct storage_pass *pass = (struct storage_pass *)ctx;
+  run_timestep(&pass->copies[task], pass->stores[task], pass->release_time,
+               pass->checkpt_time);
+}
+
+/***********************************************************************
+ prepare_world_copy:
+
+    Make the private copy of the world used by one storage during a
+    threaded pass.  The copy draws from the storage's random number stream
+    and keeps its own statistics counters, which merge_world_copy adds to
+    the storage's; mcell_get_statistics adds those up.  Updates to counts and triggers go to the
+    storage's counter shard for the same reason.
+
+    In:  struct volume *copy - the copy to fill in
+         struct volume *world - the world
+         struct storage *store - the storage the copy will run
+    Out: none
+ ***********************************************************************/
+static void prepare_world_copy(struct volume *copy, struct volume *world,
+                               struct storage *store) {
+  memcpy(copy, world, sizeof(struct volume));
+  copy->rng = store->rng;
+  copy->threaded_pass = 1;
+  memset(&copy->stats, 0, sizeof(copy->stats));
+  if (store->count_shard == NULL)
+    store->count_shard = create_counter_shard(world);
+  copy->count_shard = store->count_shard;
+  copy->product_placement_cache = store->product_placement_cache;
+}
+
+static void merge_world_copy(struct volume *world, struct volume *copy,
+                             struct storage *store) {
+  sim_stats_add(&store->stats, &copy->stats);
+  merge_counter_shard(world, copy->count_shard);
+}
+
+/***********************************************************************
+ process_storage_handoffs:
+
+    Move the molecules which stopped at a storage boundary during the last
+    threaded pass into their new storage and schedule them there.  Queues
+    are drained in storage list order so the result does not depend on how
+    the threads were interleaved.  Molecules entering another MPI rank's
+    storage are sent there, and those sent to this rank are received.
+
+    In:  struct volume *world - the world
+    Out: none.  All hand-off queues are empty.
+ ***********************************************************************/
+static void process_storage_handoffs(struct volume *world) {
+  for (struct storage_list *local = world->storage_head; local != NULL;
+       local = local->next) {
+    struct storage *store = local->store;
+    if (store->handoff_head == NULL)
+      continue;
+
+    for (struct storage_handoff *ho = store->handoff_head; ho != NULL;
+         ho = ho->next) {
+      struct volume_molecule *vm = ho->vm;
+      vm->flags &= ~IN_HANDOFF;
+      if (ho->new_sv->local_storage->rank != world->procnum) {
+        mpi_send_molecule(world, vm, ho->new_sv);
+        continue;
+      }
+      vm = migrate_volume_molecule(vm, ho->new_sv);
+      vm->flags |= IN_SCHEDULE;
+      if (schedule_add(vm->subvol->local_storage->timer, vm))
+        mcell_allocfailed("Failed to add a '%s' volume molecule to scheduler "
+                          "after moving to a new memory partition.",
+                          vm->properties->sym->name);
+    }
+
+    mem_put_list(store->handoff_mem, store->handoff_head);
+    store->handoff_head = NULL;
+    store->handoff_tail = NULL;
+  }
+
+  mpi_exchange_molecules(world);
+}
+
+/***********************************************************************
+ run_storages_threaded:
+
+    Threaded version of the inner loop of mcell_run_iteration.  Every
+    storage of this rank with molecules left in its current list is run on
+    the thread pool, or one after the other if there is none; once all are
+    done, statistics are merged, releases triggered by reactions are
+    placed and molecules that crossed between storages are handed over.  This repeats until no storage on any rank has work
+    left for this iteration.
+
+    In:  struct volume *world - the world
+         double release_time - time of the next release event
+         double checkpt_time - time of the next checkpoint
+    Out: none
+ ***********************************************************************/
+static void run_storages_threaded(struct volume *world, double release_time,
+                                  double checkpt_time) {
+  int n_stores = 0;
+  for (struct storage_list *local = world->storage_head; local != NULL;
+       local = local->next)
+    n_stores++;
+
+  struct storage_pass pass;
+  pass.stores =
+      CHECKED_MALLOC_ARRAY(struct storage *, n_stores, "threaded storages");
+  pass.copies =
+      CHECKED_MALLOC_ARRAY(struct volume, n_stores, "per-thread world copies");
+  pass.release_time = release_time;
+  pass.checkpt_time = checkpt_time;
+
+  while (1) {
+    int n_active = 0;
+    for (struct storage_list *local = world->storage_head; local != NULL;
+         local = local->next) {
+      if (local->store->rank == world->procnum &&
+          local->store->timer->current != NULL) {
+        pass.stores[n_active] = local->store;
+        prepare_world_copy(&pass.copies[n_active], world, local->store);
+        n_active++;
+      }
+    }
+    if (!mpi_any_active(world, n_active))
+      break;
+
+    thread_pool_run((world->threaded_storages > 0) ? world_thread_pool(world)
+                                                   : NULL,
+                    n_active, run_storage_task, &pass);
+
+    for (int i = 0; i < n_active; i++) {
+      pass.stores[i]->step_cost +=
+          pass.copies[i].stats.diffusion_number +
+          pass.copies[i].stats.ray_polygon_tests;
+      merge_world_copy(world, &pass.copies[i], pass.stores[i]);
+      pass.stores[i]->product_placement_cache =
+          pass.copies[i].product_placement_cache;
+    }
+    if (flush_triggered_releases(world))
+      mcell_error("Failed to place reaction-triggered releases.");
+    process_storage_handoffs(world);
+  }
+
+  free(pass.copies);
+  free(pass.stores);
+}
+
+/* Storages whose cost is within this fraction of the average are left
+ * alone by rebalance_storages */
+#define REBALANCE_TOLERANCE 0.1
+
+/***********************************************************************
+ rebalance_storages:
+
+    Move subvolumes from storages that did more than their share of the
+    work since the last rebalance to neighbouring storages that did less.
+    The work of a storage is the diffusion steps and wall tests its
+    threaded passes ran; it is shared out over the storage's subvolumes by
+    their molecule counts.  Subvolumes are visited in index order and only
+    ever handed to a storage owning one of their six neighbours, so the
+    result is reproducible and storages stay spatially compact.
+
+    In:  struct volume *world - the world, between iterations
+    Out: none.  Subvolumes may have moved, and every storage's step_cost is
+         reset.
+ ***********************************************************************/
+static void rebalance_storages(struct volume *world) {
+  int n_stores = 0;
+  double total = 0;
+  for (struct storage_list *local = world->storage_head; local != NULL;
+       local = local->next) {
+    local->store->load = 0;
+    total += (double)local->store->step_cost;
+    n_stores++;
+  }
+
+  /* Cost per molecule of each storage */
+  for (int h = 0; h < world->n_subvols; h++)
+    world->subvol[h].local_storage->load += world->subvol[h].mol_count;
+  for (struct storage_list *local = world->storage_head; local != NULL;
+       local = local->next) {
+    struct storage *store = local->store;
+    store->cost_per_mol =
+        (store->load > 0) ? (double)store->step_cost / store->load : 0;
+    store->load = (double)store->step_cost;
+    store->step_cost = 0;
+  }
+  if (n_stores < 2 || total <= 0)
+    return;
+
+  double limit = (1.0 + REBALANCE_TOLERANCE) * total / n_stores;
+  int nz = world->nz_parts - 1;
+  int nyz = (world->ny_parts - 1) * nz;
+  int n_moved = 0;
+  for (int h = 0; h < world->n_subvols; h++) {
+    struct subvolume *sv = &world->subvol[h];
+    struct storage *from = sv->local_storage;
+    if (from->load <= limit || sv->mol_count == 0)
+      continue;
+
+    /* Least loaded storage owning a neighbour of this subvolume */
+    int neighbours[6];
+    int n_neighbours = 0;
+    if (!(sv->world_edge & X_NEG_BIT))
+      neighbours[n_neighbours++] = h - nyz;
+    if (!(sv->world_edge & X_POS_BIT))
+      neighbours[n_neighbours++] = h + nyz;
+    if (!(sv->world_edge & Y_NEG_BIT))
+      neighbours[n_neighbours++] = h - nz;
+    if (!(sv->world_edge & Y_POS_BIT))
+      neighbours[n_neighbours++] = h + nz;
+    if (!(sv->world_edge & Z_NEG_BIT))
+      neighbours[n_neighbours++] = h - 1;
+    if (!(sv->world_edge & Z_POS_BIT))
+      neighbours[n_neighbours++] = h + 1;
+    struct storage *to = NULL;
+    for (int n = 0; n < n_neighbours; n++) {
+      struct storage *s = world->subvol[neighbours[n]].local_storage;
+      if (s != from && s->rank == from->rank &&
+          (to == NULL || s->load < to->load))
+        to = s;
+    }
+    if (to == NULL)
+      continue;
+
+    double cost = sv->mol_count * from->cost_per_mol;
+    if (to->load + cost >= from->load - cost)
+      continue;
+
+    move_subvolume_to_storage(sv, to);
+    from->load -= cost;
+    to->load += cost;
+    n_moved++;
+  }
+
+  if (n_moved > 0 && world->notify->progress_report != NOTIFY_NONE)
+    mcell_log("Moved %d subvolumes between memory partitions at iteration "
+              "%lld to balance the threads.",
+              n_moved, world->current_iterations);
+}
+
+/***********************************************************************
+ molecule_subvolume_index:
+
+    Sort key of a scheduled molecule for sort_current_slot.
+
+    In:  struct abstract_element *e - a molecule in a storage's scheduler
+         void *data - the world
+    Out: the index of the molecule's subvolume, or 0 for defunct molecules
+ ***********************************************************************/
+static unsigned int molecule_subvolume_index(struct abstract_element *e,
+                                             void *data) {
+  struct volume *world = (struct volume *)data;
+  struct abstract_molecule *am = (struct abstract_molecule *)e;
+  if (am->properties == NULL)
+    return 0;
+  struct subvolume *sv;
+  if (am->flags & TYPE_SURF)
+    sv = ((struct surface_molecule *)am)->grid->subvol;
+  else
+    sv = ((struct volume_molecule *)am)->subvol;
+  return (unsigned int)(sv - world->subvol);
+}
+
+/***********************************************************************
+ sort_current_slot:
+
+    Reorder the molecules a storage runs in this timestep by subvolume, so
+    that consecutive molecules share their wall and partner lists.  The
+    sort is stable, so runs stay reproducible.
+
+    In:  struct volume *world - the world
+         struct storage *store - a storage whose scheduler just advanced
+    Out: none
+ ***********************************************************************/
+static void sort_current_slot(struct volume *world, struct storage *store) {
+  if (schedule_sort_current(store->timer, molecule_subvolume_index, world,
+                            (unsigned int)world->n_subvols))
+    mcell_allocfailed("Failed to sort the molecules of a timestep.");
+}
+
+/***********************************************************************
+ update_equilibration:
+
+    Enter or leave the equilibration phase (see mcell_set_equilibration)
+    as the current iteration requires.  Nothing has to be recomputed when
+    it ends: the longer steps are only taken in compute_displacement, the
+    space steps and reaction probabilities of each step follow from its
+    length there, and unimolecular lifetimes are kept in absolute time.
+
+    In:  struct volume *world - the world, at the start of an iteration
+    Out: none.  world->equilibrating is set while the current iteration
+         belongs to the phase.
+ ***********************************************************************/
+static void update_equilibration(struct volume *world) {
+  int equilibrating =
+      world->current_iterations < world->equilibration_iterations;
+  if (equilibrating == world->equilibrating)
+    return;
+  world->equilibrating = equilibrating;
+  if (world->notify->progress_report == NOTIFY_NONE)
+    return;
+  if (equilibrating)
+    mcell_log("Equilibrating until iteration %lld, with %.15g timesteps per "
+              "diffusion step and no output.",
+              world->equilibration_iterations,
+              world->equilibration_multiplier);
+  else
+    mcell_log("Equilibration finished on iteration %lld; switching to "
+              "production settings.",
+              world->current_iterations);
+}
+
+/***********************************************************************
+ start_active_storages:
+
+    Make the schedulers of all storages members of one group, so that the
+    schedulers of empty storages can stop advancing, for a serial run.
+
+    In:  struct volume *world - the world, with all storages at the same
+                                time
+    Out: none.  Every storage is active.
+ ***********************************************************************/
+static void start_active_storages(struct volume *world) {
+  int n_stores = 0;
+  for (struct storage_list *local = world->storage_head; local != NULL;
+       local = local->next)
+    n_stores++;
+
+  world->storage_group = CHECKED_MALLOC_STRUCT(struct schedule_group,
+                                               "storage scheduler group");
+  memset(world->storage_group, 0, sizeof(struct schedule_group));
+  world->storage_group->now = world->storage_head->store->current_time;
+  world->active_storages = CHECKED_MALLOC_ARRAY(struct storage *, n_stores,
+                                                "active storages");
+  world->n_active_storages = 0;
+  for (struct storage_list *local = world->storage_head; local != NULL;
+       local = local->next) {
+    local->store->list_index = world->n_active_storages;
+    schedule_join_group(local->store->timer, world->storage_group,
+                        local->store);
+    world->active_storages[world->n_active_storages++] = local->store;
+  }
+}
+
+/***********************************************************************
+ merge_woken_storages:
+
+    Add the storages whose schedulers woke up since the last call to the
+    active storages, keeping them in storage list order.
+
+    In:  struct volume *world - the world
+         int pos - position in the active storages being visited, or -1
+    Out: the number of storages added at or before pos
+ ***********************************************************************/
+static int merge_woken_storages(struct volume *world, int pos) {
+  struct schedule_group *g = world->storage_group;
+  if (g->error)
+    mcell_allocfailed("Failed to wake the scheduler of a storage.");
+
+  int n_before = 0;
+  for (int i = 0; i < g->n_woken; i++) {
+    struct storage *store = (struct storage *)g->woken[i];
+    store->current_time = g->now;
+    store->paged_out = 0;
+    int k = world->n_active_storages;
+    while (k > 0 &&
+           world->active_storages[k - 1]->list_index > store->list_index) {
+      world->active_storages[k] = world->active_storages[k - 1];
+      k--;
+    }
+    world->active_storages[k] = store;
+    world->n_active_storages++;
+    if (k <= pos)
+      n_before++;
+  }
+  g->n_woken = 0;
+  return n_before;
+}
+
+/***********************************************************************
+ page_out_idle_storages:
+
+    Hand the memory pools of the storages that have been idle for
+    world->page_idle_storages iterations back to the system.  The pools
+    are mapped from the page file (see mem_use_page_file), so their
+    contents stay there and are read back page by page as soon as any
+    molecule, wall or grid of the storage is touched again; nothing has to
+    be reloaded explicitly when the storage wakes up.
+
+    In:  struct volume *world - the world of a serial run
+    Out: none
+ ***********************************************************************/
+static void page_out_idle_storages(struct volume *world) {
+  double now = world->storage_group->now;
+  for (struct storage_list *local = world->storage_head; local != NULL;
+       local = local->next) {
+    struct storage *store = local->store;
+    if (store->paged_out || !store->timer->idle ||
+        now - store->current_time < world->page_idle_storages)
+      continue;
+    mem_page_out(store->list);
+    mem_page_out(store->mol);
+    mem_page_out(store->smol);
+    mem_page_out(store->face);
+    mem_page_out(store->join);
+    mem_page_out(store->grids);
+    mem_page_out(store->regl);
+    mem_page_out(store->pslv);
+    store->paged_out = 1;
+  }
+}
+
+/***********************************************************************
+ run_active_storages:
+
+    Run the current timestep of the storages of a serial run.  Only the
+    active storages are visited: a storage whose scheduler is empty after
+    a timestep leaves them and is skipped until something is scheduled in
+    it, when its scheduler catches up with the others.  Storages are
+    visited in the order of the storage list, as often as molecules
+    arrive in their current timestep.
+
+    In:  struct volume *world - the world
+         double release_time - time of the next release or output barrier
+         double checkpt_time - time of the end of the run
+    Out: none.  The active storages have advanced to the next timestep.
+ ***********************************************************************/
+static void run_active_storages(struct volume *world, double release_time,
+                                double checkpt_time) {
+  merge_woken_storages(world, -1);
+
+  int done = 0;
+  while (!done) {
+    done = 1;
+    for (int i = 0; i < world->n_active_storages; i++) {
+      struct storage *store = world->active_storages[i];
+      if (store->timer->current != NULL) {
+        run_timestep(world, store, release_time, checkpt_time);
+        done = 0;
+      }
+      i += merge_woken_storages(world, i);
+    }
+    if (world->triggered_releases != NULL &&
+        world->triggered_releases->n > 0) {
+      if (flush_triggered_releases(world))
+        mcell_error("Failed to place reaction-triggered releases.");
+      merge_woken_storages(world, -1);
+      done = 0;
+    }
+  }
+
+  int n_active = 0;
+  for (int i = 0; i < world->n_active_storages; i++) {
+    struct storage *store = world->active_storages[i];
+    /* Not using the return value -- just trying to advance the scheduler */
+    void *o = schedule_next(store->timer);
+    if (o != NULL)
+      mcell_internal_error("Scheduler dropped a molecule on the floor!");
+    if (world->sort_slots)
+      sort_current_slot(world, store);
+    store->current_time += 1.0;
+    if (schedule_is_empty(store->timer))
+      schedule_set_idle(store->timer);
+    else
+      world->active_storages[n_active++] = store;
+  }
+  world->n_active_storages = n_active;
+  world->storage_group->now += 1.0;
+
+  /* Idle storages are only looked for every so often, so that a run with
+   * many of them still only visits the active ones */
+  if (world->page_idle_storages > 0 &&
+      fmod(world->storage_group->now, world->page_idle_storages) == 0.0)
+    page_out_idle_storages(world);
+}
+
 /***********************************************************************
  run_sim:
 
@@ -333,8 +927,14 @@ mcell_run_simulation(MCELL_STATE *world) {
     restarted_from_checkpoint = 1;
   }
 
+  /* Reaction and viz output files go to disk on a background thread */
+  if (world->output_writer == NULL)
+    world->output_writer = output_writer_create(OUTPUT_WRITER_QUEUE_BYTES);
+
   long long frequency = mcell_determine_output_frequency(world);
   int status = 0;
+  gettimeofday(&world->run_start_time, NULL);
+  world->run_start_iteration = world->current_iterations;
   while (world->current_iterations <= world->iterations) {
     // XXX: A return status of 1 from mcell_run_iterations does not
     // indicate an error but is used to break out of the loop.
@@ -359,6 +959,8 @@ mcell_run_simulation(MCELL_STATE *world) {
     mcell_error_nodie("Failed to print final statistics.");
     status = 1;
   }
+  if (metrics_write_bench(world))
+    status = 1;
   if(world->nfsim_flag){
     char buffer[1000];
     memset(buffer, 0, 1000*sizeof(char));
@@ -366,6 +968,8 @@ mcell_run_simulation(MCELL_STATE *world) {
     //outputNFSimObservablesF_c(buffer);
     outputNFSimObservables_c(world->seed_seq);
     deleteNFSimSystem_c();
+    free_nfsim_reaction_maps(world);
+    free_graph_hashmap(world);
   }
   return status;
 }
@@ -405,32 +1009,46 @@ mcell_run_n_iterations(MCELL_STATE *world, long long frequency,
 MCELL_STATUS
 mcell_run_iteration(MCELL_STATE *world, long long frequency,
                     int *restarted_from_checkpoint) {
-  emergency_output_hook_enabled = 1;
+  world->emergency_output_hook_enabled = 1;
 
   long long iter_report_phase = world->current_iterations % frequency;
   double not_yet = world->current_iterations + 1.0;
 
+  update_equilibration(world);
+
   if (world->current_iterations != 0)
     world->elapsed_time = world->current_iterations;
   else
     world->elapsed_time = 1.0;
 
+  /* No collision list holds a cached NFSim rxn between iterations */
+  if (world->nfsim_flag) {
+    end_nfsim_query_batches(world);
+    if (world->nfsim_cache_bytes > 0)
+      trim_nfsim_reaction_caches(world, world->nfsim_cache_bytes);
+  }
+
   if (!*restarted_from_checkpoint) {
 
     /* Change geometry if needed */
-    process_geometry_changes(world, not_yet);
+    PROFILE_COUNTED_PHASE(PHASE_GEOMETRY,
+                          process_geometry_changes(world, not_yet));
 
     /* Release molecules */
-    process_molecule_releases(world, not_yet);
+    PROFILE_COUNTED_PHASE(PHASE_RELEASES,
+                          process_molecule_releases(world, not_yet));
 
     /* Produce output */
-    process_reaction_output(world, not_yet);
-    process_volume_output(world, not_yet);
-    for (struct viz_output_block *vizblk = world->viz_blocks; vizblk != NULL;
-         vizblk = vizblk->next) {
-      if (vizblk->frame_data_head && update_frame_data_list(world, vizblk))
-        mcell_error("Unknown error while updating frame data list.");
-    }
+    PROFILE_COUNTED_PHASE(PHASE_REACTION_OUTPUT,
+                          process_reaction_output(world, not_yet));
+    PROFILE_COUNTED_PHASE(PHASE_VOLUME_OUTPUT,
+                          process_volume_output(world, not_yet));
+    PROFILE_COUNTED_PHASE(PHASE_VIZ_OUTPUT,
+      for (struct viz_output_block *vizblk = world->viz_blocks; vizblk != NULL;
+           vizblk = vizblk->next) {
+        if (vizblk->frame_data_head && update_frame_data_list(world, vizblk))
+          mcell_error("Unknown error while updating frame data list.");
+      });
 
     /* Produce iteration report */
     if (iter_report_phase == 0 &&
@@ -460,12 +1078,40 @@ mcell_run_iteration(MCELL_STATE *world, long long frequency,
         mcell_log_raw(" Species: %d ",world->n_NFSimSpecies);
         mcell_log_raw(" Reactions triggered: %d", world->n_NFSimReactions);
         mcell_log_raw(" Total Reactions: %d", world->n_NFSimPReactions);
+        struct hashmap_stats uni_stats, rxn_stats, prelim_stats, graph_stats;
+        get_nfsim_reaction_map_stats(world, &uni_stats, &rxn_stats,
+                                     &prelim_stats);
+        get_graph_hashmap_stats(world, &graph_stats);
+        mcell_log_raw(" | Caches (entries/slots, mean probe):"
+                      " unimolecular %lu/%lu %.2f,"
+                      " bimolecular %lu/%lu %.2f,"
+                      " pairs %lu/%lu %.2f,"
+                      " graphs %lu/%lu %.2f",
+                      uni_stats.n_items, uni_stats.capacity,
+                      uni_stats.mean_probe,
+                      rxn_stats.n_items, rxn_stats.capacity,
+                      rxn_stats.mean_probe, prelim_stats.n_items,
+                      prelim_stats.capacity, prelim_stats.mean_probe,
+                      graph_stats.n_items, graph_stats.capacity,
+                      graph_stats.mean_probe);
+        struct nfsim_cache_stats cache_stats;
+        get_nfsim_reaction_cache_stats(world, &cache_stats);
+        mcell_log_raw(" | Reaction cache: %llu hits, %llu misses,"
+                      " %llu evictions, %.1f MB",
+                      cache_stats.hits, cache_stats.misses,
+                      cache_stats.evictions,
+                      (double)cache_stats.bytes / (1024.0 * 1024.0));
         mcell_log_raw("]");
       }
+      if (world->notify->memory_usage_report != NOTIFY_NONE)
+        mcell_log_memory_summary();
 
       mcell_log_raw("\n");
     }
 
+    /* Memory layout report asked for by signal */
+    mcell_poll_memory_layout(world);
+
     /* Check for a checkpoint on this iteration */
     if (world->chkpt_iterations && world->current_iterations != world->start_iterations &&
         ((world->current_iterations - world->start_iterations) % world->chkpt_iterations == 0)) {
@@ -478,18 +1124,10 @@ mcell_run_iteration(MCELL_STATE *world, long long frequency,
 
     /* No checkpoint signalled.  Keep going. */
     if (world->checkpoint_requested != CHKPT_NOT_REQUESTED) {
-      // This won't work with (non-trad) PBCs until we start saving the
-      // molecules' periodic box in the checkpoint file. In principle, it
-      // should probably work with the traditional form, but I'm disabling it
-      // here to be safe.
-      if (world->periodic_box_obj) {
-        mcell_error(
-          "periodic boundary conditions do not currently work with "
-          "checkpointing.");
-      }
       /* Make a checkpoint, exiting the loop if necessary */
       if (make_checkpoint(world))
         return 1;
+      mcell_compact_memory(world);
     }
 
     /* Even if no checkpoint, the last iteration is a half-iteration. */
@@ -500,7 +1138,8 @@ mcell_run_iteration(MCELL_STATE *world, long long frequency,
   // reset this flag to zero
   *restarted_from_checkpoint = 0;
 
-  run_concentration_clamp(world, world->current_iterations);
+  PROFILE_COUNTED_PHASE(PHASE_CONC_CLAMP,
+      run_concentration_clamp(world, world->current_iterations));
 
   double next_release_time;
   if (!schedule_anticipate(world->releaser, &next_release_time))
@@ -515,21 +1154,32 @@ mcell_run_iteration(MCELL_STATE *world, long long frequency,
   double next_viz_output = find_next_viz_output(world->viz_blocks);
   double next_barrier =
       min3d(next_release_time, next_vol_output, next_viz_output);
+  /* Outputs wait for the end of the equilibration phase, which no molecule
+   * may step past */
+  if (world->equilibrating)
+    next_barrier = min2d(next_release_time,
+                         (double)world->equilibration_iterations);
+
+  if (world->num_threads > 1 && world->threaded_storages == 0)
+    setup_threaded_storages(world);
+
+#ifdef MCELL_PHASE_PROFILE
+  struct perf_sample timesteps_perf;
+  phase_perf_start(&timesteps_perf);
+  unsigned long long timesteps_start = phase_clock();
+#endif
+  if (world->threaded_storages <= 0 && world->n_procs <= 1 &&
+      world->storage_group == NULL && world->storage_head != NULL)
+    start_active_storages(world);
+
+  while (world->storage_group != NULL &&
+         world->storage_group->now <= not_yet)
+    run_active_storages(world, next_barrier, (double)world->iterations + 1.0);
 
-  while (world->storage_head != NULL &&
+  while (world->storage_group == NULL && world->storage_head != NULL &&
          world->storage_head->store->current_time <= not_yet) {
-    int done = 0;
-    while (!done) {
-      done = 1;
-      for (struct storage_list *local = world->storage_head; local != NULL;
-           local = local->next) {
-        if (local->store->timer->current != NULL) {
-          run_timestep(world, local->store, next_barrier,
-                       (double)world->iterations + 1.0);
-          done = 0;
-        }
-      }
-    }
+    run_storages_threaded(world, next_barrier,
+                          (double)world->iterations + 1.0);
 
     for (struct storage_list *local = world->storage_head; local != NULL;
          local = local->next) {
@@ -537,12 +1187,31 @@ mcell_run_iteration(MCELL_STATE *world, long long frequency,
       void *o = schedule_next(local->store->timer);
       if (o != NULL)
         mcell_internal_error("Scheduler dropped a molecule on the floor!");
+      if (world->sort_slots)
+        sort_current_slot(world, local->store);
       local->store->current_time += 1.0;
     }
   }
+#ifdef MCELL_PHASE_PROFILE
+  phase_profile_add(PHASE_TIMESTEPS, timesteps_start);
+  phase_perf_add(PHASE_TIMESTEPS, &timesteps_perf);
+#endif
 
   world->current_iterations++;
 
+  if (world->threaded_storages > 0 && world->rebalance_interval > 0 &&
+      world->current_iterations % world->rebalance_interval == 0)
+    rebalance_storages(world);
+
+  if (world->sort_interval > 0 &&
+      world->current_iterations % world->sort_interval == 0) {
+    for (struct storage_list *local = world->storage_head; local != NULL;
+         local = local->next)
+      morton_sort_storage(world, local->store);
+  }
+
+  metrics_update(world);
+
   return 0;
 }
 
@@ -590,8 +1259,10 @@ mcell_flush_data(MCELL_STATE *world) {
       world->current_iterations > world->last_checkpoint_iteration) {
     status = make_checkpoint(world);
   }
+  if (wait_background_chkpt(world))
+    status = 1;
 
-  emergency_output_hook_enabled = 0;
+  world->emergency_output_hook_enabled = 0;
   int num_errors = flush_reaction_output(world);
   if (num_errors != 0) {
     mcell_warn("%d errors occurred while flushing buffered reaction output.\n"
@@ -599,6 +1270,8 @@ mcell_flush_data(MCELL_STATE *world) {
                num_errors);
     status = 1;
   }
+  /* Keep the journals of output that did not make it to disk */
+  output_journals_close(world, num_errors == 0);
 
   if (world->notify->progress_report != NOTIFY_NONE)
     mcell_log("Exiting run loop.");
@@ -614,6 +1287,20 @@ mcell_flush_data(MCELL_STATE *world) {
     }
   }
 
+  stop_geometry_prefetch(world);
+
+  /* Wait for the remaining output to reach the disk */
+  num_errors = output_writer_destroy(world->output_writer);
+  world->output_writer = NULL;
+  if (num_errors != 0) {
+    mcell_warn("%d output files could not be written.", num_errors);
+    status = 1;
+  }
+
+  /* Leave the final state in the metrics file */
+  if (metrics_write(world))
+    status = 1;
+
   return status;
 }
 
@@ -716,30 +1403,62 @@ mcell_print_final_statistics(MCELL_STATE *world) {
               world->chkpt_start_time_seconds +
                   ((world->current_iterations - world->start_iterations) * world->time_unit));
 
-    if (world->diffusion_number > 0)
+    struct sim_stats stats;
+    mcell_get_statistics(world, &stats);
+    if (stats.diffusion_number > 0)
       mcell_log("Average diffusion jump was %.2f timesteps\n",
-                world->diffusion_cumtime / (double)world->diffusion_number);
+                stats.diffusion_cumtime / (double)stats.diffusion_number);
     mcell_log("Total number of random number use: %lld", rng_uses(world->rng));
+    mcell_log("Total number of diffusion steps without collision checks: "
+              "%lld of %lld",
+              stats.diffusion_fast_steps, stats.diffusion_number);
     mcell_log("Total number of ray-subvolume intersection tests: %lld",
-              world->ray_voxel_tests);
+              stats.ray_voxel_tests);
     mcell_log("Total number of ray-polygon intersection tests: %lld",
-              world->ray_polygon_tests);
+              stats.ray_polygon_tests);
     mcell_log("Total number of ray-polygon intersections: %lld",
-              world->ray_polygon_colls);
+              stats.ray_polygon_colls);
     mcell_log("Total number of dynamic geometry molecule displacements: %lld",
               world->dyngeom_molec_displacements);
+    if (world->clamp_list != NULL)
+      mcell_log("Total number of concentration clamp emissions: %lld "
+                "(%lld walls stepped over to place them)",
+                world->clamp_mols_emitted, world->clamp_side_steps);
     print_molecule_collision_report(
         world->notify->molecule_collision_report,
-        world->vol_vol_colls,
-        world->vol_surf_colls,
-        world->surf_surf_colls,
-        world->vol_wall_colls,
-        world->vol_vol_vol_colls,
-        world->vol_vol_surf_colls,
-        world->vol_surf_surf_colls,
-        world->surf_surf_surf_colls,
+        stats.vol_vol_colls,
+        stats.vol_surf_colls,
+        stats.surf_surf_colls,
+        stats.vol_wall_colls,
+        stats.vol_vol_vol_colls,
+        stats.vol_vol_surf_colls,
+        stats.vol_surf_surf_colls,
+        stats.surf_surf_surf_colls,
         &world->rxn_flags);
 
+#ifdef SCHED_UTIL_KEEP_STATS
+    int storage_idx = 0;
+    for (struct storage_list *local = world->storage_head; local != NULL;
+         local = local->next) {
+      char name[64];
+      snprintf(name, sizeof(name), "memory partition %d", storage_idx++);
+      schedule_dump_stats(mcell_get_log_file(), local->store->timer, name);
+    }
+    schedule_dump_stats(mcell_get_log_file(), world->releaser, "releaser");
+    schedule_dump_stats(mcell_get_log_file(), world->count_scheduler,
+                        "reaction output");
+    schedule_dump_stats(mcell_get_log_file(), world->volume_output_scheduler,
+                        "volume output");
+#endif
+
+#ifdef MCELL_PHASE_PROFILE
+    phase_profile_report(world);
+#endif
+
+    if (world->notify->memory_usage_report != NOTIFY_NONE ||
+        world->use_huge_pages)
+      mcell_print_memory_usage(world);
+
     struct rusage run_time;
     time_t t_end; /* global end time of MCell run */
     double u_init_time,
@@ -769,3 +1488,292 @@ mcell_print_final_statistics(MCELL_STATE *world) {
 
   return 0;
 }
+
+/***********************************************************************
+ rename_branch_output:
+    Give all the output files of a branch of the simulation their own names.
+
+ In:  world: the simulation state
+      suffix: appended to every output file name
+ Out: none.  Reaction data, viz, volume, checkpoint and benchmark output
+      of the branch is written to the renamed files; reaction data files
+      start afresh with their headers.
+ ***********************************************************************/
+static void rename_branch_output(struct volume *world, char const *suffix) {
+  for (struct output_block *obp = world->output_block_head; obp != NULL;
+       obp = obp->next) {
+    for (struct output_set *set = obp->data_set_head; set != NULL;
+         set = set->next) {
+      char *name = CHECKED_SPRINTF("%s%s", set->outfile_name, suffix);
+      free(set->outfile_name);
+      set->outfile_name = name;
+      set->chunk_count = 0;
+    }
+  }
+
+  for (struct viz_output_block *vizblk = world->viz_blocks; vizblk != NULL;
+       vizblk = vizblk->next) {
+    if (vizblk->file_prefix_name == NULL)
+      continue;
+    char *name = CHECKED_SPRINTF("%s%s", vizblk->file_prefix_name, suffix);
+    free(vizblk->file_prefix_name);
+    vizblk->file_prefix_name = name;
+    vizblk->container_started = 0;
+  }
+
+  for (struct volume_output_item *vo = world->volume_output_head; vo != NULL;
+       vo = vo->next) {
+    char *name = CHECKED_SPRINTF("%s%s", vo->filename_prefix, suffix);
+    free(vo->filename_prefix);
+    vo->filename_prefix = name;
+  }
+
+  if (world->chkpt_outfile != NULL) {
+    char *name = CHECKED_SPRINTF("%s%s", world->chkpt_outfile, suffix);
+    free(world->chkpt_outfile);
+    world->chkpt_outfile = name;
+  }
+
+  if (world->bench_json_file != NULL) {
+    char *name = CHECKED_SPRINTF("%s%s", world->bench_json_file, suffix);
+    free(world->bench_json_file);
+    world->bench_json_file = name;
+  }
+}
+
+/***********************************************************************
+ reseed_branch:
+    Start a branch of the simulation on its own random number streams.
+
+ In:  world: the simulation state
+      seed: the new seed
+ Out: none.  The world's and every storage's generator are reinitialized
+      exactly as they would be for a run with this seed.
+ ***********************************************************************/
+static void reseed_branch(struct volume *world, u_int seed) {
+  world->seed_seq = seed;
+  rng_init(world->rng, seed);
+
+  /* Storages were created in reverse order of the storage list */
+  u_int n_storages = 0;
+  for (struct storage_list *slp = world->storage_head; slp != NULL;
+       slp = slp->next)
+    ++n_storages;
+  u_int i = n_storages;
+  for (struct storage_list *slp = world->storage_head; slp != NULL;
+       slp = slp->next) {
+    --i;
+    if (slp->store->rng != NULL)
+      rng_init_stream(slp->store->rng, seed, i + 1);
+  }
+}
+
+/************************************************************************
+ *
+ * function forking a branch of the simulation from its current state.
+ * The branch is a copy of the process, so it starts from exactly the
+ * molecules, schedulers, random number state and counts the simulation
+ * has now, without re-reading the model or rebuilding its geometry.
+ *
+ * In the branch, output files are renamed by appending output_suffix
+ * (if not NULL) and the random number streams are reseeded with seed
+ * (if not 0).  The branch should end with mcell_finish_branch.
+ *
+ * Returns the process id of the branch in the caller, 0 in the branch,
+ * and -1 if the branch could not be created.
+ *
+ ************************************************************************/
+int
+mcell_fork_branch(MCELL_STATE *world, u_int seed, char const *output_suffix) {
+#ifndef _WIN32
+  /* Pools paged to the page file are mapped shared, so the branch would
+   * write over our molecules rather than its own copy */
+  if (mem_page_file_shared()) {
+    mcell_error_nodie("Cannot branch a simulation whose storages are paged "
+                      "to a page file.");
+    return -1;
+  }
+
+
+  /* The output writer's thread and queue don't survive fork, so empty it
+   * first; it is recreated when needed */
+  if (wait_background_chkpt(world))
+    mcell_warn("Continuing after the failure of a background checkpoint.");
+  if (world->output_writer != NULL) {
+    if (output_writer_destroy(world->output_writer) != 0)
+      mcell_warn("Some output files could not be written.");
+    world->output_writer = NULL;
+  }
+  /* Nor does the geometry frame loader's */
+  stop_geometry_prefetch(world);
+
+  /* Don't let the branch write out our buffered output a second time */
+  fflush(NULL);
+
+  pid_t pid = fork();
+  if (pid == 0) {
+    /* Only this thread exists in the branch; the pool is rebuilt by the
+     * next iteration */
+    world->thread_pool = NULL;
+    signal(SIGALRM, SIG_IGN);
+
+    /* The journals' mappings are shared with us, so the branch only
+     * journals output it writes to files of its own */
+    output_journals_close(world, 0);
+    if (output_suffix != NULL && output_suffix[0] != '\0') {
+      rename_branch_output(world, output_suffix);
+      if (output_journals_create(world))
+        mcell_warn("Some reaction data of this branch is not journaled.");
+    }
+    if (seed != 0)
+      reseed_branch(world, seed);
+    return 0;
+  } else if (pid > 0) {
+    return (int)pid;
+  }
+
+  mcell_perror_nodie(errno, "Failed to fork a branch of the simulation");
+#else
+  UNUSED(world);
+  UNUSED(seed);
+  UNUSED(output_suffix);
+  mcell_error_nodie("Branching simulations is not supported on Windows.");
+#endif
+  return -1;
+}
+
+#ifndef _WIN32
+/* Wait for one branch of a seed sweep to finish, counting it in *n_failed
+ * if it failed; returns 0 if there are no branches left */
+static int wait_for_seed(int *n_failed) {
+  int status;
+  pid_t pid;
+  do {
+    pid = wait(&status);
+  } while (pid < 0 && errno == EINTR);
+
+  if (pid < 0)
+    return 0;
+  if (!WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS)
+    (*n_failed)++;
+  return 1;
+}
+#endif
+
+/************************************************************************
+ *
+ * function running a sweep over the seeds seed_seq .. seed_seq +
+ * n_seeds - 1.  Each seed runs in a branch forked from the current,
+ * partly initialized state, so the model, geometry, reaction tables and
+ * diffusion step tables built so far are shared read-only between all
+ * seeds rather than rebuilt.  A branch reseeds its random number streams
+ * and skips as many numbers as have been drawn so far, which leaves it
+ * where a run started with its seed would be, then carries on
+ * initializing and runs on its own.  Output files of each seed get a
+ * "_seed<n>" suffix.
+ *
+ * The calling process only hands out the seeds, keeping one branch per
+ * processor running, and exits once all of them are done.  Returns only
+ * in the branches.
+ *
+ ************************************************************************/
+void
+mcell_sweep_seeds(MCELL_STATE *world) {
+#ifndef _WIN32
+  if (world->chkpt_infile != NULL)
+    mcell_error("-seeds cannot be combined with reading a checkpoint.");
+  if (world->n_procs > 1)
+    mcell_error("-seeds cannot be combined with an MPI run.");
+
+  long long n_drawn = rng_uses(world->rng);
+  u_int first_seed = world->seed_seq;
+  long max_running = sysconf(_SC_NPROCESSORS_ONLN);
+  if (max_running < 1)
+    max_running = 1;
+  if (world->notify->progress_report != NOTIFY_NONE)
+    mcell_log("Running %d seeds from %u, up to %ld at a time.",
+              world->n_seeds, first_seed, max_running);
+
+  int n_running = 0;
+  int n_failed = 0;
+  for (int k = 0; k < world->n_seeds; k++) {
+    while (n_running == max_running && wait_for_seed(&n_failed))
+      n_running--;
+
+    u_int seed = first_seed + (u_int)k;
+    char suffix[32];
+    snprintf(suffix, sizeof(suffix), "_seed%u", seed);
+    int pid = mcell_fork_branch(world, seed, suffix);
+    if (pid == 0) {
+      if (seed != 0) {
+        uint32_t skipped[1024];
+        for (long long left = n_drawn; left > 0; left -= 1024)
+          rng_uint_n(world->rng, skipped, (left < 1024) ? (int)left : 1024);
+      }
+      world->n_seeds = 1;
+      return;
+    }
+    if (pid < 0)
+      n_failed++;
+    else
+      n_running++;
+  }
+
+  while (n_running > 0 && wait_for_seed(&n_failed))
+    n_running--;
+
+  if (n_failed > 0)
+    mcell_error("%d of %d seeds failed.", n_failed, world->n_seeds);
+  if (world->notify->progress_report != NOTIFY_NONE)
+    mcell_log("All %d seeds finished.", world->n_seeds);
+  fflush(NULL);
+  exit(EXIT_SUCCESS);
+#else
+  UNUSED(world);
+  mcell_error("-seeds is not supported on Windows.");
+#endif
+}
+
+/************************************************************************
+ *
+ * function ending a branch of the simulation created by
+ * mcell_fork_branch.  Flushes all its output and exits the branch; it
+ * does not return.
+ *
+ ************************************************************************/
+void
+mcell_finish_branch(MCELL_STATE *world) {
+  int status = mcell_flush_data(world);
+  fflush(NULL);
+  _exit(status ? EXIT_FAILURE : EXIT_SUCCESS);
+}
+
+/************************************************************************
+ *
+ * function waiting for a branch of the simulation to finish
+ *
+ * Returns 0 if the branch finished successfully, 1 otherwise.
+ *
+ ************************************************************************/
+MCELL_STATUS
+mcell_wait_branch(int branch_pid) {
+#ifndef _WIN32
+  int status;
+  pid_t pid;
+  do {
+    pid = waitpid((pid_t)branch_pid, &status, 0);
+  } while (pid < 0 && errno == EINTR);
+
+  if (pid < 0) {
+    mcell_perror_nodie(errno, "Failed to wait for simulation branch %d",
+                       branch_pid);
+    return MCELL_FAIL;
+  }
+  if (!WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS)
+    return MCELL_FAIL;
+  return MCELL_SUCCESS;
+#else
+  UNUSED(branch_pid);
+  return MCELL_FAIL;
+#endif
+}
@@ -46,3 +46,22 @@ MCELL_STATUS mcell_print_final_warnings(MCELL_STATE *state);
 
 /* print the final simulation statistics */
 MCELL_STATUS mcell_print_final_statistics(MCELL_STATE *state);
+
+/* NULL if the memory partitions can be run independently of each other,
+ * otherwise a short description of the feature that prevents it */
+char const *storages_are_independent(struct volume *world);
+
+/* fork a branch of the simulation from its current state; returns the
+ * branch's process id, 0 in the branch and -1 on failure */
+int mcell_fork_branch(MCELL_STATE *state, u_int seed,
+                      char const *output_suffix);
+
+/* flush the output of a branch and exit it */
+void mcell_finish_branch(MCELL_STATE *state);
+
+/* run each of state->n_seeds seeds in a branch forked from the current
+ * state; returns in the branches only */
+void mcell_sweep_seeds(MCELL_STATE *state);
+
+/* wait for a branch of the simulation to finish */
+MCELL_STATUS mcell_wait_branch(int branch_pid);
@@ -23,13 +23,44 @@
 /* this function runs the whole simulations */
 MCELL_STATUS mcell_run_simulation(MCELL_STATE *state);
 
-/* this function runs n iterations */
-MCELL_STATUS mcell_run_n_iterations(MCELL_STATE *state, long long output_frequency,
-                    int *INPUT, int n_iter);
+/* these run n iterations and a single iteration without holding the GIL,
+ * so other Python threads (and other worlds) can run meanwhile.  NFSim is
+ * a single library instance per process, so worlds using it keep the GIL
+ * and are run one at a time. */
+%rename(mcell_run_n_iterations) pymcell_run_n_iterations;
+%rename(mcell_run_iteration) pymcell_run_iteration;
+%inline %{
+MCELL_STATUS pymcell_run_n_iterations(MCELL_STATE *state,
+                                      long long output_frequency,
+                                      int restarted_from_checkpoint,
+                                      int n_iter) {
+  if (state->nfsim_flag)
+    return mcell_run_n_iterations(state, output_frequency,
+                                  &restarted_from_checkpoint, n_iter);
 
-/* this function runs a single iteration of simulations */
-MCELL_STATUS mcell_run_iteration(MCELL_STATE *state, long long output_frequency,
-                                 int *INPUT);
+  MCELL_STATUS status;
+  Py_BEGIN_ALLOW_THREADS
+  status = mcell_run_n_iterations(state, output_frequency,
+                                  &restarted_from_checkpoint, n_iter);
+  Py_END_ALLOW_THREADS
+  return status;
+}
+
+MCELL_STATUS pymcell_run_iteration(MCELL_STATE *state,
+                                   long long output_frequency,
+                                   int restarted_from_checkpoint) {
+  if (state->nfsim_flag)
+    return mcell_run_iteration(state, output_frequency,
+                               &restarted_from_checkpoint);
+
+  MCELL_STATUS status;
+  Py_BEGIN_ALLOW_THREADS
+  status = mcell_run_iteration(state, output_frequency,
+                               &restarted_from_checkpoint);
+  Py_END_ALLOW_THREADS
+  return status;
+}
+%}
 
 /* flush all output buffers to disk to disk after the simulation
  * run is complete */
@@ -42,4 +73,13 @@ MCELL_STATUS mcell_print_final_warnings(MCELL_STATE *state);
 /* print the final simulation statistics */
 MCELL_STATUS mcell_print_final_statistics(MCELL_STATE *state);
 
+/* fork a branch of the simulation from its current state; returns the
+ * branch's process id, 0 in the branch and -1 on failure */
+int mcell_fork_branch(MCELL_STATE *state, unsigned int seed,
+                      char const *output_suffix);
+
+/* flush the output of a branch and exit it */
+void mcell_finish_branch(MCELL_STATE *state);
 
+/* wait for a branch of the simulation to finish */
+MCELL_STATUS mcell_wait_branch(int branch_pid);
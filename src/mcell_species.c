@@ -27,8 +27,14 @@
 #include <stdlib.h>
 
 #include "diffuse_util.h"
+#include "grid_util.h"
 #include "sym_table.h"
 #include "mcell_species.h"
+#include "count_util.h"
+#include "mol_id_index.h"
+#include "nfsim_func.h"
+#include "sched_util.h"
+#include "vol_util.h"
 #include "logging.h"
 
 /* static helper functions */
@@ -129,6 +135,293 @@ void mcell_delete_species_list(struct mcell_species *species) {
   }
 }
 
+/**************************************************************************
+ mcell_get_species_molecules:
+    Gather the ids and positions of all live molecules of a species into a
+    caller-owned buffer.  The buffer is reused from call to call and only
+    grows when the population outgrows it, so per-iteration callers (e.g.
+    the Python views over positions and ids) see a stable pointer.
+
+ In: state: the simulation state
+     species_name: name of the species
+     mols: buffer to fill; zero it before the first call
+ Out: MCELL_SUCCESS, or MCELL_FAIL if the species is unknown or memory runs
+      out.  Positions are in microns, three doubles per molecule.
+**************************************************************************/
+MCELL_STATUS
+mcell_get_species_molecules(MCELL_STATE *state, const char *species_name,
+                            struct mcell_species_molecules *mols) {
+  struct sym_entry *sym = retrieve_sym(species_name, state->mol_sym_table);
+  if (sym == NULL)
+    return MCELL_FAIL;
+  struct species *spec = (struct species *)sym->value;
+
+  int wanted = (spec->population > 0) ? (int)spec->population : 0;
+  if (wanted > mols->max_mols) {
+    double *positions =
+        (double *)realloc(mols->positions, 3 * wanted * sizeof(double));
+    if (positions == NULL)
+      return MCELL_FAIL;
+    mols->positions = positions;
+    u_long *ids = (u_long *)realloc(mols->ids, wanted * sizeof(u_long));
+
+    if (ids == NULL)
+      return MCELL_FAIL;
+    mols->ids = ids;
+    mols->max_mols = wanted;
+  }
+
+  int n_mols = 0;
+  for (struct storage_list *slp = state->storage_head; slp != NULL;
+       slp = slp->next) {
+    for (struct schedule_helper *shp = slp->store->timer; shp != NULL;
+         shp = shp->next_scale) {
+      for (int i = -1; i < shp->buf_len; ++i) {
+        for (struct abstract_molecule *amp =
+                 (struct abstract_molecule *)((i < 0) ? shp->current
+                                                      : shp->circ_buf_head[i]);
+             amp != NULL && n_mols < mols->max_mols; amp = amp->next) {
+          if (amp->properties != spec)
+            continue;
+
+          struct vector3 where;
+          if ((amp->flags & TYPE_VOL) != 0)
+            where = ((struct volume_molecule *)amp)->pos;
+          else if ((amp->flags & TYPE_SURF) != 0) {
+            struct surface_molecule *sm = (struct surface_molecule *)amp;
+            uv2xyz(&sm->s_pos, sm->grid->surface, &where);
+          } else
+            continue;
+
+          double *xyz = mols->positions + 3 * n_mols;
+          xyz[0] = where.x * state->length_unit;
+          xyz[1] = where.y * state->length_unit;
+          xyz[2] = where.z * state->length_unit;
+          mols->ids[n_mols++] = amp->id;
+        }
+      }
+    }
+  }
+  mols->n_mols = n_mols;
+
+  return MCELL_SUCCESS;
+}
+
+/**************************************************************************
+ mcell_free_species_molecules:
+    Release the arrays of a buffer filled by mcell_get_species_molecules.
+
+ In: mols: the buffer
+ Out: None.  The buffer is left empty and may be filled again.
+**************************************************************************/
+void mcell_free_species_molecules(struct mcell_species_molecules *mols) {
+  free(mols->positions);
+  free(mols->ids);
+  mols->positions = NULL;
+  mols->ids = NULL;
+  mols->n_mols = 0;
+  mols->max_mols = 0;
+}
+
+/**************************************************************************
+ mcell_enable_molecule_index:
+    Build the index from molecule id to molecule used by mcell_find_molecule,
+    mcell_move_molecule and mcell_remove_molecule.  Molecules created from
+    here on are added to it as they are created.  Ids are unique in serial
+    runs; the worlds of threaded passes hand out ids from copies of the
+    counter, and the index then holds the latest molecule with a given id.
+
+ In: state: the simulation state
+ Out: MCELL_SUCCESS, or MCELL_FAIL if memory runs out
+**************************************************************************/
+MCELL_STATUS
+mcell_enable_molecule_index(MCELL_STATE *state) {
+  if (state->mol_id_index != NULL)
+    return MCELL_SUCCESS;
+  state->mol_id_index = create_mol_id_index();
+  if (state->mol_id_index == NULL)
+    return MCELL_FAIL;
+
+  for (struct storage_list *slp = state->storage_head; slp != NULL;
+       slp = slp->next) {
+    slp->store->mol_id_index = state->mol_id_index;
+    for (struct schedule_helper *shp = slp->store->timer; shp != NULL;
+         shp = shp->next_scale) {
+      for (int i = -1; i < shp->buf_len; ++i) {
+        for (struct abstract_molecule *amp =
+                 (struct abstract_molecule *)((i < 0) ? shp->current
+                                                      : shp->circ_buf_head[i]);
+             amp != NULL; amp = amp->next) {
+          if (amp->properties != NULL && (amp->flags & (TYPE_VOL | TYPE_SURF)))
+            mol_id_index_set(state->mol_id_index, amp);
+        }
+      }
+    }
+  }
+  return MCELL_SUCCESS;
+}
+
+/* Live molecule with the given id, by index or by scanning the schedulers */
+static struct abstract_molecule *find_molecule_by_id(MCELL_STATE *state,
+                                                     u_long id) {
+  if (state->mol_id_index != NULL)
+    return mol_id_index_lookup(state->mol_id_index, id);
+
+  for (struct storage_list *slp = state->storage_head; slp != NULL;
+       slp = slp->next) {
+    for (struct schedule_helper *shp = slp->store->timer; shp != NULL;
+         shp = shp->next_scale) {
+      for (int i = -1; i < shp->buf_len; ++i) {
+        for (struct abstract_molecule *amp =
+                 (struct abstract_molecule *)((i < 0) ? shp->current
+                                                      : shp->circ_buf_head[i]);
+             amp != NULL; amp = amp->next) {
+          if (amp->id == id && amp->properties != NULL &&
+              (amp->flags & (TYPE_VOL | TYPE_SURF)) != 0)
+            return amp;
+        }
+      }
+    }
+  }
+  return NULL;
+}
+
+/**************************************************************************
+ mcell_find_molecule:
+    Look up a live molecule by id.  Without mcell_enable_molecule_index this
+    scans every scheduler.
+
+ In: state: the simulation state
+     id: id of the molecule
+     mol: filled in with the molecule's species and position
+ Out: MCELL_SUCCESS, or MCELL_FAIL if there is no live molecule with the id.
+      The position is in microns.
+**************************************************************************/
+MCELL_STATUS
+mcell_find_molecule(MCELL_STATE *state, u_long id,
+                    struct mcell_molecule_state *mol) {
+  struct abstract_molecule *amp = find_molecule_by_id(state, id);
+  if (amp == NULL)
+    return MCELL_FAIL;
+
+  struct vector3 where;
+  if ((amp->flags & TYPE_VOL) != 0) {
+    where = ((struct volume_molecule *)amp)->pos;
+    mol->is_surface = 0;
+    mol->orient = 0;
+  } else {
+    struct surface_molecule *sm = (struct surface_molecule *)amp;
+    uv2xyz(&sm->s_pos, sm->grid->surface, &where);
+    mol->is_surface = 1;
+    mol->orient = sm->orient;
+  }
+  mol->id = amp->id;
+  mol->species_name = amp->properties->sym->name;
+  mol->x = where.x * state->length_unit;
+  mol->y = where.y * state->length_unit;
+  mol->z = where.z * state->length_unit;
+  return MCELL_SUCCESS;
+}
+
+/**************************************************************************
+ mcell_move_molecule:
+    Put a volume molecule somewhere else, as coupling codes which manage
+    individual particles do between iterations.  The molecule jumps: walls
+    between the old and the new position are not tested, and the counts of
+    the regions it leaves and enters are updated.
+
+ In: state: the simulation state
+     id: id of the molecule
+     x, y, z: new position, in microns
+ Out: MCELL_SUCCESS, or MCELL_FAIL if there is no live volume molecule with
+      the id
+**************************************************************************/
+MCELL_STATUS
+mcell_move_molecule(MCELL_STATE *state, u_long id, double x, double y,
+                    double z) {
+  struct abstract_molecule *amp = find_molecule_by_id(state, id);
+  if (amp == NULL || (amp->flags & TYPE_VOL) == 0)
+    return MCELL_FAIL;
+  struct volume_molecule *vm = (struct volume_molecule *)amp;
+
+  struct vector3 new_pos;
+  new_pos.x = x / state->length_unit;
+  new_pos.y = y / state->length_unit;
+  new_pos.z = z / state->length_unit;
+  struct subvolume *new_sv = find_subvolume(state, &new_pos, NULL);
+
+  int counted = (vm->properties->flags & (COUNT_CONTENTS | COUNT_ENCLOSED));
+  if (counted)
+    count_region_from_scratch(state, (struct abstract_molecule *)vm, NULL, -1,
+                              &vm->pos, NULL, vm->t, &vm->periodic_box);
+  vm->pos = new_pos;
+
+  if (new_sv != vm->subvol) {
+    struct storage *old_storage = vm->subvol->local_storage;
+    struct volume_molecule *new_vm = migrate_volume_molecule(vm, new_sv);
+    if (new_vm != vm) {
+      // The old copy is left in its scheduler as a defunct molecule
+      old_storage->timer->defunct_count++;
+      if (schedule_add(new_sv->local_storage->timer, new_vm))
+        mcell_allocfailed("Failed to add volume molecule to scheduler.");
+      vm = new_vm;
+    }
+  } else if (vm->species_list != NULL && vm->species_list->cells != NULL) {
+    vm->species_list->cells->stale = 1;
+  }
+
+  if (counted)
+    count_region_from_scratch(state, (struct abstract_molecule *)vm, NULL, 1,
+                              &vm->pos, NULL, vm->t, &vm->periodic_box);
+  return MCELL_SUCCESS;
+}
+
+/**************************************************************************
+ mcell_remove_molecule:
+    Remove a molecule from the simulation, as a unimolecular reaction
+    without products would.
+
+ In: state: the simulation state
+     id: id of the molecule
+ Out: MCELL_SUCCESS, or MCELL_FAIL if there is no live molecule with the id
+**************************************************************************/
+MCELL_STATUS
+mcell_remove_molecule(MCELL_STATE *state, u_long id) {
+  struct abstract_molecule *amp = find_molecule_by_id(state, id);
+  if (amp == NULL)
+    return MCELL_FAIL;
+  struct species *spec = amp->properties;
+
+  if ((amp->flags & TYPE_VOL) != 0) {
+    struct volume_molecule *vm = (struct volume_molecule *)amp;
+    vm->subvol->mol_count--;
+    if (vm->flags & IN_SCHEDULE)
+      vm->subvol->local_storage->timer->defunct_count++;
+    if (spec->flags & COUNT_SOME_MASK)
+      count_region_from_scratch(state, amp, NULL, -1, &vm->pos, NULL, vm->t,
+                                &vm->periodic_box);
+    spec->population--;
+    collect_molecule(vm);
+  } else {
+    struct surface_molecule *sm = (struct surface_molecule *)amp;
+    remove_surfmol_from_list(&sm->grid->sm_list[sm->grid_index], sm);
+    sm->grid->n_occupied--;
+    if (sm->flags & IN_SCHEDULE)
+      sm->grid->subvol->local_storage->timer->defunct_count++;
+    if (spec->flags & COUNT_SOME_MASK)
+      count_region_from_scratch(state, amp, NULL, -1, NULL, NULL, sm->t,
+                                &sm->periodic_box);
+    spec->population--;
+    mol_id_index_forget(state->mol_id_index, amp);
+    release_molecule_graph(amp);
+    sm->properties = NULL;
+    sm->flags &= ~IN_SURFACE;
+    if ((sm->flags & IN_MASK) == 0)
+      mem_put(sm->birthplace, sm);
+  }
+  return MCELL_SUCCESS;
+}
+
 /**************************************************************************
  new_mol_species:
     Create a new species. There must not yet be a molecule or named reaction
@@ -321,7 +614,7 @@ struct species *assemble_mol_species(MCELL_STATE *state,
 **************************************************************************/
 int ensure_rdstep_tables_built(MCELL_STATE *state) {
   if (state->r_step != NULL && state->r_step_surface != NULL &&
-      state->d_step != NULL) {
+      state->r_step_surface_erfc != NULL && state->d_step != NULL) {
     return 0;
   }
 
@@ -340,6 +633,14 @@ int ensure_rdstep_tables_built(MCELL_STATE *state) {
     }
   }
 
+  if (state->r_step_surface_erfc == NULL) {
+    state->r_step_surface_erfc = init_r_step_surface_erfc(
+        state->r_step_surface, state->radial_subdivisions);
+    if (state->r_step_surface_erfc == NULL) {
+      return 6;
+    }
+  }
+
   if (state->d_step == NULL) {
     // Out of memory while creating d_step data for molecule
     if ((state->d_step = init_d_step(state->radial_directions,
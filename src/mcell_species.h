@@ -58,6 +58,23 @@ struct mcell_species_list {
   struct mcell_species *mol_type_tail;
 };
 
+/* Reusable snapshot of the live molecules of one species */
+struct mcell_species_molecules {
+  int n_mols;        /* Number of molecules in the snapshot */
+  int max_mols;      /* Capacity of the arrays */
+  double *positions; /* x, y, z of each molecule, in microns */
+  u_long *ids;       /* Unique id of each molecule */
+};
+
+/* One molecule, as found by mcell_find_molecule */
+struct mcell_molecule_state {
+  u_long id;
+  const char *species_name;
+  int is_surface;   /* 1 for surface molecules */
+  short orient;     /* Orientation of surface molecules */
+  double x, y, z;   /* Position, in microns */
+};
+
 MCELL_STATUS mcell_create_species(MCELL_STATE *state,
                                   struct mcell_species_spec *species,
                                   mcell_symbol **species_ptr);
@@ -68,4 +85,20 @@ mcell_add_to_species_list(mcell_symbol *species_ptr, bool is_oriented,
 
 void mcell_delete_species_list(struct mcell_species *species);
 
+MCELL_STATUS
+mcell_get_species_molecules(MCELL_STATE *state, const char *species_name,
+                            struct mcell_species_molecules *mols);
+
+void mcell_free_species_molecules(struct mcell_species_molecules *mols);
+
+MCELL_STATUS mcell_enable_molecule_index(MCELL_STATE *state);
+
+MCELL_STATUS mcell_find_molecule(MCELL_STATE *state, u_long id,
+                                 struct mcell_molecule_state *mol);
+
+MCELL_STATUS mcell_move_molecule(MCELL_STATE *state, u_long id, double x,
+                                 double y, double z);
+
+MCELL_STATUS mcell_remove_molecule(MCELL_STATE *state, u_long id);
+
 int new_mol_species(MCELL_STATE *state, const char *name, struct sym_entry **sym_ptr);
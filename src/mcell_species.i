@@ -52,6 +52,31 @@ struct mcell_species_list {
   struct mcell_species *mol_type_tail;
 };
 
+%immutable mcell_molecule_state::species_name;
+
+struct mcell_molecule_state {
+  u_long id;
+  const char *species_name;
+  int is_surface;
+  short orient;
+  double x, y, z;
+};
+
+%immutable mcell_species_molecules::n_mols;
+%immutable mcell_species_molecules::max_mols;
+
+struct mcell_species_molecules {
+  int n_mols;
+  int max_mols;
+};
+
+%extend mcell_species_molecules {
+  ~mcell_species_molecules() {
+    mcell_free_species_molecules($self);
+    free($self);
+  }
+}
+
 %typemap(in) mcell_symbol **species_ptr (mcell_symbol *temp) {
   $1 = &temp;
 }
@@ -71,3 +96,33 @@ mcell_add_to_species_list(mcell_symbol *species_ptr, bool is_oriented,
 void mcell_delete_species_list(struct mcell_species *species);
 
 int new_mol_species(MCELL_STATE *state, char *name, struct sym_entry **sym_ptr);
+
+MCELL_STATUS
+mcell_get_species_molecules(MCELL_STATE *state, const char *species_name,
+                            struct mcell_species_molecules *mols);
+
+void mcell_free_species_molecules(struct mcell_species_molecules *mols);
+
+MCELL_STATUS mcell_enable_molecule_index(MCELL_STATE *state);
+
+MCELL_STATUS mcell_find_molecule(MCELL_STATE *state, u_long id,
+                                 struct mcell_molecule_state *mol);
+
+MCELL_STATUS mcell_move_molecule(MCELL_STATE *state, u_long id, double x,
+                                 double y, double z);
+
+MCELL_STATUS mcell_remove_molecule(MCELL_STATE *state, u_long id);
+
+// Views share memory with the snapshot and are only valid until it is
+// refilled by the next mcell_get_species_molecules call
+%inline %{
+PyObject *mcell_species_positions_view(struct mcell_species_molecules *mols) {
+  return pymcell_memoryview(mols->positions, mols->n_mols, 3, sizeof(double),
+                            3 * sizeof(double), "d");
+}
+
+PyObject *mcell_species_ids_view(struct mcell_species_molecules *mols) {
+  return pymcell_memoryview(mols->ids, mols->n_mols, 1, sizeof(u_long),
+                            sizeof(u_long), "L");
+}
+%}
@@ -26,6 +26,7 @@
 #include "config.h"
 
 #include <limits.h>
+#include <stdint.h>
 #include <sys/types.h>
 #include <stdbool.h>
 #include <stdio.h>
@@ -112,7 +113,10 @@
 /* DIFFUSE molecules diffuse (duh!) */
 /* CLAMPED molecules diffuse for part of a timestep and don't react with
    surfaces */
+/* NO_UNIMOL molecules had no unimolecular reaction where their lifetime
+   was last computed */
 #define ACT_DIFFUSE 0x008
+#define ACT_NO_UNIMOL 0x010
 #define ACT_REACT 0x020
 #define ACT_NEWBIE 0x040
 #define ACT_CHANGE 0x080
@@ -131,6 +135,11 @@
 /* Flag indicating that a molecule is old enough to take the maximum timestep */
 #define MATURE_MOLECULE 0x2000
 
+/* Flag indicating that a volume molecule stopped at a memory partition
+ * boundary during a threaded timestep and is waiting in its storage's
+ * hand-off queue to be migrated into the neighbouring storage */
+#define IN_HANDOFF 0x4000
+
 /* End of Abstract Molecule Flags. */
 
 /* Output Report Flags */
@@ -298,6 +307,14 @@ enum manifold_flag_t {
 #define MAX_TARGET_TIMESTEP 1.0e6
 #define MIN_TARGET_TIMESTEP 10.0
 
+/* Adaptive partitioning: a partition is split while it holds more than
+ * ADAPTIVE_PART_CROWDING times the mean density of the partitions along its
+ * axis, up to ADAPTIVE_PART_MAX_PER_AXIS partition boundaries per axis.
+ * Density is binned into ADAPTIVE_PART_BINS bins per axis. */
+#define ADAPTIVE_PART_CROWDING 2.0
+#define ADAPTIVE_PART_MAX_PER_AXIS 48
+#define ADAPTIVE_PART_BINS 1024
+
 /* Flags for parser to indicate which axis we are partitioning */
 enum partition_axis_t {
   X_PARTS, /* X-axis partitions */
@@ -337,6 +354,10 @@ enum release_shape_t {
 /* (those that were consumed when hit by another molecule) */
 #define MIN_DEFUNCT_FOR_GC 1024
 #define MAX_DEFUNCT_FRAC 0.2
+/* A cleanup pass is spread over about this many timesteps, examining at */
+/* least MIN_GC_ITEMS_PER_TIMESTEP scheduled items in each */
+#define GC_PASS_TIMESTEPS 16
+#define MIN_GC_ITEMS_PER_TIMESTEP 4096
 
 /* Constants for notification levels */
 enum notify_level_t {
@@ -463,6 +484,13 @@ enum checkpoint_request_type_t {
 /* default size of output count buffers */
 #define COUNTBUFFERSIZE 10000
 
+/* memory the count buffers of output blocks without an OUTPUT_BUFFER_SIZE
+ * share (bytes); each still gets at least COUNTBUFFERSIZE rows */
+#define COUNT_BUFFER_BUDGET (32 * 1024 * 1024)
+
+/* how much finished output may wait for the background writer (bytes) */
+#define OUTPUT_WRITER_QUEUE_BYTES (64 * 1024 * 1024)
+
 /* Symbol types */
 /* Data types for items in MDL parser symbol tables. */
 enum symbol_type_t {
@@ -528,6 +556,8 @@ enum viz_mode_t {
   NO_VIZ_MODE = 0,
   ASCII_MODE = 1,
   CELLBLENDER_MODE = 2,
+  CELLBLENDER_DELTA_MODE = 3,
+  TRAJECTORY_MODE = 4,
 };
 
 /* Visualization Frame Data Type */
@@ -560,6 +590,10 @@ struct graph_data {
   double space_step;
   double time_step;
   int flags;
+  unsigned long pattern_id;           /* never reused by another pattern */
+  int ref_count;
+  struct graph_data *next_interned;   /* pattern with the same hash */
+  struct volume *world;               /* world whose table interned it */
 };
 
 /****
@@ -592,12 +626,31 @@ typedef unsigned long u_long;
 struct per_species_list {
   struct per_species_list *next; /* pointer to next p-s-l */
   struct species *properties;    /* species for items in this bin */
-  struct volume_molecule *head;  /* linked list of mols */
+  struct volume_molecule **mols; /* mols in this bin, in no particular order */
+  int n_mols;                    /* number of mols in this bin */
+  int max_mols;                  /* allocated length of mols */
+
+  /* Spatial index over mols for immobile species, built on demand and
+     rebuilt when the list has changed since */
+  struct species_cell_index *cells;
 
   //JJT: nfsim related fields
   struct graph_data* graph_data;
 };
 
+/* Uniform grid over a subvolume sorting the molecules of one per-species list
+   by cell, so partner searches only visit cells close to a moving molecule */
+struct species_cell_index {
+  struct vector3 llf;            /* corner of the subvolume */
+  struct vector3 inv_cell;       /* reciprocal cell size along each axis */
+  int n_cells[3];                /* cells along each axis */
+  int *cell_start;               /* offset of each cell's first entry in mols */
+  struct volume_molecule **mols; /* the list's mols, grouped by cell */
+  int max_mols;                  /* allocated length of mols */
+  int max_cells;                 /* allocated length of cell_start, less one */
+  int stale;                     /* list has changed since the last build */
+};
+
 /* Properties of one type of molecule or surface */
 struct species {
   u_int species_id;       /* Unique ID for this species */
@@ -620,6 +673,20 @@ struct species {
   long long n_deceased; /* Total number that have been destroyed. */
   double cum_lifetime_seconds;  /* Seconds lived by now-destroyed molecules */
 
+  struct bit_array *rx_partners; /* Bit per species_id that shares at least
+                                    one bimolecular reaction with this
+                                    species, or NULL if not known */
+  struct bit_array *rx_partner_bloom; /* Bloom filter over the partner pairs
+                                         of all species, used instead of
+                                         rx_partners when there are too many
+                                         species for a row each */
+  struct rxn *unimol_rx; /* The unimolecular reaction of this species, if
+                            any; only valid when unimol_rx_known is set */
+  int unimol_rx_known;
+  u_int lifetime_epoch; /* Bumped when a rate constant of a unimolecular
+                           reaction of this diffusing species changes, so
+                           that its molecules recompute their lifetime */
+
   /* if species s a surface_class (IS_SURFACE) below there are linked lists of
    * molecule names/orientations that may be present in special reactions for
    * this surface class */
@@ -649,6 +716,11 @@ struct rxn {
                               than this still do not produce a reaction) */
   double pb_factor; /* Conversion factor from rxn rate to rxn probability (used
                        for cooperativity) */
+  int *pathway_guide;  /* For rxns with many pathways: first pathway whose
+                          cum_probs reaches each of n_pathways equal slices
+                          of [0, cum_probs[n_pathways-1]], or NULL */
+  double guide_scale;  /* n_pathways / cum_probs[n_pathways-1] when the guide
+                          was built; 0 if the guide is not usable */
 
   int *product_idx_aux; /* Number of unique players in each pathway. Used for on-the fly calculation of
                              product_idx indexes */
@@ -661,11 +733,15 @@ struct rxn {
   short **nfsim_geometries;   /* geometries of the nfsim geometries associated with each path */
 
   long long n_occurred; /* How many times has this reaction occurred? */
+  long long n_failed;   /* How many tests of it did not react? */
   double n_skipped;     /* How many reactions were skipped due to probability
                            overflow? */
 
-  struct t_func *
-  prob_t; /* List of probabilities changing over time, by pathway */
+  struct rate_cursor *rate_cursors; /* Time-varying rates, one per pathway
+                                       with a rate file */
+  int n_rate_cursors;               /* Length of rate_cursors */
+  struct rate_cursor *prob_t; /* Cursor with the next change of probability,
+                                 or NULL once all changes are applied */
 
   struct pathway *pathway_head; /* List of pathways built at parse-time */
   struct pathway_info *info;    /* Counts and names for each pathway */
@@ -674,9 +750,6 @@ struct rxn {
   struct external_reaction_datastruct* external_reaction_data; /* Stores reaction results stored from an external program (like nfsim)*/
   struct graph_data** reactant_graph_data; /* stores the graph patterns associated with the reactants for every path */
   struct graph_data*** product_graph_data; /* Stores the graph patterns associated with our products for each path*/
-  double (*get_reactant_diffusion)(struct rxn*, int);  /* returns the diffusion value associated with its reactants*/
-  double (*get_reactant_time_step)(struct rxn*, int);  /* returns the diffusion value associated with its reactants*/
-  double (*get_reactant_space_step)(struct rxn*, int);  /* returns the diffusion value associated with its reactants*/
 };
 
 /* User-defined name of a reaction pathway */
@@ -724,11 +797,24 @@ struct pathway_info {
 };
 
 /* Piecewise constant function for time-varying reaction rates */
-struct t_func {
-  struct t_func *next;
-  double time;  /* Time to switch to next rate */
-  double value; /* Current rate */
+/* Rate constants over time read from one rate file, shared by all pathways
+   using that file or one with identical contents */
+struct rate_table {
+  struct rate_table *next;
+  char *filename;      /* File the table was read from */
+  unsigned long hash;  /* Hash of time and value */
+  int n_entries;       /* Number of rate changes */
+  double *time;        /* Time of each change, in iterations, ascending */
+  double *value;       /* Rate constant from that time on */
+};
+
+/* Position of one reaction pathway in its rate table */
+struct rate_cursor {
+  struct rate_table const *table;
   int path;     /* Which rxn pathway is this for? */
+  int next;     /* Index of the next entry of table to apply */
+  double time;  /* Time of that entry, or FOREVER past the end */
+  double scale; /* Converts rate constants to probabilities */
 };
 
 // Used for dynamic geometry.
@@ -742,34 +828,40 @@ struct molecule_info {
 
 /* periodic_image tracks the periodic box a molecule is in in the presence
  * of periodic boundary conditions along one or several coordinate axes.
- * The central/starting box is at {0,0,0} */
+ * The central/starting box is at {0,0,0}. pad is always zero so that two
+ * images can be compared as a single 64-bit word (see
+ * periodic_images_equal). */
 struct periodic_image {
   int16_t x;
   int16_t y;
   int16_t z;
+  int16_t pad;
 };
 
 
 /* Abstract structure that starts all molecule structures */
 /* Used to make C structs act like C++ objects */
+/* The shared header is ordered by access frequency: the fields read on every
+ * scheduling pass and diffusion step fit in the first 64 bytes, the fields only
+ * needed for reactions, output, checkpointing and NFSim follow.  Keep the
+ * three molecule structs in sync when changing the order. */
 struct abstract_molecule {
+  /* hot: scheduling and diffusion */
   struct abstract_molecule *next; /* Next molecule in scheduling queue */
   double t;                      /* Scheduling time. */
   double t2;                     /* Time of next unimolecular reaction */
-  short flags; /* Abstract Molecule Flags: Who am I, what am I doing, etc. */
   struct species *properties;    /* What type of molecule are we? */
+  struct periodic_image periodic_box;  /* track the periodic box a molecule is in */
+  struct graph_data* graph_data; /* nfsim graph structure data; read with
+                                    the species for time and space steps */
+  short flags; /* Abstract Molecule Flags: Who am I, what am I doing, etc. */
+  u_int lifetime_epoch; /* lifetime_epoch of the species when t2 was last
+                           computed */
+
+  /* cold: reactions, output and bookkeeping */
   struct mem_helper *birthplace; /* What was I allocated from? */
   double birthday;               /* Real time at which this particle was born */
   u_long id;                     /* unique identifier of this molecule */
-  struct periodic_image* periodic_box;  /* track the periodic box a molecule is in */
-
-  /* structs used by the nfsim integration */
-  struct graph_data* graph_data; /* nfsim graph structure data */
-  u_int (*get_flags)(void *); /* returns the reactivity flags associated with this particle */
-  double (*get_diffusion)(void *);        /* returns the diffusion value */
-  double (*get_time_step)(void *);        /* function pointer to a method that returns the time step */
-  double (*get_space_step)(void *);       /* function pointer to a method that returns the space step */
-  /* end structs used by the nfsim integration */
   char *mesh_name;                // Name of mesh that molecule is either in
                                   // (volume molecule) or on (surface molecule)
 };
@@ -779,28 +871,25 @@ struct volume_molecule {
   struct abstract_molecule *next;
   double t;
   double t2;
-  short flags;
   struct species *properties;
+  struct periodic_image periodic_box;  /* track the periodic box a molecule is in */
+  struct graph_data* graph_data;
+  short flags;
+  u_int lifetime_epoch;
+
   struct mem_helper *birthplace;
   double birthday;
   u_long id;
-  struct periodic_image* periodic_box;  /* track the periodic box a molecule is in */
-
-  struct graph_data* graph_data;
-  u_int (*get_flags)(void *); /* returns the reactivity flags associated with this particle */
-  double (*get_diffusion)(void *);        /* returns the diffusion value */
-  double (*get_time_step)(void *);        /* returns the diffusion value */
-  double (*get_space_step)(void *);        /* returns the diffusion value */
-
   char *mesh_name;                // Name of mesh that the molecule is in
-  struct vector3 pos;       /* Position in space */
-  struct subvolume *subvol; /* Partition we are in */
 
   struct wall *previous_wall; /* Wall we were released from */
+  struct vector3 pos;       /* Position in space */
+  struct subvolume *subvol; /* Partition we are in */
   int index;                  /* Index on that wall (don't rebind) */
 
-  struct volume_molecule **prev_v; /* Previous molecule in this subvolume */
-  struct volume_molecule *next_v;  /* Next molecule in this subvolume */
+  struct per_species_list *species_list; /* Per-species list in this
+                                            subvolume we are in */
+  int species_index;                     /* Our index in its mols */
 };
 
 /* Fixed molecule on a grid on a surface */
@@ -808,26 +897,30 @@ struct surface_molecule {
   struct abstract_molecule *next;
   double t;
   double t2;
-  short flags;
   struct species *properties;
+  struct periodic_image periodic_box;  /* track the periodic box a molecule is in */
+  struct graph_data* graph_data;
+  short flags;
+  u_int lifetime_epoch;
+
   struct mem_helper *birthplace;
   double birthday;
   u_long id;
-  struct periodic_image* periodic_box;  /* track the periodic box a molecule is in */
-
-  struct graph_data* graph_data;
-  u_int (*get_flags)(void *); /* returns the reactivity flags associated with this particle */
-  double (*get_diffusion)(void *);        /* returns the diffusion value */
-  double (*get_time_step)(void *);        /* returns the diffusion value */
-  double (*get_space_step)(void *);        /* returns the diffusion value */
-
   char *mesh_name;                // Name of mesh that the molecule is on 
-  unsigned int grid_index;   /* Which gridpoint do we occupy? */
-  short orient;              /* Which way do we point? */
+
   struct surface_grid *grid; /* Our grid (which tells us our surface) */
   struct vector2 s_pos;      /* Where are we in surface coordinates? */
+  unsigned int grid_index;   /* Which gridpoint do we occupy? */
+  short orient;              /* Which way do we point? */
 };
 
+/* Size of a molecule record rounded up to whole cache lines, so that records
+ * carved from line-aligned storage (the slab allocator) never straddle more
+ * lines than they need. */
+#define CACHE_LINE_BYTES 64
+#define CACHE_LINE_ROUND(sz)                                                   \
+  (((sz) + CACHE_LINE_BYTES - 1) & ~(size_t)(CACHE_LINE_BYTES - 1))
+
 struct mol_ss {
   struct sym_entry *sym;
 //  struct sym_table_head *mol_comp_ss_sym_table;
@@ -883,25 +976,34 @@ struct wall {
   double uv_vert1_u;       /* Surface u-coord of 2nd corner (v=0) */
   struct vector2 uv_vert2; /* Surface coords of third corner */
 
-  struct edge *edges[3];    /* Array of pointers to each edge. */
-  struct wall *nb_walls[3]; /* Array of pointers to walls that share an edge*/
+  struct edge *edges[3]; /* Array of pointers to each edge; the walls sharing
+                            them are found with wall_neighbor */
 
   double area; /* Area of this element */
 
   struct vector3 normal; /* Normal vector for this wall */
   struct vector3 unit_u; /* U basis vector for this wall */
   struct vector3 unit_v; /* V basis vector for this wall */
+  struct vector3 origin; /* Copy of *vert[0], where u = v = 0 */
   double d;              /* Distance to origin (point normal form) */
 
   struct surface_grid *grid; /* Grid of effectors for this wall */
 
   u_short flags; /* Count Flags: flags for whether and what we need to count */
+  byte border_edges; /* Which edges border a region of the wall, once looked
+                       up (see is_wall_edge_region_border) */
 
   struct object *parent_object; /* The object we are a part of */
   struct storage *birthplace;   /* Where we live in memory */
 
   struct region_list *counting_regions; /* Counted-on regions containing this
                                            wall */
+  struct region_list *counting_set; /* counting_regions of the first wall of
+                                       the object counted on the same
+                                       regions, or NULL if there are none */
+  struct wall_rx_cache *rx_cache; /* Surface class reactions already looked
+                                     up for molecules hitting this wall, or
+                                     NULL (see trigger_intersect) */
 };
 
 /* Linked list of walls (for subvolumes) */
@@ -946,6 +1048,17 @@ struct surface_grid {
 
   struct subvolume *subvol; /* Best match for which subvolume we're in */
   struct wall *surface;     /* The wall that we are in */
+
+  /* Neighbor tiles looked up so far (see find_neighbor_tiles_cached) */
+  struct tile_neighbor_index *nbr_index;
+
+  /* One bit per tile, clear only for tiles known to be occupied; a set bit
+   * means the tile may be free (see nearest_free) */
+  struct bit_array *vacant;
+
+  /* If set, sm_list is the world's read-only empty_tiles array, and
+   * own_grid_tiles has to be called before a tile is written to */
+  int tiles_shared;
 };
 
 /* 3D vector of integers */
@@ -964,6 +1077,35 @@ struct waypoint {
   antiregions; /* We are outside of (but hit) these regions */
 };
 
+/* Counters bumped on the hot path.  During threaded passes each storage
+ * counts into its own world copy, whose counts are kept with the storage
+ * and only added to the world's by mcell_get_statistics. */
+struct sim_stats {
+  long long diffusion_number; /* Total number of times molecules have had their
+                                 positions updated */
+  double diffusion_cumtime;  /* Total time spent diffusing by all molecules */
+  long long diffusion_fast_steps; /* How many of those updates needed no
+                                     collision checks (see diffuse_3D) */
+  long long ray_voxel_tests; /* How many ray-subvolume intersection tests have
+                                we performed */
+  long long ray_polygon_tests; /* How many ray-polygon intersection tests have
+                                  we performed */
+  long long ray_polygon_colls; /* How many ray-polygon intersections have
+                                  occured */
+  /* below "vol" means volume molecule, "surf" means surface molecule */
+  long long vol_vol_colls;     /* How many vol-vol collisions have occured */
+  long long vol_surf_colls;    /* How many vol-surf collisions have occured */
+  long long surf_surf_colls;   /* How many surf-surf collisions have occured */
+  long long vol_wall_colls;    /* How many vol-wall collisions have occured */
+  long long vol_vol_vol_colls; // How many vol-vol-vol collisions have occured
+  long long
+  vol_vol_surf_colls; /* How many vol-vol-surf collisions have occured */
+  long long vol_surf_surf_colls; /* How many vol-surf-surf collisions have
+                                    occured */
+  long long surf_surf_surf_colls; /* How many surf-surf-surf collisions have
+                                     occured */
+};
+
 /* Contains local memory and scheduler for molecules, walls, wall_lists, etc. */
 struct storage {
   struct mem_helper *list;    /* Wall lists */
@@ -985,8 +1127,42 @@ struct storage {
   int vert_count;         /* How many vertices? */
 
   struct schedule_helper *timer; /* Local scheduler */
-  double current_time;           /* Local time */
+  double current_time;           /* Local time; behind the world's while the
+                                    scheduler is idle (see
+                                    run_active_storages) */
+  int list_index;                /* Position in the world's storage list */
+  int paged_out;                 /* Set once the pools of an idle storage
+                                    were handed back to the system (see
+                                    page_out_idle_storages) */
   double max_timestep;           /* Local maximum timestep */
+
+  /* Only used when running storages on several threads */
+  struct rng_state *rng;           /* Private random number stream */
+  struct mem_helper *handoff_mem;  /* Hand-off queue entries */
+  struct storage_handoff *handoff_head; /* Molecules leaving this storage */
+  struct storage_handoff *handoff_tail;
+  struct counter_shard *count_shard; /* Counter updates from the last pass */
+  struct product_placement_cache *product_placement_cache; /* This storage's
+                                     own, see product_tile_allowed */
+  long long step_cost; /* Diffusion steps and wall tests run since the last
+                          rebalance */
+  double load;         /* Working estimate of step_cost while rebalancing */
+  double cost_per_mol; /* step_cost per molecule, while rebalancing */
+  struct sim_stats stats; /* Counts of this storage's threaded passes */
+  int rank;            /* MPI rank that runs this storage */
+  int home_thread;     /* Pool thread that created and first touched the
+                          storage's memory, see init_partitions */
+  int home_node;       /* NUMA node that thread ran on then, or -1 */
+  struct mol_id_index *mol_id_index; /* The world's, for code without it */
+};
+
+/* A volume molecule that crossed into a subvolume owned by another storage
+ * during a threaded timestep.  The transfer is done serially once all
+ * storages have finished their pass. */
+struct storage_handoff {
+  struct storage_handoff *next;
+  struct volume_molecule *vm; /* Molecule waiting at the boundary */
+  struct subvolume *new_sv;   /* Subvolume it is entering */
 };
 
 /* Linked list of storage areas. */
@@ -995,9 +1171,44 @@ struct storage_list {
   struct storage *store;
 };
 
+/* Maps a coordinate to the coarse partition it lies in without bisecting.
+ * The inner partitions are covered by n_bins equal bins, and first[b] is the
+ * partition the low edge of bin b lies in (see partition_index) */
+struct partition_lookup {
+  double origin;    /* Lowest inner partition boundary */
+  double inv_width; /* Reciprocal of the width of one bin */
+  int n_bins;       /* Number of bins */
+  int *first;       /* First candidate partition for each bin */
+};
+
+/* Bins per coarse partition in a partition_lookup */
+#define PARTITION_LOOKUP_BINS_PER_PART 4
+
 /* Walls and molecules in a spatial subvolume */
+/* Planes of the walls of a subvolume, copied out of the walls (one array per
+ * component) so that a ray can be tested against a batch of walls at a time
+ * without touching the walls themselves */
+struct wall_planes {
+  double *nx, *ny, *nz; /* Wall normals */
+  double *d;            /* Distances of the planes from the origin */
+  struct wall **wall;   /* The walls themselves */
+  int n;                /* Number of walls */
+};
+
+/* Number of walls the plane test looks at in one batch */
+#define WALL_PLANE_BATCH 4
+
+/* Number of partner molecules collide_mol_batch looks at in one batch */
+#define COLLIDE_MOL_BATCH 8
+
+/* Number of displacements pick_displacement_n draws random numbers for at
+ * once */
+#define DISPLACEMENT_BATCH 32
+
 struct subvolume {
   struct wall_list *wall_head; /* Head of linked list of intersecting walls */
+  struct wall_planes wall_planes; /* The same walls, in the same order (see
+                                     build_wall_planes) */
 
   struct pointer_hash mol_by_species; /* table of species->molecule list */
   struct per_species_list *species_head;
@@ -1009,9 +1220,33 @@ struct subvolume {
   short world_edge; /* Direction Bit Flags that are set for SSVs at edge of
                        world */
 
+  double step_multiplier; /* Volume molecules here take at least this many
+                             timesteps per diffusion step (see
+                             assign_step_multipliers) */
+
   struct storage *local_storage; /* Local memory and scheduler */
 };
 
+/* Each combination of Direction Bit Flags, and the number of neighboring
+ * subvolumes reached by all of them together (the product over the axes of
+ * 1, 2, 2 or 3 choices, less the subvolume itself) */
+#define NEIGHBOR_REACH_MASKS 64
+#define NEIGHBOR_REACH_TOTAL 448
+
+/* A neighboring subvolume searched by the expanded collision lists */
+struct neighbor_reach {
+  int offset;          /* From the current subvolume in the subvolume array */
+  signed char dir[3];  /* -1, 0 or 1: the direction taken along each axis */
+};
+
+/* A box of subvolumes given a time step multiplier by the user */
+struct step_multiplier_box {
+  struct step_multiplier_box *next;
+  struct vector3 llf; /* Corners of the box, in microns */
+  struct vector3 urb;
+  double multiplier;
+};
+
 /* Count data specific to named reaction pathways */
 struct rxn_counter_data {
   double n_rxn_at;       /* # rxn occurrance on surface */
@@ -1065,11 +1300,40 @@ struct counter {
                               reference data.move for move counter
                               reference data.rx for rxn counter
                               reference data.trig for trigger */
+  struct counter *next_same; /* Next counter on the same region for the same
+                                species (see region->species_counters) */
+  int shard_slot; /* Index of this counter in counter shards, or -1 */
+};
+
+/* Trigger event recorded by a storage during a threaded pass */
+struct shard_trigger {
+  struct shard_trigger *next;
+  struct counter *c;   /* Trigger counter that fired */
+  double t_event;      /* Event time (exact) */
+  struct vector3 loc;  /* Position of event */
+  u_long id;           /* Id of the molecule involved */
+  int n;               /* Count passed to fire_count_event */
+  byte what;           /* Report type passed to fire_count_event */
+};
+
+/* Counter updates made by one storage during a threaded pass.  They are
+ * added into the shared counters by merge_counter_shard once the pass is
+ * over, storage by storage, so the output does not depend on how the
+ * threads were interleaved. */
+struct counter_shard {
+  struct move_counter_data *move; /* Deltas, indexed by counter->shard_slot */
+  byte *touched;                  /* Nonzero for slots with deltas */
+  int *touched_slots;             /* Slots with deltas, n_touched of them */
+  int n_touched;
+  struct mem_helper *trig_mem;    /* Recorded trigger events */
+  struct shard_trigger *trig_head;
+  struct shard_trigger *trig_tail;
 };
 
 enum magic_types {
   magic_undefined,
-  magic_release
+  magic_release,
+  magic_trace /* data holds the trace id of the pathway */
 };
 
 struct magic_list {
@@ -1078,6 +1342,13 @@ struct magic_list {
   enum magic_types type;
 };
 
+/* One traced occurrence of a named reaction pathway */
+struct rxn_event {
+  double t;            /* Time of the reaction (seconds once drained) */
+  struct vector3 pos;  /* Location of the reaction (microns once drained) */
+  int rxn_id;          /* Trace id returned when the pathway was traced */
+};
+
 struct reaction_flags {
   /* flags that tells whether reactions of certain types are present in the
      simulation (used for the molecule collision report, also see above
@@ -1116,18 +1387,30 @@ struct volume {
   double *x_partitions; /* Coarse X partition boundaries */
   double *y_partitions; /* Coarse Y partition boundaries */
   double *z_partitions; /* Coarse Z partition boundaries */
+  struct partition_lookup x_lookup; /* Finds coarse X partitions quickly */
+  struct partition_lookup y_lookup; /* Finds coarse Y partitions quickly */
+  struct partition_lookup z_lookup; /* Finds coarse Z partitions quickly */
+
+  /* All-NULL tile array shared by the surface grids that have been emptied
+   * (see release_empty_grid_tiles) */
+  struct surface_molecule_list **empty_tiles;
+  u_int n_empty_tiles; /* Number of entries in empty_tiles */
   int mem_part_x; /* Granularity of memory-partition binning for the X-axis */
   int mem_part_y; /* Granularity of memory-partition binning for the Y-axis */
   int mem_part_z; /* Granularity of memory-partition binning for the Z-axis */
   int mem_part_pool; /* Scaling factor for sizes of memory pools in each
                         storage. */
+  byte mem_part_auto; /* Pick mem_part_x/y/z from estimated occupancy */
 
-  /* Fine partitions are intended to allow subdivision of coarse partitions */
-  /* Subdivision is not yet implemented */
+  /* Fine partitions are the positions coarse partitions may be put at; when
+   * adaptive_partitions is set, crowded coarse partitions are subdivided
+   * along them (see refine_partitions) */
   int n_fineparts;     /* Number of fine partition boundaries */
   double *x_fineparts; /* Fine X partition boundaries */
   double *y_fineparts; /* Fine Y partition boundaries */
   double *z_fineparts; /* Fine Z partition boundaries */
+  int adaptive_partitions; /* Subdivide partitions crowded with walls or
+                              released molecules */
 
   bool periodic_traditional;
 
@@ -1135,25 +1418,46 @@ struct volume {
   struct waypoint *waypoints; /* Waypoints contain fully-closed region
                                  information */
   byte place_waypoints_flag; /* Used to save memory if waypoints not needed */
+  int geometry_serial; /* Bumped each time dynamic geometry rebuilds the
+                          subvolumes, walls and waypoints */
 
   int n_subvols;            /* How many coarse subvolumes? */
   struct subvolume *subvol; /* Array containing all subvolumes */
+  /* Neighbors to search when a molecule's path comes near the sides of its
+   * subvolume given by a mask of Direction Bit Flags: neighbor_reach[i] for
+   * neighbor_reach_start[mask] <= i < neighbor_reach_start[mask + 1] (see
+   * init_neighbor_reach) */
+  int neighbor_reach_start[NEIGHBOR_REACH_MASKS + 1];
+  struct neighbor_reach neighbor_reach[NEIGHBOR_REACH_TOTAL];
 
   int n_walls;                  /* Total number of walls */
   int n_verts;                  /* Total number of vertices */
   struct vector3 *all_vertices; /* Central repository of vertices with a
                                    partial order imposed by natural ordering
                                    of "storages" */
-  /* Array of linked lists of walls using a vertex (has the size of
-   * "all_vertices" array */
-  struct wall_list **walls_using_vertex;
+  /* Walls using each vertex of "all_vertices", in compressed sparse row
+   * form: the walls using vertex i are vertex_walls[vertex_wall_offsets[i]]
+   * up to vertex_walls[vertex_wall_offsets[i + 1]] (see
+   * build_vertex_wall_adjacency).  NULL unless create_shared_walls_info_flag
+   * is set. */
+  int *vertex_wall_offsets;
+  struct wall **vertex_walls;
   int rx_hashsize;            /* How many slots in our reaction hash table? */
   int n_reactions;            /* How many reactions are there, total? */
   struct rxn **reaction_hash; /* A hash table of all reactions. */
-  struct mem_helper *tv_rxn_mem; /* Memory to store time-varying reactions */
+  /* Where surface products may go, by reaction pathway and walls (see
+   * product_tile_allowed) */
+  struct product_placement_cache *product_placement_cache;
+  struct rate_table *rate_tables; /* Time-varying rate constants, by file */
+  struct mol_id_index *mol_id_index; /* Live molecules by id, NULL unless
+                                        mcell_enable_molecule_index was called */
 
   int count_hashmask;          /* Mask for looking up count hash table */
   struct counter **count_hash; /* Count hash table */
+  int n_counter_slots;           /* Molecule counters with a shard_slot */
+  struct counter **counter_slots; /* Those counters, by shard_slot */
+  struct counter_shard *count_shard; /* Where counter updates go on the
+                                        per-thread copies; NULL otherwise */
   struct schedule_helper *count_scheduler; // When to generate reaction output
   struct sym_table_head *counter_by_name;
 
@@ -1166,6 +1470,15 @@ struct volume {
   int n_NFSimSpecies; /* number of graph patterns encountered during the NFSim simulation */
   int n_NFSimReactions; /* number of reaction rules discovered through an NFSim simulation */
   int n_NFSimPReactions; /* number of potential reactions found in the reaction network (not necessarely triggered) */
+  size_t nfsim_cache_bytes; /* memory the cached NFSim reactions may hold, 0 if unbounded */
+  struct graph_intern_table *graph_patterns; /* interned NFSim graph patterns */
+  struct nfsim_reaction_state *nfsim_reactions; /* NFSim reaction caches
+                                                   and pending queries */
+  struct sym_table_head *viz_graph_patterns; /* NFSim viz data per pattern */
+  long viz_next_molcomp_id;  /* next id for the viz data of a pattern */
+  struct sym_table_head *viz_mol_names; /* NFSim viz glyph names */
+  long viz_mol_frame;        /* frame that the glyph lists belong to */
+  struct rxn_trace *rxn_trace; /* buffered events of traced reactions */
 
   struct species **species_list; /* Array of all species (molecules). */
  
@@ -1182,7 +1495,20 @@ struct volume {
 
   // Scheduler for dynamic geometry
   struct schedule_helper *dynamic_geometry_scheduler;
+
+  // If set, a dynamic geometry file that was parsed before is applied by
+  // moving the vertices of the meshes, when they have the same topology as
+  // then (see apply_cached_geometry)
+  int dynamic_geometry_cache_flag;
+  struct dg_cached_frame *dynamic_geometry_cache;
+
+  // Every dynamic geometry event in time order, and the background thread
+  // loading the frame of the next one (see start_geometry_prefetch)
+  struct dg_time_filename **dynamic_geometry_events;
+  int n_dynamic_geometry_events;
+  struct dg_frame_loader *dynamic_geometry_loader;
   struct schedule_helper *releaser; /* Scheduler for release events */
+  struct triggered_release_queue *triggered_releases; /* Not placed yet */
 
   struct mem_helper *storage_allocator; /* Memory for storage list */
   struct storage_list *storage_head;    /* Linked list of all local
@@ -1238,6 +1564,19 @@ struct volume {
   double time_unit; /* Duration of one global time step in real time */
                     /* Used to convert between real time and internal time */
   double time_step_max; /* Maximum internal time that a molecule may diffuse */
+  int adaptive_time_step; /* If set, long steps look for walls and partners
+                             past the molecule's own subvolume (see
+                             adaptive_diffusion_step) */
+  double auto_step_multiplier; /* Largest time step multiplier given to
+                                  subvolumes far from any wall; 1 for none */
+  struct step_multiplier_box *step_multiplier_boxes; /* User-set multipliers,
+                                                        later boxes win */
+  long long equilibration_iterations; /* Iterations run as a coarse
+                                         equilibration phase, without
+                                         output (see mcell_set_equilibration) */
+  double equilibration_multiplier; /* Time step multiplier of volume
+                                      molecules during that phase */
+  int equilibrating; /* Set while the current iteration belongs to it */
 
   double
   grid_density; /* Density of grid for surface molecules, number per um^2 */
@@ -1253,6 +1592,7 @@ struct volume {
   double *r_step;         /* Lookup table of 3D diffusion step lengths */
   double *d_step;         /* Lookup table of 3D diffusion direction vectors */
   double *r_step_surface; /* Lookup table of 2D diffusion step lengths */
+  double *r_step_surface_erfc; /* erfc of each entry of r_step_surface */
   double *r_step_release; /* Lookup table of diffusion lengths for 3D release */
   u_int radial_subdivisions; /* Size of 2D and 3D step length lookup tables */
   u_int radial_directions;   /* Requested size of 3D direction lookup table */
@@ -1271,6 +1611,14 @@ struct volume {
   chkpt_flag; /* Set if there are any CHECKPOINT statements in "mdl" file */
   u_int chkpt_seq_num; /* Number of current run in checkpoint sequence */
   int keep_chkpts;     /* flag to indicate if checkpoints should be kept */
+  int background_chkpts; /* flag to write continuing checkpoints from a
+                            forked snapshot */
+  pid_t chkpt_child_pid; /* process writing a background checkpoint, or 0 */
+  int chkpt_fixed_width; /* flag to write molecules as fixed-width records */
+  int chkpt_differential; /* differential checkpoints written between full
+                             ones, or 0 */
+  struct chkpt_base *chkpt_base; /* last full checkpoint, for differential
+                                    checkpoints */
 
   char *chkpt_infile;              /* Name of checkpoint file to read from */
   char *chkpt_outfile;             /* Name of checkpoint file to write to */
@@ -1285,29 +1633,12 @@ struct volume {
   /* simulation start time (in seconds) or time of most recent checkpoint */
   double simulation_start_seconds; 
 
-  long long diffusion_number; /* Total number of times molecules have had their
-                                 positions updated */
-  double diffusion_cumtime;  /* Total time spent diffusing by all molecules */
-  long long ray_voxel_tests; /* How many ray-subvolume intersection tests have
-                                we performed */
-  long long ray_polygon_tests; /* How many ray-polygon intersection tests have
-                                  we performed */
-  long long ray_polygon_colls; /* How many ray-polygon intersections have
-                                  occured */
+  struct sim_stats stats; /* Diffusion and collision counters */
   long long dyngeom_molec_displacements; /* Total number of dynamic geometry
                                             molecule displacements */
-  /* below "vol" means volume molecule, "surf" means surface molecule */
-  long long vol_vol_colls;     /* How many vol-vol collisions have occured */
-  long long vol_surf_colls;    /* How many vol-surf collisions have occured */
-  long long surf_surf_colls;   /* How many surf-surf collisions have occured */
-  long long vol_wall_colls;    /* How many vol-wall collisions have occured */
-  long long vol_vol_vol_colls; // How many vol-vol-vol collisions have occured
-  long long
-  vol_vol_surf_colls; /* How many vol-vol-surf collisions have occured */
-  long long vol_surf_surf_colls; /* How many vol-surf-surf collisions have
-                                    occured */
-  long long surf_surf_surf_colls; /* How many surf-surf-surf collisions have
-                                     occured */
+  long long clamp_mols_emitted; /* Molecules emitted by concentration clamps */
+  long long clamp_side_steps;   /* Walls stepped over while picking where
+                                   clamped molecules are emitted */
 
   struct vector3 bb_llf; /* llf corner of world bounding box */
   struct vector3 bb_urb; /* urb corner of world bounding box */
@@ -1324,6 +1655,54 @@ struct volume {
   long long last_timing_iteration; /* during the main run_iteration loop */
 
   int procnum;          /* Processor number for a parallel run */
+  int n_procs;          /* Number of MPI ranks sharing the storages */
+  int n_seeds;          /* Consecutive seeds run from one initialization by
+                           -seeds (0 or 1 for a single run) */
+  int num_threads;      /* Worker threads used to run storages (1 = serial) */
+  int rebalance_interval; /* Iterations between moving subvolumes from busy
+                             to idle storages (0 = never) */
+  int sort_interval;    /* Iterations between sorting the volume molecules of
+                           each storage in memory (0 = never) */
+  int sort_slots;       /* Process the molecules of each scheduler slot in
+                           subvolume order */
+  int threaded_pass;    /* Set on the per-thread copies of the world while
+                           storages are being run concurrently */
+  int threaded_storages; /* 1 if storages run on the thread pool, -1 if
+                            they can't, 0 until the run loop decides */
+  struct schedule_group *storage_group; /* Schedulers of the storages of a
+                                          serial run, which stop advancing
+                                          while empty */
+  struct storage **active_storages; /* Storages whose schedulers are not
+                                       idle, in storage list order */
+  int n_active_storages;
+  int page_idle_storages; /* Page out the pools of storages idle for this
+                             many iterations of a serial run; 0 for never */
+  char *page_dir;         /* Directory of the page file, or NULL for the
+                             default (see init_data_structures) */
+  struct thread_pool *thread_pool; /* Workers shared by all parallel phases,
+                                      see world_thread_pool */
+  struct output_writer *output_writer; /* Writes reaction and viz output in
+                                          the background; NULL to write
+                                          directly */
+  int emergency_output_hook_enabled; /* Flush reaction output if the program
+                                        dies; cleared on a clean exit */
+  int use_huge_pages;   /* Back large pools and arrays with huge pages */
+  int shortest_floats;  /* Write the doubles of text outputs with the fewest
+                           digits that read back exactly */
+  int output_journal;   /* Keep count buffers in memory-mapped journal files
+                           that outlive the process (see output_journal.c) */
+  char *metrics_file;   /* Metrics snapshot rewritten during the run by
+                           -metrics_file (NULL for none) */
+  double metrics_interval; /* Seconds between metrics snapshots */
+  struct timeval metrics_start_time; /* Time and iteration of the first */
+  long long metrics_start_iteration;  /* snapshot */
+  struct timeval last_metrics_time;  /* time and iteration of the last */
+  long long last_metrics_iteration;  /* snapshot */
+  struct timeval last_checkpoint_time; /* Wall time of the last checkpoint */
+  char *bench_json_file; /* Benchmark record written at the end of the run by
+                           -bench_json (NULL for none) */
+  struct timeval run_start_time; /* Wall time and iteration at the start of */
+  long long run_start_iteration; /* mcell_run_simulation */
   int quiet_flag;       /* Quiet mode */
   int with_checks_flag; /* Check geometry for overlapped walls? */
 
@@ -1338,6 +1717,11 @@ struct volume {
 
   int use_expanded_list; /* If set, check neighboring subvolumes for mol-mol
                             interactions */
+  /* Copy of diffuse_3D specialized for the features this run uses (see
+   * select_diffuse_3D_variant) */
+  struct volume_molecule *(*diffuse_3D_variant)(struct volume *world,
+                                                struct volume_molecule *vm,
+                                                double max_time);
   int randomize_smol_pos; /* If set, always place surface molecule at random
                              location instead of center of grid */
   double vacancy_search_dist2; /* Square of distance to search for free grid
@@ -1480,6 +1864,22 @@ struct release_event_queue {
   double train_high_time; /* time of the train's start */
 };
 
+/* A release triggered by a reaction which has not been placed yet.  The
+ * firings of a pass over the storages are placed together, grouped by
+ * release site (see flush_triggered_releases). */
+struct triggered_release {
+  struct release_site_obj *release_site;
+  double event_time;     /* Time of the reaction */
+  double t_matrix[4][4]; /* Places the site at the reaction */
+  int order;             /* Position in the queue */
+};
+
+struct triggered_release_queue {
+  struct triggered_release *events;
+  int n;
+  int max;
+};
+
 /* Release site information  */
 struct release_site_obj {
   struct vector3 *location;   /* location of release site */
@@ -1502,6 +1902,8 @@ struct release_site_obj {
   region_data; /* Information related to release on regions */
   struct release_single_molecule *
   mol_list; /* Information related to release by list */
+  struct release_list_file *mol_file; /* Positions of a list release kept
+                                        in a binary file, or NULL */
 
   double release_prob; /* Probability of releasing at scheduled time */
   struct periodic_image *periodic_box;
@@ -1533,6 +1935,9 @@ struct release_region_data {
   double *cum_area_list; /* Cumulative area of all walls */
   int *wall_index;       /* Indices of each wall (by object) */
   int *obj_index;        /* Indices for objects (in owners array) */
+  double *alias_prob;    /* Walker alias table over the included walls, */
+  int *alias_index;      /* weighted by area: keep wall k with probability
+                            alias_prob[k], else take alias_index[k] */
 
   int n_objects;                 /* How many objects are there total */
   struct object **owners;        /* Array of pointers to each object */
@@ -1544,6 +1949,21 @@ struct release_region_data {
   struct release_evaluator *expression; /* A set-construction expression
                                            combining regions to form this
                                            release site */
+
+  /* Per subvolume: 1 if the whole subvolume is inside the release, 0 if it
+     is all outside, -1 if it holds walls so each point must be tested, or
+     -2 if not yet known.  Rebuilt when sv_serial no longer matches the
+     world's geometry_serial. */
+  signed char *sv_inside;
+  int sv_serial;
+
+  /* The subvolumes meeting the bounding box which are not all outside the
+     release, with the running total of the volume they share with the box.
+     Built with sv_inside; n_release_svs is -1 until then. */
+  int n_release_svs;
+  int *release_svs;
+  double *release_sv_volume;
+  int release_svs_serial;
 };
 
 /* Data structure used to build boolean combinations of regions */
@@ -1562,6 +1982,35 @@ struct release_single_molecule {
   short orient;             /* Orientation (for 2D species) */
 };
 
+/* Binary file of molecule positions for a LIST release, named by
+ * MOLECULE_POSITIONS = "file".  In native byte order:
+ *
+ *   "MCRL" u32 0x01020304 u32 version u32 n_species, then per species a
+ *   u32 name length and the name bytes (no terminator), then u64 n_mols
+ *   and n_mols struct release_list_record.
+ *
+ * The records have a fixed size, so the file can also be written by
+ * mapping it. */
+#define RELEASE_LIST_MAGIC "MCRL"
+#define RELEASE_LIST_VERSION 1
+
+struct release_list_record {
+  double pos[3];    /* Position in microns, relative to the LOCATION */
+  uint32_t species; /* Index of the species among the file's names */
+  int32_t orient;   /* >0 up, <0 down, 0 random; unused for volume
+                       molecules */
+};
+
+/* A release list file, checked when the MDL is parsed and read each time
+ * the site releases */
+struct release_list_file {
+  char *path;
+  int n_species;
+  struct species **species; /* Species of each index in the file */
+  long long n_mols;
+  long data_offset;         /* Where the records start */
+};
+
 /* Holds information about a box with rectangular patches on it. */
 struct subdivided_box {
   int nx;    /* number of subdivisions including box corners in X-direction */
@@ -1594,6 +2043,7 @@ struct notifications {
   enum notify_level_t volume_output_report;   /* VOLUME_OUTPUT_REPORT */
   enum notify_level_t viz_output_report;      /* VIZ_OUTPUT_REPORT */
   enum notify_level_t molecule_collision_report; /* MOLECULE_COLLISION_REPORT */
+  enum notify_level_t memory_usage_report;    /* MEMORY_USAGE_REPORT */
 
   /* Warning stuff, possible values IGNORED, WARNING, ERROR */
   /* see corresponding keywords */
@@ -1630,6 +2080,8 @@ struct ccn_clamp_data {
   int n_sides;                /* How many walls? */
   int *side_idx;              /* Indices of the walls that are clamped */
   double *cum_area;           /* Cumulative area of all the clamped walls */
+  int *side_guide; /* side_guide[j] is the first wall whose cumulative area
+                      exceeds j/n_sides of the total */
   double scaling_factor;      /* Used to predict #mols/timestep */
   struct ccn_clamp_data *next_mol; /* Next clamp, by molecule, for this class */
   struct ccn_clamp_data *next_obj; /* Next clamp, by object, for this class */
@@ -1660,6 +2112,10 @@ struct volume_output_item {
   int num_times;
   double *times;     /* in numeric order  */
   double *next_time; /* points into times */
+
+  /* how? */
+  int binary_flag; /* Write only non-empty voxels, in binary (see
+                      produce_sparse_mol_counts) */
 };
 
 /* Data for a single REACTION_DATA_OUTPUT block */
@@ -1678,11 +2134,47 @@ struct output_block {
   u_int buffersize;   /* Size of output buffer */
   u_int trig_bufsize; /* Size of output buffer for triggers */
   u_int buf_index;    /* Index into buffer (for non-triggers) */
+  u_int rows_needed;  /* Most rows output before the run or the next
+                         checkpoint ends */
+  int auto_buffersize; /* No buffer size was requested, so the count
+                          buffers are sized by size_output_buffers */
 
   double *time_array; /* Array of output times (for non-triggers) */
 
   /* Linked list of data sets (separate files) */
   struct output_set *data_set_head;
+
+  /* Column expressions compiled into one program, or NULL to evaluate
+   * each column's tree (see compile_output_block) */
+  struct oexpr_program *program;
+
+  /* Memory-mapped file holding the count buffers, or NULL if they are kept
+   * in memory (see output_journal.c) */
+  struct output_journal *journal;
+};
+
+/* One step of a compiled output program: slot 'dst' gets either the value
+ * loaded from 'src' (oper == 0) or 'oper' applied to slots 'left' and
+ * 'right', with the same meaning as in struct output_expression */
+struct oexpr_op {
+  char oper;
+  int src_type; /* OEXPR_LEFT_INT or OEXPR_LEFT_DBL, for loads */
+  void *src;
+  int left;
+  int right;
+  int dst;
+};
+
+/* All non-trigger column expressions of an output block flattened into one
+ * list of steps, sharing leaves and subexpressions between columns */
+struct oexpr_program {
+  int n_ops;
+  struct oexpr_op *ops;
+  int n_slots;
+  double *slots; /* Slot 0 always holds 0.0 */
+  int n_roots;
+  struct output_expression **roots; /* Column expressions, in output order */
+  int *root_slots;                  /* Slot holding each root's value */
 };
 
 /* Data that controls what output is written to a single file */
@@ -1693,9 +2185,17 @@ struct output_set {
   enum overwrite_policy_t file_flags; /* Overwrite Policy Flags: tells us how to
                                        * handle existing files */
   u_int chunk_count;    /* Number of buffered output chunks processed */
+  int index_flag;        /* Nonzero to keep a restart index for the file,
+                            which FILE_SUBSTITUTE asks for */
+  long long file_offset; /* Size of the file once the chunks so far are
+                            written; kept for the restart index */
   const char *header_comment; /* Comment character(s) for header */
   int exact_time_flag;  /* Boolean value; nonzero means print exact time in
                            TRIGGER statements */
+  int binary_flag;      /* Boolean value; nonzero means write COUNT data in
+                           the binary format instead of text */
+  int journal_set;      /* Position of the set in its block's output journal,
+                           or -1 if it has none */
   struct output_column *column_head; /* Data for one output column */
 };
 
@@ -1769,7 +2269,7 @@ struct output_trigger_data {
 /* A polygon list object, part of a surface. */
 struct polygon_object {
   int n_verts;                         /* Number of vertices in polyhedron */
-  struct vertex_list *parsed_vertices; /* Temporary linked list */
+  struct vector3 *parsed_vertices; /* Temporary array of n_verts vertices */
   int n_walls;                         /* Number of triangles in polyhedron */
   struct element_data *element;        /* Array specifying the vertex
                                           connectivity of each triangle */
@@ -1866,6 +2366,9 @@ struct region {
   int region_has_all_elements; /* flag that tells whether the region contains
                                   ALL_ELEMENTS (effectively comprises the whole
                                   object) */
+  struct counter **species_counters; /* Indexed by species_id: first molecule
+                                        counter on this region, chained through
+                                        next_same; NULL if not indexed */
 };
 
 /* A list of surface molecules */
@@ -1903,6 +2406,11 @@ struct object {
   u_int n_tiles;          /* Number of surface grid tiles on object */
   u_int n_occupied_tiles; /* Number of occupied tiles on object */
   double t_matrix[4][4];  /* Transformation matrix for object */
+  struct vector3 *world_verts;      /* Parsed vertices in world coordinates
+                                       while the object is instantiated */
+  double world_verts_matrix[4][4];  /* Transformation they were made with */
+  struct vector3 world_llf;         /* Bounding box of world_verts */
+  struct vector3 world_urb;
   short is_closed;              /* Flag that describes the geometry
                                    of the polygon object (e.g. for sphere
                                    is_closed = 1 and for plane is 0) */
@@ -1965,10 +2473,80 @@ struct viz_output_block {
 
   int default_mol_state; // Only set if (viz_output_flag & VIZ_ALL_MOLECULES)
 
+  /* Molecules sorted by species, kept from frame to frame so that the arrays
+   * are only reallocated when a population outgrows them */
+  int viz_n_species;
+  struct abstract_molecule ***viz_molp;
+  u_int *viz_mol_count;
+  u_int *viz_mol_capacity;
+
+  /* CELLBLENDER_DELTA mode: molecules written in the last frame, by species */
+  struct viz_delta_species *delta_species;
+  long long delta_iteration; /* Iteration of the last frame written */
+  int delta_frames;          /* Frames written since the last key frame */
+
+  /* TRAJECTORY mode: which molecules of the listed species are followed.
+   * With neither ids nor a sample fraction, all of them are. */
+  u_long *traj_ids;                 /* Ids to follow, in increasing order */
+  int traj_n_ids;
+  double traj_sample_fraction;      /* Fraction of the molecules to follow */
+  struct region *traj_birth_region; /* Only follow molecules first seen in
+                                       it, or NULL */
+
+  /* TRAJECTORY mode: the molecules of the last frame, sorted by id */
+  struct viz_track *tracks;
+  u_int n_tracks;
+  u_int track_capacity;
+  struct viz_track *spare_tracks;   /* Where the next frame is built */
+  u_int spare_track_capacity;
+  struct abstract_molecule **traj_mols; /* This frame's molecules */
+  u_int traj_mol_capacity;
+  long long traj_iteration;         /* Iteration of the last frame written */
+  int traj_started;                 /* Set once the stream header is out */
+
+  /* Container output: all frames are appended to one file, with a sidecar
+   * index of the iteration, offset and length of each frame */
+  int container;                 /* Set to write a container */
+  int container_started;         /* Set once the container has been opened */
+  long long container_bytes;     /* Length of the container so far */
+  long container_frame_start;    /* Stream position of the frame being
+                                    written */
+
   /* Parse-time only: Tables to hold temporary information. */
   struct pointer_hash parser_species_viz_states;
 };
 
+/* Quantized coordinates of one molecule in a CELLBLENDER_DELTA frame */
+struct viz_delta_mol {
+  u_long id;
+  long long q[6]; /* x,y,z position, then i,j,k orientation for surface mols */
+};
+
+/* Molecules of one species in a CELLBLENDER_DELTA frame, sorted by id */
+struct viz_delta_species {
+  u_int n_mols;
+  u_int capacity;
+  struct viz_delta_mol *mols;
+  u_int spare_capacity;
+  struct viz_delta_mol *spare; /* Where the next frame is built */
+};
+
+/* One sample of a molecule in a TRAJECTORY stream */
+struct viz_track_sample {
+  long long iteration;
+  long long q[3]; /* Quantized x,y,z position */
+};
+
+/* A molecule seen by a TRAJECTORY block, with the samples not yet written */
+struct viz_track {
+  u_long id;
+  struct species *properties; /* Species of the buffered samples */
+  int followed;  /* 0 if the molecule was not born in the birth region */
+  int n_blocks;  /* Blocks of the track written so far */
+  u_int n_samples;
+  struct viz_track_sample *samples; /* VIZ_TRACK_BLOCK of them, or NULL */
+};
+
 /* Geometric transformation data for a physical object */
 struct transformation {
   struct vector3 translate; /* X,Y,Z translation vector */
@@ -2020,6 +2598,7 @@ struct sym_entry {
   char *name;             /* Name of symbol*/
   void *value;            /* Stored value, cast by sym_type */
   int count;
+  unsigned long hashval;  /* hash() of name, so it's never recomputed */
 };
 
 /* Linked list of symbols */
@@ -2066,5 +2645,3 @@ struct object_list {
   struct object *obj_tail;
 };
 
-double rxn_get_nfsim_diffusion(struct rxn*, int);
-double rxn_get_standard_diffusion(struct rxn*, int);
@@ -150,3 +150,21 @@ struct num_expr_list {
   struct num_expr_list *next;
   double value; /* Value of one element of the expression */
 };
+
+/* Diffusion and collision counts, see mcell_get_statistics */
+struct sim_stats {
+  long long diffusion_number;
+  double diffusion_cumtime;
+  long long diffusion_fast_steps;
+  long long ray_voxel_tests;
+  long long ray_polygon_tests;
+  long long ray_polygon_colls;
+  long long vol_vol_colls;
+  long long vol_surf_colls;
+  long long surf_surf_colls;
+  long long vol_wall_colls;
+  long long vol_vol_vol_colls;
+  long long vol_vol_surf_colls;
+  long long vol_surf_surf_colls;
+  long long surf_surf_surf_colls;
+};
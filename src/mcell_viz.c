@@ -92,6 +92,70 @@ mcell_create_viz_output(MCELL_STATE *state, const char *filename,
   return MCELL_SUCCESS;
 }
 
+/*************************************************************************
+ mcell_create_trajectory_output:
+    Create a TRAJECTORY viz output, which follows a few molecules densely in
+    time rather than writing frames of all of them.
+
+ In:  state: MCell state
+      filename: the path and filename prefix of the stream
+      mol_viz_list: the species whose molecules may be followed
+      start, end, step: the iterations to sample
+      sample_fraction: fraction of the molecules to follow, or 0 to follow
+                       only those added with mcell_track_molecule_id (or, if
+                       there are none, all of them)
+ Out: Returns 1 on error and 0 on success
+*************************************************************************/
+MCELL_STATUS
+mcell_create_trajectory_output(MCELL_STATE *state, const char *filename,
+                               struct mcell_species *mol_viz_list,
+                               long long start, long long end, long long step,
+                               double sample_fraction) {
+  if (sample_fraction < 0.0 || sample_fraction > 1.0)
+    return MCELL_FAIL;
+  if (mcell_create_viz_output(state, filename, mol_viz_list, start, end, step))
+    return MCELL_FAIL;
+
+  state->viz_blocks->viz_mode = TRAJECTORY_MODE;
+  state->viz_blocks->traj_sample_fraction = sample_fraction;
+  return MCELL_SUCCESS;
+}
+
+/*************************************************************************
+ mcell_track_molecule_id:
+    Follow a molecule in the TRAJECTORY output created last.  Ids have to
+    be added before the simulation is initialized.
+
+ In:  state: MCell state
+      id: the molecule's id
+ Out: Returns 1 on error and 0 on success
+*************************************************************************/
+MCELL_STATUS
+mcell_track_molecule_id(MCELL_STATE *state, u_long id) {
+  struct viz_output_block *vizblk = state->viz_blocks;
+  if (vizblk == NULL || vizblk->viz_mode != TRAJECTORY_MODE)
+    return MCELL_FAIL;
+
+  /* Ids are kept sorted and without repeats */
+  int pos = 0;
+  while (pos < vizblk->traj_n_ids && vizblk->traj_ids[pos] < id)
+    ++pos;
+  if (pos < vizblk->traj_n_ids && vizblk->traj_ids[pos] == id)
+    return MCELL_SUCCESS;
+
+  u_long *ids = (u_long *)realloc(vizblk->traj_ids,
+                                  (vizblk->traj_n_ids + 1) * sizeof(u_long));
+
+  if (ids == NULL)
+    return MCELL_FAIL;
+  memmove(ids + pos + 1, ids + pos,
+          (vizblk->traj_n_ids - pos) * sizeof(u_long));
+  ids[pos] = id;
+  vizblk->traj_ids = ids;
+  vizblk->traj_n_ids++;
+  return MCELL_SUCCESS;
+}
+
 /**************************************************************************
  mcell_new_viz_output_block:
     Build a new VIZ output block, containing parameters for an output set for
@@ -103,6 +167,30 @@ void mcell_new_viz_output_block(struct viz_output_block *vizblk) {
   vizblk->file_prefix_name = NULL;
   vizblk->viz_output_flag = 0;
   vizblk->species_viz_states = NULL;
+  vizblk->viz_n_species = 0;
+  vizblk->viz_molp = NULL;
+  vizblk->viz_mol_count = NULL;
+  vizblk->viz_mol_capacity = NULL;
+  vizblk->delta_species = NULL;
+  vizblk->delta_iteration = -1;
+  vizblk->delta_frames = 0;
+  vizblk->traj_ids = NULL;
+  vizblk->traj_n_ids = 0;
+  vizblk->traj_sample_fraction = 0.0;
+  vizblk->traj_birth_region = NULL;
+  vizblk->tracks = NULL;
+  vizblk->n_tracks = 0;
+  vizblk->track_capacity = 0;
+  vizblk->spare_tracks = NULL;
+  vizblk->spare_track_capacity = 0;
+  vizblk->traj_mols = NULL;
+  vizblk->traj_mol_capacity = 0;
+  vizblk->traj_iteration = -1;
+  vizblk->traj_started = 0;
+  vizblk->container = 0;
+  vizblk->container_started = 0;
+  vizblk->container_bytes = 0;
+  vizblk->container_frame_start = 0;
 
   if (pointer_hash_init(&vizblk->parser_species_viz_states, 32))
     mcell_allocfailed("Failed to initialize viz species states table.");
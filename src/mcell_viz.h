@@ -28,6 +28,15 @@ MCELL_STATUS mcell_create_viz_output(MCELL_STATE *state, const char *filename,
                                      long long start, long long end,
                                      long long step);
 
+MCELL_STATUS mcell_create_trajectory_output(MCELL_STATE *state,
+                                            const char *filename,
+                                            struct mcell_species *mol_viz_list,
+                                            long long start, long long end,
+                                            long long step,
+                                            double sample_fraction);
+
+MCELL_STATUS mcell_track_molecule_id(MCELL_STATE *state, u_long id);
+
 void mcell_new_viz_output_block(struct viz_output_block *vizblk);
 
 struct frame_data_list *
@@ -102,8 +102,8 @@ struct region *reg;
 struct diffusion_constant diff_const;
 
 /* Geometry */
-struct vertex_list_head vertlist;
-struct vertex_list *vertlistitem;
+struct vertex_array vertlist;
+struct element_array elemarr;
 struct element_connection_list_head ecl;
 struct element_connection_list *elem_conn;
 struct object *obj;
@@ -148,6 +148,8 @@ struct arg_list printfargs;
 %token       ABS
 %token       ABSORPTIVE
 %token       ACCURATE_3D_REACTIONS
+%token       ADAPTIVE_PARTITIONS
+%token       ADAPTIVE_TIME_STEP
 %token       ACOS
 %token       ALL_CROSSINGS
 %token       ALL_DATA
@@ -166,14 +168,21 @@ struct arg_list printfargs;
 %token       BACK
 %token       BACK_CROSSINGS
 %token       BACK_HITS
+%token       BINARY_MESH
+%token       BINARY_OUTPUT
+%token       BIRTH_REGION
 %token       BOTTOM
 %token       BOX
 %token       BOX_TRIANGULATION_REPORT
 %token       BRIEF
 %token       CEIL
 %token       CELLBLENDER
+%token       CELLBLENDER_DELTA
 %token       CENTER_MOLECULES_ON_GRID
+%token       CHECKPOINT_DIFFERENTIAL
+%token       CHECKPOINT_FIXED_WIDTH
 %token       CHECKPOINT_INFILE
+%token       CHECKPOINT_IN_BACKGROUND
 %token       CHECKPOINT_ITERATIONS
 %token       CHECKPOINT_OUTFILE
 %token       CHECKPOINT_REALTIME
@@ -181,6 +190,7 @@ struct arg_list printfargs;
 %token       CLAMP_CONCENTRATION
 %token       CLOSE_PARTITION_SPACING
 %token       CONCENTRATION
+%token       CONTAINER
 %token       CORNERS
 %token       COS
 %token       COUNT
@@ -203,12 +213,14 @@ struct arg_list printfargs;
 %token       DIFFUSION_CONSTANT_3D
 %token       DIFFUSION_CONSTANT_REPORT
 %token       DYNAMIC_GEOMETRY
+%token       DYNAMIC_GEOMETRY_CACHE
 %token       DYNAMIC_GEOMETRY_MOLECULE_PLACEMENT
 %token       EFFECTOR_GRID_DENSITY
 %token       ELEMENT_CONNECTIONS
 %token       ELLIPTIC
 %token       ELLIPTIC_RELEASE_SITE
 %token       EQUAL
+%token       EQUILIBRATION
 %token       ERROR
 %token       ESTIMATE_CONCENTRATION
 %token       EXCLUDE_ELEMENTS
@@ -270,6 +282,8 @@ struct arg_list printfargs;
 %token       MEMORY_PARTITION_Y
 %token       MEMORY_PARTITION_Z
 %token       MEMORY_PARTITION_POOL
+%token       MEMORY_PARTITION_AUTO
+%token       MEMORY_USAGE_REPORT
 %token       MICROSCOPIC_REVERSIBILITY
 %token       MIN_TOK
 %token       MISSED_REACTIONS
@@ -281,6 +295,7 @@ struct arg_list printfargs;
 %token       MOLECULE
 %token       MOLECULE_COLLISION_REPORT
 %token       MOLECULE_DENSITY
+%token       MOLECULE_IDS
 %token       MOLECULE_NUMBER
 %token       MOLECULE_POSITIONS
 %token       MOLECULES
@@ -344,6 +359,7 @@ struct arg_list printfargs;
 %token       RIGHT
 %token       ROTATE
 %token       ROUND_OFF
+%token       SAMPLE_FRACTION
 %token       SCALE
 %token       SEED
 %token       SHAPE
@@ -376,10 +392,13 @@ struct arg_list printfargs;
 %token       TIME_POINTS
 %token       TIME_STEP
 %token       TIME_STEP_MAX
+%token       TIME_STEP_MULTIPLIER
 %token       TO
 %token       TOP
+%token       TRACK_MOLECULES
 %token       TRAIN_DURATION
 %token       TRAIN_INTERVAL
+%token       TRAJECTORY
 %token       TRANSLATE
 %token       TRANSPARENT
 %token       TRIGGER
@@ -530,10 +549,10 @@ struct arg_list printfargs;
 
 /* Polygon/voxel non-terminals */
 %type <vertlist> vertex_list_cmd list_points
-%type <vertlistitem> single_vertex
-%type <ecl> element_connection_cmd tet_element_connection_cmd
-%type <elem_conn> element_connection element_connection_tet
-%type <ecl> list_element_connections list_tet_arrays
+%type <elemarr> element_connection_cmd list_element_connections
+%type <ecl> tet_element_connection_cmd
+%type <elem_conn> element_connection_tet
+%type <ecl> list_tet_arrays
 
 /* Region specification non-terminals */
 %type <elem_list> remove_element_specifier_list
@@ -599,6 +618,7 @@ struct arg_list printfargs;
 %type <vec3> volume_output_location volume_output_voxel_size
 %type <vec3> volume_output_voxel_count
 %type <otimes> volume_output_times_def
+%type <tok> volume_output_maybe_binary
 
 /* Operator associativities and precendences */
 %right '='
@@ -983,6 +1003,7 @@ notification_item_def:
                                                       }
       | ITERATION_REPORT '=' num_expr                 { if (!parse_state->vol->quiet_flag) CHECK(mdl_set_iteration_report_freq(parse_state, (long long) $3)); }
       | MOLECULE_COLLISION_REPORT '=' notify_bilevel    { if (!parse_state->vol->quiet_flag) parse_state->vol->notify->molecule_collision_report    = (enum notify_level_t)$3; }
+      | MEMORY_USAGE_REPORT '=' notify_bilevel        { if (!parse_state->vol->quiet_flag) parse_state->vol->notify->memory_usage_report    = (enum notify_level_t)$3; }
 ;
 
 notify_bilevel:
@@ -1040,6 +1061,9 @@ chkpt_stmt: CHECKPOINT_INFILE '=' file_name           { CHECK(mdl_set_checkpoint
         | CHECKPOINT_OUTFILE '=' file_name            { CHECK(mdl_set_checkpoint_outfile(parse_state, $3)); }
         | CHECKPOINT_ITERATIONS '=' num_expr exit_or_no { CHECK(mdl_set_checkpoint_interval(parse_state, $3, $4)); }
         | KEEP_CHECKPOINT_FILES '=' boolean           { CHECK(mdl_keep_checkpoint_files(parse_state, $3)); }
+        | CHECKPOINT_IN_BACKGROUND '=' boolean        { CHECK(mdl_background_checkpoints(parse_state, $3)); }
+        | CHECKPOINT_DIFFERENTIAL '=' num_expr        { CHECK(mdl_set_differential_checkpoints(parse_state, $3)); }
+        | CHECKPOINT_FIXED_WIDTH '=' boolean          { CHECK(mdl_fixed_width_checkpoints(parse_state, $3)); }
         | CHECKPOINT_REALTIME '='
           time_expr exit_or_no                        { CHECK(mdl_set_realtime_checkpoint(parse_state, (long) $3, $4)); }
 ;
@@ -1064,6 +1088,12 @@ parameter_def:
           TIME_STEP '=' num_expr                      { CHECK(mdl_set_time_step(parse_state, $3)); }
         | SPACE_STEP '=' num_expr                     { CHECK(mdl_set_space_step(parse_state, $3)); }
         | TIME_STEP_MAX '=' num_expr                  { CHECK(mdl_set_max_time_step(parse_state, $3)); }
+        | ADAPTIVE_TIME_STEP '=' boolean              { parse_state->vol->adaptive_time_step = $3; }
+        | TIME_STEP_MULTIPLIER '=' num_expr           { CHECK(mdl_set_time_step_multiplier(parse_state, $3, NULL, NULL)); }
+        | TIME_STEP_MULTIPLIER '=' num_expr
+            CORNERS '=' point ',' point               { CHECK(mdl_set_time_step_multiplier(parse_state, $3, $6, $8)); }
+        | EQUILIBRATION '=' num_expr
+            TIME_STEP_MULTIPLIER '=' num_expr         { CHECK(mdl_set_equilibration(parse_state, $3, $6)); }
         | ITERATIONS '=' num_expr { CHECK(mdl_set_num_iterations(parse_state, (long long) $3)); }
         | CENTER_MOLECULES_ON_GRID '=' boolean        { parse_state->vol->randomize_smol_pos = !($3); }
         | ACCURATE_3D_REACTIONS '=' boolean           { parse_state->vol->use_expanded_list = $3; }
@@ -1077,6 +1107,7 @@ parameter_def:
         | MICROSCOPIC_REVERSIBILITY '=' SURFACE_ONLY  { parse_state->vol->surface_reversibility=1;  parse_state->vol->volume_reversibility=0;  }
         | MICROSCOPIC_REVERSIBILITY '=' VOLUME_ONLY   { parse_state->vol->surface_reversibility=0;  parse_state->vol->volume_reversibility=1;  }
         | DYNAMIC_GEOMETRY '=' str_expr_only          { CHECK(mcell_add_dynamic_geometry_file($3, parse_state)); }
+        | DYNAMIC_GEOMETRY_CACHE '=' boolean          { parse_state->vol->dynamic_geometry_cache_flag = $3; }
         | DYNAMIC_GEOMETRY_MOLECULE_PLACEMENT '=' NEAREST_POINT    { parse_state->vol->dynamic_geometry_molecule_placement = 0; }
         | DYNAMIC_GEOMETRY_MOLECULE_PLACEMENT '=' NEAREST_TRIANGLE { parse_state->vol->dynamic_geometry_molecule_placement = 1; }
 ;
@@ -1089,10 +1120,12 @@ memory_partition_def:
         | MEMORY_PARTITION_Y '=' num_expr             { parse_state->vol->mem_part_y = (int) $3; }
         | MEMORY_PARTITION_Z '=' num_expr             { parse_state->vol->mem_part_z = (int) $3; }
         | MEMORY_PARTITION_POOL '=' num_expr          { parse_state->vol->mem_part_pool = (int) $3; }
+        | MEMORY_PARTITION_AUTO '=' boolean           { parse_state->vol->mem_part_auto = $3; }
 ;
 
 partition_def:
           partition_dimension '=' array_value         { CHECK(mcell_set_partition(parse_state->vol, $1, & $3)); }
+        | ADAPTIVE_PARTITIONS '=' boolean             { parse_state->vol->adaptive_partitions = $3; }
 ;
 
 partition_dimension:
@@ -1717,6 +1750,7 @@ release_site_cmd:
           existing_release_pattern_xor_rxpn           { CHECK(mdl_set_release_site_pattern(parse_state, parse_state->current_release_site, $3)); }
         | MOLECULE_POSITIONS
           '{' molecule_release_pos_list '}'           { CHECK(mdl_set_release_site_molecule_positions(parse_state, parse_state->current_release_site, & $3)); }
+        | MOLECULE_POSITIONS '=' file_name            { CHECK(mdl_set_release_site_molecule_file(parse_state, parse_state->current_release_site, $3)); }
         | GRAPH_PATTERN '=' str_expr                    {CHECK(mdl_set_release_site_graph_pattern(parse_state, parse_state->current_release_site,  $3)); }
 ;
 
@@ -1780,8 +1814,8 @@ polygon_list_def:
             vertex_list_cmd
             element_connection_cmd                    {
                                                         CHECKN($<obj>$ = mdl_new_polygon_list(
-                                                          parse_state, $1, $4.vertex_count, $4.vertex_head,
-                                                          $5.connection_count, $5.connection_head));
+                                                          parse_state, $1, $4.vertex_count, $4.vertices,
+                                                          $5.element_count, $5.elements));
                                                       }
             list_opt_polygon_object_cmds
             list_opt_object_cmds
@@ -1791,16 +1825,26 @@ polygon_list_def:
                                                           $$ = (struct object *) $<obj>6;
                                                           CHECK(mdl_finish_polygon_list(parse_state, $$));
                                                       }
+        | new_object_name POLYGON_LIST
+          start_object
+            BINARY_MESH '=' str_expr_only             {
+                                                        CHECKN($<obj>$ = mdl_new_binary_polygon_list(
+                                                          parse_state, $1, $6));
+                                                      }
+            list_opt_polygon_object_cmds
+            list_opt_object_cmds
+          '}'
+                                                      {
+                                                          $$ = (struct object *) $<obj>7;
+                                                          CHECK(mdl_finish_polygon_list(parse_state, $$));
+                                                      }
 ;
 
 vertex_list_cmd: VERTEX_LIST '{' list_points '}'      { $$ = $3; }
 ;
 
-single_vertex: point                                  { CHECKN($$ = mdl_new_vertex_list_item($1)); }
-;
-
-list_points: single_vertex                            { mdl_vertex_list_singleton(& $$, $1); }
-           | list_points single_vertex                { $$ = $1; mdl_add_vertex_to_list(& $$, $2); }
+list_points: point                                    { mdl_vertex_array_singleton(& $$, $1); }
+           | list_points point                        { $$ = $1; mdl_add_vertex_to_array(& $$, $2); }
 ;
 
 element_connection_cmd:
@@ -1809,12 +1853,9 @@ element_connection_cmd:
 ;
 
 list_element_connections:
-          element_connection                          { mdl_element_connection_list_singleton(& $$, $1); }
+          array_value                                 { CHECK(mdl_element_array_singleton(parse_state, & $$, & $1)); }
         | list_element_connections
-          element_connection                          { $$ = $1; mdl_add_element_connection_to_list(& $$, $2); }
-;
-
-element_connection: array_value                       { CHECKN($$ = mdl_new_element_connection(parse_state, & $1)); }
+          array_value                                 { $$ = $1; CHECK(mdl_add_element_to_array(parse_state, & $$, & $2)); }
 ;
 
 list_opt_polygon_object_cmds:
@@ -1931,7 +1972,7 @@ voxel_list_def:
             vertex_list_cmd
             tet_element_connection_cmd                {
                                                         CHECKN(mdl_new_voxel_list(parse_state, $1,
-                                                                                  $4.vertex_count, $4.vertex_head,
+                                                                                  $4.vertex_count, $4.vertices,
                                                                                   $5.connection_count, $5.connection_head));
                                                       }
             list_opt_object_cmds
@@ -2086,6 +2127,7 @@ output_def:
             output_buffer_size_def                    {
                                                           parse_state->header_comment = NULL;  /* No header by default */
                                                           parse_state->exact_time_flag = 1;    /* Print exact_time column in TRIGGER output by default */
+                                                          parse_state->binary_output_flag = 0; /* Text output by default */
                                                       }
             output_timer_def
             list_count_cmds
@@ -2093,7 +2135,7 @@ output_def:
 ;
 
 output_buffer_size_def:
-          /* empty */                                 { $$ = COUNTBUFFERSIZE; }
+          /* empty */                                 { $$ = 0; }
         | OUTPUT_BUFFER_SIZE '=' num_expr             {
                                                           double temp_value = $3;
                                                           if (!(temp_value >= 1.0 && temp_value < UINT_MAX))
@@ -2148,6 +2190,7 @@ count_cmd:
           count_stmt
         | custom_header                               { $$ = NULL; }
         | exact_time_toggle                           { $$ = NULL; }
+        | binary_output_toggle                        { $$ = NULL; }
 ;
 
 count_stmt:
@@ -2170,6 +2213,10 @@ exact_time_toggle:
           SHOW_EXACT_TIME '=' boolean                 { parse_state->exact_time_flag = $3; }
 ;
 
+binary_output_toggle:
+          BINARY_OUTPUT '=' boolean                   { parse_state->binary_output_flag = $3; }
+;
+
 list_count_exprs:
           single_count_expr
         | list_count_exprs ','
@@ -2313,6 +2360,8 @@ viz_output_maybe_mode_cmd: /* empty */                { CHECK(mdl_set_viz_mode(p
 viz_mode_def: MODE '=' NONE                           { $$ = NO_VIZ_MODE; }
             | MODE '=' ASCII                          { $$ = ASCII_MODE; }
             | MODE '=' CELLBLENDER                    { $$ = CELLBLENDER_MODE; }
+            | MODE '=' CELLBLENDER_DELTA              { $$ = CELLBLENDER_DELTA_MODE; }
+            | MODE '=' TRAJECTORY                     { $$ = TRAJECTORY_MODE; }
 ;
 
 viz_output_cmd:
@@ -2324,6 +2373,8 @@ viz_output_cmd:
                                                           parse_state->vol->viz_blocks->frame_data_head = $1.frame_head;
                                                         }
                                                       }
+        | viz_track_molecules_def
+        | viz_container_def
 ;
 
 viz_frames_def:
@@ -2333,6 +2384,27 @@ viz_frames_def:
 viz_filename_prefix_def: FILENAME '=' str_expr        { CHECK(mdl_set_viz_filename_prefix(parse_state, parse_state->vol->viz_blocks, $3)); }
 ;
 
+viz_container_def: CONTAINER '=' boolean              { CHECK(mdl_set_viz_container(parse_state, parse_state->vol->viz_blocks, $3)); }
+;
+
+viz_track_molecules_def:
+          TRACK_MOLECULES '{'
+            list_viz_track_molecules_cmds
+          '}'
+;
+
+list_viz_track_molecules_cmds:
+          viz_track_molecules_cmd
+        | list_viz_track_molecules_cmds
+          viz_track_molecules_cmd
+;
+
+viz_track_molecules_cmd:
+          MOLECULE_IDS '=' array_value                { CHECK(mdl_set_viz_track_ids(parse_state, parse_state->vol->viz_blocks, &$3)); }
+        | SAMPLE_FRACTION '=' num_expr                { CHECK(mdl_set_viz_track_fraction(parse_state, parse_state->vol->viz_blocks, $3)); }
+        | BIRTH_REGION '=' existing_region            { CHECK(mdl_set_viz_track_birth_region(parse_state, parse_state->vol->viz_blocks, $3)); }
+;
+
 viz_molecules_block_def:
           MOLECULES '{'
             list_viz_molecules_block_cmds
@@ -2471,9 +2543,11 @@ volume_output_def:
             volume_output_voxel_size
             volume_output_voxel_count
             volume_output_times_def
+            volume_output_maybe_binary
           '}'                                         {
                                                           struct volume_output_item *vo;
                                                           CHECKN(vo = mdl_new_volume_output_item(parse_state, $3, & $4, $5, $6, $7, $8));
+                                                          vo->binary_flag = $9;
                                                           vo->next = parse_state->vol->volume_output_head;
                                                           parse_state->vol->volume_output_head = vo;
                                                       }
@@ -2483,6 +2557,11 @@ volume_output_filename_prefix:
           FILENAME_PREFIX '=' str_expr                { $$ = $3; }
 ;
 
+volume_output_maybe_binary:
+          /* empty */                                 { $$ = 0; }
+        | BINARY_OUTPUT '=' boolean                   { $$ = $3; }
+;
+
 volume_output_molecule_list:
           volume_output_molecule_decl
         | volume_output_molecule_list
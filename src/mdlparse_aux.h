@@ -95,10 +95,18 @@ struct element_connection_list_head {
   int connection_count;
 };
 
-struct vertex_list_head {
-  struct vertex_list *vertex_head;
-  struct vertex_list *vertex_tail;
+/* Vertices and triangles of a polygon or voxel list, in arrays that grow as
+ * they are parsed */
+struct vertex_array {
+  struct vector3 *vertices;
   int vertex_count;
+  int capacity;
+};
+
+struct element_array {
+  struct element_data *elements;
+  int element_count;
+  int capacity;
 };
 
 struct parse_mcell_species_list_item {
@@ -184,6 +192,9 @@ struct mdlparse_vars {
   /* Flag indicating whether to display the exact time */
   byte exact_time_flag;
 
+  /* Flag indicating whether to write COUNT data in binary */
+  byte binary_output_flag;
+
   /* --------------------------------------------- */
   /* Intermediate state for regions */
   int allow_patches;
@@ -31,6 +31,7 @@
 #include <float.h>
 #include <limits.h>
 #include <errno.h>
+#include <stdint.h>
 #include <sys/stat.h>
 #include <unistd.h>
 #include <signal.h>
@@ -1974,6 +1975,65 @@ int mdl_set_max_time_step(struct mdlparse_vars *parse_state, double step) {
   return 0;
 }
 
+/*************************************************************************
+ mdl_set_time_step_multiplier:
+    Set the time step multiplier of the subvolumes in a box, or with no box
+    the largest multiplier given to subvolumes far from any wall.
+
+ In:  parse_state: parser state
+      multiplier: number of timesteps per diffusion step
+      llf: lower left front corner of the box, or NULL
+      urb: upper right back corner of the box, or NULL
+ Out: 0 on success, 1 on failure.  The corners are freed.
+*************************************************************************/
+int mdl_set_time_step_multiplier(struct mdlparse_vars *parse_state,
+                                 double multiplier, struct vector3 *llf,
+                                 struct vector3 *urb) {
+  int error_code;
+  if (llf == NULL)
+    error_code =
+        mcell_set_auto_time_step_multiplier(parse_state->vol, multiplier);
+  else
+    error_code =
+        mcell_add_time_step_multiplier(parse_state->vol, llf, urb, multiplier);
+  free(llf);
+  free(urb);
+
+  if (error_code == 2) {
+    mdlerror_fmt(parse_state, "Time step multiplier of %.15g requested; the "
+                              "multiplier must be at least 1 and the box "
+                              "corners must be in order",
+                 multiplier);
+    return 1;
+  } else if (error_code != 0) {
+    mdlerror(parse_state, "Out of memory while storing time step multiplier");
+    return 1;
+  }
+  return 0;
+}
+
+/*************************************************************************
+ mdl_set_equilibration:
+    Run the first iterations as a coarse equilibration phase without output.
+
+ In:  parse_state: parser state
+      iterations: number of iterations in the phase
+      multiplier: number of timesteps per diffusion step during the phase
+ Out: 0 on success, 1 on failure.
+*************************************************************************/
+int mdl_set_equilibration(struct mdlparse_vars *parse_state, double iterations,
+                          double multiplier) {
+  if (mcell_set_equilibration(parse_state->vol, iterations, multiplier)) {
+    mdlerror_fmt(parse_state, "Equilibration of %.15g iterations with a time "
+                              "step multiplier of %.15g requested; the "
+                              "iterations may not be negative and the "
+                              "multiplier must be at least 1",
+                 iterations, multiplier);
+    return 1;
+  }
+  return 0;
+}
+
 /*************************************************************************
  mdl_set_space_step:
     Set the global space step for the simulation.
@@ -2106,17 +2166,24 @@ int mdl_set_num_radial_subdivisions(struct mdlparse_vars *parse_state,
     free(parse_state->vol->r_step);
   if (parse_state->vol->r_step_surface != NULL)
     free(parse_state->vol->r_step_surface);
+  if (parse_state->vol->r_step_surface_erfc != NULL)
+    free(parse_state->vol->r_step_surface_erfc);
   if (parse_state->vol->r_step_release != NULL)
     free(parse_state->vol->r_step_release);
 
   parse_state->vol->r_step = init_r_step(parse_state->vol->radial_subdivisions);
   parse_state->vol->r_step_surface =
       init_r_step_surface(parse_state->vol->radial_subdivisions);
+  parse_state->vol->r_step_surface_erfc = NULL;
+  if (parse_state->vol->r_step_surface != NULL)
+    parse_state->vol->r_step_surface_erfc = init_r_step_surface_erfc(
+        parse_state->vol->r_step_surface, parse_state->vol->radial_subdivisions);
   parse_state->vol->r_step_release =
       init_r_step_3d_release(parse_state->vol->radial_subdivisions);
 
   if (parse_state->vol->r_step == NULL ||
       parse_state->vol->r_step_surface == NULL ||
+      parse_state->vol->r_step_surface_erfc == NULL ||
       parse_state->vol->r_step_release == NULL) {
     mcell_allocfailed(
         "Failed to allocate the diffusion radial subdivisions table.");
@@ -2335,6 +2402,62 @@ int mdl_keep_checkpoint_files(struct mdlparse_vars *parse_state,
   return 0;
 }
 
+/*************************************************************************
+ mdl_set_differential_checkpoints:
+    Set the number of differential checkpoints written after each full
+    checkpoint.  A differential checkpoint stores only the molecules that
+    changed since the full checkpoint it refers to, which is kept alongside
+    it as CHECKPOINT_OUTFILE.base.<iteration>.
+
+ In:  parse_state: parser state
+      n_deltas: differential checkpoints between full ones, 0 for none
+ Out: 0 on success, 1 on failure
+*************************************************************************/
+int mdl_set_differential_checkpoints(struct mdlparse_vars *parse_state,
+                                     double n_deltas) {
+  if (n_deltas < 0 || n_deltas > INT_MAX || n_deltas != (int)n_deltas) {
+    mdlerror(parse_state,
+             "CHECKPOINT_DIFFERENTIAL must be a non-negative integer");
+    return 1;
+  }
+  parse_state->vol->chkpt_differential = (int)n_deltas;
+  return 0;
+}
+
+/*************************************************************************
+ mdl_fixed_width_checkpoints:
+    Select if the molecules of checkpoints should be written as fixed-width
+    records, which a restart reads straight from a mapping of the file,
+    rather than as the more compact variable-length stream.
+
+ In:  parse_state: parser state
+      fixed_width: boolean variable selecting fixed-width records
+ Out: 0 on success, 1 on failure
+*************************************************************************/
+int mdl_fixed_width_checkpoints(struct mdlparse_vars *parse_state,
+                                int fixed_width) {
+
+  parse_state->vol->chkpt_fixed_width = fixed_width;
+  return 0;
+}
+
+/*************************************************************************
+ mdl_background_checkpoints:
+    Select if checkpoints after which the simulation continues should be
+    written by a forked copy of the simulation while it carries on, rather
+    than stopping the simulation until the file is written.
+
+ In:  parse_state: parser state
+      background: boolean variable selecting background checkpoints
+ Out: 0 on success, 1 on failure
+*************************************************************************/
+int mdl_background_checkpoints(struct mdlparse_vars *parse_state,
+                               int background) {
+
+  parse_state->vol->background_chkpts = background;
+  return 0;
+}
+
 /*************************************************************************
  mdl_make_new_object:
     Create a new object, adding it to the global symbol table.  the object must
@@ -3383,6 +3506,7 @@ duplicate_release_site(struct mdlparse_vars *parse_state,
   rel_site_obj->pattern = old->pattern;
   rel_site_obj->graph_pattern = old->graph_pattern;
   rel_site_obj->mol_list = old->mol_list;
+  rel_site_obj->mol_file = old->mol_file;
   rel_site_obj->periodic_box = old->periodic_box;
   rel_site_obj->name = NULL;
 
@@ -3402,9 +3526,17 @@ duplicate_release_site(struct mdlparse_vars *parse_state,
     rel_reg_data->cum_area_list = NULL;
     rel_reg_data->wall_index = NULL;
     rel_reg_data->obj_index = NULL;
+    rel_reg_data->alias_prob = NULL;
+    rel_reg_data->alias_index = NULL;
     rel_reg_data->n_objects = -1;
     rel_reg_data->owners = NULL;
     rel_reg_data->in_release = NULL;
+    rel_reg_data->sv_inside = NULL;
+    rel_reg_data->sv_serial = 0;
+    rel_reg_data->n_release_svs = -1;
+    rel_reg_data->release_svs = NULL;
+    rel_reg_data->release_sv_volume = NULL;
+    rel_reg_data->release_svs_serial = 0;
     rel_reg_data->self = new_self;
 
     rel_reg_data->expression =
@@ -4186,7 +4318,6 @@ static int polygonalize_cuboid(struct polygon_object *pop,
                                struct subdivided_box *sb) {
   struct vector3 *v;
   struct element_data *e;
-  struct vertex_list *head = NULL;
 
   pop->n_verts = count_cuboid_vertices(sb);
 
@@ -4342,52 +4473,7 @@ static int polygonalize_cuboid(struct polygon_object *pop,
     }
   }
 
-  /* build the head node of the linked list "pop->parsed_vertices" */
-
-  struct vertex_list *vlp = CHECKED_MALLOC_STRUCT(
-      struct vertex_list, "vertex_list");
-  if (vlp == NULL) {
-    free(vert_array);
-    return 1;
-  }
-  vlp->vertex = CHECKED_MALLOC_STRUCT(struct vector3, "vertex");
-  if (vlp->vertex == NULL) {
-    free(vert_array);
-    free(vlp);
-    return 1;
-  }
-  memcpy(vlp->vertex, &vert_array[0], sizeof(struct vector3));
-  vlp->next = head;
-  head = vlp;
-  struct vertex_list *tail = head;
-
-  /* build other nodes of the linked list "pop->parsed_vertices" */
-  int error_code = 0;
-  for (int i = 1; i < pop->n_verts; i++) {
-    vlp = CHECKED_MALLOC_STRUCT(struct vertex_list, "vertex_list");
-    if (vlp == NULL) {
-      error_code = 1;
-      break;
-    }
-    vlp->vertex = CHECKED_MALLOC_STRUCT(struct vector3, "vertex");
-    if (vlp->vertex == NULL) {
-      free(vlp);
-      error_code = 1;
-      break;
-    }
-    memcpy(vlp->vertex, &vert_array[i], sizeof(struct vector3));
-    vlp->next = tail->next;
-    tail->next = vlp;
-    tail = tail->next;
-  }
-  if (error_code == 1) {
-    free_vertex_list(head);
-    if (vert_array != NULL)
-      free(vert_array);
-    vert_array = NULL;
-    return 1;
-  }
-  pop->parsed_vertices = head;
+  pop->parsed_vertices = vert_array;
 
 #ifdef DEBUG
   printf("BOX has vertices:\n");
@@ -4401,10 +4487,6 @@ static int polygonalize_cuboid(struct polygon_object *pop,
   printf("\n");
 #endif
 
-  if (vert_array != NULL)
-    free(vert_array);
-  vert_array = NULL;
-
   return 0;
 }
 
@@ -4864,9 +4946,17 @@ mdl_set_release_site_geometry_object(struct mdlparse_vars *parse_state,
   rel_reg_data->cum_area_list = NULL;
   rel_reg_data->wall_index = NULL;
   rel_reg_data->obj_index = NULL;
+  rel_reg_data->alias_prob = NULL;
+  rel_reg_data->alias_index = NULL;
   rel_reg_data->n_objects = -1;
   rel_reg_data->owners = NULL;
   rel_reg_data->in_release = NULL;
+  rel_reg_data->sv_inside = NULL;
+  rel_reg_data->sv_serial = 0;
+  rel_reg_data->n_release_svs = -1;
+  rel_reg_data->release_svs = NULL;
+  rel_reg_data->release_sv_volume = NULL;
+  rel_reg_data->release_svs_serial = 0;
   rel_reg_data->self = parse_state->current_object;
   rel_reg_data->expression = rel_eval;
   rel_site_obj_ptr->region_data = rel_reg_data;
@@ -5198,6 +5288,127 @@ int mdl_set_release_site_molecule_positions(
   return 0;
 }
 
+/**************************************************************************
+ mdl_set_release_site_molecule_file:
+    Set the binary file of molecule positions for a LIST release.  The file's
+    header is checked and its species looked up now; the positions are read
+    each time the site releases.
+
+ In: parse_state: parser state
+     rel_site_obj_ptr: the release site object
+     file_name: name of the release list file, relative to the MDL file
+ Out: 0 on success, 1 on failure
+**************************************************************************/
+int mdl_set_release_site_molecule_file(
+    struct mdlparse_vars *parse_state,
+    struct release_site_obj *rel_site_obj_ptr, char *file_name) {
+  if (rel_site_obj_ptr->release_shape != SHAPE_LIST) {
+    mdlerror(parse_state,
+             "You must use the LIST shape to specify molecule positions in a "
+             "release.");
+    free(file_name);
+    return 1;
+  }
+  if (rel_site_obj_ptr->mol_file != NULL) {
+    mdlerror(parse_state,
+             "Molecule positions may only be read from one file per release "
+             "site.");
+    free(file_name);
+    return 1;
+  }
+
+  char *path = mcell_find_include_file(file_name, parse_state->vol->curr_file);
+  free(file_name);
+  if (path == NULL) {
+    mdlerror(parse_state, "Out of memory while reading a release list file");
+    return 1;
+  }
+  FILE *f = fopen(path, "rb");
+  if (f == NULL) {
+    mdlerror_fmt(parse_state, "Cannot open release list file '%s'", path);
+    free(path);
+    return 1;
+  }
+
+  struct release_list_file *rlf = CHECKED_MALLOC_STRUCT(
+      struct release_list_file, "release list file");
+  rlf->path = path;
+  rlf->n_species = 0;
+  rlf->species = NULL;
+
+  char magic[4];
+  uint32_t hdr[3];
+  uint64_t n_mols;
+  char const *problem = NULL;
+  if (fread(magic, 1, 4, f) != 4 || memcmp(magic, RELEASE_LIST_MAGIC, 4) != 0 ||
+      fread(hdr, sizeof(uint32_t), 3, f) != 3)
+    problem = "is not a release list file";
+  else if (hdr[0] != 0x01020304)
+    problem = "was written on a machine of another byte order";
+  else if (hdr[1] != RELEASE_LIST_VERSION)
+    problem = "has an unsupported version";
+  else if (hdr[2] > INT_MAX)
+    problem = "names too many species";
+
+  if (problem == NULL) {
+    rlf->n_species = (int)hdr[2];
+    rlf->species = CHECKED_MALLOC_ARRAY(struct species *, hdr[2] + 1,
+                                        "release list species");
+  }
+  for (int i = 0; problem == NULL && i < rlf->n_species; i++) {
+    uint32_t len;
+    char name[1024];
+    if (fread(&len, sizeof(len), 1, f) != 1 || len >= sizeof(name) ||
+        fread(name, 1, len, f) != len) {
+      problem = "has a malformed species name";
+      break;
+    }
+    name[len] = '\0';
+
+    struct sym_entry *sym = retrieve_sym(name, parse_state->vol->mol_sym_table);
+    if (sym == NULL) {
+      mdlerror_fmt(parse_state,
+                   "Release list file '%s' names the undefined molecule '%s'",
+                   path, name);
+      problem = "";
+      break;
+    }
+    rlf->species[i] = (struct species *)sym->value;
+    if ((rlf->species[i]->flags & NOT_FREE) != 0 &&
+        (rlf->species[i]->flags & ON_GRID) == 0) {
+      mdlerror_fmt(parse_state,
+                   "Release list file '%s' releases the surface class '%s'",
+                   path, name);
+      problem = "";
+    }
+  }
+
+  struct stat st;
+  if (problem == NULL) {
+    rlf->data_offset = ftell(f) + (long)sizeof(n_mols);
+    if (fread(&n_mols, sizeof(n_mols), 1, f) != 1 ||
+        fstat(fileno(f), &st) != 0 ||
+        (uint64_t)st.st_size - (uint64_t)rlf->data_offset !=
+            n_mols * sizeof(struct release_list_record))
+      problem = "does not hold the number of molecules it declares";
+  }
+  fclose(f);
+
+  if (problem != NULL) {
+    if (problem[0] != '\0')
+      mdlerror_fmt(parse_state, "Release list file '%s' %s", path, problem);
+    free(rlf->species);
+    free(rlf);
+    free(path);
+    return 1;
+  }
+
+  rlf->n_mols = (long long)n_mols;
+  rel_site_obj_ptr->mol_file = rlf;
+  rel_site_obj_ptr->release_number += (double)rlf->n_mols;
+  return 0;
+}
+
 /**************************************************************************
  mdl_new_release_single_molecule:
     Create a mew single molecule release position for a LIST release site.
@@ -5263,122 +5474,96 @@ mdl_set_release_site_concentration(struct mdlparse_vars *parse_state,
 }
 
 /**************************************************************************
- mdl_vertex_list_singleton:
-    Set an item to be the sole element of a vertex list.
-
- In: head: the list
-     item: ite item
- Out: none.  list is updated
-**************************************************************************/
-void mdl_vertex_list_singleton(struct vertex_list_head *head,
-                               struct vertex_list *item) {
-  item->next = NULL;
-  head->vertex_tail = head->vertex_head = item;
-  head->vertex_count = 1;
-}
-
-/**************************************************************************
- mdl_add_vertex_to_list:
-    Append a vertex to a list.
-
- In: head: the list
-     item: ite item
- Out: none.  list is updated
-**************************************************************************/
-void mdl_add_vertex_to_list(struct vertex_list_head *head,
-                            struct vertex_list *item) {
-  item->next = NULL;
-  head->vertex_tail = head->vertex_tail->next = item;
-  ++head->vertex_count;
-}
-
-/**************************************************************************
- mdl_new_vertex_list_item:
-    Allocate an item for a vertex list.
+ mdl_vertex_array_singleton:
+    Start a vertex array with a single vertex.
 
- In: vertex: this vertex
-     normal: surface normal at this vertex, or NULL
- Out: the vertex list item, or NULL if an error occurred
+ In: head: the array
+     vertex: the vertex, which is freed once copied into the array
+ Out: none.  array is updated
 **************************************************************************/
-struct vertex_list *mdl_new_vertex_list_item(struct vector3 *vertex) {
-
-  struct vertex_list *vlp =
-      CHECKED_MALLOC_STRUCT(struct vertex_list, "vertices");
-  if (vlp == NULL)
-    return NULL;
-  vlp->vertex = vertex;
-  vlp->next = NULL;
-  return vlp;
+void mdl_vertex_array_singleton(struct vertex_array *head,
+                                struct vector3 *vertex) {
+  head->vertices = NULL;
+  head->vertex_count = 0;
+  head->capacity = 0;
+  mdl_add_vertex_to_array(head, vertex);
 }
 
 /**************************************************************************
- mdl_element_connection_list_singleton:
-    Set an item to be the sole element of an element connection list.
+ mdl_add_vertex_to_array:
+    Append a vertex to an array.
 
- In: head: the list
-     item: ite item
- Out: none.  list is updated
+ In: head: the array
+     vertex: the vertex, which is freed once copied into the array
+ Out: none.  array is updated
 **************************************************************************/
-void
-mdl_element_connection_list_singleton(struct element_connection_list_head *head,
-                                      struct element_connection_list *item) {
-  item->next = NULL;
-  head->connection_tail = head->connection_head = item;
-  head->connection_count = 1;
+void mdl_add_vertex_to_array(struct vertex_array *head,
+                             struct vector3 *vertex) {
+  if (head->vertex_count == head->capacity) {
+    head->capacity = (head->capacity == 0) ? 64 : 2 * head->capacity;
+    head->vertices = (struct vector3 *)realloc(
+        head->vertices, head->capacity * sizeof(struct vector3));
+    if (head->vertices == NULL)
+      mcell_allocfailed("Failed to allocate polygon vertices.");
+  }
+  head->vertices[head->vertex_count++] = *vertex;
+  free(vertex);
 }
 
 /**************************************************************************
- mdl_add_element_connection_to_list:
-    Append an element connection to a list.
+ mdl_element_array_singleton:
+    Start an element array with a single element.
 
- In: head: the list
-     item: ite item
- Out: none.  list is updated
+ In: parse_state: parser state
+     head: the array
+     indices: the vertex indices of the element
+ Out: 0 on success, 1 if the element is not a triangle. array is updated
 **************************************************************************/
-void
-mdl_add_element_connection_to_list(struct element_connection_list_head *head,
-                                   struct element_connection_list *item) {
-  item->next = NULL;
-  head->connection_tail = head->connection_tail->next = item;
-  ++head->connection_count;
+int mdl_element_array_singleton(struct mdlparse_vars *parse_state,
+                                struct element_array *head,
+                                struct num_expr_list_head *indices) {
+  head->elements = NULL;
+  head->element_count = 0;
+  head->capacity = 0;
+  return mdl_add_element_to_array(parse_state, head, indices);
 }
 
 /**************************************************************************
- mdl_new_element_connection:
-    Create an element connection (essentially a triplet of vertex indices).
+ mdl_add_element_to_array:
+    Append an element (a triplet of vertex indices) to an array.
 
  In: parse_state: parser state
-     indices: the element connections
- Out: the list, or NULL if an error occurred
+     head: the array
+     indices: the vertex indices of the element
+ Out: 0 on success, 1 if the element is not a triangle. array is updated
 **************************************************************************/
-struct element_connection_list *
-mdl_new_element_connection(struct mdlparse_vars *parse_state,
-                           struct num_expr_list_head *indices) {
+int mdl_add_element_to_array(struct mdlparse_vars *parse_state,
+                             struct element_array *head,
+                             struct num_expr_list_head *indices) {
   if (indices->value_count != 3) {
     mdlerror(parse_state,
              "Non-triangular element found in polygon list object");
-    return NULL;
+    free(head->elements);
+    head->elements = NULL;
+    return 1;
   }
 
-  struct element_connection_list *eclp = CHECKED_MALLOC_STRUCT(
-      struct element_connection_list, "polygon element commections");
-  if (eclp == NULL)
-    return NULL;
+  if (head->element_count == head->capacity) {
+    head->capacity = (head->capacity == 0) ? 64 : 2 * head->capacity;
+    head->elements = (struct element_data *)realloc(
+        head->elements, head->capacity * sizeof(struct element_data));
 
-  eclp->indices = CHECKED_MALLOC_ARRAY(int, 3, "polygon element connections");
-  if (eclp->indices == NULL) {
-    free(eclp);
-    return NULL;
+    if (head->elements == NULL)
+      mcell_allocfailed("Failed to allocate polygon elements.");
   }
-  eclp->indices[0] = (int)indices->value_head->value;
-  eclp->indices[1] = (int)indices->value_head->next->value;
-  eclp->indices[2] = (int)indices->value_tail->value;
-  eclp->n_verts = indices->value_count;
-  eclp->next = NULL;
+  struct element_data *edp = &head->elements[head->element_count++];
+  edp->vertex_index[0] = (int)indices->value_head->value;
+  edp->vertex_index[1] = (int)indices->value_head->next->value;
+  edp->vertex_index[2] = (int)indices->value_tail->value;
 
   if (!indices->shared)
     mcell_free_numeric_list(indices->value_head);
-  return eclp;
+  return 0;
 }
 
 /**************************************************************************
@@ -5427,16 +5612,15 @@ mdl_new_tet_element_connection(struct mdlparse_vars *parse_state,
  In: parse_state: parser state
      sym: symbol for this polygon list
      n_vertices: count of vertices
-     vertices: list of vertices
+     vertices: array of vertices
      n_connections: count of walls
-     connections: list of walls
+     elements: array of walls
  Out: polygon object, or NULL if there was an error
 **************************************************************************/
 struct object *
 mdl_new_polygon_list(struct mdlparse_vars *parse_state, char *obj_name,
-                     int n_vertices, struct vertex_list *vertices,
-                     int n_connections,
-                     struct element_connection_list *connections) {
+                     int n_vertices, struct vector3 *vertices,
+                     int n_connections, struct element_data *elements) {
   struct object_creation obj_creation;
   obj_creation.object_name_list = parse_state->object_name_list;
   obj_creation.object_name_list_end = parse_state->object_name_list_end;
@@ -5460,8 +5644,8 @@ mdl_new_polygon_list(struct mdlparse_vars *parse_state, char *obj_name,
   }
 
   struct polygon_object *poly_obj_ptr =
-      new_polygon_list(parse_state->vol, obj_ptr, n_vertices, vertices,
-                       n_connections, connections);
+      new_polygon_list_from_arrays(parse_state->vol, obj_ptr, n_vertices,
+                                   vertices, n_connections, elements);
 
   parse_state->object_name_list = obj_creation.object_name_list;
   parse_state->object_name_list_end = obj_creation.object_name_list_end;
@@ -5473,6 +5657,44 @@ mdl_new_polygon_list(struct mdlparse_vars *parse_state, char *obj_name,
   return obj_ptr;
 }
 
+/**************************************************************************
+ mdl_new_binary_polygon_list:
+    Create a new polygon list object from the vertices and elements in a
+    binary mesh file (see utils/mcell_compile_mesh.py and read_binary_mesh),
+    without parsing them as MDL.
+
+ In: parse_state: parser state
+     obj_name: name of the polygon list
+     file_name: the binary mesh file, relative to the current MDL file
+ Out: polygon object, or NULL if there was an error
+**************************************************************************/
+struct object *mdl_new_binary_polygon_list(struct mdlparse_vars *parse_state,
+                                           char *obj_name, char *file_name) {
+  char *file_path =
+      mcell_find_include_file(file_name, parse_state->vol->curr_file);
+  free(file_name);
+  if (file_path == NULL) {
+    free(obj_name);
+    return NULL;
+  }
+
+  int n_vertices, n_elements;
+  struct vector3 *vertices;
+  struct element_data *elements;
+  char *error = read_binary_mesh(file_path, &n_vertices, &vertices,
+                                 &n_elements, &elements);
+  free(file_path);
+  if (error != NULL) {
+    mdlerror(parse_state, error);
+    free(error);
+    free(obj_name);
+    return NULL;
+  }
+
+  return mdl_new_polygon_list(parse_state, obj_name, n_vertices, vertices,
+                              n_elements, elements);
+}
+
 /**************************************************************************
  mdl_finish_polygon_list:
     Finalize the polygon list, cleaning up any state updates that were made
@@ -5534,7 +5756,7 @@ static struct voxel_object *allocate_voxel_object() {
 **************************************************************************/
 struct voxel_object *
 mdl_new_voxel_list(struct mdlparse_vars *parse_state, struct sym_entry *sym,
-                   int n_vertices, struct vertex_list *vertices,
+                   int n_vertices, struct vector3 *vertices,
                    int n_connections,
                    struct element_connection_list *connections) {
   struct tet_element_data *tedp;
@@ -5550,21 +5772,9 @@ mdl_new_voxel_list(struct mdlparse_vars *parse_state, struct sym_entry *sym,
   vop->n_voxels = n_connections;
   vop->n_verts = n_vertices;
 
-  /* Allocate vertices */
-  if ((vop->vertex = CHECKED_MALLOC_ARRAY(
-           struct vector3, vop->n_verts, "voxel list object vertices")) == NULL)
-    goto failure;
-
-  /* Populate vertices */
-  for (int i = 0; i < vop->n_verts; i++) {
-    struct vertex_list *vlp_temp = vertices;
-    vop->vertex[i].x = vertices->vertex->x;
-    vop->vertex[i].y = vertices->vertex->y;
-    vop->vertex[i].z = vertices->vertex->z;
-    free(vertices->vertex);
-    vertices = vertices->next;
-    free(vlp_temp);
-  }
+  /* The parsed vertices are already an array */
+  vop->vertex = vertices;
+  vertices = NULL;
 
   /* Allocate tetrahedra */
   if ((tedp = CHECKED_MALLOC_ARRAY(struct tet_element_data, vop->n_voxels,
@@ -5587,7 +5797,7 @@ mdl_new_voxel_list(struct mdlparse_vars *parse_state, struct sym_entry *sym,
   return vop;
 
 failure:
-  free_vertex_list(vertices);
+  free(vertices);
   free_connection_list(connections);
   if (vop) {
     if (vop->element)
@@ -6229,6 +6439,8 @@ struct output_set *mdl_populate_output_set(struct mdlparse_vars *parse_state,
       mcell_create_new_output_set(comment, exact_time,
                                   col_head, file_flags, outfile_name);
   free(outfile_name);
+  if (os != NULL)
+    os->binary_flag = parse_state->binary_output_flag;
 
   return os;
 }
@@ -7220,6 +7432,125 @@ int mdl_set_viz_filename_prefix(struct mdlparse_vars *parse_state,
   return 0;
 }
 
+/**************************************************************************
+ mdl_set_viz_track_ids:
+    Set the ids of the molecules a TRAJECTORY block follows.
+
+ In: parse_state: parser state
+     vizblk: the viz block
+     ids: the ids
+ Out: 0 on success, 1 on failure
+**************************************************************************/
+int mdl_set_viz_track_ids(struct mdlparse_vars *parse_state,
+                          struct viz_output_block *vizblk,
+                          struct num_expr_list_head *ids) {
+  if (vizblk->viz_mode != TRAJECTORY_MODE) {
+    mdlerror(parse_state, "MOLECULE_IDS may only be used in TRAJECTORY mode.");
+    return 1;
+  }
+
+  u_long *all_ids = CHECKED_MALLOC_ARRAY(
+      u_long, vizblk->traj_n_ids + ids->value_count, "molecule ids");
+  if (all_ids == NULL)
+    return 1;
+  int n_ids = vizblk->traj_n_ids;
+  if (n_ids > 0)
+    memcpy(all_ids, vizblk->traj_ids, n_ids * sizeof(u_long));
+  for (struct num_expr_list *nel = ids->value_head; nel != NULL;
+       nel = nel->next) {
+    if (nel->value < 0 || nel->value != floor(nel->value)) {
+      mdlerror_fmt(parse_state, "Molecule id %g is not a valid id.",
+                   nel->value);
+      free(all_ids);
+      return 1;
+    }
+    all_ids[n_ids++] = (u_long)nel->value;
+  }
+  if (!ids->shared)
+    mcell_free_numeric_list(ids->value_head);
+
+  /* Kept sorted and without repeats for lookups by id */
+  qsort(all_ids, n_ids, sizeof(u_long), ulong_cmp);
+  int n_unique = 0;
+  for (int i = 0; i < n_ids; ++i) {
+    if (n_unique == 0 || all_ids[n_unique - 1] != all_ids[i])
+      all_ids[n_unique++] = all_ids[i];
+  }
+  free(vizblk->traj_ids);
+  vizblk->traj_ids = all_ids;
+  vizblk->traj_n_ids = n_unique;
+  return 0;
+}
+
+/**************************************************************************
+ mdl_set_viz_track_fraction:
+    Set the fraction of the molecules a TRAJECTORY block follows.
+
+ In: parse_state: parser state
+     vizblk: the viz block
+     fraction: the fraction, between 0 and 1
+ Out: 0 on success, 1 on failure
+**************************************************************************/
+int mdl_set_viz_track_fraction(struct mdlparse_vars *parse_state,
+                               struct viz_output_block *vizblk,
+                               double fraction) {
+  if (vizblk->viz_mode != TRAJECTORY_MODE) {
+    mdlerror(parse_state,
+             "SAMPLE_FRACTION may only be used in TRAJECTORY mode.");
+    return 1;
+  }
+  if (fraction <= 0.0 || fraction > 1.0) {
+    mdlerror_fmt(parse_state,
+                 "SAMPLE_FRACTION must be more than 0 and at most 1 (%g).",
+                 fraction);
+    return 1;
+  }
+  vizblk->traj_sample_fraction = fraction;
+  return 0;
+}
+
+/**************************************************************************
+ mdl_set_viz_track_birth_region:
+    Set the region in which the molecules a TRAJECTORY block follows must
+    be first seen.
+
+ In: parse_state: parser state
+     vizblk: the viz block
+     region_sym: the region
+ Out: 0 on success, 1 on failure
+**************************************************************************/
+int mdl_set_viz_track_birth_region(struct mdlparse_vars *parse_state,
+                                   struct viz_output_block *vizblk,
+                                   struct sym_entry *region_sym) {
+  if (vizblk->viz_mode != TRAJECTORY_MODE) {
+    mdlerror(parse_state, "BIRTH_REGION may only be used in TRAJECTORY mode.");
+    return 1;
+  }
+  vizblk->traj_birth_region = (struct region *)region_sym->value;
+  return 0;
+}
+
+/**************************************************************************
+ mdl_set_viz_container:
+    Set whether a viz block appends all of its frames to one container
+    file, with a frame index, rather than writing a file per frame.
+
+ In: parse_state: parser state
+     vizblk: the viz block
+     container: 1 to write a container, 0 for a file per frame
+ Out: 0 on success, 1 on failure
+**************************************************************************/
+int mdl_set_viz_container(struct mdlparse_vars *parse_state,
+                          struct viz_output_block *vizblk, int container) {
+  if (container && vizblk->viz_mode == TRAJECTORY_MODE) {
+    mdlerror(parse_state, "CONTAINER may not be used in TRAJECTORY mode, "
+                          "which already writes a single stream.");
+    return 1;
+  }
+  vizblk->container = container;
+  return 0;
+}
+
 /**************************************************************************
  mdl_viz_state:
     Sets a flag on all of the listed objects, requesting that they be
@@ -7574,6 +7905,7 @@ struct volume_output_item *mdl_new_volume_output_item(
   vo->num_times = ot->num_times;
   vo->times = ot->times;
   mem_put(parse_state->output_times_mem, ot);
+  vo->binary_flag = 0;
 
   if (vo->timer_type == OUTPUT_BY_ITERATION_LIST ||
       vo->timer_type == OUTPUT_BY_TIME_LIST)
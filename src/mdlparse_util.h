@@ -201,6 +201,13 @@ int mdl_set_time_step(struct mdlparse_vars *parse_state, double step);
 /* Set the maximum timestep for the simulation. */
 int mdl_set_max_time_step(struct mdlparse_vars *parse_state, double step);
 
+int mdl_set_time_step_multiplier(struct mdlparse_vars *parse_state,
+                                 double multiplier, struct vector3 *llf,
+                                 struct vector3 *urb);
+
+int mdl_set_equilibration(struct mdlparse_vars *parse_state, double iterations,
+                          double multiplier);
+
 /* Set the global space step for the simulation. */
 int mdl_set_space_step(struct mdlparse_vars *parse_state, double step);
 
@@ -236,6 +243,18 @@ int mdl_set_checkpoint_outfile(struct mdlparse_vars *parse_state, char *name);
 /* Set if intermediate checkpoint files should be kept */
 int mdl_keep_checkpoint_files(struct mdlparse_vars *parse_state, int keepFiles);
 
+/* Set the number of differential checkpoints between full checkpoints */
+int mdl_set_differential_checkpoints(struct mdlparse_vars *parse_state,
+                                     double n_deltas);
+
+/* Set if checkpoint molecules should be written as fixed-width records */
+int mdl_fixed_width_checkpoints(struct mdlparse_vars *parse_state,
+                                int fixed_width);
+
+/* Set if continuing checkpoints should be written in the background */
+int mdl_background_checkpoints(struct mdlparse_vars *parse_state,
+                               int background);
+
 /* Set the number of iterations between checkpoints. */
 int mdl_set_checkpoint_interval(struct mdlparse_vars *parse_state,
                                 long long iters, int continueAfterChkpt);
@@ -454,6 +473,11 @@ int mdl_set_release_site_molecule_positions(
     struct mdlparse_vars *parse_state, struct release_site_obj *rsop,
     struct release_single_molecule_list *list);
 
+/* Set the binary file of molecule positions for a LIST release. */
+int mdl_set_release_site_molecule_file(struct mdlparse_vars *parse_state,
+                                       struct release_site_obj *rsop,
+                                       char *file_name);
+
 /* Create a mew single molecule release position for a LIST release site. */
 struct release_single_molecule *
 mdl_new_release_single_molecule(struct mdlparse_vars *parse_state,
@@ -466,31 +490,23 @@ int mdl_set_release_site_concentration(struct mdlparse_vars *parse_state,
                                        struct release_site_obj *rsop,
                                        double conc);
 
-/* Set an item to be the sole element of a vertex list. */
-void mdl_vertex_list_singleton(struct vertex_list_head *head,
-                               struct vertex_list *item);
+/* Start a vertex array with a single vertex. */
+void mdl_vertex_array_singleton(struct vertex_array *head,
+                                struct vector3 *vertex);
 
-/* Append a vertex to a list. */
-void mdl_add_vertex_to_list(struct vertex_list_head *head,
-                            struct vertex_list *item);
+/* Append a vertex to an array. */
+void mdl_add_vertex_to_array(struct vertex_array *head,
+                             struct vector3 *vertex);
 
-/* Allocate an item for a vertex list. */
-struct vertex_list *mdl_new_vertex_list_item(struct vector3 *vertex);
+/* Start an element array with a single element. */
+int mdl_element_array_singleton(struct mdlparse_vars *parse_state,
+                                struct element_array *head,
+                                struct num_expr_list_head *indices);
 
-/* Set an item to be the sole element of an element connection list. */
-void
-mdl_element_connection_list_singleton(struct element_connection_list_head *head,
-                                      struct element_connection_list *item);
-
-/* Append an element connection to a list. */
-void
-mdl_add_element_connection_to_list(struct element_connection_list_head *head,
-                                   struct element_connection_list *item);
-
-/* Create an element connection (essentially a triplet of vertex indices). */
-struct element_connection_list *
-mdl_new_element_connection(struct mdlparse_vars *parse_state,
-                           struct num_expr_list_head *indices);
+/* Append an element (a triplet of vertex indices) to an array. */
+int mdl_add_element_to_array(struct mdlparse_vars *parse_state,
+                             struct element_array *head,
+                             struct num_expr_list_head *indices);
 
 /* Create a tetrahedral element connection (essentially a quadruplet of vertex
  * indices). */
@@ -501,9 +517,12 @@ mdl_new_tet_element_connection(struct mdlparse_vars *parse_state,
 /* Create a new polygon list object. */
 struct object *
 mdl_new_polygon_list(struct mdlparse_vars *parse_state, char *obj_name,
-                     int n_vertices, struct vertex_list *vertices,
-                     int n_connections,
-                     struct element_connection_list *connections);
+                     int n_vertices, struct vector3 *vertices,
+                     int n_connections, struct element_data *elements);
+
+/* Create a new polygon list object from a binary mesh file. */
+struct object *mdl_new_binary_polygon_list(struct mdlparse_vars *parse_state,
+                                           char *obj_name, char *file_name);
 
 /* Finalize the polygon list, cleaning up any state updates that were made when
  * we started creating the polygon. */
@@ -513,7 +532,7 @@ int mdl_finish_polygon_list(struct mdlparse_vars *parse_state,
 /* Create a new voxel list object. */
 struct voxel_object *
 mdl_new_voxel_list(struct mdlparse_vars *parse_state, struct sym_entry *sym,
-                   int n_vertices, struct vertex_list *vertices,
+                   int n_vertices, struct vector3 *vertices,
                    int n_connections,
                    struct element_connection_list *connections);
 
@@ -702,6 +721,25 @@ int mdl_set_viz_filename_prefix(struct mdlparse_vars *parse_state,
                                 struct viz_output_block *vizblk,
                                 char *filename);
 
+/* Set the ids of the molecules a TRAJECTORY block follows. */
+int mdl_set_viz_track_ids(struct mdlparse_vars *parse_state,
+                          struct viz_output_block *vizblk,
+                          struct num_expr_list_head *ids);
+
+/* Set the fraction of the molecules a TRAJECTORY block follows. */
+int mdl_set_viz_track_fraction(struct mdlparse_vars *parse_state,
+                               struct viz_output_block *vizblk,
+                               double fraction);
+
+/* Set the birth region of the molecules a TRAJECTORY block follows. */
+int mdl_set_viz_track_birth_region(struct mdlparse_vars *parse_state,
+                                   struct viz_output_block *vizblk,
+                                   struct sym_entry *region_sym);
+
+/* Set whether a viz block writes all of its frames to one container. */
+int mdl_set_viz_container(struct mdlparse_vars *parse_state,
+                          struct viz_output_block *vizblk, int container);
+
 /* Error-checking wrapper for a specified visualization state. */
 int mdl_viz_state(struct mdlparse_vars *parse_state, int *target, double value);
 
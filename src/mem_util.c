@@ -36,6 +36,9 @@
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
+#ifndef _WIN32
+#include <pthread.h>
+#endif
 
 #include "strfunc.h"
 #include "logging.h"
@@ -50,6 +53,21 @@
 #undef realloc
 #endif
 
+#if defined(__linux__) && !defined(MEM_UTIL_KEEP_STATS)
+#include <sys/mman.h>
+#ifdef MADV_HUGEPAGE
+#define MEM_UTIL_HAVE_HUGE_PAGES
+#endif
+#endif
+
+#if !defined(_WIN32) && !defined(MEM_UTIL_KEEP_STATS) &&                    \
+    !defined(MEM_UTIL_TRACK_FREED) && !defined(MEM_UTIL_NO_POOLING)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#define MEM_UTIL_HAVE_PAGE_FILE
+#endif
+
 #ifdef DEBUG
 #define Malloc count_malloc
 #else
@@ -314,15 +332,541 @@ void mem_dump_stats(FILE *out) {
 
 #endif
 
+/* Raise the high-water mark of a pool to its current size */
+static inline void note_peak(struct mem_helper *mh) {
+  if (mh->bytes_reserved > mh->bytes_peak)
+    mh->bytes_peak = mh->bytes_reserved;
+}
+
+#ifdef MEM_UTIL_HAVE_PAGE_FILE
+/* Scratch file backing the blocks of pageable pools, or -1 */
+static int mem_page_fd = -1;
+static off_t mem_page_end = 0;  /* Bytes of the file handed out so far */
+static size_t mem_page_mapped = 0; /* Bytes of page files still mapped */
+static size_t mem_page_bytes = 4096; /* System page size */
+static pthread_mutex_t mem_page_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Round a block length up to whole pages */
+static size_t page_file_round(size_t len) {
+  return (len + mem_page_bytes - 1) & ~(mem_page_bytes - 1);
+}
+
+/* Map len bytes, a multiple of the page size, of fresh space in the page
+ * file at addr (or anywhere if addr is NULL).  Returns NULL on failure or if
+ * no page file is in use. */
+static void *page_file_map(void *addr, size_t len) {
+  pthread_mutex_lock(&mem_page_lock);
+  if (mem_page_fd < 0) {
+    pthread_mutex_unlock(&mem_page_lock);
+    return NULL;
+  }
+  off_t offset = mem_page_end;
+  if (ftruncate(mem_page_fd, offset + (off_t)len) != 0) {
+    pthread_mutex_unlock(&mem_page_lock);
+    return NULL;
+  }
+  mem_page_end += len;
+  int fd = mem_page_fd;
+  pthread_mutex_unlock(&mem_page_lock);
+
+  void *p = mmap(addr, len, PROT_READ | PROT_WRITE,
+                 MAP_SHARED | (addr != NULL ? MAP_FIXED : 0), fd, offset);
+  if (p != MAP_FAILED) {
+    pthread_mutex_lock(&mem_page_lock);
+    mem_page_mapped += len;
+    pthread_mutex_unlock(&mem_page_lock);
+    return p;
+  }
+  /* A failed fixed mapping may have dropped what was there */
+  if (addr != NULL)
+    mmap(addr, len, PROT_READ | PROT_WRITE,
+         MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0);
+  return NULL;
+}
+
+/* Unmap a block of the page file, releasing its space in the file where the
+ * file system allows */
+static void page_file_unmap(void *p, size_t len) {
+#ifdef MADV_REMOVE
+  madvise(p, len, MADV_REMOVE);
+#endif
+  munmap(p, len);
+  pthread_mutex_lock(&mem_page_lock);
+  mem_page_mapped -= len;
+  pthread_mutex_unlock(&mem_page_lock);
+}
+
+
+/* Hand the pages of a block of the page file back to the system.  Dirty
+ * pages are written to the file first; the contents are unchanged. */
+static void page_file_release(void *p, size_t len) {
+#ifdef MADV_PAGEOUT
+  if (madvise(p, len, MADV_PAGEOUT) == 0)
+    return;
+#endif
+  msync(p, len, MS_ASYNC);
+  madvise(p, len, MADV_DONTNEED);
+}
+#endif
+
+#ifdef MEM_UTIL_SLABS
+#ifdef _WIN32
+#include <malloc.h>
+#else
+#include <sys/mman.h>
+#endif
+
+/* A slab of records, aligned to MEM_SLAB_BYTES, with its header at the
+ * start.  Freed records go back on the free list of the slab they came
+ * from, so once every record of a slab is free the whole slab can be handed
+ * back to the operating system. */
+struct mem_slab {
+  struct mem_slab *next;       /* Owner's list of all slabs */
+  struct mem_slab *prev;
+  struct mem_slab *avail_next; /* Owner's list of slabs with free records */
+  struct mem_slab *avail_prev;
+  struct mem_helper *owner;
+  struct abstract_list *free_list; /* Records freed back to this slab */
+  unsigned char *bump;          /* First record never handed out */
+  unsigned char *end;           /* End of the last whole record */
+  int live;                     /* Records currently handed out */
+  int in_avail;                 /* Set if on the owner's avail list */
+  int paged;                    /* Set if mapped from the page file */
+};
+
+#define MEM_SLAB_HEADER ((sizeof(struct mem_slab) + 63) & ~(size_t)63)
+
+static struct mem_slab *slab_of(void *data) {
+  return (struct mem_slab *)((uintptr_t)data &
+                             ~(uintptr_t)(MEM_SLAB_BYTES - 1));
+}
+
+static void *slab_map(int pageable, int *paged) {
+  *paged = 0;
+#ifdef _WIN32
+  UNUSED(pageable);
+  return _aligned_malloc(MEM_SLAB_BYTES, MEM_SLAB_BYTES);
+#else
+  /* Map twice the size and trim the ends so the slab is aligned */
+  size_t len = 2 * (size_t)MEM_SLAB_BYTES;
+  unsigned char *p = (unsigned char *)mmap(
+      NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (p == MAP_FAILED)
+    return NULL;
+  uintptr_t start = ((uintptr_t)p + MEM_SLAB_BYTES - 1) &
+                    ~(uintptr_t)(MEM_SLAB_BYTES - 1);
+  size_t head = start - (uintptr_t)p;
+  size_t tail = len - head - MEM_SLAB_BYTES;
+  if (head > 0)
+    munmap(p, head);
+  if (tail > 0)
+    munmap((unsigned char *)start + MEM_SLAB_BYTES, tail);
+#ifdef MEM_UTIL_HAVE_PAGE_FILE
+  /* Replace the anonymous slab with one from the page file, in place */
+  if (pageable && page_file_map((void *)start, MEM_SLAB_BYTES) != NULL)
+    *paged = 1;
+#else
+  UNUSED(pageable);
+#endif
+  return (void *)start;
+#endif
+}
+
+static void slab_unmap(struct mem_slab *s) {
+#ifdef _WIN32
+  _aligned_free(s);
+#else
+#ifdef MEM_UTIL_HAVE_PAGE_FILE
+  if (s->paged) {
+    page_file_unmap(s, MEM_SLAB_BYTES);
+    return;
+  }
+#endif
+  munmap(s, MEM_SLAB_BYTES);
+#endif
+}
+
+static void slab_avail_push(struct mem_helper *mh, struct mem_slab *s) {
+  s->avail_prev = NULL;
+  s->avail_next = mh->avail;
+  if (mh->avail != NULL)
+    mh->avail->avail_prev = s;
+  mh->avail = s;
+  s->in_avail = 1;
+}
+
+static void slab_avail_remove(struct mem_helper *mh, struct mem_slab *s) {
+  if (s->avail_prev != NULL)
+    s->avail_prev->avail_next = s->avail_next;
+  else
+    mh->avail = s->avail_next;
+  if (s->avail_next != NULL)
+    s->avail_next->avail_prev = s->avail_prev;
+  s->avail_next = s->avail_prev = NULL;
+  s->in_avail = 0;
+}
+
+static struct mem_slab *slab_create(struct mem_helper *mh) {
+  int paged;
+  struct mem_slab *s = (struct mem_slab *)slab_map(mh->pageable, &paged);
+  if (s == NULL)
+    return NULL;
+
+  s->paged = paged;
+  s->owner = mh;
+  s->free_list = NULL;
+  s->bump = (unsigned char *)s + MEM_SLAB_HEADER;
+  s->end = s->bump + mh->slab_records * mh->record_size;
+  s->live = 0;
+  mh->bytes_reserved += MEM_SLAB_BYTES;
+  note_peak(mh);
+
+  s->prev = NULL;
+  s->next = mh->slabs;
+  if (mh->slabs != NULL)
+    mh->slabs->prev = s;
+  mh->slabs = s;
+  slab_avail_push(mh, s);
+  mh->empty_slabs++;
+  return s;
+}
+
+static void slab_destroy(struct mem_slab *s) {
+  struct mem_helper *mh = s->owner;
+  if (s->in_avail)
+    slab_avail_remove(mh, s);
+  if (s->prev != NULL)
+    s->prev->next = s->next;
+  else
+    mh->slabs = s->next;
+  if (s->next != NULL)
+    s->next->prev = s->prev;
+  if (s->live == 0)
+    mh->empty_slabs--;
+  mh->bytes_reserved -= MEM_SLAB_BYTES;
+  slab_unmap(s);
+}
+
+static void *slab_get(struct mem_helper *mh) {
+  struct mem_slab *s = mh->avail;
+  if (s == NULL && (s = slab_create(mh)) == NULL)
+    return NULL;
+
+  struct abstract_list *data;
+  if (s->free_list != NULL) {
+    data = s->free_list;
+    s->free_list = data->next;
+  } else {
+    data = (struct abstract_list *)s->bump;
+    s->bump += mh->record_size;
+  }
+  if (s->live++ == 0)
+    mh->empty_slabs--;
+  if (s->free_list == NULL && s->bump >= s->end)
+    slab_avail_remove(mh, s);
+  return data;
+}
+
+static void slab_put(void *defunct) {
+  struct abstract_list *data = (struct abstract_list *)defunct;
+  struct mem_slab *s = slab_of(data);
+  struct mem_helper *mh = s->owner;
+
+  data->next = s->free_list;
+  s->free_list = data;
+  --mh->records_live;
+  if (!s->in_avail)
+    slab_avail_push(mh, s);
+  if (--s->live == 0) {
+    /* Keep one empty slab around so a helper hovering at a slab boundary
+     * does not map and unmap on every call */
+    if (++mh->empty_slabs > 1)
+      slab_destroy(s);
+  }
+}
+#endif
+
+/* Accounting entry shared by all pools created with the same name */
+struct mem_usage {
+  struct mem_usage *next;
+  char const *name;
+  size_t record_size;
+  struct mem_helper *helpers; /* Live pools with this name */
+};
+
+static struct mem_usage *mem_usage_root = NULL;
+#ifndef _WIN32
+/* Pools may be created and destroyed by several worlds at once */
+static pthread_mutex_t mem_usage_lock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+static int mem_usage_same_name(char const *a, char const *b) {
+  if (a == NULL || b == NULL)
+    return a == b;
+  return a == b || strcmp(a, b) == 0;
+}
+
 /*************************************************************************
-create_mem_named:
+mem_usage_register:
+   In: A freshly created mem_helper
+       Name it was created with (may be NULL)
+   Out: No return value.  The helper is linked into the accounting entry
+        for its name, which is created if this is the first such pool.
+*************************************************************************/
+static void mem_usage_register(struct mem_helper *mh, char const *name) {
+  note_peak(mh);
+#ifndef _WIN32
+  pthread_mutex_lock(&mem_usage_lock);
+#endif
+  struct mem_usage *u;
+  for (u = mem_usage_root; u != NULL; u = u->next) {
+    if (u->record_size == mh->record_size && mem_usage_same_name(u->name, name))
+      break;
+  }
+  if (u == NULL) {
+    u = (struct mem_usage *)Malloc(sizeof(struct mem_usage));
+    if (u == NULL) {
+#ifndef _WIN32
+      pthread_mutex_unlock(&mem_usage_lock);
+#endif
+      return;
+    }
+    u->name = name;
+    u->record_size = mh->record_size;
+    u->helpers = NULL;
+    u->next = mem_usage_root;
+    mem_usage_root = u;
+  }
+
+  mh->usage = u;
+  mh->usage_prev = &u->helpers;
+  mh->usage_next = u->helpers;
+  if (u->helpers != NULL)
+    u->helpers->usage_prev = &mh->usage_next;
+  u->helpers = mh;
+#ifndef _WIN32
+  pthread_mutex_unlock(&mem_usage_lock);
+#endif
+}
+
+static void mem_usage_unregister(struct mem_helper *mh) {
+  if (mh->usage == NULL)
+    return;
+#ifndef _WIN32
+  pthread_mutex_lock(&mem_usage_lock);
+#endif
+  *mh->usage_prev = mh->usage_next;
+  if (mh->usage_next != NULL)
+    mh->usage_next->usage_prev = mh->usage_prev;
+  mh->usage = NULL;
+#ifndef _WIN32
+  pthread_mutex_unlock(&mem_usage_lock);
+#endif
+}
+
+/*************************************************************************
+mem_usage_collect:
+   In: An array to fill in
+       Number of entries in the array
+   Out: The number of distinct pool names with live pools.  Up to
+        max_entries of them are written to the array, summed over every
+        pool (e.g. one per memory partition) sharing the name.
+*************************************************************************/
+int mem_usage_collect(struct mem_usage_info *out, int max_entries) {
+  int n = 0;
+#ifndef _WIN32
+  pthread_mutex_lock(&mem_usage_lock);
+#endif
+  for (struct mem_usage *u = mem_usage_root; u != NULL; u = u->next) {
+    if (u->helpers == NULL)
+      continue;
+    if (n < max_entries) {
+      struct mem_usage_info *info = &out[n];
+      info->name = u->name;
+      info->record_size = u->record_size;
+      info->helpers = 0;
+      info->bytes_reserved = 0;
+      info->records_live = 0;
+      info->bytes_huge = 0;
+      info->bytes_peak = 0;
+      for (struct mem_helper *mh = u->helpers; mh != NULL;
+           mh = mh->usage_next) {
+        ++info->helpers;
+        info->bytes_reserved += mh->bytes_reserved;
+        info->records_live += mh->records_live;
+        info->bytes_huge += mh->bytes_huge;
+        info->bytes_peak += mh->bytes_peak;
+      }
+    }
+    ++n;
+  }
+#ifndef _WIN32
+  pthread_mutex_unlock(&mem_usage_lock);
+#endif
+  return n;
+}
+
+/*************************************************************************
+mem_usage_total_bytes:
+   In: No arguments
+   Out: Total number of bytes currently held by all pools.
+*************************************************************************/
+long long mem_usage_total_bytes(void) {
+  long long total = 0;
+#ifndef _WIN32
+  pthread_mutex_lock(&mem_usage_lock);
+#endif
+  for (struct mem_usage *u = mem_usage_root; u != NULL; u = u->next) {
+    for (struct mem_helper *mh = u->helpers; mh != NULL; mh = mh->usage_next)
+      total += mh->bytes_reserved;
+  }
+#ifndef _WIN32
+  pthread_mutex_unlock(&mem_usage_lock);
+#endif
+  return total;
+}
+
+static int mem_huge_pages = 0;
+
+/*************************************************************************
+mem_use_huge_pages:
+   In: Non-zero to back large pool blocks and arrays with huge pages
+   Out: No return value.  Affects pools and blocks created afterwards.
+*************************************************************************/
+void mem_use_huge_pages(int enable) { mem_huge_pages = enable; }
+
+/*************************************************************************
+mem_alloc_large:
+   In: Number of bytes to allocate
+       Set to 1 on return if the memory is backed by huge pages, else 0
+   Out: The allocated memory, to be released with free(), or NULL.  Huge
+        pages are only requested when enabled and the size is at least
+        MEM_HUGE_MIN_CHUNK; if the system refuses, ordinary pages are used.
+*************************************************************************/
+void *mem_alloc_large(size_t size, int *huge) {
+  *huge = 0;
+#ifdef MEM_UTIL_KEEP_STATS
+  /* Callers free this with the tracking free */
+  return mem_util_tracking_malloc(size);
+#endif
+#ifdef MEM_UTIL_HAVE_HUGE_PAGES
+  if (mem_huge_pages && size >= MEM_HUGE_MIN_CHUNK) {
+    void *p = NULL;
+    if (posix_memalign(&p, MEM_HUGE_PAGE_BYTES, size) == 0) {
+      /* Transparent huge pages may be disabled, or restricted to madvise */
+      if (madvise(p, size, MADV_HUGEPAGE) == 0)
+        *huge = 1;
+      return p;
+    }
+  }
+#endif
+  return Malloc(size);
+}
+
+/*************************************************************************
+mem_use_page_file:
+   In: Directory in which to create the page file, or NULL to stop using it
+   Out: 0 on success, 1 if the file could not be created or pageable pools
+        are not supported in this build.  Blocks of pageable pools created
+        afterwards are mapped from a fresh scratch file in the directory,
+        which is unlinked at once so that it goes away with the process.
+        Blocks already mapped keep their file after it is closed here.
+*************************************************************************/
+int mem_use_page_file(char const *dir) {
+#ifdef MEM_UTIL_HAVE_PAGE_FILE
+  int fd = -1;
+  if (dir != NULL) {
+    char *path = alloc_sprintf("%s/mcell_pages.XXXXXX", dir);
+    if (path == NULL)
+      return 1;
+    fd = mkstemp(path);
+    if (fd >= 0)
+      unlink(path);
+    free(path);
+    if (fd < 0)
+      return 1;
+  }
+
+  pthread_mutex_lock(&mem_page_lock);
+  if (mem_page_fd >= 0)
+    close(mem_page_fd);
+  mem_page_fd = fd;
+  mem_page_end = 0;
+  long page = sysconf(_SC_PAGESIZE);
+  if (page > 0)
+    mem_page_bytes = (size_t)page;
+  pthread_mutex_unlock(&mem_page_lock);
+  return 0;
+#else
+  return dir != NULL;
+#endif
+}
+
+/*************************************************************************
+mem_page_file_shared:
+   In: No arguments
+   Out: 1 if any block of a pageable pool is mapped from a page file, 0
+        otherwise.  The mappings are shared, so a forked process holding
+        them would write to the same pages as its parent.
+*************************************************************************/
+int mem_page_file_shared(void) {
+#ifdef MEM_UTIL_HAVE_PAGE_FILE
+  pthread_mutex_lock(&mem_page_lock);
+  int shared = (mem_page_mapped > 0);
+  pthread_mutex_unlock(&mem_page_lock);
+  return shared;
+#else
+  return 0;
+#endif
+}
+
+
+/*************************************************************************
+mem_page_out:
+   In: A mem_helper
+   Out: Number of bytes of its blocks mapped from the page file, whose
+        pages have been handed back to the system.  Their contents are
+        kept in the file and read back when next touched, so the pool can
+        be used as before.  Returns 0 for pools without such blocks.
+*************************************************************************/
+long long mem_page_out(struct mem_helper *mh) {
+  long long bytes = 0;
+#ifdef MEM_UTIL_HAVE_PAGE_FILE
+  if (mh == NULL || mh->arena)
+    return 0;
+#ifdef MEM_UTIL_SLABS
+  for (struct mem_slab *sl = mh->slabs; sl != NULL; sl = sl->next) {
+    if (sl->paged) {
+      page_file_release(sl, MEM_SLAB_BYTES);
+      bytes += MEM_SLAB_BYTES;
+    }
+  }
+#else
+  for (struct mem_helper *h = mh; h != NULL; h = h->next_helper) {
+    if (h->heap_paged > 0) {
+      page_file_release(h->heap_array, h->heap_paged);
+      bytes += h->heap_paged;
+    }
+  }
+#endif
+#else
+  UNUSED(mh);
+#endif
+  return bytes;
+}
+
+/*************************************************************************
+new_mem_helper:
    In: Size of a single element (including the leading "next" pointer)
        Number of elements to allocate at once
        Name of "arena" (used for statistics)
-   Out: Pointer to a new mem_helper struct.
+       Non-zero to map the block from the page file, if one is in use
+   Out: Pointer to a new mem_helper struct, not yet known to the memory
+        accounting.
 *************************************************************************/
 
-struct mem_helper *create_mem_named(size_t size, int length, char const *name) {
+static struct mem_helper *new_mem_helper(size_t size, int length,
+                                         char const *name, int pageable) {
   struct mem_helper *mh;
   mh = (struct mem_helper *)Malloc(sizeof(struct mem_helper));
 
@@ -335,14 +879,66 @@ struct mem_helper *create_mem_named(size_t size, int length, char const *name) {
   mh->buf_index = 0;
   mh->defunct = NULL;
   mh->next_helper = NULL;
+  mh->arena = 0;
+  mh->arena_retired = 0;
+  mh->bytes_reserved = 0;
+  mh->records_live = 0;
+  mh->bytes_huge = 0;
+  mh->bytes_peak = 0;
+  mh->heap_huge = 0;
+  mh->pageable = pageable;
+  mh->heap_paged = 0;
+  mh->usage = NULL;
+  mh->usage_next = NULL;
+  mh->usage_prev = NULL;
+
+#ifdef MEM_UTIL_SLABS
+  /* Slabs are mapped on first use */
+  UNUSED(name);
+  mh->heap_array = NULL;
+  mh->slabs = NULL;
+  mh->avail = NULL;
+  mh->empty_slabs = 0;
+  mh->slab_records =
+      (int)((MEM_SLAB_BYTES - MEM_SLAB_HEADER) / mh->record_size);
+  if (mh->slab_records < 1) {
+    free(mh);
+    return NULL;
+  }
+  return mh;
+#endif
 
 #ifndef MEM_UTIL_NO_POOLING
 #ifdef MEM_UTIL_TRACK_FREED
-  mh->heap_array =
-      (unsigned char *)Malloc(mh->buf_len * (mh->record_size + sizeof(int)));
-  memset(mh->heap_array, 0, mh->buf_len * (mh->record_size + sizeof(int)));
+  mh->bytes_reserved = mh->buf_len * (mh->record_size + sizeof(int));
+  mh->heap_array = (unsigned char *)Malloc(mh->bytes_reserved);
+  memset(mh->heap_array, 0, mh->bytes_reserved);
 #else
-  mh->heap_array = (unsigned char *)Malloc(mh->buf_len * mh->record_size);
+  mh->bytes_reserved = mh->buf_len * mh->record_size;
+  mh->heap_array = NULL;
+#ifdef MEM_UTIL_HAVE_PAGE_FILE
+  if (pageable) {
+    /* Fill whole pages, which are what is written out and read back */
+    size_t len = page_file_round(mh->bytes_reserved);
+    if ((mh->heap_array = (unsigned char *)page_file_map(NULL, len)) != NULL) {
+      mh->heap_paged = len;
+      mh->bytes_reserved = len;
+      mh->buf_len = (int)(len / mh->record_size);
+    }
+  }
+#endif
+  if (mh->heap_array == NULL) {
+    if (mem_huge_pages && mh->bytes_reserved >= MEM_HUGE_MIN_CHUNK) {
+      /* Fill whole huge pages rather than wasting the tail of the last one */
+      mh->bytes_reserved = (mh->bytes_reserved + MEM_HUGE_PAGE_BYTES - 1) &
+                           ~(long long)(MEM_HUGE_PAGE_BYTES - 1);
+      mh->buf_len = (int)(mh->bytes_reserved / mh->record_size);
+    }
+    mh->heap_array =
+        (unsigned char *)mem_alloc_large(mh->bytes_reserved, &mh->heap_huge);
+    if (mh->heap_huge)
+      mh->bytes_huge = mh->bytes_reserved;
+  }
 #endif
 
   if (mh->heap_array == NULL) {
@@ -374,6 +970,21 @@ struct mem_helper *create_mem_named(size_t size, int length, char const *name) {
   return mh;
 }
 
+/*************************************************************************
+create_mem_named:
+   In: Size of a single element (including the leading "next" pointer)
+       Number of elements to allocate at once
+       Name of "arena" (used for statistics and memory accounting)
+   Out: Pointer to a new mem_helper struct.
+*************************************************************************/
+
+struct mem_helper *create_mem_named(size_t size, int length, char const *name) {
+  struct mem_helper *mh = new_mem_helper(size, length, name, 0);
+  if (mh != NULL)
+    mem_usage_register(mh, name);
+  return mh;
+}
+
 /*************************************************************************
 create_mem:
    In: Size of a single element (including the leading "next" pointer)
@@ -385,14 +996,153 @@ struct mem_helper *create_mem(size_t size, int length) {
 }
 
 /*************************************************************************
-mem_get:
-   In: A mem_helper
-   Out: A pointer to new storage of the appropriate size.
-   Note: Use this instead of "Malloc".
+create_mem_pageable:
+   In: Size of a single element (including the leading "next" pointer)
+       Number of elements to allocate at once
+       Name of "arena" (used for statistics and memory accounting)
+   Out: Pointer to a new mem_helper struct whose blocks are mapped from
+        the page file while one is in use, so that mem_page_out can
+        release them.  Otherwise the same as create_mem_named.
 *************************************************************************/
+struct mem_helper *create_mem_pageable(size_t size, int length,
+                                       char const *name) {
+  struct mem_helper *mh = new_mem_helper(size, length, name, 1);
+  if (mh != NULL)
+    mem_usage_register(mh, name);
+  return mh;
+}
 
-void *mem_get(struct mem_helper *mh) {
+/*************************************************************************
+create_arena_named:
+   In: Size of a single element (including the leading "next" pointer)
+       Number of elements to allocate at once
+       Name of "arena" (used for statistics and memory accounting)
+   Out: Pointer to a new mem_helper struct that hands out records by
+        bumping a pointer through one contiguous block.  mem_put and
+        mem_put_list on it do nothing; everything it handed out is
+        reclaimed at once by mem_arena_reset.  Meant for scratch records
+        whose lifetime is bounded by a single well-defined operation.
+   Note: With MEM_UTIL_NO_POOLING this is an ordinary pool, so that
+         memory checkers still see every record.
+*************************************************************************/
+
+struct mem_helper *create_arena_named(size_t size, int length,
+                                      char const *name) {
 #ifdef MEM_UTIL_NO_POOLING
+  return create_mem_named(size, length, name);
+#else
+  struct mem_helper *mh;
+  mh = (struct mem_helper *)Malloc(sizeof(struct mem_helper));
+  if (mh == NULL)
+    return NULL;
+  memset(mh, 0, sizeof(struct mem_helper));
+
+  mh->arena = 1;
+  mh->buf_len = (length > 0) ? length : 128;
+  mh->record_size =
+      (size > (int)sizeof(void *)) ? (size_t)size : sizeof(void *);
+  mh->bytes_reserved = mh->buf_len * mh->record_size;
+  mh->heap_array = (unsigned char *)Malloc(mh->bytes_reserved);
+  if (mh->heap_array == NULL) {
+    free(mh);
+    return NULL;
+  }
+
+  mem_usage_register(mh, name);
+  return mh;
+#endif
+}
+
+/*************************************************************************
+arena_get:
+   In: An arena
+   Out: A pointer to the next unused record of the current block, which is
+        retired and replaced by a fresh one when full.
+*************************************************************************/
+
+static void *arena_get(struct mem_helper *mh) {
+  if (mh->buf_index >= mh->buf_len) {
+    unsigned char *block =
+        (unsigned char *)Malloc(mh->buf_len * mh->record_size);
+    if (block == NULL)
+      return NULL;
+    if (mh->heap_array != NULL) {
+      struct abstract_list *retired = (struct abstract_list *)mh->heap_array;
+      retired->next = mh->defunct;
+      mh->defunct = retired;
+      mh->arena_retired += mh->buf_len;
+    }
+    mh->heap_array = block;
+    mh->buf_index = 0;
+    mh->bytes_reserved += mh->buf_len * mh->record_size;
+    note_peak(mh);
+  }
+  return mh->heap_array + mh->record_size * mh->buf_index++;
+}
+
+/*************************************************************************
+mem_arena_reset:
+   In: A mem_helper
+   Out: No return value.  If the helper is an arena, every record it has
+        handed out is reclaimed.  When the last cycle overflowed the first
+        block, the blocks are merged into one large enough for the whole
+        cycle, so that the next cycle stays contiguous.  Does nothing for
+        ordinary pools.
+*************************************************************************/
+
+void mem_arena_reset(struct mem_helper *mh) {
+  if (!mh->arena)
+    return;
+
+  if (mh->defunct != NULL) {
+    int needed = mh->arena_retired + mh->buf_len;
+    unsigned char *block = (unsigned char *)Malloc(needed * mh->record_size);
+    while (mh->defunct != NULL) {
+      struct abstract_list *next = mh->defunct->next;
+      free(mh->defunct);
+      mh->defunct = next;
+    }
+    if (block != NULL) {
+      free(mh->heap_array);
+      mh->heap_array = block;
+      mh->buf_len = needed;
+    }
+    mh->arena_retired = 0;
+    mh->bytes_reserved = mh->buf_len * mh->record_size;
+    note_peak(mh);
+  }
+  mh->buf_index = 0;
+  mh->records_live = 0;
+}
+
+#ifndef MEM_UTIL_NO_POOLING
+/* Release the block of a pool that is not an arena */
+static void free_block(struct mem_helper *mh) {
+#ifdef MEM_UTIL_HAVE_PAGE_FILE
+  if (mh->heap_paged > 0) {
+    page_file_unmap(mh->heap_array, mh->heap_paged);
+    return;
+  }
+#endif
+  free(mh->heap_array);
+}
+#endif
+
+/*************************************************************************
+mem_get_record:
+   In: A mem_helper
+   Out: A pointer to new storage of the appropriate size.  The record is
+        not counted as live; mem_get does that.
+*************************************************************************/
+
+static void *mem_get_record(struct mem_helper *mh) {
+  if (mh->arena)
+    return arena_get(mh);
+#if defined(MEM_UTIL_SLABS)
+  return slab_get(mh);
+#elif defined(MEM_UTIL_NO_POOLING)
+  mh->bytes_reserved += mh->record_size;
+  note_peak(mh);
   return malloc(mh->record_size);
 #else
   if (mh->defunct != NULL) {
@@ -470,32 +1220,59 @@ void *mem_get(struct mem_helper *mh) {
     unsigned char *temp;
 #ifdef MEM_UTIL_KEEP_STATS
     struct mem_stats *s = mh->stats;
-    mhnext = create_mem_named(mh->record_size, mh->buf_len, s->name);
+    mhnext = new_mem_helper(mh->record_size, mh->buf_len, s->name,
+                            mh->pageable);
     ++s->non_head_arenas;
     if (s->non_head_arenas > s->max_non_head_arenas)
       s->max_non_head_arenas = s->non_head_arenas;
     ++s->total_non_head_arenas;
 #else
-    mhnext = create_mem(mh->record_size, mh->buf_len);
+    mhnext = new_mem_helper(mh->record_size, mh->buf_len, NULL, mh->pageable);
 #endif
     if (mhnext == NULL)
       return NULL;
 
+    /* The chained helper is not accounted separately; its block counts
+     * towards the head of the chain */
+    mh->bytes_reserved += mhnext->bytes_reserved;
+    mh->bytes_huge += mhnext->bytes_huge;
+    note_peak(mh);
+
     /* Swap contents of this mem_helper with new one */
     /* Keeps mh at top of list but with freshly allocated space */
     mhnext->next_helper = mh->next_helper;
     temp = mhnext->heap_array;
     mhnext->heap_array = mh->heap_array;
     mh->heap_array = temp;
+    int temp_huge = mhnext->heap_huge;
+    mhnext->heap_huge = mh->heap_huge;
+    mh->heap_huge = temp_huge;
+    size_t temp_paged = mhnext->heap_paged;
+    mhnext->heap_paged = mh->heap_paged;
+    mh->heap_paged = temp_paged;
     mhnext->buf_index = mh->buf_index;
     mh->next_helper = mhnext;
 
     mh->buf_index = 0;
-    return mem_get(mh);
+    return mem_get_record(mh);
   }
 #endif
 }
 
+/*************************************************************************
+mem_get:
+   In: A mem_helper
+   Out: A pointer to new storage of the appropriate size.
+   Note: Use this instead of "Malloc".
+*************************************************************************/
+
+void *mem_get(struct mem_helper *mh) {
+  void *data = mem_get_record(mh);
+  if (data != NULL)
+    ++mh->records_live;
+  return data;
+}
+
 /*************************************************************************
 mem_put:
    In: A mem_helper
@@ -506,11 +1283,19 @@ mem_put:
 *************************************************************************/
 
 void mem_put(struct mem_helper *mh, void *defunct) {
-#ifdef MEM_UTIL_NO_POOLING
+  if (mh->arena)
+    return;
+#if defined(MEM_UTIL_SLABS)
+  UNUSED(mh);
+  slab_put(defunct);
+#elif defined(MEM_UTIL_NO_POOLING)
+  --mh->records_live;
+  mh->bytes_reserved -= mh->record_size;
   free(defunct);
   return;
 #else
   struct abstract_list *data = (struct abstract_list *)defunct;
+  --mh->records_live;
 #ifdef MEM_UTIL_TRACK_FREED
   int *ptr = (int *)data;
   if (ptr[-1] == 0) {
@@ -550,10 +1335,21 @@ void mem_put_list(struct mem_helper *mh, void *defunct) {
   struct abstract_list *data = (struct abstract_list *)defunct;
   struct abstract_list *alp;
 
-#ifdef MEM_UTIL_NO_POOLING
+  if (mh->arena)
+    return;
+#if defined(MEM_UTIL_SLABS)
+  struct abstract_list *alpNext;
+  UNUSED(mh);
+  for (alp = data; alp != NULL; alp = alpNext) {
+    alpNext = alp->next;
+    slab_put(alp);
+  }
+#elif defined(MEM_UTIL_NO_POOLING)
   struct abstract_list *alpNext;
   for (alp = data; alp != NULL; alp = alpNext) {
     alpNext = alp->next;
+    --mh->records_live;
+    mh->bytes_reserved -= mh->record_size;
     free(alp);
   }
 #else
@@ -578,6 +1374,7 @@ void mem_put_list(struct mem_helper *mh, void *defunct) {
   int count = 1;
   for (alp = data; alp->next != NULL; alp = alp->next)
     ++count;
+  mh->records_live -= count;
   struct mem_stats *s = mh->stats;
   s->cur_free += count;
   s->cur_alloc -= count;
@@ -588,8 +1385,10 @@ void mem_put_list(struct mem_helper *mh, void *defunct) {
       mem_max_overall_wastage)
     mem_max_overall_wastage = mem_cur_overall_wastage;
 #else
-  for (alp = data; alp->next != NULL; alp = alp->next) {
-  }
+  int count = 1;
+  for (alp = data; alp->next != NULL; alp = alp->next)
+    ++count;
+  mh->records_live -= count;
 #endif
 
   alp->next = mh->defunct;
@@ -597,6 +1396,173 @@ void mem_put_list(struct mem_helper *mh, void *defunct) {
 #endif
 }
 
+#if !defined(MEM_UTIL_SLABS) && !defined(MEM_UTIL_NO_POOLING)
+/* One block of a pool chain, as seen by mem_compact */
+struct mem_chunk {
+  unsigned char *start;     /* First byte of the block */
+  unsigned char *end;       /* End of the records handed out so far */
+  struct mem_helper *owner; /* Helper holding the block */
+  int records;              /* Records handed out from the block */
+  int free_records;         /* How many of them are on the free list */
+};
+
+static int mem_chunk_cmp(void const *a, void const *b) {
+  unsigned char *sa = ((struct mem_chunk const *)a)->start;
+  unsigned char *sb = ((struct mem_chunk const *)b)->start;
+  return (sa < sb) ? -1 : (sa > sb);
+}
+
+static struct mem_chunk *mem_chunk_find(struct mem_chunk *chunks, int n,
+                                        void *data) {
+  unsigned char *p = (unsigned char *)data;
+  int lo = 0, hi = n - 1;
+  while (lo <= hi) {
+    int mid = (lo + hi) / 2;
+    if (p < chunks[mid].start)
+      hi = mid - 1;
+    else if (p >= chunks[mid].end)
+      lo = mid + 1;
+    else
+      return &chunks[mid];
+  }
+  return NULL;
+}
+#endif
+
+/*************************************************************************
+mem_compact:
+   In: A mem_helper
+   Out: Number of bytes handed back to the system.  Blocks all of whose
+        records are on this helper's free list are released; if that
+        holds for the block currently being carved up, it is rewound
+        instead.  Live records are never moved, so this is safe at any
+        point, but it only pays off after a large depopulation.  Records
+        that were mem_put into a different helper keep their block alive.
+*************************************************************************/
+
+long long mem_compact(struct mem_helper *mh) {
+  long long released = 0;
+  if (mh == NULL || mh->arena)
+    return 0;
+
+#if defined(MEM_UTIL_SLABS)
+  struct mem_slab *s, *snext;
+  for (s = mh->slabs; s != NULL; s = snext) {
+    snext = s->next;
+    if (s->live == 0) {
+      slab_destroy(s);
+      released += MEM_SLAB_BYTES;
+    }
+  }
+#elif !defined(MEM_UTIL_NO_POOLING)
+  if (mh->defunct == NULL)
+    return 0;
+
+#ifdef MEM_UTIL_TRACK_FREED
+  size_t stride = mh->record_size + sizeof(int);
+#else
+  size_t stride = mh->record_size;
+#endif
+
+  int n = 0;
+  for (struct mem_helper *h = mh; h != NULL; h = h->next_helper)
+    ++n;
+  struct mem_chunk *chunks =
+      (struct mem_chunk *)Malloc(n * sizeof(struct mem_chunk));
+  if (chunks == NULL)
+    return 0;
+
+  n = 0;
+  for (struct mem_helper *h = mh; h != NULL; h = h->next_helper) {
+    struct mem_chunk *c = &chunks[n++];
+    c->start = h->heap_array;
+    c->end = h->heap_array + h->buf_index * stride;
+    c->owner = h;
+    c->records = h->buf_index;
+    c->free_records = 0;
+  }
+  qsort(chunks, n, sizeof(struct mem_chunk), mem_chunk_cmp);
+
+  struct abstract_list *alp;
+  for (alp = mh->defunct; alp != NULL; alp = alp->next) {
+    struct mem_chunk *c = mem_chunk_find(chunks, n, alp);
+    if (c != NULL)
+      ++c->free_records;
+  }
+
+  /* Drop the free records of every wholly idle block from the free list */
+  struct abstract_list **pp = &mh->defunct;
+  while ((alp = *pp) != NULL) {
+    struct mem_chunk *c = mem_chunk_find(chunks, n, alp);
+    if (c != NULL && c->records > 0 && c->free_records == c->records)
+      *pp = alp->next;
+    else
+      pp = &alp->next;
+  }
+
+  for (int i = 0; i < n; ++i) {
+    struct mem_chunk *c = &chunks[i];
+    if (c->records == 0 || c->free_records != c->records)
+      continue;
+    struct mem_helper *h = c->owner;
+    if (h == mh) {
+      mh->buf_index = 0;
+      continue;
+    }
+
+    struct mem_helper *prev = mh;
+    while (prev->next_helper != h)
+      prev = prev->next_helper;
+    prev->next_helper = h->next_helper;
+#ifdef MEM_UTIL_KEEP_STATS
+    struct mem_stats *st = mh->stats;
+    --st->num_arenas_unfreed;
+    --st->non_head_arenas;
+    st->unfreed_length -= h->buf_len;
+    st->cur_free -= h->buf_len;
+    mem_cur_overall_wastage -= mh->record_size * h->buf_len;
+#endif
+    released += (long long)h->buf_len * stride;
+    if (h->heap_huge)
+      mh->bytes_huge -= (long long)h->buf_len * stride;
+    free_block(h);
+    free(h);
+  }
+  free(chunks);
+  mh->bytes_reserved -= released;
+#endif
+
+  return released;
+}
+
+/*************************************************************************
+mem_first_touch:
+   In: A mem_helper
+       Maximum number of bytes to touch
+   Out: No return value.  The unused records at the start of the current
+        block are written to, one byte per page, up to max_bytes, so that
+        the system backs those pages with memory local to the calling
+        thread rather than to whichever thread first uses them.  Does
+        nothing for pools without a preallocated block.
+*************************************************************************/
+
+void mem_first_touch(struct mem_helper *mh, size_t max_bytes) {
+  if (mh == NULL || mh->heap_array == NULL)
+    return;
+#ifdef MEM_UTIL_TRACK_FREED
+  size_t stride = mh->record_size + sizeof(int);
+#else
+  size_t stride = mh->record_size;
+#endif
+  size_t start = (size_t)mh->buf_index * stride;
+  size_t end = (size_t)mh->buf_len * stride;
+  if (end - start > max_bytes)
+    end = start + max_bytes;
+  volatile unsigned char *block = mh->heap_array;
+  for (size_t offset = start; offset < end; offset += MEM_TOUCH_STRIDE)
+    block[offset] = 0;
+}
+
 /*************************************************************************
 delete_mem:
    In: A mem_helper
@@ -608,6 +1574,21 @@ delete_mem:
 void delete_mem(struct mem_helper *mh) {
   if (mh == NULL)
     return;
+  mem_usage_unregister(mh);
+  if (mh->arena) {
+    while (mh->defunct != NULL) {
+      struct abstract_list *next = mh->defunct->next;
+      free(mh->defunct);
+      mh->defunct = next;
+    }
+    free(mh->heap_array);
+    free(mh);
+    return;
+  }
+#ifdef MEM_UTIL_SLABS
+  while (mh->slabs != NULL)
+    slab_destroy(mh->slabs);
+#endif
 #ifndef MEM_UTIL_NO_POOLING
 #ifdef MEM_UTIL_KEEP_STATS
   struct mem_stats *s = mh->stats;
@@ -625,7 +1606,7 @@ void delete_mem(struct mem_helper *mh) {
   if (mh->next_helper)
     delete_mem(mh->next_helper);
 #endif
-  free(mh->heap_array);
+  free_block(mh);
 #endif
   free(mh);
 }
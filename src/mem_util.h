@@ -82,6 +82,31 @@ struct abstract_list {
   struct abstract_list *next;
 };
 
+#ifdef MEM_UTIL_SLABS
+#if defined(MEM_UTIL_NO_POOLING) || defined(MEM_UTIL_TRACK_FREED) ||           \
+    defined(MEM_UTIL_ZERO_FREED) || defined(MEM_UTIL_KEEP_STATS)
+#error "MEM_UTIL_SLABS cannot be combined with the other MEM_UTIL_ options"
+#endif
+
+/* Size (and alignment) of one slab.  The slab owning a record is found by
+ * rounding the record's address down to a multiple of this. */
+#define MEM_SLAB_BYTES (256 * 1024)
+
+struct mem_slab;
+#endif
+
+/* Huge page support: blocks of at least MEM_HUGE_MIN_CHUNK bytes are
+ * rounded up to whole huge pages and allocated on them when enabled with
+ * mem_use_huge_pages.  Falls back to ordinary pages where unavailable. */
+#define MEM_HUGE_PAGE_BYTES (2 * 1024 * 1024)
+#define MEM_HUGE_MIN_CHUNK (256 * 1024)
+
+/* mem_first_touch writes one byte every this many bytes, the smallest page
+ * size in use */
+#define MEM_TOUCH_STRIDE 4096
+
+struct mem_usage;
+
 /* Data structure to allocate blocks of memory for a specific size of struct */
 struct mem_helper {
   int buf_len;               /* Number of elements to allocate at once  */
@@ -91,8 +116,34 @@ struct mem_helper {
   struct abstract_list *defunct; /* Linked list of elements that may be reused
                                     for next memory request */
   struct mem_helper *next_helper; /* Next (fully-used) mem_helper */
+  int arena;                 /* Set for bump-pointer arenas (see
+                                create_arena_named); defunct then holds the
+                                full blocks awaiting mem_arena_reset */
+  int arena_retired;         /* Records in those full blocks */
 #ifdef MEM_UTIL_KEEP_STATS
   struct mem_stats *stats;
+#endif
+  /* Memory accounting, always kept.  Counters live in the helper itself so
+   * that storages updated from different threads never share a counter; they
+   * are summed per pool name by mem_usage_collect. */
+  long long bytes_reserved;       /* Bytes obtained for this pool's records */
+  long long records_live;         /* Records handed out and not returned */
+  long long bytes_huge;           /* Part of bytes_reserved on huge pages */
+  long long bytes_peak;           /* Largest bytes_reserved so far */
+  int heap_huge;                  /* Set if heap_array is on huge pages */
+  int pageable;                   /* Blocks go in the page file, if one is in
+                                     use (see mem_use_page_file) */
+  size_t heap_paged;              /* Length of heap_array if it is mapped
+                                     from the page file, else 0 */
+  struct mem_usage *usage;        /* Accounting entry (NULL for chained
+                                     helpers, which count towards the head) */
+  struct mem_helper *usage_next;  /* Other helpers with the same name */
+  struct mem_helper **usage_prev;
+#ifdef MEM_UTIL_SLABS
+  struct mem_slab *slabs; /* All slabs owned by this helper */
+  struct mem_slab *avail; /* Slabs with at least one free record */
+  int slab_records;       /* Records per slab */
+  int empty_slabs;        /* Slabs with no live records */
 #endif
 };
 
@@ -104,8 +155,42 @@ void mem_dump_stats(FILE *out);
   } while (0)
 #endif
 
+/* Snapshot of the memory used by all pools sharing one name */
+struct mem_usage_info {
+  char const *name;       /* Pool name, NULL for pools made by create_mem */
+  size_t record_size;     /* Size of one record */
+  int helpers;            /* Number of live pools with this name */
+  long long bytes_reserved; /* Bytes currently held by these pools */
+  long long records_live; /* Records currently in use */
+  long long bytes_huge;   /* Part of bytes_reserved backed by huge pages */
+  long long bytes_peak;   /* Sum of the high-water marks of these pools */
+};
+
+int mem_usage_collect(struct mem_usage_info *out, int max_entries);
+long long mem_usage_total_bytes(void);
+
+void mem_use_huge_pages(int enable);
+void *mem_alloc_large(size_t size, int *huge);
+
+/* Page file support: the blocks of pools made with create_mem_pageable are
+ * mapped from a scratch file once one is opened with mem_use_page_file, so
+ * that mem_page_out can hand their pages back to the system.  They are read
+ * back from the file when next touched.  The mappings are shared, so a
+ * process must not fork while mem_page_file_shared is set. */
+int mem_use_page_file(char const *dir);
+int mem_page_file_shared(void);
+
+long long mem_page_out(struct mem_helper *mh);
+
 struct mem_helper *create_mem_named(size_t size, int length, char const *name);
 struct mem_helper *create_mem(size_t size, int length);
+struct mem_helper *create_mem_pageable(size_t size, int length,
+                                       char const *name);
+struct mem_helper *create_arena_named(size_t size, int length,
+                                      char const *name);
+void mem_arena_reset(struct mem_helper *mh);
+void mem_first_touch(struct mem_helper *mh, size_t max_bytes);
+long long mem_compact(struct mem_helper *mh);
 void *mem_get(struct mem_helper *mh);
 void mem_put(struct mem_helper *mh, void *defunct);
 void mem_put_list(struct mem_helper *mh, void *defunct);
@@ -0,0 +1,577 @@
+/******************************************************************************
+ *
+ * Copyright (C) 2006-2017 by
+ * The Salk Institute for Biological Studies and
+ * Pittsburgh Supercomputing Center, Carnegie Mellon University
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ *
+******************************************************************************/
+
+/**************************************************************************\
+** File: metrics.c                                                        **
+**                                                                        **
+** Purpose: Periodic snapshots of the progress, populations, memory and   **
+**    output backlog of a running simulation (see metrics.h).             **
+\**************************************************************************/
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+#include "logging.h"
+#include "mcell_misc.h"
+#include "mem_util.h"
+#include "metrics.h"
+#include "phase_profile.h"
+#include "rng.h"
+#include "thread_util.h"
+#include "version_info.h"
+
+#define METRICS_MAX_POOLS 64
+
+/* Everything a snapshot reports, gathered before the file is written */
+struct metrics_snapshot {
+  double time;                 /* Seconds since the epoch */
+  double run_seconds;          /* Seconds since the first snapshot */
+  double iteration_rate;       /* Iterations per second since the last one,
+                                  or since the first if that was too recent */
+  double since_checkpoint;     /* Seconds since the last checkpoint, or since
+                                  the first snapshot if there was none */
+  size_t queued_bytes;         /* Output waiting for the background writer */
+  int queued_files;
+  int n_pools;
+  struct mem_usage_info pools[METRICS_MAX_POOLS];
+};
+
+static double seconds_between(struct timeval const *from,
+                              struct timeval const *to) {
+  return (double)(to->tv_sec - from->tv_sec) +
+         (double)(to->tv_usec - from->tv_usec) * 1e-6;
+}
+
+/*************************************************************************
+print_quoted:
+  In: f: file to write to
+      s: a species or pool name
+  Out: s is written in double quotes, escaped for both JSON strings and
+       Prometheus label values
+*************************************************************************/
+static void print_quoted(FILE *f, char const *s) {
+  fputc('"', f);
+  for (; *s != '\0'; ++s) {
+    if (*s == '"' || *s == '\\')
+      fputc('\\', f);
+    if (*s == '\n')
+      fputs("\\n", f);
+    else
+      fputc(*s, f);
+  }
+  fputc('"', f);
+}
+
+/* Species whose population is reported: molecules, not surface classes or
+ * the ALL_*MOLECULES wildcards */
+static int is_molecule(struct volume const *world,
+                       struct species const *spec) {
+  return (spec->flags & IS_SURFACE) == 0 && spec != world->all_mols &&
+         spec != world->all_volume_mols && spec != world->all_surface_mols;
+}
+
+static void print_prom_header(FILE *f, char const *name, char const *type,
+                              char const *help) {
+  fprintf(f, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+/*************************************************************************
+write_prometheus:
+  In: f: file to write to
+      world: simulation state
+      snap: the metrics
+  Out: the metrics are written in the Prometheus text exposition format
+*************************************************************************/
+static void write_prometheus(FILE *f, struct volume *world,
+                             struct metrics_snapshot const *snap) {
+  print_prom_header(f, "mcell_iterations", "counter", "Iterations run.");
+  fprintf(f, "mcell_iterations %lld\n", world->current_iterations);
+  print_prom_header(f, "mcell_iterations_total", "gauge",
+                    "Iterations the run will take.");
+  fprintf(f, "mcell_iterations_total %lld\n", world->iterations);
+  print_prom_header(f, "mcell_iteration_rate", "gauge",
+                    "Iterations per second since the last snapshot.");
+  fprintf(f, "mcell_iteration_rate %.6g\n", snap->iteration_rate);
+  print_prom_header(f, "mcell_run_seconds", "counter",
+                    "Seconds the run has been monitored.");
+  fprintf(f, "mcell_run_seconds %.3f\n", snap->run_seconds);
+  print_prom_header(f, "mcell_seconds_since_checkpoint", "gauge",
+                    "Seconds since the last checkpoint.");
+  fprintf(f, "mcell_seconds_since_checkpoint %.3f\n", snap->since_checkpoint);
+
+  print_prom_header(f, "mcell_molecules", "gauge", "Live molecules.");
+  for (int i = 0; i < world->n_species; i++) {
+    struct species *spec = world->species_list[i];
+    if (!is_molecule(world, spec))
+      continue;
+    fputs("mcell_molecules{species=", f);
+    print_quoted(f, spec->sym->name);
+    fprintf(f, "} %u\n", spec->population);
+  }
+
+  print_prom_header(f, "mcell_pool_bytes", "gauge",
+                    "Bytes held by the memory pools of each name.");
+  for (int i = 0; i < snap->n_pools; i++) {
+    fputs("mcell_pool_bytes{pool=", f);
+    print_quoted(f, snap->pools[i].name ? snap->pools[i].name : "(unnamed)");
+    fprintf(f, "} %lld\n", snap->pools[i].bytes_reserved);
+  }
+
+  print_prom_header(f, "mcell_output_queue_bytes", "gauge",
+                    "Output waiting to be written.");
+  fprintf(f, "mcell_output_queue_bytes %zu\n", snap->queued_bytes);
+  print_prom_header(f, "mcell_output_queue_files", "gauge",
+                    "Output files waiting to be written.");
+  fprintf(f, "mcell_output_queue_files %d\n", snap->queued_files);
+}
+
+/*************************************************************************
+write_json:
+  In: f: file to write to
+      world: simulation state
+      snap: the metrics
+  Out: the metrics are written as a JSON object
+*************************************************************************/
+static void write_json(FILE *f, struct volume *world,
+                       struct metrics_snapshot const *snap) {
+  fprintf(f, "{\n  \"time\": %.3f,\n", snap->time);
+  fprintf(f, "  \"seed\": %d,\n", world->seed_seq);
+  fprintf(f, "  \"iterations\": %lld,\n", world->current_iterations);
+  fprintf(f, "  \"iterations_total\": %lld,\n", world->iterations);
+  fprintf(f, "  \"iteration_rate\": %.6g,\n", snap->iteration_rate);
+  fprintf(f, "  \"run_seconds\": %.3f,\n", snap->run_seconds);
+  fprintf(f, "  \"seconds_since_checkpoint\": %.3f,\n",
+          snap->since_checkpoint);
+
+  fputs("  \"molecules\": {", f);
+  int first = 1;
+  for (int i = 0; i < world->n_species; i++) {
+    struct species *spec = world->species_list[i];
+    if (!is_molecule(world, spec))
+      continue;
+    fputs(first ? "\n    " : ",\n    ", f);
+    print_quoted(f, spec->sym->name);
+    fprintf(f, ": %u", spec->population);
+    first = 0;
+  }
+  fputs(first ? "},\n" : "\n  },\n", f);
+
+  fputs("  \"pools\": {", f);
+  for (int i = 0; i < snap->n_pools; i++) {
+    fputs(i ? ",\n    " : "\n    ", f);
+    print_quoted(f, snap->pools[i].name ? snap->pools[i].name : "(unnamed)");
+    fprintf(f, ": {\"bytes\": %lld, \"records\": %lld}",
+            snap->pools[i].bytes_reserved, snap->pools[i].records_live);
+  }
+  fputs(snap->n_pools ? "\n  },\n" : "},\n", f);
+
+  fprintf(f, "  \"output_queue\": {\"bytes\": %zu, \"files\": %d}\n}\n",
+          snap->queued_bytes, snap->queued_files);
+}
+
+/*************************************************************************
+open_replacement:
+  In: path: file to replace
+      tmp_name: set to the name of the file actually opened
+  Out: the file <path>.tmp opened for writing, or NULL (after a warning)
+*************************************************************************/
+static FILE *open_replacement(char const *path, char **tmp_name) {
+  *tmp_name = CHECKED_SPRINTF("%s.tmp", path);
+  FILE *f = fopen(*tmp_name, "w");
+  if (f == NULL) {
+    mcell_warn("Could not write the metrics file '%s'.", *tmp_name);
+    free(*tmp_name);
+  }
+  return f;
+}
+
+/*************************************************************************
+finish_replacement:
+  In: f: file opened by open_replacement
+      path: file to replace
+      tmp_name: name f was opened under, which is freed
+  Out: 0 on success, 1 if the file could not be written (after a warning).
+       path is replaced in one step, so that readers never see a partial
+       file.
+*************************************************************************/
+static int finish_replacement(FILE *f, char const *path, char *tmp_name) {
+  if (fclose(f) != 0 || rename(tmp_name, path) != 0) {
+    mcell_warn("Could not write the metrics file '%s'.", path);
+    remove(tmp_name);
+    free(tmp_name);
+    return 1;
+  }
+  free(tmp_name);
+  return 0;
+}
+
+/*************************************************************************
+metrics_write:
+  In: world: simulation state
+  Out: 0 on success, 1 if the metrics file could not be written (after a
+       warning).  The file is replaced in one step, so that readers never
+       see a partial snapshot.
+*************************************************************************/
+int metrics_write(struct volume *world) {
+  if (world->metrics_file == NULL)
+    return 0;
+
+  struct timeval now;
+  gettimeofday(&now, NULL);
+  if (world->metrics_start_time.tv_sec == 0) {
+    world->metrics_start_time = now;
+    world->metrics_start_iteration = world->current_iterations;
+    world->last_metrics_time = now;
+    world->last_metrics_iteration = world->current_iterations;
+  }
+
+  struct metrics_snapshot snap;
+  snap.time = (double)now.tv_sec + (double)now.tv_usec * 1e-6;
+  snap.run_seconds = seconds_between(&world->metrics_start_time, &now);
+  double interval = seconds_between(&world->last_metrics_time, &now);
+  if (interval >= world->metrics_interval)
+    snap.iteration_rate =
+        (double)(world->current_iterations - world->last_metrics_iteration) /
+        interval;
+  else if (snap.run_seconds > 0)
+    snap.iteration_rate =
+        (double)(world->current_iterations - world->metrics_start_iteration) /
+        snap.run_seconds;
+  else
+    snap.iteration_rate = 0.0;
+  snap.since_checkpoint =
+      seconds_between(world->last_checkpoint_time.tv_sec != 0
+                          ? &world->last_checkpoint_time
+                          : &world->metrics_start_time,
+                      &now);
+  snap.queued_bytes =
+      output_writer_queued(world->output_writer, &snap.queued_files);
+  snap.n_pools = mem_usage_collect(snap.pools, METRICS_MAX_POOLS);
+  if (snap.n_pools > METRICS_MAX_POOLS)
+    snap.n_pools = METRICS_MAX_POOLS;
+
+  world->last_metrics_time = now;
+  world->last_metrics_iteration = world->current_iterations;
+
+  char *tmp_name;
+  FILE *f = open_replacement(world->metrics_file, &tmp_name);
+  if (f == NULL)
+    return 1;
+  size_t len = strlen(world->metrics_file);
+  if (len > 5 && strcmp(world->metrics_file + len - 5, ".prom") == 0)
+    write_prometheus(f, world, &snap);
+  else
+    write_json(f, world, &snap);
+  return finish_replacement(f, world->metrics_file, tmp_name);
+}
+
+/*************************************************************************
+metrics_update:
+  In: world: simulation state
+  Out: the metrics file is rewritten if -metrics_interval seconds have
+       passed since the last snapshot
+*************************************************************************/
+void metrics_update(struct volume *world) {
+  if (world->metrics_file == NULL)
+    return;
+
+  if (world->metrics_start_time.tv_sec != 0) {
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    if (seconds_between(&world->last_metrics_time, &now) <
+        world->metrics_interval)
+      return;
+  }
+  metrics_write(world);
+}
+
+/*************************************************************************
+hash_file:
+  In: path: file to hash
+      hash: set to the FNV-1a hash of the file's contents
+  Out: 0 on success, 1 if the file could not be read
+*************************************************************************/
+static int hash_file(char const *path, unsigned long long *hash) {
+  FILE *f = fopen(path, "rb");
+  if (f == NULL)
+    return 1;
+  unsigned long long h = 14695981039346656037ULL;
+  unsigned char buf[65536];
+  size_t n;
+  while ((n = fread(buf, 1, sizeof(buf), f)) > 0) {
+    for (size_t i = 0; i < n; i++) {
+      h ^= buf[i];
+      h *= 1099511628211ULL;
+    }
+  }
+  int failed = ferror(f);
+  fclose(f);
+  *hash = h;
+  return failed;
+}
+
+/* Prints "name": true/false for a build option */
+static void print_flag(FILE *f, char const *name, int on, int last) {
+  fprintf(f, "    \"%s\": %s%s\n", name, on ? "true" : "false", last ? "" : ",");
+}
+
+/*************************************************************************
+write_bench_build:
+  In: f: file to write to
+  Out: the build configuration and the instruction sets the build targets
+       and the CPU supports are written as the "build" and "isa" members of
+       a JSON object
+*************************************************************************/
+static void write_bench_build(FILE *f) {
+  fputs("  \"build\": {\n    \"version\": ", f);
+  print_quoted(f, mcell_version);
+  fputs(",\n    \"revision\": ", f);
+  print_quoted(f, mcell_revision);
+  fputs(",\n    \"compiler\": ", f);
+  print_quoted(f, mcell_build_compiler);
+  fputs(",\n    \"cflags\": ", f);
+  print_quoted(f, mcell_build_cflags);
+  fputs(",\n", f);
+#ifdef __OPTIMIZE__
+  print_flag(f, "optimized", 1, 0);
+#else
+  print_flag(f, "optimized", 0, 0);
+#endif
+#ifdef MCELL_PHASE_PROFILE
+  print_flag(f, "phase_profile", 1, 0);
+#else
+  print_flag(f, "phase_profile", 0, 0);
+#endif
+#ifdef SCHED_UTIL_KEEP_STATS
+  print_flag(f, "sched_stats", 1, 0);
+#else
+  print_flag(f, "sched_stats", 0, 0);
+#endif
+#ifdef MEM_UTIL_SLABS
+  print_flag(f, "mem_slabs", 1, 0);
+#else
+  print_flag(f, "mem_slabs", 0, 0);
+#endif
+#ifdef USE_COUNTER_RNG
+  print_flag(f, "counter_rng", 1, 0);
+#else
+  print_flag(f, "counter_rng", 0, 0);
+#endif
+#ifdef MCELL_TARGET_CLONES
+  print_flag(f, "target_clones", 1, 0);
+#else
+  print_flag(f, "target_clones", 0, 0);
+#endif
+#ifdef MCELL_MPI
+  print_flag(f, "mpi", 1, 1);
+#else
+  print_flag(f, "mpi", 0, 1);
+#endif
+  fputs("  },\n", f);
+
+  char const *arch = "unknown";
+  char const *target = "baseline";
+#if defined(__x86_64__)
+  arch = "x86_64";
+#elif defined(__i386__)
+  arch = "i386";
+#elif defined(__aarch64__)
+  arch = "aarch64";
+#elif defined(__powerpc64__)
+  arch = "ppc64";
+#endif
+#if defined(__AVX512F__)
+  target = "avx512f";
+#elif defined(__AVX2__)
+  target = "avx2";
+#elif defined(__AVX__)
+  target = "avx";
+#elif defined(__SSE4_2__)
+  target = "sse4.2";
+#elif defined(__SSSE3__)
+  target = "ssse3";
+#elif defined(__ARM_NEON)
+  target = "neon";
+#endif
+  fprintf(f, "  \"isa\": {\n    \"arch\": \"%s\",\n    \"target\": \"%s\",\n"
+             "    \"cpu\": [",
+          arch, target);
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__) && \
+    !defined(__clang__)
+  /* What the CPU running the benchmark has, which the target clones pick
+   * from */
+  __builtin_cpu_init();
+  int first = 1;
+#define PRINT_CPU_FEATURE(name)                                                \
+  if (__builtin_cpu_supports(name)) {                                          \
+    fprintf(f, "%s\"%s\"", first ? "" : ", ", name);                           \
+    first = 0;                                                                 \
+  }
+  PRINT_CPU_FEATURE("sse4.2")
+  PRINT_CPU_FEATURE("avx")
+  PRINT_CPU_FEATURE("avx2")
+  PRINT_CPU_FEATURE("fma")
+  PRINT_CPU_FEATURE("avx512f")
+#undef PRINT_CPU_FEATURE
+#endif
+  fputs("]\n  },\n", f);
+}
+
+/*************************************************************************
+write_bench_phases:
+  In: f: file to write to
+  Out: the calls and seconds of each phase of an iteration, summed over
+       all threads, are written as the "phases" member of a JSON object;
+       it is empty without MCELL_PHASE_PROFILE
+*************************************************************************/
+static void write_bench_phases(FILE *f) {
+  fputs("  \"phases\": {", f);
+#ifdef MCELL_PHASE_PROFILE
+  unsigned long long calls[N_PROFILE_PHASES];
+  double seconds[N_PROFILE_PHASES];
+  if (phase_profile_totals(calls, seconds) > 0) {
+    for (int p = 0; p < N_PROFILE_PHASES; p++) {
+      fprintf(f, "%s\n    \"%s\": {\"calls\": %llu, \"seconds\": %.9f}",
+              p == 0 ? "" : ",", phase_profile_name((enum profile_phase)p),
+              calls[p], seconds[p]);
+    }
+    fputs("\n  ", f);
+  }
+#endif
+  fputs("},\n", f);
+}
+
+/*************************************************************************
+metrics_write_bench:
+  In: world: simulation state, at the end of mcell_run_simulation
+  Out: 0 on success, 1 if the record could not be written (after a
+       warning).  Nothing is written without -bench_json, or by ranks other
+       than the first of an MPI run.
+*************************************************************************/
+int metrics_write_bench(struct volume *world) {
+  if (world->bench_json_file == NULL || world->procnum != 0)
+    return 0;
+
+  struct timeval now;
+  gettimeofday(&now, NULL);
+  double run_seconds = seconds_between(&world->run_start_time, &now);
+  long long iterations = world->current_iterations - world->run_start_iteration;
+
+  char *tmp_name;
+  FILE *f = open_replacement(world->bench_json_file, &tmp_name);
+  if (f == NULL)
+    return 1;
+
+  fprintf(f, "{\n  \"format\": 1,\n  \"time\": %.3f,\n",
+          (double)now.tv_sec + (double)now.tv_usec * 1e-6);
+  write_bench_build(f);
+  fprintf(f, "  \"threads\": %d,\n", world->num_threads);
+  fprintf(f, "  \"ranks\": %d,\n", world->n_procs);
+
+  fputs("  \"model\": {\"file\": ", f);
+  unsigned long long hash;
+  if (world->mdl_infile_name != NULL) {
+    print_quoted(f, world->mdl_infile_name);
+    if (hash_file(world->mdl_infile_name, &hash) == 0)
+      fprintf(f, ", \"fnv1a64\": \"%016llx\"", hash);
+  } else {
+    fputs("null", f);
+  }
+  fputs("},\n", f);
+
+  fprintf(f, "  \"seed\": %d,\n", world->seed_seq);
+  fprintf(f, "  \"iterations\": %lld,\n", iterations);
+  fprintf(f, "  \"run_seconds\": %.6f,\n", run_seconds);
+  fprintf(f, "  \"iterations_per_second\": %.6g,\n",
+          run_seconds > 0 ? (double)iterations / run_seconds : 0.0);
+
+  double init_cpu = world->u_init_time.tv_sec + world->s_init_time.tv_sec +
+                    (world->u_init_time.tv_usec + world->s_init_time.tv_usec) *
+                        1e-6;
+  fprintf(f, "  \"init_cpu_seconds\": %.6f,\n", init_cpu);
+#ifndef _WIN32
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  fprintf(f, "  \"run_cpu_seconds\": %.6f,\n",
+          usage.ru_utime.tv_sec + usage.ru_stime.tv_sec +
+              (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) * 1e-6 -
+              init_cpu);
+  /* ru_maxrss is in kilobytes on Linux and in bytes on macOS */
+#ifdef __APPLE__
+  fprintf(f, "  \"max_rss_bytes\": %lld,\n", (long long)usage.ru_maxrss);
+#else
+  fprintf(f, "  \"max_rss_bytes\": %lld,\n", (long long)usage.ru_maxrss * 1024);
+#endif
+#endif
+
+  write_bench_phases(f);
+
+  struct mem_usage_info pools[METRICS_MAX_POOLS];
+  int n_pools = mem_usage_collect(pools, METRICS_MAX_POOLS);
+  if (n_pools > METRICS_MAX_POOLS)
+    n_pools = METRICS_MAX_POOLS;
+  fputs("  \"pools\": {", f);
+  for (int i = 0; i < n_pools; i++) {
+    fputs(i ? ",\n    " : "\n    ", f);
+    print_quoted(f, pools[i].name ? pools[i].name : "(unnamed)");
+    fprintf(f, ": {\"bytes\": %lld, \"peak_bytes\": %lld, \"records\": %lld}",
+            pools[i].bytes_reserved, pools[i].bytes_peak,
+            pools[i].records_live);
+  }
+  fputs(n_pools ? "\n  },\n" : "},\n", f);
+
+  struct sim_stats stats;
+  mcell_get_statistics(world, &stats);
+  fprintf(f, "  \"statistics\": {\n");
+  fprintf(f, "    \"random_numbers\": %lld,\n", rng_uses(world->rng));
+  fprintf(f, "    \"diffusion_steps\": %lld,\n", stats.diffusion_number);
+  fprintf(f, "    \"diffusion_timesteps\": %.17g,\n", stats.diffusion_cumtime);
+  fprintf(f, "    \"diffusion_fast_steps\": %lld,\n",
+          stats.diffusion_fast_steps);
+  fprintf(f, "    \"ray_voxel_tests\": %lld,\n", stats.ray_voxel_tests);
+  fprintf(f, "    \"ray_polygon_tests\": %lld,\n", stats.ray_polygon_tests);
+  fprintf(f, "    \"ray_polygon_colls\": %lld,\n", stats.ray_polygon_colls);
+  fprintf(f, "    \"vol_vol_colls\": %lld,\n", stats.vol_vol_colls);
+  fprintf(f, "    \"vol_surf_colls\": %lld,\n", stats.vol_surf_colls);
+  fprintf(f, "    \"surf_surf_colls\": %lld,\n", stats.surf_surf_colls);
+  fprintf(f, "    \"vol_wall_colls\": %lld,\n", stats.vol_wall_colls);
+  fprintf(f, "    \"vol_vol_vol_colls\": %lld,\n", stats.vol_vol_vol_colls);
+  fprintf(f, "    \"vol_vol_surf_colls\": %lld,\n", stats.vol_vol_surf_colls);
+  fprintf(f, "    \"vol_surf_surf_colls\": %lld,\n",
+          stats.vol_surf_surf_colls);
+  fprintf(f, "    \"surf_surf_surf_colls\": %lld,\n",
+          stats.surf_surf_surf_colls);
+  fprintf(f, "    \"dyngeom_displacements\": %lld,\n",
+          world->dyngeom_molec_displacements);
+  fprintf(f, "    \"clamp_emissions\": %lld\n  }\n}\n",
+          world->clamp_mols_emitted);
+
+  return finish_replacement(f, world->bench_json_file, tmp_name);
+}
@@ -0,0 +1,43 @@
+/******************************************************************************
+ *
+ * Copyright (C) 2006-2017 by
+ * The Salk Institute for Biological Studies and
+ * Pittsburgh Supercomputing Center, Carnegie Mellon University
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ *
+******************************************************************************/
+
+#pragma once
+
+#include "mcell_structs.h"
+
+/* Default seconds between snapshots of -metrics_file */
+#define METRICS_DEFAULT_INTERVAL 10.0
+
+/* Metrics of a running simulation, for schedulers and monitoring of long
+ * jobs.  The file named by -metrics_file is rewritten atomically every
+ * -metrics_interval seconds, as Prometheus text (for the node exporter's
+ * textfile collector) if its name ends in .prom, and as JSON otherwise. */
+void metrics_update(struct volume *world);
+int metrics_write(struct volume *world);
+
+/* Record of a whole run for tracking performance across commits and
+ * machines, written once at the end of the run to the file named by
+ * -bench_json: build configuration, instruction sets, threads, a hash of the
+ * model, iteration rate, phase times (with MCELL_PHASE_PROFILE), memory pool
+ * high-water marks and the final statistics */
+int metrics_write_bench(struct volume *world);
@@ -0,0 +1,215 @@
+/******************************************************************************
+ *
+ * Copyright (C) 2006-2017 by
+ * The Salk Institute for Biological Studies and
+ * Pittsburgh Supercomputing Center, Carnegie Mellon University
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ *
+******************************************************************************/
+
+/**************************************************************************\
+** File: mol_id_index.c                                                   **
+**                                                                        **
+** Purpose: Look up live molecules by their unique id (see                **
+**    mcell_enable_molecule_index).                                       **
+\**************************************************************************/
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <pthread.h>
+/* The __atomic builtins, unlike <stdatomic.h>, also compile as C++ */
+#define MOL_ID_LOAD(p) __atomic_load_n(&(p), __ATOMIC_ACQUIRE)
+#define MOL_ID_STORE(p, v) __atomic_store_n(&(p), (v), __ATOMIC_RELEASE)
+#else
+/* Storages are never run on several threads on Windows */
+#define MOL_ID_LOAD(p) (p)
+#define MOL_ID_STORE(p, v) ((p) = (v))
+#endif
+
+#include "logging.h"
+#include "mem_util.h"
+#include "mol_id_index.h"
+
+/* Bits of the id selecting the entry of a page, the page of a directory and
+ * the directory, so 2^38 ids can be indexed */
+#define MOL_ID_PAGE_BITS 12
+#define MOL_ID_DIR_BITS 14
+#define MOL_ID_TOP_BITS 12
+#define MOL_ID_PAGE_SIZE (1 << MOL_ID_PAGE_BITS)
+#define MOL_ID_DIR_SIZE (1 << MOL_ID_DIR_BITS)
+#define MOL_ID_TOP_SIZE (1 << MOL_ID_TOP_BITS)
+
+struct mol_id_page {
+  struct abstract_molecule *mols[MOL_ID_PAGE_SIZE];
+};
+
+struct mol_id_dir {
+  struct mol_id_page *pages[MOL_ID_DIR_SIZE]; /* See MOL_ID_LOAD */
+};
+
+struct mol_id_index {
+  struct mol_id_dir *dirs[MOL_ID_TOP_SIZE]; /* See MOL_ID_LOAD */
+
+#ifndef _WIN32
+  pthread_mutex_t lock; /* Held while adding directories and pages */
+#endif
+};
+
+struct mol_id_index *create_mol_id_index(void) {
+  struct mol_id_index *idx =
+      CHECKED_MALLOC_STRUCT(struct mol_id_index, "molecule id index");
+  for (int i = 0; i < MOL_ID_TOP_SIZE; i++)
+    MOL_ID_STORE(idx->dirs[i], NULL);
+#ifndef _WIN32
+  pthread_mutex_init(&idx->lock, NULL);
+#endif
+  return idx;
+}
+
+void destroy_mol_id_index(struct mol_id_index *idx) {
+  if (idx == NULL)
+    return;
+  for (int i = 0; i < MOL_ID_TOP_SIZE; i++) {
+    struct mol_id_dir *dir = MOL_ID_LOAD(idx->dirs[i]);
+    if (dir == NULL)
+      continue;
+    for (int j = 0; j < MOL_ID_DIR_SIZE; j++)
+      free(MOL_ID_LOAD(dir->pages[j]));
+    free(dir);
+  }
+#ifndef _WIN32
+  pthread_mutex_destroy(&idx->lock);
+#endif
+  free(idx);
+}
+
+/*************************************************************************
+clear_mol_id_index:
+  In: the index
+  Out: No return value.  All entries are cleared, e.g. before the molecules
+       are freed together; the pages are kept for reuse.
+*************************************************************************/
+void clear_mol_id_index(struct mol_id_index *idx) {
+  if (idx == NULL)
+    return;
+  for (int i = 0; i < MOL_ID_TOP_SIZE; i++) {
+    struct mol_id_dir *dir = MOL_ID_LOAD(idx->dirs[i]);
+    if (dir == NULL)
+      continue;
+    for (int j = 0; j < MOL_ID_DIR_SIZE; j++) {
+      struct mol_id_page *page = MOL_ID_LOAD(dir->pages[j]);
+      if (page != NULL)
+        memset(page->mols, 0, sizeof(page->mols));
+    }
+  }
+}
+
+/* Find the page holding an id, or NULL if there is none yet */
+static struct mol_id_page *find_page(struct mol_id_index const *idx,
+                                     u_long id) {
+  u_long top = id >> (MOL_ID_PAGE_BITS + MOL_ID_DIR_BITS);
+  if (top >= MOL_ID_TOP_SIZE)
+    return NULL;
+  struct mol_id_dir *dir = MOL_ID_LOAD(((struct mol_id_index *)idx)->dirs[top]);
+  if (dir == NULL)
+    return NULL;
+  return MOL_ID_LOAD(dir->pages[(id >> MOL_ID_PAGE_BITS) &
+                                (MOL_ID_DIR_SIZE - 1)]);
+}
+
+/* Find the page holding an id, adding it and its directory if needed, or
+ * NULL if the id is too large to be indexed */
+static struct mol_id_page *get_page(struct mol_id_index *idx, u_long id) {
+  struct mol_id_page *page = find_page(idx, id);
+  u_long top = id >> (MOL_ID_PAGE_BITS + MOL_ID_DIR_BITS);
+  if (page != NULL || top >= MOL_ID_TOP_SIZE)
+    return page;
+
+  int n_page = (id >> MOL_ID_PAGE_BITS) & (MOL_ID_DIR_SIZE - 1);
+#ifndef _WIN32
+  pthread_mutex_lock(&idx->lock);
+#endif
+  struct mol_id_dir *dir = MOL_ID_LOAD(idx->dirs[top]);
+  if (dir == NULL) {
+    dir = CHECKED_MALLOC_STRUCT(struct mol_id_dir, "molecule id index");
+    for (int j = 0; j < MOL_ID_DIR_SIZE; j++)
+      MOL_ID_STORE(dir->pages[j], NULL);
+    MOL_ID_STORE(idx->dirs[top], dir);
+  }
+  page = MOL_ID_LOAD(dir->pages[n_page]);
+  if (page == NULL) {
+    page = CHECKED_MALLOC_STRUCT(struct mol_id_page, "molecule id index");
+    memset(page->mols, 0, sizeof(page->mols));
+    MOL_ID_STORE(dir->pages[n_page], page);
+  }
+#ifndef _WIN32
+  pthread_mutex_unlock(&idx->lock);
+#endif
+  return page;
+}
+
+/*************************************************************************
+mol_id_index_set:
+  In: the index, or NULL if there is none
+      a live molecule
+  Out: No return value.  The molecule's id maps to it, replacing any copy
+       of the molecule it was made from.
+*************************************************************************/
+void mol_id_index_set(struct mol_id_index *idx, struct abstract_molecule *am) {
+  if (idx == NULL)
+    return;
+  struct mol_id_page *page = get_page(idx, am->id);
+  if (page != NULL)
+    page->mols[am->id & (MOL_ID_PAGE_SIZE - 1)] = am;
+}
+
+/*************************************************************************
+mol_id_index_forget:
+  In: the index, or NULL if there is none
+      a molecule being removed
+  Out: No return value.  The molecule's id no longer maps to it.  If the id
+       maps to another copy of the molecule, that is kept.
+*************************************************************************/
+void mol_id_index_forget(struct mol_id_index *idx,
+                         struct abstract_molecule *am) {
+  if (idx == NULL)
+    return;
+  struct mol_id_page *page = find_page(idx, am->id);
+  if (page != NULL && page->mols[am->id & (MOL_ID_PAGE_SIZE - 1)] == am)
+    page->mols[am->id & (MOL_ID_PAGE_SIZE - 1)] = NULL;
+}
+
+/*************************************************************************
+mol_id_index_lookup:
+  In: the index
+      a molecule id
+  Out: The live molecule with that id, or NULL if there is none.
+*************************************************************************/
+struct abstract_molecule *mol_id_index_lookup(struct mol_id_index const *idx,
+                                              u_long id) {
+  struct mol_id_page const *page = find_page(idx, id);
+  if (page == NULL)
+    return NULL;
+  struct abstract_molecule *am = page->mols[id & (MOL_ID_PAGE_SIZE - 1)];
+  if (am == NULL || am->id != id || am->properties == NULL)
+    return NULL;
+  return am;
+}
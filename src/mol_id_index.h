@@ -0,0 +1,44 @@
+/******************************************************************************
+ *
+ * Copyright (C) 2006-2017 by
+ * The Salk Institute for Biological Studies and
+ * Pittsburgh Supercomputing Center, Carnegie Mellon University
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ *
+******************************************************************************/
+
+#pragma once
+
+#include "mcell_structs.h"
+
+/* Map from molecule id to live molecule.  Ids are handed out densely in
+ * increasing order, so the index is a three-level table of fixed-size pages
+ * indexed directly by the id; pages are added as ids grow.  Entries are set
+ * when a molecule is created or copied to another storage, and cleared when
+ * it is removed.  Setting and clearing entries of different ids is safe from
+ * concurrent threads. */
+struct mol_id_index;
+
+struct mol_id_index *create_mol_id_index(void);
+void destroy_mol_id_index(struct mol_id_index *idx);
+void clear_mol_id_index(struct mol_id_index *idx);
+
+void mol_id_index_set(struct mol_id_index *idx, struct abstract_molecule *am);
+void mol_id_index_forget(struct mol_id_index *idx,
+                         struct abstract_molecule *am);
+struct abstract_molecule *mol_id_index_lookup(struct mol_id_index const *idx,
+                                              u_long id);
@@ -0,0 +1,498 @@
+/******************************************************************************
+ *
+ * Copyright (C) 2006-2017 by
+ * The Salk Institute for Biological Studies and
+ * Pittsburgh Supercomputing Center, Carnegie Mellon University
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ *
+******************************************************************************/
+
+/**************************************************************************\
+** File: mpi_util.c                                                       **
+**                                                                        **
+** Purpose: Splits the memory partitions of a simulation between MPI      **
+**    ranks.  Every rank parses the model and builds the whole geometry,  **
+**    but only creates and runs the molecules of its own storages.        **
+**    Molecules crossing into another rank's storages are exchanged       **
+**    between the passes of each iteration, and counts are summed on      **
+**    rank 0 whenever reaction output is produced.                        **
+\**************************************************************************/
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef MCELL_MPI
+#include <mpi.h>
+#endif
+
+#include "logging.h"
+#include "mcell_run.h"
+#include "nfsim_func.h"
+#include "sched_util.h"
+#include "vol_util.h"
+#include "mpi_util.h"
+#include "mol_id_index.h"
+
+#ifdef MCELL_MPI
+/* A volume molecule on its way to another rank */
+struct mpi_molecule {
+  struct vector3 pos;
+  double t;
+  double t2;
+  double birthday;
+  u_long id;
+  int species;  /* Index in world->species_list */
+  int subvol;   /* Index of the subvolume it is entering */
+  int flags;
+  int16_t box_x, box_y, box_z;
+};
+
+/* Molecules waiting to be sent to each rank */
+struct mpi_outbox {
+  struct mpi_molecule *mols;
+  int n;
+  int max;
+};
+
+static struct mpi_outbox *outboxes;
+
+/* Local counter values, saved while rank 0 holds the sums */
+static double *local_counts;
+static double *summed_counts;
+static int n_counts;
+#endif
+
+/*************************************************************************
+mpi_start:
+  In: world
+      command line arguments
+  Out: No return value.  world->procnum and world->n_procs are set.  Only
+       rank 0 logs progress.
+*************************************************************************/
+void mpi_start(struct volume *world, int *argc, char ***argv) {
+#ifdef MCELL_MPI
+  MPI_Init(argc, argv);
+  MPI_Comm_rank(MPI_COMM_WORLD, &world->procnum);
+  MPI_Comm_size(MPI_COMM_WORLD, &world->n_procs);
+  if (world->procnum != 0) {
+    FILE *quiet = fopen("/dev/null", "w");
+    if (quiet != NULL)
+      mcell_set_log_file(quiet);
+  }
+#else
+  (void)argc;
+  (void)argv;
+  world->procnum = 0;
+  world->n_procs = 1;
+#endif
+}
+
+/*************************************************************************
+mpi_stop:
+  In: No arguments.
+  Out: No return value.  MPI is shut down.
+*************************************************************************/
+void mpi_stop(void) {
+#ifdef MCELL_MPI
+  int finalized = 0;
+  MPI_Finalized(&finalized);
+  if (!finalized)
+    MPI_Finalize();
+#endif
+}
+
+/*************************************************************************
+mpi_split_blocker:
+  In: world
+  Out: NULL if the storages can be run on separate ranks, otherwise a
+       short description of the feature that prevents it.  On top of what
+       keeps storages from running on separate threads, a rank cannot see
+       the molecules of other ranks, so anything that looks at all the
+       molecules at once must stay on one rank.
+*************************************************************************/
+static char const *mpi_split_blocker(struct volume *world) {
+  char const *reason = storages_are_independent(world);
+  if (reason != NULL)
+    return reason;
+  if (world->clamp_list != NULL)
+    return "concentration clamps";
+  if (world->chkpt_infile != NULL || world->chkpt_outfile != NULL ||
+      world->chkpt_iterations != 0)
+    return "checkpoints";
+  if (world->volume_output_head != NULL)
+    return "volume output";
+  for (struct viz_output_block *vizblk = world->viz_blocks; vizblk != NULL;
+       vizblk = vizblk->next) {
+    if (vizblk->viz_mode != NO_VIZ_MODE && vizblk->frame_data_head != NULL)
+      return "visualization output";
+  }
+
+  for (int i = 0; i < world->n_species; i++) {
+    struct species *spec = world->species_list[i];
+    if ((spec->flags & ON_GRID) && spec != world->all_mols &&
+        spec != world->all_surface_mols)
+      return "surface molecules";
+  }
+
+  for (struct output_block *obp = world->output_block_head; obp != NULL;
+       obp = obp->next) {
+    for (struct output_set *set = obp->data_set_head; set != NULL;
+         set = set->next) {
+      if (set->column_head != NULL &&
+          set->column_head->buffer[0].data_type == COUNT_TRIG_STRUCT)
+        return "count triggers";
+    }
+  }
+
+  return NULL;
+}
+
+/*************************************************************************
+mpi_assign_storages:
+  In: world, once the geometry, counters and release sites are set up
+  Out: No return value.  The storages are given to the ranks in slabs of
+       memory partitions along x.  If the model cannot be split, all
+       storages stay on rank 0: the other ranks exit and rank 0 carries on
+       as a single-rank run.
+*************************************************************************/
+void mpi_assign_storages(struct volume *world) {
+  if (world->n_procs < 2)
+    return;
+
+  int n_slabs = (world->nx_parts + world->mem_part_x - 2) / world->mem_part_x;
+  char const *reason = mpi_split_blocker(world);
+  if (reason != NULL || n_slabs < world->n_procs) {
+    if (world->procnum != 0) {
+      mpi_stop();
+      exit(0);
+    }
+    if (reason != NULL)
+      mcell_warn("Running on MPI rank 0 only: models with %s cannot be "
+                 "split between ranks.", reason);
+    else
+      mcell_warn("Running on MPI rank 0 only: there are %d memory "
+                 "partitions along x but %d ranks.  Use "
+                 "MEMORY_PARTITION_X to create more.",
+                 n_slabs, world->n_procs);
+    world->n_procs = 1;
+    return;
+  }
+
+  int nyz = (world->ny_parts - 1) * (world->nz_parts - 1);
+  for (int h = 0; h < world->n_subvols; h++) {
+    int slab = (h / nyz) / world->mem_part_x;
+    world->subvol[h].local_storage->rank = slab * world->n_procs / n_slabs;
+  }
+
+  if (world->notify->progress_report != NOTIFY_NONE)
+    mcell_log("Splitting %d slabs of memory partitions between %d MPI ranks.",
+              n_slabs, world->n_procs);
+}
+
+/*************************************************************************
+mpi_any_active:
+  In: world
+      number of storages of this rank with work left in this iteration
+  Out: nonzero if any rank has work left
+*************************************************************************/
+int mpi_any_active(struct volume *world, int n_active) {
+#ifdef MCELL_MPI
+  if (world->n_procs > 1) {
+    int total = 0;
+    MPI_Allreduce(&n_active, &total, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+    return total;
+  }
+#else
+  (void)world;
+#endif
+  return n_active;
+}
+
+/*************************************************************************
+mpi_send_molecule:
+  In: world
+      volume molecule which stopped at the boundary of another rank's
+      storage, no longer scheduled or handed off
+      subvolume it is entering
+  Out: No return value.  The molecule is queued for the rank owning the
+       subvolume and removed from this rank.
+*************************************************************************/
+void mpi_send_molecule(struct volume *world, struct volume_molecule *vm,
+                       struct subvolume *new_sv) {
+#ifdef MCELL_MPI
+  if (outboxes == NULL) {
+    outboxes = CHECKED_MALLOC_ARRAY(struct mpi_outbox, world->n_procs,
+                                    "MPI molecule outboxes");
+    memset(outboxes, 0, world->n_procs * sizeof(struct mpi_outbox));
+  }
+
+  struct mpi_outbox *box = &outboxes[new_sv->local_storage->rank];
+  if (box->n == box->max) {
+    box->max = (box->max == 0) ? 1024 : 2 * box->max;
+    struct mpi_molecule *mols = (struct mpi_molecule *)realloc(
+        box->mols, box->max * sizeof(struct mpi_molecule));
+    if (mols == NULL)
+      mcell_allocfailed("Failed to grow the outbox for molecules sent to MPI "
+                        "rank %d.", new_sv->local_storage->rank);
+    box->mols = mols;
+  }
+
+  struct mpi_molecule *m = &box->mols[box->n++];
+  m->pos = vm->pos;
+  m->t = vm->t;
+  m->t2 = vm->t2;
+  m->birthday = vm->birthday;
+  m->id = vm->id;
+  m->species = vm->properties->species_id;
+  m->subvol = (int)(new_sv - world->subvol);
+  m->flags = vm->flags;
+  m->box_x = vm->periodic_box.x;
+  m->box_y = vm->periodic_box.y;
+  m->box_z = vm->periodic_box.z;
+
+  vm->subvol->mol_count--;
+  vm->properties->population--;
+  collect_molecule(vm);
+#else
+  (void)world;
+  (void)vm;
+  (void)new_sv;
+  mcell_internal_error("Tried to send a molecule to another rank without "
+                       "MPI support.");
+#endif
+}
+
+#ifdef MCELL_MPI
+/*************************************************************************
+receive_molecule:
+  In: world
+      molecule sent by another rank
+  Out: No return value.  The molecule is created in its subvolume and
+       scheduled, as process_storage_handoffs does for molecules moving
+       between storages of one rank.
+*************************************************************************/
+static void receive_molecule(struct volume *world,
+                             struct mpi_molecule const *m) {
+  struct subvolume *sv = &world->subvol[m->subvol];
+  struct storage *store = sv->local_storage;
+  struct volume_molecule *vm = (struct volume_molecule *)CHECKED_MEM_GET(
+      store->mol, "volume molecule");
+  memset(vm, 0, sizeof(struct volume_molecule));
+  vm->t = m->t;
+  vm->t2 = m->t2;
+  vm->properties = world->species_list[m->species];
+  vm->flags = (short)m->flags | IN_SCHEDULE;
+  vm->birthplace = store->mol;
+  vm->birthday = m->birthday;
+  vm->id = m->id;
+  vm->pos = m->pos;
+  vm->subvol = sv;
+  vm->index = -1;
+  vm->periodic_box.x = m->box_x;
+  vm->periodic_box.y = m->box_y;
+  vm->periodic_box.z = m->box_z;
+  vm->periodic_box.pad = 0;
+
+  ht_add_molecule_to_list(&sv->mol_by_species, vm);
+  sv->mol_count++;
+  vm->properties->population++;
+  mol_id_index_set(world->mol_id_index, (struct abstract_molecule *)vm);
+  if (schedule_add(store->timer, vm))
+    mcell_allocfailed("Failed to add a '%s' volume molecule to scheduler "
+                      "after it arrived from another MPI rank.",
+                      vm->properties->sym->name);
+}
+#endif
+
+/*************************************************************************
+mpi_exchange_molecules:
+  In: world, on all ranks at once
+  Out: No return value.  Queued molecules are sent to their ranks, and
+       the molecules sent to this rank are created and scheduled, in rank
+       order and in the order each rank queued them.
+*************************************************************************/
+void mpi_exchange_molecules(struct volume *world) {
+#ifdef MCELL_MPI
+  int n_procs = world->n_procs;
+  if (n_procs < 2)
+    return;
+
+  int *send_counts = CHECKED_MALLOC_ARRAY(int, 4 * n_procs, "MPI counts");
+  int *send_displs = send_counts + n_procs;
+  int *recv_counts = send_displs + n_procs;
+  int *recv_displs = recv_counts + n_procs;
+  int n_send = 0;
+  for (int r = 0; r < n_procs; r++) {
+    send_counts[r] = (outboxes == NULL) ? 0 : outboxes[r].n;
+    send_counts[r] *= (int)sizeof(struct mpi_molecule);
+    send_displs[r] = n_send;
+    n_send += send_counts[r];
+  }
+  MPI_Alltoall(send_counts, 1, MPI_INT, recv_counts, 1, MPI_INT,
+               MPI_COMM_WORLD);
+  int n_recv = 0;
+  for (int r = 0; r < n_procs; r++) {
+    recv_displs[r] = n_recv;
+    n_recv += recv_counts[r];
+  }
+
+  char *send_buf = CHECKED_MALLOC_ARRAY(char, n_send + 1, "MPI send buffer");
+  char *recv_buf = CHECKED_MALLOC_ARRAY(char, n_recv + 1, "MPI receive buffer");
+  for (int r = 0; r < n_procs; r++) {
+    if (send_counts[r] > 0)
+      memcpy(send_buf + send_displs[r], outboxes[r].mols, send_counts[r]);
+    if (outboxes != NULL)
+      outboxes[r].n = 0;
+  }
+  MPI_Alltoallv(send_buf, send_counts, send_displs, MPI_BYTE, recv_buf,
+                recv_counts, recv_displs, MPI_BYTE, MPI_COMM_WORLD);
+
+  struct mpi_molecule const *received = (struct mpi_molecule const *)recv_buf;
+  int n_mols = n_recv / (int)sizeof(struct mpi_molecule);
+  for (int i = 0; i < n_mols; i++)
+    receive_molecule(world, &received[i]);
+
+  free(recv_buf);
+  free(send_buf);
+  free(send_counts);
+#else
+  (void)world;
+#endif
+}
+
+#ifdef MCELL_MPI
+/*************************************************************************
+pack_counts:
+  In: world
+      buffer for the counts, or NULL to just count them
+  Out: the number of values.  Molecule and reaction counters are visited
+       in count hash order, then the species populations, which is the
+       same order on every rank.
+*************************************************************************/
+static int pack_counts(struct volume *world, double *buf) {
+  int n = 0;
+  for (int i = 0; i <= world->count_hashmask; i++) {
+    for (struct counter *c = world->count_hash[i]; c != NULL; c = c->next) {
+      if (c->counter_type & TRIG_COUNTER)
+        continue;
+      if (c->counter_type & RXN_COUNTER) {
+        if (buf != NULL) {
+          buf[n] = c->data.rx.n_rxn_at;
+          buf[n + 1] = c->data.rx.n_rxn_enclosed;
+        }
+        n += 2;
+      } else {
+        struct move_counter_data *d = &c->data.move;
+        if (buf != NULL) {
+          buf[n] = d->front_hits;
+          buf[n + 1] = d->back_hits;
+          buf[n + 2] = d->front_to_back;
+          buf[n + 3] = d->back_to_front;
+          buf[n + 4] = d->scaled_hits;
+          buf[n + 5] = d->n_at;
+          buf[n + 6] = d->n_enclosed;
+        }
+        n += 7;
+      }
+    }
+  }
+  for (int i = 0; i < world->n_species; i++) {
+    if (buf != NULL)
+      buf[n] = world->species_list[i]->population;
+    n++;
+  }
+  return n;
+}
+
+/*************************************************************************
+unpack_counts:
+  In: world
+      counts in the order pack_counts stored them
+  Out: No return value.  The counters and populations are set from the
+       buffer.
+*************************************************************************/
+static void unpack_counts(struct volume *world, double const *buf) {
+  int n = 0;
+  for (int i = 0; i <= world->count_hashmask; i++) {
+    for (struct counter *c = world->count_hash[i]; c != NULL; c = c->next) {
+      if (c->counter_type & TRIG_COUNTER)
+        continue;
+      if (c->counter_type & RXN_COUNTER) {
+        c->data.rx.n_rxn_at = buf[n];
+        c->data.rx.n_rxn_enclosed = buf[n + 1];
+        n += 2;
+      } else {
+        struct move_counter_data *d = &c->data.move;
+        d->front_hits = buf[n];
+        d->back_hits = buf[n + 1];
+        d->front_to_back = buf[n + 2];
+        d->back_to_front = buf[n + 3];
+        d->scaled_hits = buf[n + 4];
+        d->n_at = (int)buf[n + 5];
+        d->n_enclosed = (int)buf[n + 6];
+        n += 7;
+      }
+    }
+  }
+  for (int i = 0; i < world->n_species; i++)
+    world->species_list[i]->population = (u_int)buf[n++];
+}
+#endif
+
+/*************************************************************************
+mpi_sum_counts:
+  In: world, on all ranks at once
+  Out: No return value.  On rank 0 the counters and species populations
+       hold the sums over all ranks until mpi_restore_counts is called;
+       the other ranks keep their own.
+*************************************************************************/
+void mpi_sum_counts(struct volume *world) {
+#ifdef MCELL_MPI
+  if (world->n_procs < 2)
+    return;
+  if (local_counts == NULL) {
+    n_counts = pack_counts(world, NULL);
+    local_counts = CHECKED_MALLOC_ARRAY(double, n_counts + 1, "MPI counts");
+    summed_counts = CHECKED_MALLOC_ARRAY(double, n_counts + 1, "MPI counts");
+  }
+  pack_counts(world, local_counts);
+  MPI_Reduce(local_counts, summed_counts, n_counts, MPI_DOUBLE, MPI_SUM, 0,
+             MPI_COMM_WORLD);
+  if (world->procnum == 0)
+    unpack_counts(world, summed_counts);
+#else
+  (void)world;
+#endif
+}
+
+/*************************************************************************
+mpi_restore_counts:
+  In: world, after mpi_sum_counts
+  Out: No return value.  Rank 0's counters and populations are back to
+       its own.
+*************************************************************************/
+void mpi_restore_counts(struct volume *world) {
+#ifdef MCELL_MPI
+  if (world->n_procs > 1 && world->procnum == 0)
+    unpack_counts(world, local_counts);
+#else
+  (void)world;
+#endif
+}
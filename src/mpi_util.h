@@ -0,0 +1,45 @@
+/******************************************************************************
+ *
+ * Copyright (C) 2006-2017 by
+ * The Salk Institute for Biological Studies and
+ * Pittsburgh Supercomputing Center, Carnegie Mellon University
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ *
+******************************************************************************/
+
+#pragma once
+
+#include "mcell_structs.h"
+
+/* Domain decomposition over MPI ranks.  Each rank runs the storages of one
+ * slab of memory partitions along x; molecules that diffuse into another
+ * rank's slab are sent there between the passes of an iteration, and the
+ * counts are summed on rank 0, which writes all reaction output.  Without
+ * MCELL_MPI these are no-ops and there is a single rank. */
+
+void mpi_start(struct volume *world, int *argc, char ***argv);
+void mpi_stop(void);
+
+void mpi_assign_storages(struct volume *world);
+
+int mpi_any_active(struct volume *world, int n_active);
+void mpi_send_molecule(struct volume *world, struct volume_molecule *vm,
+                       struct subvolume *new_sv);
+void mpi_exchange_molecules(struct volume *world);
+
+void mpi_sum_counts(struct volume *world);
+void mpi_restore_counts(struct volume *world);
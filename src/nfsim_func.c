@@ -1,159 +1,137 @@
+#include <stdlib.h>
+#include <string.h>
+
 #include "nfsim_func.h"
+#include "logging.h"
 #include "map_c.h"
-
-static map_t graph_reaction_map = NULL;
-
-void initialize_rxn_diffusion_functions(struct rxn *mol_ptr);
-
-double get_standard_diffusion(void *self);
-double get_nfsim_diffusion(void *self);
-double get_standard_space_step(void *self);
-double get_nfsim_space_step(void *self);
-double get_standard_time_step(void *self);
-double get_nfsim_time_step(void *self);
-
-double rxn_get_nfsim_diffusion(struct rxn *, int);
-double rxn_get_standard_diffusion(struct rxn *, int);
-double rxn_get_nfsim_space_step(struct rxn *, int);
-double rxn_get_standard_time_step(struct rxn *, int);
-double rxn_get_nfsim_time_step(struct rxn *, int);
-double rxn_get_standard_space_step(struct rxn *, int);
-
-void initialize_diffusion_function(struct abstract_molecule *mol_ptr) {
-  // if nfsim provides spatial parameters...
-  if (mol_ptr->properties->flags & EXTERNAL_SPECIES &&
-      mol_ptr->graph_data->graph_diffusion != -1.0) {
-    mol_ptr->get_diffusion = &get_nfsim_diffusion;
-    mol_ptr->get_space_step = &get_nfsim_space_step;
-    mol_ptr->get_time_step = &get_nfsim_time_step;
+#include "mem_util.h"
+#include "react.h"
+
+/* Interned graph patterns of a world keyed by pattern hash.  Patterns whose
+ * hashes collide are chained through next_interned from the one in the
+ * map. */
+struct graph_intern_table {
+  map_t map;
+  unsigned long n_pattern_ids;
+};
+
+void initialize_graph_hashmap(struct volume *world) {
+  world->graph_patterns = CHECKED_MALLOC_STRUCT(struct graph_intern_table,
+                                                "graph pattern table");
+  world->graph_patterns->map = hashmap_new();
+  world->graph_patterns->n_pattern_ids = 0;
+}
+
+static struct graph_data *interned_chain(struct graph_intern_table *table,
+                                         unsigned long graph_pattern_hash) {
+  struct graph_data *head = NULL;
+  if (hashmap_get_pair(table->map, graph_pattern_hash, 0, (void **)&head) !=
+      MAP_OK)
+    return NULL;
+  return head;
+}
+
+/*************************************************************************
+find_graph_data:
+  In: world: simulation state
+      graph_pattern: a graph pattern
+  Out: the interned graph data of the pattern, or NULL if the pattern is not
+       in the system
+*************************************************************************/
+struct graph_data *find_graph_data(struct volume *world,
+                                   const char *graph_pattern) {
+  struct graph_data *graph =
+      interned_chain(world->graph_patterns, lhash(graph_pattern));
+  while (graph != NULL && strcmp(graph->graph_pattern, graph_pattern) != 0)
+    graph = graph->next_interned;
+  return graph;
+}
+
+/*************************************************************************
+intern_graph_data:
+  In: world: simulation state
+      graph_pattern: a graph pattern
+      created: set to whether the pattern was new
+  Out: the one graph data shared by everything with this pattern.  A new
+       one holds a copy of the pattern, no references, and no diffusion or
+       reactivity data (-1) until the caller has derived them.
+*************************************************************************/
+struct graph_data *intern_graph_data(struct volume *world,
+                                     const char *graph_pattern,
+                                     bool *created) {
+  struct graph_intern_table *table = world->graph_patterns;
+  struct graph_data *graph = find_graph_data(world, graph_pattern);
+  *created = (graph == NULL);
+  if (graph != NULL)
+    return graph;
+
+  graph = CHECKED_MALLOC_STRUCT(struct graph_data, "interned graph pattern");
+  graph->graph_pattern = CHECKED_STRDUP(graph_pattern, "graph pattern");
+  graph->graph_compartment = NULL;
+  graph->graph_pattern_hash = lhash(graph_pattern);
+  graph->pattern_id = ++table->n_pattern_ids;
+  graph->world = world;
+  graph->ref_count = 0;
+  graph->graph_diffusion = -1;
+  graph->space_step = -1;
+  graph->time_step = -1;
+  graph->flags = -1;
+
+  graph->next_interned = interned_chain(table, graph->graph_pattern_hash);
+  if (graph->next_interned != NULL)
+    hashmap_remove_pair(table->map, graph->graph_pattern_hash, 0);
+  if (hashmap_put_pair(table->map, graph->graph_pattern_hash, 0, graph) !=
+      MAP_OK)
+    mcell_allocfailed("Failed to intern a graph pattern.");
+  return graph;
+}
+
+void acquire_graph_data(struct graph_data *graph) {
+  if (graph != NULL)
+    graph->ref_count++;
+}
+
+/*************************************************************************
+release_graph_data:
+  In: graph: interned graph data, or NULL
+  Out: No return value.  The pattern leaves the system once nothing holds
+       it any more.
+*************************************************************************/
+void release_graph_data(struct graph_data *graph) {
+  if (graph == NULL || --graph->ref_count > 0)
+    return;
+
+  // the table is gone once the world's NFSim run has ended
+  struct graph_intern_table *table = graph->world->graph_patterns;
+  struct graph_data *head =
+      (table != NULL) ? interned_chain(table, graph->graph_pattern_hash) : NULL;
+  if (head == graph) {
+    hashmap_remove_pair(table->map, graph->graph_pattern_hash, 0);
+    if (graph->next_interned != NULL &&
+        hashmap_put_pair(table->map, graph->graph_pattern_hash, 0,
+                         graph->next_interned) != MAP_OK)
+      mcell_allocfailed("Failed to intern a graph pattern.");
   } else {
-    mol_ptr->get_diffusion = &get_standard_diffusion;
-    mol_ptr->get_space_step = &get_standard_space_step;
-    mol_ptr->get_time_step = &get_standard_time_step;
-  }
-
-  if (mol_ptr->properties->flags & EXTERNAL_SPECIES &&
-      mol_ptr->graph_data->flags >= 0) {
-    mol_ptr->get_flags = &get_nfsim_flags;
-  } else {
-    mol_ptr->get_flags = &get_standard_flags;
-  }
-}
-
-void initialize_rxn_diffusion_functions(struct rxn *mol_ptr) {
-  if (mol_ptr->players[0]->flags & EXTERNAL_SPECIES) {
-    mol_ptr->get_reactant_diffusion = rxn_get_nfsim_diffusion;
-    mol_ptr->get_reactant_space_step = rxn_get_nfsim_space_step;
-    mol_ptr->get_reactant_time_step = rxn_get_nfsim_time_step;
-  } else {
-    mol_ptr->get_reactant_diffusion = rxn_get_standard_diffusion;
-    mol_ptr->get_reactant_space_step = rxn_get_standard_space_step;
-    mol_ptr->get_reactant_time_step = rxn_get_standard_time_step;
-  }
-}
-
-u_int get_standard_flags(void *mol_ptr) {
-  struct abstract_molecule *am = (struct abstract_molecule *)mol_ptr;
-  return am->properties->flags;
-}
-
-u_int get_nfsim_flags(void *mol_ptr) {
-  struct abstract_molecule *am = (struct abstract_molecule *)mol_ptr;
-  if (am->graph_data->flags < 0)
-    return get_standard_flags(am);
-
-  return (unsigned int)am->graph_data->flags;
-}
-
-double get_standard_diffusion(void *mol_ptr) {
-  struct abstract_molecule *am = (struct abstract_molecule *)mol_ptr;
-  return am->properties->D;
-}
-
-double get_nfsim_diffusion(void *mol_ptr) {
-  // nfsim returns diffusion -1 when the user didnt define any diffusion
-  // functions
-  struct abstract_molecule *am = (struct abstract_molecule *)mol_ptr;
-  if (am->graph_data->graph_diffusion > 0) {
-    return am->graph_data->graph_diffusion;
+    while (head != NULL && head->next_interned != graph)
+      head = head->next_interned;
+    if (head != NULL)
+      head->next_interned = graph->next_interned;
   }
-  return get_standard_diffusion(am);
-}
-
-double get_standard_space_step(void *mol_ptr) {
-  struct abstract_molecule *am = (struct abstract_molecule *)mol_ptr;
-  return am->properties->space_step;
-}
-
-double get_nfsim_space_step(void *mol_ptr) {
-  // nfsim returns diffusion -1 when the user didnt define any diffusion
-  // functions
-  struct abstract_molecule *am = (struct abstract_molecule *)mol_ptr;
-  if (am->graph_data->graph_diffusion >= 0)
-    return am->graph_data->space_step;
-  return get_standard_space_step(am);
-}
-
-double get_standard_time_step(void *mol_ptr) {
-  struct abstract_molecule *am = (struct abstract_molecule *)mol_ptr;
-  return am->properties->time_step;
-}
-
-double get_nfsim_time_step(void *mol_ptr) {
-  // nfsim returns diffusion -1 when the user didnt define any diffusion
-  // functions
-  struct abstract_molecule *am = (struct abstract_molecule *)mol_ptr;
-  if (am->graph_data->graph_diffusion >= 0)
-    return am->graph_data->time_step;
-  return get_standard_time_step(am);
-}
 
-double rxn_get_standard_diffusion(struct rxn *mol_ptr, int index) {
-  return mol_ptr->players[index]->D;
-}
-
-double rxn_get_nfsim_diffusion(struct rxn *mol_ptr, int index) {
-  if (mol_ptr->reactant_graph_data &&
-      mol_ptr->reactant_graph_data[index]->graph_diffusion >= 0) {
-    return mol_ptr->reactant_graph_data[index]->graph_diffusion;
-  }
-  return rxn_get_standard_diffusion(mol_ptr, index);
+  free(graph->graph_pattern);
+  free(graph->graph_compartment);
+  free(graph);
 }
 
-double rxn_get_standard_time_step(struct rxn *mol_ptr, int index) {
-  return mol_ptr->players[index]->time_step;
-}
-
-double rxn_get_nfsim_time_step(struct rxn *mol_ptr, int index) {
-  if (mol_ptr->reactant_graph_data &&
-      mol_ptr->reactant_graph_data[index]->graph_diffusion >= 0) {
-    return mol_ptr->reactant_graph_data[index]->time_step;
-  }
-  return rxn_get_standard_time_step(mol_ptr, index);
-}
-
-double rxn_get_standard_space_step(struct rxn *mol_ptr, int index) {
-  return mol_ptr->players[index]->space_step;
-}
-
-double rxn_get_nfsim_space_step(struct rxn *mol_ptr, int index) {
-  if (mol_ptr->reactant_graph_data &&
-      mol_ptr->reactant_graph_data[index]->graph_diffusion >= 0) {
-    return mol_ptr->reactant_graph_data[index]->space_step;
-  }
-  return rxn_get_standard_space_step(mol_ptr, index);
-}
-
-void initialize_graph_hashmap() { graph_reaction_map = hashmap_new(); }
-
-int get_graph_data(unsigned long graph_pattern_hash,
-                   struct graph_data **graph_data) {
-  return hashmap_get_nohash(graph_reaction_map, graph_pattern_hash,
-                            graph_pattern_hash, (void **)(graph_data));
+void get_graph_hashmap_stats(struct volume *world,
+                             struct hashmap_stats *stats) {
+  hashmap_get_stats(world->graph_patterns->map, stats);
 }
 
-int store_graph_data(unsigned long graph_pattern_hash,
-                     struct graph_data *graph_data) {
-  return hashmap_put_nohash(graph_reaction_map, graph_pattern_hash,
-                            graph_pattern_hash, graph_data);
+void free_graph_hashmap(struct volume *world) {
+  if (world->graph_patterns == NULL)
+    return;
+  hashmap_free(world->graph_patterns->map);
+  free(world->graph_patterns);
+  world->graph_patterns = NULL;
 }
@@ -2,37 +2,100 @@
 #define NFSIM_FUNC
 
 #include "mcell_structs.h"
+#include "map_c.h"
 
-// typedef double (*get_reactant_diffusion)(int a, int b);
+/*
+ * Diffusion constant, time step, space step and reactivity flags of a
+ * molecule.  NFSim species take them from their graph pattern when NFSim
+ * defines them for it (a diffusion function, or reactions), everything
+ * else from its species, so standard species never leave the inlined
+ * field access.
+ */
+static inline double get_diffusion(const void *self) {
+  const struct abstract_molecule *am = (const struct abstract_molecule *)self;
+  if ((am->properties->flags & EXTERNAL_SPECIES) &&
+      am->graph_data->graph_diffusion > 0)
+    return am->graph_data->graph_diffusion;
+  return am->properties->D;
+}
 
-void initialize_diffusion_function(struct abstract_molecule *mol_ptr);
-void initialize_rxn_diffusion_functions(struct rxn *mol_ptr);
+static inline double get_time_step(const void *self) {
+  const struct abstract_molecule *am = (const struct abstract_molecule *)self;
+  if ((am->properties->flags & EXTERNAL_SPECIES) &&
+      am->graph_data->graph_diffusion >= 0)
+    return am->graph_data->time_step;
+  return am->properties->time_step;
+}
 
-double get_standard_diffusion(void *self);
-double get_nfsim_diffusion(void *self);
+static inline double get_space_step(const void *self) {
+  const struct abstract_molecule *am = (const struct abstract_molecule *)self;
+  if ((am->properties->flags & EXTERNAL_SPECIES) &&
+      am->graph_data->graph_diffusion >= 0)
+    return am->graph_data->space_step;
+  return am->properties->space_step;
+}
 
-double get_standard_space_step(void *self);
-double get_nfsim_space_step(void *self);
+static inline u_int get_flags(const void *self) {
+  const struct abstract_molecule *am = (const struct abstract_molecule *)self;
+  if ((am->properties->flags & EXTERNAL_SPECIES) && am->graph_data->flags >= 0)
+    return (u_int)am->graph_data->flags;
+  return am->properties->flags;
+}
 
-double get_standard_time_step(void *self);
-double get_nfsim_time_step(void *self);
+/*
+ * The same for reactant index of a reaction.  Only reactions built from
+ * NFSim queries have reactant graph patterns.
+ */
+static inline struct graph_data *
+nfsim_reactant_graph(const struct rxn *rx, int index) {
+  if ((rx->players[0]->flags & EXTERNAL_SPECIES) &&
+      rx->reactant_graph_data != NULL &&
+      rx->reactant_graph_data[index]->graph_diffusion >= 0)
+    return rx->reactant_graph_data[index];
+  return NULL;
+}
 
-double rxn_get_nfsim_diffusion(struct rxn *, int);
-double rxn_get_standard_diffusion(struct rxn *, int);
+static inline double get_reactant_diffusion(const struct rxn *rx, int index) {
+  struct graph_data *graph = nfsim_reactant_graph(rx, index);
+  return (graph != NULL) ? graph->graph_diffusion : rx->players[index]->D;
+}
 
-double rxn_get_nfsim_space_step(struct rxn *, int);
-double rxn_get_standard_time_step(struct rxn *, int);
+static inline double get_reactant_time_step(const struct rxn *rx, int index) {
+  struct graph_data *graph = nfsim_reactant_graph(rx, index);
+  return (graph != NULL) ? graph->time_step : rx->players[index]->time_step;
+}
 
-double rxn_get_nfsim_time_step(struct rxn *, int);
-double rxn_get_standard_space_step(struct rxn *, int);
+static inline double get_reactant_space_step(const struct rxn *rx, int index) {
+  struct graph_data *graph = nfsim_reactant_graph(rx, index);
+  return (graph != NULL) ? graph->space_step : rx->players[index]->space_step;
+}
 
-void initialize_graph_hashmap(void);
-int get_graph_data(unsigned long graph_pattern_hash,
-                   struct graph_data **graph_data);
-int store_graph_data(unsigned long graph_pattern_hash,
-                     struct graph_data *graph_data);
+/*
+ * Graph patterns are interned: every molecule, species list, reaction and
+ * query with the same pattern shares one reference counted graph_data, so
+ * its diffusion and reactivity data is derived once per pattern.
+ */
+void initialize_graph_hashmap(struct volume *world);
+struct graph_data *find_graph_data(struct volume *world,
+                                   const char *graph_pattern);
+struct graph_data *intern_graph_data(struct volume *world,
+                                     const char *graph_pattern, bool *created);
+void acquire_graph_data(struct graph_data *graph);
+void release_graph_data(struct graph_data *graph);
 
-u_int get_nfsim_flags(void *mol_ptr);
-u_int get_standard_flags(void *mol_ptr);
+/* Molecule references pair with the population counts of species */
+static inline void acquire_molecule_graph(struct abstract_molecule *am) {
+  if (am->properties->flags & EXTERNAL_SPECIES)
+    acquire_graph_data(am->graph_data);
+}
+
+static inline void release_molecule_graph(struct abstract_molecule *am) {
+  if (am->properties->flags & EXTERNAL_SPECIES)
+    release_graph_data(am->graph_data);
+}
+
+void get_graph_hashmap_stats(struct volume *world,
+                             struct hashmap_stats *stats);
+void free_graph_hashmap(struct volume *world);
 
 #endif
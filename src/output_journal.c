@@ -0,0 +1,724 @@
+/******************************************************************************
+ *
+ * Copyright (C) 2006-2017 by
+ * The Salk Institute for Biological Studies and
+ * Pittsburgh Supercomputing Center, Carnegie Mellon University
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ *
+******************************************************************************/
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include "logging.h"
+#include "mem_util.h"
+#include "mcell_structs.h"
+#include "react_output.h"
+#include "sched_util.h"
+#include "util.h"
+#include "output_journal.h"
+
+/* A journal file is a header, two copies of the journal state, the names
+ * and titles of the journaled sets, the block's time stamps and the
+ * buffers of its count columns, set by set and column by column.  All
+ * values are in native byte order, as only the machine that wrote a
+ * journal is expected to recover it.
+ *
+ * Set descriptions are a u32 binary flag and a u32 column count, then the
+ * file name, the header comment and each column title as a u32 length and
+ * its bytes; a length of OUTPUT_JOURNAL_NO_STRING stands for NULL. */
+#define OUTPUT_JOURNAL_MAGIC "MCELLOJ"
+#define OUTPUT_JOURNAL_VERSION 1
+#define OUTPUT_JOURNAL_NO_STRING 0xFFFFFFFFu
+
+#ifndef _WIN32
+
+struct journal_header {
+  char magic[8];              /* OUTPUT_JOURNAL_MAGIC, written last */
+  uint32_t version;
+  uint32_t active;            /* Which copy of the state is current; accessed
+                                 with the __atomic builtins */
+
+  uint32_t n_rows;            /* Rows of the time stamps and each buffer */
+  uint32_t n_sets;
+  uint32_t n_columns;         /* Count columns of all sets together */
+  uint32_t time_is_iteration; /* Time stamps are iteration numbers */
+  uint32_t shortest_floats;   /* See -shortest_floats */
+  uint32_t buffer_bytes;      /* sizeof(struct output_buffer) */
+  uint64_t state_offset;      /* Offsets are in bytes from the file start */
+  uint64_t state_bytes;
+  uint64_t meta_offset;
+  uint64_t time_offset;
+  uint64_t columns_offset;
+  uint64_t file_bytes;
+};
+
+/* Where one set's data file stands */
+struct journal_set_state {
+  int64_t base_offset; /* Size of the file without the buffered rows */
+  uint32_t flushed;    /* The buffered rows are in the file already */
+  uint32_t header;     /* The buffered rows start with the column header */
+};
+
+/* Committing a row only raises 'rows' of the active state.  Anything else
+ * is changed in the inactive copy, which is then made active, so the
+ * journal is consistent at whatever point the process dies. */
+struct journal_state {
+  uint32_t rows; /* Rows buffered; accessed with the __atomic builtins */
+  uint32_t padding;
+  struct journal_set_state sets[];
+};
+
+struct output_journal {
+  char *name;
+  unsigned char *map;
+  size_t map_bytes;
+  struct journal_header *header;
+};
+
+static uint64_t align_journal_offset(uint64_t offset) {
+  return (offset + 7) & ~(uint64_t)7;
+}
+
+static struct journal_state *journal_state(struct output_journal *journal,
+                                           uint32_t which) {
+  return (struct journal_state *)(journal->map +
+                                  journal->header->state_offset +
+                                  which * journal->header->state_bytes);
+}
+
+/* Bytes taken by a string in a set description, storing it at p unless p is
+ * NULL */
+static size_t put_journal_string(unsigned char *p, char const *s) {
+  uint32_t len = (s == NULL) ? OUTPUT_JOURNAL_NO_STRING : (uint32_t)strlen(s);
+  if (p != NULL) {
+    memcpy(p, &len, sizeof(len));
+    if (s != NULL)
+      memcpy(p + sizeof(len), s, len);
+  }
+  return sizeof(len) + ((s == NULL) ? 0 : len);
+}
+
+static int is_count_set(struct output_set *set) {
+  return set->column_head != NULL &&
+         (set->column_head->expr->expr_flags & OEXPR_TYPE_MASK) !=
+             OEXPR_TYPE_TRIG;
+}
+
+/**************************************************************************
+ begin_journal_change:
+    Start changing the state of a journal by copying it to the inactive
+    copy.
+
+ In: journal: the output journal
+ Out: the inactive copy, to be made active by end_journal_change
+**************************************************************************/
+static struct journal_state *begin_journal_change(
+    struct output_journal *journal) {
+  uint32_t active =
+      __atomic_load_n(&journal->header->active, __ATOMIC_RELAXED);
+  struct journal_state *from = journal_state(journal, active);
+  struct journal_state *to = journal_state(journal, 1 - active);
+  __atomic_store_n(&to->rows, __atomic_load_n(&from->rows, __ATOMIC_RELAXED),
+                   __ATOMIC_RELAXED);
+  memcpy(to->sets, from->sets,
+         journal->header->n_sets * sizeof(struct journal_set_state));
+  return to;
+}
+
+static void end_journal_change(struct output_journal *journal) {
+  uint32_t active =
+      __atomic_load_n(&journal->header->active, __ATOMIC_RELAXED);
+  __atomic_store_n(&journal->header->active, 1 - active, __ATOMIC_RELEASE);
+}
+
+/**************************************************************************
+ create_block_journal:
+    Move the time stamps and count buffers of an output block into a new
+    journal file.
+
+ In: world: simulation state
+     block: an output block without a journal
+ Out: 0 on success, 1 on failure.  Blocks without count sets get no
+      journal.
+**************************************************************************/
+static int create_block_journal(struct volume *world,
+                                struct output_block *block) {
+  struct output_set *first = NULL;
+  uint32_t n_sets = 0, n_columns = 0;
+  uint64_t meta_bytes = 0;
+  for (struct output_set *set = block->data_set_head; set != NULL;
+       set = set->next) {
+    if (!is_count_set(set))
+      continue;
+    if (first == NULL)
+      first = set;
+    n_sets++;
+    meta_bytes += 2 * sizeof(uint32_t) +
+                  put_journal_string(NULL, set->outfile_name) +
+                  put_journal_string(NULL, set->header_comment);
+    for (struct output_column *oc = set->column_head; oc != NULL;
+         oc = oc->next) {
+      n_columns++;
+      meta_bytes += put_journal_string(NULL, oc->expr->title);
+    }
+  }
+  if (first == NULL)
+    return 0;
+
+  struct journal_header layout;
+  memset(&layout, 0, sizeof(layout));
+  layout.version = OUTPUT_JOURNAL_VERSION;
+  layout.n_rows = block->buffersize;
+  layout.n_sets = n_sets;
+  layout.n_columns = n_columns;
+  layout.time_is_iteration = (block->timer_type == OUTPUT_BY_ITERATION_LIST);
+  layout.shortest_floats = (uint32_t)world->shortest_floats;
+  layout.buffer_bytes = sizeof(struct output_buffer);
+  layout.state_offset = align_journal_offset(sizeof(struct journal_header));
+  layout.state_bytes = align_journal_offset(
+      sizeof(struct journal_state) + n_sets * sizeof(struct journal_set_state));
+  layout.meta_offset = layout.state_offset + 2 * layout.state_bytes;
+  layout.time_offset = align_journal_offset(layout.meta_offset + meta_bytes);
+  layout.columns_offset = layout.time_offset + layout.n_rows * sizeof(double);
+  layout.file_bytes = layout.columns_offset + (uint64_t)n_columns *
+                                                  layout.n_rows *
+                                                  sizeof(struct output_buffer);
+
+  char *name = CHECKED_SPRINTF("%s%s", first->outfile_name,
+                               OUTPUT_JOURNAL_SUFFIX);
+  if (access(name, F_OK) == 0)
+    mcell_warn("Replacing the output journal '%s' of an earlier run.", name);
+  int fd = open(name, O_RDWR | O_CREAT | O_TRUNC, 0666);
+  if (fd < 0 || ftruncate(fd, (off_t)layout.file_bytes) != 0) {
+    mcell_perror_nodie(errno, "Failed to create output journal '%s'", name);
+    if (fd >= 0)
+      close(fd);
+    free(name);
+    return 1;
+  }
+  void *map = mmap(NULL, (size_t)layout.file_bytes, PROT_READ | PROT_WRITE,
+                   MAP_SHARED, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    mcell_perror_nodie(errno, "Failed to map output journal '%s'", name);
+    unlink(name);
+    free(name);
+    return 1;
+  }
+
+  struct output_journal *journal =
+      CHECKED_MALLOC_STRUCT(struct output_journal, "output journal");
+  journal->name = name;
+  journal->map = (unsigned char *)map;
+  journal->map_bytes = (size_t)layout.file_bytes;
+  journal->header = (struct journal_header *)map;
+  memcpy(journal->header, &layout, sizeof(layout));
+
+  /* Describe the sets and say where each file stands */
+  struct journal_state *state = journal_state(journal, 0);
+  __atomic_store_n(&state->rows, block->buf_index, __ATOMIC_RELAXED);
+  unsigned char *meta = journal->map + layout.meta_offset;
+  int index = 0;
+  for (struct output_set *set = block->data_set_head; set != NULL;
+       set = set->next) {
+    if (!is_count_set(set))
+      continue;
+    struct journal_set_state *ss = &state->sets[index];
+    ss->base_offset = 0;
+    struct stat fs;
+    if (reaction_output_mode(world, set)[0] == 'a' &&
+        stat(set->outfile_name, &fs) == 0)
+      ss->base_offset = fs.st_size;
+    ss->flushed = 0;
+    ss->header = (uint32_t)reaction_output_needs_header(world, set);
+    set->journal_set = index++;
+
+    uint32_t desc[2] = { (uint32_t)set->binary_flag, 0 };
+    for (struct output_column *oc = set->column_head; oc != NULL;
+         oc = oc->next)
+      desc[1]++;
+    memcpy(meta, desc, sizeof(desc));
+    meta += sizeof(desc);
+    meta += put_journal_string(meta, set->outfile_name);
+    meta += put_journal_string(meta, set->header_comment);
+    for (struct output_column *oc = set->column_head; oc != NULL;
+         oc = oc->next)
+      meta += put_journal_string(meta, oc->expr->title);
+  }
+  begin_journal_change(journal); /* Both copies start out the same */
+
+  /* Move the buffers in */
+  double *times = (double *)(journal->map + layout.time_offset);
+  memcpy(times, block->time_array, layout.n_rows * sizeof(double));
+  free(block->time_array);
+  block->time_array = times;
+  struct output_buffer *buffer =
+      (struct output_buffer *)(journal->map + layout.columns_offset);
+  for (struct output_set *set = block->data_set_head; set != NULL;
+       set = set->next) {
+    if (set->journal_set < 0)
+      continue;
+    for (struct output_column *oc = set->column_head; oc != NULL;
+         oc = oc->next) {
+      memcpy(buffer, oc->buffer, layout.n_rows * sizeof(struct output_buffer));
+      free(oc->buffer);
+      oc->buffer = buffer;
+      buffer += layout.n_rows;
+    }
+  }
+
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  memcpy(journal->header->magic, OUTPUT_JOURNAL_MAGIC,
+         sizeof(OUTPUT_JOURNAL_MAGIC));
+  block->journal = journal;
+  return 0;
+}
+
+/**************************************************************************
+ close_block_journal:
+    Move the time stamps and count buffers of an output block back into
+    memory and unmap its journal.
+
+ In: block: an output block with a journal
+     remove_file: nonzero to delete the journal file
+ Out: None.
+**************************************************************************/
+static void close_block_journal(struct output_block *block, int remove_file) {
+  struct output_journal *journal = block->journal;
+  u_int n_rows = journal->header->n_rows;
+
+  double *times =
+      CHECKED_MALLOC_ARRAY(double, n_rows, "reaction data output times array");
+  memcpy(times, block->time_array, n_rows * sizeof(double));
+  block->time_array = times;
+  for (struct output_set *set = block->data_set_head; set != NULL;
+       set = set->next) {
+    if (set->journal_set < 0)
+      continue;
+    for (struct output_column *oc = set->column_head; oc != NULL;
+         oc = oc->next) {
+      struct output_buffer *buffer = CHECKED_MALLOC_ARRAY(
+          struct output_buffer, n_rows, "reaction data output buffer");
+      memcpy(buffer, oc->buffer, n_rows * sizeof(struct output_buffer));
+      oc->buffer = buffer;
+    }
+    set->journal_set = -1;
+  }
+
+  munmap(journal->map, journal->map_bytes);
+  if (remove_file && unlink(journal->name) != 0 && errno != ENOENT)
+    mcell_perror_nodie(errno, "Failed to remove output journal '%s'",
+                       journal->name);
+  free(journal->name);
+  free(journal);
+  block->journal = NULL;
+}
+
+/**************************************************************************
+ for_each_scheduled_block:
+    Visit every output block in the count scheduler, which holds all of them
+    once they are scheduled.
+
+ In: world: simulation state
+     visit: called on each block, stopping at the first nonzero return
+     arg: passed to visit
+ Out: the first nonzero return of visit, or 0
+**************************************************************************/
+static int for_each_scheduled_block(struct volume *world,
+                                    int (*visit)(struct volume *,
+                                                 struct output_block *, int),
+                                    int arg) {
+  for (struct schedule_helper *sh = world->count_scheduler; sh != NULL;
+       sh = sh->next_scale) {
+    for (int i = 0; i <= sh->buf_len; i++) {
+      struct output_block *ob = (struct output_block *)(
+          (i == sh->buf_len) ? sh->current : sh->circ_buf_head[i]);
+      for (; ob != NULL; ob = ob->next) {
+        int status = visit(world, ob, arg);
+        if (status)
+          return status;
+      }
+    }
+  }
+  return 0;
+}
+
+static int close_scheduled_journal(struct volume *world,
+                                   struct output_block *block,
+                                   int remove_files) {
+  UNUSED(world);
+  if (block->journal != NULL)
+    close_block_journal(block, remove_files);
+  return 0;
+}
+
+static int create_scheduled_journal(struct volume *world,
+                                    struct output_block *block, int unused) {
+  UNUSED(unused);
+  return output_journal_create(world, block);
+}
+
+#endif
+
+/**************************************************************************
+ output_journal_create:
+    Give an output block with count output a journal, if -output_journal
+    asks for them.  Only the rank that writes reaction data keeps journals.
+
+ In: world: simulation state
+     block: an output block, with its buffers sized
+ Out: 0 on success, 1 on failure
+**************************************************************************/
+int output_journal_create(struct volume *world, struct output_block *block) {
+  if (!world->output_journal || world->procnum != 0 || block->journal != NULL)
+    return 0;
+#ifndef _WIN32
+  return create_block_journal(world, block);
+#else
+  UNUSED(block);
+  mcell_warn("Output journals are not supported on Windows; "
+             "keeping reaction data in memory.");
+  world->output_journal = 0;
+  return 0;
+#endif
+}
+
+/**************************************************************************
+ output_journals_create:
+    Give every scheduled output block a journal, if -output_journal asks for
+    them.
+
+ In: world: simulation state
+ Out: 0 on success, 1 on failure
+**************************************************************************/
+int output_journals_create(struct volume *world) {
+#ifndef _WIN32
+  return for_each_scheduled_block(world, &create_scheduled_journal, 0);
+#else
+  UNUSED(world);
+  return 0;
+#endif
+}
+
+/**************************************************************************
+ output_journals_close:
+    Stop journaling the output of all scheduled blocks.
+
+ In: world: simulation state
+     remove_files: nonzero to delete the journal files, once everything in
+                   them has been written out
+ Out: None.  The buffers are back in process memory.
+**************************************************************************/
+void output_journals_close(struct volume *world, int remove_files) {
+#ifndef _WIN32
+  for_each_scheduled_block(world, &close_scheduled_journal, remove_files);
+#else
+  UNUSED(world);
+  UNUSED(remove_files);
+#endif
+}
+
+/**************************************************************************
+ output_journal_commit:
+    Record in the block's journal that the row just filled is complete.
+
+ In: block: an output block whose buf_index was just advanced
+ Out: None.
+**************************************************************************/
+void output_journal_commit(struct output_block *block) {
+#ifndef _WIN32
+  if (block->journal == NULL)
+    return;
+  uint32_t active =
+      __atomic_load_n(&block->journal->header->active, __ATOMIC_RELAXED);
+  __atomic_store_n(&journal_state(block->journal, active)->rows,
+                   block->buf_index, __ATOMIC_RELEASE);
+#else
+  UNUSED(block);
+#endif
+}
+
+/**************************************************************************
+ output_journal_flushed:
+    Record that the buffered rows of a set are in its data file.
+
+ In: journal: the journal of the set's block
+     set: the set's journal_set
+     file_size: size of the data file with the rows written
+ Out: None.
+**************************************************************************/
+void output_journal_flushed(struct output_journal *journal, int set,
+                            long long file_size) {
+#ifndef _WIN32
+  if (journal == NULL || set < 0)
+    return;
+  struct journal_state *state = begin_journal_change(journal);
+  state->sets[set].base_offset = file_size;
+  state->sets[set].flushed = 1;
+  state->sets[set].header = 0;
+  end_journal_change(journal);
+#else
+  UNUSED(journal);
+  UNUSED(set);
+  UNUSED(file_size);
+#endif
+}
+
+/**************************************************************************
+ output_journal_reset:
+    Record that the block starts buffering its rows afresh.
+
+ In: block: an output block whose buf_index was just reset
+ Out: None.
+**************************************************************************/
+void output_journal_reset(struct output_block *block) {
+#ifndef _WIN32
+  struct output_journal *journal = block->journal;
+  if (journal == NULL)
+    return;
+  struct journal_state *state = begin_journal_change(journal);
+  __atomic_store_n(&state->rows, 0, __ATOMIC_RELAXED);
+  for (uint32_t i = 0; i < journal->header->n_sets; i++)
+    state->sets[i].flushed = 0;
+  end_journal_change(journal);
+#else
+  UNUSED(block);
+#endif
+}
+
+#ifndef _WIN32
+/* Read a string of a set description, returning 1 if it overruns end */
+static int get_journal_string(unsigned char const **p,
+                              unsigned char const *end, char **s) {
+  uint32_t len;
+  *s = NULL;
+  if ((size_t)(end - *p) < sizeof(len))
+    return 1;
+  memcpy(&len, *p, sizeof(len));
+  *p += sizeof(len);
+  if (len == OUTPUT_JOURNAL_NO_STRING)
+    return 0;
+  if ((size_t)(end - *p) < len)
+    return 1;
+  *s = (char *)CHECKED_MALLOC(len + 1, "output journal string");
+  memcpy(*s, *p, len);
+  (*s)[len] = '\0';
+  *p += len;
+  return 0;
+}
+
+/**************************************************************************
+ recover_journal_set:
+    Write the buffered rows of one set to its data file, in place of
+    whatever part of them was written before the process died.
+
+ In: set: the set, with its columns' buffers in the journal
+     ss: where the set's data file stands
+     rows: number of rows buffered
+     shortest_floats: see -shortest_floats
+ Out: 0 on success, 1 on failure
+**************************************************************************/
+static int recover_journal_set(struct output_set *set,
+                               struct journal_set_state const *ss,
+                               u_int rows, int shortest_floats) {
+  struct stat fs;
+  if (stat(set->outfile_name, &fs) == 0) {
+    if (fs.st_size > ss->base_offset &&
+        truncate(set->outfile_name, (off_t)ss->base_offset) != 0) {
+      mcell_perror_nodie(errno, "Failed to truncate reaction data file '%s'",
+                         set->outfile_name);
+      return 1;
+    } else if (fs.st_size < ss->base_offset) {
+      mcell_warn("Reaction data file '%s' is shorter than its output journal "
+                 "expects; appending the buffered rows anyway.",
+                 set->outfile_name);
+    }
+  }
+
+  FILE *fp = open_file(set->outfile_name, "a");
+  if (fp == NULL)
+    return 1;
+  int err = write_count_rows(set, fp, rows, ss->header, shortest_floats);
+  if (fclose(fp) != 0)
+    err = 1;
+  if (err)
+    mcell_perror_nodie(errno, "Failed to write reaction data to '%s'",
+                       set->outfile_name);
+  else
+    mcell_log("Wrote %u buffered rows to '%s'.", rows, set->outfile_name);
+  return err;
+}
+#endif
+
+/**************************************************************************
+ output_journal_recover:
+    Write out the rows that a run killed before flushing them left in an
+    output journal, then delete the journal.
+
+ In: name: name of the journal file
+ Out: 0 on success, 1 on failure.  The journal is kept if anything could
+      not be written out.
+**************************************************************************/
+int output_journal_recover(char const *name) {
+#ifndef _WIN32
+  int fd = open(name, O_RDONLY);
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st) != 0) {
+    mcell_perror_nodie(errno, "Failed to open output journal '%s'", name);
+    if (fd >= 0)
+      close(fd);
+    return 1;
+  }
+  if ((size_t)st.st_size < sizeof(struct journal_header)) {
+    close(fd);
+    mcell_error_nodie("'%s' is not an output journal.", name);
+    return 1;
+  }
+  void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    mcell_perror_nodie(errno, "Failed to map output journal '%s'", name);
+    return 1;
+  }
+
+  struct output_journal journal;
+  journal.name = (char *)name;
+  journal.map = (unsigned char *)map;
+  journal.map_bytes = (size_t)st.st_size;
+  journal.header = (struct journal_header *)map;
+  struct journal_header const *h = journal.header;
+  uint32_t active = __atomic_load_n(&journal.header->active, __ATOMIC_SEQ_CST);
+  if (memcmp(h->magic, OUTPUT_JOURNAL_MAGIC, sizeof(OUTPUT_JOURNAL_MAGIC)) ||
+      h->version != OUTPUT_JOURNAL_VERSION ||
+      h->buffer_bytes != sizeof(struct output_buffer) || active > 1 ||
+      h->file_bytes > (uint64_t)st.st_size ||
+      h->state_bytes < sizeof(struct journal_state) +
+                           h->n_sets * sizeof(struct journal_set_state) ||
+      h->meta_offset < h->state_offset + 2 * h->state_bytes ||
+      h->time_offset < h->meta_offset ||
+      h->columns_offset < h->time_offset + h->n_rows * sizeof(double) ||
+      h->file_bytes < h->columns_offset + (uint64_t)h->n_columns * h->n_rows *
+                                              sizeof(struct output_buffer)) {
+    munmap(map, (size_t)st.st_size);
+    mcell_error_nodie("'%s' is not an output journal this build can read.",
+                      name);
+    return 1;
+  }
+  struct journal_state const *state = journal_state(&journal, active);
+  u_int rows =
+      __atomic_load_n(&journal_state(&journal, active)->rows, __ATOMIC_SEQ_CST);
+  if (rows > h->n_rows)
+    rows = h->n_rows;
+
+  struct output_block block;
+  memset(&block, 0, sizeof(block));
+  block.timer_type =
+      h->time_is_iteration ? OUTPUT_BY_ITERATION_LIST : OUTPUT_BY_STEP;
+  block.buffersize = h->n_rows;
+  block.time_array = (double *)(journal.map + h->time_offset);
+
+  unsigned char const *meta = journal.map + h->meta_offset;
+  unsigned char const *meta_end = journal.map + h->time_offset;
+  struct output_buffer *buffer =
+      (struct output_buffer *)(journal.map + h->columns_offset);
+  uint32_t columns_left = h->n_columns;
+  int n_errors = 0;
+  for (uint32_t i = 0; i < h->n_sets && n_errors == 0; i++) {
+    struct output_set set;
+    memset(&set, 0, sizeof(set));
+    set.block = &block;
+    set.journal_set = -1;
+
+    uint32_t desc[2];
+    char *comment;
+    if ((size_t)(meta_end - meta) < sizeof(desc)) {
+      n_errors++;
+      break;
+    }
+    memcpy(desc, meta, sizeof(desc));
+    meta += sizeof(desc);
+    if (desc[1] > columns_left ||
+        get_journal_string(&meta, meta_end, &set.outfile_name) ||
+        get_journal_string(&meta, meta_end, &comment) ||
+        set.outfile_name == NULL) {
+      free(set.outfile_name);
+      n_errors++;
+      break;
+    }
+    set.binary_flag = (int)desc[0];
+    set.header_comment = comment;
+    columns_left -= desc[1];
+
+    struct output_column *columns = CHECKED_MALLOC_ARRAY(
+        struct output_column, desc[1] + 1, "output journal columns");
+    struct output_expression *exprs = CHECKED_MALLOC_ARRAY(
+        struct output_expression, desc[1] + 1, "output journal columns");
+    memset(columns, 0, (desc[1] + 1) * sizeof(struct output_column));
+    memset(exprs, 0, (desc[1] + 1) * sizeof(struct output_expression));
+    for (uint32_t c = 0; c < desc[1]; c++) {
+      columns[c].next = (c + 1 < desc[1]) ? &columns[c + 1] : NULL;
+      columns[c].set = &set;
+      columns[c].buffer = buffer;
+      columns[c].expr = &exprs[c];
+      exprs[c].column = &columns[c];
+      buffer += h->n_rows;
+      if (get_journal_string(&meta, meta_end, &exprs[c].title))
+        n_errors++;
+    }
+    set.column_head = (desc[1] > 0) ? columns : NULL;
+
+    if (n_errors == 0 && !state->sets[i].flushed && rows > 0 &&
+        set.column_head != NULL)
+      n_errors += recover_journal_set(&set, &state->sets[i], rows,
+                                      (int)h->shortest_floats);
+
+    for (uint32_t c = 0; c < desc[1]; c++)
+      free(exprs[c].title);
+    free(exprs);
+    free(columns);
+    free(comment);
+    free(set.outfile_name);
+  }
+  munmap(map, (size_t)st.st_size);
+
+  if (n_errors != 0) {
+    mcell_error_nodie("Could not recover all of output journal '%s'; "
+                      "keeping it.", name);
+    return 1;
+  }
+  if (unlink(name) != 0)
+    mcell_perror_nodie(errno, "Failed to remove output journal '%s'", name);
+  return 0;
+#else
+  mcell_error_nodie("Output journals are not supported on Windows, so '%s' "
+                    "cannot be recovered.", name);
+  return 1;
+#endif
+}
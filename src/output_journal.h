@@ -0,0 +1,46 @@
+/******************************************************************************
+ *
+ * Copyright (C) 2006-2017 by
+ * The Salk Institute for Biological Studies and
+ * Pittsburgh Supercomputing Center, Carnegie Mellon University
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ *
+******************************************************************************/
+
+#pragma once
+
+#include "mcell_structs.h"
+
+/* Output journals keep the count buffers of an output block in a
+ * memory-mapped file rather than in process memory.  A count is in the
+ * journal as soon as its row is committed, so if the process is killed
+ * before the rows reach their data files, they can still be written out
+ * afterwards with -recover_output.  Trigger output is not journaled. */
+
+/* Appended to the name of the block's first count file to name its journal */
+#define OUTPUT_JOURNAL_SUFFIX ".journal"
+
+int output_journal_create(struct volume *world, struct output_block *block);
+int output_journals_create(struct volume *world);
+void output_journals_close(struct volume *world, int remove_files);
+
+void output_journal_commit(struct output_block *block);
+void output_journal_flushed(struct output_journal *journal, int set,
+                            long long file_size);
+void output_journal_reset(struct output_block *block);
+
+int output_journal_recover(char const *name);
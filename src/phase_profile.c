@@ -0,0 +1,535 @@
+/******************************************************************************
+ *
+ * Copyright (C) 2006-2017 by
+ * The Salk Institute for Biological Studies and
+ * Pittsburgh Supercomputing Center, Carnegie Mellon University
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ *
+******************************************************************************/
+
+/**************************************************************************\
+** File: phase_profile.c                                                  **
+**                                                                        **
+** Purpose: Per-thread accumulation and final report of the time spent in **
+**    each phase of an iteration (see phase_profile.h).                   **
+\**************************************************************************/
+
+#include "config.h"
+
+#include "phase_profile.h"
+
+#ifdef MCELL_PHASE_PROFILE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifndef _WIN32
+#include <pthread.h>
+#endif
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <stdint.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "logging.h"
+#include "mcell_structs.h"
+
+#define PHASE_PROFILE_DEFAULT_FILE "mcell_phase_profile.json"
+#define COST_FILE_DEFAULT_PREFIX "mcell_cost"
+
+static const char *phase_names[N_PROFILE_PHASES] = {
+  "geometry_changes", "releases",     "reaction_output", "volume_output",
+  "viz_output",       "conc_clamp",   "timesteps",       "unimolecular",
+  "diffuse_3d",       "diffuse_2d",   "react_2d",        "reschedule"
+};
+
+static const char *perf_counter_names[N_PERF_COUNTERS] = {
+  "cycles", "instructions", "l1d_misses", "llc_misses", "branch_misses"
+};
+
+/* Every thread's profile, and the clock and monotonic time of the first one
+ * created, used to convert cycles to seconds */
+static struct phase_profile *all_profiles = NULL;
+static unsigned long long first_clock;
+static struct timespec first_time;
+#ifndef _WIN32
+static pthread_mutex_t profiles_lock = PTHREAD_MUTEX_INITIALIZER;
+static __thread struct phase_profile *thread_profile = NULL;
+#else
+static struct phase_profile *thread_profile = NULL;
+#endif
+
+/*************************************************************************
+open_perf_counters:
+  In: prof: profile of the calling thread
+  Out: the hardware counters of the calling thread are opened as one group
+       if MCELL_PERF_COUNTERS is set; counters that cannot be opened are
+       left at -1, and none are if the cycle counter cannot be
+*************************************************************************/
+static void open_perf_counters(struct phase_profile *prof) {
+  for (int c = 0; c < N_PERF_COUNTERS; c++)
+    prof->perf_fd[c] = -1;
+#ifdef __linux__
+  const char *enable = getenv("MCELL_PERF_COUNTERS");
+  if (enable == NULL || *enable == '\0' || strcmp(enable, "0") == 0)
+    return;
+
+  static const struct {
+    unsigned type;
+    unsigned long long config;
+  } events[N_PERF_COUNTERS] = {
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+    { PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D |
+                              (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                              (PERF_COUNT_HW_CACHE_RESULT_MISS << 16) },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+  };
+  for (int c = 0; c < N_PERF_COUNTERS; c++) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = events[c].type;
+    attr.config = events[c].config;
+    attr.disabled = (c == PERF_CYCLES);
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP;
+    prof->perf_fd[c] = (int)syscall(SYS_perf_event_open, &attr, 0, -1,
+                                    prof->perf_fd[PERF_CYCLES], 0);
+    if (prof->perf_fd[PERF_CYCLES] < 0) {
+      mcell_warn("Hardware counters are not available (perf_event_open "
+                 "failed); only phase times are profiled.");
+      return;
+    }
+  }
+  ioctl(prof->perf_fd[PERF_CYCLES], PERF_EVENT_IOC_ENABLE,
+        PERF_IOC_FLAG_GROUP);
+#endif
+}
+
+/*************************************************************************
+read_perf_counters:
+  In: prof: profile of the calling thread
+      value: set to the current value of every counter, 0 for counters
+             that are not open
+  Out: 1 if the counters were read, 0 otherwise
+*************************************************************************/
+static int read_perf_counters(struct phase_profile *prof,
+                              unsigned long long *value) {
+#ifdef __linux__
+  if (prof->perf_fd[PERF_CYCLES] < 0)
+    return 0;
+  /* The group is read as the number of counters and their values, in the
+   * order they were opened */
+  uint64_t buf[1 + N_PERF_COUNTERS];
+  ssize_t n = read(prof->perf_fd[PERF_CYCLES], buf, sizeof(buf));
+  if (n < (ssize_t)sizeof(uint64_t))
+    return 0;
+  unsigned k = 0;
+  for (int c = 0; c < N_PERF_COUNTERS; c++) {
+    value[c] = 0;
+    if (prof->perf_fd[c] >= 0 && k < buf[0])
+      value[c] = buf[1 + k++];
+  }
+  return 1;
+#else
+  (void)prof;
+  (void)value;
+  return 0;
+#endif
+}
+
+/*************************************************************************
+phase_perf_start:
+  In: sample: where to keep the counter values at the start of a phase
+  Out: the counters of the calling thread are read into sample
+*************************************************************************/
+void phase_perf_start(struct perf_sample *sample) {
+  sample->valid =
+      read_perf_counters(phase_profile_of_thread(), sample->value);
+}
+
+/*************************************************************************
+phase_perf_add:
+  In: phase: phase that ended
+      start: counter values at its start
+  Out: the events since start are added to the phase
+*************************************************************************/
+void phase_perf_add(enum profile_phase phase, struct perf_sample const *start) {
+  struct phase_profile *prof = phase_profile_of_thread();
+  unsigned long long value[N_PERF_COUNTERS];
+  if (!start->valid || !read_perf_counters(prof, value))
+    return;
+  for (int c = 0; c < N_PERF_COUNTERS; c++)
+    prof->events[phase][c] += value[c] - start->value[c];
+}
+
+/*************************************************************************
+phase_species_start:
+  In: world: simulation state (or the thread's copy of it)
+      sample: where to keep the clock and counters
+  Out: the clock and the diffusion counters of world are read into sample
+*************************************************************************/
+void phase_species_start(struct volume *world, struct species_sample *sample) {
+  sample->diffusion_steps = world->stats.diffusion_number;
+  sample->ray_polygon_tests = world->stats.ray_polygon_tests;
+  sample->subvol_crossings = phase_profile_of_thread()->subvol_crossings;
+  sample->start = phase_clock();
+}
+
+/*************************************************************************
+phase_species_add:
+  In: phase: per-molecule phase that ended
+      world: simulation state (or the thread's copy of it)
+      spec: species of the molecule
+      start: clock and counters at the start of the phase
+  Out: the time of the phase is added to it and to spec, and the diffusion
+       work since start to spec
+*************************************************************************/
+void phase_species_add(enum profile_phase phase, struct volume *world,
+                       struct species *spec,
+                       struct species_sample const *start) {
+  unsigned long long cycles = phase_clock() - start->start;
+  phase_profile_add(phase, start->start);
+
+  struct phase_profile *prof = phase_profile_of_thread();
+  if (spec->species_id >= prof->n_species) {
+    unsigned n = 2 * prof->n_species;
+    if (n <= spec->species_id)
+      n = spec->species_id + 16;
+    struct species_cost *costs =
+        realloc(prof->species, n * sizeof(struct species_cost));
+    if (costs == NULL)
+      mcell_allocfailed("Failed to allocate the species costs.");
+    memset(costs + prof->n_species, 0,
+           (n - prof->n_species) * sizeof(struct species_cost));
+    prof->species = costs;
+    prof->n_species = n;
+  }
+  struct species_cost *cost = &prof->species[spec->species_id];
+  cost->cycles += cycles;
+  cost->diffusion_steps += world->stats.diffusion_number - start->diffusion_steps;
+  cost->ray_polygon_tests +=
+      world->stats.ray_polygon_tests - start->ray_polygon_tests;
+  cost->subvol_crossings += prof->subvol_crossings - start->subvol_crossings;
+}
+
+/*************************************************************************
+phase_profile_of_thread:
+  In: none
+  Out: the profile of the calling thread, created and registered on first
+       use.  The process exits if it cannot be allocated.
+*************************************************************************/
+struct phase_profile *phase_profile_of_thread(void) {
+  if (thread_profile != NULL)
+    return thread_profile;
+
+  struct phase_profile *prof = calloc(1, sizeof(struct phase_profile));
+  if (prof == NULL)
+    mcell_allocfailed("Failed to allocate a phase profile.");
+#ifndef _WIN32
+  pthread_mutex_lock(&profiles_lock);
+#endif
+  if (all_profiles == NULL) {
+    clock_gettime(CLOCK_MONOTONIC, &first_time);
+    first_clock = phase_clock();
+  }
+  prof->next = all_profiles;
+  all_profiles = prof;
+#ifndef _WIN32
+  pthread_mutex_unlock(&profiles_lock);
+#endif
+  thread_profile = prof;
+  open_perf_counters(prof);
+  return prof;
+}
+
+/*************************************************************************
+phase_clock_rate:
+  In: none
+  Out: phase_clock ticks per second, measured against the monotonic clock
+       since the first profile was created, or 0 if too little time has
+       passed to tell
+*************************************************************************/
+static double phase_clock_rate(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  unsigned long long ticks = phase_clock() - first_clock;
+  double seconds = (double)(now.tv_sec - first_time.tv_sec) +
+                   1e-9 * (double)(now.tv_nsec - first_time.tv_nsec);
+  if (seconds < 1e-3)
+    return 0;
+  return (double)ticks / seconds;
+}
+
+/*************************************************************************
+open_cost_file:
+  In: kind: "species" or "reactions"
+  Out: the CSV file named from MCELL_COST_FILE_PREFIX (default mcell_cost)
+       and kind, opened for writing, or NULL after a warning
+*************************************************************************/
+static FILE *open_cost_file(char const *kind) {
+  const char *prefix = getenv("MCELL_COST_FILE_PREFIX");
+  if (prefix == NULL || *prefix == '\0')
+    prefix = COST_FILE_DEFAULT_PREFIX;
+  char path[1024];
+  snprintf(path, sizeof(path), "%s_%s.csv", prefix, kind);
+  FILE *f = fopen(path, "w");
+  if (f == NULL)
+    mcell_warn("Could not write the %s costs to '%s'.", kind, path);
+  return f;
+}
+
+/*************************************************************************
+phase_profile_write_costs:
+  In: world: simulation state
+  Out: the costs of every species, summed over all threads, and the tests
+       of every reaction are written as CSV, replacing the files of an
+       earlier call.  Failing to write them only warns.
+*************************************************************************/
+void phase_profile_write_costs(struct volume *world) {
+  double rate = phase_clock_rate();
+
+  FILE *f = open_cost_file("species");
+  if (f != NULL) {
+    fprintf(f, "iteration,species,diffusion_steps,ray_polygon_tests,"
+               "subvol_crossings,seconds,ns_per_step\n");
+#ifndef _WIN32
+    pthread_mutex_lock(&profiles_lock);
+#endif
+    for (int i = 0; i < world->n_species; i++) {
+      struct species *spec = world->species_list[i];
+      struct species_cost total = { 0, 0, 0, 0 };
+      for (struct phase_profile *prof = all_profiles; prof != NULL;
+           prof = prof->next) {
+        if (spec->species_id >= prof->n_species)
+          continue;
+        struct species_cost *cost = &prof->species[spec->species_id];
+        total.cycles += cost->cycles;
+        total.diffusion_steps += cost->diffusion_steps;
+        total.ray_polygon_tests += cost->ray_polygon_tests;
+        total.subvol_crossings += cost->subvol_crossings;
+      }
+      if (total.cycles == 0)
+        continue;
+      double seconds = rate > 0 ? (double)total.cycles / rate : 0.0;
+      fprintf(f, "%lld,%s,%lld,%lld,%lld,%.9f,%.1f\n",
+              world->current_iterations, spec->sym->name,
+              total.diffusion_steps, total.ray_polygon_tests,
+              total.subvol_crossings, seconds,
+              total.diffusion_steps > 0
+                  ? 1e9 * seconds / (double)total.diffusion_steps
+                  : 0.0);
+    }
+#ifndef _WIN32
+    pthread_mutex_unlock(&profiles_lock);
+#endif
+    if (fclose(f) != 0)
+      mcell_warn("Could not write the species costs.");
+  }
+
+  f = open_cost_file("reactions");
+  if (f != NULL) {
+    fprintf(f, "iteration,reaction,occurred,failed_tests,skipped\n");
+    for (int i = 0; i < world->rx_hashsize; i++) {
+      for (struct rxn *rx = world->reaction_hash[i]; rx != NULL;
+           rx = rx->next) {
+        fprintf(f, "%lld,", world->current_iterations);
+        for (unsigned int j = 0; j < rx->n_reactants; j++)
+          fprintf(f, "%s%s", j ? " + " : "", rx->players[j]->sym->name);
+        fprintf(f, ",%lld,%lld,%.15g\n", rx->n_occurred, rx->n_failed,
+                rx->n_skipped);
+      }
+    }
+    if (fclose(f) != 0)
+      mcell_warn("Could not write the reaction costs.");
+  }
+}
+
+/*************************************************************************
+phase_profile_name:
+  In: phase: a phase of an iteration
+  Out: the name the phase is reported under
+*************************************************************************/
+char const *phase_profile_name(enum profile_phase phase) {
+  return phase_names[phase];
+}
+
+/*************************************************************************
+phase_profile_totals:
+  In: calls: array of N_PROFILE_PHASES to fill
+      seconds: array of N_PROFILE_PHASES to fill
+  Out: the number of threads profiled.  calls and seconds hold the calls
+       and time of each phase, summed over all threads.
+*************************************************************************/
+int phase_profile_totals(unsigned long long *calls, double *seconds) {
+  unsigned long long cycles[N_PROFILE_PHASES] = { 0 };
+  for (int p = 0; p < N_PROFILE_PHASES; p++)
+    calls[p] = 0;
+
+#ifndef _WIN32
+  pthread_mutex_lock(&profiles_lock);
+#endif
+  int n_threads = 0;
+  for (struct phase_profile *prof = all_profiles; prof != NULL;
+       prof = prof->next) {
+    n_threads++;
+    for (int p = 0; p < N_PROFILE_PHASES; p++) {
+      cycles[p] += prof->cycles[p];
+      calls[p] += prof->calls[p];
+    }
+  }
+#ifndef _WIN32
+  pthread_mutex_unlock(&profiles_lock);
+#endif
+
+  double rate = phase_clock_rate();
+  for (int p = 0; p < N_PROFILE_PHASES; p++)
+    seconds[p] = rate > 0 ? (double)cycles[p] / rate : 0.0;
+  return n_threads;
+}
+
+/*************************************************************************
+phase_profile_report:
+  In: world: simulation state
+  Out: the summed profiles of all threads are written to the log as a table
+       and to the JSON file named by MCELL_PHASE_PROFILE_FILE (default
+       mcell_phase_profile.json), and the costs are written as CSV (see
+       phase_profile_write_costs).  Failing to write the files only warns.
+  Note: the run_timestep sub-phases are part of "timesteps", and volume
+        reactions are charged to diffuse_3d, where they are found.
+*************************************************************************/
+void phase_profile_report(struct volume *world) {
+  unsigned long long cycles[N_PROFILE_PHASES] = { 0 };
+  unsigned long long calls[N_PROFILE_PHASES] = { 0 };
+  unsigned long long events[N_PROFILE_PHASES][N_PERF_COUNTERS];
+  int counted[N_PERF_COUNTERS] = { 0 };
+  memset(events, 0, sizeof(events));
+  static unsigned long long histogram[N_PROFILE_PHASES][PHASE_HISTOGRAM_BINS];
+  memset(histogram, 0, sizeof(histogram));
+
+#ifndef _WIN32
+  pthread_mutex_lock(&profiles_lock);
+#endif
+  int n_threads = 0;
+  for (struct phase_profile *prof = all_profiles; prof != NULL;
+       prof = prof->next) {
+    n_threads++;
+    for (int p = 0; p < N_PROFILE_PHASES; p++) {
+      cycles[p] += prof->cycles[p];
+      calls[p] += prof->calls[p];
+      for (int b = 0; b < PHASE_HISTOGRAM_BINS; b++)
+        histogram[p][b] += prof->histogram[p][b];
+      for (int c = 0; c < N_PERF_COUNTERS; c++)
+        events[p][c] += prof->events[p][c];
+    }
+    for (int c = 0; c < N_PERF_COUNTERS; c++)
+      counted[c] |= (prof->perf_fd[c] >= 0);
+  }
+#ifndef _WIN32
+  pthread_mutex_unlock(&profiles_lock);
+#endif
+  if (n_threads == 0)
+    return;
+  phase_profile_write_costs(world);
+
+  double rate = phase_clock_rate();
+  unsigned long long top = 0;
+  for (int p = 0; p <= PHASE_TIMESTEPS; p++)
+    top += cycles[p];
+
+  mcell_log("Phase profile (%d thread%s):", n_threads,
+            n_threads == 1 ? "" : "s");
+  mcell_log("  %-18s %12s %12s %7s %14s", "phase", "calls", "seconds",
+            "share", "cycles/call");
+  for (int p = 0; p < N_PROFILE_PHASES; p++) {
+    mcell_log("  %-18s %12llu %12.4f %6.1f%% %14.0f", phase_names[p], calls[p],
+              rate > 0 ? (double)cycles[p] / rate : 0.0,
+              top > 0 ? 100.0 * (double)cycles[p] / (double)top : 0.0,
+              calls[p] > 0 ? (double)cycles[p] / (double)calls[p] : 0.0);
+  }
+
+  if (counted[PERF_CYCLES]) {
+    mcell_log("Hardware counters per phase (main thread; per 1000 "
+              "instructions):");
+    mcell_log("  %-18s %14s %14s %6s %9s %9s %9s", "phase", "cycles",
+              "instructions", "IPC", "L1D miss", "LLC miss", "br miss");
+    for (int p = 0; p <= PHASE_TIMESTEPS; p++) {
+      unsigned long long *e = events[p];
+      double kinstr = (double)e[PERF_INSTRUCTIONS] / 1000.0;
+      char per_kinstr[3][16];
+      for (int c = PERF_L1D_MISSES; c <= PERF_BRANCH_MISSES; c++) {
+        if (counted[c] && kinstr > 0)
+          snprintf(per_kinstr[c - PERF_L1D_MISSES], 16, "%.2f",
+                   (double)e[c] / kinstr);
+        else
+          snprintf(per_kinstr[c - PERF_L1D_MISSES], 16, "-");
+      }
+      mcell_log("  %-18s %14llu %14llu %6.2f %9s %9s %9s", phase_names[p],
+                e[PERF_CYCLES], e[PERF_INSTRUCTIONS],
+                e[PERF_CYCLES] > 0
+                    ? (double)e[PERF_INSTRUCTIONS] / (double)e[PERF_CYCLES]
+                    : 0.0,
+                per_kinstr[0], per_kinstr[1], per_kinstr[2]);
+    }
+  }
+
+  const char *path = getenv("MCELL_PHASE_PROFILE_FILE");
+  if (path == NULL || *path == '\0')
+    path = PHASE_PROFILE_DEFAULT_FILE;
+  FILE *f = fopen(path, "w");
+  if (f == NULL) {
+    mcell_warn("Could not write the phase profile to '%s'.", path);
+    return;
+  }
+  fprintf(f, "{\n  \"threads\": %d,\n  \"clock_rate\": %.6e,\n  \"phases\": {",
+          n_threads, rate);
+  for (int p = 0; p < N_PROFILE_PHASES; p++) {
+    int last_bin = PHASE_HISTOGRAM_BINS - 1;
+    while (last_bin > 0 && histogram[p][last_bin] == 0)
+      last_bin--;
+    fprintf(f, "%s\n    \"%s\": {\"calls\": %llu, \"cycles\": %llu, "
+               "\"seconds\": %.9f, \"log2_cycle_histogram\": [",
+            p == 0 ? "" : ",", phase_names[p], calls[p], cycles[p],
+            rate > 0 ? (double)cycles[p] / rate : 0.0);
+    for (int b = 0; b <= last_bin; b++)
+      fprintf(f, "%s%llu", b == 0 ? "" : ", ", histogram[p][b]);
+    fprintf(f, "]");
+    int first = 1;
+    for (int c = 0; c < N_PERF_COUNTERS; c++) {
+      if (!counted[c])
+        continue;
+      fprintf(f, "%s\"%s\": %llu", first ? ", \"counters\": {" : ", ",
+              perf_counter_names[c], events[p][c]);
+      first = 0;
+    }
+    fprintf(f, first ? "}" : "}}");
+  }
+  fprintf(f, "\n  }\n}\n");
+  if (fclose(f) != 0)
+    mcell_warn("Could not write the phase profile to '%s'.", path);
+}
+
+#endif
@@ -0,0 +1,203 @@
+/******************************************************************************
+ *
+ * Copyright (C) 2006-2017 by
+ * The Salk Institute for Biological Studies and
+ * Pittsburgh Supercomputing Center, Carnegie Mellon University
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ *
+******************************************************************************/
+
+#pragma once
+
+/* Opt-in wall-clock profiler of the phases of an iteration, enabled by
+ * building with MCELL_PHASE_PROFILE (cmake -DUSE_PHASE_PROFILE=ON).  Every
+ * thread accumulates the cycles and calls of each phase, and a log2
+ * histogram of the cycles per call, in its own profile; without the flag
+ * the timers compile down to the statements they wrap.
+ *
+ * On Linux, setting MCELL_PERF_COUNTERS=1 in the environment also counts
+ * hardware events (perf_event_open) in the phases of an iteration that run
+ * on the main thread; reading the counters costs a system call, so the
+ * per-molecule phases of run_timestep are only timed.
+ *
+ * The per-molecule phases are also charged to the species of the molecule,
+ * and failed reaction tests are counted per reaction; both are written as
+ * CSV at checkpoints and at the end of the run (phase_profile_write_costs).
+ */
+
+struct volume;
+struct species;
+
+enum profile_phase {
+  PHASE_GEOMETRY,         /* process_geometry_changes */
+  PHASE_RELEASES,         /* process_molecule_releases */
+  PHASE_REACTION_OUTPUT,  /* process_reaction_output */
+  PHASE_VOLUME_OUTPUT,    /* process_volume_output */
+  PHASE_VIZ_OUTPUT,       /* update_frame_data_list */
+  PHASE_CONC_CLAMP,       /* run_concentration_clamp */
+  PHASE_TIMESTEPS,        /* all run_timestep calls of an iteration */
+  PHASE_UNIMOLECULAR,     /* run_timestep: unimolecular checks */
+  PHASE_DIFFUSE_3D,       /* run_timestep: volume moves and their reactions */
+  PHASE_DIFFUSE_2D,       /* run_timestep: surface moves */
+  PHASE_REACT_2D,         /* run_timestep: surface-surface reactions */
+  PHASE_RESCHEDULE,       /* run_timestep: rescheduling */
+  N_PROFILE_PHASES
+};
+
+#ifdef MCELL_PHASE_PROFILE
+
+#define PHASE_HISTOGRAM_BINS 48 /* bin b counts calls of [2^b, 2^(b+1)) cycles */
+
+enum perf_counter {
+  PERF_CYCLES,
+  PERF_INSTRUCTIONS,
+  PERF_L1D_MISSES,
+  PERF_LLC_MISSES,
+  PERF_BRANCH_MISSES,
+  N_PERF_COUNTERS
+};
+
+/* What the molecules of one species cost a thread */
+struct species_cost {
+  unsigned long long cycles;
+  long long diffusion_steps;
+  long long ray_polygon_tests;
+  long long subvol_crossings;
+};
+
+struct phase_profile {
+  unsigned long long cycles[N_PROFILE_PHASES];
+  unsigned long long calls[N_PROFILE_PHASES];
+  unsigned long long histogram[N_PROFILE_PHASES][PHASE_HISTOGRAM_BINS];
+  unsigned long long events[N_PROFILE_PHASES][N_PERF_COUNTERS];
+  int perf_fd[N_PERF_COUNTERS]; /* -1 for counters that could not be opened;
+                                   perf_fd[PERF_CYCLES] leads the group */
+  struct species_cost *species; /* indexed by species_id */
+  unsigned n_species;           /* allocated length of species */
+  long long subvol_crossings;   /* subvolume boundaries crossed by volume
+                                   molecules of this thread */
+  struct phase_profile *next;   /* profile of the next thread */
+};
+
+/* Clock and counters of the world (copy) at the start of a per-molecule
+ * phase */
+struct species_sample {
+  unsigned long long start;
+  long long diffusion_steps;
+  long long ray_polygon_tests;
+  long long subvol_crossings;
+};
+
+/* Hardware counter values at the start of a phase */
+struct perf_sample {
+  int valid;
+  unsigned long long value[N_PERF_COUNTERS];
+};
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+static inline unsigned long long phase_clock(void) { return __rdtsc(); }
+#else
+#include <time.h>
+static inline unsigned long long phase_clock(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+#endif
+
+struct phase_profile *phase_profile_of_thread(void);
+void phase_profile_report(struct volume *world);
+void phase_perf_start(struct perf_sample *sample);
+void phase_perf_add(enum profile_phase phase, struct perf_sample const *start);
+void phase_species_start(struct volume *world, struct species_sample *sample);
+void phase_species_add(enum profile_phase phase, struct volume *world,
+                       struct species *spec,
+                       struct species_sample const *start);
+void phase_profile_write_costs(struct volume *world);
+char const *phase_profile_name(enum profile_phase phase);
+int phase_profile_totals(unsigned long long *calls, double *seconds);
+
+static inline void phase_profile_add(enum profile_phase phase,
+                                     unsigned long long start) {
+  unsigned long long cycles = phase_clock() - start;
+  struct phase_profile *prof = phase_profile_of_thread();
+  int bin = (cycles == 0) ? 0 : 63 - __builtin_clzll(cycles);
+  if (bin >= PHASE_HISTOGRAM_BINS)
+    bin = PHASE_HISTOGRAM_BINS - 1;
+  prof->cycles[phase] += cycles;
+  prof->calls[phase]++;
+  prof->histogram[phase][bin]++;
+}
+
+/* Run the statements, charging their time to phase */
+#define PROFILE_PHASE(phase, ...)                                              \
+  do {                                                                         \
+    unsigned long long phase_start = phase_clock();                            \
+    __VA_ARGS__;                                                               \
+    phase_profile_add(phase, phase_start);                                     \
+  } while (0)
+
+/* Run the statements, charging their time and hardware events to phase */
+#define PROFILE_COUNTED_PHASE(phase, ...)                                      \
+  do {                                                                         \
+    struct perf_sample phase_perf;                                             \
+    phase_perf_start(&phase_perf);                                             \
+    unsigned long long phase_start = phase_clock();                            \
+    __VA_ARGS__;                                                               \
+    phase_profile_add(phase, phase_start);                                     \
+    phase_perf_add(phase, &phase_perf);                                        \
+  } while (0)
+
+/* Run the statements, charging their time to phase and their time and
+ * diffusion work to spec, which must stay valid while they run */
+#define PROFILE_SPECIES_PHASE(phase, world, spec, ...)                         \
+  do {                                                                         \
+    struct species *phase_spec = (spec);                                       \
+    struct species_sample phase_sample;                                        \
+    phase_species_start(world, &phase_sample);                                 \
+    __VA_ARGS__;                                                               \
+    phase_species_add(phase, world, phase_spec, &phase_sample);                \
+  } while (0)
+
+#define PROFILE_SUBVOL_CROSSING() (phase_profile_of_thread()->subvol_crossings++)
+
+/* Count a failed test of the n reactions in rx; reactions force a
+ * single-threaded run, so the counters need no lock */
+#define PROFILE_FAILED_TESTS(rx, n)                                            \
+  do {                                                                         \
+    for (int phase_i = 0; phase_i < (n); phase_i++)                            \
+      (rx)[phase_i]->n_failed++;                                               \
+  } while (0)
+
+#else
+
+#define PROFILE_PHASE(phase, ...)                                              \
+  do {                                                                         \
+    __VA_ARGS__;                                                               \
+  } while (0)
+
+#define PROFILE_SPECIES_PHASE(phase, world, spec, ...)                         \
+  PROFILE_PHASE(phase, __VA_ARGS__)
+
+#define PROFILE_SUBVOL_CROSSING() ((void)0)
+
+#define PROFILE_FAILED_TESTS(rx, n) ((void)0)
+
+#define PROFILE_COUNTED_PHASE(phase, ...) PROFILE_PHASE(phase, __VA_ARGS__)
+
+#endif
@@ -0,0 +1,78 @@
+/******************************************************************************
+ *
+ * Copyright (C) 2006-2017 by
+ * The Salk Institute for Biological Studies and
+ * Pittsburgh Supercomputing Center, Carnegie Mellon University
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ *
+******************************************************************************/
+
+#include "config.h"
+
+#include "philox.h"
+
+#define PHILOX_M0 0xD2511F53u
+#define PHILOX_M1 0xCD9E8D57u
+#define PHILOX_W0 0x9E3779B9u
+#define PHILOX_W1 0xBB67AE85u
+
+/*************************************************************************
+philox_init:
+  In: rng: the generator
+      seed: the seed of the simulation
+      stream: the number of the stream within the seed
+  Out: No return value.  The generator is set to the start of the stream.
+*************************************************************************/
+void philox_init(struct philox_state *rng, uint32_t seed, uint32_t stream) {
+  rng->key[0] = seed;
+  rng->key[1] = stream;
+  rng->counter = 0;
+  rng->randcnt = 0;
+}
+
+/*************************************************************************
+philox_generate:
+  In: rng: the generator
+  Out: No return value.  The next block of four numbers of the stream is
+       computed by ten rounds of Philox4x32 and the counter is advanced.
+*************************************************************************/
+void philox_generate(struct philox_state *rng) {
+  uint32_t c0 = (uint32_t)rng->counter;
+  uint32_t c1 = (uint32_t)(rng->counter >> 32);
+  uint32_t c2 = 0, c3 = 0;
+  uint32_t k0 = rng->key[0], k1 = rng->key[1];
+
+  for (int round = 0; round < 10; ++round) {
+    uint64_t p0 = (uint64_t)PHILOX_M0 * c0;
+    uint64_t p1 = (uint64_t)PHILOX_M1 * c2;
+    uint32_t n0 = (uint32_t)(p1 >> 32) ^ c1 ^ k0;
+    uint32_t n2 = (uint32_t)(p0 >> 32) ^ c3 ^ k1;
+    c1 = (uint32_t)p1;
+    c3 = (uint32_t)p0;
+    c0 = n0;
+    c2 = n2;
+    k0 += PHILOX_W0;
+    k1 += PHILOX_W1;
+  }
+
+  rng->out[0] = c0;
+  rng->out[1] = c1;
+  rng->out[2] = c2;
+  rng->out[3] = c3;
+  ++rng->counter;
+  rng->randcnt = 4;
+}
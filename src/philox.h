@@ -0,0 +1,57 @@
+/******************************************************************************
+ *
+ * Copyright (C) 2006-2017 by
+ * The Salk Institute for Biological Studies and
+ * Pittsburgh Supercomputing Center, Carnegie Mellon University
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ *
+******************************************************************************/
+
+/*
+------------------------------------------------------------------------------
+philox.h: Philox4x32-10 counter-based random number generator
+
+Salmon, Moraes, Dror and Shaw, "Parallel random numbers: as easy as 1, 2, 3",
+SC11.  The n-th block of four numbers is a keyed bijection of n, so a stream
+is fully described by its key and how far it has got, and the key can be
+split between independent streams without them overlapping.
+------------------------------------------------------------------------------
+*/
+
+#pragma once
+
+#include <inttypes.h>
+
+#define PHILOX_DBL32 (2.3283064365386962890625e-10)
+
+struct philox_state {
+  uint32_t key[2];   /* seed and stream number */
+  unsigned long long counter; /* number of the next block to generate */
+  uint32_t out[4];   /* current block */
+  unsigned int randcnt; /* numbers left in the current block */
+};
+
+void philox_init(struct philox_state *rng, uint32_t seed, uint32_t stream);
+
+void philox_generate(struct philox_state *rng);
+
+#define philox_uint32(rng)                                                     \
+  ((rng)->randcnt > 0 ? (rng)->out[(rng)->randcnt -= 1]                        \
+                      : (philox_generate(rng), (rng)->randcnt = 3,             \
+                         (rng)->out[3]))
+
+#define philox_dbl32(rng) (PHILOX_DBL32 * (double)philox_uint32(rng))
@@ -81,6 +81,43 @@
   free($1);
 }
 
+// This tells SWIG to treat a list of rate constant handles as a special case
+%typemap(in) struct rxn_pathname ** {
+  /* Check if is a list */
+  if (PyList_Check($input))
+  {
+    int size = PyList_Size($input);
+    int i = 0;
+    $1 = (struct rxn_pathname **) malloc((size+1)*sizeof(struct rxn_pathname *));
+    for (i = 0; i < size; i++)
+    {
+      void *handle = NULL;
+      if (SWIG_IsOK(SWIG_ConvertPtr(PyList_GetItem($input,i), &handle,
+                                    $descriptor(struct rxn_pathname *), 0)))
+      {
+        $1[i] = (struct rxn_pathname *)handle;
+      }
+    else
+    {
+      PyErr_SetString(PyExc_TypeError,"list must contain rate constant handles");
+      free($1);
+      return NULL;
+    }
+  }
+  $1[i] = 0;
+  }
+  else
+  {
+    PyErr_SetString(PyExc_TypeError,"not a list");
+    return NULL;
+  }
+}
+
+// This cleans up the handle array we malloc'd before the function call
+%typemap(freearg) struct rxn_pathname ** {
+  free($1);
+}
+
 
 %{
 #define SWIG_FILE_WITH_INIT
@@ -97,8 +134,52 @@
 #include "mcell_run.h"
 #include "mcell_structs.h"
 #include "mcell_dyngeom.h"
+#include "chkpt_reader.h"
 #include "vector.h"
 
+/* Wrap rows x cols items living in MCell memory in a read-only memoryview,
+ * so that e.g. numpy.asarray() can look at them without a copy.  The items
+ * of a row are contiguous, rows are row_stride bytes apart. */
+static PyObject *pymcell_memoryview(void *buf, Py_ssize_t rows,
+                                    Py_ssize_t cols, Py_ssize_t itemsize,
+                                    Py_ssize_t row_stride, char *format) {
+  Py_ssize_t shape[2] = { rows, cols };
+  Py_ssize_t strides[2] = { row_stride, itemsize };
+  Py_buffer info;
+  info.buf = buf;
+  info.obj = NULL;
+  info.len = rows * cols * itemsize;
+  info.itemsize = itemsize;
+  info.readonly = 1;
+  info.ndim = (cols > 1) ? 2 : 1;
+  info.format = format;
+  info.shape = shape;
+  info.strides = strides;
+  info.suboffsets = NULL;
+  info.internal = NULL;
+  return PyMemoryView_FromBuffer(&info);
+}
+
+/* Borrow a C-contiguous buffer holding n rows of width items, each item of
+ * the given size and of one of the struct format codes listed.  Returns 0
+ * and fills buf (to be released by the caller) and n, or 1 if obj does not
+ * fit. */
+static int pymcell_get_array(PyObject *obj, const char *codes,
+                             Py_ssize_t itemsize, Py_ssize_t width,
+                             Py_buffer *buf, Py_ssize_t *n) {
+  if (PyObject_GetBuffer(obj, buf, PyBUF_C_CONTIGUOUS | PyBUF_FORMAT)) {
+    PyErr_Clear();
+    return 1;
+  }
+  char code = buf->format[strlen(buf->format) - 1];
+  *n = buf->len / (width * itemsize);
+  if (strchr(codes, code) == NULL || buf->itemsize != itemsize ||
+      buf->len != *n * width * itemsize || *n > INT_MAX) {
+    PyBuffer_Release(buf);
+    return 1;
+  }
+  return 0;
+}
 
 %}
 
@@ -137,6 +218,7 @@ from data_model_import import *
 %include "mcell_run.i"
 %include "mcell_structs.i"
 %include "mcell_dyngeom.i"
+%include "chkpt_reader.i"
 %include "vector.i"
 
 // Generate docstrings
@@ -11,6 +11,9 @@ import pymcell as m
 from typing import List, Dict, Iterable, Tuple, Any
 import logging
 from enum import Enum
+from concurrent.futures import Future
+import threading
+import array
 # import uuid
 import random
 
@@ -46,12 +49,16 @@ class MeshObj:
             name: str,
             vert_list: List[Tuple[float, float, float]],
             face_list: List[Tuple[int, int, int]],
-            translation: Tuple[float, float, float] = None) -> None:
+            translation: Tuple[float, float, float] = None,
+            binary_mesh: str = None) -> None:
         self.name = name
         self.vert_list = vert_list
         self.face_list = face_list
         self.regions = []  # type: List[SurfaceRegion]
         self.translation = translation
+        # Binary mesh file (see read_binary_mesh) holding the vertices and
+        # faces instead of vert_list and face_list
+        self.binary_mesh = binary_mesh
         logging.info("Creating mesh object '%s'" % name)
 
     def __str__(self):
@@ -284,6 +291,9 @@ class MCellSim:
         self._regions = {}  # type: Dict[str, Any]
         self._releases = {}  # type: Dict[str, Any]
         self._counts = {}  # type: Dict[str, Any]
+        # the value for _rate_handles is a swig wrapped "rxn_pathname"
+        self._rate_handles = {}  # type: Dict[str, Any]
+        self._mol_index = False
         self._iterations = 0
         self._current_iteration = 0
         self._finished = False
@@ -341,6 +351,11 @@ class MCellSim:
         m.mcell_set_iterations(self._world, iterations)
         self._iterations = iterations
 
+    def set_threads(self, num_threads: int) -> None:
+        """ Set number of threads used by the parallel phases of the
+        simulation. Call this before the simulation is started. """
+        m.mcell_set_threads(self._world, num_threads)
+
     # def set_seed(self, seed):
     #     self._seed = seed
     #     m.mcell_set_seed(self._world, seed)
@@ -416,13 +431,18 @@ class MCellSim:
 
     def add_geometry(self, mesh_obj: MeshObj) -> None:
         """ Add a mesh object to the simulation. """
-        mesh = m.create_polygon_object(
-            self._world,
-            mesh_obj.vert_list,
-            mesh_obj.face_list,
-            self._scene,
-            mesh_obj.name,
-            mesh_obj.translation)
+        if mesh_obj.binary_mesh is not None:
+            mesh = m.mcell_create_poly_object_from_binary(
+                self._world, self._scene, mesh_obj.name,
+                mesh_obj.binary_mesh, m.object())
+        else:
+            mesh = m.create_polygon_object(
+                self._world,
+                mesh_obj.vert_list,
+                mesh_obj.face_list,
+                self._scene,
+                mesh_obj.name,
+                mesh_obj.translation)
         if mesh_obj.name not in self._mesh_objects:
             self._mesh_objects[mesh_obj.name] = mesh
         for reg in mesh_obj.regions:
@@ -444,6 +464,22 @@ class MCellSim:
             self._world, "./viz_data/seed_%04i/Scene" % self._seed, viz_list,
             0, self._iterations, 1)
 
+    def add_trajectory(self, species: Iterable[Species], step: int = 1,
+                       sample_fraction: float = 0.0,
+                       mol_ids: Iterable[int] = ()) -> None:
+        """ Follow the molecules with the given ids, a sample_fraction of
+        all the molecules, or (with neither) all the molecules of the
+        species, writing their positions every step iterations. """
+        viz_list = None
+        for spec in species:
+            viz_list = m.mcell_add_to_species_list(
+                self._species[spec.name], False, 0, viz_list)
+        m.mcell_create_trajectory_output(
+            self._world, "./viz_data/seed_%04i/Scene" % self._seed, viz_list,
+            0, self._iterations, step, sample_fraction)
+        for mol_id in mol_ids:
+            m.mcell_track_molecule_id(self._world, mol_id)
+
     def release(self, relobj):
         """ Release molecules in/on an object or as a ListRelease. """
         if isinstance(relobj, ObjectRelease):
@@ -660,14 +696,61 @@ class MCellSim:
         return m.mcell_get_count(
             species.name, "Scene.%s,ALL" % mesh_obj.name, self._world)
 
+    def get_statistics(self) -> Dict[str, float]:
+        """ Get the diffusion and collision counts of the simulation so far,
+        added up over all memory partitions. """
+        stats = m.sim_stats()
+        m.mcell_get_statistics(self._world, stats)
+        return {name: getattr(stats, name) for name in (
+            "diffusion_number", "diffusion_cumtime", "diffusion_fast_steps",
+            "ray_voxel_tests", "ray_polygon_tests", "ray_polygon_colls",
+            "vol_vol_colls", "vol_surf_colls", "surf_surf_colls",
+            "vol_wall_colls", "vol_vol_vol_colls", "vol_vol_surf_colls",
+            "vol_surf_surf_colls", "surf_surf_surf_colls")}
+
+    def _enable_molecule_index(self) -> None:
+        if not self._mol_index:
+            m.mcell_enable_molecule_index(self._world)
+            self._mol_index = True
+
+    def find_molecule(self, mol_id: int):
+        """ Get the species name, position (in microns) and, for surface
+        molecules, orientation of the molecule with the given id, or None if
+        it is gone. """
+        self._enable_molecule_index()
+        mol = m.mcell_molecule_state()
+        if m.mcell_find_molecule(self._world, mol_id, mol) != 0:
+            return None
+        return {"species": mol.species_name, "pos": (mol.x, mol.y, mol.z),
+                "surface": bool(mol.is_surface), "orient": mol.orient}
+
+    def move_molecule(self, mol_id: int, pos) -> bool:
+        """ Put the volume molecule with the given id at pos (in microns),
+        without testing the walls in between. """
+        self._enable_molecule_index()
+        return m.mcell_move_molecule(
+            self._world, mol_id, pos[0], pos[1], pos[2]) == 0
+
+    def remove_molecule(self, mol_id: int) -> bool:
+        """ Remove the molecule with the given id from the simulation. """
+        self._enable_molecule_index()
+        return m.mcell_remove_molecule(self._world, mol_id) == 0
+
     def modify_rate_constant(
             self, rxn: Reaction, new_rate_constant: float) -> None:
         """ Modify the rate constant of the specified reaction. """
         if not rxn.name:
             print("You can only change a named reaction.")
         else:
-            m.mcell_modify_rate_constant(
-                self._world, rxn.name, new_rate_constant)
+            handle = self._rate_handles.get(rxn.name)
+            if handle is None:
+                handle = m.mcell_get_rate_constant_handle(
+                    self._world, rxn.name)
+                if handle is None:
+                    print("There is no reaction named %s." % rxn.name)
+                    return
+                self._rate_handles[rxn.name] = handle
+            m.mcell_set_rate_constant(self._world, handle, new_rate_constant)
 
     def run_iteration(self) -> None:
         """ Run a single iteration. """
@@ -689,6 +772,32 @@ class MCellSim:
             self._finished = True
         self._current_iteration += 1
 
+    def run_iterations_async(self, n_iter: int, callback=None) -> Future:
+        """ Run the next n_iter iterations in a background thread and return
+        a Future that is done when they are. The iterations run without the
+        GIL, so Python code (or other worlds) can run meanwhile, but this
+        world must not be touched until the Future is done. callback, if
+        given, is called with the Future when it is done. """
+        future = Future()  # type: Future
+        if callback is not None:
+            future.add_done_callback(callback)
+
+        def run():
+            if not future.set_running_or_notify_cancel():
+                return
+            try:
+                for i in range(n_iter):
+                    if self._finished:
+                        break
+                    self.run_iteration()
+            except BaseException as e:
+                future.set_exception(e)
+            else:
+                future.set_result(self._current_iteration)
+
+        threading.Thread(target=run, daemon=True).start()
+        return future
+
     def run_sim(self) -> None:
         """ Run the entire simulation without interruption. """
         if self._finished:
@@ -713,6 +822,37 @@ class MCellSim:
             m.mcell_print_final_statistics(self._world)
             self._finished = True
 
+    def run_branches(self, seeds, setup=None, max_parallel=1) -> List[bool]:
+        """ Run the rest of the simulation once per seed, each run branching
+        from the current state without reinitializing it. The output files
+        of each branch get the suffix ".branch<N>". setup(self, N) is called
+        in each branch before it runs, e.g. to modify rate constants.
+        Returns whether each branch succeeded. """
+        if not self._started:
+            m.mcell_init_simulation(self._world)
+            m.mcell_init_output(self._world)
+            self._started = True
+
+        results = [False] * len(seeds)
+        running = []
+        for n, seed in enumerate(seeds):
+            if len(running) >= max(1, max_parallel):
+                pid, i = running.pop(0)
+                results[i] = m.mcell_wait_branch(pid) == 0
+            pid = m.mcell_fork_branch(self._world, seed, ".branch%d" % n)
+            if pid == 0:
+                if setup is not None:
+                    setup(self, n)
+                while self._current_iteration <= self._iterations:
+                    m.mcell_run_iteration(self._world, self._output_freq, 0)
+                    self._current_iteration += 1
+                m.mcell_finish_branch(self._world)
+            if pid > 0:
+                running.append((pid, n))
+        for pid, i in running:
+            results[i] = m.mcell_wait_branch(pid) == 0
+        return results
+
 
 def create_partitions(world, axis, start, stop, step):
     expr_list = m.num_expr_list_head()
@@ -1098,6 +1238,8 @@ def create_box(world, scene, half_length, name):
 
 
 def change_geometry(world, scene_name, obj_list):
+    """Replaces the geometry; if only vertices move, the meshes are moved in
+    place instead of being rebuilt"""
 
     pobj_list = None
     verts = None
@@ -1131,6 +1273,30 @@ def change_geometry(world, scene_name, obj_list):
     m.mcell_change_geometry(world, pobj_list)
 
 
+def move_mesh_vertices(world, mesh_name, vert_list):
+    """Moves the vertices of a mesh in place, keeping its walls, regions and
+    molecules
+
+    Args:
+        world (object) -- the world object which has been generated by
+            mcell create_instance_object
+        mesh_name (string) -- fully qualified name of the mesh, e.g.
+            "Scene.box"
+        vert_list (vertex list) -- new position of every vertex, in the order
+            of the mesh's vertex list; an (n, 3) float64 numpy array is used
+            without a copy
+
+    Returns:
+        0 on success
+    """
+
+    try:
+        verts = memoryview(vert_list)
+    except TypeError:
+        verts = array.array('d', (c for v in vert_list for c in v))
+    return m.mcell_move_mesh_vertices_from_array(world, mesh_name, verts)
+
+
 def create_polygon_object(world, vert_list, face_list, scene, name, translation=None):
     """Creates a polygon object from a vertex and element lest
 
@@ -1146,30 +1312,17 @@ def create_polygon_object(world, vert_list, face_list, scene, name, translation=
         polygon object
     """
 
-    verts = None
-    vert_list = vert_list[::-1]
     t = translation
     if t:
-        for x, y, z in vert_list:
-            verts = m.mcell_add_to_vertex_list(x+t[0], y+t[1], z+t[2], verts)
+        verts = array.array('d', (c for x, y, z in vert_list
+                                  for c in (x+t[0], y+t[1], z+t[2])))
     else:
-        for x, y, z in vert_list:
-            verts = m.mcell_add_to_vertex_list(x, y, z, verts)
-
-    elems = None
-    face_list = face_list[::-1]
-    for x, y, z in face_list:
-        elems = m.mcell_add_to_connection_list(x, y, z, elems)
-
-    pobj = m.poly_object()
-    pobj.obj_name = name
-    pobj.vertices = verts
-    pobj.num_vert = len(vert_list)
-    pobj.connections = elems
-    pobj.num_conn = len(face_list)
+        verts = array.array('d', (c for v in vert_list for c in v))
+    faces = array.array('i', (i for f in face_list for i in f))
 
     mesh_temp = m.object()
-    mesh = m.mcell_create_poly_object(world, scene, pobj, mesh_temp)
+    mesh = m.mcell_create_poly_object_from_arrays(
+        world, scene, name, verts, faces, mesh_temp)
 
     return mesh
 
@@ -1192,10 +1345,100 @@ def create_surface_region(world, mesh, surf_reg_face_list, region_name):
 
     surface_region = m.mcell_create_region(world, mesh, region_name)
 
-    surf_reg_faces = None
-    for idx in surf_reg_face_list:
-        surf_reg_faces = m.mcell_add_to_region_list(surf_reg_faces, idx)
-
-    m.mcell_set_region_elements(surface_region, surf_reg_faces, 1)
+    m.mcell_set_region_elements_from_array(
+        surface_region, array.array('i', surf_reg_face_list), 1)
 
     return surface_region
+
+
+class CheckpointReader:
+    """Reads the molecules of a checkpoint file without setting up a
+    simulation, for offline analysis
+
+    The molecules of a checkpoint are stored as chunks (one per memory
+    partition, or slices of fixed-width records), which are read in batches
+    of numpy arrays. Chunks are independent of each other, so e.g. the
+    processes of a multiprocessing pool can each open the checkpoint and
+    read a share of them. Species are given by their checkpoint species id,
+    an index into species_names; positions are in the internal length units
+    of the model and times in seconds.
+    """
+
+    FIELDS = ('species', 'positions', 'sched_times', 'lifetimes',
+              'birthdays', 'orients', 'flags', 'boxes')
+
+    def __init__(self, filename):
+        self.reader = m.open_chkpt_reader(filename)
+        if self.reader is None:
+            raise IOError("Failed to read checkpoint file '%s'" % filename)
+        rd = self.reader
+        self.filename = filename
+        self.iteration = rd.iteration
+        self.time_seconds = rd.time_seconds
+        self.base_filename = rd.base_filename
+        self.n_mols = rd.n_mols
+        self.n_chunks = rd.n_chunks
+        self.species_names = [m.chkpt_reader_species_name(rd, i)
+                              for i in range(rd.n_species)]
+
+    def close(self):
+        if self.reader is not None:
+            m.close_chkpt_reader(self.reader)
+            self.reader = None
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *exc):
+        self.close()
+
+    def chunk_size(self, chunk):
+        """Number of molecules in a chunk"""
+        return m.chkpt_reader_chunk_mols(self.reader, chunk)
+
+    def read_chunk(self, chunk, batch_size=65536):
+        """Yields the molecules of one chunk in batches
+
+        Args:
+            chunk (int) -- index of the chunk, below n_chunks
+            batch_size (int) -- largest number of molecules in a batch
+
+        Yields:
+            dict from the names in FIELDS to numpy arrays of the batch;
+            positions and boxes are (n, 3) arrays
+        """
+
+        import numpy as np
+        mols = m.chkpt_molecules(batch_size)
+        it = m.open_chkpt_chunk(self.reader, chunk)
+        if it is None:
+            raise IOError("Failed to read chunk %d of checkpoint file '%s'"
+                          % (chunk, self.filename))
+        try:
+            while True:
+                if m.read_chkpt_chunk(it, mols):
+                    raise IOError("Corrupted checkpoint file '%s'"
+                                  % self.filename)
+                if mols.n_mols == 0:
+                    break
+                # the views are refilled by the next read, so copy them
+                yield {
+                    'species': np.array(m.chkpt_species_view(mols)),
+                    'positions': np.array(m.chkpt_positions_view(mols)),
+                    'sched_times': np.array(m.chkpt_sched_times_view(mols)),
+                    'lifetimes': np.array(m.chkpt_lifetimes_view(mols)),
+                    'birthdays': np.array(m.chkpt_birthdays_view(mols)),
+                    'orients': np.array(m.chkpt_orients_view(mols)),
+                    'flags': np.array(m.chkpt_flags_view(mols)),
+                    'boxes': np.array(m.chkpt_boxes_view(mols)),
+                }
+        finally:
+            m.close_chkpt_chunk(it)
+
+    def molecules(self, batch_size=65536):
+        """Yields all molecules of the checkpoint in batches, chunk by chunk,
+        in the order they were written; see read_chunk
+        """
+
+        for chunk in range(self.n_chunks):
+            yield from self.read_chunk(chunk, batch_size)
@@ -59,6 +59,25 @@ int trigger_surface_unimol(struct rxn **reaction_hash, int rx_hashsize,
                            struct abstract_molecule *reac, struct wall *w,
                            struct rxn **matching_rxns);
 
+/*
+ * A species pair with a bimolecular reaction sets RX_PARTNER_BLOOM_HASHES
+ * bits of the partner Bloom filter; the pair is unordered.
+ */
+#define RX_PARTNER_BLOOM_HASHES 3
+
+static inline int rx_partner_bloom_bit(const struct bit_array *bloom,
+                                       u_int idA, u_int idB, int k) {
+  unsigned long long lo = (unsigned long long)((idA < idB) ? idA : idB);
+  unsigned long long hi = (unsigned long long)((idA < idB) ? idB : idA);
+  unsigned long long x = ((lo << 32) | hi) * 0x9E3779B97F4A7C15ULL;
+  x ^= x >> 29;
+  x *= 0xBF58476D1CE4E5B9ULL;
+  x ^= x >> 32;
+  u_int h1 = (u_int)x;
+  u_int h2 = (u_int)(x >> 32) | 1;
+  return (int)((h1 + (u_int)k * h2) & (u_int)(bloom->nbits - 1));
+}
+
 int trigger_bimolecular_preliminary(struct rxn **reaction_hash, int hashsize,
                                     u_int hashA, u_int hashB,
                                     struct species *reacA,
@@ -92,10 +111,25 @@ int trigger_intersect(struct rxn **reaction_hash, int rx_hashsize,
                       int allow_rx_transp, int allow_rx_reflec,
                       int allow_rx_absorb_reg_border);
 
+void free_wall_rx_cache(struct wall *w);
+
+signed char *wall_rx_cache_border_edges(struct wall *w, struct species *spec,
+                                        short orient);
+
 void compute_lifetime(struct volume *state,
                       struct rxn *r,
                       struct abstract_molecule *am);
 
+/*
+ * A rate change of a unimolecular reaction bumps the lifetime epoch of its
+ * diffusing reactant species instead of visiting all its molecules; a
+ * molecule whose lifetime was computed under an older epoch has a stale t2.
+ */
+static inline int lifetime_is_stale(const struct abstract_molecule *am) {
+  return am->properties->lifetime_epoch != am->lifetime_epoch &&
+         (am->flags & ACT_NEWBIE) == 0;
+}
+
 int check_for_unimolecular_reaction(struct volume *state,
                                     struct abstract_molecule *am);
 
@@ -129,6 +163,13 @@ int which_unimolecular(struct rxn *rx, struct abstract_molecule *a,
 
 int binary_search_double(double *A, double match, int max, double mult);
 
+/* Reactions with at least this many pathways get a pathway guide table */
+#define PATHWAY_GUIDE_MIN_PATHWAYS 16
+
+void build_pathway_guide(struct rxn *rx);
+
+int select_pathway(struct rxn *rx, double match, double mult);
+
 int test_bimolecular(struct rxn *rx, double scaling, double local_prob_factor,
                      struct abstract_molecule *a1, struct abstract_molecule *a2,
                      struct rng_state *rng);
@@ -153,6 +194,7 @@ struct rxn *test_many_unimol(struct rxn **rx, int n,
                              struct rng_state *rng);
 
 void update_probs(struct volume *world, struct rxn *rx, double t);
+void select_next_rate_change(struct rxn *rx);
 
 /* In react_outc.c */
 int outcome_unimolecular(struct volume *world, struct rxn *rx, int path,
@@ -248,6 +290,8 @@ bool product_tile_can_be_reached(struct wall *target,
                                  struct region_list *rlp_head_obj_2,
                                  int sm_bitmask, bool is_unimol);
 
+void clear_product_placement_cache(struct volume *world);
+
 //NFSim specific functions
 
 //This function creates a queryOptions object for designing an NFSim experiment query
@@ -32,6 +32,7 @@
 #include "rng.h"
 #include "react.h"
 #include "vol_util.h"
+#include "phase_profile.h"
 
 /*************************************************************************
 timeof_unimolecular:
@@ -62,7 +63,7 @@ int which_unimolecular(struct rxn *rx, struct abstract_molecule *a,
   int max = rx->n_pathways - 1;
   double match = rng_dbl(rng);
   match = match * rx->cum_probs[max];
-  return binary_search_double(rx->cum_probs, match, max, 1);
+  return select_pathway(rx, match, 1);
 }
 
 /*************************************************************************
@@ -93,6 +94,73 @@ int binary_search_double(double *A, double match, int max_idx, double mult) {
     return min_idx;
 }
 
+/*************************************************************************
+build_pathway_guide:
+  In: a reaction whose cum_probs have just been set up or changed
+  Out: No return value.  For reactions with many pathways the guide table
+       is (re)computed, so that select_pathway can narrow its search to
+       the one or two pathways inside the slice of [0, total] that the
+       random number falls into.
+  Note: The table is allocated once and then rewritten in place, since
+        reactions are shared by all threads.  select_pathway checks the
+        bounds it gets from the table against cum_probs, so a guide that
+        is momentarily out of date only costs a full search.
+*************************************************************************/
+void build_pathway_guide(struct rxn *rx) {
+  int n = rx->n_pathways;
+  if (n < PATHWAY_GUIDE_MIN_PATHWAYS || rx->cum_probs == NULL)
+    return;
+
+  if (rx->pathway_guide == NULL) {
+    rx->pathway_guide = CHECKED_MALLOC_ARRAY(int, n, "pathway guide table");
+  }
+
+  /* a guide only makes sense for a non-decreasing, positive total */
+  double total = rx->cum_probs[n - 1];
+  rx->guide_scale = 0.0;
+  if (!(total > 0.0) || total >= GIGANTIC)
+    return;
+  for (int i = 1; i < n; i++) {
+    if (rx->cum_probs[i] < rx->cum_probs[i - 1])
+      return;
+  }
+
+  int i = 0;
+  for (int b = 0; b < n; b++) {
+    double threshold = total * b / n;
+    while (i < n - 1 && rx->cum_probs[i] < threshold)
+      i++;
+    rx->pathway_guide[b] = i;
+  }
+  rx->guide_scale = n / total;
+}
+
+/*************************************************************************
+select_pathway:
+  In: the reaction, the value to match against its cum_probs and the
+      multiplier for the comparison (see binary_search_double)
+  Out: the pathway binary_search_double(rx->cum_probs, match,
+       rx->n_pathways - 1, mult) would return
+*************************************************************************/
+int select_pathway(struct rxn *rx, double match, double mult) {
+  int max = rx->n_pathways - 1;
+  double b = match / mult * rx->guide_scale;
+  if (rx->guide_scale > 0.0 && b >= 0.0) {
+    double *A = rx->cum_probs;
+    int slot = (b < max) ? (int)b : max;
+    int lo = rx->pathway_guide[slot];
+    int hi = (slot < max) ? rx->pathway_guide[slot + 1] : max;
+
+    /* the answer is the first pathway with match <= A[i] * mult; the
+       slice bounds are only trusted after checking them */
+    if (lo <= hi && (lo == 0 || match > A[lo - 1] * mult) &&
+        (hi == max || match <= A[hi] * mult))
+      return lo + binary_search_double(A + lo, match, hi - lo, mult);
+  }
+
+  return binary_search_double(rx->cum_probs, match, max, mult);
+}
+
 /*************************************************************************
 test_bimolecular
   In: the reaction we're testing
@@ -110,7 +178,7 @@ int test_bimolecular(struct rxn *rx, double scaling, double local_prob_factor,
                      struct abstract_molecule *a1, struct abstract_molecule *a2,
                      struct rng_state *rng) {
   if (a1 != NULL && a2 != NULL) {
-    assert(periodic_boxes_are_identical(a1->periodic_box, a2->periodic_box));
+    assert(periodic_images_equal(&a1->periodic_box, &a2->periodic_box));
   }
 
   /* rescale probabilities for the case of the reaction
@@ -128,8 +196,10 @@ int test_bimolecular(struct rxn *rx, double scaling, double local_prob_factor,
     /* Instead of scaling rx->cum_probs array we scale random probability */
     p = rng_dbl(rng) * scaling;
 
-    if (p >= min_noreaction_p)
+    if (p >= min_noreaction_p) {
+      PROFILE_FAILED_TESTS(&rx, 1);
       return RX_NO_RX;
+    }
   } else /* May or may not scale enough. check varying pathways. */
   {
     double max_p = rx->cum_probs[rx->n_pathways - 1];
@@ -151,17 +221,18 @@ int test_bimolecular(struct rxn *rx, double scaling, double local_prob_factor,
       /* Instead of scaling rx->cum_probs array we scale random probability */
       p = rng_dbl(rng) * scaling;
 
-      if (p >= max_p)
+      if (p >= max_p) {
+        PROFILE_FAILED_TESTS(&rx, 1);
         return RX_NO_RX;
+      }
     }
   }
 
   /* If we have only fixed pathways... */
-  int M = rx->n_pathways - 1;
   if (local_prob_factor > 0)
-    return binary_search_double(rx->cum_probs, p, M, local_prob_factor);
+    return select_pathway(rx, p, local_prob_factor);
   else
-    return binary_search_double(rx->cum_probs, p, M, 1);
+    return select_pathway(rx, p, 1);
 }
 
 /*************************************************************************
@@ -195,7 +266,7 @@ int test_many_bimolecular(struct rxn **rx, double *scaling,
   double rxp[2 * n]; /* array of cumulative rxn probabilities */
   struct rxn *my_rx;
   int i; /* index in the array of reactions - return value */
-  int m, M;
+  int m;
   double p, f;
 
   if (all_neighbors_flag && local_prob_factor <= 0)
@@ -242,8 +313,10 @@ int test_many_bimolecular(struct rxn **rx, double *scaling,
     p = rng_dbl(rng) * rxp[n - 1];
   } else {
     p = rng_dbl(rng);
-    if (p > rxp[n - 1])
+    if (p > rxp[n - 1]) {
+      PROFILE_FAILED_TESTS(rx, n);
       return RX_NO_RX;
+    }
   }
 
   /* Pick the reaction that happens */
@@ -255,12 +328,10 @@ int test_many_bimolecular(struct rxn **rx, double *scaling,
   p = p * scaling[i];
 
   /* Now pick the pathway within that reaction */
-  M = my_rx->n_pathways - 1;
-
   if (all_neighbors_flag && local_prob_factor > 0)
-    m = binary_search_double(my_rx->cum_probs, p, M, local_prob_factor);
+    m = select_pathway(my_rx, p, local_prob_factor);
   else
-    m = binary_search_double(my_rx->cum_probs, p, M, 1);
+    m = select_pathway(my_rx, p, 1);
 
   *chosen_pathway = m;
 
@@ -292,20 +363,24 @@ int test_intersect(struct rxn *rx, double scaling, struct rng_state *rng) {
   } else {
     p = rng_dbl(rng) * scaling;
 
-    if (p > rx->cum_probs[rx->n_pathways - 1])
+    if (p > rx->cum_probs[rx->n_pathways - 1]) {
+      PROFILE_FAILED_TESTS(&rx, 1);
       return RX_NO_RX;
+    }
   }
 
   int M = rx->n_pathways - 1;
-  if (p > rx->cum_probs[M])
+  if (p > rx->cum_probs[M]) {
+    PROFILE_FAILED_TESTS(&rx, 1);
     return RX_NO_RX;
+  }
 
   int max = rx->n_pathways - 1;
 
   double match = rng_dbl(rng);
   match = match * rx->cum_probs[max];
 
-  return binary_search_double(rx->cum_probs, match, max, 1);
+  return select_pathway(rx, match, 1);
 }
 
 /*************************************************************************
@@ -345,8 +420,10 @@ int test_many_intersect(struct rxn **rx, double scaling, int n,
     p = rng_dbl(rng) * rxp[n - 1];
   } else {
     p = rng_dbl(rng);
-    if (p > rxp[n - 1])
+    if (p > rxp[n - 1]) {
+      PROFILE_FAILED_TESTS(rx, n);
       return RX_NO_RX;
+    }
   }
 
   /* Pick the reaction that happens */
@@ -359,8 +436,7 @@ int test_many_intersect(struct rxn **rx, double scaling, int n,
   p = p * scaling;
 
   /* Now pick the pathway within that reaction */
-  *chosen_pathway =
-      binary_search_double(my_rx->cum_probs, p, my_rx->n_pathways - 1, 1);
+  *chosen_pathway = select_pathway(my_rx, p, 1);
 
   return i;
 }
@@ -401,34 +477,55 @@ struct rxn *test_many_unimol(struct rxn **rx, int n,
   return rx[i];
 }
 
+/*************************************************************************
+select_next_rate_change:
+  In: A reaction struct
+  Out: No return value.  prob_t is set to the rate cursor with the earliest
+       pending change, the one of the lowest pathway on ties, or NULL if all
+       rate changes were applied.
+*************************************************************************/
+void select_next_rate_change(struct rxn *rx) {
+  struct rate_cursor *next = NULL;
+  for (int n = 0; n < rx->n_rate_cursors; n++) {
+    struct rate_cursor *rc = &rx->rate_cursors[n];
+    if (rc->time < FOREVER && (next == NULL || rc->time < next->time))
+      next = rc;
+  }
+  rx->prob_t = next;
+}
+
 /*************************************************************************
 check_probs:
   In: A reaction struct
       The current time
   Out: No return value.  Probabilities are updated if necessary.
        Memory isn't reclaimed.
-  Note: This isn't meant for really heavy-duty use (multiple pathways
-        with rapidly changing rates)--if you want that, the code should
-        probably be rewritten to accumulate probability changes from the
-        list as it goes (and the list should be sorted by pathway, too).
+  Note: Changes are applied in order of time across pathways, each
+        pathway advancing its cursor in its (shared) rate table.
   Note: We're still displaying geometries here, rather than orientations.
         Perhaps that should be fixed.
 *************************************************************************/
 void update_probs(struct volume *world, struct rxn *rx, double t) {
   int j, k;
   double dprob;
-  struct t_func *tv;
   int did_something = 0;
   double new_prob = 0;
 
-  for (tv = rx->prob_t; tv != NULL && tv->time < t; tv = tv->next) {
-    j = tv->path;
+  while (rx->prob_t != NULL && rx->prob_t->time < t) {
+    struct rate_cursor *rc = rx->prob_t;
+    double value = rc->table->value[rc->next] * rc->scale;
+    j = rc->path;
+    rc->next++;
+    rc->time =
+        (rc->next < rc->table->n_entries) ? rc->table->time[rc->next] : FOREVER;
+    select_next_rate_change(rx);
+
     if (j == 0)
-      dprob = tv->value - rx->cum_probs[0];
+      dprob = value - rx->cum_probs[0];
     else
-      dprob = tv->value - (rx->cum_probs[j] - rx->cum_probs[j - 1]);
+      dprob = value - (rx->cum_probs[j] - rx->cum_probs[j - 1]);
 
-    for (k = tv->path; k < rx->n_pathways; k++)
+    for (k = j; k < rx->n_pathways; k++)
       rx->cum_probs[k] += dprob;
     rx->max_fixed_p += dprob;
     rx->min_noreaction_p += dprob;
@@ -444,8 +541,8 @@ void update_probs(struct volume *world, struct rxn *rx, double t) {
         new_prob = rx->cum_probs[j] - rx->cum_probs[j - 1];
 
       if (world->chkpt_seq_num > 1) {
-        if (tv->next != NULL) {
-          if (tv->next->time < t)
+        if (rx->prob_t != NULL) {
+          if (rx->prob_t->time < t)
             continue; /* do not print messages */
         }
       }
@@ -485,11 +582,11 @@ void update_probs(struct volume *world, struct rxn *rx, double t) {
     }
   }
 
-  rx->prob_t = tv;
-
   if (!did_something)
     return;
 
+  build_pathway_guide(rx);
+
   /* Now we have to see if we need to warn the user. */
   if (rx->cum_probs[rx->n_pathways - 1] > world->notify->reaction_prob_warn) {
     FILE *warn_file = mcell_get_log_file();
@@ -593,8 +690,10 @@ int test_many_reactions_all_neighbors(struct rxn **rx, double *scaling,
     p = rng_dbl(rng) * rxp[n - 1];
   } else {
     p = rng_dbl(rng);
-    if (p > rxp[n - 1])
+    if (p > rxp[n - 1]) {
+      PROFILE_FAILED_TESTS(rx, n);
       return RX_NO_RX;
+    }
   }
 
   /* Pick the reaction that happens */
@@ -608,12 +707,11 @@ int test_many_reactions_all_neighbors(struct rxn **rx, double *scaling,
   p = p * scaling[i];
 
   /* Now pick the pathway within that reaction */
-  int M = my_rx->n_pathways - 1;
   if (my_local_prob_factor > 0) {
     *chosen_pathway =
-        binary_search_double(my_rx->cum_probs, p, M, my_local_prob_factor);
+        select_pathway(my_rx, p, my_local_prob_factor);
   } else {
-    *chosen_pathway = binary_search_double(my_rx->cum_probs, p, M, 1);
+    *chosen_pathway = select_pathway(my_rx, p, 1);
   }
 
   return i;
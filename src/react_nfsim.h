@@ -25,6 +25,7 @@
 #define REACT_NFSIM_H
 
 #include "mcell_structs.h"
+#include "map_c.h"
 
 /*
 calculates particle orientation based on nfsim compartment information
@@ -40,10 +41,41 @@ queryOptions initializeNFSimQueryForBimolecularReactions(struct graph_data *am,
                                                          struct graph_data *am2,
                                                          const char *onlyActive);
 
-int trigger_bimolecular_preliminary_nfsim(struct abstract_molecule *reacA,
+int trigger_bimolecular_preliminary_nfsim(struct volume *world,
+                                          struct abstract_molecule *reacA,
                                           struct abstract_molecule *reacB);
 
 struct rxn *pick_unimolecular_reaction_nfsim(struct volume *state,
                                              struct abstract_molecule *am);
 
+/* Load of the caches of unimolecular reactions found for graph patterns,
+ * of bimolecular reactions found for pairs of them, and of whether a pair
+ * can react at all */
+/* The reaction caches and pending queries of a world */
+struct nfsim_reaction_state;
+
+void get_nfsim_reaction_map_stats(struct volume *world,
+                                  struct hashmap_stats *unimolecular,
+                                  struct hashmap_stats *reactions,
+                                  struct hashmap_stats *preliminary);
+void free_nfsim_reaction_maps(struct volume *world);
+
+/* Hits, misses and evictions summed over the reaction caches, and the
+ * memory they hold */
+struct nfsim_cache_stats {
+  unsigned long long hits;
+  unsigned long long misses;
+  unsigned long long evictions;
+  size_t bytes;
+};
+
+void get_nfsim_reaction_cache_stats(struct volume *world,
+                                    struct nfsim_cache_stats *stats);
+void trim_nfsim_reaction_caches(struct volume *world, size_t budget);
+
+/* Unimolecular queries for new graph patterns, sent in batches */
+void queue_nfsim_unimolecular_query(struct volume *world,
+                                    struct graph_data *graph);
+void end_nfsim_query_batches(struct volume *world);
+
 #endif
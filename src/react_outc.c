@@ -27,6 +27,7 @@
 #include <math.h>
 #include <stdlib.h>
 #include <assert.h>
+#include <stdint.h>
 
 #include "logging.h"
 #include "rng.h"
@@ -38,8 +39,26 @@
 #include "wall_util.h"
 #include "nfsim_func.h"
 #include "mcell_reactions.h"
+#include "react_output.h"
 
 #include "diffuse.h"
+#include "mol_id_index.h"
+
+/* Where the products of one reaction firing may go, worked out on demand
+ * (see product_tile_allowed) */
+struct product_topology {
+  struct surface_molecule *sm_1, *sm_2;
+  short orient_1, orient_2; /* reactant orientations when the rxn fired */
+  bool is_unimol;
+  int sm_bitmask; /* -1 until determine_molecule_region_topology has run */
+  struct region_list *rlp_head_wall_1, *rlp_head_wall_2;
+  struct region_list *rlp_head_obj_1, *rlp_head_obj_2;
+};
+
+static bool product_tile_allowed(struct volume *world, struct rxn *rx,
+                                 int path, struct product_topology *topo,
+                                 struct wall *target);
+static void free_product_topology(struct product_topology *topo);
 
 static int outcome_products_random(struct volume *world, struct wall *w,
                                    struct vector3 *hitpt, double t,
@@ -49,7 +68,6 @@ static int outcome_products_random(struct volume *world, struct wall *w,
                                    short orientA, short orientB);
 
 
-static int cleanup_and_block_rx(struct tile_neighbor *tn1, struct tile_neighbor *tn2);
 
 int is_compatible_surface(void *req_species, struct wall *w) {
   struct surf_class_list *scl, *scl2;
@@ -123,6 +141,15 @@ void tiny_diffuse_3D(
     struct vector3 *pos,
     struct wall *w) {
 
+  /* Nearly always the nudge off w stays in the subvolume and crosses the
+   * plane of no other wall, so there is nothing to ray trace */
+  if (step_stays_in_subvolume(world, subvol, pos, displacement, w)) {
+    pos->x += displacement->x;
+    pos->y += displacement->y;
+    pos->z += displacement->z;
+    return;
+  }
+
   struct vector3 temp_displacement = {
     .x = displacement->x,
     .y = displacement->y,
@@ -145,7 +172,6 @@ void tiny_diffuse_3D(
   pos->x += displacement->x;
   pos->y += displacement->y;
   pos->z += displacement->z;
-  subvol = find_subvolume(world, pos, subvol);
 }
 
 struct volume_molecule *
@@ -178,18 +204,13 @@ place_volume_product(struct volume *world, struct species *product_species, stru
   new_volume_mol->t = t;
   new_volume_mol->t2 = 0.0;
 
-  new_volume_mol->periodic_box = CHECKED_MALLOC_STRUCT(struct periodic_image,
-    "periodic image descriptor");
-  new_volume_mol->periodic_box->x = periodic_box->x;
-  new_volume_mol->periodic_box->y = periodic_box->y;
-  new_volume_mol->periodic_box->z = periodic_box->z;
+  new_volume_mol->periodic_box = *periodic_box;
 
   new_volume_mol->properties = product_species;
   new_volume_mol->graph_data = graph;
-  initialize_diffusion_function((struct abstract_molecule*) new_volume_mol);
+  acquire_molecule_graph((struct abstract_molecule *)new_volume_mol);
 
-  new_volume_mol->prev_v = NULL;
-  new_volume_mol->next_v = NULL;
+  new_volume_mol->species_list = NULL;
   new_volume_mol->pos = pos;
   new_volume_mol->subvol = subvol;
   new_volume_mol->index = 0;
@@ -198,7 +219,7 @@ place_volume_product(struct volume *world, struct species *product_species, stru
   //XXX: is this the best way?
 
 
-  if (new_volume_mol->get_space_step(new_volume_mol) > 0.0)
+  if (get_space_step(new_volume_mol) > 0.0)
     new_volume_mol->flags |= ACT_DIFFUSE;
   if ((product_species->flags & COUNT_SOME_MASK) != 0)
     new_volume_mol->flags |= COUNT_ME;
@@ -211,7 +232,7 @@ place_volume_product(struct volume *world, struct species *product_species, stru
 
   /* If this product resulted from a surface rxn, store the previous wall
    * position. */
-  if (sm_reactant && distinguishable(new_volume_mol->get_diffusion(new_volume_mol), 0, EPS_C)) {
+  if (sm_reactant && distinguishable(get_diffusion(new_volume_mol), 0, EPS_C)) {
     new_volume_mol->previous_wall = sm_reactant->grid->surface;
 
     /* This will be overwritten with orientation in the CLAMPED/surf.
@@ -243,6 +264,8 @@ place_volume_product(struct volume *world, struct species *product_species, stru
   ht_add_molecule_to_list(&new_volume_mol->subvol->mol_by_species,
                           new_volume_mol);
   ++new_volume_mol->subvol->mol_count;
+  mol_id_index_set(world->mol_id_index,
+                   (struct abstract_molecule *)new_volume_mol);
 
   /* Add to the schedule. */
   if (schedule_add(subvol->local_storage->timer, new_volume_mol))
@@ -273,15 +296,11 @@ place_sm_product(struct volume *world, struct species *product_species, struct g
   new_surf_mol->properties = product_species;
   //nfsim graph init
   new_surf_mol->graph_data = graph;
-  initialize_diffusion_function((struct abstract_molecule*) new_surf_mol);
-  new_surf_mol->periodic_box = CHECKED_MALLOC_STRUCT(struct periodic_image,
-    "periodic image descriptor");
-  new_surf_mol->periodic_box->x = periodic_box->x;
-  new_surf_mol->periodic_box->y = periodic_box->y;
-  new_surf_mol->periodic_box->z = periodic_box->z;
+  acquire_molecule_graph((struct abstract_molecule *)new_surf_mol);
+  new_surf_mol->periodic_box = *periodic_box;
 
   new_surf_mol->flags = TYPE_SURF | ACT_NEWBIE | IN_SCHEDULE;
-  if (new_surf_mol->get_space_step(new_surf_mol) > 0)
+  if (get_space_step(new_surf_mol) > 0)
     new_surf_mol->flags |= ACT_DIFFUSE;
   if (product_species->flags & COUNT_ENCLOSED)
     new_surf_mol->flags |= COUNT_ME;
@@ -298,6 +317,7 @@ place_sm_product(struct volume *world, struct species *product_species, struct g
     new_surf_mol->flags |= ACT_REACT;
 
   /* Add to the grid. */
+  own_grid_tiles(grid);
   ++grid->n_occupied;
   if (grid->sm_list[grid_index]) {
     remove_surfmol_from_list(
@@ -305,6 +325,8 @@ place_sm_product(struct volume *world, struct species *product_species, struct g
   }
   grid->sm_list[grid_index] = add_surfmol_with_unique_pb_to_list(
     grid->sm_list[grid_index], new_surf_mol);
+  mol_id_index_set(world->mol_id_index,
+                   (struct abstract_molecule *)new_surf_mol);
 
   /* Add to the schedule. */
   if (schedule_add(sv->local_storage->timer, new_surf_mol))
@@ -400,15 +422,15 @@ static int outcome_products_random(struct volume *world, struct wall *w,
   struct surface_molecule *const sm_reactant = sm_1 ? sm_1 : sm_2;
   bool const is_orientable = (w != NULL) || (sm_reactant != NULL);
 
-  /* list of the restricted regions for the reactants by wall */
-  struct region_list *rlp_head_wall_1 = NULL, *rlp_head_wall_2 = NULL;
-
-  /* list of the restricted regions for the reactants by object */
-  struct region_list *rlp_head_obj_1 = NULL, *rlp_head_obj_2 = NULL;
-
-  int sm_bitmask = determine_molecule_region_topology(
-      world, sm_1, sm_2, &rlp_head_wall_1, &rlp_head_wall_2, &rlp_head_obj_1,
-      &rlp_head_obj_2, is_unimol);
+  /* restricted regions of the reactants, looked up only if a product tile
+   * is not in the placement cache yet */
+  struct product_topology topo = {
+    .sm_1 = sm_1, .sm_2 = sm_2,
+    .orient_1 = sm_1 ? sm_1->orient : 0, .orient_2 = sm_2 ? sm_2->orient : 0,
+    .is_unimol = is_unimol, .sm_bitmask = -1,
+    .rlp_head_wall_1 = NULL, .rlp_head_wall_2 = NULL,
+    .rlp_head_obj_1 = NULL, .rlp_head_obj_2 = NULL
+  };
 
   /* reacA is the molecule which initiated the reaction. */
   struct abstract_molecule *const initiator = reacA;
@@ -457,10 +479,10 @@ static int outcome_products_random(struct volume *world, struct wall *w,
     rxn_uv_idx = uv2grid(&rxn_uv_pos, w->grid);
 
     /* find out number of static surface reactants */
-    if ((sm_1 != NULL) && (!distinguishable(sm_1->get_diffusion(sm_1), 0, EPS_C))){
+    if ((sm_1 != NULL) && (!distinguishable(get_diffusion(sm_1), 0, EPS_C))){
       num_surface_static_reactants++;
     }
-    if ((sm_2 != NULL) && (!distinguishable(sm_2->get_diffusion(sm_2), 0, EPS_C))){
+    if ((sm_2 != NULL) && (!distinguishable(get_diffusion(sm_2), 0, EPS_C))){
       num_surface_static_reactants++;
     }
   }
@@ -482,30 +504,36 @@ static int outcome_products_random(struct volume *world, struct wall *w,
   int mol_idx = INT_MAX;
   /* If the reaction involves a surface, make sure there is room for each
    * product. */
-  struct tile_neighbor *tile_nbr_head = NULL; // list of neighbor tiles
-  int tile_nbr_list_length = 0;
-  struct tile_neighbor *tile_vacant_nbr_head = NULL; // list of vacant neighbor tiles
-  if (is_orientable) {
-    if (num_surface_products > 0) {
-      if (sm_reactant != NULL) {
-        find_neighbor_tiles(world, sm_reactant, sm_reactant->grid,
-                            sm_reactant->grid_index, 1, 0, &tile_nbr_head,
-                            &tile_nbr_list_length);
-      } else {
-        find_neighbor_tiles(world, sm_reactant, w->grid, rxn_uv_idx, 1, 0,
-                            &tile_nbr_head, &tile_nbr_list_length);
-      }
+  struct surface_grid **nbr_grid = NULL; // neighbor tiles
+  int *nbr_idx = NULL;
+  int n_nbrs = 0;
+  if (is_orientable && num_surface_products > 0) {
+    if (sm_reactant != NULL) {
+      n_nbrs = find_product_tiles(world, sm_reactant->grid,
+                                  sm_reactant->grid_index, &nbr_grid, &nbr_idx);
+    } else {
+      n_nbrs = find_product_tiles(world, w->grid, rxn_uv_idx, &nbr_grid,
+                                  &nbr_idx);
+    }
+  }
 
-      /* Create list of vacant tiles */
-      for (struct tile_neighbor *tile_nbr = tile_nbr_head; tile_nbr != NULL;
-           tile_nbr = tile_nbr->next) {
-        struct surface_molecule_list *sm_list = tile_nbr->grid->sm_list[tile_nbr->idx]; 
-        if (sm_list == NULL || sm_list->sm == NULL) {
-          num_vacant_tiles++;
-          push_tile_neighbor_to_list(&tile_vacant_nbr_head, tile_nbr->grid, tile_nbr->idx);
-        }
+  /* vacant neighbor tiles, last neighbor first; a tile is checked once it
+   * has been probed for a product */
+  struct surface_grid *vacant_grid[n_nbrs + 1];
+  int vacant_idx[n_nbrs + 1];
+  byte vacant_checked[n_nbrs + 1];
+  int num_unchecked_tiles = 0;
+  if (is_orientable) {
+    for (int n = n_nbrs - 1; n >= 0; n--) {
+      struct surface_molecule_list *sm_list = nbr_grid[n]->sm_list[nbr_idx[n]];
+      if (sm_list == NULL || sm_list->sm == NULL) {
+        vacant_grid[num_vacant_tiles] = nbr_grid[n];
+        vacant_idx[num_vacant_tiles] = nbr_idx[n];
+        vacant_checked[num_vacant_tiles] = 0;
+        num_vacant_tiles++;
       }
     }
+    num_unchecked_tiles = num_vacant_tiles;
 
     /* Can this reaction happen at all? */
     int num_recycled_tiles = 0;
@@ -515,7 +543,7 @@ static int outcome_products_random(struct volume *world, struct wall *w,
       num_recycled_tiles = 1;
     }
     if (num_surface_products > num_vacant_tiles + num_recycled_tiles) {
-      return cleanup_and_block_rx(tile_nbr_head, tile_vacant_nbr_head);
+      return RX_BLOCKED;
     }
 
     /* set the orientations of the products. */
@@ -712,9 +740,9 @@ static int outcome_products_random(struct volume *world, struct wall *w,
     } else if (num_surface_products > 1) {
       /* more than one surface products */
       if (num_surface_static_reactants > 0) {
-        bool replace_reacA = (!distinguishable(reacA->get_diffusion(reacA), 0, EPS_C)) && replace_p1;
+        bool replace_reacA = (!distinguishable(get_diffusion(reacA), 0, EPS_C)) && replace_p1;
         bool replace_reacB =
-            (reacB == NULL) ? false : (!distinguishable(reacB->get_diffusion(reacB), 0, EPS_C)) && replace_p2;
+            (reacB == NULL) ? false : (!distinguishable(get_diffusion(reacB), 0, EPS_C)) && replace_p2;
 
         if (replace_reacA || replace_reacB) {
           int max_static_count = (num_surface_static_products < num_surface_static_reactants)
@@ -843,33 +871,38 @@ static int outcome_products_random(struct volume *world, struct wall *w,
 
         /* can't place products - reaction blocked */
         if (num_vacant_tiles == 0) {
-          return cleanup_and_block_rx(tile_nbr_head, tile_vacant_nbr_head);
+          free_product_topology(&topo);
+          return RX_BLOCKED;
         }
 
         num_attempts = 0;
         while (true) {
           if (num_attempts > SURFACE_DIFFUSION_RETRIES) {
-            return cleanup_and_block_rx(tile_nbr_head, tile_vacant_nbr_head);
+            free_product_topology(&topo);
+            return RX_BLOCKED;
           }
 
           /* randomly pick a tile from the list */
           unsigned int rnd_num = rng_uint(world->rng) % num_vacant_tiles;
-          int tile_idx = -1; /* index of the tile on the grid */
-          tile_grid = NULL;
-          if (get_tile_neighbor_from_list_of_vacant_neighbors(
-                  tile_vacant_nbr_head, rnd_num, &tile_grid, &tile_idx) == 0) {
-            return cleanup_and_block_rx(tile_nbr_head, tile_vacant_nbr_head);
+          if (num_unchecked_tiles == 0) {
+            free_product_topology(&topo);
+            return RX_BLOCKED;
           }
-          if (tile_idx < 0) {
+          if (vacant_checked[rnd_num]) {
             continue; /* this tile was probed already */
           }
+          vacant_checked[rnd_num] = 1;
+          num_unchecked_tiles--;
+          tile_grid = vacant_grid[rnd_num];
+          int tile_idx = vacant_idx[rnd_num]; /* index of the tile on the grid */
           assert(tile_grid != NULL);
 
           /* make sure we can get to the tile given the surface regions defined
            * in the model */
-          if (!product_tile_can_be_reached(tile_grid->surface, rlp_head_wall_1,
-            rlp_head_wall_2, rlp_head_obj_1, rlp_head_obj_2, sm_bitmask, is_unimol)) {
-            uncheck_vacant_tile(tile_vacant_nbr_head, rnd_num);
+          if (!product_tile_allowed(world, rx, path, &topo,
+                                    tile_grid->surface)) {
+            vacant_checked[rnd_num] = 0;
+            num_unchecked_tiles++;
             num_attempts++;
             continue;
           }
@@ -891,7 +924,7 @@ static int outcome_products_random(struct volume *world, struct wall *w,
 
   /* Determine the location of the reaction for count purposes. */
   struct vector3 count_pos_xyz;
-  struct periodic_image *periodic_box = ((struct volume_molecule *)reacA)->periodic_box;
+  struct periodic_image *periodic_box = &reacA->periodic_box;
   if (hitpt != NULL) {
     count_pos_xyz = *hitpt;
   } else if (sm_reactant) {
@@ -963,7 +996,7 @@ static int outcome_products_random(struct volume *world, struct wall *w,
       this_product = (struct abstract_molecule *)place_sm_product(
           world, product_species, g_data, product_grid[n_product],
           product_grid_idx[n_product], &prod_uv_pos, product_orient[n_product],
-          t, reacA->periodic_box);
+          t, &reacA->periodic_box);
     } else { /* else place the molecule in space. */
       /* For either a unimolecular reaction, or a reaction between two surface
          molecules we don't have a hitpoint. */
@@ -987,7 +1020,7 @@ static int outcome_products_random(struct volume *world, struct wall *w,
 
       this_product = (struct abstract_molecule *)place_volume_product(
           world, product_species, g_data, sm_reactant, w, product_subvol, hitpt,
-          product_orient[n_product], t, reacA->periodic_box);
+          product_orient[n_product], t, &reacA->periodic_box);
 
       if (((struct volume_molecule *)this_product)->index < DISSOCIATION_MAX)
         update_dissociation_index = true;
@@ -1002,18 +1035,20 @@ static int outcome_products_random(struct volume *world, struct wall *w,
     /* Update molecule counts */
     ++product_species->population;
     if (product_species->flags & (COUNT_CONTENTS | COUNT_ENCLOSED))
-      count_region_from_scratch(world, this_product, NULL, 1, NULL, NULL, t, this_product->periodic_box);
+      count_region_from_scratch(world, this_product, NULL, 1, NULL, NULL, t, &this_product->periodic_box);
 
     /* preserve molecule id if rxn is unimolecular with one product */
     if (is_unimol && (n_players == 1)) {
       this_product->id = reacA->id;
       world->current_mol_id--; /* give back id we used */
+      mol_id_index_set(world->mol_id_index, this_product);
       continue;
     }
     /* preserve molecule id if rxn is surface rxn with one product */
     if ((n_players == 3) && product_type[1] == PLAYER_WALL) {
       this_product->id = reacA->id;
       world->current_mol_id--; /* give back id we used */
+      mol_id_index_set(world->mol_id_index, this_product);
       continue;
     }
   }
@@ -1032,7 +1067,7 @@ static int outcome_products_random(struct volume *world, struct wall *w,
       count_region_from_scratch(world, NULL, rx->info[path].pathname, 1,
                                 &count_pos_xyz, w, t, periodic_box);
 
-    /* Other magical stuff.  For now, can only trigger releases. */
+    /* Other magical stuff: triggered releases and reaction traces. */
     if (rx->info[path].pathname->magic != NULL) {
       if (reaction_wizardry(world, rx->info[path].pathname->magic, w,
                             &count_pos_xyz, t))
@@ -1043,12 +1078,7 @@ static int outcome_products_random(struct volume *world, struct wall *w,
   }
 
   /* recover memory */
-  delete_tile_neighbor_list(tile_nbr_head);
-  delete_tile_neighbor_list(tile_vacant_nbr_head);
-  delete_region_list(rlp_head_wall_1);
-  delete_region_list(rlp_head_wall_2);
-  delete_region_list(rlp_head_obj_1);
-  delete_region_list(rlp_head_obj_2);
+  free_product_topology(&topo);
 
   return cross_wall ? RX_FLIP : RX_A_OK;
 }
@@ -1130,7 +1160,7 @@ int outcome_unimolecular(struct volume *world, struct rxn *rx, int path,
         vm->subvol->local_storage->timer->defunct_count++;
       if (vm->properties->flags & COUNT_SOME_MASK) {
         count_region_from_scratch(world, (struct abstract_molecule *)vm, NULL,
-                                  -1, &(vm->pos), NULL, vm->t, vm->periodic_box);
+                                  -1, &(vm->pos), NULL, vm->t, &vm->periodic_box);
       }
     } else {
       remove_surfmol_from_list(&sm->grid->sm_list[sm->grid_index], sm);
@@ -1140,11 +1170,10 @@ int outcome_unimolecular(struct volume *world, struct rxn *rx, int path,
       }
       if (sm->properties->flags & COUNT_SOME_MASK) {
         count_region_from_scratch(world, (struct abstract_molecule *)sm, NULL,
-                                  -1, NULL, NULL, sm->t, sm->periodic_box);
+                                  -1, NULL, NULL, sm->t, &sm->periodic_box);
       }
     }
 
-    free(reac->periodic_box);
     who_was_i->n_deceased++;
     double t_time = convert_iterations_to_seconds(
         world->start_iterations, world->time_unit,
@@ -1155,6 +1184,8 @@ int outcome_unimolecular(struct volume *world, struct rxn *rx, int path,
     if (vm != NULL)
       collect_molecule(vm);
     else {
+      mol_id_index_forget(world->mol_id_index, reac);
+      release_molecule_graph(reac);
       reac->properties = NULL;
       mem_put(reac->birthplace, reac);
     }
@@ -1162,8 +1193,11 @@ int outcome_unimolecular(struct volume *world, struct rxn *rx, int path,
   } else if (who_am_i != who_was_i) {
     if (vm != NULL)
       collect_molecule(vm);
-    else
+    else {
+      mol_id_index_forget(world->mol_id_index, reac);
+      release_molecule_graph(reac);
       reac->properties = NULL;
+    }
     return RX_DESTROY;
   } else
     return result;
@@ -1191,7 +1225,7 @@ int outcome_bimolecular(struct volume *world, struct rxn *rx, int path,
                         short orientB, double t, struct vector3 *hitpt,
                         struct vector3 *loc_okay) {
 
-  assert(periodic_boxes_are_identical(reacA->periodic_box, reacB->periodic_box));
+  assert(periodic_images_equal(&reacA->periodic_box, &reacB->periodic_box));
 
   struct surface_molecule *sm = NULL;
   struct volume_molecule *vm = NULL;
@@ -1263,11 +1297,9 @@ int outcome_bimolecular(struct volume *world, struct rxn *rx, int path,
     }
 
     if ((reacB->properties->flags & (COUNT_CONTENTS | COUNT_ENCLOSED)) != 0) {
-      count_region_from_scratch(world, reacB, NULL, -1, NULL, NULL, t, reacB->periodic_box);
+      count_region_from_scratch(world, reacB, NULL, -1, NULL, NULL, t, &reacB->periodic_box);
     }
 
-    free(reacB->periodic_box);
-    reacB->periodic_box = NULL;
     reacB->properties->n_deceased++;
     double t_time = convert_iterations_to_seconds(
         world->start_iterations, world->time_unit,
@@ -1277,8 +1309,11 @@ int outcome_bimolecular(struct volume *world, struct rxn *rx, int path,
 
     if (vm != NULL)
       collect_molecule(vm);
-    else
+    else {
+      mol_id_index_forget(world->mol_id_index, reacB);
+      release_molecule_graph(reacB);
       reacB->properties = NULL;
+    }
   }
 
   if (killA) {
@@ -1305,7 +1340,7 @@ int outcome_bimolecular(struct volume *world, struct rxn *rx, int path,
       if (reacA->properties->flags &
           COUNT_SOME_MASK) /* If we're ever counted, try to count us now */
       {
-        count_region_from_scratch(world, reacA, NULL, -1, NULL, NULL, t, reacA->periodic_box);
+        count_region_from_scratch(world, reacA, NULL, -1, NULL, NULL, t, &reacA->periodic_box);
       }
     } else if (reacA->flags & COUNT_ME) {
       /* Subtlety: we made it up to hitpt, but our position is wherever we were
@@ -1314,7 +1349,7 @@ int outcome_bimolecular(struct volume *world, struct rxn *rx, int path,
           (reacB->properties != NULL &&
            (reacB->properties->flags & NOT_FREE) == 0)) {
         /* Vol-vol rx should be counted at hitpt */
-        count_region_from_scratch(world, reacA, NULL, -1, hitpt, NULL, t, reacA->periodic_box);
+        count_region_from_scratch(world, reacA, NULL, -1, hitpt, NULL, t, &reacA->periodic_box);
       } else /* Vol-surf but don't want to count exactly on a wall or we might
                 count on the wrong side */
       {
@@ -1330,12 +1365,10 @@ int outcome_bimolecular(struct volume *world, struct rxn *rx, int path,
         fake_hitpt.y = 0.5 * hitpt->y + 0.5 * loc_okay->y;
         fake_hitpt.z = 0.5 * hitpt->z + 0.5 * loc_okay->z;
 
-        count_region_from_scratch(world, reacA, NULL, -1, &fake_hitpt, NULL, t, reacA->periodic_box);
+        count_region_from_scratch(world, reacA, NULL, -1, &fake_hitpt, NULL, t, &reacA->periodic_box);
       }
     }
 
-    free(reacA->periodic_box);
-    reacA->periodic_box = NULL;
     reacA->properties->n_deceased++;
     double t_time = convert_iterations_to_seconds(
         world->start_iterations, world->time_unit,
@@ -1345,8 +1378,11 @@ int outcome_bimolecular(struct volume *world, struct rxn *rx, int path,
 
     if (vm != NULL)
       collect_molecule(vm);
-    else
+    else {
+      mol_id_index_forget(world->mol_id_index, reacA);
+      release_molecule_graph(reacA);
       reacA->properties = NULL;
+    }
 
     return RX_DESTROY;
   }
@@ -1417,7 +1453,7 @@ int outcome_intersect(struct volume *world, struct rxn *rx, int path,
       if (world->place_waypoints_flag && (reac->flags & COUNT_ME)) {
         if (hitpt == NULL) {
           count_region_from_scratch(
-            world, reac, NULL, -1, NULL, NULL, t, reac->periodic_box);
+            world, reac, NULL, -1, NULL, NULL, t, &reac->periodic_box);
         } else {
           struct vector3 fake_hitpt;
 
@@ -1430,10 +1466,9 @@ int outcome_intersect(struct volume *world, struct rxn *rx, int path,
           fake_hitpt.z = 0.5 * hitpt->z + 0.5 * loc_okay->z;
 
           count_region_from_scratch(world, reac, NULL, -1, &fake_hitpt, NULL,
-                                    t, reac->periodic_box);
+                                    t, &reac->periodic_box);
         }
       }
-      free(reac->periodic_box);
       reac->properties->n_deceased++;
       double t_time = convert_iterations_to_seconds(
           world->start_iterations, world->time_unit,
@@ -1461,6 +1496,7 @@ reaction_wizardry:
       the location of the release
       the time of the release
   Out: 0 if successful, 1 on failure (usually out of memory).
+       A traced pathway appends an event to the reaction trace.
        Each release event in the list is triggered at a location that
        is relative to the location of the release and the surface normal
        of the wall.  The surface normal of the wall is considered to be
@@ -1478,11 +1514,24 @@ reaction_wizardry:
   Note: if we wanted to be extra-super clever, we could actually schedule
         this event instead of running it and somehow have it start a
         time-shifted release pattern (so we could have delays and stuff).
+  Note: the releases are queued rather than run, and flush_triggered_releases
+        places all firings of a release site in one pass over the storages
+        together.
 *************************************************************************/
 int reaction_wizardry(struct volume *world, struct magic_list *incantation,
                       struct wall *surface, struct vector3 *hitpt, double t) {
   struct release_event_queue req; /* Create a release event on the fly */
 
+  int n_releases = 0;
+  for (struct magic_list *ml = incantation; ml != NULL; ml = ml->next) {
+    if (ml->type == magic_trace)
+      record_rxn_event(world, (int)(intptr_t)ml->data, hitpt, t);
+    else if (ml->type == magic_release)
+      ++n_releases;
+  }
+  if (n_releases == 0)
+    return 0;
+
   /* Release event happens "now" */
   req.next = NULL;
   req.event_time = t;
@@ -1529,7 +1578,10 @@ int reaction_wizardry(struct volume *world, struct magic_list *incantation,
 
     req.release_site = (struct release_site_obj *)incantation->data;
 
-    if (release_molecules(world, &req))
+    /* Placed with the site's other firings once this pass is over */
+    if (world->triggered_releases != NULL)
+      queue_triggered_release(world, &req);
+    else if (release_molecules(world, &req))
       return 1;
   }
 
@@ -1751,16 +1803,191 @@ bool product_tile_can_be_reached(struct wall *target,
   return status;
 }
 
-/*
- * cleanup_and_block_rx is a simple helper function which deletes the provided
- * linked lists of tile_neighbors and the return RX_BLOCKED
- */
-int cleanup_and_block_rx(struct tile_neighbor *tn1, struct tile_neighbor *tn2) {
-  if (tn1 != NULL) {
-    delete_tile_neighbor_list(tn1);
+/* One product placement decision: may the products of a pathway fired by
+ * reactants on walls w_1 and w_2 go to the target wall? */
+struct product_placement_entry {
+  struct rxn *rx; /* NULL for an empty slot */
+  struct wall *w_1, *w_2, *target;
+  int path;
+  u_int reactants; /* species order and orientation signs of the reactants */
+  bool allowed;
+};
+
+struct product_placement_cache {
+  int n_entries;
+  int capacity; /* power of two */
+  struct product_placement_entry *entries;
+};
+
+/* More decisions than this are forgotten rather than kept */
+#define PRODUCT_PLACEMENT_CACHE_MAX (1 << 16)
+
+static u_int orient_class(short orient) {
+  return (orient > 0) ? 2 : ((orient < 0) ? 1 : 0);
+}
+
+static u_int product_placement_hash(struct product_placement_entry const *e) {
+  uintptr_t h = (uintptr_t)e->rx ^ ((uintptr_t)e->w_1 * 31) ^
+                ((uintptr_t)e->w_2 * 131) ^ ((uintptr_t)e->target * 1031) ^
+                ((uintptr_t)e->path << 3) ^ e->reactants;
+  h ^= h >> 17;
+  return (u_int)h * 2654435761u;
+}
+
+static struct product_placement_entry *
+product_placement_slot(struct product_placement_cache *cache,
+                       struct product_placement_entry const *key) {
+  u_int mask = (u_int)cache->capacity - 1;
+  u_int i = product_placement_hash(key) & mask;
+  for (;; i = (i + 1) & mask) {
+    struct product_placement_entry *e = &cache->entries[i];
+    if (e->rx == NULL ||
+        (e->rx == key->rx && e->path == key->path && e->w_1 == key->w_1 &&
+         e->w_2 == key->w_2 && e->target == key->target &&
+         e->reactants == key->reactants))
+      return e;
+  }
+}
+
+static void grow_product_placement_cache(struct product_placement_cache *cache) {
+  struct product_placement_entry *old = cache->entries;
+  int old_capacity = cache->capacity;
+
+  cache->capacity = (old_capacity == 0) ? 64 : 2 * old_capacity;
+  cache->entries = CHECKED_MALLOC_ARRAY(struct product_placement_entry,
+                                        cache->capacity,
+                                        "product placement cache");
+  memset(cache->entries, 0,
+         cache->capacity * sizeof(struct product_placement_entry));
+  for (int i = 0; i < old_capacity; i++) {
+    if (old[i].rx != NULL)
+      *product_placement_slot(cache, &old[i]) = old[i];
   }
-  if (tn2 != NULL) {
-    delete_tile_neighbor_list(tn2);
+  free(old);
+}
+
+/*************************************************************************
+clear_product_placement_cache:
+   In: world: simulation state
+   Out: No return value.  The product placement decisions made so far are
+        forgotten; this must be done whenever walls, regions or surface
+        classes change.  Threaded passes keep one cache per storage, and
+        those are cleared as well.
+*************************************************************************/
+static void free_product_placement_cache(struct product_placement_cache **cp) {
+  if (*cp == NULL)
+    return;
+
+  free((*cp)->entries);
+  free(*cp);
+  *cp = NULL;
+}
+
+void clear_product_placement_cache(struct volume *world) {
+  free_product_placement_cache(&world->product_placement_cache);
+  for (struct storage_list *sl = world->storage_head; sl != NULL; sl = sl->next)
+    free_product_placement_cache(&sl->store->product_placement_cache);
+}
+
+static void free_product_topology(struct product_topology *topo) {
+  delete_region_list(topo->rlp_head_wall_1);
+  delete_region_list(topo->rlp_head_wall_2);
+  delete_region_list(topo->rlp_head_obj_1);
+  delete_region_list(topo->rlp_head_obj_2);
+  topo->rlp_head_wall_1 = topo->rlp_head_wall_2 = NULL;
+  topo->rlp_head_obj_1 = topo->rlp_head_obj_2 = NULL;
+}
+
+/*************************************************************************
+product_tile_allowed:
+   In: world: simulation state
+       rx, path: the reaction pathway that fired
+       topo: the reactants of this firing
+       target: wall of a tile a surface product may be placed on
+   Out: true if a product may be placed on the target wall, the same as
+        product_tile_can_be_reached for the topology of the reactants.
+   Note: The answer only depends on the walls and orientations of the
+         reactants and on region membership, so it is kept in the world's
+         product placement cache; the reactants' restricted regions are
+         looked up (once per firing) only when the answer is not cached.
+*************************************************************************/
+static bool product_tile_allowed(struct volume *world, struct rxn *rx,
+                                 int path, struct product_topology *topo,
+                                 struct wall *target) {
+  struct surface_molecule *sm_1 = topo->sm_1;
+  struct surface_molecule *sm_2 = topo->sm_2;
+
+  /* Reactants without restrictive borders can put products anywhere; so
+   * can a volume initiator (see determine_molecule_region_topology) */
+  if (sm_1 == NULL)
+    return true;
+  if (!(sm_1->properties->flags & CAN_REGION_BORDER) &&
+      (sm_2 == NULL || !(sm_2->properties->flags & CAN_REGION_BORDER)))
+    return true;
+
+  struct product_placement_entry key = {
+    .rx = rx,
+    .w_1 = sm_1->grid->surface,
+    .w_2 = sm_2 ? sm_2->grid->surface : NULL,
+    .target = target,
+    .path = path,
+    .reactants = (orient_class(topo->orient_1) << 3) |
+                 (orient_class(topo->orient_2) << 1) |
+                 (sm_1->properties != rx->players[0]) |
+                 (topo->is_unimol << 5),
+    .allowed = false
+  };
+
+  struct product_placement_cache *cache = world->product_placement_cache;
+  if (cache == NULL) {
+    cache = CHECKED_MALLOC_STRUCT(struct product_placement_cache,
+                                  "product placement cache");
+    cache->n_entries = 0;
+    cache->capacity = 0;
+    cache->entries = NULL;
+    grow_product_placement_cache(cache);
+    world->product_placement_cache = cache;
   }
-  return RX_BLOCKED;
+
+  struct product_placement_entry *entry = product_placement_slot(cache, &key);
+  if (entry->rx != NULL)
+    return entry->allowed;
+
+  if (topo->sm_bitmask < 0) {
+    /* Orientations may have been changed for the products by now, while
+     * the restricted regions are those of the reactants as they fired */
+    short orient_1 = sm_1 ? sm_1->orient : 0;
+    short orient_2 = sm_2 ? sm_2->orient : 0;
+    if (sm_1)
+      sm_1->orient = topo->orient_1;
+    if (sm_2)
+      sm_2->orient = topo->orient_2;
+    topo->sm_bitmask = determine_molecule_region_topology(
+        world, sm_1, sm_2, &topo->rlp_head_wall_1, &topo->rlp_head_wall_2,
+        &topo->rlp_head_obj_1, &topo->rlp_head_obj_2, topo->is_unimol);
+    if (sm_1)
+      sm_1->orient = orient_1;
+    if (sm_2)
+      sm_2->orient = orient_2;
+  }
+  key.allowed = product_tile_can_be_reached(
+      target, topo->rlp_head_wall_1, topo->rlp_head_wall_2,
+      topo->rlp_head_obj_1, topo->rlp_head_obj_2, topo->sm_bitmask,
+      topo->is_unimol);
+
+  if (4 * (cache->n_entries + 1) > 3 * cache->capacity) {
+    if (cache->capacity >= PRODUCT_PLACEMENT_CACHE_MAX) {
+      memset(cache->entries, 0,
+             cache->capacity * sizeof(struct product_placement_entry));
+      cache->n_entries = 0;
+    } else {
+      grow_product_placement_cache(cache);
+    }
+    entry = product_placement_slot(cache, &key);
+  }
+  *entry = key;
+  cache->n_entries++;
+
+  return key.allowed;
 }
+
@@ -242,34 +242,23 @@ int prepare_reaction_nfsim(struct volume *world, struct rxn *rx, void *results,
     product_pattern = map_get(individualResult,
                               "label"); // results->results[productIdx].label;
 
-    // query  graph_pattern hashmap instead of recreating stuff
-    unsigned long graph_hash = lhash(product_pattern);
-    int error =
-        get_graph_data(graph_hash, &rx->product_graph_data[path][counter]);
-    if (error != 0) {
-      rx->product_graph_data[path][counter] = CHECKED_MALLOC_ARRAY(
-          struct graph_data, 1, "graph pattern for a single path");
-      rx->product_graph_data[path][counter]->graph_pattern =
-          strdup(product_pattern);
-      rx->product_graph_data[path][counter]->graph_pattern_hash =
-          lhash(product_pattern);
+    // patterns already in the system keep the data derived for them
+    bool created;
+    struct graph_data *graph = intern_graph_data(world, product_pattern, &created);
+    if (created) {
       diffusion = map_get(individualResult, "diffusion_function");
       if (diffusion) {
-        rx->product_graph_data[path][counter]->graph_diffusion =
-            atof(diffusion);
-        calculate_nfsim_diffusion_derived_data(
-            world, rx->product_graph_data[path][counter]);
-      } else {
-        rx->product_graph_data[path][counter]->graph_diffusion = -1;
-        rx->product_graph_data[path][counter]->time_step = -1;
-        rx->product_graph_data[path][counter]->space_step = -1;
+        graph->graph_diffusion = atof(diffusion);
+        calculate_nfsim_diffusion_derived_data(world, graph);
       }
 
-      calculate_nfsim_reactivity(rx->product_graph_data[path][counter]);
+      calculate_nfsim_reactivity(graph);
 
-      store_graph_data(graph_hash, rx->product_graph_data[path][counter]);
       world->n_NFSimSpecies += 1;
+      queue_nfsim_unimolecular_query(world, graph);
     }
+    acquire_graph_data(graph);
+    rx->product_graph_data[path][counter] = graph;
     counter++;
     //}
   }
@@ -573,11 +562,8 @@ void free_reaction_nfsim(struct rxn *rx, int path) {
   free(rx->nfsim_players[path]);
   free(rx->nfsim_geometries[path]);
 
-  // i actually need to iterate over all products
-  /*for(int i=0; i < rx->external_reaction_data[path].products;i++){
-    free(rx->product_graph_data[path][i]->graph_pattern);
-    free(rx->product_graph_data[path][i]);
-  }*/
+  for (int i = 0; i < rx->product_idx_aux[path]; i++)
+    release_graph_data(rx->product_graph_data[path][i]);
   free(rx->product_graph_data[path]);
 
   rx->nfsim_players[path] = NULL;
@@ -736,18 +722,12 @@ void properties_nfsim(struct volume *world, struct abstract_molecule *reac) {
     reac->graph_data->graph_diffusion = -1;
     reac->graph_data->space_step = -1;
     reac->graph_data->time_step = -1;
-    reac->get_diffusion = get_standard_diffusion;
-    reac->get_space_step = get_standard_space_step;
-    reac->get_time_step = get_standard_time_step;
   }
   mapvector_delete(results);
 
-  // now lets get information about the reactionality of this reactant
-  if (calculate_nfsim_reactivity(reac->graph_data)) {
-    reac->get_flags = get_nfsim_flags;
-  } else {
-    reac->get_flags = get_standard_flags;
-  }
+  // now lets get information about the reactionality of this reactant; the
+  // graph flags stay -1 if nfsim has none and the species flags apply
+  calculate_nfsim_reactivity(reac->graph_data);
 
   free(options.optionValues[0]);
   free(options.optionValues);
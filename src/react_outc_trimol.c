@@ -37,6 +37,7 @@
 #include "react.h"
 #include "vol_util.h"
 #include "wall_util.h"
+#include "mol_id_index.h"
 
 static int outcome_products_trimol_reaction_random(
     struct volume *world, struct wall *w, struct vector3 *hitpt, double t,
@@ -72,11 +73,11 @@ static int outcome_products_trimol_reaction_random(
     short orientA, short orientB, short orientC) {
 
   if (reacA != NULL && reacB != NULL) {
-    assert(periodic_boxes_are_identical(reacA->periodic_box, reacB->periodic_box));
+    assert(periodic_images_equal(&reacA->periodic_box, &reacB->periodic_box));
   } else if (reacA != NULL && reacC != NULL) {
-    assert(periodic_boxes_are_identical(reacA->periodic_box, reacC->periodic_box));
+    assert(periodic_images_equal(&reacA->periodic_box, &reacC->periodic_box));
   } else if (reacB != NULL && reacC != NULL) {
-    assert(periodic_boxes_are_identical(reacB->periodic_box, reacC->periodic_box));
+    assert(periodic_images_equal(&reacB->periodic_box, &reacC->periodic_box));
   }
 
   bool update_dissociation_index =
@@ -1672,7 +1673,7 @@ static int outcome_products_trimol_reaction_random(
       this_product = (struct abstract_molecule *)place_sm_product(
           world, product_species, 0, product_grid[n_product],
           product_grid_idx[n_product], &prod_uv_pos, product_orient[n_product],
-          t, reacA->periodic_box);
+          t, &reacA->periodic_box);
     }
 
     /* else place the molecule in space. */
@@ -1698,7 +1699,7 @@ static int outcome_products_trimol_reaction_random(
 
       this_product = (struct abstract_molecule *)place_volume_product(
           world, product_species, 0, sm_reactant, w, product_subvol, hitpt,
-          product_orient[n_product], t, reacA->periodic_box);
+          product_orient[n_product], t, &reacA->periodic_box);
 
       if (((struct volume_molecule *)this_product)->index < DISSOCIATION_MAX)
         update_dissociation_index = true;
@@ -1724,7 +1725,7 @@ static int outcome_products_trimol_reaction_random(
       count_region_from_scratch(world, NULL, rx->info[path].pathname, 1,
                                 &count_pos_xyz, w, t, NULL);
 
-    /* Other magical stuff.  For now, can only trigger releases. */
+    /* Other magical stuff: triggered releases and reaction traces. */
     if (rx->info[path].pathname->magic != NULL) {
       if (reaction_wizardry(world, rx->info[path].pathname->magic, w,
                             &count_pos_xyz, t))
@@ -1878,6 +1879,7 @@ int outcome_trimolecular(struct volume *world, struct rxn *rx, int path,
     if (vm != NULL)
       collect_molecule(vm);
     else {
+      mol_id_index_forget(world->mol_id_index, reacC);
       reacC->properties = NULL;
       if ((reacC->flags & IN_MASK) == 0)
         mem_put(reacC->birthplace, reacC);
@@ -1917,6 +1919,7 @@ int outcome_trimolecular(struct volume *world, struct rxn *rx, int path,
     if (vm != NULL)
       collect_molecule(vm);
     else {
+      mol_id_index_forget(world->mol_id_index, reacB);
       reacB->properties = NULL;
       if ((reacB->flags & IN_MASK) == 0)
         mem_put(reacB->birthplace, reacB);
@@ -1984,8 +1987,10 @@ int outcome_trimolecular(struct volume *world, struct rxn *rx, int path,
     reacA->properties->population--;
     if (vm != NULL)
       collect_molecule(vm);
-    else
+    else {
+      mol_id_index_forget(world->mol_id_index, reacA);
       reacA->properties = NULL;
+    }
 
     return RX_DESTROY;
   }
@@ -25,13 +25,19 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <string.h>
 #include <ctype.h>
+#include <limits.h>
+#include <math.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <unistd.h>
 #include <signal.h>
 #include <errno.h>
+#ifndef _WIN32
+#include <pthread.h>
+#endif
 
 #include "logging.h"
 #include "sched_util.h"
@@ -39,10 +45,136 @@
 #include "react_output.h"
 #include "mdlparse_util.h"
 #include "strfunc.h"
+#include "thread_util.h"
+#include "mpi_util.h"
+#include "util.h"
+#include "text_output.h"
+#include "output_journal.h"
+
+/* Worlds whose reaction output is flushed by the emergency hooks.  The
+ * hooks can only reach them through global state, so every world that is
+ * initialized (e.g. several pyMCell worlds in one process) is listed here. */
+#define MAX_HOOKED_WORLDS 64
+
+static struct volume *hooked_worlds[MAX_HOOKED_WORLDS];
+static int n_hooked_worlds = 0;
+#ifndef _WIN32
+static pthread_mutex_t hooked_worlds_lock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+static void run_oexpr_program(struct oexpr_program *prog);
+static int flush_output_sets(struct volume *world, int skip_journaled);
+
+/* One entry of the sidecar index of a text reaction data file */
+struct output_index_entry {
+  double value;     /* Leading value of the first line of a chunk */
+  long long offset; /* Byte offset of that line in the data file */
+};
+
+/**************************************************************************
+find_indexed_chunk:
+  In: name: reaction data file
+      start_value: value that we will start outputting to the file
+      size: size of the data file
+      f: the data file, opened for reading
+  Out: Byte offset of a line that starts before the first entry greater
+       than or equal to start_value, from which the file can be scanned.
+       This is the start of the last indexed chunk below start_value, or 0
+       if the file has no usable index.  An index that does not match the
+       file is removed.
+**************************************************************************/
+static off_t find_indexed_chunk(char const *name, double start_value,
+                                off_t size, FILE *f) {
+  char *idx_name = CHECKED_SPRINTF("%s%s", name, OUTPUT_INDEX_SUFFIX);
+  FILE *idx = fopen(idx_name, "rb");
+  if (idx == NULL) {
+    free(idx_name);
+    return 0;
+  }
+
+  struct stat is;
+  struct output_index_entry *entries = NULL;
+  long long n = 0;
+  int valid = (fstat(fileno(idx), &is) == 0 &&
+               is.st_size % sizeof(struct output_index_entry) == 0);
+  if (valid) {
+    n = is.st_size / sizeof(struct output_index_entry);
+    entries = CHECKED_MALLOC_ARRAY_NODIE(struct output_index_entry,
+                                         n > 0 ? n : 1, "output index");
+    valid = (entries != NULL &&
+             fread(entries, sizeof(struct output_index_entry), n, idx) ==
+                 (size_t)n);
+  }
+  fclose(idx);
+  for (long long e = 0; valid && e < n; e++)
+    valid = (entries[e].offset >= 0 && entries[e].offset < size &&
+             (e == 0 || (entries[e].offset > entries[e - 1].offset &&
+                         entries[e].value >= entries[e - 1].value)));
+
+  /* Binary search for the last chunk that starts below start_value */
+  long long lo = 0, hi = n;
+  while (valid && lo < hi) {
+    long long mid = lo + (hi - lo) / 2;
+    if (entries[mid].value + EPS_C < start_value)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+
+  /* The chunk must start a line with the value it was indexed with */
+  off_t from = 0;
+  if (valid && lo > 0) {
+    struct output_index_entry *chunk = &entries[lo - 1];
+    char line[64];
+    int prev = '\n';
+    if (fseeko(f, chunk->offset > 0 ? chunk->offset - 1 : 0, SEEK_SET) == 0 &&
+        (chunk->offset == 0 || (prev = fgetc(f)) != EOF) &&
+        fgets(line, sizeof(line), f) != NULL) {
+      char *done = NULL;
+      double value = strtod(line, &done);
+      valid = ((prev == '\n' || prev == '\r') && done != line &&
+               !distinguishable(value, chunk->value, 1e-9));
+    } else
+      valid = 0;
+    if (valid)
+      from = (off_t)chunk->offset;
+  }
+
+  if (!valid) {
+    mcell_warn("Ignoring index '%s', which does not match reaction data "
+               "output file '%s'.",
+               idx_name, name);
+    unlink(idx_name);
+  }
+  free(entries);
+  free(idx_name);
+  return from;
+}
+
+/**************************************************************************
+truncate_output_index:
+  In: name: reaction data file
+      size: size the data file was truncated to
+  Out: None.  Index entries of chunks that are no longer in the file are
+       dropped, so that chunks appended after the restart extend it.
+**************************************************************************/
+static void truncate_output_index(char const *name, off_t size) {
+  char *idx_name = CHECKED_SPRINTF("%s%s", name, OUTPUT_INDEX_SUFFIX);
+  FILE *idx = fopen(idx_name, "r+b");
+  if (idx == NULL) {
+    free(idx_name);
+    return;
+  }
 
-// XXX: This global state should be removed. Currently
-// we need it for cleanup via signals.
-static struct volume *global_state;
+  struct output_index_entry entry;
+  off_t keep = 0;
+  while (fread(&entry, sizeof(entry), 1, idx) == 1 && entry.offset < size)
+    keep += sizeof(entry);
+  if (ftruncate(fileno(idx), keep))
+    mcell_perror_nodie(errno, "Failed to truncate index '%s'", idx_name);
+  fclose(idx);
+  free(idx_name);
+}
 
 /**************************************************************************
 truncate_output_file:
@@ -50,7 +182,9 @@ truncate_output_file:
       value that we will start outputting to the file
   Out: 0 if file preparation is successful, 1 if not.  The file is
        truncated at start of the line containing the first entry
-       greater than or equal to the value to be printed out.
+       greater than or equal to the value to be printed out.  With a
+       sidecar index only the chunk holding that line is scanned;
+       otherwise the file is scanned from the start.
 **************************************************************************/
 
 int truncate_output_file(char *name, double start_value) {
@@ -64,8 +198,10 @@ int truncate_output_file(char *name, double start_value) {
                         "preparation for truncation.",
                  name);
   }
-  if (fs.st_size == 0)
+  if (fs.st_size == 0) {
+    truncate_output_index(name, 0);
     return 0; /* File already is empty */
+  }
 
   /* Set the buffer size */
   off_t bsize;
@@ -90,10 +226,14 @@ int truncate_output_file(char *name, double start_value) {
   }
 
   {
-  /* Iterate over the entire file */
-  int where = 0; /* Byte offset in file */
+  /* Iterate over the file from the chunk the start value is in */
+  off_t where = find_indexed_chunk(name, start_value, fs.st_size, f);
+  if (fseeko(f, where, SEEK_SET)) {
+    mcell_perror(errno, "Failed to seek in reaction data output file '%s'",
+                 name);
+  }
   int start = 0; /* Byte offset in buffer */
-  while (ftell(f) != fs.st_size) {
+  while (ftello(f) != fs.st_size) {
     /* Refill the buffer */
     long long n = (long long)fread(buffer + start, 1, bsize - start, f);
 
@@ -138,6 +278,7 @@ int truncate_output_file(char *name, double start_value) {
                          name);
             /*goto failure;*/
           }
+          truncate_output_index(name, where + lf);
           fclose(f);
           free(buffer);
           return 0;
@@ -193,6 +334,176 @@ failure:
   return 1;
 }
 
+/* One triggered event in the binary trigger format: 64 bytes, no padding */
+struct binary_trigger_record {
+  double t_iteration;
+  double event_time;
+  double x, y, z;
+  long long id;
+  int how_many;
+  short orient;
+  short flags;      /* TRIG_IS_RXN, TRIG_IS_HIT, ... */
+  u_int name_index; /* Into the schema's names, or UINT_MAX if unnamed */
+  u_int reserved;
+};
+
+/**************************************************************************
+truncate_binary_output_file:
+  In: name: binary reaction data file (see write_binary_reaction_output
+            and write_binary_trigger_output)
+      start_value: value that we will start outputting to the file
+  Out: 0 if file preparation is successful, 1 if not.  The file is
+       truncated before the first row or event whose time is greater than
+       or equal to start_value.  Records are skipped by their headers, so only the
+       time columns are read; a record holding the cut is rewritten with
+       the rows before it.
+**************************************************************************/
+static int truncate_binary_output_file(char *name, double start_value) {
+  FILE *f = fopen(name, "r+b");
+  if (f == NULL) {
+    mcell_perror_nodie(errno, "Failed to open reaction data output file '%s' "
+                       "for truncation.", name);
+    return 1;
+  }
+
+  struct stat fs;
+  int err = (fstat(fileno(f), &fs) != 0);
+  if (err)
+    mcell_perror_nodie(errno, "Failed to stat reaction data output file '%s'",
+                       name);
+  off_t size = err ? 0 : fs.st_size;
+  off_t cut = -1;
+  double *times = NULL;
+  u_int times_capacity = 0;
+  char tag[4];
+  while (cut < 0 && !err && fread(tag, 1, 4, f) == 4) {
+    off_t record = ftello(f) - 4;
+    int damaged = 0;
+    if (memcmp(tag, "MCRH", 4) == 0) {
+      u_int hdr[4], len = 0;
+      damaged = (fread(hdr, sizeof(u_int), 4, f) != 4);
+      for (u_int c = 0; !damaged && c < hdr[2]; c++)
+        damaged = (fread(&len, sizeof(u_int), 1, f) != 1 ||
+                   fseeko(f, len, SEEK_CUR) != 0);
+    } else if (memcmp(tag, "MCRD", 4) == 0) {
+      u_int hdr[2] = { 0, 0 };
+      damaged = (fread(hdr, sizeof(u_int), 2, f) != 2 ||
+                 (off_t)hdr[0] * (off_t)sizeof(double) > size);
+      u_int n_rows = damaged ? 0 : hdr[0], n_columns = hdr[1];
+      if (n_rows > times_capacity) {
+        free(times);
+        times_capacity = n_rows;
+        times = CHECKED_MALLOC_ARRAY(double, times_capacity,
+                                     "binary reaction output times");
+      }
+      damaged = damaged || (fread(times, sizeof(double), n_rows, f) != n_rows);
+      u_int keep = 0;
+      while (!damaged && keep < n_rows && times[keep] + EPS_C < start_value)
+        keep++;
+
+      off_t column_bytes = sizeof(u_int) + (off_t)n_rows * sizeof(double);
+      off_t columns = ftello(f);
+      damaged = damaged || (columns + n_columns * column_bytes > size);
+      if (!damaged && keep == n_rows) {
+        damaged = (fseeko(f, n_columns * column_bytes, SEEK_CUR) != 0);
+      } else if (!damaged && keep == 0) {
+        cut = record;
+      } else if (!damaged) {
+        /* Gather the kept rows of each column, then rewrite the record */
+        off_t kept_bytes = sizeof(u_int) + (off_t)keep * sizeof(double);
+        size_t n_kept = (size_t)(n_columns * kept_bytes);
+        char *kept = CHECKED_MALLOC_ARRAY(char, n_kept > 0 ? n_kept : 1,
+                                          "binary reaction output record");
+        for (u_int c = 0; !damaged && c < n_columns; c++)
+          damaged = (fseeko(f, columns + c * column_bytes, SEEK_SET) != 0 ||
+                     fread(kept + c * kept_bytes, 1, kept_bytes, f) !=
+                         (size_t)kept_bytes);
+        hdr[0] = keep;
+        if (!damaged) {
+          err = (fseeko(f, record, SEEK_SET) != 0 ||
+                 fwrite("MCRD", 1, 4, f) != 4 ||
+                 fwrite(hdr, sizeof(u_int), 2, f) != 2 ||
+                 fwrite(times, sizeof(double), keep, f) != keep ||
+                 fwrite(kept, 1, n_kept, f) != n_kept || fflush(f) != 0);
+          if (err)
+            mcell_perror_nodie(errno, "Failed to rewrite reaction data in "
+                               "'%s'", name);
+          cut = ftello(f);
+        }
+        free(kept);
+      }
+    } else if (memcmp(tag, "MCTH", 4) == 0) {
+      u_int hdr[5], len = 0;
+      damaged = (fread(hdr, sizeof(u_int), 5, f) != 5);
+      for (u_int c = 0; !damaged && c < hdr[2]; c++)
+        damaged = (fread(&len, sizeof(u_int), 1, f) != 1 ||
+                   fseeko(f, len, SEEK_CUR) != 0);
+    } else if (memcmp(tag, "MCTD", 4) == 0) {
+      /* Fixed-size events, each starting with its iteration time */
+      const off_t record_bytes = sizeof(struct binary_trigger_record);
+      u_int n_events = 0;
+      damaged = (fread(&n_events, sizeof(u_int), 1, f) != 1);
+      off_t events = ftello(f);
+      damaged = damaged || (events + n_events * record_bytes > size);
+      u_int keep = 0;
+      double t = 0;
+      while (!damaged && keep < n_events &&
+             fseeko(f, events + keep * record_bytes, SEEK_SET) == 0 &&
+             fread(&t, sizeof(double), 1, f) == 1 && t + EPS_C < start_value)
+        keep++;
+      if (!damaged && keep == n_events) {
+        damaged = (fseeko(f, events + n_events * record_bytes, SEEK_SET) != 0);
+      } else if (!damaged && keep == 0) {
+        cut = record;
+      } else if (!damaged) {
+        err = (fseeko(f, record + 4, SEEK_SET) != 0 ||
+               fwrite(&keep, sizeof(u_int), 1, f) != 1 || fflush(f) != 0);
+        if (err)
+          mcell_perror_nodie(errno, "Failed to rewrite trigger data in '%s'",
+                             name);
+        cut = events + keep * record_bytes;
+      }
+    } else {
+      mcell_error_nodie("Reaction data output file '%s' is not in the "
+                        "binary format.", name);
+      err = 1;
+    }
+
+    /* A record cut short, e.g. by a crash, is dropped with what follows */
+    if (!err && cut < 0 && ftello(f) > size)
+      damaged = 1;
+    if (damaged) {
+      mcell_warn("Dropping a damaged record at the end of reaction data "
+                 "output file '%s'.", name);
+      cut = record;
+    }
+  }
+  free(times);
+
+  if (!err && cut >= 0 && ftruncate(fileno(f), cut)) {
+    mcell_perror_nodie(errno, "Failed to truncate reaction data output file "
+                       "'%s'", name);
+    err = 1;
+  }
+  if (fclose(f) != 0)
+    err = 1;
+  return err;
+}
+
+/**************************************************************************
+truncate_output_set:
+  In: set: output_set whose file a checkpoint restart continues
+      start_value: value that we will start outputting to the file
+  Out: 0 if file preparation is successful, 1 if not.  The file is
+       truncated before the first entry greater than or equal to
+       start_value, in whichever format the set writes.
+**************************************************************************/
+int truncate_output_set(struct output_set *set, double start_value) {
+  if (set->binary_flag)
+    return truncate_binary_output_file(set->outfile_name, start_value);
+  return truncate_output_file(set->outfile_name, start_value);
+}
+
 /**************************************************************************
 emergency_output:
   In: No arguments.
@@ -225,46 +536,95 @@ static int emergency_output(struct volume *world) {
   }
   delete_mem(world->storage_allocator);
 
-  return flush_reaction_output(world);
+  /* Finish what is already queued before writing out the rest directly */
+  int n_errors = output_writer_destroy(world->output_writer);
+  world->output_writer = NULL;
+
+  n_errors += flush_reaction_output(world);
+  output_journals_close(world, n_errors == 0);
+  return n_errors;
 }
 
 /**************************************************************************
- emergency_output_hook_enabled:
-    Flag to disable emergency output hook when the program exits successfully.
+ flush_hooked_worlds:
+    Flushes the reaction output of every hooked world whose emergency output
+    hook is enabled, disabling it first in case a signal is received while
+    producing emergency output.
+
+  In: flush: function flushing the output of one world
+      n_flushed: set to the number of worlds flushed
+  Out: Total number of errors returned by flush.
 **************************************************************************/
-int emergency_output_hook_enabled = 1;
+static int flush_hooked_worlds(int (*flush)(struct volume *), int *n_flushed) {
+  int n_errors = 0;
+  *n_flushed = 0;
+  for (int i = 0; i < n_hooked_worlds; i++) {
+    struct volume *world = hooked_worlds[i];
+    if (!world->emergency_output_hook_enabled)
+      continue;
+    world->emergency_output_hook_enabled = 0;
+    n_errors += flush(world);
+    ++*n_flushed;
+  }
+  return n_errors;
+}
+
+/**************************************************************************
+ disable_emergency_output_hooks:
+    Disables the emergency output hooks of all worlds, e.g. in a forked
+    process which must not write out its parent's output.
+
+  In: No arguments.
+  Out: None.
+**************************************************************************/
+void disable_emergency_output_hooks(void) {
+  for (int i = 0; i < n_hooked_worlds; i++)
+    hooked_worlds[i]->emergency_output_hook_enabled = 0;
+}
 
 /**************************************************************************
  emergency_output_hook:
     This is an atexit hook to flush reaction output to disk in case an error is
-    occurred.  Set emergency_output_hook_enabled to 0 to prevent it from being
-    called (say, on successful exit).
+    occurred.  Set a world's emergency_output_hook_enabled to 0 to prevent its
+    output from being flushed (say, on successful exit).
 
   In: No arguments.
   Out: None.
 
 **************************************************************************/
 static void emergency_output_hook(void) {
-  if (emergency_output_hook_enabled) {
-    /* Disable the emergency output hook in case a signal is received while
-     * producing emergency output. */
-    emergency_output_hook_enabled = 0;
+  int n_flushed;
+  int n_errors = flush_hooked_worlds(&emergency_output, &n_flushed);
+  if (n_flushed == 0)
+    return;
 
-    int n_errors = emergency_output(global_state);
-    if (n_errors == 0)
-      mcell_warn("Emergency output hook triggered:\n    Reaction output was successfully flushed to disk.");
-    else if (n_errors == 1)
-      mcell_warn("An error occurred while flushing reaction output to disk.");
-    else
-      mcell_warn("%d errors occurred while flushing reaction output to disk.",
-                 n_errors);
-  }
+  if (n_errors == 0)
+    mcell_warn("Emergency output hook triggered:\n    Reaction output was successfully flushed to disk.");
+  else if (n_errors == 1)
+    mcell_warn("An error occurred while flushing reaction output to disk.");
+  else
+    mcell_warn("%d errors occurred while flushing reaction output to disk.",
+               n_errors);
+}
+
+/**************************************************************************
+ flush_unjournaled_output:
+    Flushes the reaction output of a world that is not kept in output
+    journals.  Journaled counts are already safe on disk, so a dying
+    process need not format them.
+
+  In: world: simulation state
+  Out: Number of sets that could not be written.
+**************************************************************************/
+static int flush_unjournaled_output(struct volume *world) {
+  return flush_output_sets(world, 1);
 }
 
 /**************************************************************************
  emergency_output_signal_handler:
     This is a signal handler to catch any abnormal termination signals, and
     flush the reaction output data (and anything else which should be flushed).
+    Output kept in output journals is left to -recover_output.
 
   In: No arguments.
   Out: None.
@@ -274,10 +634,18 @@ static void emergency_output_signal_handler(int signo)
 
 static void emergency_output_signal_handler(int signo) {
 
-  if (emergency_output_hook_enabled) {
-    emergency_output_hook_enabled = 0;
+  int n_journaled = 0;
+  for (int i = 0; i < n_hooked_worlds; i++) {
+    if (!hooked_worlds[i]->emergency_output_hook_enabled)
+      continue;
+    for (struct output_block *ob = hooked_worlds[i]->output_block_head;
+         ob != NULL; ob = ob->next)
+      n_journaled += (ob->journal != NULL);
+  }
 
-    int n_errors = flush_reaction_output(global_state);
+  int n_flushed;
+  int n_errors = flush_hooked_worlds(&flush_unjournaled_output, &n_flushed);
+  if (n_flushed > 0) {
     if (n_errors == 0)
       mcell_error_raw("Emergency output signal handler triggered by signal %d:\n    Reaction output was successfully flushed to disk.\n", signo);
     else if (n_errors == 1)
@@ -287,6 +655,9 @@ static void emergency_output_signal_handler(int signo) {
       mcell_error_raw(
           "%d errors occurred while flushing reaction output to disk.\n",
           n_errors);
+    if (n_journaled > 0)
+      mcell_error_raw("    Counts kept in output journals were left for "
+                      "-recover_output.\n");
   }
   raise(signo);
 
@@ -325,11 +696,26 @@ static void install_emergency_output_signal_handler(int signo) {
     Installs all relevant hooks for catching invalid program termination and
     flushing output to disk, where possible.
 
-  In: No arguments.
+  In: world: simulation whose reaction output the hooks should flush
   Out: None.
 **************************************************************************/
 void install_emergency_output_hooks(struct volume *world) {
-  global_state = world;
+#ifndef _WIN32
+  pthread_mutex_lock(&hooked_worlds_lock);
+#endif
+  int n_before = n_hooked_worlds;
+  if (n_hooked_worlds < MAX_HOOKED_WORLDS)
+    hooked_worlds[n_hooked_worlds++] = world;
+  else
+    mcell_warn("Too many simulations for emergency output; the reaction "
+               "output of this one will not be flushed on abnormal exit.");
+#ifndef _WIN32
+  pthread_mutex_unlock(&hooked_worlds_lock);
+#endif
+
+  /* The hooks themselves are shared by all worlds */
+  if (n_before > 0)
+    return;
 
   if (atexit(&emergency_output_hook) != 0)
     mcell_warn("Failed to install emergency output hook.");
@@ -408,6 +794,17 @@ flush_reaction_output:
         (Do this before ending the simulation.)
 *************************************************************************/
 int flush_reaction_output(struct volume *world) {
+  return flush_output_sets(world, 0);
+}
+
+/*************************************************************************
+flush_output_sets:
+   In: world: simulation state
+       skip_journaled: nonzero to leave out the sets kept in output journals
+   Out: number of sets that could not be written.  The buffered output of
+        the other sets is written to disk.
+*************************************************************************/
+static int flush_output_sets(struct volume *world, int skip_journaled) {
   struct schedule_helper *sh;
   struct output_block *ob;
   struct output_set *os;
@@ -423,6 +820,8 @@ int flush_reaction_output(struct volume *world) {
 
       for (; ob != NULL; ob = ob->next) {
         for (os = ob->data_set_head; os != NULL; os = os->next) {
+          if (skip_journaled && os->journal_set >= 0)
+            continue;
           if (write_reaction_output(world, os))
             n_errors++;
         }
@@ -434,47 +833,17 @@ int flush_reaction_output(struct volume *world) {
 }
 
 /**************************************************************************
-update_reaction_output:
-  In: the output_block we want to update
-  Out: 0 on success, 1 on failure.
-       The counters in this block are updated, and the block is
-       rescheduled for the next output time.  The counters are saved
-       to an internal buffer, and written out when full.
+store_reaction_output_row:
+  In: world: simulation state
+      block: the output_block being updated
+      report_as_non_trigger: set unless the block holds trigger columns
+  Out: 0 if a row was stored in the buffers of the block at its current
+       time, 1 if the block has no time left for one.
 **************************************************************************/
-int update_reaction_output(struct volume *world, struct output_block *block) {
-  int report_as_non_trigger = 1;
+static int store_reaction_output_row(struct volume *world,
+                                     struct output_block *block,
+                                     int report_as_non_trigger) {
   int i = block->buf_index;
-  if (block->data_set_head != NULL &&
-      block->data_set_head->column_head != NULL &&
-      block->data_set_head->column_head->buffer[i].data_type == COUNT_TRIG_STRUCT)
-    report_as_non_trigger = 0;
-
-  if (report_as_non_trigger) {
-    switch (world->notify->reaction_output_report) {
-    case NOTIFY_NONE:
-      break;
-
-    case NOTIFY_BRIEF:
-      mcell_log(
-          "Updating reaction output scheduled at time %.15g on iteration %lld.",
-          block->t, world->current_iterations);
-      break;
-
-    case NOTIFY_FULL:
-      mcell_log("Updating reaction output scheduled at time %.15g on iteration"
-                " %lld.\n  Buffer fill level is at %u/%u.",
-                block->t, world->current_iterations, block->buf_index,
-                block->buffersize);
-      break;
-
-    default:
-      UNHANDLED_CASE(world->notify->reaction_output_report);
-    }
-  }
-
-  /* update all counters */
-
-  block->t /= (1. + EPS_C);
   if (world->chkpt_seq_num == 1) {
     if (block->timer_type == OUTPUT_BY_ITERATION_LIST)
       block->time_array[i] = block->t;
@@ -485,7 +854,7 @@ int update_reaction_output(struct volume *world, struct output_block *block) {
       block->time_array[i] = block->t;
     } else if (block->timer_type == OUTPUT_BY_TIME_LIST) {
       if (block->time_now == NULL) {
-        return 0;
+        return 1;
       } else {
         block->time_array[i] = block->time_now->value;
       }
@@ -497,20 +866,25 @@ int update_reaction_output(struct volume *world, struct output_block *block) {
     }
   }
 
-  struct output_set *set;
-  struct output_column *column;
+  /* On a split run, rank 0 evaluates the columns from the sums over all
+   * ranks */
+  mpi_sum_counts(world);
+  if (block->program != NULL)
+    run_oexpr_program(block->program);
+
   // Each file
-  for (set = block->data_set_head; set != NULL; set = set->next) 
-  {
+  for (struct output_set *set = block->data_set_head; set != NULL;
+       set = set->next) {
     if (report_as_non_trigger) {
       if (world->notify->reaction_output_report == NOTIFY_FULL)
         mcell_log("  Processing reaction output file '%s'.", set->outfile_name);
     }
     // Each column
-    for (column = set->column_head; column != NULL; column = column->next) 
-    {
+    for (struct output_column *column = set->column_head; column != NULL;
+         column = column->next) {
       if (column->buffer[i].data_type != COUNT_TRIG_STRUCT) {
-        eval_oexpr_tree(column->expr, 1);
+        if (block->program == NULL)
+          eval_oexpr_tree(column->expr, 1);
         switch (column->buffer[i].data_type) {
         case COUNT_INT:
           column->buffer[i].val.ival = (int)column->expr->value;
@@ -531,7 +905,59 @@ int update_reaction_output(struct volume *world, struct output_block *block) {
       }
     }
   }
+  mpi_restore_counts(world);
   block->buf_index++;
+  output_journal_commit(block);
+  return 0;
+}
+
+/**************************************************************************
+update_reaction_output:
+  In: the output_block we want to update
+  Out: 0 on success, 1 on failure.
+       The counters in this block are updated, and the block is
+       rescheduled for the next output time.  The counters are saved
+       to an internal buffer, and written out when full.
+**************************************************************************/
+int update_reaction_output(struct volume *world, struct output_block *block) {
+  int report_as_non_trigger = 1;
+  int i = block->buf_index;
+  if (block->data_set_head != NULL &&
+      block->data_set_head->column_head != NULL &&
+      block->data_set_head->column_head->buffer[i].data_type == COUNT_TRIG_STRUCT)
+    report_as_non_trigger = 0;
+
+  if (report_as_non_trigger) {
+    switch (world->notify->reaction_output_report) {
+    case NOTIFY_NONE:
+      break;
+
+    case NOTIFY_BRIEF:
+      mcell_log(
+          "Updating reaction output scheduled at time %.15g on iteration %lld.",
+          block->t, world->current_iterations);
+      break;
+
+    case NOTIFY_FULL:
+      mcell_log("Updating reaction output scheduled at time %.15g on iteration"
+                " %lld.\n  Buffer fill level is at %u/%u.",
+                block->t, world->current_iterations, block->buf_index,
+                block->buffersize);
+      break;
+
+    default:
+      UNHANDLED_CASE(world->notify->reaction_output_report);
+    }
+  }
+
+  /* update all counters */
+
+  block->t /= (1. + EPS_C);
+  /* Rows of the equilibration phase are not recorded, but the block still
+   * moves on to its next output time */
+  if (!world->equilibrating &&
+      store_reaction_output_row(world, block, report_as_non_trigger))
+    return 0;
 
   int final_chunk_flag = 0; // flag signaling an end to the scheduled
                             // reaction outputs. Takes values {0,1}.
@@ -589,7 +1015,8 @@ int update_reaction_output(struct volume *world, struct output_block *block) {
 
   /* write data to outfile */
   if (block->buf_index == block->buffersize || final_chunk_flag) {
-    for (set = block->data_set_head; set != NULL; set = set->next) {
+    for (struct output_set *set = block->data_set_head; set != NULL;
+         set = set->next) {
       if (set->column_head->buffer[i].data_type == COUNT_TRIG_STRUCT)
         continue;
       if (write_reaction_output(world, set)) {
@@ -599,6 +1026,7 @@ int update_reaction_output(struct volume *world, struct output_block *block) {
       }
     }
     block->buf_index = 0;
+    output_journal_reset(block);
     no_printf("Done updating reaction output\n");
   }
 
@@ -608,6 +1036,153 @@ int update_reaction_output(struct volume *world, struct output_block *block) {
   return 0;
 }
 
+/**************************************************************************
+ new_count_buffer:
+    Allocate and initialize the buffer of a non-trigger output column.
+
+ In: oc: the column, whose expression type decides the initial values
+     n_rows: number of rows to allocate
+ Out: the new buffer, or NULL if the column type is not a count type
+**************************************************************************/
+struct output_buffer *new_count_buffer(struct output_column *oc, u_int n_rows) {
+  enum count_type_t data_type;
+  switch (oc->expr->expr_flags & OEXPR_TYPE_MASK) {
+  // Counting on meshes that don't exist at the beginning of the sim.
+  case OEXPR_TYPE_UNDEF:
+    data_type = COUNT_UNSET;
+    break;
+  case OEXPR_TYPE_INT:
+    data_type = COUNT_INT;
+    break;
+  case OEXPR_TYPE_DBL:
+    data_type = COUNT_DBL;
+    break;
+  default:
+    return NULL;
+  }
+
+  struct output_buffer *buffer = CHECKED_MALLOC_ARRAY(
+      struct output_buffer, n_rows, "reaction data output buffer");
+  for (u_int i = 0; i < n_rows; ++i) {
+    buffer[i].data_type = data_type;
+    if (data_type == COUNT_UNSET)
+      buffer[i].val.cval = 'X';
+    else if (data_type == COUNT_INT)
+      buffer[i].val.ival = 0;
+    else
+      buffer[i].val.dval = 0.0;
+  }
+  return buffer;
+}
+
+/**************************************************************************
+ output_row_bytes:
+    Bytes one buffered row of an output block takes: the time stamp plus one
+    entry per count column.  Trigger columns are sized separately.
+
+ In: obp: the output block
+ Out: bytes per row
+**************************************************************************/
+static long long output_row_bytes(struct output_block *obp) {
+  long long row_bytes = sizeof(double);
+  for (struct output_set *os = obp->data_set_head; os != NULL; os = os->next) {
+    for (struct output_column *oc = os->column_head; oc != NULL;
+         oc = oc->next) {
+      if ((oc->expr->expr_flags & OEXPR_TYPE_MASK) != OEXPR_TYPE_TRIG)
+        row_bytes += sizeof(struct output_buffer);
+    }
+  }
+  return row_bytes;
+}
+
+/**************************************************************************
+ resize_output_block:
+    Reallocate the time stamps and count buffers of an output block that has
+    nothing buffered yet.
+
+ In: obp: the output block
+     n_rows: new number of rows
+ Out: 0 on success, 1 on failure
+**************************************************************************/
+static int resize_output_block(struct output_block *obp, u_int n_rows) {
+  if (n_rows == obp->buffersize)
+    return 0;
+
+  free(obp->time_array);
+  obp->time_array = CHECKED_MALLOC_ARRAY(double, n_rows,
+                                         "reaction data output times array");
+
+  for (struct output_set *os = obp->data_set_head; os != NULL; os = os->next) {
+    for (struct output_column *oc = os->column_head; oc != NULL;
+         oc = oc->next) {
+      if ((oc->expr->expr_flags & OEXPR_TYPE_MASK) == OEXPR_TYPE_TRIG)
+        continue;
+      free(oc->buffer);
+      if ((oc->buffer = new_count_buffer(oc, n_rows)) == NULL)
+        return 1;
+    }
+  }
+  obp->buffersize = n_rows;
+  return 0;
+}
+
+/**************************************************************************
+ size_output_buffers:
+    Give the count buffers of output blocks without an explicit
+    OUTPUT_BUFFER_SIZE a share of COUNT_BUFFER_BUDGET.  Each such block gets
+    the same number of rows, never fewer than COUNTBUFFERSIZE nor more than
+    it will ever fill; whatever a block cannot use goes to the others.  Wide
+    blocks thus flush no more often than narrow ones, and small runs buffer
+    all their output.  Must run before any data is buffered.
+
+ In: world: simulation state
+ Out: 0 on success, 1 on failure
+**************************************************************************/
+int size_output_buffers(struct volume *world) {
+  long long budget = COUNT_BUFFER_BUDGET;
+  long long open_row_bytes = 0;
+  struct output_block *obp;
+
+  /* Fixed and already sufficient buffers use up part of the budget first */
+  for (obp = world->output_block_head; obp != NULL; obp = obp->next) {
+    if (obp->auto_buffersize && obp->rows_needed > obp->buffersize)
+      open_row_bytes += output_row_bytes(obp);
+    else
+      budget -= output_row_bytes(obp) * obp->buffersize;
+  }
+
+  /* Share the rest evenly, settling blocks that need less than their share
+   * until the share stops growing */
+  long long rows = COUNTBUFFERSIZE;
+  while (open_row_bytes > 0) {
+    rows = (budget > 0) ? budget / open_row_bytes : 0;
+    if (rows <= COUNTBUFFERSIZE)
+      return 0;
+
+    int settled = 0;
+    for (obp = world->output_block_head; obp != NULL; obp = obp->next) {
+      if (!obp->auto_buffersize || obp->rows_needed <= obp->buffersize ||
+          obp->rows_needed > rows)
+        continue;
+      long long row_bytes = output_row_bytes(obp);
+      if (resize_output_block(obp, obp->rows_needed))
+        return 1;
+      budget -= row_bytes * obp->buffersize;
+      open_row_bytes -= row_bytes;
+      settled = 1;
+    }
+    if (!settled)
+      break;
+  }
+
+  for (obp = world->output_block_head; obp != NULL; obp = obp->next) {
+    if (obp->auto_buffersize && obp->rows_needed > obp->buffersize &&
+        resize_output_block(obp, (u_int)rows))
+      return 1;
+  }
+  return 0;
+}
+
 /**************************************************************************
  check_reaction_output_file:
     Check that the reaction output file is writable within the policy set by
@@ -759,164 +1334,499 @@ int check_reaction_output_file(struct output_set *os) {
 }
 
 /**************************************************************************
-write_reaction_output:
-  In: the output_set we want to write to disk
-      the flag that signals an end to the scheduled reaction outputs
-  Out: 0 on success, 1 on failure.
-       The reaction output buffer is flushed and written to disk.
-       Indices are not reset; that's the job of the calling function.
+write_binary_reaction_output:
+  In: set: the output_set we want to write to disk
+      fp: file opened for writing at the end
+      n_output: number of buffered rows
+      write_header: nonzero to start with a schema record
+  Out: 0 on success, 1 on a write error.
+       The buffered rows are written as records in native byte order:
+
+         schema: "MCRH" u32 0x01020304 u32 version u32 n_columns
+                 u32 time_is_iteration, then per column u32 name_length and
+                 the name bytes (no terminator)
+         data:   "MCRD" u32 n_rows u32 n_columns, the time column as
+                 n_rows float64 values, then per column a u32 type
+                 (BINARY_COLUMN_*) followed by n_rows int64 or float64
+                 values; unset values are INT64_MIN or NaN.
+
+       A file holds a schema record and any number of data records, and
+       appending with >>> adds a new schema record first.
 **************************************************************************/
-int write_reaction_output(struct volume *world, struct output_set *set) {
+static int write_binary_reaction_output(struct output_set *set, FILE *fp,
+                                        u_int n_output, int write_header) {
+  u_int n_columns = 0;
+  for (struct output_column *column = set->column_head; column != NULL;
+       column = column->next)
+    n_columns++;
+
+  if (write_header) {
+    u_int hdr[4] = { 0x01020304, BINARY_OUTPUT_VERSION, n_columns,
+                     (set->block->timer_type == OUTPUT_BY_ITERATION_LIST) };
+    if (fwrite("MCRH", 1, 4, fp) != 4 || fwrite(hdr, sizeof(u_int), 4, fp) != 4)
+      return 1;
+    for (struct output_column *column = set->column_head; column != NULL;
+         column = column->next) {
+      const char *title =
+          (column->expr->title == NULL) ? "untitled" : column->expr->title;
+      u_int len = (u_int)strlen(title);
+      if (fwrite(&len, sizeof(u_int), 1, fp) != 1 ||
+          fwrite(title, 1, len, fp) != len)
+        return 1;
+    }
+  }
 
-  FILE *fp;
-  struct output_column *column;
-  const char *mode;
-  u_int n_output;
-  u_int i;
+  u_int hdr[2] = { n_output, n_columns };
+  if (fwrite("MCRD", 1, 4, fp) != 4 || fwrite(hdr, sizeof(u_int), 2, fp) != 2 ||
+      fwrite(set->block->time_array, sizeof(double), n_output, fp) != n_output)
+    return 1;
+
+  /* One column at a time, staged so each is a single fwrite */
+  u_int n_alloc = (n_output > 0) ? n_output : 1;
+  double *dvals = CHECKED_MALLOC_ARRAY(double, n_alloc,
+                                       "binary reaction output column");
+  long long *ivals = CHECKED_MALLOC_ARRAY(long long, n_alloc,
+                                          "binary reaction output column");
+  int err = 0;
+  for (struct output_column *column = set->column_head;
+       column != NULL && !err; column = column->next) {
+    u_int type = BINARY_COLUMN_DBL;
+    if (n_output > 0 && column->buffer[0].data_type == COUNT_INT)
+      type = BINARY_COLUMN_INT;
+
+    for (u_int i = 0; i < n_output; i++) {
+      struct output_buffer *b = &column->buffer[i];
+      if (type == BINARY_COLUMN_INT)
+        ivals[i] = (b->data_type == COUNT_INT) ? (long long)b->val.ival
+                 : (b->data_type == COUNT_DBL) ? (long long)b->val.dval
+                 : LLONG_MIN;
+      else
+        dvals[i] = (b->data_type == COUNT_DBL) ? b->val.dval
+                 : (b->data_type == COUNT_INT) ? (double)b->val.ival
+                 : NAN;
+    }
+
+    if (fwrite(&type, sizeof(u_int), 1, fp) != 1)
+      err = 1;
+    else if (type == BINARY_COLUMN_INT)
+      err = (fwrite(ivals, sizeof(long long), n_output, fp) != n_output);
+    else
+      err = (fwrite(dvals, sizeof(double), n_output, fp) != n_output);
+  }
+  free(ivals);
+  free(dvals);
+  return err;
+}
+
+/* Trigger column title and its position, to intern record names */
+struct trigger_name_entry {
+  char const *name;
+  u_int index;
+};
+
+static int compare_trigger_names(void const *a, void const *b) {
+  uintptr_t pa = (uintptr_t)((struct trigger_name_entry const *)a)->name;
+  uintptr_t pb = (uintptr_t)((struct trigger_name_entry const *)b)->name;
+  return (pa > pb) - (pa < pb);
+}
+
+/**************************************************************************
+write_binary_trigger_output:
+  In: set: the trigger output_set we want to write to disk
+      fp: file opened for writing at the end
+      n_output: number of buffered events
+      write_header: nonzero to start with a schema record
+  Out: 0 on success, 1 on a write error.
+       The buffered events are written as records in native byte order:
+
+         schema: "MCTH" u32 0x01020304 u32 version u32 n_names
+                 u32 time_is_iteration u32 exact_time, then per name
+                 u32 name_length and the name bytes (no terminator)
+         data:   "MCTD" u32 n_events, then n_events 64-byte
+                 binary_trigger_record entries
+
+       The names are the titles of the set's columns, in column order;
+       every event refers to the name of the TRIGGER statement that
+       produced it by index.
+**************************************************************************/
+static int write_binary_trigger_output(struct output_set *set, FILE *fp,
+                                       u_int n_output, int write_header) {
+  u_int n_names = 0;
+  for (struct output_column *column = set->column_head; column != NULL;
+       column = column->next)
+    n_names++;
+
+  if (write_header) {
+    u_int hdr[5] = { 0x01020304, BINARY_TRIGGER_VERSION, n_names,
+                     (set->block->timer_type == OUTPUT_BY_ITERATION_LIST),
+                     (u_int)set->exact_time_flag };
+    if (fwrite("MCTH", 1, 4, fp) != 4 || fwrite(hdr, sizeof(u_int), 5, fp) != 5)
+      return 1;
+    for (struct output_column *column = set->column_head; column != NULL;
+         column = column->next) {
+      const char *title = (column->expr->title == NULL) ? "" : column->expr->title;
+      u_int len = (u_int)strlen(title);
+      if (fwrite(&len, sizeof(u_int), 1, fp) != 1 ||
+          fwrite(title, 1, len, fp) != len)
+        return 1;
+    }
+  }
+
+  /* Events carry their column's title, so look names up by address */
+  struct trigger_name_entry *names = CHECKED_MALLOC_ARRAY(
+      struct trigger_name_entry, n_names, "binary trigger output names");
+  u_int n = 0;
+  for (struct output_column *column = set->column_head; column != NULL;
+       column = column->next, n++) {
+    names[n].name = column->expr->title;
+    names[n].index = n;
+  }
+  qsort(names, n_names, sizeof(struct trigger_name_entry),
+        compare_trigger_names);
+
+  u_int n_alloc = (n_output > 0) ? n_output : 1;
+  struct binary_trigger_record *records = CHECKED_MALLOC_ARRAY(
+      struct binary_trigger_record, n_alloc, "binary trigger output block");
+  for (u_int i = 0; i < n_output; i++) {
+    struct output_trigger_data const *trig = set->column_head->buffer[i].val.tval;
+    struct binary_trigger_record *r = &records[i];
+    r->t_iteration = trig->t_iteration;
+    r->event_time = trig->event_time;
+    r->x = trig->loc.x;
+    r->y = trig->loc.y;
+    r->z = trig->loc.z;
+    r->id = (long long)trig->id;
+    r->how_many = trig->how_many;
+    r->orient = trig->orient;
+    r->flags = trig->flags;
+    r->name_index = UINT_MAX;
+    r->reserved = 0;
+    if (trig->name != NULL) {
+      struct trigger_name_entry key = { trig->name, 0 };
+      struct trigger_name_entry *found = (struct trigger_name_entry *)bsearch(
+          &key, names, n_names, sizeof(struct trigger_name_entry),
+          compare_trigger_names);
+      if (found != NULL)
+        r->name_index = found->index;
+    }
+  }
+
+  int err = (fwrite("MCTD", 1, 4, fp) != 4 ||
+             fwrite(&n_output, sizeof(u_int), 1, fp) != 1 ||
+             fwrite(records, sizeof(struct binary_trigger_record), n_output,
+                    fp) != n_output);
+  free(records);
+  free(names);
+  return err;
+}
+
+/**************************************************************************
+index_output_chunk:
+  In: world: simulation state
+      set: the text output_set a chunk was written for
+      mode: mode the data file was opened with
+      value: leading value of the first line of the chunk
+      n_rows: number of data lines in the chunk
+      n_bytes: length of the chunk
+  Out: 0 on success, 1 on a write error.  For a FILE_SUBSTITUTE set,
+       which is written as FILE_OVERWRITE while its file is still empty,
+       the chunk's value and byte offset are appended to the sidecar index
+       that truncate_output_file uses on a checkpoint restart.  Chunks
+       without data lines hold at most a header and are not indexed.
+**************************************************************************/
+static int index_output_chunk(struct volume *world, struct output_set *set,
+                              const char *mode, double value, u_int n_rows,
+                              long long n_bytes) {
+  if (!set->index_flag)
+    return 0;
+
+  struct output_index_entry entry = { value, set->file_offset };
+  set->file_offset += n_bytes;
+  if (n_rows == 0)
+    return 0;
+
+  char *idx_name =
+      CHECKED_SPRINTF("%s%s", set->outfile_name, OUTPUT_INDEX_SUFFIX);
+  FILE *idx = output_writer_open(world->output_writer, idx_name, mode);
+  free(idx_name);
+  if (idx == NULL)
+    return 1;
+  int err = (fwrite(&entry, sizeof(entry), 1, idx) != 1);
+  if (output_writer_close(world->output_writer, idx))
+    err = 1;
+  return err;
+}
 
+/**************************************************************************
+close_journaled_output:
+  In: set: a COUNT output_set kept in an output journal
+      fp: its data file, holding the rows just written
+      err: nonzero if writing them failed
+  Out: 0 on success, 1 on failure.  Once the rows are in the file, the
+       journal records the file's new size and that the rows no longer need
+       recovering.
+**************************************************************************/
+static int close_journaled_output(struct output_set *set, FILE *fp, int err) {
+  struct stat fs;
+  if (fflush(fp) != 0 || fstat(fileno(fp), &fs) != 0) {
+    mcell_perror_nodie(errno, "Failed to write reaction data to '%s'",
+                       set->outfile_name);
+    err = 1;
+  }
+  if (!err)
+    output_journal_flushed(set->block->journal, set->journal_set, fs.st_size);
+  if (fclose(fp) != 0)
+    err = 1;
+  return err;
+}
+
+/**************************************************************************
+reaction_output_mode:
+  In: world: simulation state
+      set: the output_set about to be written
+  Out: "w" if the next chunk starts the file afresh, "a" if it is appended
+**************************************************************************/
+char const *reaction_output_mode(struct volume *world, struct output_set *set) {
   switch (set->file_flags) {
   case FILE_OVERWRITE:
   case FILE_CREATE:
-    if (set->chunk_count == 0)
-      mode = "w";
-    else
-      mode = "a";
-    break;
+    return (set->chunk_count == 0) ? "w" : "a";
   case FILE_SUBSTITUTE:
-    if (world->chkpt_seq_num == 1 && set->chunk_count == 0)
-      mode = "w";
-    else
-      mode = "a";
-    break;
+    return (world->chkpt_seq_num == 1 && set->chunk_count == 0) ? "w" : "a";
   case FILE_APPEND:
   case FILE_APPEND_HEADER:
-    mode = "a";
-    break;
+    return "a";
   default:
     mcell_internal_error(
         "Bad file output code %d for reaction data output file '%s'.",
         set->file_flags, set->outfile_name);
   }
+}
 
-  fp = open_file(set->outfile_name, mode);
-  if (fp == NULL)
-    return 1;
+/**************************************************************************
+reaction_output_needs_header:
+  In: world: simulation state
+      set: the output_set about to be written
+  Out: nonzero if the next chunk starts with the column header
+**************************************************************************/
+int reaction_output_needs_header(struct volume *world, struct output_set *set) {
+  return (set->chunk_count == 0 && set->file_flags != FILE_APPEND &&
+          (world->chkpt_seq_num == 1 ||
+           set->file_flags == FILE_APPEND_HEADER ||
+           set->file_flags == FILE_CREATE ||
+           set->file_flags == FILE_OVERWRITE));
+}
 
-  /*int idx = set->block->buf_index;*/
-  if (set->column_head->buffer[0].data_type != COUNT_TRIG_STRUCT) {
-    n_output = set->block->buffersize;
-    if (set->block->buf_index < set->block->buffersize)
-      n_output = set->block->buf_index;
+/**************************************************************************
+write_count_rows:
+  In: set: a COUNT output_set
+      fp: file opened for writing at the end
+      n_output: number of buffered rows to write
+      write_header: nonzero to start with the column header
+      shortest_floats: nonzero to write text doubles with the fewest digits
+                       that read back exactly
+  Out: 0 on success, 1 on a write error.  The first n_output rows of the
+       block's buffers are written in the set's text or binary format.
+**************************************************************************/
+int write_count_rows(struct output_set *set, FILE *fp, u_int n_output,
+                     int write_header, int shortest_floats) {
+  struct output_column *column;
 
-    if (world->notify->file_writes == NOTIFY_FULL)
-      mcell_log("Writing %d lines to output file %s.", n_output,
-                set->outfile_name);
+  if (set->binary_flag)
+    return write_binary_reaction_output(set, fp, n_output, write_header);
+
+  /* Write headers */
+  if (write_header && set->header_comment != NULL) {
+    if (set->block->timer_type == OUTPUT_BY_ITERATION_LIST)
+      fprintf(fp, "%sIteration_#", set->header_comment);
+    else
+      fprintf(fp, "%sSeconds", set->header_comment);
 
-    /* Write headers */
-    if (set->chunk_count == 0 && set->header_comment != NULL &&
-        set->file_flags != FILE_APPEND &&
-        (world->chkpt_seq_num == 1 || set->file_flags == FILE_APPEND_HEADER ||
-         set->file_flags == FILE_CREATE || set->file_flags == FILE_OVERWRITE)) {
-      if (set->block->timer_type == OUTPUT_BY_ITERATION_LIST)
-        fprintf(fp, "%sIteration_#", set->header_comment);
+    for (column = set->column_head; column != NULL; column = column->next) {
+      if (column->expr->title == NULL)
+        fprintf(fp, " untitled");
       else
-        fprintf(fp, "%sSeconds", set->header_comment);
+        fprintf(fp, " %s", column->expr->title);
+    }
+    fprintf(fp, "\n");
+  }
 
-      for (column = set->column_head; column != NULL; column = column->next) {
-        if (column->expr->title == NULL)
-          fprintf(fp, " untitled");
+  /* Write data */
+  struct text_writer *tw = CHECKED_MALLOC_STRUCT(struct text_writer,
+                                                 "reaction output buffer");
+  text_writer_init(tw, fp, shortest_floats);
+  for (u_int i = 0; i < n_output; i++) {
+    text_writer_double(tw, set->block->time_array[i], 15);
+
+    for (column = set->column_head; column != NULL; column = column->next) {
+      switch (column->buffer[i].data_type) {
+      case COUNT_INT:
+        text_writer_char(tw, ' ');
+        text_writer_long(tw, column->buffer[i].val.ival);
+        break;
+
+      case COUNT_DBL:
+        text_writer_char(tw, ' ');
+        text_writer_double(tw, column->buffer[i].val.dval, 9);
+        break;
+
+      case COUNT_UNSET:
+        text_writer_string(tw, " X");
+        break;
+
+      case COUNT_TRIG_STRUCT:
+      default:
+        if (column->expr->title != NULL)
+          mcell_warn(
+              "Unexpected data type in column titled '%s' -- skipping.",
+              column->expr->title);
         else
-          fprintf(fp, " %s", column->expr->title);
+          mcell_warn("Unexpected data type in untitled column -- skipping.");
+        break;
       }
-      fprintf(fp, "\n");
     }
+    text_writer_char(tw, '\n');
+  }
+  text_writer_flush(tw);
+  free(tw);
+  return 0;
+}
 
-    /* Write data */
-    for (i = 0; i < n_output; i++) {
-      fprintf(fp, "%.15g", set->block->time_array[i]);
+/**************************************************************************
+write_reaction_output:
+  In: the output_set we want to write to disk
+      the flag that signals an end to the scheduled reaction outputs
+  Out: 0 on success, 1 on failure.
+       The reaction output buffer is flushed and written to disk.
+       Indices are not reset; that's the job of the calling function.
+       Only rank 0 writes the output of a run split between MPI ranks.
+       Sets kept in an output journal are written directly rather than
+       through the background writer, so that the journal can record
+       where the file ends once the rows are in it.
+**************************************************************************/
+int write_reaction_output(struct volume *world, struct output_set *set) {
 
-      for (column = set->column_head; column != NULL; column = column->next) {
-        switch (column->buffer[i].data_type) {
-        case COUNT_INT:
-          fprintf(fp, " %d", (column->buffer[i].val.ival));
-          break;
+  FILE *fp;
+  u_int n_output;
+  u_int i;
 
-        case COUNT_DBL:
-          fprintf(fp, " %.9g", (column->buffer[i].val.dval));
-          break;
+  if (world->procnum != 0)
+    return 0;
 
-        case COUNT_UNSET:
-          fprintf(fp, " X");
-          break;
+  const char *mode = reaction_output_mode(world, set);
 
-        case COUNT_TRIG_STRUCT:
-        default:
-          if (column->expr->title != NULL)
-            mcell_warn(
-                "Unexpected data type in column titled '%s' -- skipping.",
-                column->expr->title);
-          else
-            mcell_warn("Unexpected data type in untitled column -- skipping.");
-          break;
-        }
-      }
-      fprintf(fp, "\n");
+  /* The first chunk of a run continues the file as it is on disk */
+  if (set->chunk_count == 0) {
+    struct stat fs;
+    set->file_offset = 0;
+    if (mode[0] == 'a' && stat(set->outfile_name, &fs) == 0)
+      set->file_offset = fs.st_size;
+  }
+
+  int journaled = (set->journal_set >= 0);
+  if (journaled)
+    fp = open_file(set->outfile_name, mode);
+  else
+    fp = output_writer_open(world->output_writer, set->outfile_name, mode);
+  if (fp == NULL)
+    return 1;
+  long chunk_start = ftell(fp);
+  double first_value = 0.0;
+
+  /*int idx = set->block->buf_index;*/
+  if (set->column_head->buffer[0].data_type != COUNT_TRIG_STRUCT) {
+    n_output = set->block->buffersize;
+    if (set->block->buf_index < set->block->buffersize)
+      n_output = set->block->buf_index;
+
+    if (world->notify->file_writes == NOTIFY_FULL)
+      mcell_log("Writing %d lines to output file %s.", n_output,
+                set->outfile_name);
+
+    int write_header = reaction_output_needs_header(world, set);
+    int err = write_count_rows(set, fp, n_output, write_header,
+                               world->shortest_floats);
+    if (set->binary_flag) {
+      set->chunk_count++;
+      if (err)
+        mcell_perror_nodie(errno, "Failed to write binary reaction data to "
+                           "'%s'", set->outfile_name);
+      if (journaled)
+        err = close_journaled_output(set, fp, err);
+      else if (output_writer_close(world->output_writer, fp))
+        err = 1;
+      return err;
     }
+    if (n_output > 0)
+      first_value = set->block->time_array[0];
+  } else if (set->binary_flag) {
+    n_output = (u_int)set->column_head->initial_value;
+    int write_header = reaction_output_needs_header(world, set);
+    int err = write_binary_trigger_output(set, fp, n_output, write_header);
+    set->chunk_count++;
+    if (err)
+      mcell_perror_nodie(errno, "Failed to write binary trigger data to '%s'",
+                         set->outfile_name);
+    if (output_writer_close(world->output_writer, fp))
+      err = 1;
+    return err;
   } else /* Write accumulated trigger data */
   {
     struct output_trigger_data *trig;
-    char event_time_string[1024]; /* Wouldn't run out of space even if we
-                                     printed out DBL_MAX in non-exponential
-                                     notation! */
+    struct text_writer *tw = CHECKED_MALLOC_STRUCT(struct text_writer,
+                                                   "trigger output buffer");
+    text_writer_init(tw, fp, world->shortest_floats);
 
     n_output = (u_int)set->column_head->initial_value;
+    if (n_output > 0)
+      first_value = set->column_head->buffer[0].val.tval->t_iteration;
     for (i = 0; i < n_output; i++) {
       trig = set->column_head->buffer[i].val.tval;
 
-      if (set->exact_time_flag)
-        sprintf(event_time_string, "%.12g ", trig->event_time);
-      else
-        strcpy(event_time_string, "");
-
-      if (trig->flags & TRIG_IS_RXN) /* Just need time, pos, name */
-      {
-        fprintf(fp, "%.15g %s%.9g %.9g %.9g %s\n",
-                trig->t_iteration,
-                event_time_string,
-                trig->loc.x,
-                trig->loc.y,
-                trig->loc.z,
-                (trig->name == NULL) ? "" : trig->name);
-      } else if (trig->flags & TRIG_IS_HIT) /* Need orientation also */
-      {
-        fprintf(fp, "%.15g %s%.9g %.9g %.9g %d %s\n",
-                trig->t_iteration,
-                event_time_string,
-                trig->loc.x,
-                trig->loc.y,
-                trig->loc.z,
-                trig->orient,
-                (trig->name == NULL) ? "" : trig->name);
-      } else /* Molecule count -- need both number and orientation */
-      {
-        fprintf(fp, "%.15g %s%.9g %.9g %.9g %d %d %s %lu\n",
-                trig->t_iteration,
-                event_time_string,
-                trig->loc.x,
-                trig->loc.y,
-                trig->loc.z,
-                trig->orient,
-                trig->how_many,
-                (trig->name == NULL) ? "" : trig->name,
-                trig->id);
+      /* "%.15g %.12g %.9g %.9g %.9g", the event time only if exact */
+      text_writer_double(tw, trig->t_iteration, 15);
+      text_writer_char(tw, ' ');
+      if (set->exact_time_flag) {
+        text_writer_double(tw, trig->event_time, 12);
+        text_writer_char(tw, ' ');
+      }
+      text_writer_double(tw, trig->loc.x, 9);
+      text_writer_char(tw, ' ');
+      text_writer_double(tw, trig->loc.y, 9);
+      text_writer_char(tw, ' ');
+      text_writer_double(tw, trig->loc.z, 9);
+      text_writer_char(tw, ' ');
+
+      /* Reactions just need the name, hits the orientation too and
+       * molecule counts also the number and the id */
+      if ((trig->flags & TRIG_IS_RXN) == 0) {
+        text_writer_long(tw, trig->orient);
+        text_writer_char(tw, ' ');
+        if ((trig->flags & TRIG_IS_HIT) == 0) {
+          text_writer_long(tw, trig->how_many);
+          text_writer_char(tw, ' ');
+        }
+      }
+      text_writer_string(tw, (trig->name == NULL) ? "" : trig->name);
+      if ((trig->flags & (TRIG_IS_RXN | TRIG_IS_HIT)) == 0) {
+        text_writer_char(tw, ' ');
+        text_writer_ulong(tw, trig->id);
       }
+      text_writer_char(tw, '\n');
     }
+    text_writer_flush(tw);
+    free(tw);
   }
 
+  int err = index_output_chunk(world, set, mode, first_value, n_output,
+                               ftell(fp) - chunk_start);
   set->chunk_count++;
 
-  fclose(fp);
-  return 0;
+  if (journaled)
+    err = close_journaled_output(set, fp, err);
+  else if (output_writer_close(world->output_writer, fp))
+    err = 1;
+  return err;
 }
 
 /*************************************************************************
@@ -1133,6 +2043,259 @@ void eval_oexpr_tree(struct output_expression *root, int skip_const) {
   }
 }
 
+/* Scratch state used while compiling an output block */
+struct oexpr_compiler {
+  struct oexpr_program *prog;
+  int *table;     /* Index into prog->ops of each distinct step, -1 if empty */
+  int table_mask; /* Table size minus one (size is a power of two) */
+};
+
+/*************************************************************************
+count_oexpr_nodes:
+   In: root of an output_expression tree
+   Out: number of expression nodes in the tree
+*************************************************************************/
+static int count_oexpr_nodes(struct output_expression *root) {
+  int n = 1;
+  if ((root->expr_flags & OEXPR_LEFT_MASK) == OEXPR_LEFT_OEXPR &&
+      root->left != NULL)
+    n += count_oexpr_nodes((struct output_expression *)root->left);
+  if ((root->expr_flags & OEXPR_RIGHT_MASK) == OEXPR_RIGHT_OEXPR &&
+      root->right != NULL)
+    n += count_oexpr_nodes((struct output_expression *)root->right);
+  return n;
+}
+
+/*************************************************************************
+add_oexpr_op:
+   In: compiler state
+       step to add (everything but the destination slot)
+   Out: slot holding the step's value.  An identical step added earlier
+        is reused rather than appended again.
+*************************************************************************/
+static int add_oexpr_op(struct oexpr_compiler *oc, struct oexpr_op *op) {
+  struct oexpr_program *prog = oc->prog;
+  unsigned long hash = (unsigned long)(uintptr_t)op->src;
+  hash = hash * 31 + (unsigned long)op->oper;
+  hash = hash * 31 + (unsigned long)op->src_type;
+  hash = hash * 31 + (unsigned long)op->left;
+  hash = hash * 31 + (unsigned long)op->right;
+  hash ^= hash >> 16;
+
+  int bin = (int)(hash & (unsigned long)oc->table_mask);
+  while (oc->table[bin] != -1) {
+    struct oexpr_op *old = &prog->ops[oc->table[bin]];
+    if (old->oper == op->oper && old->src_type == op->src_type &&
+        old->src == op->src && old->left == op->left &&
+        old->right == op->right)
+      return old->dst;
+    bin = (bin + 1) & oc->table_mask;
+  }
+
+  op->dst = prog->n_slots++;
+  oc->table[bin] = prog->n_ops;
+  prog->ops[prog->n_ops++] = *op;
+  return op->dst;
+}
+
+/*************************************************************************
+compile_oexpr_load:
+   In: compiler state
+       OEXPR_LEFT_INT or OEXPR_LEFT_DBL
+       value to read
+   Out: slot holding the value read, or the zero slot for NULL
+*************************************************************************/
+static int compile_oexpr_load(struct oexpr_compiler *oc, int src_type,
+                              void *src) {
+  if (src == NULL)
+    return 0;
+  struct oexpr_op op = { 0, src_type, src, 0, 0, 0 };
+  return add_oexpr_op(oc, &op);
+}
+
+/*************************************************************************
+compile_oexpr_tree:
+   In: compiler state
+       root of an output_expression tree
+   Out: slot which, after the program has run, holds the value that
+        eval_oexpr_tree(root, 1) would have stored in root->value
+*************************************************************************/
+static int compile_oexpr_tree(struct oexpr_compiler *oc,
+                              struct output_expression *root) {
+  if (root->expr_flags & OEXPR_TYPE_CONST)
+    return compile_oexpr_load(oc, OEXPR_LEFT_DBL, &root->value);
+
+  int left = 0;
+  int right = 0;
+  if (root->left != NULL) {
+    switch (root->expr_flags & OEXPR_LEFT_MASK) {
+    case OEXPR_LEFT_INT:
+      left = compile_oexpr_load(oc, OEXPR_LEFT_INT, root->left);
+      break;
+    case OEXPR_LEFT_DBL:
+      left = compile_oexpr_load(oc, OEXPR_LEFT_DBL, root->left);
+      break;
+    case OEXPR_LEFT_OEXPR:
+      left = compile_oexpr_tree(oc, (struct output_expression *)root->left);
+      break;
+    }
+  }
+  if (root->right != NULL) {
+    switch (root->expr_flags & OEXPR_RIGHT_MASK) {
+    case OEXPR_RIGHT_INT:
+      right = compile_oexpr_load(oc, OEXPR_LEFT_INT, root->right);
+      break;
+    case OEXPR_RIGHT_DBL:
+      right = compile_oexpr_load(oc, OEXPR_LEFT_DBL, root->right);
+      break;
+    case OEXPR_RIGHT_OEXPR:
+      right = compile_oexpr_tree(oc, (struct output_expression *)root->right);
+      break;
+    }
+  }
+
+  struct oexpr_op op = { root->oper, 0, NULL, left, right, 0 };
+  switch (root->oper) {
+  case '(':
+  case '#':
+  case '@':
+    if (root->right == NULL)
+      return left;
+    op.oper = '+';
+  /* Fall through */
+  case '+':
+  case '*':
+    /* Exact in either order, so share a+b with b+a */
+    if (left > right) {
+      op.left = right;
+      op.right = left;
+    }
+    break;
+  case '_':
+    op.right = 0;
+    break;
+  case '-':
+  case '/':
+    break;
+  default:
+    /* '=' and anything unknown keep whatever value the node already has */
+    return compile_oexpr_load(oc, OEXPR_LEFT_DBL, &root->value);
+  }
+  return add_oexpr_op(oc, &op);
+}
+
+/*************************************************************************
+compile_output_block:
+   In: an output block whose count requests have all been resolved
+   Out: no return value.  The non-trigger column expressions of the
+        block are flattened into block->program, with each distinct
+        leaf read and each distinct subexpression computed once per
+        update no matter how many columns use it.
+   Note: The trees must not change afterwards (e.g. by dynamic geometry
+         re-resolving count requests), or the program will be stale.
+*************************************************************************/
+void compile_output_block(struct output_block *block) {
+  int n_nodes = 0;
+  int n_roots = 0;
+  for (struct output_set *set = block->data_set_head; set != NULL;
+       set = set->next) {
+    for (struct output_column *column = set->column_head; column != NULL;
+         column = column->next) {
+      if (column->buffer[0].data_type == COUNT_TRIG_STRUCT)
+        continue;
+      n_nodes += count_oexpr_nodes(column->expr);
+      ++n_roots;
+    }
+  }
+  if (n_roots == 0)
+    return;
+
+  /* Each node adds at most one step of its own plus two leaf loads */
+  int max_ops = 3 * n_nodes;
+  struct oexpr_program *prog =
+      CHECKED_MALLOC_STRUCT(struct oexpr_program, "output expression program");
+  prog->n_ops = 0;
+  prog->ops = CHECKED_MALLOC_ARRAY(struct oexpr_op, max_ops,
+                                   "output expression program steps");
+  prog->n_slots = 1;
+  prog->slots = CHECKED_MALLOC_ARRAY(double, max_ops + 1,
+                                     "output expression program values");
+  prog->slots[0] = 0.0;
+  prog->n_roots = 0;
+  prog->roots = CHECKED_MALLOC_ARRAY(struct output_expression *, n_roots,
+                                     "output expression program columns");
+  prog->root_slots = CHECKED_MALLOC_ARRAY(int, n_roots,
+                                          "output expression program columns");
+
+  struct oexpr_compiler oc;
+  int table_size = 16;
+  while (table_size < 2 * max_ops)
+    table_size <<= 1;
+  oc.prog = prog;
+  oc.table_mask = table_size - 1;
+  oc.table = CHECKED_MALLOC_ARRAY(int, table_size,
+                                  "output expression compiler table");
+  for (int i = 0; i < table_size; ++i)
+    oc.table[i] = -1;
+
+  for (struct output_set *set = block->data_set_head; set != NULL;
+       set = set->next) {
+    for (struct output_column *column = set->column_head; column != NULL;
+         column = column->next) {
+      if (column->buffer[0].data_type == COUNT_TRIG_STRUCT)
+        continue;
+      prog->roots[prog->n_roots] = column->expr;
+      prog->root_slots[prog->n_roots] = compile_oexpr_tree(&oc, column->expr);
+      ++prog->n_roots;
+    }
+  }
+
+  free(oc.table);
+  block->program = prog;
+}
+
+/*************************************************************************
+run_oexpr_program:
+   In: a compiled output program
+   Out: no return value.  The value of every column expression in the
+        program is updated, exactly as eval_oexpr_tree would.
+*************************************************************************/
+static void run_oexpr_program(struct oexpr_program *prog) {
+  double *slots = prog->slots;
+  for (int i = 0; i < prog->n_ops; ++i) {
+    struct oexpr_op *op = &prog->ops[i];
+    double lval = slots[op->left];
+    double rval = slots[op->right];
+    switch (op->oper) {
+    case 0:
+      if (op->src_type == OEXPR_LEFT_INT)
+        slots[op->dst] = (double)*((int *)op->src);
+      else
+        slots[op->dst] = *((double *)op->src);
+      break;
+    case '_':
+      slots[op->dst] = -lval;
+      break;
+    case '+':
+      slots[op->dst] = lval + rval;
+      break;
+    case '-':
+      slots[op->dst] = lval - rval;
+      break;
+    case '*':
+      slots[op->dst] = lval * rval;
+      break;
+    case '/':
+      slots[op->dst] = (!distinguishable(rval, 0, EPS_C)) ? 0 : lval / rval;
+      break;
+    default:
+      UNHANDLED_CASE(op->oper);
+    }
+  }
+  for (int i = 0; i < prog->n_roots; ++i)
+    prog->roots[i]->value = slots[prog->root_slots[i]];
+}
+
 /*************************************************************************
 oexpr_flood_convert
    In: root of an expression tree
@@ -1261,3 +2424,180 @@ char *oexpr_title(struct output_expression *root) {
   }
   return NULL;
 }
+
+/* Events of traced reaction pathways, written by the simulation as the
+ * reactions occur and drained in batches through the API.  The buffer is a
+ * ring of a power-of-two size; events arriving while it is full are dropped
+ * (and counted) rather than stalling the simulation. */
+struct rxn_trace {
+  struct rxn_event *events;
+  unsigned long long mask;    /* capacity - 1 */
+  unsigned long long head;    /* events written so far */
+  unsigned long long tail;    /* events drained so far */
+  unsigned long long dropped; /* events lost to a full buffer */
+  int n_traced;               /* trace ids handed out so far */
+#ifndef _WIN32
+  /* A pyMCell thread may drain while the simulation runs without the GIL */
+  pthread_mutex_t lock;
+#endif
+};
+
+/*************************************************************************
+trace_rxn_pathname:
+  In: world: simulation state
+      rxpn: named reaction pathway to trace
+      capacity: events the buffer holds, used when the buffer is created
+  Out: the trace id of the pathway, or -1 on failure.  Tracing a pathway
+       again returns the id it already has.
+*************************************************************************/
+int trace_rxn_pathname(struct volume *world, struct rxn_pathname *rxpn,
+                       u_int capacity) {
+  for (struct magic_list *ml = rxpn->magic; ml != NULL; ml = ml->next) {
+    if (ml->type == magic_trace)
+      return (int)(intptr_t)ml->data;
+  }
+
+  struct rxn_trace *trace = world->rxn_trace;
+  if (trace == NULL) {
+    unsigned long long size = 1;
+    while (size < capacity)
+      size <<= 1;
+
+    trace = CHECKED_MALLOC_STRUCT_NODIE(struct rxn_trace, "reaction trace");
+    if (trace == NULL)
+      return -1;
+    trace->events = CHECKED_MALLOC_ARRAY_NODIE(struct rxn_event, size,
+                                               "reaction trace events");
+    if (trace->events == NULL) {
+      free(trace);
+      return -1;
+    }
+    trace->mask = size - 1;
+    trace->head = trace->tail = trace->dropped = 0;
+    trace->n_traced = 0;
+#ifndef _WIN32
+    pthread_mutex_init(&trace->lock, NULL);
+#endif
+    world->rxn_trace = trace;
+  }
+
+  struct magic_list *ml = (struct magic_list *)CHECKED_MEM_GET_NODIE(
+      world->magic_mem, "reaction trace descriptor");
+  if (ml == NULL)
+    return -1;
+  ml->type = magic_trace;
+  ml->data = (void *)(intptr_t)trace->n_traced;
+  ml->next = rxpn->magic;
+  rxpn->magic = ml;
+  return trace->n_traced++;
+}
+
+/*************************************************************************
+record_rxn_event:
+  In: world: simulation state
+      rxn_id: trace id of the pathway that fired
+      pos: location of the reaction, or NULL if it has none
+      t: time of the reaction, in iterations
+  Out: No return value.  The event is appended to the trace buffer, or
+       counted as dropped if the buffer is full.
+*************************************************************************/
+void record_rxn_event(struct volume *world, int rxn_id,
+                      struct vector3 const *pos, double t) {
+  struct rxn_trace *trace = world->rxn_trace;
+#ifndef _WIN32
+  pthread_mutex_lock(&trace->lock);
+#endif
+  if (trace->head - trace->tail > trace->mask) {
+    ++trace->dropped;
+  } else {
+    struct rxn_event *ev = &trace->events[trace->head & trace->mask];
+    ev->t = t;
+    if (pos != NULL)
+      ev->pos = *pos;
+    else
+      ev->pos.x = ev->pos.y = ev->pos.z = 0.0;
+    ev->rxn_id = rxn_id;
+    ++trace->head;
+  }
+#ifndef _WIN32
+  pthread_mutex_unlock(&trace->lock);
+#endif
+}
+
+/*************************************************************************
+drain_rxn_events:
+  In: world: simulation state
+      events: receives the oldest buffered events
+      max_events: room in events
+      dropped: if not NULL, receives the events dropped since the last
+               drain because the buffer was full
+  Out: the number of events copied.  Times are converted to seconds and
+       locations to microns, and the copied events leave the buffer.
+*************************************************************************/
+u_int drain_rxn_events(struct volume *world, struct rxn_event *events,
+                       u_int max_events, unsigned long long *dropped) {
+  struct rxn_trace *trace = world->rxn_trace;
+  if (dropped != NULL)
+    *dropped = 0;
+  if (trace == NULL)
+    return 0;
+
+#ifndef _WIN32
+  pthread_mutex_lock(&trace->lock);
+#endif
+  u_int n = 0;
+  for (; n < max_events && trace->tail != trace->head; ++n, ++trace->tail)
+    events[n] = trace->events[trace->tail & trace->mask];
+  if (dropped != NULL)
+    *dropped = trace->dropped;
+  trace->dropped = 0;
+#ifndef _WIN32
+  pthread_mutex_unlock(&trace->lock);
+#endif
+
+  for (u_int i = 0; i < n; ++i) {
+    events[i].t = convert_iterations_to_seconds(
+        world->start_iterations, world->time_unit,
+        world->simulation_start_seconds, events[i].t);
+    events[i].pos.x *= world->length_unit;
+    events[i].pos.y *= world->length_unit;
+    events[i].pos.z *= world->length_unit;
+  }
+  return n;
+}
+
+/*************************************************************************
+free_rxn_trace:
+  In: world: simulation state
+  Out: No return value.  Tracing stops: the trace descriptors are removed
+       from the named pathways and buffered events are discarded.
+*************************************************************************/
+void free_rxn_trace(struct volume *world) {
+  struct rxn_trace *trace = world->rxn_trace;
+  if (trace == NULL)
+    return;
+
+  for (int i = 0; i < world->rxpn_sym_table->n_bins; ++i) {
+    for (struct sym_entry *sym = world->rxpn_sym_table->entries[i];
+         sym != NULL; sym = sym->next) {
+      struct rxn_pathname *rxpn = (struct rxn_pathname *)sym->value;
+      struct magic_list **mlp = &rxpn->magic;
+      while (*mlp != NULL) {
+        if ((*mlp)->type == magic_trace) {
+          struct magic_list *dead = *mlp;
+          *mlp = dead->next;
+          mem_put(world->magic_mem, dead);
+        } else {
+          mlp = &(*mlp)->next;
+        }
+      }
+    }
+  }
+
+  world->rxn_trace = NULL;
+#ifndef _WIN32
+  pthread_mutex_destroy(&trace->lock);
+#endif
+  free(trace->events);
+  free(trace);
+}
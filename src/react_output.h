@@ -27,11 +27,24 @@
 
 /* Header file for reaction output routines */
 
-extern int emergency_output_hook_enabled;
+/* Binary reaction data format (see write_binary_reaction_output) */
+#define BINARY_OUTPUT_VERSION 1
+#define BINARY_COLUMN_INT 1 /* int64 values */
+#define BINARY_COLUMN_DBL 2 /* float64 values */
+
+/* Binary trigger data format (see write_binary_trigger_output) */
+#define BINARY_TRIGGER_VERSION 1
+
 
 void install_emergency_output_hooks(struct volume *world);
+void disable_emergency_output_hooks(void);
+
+/* Text reaction data written with FILE_SUBSTITUTE keeps a sidecar index
+ * named after the data file plus this suffix (see index_output_chunk) */
+#define OUTPUT_INDEX_SUFFIX ".idx"
 
 int truncate_output_file(char *name, double start_value);
+int truncate_output_set(struct output_set *set, double start_value);
 
 void add_trigger_output(struct volume *world, struct counter *c,
                         struct output_request *ear, int n, short flags,
@@ -41,8 +54,15 @@ int flush_reaction_output(struct volume *world);
 
 int check_reaction_output_file(struct output_set *os);
 
+struct output_buffer *new_count_buffer(struct output_column *oc, u_int n_rows);
+int size_output_buffers(struct volume *world);
+
 int update_reaction_output(struct volume *world, struct output_block *block);
 
+char const *reaction_output_mode(struct volume *world, struct output_set *set);
+int reaction_output_needs_header(struct volume *world, struct output_set *set);
+int write_count_rows(struct output_set *set, FILE *fp, u_int n_output,
+                     int write_header, int shortest_floats);
 int write_reaction_output(struct volume *world, struct output_set *set);
 
 struct output_expression *new_output_expr(struct mem_helper *oexpr_mem);
@@ -53,6 +73,15 @@ struct output_expression *dupl_oexpr_tree(struct output_expression *root,
 struct output_expression *first_oexpr_tree(struct output_expression *root);
 struct output_expression *next_oexpr_tree(struct output_expression *leaf);
 void eval_oexpr_tree(struct output_expression *root, int skip_const);
+void compile_output_block(struct output_block *block);
 void oexpr_flood_convert(struct output_expression *root, char old_oper,
                          char new_oper);
 char *oexpr_title(struct output_expression *root);
+
+int trace_rxn_pathname(struct volume *world, struct rxn_pathname *rxpn,
+                       u_int capacity);
+void record_rxn_event(struct volume *world, int rxn_id,
+                      struct vector3 const *pos, double t);
+u_int drain_rxn_events(struct volume *world, struct rxn_event *events,
+                       u_int max_events, unsigned long long *dropped);
+void free_rxn_trace(struct volume *world);
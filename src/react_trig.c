@@ -51,6 +51,10 @@ trigger_unimolecular:
 *************************************************************************/
 struct rxn *trigger_unimolecular(struct rxn **reaction_hash, int rx_hashsize,
                                  u_int hash, struct abstract_molecule *reac) {
+  /* looked up once per species at init */
+  if (reac->properties->unimol_rx_known && hash == reac->properties->hashval)
+    return reac->properties->unimol_rx;
+
   struct rxn *inter = reaction_hash[hash & (rx_hashsize - 1)];
 
   while (inter != NULL) {
@@ -93,6 +97,19 @@ int trigger_surface_unimol(struct rxn **reaction_hash, int rx_hashsize,
   return num_matching_rxns;
 }
 
+/* 0 if the partner Bloom filter rules out any bimolecular reaction between
+ * the two species, 1 if there may be one */
+static inline int may_be_rx_partners(struct species *reacA,
+                                     struct species *reacB) {
+  struct bit_array *bloom = reacA->rx_partner_bloom;
+  for (int k = 0; k < RX_PARTNER_BLOOM_HASHES; k++) {
+    if (!get_bit(bloom, rx_partner_bloom_bit(bloom, reacA->species_id,
+                                             reacB->species_id, k)))
+      return 0;
+  }
+  return 1;
+}
+
 /*************************************************************************
 trigger_bimolecular_preliminary:
    In: hashA - hash value for first molecule
@@ -102,12 +119,21 @@ trigger_bimolecular_preliminary:
    Out: 1 if any reaction exists naming the two specified reactants, 0
        otherwise.
    Note: This is a quick test used to determine which per-species lists to
-   traverse when checking for mol-mol collisions.
+   traverse when checking for mol-mol collisions.  Once the reaction
+   partner bits or Bloom filter are set up (see init_reaction_partners) the
+   answer takes a few bit tests; the Bloom filter may answer 1 for a pair
+   without reactions.
 *************************************************************************/
 int trigger_bimolecular_preliminary(struct rxn **reaction_hash, int rx_hashsize,
                                     u_int hashA, u_int hashB,
                                     struct species *reacA,
                                     struct species *reacB) {
+  if (reacA->rx_partners != NULL)
+    return get_bit(reacA->rx_partners, reacB->species_id);
+  /* a false positive only costs trigger_bimolecular a chain walk */
+  if (reacA->rx_partner_bloom != NULL)
+    return may_be_rx_partners(reacA, reacB);
+
   u_int hash = (hashA + hashB) & (rx_hashsize - 1);
   for (struct rxn *inter = reaction_hash[hash]; inter != NULL; inter = inter->next) {
     /* Enough reactants? (3=>wall also) */
@@ -256,7 +282,18 @@ int trigger_bimolecular(struct rxn **reaction_hash, int rx_hashsize,
   /*struct surf_class_list *scl, *scl2;*/
 
   // reactions between reacA and reacB only happen if both are in the same periodic box
-  if (!periodic_boxes_are_identical(reacA->periodic_box, reacB->periodic_box)) {
+  if (!periodic_images_equal(&reacA->periodic_box, &reacB->periodic_box)) {
+    return 0;
+  }
+
+  /* pairs without any bimolecular reaction between them are rejected
+     without touching the hash chain */
+  struct bit_array *partners = reacA->properties->rx_partners;
+  if (partners != NULL && !get_bit(partners, reacB->properties->species_id)) {
+    return 0;
+  }
+  if (reacA->properties->rx_partner_bloom != NULL &&
+      !may_be_rx_partners(reacA->properties, reacB->properties)) {
     return 0;
   }
 
@@ -417,8 +454,8 @@ int trigger_bimolecular(struct rxn **reaction_hash, int rx_hashsize,
   }   /* end for (inter = reaction_hash[hash]; ...) */
 
   if (num_matching_rxns > MAX_MATCHING_RXNS) {
-    mcell_warn("Number of matching reactions exceeds the maximum allowed "
-               "number MAX_MATCHING_RXNS.");
+    mcell_warn_limited("Number of matching reactions exceeds the maximum "
+                       "allowed number MAX_MATCHING_RXNS.");
   }
 
   return num_matching_rxns;
@@ -649,8 +686,130 @@ int trigger_trimolecular(struct rxn **reaction_hash, int rx_hashsize,
   }
 
   if (num_matching_rxns > MAX_MATCHING_RXNS) {
-    mcell_warn("Number of matching reactions exceeds the maximum allowed "
-               "number MAX_MATCHING_RXNS.");
+    mcell_warn_limited("Number of matching reactions exceeds the maximum "
+                       "allowed number MAX_MATCHING_RXNS.");
+  }
+
+  return num_matching_rxns;
+}
+
+/* Surface class reactions of one kind of molecule hitting a wall */
+struct wall_rx_cache_entry {
+  u_int key;          /* see wall_rx_cache_key */
+  int n_rxns;         /* -1 for an empty slot */
+  struct rxn **rxns;
+  signed char border_edges; /* see wall_rx_cache_border_edges */
+};
+
+struct wall_rx_cache {
+  int n_entries;
+  int capacity;       /* power of two */
+  struct wall_rx_cache_entry *entries;
+};
+
+/* The reactions found for a wall depend on the species, the sign of its
+ * orientation and which special reactions are allowed */
+static u_int wall_rx_cache_key(struct species *spec, short orient,
+                               int allow_rx_transp, int allow_rx_reflec,
+                               int allow_rx_absorb_reg_border) {
+  u_int orient_class = (orient > 0) ? 2 : ((orient < 0) ? 1 : 0);
+  return (spec->species_id << 5) | (orient_class << 3) |
+         ((allow_rx_transp != 0) << 2) | ((allow_rx_reflec != 0) << 1) |
+         (allow_rx_absorb_reg_border != 0);
+}
+
+static struct wall_rx_cache_entry *
+wall_rx_cache_slot(struct wall_rx_cache *cache, u_int key) {
+  u_int mask = (u_int)cache->capacity - 1;
+  u_int i = (key * 2654435761u) & mask;
+  while (cache->entries[i].n_rxns >= 0 && cache->entries[i].key != key)
+    i = (i + 1) & mask;
+  return &cache->entries[i];
+}
+
+static void grow_wall_rx_cache(struct wall_rx_cache *cache) {
+  struct wall_rx_cache_entry *old = cache->entries;
+  int old_capacity = cache->capacity;
+
+  cache->capacity = (old_capacity == 0) ? 8 : 2 * old_capacity;
+  cache->entries = CHECKED_MALLOC_ARRAY(struct wall_rx_cache_entry,
+                                        cache->capacity,
+                                        "wall reaction cache");
+  for (int i = 0; i < cache->capacity; i++)
+    cache->entries[i].n_rxns = -1;
+  for (int i = 0; i < old_capacity; i++) {
+    if (old[i].n_rxns >= 0)
+      *wall_rx_cache_slot(cache, old[i].key) = old[i];
+  }
+  free(old);
+}
+
+/*************************************************************************
+free_wall_rx_cache:
+   In: w: a wall
+   Out: No return value.  The surface class reactions looked up on the wall
+        are forgotten; this must be done whenever its surface classes
+        change.
+*************************************************************************/
+void free_wall_rx_cache(struct wall *w) {
+  struct wall_rx_cache *cache = w->rx_cache;
+  if (cache == NULL)
+    return;
+
+  for (int i = 0; i < cache->capacity; i++)
+    free(cache->entries[i].rxns);
+  free(cache->entries);
+  free(cache);
+  w->rx_cache = NULL;
+}
+
+/*************************************************************************
+wall_rx_cache_border_edges:
+   In: w: a wall
+       spec: species of a surface molecule
+       orient: orientation of the molecule
+   Out: the bit mask of the wall's edges that border regions restrictive
+        to the molecule, kept with the reactions trigger_intersect found
+        for it with all special reactions allowed; -1 if not known yet.
+        NULL if trigger_intersect has not looked those reactions up.
+*************************************************************************/
+signed char *wall_rx_cache_border_edges(struct wall *w, struct species *spec,
+                                        short orient) {
+  struct wall_rx_cache *cache = w->rx_cache;
+  if (cache == NULL)
+    return NULL;
+
+  struct wall_rx_cache_entry *entry =
+      wall_rx_cache_slot(cache, wall_rx_cache_key(spec, orient, 1, 1, 1));
+  if (entry->n_rxns < 0)
+    return NULL;
+  return &entry->border_edges;
+}
+
+/* The hash chain walk behind trigger_intersect */
+static int find_intersect_reactions(
+    struct rxn **reaction_hash, int rx_hashsize, struct species *all_mols,
+    struct species *all_volume_mols, struct species *all_surface_mols,
+    u_int hashA, struct abstract_molecule *reacA, short orientA,
+    struct wall *w, struct rxn **matching_rxns, int allow_rx_transp,
+    int allow_rx_reflec, int allow_rx_absorb_reg_border) {
+  int num_matching_rxns = find_unimol_reactions_with_surf_classes(
+      reaction_hash, rx_hashsize, reacA, w, hashA, orientA, 0,
+      allow_rx_transp, allow_rx_reflec, allow_rx_absorb_reg_border,
+      matching_rxns);
+
+  for (struct surf_class_list *scl = w->surf_class_head; scl != NULL; scl = scl->next) {
+    if ((reacA->properties->flags & NOT_FREE) == 0) {
+      num_matching_rxns = find_volume_mol_reactions_with_surf_classes(
+          reaction_hash, rx_hashsize, all_mols, all_volume_mols, orientA,
+          scl->surf_class, num_matching_rxns, allow_rx_transp, allow_rx_reflec,
+          matching_rxns);
+    } else if ((reacA->properties->flags & ON_GRID) != 0) {
+      num_matching_rxns = find_surface_mol_reactions_with_surf_classes(
+          reaction_hash, rx_hashsize, all_mols, all_surface_mols, orientA,
+          scl->surf_class, num_matching_rxns, allow_rx_transp, allow_rx_reflec,
+          allow_rx_absorb_reg_border, matching_rxns);
+    }
   }
 
   return num_matching_rxns;
@@ -669,7 +828,9 @@ trigger_intersect:
         molecule/wall intersection, or for this mol/generic wall,
         or this wall/generic mol.  All matching reactions are placed in
         the array "matching_rxns" in the first "number" slots.
-   Note: Moving molecule may be inert.
+   Note: Moving molecule may be inert.  The answer only depends on the
+        species and orientation of the molecule and the surface classes of
+        the wall, so it is looked up once and kept in the wall's rx_cache.
 
 *************************************************************************/
 int trigger_intersect(struct rxn **reaction_hash, int rx_hashsize,
@@ -679,28 +840,48 @@ int trigger_intersect(struct rxn **reaction_hash, int rx_hashsize,
                       struct wall *w, struct rxn **matching_rxns,
                       int allow_rx_transp, int allow_rx_reflec,
                       int allow_rx_absorb_reg_border) {
-  int num_matching_rxns = 0; /* number of matching rxns */
+  if (w->surf_class_head == NULL)
+    return 0;
 
-  if (w->surf_class_head != NULL) {
-    num_matching_rxns = find_unimol_reactions_with_surf_classes(
-        reaction_hash, rx_hashsize, reacA, w, hashA, orientA, num_matching_rxns,
-        allow_rx_transp, allow_rx_reflec, allow_rx_absorb_reg_border,
-        matching_rxns);
+  struct wall_rx_cache *cache = w->rx_cache;
+  if (cache == NULL) {
+    cache = CHECKED_MALLOC_STRUCT(struct wall_rx_cache, "wall reaction cache");
+    cache->n_entries = 0;
+    cache->capacity = 0;
+    cache->entries = NULL;
+    grow_wall_rx_cache(cache);
+    w->rx_cache = cache;
   }
 
-  for (struct surf_class_list *scl = w->surf_class_head; scl != NULL; scl = scl->next) {
-    if ((reacA->properties->flags & NOT_FREE) == 0) {
-      num_matching_rxns = find_volume_mol_reactions_with_surf_classes(
-          reaction_hash, rx_hashsize, all_mols, all_volume_mols, orientA,
-          scl->surf_class, num_matching_rxns, allow_rx_transp, allow_rx_reflec,
-          matching_rxns);
-    } else if ((reacA->properties->flags & ON_GRID) != 0) {
-      num_matching_rxns = find_surface_mol_reactions_with_surf_classes(
-          reaction_hash, rx_hashsize, all_mols, all_surface_mols, orientA,
-          scl->surf_class, num_matching_rxns, allow_rx_transp, allow_rx_reflec,
-          allow_rx_absorb_reg_border, matching_rxns);
-    }
+  u_int key = wall_rx_cache_key(reacA->properties, orientA, allow_rx_transp,
+                                allow_rx_reflec, allow_rx_absorb_reg_border);
+  struct wall_rx_cache_entry *entry = wall_rx_cache_slot(cache, key);
+  if (entry->n_rxns >= 0) {
+    if (entry->n_rxns > 0)
+      memcpy(matching_rxns, entry->rxns, entry->n_rxns * sizeof(struct rxn *));
+    return entry->n_rxns;
+  }
+
+  int num_matching_rxns = find_intersect_reactions(
+      reaction_hash, rx_hashsize, all_mols, all_volume_mols, all_surface_mols,
+      hashA, reacA, orientA, w, matching_rxns, allow_rx_transp,
+      allow_rx_reflec, allow_rx_absorb_reg_border);
+
+  if (4 * (cache->n_entries + 1) > 3 * cache->capacity) {
+    grow_wall_rx_cache(cache);
+    entry = wall_rx_cache_slot(cache, key);
+  }
+  entry->key = key;
+  entry->n_rxns = num_matching_rxns;
+  entry->rxns = NULL;
+  entry->border_edges = -1;
+  if (num_matching_rxns > 0) {
+    entry->rxns = CHECKED_MALLOC_ARRAY(struct rxn *, num_matching_rxns,
+                                       "wall reaction cache");
+    memcpy(entry->rxns, matching_rxns,
+           num_matching_rxns * sizeof(struct rxn *));
   }
+  cache->n_entries++;
 
   return num_matching_rxns;
 }
@@ -1006,7 +1187,8 @@ int find_surface_mol_reactions_with_surf_classes(
  * compute_lifetime
  *
  * Determine time of next unimolecular reaction; may need to check before the
- * next rate change for time dependent rates.
+ * next rate change for time dependent rates.  The molecule is stamped with
+ * the lifetime epoch of its species, see lifetime_is_stale.
  *
  * In: state: system state
  *     am: pointer to abstract molecule to be tested for unimolecular reaction
@@ -1015,9 +1197,11 @@ int find_surface_mol_reactions_with_surf_classes(
 void compute_lifetime(struct volume *state,
                       struct rxn *r,
                       struct abstract_molecule *am) {
+  am->lifetime_epoch = am->properties->lifetime_epoch;
   if (r != NULL) {
     double tt = FOREVER;
 
+    am->flags &= ~ACT_NO_UNIMOL;
     am->t2 = timeof_unimolecular(r, am, state->rng);
     if (r->prob_t != NULL) {
       tt = r->prob_t->time;
@@ -1028,6 +1212,7 @@ void compute_lifetime(struct volume *state,
       am->flags |= ACT_CHANGE;
     }
   } else {
+    am->flags |= ACT_NO_UNIMOL;
     am->t2 = FOREVER;
   }
 }
@@ -1051,6 +1236,7 @@ int check_for_unimolecular_reaction(struct volume *state,
   struct rxn *r = NULL;
   if ((am->flags & (ACT_NEWBIE + ACT_CHANGE)) != 0) {
     am->flags -= (am->flags & (ACT_NEWBIE + ACT_CHANGE));
+    am->lifetime_epoch = am->properties->lifetime_epoch;
     if ((am->flags & ACT_REACT) != 0) {
 
       r = pick_unimolecular_reaction(state, am);
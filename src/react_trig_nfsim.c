@@ -3,6 +3,7 @@
 //#include "hashmap.h"
 #include "map_c.h"
 #include "logging.h"
+#include "mcell_reactions.h"
 #include "mcell_structs.h"
 #include "nfsim_func.h"
 #include "react.h"
@@ -13,13 +14,279 @@
 #include <string.h>
 //#include "lru.h"
 
-map_t reaction_map = NULL;
-map_t reaction_preliminary_map = NULL;
+/*
+ * Reaction caches.  Pair maps are keyed on the ordered pair of graph pattern
+ * hashes, so unlike a sum of hashes two different pairs never share an
+ * entry, and unimolecular lookups keep to a map of their own.
+ *
+ * Every map value is a cache entry, also listed in cache_entries so that
+ * trim_nfsim_reaction_caches can evict by the clock algorithm: the hand
+ * gives an entry used since its last visit a second chance and evicts the
+ * others.  The rxns in the caches are handed out to collision lists, so
+ * entries are only evicted between iterations.
+ */
+struct nfsim_cache_entry {
+  map_t map;
+  unsigned long key;
+  unsigned long key2;
+  struct rxn *rx;  /* cached reaction, or NULL if there is none */
+  bool can_react;  /* preliminary map: whether the pair can react */
+  bool referenced; /* used since the clock hand last passed */
+  size_t bytes;    /* memory accounted to this entry */
+};
+
+/*
+ * Batched unimolecular queries.  A graph pattern that enters the system is
+ * soon asked for its unimolecular reactions, so new patterns are queued
+ * instead.  The first of them that is needed sends a single query naming
+ * every queued pattern, and the others pick their reactions out of its
+ * results as they are needed.  Batches only live for one iteration.
+ */
+struct nfsim_query_batch {
+  void *results;
+  int n_unclaimed; /* pending queries that still point at this batch */
+};
+
+struct nfsim_pending_query {
+  struct graph_data *graph; /* referenced until claimed or dropped */
+  struct nfsim_query_batch *batch; /* NULL while queued */
+  void *head_complex; /* this pattern's reactions in the batch results */
+};
+
+/* The caches and pending queries of one world */
+struct nfsim_reaction_state {
+  map_t reaction_map;
+  map_t reaction_preliminary_map;
+  map_t unimolecular_reaction_map;
+
+  struct nfsim_cache_entry **cache_entries;
+  size_t n_cache_entries;
+  size_t max_cache_entries;
+  size_t cache_hand;
+  struct nfsim_cache_stats cache_stats;
+
+  map_t pending_unimolecular_map;
+  struct nfsim_pending_query **queued_queries;
+  int n_queued_queries;
+  int max_queued_queries;
+  struct nfsim_pending_query **resolved_queries;
+  int n_resolved_queries;
+  int max_resolved_queries;
+
+  long rxnfound;
+  long rxnmissed;
+};
+
+/* The world's state, created the first time it is needed */
+static struct nfsim_reaction_state *reaction_state(struct volume *world) {
+  if (world->nfsim_reactions == NULL) {
+    world->nfsim_reactions = CHECKED_MALLOC_STRUCT(
+        struct nfsim_reaction_state, "NFSim reaction caches");
+    memset(world->nfsim_reactions, 0, sizeof(struct nfsim_reaction_state));
+  }
+  return world->nfsim_reactions;
+}
+
+/* The memory held by an NFSim rxn.  Paths fill in their products as they
+ * fire, so this grows over the life of the rxn. */
+static size_t nfsim_rxn_bytes(struct rxn *rx) {
+  if (rx == NULL)
+    return 0;
+
+  size_t n_paths = (rx->n_pathways > 0) ? (size_t)rx->n_pathways : 0;
+  size_t bytes = sizeof(struct rxn);
+  bytes += n_paths * (sizeof(double) + sizeof(u_int) + sizeof(int) +
+                      sizeof(struct external_reaction_datastruct) +
+                      sizeof(struct pathway_info) +
+                      sizeof(struct graph_data **) + sizeof(struct species **) +
+                      sizeof(short *));
+  bytes += rx->n_reactants * (sizeof(struct graph_data *) +
+                              sizeof(struct species *) + sizeof(short));
+  for (size_t path = 0; path < n_paths; path++) {
+    if (rx->external_reaction_data[path].reaction_name != NULL)
+      bytes += strlen(rx->external_reaction_data[path].reaction_name) + 1;
+    if (rx->product_idx_aux[path] > 0)
+      bytes += (size_t)rx->product_idx_aux[path] *
+               (2 * sizeof(struct species *) + 2 * sizeof(short) +
+                sizeof(struct graph_data *));
+  }
+  return bytes;
+}
+
+static size_t cache_entry_bytes(struct nfsim_cache_entry *entry) {
+  return sizeof(struct nfsim_cache_entry) +
+         2 * sizeof(struct nfsim_cache_entry *) + nfsim_rxn_bytes(entry->rx);
+}
+
+/* Free an rxn built by initializeNFSimReaction, with its references to
+ * the graph patterns of its reactants and products. */
+static void free_nfsim_reaction(struct rxn *rx) {
+  if (rx == NULL)
+    return;
+
+  for (int path = 0; path < rx->n_pathways; path++) {
+    free(rx->external_reaction_data[path].reaction_name);
+    if (rx->product_idx_aux[path] != -1)
+      free_reaction_nfsim(rx, path);
+  }
+  free(rx->cum_probs);
+  free(rx->external_reaction_data);
+  free(rx->product_idx);
+  free(rx->product_idx_aux);
+  if (rx->reactant_graph_data != NULL) {
+    for (u_int i = 0; i < rx->n_reactants; i++)
+      release_graph_data(rx->reactant_graph_data[i]);
+  }
+  free(rx->reactant_graph_data);
+  free(rx->product_graph_data);
+  free(rx->nfsim_players);
+  free(rx->nfsim_geometries);
+  free(rx->players);
+  free(rx->geometries);
+  free(rx->pathway_guide);
+  free(rx->info);
+  free(rx);
+}
+
+/* Look up a cached entry, counting the hit or miss */
+static struct nfsim_cache_entry *cache_lookup(struct nfsim_reaction_state *rs,
+                                              map_t map, unsigned long key,
+                                              unsigned long key2) {
+  struct nfsim_cache_entry *entry = NULL;
+  if (hashmap_get_pair(map, key, key2, (void **)&entry) != MAP_OK) {
+    rs->cache_stats.misses++;
+    return NULL;
+  }
+  rs->cache_stats.hits++;
+  entry->referenced = true;
+  return entry;
+}
+
+static void cache_store(struct nfsim_reaction_state *rs, map_t map,
+                        unsigned long key, unsigned long key2, struct rxn *rx,
+                        bool can_react) {
+  if (rs->n_cache_entries == rs->max_cache_entries) {
+    size_t new_max =
+        (rs->max_cache_entries == 0) ? 1024 : 2 * rs->max_cache_entries;
+    struct nfsim_cache_entry **new_entries =
+        (struct nfsim_cache_entry **)realloc(
+            rs->cache_entries, new_max * sizeof(struct nfsim_cache_entry *));
+    if (new_entries == NULL)
+      mcell_allocfailed("Failed to grow the NFSim reaction cache.");
+    rs->cache_entries = new_entries;
+    rs->max_cache_entries = new_max;
+  }
+
+  struct nfsim_cache_entry *entry =
+      CHECKED_MALLOC_STRUCT(struct nfsim_cache_entry, "NFSim cache entry");
+  entry->map = map;
+  entry->key = key;
+  entry->key2 = key2;
+  entry->rx = rx;
+  entry->can_react = can_react;
+  entry->referenced = true;
+  entry->bytes = cache_entry_bytes(entry);
+  if (hashmap_put_pair(map, key, key2, entry) != MAP_OK)
+    mcell_allocfailed("Failed to store an NFSim reaction.");
+
+  rs->cache_entries[rs->n_cache_entries++] = entry;
+  rs->cache_stats.bytes += entry->bytes;
+}
+
+/* Drop the entry under the clock hand; the last entry takes its place */
+static void cache_evict_at_hand(struct nfsim_reaction_state *rs) {
+  struct nfsim_cache_entry *entry = rs->cache_entries[rs->cache_hand];
+  hashmap_remove_pair(entry->map, entry->key, entry->key2);
+  rs->cache_stats.bytes -= entry->bytes;
+  free_nfsim_reaction(entry->rx);
+  free(entry);
+  rs->cache_entries[rs->cache_hand] = rs->cache_entries[--rs->n_cache_entries];
+}
+
+static void drop_cache_entries(struct nfsim_reaction_state *rs) {
+  for (size_t i = 0; i < rs->n_cache_entries; i++) {
+    free_nfsim_reaction(rs->cache_entries[i]->rx);
+    free(rs->cache_entries[i]);
+  }
+  rs->n_cache_entries = 0;
+  rs->cache_hand = 0;
+  rs->cache_stats.bytes = 0;
+}
+
+void clear_maps(struct volume *world) {
+  struct nfsim_reaction_state *rs = reaction_state(world);
+  end_nfsim_query_batches(world);
+  drop_cache_entries(rs);
+  hashmap_clear(rs->reaction_map);
+  hashmap_clear(rs->reaction_preliminary_map);
+  hashmap_clear(rs->unimolecular_reaction_map);
+}
+
+void free_nfsim_reaction_maps(struct volume *world) {
+  struct nfsim_reaction_state *rs = world->nfsim_reactions;
+  if (rs == NULL)
+    return;
+
+  end_nfsim_query_batches(world);
+  hashmap_free(rs->pending_unimolecular_map);
+  free(rs->queued_queries);
+  free(rs->resolved_queries);
+  drop_cache_entries(rs);
+  free(rs->cache_entries);
+  hashmap_free(rs->reaction_map);
+  hashmap_free(rs->reaction_preliminary_map);
+  hashmap_free(rs->unimolecular_reaction_map);
+  free(rs);
+  world->nfsim_reactions = NULL;
+}
+
+/*************************************************************************
+trim_nfsim_reaction_caches:
+  In: world: simulation state
+      budget: bytes the reaction caches may hold
+  Out: No return value.  If the caches hold more than budget, entries are
+       evicted until they are 1/8 below it, so that the next few misses do
+       not trigger another sweep.  Only call this between iterations.
+*************************************************************************/
+void trim_nfsim_reaction_caches(struct volume *world, size_t budget) {
+  struct nfsim_reaction_state *rs = reaction_state(world);
+  if (rs->cache_stats.bytes <= budget)
+    return;
+
+  size_t target = budget - budget / 8;
+  while (rs->n_cache_entries > 0 && rs->cache_stats.bytes > target) {
+    if (rs->cache_hand >= rs->n_cache_entries)
+      rs->cache_hand = 0;
+    struct nfsim_cache_entry *entry = rs->cache_entries[rs->cache_hand];
+
+    // products fill in as paths fire, so bring the accounting up to date
+    size_t bytes = cache_entry_bytes(entry);
+    rs->cache_stats.bytes = rs->cache_stats.bytes - entry->bytes + bytes;
+    entry->bytes = bytes;
+
+    if (entry->referenced) {
+      entry->referenced = false;
+      rs->cache_hand++;
+      continue;
+    }
+    cache_evict_at_hand(rs);
+    rs->cache_stats.evictions++;
+  }
+}
 
+void get_nfsim_reaction_cache_stats(struct volume *world,
+                                    struct nfsim_cache_stats *stats) {
+  *stats = reaction_state(world)->cache_stats;
+}
 
-void clear_maps() {
-  hashmap_clear(reaction_map);
-  hashmap_clear(reaction_preliminary_map);
+void get_nfsim_reaction_map_stats(struct volume *world,
+                                  struct hashmap_stats *unimolecular,
+                                  struct hashmap_stats *reactions,
+                                  struct hashmap_stats *preliminary) {
+  struct nfsim_reaction_state *rs = reaction_state(world);
+  hashmap_get_stats(rs->unimolecular_reaction_map, unimolecular);
+  hashmap_get_stats(rs->reaction_map, reactions);
+  hashmap_get_stats(rs->reaction_preliminary_map, preliminary);
 }
 
 // struct rxn *rx;
@@ -122,35 +389,40 @@ initializeNFSimQueryForUnimolecularReactions(struct abstract_molecule *am) {
    traverse when checking for mol-mol collisions.
 *************************************************************************/
 
-long rxnfound = 0;
-long rxnmissed = 0;
 
 
-int trigger_bimolecular_preliminary_nfsim(struct abstract_molecule *reacA,
+int trigger_bimolecular_preliminary_nfsim(struct volume *world,
+                                          struct abstract_molecule *reacA,
                                           struct abstract_molecule *reacB) {
-
-  if (reaction_preliminary_map == NULL)
-    reaction_preliminary_map = hashmap_new();
-
-  bool *isValidReaction = NULL;
-  unsigned long reactionHash = reacA->graph_data->graph_pattern_hash +
-                               reacB->graph_data->graph_pattern_hash;
-  int error = hashmap_get_nohash(reaction_preliminary_map, reactionHash,
-                                 reactionHash, (void **)(&isValidReaction));
+  struct nfsim_reaction_state *rs = reaction_state(world);
+
+  if (rs->reaction_preliminary_map == NULL)
+    rs->reaction_preliminary_map = hashmap_new();
+
+  // whether a pair can react does not depend on the order of the reactants
+  unsigned long idA = reacA->graph_data->pattern_id;
+  unsigned long idB = reacB->graph_data->pattern_id;
+  if (idA > idB) {
+    unsigned long tmp = idA;
+    idA = idB;
+    idB = tmp;
+  }
+  struct nfsim_cache_entry *entry =
+      cache_lookup(rs, rs->reaction_preliminary_map, idA, idB);
   // error = find_in_cache(reaction_key, rx);
 
   // XXX: it might be worth it to return the rx object since we already queried
   // it
-  if (error == MAP_OK) {
-    if (isValidReaction != NULL)
+  if (entry != NULL) {
+    if (entry->can_react)
       return 1;
 
-    rxnfound++;
+    rs->rxnfound++;
 
     return 0;
   }
 
-  rxnmissed++;
+  rs->rxnmissed++;
 
   queryOptions options = initializeNFSimQueryForBimolecularReactions(
       reacA->graph_data, reacB->graph_data, "1");
@@ -161,18 +433,13 @@ int trigger_bimolecular_preliminary_nfsim(struct abstract_molecule *reacA,
   // yet. bummer.
 
   if (mapvectormap_size(results) > 0) {
-    isValidReaction = CHECKED_MALLOC_ARRAY(bool, 1, "this is a valid reaction");
-    *isValidReaction = true;
     mapvectormap_delete(results);
-
-    error = hashmap_put_nohash(reaction_preliminary_map, reactionHash,
-                               reactionHash, isValidReaction);
+    cache_store(rs, rs->reaction_preliminary_map, idA, idB, NULL, true);
     return 1;
   } else {
     // if we know there's no reactions there's no need to check again later
     mapvectormap_delete(results);
-    error = hashmap_put_nohash(reaction_preliminary_map, reactionHash,
-                               reactionHash, NULL);
+    cache_store(rs, rs->reaction_preliminary_map, idA, idB, NULL, false);
     return 0;
   }
 }
@@ -185,17 +452,19 @@ int trigger_bimolecular_nfsim(struct volume *state,
                               struct abstract_molecule *reacB, short orientA,
                               short orientB, struct rxn **matching_rxns) {
 
-  int error;
+  struct nfsim_reaction_state *rs = reaction_state(state);
   int num_matching_rxns = 0;
 
-  if (reaction_map == NULL)
-    reaction_map = hashmap_new();
+  if (rs->reaction_map == NULL)
+    rs->reaction_map = hashmap_new();
 
   // memset(&reaction_key[0], 0, sizeof(reaction_key));
   struct rxn *rx = NULL;
 
-  unsigned long reactionHash = reacA->graph_data->graph_pattern_hash +
-                               reacB->graph_data->graph_pattern_hash;
+  // the cached rxn has its players and geometries in the order of the
+  // reactants it was built for, so the key is the ordered pair
+  unsigned long idA = reacA->graph_data->pattern_id;
+  unsigned long idB = reacB->graph_data->pattern_id;
   // sprintf(reaction_key,"%lu",reacA->graph_pattern_hash +
   // reacB->graph_pattern_hash);
   // mcell_log("reaction_key %s %s %s",reacA->graph_pattern,
@@ -206,13 +475,14 @@ int trigger_bimolecular_nfsim(struct volume *state,
   // else
   //    sprintf(reaction_key,"%s-%s",reacB->graph_pattern,reacA->graph_pattern);
 
-  error = hashmap_get_nohash(reaction_map, reactionHash, reactionHash,
-                             (void **)(&rx));
+  struct nfsim_cache_entry *entry =
+      cache_lookup(rs, rs->reaction_map, idA, idB);
   // error = find_in_cache(reaction_key, rx);
 
-  if (error == MAP_OK) {
+  if (entry != NULL) {
     // if(error != -1){
 
+    rx = entry->rx;
     if (rx != NULL) {
       int result = process_bimolecular(reacA, reacB, rx, orientA, orientB,
                                        matching_rxns, num_matching_rxns);
@@ -248,7 +518,7 @@ int trigger_bimolecular_nfsim(struct volume *state,
   }
   // store value in hashmap
 
-  error = hashmap_put_nohash(reaction_map, reactionHash, reactionHash, rx);
+  cache_store(rs, rs->reaction_map, idA, idB, rx, rx != NULL);
   // add_to_cache(reaction_key, rx);
 
   // CLEANUP
@@ -297,17 +567,12 @@ int adjust_rates_nfsim(struct volume *state, struct rxn *rx, bool is_surface) {
     return 1;*/
 }
 
-int initializeNFSimReaction(struct volume *state, struct rxn *r,
-                            int n_reactants, void *results,
-                            struct abstract_molecule *reacA,
-                            struct abstract_molecule *reacB) {
-
-  char **resultKeys = mapvectormap_getKeys(results);
-  void *headComplex = mapvectormap_get(results, resultKeys[0]);
-
-  // we know that it only contains one result
-  int keysize = mapvectormap_size(results);
-
+/* Build rxn r from the reactions NFSim listed for one complex */
+static void initializeNFSimReactionFromComplex(struct volume *state,
+                                               struct rxn *r, int n_reactants,
+                                               void *headComplex,
+                                               struct abstract_molecule *reacA,
+                                               struct abstract_molecule *reacB) {
   int headNumAssociatedReactions = mapvector_size(headComplex);
   state->n_NFSimPReactions += headNumAssociatedReactions;
 
@@ -331,8 +596,10 @@ int initializeNFSimReaction(struct volume *state, struct rxn *r,
                            "graph patterns of the possible products");
 
   r->reactant_graph_data[0] = reacA->graph_data;
+  acquire_graph_data(reacA->graph_data);
   if (reacB) {
     r->reactant_graph_data[1] = reacB->graph_data;
+    acquire_graph_data(reacB->graph_data);
   }
 
   r->product_graph_data =
@@ -382,10 +649,6 @@ int initializeNFSimReaction(struct volume *state, struct rxn *r,
     r->geometries[1] = 0;
   }
 
-  // nfsim diffusion function, depending on whether the user wants us to do
-  // this.
-  initialize_rxn_diffusion_functions(r);
-
   bool orientation_flag1 = 0, orientation_flag2 = 0;
   int reactantOrientation1, reactantOrientation2;
 
@@ -418,6 +681,20 @@ int initializeNFSimReaction(struct volume *state, struct rxn *r,
     r->min_noreaction_p = r->max_fixed_p = r->cum_probs[r->n_pathways - 1];
   else
     r->min_noreaction_p = r->max_fixed_p = 1.0;
+}
+
+int initializeNFSimReaction(struct volume *state, struct rxn *r,
+                            int n_reactants, void *results,
+                            struct abstract_molecule *reacA,
+                            struct abstract_molecule *reacB) {
+
+  char **resultKeys = mapvectormap_getKeys(results);
+  // we know that it only contains one result
+  void *headComplex = mapvectormap_get(results, resultKeys[0]);
+  int keysize = mapvectormap_size(results);
+
+  initializeNFSimReactionFromComplex(state, r, n_reactants, headComplex, reacA,
+                                     reacB);
 
   // cleanup
   for (int i = 0; i < keysize; i++)
@@ -428,31 +705,209 @@ int initializeNFSimReaction(struct volume *state, struct rxn *r,
   return 0;
 }
 
+static void push_pending_query(struct nfsim_pending_query ***list, int *n,
+                               int *max, struct nfsim_pending_query *query) {
+  if (*n == *max) {
+    int new_max = (*max == 0) ? 64 : 2 * *max;
+    struct nfsim_pending_query **new_list =
+        (struct nfsim_pending_query **)realloc(
+            *list, new_max * sizeof(struct nfsim_pending_query *));
+    if (new_list == NULL)
+      mcell_allocfailed("Failed to grow the NFSim query batch.");
+    *list = new_list;
+    *max = new_max;
+  }
+  (*list)[(*n)++] = query;
+}
+
+/*************************************************************************
+queue_nfsim_unimolecular_query:
+  In: world: simulation state
+      graph: a graph pattern that just entered the system
+  Out: No return value.  The unimolecular reactions of the pattern will be
+       asked for together with the other queued patterns.
+*************************************************************************/
+void queue_nfsim_unimolecular_query(struct volume *world,
+                                    struct graph_data *graph) {
+  struct nfsim_reaction_state *rs = reaction_state(world);
+  if (rs->pending_unimolecular_map == NULL)
+    rs->pending_unimolecular_map = hashmap_new();
+
+  void *found;
+  if (hashmap_get_pair(rs->pending_unimolecular_map, graph->pattern_id, 0,
+                       &found) == MAP_OK)
+    return;
+  if (rs->unimolecular_reaction_map != NULL &&
+      hashmap_get_pair(rs->unimolecular_reaction_map, graph->pattern_id, 0,
+                       &found) == MAP_OK)
+    return;
+
+  struct nfsim_pending_query *query = CHECKED_MALLOC_STRUCT(
+      struct nfsim_pending_query, "pending NFSim query");
+  query->graph = graph;
+  acquire_graph_data(graph);
+  query->batch = NULL;
+  query->head_complex = NULL;
+  if (hashmap_put_pair(rs->pending_unimolecular_map, graph->pattern_id, 0,
+                       query) != MAP_OK)
+    mcell_allocfailed("Failed to queue an NFSim query.");
+  push_pending_query(&rs->queued_queries, &rs->n_queued_queries,
+                     &rs->max_queued_queries, query);
+}
+
+/* Send one query for all queued patterns */
+static void flush_unimolecular_queries(struct volume *world) {
+  struct nfsim_reaction_state *rs = reaction_state(world);
+  static const char *optionKeys[1] = {"numReactants"};
+  static char *optionValues[1] = {(char *)"1"};
+
+  char **speciesArray = CHECKED_MALLOC_ARRAY(char *, rs->n_queued_queries,
+                                             "patterns of a batched query");
+  int *optionSeeds = CHECKED_MALLOC_ARRAY(int, rs->n_queued_queries,
+                                          "seeds of a batched query");
+  for (int i = 0; i < rs->n_queued_queries; i++) {
+    speciesArray[i] = rs->queued_queries[i]->graph->graph_pattern;
+    optionSeeds[i] = 1;
+  }
+
+  queryOptions options;
+  options.initKeys = speciesArray;
+  options.initValues = optionSeeds;
+  options.numOfInitElements = rs->n_queued_queries;
+  options.optionKeys = optionKeys;
+  options.optionValues = optionValues;
+  options.numOfOptions = 1;
+
+  struct nfsim_query_batch *batch = CHECKED_MALLOC_STRUCT(
+      struct nfsim_query_batch, "batched NFSim query");
+  batch->results = mapvectormap_create();
+  batch->n_unclaimed = rs->n_queued_queries;
+  initAndQueryByNumReactant_c(options, batch->results);
+  free(speciesArray);
+  free(optionSeeds);
+
+  // results are keyed by the pattern of each complex
+  int n_keys = mapvectormap_size(batch->results);
+  char **keys = mapvectormap_getKeys(batch->results);
+  for (int i = 0; i < n_keys; i++) {
+    struct graph_data *graph = find_graph_data(world, keys[i]);
+    struct nfsim_pending_query *query = NULL;
+    if (graph != NULL &&
+        hashmap_get_pair(rs->pending_unimolecular_map, graph->pattern_id, 0,
+                         (void **)&query) == MAP_OK &&
+        query->batch == NULL)
+      query->head_complex = mapvectormap_get(batch->results, keys[i]);
+    free(keys[i]);
+  }
+  free(keys);
+
+  for (int i = 0; i < rs->n_queued_queries; i++) {
+    rs->queued_queries[i]->batch = batch;
+    push_pending_query(&rs->resolved_queries, &rs->n_resolved_queries,
+                       &rs->max_resolved_queries, rs->queued_queries[i]);
+  }
+  rs->n_queued_queries = 0;
+}
+
+static void release_query_batch(struct nfsim_query_batch *batch) {
+  if (--batch->n_unclaimed == 0) {
+    mapvectormap_delete(batch->results);
+    free(batch);
+  }
+}
+
+/* Build the unimolecular rxn for a queued pattern from its batch, sending
+ * the batch first if need be.  Returns false if the pattern was not queued
+ * or the batch has nothing under its name. */
+static bool claim_unimolecular_query(struct volume *state,
+                                     struct abstract_molecule *am,
+                                     struct rxn **rx) {
+  struct nfsim_reaction_state *rs = reaction_state(state);
+  struct nfsim_pending_query *query = NULL;
+  if (rs->pending_unimolecular_map == NULL ||
+      hashmap_get_pair(rs->pending_unimolecular_map,
+                       am->graph_data->pattern_id, 0,
+                       (void **)&query) != MAP_OK)
+    return false;
+  if (query->batch == NULL)
+    flush_unimolecular_queries(state);
+
+  bool found = (query->head_complex != NULL);
+  if (found) {
+    *rx = new_reaction();
+    initializeNFSimReactionFromComplex(state, *rx, 1, query->head_complex, am,
+                                       NULL);
+  }
+  hashmap_remove_pair(rs->pending_unimolecular_map,
+                      am->graph_data->pattern_id, 0);
+  release_query_batch(query->batch);
+  release_graph_data(query->graph);
+  query->batch = NULL;
+  query->graph = NULL;
+  return found;
+}
+
+/*************************************************************************
+end_nfsim_query_batches:
+  In: world: simulation state
+  Out: No return value.  Queued and unclaimed queries of the iteration that
+       ended are dropped; their patterns are asked for one by one if they
+       are needed later.
+*************************************************************************/
+void end_nfsim_query_batches(struct volume *world) {
+  struct nfsim_reaction_state *rs = reaction_state(world);
+  for (int i = 0; i < rs->n_resolved_queries; i++) {
+    struct nfsim_pending_query *query = rs->resolved_queries[i];
+    if (query->graph != NULL) {
+      hashmap_remove_pair(rs->pending_unimolecular_map,
+                          query->graph->pattern_id, 0);
+      release_query_batch(query->batch);
+      release_graph_data(query->graph);
+    }
+    free(query);
+  }
+  rs->n_resolved_queries = 0;
+
+  for (int i = 0; i < rs->n_queued_queries; i++) {
+    hashmap_remove_pair(rs->pending_unimolecular_map,
+                        rs->queued_queries[i]->graph->pattern_id, 0);
+    release_graph_data(rs->queued_queries[i]->graph);
+    free(rs->queued_queries[i]);
+  }
+  rs->n_queued_queries = 0;
+}
+
 struct rxn *pick_unimolecular_reaction_nfsim(struct volume *state,
                                              struct abstract_molecule *am) {
 
-  int error;
+  struct nfsim_reaction_state *rs = reaction_state(state);
   struct rxn *rx = NULL;
-  if (reaction_map == NULL)
-    reaction_map = hashmap_new();
+  if (rs->unimolecular_reaction_map == NULL)
+    rs->unimolecular_reaction_map = hashmap_new();
 
   // memset(&reaction_key[0], 0, sizeof(reaction_key));
   // sprintf(reaction_key,"%s",am->graph_pattern);
   // sprintf(reaction_key,"%lu",am->graph_pattern_hash);
 
   // check in the hashmap in case this is a reaction we have encountered before
-  error =
-      hashmap_get_nohash(reaction_map, am->graph_data->graph_pattern_hash,
-                         am->graph_data->graph_pattern_hash, (void **)(&rx));
+  struct nfsim_cache_entry *entry = cache_lookup(
+      rs, rs->unimolecular_reaction_map, am->graph_data->pattern_id, 0);
   // error = find_in_cache(reaction_key, rx);
 
-  if (error == MAP_OK) {
-    return rx;
+  if (entry != NULL) {
+    return entry->rx;
   }
 
   // if(error != -1)
   //    return rx;
 
+  // a new pattern is answered by the batch it was queued in
+  if (claim_unimolecular_query(state, am, &rx)) {
+    cache_store(rs, rs->unimolecular_reaction_map,
+                am->graph_data->pattern_id, 0, rx, true);
+    return rx;
+  }
+
   // otherwise build the object
   queryOptions options = initializeNFSimQueryForUnimolecularReactions(am);
   // reset, init, query the nfsim system
@@ -468,8 +923,8 @@ struct rxn *pick_unimolecular_reaction_nfsim(struct volume *state,
   }
 
   // store newly created reaction in the hashmap
-  error = hashmap_put_nohash(reaction_map, am->graph_data->graph_pattern_hash,
-                             am->graph_data->graph_pattern_hash, rx);
+  cache_store(rs, rs->unimolecular_reaction_map, am->graph_data->pattern_id,
+              0, rx, rx != NULL);
   // add_to_cache(reaction_key, rx);
 
   // CLEANUP
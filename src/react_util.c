@@ -40,6 +40,8 @@
 #include "logging.h"
 #include "mcell_structs.h"
 #include "react_util.h"
+#include "react.h"
+#include "nfsim_func.h"
 
 /*************************************************************************
  *
@@ -143,11 +145,11 @@ double compute_pb_factor(double time_unit,
       double D_tot = 0.0;
       double t_step = 0.0;
       if ((rx->players[0]->flags & NOT_FREE) == 0) {
-        D_tot = rx->get_reactant_diffusion(rx, 0);
-        t_step = rx->get_reactant_time_step(rx,0) * time_unit;
+        D_tot = get_reactant_diffusion(rx, 0);
+        t_step = get_reactant_time_step(rx, 0) * time_unit;
       } else if ((rx->players[1]->flags & NOT_FREE) == 0) {
-        D_tot = rx->get_reactant_diffusion(rx, 1);
-        t_step = rx->get_reactant_time_step(rx,1) * time_unit;
+        D_tot = get_reactant_diffusion(rx, 1);
+        t_step = get_reactant_time_step(rx, 1) * time_unit;
       } else {
         /* Should never happen. */
         D_tot = 1.0;
@@ -171,8 +173,8 @@ double compute_pb_factor(double time_unit,
     /* This is the reaction between two "vol_mols" */
     rxn_flags->vol_vol_reaction_flag = 1;
 
-    double eff_vel_a = rx->get_reactant_space_step(rx,0) / rx->get_reactant_time_step(rx,0);
-    double eff_vel_b = rx->get_reactant_space_step(rx,1) / rx->get_reactant_time_step(rx,1);
+    double eff_vel_a = get_reactant_space_step(rx, 0) / get_reactant_time_step(rx, 0);
+    double eff_vel_b = get_reactant_space_step(rx, 1) / get_reactant_time_step(rx, 1);
     double eff_vel;
 
     if (rx->players[0]->flags & rx->players[1]->flags & CANT_INITIATE)
@@ -198,9 +200,9 @@ double compute_pb_factor(double time_unit,
 
     double eff_dif_a, eff_dif_b, eff_dif_c,
         eff_dif; /* effective diffusion constants*/
-    eff_dif_a = rx->get_reactant_diffusion(rx, 0);
-    eff_dif_b = rx->get_reactant_diffusion(rx, 1);
-    eff_dif_c = rx->get_reactant_diffusion(rx, 2);
+    eff_dif_a = get_reactant_diffusion(rx, 0);
+    eff_dif_b = get_reactant_diffusion(rx, 1);
+    eff_dif_c = get_reactant_diffusion(rx, 2);
 
     if (rx->players[0]->flags & rx->players[1]->flags & rx->players[2]->flags &
         CANT_INITIATE)
@@ -284,8 +286,8 @@ double compute_pb_factor(double time_unit,
                   vol_reactant2->sym->name);
 
     double eff_dif_1, eff_dif_2, eff_dif; /* effective diffusion constants*/
-    eff_dif_1 = rx->get_reactant_diffusion(rx, 0);
-    eff_dif_2 = rx->get_reactant_diffusion(rx, 1);
+    eff_dif_1 = get_reactant_diffusion(rx, 0);
+    eff_dif_2 = get_reactant_diffusion(rx, 1);
 
     if (vol_reactant1->flags & vol_reactant2->flags & surf_reactant->flags &
         CANT_INITIATE) {
@@ -390,7 +392,7 @@ double compute_pb_factor(double time_unit,
                   vol_reactant->sym->name, surf_reactant1->sym->name,
                   surf_reactant2->sym->name, vol_reactant->sym->name);
 
-    double eff_vel = rx->get_reactant_space_step(rx, volume_index) / rx->get_reactant_time_step(rx, volume_index);
+    double eff_vel = get_reactant_space_step(rx, volume_index) / get_reactant_time_step(rx, volume_index);
 
     if (eff_vel > 0) {
       eff_vel =
@@ -559,6 +561,7 @@ int change_reaction_probability(byte *reaction_prob_limit_flag,
   // update probability trackers
   rx->max_fixed_p += delta_prob;
   rx->min_noreaction_p += delta_prob;
+  build_pathway_guide(rx);
 
   // print update message
   if (rx->n_reactants == 1) {
@@ -28,6 +28,86 @@
 #include "rng.h"
 #include "mcell_structs.h"
 
+/* Scale of a 32-bit random integer to [0, 1), as in rng_dbl */
+#define RNG_DBL32 (2.3283064365386962890625e-10)
+
+#if !defined(USE_MINIMAL_RNG)
+/*************************************************************************
+rng_block:
+  In:  struct rng_state *rng - uniform RNG state
+  Out: Returns the generator's current block of 32-bit numbers, generating
+       a new one if it is used up.  rng->randcnt numbers are left in it,
+       handed out from the top down.
+ *************************************************************************/
+static uint32_t *rng_block(struct rng_state *rng) {
+#if defined(USE_COUNTER_RNG)
+  if (rng->randcnt == 0)
+    philox_generate(rng);
+  return rng->out;
+#else
+  if (rng->randcnt == 0) {
+    isaac64_generate(rng);
+    rng->randcnt = RANDMAX;
+  }
+  return (uint32_t *)rng->randrsl;
+#endif
+}
+#endif
+
+/*************************************************************************
+rng_uint_n:
+  In:  struct rng_state *rng - uniform RNG state
+       uint32_t *out - array to store the numbers in
+       int n - number of numbers to draw
+  Out: No return value.  out is filled with n 32-bit random numbers, the
+       same ones, in the same order, as n calls to rng_uint would return.
+       They are copied a block at a time rather than one per call.
+ *************************************************************************/
+void rng_uint_n(struct rng_state *rng, uint32_t *out, int n) {
+#if defined(USE_MINIMAL_RNG)
+  for (int i = 0; i < n; i++)
+    out[i] = rng_uint(rng);
+#else
+  while (n > 0) {
+    uint32_t *block = rng_block(rng);
+    int m = ((int)rng->randcnt < n) ? (int)rng->randcnt : n;
+    uint32_t *top = block + rng->randcnt - 1;
+    for (int i = 0; i < m; i++)
+      out[i] = top[-i];
+    rng->randcnt -= m;
+    out += m;
+    n -= m;
+  }
+#endif
+}
+
+/*************************************************************************
+rng_dbl_n:
+  In:  struct rng_state *rng - uniform RNG state
+       double *out - array to store the numbers in
+       int n - number of numbers to draw
+  Out: No return value.  out is filled with n uniform variates in [0, 1),
+       the same ones, in the same order, as n calls to rng_dbl would
+       return.
+ *************************************************************************/
+void rng_dbl_n(struct rng_state *rng, double *out, int n) {
+#if defined(USE_MINIMAL_RNG)
+  for (int i = 0; i < n; i++)
+    out[i] = rng_dbl(rng);
+#else
+  while (n > 0) {
+    uint32_t *block = rng_block(rng);
+    int m = ((int)rng->randcnt < n) ? (int)rng->randcnt : n;
+    uint32_t *top = block + rng->randcnt - 1;
+    for (int i = 0; i < m; i++)
+      out[i] = RNG_DBL32 * (double)top[-i];
+    rng->randcnt -= m;
+    out += m;
+    n -= m;
+  }
+#endif
+}
+
 /*************************************************************************
  * Ziggurat Gaussian generator
  *
@@ -171,19 +251,19 @@ static const double WTAB[128] = {
 };
 
 /*************************************************************************
-rng_gauss:
+rng_gauss_slow:
   In:  struct rng_state *rng - uniform RNG state
-  Out: Returns a Gaussian variate (mean 0, variance 1)
+       unsigned long bits - first uniform variate, which did not fall
+                            entirely under the curve
+  Out: Returns a Gaussian variate (mean 0, variance 1).  This is the rest of
+       the rejection loop of rng_gauss, for the rare draws that need it.
  *************************************************************************/
-double rng_gauss(struct rng_state *rng) {
+static double rng_gauss_slow(struct rng_state *rng, unsigned long bits) {
   double x, y;
   double sign = 1.0;
 
-  int npasses = 0;
-  do {
-    unsigned long bits = rng_uint(rng);
+  for (;;) {
     unsigned long region, pos_within_region;
-    ++npasses;
 
     /* Partition bits:
      *    - Bits 0...7: select a region under the curve
@@ -213,7 +293,80 @@ double rng_gauss(struct rng_state *rng) {
       x = SCALE_FACTOR - log1p(-rng_dbl(rng)) * RECIP_SCALE_FACTOR;
       y = exp(-SCALE_FACTOR * (x - 0.5 * SCALE_FACTOR)) * rng_dbl(rng);
     }
-  } while (y >= exp(-0.5 * x * x));
+
+    if (y < exp(-0.5 * x * x))
+      break;
+    bits = rng_uint(rng);
+  }
 
   return sign * x;
 }
+
+/*************************************************************************
+rng_gauss:
+  In:  struct rng_state *rng - uniform RNG state
+  Out: Returns a Gaussian variate (mean 0, variance 1)
+ *************************************************************************/
+double rng_gauss(struct rng_state *rng) {
+  unsigned long bits = rng_uint(rng);
+  unsigned long region = bits & 0x0000007f;
+  unsigned long pos_within_region = bits & 0xffffff00;
+
+  /* Most draws lie entirely under the curve for their region */
+  if (pos_within_region < KTAB[region])
+    return ((bits & 0x80) ? -1.0 : 1.0) * (pos_within_region * WTAB[region]);
+  return rng_gauss_slow(rng, bits);
+}
+
+/*************************************************************************
+rng_gauss_n:
+  In:  struct rng_state *rng - uniform RNG state
+       double *out - array to store the variates in
+       int n - number of variates to draw
+  Out: No return value.  out is filled with n Gaussian variates (mean 0,
+       variance 1), the same ones, in the same order, as n calls to
+       rng_gauss would return.
+
+       The numbers are read straight out of the generator's block.  Each
+       run up to the first one that misses the fast path is evaluated in a
+       branch-free loop that the compiler can vectorize; the miss is then
+       consumed and handed to rng_gauss_slow, which draws its own extra
+       numbers exactly where the scalar code would.
+ *************************************************************************/
+TARGET_CLONES
+void rng_gauss_n(struct rng_state *rng, double *out, int n) {
+#if defined(USE_MINIMAL_RNG)
+  for (int i = 0; i < n; i++)
+    out[i] = rng_gauss(rng);
+#else
+  while (n > 0) {
+    uint32_t *block = rng_block(rng);
+    int m = ((int)rng->randcnt < n) ? (int)rng->randcnt : n;
+    uint32_t *top = block + rng->randcnt - 1;
+
+    /* Find the first number that needs the slow path. */
+    int k;
+    for (k = 0; k < m; k++) {
+      uint32_t bits = top[-k];
+      if ((bits & 0xffffff00) >= KTAB[bits & 0x7f])
+        break;
+    }
+
+    /* Everything before it is on the fast path. */
+    for (int i = 0; i < k; i++) {
+      uint32_t bits = top[-i];
+      double sign = (bits & 0x80) ? -1.0 : 1.0;
+      out[i] = sign * ((bits & 0xffffff00) * WTAB[bits & 0x7f]);
+    }
+    rng->randcnt -= k;
+    out += k;
+    n -= k;
+
+    if (k < m) {
+      unsigned long bits = rng_uint(rng);
+      *out++ = rng_gauss_slow(rng, bits);
+      n--;
+    }
+  }
+#endif
+}
@@ -30,9 +30,22 @@
 #define rng_state mrng_state
 
 #define rng_init(x, y) mrng_init((x), (y))
+#define rng_init_stream(x, y, s) mrng_init((x), (y) + 7919u * (s))
 #define rng_dbl(x) mrng_dbl32((x))
 #define rng_uint(x) mrng_uint32((x))
 
+#elif defined(USE_COUNTER_RNG)
+/*******************Philox4x32-10***************/
+#include "philox.h"
+#define rng_state philox_state
+
+#define rng_uses(x) ((long long)(4 * (x)->counter) - (long long)(x)->randcnt)
+#define rng_init(x, y) philox_init((x), (y), 0)
+#define rng_init_stream(x, y, s) philox_init((x), (y), (s))
+#define rng_dbl(x) philox_dbl32((x))
+#define rng_uint(x) philox_uint32((x))
+/***********************************************/
+
 #else
 /*******************ISAAC64*********************/
 #include "isaac64.h"
@@ -42,12 +55,21 @@
 #define rng_uses(x)                                                            \
   ((RANDMAX *((x)->rngblocks - 1)) + (long long)(RANDMAX - (x)->randcnt))
 #define rng_init(x, y) isaac64_init((x), (y))
+#define rng_init_stream(x, y, s) isaac64_init((x), (y) + 7919u * (s))
 #define rng_dbl(x) isaac64_dbl32((x))
 #define rng_uint(x) isaac64_uint32((x))
 /***********************************************/
 
 #endif
 
+/* rng_init_stream(x, seed, s) starts stream s of a seed; stream 0 is the
+ * world's generator, and the storages of a threaded run use streams 1 and
+ * up.  Only the counter-based generator guarantees that the streams of one
+ * seed never overlap each other or the streams of another seed. */
+
 #define rng_open_dbl(x) (rng_dbl(x) + ONE_OVER_2_TO_THE_33RD)
 
+void rng_uint_n(struct rng_state *rng, uint32_t *out, int n);
+void rng_dbl_n(struct rng_state *rng, double *out, int n);
 double rng_gauss(struct rng_state *rng);
+void rng_gauss_n(struct rng_state *rng, double *out, int n);
@@ -11,6 +11,8 @@ import os
 import read_bngxml
 import write_bngxmle as writeBXe
 import sys
+import glob
+import mdlr_cache
 
 
 def define_console():
@@ -21,6 +23,8 @@ def define_console():
     parser.add_argument('-b', '--bng-executable',   type=str,            help='file path pointing to the BNG2.pl file')
     parser.add_argument('-m', '--mcell-executable', type=str,            help='file path pointing to the MCell binary')
     parser.add_argument('-r', '--run', action='store_true',        help='run generated model with mcell')
+    parser.add_argument('-c', '--cache-dir',        type=str,            help='cache of generated files (default: $MCELL_MDLR_CACHE or ~/.cache/mcell/mdlr)')
+    parser.add_argument('--no-cache', action='store_true',        help='always regenerate, and do not cache the generated files')
     return parser
 
 
@@ -64,6 +68,17 @@ class MDLR2MDL(object):
         
         self.nfsim = NFSim(libnfsim_c_path, libNFsim_path=libNFsim_path)
 
+    def tool_paths(self):
+        '''
+        files whose changes invalidate cached translations: these scripts,
+        BioNetGen and the nfsim libraries
+        '''
+        paths = glob.glob(os.path.join(self.config['scriptpath'], '*.py'))
+        paths.append(self.config['bionetgen'])
+        if os.path.isdir(self.config['libpath']):
+            paths.extend(glob.glob(os.path.join(self.config['libpath'], '*')))
+        return paths
+
     def process_mdlr(self, mdlrPath):
         '''
         main method. extracts species definition, creates bng-xml, creates mdl
@@ -190,30 +205,46 @@ if __name__ == "__main__":
     final_name = namespace.output if namespace.output else namespace.input
     print("Running " + namespace.input)
 
-    # mdl to bngl
-    result_dict = read_mdl.construct_bng_from_mdlr(
-        namespace.input, namespace.nfsim)
-    output_dir = os.sep.join(namespace.output.split(os.sep)[:-1])
-    # create bngl file
-    read_mdl.output_bngl(result_dict['bnglstr'], bngl_path)
-
-    # temporarily store bng-xml information in a separate file for display
-    # purposes
-    with open(namespace.input + '_extended_bng.xml', 'wb') as f:
-        f.write(result_dict['bngxmlestr'])
-
-    # get canonical label -bngl label dictionary
-
-    if not namespace.nfsim:
-        # bngl 2 sbml 2 json
-        read_mdl.bngl2json(namespace.input + '.bngl')
-        # json 2 plain mdl
-        mdl_dict = write_mdl.constructMDL(
-            namespace.input + '_sbml.xml.json', namespace.input, final_name)
-        # create an mdl with nfsim-species and nfsim-reactions
-        write_mdl.write_mdl(mdl_dict, final_name)
+    cache_dir = namespace.cache_dir if namespace.cache_dir else mdlr_cache.default_cache_dir()
+    cache_key = None
+    if not namespace.no_cache:
+        cache_key = mdlr_cache.cache_key(namespace.input, final_name, namespace.nfsim,
+                                         mdlr2mdl.tool_paths())
+
+    if cache_key and mdlr_cache.restore(cache_dir, cache_key):
+        print("Restored the files generated from " + namespace.input + " from " + cache_dir)
     else:
-        mdlr2mdl.process_mdlr(namespace.input)
+        prefixes = [namespace.input, final_name]
+        before = mdlr_cache.snapshot(prefixes)
+
+        # mdl to bngl
+        result_dict = read_mdl.construct_bng_from_mdlr(
+            namespace.input, namespace.nfsim)
+        output_dir = os.sep.join(namespace.output.split(os.sep)[:-1])
+        # create bngl file
+        read_mdl.output_bngl(result_dict['bnglstr'], bngl_path)
+
+        # temporarily store bng-xml information in a separate file for display
+        # purposes
+        with open(namespace.input + '_extended_bng.xml', 'wb') as f:
+            f.write(result_dict['bngxmlestr'])
+
+        # get canonical label -bngl label dictionary
+
+        if not namespace.nfsim:
+            # bngl 2 sbml 2 json
+            read_mdl.bngl2json(namespace.input + '.bngl')
+            # json 2 plain mdl
+            mdl_dict = write_mdl.constructMDL(
+                namespace.input + '_sbml.xml.json', namespace.input, final_name)
+            # create an mdl with nfsim-species and nfsim-reactions
+            write_mdl.write_mdl(mdl_dict, final_name)
+        else:
+            mdlr2mdl.process_mdlr(namespace.input)
+
+        if cache_key:
+            mdlr_cache.store(cache_dir, cache_key,
+                             mdlr_cache.generated_files(before, prefixes, [namespace.input]))
 
     # get the species definitions
     noext = os.path.splitext(namespace.input)[0]
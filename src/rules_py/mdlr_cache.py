@@ -0,0 +1,123 @@
+import hashlib
+import json
+import os
+import shutil
+import tempfile
+
+'''
+Content-addressed cache of the files mdlr2mdl.py generates from an MDLr model
+(bngl, bng-xml and the plain mdl files). The key covers the model text, the
+options and paths that end up in the generated files, and the translation
+tools themselves, so runs of an unchanged model (e.g. a sweep over seeds)
+restore the files instead of rerunning BioNetGen and NFSim.
+'''
+
+CACHE_FORMAT = 1
+MANIFEST = 'manifest.json'
+
+
+def default_cache_dir():
+    if os.environ.get('MCELL_MDLR_CACHE'):
+        return os.environ['MCELL_MDLR_CACHE']
+    return os.path.join(os.path.expanduser('~'), '.cache', 'mcell', 'mdlr')
+
+
+def _hash_file(digest, path):
+    with open(path, 'rb') as f:
+        for block in iter(lambda: f.read(1 << 20), b''):
+            digest.update(block)
+
+
+def cache_key(input_file, output_name, nfsim, tool_paths):
+    '''
+    key of the files generated from input_file; tool_paths are the scripts
+    and libraries run on the way, which are hashed too when they exist (large
+    libraries only by size and modification time)
+    '''
+    digest = hashlib.sha256()
+    digest.update(('mdlr-cache %d\n' % CACHE_FORMAT).encode())
+    digest.update(('%s\n%s\n%d\n' % (input_file, output_name, nfsim)).encode())
+    _hash_file(digest, input_file)
+    for path in sorted(tool_paths):
+        digest.update(('\n%s\n' % os.path.basename(path)).encode())
+        if not os.path.exists(path):
+            continue
+        if path.endswith('.py') or path.endswith('.pl'):
+            _hash_file(digest, path)
+        else:
+            st = os.stat(path)
+            digest.update(('%d %d' % (st.st_size, st.st_mtime_ns)).encode())
+    return digest.hexdigest()
+
+
+def snapshot(prefixes):
+    '''
+    modification times of the files in the directories of prefixes whose
+    names start with the prefix's base name
+    '''
+    state = {}
+    for prefix in prefixes:
+        directory = os.path.dirname(prefix) or '.'
+        base = os.path.basename(prefix)
+        if not os.path.isdir(directory):
+            continue
+        for name in os.listdir(directory):
+            path = os.path.join(directory, name)
+            if name.startswith(base) and os.path.isfile(path):
+                state[os.path.normpath(path)] = os.stat(path).st_mtime_ns
+    return state
+
+
+def generated_files(before, prefixes, exclude):
+    '''
+    files matching prefixes which were created or changed since snapshot
+    before was taken
+    '''
+    after = snapshot(prefixes)
+    excluded = set(os.path.normpath(x) for x in exclude)
+    return sorted(x for x in after
+                  if x not in excluded and before.get(x) != after[x])
+
+
+def restore(cache_dir, key):
+    '''
+    copy the files cached under key back to where they were generated, which
+    is relative to the current directory; returns False on a cache miss
+    '''
+    entry = os.path.join(cache_dir, key)
+    try:
+        with open(os.path.join(entry, MANIFEST), 'r') as f:
+            manifest = json.load(f)
+    except (OSError, ValueError):
+        return False
+    for i, path in enumerate(manifest['files']):
+        directory = os.path.dirname(path)
+        if directory and not os.path.isdir(directory):
+            os.makedirs(directory)
+        shutil.copyfile(os.path.join(entry, str(i)), path)
+    return True
+
+
+def store(cache_dir, key, files):
+    '''
+    add files under key; the entry is filled in a temporary directory and
+    renamed into place, so concurrent runs of the same model never see a
+    partial entry
+    '''
+    entry = os.path.join(cache_dir, key)
+    if os.path.exists(entry):
+        return
+    if not os.path.isdir(cache_dir):
+        os.makedirs(cache_dir, exist_ok=True)
+    tmp = tempfile.mkdtemp(prefix='.' + key[:16], dir=cache_dir)
+    try:
+        paths = [os.path.relpath(x) for x in files]
+        for i, path in enumerate(paths):
+            shutil.copyfile(path, os.path.join(tmp, str(i)))
+        with open(os.path.join(tmp, MANIFEST), 'w') as f:
+            json.dump({'format': CACHE_FORMAT, 'files': paths}, f, indent=1)
+        os.rename(tmp, entry)
+    except OSError:
+        # another run stored the same entry first, or the cache is not
+        # writable; either way the generated files are already in place
+        shutil.rmtree(tmp, ignore_errors=True)
@@ -24,16 +24,114 @@
 #include "config.h"
 
 #include <float.h>
+#include <math.h>
 #include <string.h>
 #include <stdlib.h>
 
 #include "sched_util.h"
+#include "util.h"
+
+#ifdef SCHED_UTIL_KEEP_STATS
+#include <time.h>
+
+static double sched_stats_clock(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + 1e-9 * (double)ts.tv_nsec;
+}
+
+static void sched_stats_record_slot(struct schedule_helper *sh, int n) {
+  int bin = 0;
+  while (n >> bin && bin < SCHED_STATS_HIST_BINS - 1)
+    bin++;
+  sh->stats.slots_advanced++;
+  sh->stats.occupancy_hist[bin]++;
+  if (n > sh->stats.max_occupancy)
+    sh->stats.max_occupancy = n;
+}
+#endif
+
+/* Lists at least this long are radix sorted as arrays by ae_list_sort */
+#define AE_SORT_AS_ARRAY_MIN 64
+
+/*************************************************************************
+ae_list_sort_array:
+  In: head of a linked list of abstract_elements
+      its length
+  Out: head of the list radix sorted by time as an array, or NULL if there
+       was no memory to do so.  Equal times keep their order, as in the list
+       mergesort.
+*************************************************************************/
+static struct abstract_element *ae_list_sort_array(struct abstract_element *ae,
+                                                   size_t n) {
+  struct sort_item *items =
+      (struct sort_item *)malloc(2 * n * sizeof(struct sort_item));
+  if (items == NULL)
+    return NULL;
+
+  size_t i = 0;
+  for (; ae != NULL; ae = ae->next, i++) {
+    /* Map the time to an integer with the same order; -0.0 becomes 0.0 so
+     * the two stay equal */
+    double t = ae->t + 0.0;
+    uint64_t bits;
+    memcpy(&bits, &t, sizeof(bits));
+    items[i].key = (bits >> 63) ? ~bits : bits | (UINT64_C(1) << 63);
+    items[i].item = ae;
+  }
+
+  struct sort_item *sorted = radix_sort_items(items, items + n, n);
+  for (i = 0; i + 1 < n; i++)
+    ((struct abstract_element *)sorted[i].item)->next =
+        (struct abstract_element *)sorted[i + 1].item;
+  ((struct abstract_element *)sorted[n - 1].item)->next = NULL;
+  ae = (struct abstract_element *)sorted[0].item;
+
+  free(items);
+  return ae;
+}
+
+/* Lists of three up to this many elements are insertion sorted in an array
+ * on the stack by ae_list_sort; most collision lists of a diffusion step are
+ * this short, and a pair is sorted fastest by the mergesort */
+#define AE_SORT_INSERTION_MAX 32
+
+/*************************************************************************
+ae_list_sort_short:
+  In: head of a linked list of abstract_elements
+      its length, at least 1 and at most AE_SORT_INSERTION_MAX
+  Out: head of the list insertion sorted by time.  Equal times keep their
+       order, as in the list mergesort.
+*************************************************************************/
+static struct abstract_element *ae_list_sort_short(struct abstract_element *ae,
+                                                   size_t n) {
+  double t[AE_SORT_INSERTION_MAX];
+  struct abstract_element *item[AE_SORT_INSERTION_MAX];
+
+  size_t i = 0;
+  for (; ae != NULL; ae = ae->next, i++) {
+    double ae_t = ae->t;
+    size_t j = i;
+    for (; j > 0 && t[j - 1] > ae_t; j--) {
+      t[j] = t[j - 1];
+      item[j] = item[j - 1];
+    }
+    t[j] = ae_t;
+    item[j] = ae;
+  }
+
+  for (i = 0; i + 1 < n; i++)
+    item[i]->next = item[i + 1];
+  item[n - 1]->next = NULL;
+  return item[0];
+}
 
 /*************************************************************************
 ae_list_sort:
   In: head of a linked list of abstract_elements
   Out: head of the newly sorted list
-  Note: uses mergesort
+  Note: uses an insertion sort over an array for short lists, mergesort, or
+        a radix sort over an array for long lists
 *************************************************************************/
 
 struct abstract_element *ae_list_sort(struct abstract_element *ae) {
@@ -46,6 +144,14 @@ struct abstract_element *ae_list_sort(struct abstract_element *ae) {
   if (ae == NULL)
     return NULL;
 
+  size_t n = 0;
+  for (struct abstract_element *p = ae; p != NULL; p = p->next)
+    n++;
+  if (n > 2 && n <= AE_SORT_INSERTION_MAX)
+    return ae_list_sort_short(ae, n);
+  if (n >= AE_SORT_AS_ARRAY_MIN && (merge = ae_list_sort_array(ae, n)) != NULL)
+    return merge;
+
   while (ae != NULL) {
     if (ae->next == NULL) {
       stack[si] = ae;
@@ -214,6 +320,122 @@ failure:
   return NULL;
 }
 
+/*************************************************************************
+slot_insert:
+  In: scheduler that we are using
+      index of the slot in the circular buffer
+      item to add to the slot
+      1 to push the item at the front of the slot, 0 to append it
+  Out: No return value.  The item is linked into the slot.  Counts other
+       than the per-slot count are left to the caller.
+*************************************************************************/
+
+static inline void slot_insert(struct schedule_helper *sh, int i,
+                               struct abstract_element *ae, int lifo) {
+  if (sh->circ_buf_tail[i] == NULL) {
+    sh->circ_buf_count[i] = 1;
+    sh->circ_buf_head[i] = sh->circ_buf_tail[i] = ae;
+    ae->next = NULL;
+  } else {
+    sh->circ_buf_count[i]++;
+    if (lifo) {
+      ae->next = sh->circ_buf_head[i];
+      sh->circ_buf_head[i] = ae;
+    } else {
+      sh->circ_buf_tail[i]->next = ae;
+      ae->next = NULL;
+      sh->circ_buf_tail[i] = ae;
+    }
+  }
+}
+
+/* Link in the deferred items before anything else looks at the slots or
+ * adds to them, so the order is as if they had been inserted right away */
+static inline int flush_deferred(struct schedule_helper *sh) {
+  return (sh->n_deferred > 0) ? schedule_flush_deferred(sh) : 0;
+}
+
+/*************************************************************************
+skip_empty_slots:
+  In: scheduler that we are using, with nothing scheduled
+      number of slots to skip
+  Out: No return value.  The scheduler and its coarser tiers are where that
+       many calls of schedule_advance would have left them.
+*************************************************************************/
+
+static void skip_empty_slots(struct schedule_helper *sh, long long n_slots) {
+  while (sh != NULL && n_slots > 0) {
+    long long index = sh->index + n_slots;
+    sh->index = (int)(index % sh->buf_len);
+    sh->now += (double)n_slots * sh->dt;
+    n_slots = index / sh->buf_len;
+    sh = sh->next_scale;
+  }
+}
+
+/*************************************************************************
+wake_from_group:
+  In: idle scheduler that we are using
+  Out: 0 on success, 1 on memory allocation failure.  The scheduler has
+       caught up with its group, is no longer idle, and its owner is in the
+       group's woken list.
+*************************************************************************/
+
+static int wake_from_group(struct schedule_helper *sh) {
+  struct schedule_group *g = sh->group;
+  skip_empty_slots(sh, (long long)llround((g->now - sh->now) * sh->dt_1));
+  sh->idle = 0;
+
+  if (g->n_woken == g->woken_len) {
+    int len = (g->woken_len == 0) ? 16 : 2 * g->woken_len;
+    void **woken = (void **)realloc(g->woken, len * sizeof(void *));
+    if (woken == NULL) {
+      g->error = 1;
+      return 1;
+    }
+    g->woken = woken;
+    g->woken_len = len;
+  }
+  g->woken[g->n_woken++] = sh->group_owner;
+  return 0;
+}
+
+/*************************************************************************
+schedule_join_group:
+  In: scheduler that we are using, at the group's time
+      group to join
+      owner to list in the group's woken list when the scheduler wakes
+  Out: No return value.  The scheduler may be set idle from now on.
+*************************************************************************/
+
+void schedule_join_group(struct schedule_helper *sh,
+                         struct schedule_group *group, void *owner) {
+  sh->group = group;
+  sh->group_owner = owner;
+  sh->idle = 0;
+}
+
+/*************************************************************************
+schedule_is_empty:
+  In: scheduler that we are using
+  Out: 1 if nothing at all is scheduled, 0 otherwise
+*************************************************************************/
+
+int schedule_is_empty(struct schedule_helper const *sh) {
+  return sh->count == 0 && sh->current == NULL && sh->n_deferred == 0;
+}
+
+/*************************************************************************
+schedule_set_idle:
+  In: empty scheduler that is a member of a group, at the group's time
+  Out: No return value.  The caller stops advancing the scheduler, which
+       skips the slots it missed the next time an item is added to it.
+*************************************************************************/
+
+void schedule_set_idle(struct schedule_helper *sh) {
+  sh->idle = 1;
+}
+
 /*************************************************************************
 schedule_insert:
   In: scheduler that we are using
@@ -228,6 +450,11 @@ int schedule_insert(struct schedule_helper *sh, void *data,
                     int put_neg_in_current) {
   struct abstract_element *ae = (struct abstract_element *)data;
 
+  if (sh->idle && wake_from_group(sh))
+    return 1;
+  if (flush_deferred(sh))
+    return 1;
+
   if (put_neg_in_current && ae->t < sh->now) {
     /* insert item into current list */
 
@@ -243,44 +470,147 @@ int schedule_insert(struct schedule_helper *sh, void *data,
     return 0;
   }
 
-  /* insert item into future lists */
-  sh->count++;
-  double nsteps = (ae->t - sh->now) * sh->dt_1;
+  /* insert item into future lists, walking down to the first tier whose
+   * wheel reaches far enough; coarser tiers never use the current list */
+  while (1) {
+    sh->count++;
+    double nsteps = (ae->t - sh->now) * sh->dt_1;
+
+    if (nsteps < ((double)sh->buf_len)) {
+      /* item fits in array for this scale */
+      int i;
+      if (nsteps < 0.0)
+        i = sh->index;
+      else
+        i = (int)nsteps + sh->index;
+      if (i >= sh->buf_len)
+        i -= sh->buf_len;
+
+      /* For schedulers other than the first tier, maintain a LIFO ordering;
+       * for first-tier scheduler, maintain FIFO ordering */
+      slot_insert(sh, i, ae, sh->depth != 0);
+      return 0;
+    }
 
-  if (nsteps < ((double)sh->buf_len)) {
-    /* item fits in array for this scale */
+    /* item fits in array for coarser scale */
+    if (sh->next_scale == NULL) {
+      sh->next_scale = create_scheduler(
+          sh->dt * sh->buf_len, sh->dt * sh->buf_len * sh->buf_len, sh->buf_len,
+          sh->now + sh->dt * (sh->buf_len - sh->index));
+      if (sh->next_scale == NULL)
+        return 1;
+      sh->next_scale->depth = sh->depth + 1;
+    }
+    sh = sh->next_scale;
+  }
+}
 
-    int i;
-    if (nsteps < 0.0)
-      i = sh->index;
-    else
-      i = (int)nsteps + sh->index;
-    if (i >= sh->buf_len)
-      i -= sh->buf_len;
+/*************************************************************************
+schedule_insert_batch:
+  In: scheduler that we are using
+      array of items to schedule (each assumed to start with an
+        abstract_element struct)
+      number of items in the array
+      flag to indicate whether times in the "past" go into the list
+         of current events (if 0, go into next event, not current).
+  Out: 0 on success, 1 on memory allocation failure.  The items end up
+       exactly where n calls to schedule_insert would have put them, but
+       consecutive items bound for the same slot are chained together and
+       linked into the slot in one step.  Items that belong to coarser
+       tiers are moved to the front of the array, so its order is not
+       preserved.
+*************************************************************************/
 
-    if (sh->circ_buf_tail[i] == NULL) {
-      sh->circ_buf_count[i] = 1;
-      sh->circ_buf_head[i] = sh->circ_buf_tail[i] = ae;
-      ae->next = NULL;
-    } else {
-      sh->circ_buf_count[i]++;
+int schedule_insert_batch(struct schedule_helper *sh,
+                          struct abstract_element **items, int n,
+                          int put_neg_in_current) {
+  if (sh->idle && wake_from_group(sh))
+    return 1;
+  if (flush_deferred(sh))
+    return 1;
 
-      /* For schedulers other than the first tier, maintain a LIFO ordering */
-      if (sh->depth) {
-        ae->next = sh->circ_buf_head[i];
-        sh->circ_buf_head[i] = ae;
+  while (n > 0) {
+    /* The run being built: -2 means none, -1 means the current list */
+    int run_slot = -2;
+    int run_count = 0;
+    struct abstract_element *run_head = NULL, *run_tail = NULL;
+    int lifo = (sh->depth != 0);
+    int n_coarse = 0;
+
+    for (int k = 0; k <= n; k++) {
+      struct abstract_element *ae = NULL;
+      int slot = -2;
+      if (k < n) {
+        ae = items[k];
+        if (put_neg_in_current && ae->t < sh->now)
+          slot = -1;
+        else {
+          double nsteps = (ae->t - sh->now) * sh->dt_1;
+          if (nsteps < ((double)sh->buf_len)) {
+            slot = (nsteps < 0.0) ? sh->index : (int)nsteps + sh->index;
+            if (slot >= sh->buf_len)
+              slot -= sh->buf_len;
+          } else {
+            /* Goes to a coarser tier */
+            sh->count++;
+            items[n_coarse++] = ae;
+            continue;
+          }
+        }
+        if (slot == run_slot) {
+          /* Extend the run, keeping the order the slot would have */
+          if (lifo && slot != -1) {
+            ae->next = run_head;
+            run_head = ae;
+          } else {
+            ae->next = NULL;
+            run_tail->next = ae;
+            run_tail = ae;
+          }
+          run_count++;
+          continue;
+        }
+      }
+
+      /* Splice the finished run into its list */
+      if (run_slot == -1) {
+        sh->current_count += run_count;
+        if (sh->current_tail == NULL)
+          sh->current = run_head;
+        else
+          sh->current_tail->next = run_head;
+        sh->current_tail = run_tail;
+      } else if (run_slot >= 0) {
+        sh->count += run_count;
+        if (sh->circ_buf_tail[run_slot] == NULL) {
+          sh->circ_buf_count[run_slot] = run_count;
+          sh->circ_buf_head[run_slot] = run_head;
+          sh->circ_buf_tail[run_slot] = run_tail;
+        } else {
+          sh->circ_buf_count[run_slot] += run_count;
+          if (lifo) {
+            run_tail->next = sh->circ_buf_head[run_slot];
+            sh->circ_buf_head[run_slot] = run_head;
+          } else {
+            sh->circ_buf_tail[run_slot]->next = run_head;
+            sh->circ_buf_tail[run_slot] = run_tail;
+          }
+        }
       }
 
-      /* For first-tier scheduler, maintain FIFO ordering */
-      else {
-        sh->circ_buf_tail[i]->next = ae;
+      /* Start a new run */
+      if (ae != NULL) {
         ae->next = NULL;
-        sh->circ_buf_tail[i] = ae;
+        run_head = run_tail = ae;
+        run_count = 1;
+        run_slot = slot;
       }
     }
-  } else {
-    /* item fits in array for coarser scale */
 
+    if (n_coarse == 0)
+      break;
+
+    /* Remaining items fit in array for coarser scale */
     if (sh->next_scale == NULL) {
       sh->next_scale = create_scheduler(
           sh->dt * sh->buf_len, sh->dt * sh->buf_len * sh->buf_len, sh->buf_len,
@@ -289,15 +619,67 @@ int schedule_insert(struct schedule_helper *sh, void *data,
         return 1;
       sh->next_scale->depth = sh->depth + 1;
     }
-
-    /* insert item at coarser scale and insist that item is not placed in
-     * "current" list */
-    return schedule_insert(sh->next_scale, data, 0);
+    sh = sh->next_scale;
+    n = n_coarse;
+    put_neg_in_current = 0;
   }
 
   return 0;
 }
 
+/*************************************************************************
+schedule_insert_deferred:
+  In: scheduler that we are using
+      data to schedule (assumed to start with abstract_element struct)
+  Out: 0 on success, 1 on memory allocation failure.  The same as
+       schedule_insert with put_neg_in_current set, except that items due
+       after now are queued and linked in by one schedule_insert_batch
+       when schedule_flush_deferred is called.  Any other call that adds
+       to the slots or reads them flushes the queue first, so the result
+       is the same as inserting each item right away.
+*************************************************************************/
+
+int schedule_insert_deferred(struct schedule_helper *sh, void *data) {
+  struct abstract_element *ae = (struct abstract_element *)data;
+
+  if (sh->idle && wake_from_group(sh))
+    return 1;
+
+  /* Current items are handed out before the queue would be flushed */
+  if (ae->t < sh->now)
+    return schedule_insert(sh, data, 1);
+
+  if (sh->n_deferred == sh->deferred_len) {
+    int len = (sh->deferred_len == 0) ? 256 : 2 * sh->deferred_len;
+    struct abstract_element **deferred = (struct abstract_element **)realloc(
+        sh->deferred, len * sizeof(struct abstract_element *));
+    if (deferred == NULL) {
+      if (schedule_flush_deferred(sh))
+        return 1;
+      return schedule_insert(sh, data, 1);
+    }
+    sh->deferred = deferred;
+    sh->deferred_len = len;
+  }
+  sh->deferred[sh->n_deferred++] = ae;
+  return 0;
+}
+
+/*************************************************************************
+schedule_flush_deferred:
+  In: scheduler that we are using
+  Out: 0 on success, 1 on memory allocation failure.  The items queued by
+       schedule_insert_deferred are linked into their slots.
+*************************************************************************/
+
+int schedule_flush_deferred(struct schedule_helper *sh) {
+  int n = sh->n_deferred;
+  sh->n_deferred = 0;
+  if (n == 0)
+    return 0;
+  return schedule_insert_batch(sh, sh->deferred, n, 1);
+}
+
 /*************************************************************************
 unlink_list_item:
   Removes a specific item from the linked list.
@@ -338,6 +720,9 @@ schedule_deschedule:
 int schedule_deschedule(struct schedule_helper *sh, void *data) {
   struct abstract_element *ae = (struct abstract_element *)data;
 
+  if (flush_deferred(sh))
+    sh->error = 1;
+
   /* If the item is in "current" */
   if (sh->current && ae->t < sh->now) {
     if (unlink_list_item(&sh->current, &sh->current_tail, ae))
@@ -420,6 +805,9 @@ int schedule_advance(struct schedule_helper *sh, struct abstract_element **head,
   int n;
   struct abstract_element *p, *nextp;
 
+  if (flush_deferred(sh))
+    return -1;
+
   if (head != NULL)
     *head = sh->circ_buf_head[sh->index];
   if (tail != NULL)
@@ -428,6 +816,9 @@ int schedule_advance(struct schedule_helper *sh, struct abstract_element **head,
   sh->circ_buf_head[sh->index] = sh->circ_buf_tail[sh->index] = NULL;
   sh->count -= n = sh->circ_buf_count[sh->index];
   sh->circ_buf_count[sh->index] = 0;
+#ifdef SCHED_UTIL_KEEP_STATS
+  sched_stats_record_slot(sh, n);
+#endif
 
   sh->index++;
   sh->now += sh->dt;
@@ -437,34 +828,30 @@ int schedule_advance(struct schedule_helper *sh, struct abstract_element **head,
 
     sh->index = 0;
     if (sh->next_scale != NULL) {
-      /* Save our depth */
-      int old_depth = sh->depth;
-      int conservecount = sh->count;
-
-      /* Hack: Toggle the non-zero-ness of our depth to toggle FIFO/LIFO
-       * behavior
-       */
-      sh->depth = old_depth ? 0 : -1;
-
-      if (schedule_advance(sh->next_scale, &p, NULL) == -1) {
-        sh->depth = old_depth;
+      if (schedule_advance(sh->next_scale, &p, NULL) == -1)
         return -1;
-      }
+
+      /* Coarser slots are LIFO, so the order of their items is flipped
+       * while spreading them over this scale: pushed to the front of the
+       * first tier (restoring insertion order), appended elsewhere.  The
+       * items were already counted when originally scheduled. */
+      int lifo = (sh->depth == 0);
+#ifdef SCHED_UTIL_KEEP_STATS
+      sh->stats.cascades++;
+#endif
       while (p != NULL) {
         nextp = p->next;
-        if (schedule_insert(sh, (void *)p, 0)) {
-          sh->depth = old_depth;
+#ifdef SCHED_UTIL_KEEP_STATS
+        sh->stats.cascaded_items++;
+#endif
+        double nsteps = (p->t - sh->now) * sh->dt_1;
+        if (nsteps < ((double)sh->buf_len)) {
+          int i = (nsteps < 0.0) ? 0 : (int)nsteps;
+          slot_insert(sh, i, p, lifo);
+        } else if (schedule_insert(sh->next_scale, (void *)p, 0))
           return -1;
-        }
         p = nextp;
       }
-
-      /* moved items were already counted when originally scheduled so don't
-       * count again */
-      sh->count = conservecount;
-
-      /* restore our depth */
-      sh->depth = old_depth;
     }
   }
 
@@ -482,20 +869,28 @@ schedule_next:
 
 void *schedule_next(struct schedule_helper *sh) {
   void *data;
+#ifdef SCHED_UTIL_KEEP_STATS
+  double start = sched_stats_clock();
+  sh->stats.next_calls++;
+#endif
 
   if (sh->current == NULL) {
     sh->current_count = schedule_advance(sh, &sh->current, &sh->current_tail);
     if (sh->current_count == -1)
       sh->error = 1;
-    return NULL;
+    data = NULL;
   } else {
     sh->current_count--;
     data = sh->current;
     sh->current = sh->current->next;
     if (sh->current == NULL)
       sh->current_tail = NULL;
-    return data;
   }
+
+#ifdef SCHED_UTIL_KEEP_STATS
+  sh->stats.next_seconds += sched_stats_clock() - start;
+#endif
+  return data;
 }
 
 
@@ -534,6 +929,9 @@ int schedule_anticipate(struct schedule_helper *sh, double *t) {
   int i, j;
   double earliest_t = DBL_MAX;
 
+  if (flush_deferred(sh))
+    sh->error = 1;
+
   if (sh->current != NULL) {
     *t = sh->now;
     return 1;
@@ -565,6 +963,68 @@ int schedule_anticipate(struct schedule_helper *sh, double *t) {
     return 0;
 }
 
+/*************************************************************************
+cleanup_slot:
+  In: top tier of the scheduler
+      tier holding the slot
+      index of the slot
+      function telling whether an abstract_element is defunct
+      list the defunct items are pushed onto
+  Out: number of items examined.  The defunct items of the slot are moved
+       to the list, and the counts of this tier and the ones above it are
+       updated.
+*************************************************************************/
+
+static int cleanup_slot(struct schedule_helper *top, struct schedule_helper *sh,
+                        int i, int (*is_defunct)(struct abstract_element *),
+                        struct abstract_element **defunct_list) {
+  int n_scanned = sh->circ_buf_count[i];
+  int n_removed = 0;
+  struct abstract_element *temp;
+
+#ifdef SCHED_UTIL_KEEP_STATS
+  sh->stats.cleanup_scanned += n_scanned;
+#endif
+  /* Remove defunct elements from beginning of list */
+  while (sh->circ_buf_head[i] != NULL && (*is_defunct)(sh->circ_buf_head[i])) {
+    temp = sh->circ_buf_head[i]->next;
+    sh->circ_buf_head[i]->next = *defunct_list;
+    *defunct_list = sh->circ_buf_head[i];
+    sh->circ_buf_head[i] = temp;
+    n_removed++;
+  }
+
+  if (sh->circ_buf_head[i] == NULL) {
+    sh->circ_buf_tail[i] = NULL;
+  } else {
+    /* Now remove defunct elements from later in list */
+    for (struct abstract_element *ae = sh->circ_buf_head[i]; ae != NULL;
+         ae = ae->next) {
+      while (ae->next != NULL && (*is_defunct)(ae->next)) {
+        temp = ae->next->next;
+        ae->next->next = *defunct_list;
+        *defunct_list = ae->next;
+        ae->next = temp;
+        n_removed++;
+      }
+      if (ae->next == NULL) {
+        sh->circ_buf_tail[i] = ae;
+        break;
+      }
+    }
+  }
+
+  sh->circ_buf_count[i] -= n_removed;
+  for (struct schedule_helper *shp = top; shp != sh; shp = shp->next_scale)
+    shp->count -= n_removed;
+  sh->count -= n_removed;
+#ifdef SCHED_UTIL_KEEP_STATS
+  sh->stats.cleanup_removed += n_removed;
+#endif
+  top->gc_removed += n_removed;
+  return n_scanned;
+}
+
 /*************************************************************************
 schedule_cleanup:
   In: scheduler that we are using
@@ -578,60 +1038,159 @@ schedule_cleanup:
 struct abstract_element *
 schedule_cleanup(struct schedule_helper *sh,
                  int (*is_defunct)(struct abstract_element*)) {
-  struct abstract_element *defunct_list;
-  struct abstract_element *ae;
-  struct abstract_element *temp;
-  struct schedule_helper *top;
-  struct schedule_helper *shp;
-  int i;
+  struct abstract_element *defunct_list = NULL;
+  struct schedule_helper *top = sh;
 
-  defunct_list = NULL;
+  if (flush_deferred(sh))
+    sh->error = 1;
 
-  top = sh;
+#ifdef SCHED_UTIL_KEEP_STATS
+  top->stats.cleanups++;
+#endif
   for (; sh != NULL; sh = sh->next_scale) {
     sh->defunct_count = 0;
+    for (int i = 0; i < sh->buf_len; i++)
+      cleanup_slot(top, sh, i, is_defunct, &defunct_list);
+  }
+  top->gc_tier = NULL;
+  top->gc_removed = 0;
 
-    for (i = 0; i < sh->buf_len; i++) {
-      /* Remove defunct elements from beginning of list */
-      while (sh->circ_buf_head[i] != NULL &&
-             (*is_defunct)(sh->circ_buf_head[i])) {
-        temp = sh->circ_buf_head[i]->next;
-        sh->circ_buf_head[i]->next = defunct_list;
-        defunct_list = sh->circ_buf_head[i];
-        sh->circ_buf_head[i] = temp;
-        sh->circ_buf_count[i]--;
-        sh->count--;
-        for (shp = top; shp != sh; shp = shp->next_scale)
-          shp->count--;
-      }
+  return defunct_list;
+}
 
-      if (sh->circ_buf_head[i] == NULL) {
-        sh->circ_buf_tail[i] = NULL;
-      } else {
-        /* Now remove defunct elements from later in list */
-        for (ae = sh->circ_buf_head[i]; ae != NULL; ae = ae->next) {
-          while (ae->next != NULL && (*is_defunct)(ae->next)) {
-            temp = ae->next->next;
-            ae->next->next = defunct_list;
-            defunct_list = ae->next;
-            ae->next = temp;
-            sh->circ_buf_count[i]--;
-            sh->count--;
-            for (shp = top; shp != sh; shp = shp->next_scale)
-              shp->count--;
-          }
-          if (ae->next == NULL) {
-            sh->circ_buf_tail[i] = ae;
-            break;
-          }
-        }
-      }
+/*************************************************************************
+schedule_cleanup_step:
+  In: scheduler that we are using
+      pointer to a function that will return 0 if an abstract_element is
+        okay, or 1 if it is defunct
+      number of items to examine, roughly
+  Out: the defunct items found, as a linked list.  This is schedule_cleanup
+       spread over several calls: each call resumes where the last one
+       stopped and examines whole slots until it has seen max_items items.
+       Returns with sh->gc_tier set to NULL once every slot has been seen,
+       at which point defunct_count no longer counts the defunct items
+       that had already left the scheduler when the pass began.
+*************************************************************************/
+
+struct abstract_element *
+schedule_cleanup_step(struct schedule_helper *sh,
+                      int (*is_defunct)(struct abstract_element *),
+                      int max_items) {
+  struct abstract_element *defunct_list = NULL;
+
+  if (flush_deferred(sh))
+    sh->error = 1;
+
+  if (sh->gc_tier == NULL) {
+#ifdef SCHED_UTIL_KEEP_STATS
+    sh->stats.cleanups++;
+#endif
+    sh->gc_tier = sh;
+    sh->gc_slot = 0;
+    sh->gc_expected = sh->defunct_count;
+    sh->gc_removed = 0;
+  }
+
+  int n_scanned = 0;
+  while (sh->gc_tier != NULL && n_scanned < max_items) {
+    n_scanned += cleanup_slot(sh, sh->gc_tier, sh->gc_slot, is_defunct,
+                              &defunct_list);
+    if (++sh->gc_slot == sh->gc_tier->buf_len) {
+      sh->gc_tier = sh->gc_tier->next_scale;
+      sh->gc_slot = 0;
     }
   }
 
+  /* New defunct items are counted as they come, so only the removed ones
+   * come off; items that were never found are dropped when the pass
+   * ends, as schedule_cleanup would */
+  int removed = sh->gc_removed;
+  sh->gc_removed = 0;
+  sh->gc_expected -= removed;
+  sh->defunct_count -= removed;
+  if (sh->gc_tier == NULL && sh->gc_expected > 0)
+    sh->defunct_count -= sh->gc_expected;
+  if (sh->defunct_count < 0)
+    sh->defunct_count = 0;
+
   return defunct_list;
 }
 
+/* Bits of the key sorted on in each pass of schedule_sort_current */
+#define SCHED_SORT_RADIX_BITS 8
+#define SCHED_SORT_RADIX (1 << SCHED_SORT_RADIX_BITS)
+
+/*************************************************************************
+schedule_sort_current:
+  In: scheduler that we are using
+      pointer to a function giving the key of an abstract_element, at most
+        max_key
+      data passed on to the key function
+      largest key
+  Out: 0 on success, 1 on memory allocation failure.  The items scheduled
+       now are reordered by key with a radix sort, a pass per
+       SCHED_SORT_RADIX_BITS bits of max_key.  Each key is looked up once.
+       Items with equal keys keep their order, so the result only depends
+       on the order the items were scheduled in.
+*************************************************************************/
+
+int schedule_sort_current(struct schedule_helper *sh,
+                          unsigned int (*key)(struct abstract_element *,
+                                              void *),
+                          void *data, unsigned int max_key) {
+  if (sh->current == NULL || sh->current->next == NULL)
+    return 0;
+
+  int n = 0;
+  for (struct abstract_element *ae = sh->current; ae != NULL; ae = ae->next)
+    n++;
+  if (2 * n > sh->sort_items_len) {
+    struct schedule_sort_item *items = (struct schedule_sort_item *)realloc(
+        sh->sort_items, 4 * n * sizeof(struct schedule_sort_item));
+    if (items == NULL)
+      return 1;
+    sh->sort_items = items;
+    sh->sort_items_len = 4 * n;
+  }
+
+  struct schedule_sort_item *from = sh->sort_items;
+  struct schedule_sort_item *to = sh->sort_items + n;
+  int i = 0;
+  for (struct abstract_element *ae = sh->current; ae != NULL; ae = ae->next) {
+    from[i].key = (*key)(ae, data);
+    from[i].ae = ae;
+    i++;
+  }
+
+  unsigned int shift = 0;
+  do {
+    int start[SCHED_SORT_RADIX];
+    memset(start, 0, sizeof(start));
+    for (i = 0; i < n; i++)
+      start[(from[i].key >> shift) & (SCHED_SORT_RADIX - 1)]++;
+    int sum = 0;
+    for (int b = 0; b < SCHED_SORT_RADIX; b++) {
+      int count = start[b];
+      start[b] = sum;
+      sum += count;
+    }
+    for (i = 0; i < n; i++)
+      to[start[(from[i].key >> shift) & (SCHED_SORT_RADIX - 1)]++] = from[i];
+
+    struct schedule_sort_item *swap = from;
+    from = to;
+    to = swap;
+    shift += SCHED_SORT_RADIX_BITS;
+  } while (shift < 8 * sizeof(unsigned int) && (max_key >> shift) != 0);
+
+  for (i = 0; i < n - 1; i++)
+    from[i].ae->next = from[i + 1].ae;
+  from[n - 1].ae->next = NULL;
+  sh->current = from[0].ae;
+  sh->current_tail = from[n - 1].ae;
+  return 0;
+}
+
 /*************************************************************************
 delete_scheduler:
   In: scheduler that we are using
@@ -646,6 +1205,57 @@ void delete_scheduler(struct schedule_helper *sh) {
       free(sh->circ_buf_head);
     if (sh->circ_buf_count)
       free(sh->circ_buf_count);
+    free(sh->sort_items);
+    free(sh->deferred);
     free(sh);
   }
 }
+
+#ifdef SCHED_UTIL_KEEP_STATS
+/*************************************************************************
+schedule_dump_stats:
+  In: file handle to write to
+      scheduler that we are using
+      name to print for the scheduler
+  Out: No return value.  The instrumentation counters of every tier are
+       written to the file.
+*************************************************************************/
+void schedule_dump_stats(FILE *out, struct schedule_helper *sh,
+                         char const *name) {
+  fprintf(out, "Scheduler %s\n", name);
+  fprintf(out, "---------------------\n");
+  fprintf(out, "schedule_next calls:   %lld (%.6f s)\n", sh->stats.next_calls,
+          sh->stats.next_seconds);
+  fprintf(out, "Cleanups:              %lld\n", sh->stats.cleanups);
+
+  for (; sh != NULL; sh = sh->next_scale) {
+    fprintf(out, "Tier %d (dt %g, %d slots):\n", sh->depth, sh->dt,
+            sh->buf_len);
+    fprintf(out, "  Scheduled items:     %d (%d defunct)\n", sh->count,
+            sh->defunct_count);
+    fprintf(out, "  Slots advanced:      %lld\n", sh->stats.slots_advanced);
+    fprintf(out, "  Max slot occupancy:  %lld\n", sh->stats.max_occupancy);
+    fprintf(out, "  Cascades in:         %lld (%lld items)\n",
+            sh->stats.cascades, sh->stats.cascaded_items);
+    fprintf(out, "  Cleanup work:        %lld scanned, %lld purged\n",
+            sh->stats.cleanup_scanned, sh->stats.cleanup_removed);
+    fprintf(out, "  Occupancy histogram:\n");
+    for (int bin = 0; bin < SCHED_STATS_HIST_BINS; bin++) {
+      if (sh->stats.occupancy_hist[bin] == 0)
+        continue;
+      long long lo = bin ? (1LL << (bin - 1)) : 0;
+      long long hi = bin ? (1LL << bin) - 1 : 0;
+      if (bin == SCHED_STATS_HIST_BINS - 1)
+        fprintf(out, "    %lld+ items: %lld\n", lo,
+                sh->stats.occupancy_hist[bin]);
+      else if (lo == hi)
+        fprintf(out, "    %lld items: %lld\n", lo,
+                sh->stats.occupancy_hist[bin]);
+      else
+        fprintf(out, "    %lld-%lld items: %lld\n", lo, hi,
+                sh->stats.occupancy_hist[bin]);
+    }
+  }
+  fprintf(out, "\n");
+}
+#endif
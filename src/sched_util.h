@@ -30,6 +30,45 @@ struct abstract_element {
   double t; /* Time at which the element is scheduled */
 };
 
+/* An item of the list being sorted by schedule_sort_current */
+struct schedule_sort_item {
+  unsigned int key;
+  struct abstract_element *ae;
+};
+
+#ifdef SCHED_UTIL_KEEP_STATS
+#include <stdio.h>
+
+/* Number of power-of-two bins in the slot occupancy histogram */
+#define SCHED_STATS_HIST_BINS 20
+
+/* Instrumentation counters for one tier of a scheduler */
+struct schedule_stats {
+  long long slots_advanced;   /* Slots drained by schedule_advance */
+  long long max_occupancy;    /* Most items seen in a drained slot */
+  /* Drained slots with 0, 1, 2-3, 4-7, ... items */
+  long long occupancy_hist[SCHED_STATS_HIST_BINS];
+  long long cascades;         /* Coarser slots spread over this tier */
+  long long cascaded_items;   /* Items moved down by those cascades */
+  long long cleanups;         /* Calls to schedule_cleanup */
+  long long cleanup_scanned;  /* Items examined by schedule_cleanup */
+  long long cleanup_removed;  /* Defunct items purged by schedule_cleanup */
+  long long next_calls;       /* Calls to schedule_next */
+  double next_seconds;        /* Wall time spent in schedule_next */
+};
+#endif
+
+/* Schedulers advanced in step, whose members may stop advancing while they
+ * are empty.  An idle member catches up with the group when an item is
+ * added to it and is listed in woken, so the caller can advance it again. */
+struct schedule_group {
+  double now;     /* Time the members that are not idle have reached */
+  void **woken;   /* Owners of the members woken since woken was emptied */
+  int n_woken;
+  int woken_len;
+  int error;      /* Set if woken could not be grown */
+};
+
 /* Implements a multi-scale, discretized event scheduler */
 struct schedule_helper {
   struct schedule_helper *next_scale; /* Next coarser time scale */
@@ -57,8 +96,44 @@ struct schedule_helper {
   int defunct_count; /* Number of defunct items (set by user)*/
   int error;         /* Error code (1 - on error, 0 - no errors) */
   int depth;         /* "Tier" of scheduler in timescale hierarchy, 0-based */
+
+  /* Scratch space of schedule_sort_current */
+  struct schedule_sort_item *sort_items;
+  int sort_items_len;
+
+  /* Position of the cleanup pass in progress (see schedule_cleanup_step);
+   * gc_tier is NULL between passes */
+  struct schedule_helper *gc_tier;
+  int gc_slot;
+  int gc_expected; /* Defunct items counted when the pass began, not found
+                      yet */
+  int gc_removed;  /* Removed by cleanup_slot, not yet taken off
+                      defunct_count */
+
+  /* Items queued by schedule_insert_deferred, not linked in yet */
+  struct abstract_element **deferred;
+  int n_deferred;
+  int deferred_len;
+
+  /* Group this scheduler is a member of, or NULL (see schedule_join_group) */
+  struct schedule_group *group;
+  void *group_owner; /* Listed in the group's woken list */
+  int idle;          /* Set while the scheduler is left behind the group */
+
+#ifdef SCHED_UTIL_KEEP_STATS
+  struct schedule_stats stats;
+#endif
 };
 
+#ifdef SCHED_UTIL_KEEP_STATS
+void schedule_dump_stats(FILE *out, struct schedule_helper *sh,
+                         char const *name);
+#else
+#define schedule_dump_stats(out, sh, name)                                     \
+  do { /* do nothing */                                                        \
+  } while (0)
+#endif
+
 struct abstract_element *ae_list_sort(struct abstract_element *ae);
 
 struct schedule_helper *create_scheduler(double dt_min, double dt_max,
@@ -66,6 +141,11 @@ struct schedule_helper *create_scheduler(double dt_min, double dt_max,
 
 int schedule_insert(struct schedule_helper *sh, void *data,
                     int put_neg_in_current);
+int schedule_insert_batch(struct schedule_helper *sh,
+                          struct abstract_element **items, int n,
+                          int put_neg_in_current);
+int schedule_insert_deferred(struct schedule_helper *sh, void *data);
+int schedule_flush_deferred(struct schedule_helper *sh);
 int schedule_deschedule(struct schedule_helper *sh, void *data);
 int schedule_reschedule(struct schedule_helper *sh, void *data, double new_t);
 /*void schedule_excert(struct schedule_helper *sh,void *data,void *blank,int
@@ -81,5 +161,19 @@ int schedule_anticipate(struct schedule_helper *sh, double *t);
 struct abstract_element *
 schedule_cleanup(struct schedule_helper *sh,
                  int (*is_defunct)(struct abstract_element *e));
+struct abstract_element *
+schedule_cleanup_step(struct schedule_helper *sh,
+                      int (*is_defunct)(struct abstract_element *e),
+                      int max_items);
+
+int schedule_sort_current(struct schedule_helper *sh,
+                          unsigned int (*key)(struct abstract_element *,
+                                              void *),
+                          void *data, unsigned int max_key);
 
 void delete_scheduler(struct schedule_helper *sh);
+
+void schedule_join_group(struct schedule_helper *sh,
+                         struct schedule_group *group, void *owner);
+int schedule_is_empty(struct schedule_helper const *sh);
+void schedule_set_idle(struct schedule_helper *sh);
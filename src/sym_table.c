@@ -178,18 +178,24 @@ unsigned long hash(char const *sym) {
   return (hashval);
 }
 
+/* Finds sym in its bin, given its hash.  The hash is compared before the
+ * name, and names which are the table's own copy match without strcmp. */
+static struct sym_entry *find_sym(char const *sym, unsigned long hashval,
+                                  struct sym_table_head *hashtab) {
+  for (struct sym_entry *sp = hashtab->entries[hashval & (hashtab->n_bins - 1)];
+       sp != NULL; sp = sp->next) {
+    if (sp->hashval == hashval && (sp->name == sym || strcmp(sym, sp->name) == 0))
+      return sp;
+  }
+  return NULL;
+}
+
 struct sym_entry *retrieve_sym(char const *sym,
                                struct sym_table_head *hashtab) {
   if (sym == NULL)
     return NULL;
 
-  for (struct sym_entry *sp =
-           hashtab->entries[hash(sym) & (hashtab->n_bins - 1)];
-       sp != NULL; sp = sp->next) {
-    if (strcmp(sym, sp->name) == 0)
-      return sp;
-  }
-  return NULL;
+  return find_sym(sym, hash(sym), hashtab);
 }
 
 /**
@@ -218,6 +224,11 @@ struct species *new_species(void) {
   specp->transp_mols = NULL;
   specp->absorb_mols = NULL;
   specp->clamp_conc_mols = NULL;
+  specp->rx_partners = NULL;
+  specp->rx_partner_bloom = NULL;
+  specp->unimol_rx = NULL;
+  specp->unimol_rx_known = 0;
+  specp->lifetime_epoch = 0;
 
   return specp;
 }
@@ -281,6 +292,7 @@ struct object *new_object(void) {
   objp->n_tiles = 0;
   objp->n_occupied_tiles = 0;
   init_matrix(objp->t_matrix);
+  objp->world_verts = NULL;
   return objp;
 }
 
@@ -318,15 +330,23 @@ struct rxn *new_reaction(void) {
   rxnp->max_fixed_p = 0.0;
   rxnp->min_noreaction_p = 0.0;
   rxnp->pb_factor = 0.0;
+  rxnp->pathway_guide = NULL;
+  rxnp->guide_scale = 0.0;
   rxnp->product_idx = NULL;
   rxnp->players = NULL;
   rxnp->nfsim_players = NULL;
   rxnp->geometries = NULL;
   rxnp->n_occurred = 0;
+  rxnp->n_failed = 0;
   rxnp->n_skipped = 0;
+  rxnp->rate_cursors = NULL;
+  rxnp->n_rate_cursors = 0;
   rxnp->prob_t = NULL;
   rxnp->pathway_head = NULL;
   rxnp->info = NULL;
+  rxnp->external_reaction_data = NULL;
+  rxnp->reactant_graph_data = NULL;
+  rxnp->product_graph_data = NULL;
   return rxnp;
 }
 
@@ -368,6 +388,7 @@ struct region *new_region(void) {
   rp->volume = 0.0;
   rp->boundaries = NULL;
   rp->region_has_all_elements = 0;
+  rp->species_counters = NULL;
   return rp;
 }
 
@@ -388,7 +409,7 @@ struct file_stream *new_filestream(void) {
 
 /**
  * resize_symtab:
- *      Resize the symbol table, rehashing all values.
+ *      Resize the symbol table, rebinning all values by their stored hashes.
  *
  *      In:  hashtab: the symbol table
  *           size: new size for hash table
@@ -423,7 +444,7 @@ static int resize_symtab(struct sym_table_head *hashtab, int size) {
       struct sym_entry *entry = entries[i];
       entries[i] = entries[i]->next;
 
-      unsigned long hashval = hash(entry->name) & (size - 1);
+      unsigned long hashval = entry->hashval & (size - 1);
       entry->next = hashtab->entries[hashval];
       hashtab->entries[hashval] = entry;
     }
@@ -484,7 +505,8 @@ struct sym_entry *store_sym(char const *sym, enum symbol_type_t sym_type,
   unsigned long rawhash;
 
   /* try to find sym in table */
-  if ((sp = retrieve_sym(sym, hashtab)) == NULL) {
+  rawhash = hash(sym);
+  if ((sp = find_sym(sym, rawhash, hashtab)) == NULL) {
     maybe_grow_symtab(hashtab);
     ++hashtab->n_entries;
 
@@ -493,7 +515,7 @@ struct sym_entry *store_sym(char const *sym, enum symbol_type_t sym_type,
     sp->name = CHECKED_STRDUP(sym, "symbol name");
     sp->sym_type = sym_type;
     sp->count = 1;
-    rawhash = hash(sym);
+    sp->hashval = rawhash;
     hashval = rawhash & (hashtab->n_bins - 1);
 
     sp->next = hashtab->entries[hashval];
@@ -0,0 +1,579 @@
+/******************************************************************************
+ *
+ * Copyright (C) 2006-2017 by
+ * The Salk Institute for Biological Studies and
+ * Pittsburgh Supercomputing Center, Carnegie Mellon University
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ *
+******************************************************************************/
+
+/**************************************************************************\
+** File: text_output.c                                                    **
+**                                                                        **
+** Purpose: Formats the numbers of the text outputs (reaction data,       **
+**    triggers, ASCII visualization and volume output) without going      **
+**    through printf.                                                     **
+**                                                                        **
+** format_double writes a double the way printf's "%.<precision>g" does.  **
+** The value is scaled by a power of ten into 64.64 fixed point with an   **
+** error bound, in the manner of Grisu; the digits are taken straight     **
+** from that unless the rounding is too close to call, in which case      **
+** printf is used after all.  With shortest set it writes instead the     **
+** fewest digits that read back as the same double, which is the same     **
+** text whenever "%.<precision>g" already was that short.                 **
+\**************************************************************************/
+
+#include "config.h"
+
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "text_output.h"
+
+/* For N up to this, %.Ng is the shortest text reading back as the double
+ * whenever that has at most N digits */
+#define MAX_EXACT_PRECISION 15
+
+/* x * 10^k for the k used here is a 64 bit significand c and a binary
+ * exponent b, x = c * 2^b with c rounded to nearest */
+struct cached_pow10 {
+  uint64_t c;
+  int b;
+};
+
+/* 10^(8 i) for i from -37 to 42 */
+#define POW10_CACHE_MIN (-37)
+static const struct cached_pow10 pow10_cache[] = {
+  { 0xd1476e2c07286faaULL, -1047 }, { 0x9becce62836ac577ULL, -1020 },
+  { 0xe858ad248f5c22caULL, -994 }, { 0xad1c8eab5ee43b67ULL, -967 },
+  { 0x80fa687f881c7f8eULL, -940 }, { 0xc0314325637a193aULL, -914 },
+  { 0x8f31cc0937ae58d3ULL, -887 }, { 0xd5605fcdcf32e1d7ULL, -861 },
+  { 0x9efa548d26e5a6e2ULL, -834 }, { 0xece53cec4a314ebeULL, -808 },
+  { 0xb080392cc4349dedULL, -781 }, { 0x8380dea93da4bc60ULL, -754 },
+  { 0xc3f490aa77bd60fdULL, -728 }, { 0x91ff83775423cc06ULL, -701 },
+  { 0xd98ddaee19068c76ULL, -675 }, { 0xa21727db38cb0030ULL, -648 },
+  { 0xf18899b1bc3f8ca2ULL, -622 }, { 0xb3f4e093db73a093ULL, -595 },
+  { 0x8613fd0145877586ULL, -568 }, { 0xc7caba6e7c5382c9ULL, -542 },
+  { 0x94db483840b717f0ULL, -515 }, { 0xddd0467c64bce4a1ULL, -489 },
+  { 0xa54394fe1eedb8ffULL, -462 }, { 0xf64335bcf065d37dULL, -436 },
+  { 0xb77ada0617e3bbcbULL, -409 }, { 0x88b402f7fd75539bULL, -382 },
+  { 0xcbb41ef979346bcaULL, -356 }, { 0x97c560ba6b0919a6ULL, -329 },
+  { 0xe2280b6c20dd5232ULL, -303 }, { 0xa87fea27a539e9a5ULL, -276 },
+  { 0xfb158592be068d2fULL, -250 }, { 0xbb127c53b17ec159ULL, -223 },
+  { 0x8b61313bbabce2c6ULL, -196 }, { 0xcfb11ead453994baULL, -170 },
+  { 0x9abe14cd44753b53ULL, -143 }, { 0xe69594bec44de15bULL, -117 },
+  { 0xabcc77118461cefdULL, -90 }, { 0x8000000000000000ULL, -63 },
+  { 0xbebc200000000000ULL, -37 }, { 0x8e1bc9bf04000000ULL, -10 },
+  { 0xd3c21bcecceda100ULL, 16 }, { 0x9dc5ada82b70b59eULL, 43 },
+  { 0xeb194f8e1ae525fdULL, 69 }, { 0xaf298d050e4395d7ULL, 96 },
+  { 0x82818f1281ed44a0ULL, 123 }, { 0xc2781f49ffcfa6d5ULL, 149 },
+  { 0x90e40fbeea1d3a4bULL, 176 }, { 0xd7e77a8f87daf7fcULL, 202 },
+  { 0xa0dc75f1778e39d6ULL, 229 }, { 0xefb3ab16c59b14a3ULL, 255 },
+  { 0xb2977ee300c50fe7ULL, 282 }, { 0x850fadc09923329eULL, 309 },
+  { 0xc646d63501a1511eULL, 335 }, { 0x93ba47c980e98ce0ULL, 362 },
+  { 0xdc21a1171d42645dULL, 388 }, { 0xa402b9c5a8d3a6e7ULL, 415 },
+  { 0xf46518c2ef5b8cd1ULL, 441 }, { 0xb616a12b7fe617aaULL, 468 },
+  { 0x87aa9aff79042287ULL, 495 }, { 0xca28a291859bbf93ULL, 521 },
+  { 0x969eb7c47859e744ULL, 548 }, { 0xe070f78d3927556bULL, 574 },
+  { 0xa738c6bebb12d16dULL, 601 }, { 0xf92e0c3537826146ULL, 627 },
+  { 0xb9a74a0637ce2ee1ULL, 654 }, { 0x8a5296ffe33cc930ULL, 681 },
+  { 0xce1de40642e3f4b9ULL, 707 }, { 0x9991a6f3d6bf1766ULL, 734 },
+  { 0xe4d5e82392a40515ULL, 760 }, { 0xaa7eebfb9df9de8eULL, 787 },
+  { 0xfe0efb53d30dd4d8ULL, 813 }, { 0xbd49d14aa79dbc82ULL, 840 },
+  { 0x8d07e33455637eb3ULL, 867 }, { 0xd226fc195c6a2f8cULL, 893 },
+  { 0x9c935e00d4b9d8d2ULL, 920 }, { 0xe950df20247c83fdULL, 946 },
+  { 0xadd57a27d29339f6ULL, 973 }, { 0x81842f29f2cce376ULL, 1000 },
+  { 0xc0fe908895cf3b44ULL, 1026 }, { 0x8fcac257558ee4e6ULL, 1053 },
+};
+
+static const uint64_t pow10_u64[] = {
+  1ULL,
+  10ULL,
+  100ULL,
+  1000ULL,
+  10000ULL,
+  100000ULL,
+  1000000ULL,
+  10000000ULL,
+  100000000ULL,
+  1000000000ULL,
+  10000000000ULL,
+  100000000000ULL,
+  1000000000000ULL,
+  10000000000000ULL,
+  100000000000000ULL,
+  1000000000000000ULL,
+  10000000000000000ULL,
+  100000000000000000ULL,
+  1000000000000000000ULL,
+};
+
+/* Scaled values have 17 digits before the point */
+#define SCALED_DIGITS 17
+
+struct u128 {
+  uint64_t hi;
+  uint64_t lo;
+};
+
+static struct u128 mul_64x64(uint64_t a, uint64_t b) {
+  uint64_t a_lo = (uint32_t)a, a_hi = a >> 32;
+  uint64_t b_lo = (uint32_t)b, b_hi = b >> 32;
+  uint64_t p0 = a_lo * b_lo;
+  uint64_t p1 = a_lo * b_hi;
+  uint64_t p2 = a_hi * b_lo;
+  uint64_t p3 = a_hi * b_hi;
+  uint64_t mid = (p0 >> 32) + (uint32_t)p1 + (uint32_t)p2;
+  struct u128 r;
+  r.lo = (mid << 32) | (uint32_t)p0;
+  r.hi = p3 + (p1 >> 32) + (p2 >> 32) + (mid >> 32);
+  return r;
+}
+
+/* Shifts by 0 to 127 bits */
+static struct u128 shl_128(struct u128 a, int s) {
+  struct u128 r;
+  if (s == 0)
+    return a;
+  if (s >= 64) {
+    r.hi = a.lo << (s - 64);
+    r.lo = 0;
+  } else {
+    r.hi = (a.hi << s) | (a.lo >> (64 - s));
+    r.lo = a.lo << s;
+  }
+  return r;
+}
+
+static struct u128 shr_128(struct u128 a, int s) {
+  struct u128 r;
+  if (s == 0)
+    return a;
+  if (s >= 64) {
+    r.hi = 0;
+    r.lo = a.hi >> (s - 64);
+  } else {
+    r.hi = a.hi >> s;
+    r.lo = (a.lo >> s) | (a.hi << (64 - s));
+  }
+  return r;
+}
+
+static int cmp_128(struct u128 a, struct u128 b) {
+  if (a.hi != b.hi)
+    return (a.hi < b.hi) ? -1 : 1;
+  if (a.lo != b.lo)
+    return (a.lo < b.lo) ? -1 : 1;
+  return 0;
+}
+
+static struct u128 sub_128(struct u128 a, struct u128 b) {
+  struct u128 r;
+  r.lo = a.lo - b.lo;
+  r.hi = a.hi - b.hi - (a.lo < b.lo);
+  return r;
+}
+
+/*************************************************************************
+get_pow10:
+  In: k: decimal exponent, for which k / 8 rounded down is covered by
+         pow10_cache
+      c, b: set so that 10^k = c * 2^b to within 2^-63 relative, with c
+            normalized to the top bit
+  Out: No return value.
+*************************************************************************/
+static void get_pow10(int k, uint64_t *c, int *b) {
+  int i = (k >= 0) ? k / 8 : -((7 - k) / 8);
+  int j = k - 8 * i;
+  struct cached_pow10 const *cp = &pow10_cache[i - POW10_CACHE_MIN];
+  if (j == 0) {
+    *c = cp->c;
+    *b = cp->b;
+    return;
+  }
+
+  /* At most 88 bits, so the top 64 bits are all in hi and the next */
+  struct u128 p = mul_64x64(cp->c, pow10_u64[j]);
+  int shift = 0;
+  while ((p.hi >> shift) != 0)
+    shift++;
+  uint64_t top = shr_128(p, shift).lo;
+  if ((shr_128(p, shift - 1).lo & 1) != 0 && ++top == 0) {
+    top = 1ULL << 63;
+    shift++;
+  }
+  *c = top;
+  *b = cp->b + shift;
+}
+
+/* A double scaled by a power of ten */
+struct scaled_double {
+  struct u128 y;    /* x 10^k as 64.64 fixed point, with SCALED_DIGITS
+                       digits before the point */
+  struct u128 half; /* Half the gap to the next double, scaled the same */
+  uint64_t err;     /* Bound on the error of y and half */
+  int exp10;        /* Decimal exponent of the leading digit of x */
+  int closer_below; /* The gap to the previous double is half as wide */
+};
+
+/*************************************************************************
+scale_double:
+  In: x: positive, finite double
+      sd: the result
+  Out: 1 if x was scaled, 0 if it couldn't be.
+*************************************************************************/
+static int scale_double(double x, struct scaled_double *sd) {
+  uint64_t bits;
+  memcpy(&bits, &x, sizeof(bits));
+  int exp_bits = (int)((bits >> 52) & 0x7ff);
+  uint64_t f = bits & ((1ULL << 52) - 1);
+  int e;
+  if (exp_bits == 0) {
+    e = -1074;
+  } else {
+    f |= 1ULL << 52;
+    e = exp_bits - 1075;
+  }
+  sd->closer_below = (f == (1ULL << 52) && exp_bits > 1);
+
+  int exp10 = (int)floor(log10(x));
+  for (int tries = 0; tries < 3; tries++) {
+    int k = SCALED_DIGITS - 1 - exp10;
+    uint64_t c;
+    int b;
+    get_pow10(k, &c, &b);
+    struct u128 p = mul_64x64(f, c);
+    int s = e + b + 64;
+    if (s >= 128 || s <= -128 || s - 1 >= 128)
+      return 0;
+    sd->y = (s >= 0) ? shl_128(p, s) : shr_128(p, -s);
+    if (sd->y.hi >= pow10_u64[SCALED_DIGITS]) {
+      exp10++;
+      continue;
+    }
+    if (sd->y.hi < pow10_u64[SCALED_DIGITS - 1]) {
+      exp10--;
+      continue;
+    }
+
+    struct u128 cc = { 0, c };
+    sd->half = (s >= 1) ? shl_128(cc, s - 1) : shr_128(cc, 1 - s);
+    sd->err = shr_128(sd->y, 62).lo + 2;
+    sd->exp10 = exp10;
+    return 1;
+  }
+  return 0;
+}
+
+/*************************************************************************
+round_scaled:
+  In: sd: scaled double
+      n: number of significant digits, 1 to SCALED_DIGITS
+      digits: set to the n digits of x correctly rounded to n digits
+  Out: 1 on success, 0 if the true value may be too close to halfway for
+       the rounding to be decided.  sd->exp10 is updated if the rounding
+       carries into another digit.
+*************************************************************************/
+static int round_scaled(struct scaled_double *sd, int n, uint64_t *digits) {
+  uint64_t unit = pow10_u64[SCALED_DIGITS - n];
+  uint64_t q = sd->y.hi / unit;
+  struct u128 rem = { sd->y.hi % unit, sd->y.lo };
+  struct u128 half = { unit >> 1, (unit & 1) ? (1ULL << 63) : 0 };
+  int c = cmp_128(rem, half);
+  struct u128 d = (c >= 0) ? sub_128(rem, half) : sub_128(half, rem);
+  if (d.hi == 0 && d.lo <= sd->err)
+    return 0;
+  if (c > 0 && ++q == pow10_u64[n]) {
+    q = pow10_u64[n - 1];
+    sd->exp10++;
+  }
+  *digits = q;
+  return 1;
+}
+
+/* Whether a distance d is below bound: 1 if it certainly is, 0 if it
+ * certainly isn't and -1 if they are within margin of each other */
+static int below_bound(struct u128 d, struct u128 bound, struct u128 margin) {
+  struct u128 lower = (cmp_128(bound, margin) > 0) ? sub_128(bound, margin)
+                                                    : (struct u128) { 0, 0 };
+  if (cmp_128(d, lower) < 0)
+    return 1;
+  struct u128 upper = { bound.hi + (bound.lo + margin.lo < bound.lo),
+                        bound.lo + margin.lo };
+  if (cmp_128(d, upper) > 0)
+    return 0;
+  return -1;
+}
+
+/*************************************************************************
+shortest_scaled:
+  In: sd: scaled double
+      digits: set to the shortest digits which read back as x, the nearest
+              to x if there are two
+      n: set to their number
+  Out: 1 on success, 0 if the error of the scaling leaves it open which
+       digits those are.  sd->exp10 is updated if the digits carry into
+       another digit.
+*************************************************************************/
+static int shortest_scaled(struct scaled_double *sd, uint64_t *digits,
+                           int *n) {
+  struct u128 margin = { 0, sd->err + 1 };
+  struct u128 above = sd->half;
+  struct u128 below = sd->closer_below ? shr_128(sd->half, 1) : sd->half;
+
+  for (int i = 1; i <= SCALED_DIGITS; i++) {
+    uint64_t unit = pow10_u64[SCALED_DIGITS - i];
+    uint64_t q = sd->y.hi / unit;
+    struct u128 down = { sd->y.hi % unit, sd->y.lo };
+    struct u128 step = { unit, 0 };
+    struct u128 up = sub_128(step, down);
+    int down_ok = below_bound(down, below, margin);
+    int up_ok = below_bound(up, above, margin);
+    if (down_ok != 1 && up_ok != 1) {
+      if (down_ok < 0 || up_ok < 0)
+        return 0;
+      continue;
+    }
+
+    int use_up = (down_ok != 1);
+    if (down_ok == 1 && up_ok == 1) {
+      /* Both read back as x; take the nearer */
+      struct u128 gap = (cmp_128(up, down) < 0) ? sub_128(down, up)
+                                                : sub_128(up, down);
+      if (gap.hi == 0 && gap.lo <= 2 * margin.lo)
+        return 0;
+      use_up = (cmp_128(up, down) < 0);
+    }
+    if (use_up && ++q == pow10_u64[i]) {
+      q = pow10_u64[i - 1];
+      sd->exp10++;
+    }
+    *digits = q;
+    *n = i;
+    return 1;
+  }
+  return 0;
+}
+
+/*************************************************************************
+layout_g:
+  In: buf: output buffer of FORMAT_DOUBLE_SIZE bytes
+      negative: nonzero to write a minus sign
+      digits: the significant digits, with no leading zeros
+      n: number of digits
+      exp10: decimal exponent of the leading digit
+      precision: precision of the %g conversion deciding the notation
+  Out: length of the text written, laid out as printf's %g lays it out:
+       exponential notation if exp10 < -4 or exp10 >= precision, and no
+       trailing zeros.
+*************************************************************************/
+static int layout_g(char *buf, int negative, uint64_t digits, int n,
+                    int exp10, int precision) {
+  char d[SCALED_DIGITS];
+  for (int i = n - 1; i >= 0; i--) {
+    d[i] = (char)('0' + digits % 10);
+    digits /= 10;
+  }
+  while (n > 1 && d[n - 1] == '0')
+    n--;
+
+  char *p = buf;
+  if (negative)
+    *p++ = '-';
+  if (exp10 < -4 || exp10 >= precision) {
+    *p++ = d[0];
+    if (n > 1) {
+      *p++ = '.';
+      memcpy(p, d + 1, n - 1);
+      p += n - 1;
+    }
+    *p++ = 'e';
+    int x = exp10;
+    if (x < 0) {
+      *p++ = '-';
+      x = -x;
+    } else {
+      *p++ = '+';
+    }
+    if (x >= 100)
+      *p++ = (char)('0' + x / 100);
+    *p++ = (char)('0' + (x / 10) % 10);
+    *p++ = (char)('0' + x % 10);
+  } else if (exp10 >= 0) {
+    for (int i = 0; i <= exp10; i++)
+      *p++ = (i < n) ? d[i] : '0';
+    if (n > exp10 + 1) {
+      *p++ = '.';
+      memcpy(p, d + exp10 + 1, n - exp10 - 1);
+      p += n - exp10 - 1;
+    }
+  } else {
+    *p++ = '0';
+    *p++ = '.';
+    for (int i = -1; i > exp10; i--)
+      *p++ = '0';
+    memcpy(p, d, n);
+    p += n;
+  }
+  *p = '\0';
+  return (int)(p - buf);
+}
+
+/* Shortest text printf gives which reads back as x */
+static int shortest_printf(char *buf, double x) {
+  for (int precision = MAX_EXACT_PRECISION; precision < SCALED_DIGITS;
+       precision++) {
+    int len = snprintf(buf, FORMAT_DOUBLE_SIZE, "%.*g", precision, x);
+    if (strtod(buf, NULL) == x)
+      return len;
+  }
+  return snprintf(buf, FORMAT_DOUBLE_SIZE, "%.17g", x);
+}
+
+/*************************************************************************
+format_double:
+  In: buf: output buffer of FORMAT_DOUBLE_SIZE bytes
+      x: value to write
+      precision: precision of the %g conversion to match, 1 to 17
+      shortest: nonzero to write the fewest digits that read back as x,
+                laid out as %g would lay out that many digits
+  Out: length of the text, which is the same as printf's "%.*g" unless
+       shortest is set and that would have more digits than needed.
+*************************************************************************/
+int format_double(char *buf, double x, int precision, int shortest) {
+  if (!isfinite(x) || precision < 1 || precision > SCALED_DIGITS)
+    return snprintf(buf, FORMAT_DOUBLE_SIZE, "%.*g", precision, x);
+
+  int negative = (signbit(x) != 0);
+  double ax = fabs(x);
+  if (ax == 0.0)
+    return layout_g(buf, negative, 0, 1, 0, precision);
+
+  /* Whole numbers with at most precision digits, e.g. counts; above 2^53
+   * the shortest digits may leave some out */
+  if (ax < (double)pow10_u64[precision] && ax == floor(ax) &&
+      (!shortest || ax < 9007199254740992.0)) {
+    uint64_t v = (uint64_t)ax;
+    int n = 1;
+    while (n < SCALED_DIGITS && v >= pow10_u64[n])
+      n++;
+    return layout_g(buf, negative, v, n, n - 1, precision);
+  }
+
+  struct scaled_double sd;
+  uint64_t digits;
+  int n;
+  if (!scale_double(ax, &sd)) {
+    if (shortest)
+      return shortest_printf(buf, x);
+    return snprintf(buf, FORMAT_DOUBLE_SIZE, "%.*g", precision, x);
+  }
+
+  if (shortest) {
+    if (!shortest_scaled(&sd, &digits, &n))
+      return shortest_printf(buf, x);
+    return layout_g(buf, negative, digits, n, sd.exp10,
+                    (n > precision) ? n : precision);
+  }
+
+  if (!round_scaled(&sd, precision, &digits))
+    return snprintf(buf, FORMAT_DOUBLE_SIZE, "%.*g", precision, x);
+  return layout_g(buf, negative, digits, precision, sd.exp10, precision);
+}
+
+/*************************************************************************
+text_writer_init:
+  In: w: writer to set up
+      f: file to write to
+      shortest: nonzero to write doubles with the fewest digits that read
+                back exactly
+  Out: No return value.
+*************************************************************************/
+void text_writer_init(struct text_writer *w, FILE *f, int shortest) {
+  w->f = f;
+  w->shortest = shortest;
+  w->failed = 0;
+  w->n = 0;
+}
+
+/*************************************************************************
+text_writer_flush:
+  In: w: writer
+  Out: 0 if everything written so far reached the file, 1 otherwise.  The
+       buffer is empty.
+*************************************************************************/
+int text_writer_flush(struct text_writer *w) {
+  if (w->n > 0 && fwrite(w->buf, 1, w->n, w->f) != w->n)
+    w->failed = 1;
+  w->n = 0;
+  return w->failed;
+}
+
+/* Makes room for len more bytes */
+static char *text_writer_reserve(struct text_writer *w, size_t len) {
+  if (w->n + len > TEXT_WRITER_SIZE)
+    text_writer_flush(w);
+  return w->buf + w->n;
+}
+
+void text_writer_double(struct text_writer *w, double x, int precision) {
+  char *p = text_writer_reserve(w, FORMAT_DOUBLE_SIZE);
+  w->n += format_double(p, x, precision, w->shortest);
+}
+
+void text_writer_ulong(struct text_writer *w, unsigned long long v) {
+  char d[20];
+  int n = 0;
+  do {
+    d[n++] = (char)('0' + v % 10);
+    v /= 10;
+  } while (v != 0);
+  char *p = text_writer_reserve(w, n);
+  for (int i = 0; i < n; i++)
+    p[i] = d[n - 1 - i];
+  w->n += n;
+}
+
+void text_writer_long(struct text_writer *w, long long v) {
+  if (v < 0) {
+    text_writer_char(w, '-');
+    text_writer_ulong(w, 0ULL - (unsigned long long)v);
+  } else {
+    text_writer_ulong(w, (unsigned long long)v);
+  }
+}
+
+void text_writer_string(struct text_writer *w, char const *s) {
+  size_t len = strlen(s);
+  if (len > TEXT_WRITER_SIZE / 2) {
+    text_writer_flush(w);
+    if (fwrite(s, 1, len, w->f) != len)
+      w->failed = 1;
+    return;
+  }
+  char *p = text_writer_reserve(w, len);
+  memcpy(p, s, len);
+  w->n += len;
+}
+
+void text_writer_char(struct text_writer *w, char c) {
+  char *p = text_writer_reserve(w, 1);
+  *p = c;
+  w->n++;
+}
@@ -0,0 +1,54 @@
+/******************************************************************************
+ *
+ * Copyright (C) 2006-2017 by
+ * The Salk Institute for Biological Studies and
+ * Pittsburgh Supercomputing Center, Carnegie Mellon University
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ *
+******************************************************************************/
+
+#pragma once
+
+#include <stdio.h>
+
+/* Longest text written by format_double, including the terminating NUL */
+#define FORMAT_DOUBLE_SIZE 32
+
+/* Size of the buffer text_writer collects a file's text in */
+#define TEXT_WRITER_SIZE 16384
+
+/* Text being written to a file.  Numbers are formatted straight into the
+ * buffer, which is written out whenever it fills up and by
+ * text_writer_flush. */
+struct text_writer {
+  FILE *f;
+  int shortest; /* Write doubles with the fewest digits that read back
+                   exactly (see -shortest_floats) */
+  int failed;   /* Set once a write has failed */
+  size_t n;     /* Bytes in buf */
+  char buf[TEXT_WRITER_SIZE];
+};
+
+int format_double(char *buf, double x, int precision, int shortest);
+
+void text_writer_init(struct text_writer *w, FILE *f, int shortest);
+int text_writer_flush(struct text_writer *w);
+void text_writer_double(struct text_writer *w, double x, int precision);
+void text_writer_long(struct text_writer *w, long long v);
+void text_writer_ulong(struct text_writer *w, unsigned long long v);
+void text_writer_string(struct text_writer *w, char const *s);
+void text_writer_char(struct text_writer *w, char c);
@@ -0,0 +1,740 @@
+/******************************************************************************
+ *
+ * Copyright (C) 2006-2017 by
+ * The Salk Institute for Biological Studies and
+ * Pittsburgh Supercomputing Center, Carnegie Mellon University
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ *
+******************************************************************************/
+
+/**************************************************************************\
+** File: thread_util.c                                                    **
+**                                                                        **
+** Purpose: A small persistent pool of worker threads.  The caller hands  **
+**    the pool a batch of independent tasks and blocks until all of them  **
+**    are done; the calling thread works on the batch as well.  Threads   **
+**    that run out of tasks steal from the others.                        **
+**    Also a single background thread that writes finished output files.  **
+\**************************************************************************/
+
+#include "config.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <pthread.h>
+#include <stdint.h>
+#include <limits.h>
+#include <sys/uio.h>
+#ifndef IOV_MAX
+#define IOV_MAX 16
+#endif
+#endif
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "logging.h"
+#include "mem_util.h"
+#include "util.h"
+#include "thread_util.h"
+
+/* Unstarted tasks of one thread, [lo, hi) of the batch tagged 'tag',
+ * packed so that the owner and thieves can claim tasks with a single
+ * compare-and-swap: lo in the low 24 bits, hi in the next 24, then the
+ * low 16 bits of the batch generation */
+#define POOL_RANGE_BITS 24
+#define POOL_MAX_TASKS ((1 << POOL_RANGE_BITS) - 1)
+#define POOL_RANGE_MASK ((uint64_t)POOL_MAX_TASKS)
+
+#ifndef _WIN32
+/* Index of the calling thread in the pool it belongs to; 0 for the thread
+ * that created the pool and for threads outside any pool */
+static __thread int pool_thread_index = 0;
+
+/* The ranges and tasks_pending are only accessed through the __atomic
+ * builtins, which compile both as C and as C++ */
+struct pool_range {
+  uint64_t v;
+
+  char pad[64 - sizeof(uint64_t)]; /* One cache line per thread */
+};
+
+struct pool_worker {
+  struct thread_pool *pool;
+  int index; /* 1 .. num_threads - 1; the caller is thread 0 */
+};
+#endif
+
+struct thread_pool {
+  int num_threads; /* Total number of threads, including the caller */
+
+#ifndef _WIN32
+  pthread_t *workers;
+  struct pool_worker *worker_args;
+  struct pool_range *ranges; /* One per thread */
+  pthread_mutex_t lock;
+  pthread_cond_t work_ready; /* Signalled when a new batch is posted */
+  pthread_cond_t work_done;  /* Signalled when the last task finishes */
+
+  /* Current batch, protected by 'lock' */
+  unsigned long generation; /* Incremented for each new batch */
+  thread_task_fn fn;
+  void *ctx;
+  int shutdown;
+
+  int tasks_pending; /* Tasks not finished yet */
+#endif
+};
+
+#ifndef _WIN32
+static inline uint64_t pack_range(uint64_t lo, uint64_t hi, uint64_t tag) {
+  return lo | (hi << POOL_RANGE_BITS) | (tag << (2 * POOL_RANGE_BITS));
+}
+
+/*************************************************************************
+take_task:
+  In: pool: the thread pool
+      self: index of the calling thread
+      tag: tag of the batch the caller is working on
+      task: where to store the task claimed
+  Out: 1 if a task was claimed, 0 if none is left.  Tasks come from the
+       front of the thread's own range first; once that is empty, the back
+       half of another thread's range is stolen and the rest of it becomes
+       the thread's own range.
+*************************************************************************/
+static int take_task(struct thread_pool *pool, int self, uint64_t tag,
+                     int *task) {
+  uint64_t *own = &pool->ranges[self].v;
+  uint64_t v = __atomic_load_n(own, __ATOMIC_ACQUIRE);
+  while (1) {
+    uint64_t lo = v & POOL_RANGE_MASK;
+    uint64_t hi = (v >> POOL_RANGE_BITS) & POOL_RANGE_MASK;
+    if ((v >> (2 * POOL_RANGE_BITS)) != tag || lo >= hi)
+      break;
+    if (__atomic_compare_exchange_n(own, &v, pack_range(lo + 1, hi, tag), 1,
+                                    __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+      *task = (int)lo;
+      return 1;
+    }
+  }
+
+  for (int k = 1; k < pool->num_threads; ++k) {
+    uint64_t *victim = &pool->ranges[(self + k) % pool->num_threads].v;
+    v = __atomic_load_n(victim, __ATOMIC_ACQUIRE);
+    while (1) {
+      uint64_t lo = v & POOL_RANGE_MASK;
+      uint64_t hi = (v >> POOL_RANGE_BITS) & POOL_RANGE_MASK;
+      if ((v >> (2 * POOL_RANGE_BITS)) != tag || lo >= hi)
+        break;
+      uint64_t mid = lo + (hi - lo) / 2;
+      if (__atomic_compare_exchange_n(victim, &v, pack_range(lo, mid, tag), 1,
+                                      __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        /* Nobody steals from an empty range, so this store is safe */
+        __atomic_store_n(own, pack_range(mid + 1, hi, tag), __ATOMIC_RELEASE);
+        *task = (int)mid;
+        return 1;
+      }
+    }
+  }
+  return 0;
+}
+
+/*************************************************************************
+run_tasks:
+  In: pool: the thread pool
+      self: index of the calling thread
+      tag, fn, ctx: the batch, as read under 'lock' when it was posted
+  Out: Tasks of the batch are run until none are left to claim.
+*************************************************************************/
+static void run_tasks(struct thread_pool *pool, int self, uint64_t tag,
+                      thread_task_fn fn, void *ctx) {
+  int task;
+  while (take_task(pool, self, tag, &task)) {
+    fn(ctx, task);
+
+    if (__atomic_fetch_sub(&pool->tasks_pending, 1, __ATOMIC_ACQ_REL) == 1) {
+      pthread_mutex_lock(&pool->lock);
+      pthread_cond_broadcast(&pool->work_done);
+      pthread_mutex_unlock(&pool->lock);
+    }
+  }
+}
+
+static void *worker_main(void *arg) {
+  struct pool_worker *worker = (struct pool_worker *)arg;
+  struct thread_pool *pool = worker->pool;
+  unsigned long seen = 0;
+  pool_thread_index = worker->index;
+
+  pthread_mutex_lock(&pool->lock);
+  while (1) {
+    while (!pool->shutdown && pool->generation == seen)
+      pthread_cond_wait(&pool->work_ready, &pool->lock);
+    if (pool->shutdown)
+      break;
+    seen = pool->generation;
+    thread_task_fn fn = pool->fn;
+    void *ctx = pool->ctx;
+    pthread_mutex_unlock(&pool->lock);
+
+    run_tasks(pool, worker->index, seen & 0xffff, fn, ctx);
+
+    pthread_mutex_lock(&pool->lock);
+  }
+  pthread_mutex_unlock(&pool->lock);
+  return NULL;
+}
+#endif
+
+/*************************************************************************
+thread_pool_create:
+  In: num_threads: total number of threads to use, counting the caller
+  Out: A new thread pool, or NULL if the threads could not be started.  On
+       platforms without pthreads the pool runs every task on the caller.
+*************************************************************************/
+struct thread_pool *thread_pool_create(int num_threads) {
+  struct thread_pool *pool =
+      CHECKED_MALLOC_STRUCT_NODIE(struct thread_pool, "thread pool");
+  if (pool == NULL)
+    return NULL;
+  if (num_threads < 1)
+    num_threads = 1;
+  pool->num_threads = num_threads;
+
+#ifndef _WIN32
+  pool->generation = 0;
+  pool->fn = NULL;
+  pool->ctx = NULL;
+  pool->shutdown = 0;
+  pool->workers = NULL;
+  pool->worker_args = NULL;
+  pool->ranges = NULL;
+  __atomic_store_n(&pool->tasks_pending, 0, __ATOMIC_RELAXED);
+  pthread_mutex_init(&pool->lock, NULL);
+  pthread_cond_init(&pool->work_ready, NULL);
+  pthread_cond_init(&pool->work_done, NULL);
+
+  if (num_threads > 1) {
+    pool->num_threads = 1; /* Threads started so far, for destroy */
+    pool->workers = CHECKED_MALLOC_ARRAY_NODIE(pthread_t, num_threads - 1,
+                                               "thread pool workers");
+    pool->worker_args = CHECKED_MALLOC_ARRAY_NODIE(
+        struct pool_worker, num_threads - 1, "thread pool workers");
+    pool->ranges = CHECKED_MALLOC_ARRAY_NODIE(struct pool_range, num_threads,
+                                              "thread pool task ranges");
+    if (pool->workers == NULL || pool->worker_args == NULL ||
+        pool->ranges == NULL) {
+      thread_pool_destroy(pool);
+      return NULL;
+    }
+    for (int i = 0; i < num_threads; ++i)
+      __atomic_store_n(&pool->ranges[i].v, 0, __ATOMIC_RELAXED);
+    for (int i = 0; i < num_threads - 1; ++i) {
+      pool->worker_args[i].pool = pool;
+      pool->worker_args[i].index = i + 1;
+      if (pthread_create(&pool->workers[i], NULL, worker_main,
+                         &pool->worker_args[i]) != 0) {
+        thread_pool_destroy(pool);
+        return NULL;
+      }
+      pool->num_threads = i + 2;
+    }
+  }
+#endif
+
+  return pool;
+}
+
+/*************************************************************************
+thread_pool_threads:
+  In: pool: the thread pool, or NULL
+  Out: number of threads running tasks of a batch, counting the caller
+*************************************************************************/
+int thread_pool_threads(struct thread_pool const *pool) {
+  return (pool != NULL) ? pool->num_threads : 1;
+}
+
+/*************************************************************************
+thread_pool_current_thread:
+  In: none
+  Out: index of the calling thread among the threads of its pool, counting
+       the caller of thread_pool_run as 0; 0 outside a pool
+*************************************************************************/
+int thread_pool_current_thread(void) {
+#ifndef _WIN32
+  return pool_thread_index;
+#else
+  return 0;
+#endif
+}
+
+/*************************************************************************
+thread_current_node:
+  In: none
+  Out: NUMA node of the CPU the calling thread is running on, or -1 if
+       that cannot be queried
+*************************************************************************/
+int thread_current_node(void) {
+#if defined(__linux__) && defined(SYS_getcpu)
+  unsigned cpu, node;
+  if (syscall(SYS_getcpu, &cpu, &node, NULL) == 0)
+    return (int)node;
+#endif
+  return -1;
+}
+
+/*************************************************************************
+thread_memory_node:
+  In: p: an address in memory of this process
+  Out: NUMA node holding the page of p, or -1 if the page is not mapped
+       yet or the node cannot be queried
+*************************************************************************/
+int thread_memory_node(void const *p) {
+#if defined(__linux__) && defined(SYS_move_pages)
+  if (p == NULL)
+    return -1;
+  /* Without target nodes move_pages only reports where the pages are */
+  long page = sysconf(_SC_PAGESIZE);
+  void *pages[1] = { (void *)((uintptr_t)p & ~(uintptr_t)(page - 1)) };
+  int status[1] = { -1 };
+  if (syscall(SYS_move_pages, 0, 1UL, pages, NULL, status, 0) == 0 &&
+      status[0] >= 0)
+    return status[0];
+#else
+  UNUSED(p);
+#endif
+  return -1;
+}
+
+/*************************************************************************
+thread_pool_run:
+  In: pool: the thread pool, or NULL to run the tasks on the caller
+      n_tasks: number of tasks in the batch
+      fn: function to call for each task
+      ctx: context passed to each call
+  Out: Returns once fn(ctx, i) has completed for every i in [0, n_tasks).
+       Each thread starts on its own contiguous block of tasks and steals
+       from the others once done, so which thread runs a task varies, but
+       the tasks are the same whatever the thread count; callers give each
+       task its own output so results do not depend on the schedule.  With
+       a single thread the tasks run in order on the caller.
+*************************************************************************/
+void thread_pool_run(struct thread_pool *pool, int n_tasks, thread_task_fn fn,
+                     void *ctx) {
+#ifndef _WIN32
+  if (pool != NULL && pool->num_threads > 1 && n_tasks > 1) {
+    int n_threads = pool->num_threads;
+    if (n_tasks > POOL_MAX_TASKS) {
+      mcell_internal_error("Thread pool batch of %d tasks is too large.",
+                           n_tasks);
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    uint64_t tag = (pool->generation + 1) & 0xffff;
+    for (int t = 0; t < n_threads; ++t) {
+      uint64_t lo = (uint64_t)n_tasks * t / n_threads;
+      uint64_t hi = (uint64_t)n_tasks * (t + 1) / n_threads;
+      __atomic_store_n(&pool->ranges[t].v, pack_range(lo, hi, tag),
+                       __ATOMIC_RELAXED);
+    }
+    __atomic_store_n(&pool->tasks_pending, n_tasks, __ATOMIC_RELEASE);
+    pool->fn = fn;
+    pool->ctx = ctx;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->work_ready);
+    pthread_mutex_unlock(&pool->lock);
+
+    run_tasks(pool, 0, tag, fn, ctx);
+
+    pthread_mutex_lock(&pool->lock);
+    while (__atomic_load_n(&pool->tasks_pending, __ATOMIC_ACQUIRE) > 0)
+      pthread_cond_wait(&pool->work_done, &pool->lock);
+    pthread_mutex_unlock(&pool->lock);
+    return;
+  }
+#endif
+
+  for (int i = 0; i < n_tasks; ++i)
+    fn(ctx, i);
+}
+
+/*************************************************************************
+thread_pool_destroy:
+  In: pool: the thread pool
+  Out: Worker threads are stopped and joined, and the pool is freed.
+*************************************************************************/
+void thread_pool_destroy(struct thread_pool *pool) {
+  if (pool == NULL)
+    return;
+
+#ifndef _WIN32
+  pthread_mutex_lock(&pool->lock);
+  pool->shutdown = 1;
+  pthread_cond_broadcast(&pool->work_ready);
+  pthread_mutex_unlock(&pool->lock);
+
+  if (pool->workers != NULL) {
+    for (int i = 0; i < pool->num_threads - 1; ++i)
+      pthread_join(pool->workers[i], NULL);
+    free(pool->workers);
+  }
+  free(pool->worker_args);
+  free(pool->ranges);
+  pthread_cond_destroy(&pool->work_done);
+  pthread_cond_destroy(&pool->work_ready);
+  pthread_mutex_destroy(&pool->lock);
+#endif
+
+  free(pool);
+}
+
+#ifndef _WIN32
+/* An output file being written to memory, or waiting to go to disk */
+struct queued_file {
+  struct queued_file *next;
+  FILE *fp;    /* Memory stream the caller writes to */
+  char *fname; /* File to write the contents to... */
+  char *mode;  /* ...opened with this mode */
+  char *buf;   /* Contents, once the memory stream is closed */
+  size_t size;
+};
+
+struct output_writer {
+  pthread_t writer;
+  pthread_mutex_t lock;
+  pthread_cond_t work_ready; /* Signalled when a file is queued */
+  pthread_cond_t space_free; /* Signalled when a queued file is written */
+
+  struct queued_file *open_head; /* Files the caller still has open; only
+                                    touched by the caller */
+
+  /* Protected by 'lock' */
+  struct queued_file *queue_head; /* Files waiting to be written, in order */
+  struct queued_file *queue_tail;
+  size_t queued_bytes;     /* Size of queued files and the one being written */
+  size_t max_queued_bytes; /* Callers block beyond this */
+  int n_errors;            /* Write errors not yet reported */
+  int shutdown;
+};
+
+static void free_queued_file(struct queued_file *qf) {
+  free(qf->buf);
+  free(qf->mode);
+  free(qf->fname);
+  free(qf);
+}
+
+/*************************************************************************
+write_queued_file:
+  Write a file and any later queued contents for the same file with one
+  open and a single writev, instead of reopening the file for each.
+
+  In: qf: closed output files for the same name, chained through 'next',
+          oldest first. A file opened for writing ("w") empties it, so
+          contents queued before the last such file are skipped.
+  Out: 0 on success, 1 if the file could not be written.
+*************************************************************************/
+static int write_queued_file(struct queued_file *qf) {
+  struct queued_file *first = qf;
+  int n_pieces = 0;
+  for (struct queued_file *q = qf; q != NULL; q = q->next) {
+    if (q->mode[0] == 'w') {
+      first = q;
+      n_pieces = 0;
+    }
+    if (q->size > 0)
+      ++n_pieces;
+  }
+
+  FILE *fp = open_file(first->fname, first->mode);
+  if (fp == NULL)
+    return 1;
+
+  struct iovec *iov =
+      CHECKED_MALLOC_ARRAY(struct iovec, n_pieces + 1, "output write list");
+  int n_iov = 0;
+  for (struct queued_file *q = first; q != NULL; q = q->next) {
+    if (q->size > 0) {
+      iov[n_iov].iov_base = q->buf;
+      iov[n_iov].iov_len = q->size;
+      ++n_iov;
+    }
+  }
+
+  /* Nothing was written through the stream, so its descriptor is positioned
+   * where the stream would have been */
+  int err = 0;
+  int fd = fileno(fp);
+  struct iovec *next = iov;
+  while (n_iov > 0) {
+    ssize_t n = writev(fd, next, (n_iov < IOV_MAX) ? n_iov : IOV_MAX);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      err = 1;
+      break;
+    }
+    while (n_iov > 0 && (size_t)n >= next->iov_len) {
+      n -= next->iov_len;
+      ++next;
+      --n_iov;
+    }
+    if (n_iov > 0) {
+      next->iov_base = (char *)next->iov_base + n;
+      next->iov_len -= n;
+    }
+  }
+  int write_errno = errno;
+  free(iov);
+
+  if (fclose(fp) != 0) {
+    write_errno = errno;
+    err = 1;
+  }
+  if (err)
+    mcell_perror_nodie(write_errno, "Failed to write file %s.", qf->fname);
+  return err;
+}
+
+static void *writer_main(void *arg) {
+  struct output_writer *ow = (struct output_writer *)arg;
+
+  pthread_mutex_lock(&ow->lock);
+  while (1) {
+    while (!ow->shutdown && ow->queue_head == NULL)
+      pthread_cond_wait(&ow->work_ready, &ow->lock);
+    if (ow->queue_head == NULL)
+      break;
+
+    /* Take the first file and everything queued for the same name behind
+     * it, so output that backed up reaches each file in one write */
+    struct queued_file *qf = ow->queue_head;
+    struct queued_file *last = qf;
+    struct queued_file *rest = qf->next;
+    qf->next = NULL;
+    ow->queue_tail = NULL;
+    ow->queue_head = NULL;
+    struct queued_file **restp = &ow->queue_head;
+    while (rest != NULL) {
+      struct queued_file *q = rest;
+      rest = q->next;
+      q->next = NULL;
+      if (strcmp(q->fname, qf->fname) == 0) {
+        last->next = q;
+        last = q;
+      } else {
+        *restp = q;
+        restp = &q->next;
+        ow->queue_tail = q;
+      }
+    }
+    pthread_mutex_unlock(&ow->lock);
+
+    int err = write_queued_file(qf);
+
+    pthread_mutex_lock(&ow->lock);
+    while (qf != NULL) {
+      struct queued_file *q = qf;
+      qf = qf->next;
+      ow->queued_bytes -= q->size;
+      free_queued_file(q);
+    }
+    ow->n_errors += err;
+    pthread_cond_broadcast(&ow->space_free);
+  }
+  pthread_mutex_unlock(&ow->lock);
+  return NULL;
+}
+#endif
+
+/*************************************************************************
+output_writer_create:
+  In: max_queued_bytes: how much closed output may wait for the writer
+      before output_writer_close blocks
+  Out: A new background writer, or NULL if no writer thread could be
+       started (or on platforms without pthreads), in which case files are
+       written directly.
+*************************************************************************/
+struct output_writer *output_writer_create(size_t max_queued_bytes) {
+#ifndef _WIN32
+  struct output_writer *ow =
+      CHECKED_MALLOC_STRUCT_NODIE(struct output_writer, "output writer");
+  if (ow == NULL)
+    return NULL;
+
+  ow->open_head = NULL;
+  ow->queue_head = NULL;
+  ow->queue_tail = NULL;
+  ow->queued_bytes = 0;
+  ow->max_queued_bytes = max_queued_bytes;
+  ow->n_errors = 0;
+  ow->shutdown = 0;
+  pthread_mutex_init(&ow->lock, NULL);
+  pthread_cond_init(&ow->work_ready, NULL);
+  pthread_cond_init(&ow->space_free, NULL);
+
+  if (pthread_create(&ow->writer, NULL, writer_main, ow) != 0) {
+    pthread_cond_destroy(&ow->space_free);
+    pthread_cond_destroy(&ow->work_ready);
+    pthread_mutex_destroy(&ow->lock);
+    free(ow);
+    return NULL;
+  }
+  return ow;
+#else
+  return NULL;
+#endif
+}
+
+/*************************************************************************
+output_writer_open:
+  In: ow: the background writer, or NULL
+      fname: file to write
+      mode: mode to open it with once the contents are complete
+  Out: A stream to write the file contents to, to be closed with
+       output_writer_close, or NULL on error.
+*************************************************************************/
+FILE *output_writer_open(struct output_writer *ow, const char *fname,
+                         const char *mode) {
+#ifndef _WIN32
+  if (ow != NULL) {
+    struct queued_file *qf =
+        CHECKED_MALLOC_STRUCT(struct queued_file, "queued output file");
+    qf->fname = CHECKED_STRDUP(fname, "queued output file name");
+    qf->mode = CHECKED_STRDUP(mode, "queued output file mode");
+    qf->buf = NULL;
+    qf->size = 0;
+    qf->fp = open_memstream(&qf->buf, &qf->size);
+    if (qf->fp == NULL) {
+      mcell_perror_nodie(errno, "Failed to buffer output for file %s.", fname);
+      free_queued_file(qf);
+      return NULL;
+    }
+    qf->next = ow->open_head;
+    ow->open_head = qf;
+    return qf->fp;
+  }
+#endif
+  return open_file(fname, mode);
+}
+
+/*************************************************************************
+output_writer_close:
+  In: ow: the background writer, or NULL
+      fp: stream returned by output_writer_open
+  Out: 0 on success, 1 if this file or an earlier one from the writer
+       could not be written. The file is queued for writing, waiting first
+       if too much output is already queued.
+*************************************************************************/
+int output_writer_close(struct output_writer *ow, FILE *fp) {
+#ifndef _WIN32
+  if (ow != NULL) {
+    struct queued_file **qfp = &ow->open_head;
+    while (*qfp != NULL && (*qfp)->fp != fp)
+      qfp = &(*qfp)->next;
+    if (*qfp != NULL) {
+      struct queued_file *qf = *qfp;
+      *qfp = qf->next;
+      qf->next = NULL;
+      if (fclose(fp) != 0) {
+        mcell_perror_nodie(errno, "Failed to buffer output for file %s.",
+                           qf->fname);
+        free_queued_file(qf);
+        return 1;
+      }
+      qf->fp = NULL;
+
+      pthread_mutex_lock(&ow->lock);
+      while (ow->queued_bytes > 0 &&
+             ow->queued_bytes + qf->size > ow->max_queued_bytes)
+        pthread_cond_wait(&ow->space_free, &ow->lock);
+      if (ow->queue_tail == NULL)
+        ow->queue_head = qf;
+      else
+        ow->queue_tail->next = qf;
+      ow->queue_tail = qf;
+      ow->queued_bytes += qf->size;
+      pthread_cond_signal(&ow->work_ready);
+      int n_errors = ow->n_errors;
+      ow->n_errors = 0;
+      pthread_mutex_unlock(&ow->lock);
+      return (n_errors != 0);
+    }
+  }
+#endif
+  return (fclose(fp) != 0);
+}
+
+/*************************************************************************
+output_writer_queued:
+  In: ow: the background writer, or NULL
+      n_files: where to store the number of files waiting to be written
+  Out: bytes of output queued or being written
+*************************************************************************/
+size_t output_writer_queued(struct output_writer *ow, int *n_files) {
+  *n_files = 0;
+  if (ow == NULL)
+    return 0;
+
+#ifndef _WIN32
+  pthread_mutex_lock(&ow->lock);
+  for (struct queued_file *qf = ow->queue_head; qf != NULL; qf = qf->next)
+    ++*n_files;
+  size_t bytes = ow->queued_bytes;
+  pthread_mutex_unlock(&ow->lock);
+  return bytes;
+#else
+  return 0;
+#endif
+}
+
+/*************************************************************************
+output_writer_destroy:
+  In: ow: the background writer, or NULL
+  Out: Number of files that could not be written and were not yet
+       reported. Every queued file has been written and the writer thread
+       is stopped and freed.
+*************************************************************************/
+int output_writer_destroy(struct output_writer *ow) {
+  if (ow == NULL)
+    return 0;
+
+#ifndef _WIN32
+  int n_errors = 0;
+  while (ow->open_head != NULL)
+    n_errors += output_writer_close(ow, ow->open_head->fp);
+
+  pthread_mutex_lock(&ow->lock);
+  ow->shutdown = 1;
+  pthread_cond_signal(&ow->work_ready);
+  pthread_mutex_unlock(&ow->lock);
+  pthread_join(ow->writer, NULL);
+
+  n_errors += ow->n_errors;
+  pthread_cond_destroy(&ow->space_free);
+  pthread_cond_destroy(&ow->work_ready);
+  pthread_mutex_destroy(&ow->lock);
+  free(ow);
+  return n_errors;
+#else
+  return 0;
+#endif
+}
@@ -0,0 +1,56 @@
+/******************************************************************************
+ *
+ * Copyright (C) 2006-2017 by
+ * The Salk Institute for Biological Studies and
+ * Pittsburgh Supercomputing Center, Carnegie Mellon University
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ *
+******************************************************************************/
+
+#pragma once
+
+#include <stdio.h>
+
+/* Work function run by the pool: 'task' is in [0, n_tasks) */
+typedef void (*thread_task_fn)(void *ctx, int task);
+
+struct thread_pool;
+
+struct thread_pool *thread_pool_create(int num_threads);
+int thread_pool_threads(struct thread_pool const *pool);
+int thread_pool_current_thread(void);
+void thread_pool_run(struct thread_pool *pool, int n_tasks, thread_task_fn fn,
+                     void *ctx);
+void thread_pool_destroy(struct thread_pool *pool);
+
+/* NUMA node of the calling thread's CPU and of the page holding an
+ * address, or -1 where unknown */
+int thread_current_node(void);
+int thread_memory_node(void const *p);
+
+/* Background writer for output files.  Files opened through it are written
+ * to memory by the caller and handed to a writer thread when closed, which
+ * writes them out in the order they were closed.  A NULL writer writes
+ * files directly. */
+struct output_writer;
+
+struct output_writer *output_writer_create(size_t max_queued_bytes);
+FILE *output_writer_open(struct output_writer *ow, const char *fname,
+                         const char *mode);
+int output_writer_close(struct output_writer *ow, FILE *fp);
+size_t output_writer_queued(struct output_writer *ow, int *n_files);
+int output_writer_destroy(struct output_writer *ow);
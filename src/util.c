@@ -32,6 +32,9 @@
 #include <stdlib.h>
 #include <errno.h>
 #include <sys/stat.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 #include <unistd.h>
 #include <stdbool.h>
 
@@ -85,57 +88,66 @@ struct bit_array *duplicate_bit_array(struct bit_array *old) {
 }
 
 /*******************************************************************
-get_bit: returns the value of a bit in a bit_array
+next_set_bit: finds the first set bit at or after an index
 
  In:
     ba: pointer to a bit_array struct
-    idx: the index of the bit to return
+    idx: the index to start looking at
 
  Out:
-    0 or 1, depending on whether the idx'th bit is set.  No
-    bounds checking is performed.
+    The index of the first set bit at or after idx, or -1 if there is
+    none.
 *******************************************************************/
-int get_bit(struct bit_array *ba, int idx) {
-  int *data = &(ba->nints);
-  data++; /* At start of bit array memory */
+int next_set_bit(struct bit_array *ba, int idx) {
+  unsigned int *data = bit_array_words(ba);
 
-  size_t ofs = idx & (8 * sizeof(int) - 1);
-  idx = idx / (8 * sizeof(int));
-  ofs = 1u << ofs;
+  if (idx < 0)
+    idx = 0;
+  if (idx >= ba->nbits)
+    return -1;
 
-  if ((data[idx] & ofs) != 0) {
-    return 1;
-  } else {
-    return 0;
+  int word = idx / BITS_PER_WORD;
+  unsigned int w = data[word] & (~0u << (idx & (BITS_PER_WORD - 1)));
+  while (w == 0) {
+    if (++word >= ba->nints)
+      return -1;
+    w = data[word];
   }
+
+  idx = word * BITS_PER_WORD + __builtin_ctz(w);
+  return (idx < ba->nbits) ? idx : -1;
 }
 
 /*******************************************************************
-set_bit: set a value in a bit array
+next_set_range: finds the next run of set bits at or after an index
 
  In:
     ba: pointer to a bit_array struct
-    idx: the index of the bit to set
-    value: 0 = turn bit off; nonzero = turn bit on
+    idx: the index to start looking at
+    end: where to store the index one past the last bit of the run
 
  Out:
-    Nothing
+    The index of the first bit of the run, or -1 if no bit at or after
+    idx is set.  Iterate over all set bits a run at a time with
+      for (i = next_set_range(ba, 0, &end); i >= 0;
+           i = next_set_range(ba, end, &end))
 *******************************************************************/
-void set_bit(struct bit_array *ba, int idx, int value) {
-  int *data = &(ba->nints);
-  data++; /* At start of bit array memory */
+int next_set_range(struct bit_array *ba, int idx, int *end) {
+  unsigned int *data = bit_array_words(ba);
 
-  size_t ofs = idx & (8 * sizeof(int) - 1);
-  idx = idx / (8 * sizeof(int));
-  ofs = (1u << ofs);
+  int start = next_set_bit(ba, idx);
+  if (start < 0)
+    return -1;
 
-  if (value) {
-    value = ofs;
-  } else {
-    value = 0;
-  }
+  /* Scan for the first clear bit after start */
+  int word = start / BITS_PER_WORD;
+  unsigned int w = ~data[word] & (~0u << (start & (BITS_PER_WORD - 1)));
+  while (w == 0 && ++word < ba->nints)
+    w = ~data[word];
 
-  data[idx] = (data[idx] & ~ofs) | value;
+  int stop = (w == 0) ? ba->nbits : word * BITS_PER_WORD + __builtin_ctz(w);
+  *end = (stop < ba->nbits) ? stop : ba->nbits;
+  return start;
 }
 
 /*******************************************************************
@@ -151,59 +163,27 @@ set_bit_range: set many bits to a value in a bit array
     Nothing
 *******************************************************************/
 void set_bit_range(struct bit_array *ba, int idx1, int idx2, int value) {
-  int *data = &(ba->nints);
-  data++; /* At start of bit array memory */
+  unsigned int *data = bit_array_words(ba);
 
-  int ofs1 = idx1 & (8 * sizeof(int) - 1);
-  int ofs2 = idx2 & (8 * sizeof(int) - 1);
-  idx1 = idx1 / (8 * sizeof(int));
-  idx2 = idx2 / (8 * sizeof(int));
+  int ofs1 = idx1 & (BITS_PER_WORD - 1);
+  int ofs2 = idx2 & (BITS_PER_WORD - 1);
+  idx1 = idx1 / BITS_PER_WORD;
+  idx2 = idx2 / BITS_PER_WORD;
 
-  unsigned int mask, cmask;
+  /* Bits ofs1 and up of the first word, bits ofs2 and down of the last */
+  unsigned int mask1 = ~0u << ofs1;
+  unsigned int mask2 = ~0u >> (BITS_PER_WORD - 1 - ofs2);
   if (idx1 == idx2) {
-    mask = 0;
-    for (int i = ofs1; i <= ofs2; i++) {
-      mask |= (1u << i);
-    }
-    cmask = ~mask;
-
-    if (value) {
-      data[idx1] = (data[idx1] & cmask) | mask;
-    } else {
-      data[idx1] = data[idx1] & cmask;
-    }
-  } else {
-    if (value) {
-      value = ~0;
-    } else {
-      value = 0;
-    }
-    for (int i = idx1 + 1; i < idx2; i++) {
-      data[i] = value;
-    }
-
-    mask = 0;
-    for (unsigned int i = ofs1; i < 8 * sizeof(int); i++) {
-      mask |= (1u << i);
-    }
-    cmask = ~mask;
-    if (value) {
-      data[idx1] = (data[idx1] & cmask) | mask;
-    } else {
-      data[idx1] = data[idx1] & cmask;
-    }
-
-    mask = 0;
-    for (int i = 0; i <= ofs2; i++) {
-      mask |= (1u << i);
-    }
-    cmask = ~mask;
-    if (value) {
-      data[idx2] = (data[idx2] & cmask) | mask;
-    } else {
-      data[idx2] = data[idx2] & cmask;
-    }
+    mask1 &= mask2;
+    data[idx1] = value ? (data[idx1] | mask1) : (data[idx1] & ~mask1);
+    return;
   }
+
+  data[idx1] = value ? (data[idx1] | mask1) : (data[idx1] & ~mask1);
+  if (idx2 > idx1 + 1)
+    memset(data + idx1 + 1, value ? 0xFF : 0,
+           sizeof(unsigned int) * (idx2 - idx1 - 1));
+  data[idx2] = value ? (data[idx2] | mask2) : (data[idx2] & ~mask2);
 }
 
 /*******************************************************************
@@ -217,16 +197,8 @@ set_all_bits: sets all values in a bit array
     Nothing
 *******************************************************************/
 void set_all_bits(struct bit_array *ba, int value) {
-  if (value) {
-    value = ~0;
-  }
-
-  int *data = &(ba->nints);
-  data++; /* At start of bit array memory */
-
-  for (int i = 0; i < ba->nints; i++) {
-    data[i] = value;
-  }
+  memset(bit_array_words(ba), value ? 0xFF : 0,
+         sizeof(unsigned int) * ba->nints);
 }
 
 /*******************************************************************
@@ -247,12 +219,12 @@ bit operation: performs a logical operation on two bit arrays
  Out:
     Nothing
 *******************************************************************/
+TARGET_CLONES
 void bit_operation(struct bit_array *ba, struct bit_array *bb, char op) {
-  int *da, *db;
+  unsigned int *__restrict__ da = bit_array_words(ba);
+  int n = ba->nints;
   if (op == '!' || op == '~') {
-    da = &(ba->nints);
-    da++;
-    for (int i = 0; i < ba->nints; i++) {
+    for (int i = 0; i < n; i++) {
       da[i] = ~da[i];
     }
     return;
@@ -262,30 +234,34 @@ void bit_operation(struct bit_array *ba, struct bit_array *bb, char op) {
     return;
   }
 
-  da = &(ba->nints);
-  da++;
-  db = &(bb->nints);
-  db++;
+  /* x op x: only '-' and '^' change anything, and they clear x */
+  if (ba == bb) {
+    if (op == '-' || op == '^')
+      set_all_bits(ba, 0);
+    return;
+  }
 
+  /* Plain word loops over distinct arrays; the compiler vectorizes them */
+  unsigned int const *__restrict__ db = bit_array_words(bb);
   switch (op) {
   case '^':
-    for (int i = 0; i < ba->nints; i++) {
+    for (int i = 0; i < n; i++) {
       da[i] ^= db[i];
     }
     break;
   case '|':
   case '+':
-    for (int i = 0; i < ba->nints; i++) {
+    for (int i = 0; i < n; i++) {
       da[i] |= db[i];
     }
     break;
   case '-':
-    for (int i = 0; i < ba->nints; i++) {
+    for (int i = 0; i < n; i++) {
       da[i] &= ~db[i];
     }
     break;
   case '&':
-    for (int i = 0; i < ba->nints; i++) {
+    for (int i = 0; i < n; i++) {
       da[i] &= db[i];
     }
     break;
@@ -303,45 +279,27 @@ count_bits: count how many bits are set in a bit array
  Out:
     int containing number of nonzero bits
 **********************************************************************/
+TARGET_CLONES
 int count_bits(struct bit_array *ba) {
-  static const int cb_table[256] = {
-    0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4, 1, 2, 2, 3, 2, 3, 3, 4,
-    2, 3, 3, 4, 3, 4, 4, 5, 1, 2, 2, 3, 2, 3, 3, 4, 2, 3, 3, 4, 3, 4, 4, 5,
-    2, 3, 3, 4, 3, 4, 4, 5, 3, 4, 4, 5, 4, 5, 5, 6, 1, 2, 2, 3, 2, 3, 3, 4,
-    2, 3, 3, 4, 3, 4, 4, 5, 2, 3, 3, 4, 3, 4, 4, 5, 3, 4, 4, 5, 4, 5, 5, 6,
-    2, 3, 3, 4, 3, 4, 4, 5, 3, 4, 4, 5, 4, 5, 5, 6, 3, 4, 4, 5, 4, 5, 5, 6,
-    4, 5, 5, 6, 5, 6, 6, 7, 1, 2, 2, 3, 2, 3, 3, 4, 2, 3, 3, 4, 3, 4, 4, 5,
-    2, 3, 3, 4, 3, 4, 4, 5, 3, 4, 4, 5, 4, 5, 5, 6, 2, 3, 3, 4, 3, 4, 4, 5,
-    3, 4, 4, 5, 4, 5, 5, 6, 3, 4, 4, 5, 4, 5, 5, 6, 4, 5, 5, 6, 5, 6, 6, 7,
-    2, 3, 3, 4, 3, 4, 4, 5, 3, 4, 4, 5, 4, 5, 5, 6, 3, 4, 4, 5, 4, 5, 5, 6,
-    4, 5, 5, 6, 5, 6, 6, 7, 3, 4, 4, 5, 4, 5, 5, 6, 4, 5, 5, 6, 5, 6, 6, 7,
-    4, 5, 5, 6, 5, 6, 6, 7, 5, 6, 6, 7, 6, 7, 7, 8
-  };
-
-  int *dd = &(ba->nints);
-  dd++;
-  unsigned char *d = (unsigned char *)dd;
-
-  int n = (ba->nints - 1) * sizeof(int);
-  int cnt = 0;
-  for (int i = 0; i < n; i++) {
-    cnt += cb_table[(*d++)];
-  }
-
-  n = ba->nbits - n * 8;
-  if (n == 0)
-    return cnt;
-
-  int j = dd[ba->nints - 1];
-  while (n >= 8) {
-    cnt += cb_table[j & 0xFF];
-    n -= 8;
-    j >>= 8;
-  }
-  if (n > 0) {
-    cnt += cb_table[j & 0xFF] - cb_table[(j & 0xFF) >> n];
-  }
-  return cnt;
+  unsigned int const *data = bit_array_words(ba);
+  int n_full = ba->nbits / BITS_PER_WORD;
+
+  /* Two words per hardware popcount where the instruction set has one */
+  long long cnt = 0;
+  int i = 0;
+  for (; i + 1 < n_full; i += 2) {
+    unsigned long long pair;
+    memcpy(&pair, data + i, sizeof(pair));
+    cnt += __builtin_popcountll(pair);
+  }
+  for (; i < n_full; i++)
+    cnt += __builtin_popcount(data[i]);
+
+  /* Bits past nbits in the last word may hold anything */
+  int n_tail = ba->nbits & (BITS_PER_WORD - 1);
+  if (n_tail > 0)
+    cnt += __builtin_popcount(data[n_full] & ~(~0u << n_tail));
+  return (int)cnt;
 }
 
 /**********************************************************************
@@ -477,10 +435,160 @@ int is_reverse_abbrev(const char *abbrev, const char *full) {
   return (strcmp(abbrev, full + (nf - na)) == 0);
 }
 
+/* Lists at least this long are sorted as arrays: one pass gathers the
+ * nodes, the sort then runs over contiguous memory instead of chasing next
+ * pointers, and one pass relinks them.  Shorter lists are merge sorted in
+ * place. */
+#define SORT_AS_ARRAY_MIN 64
+
+/*************************************************************************
+radix_sort_items:
+  In: items: array of items to sort by key
+      scratch: array of the same length to sort through
+      n: number of items
+  Out: whichever of the two arrays holds the items in ascending key order.
+       Items with equal keys keep their order.  Byte positions where all
+       keys agree are skipped, so keys that only vary in their low bytes
+       (e.g. addresses from one pool) take only a few passes.
+*************************************************************************/
+struct sort_item *radix_sort_items(struct sort_item *items,
+                                   struct sort_item *scratch, size_t n) {
+  size_t count[8][256];
+  memset(count, 0, sizeof(count));
+  for (size_t i = 0; i < n; i++) {
+    uint64_t key = items[i].key;
+    for (int d = 0; d < 8; d++)
+      count[d][(key >> (8 * d)) & 0xFF]++;
+  }
+
+  struct sort_item *from = items, *to = scratch;
+  for (int d = 0; d < 8; d++) {
+    if (n == 0 || count[d][(from[0].key >> (8 * d)) & 0xFF] == n)
+      continue;
+    size_t sum = 0;
+    for (int b = 0; b < 256; b++) {
+      size_t c = count[d][b];
+      count[d][b] = sum;
+      sum += c;
+    }
+    for (size_t i = 0; i < n; i++)
+      to[count[d][(from[i].key >> (8 * d)) & 0xFF]++] = from[i];
+    struct sort_item *swap = from;
+    from = to;
+    to = swap;
+  }
+  return from;
+}
+
+/* Relink an array of list nodes in array order. */
+static struct void_list *relink_void_list(struct void_list **nodes, size_t n) {
+  for (size_t i = 0; i + 1 < n; i++)
+    nodes[i]->next = nodes[i + 1];
+  nodes[n - 1]->next = NULL;
+  return nodes[0];
+}
+
+/* Number of nodes in a list, or 0 if it is shorter than SORT_AS_ARRAY_MIN */
+static size_t void_list_long_length(struct void_list *vl) {
+  size_t n = 0;
+  for (; vl != NULL; vl = vl->next)
+    n++;
+  return (n >= SORT_AS_ARRAY_MIN) ? n : 0;
+}
+
+/*************************************************************************
+void_list_sort_array:
+  In: linked list containing void pointers, at least SORT_AS_ARRAY_MIN long
+      its length
+  Out: the list radix sorted by memory address, or NULL if there was no
+       memory to sort it as an array
+*************************************************************************/
+static struct void_list *void_list_sort_array(struct void_list *vl, size_t n) {
+  struct sort_item *items =
+      (struct sort_item *)malloc(2 * n * sizeof(struct sort_item));
+  if (items == NULL)
+    return NULL;
+
+  /* Flip the sign bit so unsigned key order is the signed order used by
+   * the list sort */
+  size_t i = 0;
+  for (; vl != NULL; vl = vl->next, i++) {
+    items[i].key = (uint64_t)(intptr_t)vl->data ^ (UINT64_C(1) << 63);
+    items[i].item = vl;
+  }
+
+  struct sort_item *sorted = radix_sort_items(items, items + n, n);
+  for (i = 0; i + 1 < n; i++)
+    ((struct void_list *)sorted[i].item)->next =
+        (struct void_list *)sorted[i + 1].item;
+  ((struct void_list *)sorted[n - 1].item)->next = NULL;
+  vl = (struct void_list *)sorted[0].item;
+
+  free(items);
+  return vl;
+}
+
+/*************************************************************************
+void_list_sort_array_by:
+  In: linked list containing void pointers, at least SORT_AS_ARRAY_MIN long
+      its length
+      "less than or equal to" function, as for void_list_sort_by
+  Out: the list sorted with a stable bottom-up merge sort over an array of
+       its nodes (insertion sorted runs of 16 first), or NULL if there was
+       no memory to sort it as an array
+*************************************************************************/
+static struct void_list *void_list_sort_array_by(struct void_list *vl,
+                                                 size_t n,
+                                                 int (*leq)(void *, void *)) {
+  struct void_list **nodes =
+      (struct void_list **)malloc(2 * n * sizeof(struct void_list *));
+  if (nodes == NULL)
+    return NULL;
+
+  size_t i = 0;
+  for (; vl != NULL; vl = vl->next)
+    nodes[i++] = vl;
+
+  const size_t run = 16;
+  for (size_t lo = 0; lo < n; lo += run) {
+    size_t hi = (lo + run < n) ? lo + run : n;
+    for (i = lo + 1; i < hi; i++) {
+      struct void_list *x = nodes[i];
+      size_t j = i;
+      for (; j > lo && !(*leq)(nodes[j - 1]->data, x->data); j--)
+        nodes[j] = nodes[j - 1];
+      nodes[j] = x;
+    }
+  }
+
+  struct void_list **from = nodes, **to = nodes + n;
+  for (size_t width = run; width < n; width *= 2) {
+    for (size_t lo = 0; lo < n; lo += 2 * width) {
+      size_t mid = (lo + width < n) ? lo + width : n;
+      size_t hi = (lo + 2 * width < n) ? lo + 2 * width : n;
+      size_t a = lo, b = mid, k = lo;
+      while (a < mid && b < hi)
+        to[k++] = (*leq)(from[a]->data, from[b]->data) ? from[a++] : from[b++];
+      while (a < mid)
+        to[k++] = from[a++];
+      while (b < hi)
+        to[k++] = from[b++];
+    }
+    struct void_list **swap = from;
+    from = to;
+    to = swap;
+  }
+
+  vl = relink_void_list(from, n);
+  free(nodes);
+  return vl;
+}
+
 /*************************************************************************
 void_list_sort:
   In: linked list contining void pointers
-  Out: linked list is mergesorted by memory address
+  Out: linked list is mergesorted by memory address (radix sorted as an
+       array if it is long)
 *************************************************************************/
 struct void_list *void_list_sort(struct void_list *vl) {
   struct void_list *stack[64];
@@ -488,6 +596,10 @@ struct void_list *void_list_sort(struct void_list *vl) {
   struct void_list *left, *right, *merge, *tail;
   int si = 0;
 
+  size_t n = void_list_long_length(vl);
+  if (n > 0 && (merge = void_list_sort_array(vl, n)) != NULL)
+    return merge;
+
   /* HACK: If vl == NULL, we return stack[0] unmodified, so initialize it to
    *       NULL. */
   stack[0] = NULL;
@@ -602,7 +714,8 @@ struct void_list *void_list_sort(struct void_list *vl) {
 void_list_sort_by:
   In: linked list containing void pointers
       comparison function that compares two void pointers
-  Out: linked list is mergesorted according to function
+  Out: linked list is mergesorted according to function (as an array if
+       it is long)
   Note: function should implement "less than or equal to", i.e., it
         should return a nonzero value if the first pointer is considered
         to be less than or equal to the second (based on contents or
@@ -615,6 +728,10 @@ struct void_list *void_list_sort_by(struct void_list *vl,
   struct void_list *left, *right, *merge, *tail;
   int si = 0;
 
+  size_t n = void_list_long_length(vl);
+  if (n > 0 && (merge = void_list_sort_array_by(vl, n, leq)) != NULL)
+    return merge;
+
   /* HACK: If vl == NULL, we return stack[0] unmodified, so initialize it to
    *       NULL. */
   stack[0] = NULL;
@@ -1553,11 +1670,273 @@ int add_string_to_buffer(struct string_buffer *sb, char *str) {
  Pointer hashes implementation
 *******************************************************************/
 
+#define PH_EMPTY 0x80   /* Control byte of an empty slot */
+#define PH_DELETED 0xFE /* Control byte of a slot whose item was removed */
+#define PH_MIN_SIZE 8   /* Smallest table */
+#define PH_MIGRATE_STEP 32 /* Fewest old slots moved per add or remove */
+
+/* Groups of control bytes, and bit masks of the bytes in a group that
+ * match: one bit per byte with SSE2, the top bit of each byte otherwise. */
+#ifdef __SSE2__
+#define PH_GROUP 16
+#define PH_MASK_SHIFT 0
+typedef unsigned int ph_mask;
+
+static inline ph_mask ph_match(unsigned char const *g, unsigned char c) {
+  __m128i ctrl = _mm_loadu_si128((__m128i const *)g);
+  return _mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8((char)c)));
+}
+
+/* Empty or deleted: the control bytes with their top bit set */
+static inline ph_mask ph_match_free(unsigned char const *g) {
+  return _mm_movemask_epi8(_mm_loadu_si128((__m128i const *)g));
+}
+#else
+#define PH_GROUP 8
+#define PH_MASK_SHIFT 3
+typedef uint64_t ph_mask;
+#define PH_LSB UINT64_C(0x0101010101010101)
+#define PH_MSB UINT64_C(0x8080808080808080)
+
+static inline ph_mask ph_match(unsigned char const *g, unsigned char c) {
+  uint64_t ctrl;
+  memcpy(&ctrl, g, sizeof(ctrl));
+  uint64_t x = ctrl ^ (PH_LSB * c);
+  /* May flag a byte above a true match as well; callers compare keys */
+  ph_mask m = (x - PH_LSB) & ~x & PH_MSB;
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  m = __builtin_bswap64(m);
+#endif
+  return m;
+}
+
+static inline ph_mask ph_match_free(unsigned char const *g) {
+  uint64_t ctrl;
+  memcpy(&ctrl, g, sizeof(ctrl));
+  ph_mask m = ctrl & PH_MSB;
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  m = __builtin_bswap64(m);
+#endif
+  return m;
+}
+#endif
+
+/* Slot offset within the group of the lowest bit of a mask */
+#define PH_MASK_OFFSET(m) (__builtin_ctzll(m) >> PH_MASK_SHIFT)
+
+/* Remix a caller's hash so its low bits pick the slot and its top bits the
+ * control byte; callers' hashes are often weak in one or the other. */
+static inline unsigned int ph_mix(unsigned int h) {
+  h ^= h >> 16;
+  h *= 0x85ebca6bu;
+  h ^= h >> 13;
+  h *= 0xc2b2ae35u;
+  h ^= h >> 16;
+  return h;
+}
+
+static inline unsigned char ph_h2(unsigned int mixed) {
+  return (unsigned char)(mixed >> 25);
+}
+
+/* First group to probe.  Tables of at most PH_GROUP slots are one group
+ * padded with empty bytes, so they are always probed from slot 0. */
+static inline int ph_first_group(struct pointer_hash_slots const *s,
+                                 unsigned int mixed) {
+  return (s->size <= PH_GROUP) ? 0 : (int)(mixed & (s->size - 1));
+}
+
+static inline void ph_set_ctrl(struct pointer_hash_slots *s, int i,
+                               unsigned char c) {
+  s->ctrl[i] = c;
+  if (s->size > PH_GROUP && i < PH_GROUP)
+    s->ctrl[s->size + i] = c;
+}
+
+/*************************************************************************
+ph_slots_alloc:
+  In:  s: slots to set up
+       size: number of slots, a power of two of at least PH_MIN_SIZE
+  Out: 0 on success; 1 if memory allocation fails.  All slots are empty.
+       Everything lives in one block that starts at s->ctrl.
+**************************************************************************/
+static int ph_slots_alloc(struct pointer_hash_slots *s, int size) {
+  size_t ctrl_bytes = (size + PH_GROUP + 7) & ~(size_t)7;
+  char *block = (char *)malloc(ctrl_bytes + size * (sizeof(unsigned int) +
+                                                    sizeof(void const *) +
+                                                    sizeof(void *)));
+  if (block == NULL)
+    return 1;
+
+  s->size = size;
+  s->ctrl = (unsigned char *)block;
+  s->keys = (void const **)(block + ctrl_bytes);
+  s->values = (void **)(s->keys + size);
+  s->hashes = (unsigned int *)(s->values + size);
+  memset(s->ctrl, PH_EMPTY, size + PH_GROUP);
+  return 0;
+}
+
+static void ph_slots_free(struct pointer_hash_slots *s) {
+  free(s->ctrl);
+  memset(s, 0, sizeof(struct pointer_hash_slots));
+}
+
+/*************************************************************************
+ph_find:
+  In:  s: slots to search
+       key: the key to find
+       mixed: the remixed hash of the key
+  Out: the slot holding key, or -1 if it is not there
+**************************************************************************/
+static int ph_find(struct pointer_hash_slots const *s, void const *key,
+                   unsigned int mixed) {
+  if (s->size == 0)
+    return -1;
+
+  int mask = s->size - 1;
+  unsigned char h2 = ph_h2(mixed);
+  int pos = ph_first_group(s, mixed);
+  for (int stride = 0; stride < s->size; ) {
+    unsigned char const *g = s->ctrl + pos;
+    for (ph_mask m = ph_match(g, h2); m != 0; m &= m - 1) {
+      int idx = (pos + PH_MASK_OFFSET(m)) & mask;
+      if (s->keys[idx] == key)
+        return idx;
+    }
+    if (ph_match(g, PH_EMPTY) != 0 || s->size <= PH_GROUP)
+      return -1;
+    stride += PH_GROUP;
+    pos = (pos + stride) & mask;
+  }
+  return -1;
+}
+
+/*************************************************************************
+ph_insert_new:
+  In:  s: slots to insert into, with at least one free slot
+       key, keyhash, value: the item, which must not be in s yet
+       mixed: the remixed hash of the key
+  Out: 1 if a deleted slot was reused, else 0
+**************************************************************************/
+static int ph_insert_new(struct pointer_hash_slots *s, void const *key,
+                         unsigned int keyhash, unsigned int mixed,
+                         void *value) {
+  int mask = s->size - 1;
+  int pos = ph_first_group(s, mixed);
+  for (int stride = 0;; ) {
+    for (ph_mask m = ph_match_free(s->ctrl + pos); m != 0; m &= m - 1) {
+      int off = PH_MASK_OFFSET(m);
+      if (s->size <= PH_GROUP && off >= s->size)
+        break; /* Padding of a one-group table */
+      int idx = (pos + off) & mask;
+      int reused = (s->ctrl[idx] == PH_DELETED);
+      ph_set_ctrl(s, idx, ph_h2(mixed));
+      s->hashes[idx] = keyhash;
+      s->keys[idx] = key;
+      s->values[idx] = value;
+      return reused;
+    }
+    stride += PH_GROUP;
+    pos = (pos + stride) & mask;
+  }
+}
+
+/* Move the item in slot i of 'from' to 'to', which must have a free slot,
+ * leaving a deleted slot behind; returns 1 if a deleted slot of 'to' was
+ * reused */
+static int ph_move(struct pointer_hash_slots *from, int i,
+                   struct pointer_hash_slots *to) {
+  unsigned int mixed = ph_mix(from->hashes[i]);
+  int reused = ph_insert_new(to, from->keys[i], from->hashes[i], mixed,
+                             from->values[i]);
+  ph_set_ctrl(from, i, PH_DELETED);
+  return reused;
+}
+
+/* Smallest table size of at least 'size' (a power of two) */
+
+static int ph_table_size(int size) {
+  int n = PH_MIN_SIZE;
+  while (n < size)
+    n <<= 1;
+  return n;
+}
+
+/*************************************************************************
+ph_migrate:
+  In:  ht: hash table with an incremental resize going on
+       n_slots: how many slots of the old table to move at most
+  Out: items in those slots are in the new table; the old table is freed
+       once all have moved
+**************************************************************************/
+static void ph_migrate(struct pointer_hash *ht, int n_slots) {
+  struct pointer_hash_slots *old = &ht->old;
+  int end = ht->old_pos + n_slots;
+  if (end > old->size || n_slots < 0)
+    end = old->size;
+  for (int i = ht->old_pos; i < end; i++) {
+    if (old->ctrl[i] & 0x80)
+      continue;
+    ht->num_deleted -= ph_move(old, i, &ht->cur);
+    --ht->old_items;
+  }
+  ht->old_pos = end;
+  if (ht->old_pos >= old->size || ht->old_items == 0)
+    ph_slots_free(old);
+}
+
+/* Old slots to move per add or remove.  After a resize the new table has
+ * room for at least a quarter of its size more items, so moving this many
+ * empties the old table, however much larger, before the new one fills. */
+static inline int ph_migrate_step(struct pointer_hash const *ht) {
+  int step = (int)(4 * (long long)ht->old.size / ht->cur.size);
+  return (step > PH_MIGRATE_STEP) ? step : PH_MIGRATE_STEP;
+}
+
+/*************************************************************************
+ph_start_resize:
+  In:  ht: hash table
+       size: slots of the new table
+  Out: 0 on success; 1 if memory allocation fails, leaving the table as it
+       was.  New items now go to a fresh table, grown if need be to hold
+       all items and one more; the items of the current table follow a few
+       at a time (see ph_migrate).  Any left over from an earlier resize go
+       straight to the fresh table, as the current one may have no room.
+**************************************************************************/
+static int ph_start_resize(struct pointer_hash *ht, int size) {
+  while (ht->num_items + 1 > size - (size >> 3))
+    size <<= 1;
+
+  struct pointer_hash_slots fresh;
+  if (ph_slots_alloc(&fresh, size))
+    return 1;
+
+  int left_over = 0;
+  if (ht->old.size != 0) {
+    left_over = ht->old_items;
+    for (int i = ht->old_pos; i < ht->old.size; i++) {
+      if (!(ht->old.ctrl[i] & 0x80))
+        ph_move(&ht->old, i, &fresh);
+    }
+    ph_slots_free(&ht->old);
+  }
+  ht->old = ht->cur;
+  ht->old_pos = 0;
+  ht->old_items = ht->num_items - left_over;
+  ht->cur = fresh;
+
+  ht->num_deleted = 0;
+  if (ht->old_items == 0)
+    ph_slots_free(&ht->old);
+  return 0;
+}
+
 /*************************************************************************
   Initialize a pointer hash to a given initial size.  Returns 0 on success.
   Note that the desired table size may be exceeded.  Presently, the
   implementation always rounds the table size up to the nearest integer power
-  of two.
+  of two, and to at least PH_MIN_SIZE.
 
   In:  struct pointer_hash *ht - the hash table to initialize
        int size - the desired table size
@@ -1567,42 +1946,24 @@ int pointer_hash_init(struct pointer_hash *ht, int size) {
   assert(size >= 0);
 
   memset(ht, 0, sizeof(struct pointer_hash));
+  return ph_slots_alloc(&ht->cur, ph_table_size(size));
+}
 
-  /* Don't allow size 0 tables.  Otherwise, the key & (tablesize-1) trick fails
-   * spectacularly. */
-  if (size == 0) {
-    ++size;
-  }
-
-  /* Fold size to next larger power of 2 if it isn't a power of 2 already */
-  if ((size) & (size - 1)) {
-    size |= (size >> 1);
-    size |= (size >> 2);
-    size |= (size >> 4);
-    size |= (size >> 8);
-    size |= (size >> 16);
-    ++size;
-  }
+/*************************************************************************
+  Quickly clear all values from a pointer hash.  Does not free any memory
+  of the current table.
 
-  /* Initialize fields */
+  In:  struct pointer_hash *ht - the hash table to clear
+  Out: hash table is empty
+**************************************************************************/
+void pointer_hash_clear(struct pointer_hash *ht) {
+  ph_slots_free(&ht->old);
+  if (ht->cur.size != 0)
+    memset(ht->cur.ctrl, PH_EMPTY, ht->cur.size + PH_GROUP);
   ht->num_items = 0;
-  ht->table_size = size;
-  if ((ht->hashes = (unsigned int *)malloc(sizeof(unsigned int) *size)) ==
-          NULL ||
-      (ht->keys = (void const **)malloc(sizeof(void const *) *size)) == NULL ||
-      (ht->values = (void **)malloc(sizeof(void *) * size)) == NULL)
-    goto failure;
-
-  /* Make sure our table starts out empty */
-  memset(ht->hashes, 0, sizeof(unsigned int) * size);
-  memset(ht->keys, 0, sizeof(void *) * size);
-  memset(ht->values, 0, sizeof(void *) * size);
-
-  return 0;
-
-failure:
-  pointer_hash_destroy(ht);
-  return 1;
+  ht->num_deleted = 0;
+  ht->old_pos = 0;
+  ht->old_items = 0;
 }
 
 /*************************************************************************
@@ -1612,23 +1973,15 @@ failure:
   Out: hash table is destroyed and associated memory is freed
 **************************************************************************/
 void pointer_hash_destroy(struct pointer_hash *ht) {
-  if (ht->hashes)
-    free(ht->hashes);
-  if (ht->keys)
-    free(ht->keys);
-  if (ht->values)
-    free(ht->values);
-  ht->num_items = 0;
-  ht->table_size = 0;
-  ht->hashes = NULL;
-  ht->keys = NULL;
-  ht->values = NULL;
+  ph_slots_free(&ht->cur);
+  ph_slots_free(&ht->old);
+  memset(ht, 0, sizeof(struct pointer_hash));
 }
 
 /*************************************************************************
   Manually resize a pointer hash to have at least 'new_size' bins.  New size
-  may exceed requested size.  Works exactly like pointer_hash_init, except
-  values are copied from the old table to the new one.
+  may exceed requested size.  Unlike the resizing done by add and remove,
+  all items are moved at once.
 
   In:  struct pointer_hash *ht - the hash table to resize
        int new_size - the desired table size
@@ -1637,36 +1990,20 @@ void pointer_hash_destroy(struct pointer_hash *ht) {
   On failure, the hash table is left unchanged from its prior state.
 **************************************************************************/
 int pointer_hash_resize(struct pointer_hash *ht, int new_size) {
-  if (new_size == ht->table_size)
-    return 0;
   if (new_size < ht->num_items)
     return 1;
 
-  /* Save old hash, allocate new hash */
-  struct pointer_hash old = *ht;
-  if (pointer_hash_init(ht, new_size)) {
-    *ht = old;
-    return 1;
-  }
-
-  /* Copy items over to new hash */
-  for (int old_item_idx = 0; old_item_idx < old.table_size; ++old_item_idx) {
-    if (old.keys[old_item_idx] == NULL)
-      continue;
-
-    if (pointer_hash_add(ht, old.keys[old_item_idx], old.hashes[old_item_idx],
-                         old.values[old_item_idx]))
-      goto failure;
-  }
+  new_size = ph_table_size(new_size);
+  while (ht->num_items >= new_size - (new_size >> 3))
+    new_size <<= 1;
+  if (new_size == ht->cur.size && ht->old.size == 0 && ht->num_deleted == 0)
+    return 0;
 
-  /* Destroy the old hash */
-  pointer_hash_destroy(&old);
+  if (ph_start_resize(ht, new_size))
+    return 1;
+  if (ht->old.size != 0)
+    ph_migrate(ht, -1);
   return 0;
-
-failure:
-  pointer_hash_destroy(ht);
-  *ht = old;
-  return 1;
 }
 
 /*************************************************************************
@@ -1683,43 +2020,37 @@ int pointer_hash_add(struct pointer_hash *ht, void const *key,
                      unsigned int keyhash, void *value) {
   /* In case pointer hash was initialized using memset, we'll allocate space
    * on-demand.  */
-  if (ht->table_size == 0) {
-    if (pointer_hash_resize(ht, 2))
+  if (ht->cur.size == 0) {
+    if (ph_slots_alloc(&ht->cur, PH_MIN_SIZE))
       return 1;
   }
+  if (ht->old.size != 0)
+    ph_migrate(ht, ph_migrate_step(ht));
 
-  /* Make sure our table always has free space */
-  if (ht->num_items >= (ht->table_size >> 1)) {
-    if (pointer_hash_resize(ht, ht->table_size << 1))
-      return 1;
+  /* Found an old value for this key.  Replace it.  Do not increment the item
+   * count. */
+  unsigned int mixed = ph_mix(keyhash);
+  int idx = ph_find(&ht->cur, key, mixed);
+  if (idx >= 0) {
+    ht->cur.values[idx] = value;
+    return 0;
   }
-
-  /* Scan over entries until the end of the table */
-  unsigned int start_index = keyhash & (ht->table_size - 1);
-  for (unsigned int i = 0; i < (unsigned int)ht->table_size; i++) {
-    unsigned int cur_index = (start_index + i) & (ht->table_size - 1);
-
-    /* Found an old value for this key.  Replace it.  Do not increment the item
-     * count. */
-    if (ht->keys[cur_index] == key) {
-      ht->values[cur_index] = value;
-      return 0;
-    }
-
-    /* Found an empty slot.  Fill it. */
-    if (ht->keys[cur_index] == NULL) {
-      ht->hashes[cur_index] = keyhash;
-      ht->keys[cur_index] = key;
-      ht->values[cur_index] = value;
-      goto done;
-    }
+  if (ht->old.size != 0 && (idx = ph_find(&ht->old, key, mixed)) >= 0) {
+    ht->old.values[idx] = value;
+    return 0;
   }
 
-  /* This shouldn't happen unless the pointer hash is corrupted, since we've
-   * already ensured that we have enough space */
-  return 1;
+  /* Keep the table at most 7/8 full, counting deleted slots; grow if live
+   * items are the problem, else just sweep out the deleted ones */
+  int in_cur = ht->num_items - ht->old_items;
+  int size = ht->cur.size;
+  if (in_cur + ht->num_deleted + 1 > size - (size >> 3)) {
+    int new_size = (2 * (ht->num_items + 1) > size) ? 2 * size : size;
+    if (ph_start_resize(ht, new_size))
+      return 1;
+  }
 
-done:
+  ht->num_deleted -= ph_insert_new(&ht->cur, key, keyhash, mixed, value);
   ++ht->num_items;
   return 0;
 }
@@ -1736,33 +2067,18 @@ done:
 **************************************************************************/
 void *pointer_hash_lookup_ext(struct pointer_hash const *ht, void const *key,
                               unsigned int keyhash, void *default_value) {
-  /* Empty table.  Not found. */
-  if (ht->table_size == 0)
-    return default_value;
-
-  /* Search from start position to end of table */
-  unsigned int start_index = keyhash & (ht->table_size - 1);
-  for (unsigned int i = 0; i < (unsigned int)ht->table_size; i++) {
-    unsigned int cur_index = (start_index + i) & (ht->table_size - 1);
-
-    /* Empty slot - key not found. */
-    if (ht->keys[cur_index] == NULL)
-      return default_value;
-
-    /* Found our value. */
-    if (ht->keys[cur_index] == key)
-      return ht->values[cur_index];
-  }
-
-  /* Worst case scenario.  We searched the entire table.  Shouldn't happen with
-   * the current tuning parameters, which do not permit the table to be full.
-   */
+  unsigned int mixed = ph_mix(keyhash);
+  int idx = ph_find(&ht->cur, key, mixed);
+  if (idx >= 0)
+    return ht->cur.values[idx];
+  if (ht->old.size != 0 && (idx = ph_find(&ht->old, key, mixed)) >= 0)
+    return ht->old.values[idx];
   return default_value;
 }
 
 /*************************************************************************
   Remove a value from a pointer hash.  Returns 0 if the item was
-  successfully removed, or 0 if the item was not found.  Note that a
+  successfully removed, or 1 if the item was not found.  Note that a
   NULL key is not allowed in a pointer hash.
 
   In:  struct pointer_hash *ht - the hash table to remove from
@@ -1779,91 +2095,64 @@ int pointer_hash_remove(struct pointer_hash *ht, void const *key,
   if (key == NULL)
     return 1;
 
-  /* If the table is empty, we're done */
-  if (ht->table_size == 0)
+  if (ht->old.size != 0)
+    ph_migrate(ht, ph_migrate_step(ht));
+
+  unsigned int mixed = ph_mix(keyhash);
+  struct pointer_hash_slots *s = &ht->cur;
+  int idx = ph_find(s, key, mixed);
+  if (idx < 0 && ht->old.size != 0) {
+    s = &ht->old;
+    idx = ph_find(s, key, mixed);
+  }
+  if (idx < 0)
     return 1;
 
-  int start = keyhash & (ht->table_size - 1); /* Where do we start? */
-  int next_slot = -1;                         /* Next vacant slot to fill */
-
-  /* Scan through the table to remove the item, and resituate any
-   * entries which would, due to the streaming collision-avoidance
-   * approach, be orphaned.
-   */
-  int cur = start;
-  do {
-    /* If we found the item to remove, remove it */
-    if (key != NULL && ht->keys[cur] == key) {
-      /* Clear this value */
-      ht->keys[cur] = NULL;
-      ht->values[cur] = NULL;
-      ht->hashes[cur] = 0;
-      --ht->num_items;
-
-      if (ht->table_size > (ht->num_items << 2)) {
-        /* If resizing the pointer hash succeeded, we don't need to do
-         * any more work, since it will have prevented orphans. */
-        if (!pointer_hash_resize(ht, ht->num_items << 1))
-          return 0;
-      }
+  /* One-group tables never probe past a slot, so it can simply be empty
+   * again; elsewhere, a probe may have passed this slot on its way on */
+  int tombstone = (s->size > PH_GROUP);
+  ph_set_ctrl(s, idx, tombstone ? PH_DELETED : PH_EMPTY);
+  s->keys[idx] = NULL;
+  s->values[idx] = NULL;
+  --ht->num_items;
+  if (s == &ht->old)
+    --ht->old_items;
+  else
+    ht->num_deleted += tombstone;
 
-      /* We may need to move something into this empty slot, so
-       * remember where we were. */
-      next_slot = cur;
+  /* Shrink tables that have become mostly empty */
+  if (ht->old.size == 0 && ht->cur.size > PH_MIN_SIZE &&
+      ht->cur.size > (ht->num_items << 2))
+    (void)ph_start_resize(ht, ph_table_size(ht->num_items << 1));
+  return 0;
+}
 
-      /* This indicates that we've already removed the value and are
-       * now just fixing the table contents */
-      key = NULL;
-    }
+/*************************************************************************
+  Step through the items of a pointer hash.
 
-    /* We found a NULL entry, so stop scanning -- the table is in a
-     * valid state */
-    else if (ht->keys[cur] == NULL) {
-      if (key == NULL)
-        return 0;
-      else
-        return 1;
+  In:  struct pointer_hash *ht - the hash table
+       int *pos - position, 0 to start
+       void const **key - where to store the key of the next item
+       void **value - where to store its value
+  Out: 1 if an item was found, 0 if there are no more
+**************************************************************************/
+int pointer_hash_next(struct pointer_hash const *ht, int *pos,
+                      void const **key, void **value) {
+  for (; *pos < ht->cur.size + ht->old.size; ++*pos) {
+    struct pointer_hash_slots const *s = &ht->cur;
+    int i = *pos;
+    if (i >= s->size) {
+      i -= s->size;
+      s = &ht->old;
     }
-
-    /* This entry may need to be reseated */
-    else if (next_slot != -1) {
-      /* This is the slot where we'd start looking for this entry */
-      int desiredSlot = ht->hashes[cur] & (ht->table_size - 1);
-
-      /* If we would have hit our newly introduced NULL entry after we
-       * started searching for this entry, but before we found what we
-       * were looking for, resituate this entry.
-       */
-      if ((next_slot < cur &&
-           (desiredSlot <= next_slot || desiredSlot > cur)) ||
-          (next_slot > cur &&
-           (desiredSlot <= next_slot && desiredSlot > cur))) {
-        /* Move this entry to its new location */
-        ht->hashes[next_slot] = ht->hashes[cur];
-        ht->keys[next_slot] = ht->keys[cur];
-        ht->values[next_slot] = ht->values[cur];
-
-        /* Free this slot */
-        ht->hashes[cur] = 0;
-        ht->keys[cur] = NULL;
-        ht->values[cur] = NULL;
-
-        /* We may need to move something into this empty slot, so
-         * remember where we were. */
-        next_slot = cur;
-      }
+    if ((s->ctrl[i] & 0x80) == 0) {
+      *key = s->keys[i];
+      *value = s->values[i];
+      ++*pos;
+      return 1;
     }
-
-    /* Advance to the next entry */
-    if (++cur == ht->table_size)
-      cur = 0;
-  } while (cur != start);
-
-  /* If we found our entry, success, else failure. */
-  if (key == NULL)
-    return 0;
-  else
-    return 1;
+  }
+  return 0;
 }
 
 /*************************************************************************
@@ -1945,6 +2234,21 @@ int double_cmp(void const *i1, void const *i2) {
     return 0;
 }
 
+/*************************************************************************
+ ulong_cmp:
+    Comparison function for u_longs, to be passed to qsort or bsearch.
+
+ In:  i1: first item for comparison
+      i2: second item for comparison
+ Out: -1, 0, or 1 if the first item is less than, equal to, or greater than the
+      second, resp.
+*************************************************************************/
+int ulong_cmp(void const *i1, void const *i2) {
+  u_long const *u1 = (u_long const *)i1;
+  u_long const *u2 = (u_long const *)i2;
+  return (*u1 > *u2) - (*u1 < *u2);
+}
+
 /**************************************************************************
 is_string_present_in_string_array:
   In: string "str"
@@ -24,6 +24,7 @@
 #pragma once
 
 #include <stdio.h>
+#include <stdint.h>
 
 #define COUNT_OF(arr) (sizeof((arr)) / sizeof((arr[0])))
 
@@ -55,10 +56,50 @@ struct bit_array {
   /* Bit array data runs off the end of this struct */
 };
 
+#define BITS_PER_WORD (8 * (int)sizeof(unsigned int))
+
+/* The words of a bit array, which follow the struct */
+static inline unsigned int *bit_array_words(struct bit_array *ba) {
+  return (unsigned int *)(ba + 1);
+}
+
+/*******************************************************************
+get_bit: returns the value of a bit in a bit_array
+
+ In:
+    ba: pointer to a bit_array struct
+    idx: the index of the bit to return
+
+ Out:
+    0 or 1, depending on whether the idx'th bit is set.  No
+    bounds checking is performed.
+*******************************************************************/
+static inline int get_bit(struct bit_array *ba, int idx) {
+  return (bit_array_words(ba)[idx / BITS_PER_WORD] >>
+          (idx & (BITS_PER_WORD - 1))) & 1u;
+}
+
+/*******************************************************************
+set_bit: set a value in a bit array
+
+ In:
+    ba: pointer to a bit_array struct
+    idx: the index of the bit to set
+    value: 0 = turn bit off; nonzero = turn bit on
+
+ Out:
+    Nothing
+*******************************************************************/
+static inline void set_bit(struct bit_array *ba, int idx, int value) {
+  unsigned int *word = &bit_array_words(ba)[idx / BITS_PER_WORD];
+  unsigned int bit = 1u << (idx & (BITS_PER_WORD - 1));
+  *word = value ? (*word | bit) : (*word & ~bit);
+}
+
 struct bit_array *new_bit_array(int bits);
 struct bit_array *duplicate_bit_array(struct bit_array *old);
-int get_bit(struct bit_array *ba, int idx);
-void set_bit(struct bit_array *ba, int idx, int value);
+int next_set_bit(struct bit_array *ba, int idx);
+int next_set_range(struct bit_array *ba, int idx, int *end);
 void set_bit_range(struct bit_array *ba, int idx1, int idx2, int value);
 void set_all_bits(struct bit_array *ba, int value);
 void bit_operation(struct bit_array *ba, struct bit_array *bb, char op);
@@ -77,6 +118,14 @@ struct void_list {
   void *data;
 };
 
+/* An item and its key, for radix_sort_items */
+struct sort_item {
+  uint64_t key;
+  void *item;
+};
+
+struct sort_item *radix_sort_items(struct sort_item *items,
+                                   struct sort_item *scratch, size_t n);
 struct void_list *void_list_sort(struct void_list *vl);
 struct void_list *void_list_sort_by(struct void_list *vl,
                                     int (*leq)(void *, void *));
@@ -157,27 +206,41 @@ double convert_iterations_to_seconds(
   if pointer_hash_destroy is not called on the hash before it goes out
   of scope.
 
-  The hash table collision strategy implemented by this structure is a
-  streaming strategy, rather than a chaining strategy.  This means that
-  when we try to insert a value into the n-th bin, if the n-th bin is
-  already occupied, we will move to the n+1-th bin (modulo table size)
-  until we find an insertion point.  When we do a lookup, therefore, we
-  need to scan forward until we either find our key, or until we find
-  an empty bin.  We can ensure that at least one of these conditions is
-  met by always keeping the table size greater than the number of
-  entries.
-
-  Currently, the pointer hash is tuned to keep the table size between 2
-  and 4 times the number of items it contains.
+  The table uses open addressing with a control byte per slot, as in
+  SwissTable: the byte says whether the slot is empty, deleted, or full,
+  and for a full slot holds 7 bits of the (remixed) hash.  Probing loads
+  a group of PH_GROUP control bytes at once (16 with SSE2, else 8 through
+  word operations), and only compares keys in slots whose byte matches.
+  A lookup stops at the first group with an empty slot; groups are visited
+  in triangular steps.  Tables are kept at most 7/8 full.
+
+  Growing or shrinking is incremental: the new table takes new items while
+  add and remove move a few slots of the old one over, so no single call
+  rehashes everything.  Lookups check both tables while this goes on.
+
+  A zeroed struct pointer_hash is a valid, empty table.
 *******************************************************************/
-struct pointer_hash {
-  int num_items;        /* num items in table */
-  int table_size;       /* size of table */
+
+/* Slots of one pointer hash table */
+struct pointer_hash_slots {
+  int size;             /* number of slots, a power of two; 0 if none */
+  unsigned char *ctrl;  /* control byte per slot; the first PH_GROUP are
+                           repeated after the last so that a group can be
+                           loaded at any slot */
   unsigned int *hashes; /* hash values for each entry */
   void const **keys;    /* keys for each entry */
   void **values;        /* values for each entry */
 };
 
+struct pointer_hash {
+  int num_items;   /* num items in both tables */
+  int num_deleted; /* deleted slots in 'cur' */
+  struct pointer_hash_slots cur; /* table new items go to */
+  struct pointer_hash_slots old; /* table being moved into 'cur' */
+  int old_pos;     /* next slot of 'old' to move */
+  int old_items;   /* items still in 'old' */
+};
+
 /* Initialize a pointer hash to a given initial size.  Returns 0 on
  * success. */
 int pointer_hash_init(struct pointer_hash *ht, int size);
@@ -189,8 +252,8 @@ void pointer_hash_clear(struct pointer_hash *ht);
 /* Destroy a pointer hash, freeing all memory associated with it. */
 void pointer_hash_destroy(struct pointer_hash *ht);
 
-/* Manually resize a pointer hash to have at least 'new_size' bins.
- * New size may exceed requested size. */
+/* Manually resize a pointer hash to have at least 'new_size' bins, all at
+ * once.  New size may exceed requested size. */
 int pointer_hash_resize(struct pointer_hash *ht, int new_size);
 
 /* Add a value to a pointer hash.  If a previous item was added for
@@ -209,13 +272,21 @@ void *pointer_hash_lookup_ext(struct pointer_hash const *ht, void const *key,
                               unsigned int keyhash, void *default_value);
 
 /* Remove a value from a pointer hash.  Returns 0 if the item was
- * successfully removed, or 0 if the item was not found.
+ * successfully removed, or 1 if the item was not found.
  */
 int pointer_hash_remove(struct pointer_hash *ht, void const *key,
                         unsigned int keyhash);
 
+/* Step through the items of a pointer hash, in no particular order.  Start
+ * with *pos = 0; returns 0 once all items have been seen.  The hash must not
+ * be changed while stepping through it. */
+int pointer_hash_next(struct pointer_hash const *ht, int *pos,
+                      void const **key, void **value);
+
 int double_cmp(void const *i1, void const *i2);
 
+int ulong_cmp(void const *i1, void const *i2);
+
 int is_string_present_in_string_array(const char * str, char ** strings, int length);
 
 int generate_range(struct num_expr_list_head *list, double start, double end,
@@ -388,7 +388,8 @@ void tform_matrix(struct vector3 *scale, struct vector3 *translate,
  * Performs vector subtraction.
  * Subtracts vector3 p1 from vector3 p2 placing the result in vector3 v.
  */
-void vectorize(struct vector3 *p1, struct vector3 *p2, struct vector3 *v) {
+void vectorize(struct vector3 const *p1, struct vector3 const *p2,
+               struct vector3 *v) {
 
   v->x = p2->x - p1->x;
   v->y = p2->y - p1->y;
@@ -48,7 +48,8 @@ void rotate_matrix(double (*im)[4], double (*om)[4], struct vector3 *axis,
                    double angle);
 void tform_matrix(struct vector3 *scale, struct vector3 *translate,
                   struct vector3 *axis, double angle, double (*om)[4]);
-void vectorize(struct vector3 *p1, struct vector3 *p2, struct vector3 *v);
+void vectorize(struct vector3 const *p1, struct vector3 const *p2,
+               struct vector3 *v);
 double vect_length(struct vector3 *v);
 double dot_prod(struct vector3 *v1, struct vector3 *v2);
 void cross_prod(struct vector3 *v1, struct vector3 *v2, struct vector3 *v3);
@@ -33,6 +33,9 @@
 #include "version.h"
 
 const char mcell_version[] = MCELL_VERSION;
+const char mcell_revision[] = MCELL_REVISION;
+const char mcell_build_compiler[] = MCELL_CC_VERSION;
+const char mcell_build_cflags[] = MCELL_CFLAGS;
 
 /*
  * Prints out authors' institutions.
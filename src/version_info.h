@@ -28,6 +28,12 @@
 /* MCell version as a string */
 extern char const mcell_version[];
 
+/* Revision, compiler version and compiler flags of the build, for machine
+ * readable records such as -bench_json */
+extern char const mcell_revision[];
+extern char const mcell_build_compiler[];
+extern char const mcell_build_cflags[];
+
 /* Write the credits to a file handle */
 void print_credits(FILE *f);
 
@@ -48,9 +48,14 @@
 #include "sched_util.h"
 #include "viz_output.h"
 #include "strfunc.h"
+#include "thread_util.h"
 #include "util.h"
 #include "vol_util.h"
 #include "sym_table.h"
+#include "dyngeom.h"
+#include "mcell_species.h"
+#include "mol_id_index.h"
+#include "text_output.h"
 
 /***  Temporary Viz Options compared to world->viz_options ***/
 
@@ -66,6 +71,30 @@
 #define VIZ_ALT_DUMP_FMT     0x10L /* Text format for human reading */
 #define VIZ_JSON_MOLCOMP_FMT 0x20L /* Text format using JSON lists to represent a molecule/component list */
 
+/* CELLBLENDER_DELTA format (see output_cellblender_delta_molecules) */
+#define VIZ_DELTA_VERSION    1
+#define VIZ_DELTA_POS_QUANTUM 1e-5  /* Position resolution in microns */
+#define VIZ_DELTA_NORM_SCALE 32767.0 /* Orientation steps per unit length */
+#define VIZ_DELTA_KEY_INTERVAL 16   /* Frames from one key frame to the next */
+
+/* TRAJECTORY format (see output_trajectory_molecules) */
+#define VIZ_TRACK_VERSION    1
+#define VIZ_TRACK_BLOCK      64     /* Samples buffered per molecule */
+
+/* Container format (see open_viz_frame) */
+#define VIZ_CONTAINER_SUFFIX ".frames"
+#define VIZ_CONTAINER_INDEX_SUFFIX ".idx"
+
+/* One entry of the frame index of a container */
+struct viz_frame_index_entry {
+  long long iteration; /* Iteration of the frame */
+  long long offset;    /* Byte offset of the frame in the container */
+  long long length;    /* Length of the frame in bytes */
+  int key;             /* 0 for a CELLBLENDER_DELTA frame coded against the
+                          one before it, 1 otherwise */
+  int reserved;
+};
+
 
 
 /* Output frame types. */
@@ -77,6 +106,17 @@ static int output_cellblender_molecules(struct volume *world,
                                         struct viz_output_block *,
                                         struct frame_data_list *fdlp);
 
+static int output_cellblender_delta_molecules(struct volume *world,
+                                              struct viz_output_block *,
+                                              struct frame_data_list *fdlp);
+
+static int output_trajectory_molecules(struct volume *world,
+                                       struct viz_output_block *,
+                                       struct frame_data_list *fdlp);
+
+static int finish_trajectory(struct volume *world,
+                             struct viz_output_block *vizblk);
+
 /* == viz-specific Utilities == */
 
 /*************************************************************************
@@ -115,35 +155,405 @@ static long long frame_iteration(struct volume *world, double iterval,
   }
 }
 
+/*************************************************************************
+free_viz_molecule_lists:
+    Releases the per-species molecule lists and the CELLBLENDER_DELTA and
+    TRAJECTORY state kept by a viz block between frames.
+
+        In:  struct viz_output_block *vizblk - the block
+        Out: none
+**************************************************************************/
+static void free_viz_molecule_lists(struct viz_output_block *vizblk) {
+  if (vizblk->viz_molp != NULL)
+    free_ptr_array((void **)vizblk->viz_molp, vizblk->viz_n_species);
+  free(vizblk->viz_mol_count);
+  free(vizblk->viz_mol_capacity);
+  if (vizblk->delta_species != NULL) {
+    for (int i = 0; i < vizblk->viz_n_species; ++i) {
+      free(vizblk->delta_species[i].mols);
+      free(vizblk->delta_species[i].spare);
+    }
+    free(vizblk->delta_species);
+  }
+  for (u_int i = 0; i < vizblk->n_tracks; ++i)
+    free(vizblk->tracks[i].samples);
+  free(vizblk->tracks);
+  free(vizblk->spare_tracks);
+  free(vizblk->traj_mols);
+  vizblk->tracks = NULL;
+  vizblk->n_tracks = 0;
+  vizblk->track_capacity = 0;
+  vizblk->spare_tracks = NULL;
+  vizblk->spare_track_capacity = 0;
+  vizblk->traj_mols = NULL;
+  vizblk->traj_mol_capacity = 0;
+  vizblk->viz_molp = NULL;
+  vizblk->viz_mol_count = NULL;
+  vizblk->viz_mol_capacity = NULL;
+  vizblk->delta_species = NULL;
+  vizblk->viz_n_species = 0;
+  vizblk->delta_frames = 0;
+}
+
+/*************************************************************************
+start_viz_container:
+    Prepares the container of a viz block for its first frame of the run.
+    On a checkpoint restart, the frames of iterations before the first one
+    to be written, as listed in the index, are kept and anything after them
+    is cut off; otherwise the container and its index start afresh.
+
+        In:  struct viz_output_block *vizblk - the block
+             char const *name - the container
+             long long iteration - iteration of the first frame
+        Out: none.  vizblk->container_bytes holds the length kept.
+**************************************************************************/
+static void start_viz_container(struct volume *world,
+                                struct viz_output_block *vizblk,
+                                char const *name, long long iteration) {
+  char *idx_name = CHECKED_SPRINTF("%s%s", name, VIZ_CONTAINER_INDEX_SUFFIX);
+  if (idx_name == NULL)
+    mcell_die();
+
+  off_t keep = 0, keep_entries = 0;
+  struct stat fs;
+  FILE *idx;
+  if (world->chkpt_seq_num > 1 && stat(name, &fs) == 0 &&
+      (idx = fopen(idx_name, "rb")) != NULL) {
+    struct viz_frame_index_entry entry;
+    while (fread(&entry, sizeof(entry), 1, idx) == 1 &&
+           entry.iteration < iteration && entry.offset == keep &&
+           entry.length >= 0 && entry.offset + entry.length <= fs.st_size) {
+      keep += entry.length;
+      keep_entries += sizeof(entry);
+    }
+    fclose(idx);
+  }
+
+  if (keep > 0) {
+    FILE *f = fopen(name, "r+b");
+    idx = fopen(idx_name, "r+b");
+    if (f == NULL || idx == NULL || ftruncate(fileno(f), keep) ||
+        ftruncate(fileno(idx), keep_entries)) {
+      mcell_perror_nodie(errno, "Failed to truncate VIZ output container "
+                                "'%s'", name);
+      keep = 0;
+    }
+    if (f != NULL)
+      fclose(f);
+    if (idx != NULL)
+      fclose(idx);
+  }
+  if (keep == 0 && unlink(idx_name) && errno != ENOENT)
+    mcell_perror_nodie(errno, "Failed to remove frame index '%s'", idx_name);
+  free(idx_name);
+
+  vizblk->container_bytes = keep;
+  vizblk->container_started = 1;
+
+  /* A container must be readable from its first frame on */
+  if (keep == 0)
+    vizblk->delta_frames = 0;
+}
+
+/*************************************************************************
+open_viz_frame:
+    Opens the stream a frame of a viz block is written to.  Without a
+    container this is a file of its own, <prefix>.<kind>.<iteration>.dat.
+    With one, the frame is appended to <prefix>.<kind>.frames exactly as it
+    would be written to its own file, and close_viz_frame appends an entry
+    to the frame index <prefix>.<kind>.frames.idx.  The index is an array of
+    struct viz_frame_index_entry in native byte order: for each frame, the
+    iteration, the byte offset and length of the frame in the container,
+    and whether reading can start at the frame (always, except for a
+    CELLBLENDER_DELTA frame that is not a key frame).
+
+        In:  struct viz_output_block *vizblk - the block
+             char const *kind - kind of frame, as in file names
+             char const *mode_name - viz mode, for error messages
+             long long iteration - iteration of the frame
+             int binary - 1 for a binary frame, 0 for a text frame
+        Out: the stream, to be closed with close_viz_frame
+**************************************************************************/
+static FILE *open_viz_frame(struct volume *world,
+                            struct viz_output_block *vizblk, char const *kind,
+                            char const *mode_name, long long iteration,
+                            int binary) {
+  char *cf_name;
+  int append = 0;
+  if (vizblk->container) {
+    cf_name = CHECKED_SPRINTF("%s.%s%s", vizblk->file_prefix_name, kind,
+                              VIZ_CONTAINER_SUFFIX);
+  } else {
+    long long lli = 10;
+    int ndigits = 1;
+    for (; lli <= world->iterations && ndigits < 20; lli *= 10, ndigits++) {
+    }
+    cf_name = CHECKED_SPRINTF("%s.%s.%.*lld.dat", vizblk->file_prefix_name,
+                              kind, ndigits, iteration);
+  }
+  if (cf_name == NULL)
+    mcell_die();
+
+  if (!vizblk->container || !vizblk->container_started) {
+    if (make_parent_dir(cf_name)) {
+      free(cf_name);
+      mcell_error("Failed to create parent directory for %s-mode VIZ output.",
+                  mode_name);
+      /*return NULL;*/
+    }
+    if (vizblk->container)
+      start_viz_container(world, vizblk, cf_name, iteration);
+  }
+  if (vizblk->container)
+    append = (vizblk->container_bytes > 0);
+
+  FILE *custom_file = output_writer_open(
+      world->output_writer, cf_name,
+      append ? (binary ? "ab" : "a") : (binary ? "wb" : "w"));
+  if (!custom_file)
+    mcell_die();
+  no_printf("Writing to file %s\n", cf_name);
+  free(cf_name);
+
+  /* Some C libraries report 0 for a stream just opened for appending */
+  if (append && fseek(custom_file, 0, SEEK_END))
+    mcell_perror(errno, "Failed to find the end of VIZ output container.");
+  vizblk->container_frame_start = ftell(custom_file);
+  return custom_file;
+}
+
+/*************************************************************************
+close_viz_frame:
+    Closes the stream of a frame opened with open_viz_frame, indexing the
+    frame if it went to a container.
+
+        In:  struct viz_output_block *vizblk - the block
+             FILE *custom_file - the stream
+             char const *kind - kind of frame, as passed to open_viz_frame
+             long long iteration - iteration of the frame
+             int key - 1 if reading can start at the frame, 0 if not
+        Out: 0 on success, 1 on a write error
+**************************************************************************/
+static int close_viz_frame(struct volume *world,
+                           struct viz_output_block *vizblk, FILE *custom_file,
+                           char const *kind, long long iteration, int key) {
+  if (!vizblk->container)
+    return output_writer_close(world->output_writer, custom_file);
+
+  struct viz_frame_index_entry entry;
+  memset(&entry, 0, sizeof(entry));
+  entry.iteration = iteration;
+  entry.offset = vizblk->container_bytes;
+  entry.length = ftell(custom_file) - vizblk->container_frame_start;
+  entry.key = key;
+  vizblk->container_bytes += entry.length;
+  int err = output_writer_close(world->output_writer, custom_file);
+
+  char *idx_name =
+      CHECKED_SPRINTF("%s.%s%s%s", vizblk->file_prefix_name, kind,
+                      VIZ_CONTAINER_SUFFIX, VIZ_CONTAINER_INDEX_SUFFIX);
+  if (idx_name == NULL)
+    return 1;
+  FILE *idx = output_writer_open(world->output_writer, idx_name, "ab");
+  free(idx_name);
+  if (idx == NULL)
+    return 1;
+  if (fwrite(&entry, sizeof(entry), 1, idx) != 1)
+    err = 1;
+  if (output_writer_close(world->output_writer, idx))
+    err = 1;
+  return err;
+}
+
+/*************************************************************************
+viz_includes_molecule:
+    Checks whether a scheduled molecule belongs in a viz frame.
+
+        In:  struct viz_output_block *vizblk - the block being output
+             struct abstract_molecule *amp - the molecule
+             int include_volume - should the lists include vol mols?
+             int include_grid - should the lists include surface mols?
+        Out: 1 if the molecule is to be output, 0 otherwise
+**************************************************************************/
+static int viz_includes_molecule(struct viz_output_block *vizblk,
+                                 struct abstract_molecule *amp,
+                                 int include_volume, int include_grid) {
+  if (amp->properties == NULL)
+    return 0;
+
+  if (vizblk->species_viz_states[amp->properties->species_id] == EXCLUDE_OBJ)
+    return 0;
+
+  if (!include_grid && (amp->flags & TYPE_MASK) != TYPE_VOL)
+    return 0;
+
+  if (!include_volume && (amp->flags & TYPE_MASK) == TYPE_VOL)
+    return 0;
+
+  return 1;
+}
+
+/* Shared state for sorting the molecules of each storage on its own thread */
+struct viz_sort_pass {
+  struct volume *world;
+  struct viz_output_block *vizblk;
+  struct storage **stores;
+  int include_volume;
+  int include_grid;
+  int fill;       /* 0 while counting, 1 while filling */
+  u_int *counts;  /* Molecules of each species in each storage */
+  u_int *offsets; /* Where each storage's molecules of a species go */
+};
+
+/*************************************************************************
+sort_storage_molecules:
+    Thread pool task: counts the molecules of one storage by species or,
+    on the second pass, copies them to their place in the species arrays.
+
+        In:  void *ctx - the struct viz_sort_pass
+             int task - index of the storage
+        Out: none
+**************************************************************************/
+static void sort_storage_molecules(void *ctx, int task) {
+  struct viz_sort_pass *pass = (struct viz_sort_pass *)ctx;
+  int n_species = pass->world->n_species;
+  u_int *counts = pass->counts + (size_t)task * n_species;
+  u_int *offsets = pass->offsets + (size_t)task * n_species;
+
+  for (struct schedule_helper *shp = pass->stores[task]->timer; shp != NULL;
+       shp = shp->next_scale) {
+    for (int i = -1; i < shp->buf_len; ++i) {
+      for (struct abstract_molecule *amp =
+               (struct abstract_molecule *)((i < 0) ? shp->current
+                                                    : shp->circ_buf_head[i]);
+           amp != NULL; amp = amp->next) {
+        if (!viz_includes_molecule(pass->vizblk, amp, pass->include_volume,
+                                   pass->include_grid))
+          continue;
+
+        u_int spec_id = amp->properties->species_id;
+        if (!pass->fill)
+          ++counts[spec_id];
+        else if (counts[spec_id] > 0) {
+          pass->vizblk->viz_molp[spec_id][offsets[spec_id]++] = amp;
+          --counts[spec_id];
+        }
+      }
+    }
+  }
+}
+
+/*************************************************************************
+sort_molecules_in_parallel:
+    Fills the species arrays of sort_molecules_by_species with one thread
+    pool task per storage.  Each storage is counted first so that its
+    molecules can be copied straight to their final place, giving the same
+    order as scanning the storages one after another.
+
+        In:  struct viz_output_block *vizblk - the block being output
+             int include_volume - should the lists include vol mols?
+             int include_grid - should the lists include surface mols?
+        Out: 0 on success, 1 on error
+**************************************************************************/
+static int sort_molecules_in_parallel(struct volume *world,
+                                      struct viz_output_block *vizblk,
+                                      int include_volume, int include_grid) {
+  int n_stores = 0;
+  for (struct storage_list *slp = world->storage_head; slp != NULL;
+       slp = slp->next)
+    ++n_stores;
+
+  struct viz_sort_pass pass;
+  pass.world = world;
+  pass.vizblk = vizblk;
+  pass.include_volume = include_volume;
+  pass.include_grid = include_grid;
+  pass.fill = 0;
+  pass.stores = CHECKED_MALLOC_ARRAY_NODIE(struct storage *, n_stores,
+                                           "viz output storage list");
+  pass.counts = allocate_uint_array(n_stores * world->n_species, 0);
+  pass.offsets = allocate_uint_array(n_stores * world->n_species, 0);
+  if (pass.stores == NULL || pass.counts == NULL || pass.offsets == NULL) {
+    free(pass.stores);
+    free(pass.counts);
+    free(pass.offsets);
+    return 1;
+  }
+
+  int n = 0;
+  for (struct storage_list *slp = world->storage_head; slp != NULL;
+       slp = slp->next)
+    pass.stores[n++] = slp->store;
+
+  thread_pool_run(world->thread_pool, n_stores, sort_storage_molecules, &pass);
+
+  /* Lay the storages out one after another within each species, keeping
+   * no more molecules than the population has room for */
+  for (int spec_id = 0; spec_id < world->n_species; ++spec_id) {
+    struct species *spec = world->species_list[spec_id];
+    u_int room = (spec->population > 0) ? (u_int)spec->population : 0;
+    u_int total = 0;
+    u_int found = 0;
+    for (int i = 0; i < n_stores; ++i) {
+      u_int *count = &pass.counts[(size_t)i * world->n_species + spec_id];
+      pass.offsets[(size_t)i * world->n_species + spec_id] = total;
+      found += *count;
+      if (*count > room - total)
+        *count = room - total;
+      total += *count;
+    }
+    vizblk->viz_mol_count[spec_id] = total;
+    if (found > total)
+      mcell_warn("Molecule count disagreement!\n"
+                 "  Species %s  population = %d  count = %u",
+                 spec->sym->name, spec->population, found);
+  }
+
+  pass.fill = 1;
+  thread_pool_run(world->thread_pool, n_stores, sort_storage_molecules, &pass);
+
+  free(pass.stores);
+  free(pass.counts);
+  free(pass.offsets);
+  return 0;
+}
+
 /*************************************************************************
 sort_molecules_by_species:
     Scans over all molecules, sorting them into arrays by species.
 
-        In:  struct abstract_molecule ****viz_molpp
-             u_int  **viz_mol_countp
+        In:  struct viz_output_block *vizblk - the block being output
              int include_volume - should the lists include vol mols?
              int include_grid - should the lists include surface mols?
-        Out: 0 on success, 1 on error; viz_molpp and viz_mol_countp arrays are
-             allocated and filled with sorted data.
+        Out: 0 on success, 1 on error; vizblk->viz_molp and
+             vizblk->viz_mol_count are filled with sorted data.  The arrays
+             belong to the block and are reused by later frames.
 **************************************************************************/
 static int sort_molecules_by_species(struct volume *world,
                                      struct viz_output_block *vizblk,
-                                     struct abstract_molecule ****viz_molpp,
-                                     u_int **viz_mol_countp, int include_volume,
-                                     int include_grid) {
+                                     int include_volume, int include_grid) {
   struct storage_list *slp;
   u_int *counts;
   int species_index;
 
-  /* XXX: May leave memory allocated on failure */
-  if ((*viz_molpp = (struct abstract_molecule ***)allocate_ptr_array(
-           world->n_species)) == NULL)
-    return 1;
-  if ((counts = *viz_mol_countp = allocate_uint_array(world->n_species, 0)) ==
-      NULL)
-    return 1;
+  /* NFSim may add species as the simulation goes, so start over if needed */
+  if (vizblk->viz_n_species != world->n_species) {
+    free_viz_molecule_lists(vizblk);
+    if ((vizblk->viz_molp = (struct abstract_molecule ***)allocate_ptr_array(
+             world->n_species)) == NULL)
+      return 1;
+    if ((vizblk->viz_mol_count = allocate_uint_array(world->n_species, 0)) ==
+        NULL)
+      return 1;
+    if ((vizblk->viz_mol_capacity =
+             allocate_uint_array(world->n_species, 0)) == NULL)
+      return 1;
+    vizblk->viz_n_species = world->n_species;
+  }
+  counts = vizblk->viz_mol_count;
+  memset(counts, 0, world->n_species * sizeof(u_int));
 
-  /* Walk through the species allocating arrays for all molecules of that
+  /* Walk through the species making room for all molecules of that
    * species */
   for (species_index = 0; species_index < world->n_species; ++species_index) {
     int mol_count;
@@ -163,16 +573,29 @@ static int sort_molecules_by_species(struct volume *world,
       continue;
 
     mol_count = world->species_list[species_index]->population;
-    if (mol_count <= 0)
+    if (mol_count <= 0 || (u_int)mol_count <= vizblk->viz_mol_capacity[spec_id])
       continue;
 
-    if (((*viz_molpp)[spec_id] =
-             (struct abstract_molecule **)allocate_ptr_array(mol_count)) ==
+    /* Grow geometrically so a slowly rising population isn't reallocated
+     * every frame */
+    u_int capacity = 2 * vizblk->viz_mol_capacity[spec_id];
+    if (capacity < (u_int)mol_count)
+      capacity = mol_count;
+    free(vizblk->viz_molp[spec_id]);
+    vizblk->viz_mol_capacity[spec_id] = 0;
+    if ((vizblk->viz_molp[spec_id] =
+             (struct abstract_molecule **)allocate_ptr_array(capacity)) ==
         NULL)
       return 1;
+    vizblk->viz_mol_capacity[spec_id] = capacity;
   }
 
   /* Sort molecules by species id */
+  if (world->thread_pool != NULL && world->storage_head != NULL &&
+      world->storage_head->next != NULL)
+    return sort_molecules_in_parallel(world, vizblk, include_volume,
+                                      include_grid);
+
   for (slp = world->storage_head; slp != NULL; slp = slp->next) {
     struct storage *sp = slp->store;
     struct schedule_helper *shp;
@@ -186,22 +609,13 @@ static int sort_molecules_by_species(struct volume *world,
                                                     : shp->circ_buf_head
                                                           [sched_slot_index]);
              amp != NULL; amp = amp->next) {
-          u_int spec_id;
-          if (amp->properties == NULL)
-            continue;
-
-          spec_id = amp->properties->species_id;
-          if (vizblk->species_viz_states[spec_id] == EXCLUDE_OBJ)
-            continue;
-
-          if (!include_grid && (amp->flags & TYPE_MASK) != TYPE_VOL)
-            continue;
-
-          if (!include_volume && (amp->flags & TYPE_MASK) == TYPE_VOL)
+          if (!viz_includes_molecule(vizblk, amp, include_volume,
+                                     include_grid))
             continue;
 
+          u_int spec_id = amp->properties->species_id;
           if (counts[spec_id] < amp->properties->population)
-            (*viz_molpp)[spec_id][counts[spec_id]++] = amp;
+            vizblk->viz_molp[spec_id][counts[spec_id]++] = amp;
           else {
             mcell_warn("Molecule count disagreement!\n"
                        "  Species %s  population = %d  count = %d",
@@ -339,13 +753,13 @@ output_ascii_molecules:
 In: vizblk: VIZ_OUTPUT block for this frame list
     a frame data list (internal viz output data structure)
 Out: 0 on success, 1 on failure.  The positions of molecules are output
-     in exponential floating point notation (with 8 decimal places)
+     in exponential floating point notation (with 8 decimal places), to a
+     file per frame or to a container (see open_viz_frame)
 *************************************************************************/
 static int output_ascii_molecules(struct volume *world,
                                   struct viz_output_block *vizblk,
                                   struct frame_data_list *fdlp) {
   FILE *custom_file;
-  char *cf_name;
   struct storage_list *slp;
   struct schedule_helper *shp;
   struct abstract_element *aep;
@@ -354,38 +768,19 @@ static int output_ascii_molecules(struct volume *world,
   struct surface_molecule *gmp;
   short orient = 0;
 
-  int ndigits, i;
-  long long lli;
+  int i;
 
   struct vector3 where, norm;
 
   no_printf("Output in ASCII mode (molecules only)...\n");
 
   if ((fdlp->type == ALL_MOL_DATA) || (fdlp->type == MOL_POS)) {
-    lli = 10;
-    for (ndigits = 1; lli <= world->iterations && ndigits < 20;
-         lli *= 10, ndigits++) {
-    }
-    cf_name =
-        CHECKED_SPRINTF("%s.ascii.%.*lld.dat", vizblk->file_prefix_name,
-                        ndigits, fdlp->viz_iteration);
-    if (cf_name == NULL)
-      return 1;
-    if (make_parent_dir(cf_name)) {
-      free(cf_name);
-      mcell_error(
-          "Failed to create parent directory for ASCII-mode VIZ output.");
-      /*return 1;*/
-    }
-    custom_file = open_file(cf_name, "w");
-    if (!custom_file)
-      mcell_die();
-    else {
-      no_printf("Writing to file %s\n", cf_name);
-    }
-    free(cf_name);
-    cf_name = NULL;
+    custom_file = open_viz_frame(world, vizblk, "ascii", "ASCII",
+                                 fdlp->viz_iteration, 0);
 
+    struct text_writer *tw = CHECKED_MALLOC_STRUCT(struct text_writer,
+                                                   "ASCII output buffer");
+    text_writer_init(tw, custom_file, world->shortest_floats);
     for (slp = world->storage_head; slp != NULL; slp = slp->next) {
       for (shp = slp->store->timer; shp != NULL; shp = shp->next_scale) {
         for (i = -1; i < shp->buf_len; i++) {
@@ -426,20 +821,29 @@ static int output_ascii_molecules(struct volume *world,
             */
             if (id == INCLUDE_OBJ) {
               /* write name of molecule */
-              fprintf(custom_file, "%s %lu %.9g %.9g %.9g %.9g %.9g %.9g\n",
-                      amp->properties->sym->name, amp->id, where.x, where.y,
-                      where.z, norm.x, norm.y, norm.z);
+              text_writer_string(tw, amp->properties->sym->name);
             } else {
               /* write state value of molecule */
-              fprintf(custom_file, "%d %lu %.9g %.9g %.9g %.9g %.9g %.9g\n", id,
-                      amp->id, where.x, where.y, where.z, norm.x, norm.y,
-                      norm.z);
+              text_writer_long(tw, id);
+            }
+            /* " %lu %.9g %.9g %.9g %.9g %.9g %.9g" */
+            text_writer_char(tw, ' ');
+            text_writer_ulong(tw, amp->id);
+            double const coords[6] = { where.x, where.y, where.z,
+                                       norm.x,  norm.y,  norm.z };
+            for (int c = 0; c < 6; c++) {
+              text_writer_char(tw, ' ');
+              text_writer_double(tw, coords[c], 9);
             }
+            text_writer_char(tw, '\n');
           }
         }
       }
     }
-    fclose(custom_file);
+    text_writer_flush(tw);
+    free(tw);
+    close_viz_frame(world, vizblk, custom_file, "ascii", fdlp->viz_iteration,
+                    1);
   }
 
   return 0;
@@ -457,6 +861,7 @@ typedef struct external_mol_viz_by_name_struct {
   char *mol_name;
   external_mol_viz *mol_list;
   struct external_mol_viz_by_name_struct *next_name;
+  long frame;  /* Frame that mol_list and next_name belong to */
 } external_mol_viz_by_name;
 
 
@@ -466,8 +871,10 @@ typedef struct external_mol_viz_entry_struct {
 } external_mol_viz_entry;
 
 
-static struct sym_table_head *graph_pattern_table = NULL;
-static long next_molcomp_id = 0L;
+/* The layouts of EXTERNAL_SPECIES graph patterns are kept in the world's
+ * viz_graph_patterns table, and the names of the glyphs used for their
+ * molecules and components in viz_mol_names, for the whole run so each
+ * frame only has to link them together. */
 
 typedef struct external_molcomp_loc_struct {
   bool is_mol;
@@ -486,6 +893,13 @@ typedef struct molcomp_list_struct {
   external_molcomp_loc *molcomp_array;
   int num_molcomp_items;
   long molcomp_id;
+
+  /* Display layout, worked out once when the pattern is first seen */
+  bool spatial;  /* False if any component sits at the origin */
+  external_mol_viz_by_name **part_names;  /* Glyph of each part, or NULL if
+                                             the part isn't drawn */
+  int num_plain_mols;  /* Non-spatial patterns: one glyph per molecule */
+  external_mol_viz_by_name **plain_mol_names;
 } molcomp_list;
 
 static void dump_molcomp_array_to ( FILE *out_file, external_molcomp_loc *molcomp_array, int num_parts ) {
@@ -1314,6 +1728,232 @@ static void end_line_opt_comma ( FILE *space_struct_file, bool add_comma ) {
   fprintf ( space_struct_file, "\n" );
 }
 
+/*************************************************************************
+find_mol_viz_name:
+    Finds the glyph list for a molecule or component name, adding it the
+    first time the name is seen.
+
+        In:  struct volume *world - the simulation state
+             const char *name - the name
+        Out: the (persistent) entry for the name
+**************************************************************************/
+static external_mol_viz_by_name *find_mol_viz_name(struct volume *world,
+                                                  const char *name) {
+  if (world->viz_mol_names == NULL)
+    world->viz_mol_names = init_symtab(64);
+
+  struct sym_entry *sp = retrieve_sym(name, world->viz_mol_names);
+  if (sp != NULL)
+    return (external_mol_viz_by_name *)sp->value;
+
+  external_mol_viz_by_name *entry = CHECKED_MALLOC_STRUCT(
+      external_mol_viz_by_name, "viz molecule name");
+  entry->mol_name = CHECKED_STRDUP(name, "viz molecule name");
+  entry->mol_list = NULL;
+  entry->next_name = NULL;
+  entry->frame = -1;
+  store_sym(name, VOID_PTR, world->viz_mol_names, entry);
+  return entry;
+}
+
+/*************************************************************************
+add_mol_viz_item:
+    Adds a glyph position to the current frame.  Names are listed in the
+    frame in the reverse of the order they were first used, and positions
+    within each name the same way.
+
+        In:  long frame - the current frame
+             external_mol_viz_by_name **mol_name_list - the frame's names
+             external_mol_viz_by_name *entry - the glyph's name
+             mol_type, position and orientation of the glyph
+        Out: none
+**************************************************************************/
+static void add_mol_viz_item(long frame,
+                             external_mol_viz_by_name **mol_name_list,
+                             external_mol_viz_by_name *entry, char mol_type,
+                             float pos_x, float pos_y, float pos_z,
+                             float norm_x, float norm_y, float norm_z) {
+  if (entry->frame != frame) {
+    entry->frame = frame;
+    entry->mol_list = NULL;
+    entry->next_name = *mol_name_list;
+    *mol_name_list = entry;
+  }
+
+  external_mol_viz *new_mol_viz_item = (external_mol_viz *) malloc ( sizeof(external_mol_viz) );
+  new_mol_viz_item->mol_type = mol_type;
+  new_mol_viz_item->pos_x = pos_x;
+  new_mol_viz_item->pos_y = pos_y;
+  new_mol_viz_item->pos_z = pos_z;
+  new_mol_viz_item->norm_x = norm_x;
+  new_mol_viz_item->norm_y = norm_y;
+  new_mol_viz_item->norm_z = norm_z;
+  new_mol_viz_item->next_mol = entry->mol_list;
+  entry->mol_list = new_mol_viz_item;
+}
+
+/*************************************************************************
+part_viz_name:
+    Builds the name of the glyph drawn for one part of a graph pattern,
+    following the component naming bits of the viz options.
+
+        In:  molcomp_list *mcl - the pattern
+             int part_num - the part
+        Out: the name (to be freed by the caller), or NULL if the part
+             isn't drawn
+**************************************************************************/
+static char *part_viz_name(struct volume *world, molcomp_list *mcl,
+                           int part_num) {
+  if (mcl->molcomp_array[part_num].is_mol) {
+    // Handle Molecule Viz
+    return my_strcat(mcl->molcomp_array[part_num].name, NULL);
+  }
+
+  if (world->viz_options == VIZ_OPTS_NONE)
+    return NULL;
+
+  // Handle Component Viz
+  int viz_naming_bits = world->viz_options & VIZ_COMP_NAMING_MASK;
+
+  if (viz_naming_bits == VIZ_COMP_ALL_SAME) {
+    // Build a global component name alone (same glyph for all components and all molecules)
+    return my_strcat("component", NULL);
+  } else if (viz_naming_bits == VIZ_COMP_NAME_GLOBAL) {
+    // Build the name from the component name alone (same glyph for all components with this name across all molecules)
+    return my_strcat("comp_", mcl->molcomp_array[part_num].name);
+  } else if (viz_naming_bits == VIZ_COMP_MOL_LOCAL) {
+    // Build the name from the molecule name and the component name (glyph only applies to this mol/comp combination)
+    char *last_mol_name;
+    if (mcl->molcomp_array[part_num].num_peers < 1) {
+      // This shouldn't happen ...
+      last_mol_name = my_strcat("unknown_", "_comp_");
+    } else {
+      // Copy the molecule name
+      last_mol_name = my_strcat(
+          mcl->molcomp_array[mcl->molcomp_array[part_num].peers[0]].name,
+          "_comp_");
+    }
+    char *name = my_strcat(last_mol_name, mcl->molcomp_array[part_num].name);
+    free(last_mol_name);
+    return name;
+  }
+
+  return NULL;
+}
+
+/*************************************************************************
+get_graph_pattern_layout:
+    Looks up the display layout of an EXTERNAL_SPECIES graph pattern,
+    parsing the pattern and laying out its molecules and components the
+    first time it is seen.  Patterns stored in the world's viz_graph_patterns
+    are never purged; they remain throughout the life of the simulation.
+
+        In:  struct volume *world - the simulation state
+             char *graph_pattern - the NAUTY graph pattern
+        Out: the layout of the pattern
+**************************************************************************/
+static molcomp_list *get_graph_pattern_layout(struct volume *world,
+                                              char *graph_pattern) {
+  if (world->viz_graph_patterns == NULL) {
+    world->viz_graph_patterns = init_symtab ( 10 );
+  }
+
+  struct sym_entry *sp =
+      retrieve_sym(graph_pattern, world->viz_graph_patterns);
+  if (sp != NULL)
+    return (molcomp_list *) sp->value;
+
+  char **graph_parts = get_graph_strings ( graph_pattern );
+
+  // Print for use with external tools like the SpatialMols2D.java
+  if (world->dump_level >= 10) {
+    fprintf ( stdout, "=#= New Graph Pattern: %s\n", graph_pattern );
+  }
+
+  // Count the number of parts in graph_parts linked list
+  int num_parts = 0;
+  char *next_part = graph_parts[num_parts];
+  while (next_part != NULL) {
+    if (world->dump_level >= 20) {
+      fprintf ( stdout, "  Graph Part %d: %s\n", num_parts, next_part );
+    }
+    num_parts++;
+    next_part = graph_parts[num_parts];
+  }
+
+  external_molcomp_loc *molcomp_array = build_molcomp_array ( world, graph_parts );
+
+  if (world->dump_level >= 10) {
+    fprintf ( stdout, "=============== molcomp_array ===============\n" );
+    dump_molcomp_array ( molcomp_array, num_parts );
+    fprintf ( stdout, "=============================================\n" );
+  }
+
+  molcomp_list *mcl = (molcomp_list *) malloc ( sizeof(molcomp_list) );
+  mcl->molcomp_array = molcomp_array;
+  mcl->num_molcomp_items = num_parts;
+  mcl->molcomp_id = world->viz_next_molcomp_id;
+  world->viz_next_molcomp_id += 1;
+
+  // Look for component locations of all zero which indicates a non-spatial molecule
+  mcl->spatial = true;
+  for (int part_num = 0; part_num < num_parts; part_num++) {
+    if ( mcl->molcomp_array[part_num].is_mol == false ) {
+      // Check component location
+      if ((molcomp_array[part_num].x==0) && (molcomp_array[part_num].y==0) && (molcomp_array[part_num].z==0) ) {
+        // A component cannot be at the origin
+        mcl->spatial = false;
+        break;
+      }
+    }
+  }
+
+  mcl->part_names = NULL;
+  mcl->num_plain_mols = 0;
+  mcl->plain_mol_names = NULL;
+  if (mcl->spatial) {
+    mcl->part_names = CHECKED_MALLOC_ARRAY(
+        external_mol_viz_by_name *, num_parts > 0 ? num_parts : 1,
+        "graph pattern layout");
+    for (int part_num = 0; part_num < num_parts; part_num++) {
+      char *name = part_viz_name(world, mcl, part_num);
+      mcl->part_names[part_num] = (name != NULL) ? find_mol_viz_name(world, name) : NULL;
+      free(name);
+    }
+  } else {
+    /* Pull each actual molecule name out of the graph pattern */
+    char *next_mol = graph_pattern;
+    while ((next_mol = strstr(next_mol, "m:")) != NULL) {
+      mcl->num_plain_mols++;
+      next_mol += 1;
+    }
+    mcl->plain_mol_names = CHECKED_MALLOC_ARRAY(
+        external_mol_viz_by_name *,
+        mcl->num_plain_mols > 0 ? mcl->num_plain_mols : 1,
+        "graph pattern layout");
+    next_mol = graph_pattern;
+    for (int i = 0; (next_mol = strstr(next_mol, "m:")) != NULL; i++) {
+      char *end_mol = strpbrk ( next_mol, "@!,(~" );
+      if (end_mol == NULL) {
+        end_mol = next_mol + strlen(next_mol);
+      }
+      int ext_name_len = end_mol - next_mol;
+      char *ext_name = (char *) malloc ( ext_name_len + 1 );
+      strncpy ( ext_name, next_mol+2, ext_name_len-2 );
+      ext_name[ext_name_len-2] = '\0';
+      mcl->plain_mol_names[i] = find_mol_viz_name(world, ext_name);
+      free(ext_name);
+      next_mol += 1;
+    }
+  }
+
+  /*   store_sym ( symbol,   sym_type, symbol_table,       data )  */
+  store_sym ( graph_pattern, VOID_PTR, world->viz_graph_patterns, mcl );
+
+  free_graph_parts ( graph_parts );
+  return mcl;
+}
+
 /************************************************************************
 output_cellblender_molecules:
 In: vizblk: VIZ_OUTPUT block for this frame list
@@ -1354,6 +1994,9 @@ Out: 0 on success, 1 on failure.  The names and positions of molecules are
            i,j,k components of the orientation vector of the surface molecules.
 
          Note that the end of the file is indicated by the usual EOF only.
+         In a container (see open_viz_frame), the frame index gives where
+         each frame ends instead.  The bnglviz files of VIZ_ALT_FILES_MASK
+         output are always written one per frame.
 
 *************************************************************************/
 static int output_cellblender_molecules(struct volume *world,
@@ -1403,25 +2046,9 @@ static int output_cellblender_molecules(struct volume *world,
     for (; lli <= world->iterations && ndigits < 20;
          lli *= 10, ndigits++) {
     }
-    char *cf_name =
-        CHECKED_SPRINTF("%s.cellbin.%.*lld.dat", vizblk->file_prefix_name,
-                        ndigits, fdlp->viz_iteration);
-    if (cf_name == NULL)
-      return 1;
-    if (make_parent_dir(cf_name)) {
-      free(cf_name);
-      mcell_error(
-          "Failed to create parent directory for CELLBLENDER-mode VIZ output.");
-      /*return 1;*/
-    }
-    FILE *custom_file = open_file(cf_name, "wb");
-    if (!custom_file)
-      mcell_die();
-    else {
-      no_printf("Writing to file %s\n", cf_name);
-    }
-    free(cf_name);
-    cf_name = NULL;
+    FILE *custom_file = open_viz_frame(world, vizblk, "cellbin", "CELLBLENDER",
+                                       fdlp->viz_iteration, 1);
+    char *cf_name = NULL;
 
     FILE *space_struct_file = NULL;
     if (world->viz_options & VIZ_ALT_FILES_MASK) {
@@ -1441,7 +2068,8 @@ static int output_cellblender_molecules(struct volume *world,
             "Failed to create parent directory for SPATIAL-mode VIZ output.");
         /*return 1;*/
       }
-      space_struct_file = open_file(cf_name, "wb");
+      space_struct_file =
+          output_writer_open(world->output_writer, cf_name, "wb");
       if (!space_struct_file) {
         mcell_die();
       } else {
@@ -1452,14 +2080,14 @@ static int output_cellblender_molecules(struct volume *world,
     }
 
     /* Get a list of molecules sorted by species. */
-    u_int *viz_mol_count = NULL;
-    struct abstract_molecule ***viz_molp = NULL;
-    if (sort_molecules_by_species(
-        world, vizblk, &viz_molp, &viz_mol_count, 1, 1)) {
-      fclose(custom_file);
+    if (sort_molecules_by_species(world, vizblk, 1, 1)) {
+      close_viz_frame(world, vizblk, custom_file, "cellbin",
+                      fdlp->viz_iteration, 1);
       custom_file = NULL;
       return 1;
     }
+    u_int *const viz_mol_count = vizblk->viz_mol_count;
+    struct abstract_molecule ***const viz_molp = vizblk->viz_molp;
 
     /* Write file header(s) */
     u_int cellbin_version = 1;
@@ -1521,7 +2149,7 @@ static int output_cellblender_molecules(struct volume *world,
             struct vector3 pos_output = {0.0, 0.0, 0.0};
             if (!convert_relative_to_abs_PBC_coords(
                 world->periodic_box_obj,
-                mp->periodic_box,
+                &mp->periodic_box,
                 world->periodic_traditional,
                 &mp->pos,
                 &pos_output)) {
@@ -1542,7 +2170,7 @@ static int output_cellblender_molecules(struct volume *world,
             struct vector3 pos_output = {0.0, 0.0, 0.0};
             if (!convert_relative_to_abs_PBC_coords(
                 world->periodic_box_obj,
-                gmp->periodic_box,
+                &gmp->periodic_box,
                 world->periodic_traditional,
                 &where,
                 &pos_output)) {
@@ -1578,13 +2206,13 @@ static int output_cellblender_molecules(struct volume *world,
             float norm_z = orient * gmp->grid->surface->normal.z;
 
             if (world->periodic_box_obj && !(world->periodic_traditional)) {
-              if (gmp->periodic_box->x % 2 != 0) {
+              if (gmp->periodic_box.x % 2 != 0) {
                 norm_x *= -1;
               }
-              if (gmp->periodic_box->y % 2 != 0) {
+              if (gmp->periodic_box.y % 2 != 0) {
                 norm_y *= -1;
               }
-              if (gmp->periodic_box->z % 2 != 0) {
+              if (gmp->periodic_box.z % 2 != 0) {
                 norm_z *= -1;
               }
             }
@@ -1602,6 +2230,7 @@ static int output_cellblender_molecules(struct volume *world,
     /* Note that this could be done while processing normal molecules, but separating makes code clearer. */
 
     external_mol_viz_by_name *mol_name_list = NULL;
+    ++world->viz_mol_frame;
 
     for (int species_idx = 0; species_idx < world->n_species; species_idx++) {
       const unsigned int this_mol_count = viz_mol_count[species_idx];
@@ -1679,92 +2308,10 @@ static int output_cellblender_molecules(struct volume *world,
           /* This is complex molecule, so add a new viz molecule for each molecule in the complex */
           /* The graph pattern will be something like: */
           /*    c:SH2~NO_STATE!5,c:U~NO_STATE!5!3,c:a~NO_STATE!6,c:b~Y!6!1,c:g~Y!6,m:Lyn@PM!0!1,m:Rec@PM!2!3!4, */
-          char *next_mol = amp->graph_data->graph_pattern;
-
-/* BEGIN NEW PROCESSING */
-// fprintf ( stdout, "=============== BEGIN NEW PROCESSING ===============\n" );
+          molcomp_list *mcl =
+              get_graph_pattern_layout(world, amp->graph_data->graph_pattern);
 
-          if (graph_pattern_table == NULL) {
-            graph_pattern_table = init_symtab ( 10 );
-          }
-
-          struct sym_entry *sp;
-          sp = retrieve_sym(next_mol, graph_pattern_table);
-
-          if (sp == NULL) {
-
-            // This pattern has not been saved yet, so parse it, save it, and possibly print it.
-            // Note that patterns stored in the graph_pattern_table are never purged.
-            // These patterns remain throughout the life of the simulation.
-
-            char **graph_parts = get_graph_strings ( next_mol );
-
-            // Print for use with external tools like the SpatialMols2D.java
-            if (world->dump_level >= 10) {
-              fprintf ( stdout, "=#= New Graph Pattern: %s\n", next_mol );
-            }
-
-            // Count the number of parts in graph_parts linked list
-            int num_parts = 0;
-            char *next_part = graph_parts[num_parts];
-            while (next_part != NULL) {
-              if (world->dump_level >= 20) {
-                fprintf ( stdout, "  Graph Part %d: %s\n", num_parts, next_part );
-              }
-              num_parts++;
-              next_part = graph_parts[num_parts];
-            }
-
-            external_molcomp_loc *molcomp_array = build_molcomp_array ( world, graph_parts );
-
-            if (world->dump_level >= 10) {
-              fprintf ( stdout, "=============== molcomp_array ===============\n" );
-              dump_molcomp_array ( molcomp_array, num_parts );
-              fprintf ( stdout, "=============================================\n" );
-            }
-
-
-            molcomp_list *mcl = (molcomp_list *) malloc ( sizeof(molcomp_list) );
-            mcl->molcomp_array = molcomp_array;
-            mcl->num_molcomp_items = num_parts;
-            mcl->molcomp_id = next_molcomp_id;
-            next_molcomp_id += 1;
-
-
-            //#### fprintf ( stdout, "=============== molcomp_list ===============\n" );
-            //#### dump_molcomp_list ( mcl );
-            //#### fprintf ( stdout, "=============================================\n" );
-
-            /*   store_sym ( symbol,   sym_type, symbol_table,       data )  */
-            sp = store_sym ( next_mol, VOID_PTR, graph_pattern_table, mcl );
-
-            //#### fprintf ( stdout, "=============== graph_pattern_table ===============\n" );
-            //#### dump_symtab ( graph_pattern_table );
-            //#### fprintf ( stdout, "===================================================\n" );
-
-            free_graph_parts ( graph_parts );
-          }
-
-          molcomp_list *mcl = NULL;
-          if (sp != NULL) {
-            mcl = (molcomp_list *) sp->value;
-            // fprintf ( stdout, "     sp: %s\n", mcl->name );
-            // Look for component locations of all zero which indicates a non-spatial molecule
-            int part_num;
-            for (part_num = 0; part_num<mcl->num_molcomp_items; part_num++) {
-              // fprintf ( stdout, "    Mol Viz part_num %d\n", part_num );
-              if ( mcl->molcomp_array[part_num].is_mol == false ) {
-                // Check component location
-                if ((mcl->molcomp_array[part_num].x==0) && (mcl->molcomp_array[part_num].y==0) && (mcl->molcomp_array[part_num].z==0) ) {
-                  // A component cannot be at the origin
-                  mcl = NULL;
-                  break;
-                }
-              }
-            }
-          }
-
-          if (mcl != NULL) {
+          if (mcl->spatial) {
 
             // This is the normal path for spatially structured molecules
 
@@ -1772,186 +2319,26 @@ static int output_cellblender_molecules(struct volume *world,
             // That's fine at the time of this design, but be aware that adding anything else
             //   that's other than a molecule or component may break this logic!!
 
-            int part_num;
-
-            for (part_num = 0; part_num<mcl->num_molcomp_items; part_num++) {
-              // fprintf ( stdout, "    Mol Viz part_num %d\n", part_num );
-              if ( mcl->molcomp_array[part_num].is_mol || (world->viz_options!=VIZ_OPTS_NONE) ) {
-                // fprintf ( stdout, "    mcl %s\n", mcl->molcomp_array[part_num].name );
-
-                // Choose the name based on the type of item and the viz flags
-                char *name_to_find_or_add = NULL;
-
-                if (mcl->molcomp_array[part_num].is_mol) {
-
-                  // Handle Molecule Viz
-
-                  name_to_find_or_add = (char *) malloc (1+strlen(mcl->molcomp_array[part_num].name));
-                  strcpy ( name_to_find_or_add, mcl->molcomp_array[part_num].name );
-
-                } else {
-
-                  // Handle Component Viz
-
-                  int viz_naming_bits = world->viz_options & VIZ_COMP_NAMING_MASK;
-
-                  if (viz_naming_bits == VIZ_COMP_ALL_SAME) {
-                    // Build a global component name alone (same glyph for all components and all molecules)
-                    name_to_find_or_add = (char *) malloc (1+strlen("component"));
-                    strcpy ( name_to_find_or_add, "component" );
-                  } else if (viz_naming_bits == VIZ_COMP_NAME_GLOBAL) {
-                    // Build the name from the component name alone (same glyph for all components with this name across all molecules)
-                    name_to_find_or_add = (char *) malloc (1+strlen("comp_")+strlen(mcl->molcomp_array[part_num].name));
-                    strcpy ( name_to_find_or_add, "comp_" );
-                    strcpy ( &name_to_find_or_add[strlen("comp_")], mcl->molcomp_array[part_num].name );
-                  } else if (viz_naming_bits == VIZ_COMP_MOL_LOCAL) {
-                    // Build the name from the molecule name and the component name (glyph only applies to this mol/comp combination)
-                    char *last_mol_name = NULL;
-                    if (mcl->molcomp_array[part_num].num_peers < 1) {
-                      // This shouldn't happen ...
-                      last_mol_name = (char *) malloc (1+strlen("unknown_"));
-                      strcpy ( last_mol_name, "unknown_" );
-                    } else {
-                      // Copy the molecule name
-                      char *name_ptr = mcl->molcomp_array[mcl->molcomp_array[part_num].peers[0]].name;
-                      last_mol_name = (char *) malloc (1+strlen(name_ptr));
-                      strcpy ( last_mol_name, name_ptr );
-                    }
-                    name_to_find_or_add = (char *) malloc (1+strlen(last_mol_name)+strlen("_comp_")+strlen(mcl->molcomp_array[part_num].name));
-                    strcpy ( name_to_find_or_add,                               last_mol_name );
-                    strcpy ( &name_to_find_or_add[strlen(name_to_find_or_add)], "_comp_" );
-                    strcpy ( &name_to_find_or_add[strlen(name_to_find_or_add)], mcl->molcomp_array[part_num].name );
-
-                    if (last_mol_name != NULL) {
-                      free ( last_mol_name );
-                    }
-                  }
-
-                }
-
-                /* Check to see if this name is already in the mol_name_list */
-                external_mol_viz_by_name *next_mol_name = mol_name_list;
-                int found = 0;
-                // Check for the actual mol name being in the list
-                do {
-                  if (next_mol_name == NULL) {
-                    break;
-                  }
-                  if (strcmp(name_to_find_or_add, next_mol_name->mol_name) == 0) {
-                    found = 1;
-                    break;
-                  }
-                  next_mol_name = next_mol_name->next_name;
-                } while ( found == 0 );
-
-                if (found == 0) {
-                  /* This molecule or component name is not in the list, so add a new name to the front */
-                  next_mol_name = (external_mol_viz_by_name *) malloc ( sizeof(external_mol_viz_by_name) );
-                  next_mol_name->mol_name = name_to_find_or_add;  /* This takes "ownership" of the allocated "name_to_find_or_add" memory */
-                  next_mol_name->mol_list = NULL;
-                  next_mol_name->next_name = mol_name_list;
-                  mol_name_list = next_mol_name;
-                } else {
-                  /* The name was already in the list so free the memory */
-                  if (name_to_find_or_add != NULL) {
-                    free ( name_to_find_or_add );
-                    name_to_find_or_add = NULL;
-                  }
-                }
-
-                /* next_mol_name now points to the list of molecules by this name */
-
-                /* Make a new molecule viz item to store this location */
-						    external_mol_viz *new_mol_viz_item = (external_mol_viz *) malloc ( sizeof(external_mol_viz) );
-
-                /* Set its values */
-                new_mol_viz_item->mol_type = mol_type;
-
-                new_mol_viz_item->pos_x = pos_x + mcl->molcomp_array[part_num].x;
-                new_mol_viz_item->pos_y = pos_y + mcl->molcomp_array[part_num].y;
-                new_mol_viz_item->pos_z = pos_z + mcl->molcomp_array[part_num].z;
-
-                // fprintf ( stdout, "=MVM= Mol Viz Mol at: (%g,%g,%g)\n", new_mol_viz_item->pos_x, new_mol_viz_item->pos_y, new_mol_viz_item->pos_z );
-
-                new_mol_viz_item->norm_x = norm_x;
-                new_mol_viz_item->norm_y = norm_y;
-                new_mol_viz_item->norm_z = norm_z;
-
-                /* Add it to the top of the molecule list. This takes ownership of the allocated memory. */
-                new_mol_viz_item->next_mol = next_mol_name->mol_list;
-                next_mol_name->mol_list = new_mol_viz_item;
-
-                next_mol += 1;
-
-              }
+            for (int part_num = 0; part_num < mcl->num_molcomp_items; part_num++) {
+              if (mcl->part_names[part_num] == NULL)
+                continue;
+              add_mol_viz_item(world->viz_mol_frame, &mol_name_list,
+                               mcl->part_names[part_num], mol_type,
+                               pos_x + mcl->molcomp_array[part_num].x,
+                               pos_y + mcl->molcomp_array[part_num].y,
+                               pos_z + mcl->molcomp_array[part_num].z,
+                               norm_x, norm_y, norm_z);
             }
 
-// fprintf ( stdout, "=============== END NEW PROCESSING ===============\n" );
-
-/* END NEW PROCESSING */
-
           } else {
 
             // Arriving here means that the molecules are non-spatial (at least one component is at the origin)
 
-            while ((next_mol = strstr(next_mol,"m:")) != NULL ) {
-              /* Pull the next actual molecule name out of the graph pattern */
-              char *end_mol = strpbrk ( next_mol, "@!,(~" );
-              if (end_mol == NULL) {
-                end_mol = next_mol + strlen(next_mol);
-              }
-              int ext_name_len = end_mol - next_mol;
-              char *ext_name = (char *) malloc ( ext_name_len + 1 );
-              strncpy ( ext_name, next_mol+2, ext_name_len-2 );
-              ext_name[ext_name_len-2] = '\0';
-
-              /* Check to see if this name is already in the list */
-              external_mol_viz_by_name *next_mol_name = mol_name_list;
-              int found = 0;
-              do {
-                if (next_mol_name == NULL) {
-                  break;
-                }
-                if (strcmp(ext_name, next_mol_name->mol_name) == 0) {
-                  found = 1;
-                  break;
-                }
-                next_mol_name = next_mol_name->next_name;
-              } while ( found == 0 );
-
-              if (found == 0) {
-                /* This molecule name is not in the list, so add a new name to the front */
-                next_mol_name = (external_mol_viz_by_name *) malloc ( sizeof(external_mol_viz_by_name) );
-                next_mol_name->mol_name = ext_name;  /* This takes "ownership" of the allocated name memory */
-                next_mol_name->mol_list = NULL;
-                next_mol_name->next_name = mol_name_list;
-                mol_name_list = next_mol_name;
-              } else {
-                /* This molecule name is already in the list and next_mol_name points to it, so just free the name. */
-                free ( ext_name );
-              }
-
-              /* next_mol_name now points to the list of molecules by this name */
-
-              /* Make a new molecule viz item to store this location */
-						  external_mol_viz *new_mol_viz_item = (external_mol_viz *) malloc ( sizeof(external_mol_viz) );
-
-              /* Set its values */
-              new_mol_viz_item->mol_type = mol_type;
-
-              new_mol_viz_item->pos_x = pos_x + x_offset; //   x_offset += 0.008;
-              new_mol_viz_item->pos_y = pos_y;
-              new_mol_viz_item->pos_z = pos_z;
-
-              new_mol_viz_item->norm_x = norm_x;
-              new_mol_viz_item->norm_y = norm_y;
-              new_mol_viz_item->norm_z = norm_z;
-
-              /* Add it to the top of the molecule list */
-              new_mol_viz_item->next_mol = next_mol_name->mol_list;
-              next_mol_name->mol_list = new_mol_viz_item;
-
-              next_mol += 1;
+            for (int i = 0; i < mcl->num_plain_mols; i++) {
+              add_mol_viz_item(world->viz_mol_frame, &mol_name_list,
+                               mcl->plain_mol_names[i], mol_type,
+                               pos_x + x_offset, pos_y, pos_z,
+                               norm_x, norm_y, norm_z);
             }
 
           }
@@ -2036,17 +2423,17 @@ static int output_cellblender_molecules(struct volume *world,
         // fwrite(&ss_version, sizeof(ss_version), 1, space_struct_file );
         fprintf ( space_struct_file, "%d\n", ss_version );
 
-        if (graph_pattern_table != NULL) {
+        if (world->viz_graph_patterns != NULL) {
           // Traverse the symbol table to build a dictionary of molecule types
           // A sym_table_head has: sym_entry **entries
           //   First dimension is n_bins
           //   Second dimension is a linked list
           // fprintf ( stdout, "] ] ] ] ] ] ] ] graph pattern table has %d entries in %d bins\n", graph_pattern_table->n_entries, graph_pattern_table->n_bins );
 
-          for (int bin=0; bin<graph_pattern_table->n_bins; bin++) {
-            if (graph_pattern_table->entries[bin] != NULL) {
+          for (int bin=0; bin<world->viz_graph_patterns->n_bins; bin++) {
+            if (world->viz_graph_patterns->entries[bin] != NULL) {
               // fprintf ( stdout, "  bin %d is non-empty\n", bin );
-              struct sym_entry *se = graph_pattern_table->entries[bin];
+              struct sym_entry *se = world->viz_graph_patterns->entries[bin];
               while (se != NULL) {
                 // fprintf ( stdout, "   entry: %.200s\n", se->name );
                 fprintf ( space_struct_file, "Entry: %s\n", se->name );
@@ -2096,10 +2483,10 @@ static int output_cellblender_molecules(struct volume *world,
 
               long mol_class = -1;
 
-              if (graph_pattern_table != NULL) {
+              if (world->viz_graph_patterns != NULL) {
 
                 struct sym_entry *sp;
-                sp = retrieve_sym(gp, graph_pattern_table);
+                sp = retrieve_sym(gp, world->viz_graph_patterns);
 
                 if (sp != NULL) {
                   molcomp_list *mcl = NULL;
@@ -2149,7 +2536,7 @@ static int output_cellblender_molecules(struct volume *world,
           }
         }
         fflush ( space_struct_file );
-        fclose ( space_struct_file );
+        output_writer_close(world->output_writer, space_struct_file);
 
       } else if ( world->viz_options & VIZ_JSON_MOLCOMP_FMT ) {
 
@@ -2161,22 +2548,22 @@ static int output_cellblender_molecules(struct volume *world,
         fprintf ( space_struct_file, " 2,\n" );  // File format number
         fprintf ( space_struct_file, " [\n" );   // Start of molecule definitions
 
-        if (graph_pattern_table != NULL) {
+        if (world->viz_graph_patterns != NULL) {
           // Traverse the symbol table to build a dictionary of molecule types
           // A sym_table_head has: sym_entry **entries
           //   First dimension is n_bins
           //   Second dimension is a linked list
           // fprintf ( stdout, "] ] ] ] ] ] ] ] graph pattern table has %d entries in %d bins\n", graph_pattern_table->n_entries, graph_pattern_table->n_bins );
 
-          int n_gp_entries = graph_pattern_table->n_entries;
+          int n_gp_entries = world->viz_graph_patterns->n_entries;
           int gp_entry_num = 0;
 
           gp_entry_for_id = (int *) malloc ( n_gp_entries * sizeof(int) ); // This is the mapping from ids to index in the table
 
-          for (int bin=0; bin<graph_pattern_table->n_bins; bin++) {
-            if (graph_pattern_table->entries[bin] != NULL) {
+          for (int bin=0; bin<world->viz_graph_patterns->n_bins; bin++) {
+            if (world->viz_graph_patterns->entries[bin] != NULL) {
               // fprintf ( stdout, "  bin %d is non-empty\n", bin );
-              struct sym_entry *se = graph_pattern_table->entries[bin];
+              struct sym_entry *se = world->viz_graph_patterns->entries[bin];
               while (se != NULL) {
                 // fprintf ( stdout, "   entry: %.200s\n", se->name );
                 // fprintf ( space_struct_file, "Entry: %s\n", se->name );
@@ -2269,10 +2656,10 @@ static int output_cellblender_molecules(struct volume *world,
 
               long mol_class = -1;
 
-              if (graph_pattern_table != NULL) {
+              if (world->viz_graph_patterns != NULL) {
 
                 struct sym_entry *sp;
-                sp = retrieve_sym(gp, graph_pattern_table);
+                sp = retrieve_sym(gp, world->viz_graph_patterns);
 
                 if (sp != NULL) {
                   molcomp_list *mcl = NULL;
@@ -2337,7 +2724,7 @@ static int output_cellblender_molecules(struct volume *world,
         fprintf ( space_struct_file, "]\n" );  // End of entire file as a single list
 
         fflush ( space_struct_file );
-        fclose ( space_struct_file );
+        output_writer_close(world->output_writer, space_struct_file);
 
         if ( gp_entry_for_id != NULL ) {
           free ( gp_entry_for_id );
@@ -2346,29 +2733,21 @@ static int output_cellblender_molecules(struct volume *world,
       }
     }
 
-    /* Free the structures used to build the molecule lists from the complexes */
+    /* Free the molecule instances (the names are kept for later frames) */
     while (mol_name_list != NULL) {
       nl = mol_name_list;
-      /* Free the name block */
-      free ( nl->mol_name );
-      /* Free the list of molecule instances */
       while (nl->mol_list != NULL) {
         mv = nl->mol_list;
         nl->mol_list = mv->next_mol;
         free ( mv );
       }
       mol_name_list = nl->next_name;
-      free ( nl );
     }
 
-    fclose(custom_file);
+    close_viz_frame(world, vizblk, custom_file, "cellbin", fdlp->viz_iteration,
+                    1);
     custom_file = NULL;
 
-    free_ptr_array((void **)viz_molp, world->n_species);
-    viz_molp = NULL;
-    free(viz_mol_count);
-    viz_mol_count = NULL;
-
   } // if ((fdlp->type == ALL_MOL_DATA) || (fdlp->type == MOL_POS)) {
 
   free ( file_prefix_no_Scene );
@@ -2381,6 +2760,634 @@ static int output_cellblender_molecules(struct volume *world,
   return 0;
 }
 
+/*************************************************************************
+write_viz_varint:
+    Writes an unsigned integer 7 bits per byte, low bits first, with the top
+    bit of each byte set when more bytes follow.
+
+        In:  FILE *file - where to write
+             unsigned long long value - the value
+        Out: none
+**************************************************************************/
+static void write_viz_varint(FILE *file, unsigned long long value) {
+  byte buf[10];
+  int n = 0;
+  while (value >= 0x80) {
+    buf[n++] = (byte)(value | 0x80);
+    value >>= 7;
+  }
+  buf[n++] = (byte)value;
+  fwrite(buf, sizeof(byte), n, file);
+}
+
+/*************************************************************************
+write_viz_signed_varint:
+    Writes a signed integer as a varint, interleaving positive and negative
+    values (0, -1, 1, -2, ...) so that small magnitudes stay short.
+
+        In:  FILE *file - where to write
+             long long value - the value
+        Out: none
+**************************************************************************/
+static void write_viz_signed_varint(FILE *file, long long value) {
+  unsigned long long bits = (unsigned long long)value << 1;
+  write_viz_varint(file, (value < 0) ? ~bits : bits);
+}
+
+/*************************************************************************
+compare_molecule_ids:
+    qsort comparison putting molecules in increasing id order.
+**************************************************************************/
+static int compare_molecule_ids(const void *a, const void *b) {
+  u_long id_a = (*(struct abstract_molecule *const *)a)->id;
+  u_long id_b = (*(struct abstract_molecule *const *)b)->id;
+  return (id_a > id_b) - (id_a < id_b);
+}
+
+/*************************************************************************
+quantize_viz_molecule:
+    Gets the quantized position (and orientation, for surface molecules) at
+    which a molecule is drawn, unfolding periodic images the same way as in
+    CELLBLENDER mode.
+
+        In:  struct abstract_molecule *amp - the molecule
+             long long *q - 3 (volume) or 6 (surface) values to fill
+        Out: none
+**************************************************************************/
+static void quantize_viz_molecule(struct volume *world,
+                                  struct abstract_molecule *amp,
+                                  long long *q) {
+  struct vector3 where = { 0.0, 0.0, 0.0 };
+  struct vector3 pos_output = { 0.0, 0.0, 0.0 };
+  struct periodic_image *periodic_box = &amp->periodic_box;
+  struct surface_molecule *gmp = NULL;
+
+  if ((amp->properties->flags & NOT_FREE) == 0) {
+    where = ((struct volume_molecule *)amp)->pos;
+  } else if ((amp->properties->flags & ON_GRID) != 0) {
+    gmp = (struct surface_molecule *)amp;
+    uv2xyz(&(gmp->s_pos), gmp->grid->surface, &where);
+  }
+  if (!convert_relative_to_abs_PBC_coords(world->periodic_box_obj,
+                                          periodic_box,
+                                          world->periodic_traditional, &where,
+                                          &pos_output))
+    where = pos_output;
+
+  double scale = world->length_unit / VIZ_DELTA_POS_QUANTUM;
+  q[0] = llround(where.x * scale);
+  q[1] = llround(where.y * scale);
+  q[2] = llround(where.z * scale);
+
+  if (gmp != NULL) {
+    struct vector3 norm;
+    norm.x = gmp->orient * gmp->grid->surface->normal.x;
+    norm.y = gmp->orient * gmp->grid->surface->normal.y;
+    norm.z = gmp->orient * gmp->grid->surface->normal.z;
+    if (world->periodic_box_obj && !(world->periodic_traditional)) {
+      if (gmp->periodic_box.x % 2 != 0)
+        norm.x *= -1;
+      if (gmp->periodic_box.y % 2 != 0)
+        norm.y *= -1;
+      if (gmp->periodic_box.z % 2 != 0)
+        norm.z *= -1;
+    }
+    q[3] = llround(norm.x * VIZ_DELTA_NORM_SCALE);
+    q[4] = llround(norm.y * VIZ_DELTA_NORM_SCALE);
+    q[5] = llround(norm.z * VIZ_DELTA_NORM_SCALE);
+  }
+}
+
+/*************************************************************************
+output_cellblender_delta_molecules:
+    Writes molecule positions as quantized integers, each coded against the
+    same molecule's position in the previous frame when it has one.
+
+       In: vizblk: VIZ_OUTPUT block for this frame list
+           a frame data list (internal viz output data structure)
+       Out: 0 on success, 1 on failure.  One file is written per frame,
+            named <prefix>.cellbin_delta.<iteration>.dat, or the frames are
+            appended to a container (see open_viz_frame).
+       Format:
+         The 4 bytes "MCVD", a four-byte u_int version (1), a byte that is 1
+         for a key frame and 0 otherwise, then two doubles: the position
+         quantum in microns and the number of orientation steps per unit.
+
+         Then, for each species with molecules in the frame, the species
+         name (or state value) and type exactly as in CELLBLENDER mode,
+         followed by a varint molecule count and that many molecules in
+         increasing id order.  Each molecule is a varint holding
+         (id - previous id) * 2 + d, followed by 3 (volume) or 6 (surface)
+         signed varints: x, y, z and then i, j, k.  When d is 1 the values
+         are differences from the molecule's values in the previous frame,
+         otherwise they are the quantized values themselves.
+
+         A key frame (the first frame and every VIZ_DELTA_KEY_INTERVAL'th
+         after it) never uses differences, so reading can start at any key
+         frame.  Varints use 7 bits per byte, low bits first, with the top
+         bit set on all but the last byte; signed values are mapped
+         0, -1, 1, -2, ... to 0, 1, 2, 3, ...  Unlike CELLBLENDER mode, all
+         molecules are written as points, including EXTERNAL_SPECIES.
+**************************************************************************/
+static int output_cellblender_delta_molecules(struct volume *world,
+                                              struct viz_output_block *vizblk,
+                                              struct frame_data_list *fdlp) {
+  if ((fdlp->type != ALL_MOL_DATA) && (fdlp->type != MOL_POS))
+    return 0;
+
+  /* Frames are coded against the one before, so write each iteration once */
+  if (vizblk->delta_iteration == fdlp->viz_iteration)
+    return 0;
+
+  FILE *custom_file =
+      open_viz_frame(world, vizblk, "cellbin_delta", "CELLBLENDER_DELTA",
+                     fdlp->viz_iteration, 1);
+
+  if (sort_molecules_by_species(world, vizblk, 1, 1)) {
+    close_viz_frame(world, vizblk, custom_file, "cellbin_delta",
+                    fdlp->viz_iteration, 1);
+    return 1;
+  }
+
+  if (vizblk->delta_species == NULL) {
+    vizblk->delta_species =
+        CHECKED_MALLOC_ARRAY(struct viz_delta_species, vizblk->viz_n_species,
+                             "CELLBLENDER_DELTA frame state");
+    memset(vizblk->delta_species, 0,
+           vizblk->viz_n_species * sizeof(struct viz_delta_species));
+    vizblk->delta_frames = 0;
+  }
+  const int key_frame = (vizblk->delta_frames == 0);
+
+  /* Write file header */
+  u_int version = VIZ_DELTA_VERSION;
+  byte key_flag = (byte)key_frame;
+  double quantum = VIZ_DELTA_POS_QUANTUM;
+  double norm_scale = VIZ_DELTA_NORM_SCALE;
+  fwrite("MCVD", sizeof(char), 4, custom_file);
+  fwrite(&version, sizeof(version), 1, custom_file);
+  fwrite(&key_flag, sizeof(key_flag), 1, custom_file);
+  fwrite(&quantum, sizeof(quantum), 1, custom_file);
+  fwrite(&norm_scale, sizeof(norm_scale), 1, custom_file);
+
+  for (int species_idx = 0; species_idx < world->n_species; species_idx++) {
+    struct viz_delta_species *ds = &vizblk->delta_species[species_idx];
+    const u_int this_mol_count = vizblk->viz_mol_count[species_idx];
+    struct abstract_molecule **const mols = vizblk->viz_molp[species_idx];
+    const int id = vizblk->species_viz_states[species_idx];
+    if (this_mol_count == 0 || mols == NULL || id == EXCLUDE_OBJ) {
+      ds->n_mols = 0;
+      continue;
+    }
+
+    if (ds->spare_capacity < this_mol_count) {
+      u_int capacity = 2 * ds->spare_capacity;
+      if (capacity < this_mol_count)
+        capacity = this_mol_count;
+      free(ds->spare);
+      ds->spare = CHECKED_MALLOC_ARRAY(struct viz_delta_mol, capacity,
+                                       "CELLBLENDER_DELTA frame state");
+      ds->spare_capacity = capacity;
+    }
+
+    qsort(mols, this_mol_count, sizeof(struct abstract_molecule *),
+          compare_molecule_ids);
+
+    /* Write species name and type as in CELLBLENDER mode */
+    char mol_name[33];
+    if (id == INCLUDE_OBJ)
+      snprintf(mol_name, 33, "%s", mols[0]->properties->sym->name);
+    else
+      snprintf(mol_name, 33, "%d", id);
+    byte name_len = strlen(mol_name);
+    fwrite(&name_len, sizeof(name_len), 1, custom_file);
+    fwrite(mol_name, sizeof(char), name_len, custom_file);
+    byte species_type = ((mols[0]->properties->flags & ON_GRID) != 0) ? 1 : 0;
+    fwrite(&species_type, sizeof(species_type), 1, custom_file);
+    const int n_values = species_type ? 6 : 3;
+
+    write_viz_varint(custom_file, this_mol_count);
+    u_long last_id = 0;
+    u_int prev = 0;
+    for (u_int n_mol = 0; n_mol < this_mol_count; ++n_mol) {
+      struct viz_delta_mol *cur = &ds->spare[n_mol];
+      cur->id = mols[n_mol]->id;
+      quantize_viz_molecule(world, mols[n_mol], cur->q);
+
+      /* Both frames are in id order, so walk the previous one alongside */
+      int from_prev = 0;
+      if (!key_frame) {
+        while (prev < ds->n_mols && ds->mols[prev].id < cur->id)
+          ++prev;
+        from_prev = (prev < ds->n_mols && ds->mols[prev].id == cur->id);
+      }
+
+      write_viz_varint(custom_file,
+                       ((unsigned long long)(cur->id - last_id) << 1) |
+                           (unsigned long long)from_prev);
+      last_id = cur->id;
+      for (int k = 0; k < n_values; ++k) {
+        long long value = cur->q[k];
+        if (from_prev)
+          value -= ds->mols[prev].q[k];
+        write_viz_signed_varint(custom_file, value);
+      }
+    }
+
+    /* This frame becomes the reference for the next one */
+    struct viz_delta_mol *tmp_mols = ds->mols;
+    u_int tmp_capacity = ds->capacity;
+    ds->mols = ds->spare;
+    ds->capacity = ds->spare_capacity;
+    ds->spare = tmp_mols;
+    ds->spare_capacity = tmp_capacity;
+    ds->n_mols = this_mol_count;
+  }
+
+  close_viz_frame(world, vizblk, custom_file, "cellbin_delta",
+                  fdlp->viz_iteration, key_frame);
+
+  vizblk->delta_iteration = fdlp->viz_iteration;
+  if (++vizblk->delta_frames == VIZ_DELTA_KEY_INTERVAL)
+    vizblk->delta_frames = 0;
+  return 0;
+}
+
+/*************************************************************************
+viz_track_sampled:
+    Decides whether a molecule is in the sample of a TRAJECTORY block.  The
+    decision only depends on the id, so molecules born after the first
+    frame are sampled at the same rate and reruns sample the same ones.
+
+        In:  u_long id - the molecule's id
+             double fraction - the fraction of the molecules to follow
+        Out: 1 if the molecule is followed, 0 otherwise
+**************************************************************************/
+static int viz_track_sampled(u_long id, double fraction) {
+  unsigned long long z = (unsigned long long)id + 0x9e3779b97f4a7c15ULL;
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  z ^= z >> 31;
+  return (double)(z >> 11) * (1.0 / 9007199254740992.0) < fraction;
+}
+
+/*************************************************************************
+viz_track_candidate:
+    Checks the ids and sample of a TRAJECTORY block for a molecule of one
+    of its species.
+
+        In:  struct viz_output_block *vizblk - the block
+             struct abstract_molecule *amp - the molecule
+        Out: 1 if the molecule is followed, unless it turns out not to be
+             born in the block's birth region; 0 otherwise
+**************************************************************************/
+static int viz_track_candidate(struct viz_output_block *vizblk,
+                               struct abstract_molecule *amp) {
+  if (vizblk->traj_n_ids == 0 && vizblk->traj_sample_fraction <= 0.0)
+    return 1;
+  if (vizblk->traj_n_ids > 0 &&
+      bsearch(&amp->id, vizblk->traj_ids, vizblk->traj_n_ids, sizeof(u_long),
+              ulong_cmp) != NULL)
+    return 1;
+  return vizblk->traj_sample_fraction > 0.0 &&
+         viz_track_sampled(amp->id, vizblk->traj_sample_fraction);
+}
+
+/*************************************************************************
+viz_track_born_in_region:
+    Checks where a molecule was first seen for the birth region of a
+    TRAJECTORY block: surface molecules must be on a wall of the region,
+    volume molecules inside the region's object.
+
+        In:  struct region *rp - the region
+             struct abstract_molecule *amp - the molecule
+        Out: 1 if the molecule is in the region, 0 otherwise
+**************************************************************************/
+static int viz_track_born_in_region(struct volume *world, struct region *rp,
+                                    struct abstract_molecule *amp) {
+  if ((amp->flags & TYPE_SURF) != 0) {
+    struct wall *w = ((struct surface_molecule *)amp)->grid->surface;
+    return w->parent_object == rp->parent && rp->membership != NULL &&
+           get_bit(rp->membership, w->side);
+  }
+
+  struct string_buffer *mesh_names =
+      find_enclosing_meshes(world, (struct volume_molecule *)amp, NULL);
+  int inside = 0;
+  for (int i = 0; mesh_names != NULL && i < mesh_names->n_strings; ++i) {
+    if (strcmp(mesh_names->strings[i], rp->parent->sym->name) == 0)
+      inside = 1;
+  }
+  if (mesh_names != NULL) {
+    destroy_string_buffer(mesh_names);
+    free(mesh_names);
+  }
+  return inside;
+}
+
+/*************************************************************************
+open_trajectory_stream:
+    Opens the stream of a TRAJECTORY block for appending, writing the
+    header the first time.
+
+        In:  struct viz_output_block *vizblk - the block
+        Out: the stream, to be closed with output_writer_close
+**************************************************************************/
+static FILE *open_trajectory_stream(struct volume *world,
+                                    struct viz_output_block *vizblk) {
+  char *cf_name = CHECKED_SPRINTF("%s.traj.bin", vizblk->file_prefix_name);
+  if (cf_name == NULL)
+    mcell_die();
+  if (!vizblk->traj_started && make_parent_dir(cf_name)) {
+    free(cf_name);
+    mcell_error("Failed to create parent directory for TRAJECTORY-mode "
+                "VIZ output.");
+    /*return NULL;*/
+  }
+  FILE *custom_file = output_writer_open(world->output_writer, cf_name,
+                                         vizblk->traj_started ? "ab" : "wb");
+  if (!custom_file)
+    mcell_die();
+  free(cf_name);
+
+  if (!vizblk->traj_started) {
+    u_int version = VIZ_TRACK_VERSION;
+    double quantum = VIZ_DELTA_POS_QUANTUM;
+    double time_unit = world->time_unit;
+    fwrite("MCTJ", sizeof(char), 4, custom_file);
+    fwrite(&version, sizeof(version), 1, custom_file);
+    fwrite(&quantum, sizeof(quantum), 1, custom_file);
+    fwrite(&time_unit, sizeof(time_unit), 1, custom_file);
+    vizblk->traj_started = 1;
+  }
+  return custom_file;
+}
+
+/*************************************************************************
+write_track_block:
+    Writes the buffered samples of a molecule as one block of its track.
+
+        In:  struct viz_output_block *vizblk - the block
+             FILE **file - the stream, opened here if still NULL
+             struct viz_track *track - the molecule
+             int ended - set if the molecule is gone
+        Out: none.  The track's buffer is empty.
+**************************************************************************/
+static void write_track_block(struct volume *world,
+                              struct viz_output_block *vizblk, FILE **file,
+                              struct viz_track *track, int ended) {
+  if (*file == NULL)
+    *file = open_trajectory_stream(world, vizblk);
+  FILE *custom_file = *file;
+
+  write_viz_varint(custom_file, track->id);
+  byte flags = (byte)((track->n_blocks == 0 ? 1 : 0) | (ended ? 2 : 0));
+  fwrite(&flags, sizeof(flags), 1, custom_file);
+
+  /* Species name (or state value) and type as in CELLBLENDER mode */
+  char mol_name[33];
+  const int id = vizblk->species_viz_states[track->properties->species_id];
+  if (id == INCLUDE_OBJ)
+    snprintf(mol_name, 33, "%s", track->properties->sym->name);
+  else
+    snprintf(mol_name, 33, "%d", id);
+  byte name_len = strlen(mol_name);
+  fwrite(&name_len, sizeof(name_len), 1, custom_file);
+  fwrite(mol_name, sizeof(char), name_len, custom_file);
+  byte species_type = ((track->properties->flags & ON_GRID) != 0) ? 1 : 0;
+  fwrite(&species_type, sizeof(species_type), 1, custom_file);
+
+  write_viz_varint(custom_file, track->n_samples);
+  for (u_int n = 0; n < track->n_samples; ++n) {
+    struct viz_track_sample const *cur = &track->samples[n];
+    struct viz_track_sample const *prev = (n > 0) ? cur - 1 : NULL;
+    write_viz_varint(custom_file,
+                     cur->iteration - (prev ? prev->iteration : 0));
+    for (int k = 0; k < 3; ++k)
+      write_viz_signed_varint(custom_file,
+                              cur->q[k] - (prev ? prev->q[k] : 0));
+  }
+
+  track->n_samples = 0;
+  track->n_blocks++;
+}
+
+/*************************************************************************
+add_track_sample:
+    Buffers the position of a followed molecule, writing out the buffer
+    first if it is full or holds samples of another species.
+
+        In:  struct viz_output_block *vizblk - the block
+             FILE **file - the stream, opened here if needed
+             struct viz_track *track - the molecule's track
+             struct abstract_molecule *amp - the molecule
+             long long iteration - the frame's iteration
+        Out: none
+**************************************************************************/
+static void add_track_sample(struct volume *world,
+                             struct viz_output_block *vizblk, FILE **file,
+                             struct viz_track *track,
+                             struct abstract_molecule *amp,
+                             long long iteration) {
+  if (track->samples == NULL)
+    track->samples = CHECKED_MALLOC_ARRAY(
+        struct viz_track_sample, VIZ_TRACK_BLOCK, "TRAJECTORY samples");
+  if (track->n_samples > 0 &&
+      (track->n_samples == VIZ_TRACK_BLOCK || track->properties != amp->properties))
+    write_track_block(world, vizblk, file, track, 0);
+  track->properties = amp->properties;
+
+  long long q[6];
+  quantize_viz_molecule(world, amp, q);
+  struct viz_track_sample *sample = &track->samples[track->n_samples++];
+  sample->iteration = iteration;
+  sample->q[0] = q[0];
+  sample->q[1] = q[1];
+  sample->q[2] = q[2];
+}
+
+/*************************************************************************
+end_track:
+    Writes the rest of a followed molecule's track and releases its buffer.
+
+        In:  struct viz_output_block *vizblk - the block
+             FILE **file - the stream, opened here if needed
+             struct viz_track *track - the track
+             int ended - set if the molecule is gone
+        Out: none
+**************************************************************************/
+static void end_track(struct volume *world, struct viz_output_block *vizblk,
+                      FILE **file, struct viz_track *track, int ended) {
+  if (track->followed && (track->n_samples > 0 || ended))
+    write_track_block(world, vizblk, file, track, ended);
+  free(track->samples);
+  track->samples = NULL;
+}
+
+/*************************************************************************
+output_trajectory_molecules:
+    Buffers the positions of the followed molecules, writing each
+    molecule's samples to one stream in blocks.  Unlike the other modes,
+    frames are meant to be frequent and the set of followed molecules
+    small: a molecule of the listed species is followed if its id is
+    listed or it is in the sample (or, with neither, always), and if it
+    was first seen in the birth region when there is one.
+
+       In: vizblk: VIZ_OUTPUT block for this frame list
+           a frame data list (internal viz output data structure)
+       Out: 0 on success, 1 on failure.  The stream is <prefix>.traj.bin.
+       Format:
+         The 4 bytes "MCTJ", a four-byte u_int version (1) and two
+         doubles: the position quantum in microns and the length of an
+         iteration in seconds.
+
+         Then blocks of VIZ_TRACK_BLOCK samples or fewer.  Each is a varint
+         molecule id, a flags byte (1 on the first block of the molecule,
+         2 if the molecule was gone by the frame after the last sample),
+         the species name (or state value) and type exactly as in
+         CELLBLENDER mode, and a varint sample count.  Each sample is a
+         varint iteration and 3 signed varints x, y, z of the quantized
+         position; after the first sample of a block, all four are
+         differences from the sample before.  A molecule's blocks are in
+         order, and a new block starts when its species changes.  Varints
+         are coded as in CELLBLENDER_DELTA mode.
+**************************************************************************/
+static int output_trajectory_molecules(struct volume *world,
+                                       struct viz_output_block *vizblk,
+                                       struct frame_data_list *fdlp) {
+  if ((fdlp->type != ALL_MOL_DATA) && (fdlp->type != MOL_POS))
+    return 0;
+
+  /* Samples are buffered per frame, so take each iteration once */
+  if (vizblk->traj_iteration == fdlp->viz_iteration)
+    return 0;
+  vizblk->traj_iteration = fdlp->viz_iteration;
+
+  /* This frame's molecules, in increasing id order.  Listed ids alone are
+   * looked up in the id index rather than found among all molecules. */
+  u_int n_mols = 0;
+  if (vizblk->traj_n_ids > 0 && vizblk->traj_sample_fraction <= 0.0 &&
+      world->mol_id_index != NULL) {
+    if (vizblk->traj_mol_capacity < (u_int)vizblk->traj_n_ids) {
+      free(vizblk->traj_mols);
+      vizblk->traj_mols = CHECKED_MALLOC_ARRAY(
+          struct abstract_molecule *, vizblk->traj_n_ids, "TRAJECTORY frame");
+      vizblk->traj_mol_capacity = vizblk->traj_n_ids;
+    }
+    for (int i = 0; i < vizblk->traj_n_ids; ++i) {
+      struct abstract_molecule *amp =
+          mol_id_index_lookup(world->mol_id_index, vizblk->traj_ids[i]);
+      if (amp != NULL && viz_includes_molecule(vizblk, amp, 1, 1))
+        vizblk->traj_mols[n_mols++] = amp;
+    }
+  } else {
+    if (sort_molecules_by_species(world, vizblk, 1, 1))
+      return 1;
+    for (int species_idx = 0; species_idx < world->n_species; species_idx++) {
+      struct abstract_molecule **const mols = vizblk->viz_molp[species_idx];
+      if (mols == NULL ||
+          vizblk->species_viz_states[species_idx] == EXCLUDE_OBJ)
+        continue;
+      for (u_int n_mol = 0; n_mol < vizblk->viz_mol_count[species_idx];
+           ++n_mol) {
+        if (!viz_track_candidate(vizblk, mols[n_mol]))
+          continue;
+        if (n_mols == vizblk->traj_mol_capacity) {
+          u_int capacity = 2 * vizblk->traj_mol_capacity + 16;
+          struct abstract_molecule **grown = CHECKED_MALLOC_ARRAY(
+              struct abstract_molecule *, capacity, "TRAJECTORY frame");
+          if (n_mols > 0)
+            memcpy(grown, vizblk->traj_mols,
+                   n_mols * sizeof(struct abstract_molecule *));
+          free(vizblk->traj_mols);
+          vizblk->traj_mols = grown;
+          vizblk->traj_mol_capacity = capacity;
+        }
+        vizblk->traj_mols[n_mols++] = mols[n_mol];
+      }
+    }
+    qsort(vizblk->traj_mols, n_mols, sizeof(struct abstract_molecule *),
+          compare_molecule_ids);
+  }
+
+  if (vizblk->spare_track_capacity < n_mols) {
+    u_int capacity = 2 * vizblk->spare_track_capacity;
+    if (capacity < n_mols)
+      capacity = n_mols;
+    free(vizblk->spare_tracks);
+    vizblk->spare_tracks = CHECKED_MALLOC_ARRAY(struct viz_track, capacity,
+                                                "TRAJECTORY tracks");
+    vizblk->spare_track_capacity = capacity;
+  }
+
+  /* Both frames are in id order: molecules only in the last one are gone,
+   * those only in this one are new */
+  FILE *custom_file = NULL;
+  u_int prev = 0;
+  for (u_int n_mol = 0; n_mol < n_mols; ++n_mol) {
+    struct abstract_molecule *amp = vizblk->traj_mols[n_mol];
+    while (prev < vizblk->n_tracks && vizblk->tracks[prev].id < amp->id)
+      end_track(world, vizblk, &custom_file, &vizblk->tracks[prev++], 1);
+
+    struct viz_track *track = &vizblk->spare_tracks[n_mol];
+    if (prev < vizblk->n_tracks && vizblk->tracks[prev].id == amp->id) {
+      *track = vizblk->tracks[prev++];
+    } else {
+      track->id = amp->id;
+      track->properties = amp->properties;
+      track->followed =
+          vizblk->traj_birth_region == NULL ||
+          viz_track_born_in_region(world, vizblk->traj_birth_region, amp);
+      track->n_blocks = 0;
+      track->n_samples = 0;
+      track->samples = NULL;
+    }
+    if (track->followed)
+      add_track_sample(world, vizblk, &custom_file, track, amp,
+                       fdlp->viz_iteration);
+  }
+  while (prev < vizblk->n_tracks)
+    end_track(world, vizblk, &custom_file, &vizblk->tracks[prev++], 1);
+
+  /* This frame becomes the reference for the next one */
+  struct viz_track *tmp_tracks = vizblk->tracks;
+  u_int tmp_capacity = vizblk->track_capacity;
+  vizblk->tracks = vizblk->spare_tracks;
+  vizblk->track_capacity = vizblk->spare_track_capacity;
+  vizblk->spare_tracks = tmp_tracks;
+  vizblk->spare_track_capacity = tmp_capacity;
+  vizblk->n_tracks = n_mols;
+
+  if (custom_file != NULL &&
+      output_writer_close(world->output_writer, custom_file))
+    return 1;
+  return 0;
+}
+
+/*************************************************************************
+finish_trajectory:
+    Writes the buffered samples of the molecules still alive at the end of
+    the run.
+
+        In:  struct viz_output_block *vizblk - a TRAJECTORY block
+        Out: 0 on success, 1 on failure.  The stream exists even if no
+             molecule was ever followed.
+**************************************************************************/
+static int finish_trajectory(struct volume *world,
+                             struct viz_output_block *vizblk) {
+  FILE *custom_file = NULL;
+  if (!vizblk->traj_started && vizblk->file_prefix_name != NULL)
+    custom_file = open_trajectory_stream(world, vizblk);
+  for (u_int i = 0; i < vizblk->n_tracks; ++i)
+    end_track(world, vizblk, &custom_file, &vizblk->tracks[i], 0);
+  vizblk->n_tracks = 0;
+
+  if (custom_file != NULL &&
+      output_writer_close(world->output_writer, custom_file))
+    return 1;
+  return 0;
+}
+
 /*********************************************************************
 init_frame_data_list:
 
@@ -2419,6 +3426,16 @@ int init_frame_data_list(struct volume *world,
       return 1;
     break;
 
+  case TRAJECTORY_MODE:
+    count_time_values(world, vizblk->frame_data_head);
+    if (reset_time_values(world, vizblk->frame_data_head, world->start_iterations))
+      return 1;
+    /* Molecules followed by id alone are found through the id index */
+    if (vizblk->traj_n_ids > 0 && vizblk->traj_sample_fraction <= 0.0 &&
+        mcell_enable_molecule_index(world))
+      return 1;
+    break;
+
   default:
     count_time_values(world, vizblk->frame_data_head);
     if (reset_time_values(world, vizblk->frame_data_head, world->start_iterations))
@@ -2504,21 +3521,34 @@ int update_frame_data_list(struct volume *world,
         mcell_log("  Updating data frame of type %s.", FRAME_TYPES[fdlp->type]);
     }
 
-    switch (vizblk->viz_mode) {
-    case ASCII_MODE:
-      if (output_ascii_molecules(world, vizblk, fdlp))
-        return 1;
-      break;
+    /* Frames of the equilibration phase are skipped */
+    if (!world->equilibrating) {
+      switch (vizblk->viz_mode) {
+      case ASCII_MODE:
+        if (output_ascii_molecules(world, vizblk, fdlp))
+          return 1;
+        break;
 
-    case CELLBLENDER_MODE:
-      if (output_cellblender_molecules(world, vizblk, fdlp))
-        return 1;
-      break;
+      case CELLBLENDER_MODE:
+        if (output_cellblender_molecules(world, vizblk, fdlp))
+          return 1;
+        break;
 
-    case NO_VIZ_MODE:
-    default:
-      /* Do nothing for vizualization */
-      break;
+      case CELLBLENDER_DELTA_MODE:
+        if (output_cellblender_delta_molecules(world, vizblk, fdlp))
+          return 1;
+        break;
+
+      case TRAJECTORY_MODE:
+        if (output_trajectory_molecules(world, vizblk, fdlp))
+          return 1;
+        break;
+
+      case NO_VIZ_MODE:
+      default:
+        /* Do nothing for vizualization */
+        break;
+      }
     }
 
     while (fdlp->curr_viz_iteration != NULL &&
@@ -2544,7 +3574,12 @@ int finalize_viz_output(struct volume *world, struct viz_output_block *vizblk) {
   if (vizblk == NULL)
     return 0;
 
+  int result = 0;
   switch (vizblk->viz_mode) {
+  case TRAJECTORY_MODE:
+    result = finish_trajectory(world, vizblk);
+    break;
+
   case NO_VIZ_MODE:
   case ASCII_MODE:
   default:
@@ -2552,5 +3587,6 @@ int finalize_viz_output(struct volume *world, struct viz_output_block *vizblk) {
     break;
   }
 
-  return 0;
+  free_viz_molecule_lists(vizblk);
+  return result;
 }
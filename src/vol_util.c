@@ -32,12 +32,15 @@
 #include "config.h"
 
 #include <assert.h>
+#include <errno.h>
 #include <math.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "diffuse.h"
+#include "init.h"
 #include "vector.h"
 #include "logging.h"
 #include "rng.h"
@@ -50,6 +53,7 @@
 #include "nfsim_func.h"
 #include "mcell_reactions.h"
 #include "diffuse.h"
+#include "mol_id_index.h"
 
 static int test_max_release(double num_to_release, char *name);
 
@@ -88,6 +92,69 @@ int inside_subvolume(struct vector3 *point, struct subvolume *subvol,
           (point->z <= z_fineparts[subvol->urb.z]));
 }
 
+/*************************************************************************
+partition_index:
+  In: lookup: bins built over the partitions by build_partition_lookup
+      partitions: coarse partition boundaries along one axis
+      n_parts: number of boundaries
+      val: coordinate along that axis
+  Out: index of the coarse partition val lies in; the same answer
+       bisect(partitions, n_parts, val) gives for any val below the
+       outermost boundary
+*************************************************************************/
+int partition_index(struct partition_lookup const *lookup, double *partitions,
+                    int n_parts, double val) {
+  if (lookup->n_bins == 0)
+    return bisect(partitions, n_parts, val);
+  if (!(val >= partitions[1]))
+    return 0;
+  if (val >= partitions[n_parts - 2])
+    return n_parts - 2;
+
+  int b = (int)((val - lookup->origin) * lookup->inv_width);
+  if (b >= lookup->n_bins)
+    b = lookup->n_bins - 1;
+  int i = lookup->first[b];
+  /* Rounding in the bin computation can land us one bin off */
+  while (i > 0 && partitions[i] > val)
+    i--;
+  while (partitions[i + 1] <= val)
+    i++;
+  return i;
+}
+
+/*************************************************************************
+build_partition_lookup:
+  In: lookup: lookup to (re)build
+      partitions: coarse partition boundaries along one axis
+      n_parts: number of boundaries
+  Out: 0 on success, 1 if memory ran out.  The inner partitions are split
+       into PARTITION_LOOKUP_BINS_PER_PART equal bins per partition.
+*************************************************************************/
+static int build_partition_lookup(struct partition_lookup *lookup,
+                                  double *partitions, int n_parts) {
+  free(lookup->first);
+  memset(lookup, 0, sizeof(struct partition_lookup));
+
+  /* Nothing but the two outermost partitions: bisect is as fast */
+  if (n_parts < 4 || !(partitions[n_parts - 2] > partitions[1]))
+    return 0;
+
+  int n_bins = PARTITION_LOOKUP_BINS_PER_PART * (n_parts - 3);
+  lookup->first = CHECKED_MALLOC_ARRAY_NODIE(int, n_bins, "partition lookup");
+  if (lookup->first == NULL)
+    return 1;
+
+  double width = (partitions[n_parts - 2] - partitions[1]) / n_bins;
+  lookup->origin = partitions[1];
+  lookup->inv_width = 1.0 / width;
+  lookup->n_bins = n_bins;
+  for (int b = 0; b < n_bins; b++)
+    lookup->first[b] =
+        bisect(partitions, n_parts, lookup->origin + b * width);
+  return 0;
+}
+
 /*************************************************************************
 find_coarse_subvolume:
   In: pointer to vector3
@@ -95,9 +162,12 @@ find_coarse_subvolume:
 *************************************************************************/
 struct subvolume *find_coarse_subvol(struct volume *state,
                                      struct vector3 *loc) {
-  int i = bisect(state->x_partitions, state->nx_parts, loc->x);
-  int j = bisect(state->y_partitions, state->ny_parts, loc->y);
-  int k = bisect(state->z_partitions, state->nz_parts, loc->z);
+  int i = partition_index(&state->x_lookup, state->x_partitions,
+                          state->nx_parts, loc->x);
+  int j = partition_index(&state->y_lookup, state->y_partitions,
+                          state->ny_parts, loc->y);
+  int k = partition_index(&state->z_lookup, state->z_partitions,
+                          state->nz_parts, loc->z);
   return &(state->subvol
                [k + (state->nz_parts - 1) * (j + (state->ny_parts - 1) * i)]);
 }
@@ -645,17 +715,14 @@ place_surface_molecule(struct volume *state, struct species *s,
       state->simulation_start_seconds, t);
   sm->id = state->current_mol_id++;
   sm->properties = s;
-  initialize_diffusion_function((struct abstract_molecule*)sm);
+  sm->graph_data = NULL;
 
   s->population++;
-  sm->periodic_box = CHECKED_MALLOC_STRUCT(struct periodic_image,
-    "periodic image descriptor");
-  sm->periodic_box->x = periodic_box->x;
-  sm->periodic_box->y = periodic_box->y;
-  sm->periodic_box->z = periodic_box->z;
+  sm->periodic_box = *periodic_box;
 
   sm->flags = TYPE_SURF | ACT_NEWBIE | IN_SCHEDULE;
-  if (sm->get_space_step(sm) > 0)
+  sm->lifetime_epoch = s->lifetime_epoch;
+  if (get_space_step(sm) > 0)
     sm->flags |= ACT_DIFFUSE;
   if (trigger_unimolecular(state->reaction_hash, state->rx_hashsize, s->hashval,
                            (struct abstract_molecule *)sm) != NULL ||
@@ -674,6 +741,7 @@ place_surface_molecule(struct volume *state, struct species *s,
   if (sm_list == NULL) {
     return NULL; 
   }
+  own_grid_tiles(sm->grid);
   sm->grid->sm_list[sm->grid_index] = sm_list;
   
   sm->grid->n_occupied++;
@@ -681,6 +749,7 @@ place_surface_molecule(struct volume *state, struct species *s,
 
   if ((s->flags & COUNT_ENCLOSED) != 0)
     sm->flags |= COUNT_ME;
+  mol_id_index_set(state->mol_id_index, (struct abstract_molecule *)sm);
 
   *psv = sv;
 
@@ -715,9 +784,7 @@ insert_surface_molecule(struct volume *state, struct species *s,
     return NULL;
 
   if (periodic_box != NULL) {
-    sm->periodic_box->x = periodic_box->x;
-    sm->periodic_box->y = periodic_box->y;
-    sm->periodic_box->z = periodic_box->z;
+    sm->periodic_box = *periodic_box;
   }
 
   if (sm->properties->flags & (COUNT_CONTENTS | COUNT_ENCLOSED))
@@ -731,27 +798,37 @@ insert_surface_molecule(struct volume *state, struct species *s,
 }
 
 /*************************************************************************
-insert_volume_molecule
-  In: pointer to a volume_molecule that we're going to place in local storage
-      pointer to a volume_molecule that may be nearby
-  Out: pointer to the new volume_molecule (copies data from volume molecule
-       passed in), or NULL if out of memory.  Molecule is placed in scheduler
-       also.
+find_release_subvolume
+  In: simulation state
+      position of a molecule being released
+      subvolume that may contain the position, or NULL
+  Out: the subvolume containing the position
 *************************************************************************/
-struct volume_molecule *insert_volume_molecule(
-    struct volume *state, struct volume_molecule *vm,
-    struct volume_molecule *vm_guess) {
-
-  struct subvolume *sv;
-
-  if (vm_guess == NULL)
-    sv = find_subvolume(state, &(vm->pos), NULL);
-  else if (inside_subvolume(&(vm->pos), vm_guess->subvol, state->x_fineparts,
-                            state->y_fineparts, state->z_fineparts))
-    sv = vm_guess->subvol;
-  else
-    sv = find_subvolume(state, &(vm->pos), vm_guess->subvol);
+static struct subvolume *find_release_subvolume(struct volume *state,
+                                                struct vector3 *pos,
+                                                struct subvolume *guess) {
+  if (guess == NULL)
+    return find_subvolume(state, pos, NULL);
+  if (inside_subvolume(pos, guess, state->x_fineparts, state->y_fineparts,
+                       state->z_fineparts))
+    return guess;
+  return find_subvolume(state, pos, guess);
+}
 
+/*************************************************************************
+place_in_subvolume
+  In: simulation state
+      pointer to a volume_molecule that we're going to place in local storage
+      subvolume containing the molecule's position
+      unique id to give the new molecule
+  Out: pointer to the new volume_molecule (copies data from volume molecule
+       passed in), or NULL if out of memory.  The molecule is added to the
+       subvolume and counted, but not scheduled.
+*************************************************************************/
+static struct volume_molecule *place_in_subvolume(struct volume *state,
+                                                  struct volume_molecule *vm,
+                                                  struct subvolume *sv,
+                                                  u_long id) {
   // Make sure this molecule isn't outside of the periodic boundaries
   struct vector3 llf, urb;
   if (state->periodic_box_obj) {
@@ -771,59 +848,264 @@ struct volume_molecule *insert_volume_molecule(
   memcpy(new_vm, vm, sizeof(struct volume_molecule));
   new_vm->mesh_name = NULL;
   new_vm->birthplace = sv->local_storage->mol;
-  new_vm->id = state->current_mol_id++;
-  new_vm->prev_v = NULL;
-  new_vm->next_v = NULL;
+  new_vm->id = id;
+  new_vm->species_list = NULL;
   new_vm->next = NULL;
   new_vm->subvol = sv;
   ht_add_molecule_to_list(&sv->mol_by_species, new_vm);
+  mol_id_index_set(state->mol_id_index, (struct abstract_molecule *)new_vm);
   sv->mol_count++;
   new_vm->properties->population++;
-  new_vm->periodic_box = CHECKED_MALLOC_STRUCT(struct periodic_image,
-    "periodic image descriptor");
-  new_vm->periodic_box->x = vm->periodic_box->x;
-  new_vm->periodic_box->y = vm->periodic_box->y;
-  new_vm->periodic_box->z = vm->periodic_box->z;
-
-  //initialize function pointer to diffusion function
-  initialize_diffusion_function((struct abstract_molecule*)new_vm);
+  acquire_molecule_graph((struct abstract_molecule *)new_vm);
+  new_vm->periodic_box = vm->periodic_box;
 
   if ((new_vm->properties->flags & COUNT_SOME_MASK) != 0)
     new_vm->flags |= COUNT_ME;
   if (new_vm->properties->flags & (COUNT_CONTENTS | COUNT_ENCLOSED)) {
     count_region_from_scratch(state, (struct abstract_molecule *)new_vm, NULL,
                               1, &(new_vm->pos), NULL, new_vm->t,
-                              new_vm->periodic_box);
+                              &new_vm->periodic_box);
   }
 
-  if (schedule_add(sv->local_storage->timer, new_vm))
+  return new_vm;
+}
+
+/*************************************************************************
+place_volume_molecule
+  In: pointer to a volume_molecule that we're going to place in local storage
+      pointer to a volume_molecule that may be nearby
+  Out: pointer to the new volume_molecule (copies data from volume molecule
+       passed in), or NULL if out of memory.  The molecule is added to its
+       subvolume and counted, but not scheduled.
+*************************************************************************/
+static struct volume_molecule *place_volume_molecule(
+    struct volume *state, struct volume_molecule *vm,
+    struct volume_molecule *vm_guess) {
+  struct subvolume *sv = find_release_subvolume(
+      state, &(vm->pos), (vm_guess == NULL) ? NULL : vm_guess->subvol);
+  return place_in_subvolume(state, vm, sv, state->current_mol_id++);
+}
+
+/*************************************************************************
+insert_volume_molecule
+  In: pointer to a volume_molecule that we're going to place in local storage
+      pointer to a volume_molecule that may be nearby
+  Out: pointer to the new volume_molecule (copies data from volume molecule
+       passed in), or NULL if out of memory.  Molecule is placed in scheduler
+       also.
+*************************************************************************/
+struct volume_molecule *insert_volume_molecule(
+    struct volume *state, struct volume_molecule *vm,
+    struct volume_molecule *vm_guess) {
+  struct volume_molecule *new_vm = place_volume_molecule(state, vm, vm_guess);
+  if (new_vm == NULL)
+    return NULL;
+
+  if (schedule_add(new_vm->subvol->local_storage->timer, new_vm))
     mcell_allocfailed("Failed to add volume molecule to scheduler.");
   return new_vm;
 }
 
-static int remove_from_list(struct volume_molecule *it) {
-  if (it->prev_v) {
-#ifdef DEBUG_LIST_CHECKS
-    if (*it->prev_v != it) {
-      mcell_error_nodie("Stale previous pointer!");
+/*************************************************************************
+init_release_batch
+  In: batch of released molecules
+  Out: No return value.  The batch is empty.  Its items are left as they
+       are, since only the first n are ever read.
+*************************************************************************/
+void init_release_batch(struct release_batch *batch) {
+  batch->timer = NULL;
+  batch->n = 0;
+}
+
+/*************************************************************************
+flush_release_batch
+  In: batch of released molecules
+  Out: No return value.  All molecules in the batch are scheduled and the
+       batch is empty.
+*************************************************************************/
+void flush_release_batch(struct release_batch *batch) {
+  if (batch->n == 0)
+    return;
+  if (schedule_insert_batch(batch->timer, batch->items, batch->n, 1))
+    mcell_allocfailed("Failed to add volume molecules to scheduler.");
+  batch->n = 0;
+}
+
+/*************************************************************************
+add_to_release_batch
+  In: batch of released molecules
+      molecule which has just been placed
+  Out: No return value.  The molecule is added to the batch, flushing it
+       first if it is full or holds another storage's molecules.
+*************************************************************************/
+static void add_to_release_batch(struct release_batch *batch,
+                                 struct volume_molecule *new_vm) {
+  struct schedule_helper *timer = new_vm->subvol->local_storage->timer;
+  if (timer != batch->timer || batch->n == RELEASE_BATCH_SIZE) {
+    flush_release_batch(batch);
+    batch->timer = timer;
+  }
+  batch->items[batch->n++] = (struct abstract_element *)new_vm;
+}
+
+/*************************************************************************
+release_volume_molecule
+  In: simulation state
+      pointer to a volume_molecule that we're going to place in local storage
+      pointer to a volume_molecule that may be nearby
+      batch which will schedule the new molecule
+  Out: pointer to the new volume_molecule, or NULL if out of memory.  The
+       molecule is scheduled when the batch is flushed, in the same order
+       insert_volume_molecule would have scheduled it.  If the molecule
+       falls in another MPI rank's storage, that rank creates it: its id is
+       used up and vm, with its subvolume set, is returned to serve as the
+       next guess.
+*************************************************************************/
+struct volume_molecule *release_volume_molecule(
+    struct volume *state, struct volume_molecule *vm,
+    struct volume_molecule *vm_guess, struct release_batch *batch) {
+  struct subvolume *sv = find_release_subvolume(
+      state, &(vm->pos), (vm_guess == NULL) ? NULL : vm_guess->subvol);
+  if (sv->local_storage->rank != state->procnum) {
+    state->current_mol_id++;
+    vm->subvol = sv;
+    return vm;
+  }
+
+  struct volume_molecule *new_vm =
+      place_in_subvolume(state, vm, sv, state->current_mol_id++);
+  if (new_vm == NULL)
+    return NULL;
+
+  add_to_release_batch(batch, new_vm);
+  return new_vm;
+}
+
+/* Released volume molecules whose positions and subvolumes are known but
+ * which have not been created yet.  They are created grouped by storage,
+ * so a release scattered over many storages allocates and schedules each
+ * storage's molecules together.  At most STAGED_RELEASE_SIZE are held at
+ * once. */
+#define STAGED_RELEASE_SIZE 65536
+
+struct staged_molecule {
+  struct vector3 pos;
+  struct species *properties;
+  struct subvolume *sv;
+  u_long id;
+  short flags;
+  double t;        /* Release time, which differs between the firings of a */
+  double birthday; /* reaction-triggered release */
+  int order;       /* Position in the release */
+};
+
+struct staged_release {
+  struct staged_molecule *mols;
+  int n;
+  int max;
+};
+
+/*************************************************************************
+compare_staged_molecules
+  In: two staged molecules
+  Out: qsort ordering: grouped by storage, in release order within each
+       storage.
+*************************************************************************/
+static int compare_staged_molecules(void const *a, void const *b) {
+  struct staged_molecule const *sa = (struct staged_molecule const *)a;
+  struct staged_molecule const *sb = (struct staged_molecule const *)b;
+  uintptr_t ta = (uintptr_t)sa->sv->local_storage;
+  uintptr_t tb = (uintptr_t)sb->sv->local_storage;
+  if (ta != tb)
+    return (ta < tb) ? -1 : 1;
+  return sa->order - sb->order;
+}
+
+/*************************************************************************
+stage_volume_molecule
+  In: simulation state
+      staged release to add to
+      volume molecule being released, with its position, species and flags
+      set
+  Out: No return value.  The molecule's subvolume is found and it is given
+       its id, but it is not created until place_staged_molecules is
+       called.
+*************************************************************************/
+static void stage_volume_molecule(struct volume *state,
+                                  struct staged_release *sr,
+                                  struct volume_molecule *vm) {
+  assert(sr->n < sr->max);
+  struct staged_molecule *sm = &sr->mols[sr->n];
+  struct subvolume *guess = (sr->n == 0) ? NULL : sr->mols[sr->n - 1].sv;
+  sm->pos = vm->pos;
+  sm->properties = vm->properties;
+  sm->sv = find_release_subvolume(state, &sm->pos, guess);
+  sm->id = state->current_mol_id++;
+  sm->flags = vm->flags;
+  sm->t = vm->t;
+  sm->birthday = vm->birthday;
+  sm->order = sr->n++;
+}
+
+/*************************************************************************
+place_staged_molecules
+  In: simulation state
+      staged release
+      volume molecule to copy the rest of the released molecules' data
+      from; its position, species, flags and times are left as they were
+      batch which will schedule the new molecules
+  Out: 0 on success, 1 on failure.  The staged molecules are created
+       grouped by storage, so each storage's share comes out of its
+       mem_helper in one run, and the staged release is emptied.  Within a
+       storage they are created and scheduled in release order, so the
+       simulation is the same as releasing them one at a time.  Molecules
+       in other MPI ranks' storages are left to those ranks.
+*************************************************************************/
+static int place_staged_molecules(struct volume *state,
+                                  struct staged_release *sr,
+                                  struct volume_molecule *vm,
+                                  struct release_batch *batch) {
+  qsort(sr->mols, sr->n, sizeof(struct staged_molecule),
+        compare_staged_molecules);
+
+  struct vector3 pos = vm->pos;
+  struct species *properties = vm->properties;
+  short flags = vm->flags;
+  double t = vm->t;
+  double birthday = vm->birthday;
+  int status = 0;
+  for (int i = 0; i < sr->n; i++) {
+    struct staged_molecule *sm = &sr->mols[i];
+    if (sm->sv->local_storage->rank != state->procnum)
+      continue;
+    vm->pos = sm->pos;
+    vm->properties = sm->properties;
+    vm->flags = sm->flags;
+    vm->t = sm->t;
+    vm->birthday = sm->birthday;
+    struct volume_molecule *new_vm =
+        place_in_subvolume(state, vm, sm->sv, sm->id);
+    if (new_vm == NULL) {
+      status = 1;
+      break;
     }
-#endif
-    *(it->prev_v) = it->next_v;
-  } else {
-#ifdef DEBUG_LIST_CHECKS
-    mcell_error_nodie("No previous pointer.");
-#endif
+    add_to_release_batch(batch, new_vm);
   }
-  if (it->next_v) {
+  vm->pos = pos;
+  vm->properties = properties;
+  vm->flags = flags;
+  vm->t = t;
+  vm->birthday = birthday;
+  sr->n = 0;
+  return status;
+}
+
+static int remove_from_list(struct volume_molecule *it) {
 #ifdef DEBUG_LIST_CHECKS
-    if (it->next_v->prev_v != &it->next_v) {
-      mcell_error_nodie("Stale next pointer!");
-    }
+  if (it->species_list == NULL)
+    mcell_error_nodie("Molecule is not in a species list.");
 #endif
-    it->next_v->prev_v = it->prev_v;
-  }
-  it->prev_v = NULL;
-  it->next_v = NULL;
+  species_list_remove(it);
   return 1;
 }
 
@@ -853,18 +1135,322 @@ struct volume_molecule *migrate_volume_molecule(struct volume_molecule *vm,
   memcpy(new_vm, vm, sizeof(struct volume_molecule));
   new_vm->birthplace = new_sv->local_storage->mol;
   new_vm->mesh_name = NULL;
-  new_vm->prev_v = NULL;
-  new_vm->next_v = NULL;
+  new_vm->species_list = NULL;
   new_vm->next = NULL;
   new_vm->subvol = new_sv;
 
   ht_add_molecule_to_list(&new_sv->mol_by_species, new_vm);
+  acquire_molecule_graph((struct abstract_molecule *)new_vm);
+  mol_id_index_set(new_sv->local_storage->mol_id_index,
+                   (struct abstract_molecule *)new_vm);
 
   collect_molecule(vm);
 
   return new_vm;
 }
 
+/*************************************************************************
+move_subvolume_to_storage:
+  In: subvolume
+      storage to hand the subvolume to
+  Out: No return value.  The subvolume and its volume molecules now belong
+       to the new storage: each molecule is copied into the storage's
+       memory and scheduler, taking its old copy's place in the species
+       lists, and the old copy is left in its scheduler as a defunct
+       molecule.  Walls and per-species lists are shared and stay where
+       they are.
+*************************************************************************/
+void move_subvolume_to_storage(struct subvolume *sv, struct storage *store) {
+  struct storage *old_store = sv->local_storage;
+  if (old_store == store)
+    return;
+  sv->local_storage = store;
+
+  for (struct per_species_list *psl = sv->species_head; psl != NULL;
+       psl = psl->next) {
+    for (int mi = 0; mi < psl->n_mols; mi++) {
+      struct volume_molecule *vm = psl->mols[mi];
+      struct volume_molecule *new_vm = (struct volume_molecule *)
+          CHECKED_MEM_GET(store->mol, "volume molecule");
+      memcpy(new_vm, vm, sizeof(struct volume_molecule));
+      new_vm->birthplace = store->mol;
+      new_vm->next = NULL;
+      psl->mols[mi] = new_vm;
+      mol_id_index_set(store->mol_id_index, (struct abstract_molecule *)new_vm);
+
+      if ((new_vm->flags & IN_SCHEDULE) &&
+          schedule_add(store->timer, new_vm))
+        mcell_allocfailed("Failed to add volume molecule to scheduler.");
+
+      vm->properties = NULL;
+      vm->species_list = NULL;
+      vm->flags &= ~IN_VOLUME;
+      if ((vm->flags & IN_MASK) == 0)
+        mem_put(vm->birthplace, vm);
+      else
+        old_store->timer->defunct_count++;
+    }
+  }
+}
+
+/* Bits of each coordinate in the Morton key of a volume molecule */
+#define MORTON_BITS 21
+
+/* A volume molecule and its place along the Morton curve; seq breaks ties
+ * the same way on every run */
+struct morton_entry {
+  uint64_t key;
+  int seq;
+  struct volume_molecule *vm;
+};
+
+/* A list item and its position, ordered by the Morton rank of the molecule
+ * it is (-1 for items which were not sorted) */
+struct morton_rank_item {
+  int rank;
+  int pos;
+  void *item;
+};
+
+/* Items of the list being put into Morton order */
+struct morton_rank_buffer {
+  struct morton_rank_item *items;
+  int n_items;
+  int max_items;
+};
+
+/* Spread the low MORTON_BITS bits of v out to every third bit */
+static uint64_t morton_spread(uint64_t v) {
+  v &= (1ULL << MORTON_BITS) - 1;
+  v = (v | v << 32) & 0x1f00000000ffffULL;
+  v = (v | v << 16) & 0x1f0000ff0000ffULL;
+  v = (v | v << 8) & 0x100f00f00f00f00fULL;
+  v = (v | v << 4) & 0x10c30c30c30c30c3ULL;
+  v = (v | v << 2) & 0x1249249249249249ULL;
+  return v;
+}
+
+/* Grid cell of a coordinate, given the low corner and cells per unit */
+static uint64_t morton_cell(double x, double low, double scale) {
+  double c = (x - low) * scale;
+  if (c <= 0)
+    return 0;
+  if (c >= (double)((1ULL << MORTON_BITS) - 1))
+    return (1ULL << MORTON_BITS) - 1;
+  return (uint64_t)c;
+}
+
+static int compare_morton_entries(void const *a, void const *b) {
+  struct morton_entry const *ea = (struct morton_entry const *)a;
+  struct morton_entry const *eb = (struct morton_entry const *)b;
+  if (ea->key != eb->key)
+    return (ea->key < eb->key) ? -1 : 1;
+  return ea->seq - eb->seq;
+}
+
+static int compare_molecule_addresses(void const *a, void const *b) {
+  uintptr_t pa = (uintptr_t)*(struct volume_molecule *const *)a;
+  uintptr_t pb = (uintptr_t)*(struct volume_molecule *const *)b;
+  return (pa < pb) ? -1 : (pa > pb);
+}
+
+static int compare_morton_rank_items(void const *a, void const *b) {
+  struct morton_rank_item const *ia = (struct morton_rank_item const *)a;
+  struct morton_rank_item const *ib = (struct morton_rank_item const *)b;
+  if (ia->rank != ib->rank)
+    return ia->rank - ib->rank;
+  return ia->pos - ib->pos;
+}
+
+/* Index of p among the n sorted addresses in addr, or -1 */
+static int morton_address_index(void *p, struct volume_molecule **addr,
+                                int n) {
+  int lo = 0, hi = n - 1;
+  while (lo <= hi) {
+    int mid = lo + (hi - lo) / 2;
+    if ((uintptr_t)addr[mid] < (uintptr_t)p)
+      lo = mid + 1;
+    else if ((uintptr_t)addr[mid] > (uintptr_t)p)
+      hi = mid - 1;
+    else
+      return mid;
+  }
+  return -1;
+}
+
+/* Append an item to the buffer, ranked by where it now sits in addr */
+static void morton_rank_push(struct morton_rank_buffer *buf, void *item,
+                             struct volume_molecule **addr, int n) {
+  if (buf->n_items == buf->max_items) {
+    int max_items = (buf->max_items == 0) ? 64 : 2 * buf->max_items;
+    struct morton_rank_item *items = (struct morton_rank_item *)realloc(
+        buf->items, max_items * sizeof(struct morton_rank_item));
+    if (items == NULL)
+      mcell_allocfailed("Failed to grow the molecule sort buffer.");
+    buf->items = items;
+    buf->max_items = max_items;
+  }
+  struct morton_rank_item *it = &buf->items[buf->n_items];
+  it->rank = morton_address_index(item, addr, n);
+  it->pos = buf->n_items++;
+  it->item = item;
+}
+
+/*************************************************************************
+morton_sort_schedule_list:
+  In: head, tail: a slot list of the scheduler, with the links still
+                  pointing to where the sorted molecules used to be
+      addr: the n sorted addresses the molecules were moved between
+      new_addr: where the molecule at each of those addresses went
+      buf: scratch space
+  Out: No return value.  The list holds the same items, with the sorted
+       molecules in Morton order after all other items.
+*************************************************************************/
+static void morton_sort_schedule_list(struct abstract_element **head,
+                                      struct abstract_element **tail,
+                                      struct volume_molecule **addr,
+                                      struct volume_molecule **new_addr,
+                                      int n, struct morton_rank_buffer *buf) {
+  buf->n_items = 0;
+  for (struct abstract_element *e = *head; e != NULL;) {
+    int j = morton_address_index(e, addr, n);
+    if (j >= 0)
+      e = (struct abstract_element *)new_addr[j];
+    morton_rank_push(buf, e, addr, n);
+    e = e->next;
+  }
+  if (buf->n_items == 0)
+    return;
+
+  qsort(buf->items, buf->n_items, sizeof(struct morton_rank_item),
+        compare_morton_rank_items);
+  for (int i = 0; i < buf->n_items - 1; i++)
+    ((struct abstract_element *)buf->items[i].item)->next =
+        (struct abstract_element *)buf->items[i + 1].item;
+  *head = (struct abstract_element *)buf->items[0].item;
+  *tail = (struct abstract_element *)buf->items[buf->n_items - 1].item;
+  (*tail)->next = NULL;
+}
+
+/*************************************************************************
+morton_sort_storage:
+  In: world: simulation state, between iterations
+      store: storage whose volume molecules to sort
+  Out: No return value.  The volume molecules of the storage are moved
+       around between the records they already occupy so that increasing
+       addresses follow the Morton curve through their positions.  The
+       slot lists of the storage's scheduler and the per-species lists of
+       its subvolumes are put in the same order, so that both the timestep
+       and the scans for collision partners walk memory forwards.  This
+       changes the order in which molecules are processed, but the result
+       is the same on every run.
+*************************************************************************/
+void morton_sort_storage(struct volume *world, struct storage *store) {
+  int n = 0;
+  for (int i = 0; i < world->n_subvols; i++) {
+    struct subvolume *sv = &world->subvol[i];
+    if (sv->local_storage != store)
+      continue;
+    for (struct per_species_list *psl = sv->species_head; psl != NULL;
+         psl = psl->next)
+      for (int mi = 0; mi < psl->n_mols; mi++)
+        if (psl->mols[mi]->birthplace == store->mol)
+          n++;
+  }
+  if (n < 2)
+    return;
+
+  struct morton_entry *order =
+      CHECKED_MALLOC_ARRAY(struct morton_entry, n, "molecule sort keys");
+  struct volume_molecule **addr = CHECKED_MALLOC_ARRAY(
+      struct volume_molecule *, n, "molecule sort addresses");
+  struct volume_molecule **new_addr = CHECKED_MALLOC_ARRAY(
+      struct volume_molecule *, n, "molecule sort addresses");
+  struct volume_molecule *copies =
+      CHECKED_MALLOC_ARRAY(struct volume_molecule, n, "sorted molecules");
+
+  struct vector3 extent;
+  vectorize(&world->bb_llf, &world->bb_urb, &extent);
+  double longest = extent.x;
+  if (extent.y > longest)
+    longest = extent.y;
+  if (extent.z > longest)
+    longest = extent.z;
+  double scale = (longest > 0) ? ((1ULL << MORTON_BITS) - 1) / longest : 0;
+
+  int k = 0;
+  for (int i = 0; i < world->n_subvols; i++) {
+    struct subvolume *sv = &world->subvol[i];
+    if (sv->local_storage != store)
+      continue;
+    for (struct per_species_list *psl = sv->species_head; psl != NULL;
+         psl = psl->next) {
+      for (int mi = 0; mi < psl->n_mols; mi++) {
+        struct volume_molecule *vm = psl->mols[mi];
+        if (vm->birthplace != store->mol)
+          continue;
+        order[k].key =
+            morton_spread(morton_cell(vm->pos.x, world->bb_llf.x, scale)) |
+            morton_spread(morton_cell(vm->pos.y, world->bb_llf.y, scale))
+                << 1 |
+            morton_spread(morton_cell(vm->pos.z, world->bb_llf.z, scale))
+                << 2;
+        order[k].seq = k;
+        order[k].vm = vm;
+        addr[k] = vm;
+        k++;
+      }
+    }
+  }
+  qsort(order, n, sizeof(struct morton_entry), compare_morton_entries);
+  qsort(addr, n, sizeof(struct volume_molecule *), compare_molecule_addresses);
+
+  /* The i-th molecule along the curve takes the i-th lowest address */
+  for (int i = 0; i < n; i++) {
+    new_addr[morton_address_index(order[i].vm, addr, n)] = addr[i];
+    memcpy(&copies[i], order[i].vm, sizeof(struct volume_molecule));
+  }
+  for (int i = 0; i < n; i++)
+    memcpy(addr[i], &copies[i], sizeof(struct volume_molecule));
+
+  struct morton_rank_buffer buf = { NULL, 0, 0 };
+  for (struct schedule_helper *sh = store->timer; sh != NULL;
+       sh = sh->next_scale) {
+    for (int i = 0; i < sh->buf_len; i++)
+      morton_sort_schedule_list(&sh->circ_buf_head[i], &sh->circ_buf_tail[i],
+                                addr, new_addr, n, &buf);
+    morton_sort_schedule_list(&sh->current, &sh->current_tail, addr,
+                              new_addr, n, &buf);
+  }
+
+  for (int i = 0; i < world->n_subvols; i++) {
+    struct subvolume *sv = &world->subvol[i];
+    if (sv->local_storage != store)
+      continue;
+    for (struct per_species_list *psl = sv->species_head; psl != NULL;
+         psl = psl->next) {
+      buf.n_items = 0;
+      for (int mi = 0; mi < psl->n_mols; mi++) {
+        struct volume_molecule *vm = psl->mols[mi];
+        int j = morton_address_index(vm, addr, n);
+        morton_rank_push(&buf, (j >= 0) ? new_addr[j] : vm, addr, n);
+      }
+      qsort(buf.items, buf.n_items, sizeof(struct morton_rank_item),
+            compare_morton_rank_items);
+      for (int mi = 0; mi < psl->n_mols; mi++) {
+        psl->mols[mi] = (struct volume_molecule *)buf.items[mi].item;
+        psl->mols[mi]->species_index = mi;
+      }
+    }
+  }
+
+  free(buf.items);
+  free(copies);
+  free(new_addr);
+  free(addr);
+  free(order);
+}
+
 /*************************************************************************
 eval_rel_region_3d:
   In: an expression tree containing regions to release on
@@ -947,6 +1533,221 @@ int eval_rel_region_3d(struct release_evaluator *expr, struct waypoint *wp,
   return 0;
 }
 
+/*************************************************************************
+subvolume_inside_release:
+  In: simulation state
+      release region data for a 3D region release
+      index of a subvolume
+  Out: 1 if every point of the subvolume is inside the release region, 0 if
+       none is, or -1 if the subvolume holds walls and points in it have to
+       be tested one at a time.  A subvolume without walls is classified by
+       its waypoint alone; the answer is cached in the release region data
+       until dynamic geometry rebuilds the subvolumes.
+*************************************************************************/
+static int subvolume_inside_release(struct volume *state,
+                                    struct release_region_data *rrd,
+                                    int this_sv) {
+  if (rrd->sv_inside == NULL || rrd->sv_serial != state->geometry_serial) {
+    free(rrd->sv_inside);
+    rrd->sv_inside = CHECKED_MALLOC_ARRAY(signed char, state->n_subvols,
+                                          "release region subvolumes");
+    memset(rrd->sv_inside, -2, state->n_subvols * sizeof(signed char));
+    rrd->sv_serial = state->geometry_serial;
+  }
+
+  signed char *inside = &rrd->sv_inside[this_sv];
+  if (*inside == -2) {
+    if (state->subvol[this_sv].wall_head != NULL)
+      *inside = -1;
+    else
+      *inside = (signed char)eval_rel_region_3d(
+          rrd->expression, &state->waypoints[this_sv], NULL, NULL);
+  }
+  return *inside;
+}
+
+/* Release points are only drawn from the subvolumes which may hold some of
+ * the release once those make up less than this fraction of its bounding
+ * box; otherwise drawing from the whole box rejects few enough points. */
+#define RELEASE_SV_SAMPLING_FRACTION 0.5
+
+/*************************************************************************
+release_subvolumes:
+  In: simulation state
+      release region data for a 3D region release
+  Out: the volume of the bounding box shared with the subvolumes which are
+       not all outside the release.  Those subvolumes are listed in the
+       release region data along with the running total of that volume;
+       the list is kept until dynamic geometry rebuilds the subvolumes.
+*************************************************************************/
+static double release_subvolumes(struct volume *state,
+                                 struct release_region_data *rrd) {
+  if (rrd->n_release_svs >= 0 &&
+      rrd->release_svs_serial == state->geometry_serial)
+    return (rrd->n_release_svs > 0)
+               ? rrd->release_sv_volume[rrd->n_release_svs - 1]
+               : 0.0;
+
+  const int x_min = bisect(state->x_partitions, state->nx_parts, rrd->llf.x);
+  const int x_max =
+      bisect_high(state->x_partitions, state->nx_parts, rrd->urb.x);
+  const int y_min = bisect(state->y_partitions, state->ny_parts, rrd->llf.y);
+  const int y_max =
+      bisect_high(state->y_partitions, state->ny_parts, rrd->urb.y);
+  const int z_min = bisect(state->z_partitions, state->nz_parts, rrd->llf.z);
+  const int z_max =
+      bisect_high(state->z_partitions, state->nz_parts, rrd->urb.z);
+  const int max_svs = (x_max - x_min) * (y_max - y_min) * (z_max - z_min);
+
+  free(rrd->release_svs);
+  free(rrd->release_sv_volume);
+  rrd->release_svs =
+      CHECKED_MALLOC_ARRAY(int, max_svs, "release region subvolumes");
+  rrd->release_sv_volume =
+      CHECKED_MALLOC_ARRAY(double, max_svs, "release region subvolumes");
+
+  int n_svs = 0;
+  double total = 0.0;
+  for (int px = x_min; px < x_max; px++) {
+    for (int py = y_min; py < y_max; py++) {
+      for (int pz = z_min; pz < z_max; pz++) {
+        const int this_sv =
+            pz + (state->nz_parts - 1) * (py + (state->ny_parts - 1) * px);
+        if (subvolume_inside_release(state, rrd, this_sv) == 0)
+          continue;
+
+        struct subvolume *sv = &state->subvol[this_sv];
+        double dx = min2d(state->x_fineparts[sv->urb.x], rrd->urb.x) -
+                    max2d(state->x_fineparts[sv->llf.x], rrd->llf.x);
+        double dy = min2d(state->y_fineparts[sv->urb.y], rrd->urb.y) -
+                    max2d(state->y_fineparts[sv->llf.y], rrd->llf.y);
+        double dz = min2d(state->z_fineparts[sv->urb.z], rrd->urb.z) -
+                    max2d(state->z_fineparts[sv->llf.z], rrd->llf.z);
+        if (dx <= 0.0 || dy <= 0.0 || dz <= 0.0)
+          continue;
+
+        total += dx * dy * dz;
+        rrd->release_svs[n_svs] = this_sv;
+        rrd->release_sv_volume[n_svs] = total;
+        n_svs++;
+      }
+    }
+  }
+  rrd->n_release_svs = n_svs;
+  rrd->release_svs_serial = state->geometry_serial;
+  return total;
+}
+
+/*************************************************************************
+pick_release_point:
+  In: simulation state
+      release region data for a 3D region release
+      volume of the release subvolumes (see release_subvolumes)
+      where to put the point
+  Out: the subvolume the point was drawn in.  The point is uniform over
+       the part of the bounding box in the release subvolumes.
+*************************************************************************/
+static struct subvolume *pick_release_point(struct volume *state,
+                                            struct release_region_data *rrd,
+                                            double total,
+                                            struct vector3 *pos) {
+  double u = total * rng_dbl(state->rng);
+  int lo = 0, hi = rrd->n_release_svs - 1;
+  while (lo < hi) {
+    int mid = (lo + hi) / 2;
+    if (rrd->release_sv_volume[mid] <= u)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+
+  struct subvolume *sv = &state->subvol[rrd->release_svs[lo]];
+  double x0 = max2d(state->x_fineparts[sv->llf.x], rrd->llf.x);
+  double y0 = max2d(state->y_fineparts[sv->llf.y], rrd->llf.y);
+  double z0 = max2d(state->z_fineparts[sv->llf.z], rrd->llf.z);
+  pos->x = x0 +
+      (min2d(state->x_fineparts[sv->urb.x], rrd->urb.x) - x0) * rng_dbl(state->rng);
+  pos->y = y0 +
+      (min2d(state->y_fineparts[sv->urb.y], rrd->urb.y) - y0) * rng_dbl(state->rng);
+  pos->z = z0 +
+      (min2d(state->z_fineparts[sv->urb.z], rrd->urb.z) - z0) * rng_dbl(state->rng);
+  return sv;
+}
+
+/*************************************************************************
+molecule_inside_release:
+  In: simulation state
+      release region data for a 3D region release
+      volume molecule to test
+      index of the molecule's subvolume
+  Out: 1 if the molecule is inside the release region, 0 otherwise.  The
+       walls crossed between the subvolume's waypoint and the molecule
+       decide.
+*************************************************************************/
+static int molecule_inside_release(struct volume *state,
+                                   struct release_region_data *rrd,
+                                   struct volume_molecule *mp, int this_sv) {
+  struct subvolume *sv = &(state->subvol[this_sv]);
+  struct region_list *extra_in = NULL, *extra_out = NULL;
+  struct region_list *rl, *rl2;
+  struct waypoint *wp = &(state->waypoints[this_sv]);
+  struct vector3 *origin = &(wp->loc);
+  struct vector3 hit, delta;
+  double t;
+
+  delta.x = mp->pos.x - origin->x;
+  delta.y = mp->pos.y - origin->y;
+  delta.z = mp->pos.z - origin->z;
+
+  for (struct wall_list *wl = sv->wall_head; wl != NULL; wl = wl->next) {
+    int hitcode = collide_wall(origin, &delta, wl->this_wall, &t, &hit, 0,
+                               state->rng, state->notify,
+                               &(state->stats.ray_polygon_tests));
+    if (hitcode != COLLIDE_MISS) {
+      state->stats.ray_polygon_colls++;
+
+      for (rl = wl->this_wall->counting_regions; rl != NULL; rl = rl->next) {
+        if (hitcode == COLLIDE_FRONT || hitcode == COLLIDE_BACK) {
+          rl2 = (struct region_list *)CHECKED_MEM_GET(sv->local_storage->regl,
+                                                      "region list");
+          rl2->reg = rl->reg;
+
+          if (hitcode == COLLIDE_FRONT) {
+            rl2->next = extra_in;
+            extra_in = rl2;
+          } else /*hitcode == COLLIDE_BACK*/
+          {
+            rl2->next = extra_out;
+            extra_out = rl2;
+          }
+        }
+      }
+    }
+  }
+
+  for (rl = extra_in; rl != NULL; rl = rl->next) {
+    if (rl->reg == NULL)
+      continue;
+    for (rl2 = extra_out; rl2 != NULL; rl2 = rl2->next) {
+      if (rl2->reg == NULL)
+        continue;
+      if (rl->reg == rl2->reg) {
+        rl->reg = NULL;
+        rl2->reg = NULL;
+        break;
+      }
+    }
+  }
+
+  int inside = eval_rel_region_3d(rrd->expression, wp, extra_in, extra_out);
+
+  if (extra_in != NULL)
+    mem_put_list(sv->local_storage->regl, extra_in);
+  if (extra_out != NULL)
+    mem_put_list(sv->local_storage->regl, extra_out);
+  return inside;
+}
+
 /*************************************************************************
 vacuum_inside_regions:
   In: pointer to a release site object
@@ -962,18 +1763,19 @@ static int vacuum_inside_regions(struct volume *state,
                                  struct volume_molecule *vm, int n) {
   struct volume_molecule *mp;
   struct release_region_data *rrd;
-  struct region_list *extra_in, *extra_out;
-  struct region_list *rl, *rl2;
-  struct waypoint *wp;
   struct subvolume *sv = NULL;
   struct mem_helper *mh;
   struct void_list *vl;
   struct void_list *vl_head = NULL;
   int vl_num = 0;
-  double t;
-  struct vector3 hit, delta;
-  struct vector3 *origin;
-  struct wall_list *wl;
+
+  /* Each rank only sees its own molecules to choose from */
+  if (state->n_procs > 1) {
+    mcell_error_nodie("Cannot remove '%s' molecules with a negative release "
+                      "when the simulation is split between MPI ranks.",
+                      vm->properties->sym->name);
+    return 1;
+  }
 
   rrd = rso->region_data;
   mh = create_mem(sizeof(struct void_list), 1024);
@@ -1000,70 +1802,23 @@ static int vacuum_inside_regions(struct volume *state,
         struct per_species_list *psl =
             (struct per_species_list *)pointer_hash_lookup(
                 &sv->mol_by_species, vm->properties, vm->properties->hashval);
-
-        if (psl != NULL) {
-          for (mp = psl->head; mp != NULL; mp = mp->next_v) {
-            extra_in = extra_out = NULL;
-            wp = &(state->waypoints[this_sv]);
-            origin = &(wp->loc);
-            delta.x = mp->pos.x - origin->x;
-            delta.y = mp->pos.y - origin->y;
-            delta.z = mp->pos.z - origin->z;
-
-            for (wl = sv->wall_head; wl != NULL; wl = wl->next) {
-              int hitcode = collide_wall(origin, &delta, wl->this_wall, &t,
-                                         &hit, 0, state->rng, state->notify,
-                                         &(state->ray_polygon_tests));
-              if (hitcode != COLLIDE_MISS) {
-                state->ray_polygon_colls++;
-
-                for (rl = wl->this_wall->counting_regions; rl != NULL;
-                     rl = rl->next) {
-                  if (hitcode == COLLIDE_FRONT || hitcode == COLLIDE_BACK) {
-                    rl2 = (struct region_list *)CHECKED_MEM_GET(
-                        sv->local_storage->regl, "region list");
-                    rl2->reg = rl->reg;
-
-                    if (hitcode == COLLIDE_FRONT) {
-                      rl2->next = extra_in;
-                      extra_in = rl2;
-                    } else /*hitcode == COLLIDE_BACK*/
-                    {
-                      rl2->next = extra_out;
-                      extra_out = rl2;
-                    }
-                  }
-                }
-              }
-            }
-
-            for (rl = extra_in; rl != NULL; rl = rl->next) {
-              if (rl->reg == NULL)
-                continue;
-              for (rl2 = extra_out; rl2 != NULL; rl2 = rl2->next) {
-                if (rl2->reg == NULL)
-                  continue;
-                if (rl->reg == rl2->reg) {
-                  rl->reg = NULL;
-                  rl2->reg = NULL;
-                  break;
-                }
-              }
-            }
-
-            if (eval_rel_region_3d(rrd->expression, wp, extra_in, extra_out)) {
-              vl = (struct void_list *)CHECKED_MEM_GET(mh, "temporary list");
-              vl->data = mp;
-              vl->next = vl_head;
-              vl_head = vl;
-              vl_num++;
-            }
-
-            if (extra_in != NULL)
-              mem_put_list(sv->local_storage->regl, extra_in);
-            if (extra_out != NULL)
-              mem_put_list(sv->local_storage->regl, extra_out);
-          }
+        if (psl == NULL)
+          continue;
+
+        const int sv_inside = subvolume_inside_release(state, rrd, this_sv);
+        if (sv_inside == 0)
+          continue;
+
+        for (int mi = psl->n_mols - 1; mi >= 0; mi--) {
+          mp = psl->mols[mi];
+          if (sv_inside < 0 && !molecule_inside_release(state, rrd, mp, this_sv))
+            continue;
+
+          vl = (struct void_list *)CHECKED_MEM_GET(mh, "temporary list");
+          vl->data = mp;
+          vl->next = vl_head;
+          vl_head = vl;
+          vl_num++;
         }
       }
     }
@@ -1129,10 +1884,10 @@ static int is_point_inside_region(struct volume *state,
     double hit_time;
     int hit_check =
         collide_wall(origin, &delta, wl->this_wall, &hit_time, &hit_pos, 0,
-                     state->rng, state->notify, &(state->ray_polygon_tests));
+                     state->rng, state->notify, &(state->stats.ray_polygon_tests));
 
     if (hit_check != COLLIDE_MISS) {
-      state->ray_polygon_colls++;
+      state->stats.ray_polygon_colls++;
 
       if ((hit_time > -EPS_C && hit_time < EPS_C) ||
           (hit_time > 1.0 - EPS_C && hit_time < 1.0 + EPS_C)) {
@@ -1223,14 +1978,42 @@ static int release_inside_regions(struct volume *state,
   if (n < 0)
     return vacuum_inside_regions(state, rso, vm, n);
 
+  /* Where the release fills little of its bounding box, points are drawn
+   * from the subvolumes that may hold some of it instead of the whole box.
+   * The number of tries of an approximate concentration release is scaled
+   * down to the volume they are drawn from. */
+  const double box_volume = (rrd->urb.x - rrd->llf.x) *
+                            (rrd->urb.y - rrd->llf.y) *
+                            (rrd->urb.z - rrd->llf.z);
+  const double sv_volume = release_subvolumes(state, rrd);
+  const int from_svs = (rrd->n_release_svs > 0 &&
+                        sv_volume < RELEASE_SV_SAMPLING_FRACTION * box_volume);
+  if (from_svs && rso->release_number_method == CCNNUM && !exactNumber) {
+    double tries = n * (sv_volume / box_volume);
+    n = (int)tries;
+    if (rng_dbl(state->rng) < tries - n)
+      n++;
+  }
+
+  struct release_batch batch;
+  init_release_batch(&batch);
   struct volume_molecule *new_vm = NULL;
   struct subvolume *sv = NULL;
   while (n > 0) {
-    vm->pos.x = rrd->llf.x + (rrd->urb.x - rrd->llf.x) * rng_dbl(state->rng);
-    vm->pos.y = rrd->llf.y + (rrd->urb.y - rrd->llf.y) * rng_dbl(state->rng);
-    vm->pos.z = rrd->llf.z + (rrd->urb.z - rrd->llf.z) * rng_dbl(state->rng);
+    if (from_svs)
+      sv = pick_release_point(state, rrd, sv_volume, &vm->pos);
+    else {
+      vm->pos.x = rrd->llf.x + (rrd->urb.x - rrd->llf.x) * rng_dbl(state->rng);
+      vm->pos.y = rrd->llf.y + (rrd->urb.y - rrd->llf.y) * rng_dbl(state->rng);
+      vm->pos.z = rrd->llf.z + (rrd->urb.z - rrd->llf.z) * rng_dbl(state->rng);
+      sv = find_release_subvolume(state, &vm->pos, sv);
+    }
 
-    if (!is_point_inside_region(state, &vm->pos, rrd->expression, NULL)) {
+    /* Only points in subvolumes holding walls need a ray cast */
+    int inside = subvolume_inside_release(state, rrd, sv - state->subvol);
+    if (inside < 0)
+      inside = is_point_inside_region(state, &vm->pos, rrd->expression, sv);
+    if (!inside) {
       if (rso->release_number_method == CCNNUM && !exactNumber)
         n--;
       continue;
@@ -1238,16 +2021,17 @@ static int release_inside_regions(struct volume *state,
 
     /* Actually place the molecule */
     vm->subvol = sv;
-    vm->periodic_box->x = rso->periodic_box->x;
-    vm->periodic_box->y = rso->periodic_box->y;
-    vm->periodic_box->z = rso->periodic_box->z;
-    new_vm = insert_volume_molecule(state, vm, new_vm);
-    if (new_vm == NULL)
+    vm->periodic_box = *rso->periodic_box;
+    new_vm = release_volume_molecule(state, vm, new_vm, &batch);
+    if (new_vm == NULL) {
+      flush_release_batch(&batch);
       return 1;
+    }
 
     n--;
   }
 
+  flush_release_batch(&batch);
   return 0;
 }
 
@@ -1273,7 +2057,8 @@ int release_molecules(struct volume *state, struct release_event_queue *req) {
 
   /* Set up canonical molecule to be released */
   /* If we have a list, assume a 3D molecule and fix later */
-  if (rso->mol_list != NULL || (rso->mol_type->flags & NOT_FREE) == 0) {
+  if (rso->mol_list != NULL || rso->mol_file != NULL ||
+      (rso->mol_type->flags & NOT_FREE) == 0) {
     vm.flags = TYPE_VOL | IN_VOLUME;
   } else {
     vm.flags = TYPE_SURF | IN_SURFACE;
@@ -1301,29 +2086,21 @@ int release_molecules(struct volume *state, struct release_event_queue *req) {
   vm.birthday = convert_iterations_to_seconds(
       state->start_iterations, state->time_unit,
       state->simulation_start_seconds, vm.t);
-  struct periodic_image periodic_box = { .x = rso->periodic_box->x,
-                                         .y = rso->periodic_box->y,
-                                         .z = rso->periodic_box->z
-                                       };
-  vm.periodic_box = &periodic_box;
+  vm.periodic_box = *rso->periodic_box;
 
   struct abstract_molecule *ap = (struct abstract_molecule *)(&vm);
 
   
   if(ap->properties && (ap->properties->flags & EXTERNAL_SPECIES)){
-    //TODO: i should check against a hashmap storing rso->graph_pattern data instead of reacting this object
-    int error = get_graph_data(lhash(rso->graph_pattern), &ap->graph_data);
-    if(error != 0){
-      if(!ap->graph_data){
-        ap->graph_data = CHECKED_MALLOC_ARRAY(struct graph_data, 1, "structure to store graph data");
-        ap->graph_data->graph_pattern = rso->graph_pattern;
-        ap->graph_data->graph_pattern_hash = lhash(ap->graph_data->graph_pattern);
-        properties_nfsim(state, ap);
-      }
-      store_graph_data(lhash(rso->graph_pattern), ap->graph_data);
+    // a pattern already in the system keeps the data derived for it
+    bool created;
+    ap->graph_data = intern_graph_data(state, rso->graph_pattern, &created);
+    if (created) {
+      properties_nfsim(state, ap);
       state->n_NFSimSpecies += 1;
-
     }
+    // held until the release is done, in case it removes molecules
+    acquire_graph_data(ap->graph_data);
   }
   else{
     ap->graph_data = NULL;
@@ -1332,13 +2109,12 @@ int release_molecules(struct volume *state, struct release_event_queue *req) {
   }
 
   // All molecules are the same, so we can set flags
-  if (rso->mol_list == NULL) {
-    initialize_diffusion_function(ap);
+  if (rso->mol_list == NULL && rso->mol_file == NULL) {
     if (trigger_unimolecular(state->reaction_hash, state->rx_hashsize,
                              rso->mol_type->hashval, ap) != NULL ||
         (rso->mol_type->flags & CAN_SURFWALL) != 0)
       ap->flags |= ACT_REACT;
-    if (ap->get_space_step(ap) > 0.0)
+    if (get_space_step(ap) > 0.0)
       ap->flags |= ACT_DIFFUSE;
   }
 
@@ -1385,7 +2161,7 @@ int release_molecules(struct volume *state, struct release_event_queue *req) {
     vm.previous_wall = NULL;
     vm.index = -1;
 
-    if (rso->mol_list != NULL) {
+    if (rso->mol_list != NULL || rso->mol_file != NULL) {
       if (release_by_list(state, req, &vm)) {
         return 1;
       }
@@ -1407,15 +2183,18 @@ int release_molecules(struct volume *state, struct release_event_queue *req) {
       vm.pos.y = location[0][1];
       vm.pos.z = location[0][2];
 
+      struct release_batch batch;
+      init_release_batch(&batch);
       struct volume_molecule *vm_guess = NULL;
       for (int i = 0; i < number; i++) {
-        vm_guess = insert_volume_molecule(state, &vm, vm_guess);
-        if (vm_guess == NULL)
+        vm_guess = release_volume_molecule(state, &vm, vm_guess, &batch);
+        if (vm_guess == NULL) {
+          flush_release_batch(&batch);
           return 1;
-        vm.periodic_box->x = rso->periodic_box->x;
-        vm.periodic_box->y = rso->periodic_box->y;
-        vm.periodic_box->z = rso->periodic_box->z;
+        }
+        vm.periodic_box = *rso->periodic_box;
       }
+      flush_release_batch(&batch);
       if (state->notify->release_events == NOTIFY_FULL) {
         mcell_log("Released %d %s from \"%s\" at iteration %lld.", number,
                   rso->mol_type->sym->name, rso->name, state->current_iterations);
@@ -1423,107 +2202,525 @@ int release_molecules(struct volume *state, struct release_event_queue *req) {
     }
   }
 
-  /* Schedule next release event. */
-  if (!distinguishable(rso->release_prob, MAGIC_PATTERN_PROBABILITY, EPS_C))
-    return 0; /* Triggered by reaction, don't schedule */
-  req->event_time += rpat->release_interval;
-
-  /* we may need to move to the next train. */
-  if (!distinguishable(req->event_time,
-                       req->train_high_time + rpat->train_duration, EPS_C) ||
-      req->event_time > req->train_high_time + rpat->train_duration) {
-    req->train_high_time += rpat->train_interval;
-    req->event_time = req->train_high_time;
-    req->train_counter++;
+  release_graph_data(ap->graph_data);
+
+  /* Schedule next release event. */
+  if (!distinguishable(rso->release_prob, MAGIC_PATTERN_PROBABILITY, EPS_C))
+    return 0; /* Triggered by reaction, don't schedule */
+  req->event_time += rpat->release_interval;
+
+  /* we may need to move to the next train. */
+  if (!distinguishable(req->event_time,
+                       req->train_high_time + rpat->train_duration, EPS_C) ||
+      req->event_time > req->train_high_time + rpat->train_duration) {
+    req->train_high_time += rpat->train_interval;
+    req->event_time = req->train_high_time;
+    req->train_counter++;
+  }
+
+  if (req->train_counter <= rpat->number_of_trains &&
+      req->event_time < FOREVER) {
+    if (schedule_add(state->releaser, req))
+      mcell_allocfailed("Failed to add release request to scheduler.");
+  }
+  else {
+    free(req);
+  }
+
+  return 0;
+}
+
+/*************************************************************************
+pick_release_site_point:
+  In: state: MCell simulation state
+      rso: release site with a location and, unless it releases at a
+           point, a diameter
+      t_matrix: transform placing the release site
+      pos: set to the picked point
+  Out: No return value.  For CUBIC, SPHERICAL and SPHERICAL_SHELL sites a
+       point is drawn uniformly from the shape.
+*************************************************************************/
+static void pick_release_site_point(struct volume *state,
+                                    struct release_site_obj *rso,
+                                    double (*t_matrix)[4],
+                                    struct vector3 *pos) {
+  double location[1][4];
+  if (rso->diameter == NULL) {
+    location[0][0] = rso->location->x;
+    location[0][1] = rso->location->y;
+    location[0][2] = rso->location->z;
+  } else {
+    const int is_spheroidal = (rso->release_shape == SHAPE_SPHERICAL ||
+                               rso->release_shape == SHAPE_ELLIPTIC ||
+                               rso->release_shape == SHAPE_SPHERICAL_SHELL);
+    struct vector3 p;
+    do /* Pick values in unit square, toss if not in unit circle */
+    {
+      double u[3];
+      rng_dbl_n(state->rng, u, 3);
+      p.x = (u[0] - 0.5);
+      p.y = (u[1] - 0.5);
+      p.z = (u[2] - 0.5);
+    } while (is_spheroidal && p.x * p.x + p.y * p.y + p.z * p.z >= 0.25);
+
+    if (rso->release_shape == SHAPE_SPHERICAL_SHELL) {
+      double r = sqrt(p.x * p.x + p.y * p.y + p.z * p.z) * 2.0;
+      if (r == 0.0) {
+        p.x = 0.0;
+        p.y = 0.0;
+        p.z = 0.5;
+      } else {
+        p.x /= r;
+        p.y /= r;
+        p.z /= r;
+      }
+    }
+
+    struct vector3 *diam_xyz = rso->diameter;
+    location[0][0] = p.x * diam_xyz->x + rso->location->x;
+    location[0][1] = p.y * diam_xyz->y + rso->location->y;
+    location[0][2] = p.z * diam_xyz->z + rso->location->z;
+  }
+  location[0][3] = 1;
+
+  mult_matrix(location, t_matrix, location, 1, 4, 4);
+
+  pos->x = location[0][0];
+  pos->y = location[0][1];
+  pos->z = location[0][2];
+}
+
+/*************************************************************************
+ release_ellipsoid_or_rectcuboid:
+    This function is used for CUBIC (aka RECTANGULAR), SPHERICAL (aka
+    ELLIPTICAL), and SPHERICAL_SHELL release sites.
+
+  In: state: MCell simulation state
+      req:
+      vm: volume molecule being released
+      number: number to release
+  Out: 0 on success, 1 on failure
+*************************************************************************/
+int release_ellipsoid_or_rectcuboid(struct volume *state,
+                                    struct release_event_queue *req,
+                                    struct volume_molecule *vm, int number) {
+
+  struct release_site_obj *rso = req->release_site;
+
+  /* Counting a molecule as it is placed may draw random numbers, so only
+   * molecules which aren't counted that way can all be picked first. */
+  struct staged_release sr = { NULL, 0, 0 };
+  if (number > 1 &&
+      (vm->properties->flags & (COUNT_CONTENTS | COUNT_ENCLOSED)) == 0) {
+    sr.max = (number < STAGED_RELEASE_SIZE) ? number : STAGED_RELEASE_SIZE;
+    sr.mols = CHECKED_MALLOC_ARRAY(struct staged_molecule, sr.max,
+                                   "staged release");
+  }
+
+  struct release_batch batch;
+  init_release_batch(&batch);
+  for (int i = 0; i < number; i++) {
+    pick_release_site_point(state, rso, req->t_matrix, &vm->pos);
+    struct volume_molecule *guess = NULL;
+    /* Insert copy of vm into state */
+    vm->periodic_box = *rso->periodic_box;
+    if (sr.mols != NULL) {
+      stage_volume_molecule(state, &sr, vm);
+      if (sr.n == sr.max && place_staged_molecules(state, &sr, vm, &batch)) {
+        flush_release_batch(&batch);
+        free(sr.mols);
+        return 1;
+      }
+      continue;
+    }
+    guess = release_volume_molecule(state, vm, guess, &batch);
+    if (guess == NULL) {
+      flush_release_batch(&batch);
+      return 1;
+    }
+  }
+  if (sr.mols != NULL) {
+    int failed = place_staged_molecules(state, &sr, vm, &batch);
+    free(sr.mols);
+    if (failed) {
+      flush_release_batch(&batch);
+      return 1;
+    }
+  }
+  flush_release_batch(&batch);
+  if (state->notify->release_events == NOTIFY_FULL) {
+    mcell_log("Released %d %s from \"%s\" at iteration %lld.", number,
+              rso->mol_type->sym->name, rso->name, state->current_iterations);
+  }
+  return 0;
+}
+
+/*************************************************************************
+queue_triggered_release:
+  In: state: MCell simulation state
+      req: release event set up by a reaction, with its release site, time
+           and transform
+  Out: No return value.  The release is placed by the next call to
+       flush_triggered_releases, together with the other firings of the
+       same release site.
+*************************************************************************/
+void queue_triggered_release(struct volume *state,
+                             struct release_event_queue *req) {
+  struct triggered_release_queue *q = state->triggered_releases;
+  if (q->n == q->max) {
+    int max = (q->max == 0) ? 64 : 2 * q->max;
+    struct triggered_release *events = (struct triggered_release *)realloc(
+        q->events, max * sizeof(struct triggered_release));
+    if (events == NULL)
+      mcell_allocfailed("Failed to grow the reaction-triggered release queue.");
+    q->events = events;
+    q->max = max;
+  }
+  struct triggered_release *ev = &q->events[q->n];
+  ev->release_site = req->release_site;
+  ev->event_time = req->event_time;
+  memcpy(ev->t_matrix, req->t_matrix, sizeof(ev->t_matrix));
+  ev->order = q->n++;
+}
+
+/* qsort ordering: grouped by release site, in firing order within each */
+static int compare_triggered_releases(void const *a, void const *b) {
+  struct triggered_release const *ea = (struct triggered_release const *)a;
+  struct triggered_release const *eb = (struct triggered_release const *)b;
+  uintptr_t ra = (uintptr_t)ea->release_site;
+  uintptr_t rb = (uintptr_t)eb->release_site;
+  if (ra != rb)
+    return (ra < rb) ? -1 : 1;
+  return ea->order - eb->order;
+}
+
+/* A run of queued firings of one release site */
+struct triggered_group {
+  int start;
+  int n;
+  int first; /* Queue position of the earliest firing */
+};
+
+static int compare_triggered_groups(void const *a, void const *b) {
+  return ((struct triggered_group const *)a)->first -
+         ((struct triggered_group const *)b)->first;
+}
+
+/*************************************************************************
+release_triggered_group:
+  In: state: MCell simulation state
+      events: firings of one release site, in firing order
+      n: number of firings
+  Out: 0 on success, 1 on failure.  Free volume molecules released at a
+       point or from a CUBIC or SPHERICAL site are all staged and placed as
+       one release, each with the time of its own firing; other release
+       sites are run once per firing.
+*************************************************************************/
+static int release_triggered_group(struct volume *state,
+                                   struct triggered_release *events, int n) {
+  struct release_site_obj *rso = events[0].release_site;
+  if (n == 1 || rso->release_shape == SHAPE_REGION || rso->mol_list != NULL ||
+      (rso->mol_type->flags &
+       (NOT_FREE | EXTERNAL_SPECIES | COUNT_CONTENTS | COUNT_ENCLOSED)) != 0) {
+    for (int i = 0; i < n; i++) {
+      struct release_event_queue req;
+      req.next = NULL;
+      req.release_site = rso;
+      req.event_time = events[i].event_time;
+      req.train_counter = 0;
+      req.train_high_time = events[i].event_time;
+      memcpy(req.t_matrix, events[i].t_matrix, sizeof(req.t_matrix));
+      if (release_molecules(state, &req))
+        return 1;
+    }
+    return 0;
+  }
+
+  /* Set up canonical molecule to be released, as release_molecules does */
+  struct volume_molecule vm;
+  memset(&vm, 0, sizeof(struct volume_molecule));
+  vm.flags = TYPE_VOL | IN_VOLUME | IN_SCHEDULE | ACT_NEWBIE;
+  vm.properties = rso->mol_type;
+  vm.periodic_box = *rso->periodic_box;
+  vm.previous_wall = NULL;
+  vm.index = -1;
+  struct abstract_molecule *ap = (struct abstract_molecule *)(&vm);
+  if (trigger_unimolecular(state->reaction_hash, state->rx_hashsize,
+                           rso->mol_type->hashval, ap) != NULL ||
+      (rso->mol_type->flags & CAN_SURFWALL) != 0)
+    ap->flags |= ACT_REACT;
+  if (get_space_step(ap) > 0.0)
+    ap->flags |= ACT_DIFFUSE;
+
+  int *numbers = CHECKED_MALLOC_ARRAY(int, n, "triggered release numbers");
+  long long total = 0;
+  for (int i = 0; i < n; i++) {
+    numbers[i] = calculate_number_to_release(rso, state);
+    if (numbers[i] > 0)
+      total += numbers[i];
   }
 
-  if (req->train_counter <= rpat->number_of_trains &&
-      req->event_time < FOREVER) {
-    if (schedule_add(state->releaser, req))
-      mcell_allocfailed("Failed to add release request to scheduler.");
+  struct staged_release sr = { NULL, 0, 0 };
+  sr.max = (total < STAGED_RELEASE_SIZE) ? (int)total : STAGED_RELEASE_SIZE;
+  if (sr.max > 0)
+    sr.mols = CHECKED_MALLOC_ARRAY(struct staged_molecule, sr.max,
+                                   "staged release");
+
+  struct release_batch batch;
+  init_release_batch(&batch);
+  int status = 0;
+  for (int i = 0; i < n && status == 0; i++) {
+    vm.t = events[i].event_time;
+    vm.birthday = convert_iterations_to_seconds(
+        state->start_iterations, state->time_unit,
+        state->simulation_start_seconds, vm.t);
+    for (int j = 0; j < numbers[i]; j++) {
+      pick_release_site_point(state, rso, events[i].t_matrix, &vm.pos);
+      stage_volume_molecule(state, &sr, &vm);
+      if (sr.n == sr.max && place_staged_molecules(state, &sr, &vm, &batch)) {
+        status = 1;
+        break;
+      }
+    }
   }
-  else {
-    free(req);
+  if (status == 0 && sr.n > 0)
+    status = place_staged_molecules(state, &sr, &vm, &batch);
+  flush_release_batch(&batch);
+  free(sr.mols);
+  free(numbers);
+
+  if (status == 0 && state->notify->release_events == NOTIFY_FULL) {
+    mcell_log("Released %lld %s from \"%s\" (%d reactions) at iteration %lld.",
+              total, rso->mol_type->sym->name, rso->name, n,
+              state->current_iterations);
   }
+  return status;
+}
 
-  return 0;
+/*************************************************************************
+flush_triggered_releases:
+  In: state: MCell simulation state
+  Out: 0 on success, 1 on failure.  The releases queued by reactions since
+       the last call are placed, one release per release site in the order
+       the sites first fired, and the queue is emptied.  The molecules are
+       scheduled at the times of their reactions, so the current pass over
+       the storages picks them up.
+*************************************************************************/
+int flush_triggered_releases(struct volume *state) {
+  struct triggered_release_queue *q = state->triggered_releases;
+  if (q == NULL || q->n == 0)
+    return 0;
+
+  qsort(q->events, q->n, sizeof(struct triggered_release),
+        compare_triggered_releases);
+
+  int n_groups = 0;
+  for (int i = 0; i < q->n; i++)
+    if (i == 0 || q->events[i].release_site != q->events[i - 1].release_site)
+      n_groups++;
+  struct triggered_group *groups = CHECKED_MALLOC_ARRAY(
+      struct triggered_group, n_groups, "triggered release groups");
+  n_groups = 0;
+  for (int i = 0; i < q->n; i++) {
+    if (i == 0 || q->events[i].release_site != q->events[i - 1].release_site) {
+      groups[n_groups].start = i;
+      groups[n_groups].n = 0;
+      groups[n_groups].first = q->events[i].order;
+      n_groups++;
+    }
+    groups[n_groups - 1].n++;
+  }
+  /* Draw from the random stream in an order which doesn't depend on where
+   * the release sites were allocated */
+  qsort(groups, n_groups, sizeof(struct triggered_group),
+        compare_triggered_groups);
+
+  int status = 0;
+  for (int g = 0; g < n_groups && status == 0; g++)
+    status = release_triggered_group(state, q->events + groups[g].start,
+                                     groups[g].n);
+  free(groups);
+  q->n = 0;
+  return status;
 }
 
 /*************************************************************************
- release_ellipsoid_or_rectcuboid:
-    This function is used for CUBIC (aka RECTANGULAR), SPHERICAL (aka
-    ELLIPTICAL), and SPHERICAL_SHELL release sites.
+release_list_molecule:
+    Releases one molecule of a LIST release site.
 
   In: state: MCell simulation state
-      req:
-      vm: volume molecule being released
-      number: number to release
+      req: the release event
+      vm: volume molecule to release it as, if it is a volume molecule
+      spec: species of the molecule
+      loc: its position relative to the release site's location
+      list_orient: its orientation, if it is a surface molecule (>0 up,
+                   <0 down, 0 random)
+      sr: staged release that volume molecules may be added to
+      batch: batch which will schedule the new molecules
+      n_released: counts the molecules released
+      n_failed: counts the surface molecules that found no surface
   Out: 0 on success, 1 on failure
 *************************************************************************/
-int release_ellipsoid_or_rectcuboid(struct volume *state,
-                                    struct release_event_queue *req,
-                                    struct volume_molecule *vm, int number) {
-
+static int release_list_molecule(struct volume *state,
+                                 struct release_event_queue *req,
+                                 struct volume_molecule *vm,
+                                 struct species *spec,
+                                 struct vector3 const *loc, int list_orient,
+                                 struct staged_release *sr,
+                                 struct release_batch *batch,
+                                 int *n_released, int *n_failed) {
   struct release_site_obj *rso = req->release_site;
-  struct vector3 *diam_xyz = rso->diameter;
-
-  struct vector3 pos;
-  const int is_spheroidal = (rso->release_shape == SHAPE_SPHERICAL ||
-                             rso->release_shape == SHAPE_ELLIPTIC ||
-                             rso->release_shape == SHAPE_SPHERICAL_SHELL);
+  double location[1][4];
+  location[0][0] = loc->x + rso->location->x;
+  location[0][1] = loc->y + rso->location->y;
+  location[0][2] = loc->z + rso->location->z;
+  location[0][3] = 1;
+
+  mult_matrix(location, req->t_matrix, location, 1, 4, 4);
+
+  vm->pos.x = location[0][0];
+  vm->pos.y = location[0][1];
+  vm->pos.z = location[0][2];
+
+  struct volume_molecule *vm_guess = NULL;
+  if ((spec->flags & NOT_FREE) == 0) {
+    struct abstract_molecule *ap = (struct abstract_molecule *)(vm);
+    vm->properties = spec;
+    // Have to set flags, since insert_volume_molecule doesn't
+    if (trigger_unimolecular(state->reaction_hash, state->rx_hashsize,
+                             ap->properties->hashval, ap) != NULL ||
+        (ap->properties->flags & CAN_SURFWALL) != 0) {
+      ap->flags |= ACT_REACT;
+    }
+    if (get_space_step(vm) > 0.0)
+      ap->flags |= ACT_DIFFUSE;
+    /* Counting a molecule as it is placed may draw random numbers, so
+     * those are placed in list order */
+    if (sr->mols != NULL &&
+        (spec->flags & (COUNT_CONTENTS | COUNT_ENCLOSED)) == 0) {
+      stage_volume_molecule(state, sr, vm);
+      if (sr->n == sr->max && place_staged_molecules(state, sr, vm, batch))
+        return 1;
+      (*n_released)++;
+      return 0;
+    }
+    if (sr->n > 0 && place_staged_molecules(state, sr, vm, batch))
+      return 1;
+    vm_guess = release_volume_molecule(state, vm, vm_guess, batch);
+    if (vm_guess == NULL)
+      return 1;
+    vm_guess->periodic_box = *rso->periodic_box;
+    (*n_released)++;
+  } else {
+    double diam;
+    if (rso->diameter == NULL)
+      diam = 0.0;
+    else
+      diam = rso->diameter->x;
 
-  for (int i = 0; i < number; i++) {
-    do /* Pick values in unit square, toss if not in unit circle */
-    {
-      pos.x = (rng_dbl(state->rng) - 0.5);
-      pos.y = (rng_dbl(state->rng) - 0.5);
-      pos.z = (rng_dbl(state->rng) - 0.5);
-    } while (is_spheroidal &&
-             pos.x * pos.x + pos.y * pos.y + pos.z * pos.z >= 0.25);
+    short orient;
+    if (list_orient > 0)
+      orient = 1;
+    else if (list_orient < 0)
+      orient = -1;
+    else {
+      orient = (rng_uint(state->rng) & 1) ? 1 : -1;
+    }
 
-    if (rso->release_shape == SHAPE_SPHERICAL_SHELL) {
-      double r = sqrt(pos.x * pos.x + pos.y * pos.y + pos.z * pos.z) * 2.0;
-      if (r == 0.0) {
-        pos.x = 0.0;
-        pos.y = 0.0;
-        pos.z = 0.5;
-      } else {
-        pos.x /= r;
-        pos.y /= r;
-        pos.z /= r;
-      }
+    // Keep the scheduling order of mixed volume/surface lists
+    if (sr->n > 0 && place_staged_molecules(state, sr, vm, batch))
+      return 1;
+    flush_release_batch(batch);
+
+    // Don't have to set flags, insert_surface_molecule takes care of it
+    struct surface_molecule *sm;
+    sm = insert_surface_molecule(state, spec, &vm->pos, orient, diam,
+                                 req->event_time, NULL, NULL, NULL,
+                                 rso->periodic_box);
+    if (sm == NULL) {
+      mcell_warn("Molecule release is unable to find surface upon which "
+                 "to place molecule %s.\n"
+                 "  This could be caused by too small of a SITE_DIAMETER "
+                 "on the release site '%s'.",
+                 spec->sym->name, rso->name);
+      (*n_failed)++;
+    } else {
+      (*n_released)++;
     }
+  }
+  return 0;
+}
 
-    double location[1][4];
-    location[0][0] = pos.x * diam_xyz->x + rso->location->x;
-    location[0][1] = pos.y * diam_xyz->y + rso->location->y;
-    location[0][2] = pos.z * diam_xyz->z + rso->location->z;
-    location[0][3] = 1;
+/* Records of a release list file read at a time */
+#define RELEASE_LIST_CHUNK 4096
 
-    mult_matrix(location, req->t_matrix, location, 1, 4, 4);
+/*************************************************************************
+release_list_file:
+    Releases the molecules of the release list file of a LIST release site,
+    a chunk of records at a time.
 
-    vm->pos.x = location[0][0];
-    vm->pos.y = location[0][1];
-    vm->pos.z = location[0][2];
-    struct volume_molecule *guess = NULL;
-    /* Insert copy of vm into state */
-    vm->periodic_box->x = rso->periodic_box->x;
-    vm->periodic_box->y = rso->periodic_box->y;
-    vm->periodic_box->z = rso->periodic_box->z;
-    guess = insert_volume_molecule(state, vm, guess); 
-    if (guess == NULL)
-      return 1;
+  In: state: MCell simulation state
+      req: the release event
+      vm: volume molecule to release volume molecules as
+      sr, batch, n_released, n_failed: as for release_list_molecule
+  Out: 0 on success, 1 on failure
+*************************************************************************/
+static int release_list_file(struct volume *state,
+                             struct release_event_queue *req,
+                             struct volume_molecule *vm,
+                             struct staged_release *sr,
+                             struct release_batch *batch, int *n_released,
+                             int *n_failed) {
+  struct release_list_file *rlf = req->release_site->mol_file;
+  FILE *f = fopen(rlf->path, "rb");
+  if (f == NULL || fseek(f, rlf->data_offset, SEEK_SET) != 0) {
+    mcell_perror_nodie(errno, "Failed to read release list file '%s'",
+                       rlf->path);
+    if (f != NULL)
+      fclose(f);
+    return 1;
   }
-  if (state->notify->release_events == NOTIFY_FULL) {
-    mcell_log("Released %d %s from \"%s\" at iteration %lld.", number,
-              rso->mol_type->sym->name, rso->name, state->current_iterations);
+
+  struct release_list_record *records = CHECKED_MALLOC_ARRAY(
+      struct release_list_record, RELEASE_LIST_CHUNK, "release list records");
+  int err = 0;
+  long long n_left = rlf->n_mols;
+  while (n_left > 0 && !err) {
+    size_t n = (n_left < RELEASE_LIST_CHUNK) ? (size_t)n_left
+                                             : RELEASE_LIST_CHUNK;
+    if (fread(records, sizeof(struct release_list_record), n, f) != n) {
+      mcell_error_nodie("Release list file '%s' ends before its %lld "
+                        "molecules.", rlf->path, rlf->n_mols);
+      err = 1;
+      break;
+    }
+    for (size_t k = 0; k < n && !err; k++) {
+      struct release_list_record const *r = &records[k];
+      if (r->species >= (uint32_t)rlf->n_species) {
+        mcell_error_nodie("Release list file '%s' has a molecule of unknown "
+                          "species %u.", rlf->path, r->species);
+        err = 1;
+        break;
+      }
+      struct vector3 loc = { r->pos[0] * state->r_length_unit,
+                             r->pos[1] * state->r_length_unit,
+                             r->pos[2] * state->r_length_unit };
+      err = release_list_molecule(state, req, vm, rlf->species[r->species],
+                                  &loc, r->orient, sr, batch, n_released,
+                                  n_failed);
+    }
+    n_left -= (long long)n;
   }
-  return 0;
+  free(records);
+  fclose(f);
+  return err;
 }
 
 /*************************************************************************
 release_by_list:
-    This function is used for LIST based release sites.
+    This function is used for LIST based release sites.  The molecules
+    listed in the MDL are released first, then those of the site's release
+    list file.
 
   In: state: MCell simulation state
       req:
@@ -1538,83 +2735,152 @@ int release_by_list(struct volume *state, struct release_event_queue *req,
 
   struct release_site_obj *rso = req->release_site;
   struct release_single_molecule *rsm = rso->mol_list;
+  struct release_batch batch;
+  init_release_batch(&batch);
+
+  struct staged_release sr = { NULL, 0, 0 };
+  for (; rsm != NULL && sr.max < STAGED_RELEASE_SIZE; rsm = rsm->next)
+    sr.max++;
+  if (rso->mol_file != NULL)
+    sr.max += (int)((rso->mol_file->n_mols < STAGED_RELEASE_SIZE - sr.max)
+                        ? rso->mol_file->n_mols
+                        : STAGED_RELEASE_SIZE - sr.max);
+  if (sr.max > 1)
+    sr.mols = CHECKED_MALLOC_ARRAY(struct staged_molecule, sr.max,
+                                   "staged release");
+
+  for (rsm = rso->mol_list; rsm != NULL; rsm = rsm->next) {
+    if (release_list_molecule(state, req, vm, rsm->mol_type, &rsm->loc,
+                              rsm->orient, &sr, &batch, &i, &i_failed))
+      goto failure;
+  }
+  if (rso->mol_file != NULL &&
+      release_list_file(state, req, vm, &sr, &batch, &i, &i_failed))
+    goto failure;
+  if (sr.n > 0 && place_staged_molecules(state, &sr, vm, &batch))
+    goto failure;
+  flush_release_batch(&batch);
+  free(sr.mols);
+  if (state->notify->release_events == NOTIFY_FULL) {
+    mcell_log("Released %d molecules from list \"%s\" at iteration %lld.", i,
+              rso->name, state->current_iterations);
+  }
+  if (i_failed > 0)
+    mcell_warn("Failed to release %d molecules from list \"%s\" at "
+               "iteration %lld.",
+               i_failed, rso->name, state->current_iterations);
+
+  return 0;
+
+failure:
+  flush_release_batch(&batch);
+  free(sr.mols);
+  return 1;
+}
+
+/*************************************************************************
+release_molecule_array:
+    Places molecules of one species at the given positions right away,
+    without a release site.  Volume molecules go through the same staging
+    and batched scheduling as LIST releases, so they are created in the
+    same order as if they had been listed one by one.
+
+  In: state: MCell simulation state
+      spec: species to release
+      xyz: x, y, z of each molecule, in microns
+      orient: orientation of each surface molecule (>0 up, <0 down, 0 or
+              NULL random); ignored for volume molecules
+      n: number of molecules
+      diam: distance to search for a surface to place surface molecules on
+  Out: 0 on success, 1 on failure.  Surface molecules that find no surface
+       are skipped with a warning.
+*************************************************************************/
+int release_molecule_array(struct volume *state, struct species *spec,
+                           const double *xyz, const int *orient, int n,
+                           double diam) {
+  struct volume_molecule vm;
+  memset(&vm, 0, sizeof(struct volume_molecule));
+  vm.flags = TYPE_VOL | IN_VOLUME | IN_SCHEDULE | ACT_NEWBIE;
+  vm.t = (double)state->current_iterations;
+  vm.properties = spec;
+  vm.birthday = convert_iterations_to_seconds(
+      state->start_iterations, state->time_unit,
+      state->simulation_start_seconds, vm.t);
+  struct periodic_image periodic_box = { .x = 0, .y = 0, .z = 0 };
+  vm.periodic_box = periodic_box;
+  vm.previous_wall = NULL;
+  vm.index = -1;
+
+  int is_volume = ((spec->flags & NOT_FREE) == 0);
+  if (is_volume) {
+    struct abstract_molecule *ap = (struct abstract_molecule *)(&vm);
+    if (trigger_unimolecular(state->reaction_hash, state->rx_hashsize,
+                             spec->hashval, ap) != NULL ||
+        (spec->flags & CAN_SURFWALL) != 0)
+      ap->flags |= ACT_REACT;
+    if (get_space_step(ap) > 0.0)
+      ap->flags |= ACT_DIFFUSE;
+  }
+
+  struct release_batch batch;
+  init_release_batch(&batch);
+  struct staged_release sr = { NULL, 0, 0 };
+  if (is_volume && (spec->flags & (COUNT_CONTENTS | COUNT_ENCLOSED)) == 0) {
+    sr.max = (n < STAGED_RELEASE_SIZE) ? n : STAGED_RELEASE_SIZE;
+    if (sr.max > 1)
+      sr.mols = CHECKED_MALLOC_ARRAY(struct staged_molecule, sr.max,
+                                     "staged release");
+  }
 
-  for (; rsm != NULL; rsm = rsm->next) {
-    double location[1][4];
-    location[0][0] = rsm->loc.x + rso->location->x;
-    location[0][1] = rsm->loc.y + rso->location->y;
-    location[0][2] = rsm->loc.z + rso->location->z;
-    location[0][3] = 1;
-
-    mult_matrix(location, req->t_matrix, location, 1, 4, 4);
-
-    vm->pos.x = location[0][0];
-    vm->pos.y = location[0][1];
-    vm->pos.z = location[0][2];
-
-    struct volume_molecule *vm_guess = NULL;
-    if ((rsm->mol_type->flags & NOT_FREE) == 0) {
-      struct abstract_molecule *ap = (struct abstract_molecule *)(vm);
-      vm->properties = rsm->mol_type;
-      initialize_diffusion_function(ap);
-      // Have to set flags, since insert_volume_molecule doesn't
-      if (trigger_unimolecular(state->reaction_hash, state->rx_hashsize,
-                               ap->properties->hashval, ap) != NULL ||
-          (ap->properties->flags & CAN_SURFWALL) != 0) {
-        ap->flags |= ACT_REACT;
+  int i_failed = 0;
+  struct volume_molecule *vm_guess = NULL;
+  for (int i = 0; i < n; i++) {
+    vm.pos.x = xyz[3 * i] * state->r_length_unit;
+    vm.pos.y = xyz[3 * i + 1] * state->r_length_unit;
+    vm.pos.z = xyz[3 * i + 2] * state->r_length_unit;
+
+    if (is_volume) {
+      if (sr.mols != NULL) {
+        stage_volume_molecule(state, &sr, &vm);
+        if (sr.n == sr.max && place_staged_molecules(state, &sr, &vm, &batch))
+          goto failure;
+        continue;
       }
-      if (vm->get_space_step(vm) > 0.0)
-        ap->flags |= ACT_DIFFUSE;
-      vm_guess = insert_volume_molecule(state, vm, vm_guess);
+      vm_guess = release_volume_molecule(state, &vm, vm_guess, &batch);
       if (vm_guess == NULL)
-        return 1;
-      vm_guess->periodic_box->x = rso->periodic_box->x;
-      vm_guess->periodic_box->y = rso->periodic_box->y;
-      vm_guess->periodic_box->z = rso->periodic_box->z;
-      i++;
+        goto failure;
     } else {
-      double diam;
-      if (rso->diameter == NULL)
-        diam = 0.0;
+      short o;
+      if (orient != NULL && orient[i] > 0)
+        o = 1;
+      else if (orient != NULL && orient[i] < 0)
+        o = -1;
       else
-        diam = rso->diameter->x;
-
-      short orient;
-      if (rsm->orient > 0)
-        orient = 1;
-      else if (rsm->orient < 0)
-        orient = -1;
-      else {
-        orient = (rng_uint(state->rng) & 1) ? 1 : -1;
-      }
+        o = (rng_uint(state->rng) & 1) ? 1 : -1;
 
-      // Don't have to set flags, insert_surface_molecule takes care of it
-      struct surface_molecule *sm;
-      sm = insert_surface_molecule(state, rsm->mol_type, &vm->pos, orient,
-                                   diam, req->event_time, NULL, NULL, NULL,
-                                   rso->periodic_box);
-      if (sm == NULL) {
-        mcell_warn("Molecule release is unable to find surface upon which "
-                   "to place molecule %s.\n"
-                   "  This could be caused by too small of a SITE_DIAMETER "
-                   "on the release site '%s'.",
-                   rsm->mol_type->sym->name, rso->name);
+      if (insert_surface_molecule(state, spec, &vm.pos, o, diam, vm.t, NULL,
+                                  NULL, NULL, &periodic_box) == NULL)
         i_failed++;
-      } else {
-        i++;
-      }
     }
   }
+  if (sr.n > 0 && place_staged_molecules(state, &sr, &vm, &batch))
+    goto failure;
+  flush_release_batch(&batch);
+  free(sr.mols);
   if (state->notify->release_events == NOTIFY_FULL) {
-    mcell_log("Released %d molecules from list \"%s\" at iteration %lld.", i,
-              rso->name, state->current_iterations);
+    mcell_log("Released %d %s at iteration %lld.", n - i_failed,
+              spec->sym->name, state->current_iterations);
   }
   if (i_failed > 0)
-    mcell_warn("Failed to release %d molecules from list \"%s\" at "
-               "iteration %lld.",
-               i_failed, rso->name, state->current_iterations);
+    mcell_warn("Failed to find a surface to place %d %s at iteration %lld.",
+               i_failed, spec->sym->name, state->current_iterations);
 
   return 0;
+
+failure:
+  flush_release_batch(&batch);
+  free(sr.mols);
+  return 1;
 }
 
 /*************************************************************************
@@ -1815,6 +3081,17 @@ int set_partitions(struct volume *state) {
     set_user_partitions(state, dfx, dfy, dfz);
   }
 
+  if (state->adaptive_partitions && refine_partitions(state, smallest_spacing))
+    return 1;
+
+  if (build_partition_lookup(&state->x_lookup, state->x_partitions,
+                             state->nx_parts) ||
+      build_partition_lookup(&state->y_lookup, state->y_partitions,
+                             state->ny_parts) ||
+      build_partition_lookup(&state->z_lookup, state->z_partitions,
+                             state->nz_parts))
+    return 1;
+
   /* And finally we tell the user what happened */
   if (state->notify->partition_location == NOTIFY_FULL) {
     mcell_log_raw("X partitions: ");
@@ -1837,6 +3114,185 @@ int set_partitions(struct volume *state) {
   return 0;
 }
 
+/*************************************************************************
+density_below:
+  In: cum: cumulative histogram (n_bins + 1 entries, cum[0] == 0)
+      n_bins: number of bins
+      lo, hi: range covered by the histogram
+      x: position
+  Out: The amount of density below x, interpolating linearly within bins.
+*************************************************************************/
+static double density_below(double const *cum, int n_bins, double lo,
+                            double hi, double x) {
+  if (x <= lo)
+    return 0.0;
+  if (x >= hi)
+    return cum[n_bins];
+  double f = (x - lo) / (hi - lo) * n_bins;
+  int i = (int)f;
+  if (i >= n_bins)
+    return cum[n_bins];
+  return cum[i] + (f - i) * (cum[i + 1] - cum[i]);
+}
+
+/*************************************************************************
+density_position:
+  In: cum: cumulative histogram (n_bins + 1 entries, cum[0] == 0)
+      n_bins: number of bins
+      lo, hi: range covered by the histogram
+      m: amount of density
+  Out: The position below which there is m density; the inverse of
+       density_below.
+*************************************************************************/
+static double density_position(double const *cum, int n_bins, double lo,
+                               double hi, double m) {
+  int i = 0;
+  while (i < n_bins - 1 && cum[i + 1] < m)
+    i++;
+  double in_bin = cum[i + 1] - cum[i];
+  double f = (in_bin > 0.0) ? (m - cum[i]) / in_bin : 0.5;
+  if (f < 0.0)
+    f = 0.0;
+  else if (f > 1.0)
+    f = 1.0;
+  return lo + (i + f) * (hi - lo) / n_bins;
+}
+
+/*************************************************************************
+refine_axis:
+  In: partitions: coarse partitions along one axis
+      n_parts: number of coarse partitions (updated)
+      fineparts: fine partitions along the same axis
+      n_fineparts: number of fine partitions
+      cum: cumulative density histogram along the axis
+      n_bins: number of bins of the histogram
+      lo, hi: range covered by the histogram
+      min_spacing: smallest allowed distance between partitions
+  Out: The (possibly reallocated) partitions, or NULL on memory allocation
+       failure.  The partition with the most density is split at its median,
+       snapped to a fine partition, for as long as it holds more than
+       ADAPTIVE_PART_CROWDING times the mean and can be split without
+       getting narrower than min_spacing.
+*************************************************************************/
+static double *refine_axis(double *partitions, int *n_parts, double *fineparts,
+                           int n_fineparts, double const *cum, int n_bins,
+                           double lo, double hi, double min_spacing) {
+  double total = cum[n_bins];
+  if (!(hi > lo) || total <= 0.0 || *n_parts >= ADAPTIVE_PART_MAX_PER_AXIS)
+    return partitions;
+
+  double *parts =
+      CHECKED_MALLOC_ARRAY_NODIE(double, ADAPTIVE_PART_MAX_PER_AXIS,
+                                 "adaptive partitions");
+  if (parts == NULL)
+    return NULL;
+  int n = *n_parts;
+  memcpy(parts, partitions, n * sizeof(double));
+  /* Partitions that turned out not to be splittable */
+  char frozen[ADAPTIVE_PART_MAX_PER_AXIS];
+  memset(frozen, 0, sizeof(frozen));
+
+  while (n < ADAPTIVE_PART_MAX_PER_AXIS) {
+    int best = -1;
+    double best_mass = 0.0;
+    for (int i = 0; i < n - 1; i++) {
+      if (frozen[i] || parts[i + 1] - parts[i] < 2 * min_spacing)
+        continue;
+      double mass = density_below(cum, n_bins, lo, hi, parts[i + 1]) -
+                    density_below(cum, n_bins, lo, hi, parts[i]);
+      if (mass > best_mass) {
+        best_mass = mass;
+        best = i;
+      }
+    }
+    if (best < 0 || best_mass <= ADAPTIVE_PART_CROWDING * total / (n - 1))
+      break;
+
+    double a = parts[best];
+    double b = parts[best + 1];
+    double x = density_position(
+        cum, n_bins, lo, hi,
+        density_below(cum, n_bins, lo, hi, a) + 0.5 * best_mass);
+    if (x < a + min_spacing)
+      x = a + min_spacing;
+    else if (x > b - min_spacing)
+      x = b - min_spacing;
+    x = fineparts[bisect_near(fineparts, n_fineparts, x)];
+    if (x - a < min_spacing || b - x < min_spacing) {
+      frozen[best] = 1;
+      continue;
+    }
+
+    memmove(&parts[best + 2], &parts[best + 1],
+            (n - best - 1) * sizeof(double));
+    memmove(&frozen[best + 2], &frozen[best + 1], n - best - 1);
+    parts[best + 1] = x;
+    frozen[best + 1] = 0;
+    n++;
+  }
+
+  free(partitions);
+  *n_parts = n;
+  return parts;
+}
+
+/*************************************************************************
+refine_partitions:
+  In: state: simulation state, with coarse and fine partitions set
+      min_spacing: smallest allowed distance between partitions
+  Out: 0 on success, 1 on memory allocation failure.  Coarse partitions in
+       regions crowded with walls or released molecules are subdivided along
+       the fine partitions, so that a small, dense part of the world gets
+       small subvolumes without making those of the rest of it any smaller
+       than needed.  The subvolume grid stays rectilinear, so a split along
+       one axis is shared by every subvolume in that slab.
+*************************************************************************/
+int refine_partitions(struct volume *state, double min_spacing) {
+  int n_bins = ADAPTIVE_PART_BINS;
+  double *hist = CHECKED_MALLOC_ARRAY_NODIE(double, 3 * n_bins,
+                                            "partition density");
+  double *cum = CHECKED_MALLOC_ARRAY_NODIE(double, n_bins + 1,
+                                           "partition density");
+  if (hist == NULL || cum == NULL) {
+    free(hist);
+    free(cum);
+    return 1;
+  }
+  compute_partition_density(state, hist, hist + n_bins, hist + 2 * n_bins,
+                            n_bins);
+
+  double *lo[3] = { &state->bb_llf.x, &state->bb_llf.y, &state->bb_llf.z };
+  double *hi[3] = { &state->bb_urb.x, &state->bb_urb.y, &state->bb_urb.z };
+  double **partitions[3] = { &state->x_partitions, &state->y_partitions,
+                             &state->z_partitions };
+  double *fineparts[3] = { state->x_fineparts, state->y_fineparts,
+                           state->z_fineparts };
+  int *n_parts[3] = { &state->nx_parts, &state->ny_parts, &state->nz_parts };
+
+  int err = 0;
+  for (int k = 0; k < 3 && !err; k++) {
+    cum[0] = 0.0;
+    for (int i = 0; i < n_bins; i++)
+      cum[i + 1] = cum[i] + hist[k * n_bins + i];
+
+    double *refined = refine_axis(*partitions[k], n_parts[k], fineparts[k],
+                                  state->n_fineparts, cum, n_bins, *lo[k],
+                                  *hi[k], min_spacing);
+    if (refined == NULL)
+      err = 1;
+    else
+      *partitions[k] = refined;
+  }
+
+  free(hist);
+  free(cum);
+
+  if (!err && state->notify->progress_report != NOTIFY_NONE)
+    mcell_log("Adaptive partitioning: %d x %d x %d subvolumes.",
+              state->nx_parts - 1, state->ny_parts - 1, state->nz_parts - 1);
+  return err;
+}
+
 double increase_fine_partition_size(struct volume *state, double *fineparts,
                                     double *f_min, double *f_max,
                                     double smallest_spacing) {
@@ -2124,31 +3580,13 @@ void path_bounding_box(struct vector3 *loc, struct vector3 *displacement,
       possibly returned to its birthplace.
 ***************************************************************************/
 void collect_molecule(struct volume_molecule *vm) {
-  /* Unlink from the previous item */
-  if (vm->prev_v != NULL) {
-#ifdef DEBUG_LIST_CHECKS
-    if (*vm->prev_v != vm) {
-      mcell_error_nodie("Stale previous pointer!  ACK!  THRBBPPPPT!");
-    }
-#endif
-    *(vm->prev_v) = vm->next_v;
-  }
-
-  /* Unlink from the following item */
-  if (vm->next_v != NULL) {
-#ifdef DEBUG_LIST_CHECKS
-    if (vm->next_v->prev_v != &vm->next_v) {
-      mcell_error_nodie("Stale next pointer!  ACK!  THRBBPPPPT!");
-    }
-#endif
-    vm->next_v->prev_v = vm->prev_v;
-  }
-
-  /* Clear our next/prev pointers */
-  vm->prev_v = NULL;
-  vm->next_v = NULL;
+  /* Unlink from our species list */
+  species_list_remove(vm);
+  mol_id_index_forget(vm->subvol->local_storage->mol_id_index,
+                      (struct abstract_molecule *)vm);
 
   /* Dispose of the molecule */
+  release_molecule_graph((struct abstract_molecule *)vm);
   vm->properties = NULL;
   vm->flags &= ~IN_VOLUME;
   if ((vm->flags & IN_MASK) == 0)
@@ -2190,9 +3628,12 @@ void ht_add_molecule_to_list(struct pointer_hash *h,
           vm->subvol->local_storage->pslv, "per-species molecule list");
       list->properties = vm->properties;
       list->graph_data = vm->graph_data;
+      acquire_graph_data(list->graph_data);
       //list->graph_data->graph_pattern = strdup(vm->graph_data->graph_pattern);
       //list->graph_pattern_hash = vm->graph_pattern_hash;
-      list->head = NULL;
+      list->mols = NULL;
+      list->n_mols = list->max_mols = 0;
+      list->cells = NULL;
       if(vm->graph_data){
         if (pointer_hash_add(h, vm->graph_data->graph_pattern, vm->graph_data->graph_pattern_hash, list))
           mcell_allocfailed("Failed to add species to subvolume species table.");
@@ -2216,7 +3657,9 @@ void ht_add_molecule_to_list(struct pointer_hash *h,
       list = (struct per_species_list *)CHECKED_MEM_GET(
           vm->subvol->local_storage->pslv, "per-species molecule list");
       list->properties = vm->properties;
-      list->head = NULL;
+      list->mols = NULL;
+      list->n_mols = list->max_mols = 0;
+      list->cells = NULL;
       if (pointer_hash_add(h, vm->properties, vm->properties->hashval, list))
         mcell_allocfailed("Failed to add species to subvolume species table.");
 
@@ -2225,12 +3668,227 @@ void ht_add_molecule_to_list(struct pointer_hash *h,
     }
   }
 
-  /* Link the molecule into the list */
-  vm->next_v = list->head;
-  if (list->head)
-    list->head->prev_v = &vm->next_v;
-  vm->prev_v = &list->head;
-  list->head = vm;
+  /* Add the molecule to the list */
+  if (list->n_mols == list->max_mols) {
+    int max_mols = (list->max_mols == 0) ? 8 : 2 * list->max_mols;
+    struct volume_molecule **mols = (struct volume_molecule **)realloc(
+        list->mols, max_mols * sizeof(struct volume_molecule *));
+    if (mols == NULL)
+      mcell_allocfailed("Failed to grow per-species molecule list.");
+    list->mols = mols;
+    list->max_mols = max_mols;
+  }
+  vm->species_list = list;
+  vm->species_index = list->n_mols;
+  list->mols[list->n_mols++] = vm;
+  if (list->cells != NULL)
+    list->cells->stale = 1;
+}
+
+/***************************************************************************
+ species_list_remove:
+    Remove a molecule from the per-species list it is in, if any.  The last
+    molecule of the list takes its place, so this does not preserve the order
+    of the list.
+
+ In: vm: the molecule
+ Out: Nothing.  The molecule is not in any list.
+***************************************************************************/
+void species_list_remove(struct volume_molecule *vm) {
+  struct per_species_list *list = vm->species_list;
+  if (list == NULL)
+    return;
+
+#ifdef DEBUG_LIST_CHECKS
+  if (list->mols[vm->species_index] != vm)
+    mcell_error_nodie("Stale species list index!");
+#endif
+  struct volume_molecule *last = list->mols[--list->n_mols];
+  list->mols[vm->species_index] = last;
+  last->species_index = vm->species_index;
+  vm->species_list = NULL;
+  if (list->cells != NULL)
+    list->cells->stale = 1;
+}
+
+/***************************************************************************
+ free_species_list:
+    Dispose of an empty per-species list of a subvolume, which the caller has
+    already unlinked from the subvolume's species_head list.
+
+ In: sv: the subvolume
+     psl: the species list
+ Out: Nothing.  The list is removed from the subvolume's pointer hash and
+      returned to its pool.
+***************************************************************************/
+void free_species_list(struct subvolume *sv, struct per_species_list *psl) {
+  ht_remove(&sv->mol_by_species, psl);
+  if (psl->properties != NULL && (psl->properties->flags & EXTERNAL_SPECIES))
+    release_graph_data(psl->graph_data);
+  free(psl->mols);
+  free_species_cell_index(psl->cells);
+  mem_put(sv->local_storage->pslv, psl);
+}
+
+/***************************************************************************
+ free_species_cell_index:
+    Dispose of the spatial index of a per-species list.
+
+ In: ci: the index, or NULL
+ Out: Nothing.
+***************************************************************************/
+void free_species_cell_index(struct species_cell_index *ci) {
+  if (ci == NULL)
+    return;
+  free(ci->cell_start);
+  free(ci->mols);
+  free(ci);
+}
+
+/***************************************************************************
+ species_list_is_immobile:
+    Check whether a per-species list is worth indexing by position: its
+    molecules never move, and it is long enough that a scan of the whole list
+    costs more than keeping the index.
+
+ In: psl: the species list
+ Out: 1 if species_list_cells may be used on this list, 0 otherwise.
+***************************************************************************/
+int species_list_is_immobile(struct per_species_list const *psl) {
+  struct species const *s = psl->properties;
+  return s != NULL && !(s->flags & EXTERNAL_SPECIES) && s->D == 0 &&
+         psl->n_mols >= SPECIES_CELL_MIN_MOLS;
+}
+
+/* Map one coordinate to its cell along an axis, clamping strays onto the
+ * boundary cells */
+static int species_cell_coord(double x, double llf, double inv_cell, int n) {
+  double c = (x - llf) * inv_cell;
+  if (!(c > 0))
+    return 0;
+  if (c >= n)
+    return n - 1;
+  return (int)c;
+}
+
+/***************************************************************************
+ species_list_cells:
+    Get the spatial index of an immobile per-species list, (re)building it if
+    molecules were added to or removed from the list since it was last used.
+    The grid spans the subvolume, with about SPECIES_CELL_MOLS_PER_CELL
+    molecules per cell.  Molecules on the subvolume's faces, or slightly
+    outside of it, go into the nearest cell.
+
+ In: world: simulation state
+     sv: the subvolume holding the list
+     psl: the species list
+ Out: The index, sorted by cell.
+***************************************************************************/
+struct species_cell_index *species_list_cells(struct volume *world,
+                                              struct subvolume *sv,
+                                              struct per_species_list *psl) {
+  struct species_cell_index *ci = psl->cells;
+  if (ci == NULL) {
+    ci = CHECKED_MALLOC_STRUCT(struct species_cell_index,
+                               "per-species cell index");
+    ci->cell_start = NULL;
+    ci->mols = NULL;
+    ci->max_mols = ci->max_cells = 0;
+    ci->stale = 1;
+    psl->cells = ci;
+  }
+  if (!ci->stale)
+    return ci;
+
+  struct vector3 llf, urb;
+  llf.x = world->x_fineparts[sv->llf.x];
+  llf.y = world->y_fineparts[sv->llf.y];
+  llf.z = world->z_fineparts[sv->llf.z];
+  urb.x = world->x_fineparts[sv->urb.x];
+  urb.y = world->y_fineparts[sv->urb.y];
+  urb.z = world->z_fineparts[sv->urb.z];
+
+  int n = (int)cbrt((double)psl->n_mols / SPECIES_CELL_MOLS_PER_CELL);
+  if (n < 1)
+    n = 1;
+  else if (n > SPECIES_CELL_MAX_PER_AXIS)
+    n = SPECIES_CELL_MAX_PER_AXIS;
+  ci->llf = llf;
+  ci->n_cells[0] = ci->n_cells[1] = ci->n_cells[2] = n;
+  ci->inv_cell.x = (urb.x > llf.x) ? n / (urb.x - llf.x) : 0;
+  ci->inv_cell.y = (urb.y > llf.y) ? n / (urb.y - llf.y) : 0;
+  ci->inv_cell.z = (urb.z > llf.z) ? n / (urb.z - llf.z) : 0;
+
+  int n_cells = n * n * n;
+  if (n_cells > ci->max_cells) {
+    free(ci->cell_start);
+    ci->cell_start = CHECKED_MALLOC_ARRAY(int, n_cells + 1, "cell offsets");
+    ci->max_cells = n_cells;
+  }
+  if (psl->n_mols > ci->max_mols) {
+    free(ci->mols);
+    ci->max_mols = psl->max_mols;
+    ci->mols = CHECKED_MALLOC_ARRAY(struct volume_molecule *, ci->max_mols,
+                                    "per-species cell index");
+  }
+
+  /* Counting sort by cell: count, turn counts into end offsets, then fill
+   * each cell from its end, which leaves cell_start at each cell's start */
+  int *cell_start = ci->cell_start;
+  memset(cell_start, 0, (n_cells + 1) * sizeof(int));
+  for (int i = 0; i < psl->n_mols; i++)
+    cell_start[species_cell_of(ci, &psl->mols[i]->pos) + 1]++;
+  for (int c = 0; c < n_cells; c++)
+    cell_start[c + 1] += cell_start[c];
+  for (int i = psl->n_mols - 1; i >= 0; i--) {
+    struct volume_molecule *mp = psl->mols[i];
+    int c = species_cell_of(ci, &mp->pos);
+    ci->mols[--cell_start[c + 1]] = mp;
+  }
+  /* cell_start[c + 1] now holds the start of cell c; shift down by one */
+  memmove(cell_start, cell_start + 1, n_cells * sizeof(int));
+  cell_start[n_cells] = psl->n_mols;
+
+  ci->stale = 0;
+  return ci;
+}
+
+/***************************************************************************
+ species_cell_of:
+    Find the cell of a spatial index holding a point.
+
+ In: ci: the index
+     pos: the point
+ Out: The linear cell index.
+***************************************************************************/
+int species_cell_of(struct species_cell_index const *ci,
+                    struct vector3 const *pos) {
+  int ix = species_cell_coord(pos->x, ci->llf.x, ci->inv_cell.x, ci->n_cells[0]);
+  int iy = species_cell_coord(pos->y, ci->llf.y, ci->inv_cell.y, ci->n_cells[1]);
+  int iz = species_cell_coord(pos->z, ci->llf.z, ci->inv_cell.z, ci->n_cells[2]);
+  return (iz * ci->n_cells[1] + iy) * ci->n_cells[0] + ix;
+}
+
+/***************************************************************************
+ species_cell_range:
+    Find the block of cells of a spatial index overlapping a box.  Since
+    molecules off the grid are kept in the boundary cells, so are the ends of
+    the range.
+
+ In: ci: the index
+     llf, urb: corners of the box
+     lo, hi: filled with the first and last cell along each axis
+ Out: Nothing.
+***************************************************************************/
+void species_cell_range(struct species_cell_index const *ci,
+                        struct vector3 const *llf, struct vector3 const *urb,
+                        int lo[3], int hi[3]) {
+  lo[0] = species_cell_coord(llf->x, ci->llf.x, ci->inv_cell.x, ci->n_cells[0]);
+  lo[1] = species_cell_coord(llf->y, ci->llf.y, ci->inv_cell.y, ci->n_cells[1]);
+  lo[2] = species_cell_coord(llf->z, ci->llf.z, ci->inv_cell.z, ci->n_cells[2]);
+  hi[0] = species_cell_coord(urb->x, ci->llf.x, ci->inv_cell.x, ci->n_cells[0]);
+  hi[1] = species_cell_coord(urb->y, ci->llf.y, ci->inv_cell.y, ci->n_cells[1]);
+  hi[2] = species_cell_coord(urb->z, ci->llf.z, ci->inv_cell.z, ci->n_cells[2]);
 }
 
 /***************************************************************************
@@ -2626,8 +4284,8 @@ struct surface_molecule_list* add_surfmol_with_unique_pb_to_list(
   }
   else {
     for (; sm_list != NULL; sm_list = sm_list->next) {
-      if (sm && periodic_boxes_are_identical(
-          sm_list->sm->periodic_box, sm->periodic_box)) {
+      if (sm && periodic_images_equal(
+          &sm_list->sm->periodic_box, &sm->periodic_box)) {
         free(sm_entry);
         return NULL;
       }
@@ -2655,6 +4313,11 @@ void remove_surfmol_from_list(
   struct surface_molecule_list *sm_list = *sm_head;
   struct surface_molecule_list *prev = *sm_head;
 
+  /* The tile may be free from now on */
+  if (sm != NULL && sm->grid != NULL && sm->grid->vacant != NULL &&
+      sm_head == &sm->grid->sm_list[sm->grid_index])
+    set_bit(sm->grid->vacant, sm->grid_index, 1);
+
   if (sm_list == NULL) {
   }
   else if (sm_list->sm == sm) {
@@ -2679,3 +4342,60 @@ void remove_surfmol_from_list(
   }
   return;
 }
+
+/*************************************************************************
+  move_surfmol_between_lists
+
+ In:  from_head: pointer to the head of the list sm is in now
+      to_head: head of the list sm should go to
+      sm: the surface molecule to move
+ Out: Return the head of the list sm went to, or NULL if sm's periodic box
+      is already in that list.  This is the same as remove_surfmol_from_list
+      followed by add_surfmol_with_unique_pb_to_list, except that sm's list
+      entry is moved over instead of being freed and allocated again.
+      Just like remove_surfmol_from_list, this is to be called before
+      sm->grid and sm->grid_index are changed.
+*************************************************************************/
+struct surface_molecule_list *move_surfmol_between_lists(
+    struct surface_molecule_list **from_head,
+    struct surface_molecule_list *to_head,
+    struct surface_molecule *sm) {
+
+  if (sm->grid != NULL && sm->grid->vacant != NULL &&
+      from_head == &sm->grid->sm_list[sm->grid_index])
+    set_bit(sm->grid->vacant, sm->grid_index, 1);
+
+  struct surface_molecule_list *sm_entry = NULL;
+  for (struct surface_molecule_list **link = from_head; *link != NULL;
+       link = &(*link)->next) {
+    if ((*link)->sm == sm) {
+      sm_entry = *link;
+      *link = sm_entry->next;
+      break;
+    }
+  }
+  if (sm_entry == NULL)
+    return add_surfmol_with_unique_pb_to_list(to_head, sm);
+
+  sm_entry->next = NULL;
+  if (to_head == NULL)
+    return sm_entry;
+  if (to_head->sm == NULL) {
+    to_head->sm = sm;
+    free(sm_entry);
+    return to_head;
+  }
+  for (struct surface_molecule_list *sm_list = to_head; sm_list != NULL;
+       sm_list = sm_list->next) {
+    if (periodic_images_equal(&sm_list->sm->periodic_box,
+                              &sm->periodic_box)) {
+      free(sm_entry);
+      return NULL;
+    }
+    if (sm_list->next == NULL) {
+      sm_list->next = sm_entry;
+      break;
+    }
+  }
+  return to_head;
+}
@@ -23,12 +23,17 @@
 
 #pragma once
 
+#include <string.h>
+
 #include "mcell_structs.h"
 
 int inside_subvolume(struct vector3 *point, struct subvolume *subvol,
                      double *x_fineparts, double *y_fineparts,
                      double *z_fineparts);
 
+int partition_index(struct partition_lookup const *lookup, double *partitions,
+                    int n_parts, double val);
+
 struct subvolume *find_coarse_subvol(struct volume *world, struct vector3 *loc);
 
 struct subvolume *traverse_subvol(struct subvolume *here,
@@ -73,9 +78,34 @@ struct volume_molecule *insert_volume_molecule(struct volume *world,
                                                struct volume_molecule *vm,
                                                struct volume_molecule *guess);
 
+/* Volume molecules created in bulk (by a release event or a checkpoint
+ * restore) which are still waiting to be added to their storage's
+ * scheduler.  Consecutive molecules going to the same scheduler are added
+ * with one call to schedule_insert_batch. */
+#define RELEASE_BATCH_SIZE 1024
+
+struct release_batch {
+  struct schedule_helper *timer;
+  int n;
+  struct abstract_element *items[RELEASE_BATCH_SIZE];
+};
+
+struct volume_molecule *
+release_volume_molecule(struct volume *state, struct volume_molecule *vm,
+                        struct volume_molecule *vm_guess,
+                        struct release_batch *batch);
+
+void init_release_batch(struct release_batch *batch);
+
+void flush_release_batch(struct release_batch *batch);
+
 struct volume_molecule *migrate_volume_molecule(struct volume_molecule *vm,
                                                 struct subvolume *new_sv);
 
+void move_subvolume_to_storage(struct subvolume *sv, struct storage *store);
+
+void morton_sort_storage(struct volume *world, struct storage *store);
+
 int eval_rel_region_3d(struct release_evaluator *expr, struct waypoint *wp,
                        struct region_list *in_regions,
                        struct region_list *out_regions);
@@ -85,10 +115,19 @@ int release_molecules(struct volume *world, struct release_event_queue *req);
 int release_by_list(struct volume *state, struct release_event_queue *req,
                     struct volume_molecule *vm);
 
+int release_molecule_array(struct volume *state, struct species *spec,
+                           const double *xyz, const int *orient, int n,
+                           double diam);
+
 int release_ellipsoid_or_rectcuboid(struct volume *state,
                                     struct release_event_queue *req,
                                     struct volume_molecule *vm, int number);
 
+void queue_triggered_release(struct volume *state,
+                             struct release_event_queue *req);
+
+int flush_triggered_releases(struct volume *state);
+
 int set_partitions(struct volume *world);
 
 double increase_fine_partition_size(struct volume *state, double *fineparts,
@@ -106,6 +145,8 @@ void set_auto_partitions(struct volume *state, double steps_min,
 void set_user_partitions(struct volume *state, double dfx, double dfy,
                          double dfz);
 
+int refine_partitions(struct volume *state, double min_spacing);
+
 void find_closest_fine_part(double *partitions, double *fineparts,
                             int n_fineparts, int n_parts);
 
@@ -119,12 +160,41 @@ void path_bounding_box(struct vector3 *loc, struct vector3 *displacement,
 
 void ht_add_molecule_to_list(struct pointer_hash *h, struct volume_molecule *vm);
 void ht_remove(struct pointer_hash *h, struct per_species_list *psl);
+void species_list_remove(struct volume_molecule *vm);
+void free_species_list(struct subvolume *sv, struct per_species_list *psl);
+
+/* Immobile species lists at least this long get a spatial index */
+#define SPECIES_CELL_MIN_MOLS 64
+/* Target occupancy and size limit of the index's grid */
+#define SPECIES_CELL_MOLS_PER_CELL 8
+#define SPECIES_CELL_MAX_PER_AXIS 32
+
+int species_list_is_immobile(struct per_species_list const *psl);
+struct species_cell_index *species_list_cells(struct volume *world,
+                                              struct subvolume *sv,
+                                              struct per_species_list *psl);
+int species_cell_of(struct species_cell_index const *ci,
+                    struct vector3 const *pos);
+void species_cell_range(struct species_cell_index const *ci,
+                        struct vector3 const *llf, struct vector3 const *urb,
+                        int lo[3], int hi[3]);
+void free_species_cell_index(struct species_cell_index *ci);
 
 void collect_molecule(struct volume_molecule *vm);
 
 bool periodic_boxes_are_identical(const struct periodic_image *b1,
   const struct periodic_image *b2);
 
+/* Compare the periodic images carried inline by two molecules. Both images
+ * keep their pad at zero, so the whole image compares as one 64-bit word. */
+static inline bool periodic_images_equal(const struct periodic_image *b1,
+                                         const struct periodic_image *b2) {
+  uint64_t w1, w2;
+  memcpy(&w1, b1, sizeof(w1));
+  memcpy(&w2, b2, sizeof(w2));
+  return w1 == w2;
+}
+
 int convert_relative_to_abs_PBC_coords(
     struct object *periodic_box_obj,
     struct periodic_image *periodic_box,
@@ -139,3 +209,8 @@ struct surface_molecule_list* add_surfmol_with_unique_pb_to_list(
 void remove_surfmol_from_list(
     struct surface_molecule_list **sm_head,
     struct surface_molecule *sm);
+
+struct surface_molecule_list *move_surfmol_between_lists(
+    struct surface_molecule_list **from_head,
+    struct surface_molecule_list *to_head,
+    struct surface_molecule *sm);
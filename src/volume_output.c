@@ -29,10 +29,12 @@
 #include "sched_util.h"
 #include "vol_util.h"
 #include "strfunc.h"
+#include "text_output.h"
 #include "util.h"
 
 #include <errno.h>
 #include <math.h>
+#include <stdint.h>
 #include <string.h>
 #include <stdarg.h>
 #include <stdio.h>
@@ -43,9 +45,21 @@ static int produce_item_header(FILE *out_file, struct volume_output_item *vo);
 static int produce_mol_counts(struct volume *wrld, FILE *out_file,
                               struct volume_output_item *vo);
 
+static int produce_sparse_mol_counts(struct volume *wrld, FILE *out_file,
+                                     struct volume_output_item *vo);
+
 static int find_species_in_array(struct species **mols, int num_mols,
                                  struct species *ptr);
 
+static int subvolume_in_one_voxel(struct volume *wrld,
+                                  struct volume_output_item *vo,
+                                  struct subvolume *subvol, double z_lo,
+                                  double z_hi, int *u, int *v);
+
+static int count_subvolume_molecules(struct volume_output_item *vo,
+                                     struct subvolume *subvol,
+                                     int check_nonreacting);
+
 static int reschedule_volume_output_item(struct volume *wrld,
                                          struct volume_output_item *vo);
 
@@ -56,6 +70,10 @@ int update_volume_output(struct volume *wrld, struct volume_output_item *vo) {
   int failure = 0;
   char *filename;
 
+  /* Nothing is written during the equilibration phase */
+  if (wrld->equilibrating)
+    return reschedule_volume_output_item(wrld, vo);
+
   switch (wrld->notify->volume_output_report) {
   case NOTIFY_NONE:
     break;
@@ -72,7 +90,8 @@ int update_volume_output(struct volume *wrld, struct volume_output_item *vo) {
   }
 
   /* build the filename */
-  filename = CHECKED_SPRINTF("%s.%lld.dat", vo->filename_prefix, wrld->current_iterations);
+  filename = CHECKED_SPRINTF(vo->binary_flag ? "%s.%lld.bin" : "%s.%lld.dat",
+                             vo->filename_prefix, wrld->current_iterations);
 
   /* Try to make the directory if it doesn't exist */
   if (make_parent_dir(filename)) {
@@ -99,18 +118,23 @@ int update_volume_output(struct volume *wrld, struct volume_output_item *vo) {
  */
 int output_volume_output_item(struct volume *wrld, char const *filename,
                               struct volume_output_item *vo) {
-  FILE *f = fopen(filename, "w");
+  FILE *f = fopen(filename, vo->binary_flag ? "wb" : "w");
   if (f == NULL) {
     mcell_perror_nodie(errno, "Couldn't open volume output file '%s'.",
                        filename);
     return 1;
   }
 
-  if (produce_item_header(f, vo))
-    goto failure;
+  if (vo->binary_flag) {
+    if (produce_sparse_mol_counts(wrld, f, vo))
+      goto failure;
+  } else {
+    if (produce_item_header(f, vo))
+      goto failure;
 
-  if (produce_mol_counts(wrld, f, vo))
-    goto failure;
+    if (produce_mol_counts(wrld, f, vo))
+      goto failure;
+  }
 
   fclose(f);
   return 0;
@@ -152,6 +176,10 @@ static int produce_mol_counts(struct volume *wrld, FILE *out_file,
 
   z_lim_part = wrld->z_fineparts[cur_partition_z->urb.z];
 
+  struct text_writer *tw =
+      CHECKED_MALLOC_STRUCT(struct text_writer, "volume output buffer");
+  text_writer_init(tw, out_file, wrld->shortest_floats);
+
   /* For each slab: */
   double r_voxsz_x = 1.0 / vo->voxel_size.x;
   double r_voxsz_y = 1.0 / vo->voxel_size.y;
@@ -180,13 +208,28 @@ static int produce_mol_counts(struct volume *wrld, FILE *out_file,
             break;
           }
         }
-        for (psl = cur_partition->species_head; psl != NULL; psl = psl->next) {
+        /* A subvolume that lies within one voxel of this slab is counted
+         * from the sizes of its species lists; one outside the slab holds
+         * nothing for it */
+        int counted = 0;
+        int cell_u, cell_v;
+        if (wrld->z_fineparts[cur_partition->urb.z] < z ||
+            wrld->z_fineparts[cur_partition->llf.z] >= z_lim_slab)
+          counted = 1;
+        else if (subvolume_in_one_voxel(wrld, vo, cur_partition, z, z_lim_slab,
+                                        &cell_u, &cell_v)) {
+          counters[cell_u * vo->nvoxels_x + cell_v] +=
+              count_subvolume_molecules(vo, cur_partition, check_nonreacting);
+          counted = 1;
+        }
+        for (psl = counted ? NULL : cur_partition->species_head; psl != NULL;
+             psl = psl->next) {
           if (psl->properties == NULL) {
             if (!check_nonreacting)
               continue;
             else {
-              for (curmol = psl->head; curmol != NULL;
-                   curmol = curmol->next_v) {
+              for (int mi = psl->n_mols - 1; mi >= 0; mi--) {
+                curmol = psl->mols[mi];
                 /* See if we're interested in this molecule */
                 if (vo->num_molecules == 1) {
                   if (*vo->molecules != curmol->properties)
@@ -223,7 +266,8 @@ static int produce_mol_counts(struct volume *wrld, FILE *out_file,
                 continue;
             }
 
-            for (curmol = psl->head; curmol != NULL; curmol = curmol->next_v) {
+            for (int mi = psl->n_mols - 1; mi >= 0; mi--) {
+              curmol = psl->mols[mi];
               /* Skip molecules not in our slab */
               if (curmol->pos.z < z || curmol->pos.z >= z_lim_slab)
                 continue;
@@ -274,16 +318,309 @@ static int produce_mol_counts(struct volume *wrld, FILE *out_file,
     /* Spill our counts */
     countersptr = counters;
     for (u = 0; u < vo->nvoxels_y; ++u) {
-      for (v = 0; v < vo->nvoxels_x; ++v)
-        fprintf(out_file, "%d ", *countersptr++);
-      fprintf(out_file, "\n");
+      for (v = 0; v < vo->nvoxels_x; ++v) {
+        text_writer_long(tw, *countersptr++);
+        text_writer_char(tw, ' ');
+      }
+      text_writer_char(tw, '\n');
     }
 
     /* Extra newline to put visual separation between slabs */
-    fprintf(out_file, "\n");
+    text_writer_char(tw, '\n');
   }
 
+  int failure = text_writer_flush(tw);
+  free(tw);
   free(counters);
+  if (failure) {
+    mcell_perror_nodie(errno, "Couldn't write volume output file.");
+    return 1;
+  }
+  return 0;
+}
+
+/* Count for one non-empty voxel of a sparse volume output */
+struct voxel_count {
+  uint64_t index; /* (z * ny + y) * nx + x */
+  int32_t count;
+};
+
+/* Open-addressed table of voxel counts keyed by voxel index */
+struct voxel_table {
+  struct voxel_count *slots; /* count 0 marks an empty slot */
+  size_t size;               /* always a power of two */
+  size_t n_used;
+};
+
+/*
+ * Add to the count of a voxel, growing the table when it gets half full.
+ */
+static void add_voxel_count(struct voxel_table *table, uint64_t index,
+                            int32_t n) {
+  if (n == 0)
+    return;
+
+  if (2 * (table->n_used + 1) > table->size) {
+    struct voxel_count *old = table->slots;
+    size_t old_size = table->size;
+    table->size = (old_size == 0) ? 1024 : 2 * old_size;
+    table->slots = CHECKED_MALLOC_ARRAY(struct voxel_count, table->size,
+                                        "sparse voxel counts");
+    memset(table->slots, 0, table->size * sizeof(struct voxel_count));
+    table->n_used = 0;
+    for (size_t i = 0; i < old_size; ++i) {
+      if (old[i].count == 0)
+        continue;
+      size_t bin = (size_t)(old[i].index * 0x9E3779B97F4A7C15ULL) &
+                   (table->size - 1);
+      while (table->slots[bin].count != 0)
+        bin = (bin + 1) & (table->size - 1);
+      table->slots[bin] = old[i];
+      ++table->n_used;
+    }
+    free(old);
+  }
+
+  size_t bin = (size_t)(index * 0x9E3779B97F4A7C15ULL) & (table->size - 1);
+  while (table->slots[bin].count != 0 && table->slots[bin].index != index)
+    bin = (bin + 1) & (table->size - 1);
+  if (table->slots[bin].count == 0) {
+    table->slots[bin].index = index;
+    ++table->n_used;
+  }
+  table->slots[bin].count += n;
+}
+
+static int compare_voxel_counts(void const *a, void const *b) {
+  uint64_t ia = ((struct voxel_count const *)a)->index;
+  uint64_t ib = ((struct voxel_count const *)b)->index;
+  return (ia > ib) - (ia < ib);
+}
+
+/*
+ * Check whether molecules of a species are counted by a volume output item.
+ */
+static int volume_output_counts_species(struct volume_output_item *vo,
+                                        struct species *spec) {
+  if (vo->num_molecules == 1)
+    return *vo->molecules == spec;
+  return find_species_in_array(vo->molecules, vo->num_molecules, spec) != -1;
+}
+
+/*
+ * Find the slab holding a z coordinate inside the grid: the last slab
+ * boundary at or below it.
+ */
+static int find_slab(double const *z_bounds, int nvoxels_z, double pos_z) {
+  int lo = 0, hi = nvoxels_z;
+  while (hi - lo > 1) {
+    int mid = (lo + hi) / 2;
+    if (pos_z >= z_bounds[mid])
+      lo = mid;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+
+/*
+ * Check whether every point of a subvolume lies in the same voxel of the
+ * x-y grid, and within [z_lo, z_hi) in z.  If so, return 1 and the voxel.
+ * Voxels are found exactly as for single molecules, so a molecule anywhere
+ * in the subvolume would land in the same voxel.
+ */
+static int subvolume_in_one_voxel(struct volume *wrld,
+                                  struct volume_output_item *vo,
+                                  struct subvolume *subvol, double z_lo,
+                                  double z_hi, int *u, int *v) {
+  double x = vo->location.x, y = vo->location.y;
+  double x_lim = x + vo->voxel_size.x * (double)vo->nvoxels_x;
+  double y_lim = y + vo->voxel_size.y * (double)vo->nvoxels_y;
+  double r_voxsz_x = 1.0 / vo->voxel_size.x;
+  double r_voxsz_y = 1.0 / vo->voxel_size.y;
+  double xl = wrld->x_fineparts[subvol->llf.x];
+  double xu = wrld->x_fineparts[subvol->urb.x];
+  double yl = wrld->y_fineparts[subvol->llf.y];
+  double yu = wrld->y_fineparts[subvol->urb.y];
+
+  if (wrld->z_fineparts[subvol->llf.z] < z_lo ||
+      wrld->z_fineparts[subvol->urb.z] >= z_hi)
+    return 0;
+  if (xl < x || xu >= x_lim || yl < y || yu >= y_lim)
+    return 0;
+
+  int v_lo = (int)floor((xl - x) * r_voxsz_x);
+  int u_lo = (int)floor((yl - y) * r_voxsz_y);
+  if ((int)floor((xu - x) * r_voxsz_x) != v_lo ||
+      (int)floor((yu - y) * r_voxsz_y) != u_lo)
+    return 0;
+
+  *u = u_lo;
+  *v = v_lo;
+  return 1;
+}
+
+/*
+ * Count the molecules of a subvolume that a volume output item counts,
+ * using the sizes of the per-species lists.  Only the list of non-reacting
+ * molecules (mixed species) has to be looked at one molecule at a time.
+ */
+static int count_subvolume_molecules(struct volume_output_item *vo,
+                                     struct subvolume *subvol,
+                                     int check_nonreacting) {
+  int count = 0;
+  for (struct per_species_list *psl = subvol->species_head; psl != NULL;
+       psl = psl->next) {
+    if (psl->properties != NULL) {
+      if (volume_output_counts_species(vo, psl->properties))
+        count += psl->n_mols;
+    } else if (check_nonreacting) {
+      for (int mi = psl->n_mols - 1; mi >= 0; mi--) {
+        if (volume_output_counts_species(vo, psl->mols[mi]->properties))
+          ++count;
+      }
+    }
+  }
+  return count;
+}
+
+/*
+ * Write the molecule counts of the non-empty voxels to the file, in binary.
+ *
+ * Molecules are binned into the same voxels as produce_mol_counts would put
+ * them in, but in a single pass over the subvolumes that overlap the grid,
+ * keeping counts only for voxels that have molecules.  The file holds the
+ * 4 bytes "MCVS", a uint32 version (1), int32 nx, ny and nz, the double
+ * output time, a uint64 voxel count and then, for each non-empty voxel in
+ * increasing index order, a uint64 index ((z * ny + y) * nx + x) and an
+ * int32 count.
+ */
+static int produce_sparse_mol_counts(struct volume *wrld, FILE *out_file,
+                                     struct volume_output_item *vo) {
+  double z = vo->location.z, y = vo->location.y, x = vo->location.x;
+  double x_lim = x + vo->voxel_size.x * (double)vo->nvoxels_x;
+  double y_lim = y + vo->voxel_size.y * (double)vo->nvoxels_y;
+
+  if (find_subvolume(wrld, &vo->location, NULL) == NULL) {
+    mcell_internal_error(
+        "While counting at [%g, %g, %g]: point isn't within a partition.", x, y,
+        z);
+    /*return 1;*/
+  }
+
+  /* Slab boundaries, accumulated the same way produce_mol_counts steps
+   * through them */
+  double *z_bounds =
+      CHECKED_MALLOC_ARRAY(double, vo->nvoxels_z + 1, "voxel slab bounds");
+  z_bounds[0] = z;
+  for (int k = 0; k < vo->nvoxels_z; ++k)
+    z_bounds[k + 1] = z_bounds[k] + vo->voxel_size.z;
+  double z_lim = z_bounds[vo->nvoxels_z];
+
+  int check_nonreacting = 0;
+  for (int i = 0; i < vo->num_molecules; ++i) {
+    if (!(vo->molecules[i]->flags & CAN_VOLVOL)) {
+      check_nonreacting = 1;
+      break;
+    }
+  }
+
+  struct voxel_table table = { NULL, 0, 0 };
+  double r_voxsz_x = 1.0 / vo->voxel_size.x;
+  double r_voxsz_y = 1.0 / vo->voxel_size.y;
+  for (int sv = 0; sv < wrld->n_subvols; ++sv) {
+    struct subvolume *subvol = &wrld->subvol[sv];
+
+    /* Skip subvolumes (and their storages) that don't overlap the grid */
+    if (wrld->x_fineparts[subvol->urb.x] < x ||
+        wrld->x_fineparts[subvol->llf.x] >= x_lim ||
+        wrld->y_fineparts[subvol->urb.y] < y ||
+        wrld->y_fineparts[subvol->llf.y] >= y_lim ||
+        wrld->z_fineparts[subvol->urb.z] < z ||
+        wrld->z_fineparts[subvol->llf.z] >= z_lim)
+      continue;
+
+    /* A subvolume within a single voxel is counted from its list sizes */
+    double sub_z_lo = wrld->z_fineparts[subvol->llf.z];
+    double sub_z_hi = wrld->z_fineparts[subvol->urb.z];
+    if (sub_z_lo >= z && sub_z_hi < z_lim) {
+      int k = find_slab(z_bounds, vo->nvoxels_z, sub_z_lo);
+      int u, v;
+      if (find_slab(z_bounds, vo->nvoxels_z, sub_z_hi) == k &&
+          subvolume_in_one_voxel(wrld, vo, subvol, z_bounds[k],
+                                 z_bounds[k + 1], &u, &v)) {
+        add_voxel_count(
+            &table, ((uint64_t)k * vo->nvoxels_y + u) * vo->nvoxels_x + v,
+            count_subvolume_molecules(vo, subvol, check_nonreacting));
+        continue;
+      }
+    }
+
+    for (struct per_species_list *psl = subvol->species_head; psl != NULL;
+         psl = psl->next) {
+      if (psl->properties == NULL) {
+        if (!check_nonreacting)
+          continue;
+      } else if (!volume_output_counts_species(vo, psl->properties))
+        continue;
+
+      for (int mi = psl->n_mols - 1; mi >= 0; mi--) {
+        struct volume_molecule *curmol = psl->mols[mi];
+        if (psl->properties == NULL &&
+            !volume_output_counts_species(vo, curmol->properties))
+          continue;
+
+        /* Skip molecules outside our domain */
+        if (curmol->pos.x < x || curmol->pos.x >= x_lim ||
+            curmol->pos.y < y || curmol->pos.y >= y_lim ||
+            curmol->pos.z < z || curmol->pos.z >= z_lim)
+          continue;
+
+        int k = find_slab(z_bounds, vo->nvoxels_z, curmol->pos.z);
+        int u = (int)floor((curmol->pos.y - y) * r_voxsz_y);
+        int v = (int)floor((curmol->pos.x - x) * r_voxsz_x);
+        if (u >= vo->nvoxels_y)
+          u = vo->nvoxels_y - 1;
+        if (v >= vo->nvoxels_x)
+          v = vo->nvoxels_x - 1;
+        add_voxel_count(&table,
+                        ((uint64_t)k * vo->nvoxels_y + u) * vo->nvoxels_x + v,
+                        1);
+      }
+    }
+  }
+  free(z_bounds);
+
+  /* Pack the non-empty voxels to the front and put them in index order */
+  uint64_t n_voxels = 0;
+  for (size_t i = 0; i < table.size; ++i) {
+    if (table.slots[i].count != 0)
+      table.slots[n_voxels++] = table.slots[i];
+  }
+  if (n_voxels > 1)
+    qsort(table.slots, n_voxels, sizeof(struct voxel_count),
+          compare_voxel_counts);
+
+  uint32_t version = 1;
+  int32_t dims[3] = { vo->nvoxels_x, vo->nvoxels_y, vo->nvoxels_z };
+  double t = vo->t;
+  int failure =
+      fwrite("MCVS", 1, 4, out_file) != 4 ||
+      fwrite(&version, sizeof(version), 1, out_file) != 1 ||
+      fwrite(dims, sizeof(int32_t), 3, out_file) != 3 ||
+      fwrite(&t, sizeof(t), 1, out_file) != 1 ||
+      fwrite(&n_voxels, sizeof(n_voxels), 1, out_file) != 1;
+  for (uint64_t i = 0; !failure && i < n_voxels; ++i) {
+    failure =
+        fwrite(&table.slots[i].index, sizeof(uint64_t), 1, out_file) != 1 ||
+        fwrite(&table.slots[i].count, sizeof(int32_t), 1, out_file) != 1;
+  }
+  free(table.slots);
+
+  if (failure) {
+    mcell_perror_nodie(errno, "Couldn't write sparse volume output file.");
+    return 1;
+  }
   return 0;
 }
 
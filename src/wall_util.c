@@ -23,6 +23,7 @@
 
 #include "config.h"
 
+#include <limits.h>
 #include <math.h>
 #include <string.h>
 #include <stdlib.h>
@@ -41,6 +42,8 @@
 #include "react.h"
 #include "nfsim_func.h"
 #include "strfunc.h"
+#include "thread_util.h"
+#include "mol_id_index.h"
 
 /* tetrahedralVol returns the (signed) volume of the tetrahedron spanned by
  * the vertices a, b, c, and d.
@@ -71,81 +74,90 @@ static struct poly_edge* create_new_poly_edge(struct poly_edge* list);
 // are part of a common region or not
 static bool have_common_region(struct object *obj, int wall1, int wall2);
 
+// hash_surface_edges and connect_surface_edges are the two halves of
+// surface_net
+static int hash_surface_edges(struct wall **facelist, int nfaces,
+                              struct edge_hashtable *eht);
+static int connect_surface_edges(struct wall **facelist,
+                                 struct edge_hashtable *eht);
+
 
 /**************************************************************************\
  ** Edge hash table section--finds common edges in polygons              **
 \**************************************************************************/
 
 /***************************************************************************
-edge_equals:
-  In: pointers to two poly_edge structs
-  Out: Returns 1 if the edges are the same, 0 otherwise.
-  Note: Orientation invariant, so an edge between vertex 1 and 2
-        is the same as an edge between vertex 2 and 1.
+edge_hash:
+  In: key: the vertex ids of an edge, as stored in a poly_edge
+      nkeys: number of keys in the hash table, a power of two
+  Out: Returns a hash value between 0 and nkeys-1.
 ***************************************************************************/
-
-int edge_equals(struct poly_edge *e1, struct poly_edge *e2) {
-  if ((!distinguishable(e1->v1x, e2->v1x, EPS_C)) &&
-      (!distinguishable(e1->v1y, e2->v1y, EPS_C)) &&
-      (!distinguishable(e1->v1z, e2->v1z, EPS_C)) &&
-      (!distinguishable(e1->v2x, e2->v2x, EPS_C)) &&
-      (!distinguishable(e1->v2y, e2->v2y, EPS_C)) &&
-      (!distinguishable(e1->v2z, e2->v2z, EPS_C))) {
-    return 1;
-  }
-  if ((!distinguishable(e1->v1x, e2->v2x, EPS_C)) &&
-      (!distinguishable(e1->v1y, e2->v2y, EPS_C)) &&
-      (!distinguishable(e1->v1z, e2->v2z, EPS_C)) &&
-      (!distinguishable(e1->v2x, e2->v1x, EPS_C)) &&
-      (!distinguishable(e1->v2y, e2->v1y, EPS_C)) &&
-      (!distinguishable(e1->v2z, e2->v1z, EPS_C))) {
-    return 1;
-  }
-  return 0;
+int edge_hash(unsigned long long key, int nkeys) {
+  key ^= key >> 33;
+  key *= 0xff51afd7ed558ccdULL;
+  key ^= key >> 33;
+  key *= 0xc4ceb9fe1a85ec53ULL;
+  key ^= key >> 33;
+  return (int)(key & (unsigned long long)(nkeys - 1));
 }
 
 /***************************************************************************
-edge_hash:
-  In: pe: pointer to a poly_edge struct
-      nkeys: number of keys in the hash table
-  Out: Returns a hash value between 0 and nkeys-1.
-  Note: Orientation invariant, so a hash with the two endpoints swapped
-        will be the same.
+ehtable_vertex_id:
+  In: eht: pointer to an edge_hashtable struct
+      v: a vertex of one of the faces being hashed
+  Out: Returns the id of the vertex position, which is the same for all
+       vertices at exactly the same position, whether or not they are the
+       same vertex.
 ***************************************************************************/
-
-int edge_hash(struct poly_edge *pe, int nkeys) {
-  /* Get hash of X,Y,Z set of doubles for 1st and 2nd points */
-  /* (Assume they're laid out consecutively in memory) */
-  /* FIXME: This seems like a hack. Since poly_edge is a struct there's no
-   * guarantee what the memory layout will be and the compiler may pad */
-  unsigned int hashL = jenkins_hash((ub1 *)&(pe->v1x), 3 * sizeof(double));
-  unsigned int hashR = jenkins_hash((ub1 *)&(pe->v2x), 3 * sizeof(double));
-
-  return (hashL + hashR) %
-         nkeys; /* ^ is symmetric so doesn't matter which is L and which is R */
+static int ehtable_vertex_id(struct edge_hashtable *eht, struct vector3 *v) {
+  int mask = eht->nvertex_keys - 1;
+  int i = (int)(jenkins_hash((ub1 *)v, sizeof(struct vector3)) & mask);
+  while (eht->vertices[i] != NULL) {
+    if (eht->vertices[i] == v ||
+        (eht->vertices[i]->x == v->x && eht->vertices[i]->y == v->y &&
+         eht->vertices[i]->z == v->z))
+      return i;
+    i = (i + 1) & mask;
+  }
+  eht->vertices[i] = v;
+  return i;
 }
 
 /***************************************************************************
 ehtable_init:
   In: eht: pointer to an edge_hashtable struct
-      nkeys: number of keys that the hash table uses
+      nfaces: number of faces whose edges will be stored
   Out: Returns 0 on success, 1 on failure.
-       Hash table is initialized.
+       Hash table is initialized.  Both the vertex and the edge tables get
+       at least four slots per face, so they are never more than three
+       quarters full.
 ***************************************************************************/
+int ehtable_init(struct edge_hashtable *eht, int nfaces) {
+  int nkeys = 4;
+  while (nkeys < 4 * nfaces)
+    nkeys <<= 1;
 
-int ehtable_init(struct edge_hashtable *eht, int nkeys) {
   eht->nkeys = nkeys;
+  eht->nvertex_keys = nkeys;
   eht->stored = 0;
   eht->distinct = 0;
   eht->data =
       CHECKED_MALLOC_ARRAY_NODIE(struct poly_edge, nkeys, "edge hash table");
   if (eht->data == NULL)
     return 1;
+  eht->vertices = CHECKED_MALLOC_ARRAY_NODIE(struct vector3 *, nkeys,
+                                             "edge vertex hash table");
+  if (eht->vertices == NULL) {
+    free(eht->data);
+    eht->data = NULL;
+    return 1;
+  }
 
   for (int i = 0; i < nkeys; i++) {
     eht->data[i].next = NULL;
     eht->data[i].n = 0;
     eht->data[i].face[0] = eht->data[i].face[1] = -1;
+    eht->vertices[i] = NULL;
   }
 
   return 0;
@@ -167,6 +179,7 @@ struct poly_edge* create_new_poly_edge(struct poly_edge* list) {
 
   pei->next = list->next;
   list->next = pei;
+  pei->key = list->key;
   pei->n = 0;
   pei->face[0] = -1;
   pei->face[1] = -1;
@@ -178,72 +191,55 @@ struct poly_edge* create_new_poly_edge(struct poly_edge* list) {
 /***************************************************************************
 ehtable_add:
   In: pointer to an edge_hashtable struct
-      pointer to the poly_edge to add
+      edge j of face i
+      the two vertices of the edge
   Out: Returns 0 on success, 1 on failure.
-       Edge is added to the hash table.
+       Edge is added to the hash table.  Edges are the same if their
+       vertex positions are, whichever way round they are traversed; faces
+       beyond the second one sharing an edge are chained onto its slot.
 ***************************************************************************/
-int ehtable_add(struct edge_hashtable *eht, struct poly_edge *pe) {
-
-  int i = edge_hash(pe, eht->nkeys);
-  struct poly_edge *pep = &(eht->data[i]);
-
-  while (pep != NULL) {
+int ehtable_add(struct edge_hashtable *eht, int i, int j, struct vector3 *v1,
+                struct vector3 *v2) {
+  unsigned long long id1 = (unsigned long long)ehtable_vertex_id(eht, v1);
+  unsigned long long id2 = (unsigned long long)ehtable_vertex_id(eht, v2);
+  unsigned long long key = (id1 < id2) ? (id1 << 32) | id2 : (id2 << 32) | id1;
+
+  int mask = eht->nkeys - 1;
+  int k = edge_hash(key, eht->nkeys);
+  while (eht->data[k].n != 0 && eht->data[k].key != key)
+    k = (k + 1) & mask;
+
+  struct poly_edge *pep = &(eht->data[k]);
+  for (;;) {
     if (pep->n == 0) /* New entry */
     {
       pep->n = 1;
-      pep->face[0] = pe->face[0];
-      pep->edge[0] = pe->edge[0];
-      pep->v1x = pe->v1x;
-      pep->v1y = pe->v1y;
-      pep->v1z = pe->v1z;
-      pep->v2x = pe->v2x;
-      pep->v2y = pe->v2y;
-      pep->v2z = pe->v2z;
+      pep->key = key;
+      pep->face[0] = i;
+      pep->edge[0] = j;
       eht->stored++;
       eht->distinct++;
       return 0;
     }
 
-    if (edge_equals(pep, pe)) /* This edge exists already ... */
+    if (pep->face[1] == -1) /* This edge exists already and we're the 2nd */
     {
-      if (pep->face[1] == -1) /* ...and we're the 2nd one */
-      {
-        pep->face[1] = pe->face[0];
-        pep->edge[1] = pe->edge[0];
-        pep->n++;
-        eht->stored++;
-        return 0;
-      } else /* ...or we're 3rd and need more space */
-      {
-        if (pep->next != NULL) {
-          if (edge_equals(pep->next, pe)) /* Space already there */
-          {
-            pep->n++;
-            pep = pep->next;
-            continue; /* Use space on next loop */
-          }
-        }
+      pep->face[1] = i;
+      pep->edge[1] = j;
+      pep->n++;
+      eht->stored++;
+      return 0;
+    }
 
-        struct poly_edge *pei = create_new_poly_edge(pep);
-        if (pei == NULL) {
-          return 1;
-        }
-        pep->n++;
-        pep = pei;
-        eht->distinct--; /* Not really distinct, just need more space */
-      }
-    } else if (pep->next != NULL) {
-      pep = pep->next;
-    } else { /* Hit end of list, so make space for use next loop. */
-      struct poly_edge *pei = create_new_poly_edge(pep);
-      if (pei == NULL) {
+    /* ...or we're 3rd and need more space */
+    if (pep->next == NULL) {
+      if (create_new_poly_edge(pep) == NULL)
         return 1;
-      }
-      pep = pei;
+      eht->distinct--; /* Not really distinct, just need more space */
     }
+    pep->n++;
+    pep = pep->next;
   }
-
-  return 0;
 }
 
 /***************************************************************************
@@ -264,7 +260,10 @@ void ehtable_kill(struct edge_hashtable *eht) {
   }
   free(eht->data);
   eht->data = NULL;
+  free(eht->vertices);
+  eht->vertices = NULL;
   eht->nkeys = 0;
+  eht->nvertex_keys = 0;
 }
 
 /**************************************************************************\
@@ -469,44 +468,57 @@ surface_net:
         simulation is not guaranteed to be well-defined.
 ***************************************************************************/
 int surface_net(struct wall **facelist, int nfaces) {
-  struct edge *e;
-  int is_closed = 1;
-
   struct edge_hashtable eht;
-  int nkeys = (3 * nfaces) / 2;
-  if (ehtable_init(&eht, nkeys))
+  if (hash_surface_edges(facelist, nfaces, &eht))
+    return 1;
+  return connect_surface_edges(facelist, &eht);
+}
+
+/***************************************************************************
+hash_surface_edges:
+  In: array of pointers to walls
+      integer length of array
+      the edge hash table to fill
+  Out: 0 on success, 1 on malloc failure.  Every edge of the walls is added
+       to the hash table.  Only the table is written, so objects may be
+       hashed concurrently.
+***************************************************************************/
+static int hash_surface_edges(struct wall **facelist, int nfaces,
+                              struct edge_hashtable *eht) {
+  if (ehtable_init(eht, nfaces))
     return 1;
 
   for (int i = 0; i < nfaces; i++) {
     if (facelist[i] == NULL)
       continue;
 
-    int k;
-    int nedge = 3;
-    for (int j = 0; j < nedge; j++) {
-
-      if (j + 1 < nedge)
-        k = j + 1;
-      else
-        k = 0;
-
-      struct poly_edge pe;
-      pe.v1x = facelist[i]->vert[j]->x;
-      pe.v1y = facelist[i]->vert[j]->y;
-      pe.v1z = facelist[i]->vert[j]->z;
-      pe.v2x = facelist[i]->vert[k]->x;
-      pe.v2y = facelist[i]->vert[k]->y;
-      pe.v2z = facelist[i]->vert[k]->z;
-      pe.face[0] = i;
-      pe.edge[0] = j;
-
-      if (ehtable_add(&eht, &pe))
+    for (int j = 0; j < 3; j++) {
+      int k = (j + 1 < 3) ? j + 1 : 0;
+      if (ehtable_add(eht, i, j, facelist[i]->vert[j], facelist[i]->vert[k])) {
+        ehtable_kill(eht);
         return 1;
+      }
     }
   }
 
-  for (int i = 0; i < nkeys; i++) {
-    struct poly_edge *pep = (eht.data + i);
+  return 0;
+}
+
+/***************************************************************************
+connect_surface_edges:
+  In: array of pointers to walls
+      the edge hash table filled by hash_surface_edges
+  Out: -1 if the surface is a manifold, 0 if it is not, 1 on malloc failure
+       The walls are connected across their shared edges, which are
+       allocated from the walls' storages, and the hash table is freed.
+***************************************************************************/
+static int connect_surface_edges(struct wall **facelist,
+                                 struct edge_hashtable *eht) {
+  struct edge *e;
+  int is_closed = 1;
+
+  for (int i = 0; i < eht->nkeys; i++) {
+    struct poly_edge *pep = (eht->data + i);
     while (pep != NULL) {
       if (pep->n > 2) {
         refine_edge_pairs(pep, facelist);
@@ -515,8 +527,6 @@ int surface_net(struct wall **facelist, int nfaces) {
         if (pep->face[0] != -1 && pep->face[1] != -1) {
           if (compatible_edges(facelist, pep->face[0], pep->edge[0], pep->face[1],
                                pep->edge[1])) {
-            facelist[pep->face[0]]->nb_walls[pep->edge[0]] = facelist[pep->face[1]];
-            facelist[pep->face[1]]->nb_walls[pep->edge[1]] = facelist[pep->face[0]];
             e = (struct edge *)CHECKED_MEM_GET_NODIE(
                 facelist[pep->face[0]]->birthplace->join, "edge");
             if (e == NULL)
@@ -548,7 +558,7 @@ int surface_net(struct wall **facelist, int nfaces) {
     }
   }
 
-  ehtable_kill(&eht);
+  ehtable_kill(eht);
   return -is_closed; /* We use 1 to indicate malloc failure so return 0/-1 */
 }
 
@@ -668,17 +678,94 @@ int sharpen_object(struct object *parent) {
   return 0;
 }
 
+/***************************************************************************
+collect_polygon_objects:
+  In: parent: pointer to an object
+      objs: array to store the polygon objects in, or NULL to count them
+      n_objs: number of objects stored so far
+  Out: The number of polygon objects stored so far, including those in and
+       below parent, in the order sharpen_object visits them.
+***************************************************************************/
+static int collect_polygon_objects(struct object *parent, struct object **objs,
+                                   int n_objs) {
+  if (parent->object_type == POLY_OBJ || parent->object_type == BOX_OBJ) {
+    if (objs != NULL)
+      objs[n_objs] = parent;
+    ++n_objs;
+  } else if (parent->object_type == META_OBJ) {
+    for (struct object *o = parent->first_child; o != NULL; o = o->next)
+      n_objs = collect_polygon_objects(o, objs, n_objs);
+  }
+  return n_objs;
+}
+
+/* Edge hashing of all polygon objects, one object per task */
+struct sharpen_pass {
+  struct object **objs;
+  struct edge_hashtable *tables;
+  int *status;
+};
+
+static void hash_object_edges_task(void *ctx, int task) {
+  struct sharpen_pass *pass = (struct sharpen_pass *)ctx;
+  struct object *o = pass->objs[task];
+  pass->status[task] =
+      hash_surface_edges(o->wall_p, o->n_walls, &pass->tables[task]);
+}
+
 /***************************************************************************
 sharpen_world:
-  In: nothing.  Assumes if there are polygon objects then they have been
-      initialized and placed in the world in their correct memory locations.
-  Out: 0 on success, 1 on failure.  Adds edges to every object.
+  In: world: simulation state.  Assumes if there are polygon objects then
+             they have been initialized and placed in the world in their
+             correct memory locations.
+      pool: thread pool to hash the edges of the objects on, or NULL
+  Out: 0 on success, 1 on failure.  Adds edges to every object.  With a
+       pool, the edges of all objects are hashed concurrently; the edges
+       are then connected one object at a time in the serial order, since
+       they are allocated from the shared storages.
 ***************************************************************************/
-int sharpen_world(struct volume *world) {
-  for (struct object *o = world->root_instance; o != NULL; o = o->next) {
-    if (sharpen_object(o))
-      return 1;
+int sharpen_world(struct volume *world, struct thread_pool *pool) {
+  int n_objs = 0;
+  if (pool != NULL) {
+    for (struct object *o = world->root_instance; o != NULL; o = o->next)
+      n_objs = collect_polygon_objects(o, NULL, n_objs);
+  }
+
+  if (n_objs < 2) {
+    for (struct object *o = world->root_instance; o != NULL; o = o->next) {
+      if (sharpen_object(o))
+        return 1;
+    }
+    return 0;
   }
+
+  struct sharpen_pass pass;
+  pass.objs = CHECKED_MALLOC_ARRAY(struct object *, n_objs, "polygon objects");
+  pass.tables = CHECKED_MALLOC_ARRAY(struct edge_hashtable, n_objs,
+                                     "edge hash tables");
+  pass.status = CHECKED_MALLOC_ARRAY(int, n_objs, "edge hashing status");
+  n_objs = 0;
+  for (struct object *o = world->root_instance; o != NULL; o = o->next)
+    n_objs = collect_polygon_objects(o, pass.objs, n_objs);
+
+  thread_pool_run(pool, n_objs, hash_object_edges_task, &pass);
+
+  for (int i = 0; i < n_objs; ++i) {
+    struct object *o = pass.objs[i];
+    int closed = pass.status[i] ? 1
+                                : connect_surface_edges(o->wall_p,
+                                                        &pass.tables[i]);
+    if (closed == 1) {
+      mcell_allocfailed(
+          "Failed to connect walls of object %s along shared edges.",
+          o->sym->name);
+    }
+    o->is_closed = -closed;
+  }
+
+  free(pass.objs);
+  free(pass.tables);
+  free(pass.status);
   return 0;
 }
 
@@ -869,6 +956,61 @@ struct wall *traverse_surface(struct wall *here, struct vector2 *loc, int which,
   }
 }
 
+/***************************************************************************
+traverse_surface_pair:
+  In: here: a wall
+      loc: a point in the coordinate system of that wall
+      end: another point in the coordinate system of that wall
+      which: which edge to travel off of
+      newloc: a vector to set for the new wall
+      newend: another vector to set for the new wall
+  Out: the same as traverse_surface for loc and newloc, except that end is
+       carried across to newend by the same transform.  Moving points
+       across an edge needs both ends of the displacement, and this reads
+       the edge and picks the direction of its transform only once.
+***************************************************************************/
+struct wall *traverse_surface_pair(struct wall *here, struct vector2 *loc,
+                                   struct vector2 *end, int which,
+                                   struct vector2 *newloc,
+                                   struct vector2 *newend) {
+  double u, v;
+
+  struct edge *e = here->edges[which];
+
+  if (e == NULL)
+    return NULL;
+
+  double c = e->cos_theta;
+  double s = e->sin_theta;
+  if (e->forward == here) {
+    /* Apply forward transform: rotation, then translation */
+    u = c * loc->u + s * loc->v;
+    v = -s * loc->u + c * loc->v;
+    newloc->u = u + e->translate.u;
+    newloc->v = v + e->translate.v;
+
+    u = c * end->u + s * end->v;
+    v = -s * end->u + c * end->v;
+    newend->u = u + e->translate.u;
+    newend->v = v + e->translate.v;
+
+    return e->backward;
+  } else {
+    /* Apply inverse transform: inverse translation, then inverse rotation */
+    u = loc->u - e->translate.u;
+    v = loc->v - e->translate.v;
+    newloc->u = c * u - s * v;
+    newloc->v = s * u + c * v;
+
+    u = end->u - e->translate.u;
+    v = end->v - e->translate.v;
+    newend->u = c * u - s * v;
+    newend->v = s * u + c * v;
+
+    return e->forward;
+  }
+}
+
 /***************************************************************************
 is_manifold:
   In: r: A region. This region must already be painted on walls. The edges must
@@ -909,12 +1051,12 @@ int is_manifold(struct region *r, int count_regions_flag) {
     w = wall_array[n_wall];
     if (count_regions_flag) {
       for (int nb = 0; nb < 3; nb++) {
-        if (w->nb_walls[nb] == NULL) {
+        if (wall_neighbor(w, nb) == NULL) {
           mcell_error_nodie("BARE EDGE on wall %u edge %d.", n_wall, nb);
           return 0; /* Bare edge--not a manifold */
         }
 
-        for (rl = w->nb_walls[nb]->counting_regions; rl != NULL; rl = rl->next) {
+        for (rl = wall_neighbor(w, nb)->counting_regions; rl != NULL; rl = rl->next) {
           if (rl->reg == r)
             break;
         }
@@ -996,6 +1138,7 @@ collide_wall:
         the value of t returned, not hitpt (reflections happen slightly
         early to avoid rounding errors with superimposed planes).
 ***************************************************************************/
+TARGET_CLONES
 int collide_wall(struct vector3 *point, struct vector3 *move, struct wall *face,
                  double *t, struct vector3 *hitpt, int update_move,
                  struct rng_state *rng, struct notifications *notify,
@@ -1187,6 +1330,44 @@ int collide_mol(struct vector3 *point, struct vector3 *move,
   return COLLIDE_VOL_M;
 }
 
+/***************************************************************************
+collide_mol_batch:
+  In: point: starting coordinate
+      move: vector to move along
+      px, py, pz: positions of the (volume) molecules we're checking for a
+                  collision, one array per coordinate
+      n: number of molecules, at most COLLIDE_MOL_BATCH
+      rx_radius_3d: interaction radius
+      hit: set to 1 for each molecule that is hit, 0 otherwise
+      t: set to the time of collision for each molecule that is hit
+  Out: None.  This is collide_mol for n molecules at once, written without
+       branches so that the compiler turns it into vector code.  The
+       arithmetic is the same, operation for operation, so the molecules
+       hit and the collision times match collide_mol exactly; the hit
+       point of a hit is point + t * move, as in collide_mol.
+***************************************************************************/
+void collide_mol_batch(struct vector3 const *point, struct vector3 const *move,
+                       double const *px, double const *py, double const *pz,
+                       int n, double rx_radius_3d, int *hit, double *t) {
+  double sigma2 = rx_radius_3d * rx_radius_3d;
+  double movelen2 = move->x * move->x + move->y * move->y + move->z * move->z;
+  double r_movelen2_sigma2 = movelen2 * sigma2;
+
+  for (int k = 0; k < n; k++) {
+    double dx = px[k] - point->x;
+    double dy = py[k] - point->y;
+    double dz = pz[k] - point->z;
+    double d = dx * move->x + dy * move->y + dz * move->z;
+    double dirlen2 = dx * dx + dy * dy + dz * dz;
+
+    /* Not behind us, not further than the displacement, and not missing the
+     * interaction disk */
+    hit[k] = !(d < 0) & !(d > movelen2) &
+             !(movelen2 * dirlen2 - d * d > r_movelen2_sigma2);
+    t[k] = d / movelen2;
+  }
+}
+
 /***************************************************************************
 wall_in_box:
   In: array of pointers to vertices for wall (should be 3)
@@ -1388,13 +1569,12 @@ init_tri_wall:
 void init_tri_wall(struct object *objp, int side, struct vector3 *v0,
                    struct vector3 *v1, struct vector3 *v2) {
   struct wall *w; /* The wall we're working with */
-  double f, fx, fy, fz;
-  struct vector3 vA, vB, vX;
 
   w = &objp->walls[side];
   w->next = NULL;
   w->surf_class_head = NULL;
   w->num_surf_classes = 0;
+  w->rx_cache = NULL;
 
   w->side = side;
 
@@ -1405,9 +1585,33 @@ void init_tri_wall(struct object *objp, int side, struct vector3 *v0,
   w->edges[0] = NULL;
   w->edges[1] = NULL;
   w->edges[2] = NULL;
-  w->nb_walls[0] = NULL;
-  w->nb_walls[1] = NULL;
-  w->nb_walls[2] = NULL;
+
+  init_wall_geometry(w);
+
+  w->grid = NULL;
+
+  w->parent_object = objp;
+  w->flags = 0;
+  w->border_edges = 0;
+  w->counting_regions = NULL;
+  w->counting_set = NULL;
+}
+
+/***************************************************************************
+init_wall_geometry:
+  In: a wall whose vertices are set
+  Out: No return value.  The wall's area, normal vector, local coordinate
+       vectors and the coordinates of its vertices in them are computed
+       from its vertices.  Degenerate walls get zero vectors.
+***************************************************************************/
+void init_wall_geometry(struct wall *w) {
+  double f, fx, fy, fz;
+  struct vector3 vA, vB, vX;
+  struct vector3 *v0 = w->vert[0];
+  struct vector3 *v1 = w->vert[1];
+  struct vector3 *v2 = w->vert[2];
+
+  w->origin = *v0;
 
   vectorize(v0, v1, &vA);
   vectorize(v0, v2, &vB);
@@ -1433,12 +1637,6 @@ void init_tri_wall(struct object *objp, int side, struct vector3 *v0,
     w->uv_vert2.u = 0;
     w->uv_vert2.v = 0;
 
-    w->grid = NULL;
-
-    w->parent_object = objp;
-    w->flags = 0;
-    w->counting_regions = NULL;
-
     return;
   }
 
@@ -1477,12 +1675,6 @@ void init_tri_wall(struct object *objp, int side, struct vector3 *v0,
   w->uv_vert2.v = (w->vert[2]->x - w->vert[0]->x) * w->unit_v.x +
                   (w->vert[2]->y - w->vert[0]->y) * w->unit_v.y +
                   (w->vert[2]->z - w->vert[0]->z) * w->unit_v.z;
-
-  w->grid = NULL;
-
-  w->parent_object = objp;
-  w->flags = 0;
-  w->counting_regions = NULL;
 }
 
 /***************************************************************************
@@ -1493,8 +1685,8 @@ wall_bounding_box:
   Out: No return value.  The vectors are set to define the smallest box
        that contains the wall.
 ***************************************************************************/
-static void wall_bounding_box(struct wall *w, struct vector3 *llf,
-                              struct vector3 *urb) {
+void wall_bounding_box(struct wall *w, struct vector3 *llf,
+                       struct vector3 *urb) {
   llf->x = urb->x = w->vert[0]->x;
   llf->y = urb->y = w->vert[0]->y;
   llf->z = urb->z = w->vert[0]->z;
@@ -1572,12 +1764,14 @@ struct wall *localize_wall(struct wall *w, struct storage *stor) {
 /***************************************************************************
 distribute_wall:
   In: a wall belonging to an object
+      whether to copy the wall into local memory, or use it where it is
   Out: A pointer to the wall as copied into appropriate local memory, or
        NULL on memory allocation error.  Also, the wall is added to the
        appropriate wall lists for all subvolumes it intersects; if this
        fails due to memory allocation errors, NULL is also returned.
 ***************************************************************************/
-static struct wall *distribute_wall(struct volume *world, struct wall *w) {
+static struct wall *distribute_wall(struct volume *world, struct wall *w,
+                                    int localize) {
   struct wall *where_am_i;       /* Version of the wall in local memory */
   struct vector3 llf, urb, cent; /* Bounding box for wall */
   int x_max, x_min, y_max, y_min, z_max,
@@ -1635,7 +1829,8 @@ static struct wall *distribute_wall(struct volume *world, struct wall *w) {
 
   if ((z_max - z_min) * (y_max - y_min) * (x_max - x_min) == 1) {
     h = z_min + (world->nz_parts - 1) * (y_min + (world->ny_parts - 1) * x_min);
-    where_am_i = localize_wall(w, world->subvol[h].local_storage);
+    where_am_i = localize ? localize_wall(w, world->subvol[h].local_storage)
+                          : w;
     if (where_am_i == NULL)
       return NULL;
 
@@ -1660,7 +1855,8 @@ static struct wall *distribute_wall(struct volume *world, struct wall *w) {
 
   h = (k - 1) +
       (world->nz_parts - 1) * ((j - 1) + (world->ny_parts - 1) * (i - 1));
-  where_am_i = localize_wall(w, world->subvol[h].local_storage);
+  where_am_i = localize ? localize_wall(w, world->subvol[h].local_storage)
+                        : w;
   if (where_am_i == NULL)
     return NULL;
 
@@ -1699,32 +1895,18 @@ distribute_object:
 int distribute_object(struct volume *world, struct object *parent) {
   struct object *o; /* Iterator for child objects */
   int i;
-  long long vert_index; /* index of the vertex in the global array
-                     "world->all_vertices" */
 
   if (parent->object_type == BOX_OBJ || parent->object_type == POLY_OBJ) {
     for (i = 0; i < parent->n_walls; i++) {
       if (parent->wall_p[i] == NULL)
         continue; /* Wall removed. */
 
-      parent->wall_p[i] = distribute_wall(world, parent->wall_p[i]);
+      parent->wall_p[i] = distribute_wall(world, parent->wall_p[i], 1);
 
       if (parent->wall_p[i] == NULL)
         mcell_allocfailed("Failed to distribute wall %d on object %s.", i,
                           parent->sym->name);
 
-      /* create information about shared vertices */
-      if (world->create_shared_walls_info_flag) {
-        vert_index = (long long)(parent->wall_p[i]->vert[0] - world->all_vertices);
-        push_wall_to_list(&(world->walls_using_vertex[vert_index]),
-                          parent->wall_p[i]);
-        vert_index = (long long)(parent->wall_p[i]->vert[1] - world->all_vertices);
-        push_wall_to_list(&(world->walls_using_vertex[vert_index]),
-                          parent->wall_p[i]);
-        vert_index = (long long)(parent->wall_p[i]->vert[2] - world->all_vertices);
-        push_wall_to_list(&(world->walls_using_vertex[vert_index]),
-                          parent->wall_p[i]);
-      }
     }
     if (parent->walls != NULL) {
       free(parent->walls);
@@ -1740,11 +1922,24 @@ int distribute_object(struct volume *world, struct object *parent) {
   return 0;
 }
 
+/***************************************************************************
+redistribute_wall:
+  In: a wall in local memory, which has been removed from the wall lists of
+      the subvolumes
+  Out: 0 on success, 1 on memory allocation failure.  The wall is added to
+       the wall lists of all subvolumes it now intersects.  The wall planes
+       must be rebuilt afterwards.
+***************************************************************************/
+int redistribute_wall(struct volume *world, struct wall *w) {
+  return distribute_wall(world, w, 0) == NULL;
+}
+
 /***************************************************************************
 distribute_world:
   In: No arguments.
   Out: 0 on success, 1 on memory allocation failure.  Every geometric object
-       is distributed to local memory and into appropriate subvolumes.
+       is distributed to local memory and into appropriate subvolumes, and
+       the subvolumes get their wall planes and time step multipliers.
 ***************************************************************************/
 int distribute_world(struct volume *world) {
   struct object *o; /* Iterator for objects in the world */
@@ -1754,9 +1949,392 @@ int distribute_world(struct volume *world) {
       return 1;
   }
 
+  if (build_wall_planes(world))
+    return 1;
+  return assign_step_multipliers(world);
+}
+
+/***************************************************************************
+add_vertex_walls:
+  In: world: simulation state
+      parent: an object
+      fill: 0 to count the walls using each vertex, 1 to store them
+  Out: No return value.  On the counting pass vertex_wall_offsets[i] is
+       incremented for every wall using vertex i.  On the storing pass it
+       must hold the end of the walls of vertex i; the walls are stored
+       backwards from there, leaving it at the start.
+  Note: this function is recursive and is called on any children of the
+        object passed to it.
+***************************************************************************/
+static void add_vertex_walls(struct volume *world, struct object *parent,
+                             int fill) {
+  if (parent->object_type == BOX_OBJ || parent->object_type == POLY_OBJ) {
+    for (int i = 0; i < parent->n_walls; i++) {
+      struct wall *w = parent->wall_p[i];
+      if (w == NULL)
+        continue; /* Wall removed. */
+
+      for (int j = 0; j < 3; j++) {
+        long long vert_index = (long long)(w->vert[j] - world->all_vertices);
+        if (fill)
+          world->vertex_walls[--world->vertex_wall_offsets[vert_index]] = w;
+        else
+          world->vertex_wall_offsets[vert_index]++;
+      }
+    }
+  } else if (parent->object_type == META_OBJ) {
+    for (struct object *o = parent->first_child; o != NULL; o = o->next)
+      add_vertex_walls(world, o, fill);
+  }
+}
+
+/***************************************************************************
+build_vertex_wall_adjacency:
+  In: world: simulation state
+      n_vertices: length of the "all_vertices" array
+  Out: 0 on success, 1 on memory allocation failure.  The walls using each
+       vertex are stored in vertex_walls, indexed by vertex_wall_offsets.
+       The walls of a vertex come in the reverse of distribution order.
+       Must be redone whenever walls are created or destroyed.
+***************************************************************************/
+int build_vertex_wall_adjacency(struct volume *world, int n_vertices) {
+  free(world->vertex_wall_offsets);
+  free(world->vertex_walls);
+  world->vertex_walls = NULL;
+  if (!(world->vertex_wall_offsets = CHECKED_MALLOC_ARRAY_NODIE(
+            int, n_vertices + 1, "vertex wall offsets")))
+    return 1;
+  memset(world->vertex_wall_offsets, 0, sizeof(int) * (n_vertices + 1));
+
+  struct object *o;
+  for (o = world->root_instance; o != NULL; o = o->next)
+    add_vertex_walls(world, o, 0);
+
+  /* Running sums, so that each vertex starts out at the end of its walls */
+  for (int i = 1; i < n_vertices; i++)
+    world->vertex_wall_offsets[i] += world->vertex_wall_offsets[i - 1];
+  int total = (n_vertices > 0) ? world->vertex_wall_offsets[n_vertices - 1] : 0;
+  world->vertex_wall_offsets[n_vertices] = total;
+
+  if (!(world->vertex_walls = CHECKED_MALLOC_ARRAY_NODIE(
+            struct wall *, total > 0 ? total : 1, "walls using vertices")))
+    return 1;
+
+  for (o = world->root_instance; o != NULL; o = o->next)
+    add_vertex_walls(world, o, 1);
+
+  return 0;
+}
+
+/***************************************************************************
+build_wall_planes:
+  In: world: simulation state
+  Out: 0 on success, 1 on memory allocation failure.  Every subvolume gets
+       the planes of the walls in its wall list, in list order, for the
+       plane rejection test in next_wall_candidate.  Must be redone whenever
+       the wall lists change.
+***************************************************************************/
+int build_wall_planes(struct volume *world) {
+  destroy_wall_planes(world);
+
+  for (int i = 0; i < world->n_subvols; i++) {
+    struct subvolume *sv = &world->subvol[i];
+    int n = 0;
+    for (struct wall_list *wl = sv->wall_head; wl != NULL; wl = wl->next)
+      n++;
+    if (n == 0)
+      continue;
+
+    /* One block: four arrays of doubles padded to a whole batch, then the
+     * wall pointers */
+    int n_pad = (n + WALL_PLANE_BATCH - 1) / WALL_PLANE_BATCH * WALL_PLANE_BATCH;
+    char *block = (char *)CHECKED_MALLOC_NODIE(
+
+        4 * n_pad * sizeof(double) + n * sizeof(struct wall *),
+        "subvolume wall planes");
+    if (block == NULL)
+      return 1;
+
+    struct wall_planes *wp = &sv->wall_planes;
+    wp->nx = (double *)block;
+    wp->ny = wp->nx + n_pad;
+    wp->nz = wp->ny + n_pad;
+    wp->d = wp->nz + n_pad;
+    wp->wall = (struct wall **)(wp->d + n_pad);
+    wp->n = n;
+
+    int k = 0;
+    for (struct wall_list *wl = sv->wall_head; wl != NULL; wl = wl->next, k++) {
+      struct wall *w = wl->this_wall;
+      wp->nx[k] = w->normal.x;
+      wp->ny[k] = w->normal.y;
+      wp->nz[k] = w->normal.z;
+      wp->d[k] = w->d;
+      wp->wall[k] = w;
+    }
+    /* Padding planes are never looked at, but keep the batch arithmetic on
+     * defined values */
+    for (; k < n_pad; k++) {
+      wp->nx[k] = wp->ny[k] = wp->nz[k] = 0.0;
+      wp->d[k] = 0.0;
+    }
+  }
+  return 0;
+}
+
+/***************************************************************************
+destroy_wall_planes:
+  In: world: simulation state
+  Out: The wall planes of all subvolumes are freed.
+***************************************************************************/
+void destroy_wall_planes(struct volume *world) {
+  if (world->subvol == NULL)
+    return;
+  for (int i = 0; i < world->n_subvols; i++) {
+    struct subvolume *sv = &world->subvol[i];
+    free(sv->wall_planes.nx);
+    memset(&sv->wall_planes, 0, sizeof(struct wall_planes));
+  }
+}
+
+/***************************************************************************
+assign_step_multipliers:
+  In: world: simulation state
+  Out: 0 on success, 1 on memory allocation failure.  Every subvolume gets
+       its time step multiplier (see compute_displacement).  With
+       auto_step_multiplier above 1, a subvolume d subvolumes away from the
+       nearest one holding a wall (counting diagonal neighbours) gets d*d,
+       capped at auto_step_multiplier, so a molecule's longer step stays
+       about the size of the clear space around it; subvolumes with or next
+       to walls keep 1.  Subvolumes whose center lies inside one of the
+       step_multiplier_boxes then take the box's multiplier instead.  Must be
+       redone whenever the wall lists change.
+***************************************************************************/
+int assign_step_multipliers(struct volume *world) {
+  for (int i = 0; i < world->n_subvols; i++)
+    world->subvol[i].step_multiplier = 1;
+
+  if (world->auto_step_multiplier > 1) {
+    int nx = world->nx_parts - 1;
+    int ny = world->ny_parts - 1;
+    int nz = world->nz_parts - 1;
+    int *dist = CHECKED_MALLOC_ARRAY_NODIE(int, world->n_subvols,
+                                           "subvolume wall distances");
+    int *queue = CHECKED_MALLOC_ARRAY_NODIE(int, world->n_subvols,
+                                            "subvolume wall distances");
+    if (dist == NULL || queue == NULL) {
+      free(dist);
+      free(queue);
+      return 1;
+    }
+
+    /* Breadth first from the subvolumes holding walls; with no walls at
+     * all, every subvolume stays unreached and takes the cap */
+    int head = 0, tail = 0;
+    for (int h = 0; h < world->n_subvols; h++) {
+      dist[h] = (world->subvol[h].wall_head != NULL) ? 0 : INT_MAX;
+      if (dist[h] == 0)
+        queue[tail++] = h;
+    }
+    while (head < tail) {
+      int h = queue[head++];
+      int k = h % nz, j = (h / nz) % ny, i = h / (nz * ny);
+      for (int di = -1; di <= 1; di++)
+        for (int dj = -1; dj <= 1; dj++)
+          for (int dk = -1; dk <= 1; dk++) {
+            int a = i + di, b = j + dj, c = k + dk;
+            if (a < 0 || a >= nx || b < 0 || b >= ny || c < 0 || c >= nz)
+              continue;
+            int n = c + nz * (b + ny * a);
+            if (dist[n] == INT_MAX) {
+              dist[n] = dist[h] + 1;
+              queue[tail++] = n;
+            }
+          }
+    }
+
+    for (int h = 0; h < world->n_subvols; h++) {
+      double d = dist[h];
+      if (d > 1)
+        world->subvol[h].step_multiplier =
+            min2d(d * d, world->auto_step_multiplier);
+    }
+    free(dist);
+    free(queue);
+  }
+
+  for (struct step_multiplier_box *b = world->step_multiplier_boxes;
+       b != NULL; b = b->next) {
+    for (int h = 0; h < world->n_subvols; h++) {
+      struct subvolume *sv = &world->subvol[h];
+      double x = 0.5 * (world->x_fineparts[sv->llf.x] +
+                        world->x_fineparts[sv->urb.x]) * world->length_unit;
+      double y = 0.5 * (world->y_fineparts[sv->llf.y] +
+                        world->y_fineparts[sv->urb.y]) * world->length_unit;
+      double z = 0.5 * (world->z_fineparts[sv->llf.z] +
+                        world->z_fineparts[sv->urb.z]) * world->length_unit;
+      if (x >= b->llf.x && x <= b->urb.x && y >= b->llf.y && y <= b->urb.y &&
+          z >= b->llf.z && z <= b->urb.z)
+        sv->step_multiplier = b->multiplier;
+    }
+  }
   return 0;
 }
 
+/***************************************************************************
+wall_plane_batch_misses:
+  In: planes: wall planes of a subvolume
+      base: index of the first plane of the batch
+      point: starting coordinate
+      move: vector to move along
+      miss: filled in with 1 for each plane of the batch the ray cannot hit
+  Out: None.  This is the plane test at the top of collide_wall done for
+       WALL_PLANE_BATCH planes at once.  It is written without branches so
+       that the compiler turns it into vector code; the arithmetic is the
+       same, operation for operation, so the outcome matches collide_wall
+       exactly.
+***************************************************************************/
+static inline void wall_plane_batch_misses(struct wall_planes const *planes,
+                                           int base,
+                                           struct vector3 const *point,
+                                           struct vector3 const *move,
+                                           int miss[WALL_PLANE_BATCH]) {
+  double const *nx = planes->nx + base;
+  double const *ny = planes->ny + base;
+  double const *nz = planes->nz + base;
+  double const *pd = planes->d + base;
+  double px = point->x, py = point->y, pz = point->z;
+  double mx = move->x, my = move->y, mz = move->z;
+
+  for (int k = 0; k < WALL_PLANE_BATCH; k++) {
+    double dp = nx[k] * px + ny[k] * py + nz[k] * pz;
+    double dv = nx[k] * mx + ny[k] * my + nz[k] * mz;
+    double dd = dp - pd[k];
+    double e = dd + dv;
+    /* Start & end above plane */
+    double eps_above = (dd < EPS_C) ? 0.5 * dd : EPS_C;
+    /* Start & end below plane */
+    double eps_below = (dd > -EPS_C) ? 0.5 * dd : -EPS_C;
+    miss[k] = ((dd > 0.0) & (e > eps_above)) |
+              ((dd < 0.0) & (e < eps_below));
+  }
+}
+
+/***************************************************************************
+next_wall_candidate:
+  In: planes: wall planes of a subvolume
+      start: index to start looking at
+      point: starting coordinate
+      move: vector to move along
+      skip: wall to ignore (may be NULL)
+      notify: notification settings (for counting polygon tests)
+      polygon_tests: counter of ray-polygon tests
+  Out: Index of the first wall at or after start, other than skip, that
+       collide_wall could possibly hit, or planes->n if there is none.  Walls
+       passed over are those for which collide_wall would return
+       COLLIDE_MISS because the ray stays strictly on one side of the plane;
+       they are counted as tested, so results and statistics are identical
+       to calling collide_wall on every wall.
+***************************************************************************/
+TARGET_CLONES
+int next_wall_candidate(struct wall_planes const *planes, int start,
+                        struct vector3 const *point,
+                        struct vector3 const *move, struct wall *skip,
+                        struct notifications *notify,
+                        long long *polygon_tests) {
+  int n = planes->n;
+  long long rejected = 0;
+  int found = n;
+  int miss[WALL_PLANE_BATCH];
+
+  /* Batches are aligned so that the last one ends inside the padding */
+  for (int base = start - start % WALL_PLANE_BATCH; base < n && found == n;
+       base += WALL_PLANE_BATCH) {
+    wall_plane_batch_misses(planes, base, point, move, miss);
+    int begin = (base < start) ? start : base;
+    int end = (base + WALL_PLANE_BATCH < n) ? base + WALL_PLANE_BATCH : n;
+    for (int i = begin; i < end; i++) {
+      if (planes->wall[i] == skip)
+        continue;
+      if (!miss[i - base]) {
+        found = i;
+        break;
+      }
+      rejected++;
+    }
+  }
+
+  if (notify->final_summary == NOTIFY_FULL)
+    *polygon_tests += rejected;
+  return found;
+}
+
+/***************************************************************************
+disk_plane_batch_misses:
+  In: planes: wall planes of a subvolume
+      base: index of the first plane of the batch
+      loc: center of the interaction disk
+      mv: movement vector, normal to the disk
+      R2: square of the interaction radius
+      m2_i: reciprocal of the squared length of mv
+      miss: filled in with 1 for each plane of the batch the disk does not
+            reach
+  Out: None.  This is the first test of exact_disk, done for
+       WALL_PLANE_BATCH planes at once with the same arithmetic.
+***************************************************************************/
+static inline void disk_plane_batch_misses(struct wall_planes const *planes,
+                                           int base, struct vector3 const *loc,
+                                           struct vector3 const *mv, double R2,
+                                           double m2_i,
+                                           int miss[WALL_PLANE_BATCH]) {
+  double const *nx = planes->nx + base;
+  double const *ny = planes->ny + base;
+  double const *nz = planes->nz + base;
+  double const *pd = planes->d + base;
+
+  for (int k = 0; k < WALL_PLANE_BATCH; k++) {
+    double l_n = loc->x * nx[k] + loc->y * ny[k] + loc->z * nz[k];
+    double d = pd[k] - l_n;
+    double m_n = mv->x * nx[k] + mv->y * ny[k] + mv->z * nz[k];
+    miss[k] = (d * d >= R2 * (1 - m2_i * m_n * m_n));
+  }
+}
+
+/***************************************************************************
+next_disk_wall_candidate:
+  In: planes: wall planes of a subvolume
+      start: index to start looking at
+      loc: center of the interaction disk
+      mv: movement vector, normal to the disk
+      R2: square of the interaction radius
+      m2_i: reciprocal of the squared length of mv
+  Out: Index of the first wall at or after start whose plane comes within
+       the interaction disk, or planes->n if there is none.  The walls
+       passed over are exactly those exact_disk would ignore as too far
+       away.
+***************************************************************************/
+TARGET_CLONES
+int next_disk_wall_candidate(struct wall_planes const *planes, int start,
+                             struct vector3 const *loc,
+                             struct vector3 const *mv, double R2,
+                             double m2_i) {
+  int n = planes->n;
+  int miss[WALL_PLANE_BATCH];
+
+  /* Batches are aligned so that the last one ends inside the padding */
+  for (int base = start - start % WALL_PLANE_BATCH; base < n;
+       base += WALL_PLANE_BATCH) {
+    disk_plane_batch_misses(planes, base, loc, mv, R2, m2_i, miss);
+    int begin = (base < start) ? start : base;
+    int end = (base + WALL_PLANE_BATCH < n) ? base + WALL_PLANE_BATCH : n;
+    for (int i = begin; i < end; i++) {
+      if (!miss[i - base])
+        return i;
+    }
+  }
+  return n;
+}
+
 /***************************************************************************
 closest_pt_point_triangle:
   In:  p - point
@@ -1953,9 +2531,12 @@ static int vacuum_from_regions(struct volume *world,
       if ((smp->properties->flags & (COUNT_CONTENTS | COUNT_ENCLOSED)) != 0)
         count_region_from_scratch(world, (struct abstract_molecule *)smp, NULL,
                                   -1, NULL, smp->grid->surface, smp->t, NULL);
+      mol_id_index_forget(world->mol_id_index, (struct abstract_molecule *)smp);
+      release_molecule_graph((struct abstract_molecule *)smp);
       smp->properties = NULL;
       p->grid->sm_list[p->index]->sm = NULL;
       p->grid->n_occupied--;
+      set_bit(p->grid->vacant, p->index, 1);
       if (smp->flags & IN_SCHEDULE) {
         smp->grid->subvol->local_storage->timer->defunct_count++; /* Tally for
                                                                     garbage
@@ -2019,17 +2600,26 @@ int release_onto_regions(struct volume *world, struct release_site_obj *rso,
           n * (((double)(success + failure + 2)) / ((double)(success + 1)));
     }
     if (seek_cost < pick_cost) {
-      A = rng_dbl(world->rng) * max_A;
-      i = bisect_high(rrd->cum_area_list, rrd->n_walls_included, A);
+      /* Draw a wall from the alias table; the unused part of the same
+         deviate picks the position on that wall */
+      A = rng_dbl(world->rng) * rrd->n_walls_included;
+      i = (int)A;
+      if (i >= rrd->n_walls_included)
+        i = rrd->n_walls_included - 1;
+      A -= i;
+      if (A < rrd->alias_prob[i]) {
+        A /= rrd->alias_prob[i];
+      } else {
+        A = (A - rrd->alias_prob[i]) / (1 - rrd->alias_prob[i]);
+        i = rrd->alias_index[i];
+      }
       w = rrd->owners[rrd->obj_index[i]]->wall_p[rrd->wall_index[i]];
 
       if (w->grid == NULL) {
         if (create_grid(world, w, NULL))
           return 1;
       }
-      if (i)
-        A -= rrd->cum_area_list[i - 1];
-      grid_index = (unsigned int)((w->grid->n * w->grid->n) * (A / w->area));
+      grid_index = (unsigned int)((w->grid->n * w->grid->n) * A);
       if (grid_index >= w->grid->n_tiles) {
         grid_index = w->grid->n_tiles - 1;
       }
@@ -2042,7 +2632,7 @@ int release_onto_regions(struct volume *world, struct release_site_obj *rso,
         struct vector3 pos3d = {.x = 0, .y = 0, .z = 0};
         if (place_single_molecule(world, w, grid_index, sm->properties,
                                   sm->graph_data, sm->flags, rso->orientation, sm->t, sm->t2,
-                                  sm->birthday, sm->periodic_box, &pos3d) == NULL) {
+                                  sm->birthday, &sm->periodic_box, &pos3d) == NULL) {
           struct vector3 llf, urb;
           if (world->periodic_box_obj) {
             struct polygon_object *p = (struct polygon_object*)(world->periodic_box_obj->contents);
@@ -2122,7 +2712,7 @@ int release_onto_regions(struct volume *world, struct release_site_obj *rso,
           if (place_single_molecule(world, this_rrd->grid->surface,
                                     this_rrd->index, sm->properties, sm->graph_data, sm->flags,
                                     rso->orientation, sm->t, sm->t2,
-                                    sm->birthday, sm->periodic_box, &pos3d) == NULL) {
+                                    sm->birthday, &sm->periodic_box, &pos3d) == NULL) {
             return 1;
             }
             //JJT: copy over nfsim graph pattern information
@@ -2223,12 +2813,7 @@ struct surface_molecule *place_single_molecule(struct volume *state,
   new_sm->s_pos.v = s_pos.v;
   new_sm->properties = spec;
   new_sm->graph_data = graph;
-  initialize_diffusion_function((struct abstract_molecule *)new_sm);
-  new_sm->periodic_box = CHECKED_MALLOC_STRUCT(struct periodic_image,
-    "periodic image descriptor");
-  new_sm->periodic_box->x = periodic_box->x;
-  new_sm->periodic_box->y = periodic_box->y;
-  new_sm->periodic_box->z = periodic_box->z;
+  new_sm->periodic_box = *periodic_box;
 
   if (orientation == 0)
     new_sm->orient = (rng_uint(state->rng) & 1) ? 1 : -1;
@@ -2237,6 +2822,7 @@ struct surface_molecule *place_single_molecule(struct volume *state,
 
   new_sm->grid = w->grid;
 
+  own_grid_tiles(w->grid);
   if (w->grid->sm_list[grid_index] == NULL) {
     struct surface_molecule_list *sm_entry = CHECKED_MALLOC_STRUCT(
       struct surface_molecule_list, "surface molecule list");
@@ -2246,10 +2832,12 @@ struct surface_molecule *place_single_molecule(struct volume *state,
   w->grid->sm_list[grid_index]->sm = new_sm;
   w->grid->n_occupied++;
   new_sm->properties->population++;
+  mol_id_index_set(state->mol_id_index, (struct abstract_molecule *)new_sm);
+  acquire_molecule_graph((struct abstract_molecule *)new_sm);
 
   new_sm->flags = flags;
 
-  if (new_sm->get_space_step(new_sm) > 0)
+  if (get_space_step(new_sm) > 0)
     new_sm->flags |= ACT_DIFFUSE;
 
   if ((new_sm->properties->flags & COUNT_ENCLOSED) != 0)
@@ -2258,7 +2846,7 @@ struct surface_molecule *place_single_molecule(struct volume *state,
   if (new_sm->properties->flags & (COUNT_CONTENTS | COUNT_ENCLOSED))
     count_region_from_scratch(state, (struct abstract_molecule *)new_sm, NULL,
                               1, NULL, new_sm->grid->surface, new_sm->t,
-                              new_sm->periodic_box);
+                              &new_sm->periodic_box);
 
   if (schedule_add(gsv->local_storage->timer, new_sm)) {
     mcell_allocfailed("Failed to add volume molecule '%s' to scheduler.",
@@ -2314,7 +2902,7 @@ find_nbr_walls_shared_one_vertex:
    In: the origin wall
        array with information about which vertices of the origin wall
           are shared with neighbor wall (they are indices in the
-          global "world->walls_using_vertex" array).
+          global "world->all_vertices" array).
    Out: linked list of the neighbor walls that have only one common
         vertex with the origin wall (not edge-to-edge walls, but
         vertex-to-vertex walls).
@@ -2324,7 +2912,6 @@ struct wall_list *find_nbr_walls_shared_one_vertex(struct volume *world,
                                                    struct wall *origin,
                                                    long long int *shared_vert) {
   int i;
-  struct wall_list *wl;
   struct wall_list *head = NULL;
 
   if (!world->create_shared_walls_info_flag)
@@ -2333,13 +2920,14 @@ struct wall_list *find_nbr_walls_shared_one_vertex(struct volume *world,
 
   for (i = 0; i < 3; i++) {
     if (shared_vert[i] >= 0) {
-      for (wl = world->walls_using_vertex[shared_vert[i]]; wl != NULL;
-           wl = wl->next) {
-        if (wl->this_wall == origin)
+      int end = world->vertex_wall_offsets[shared_vert[i] + 1];
+      for (int k = world->vertex_wall_offsets[shared_vert[i]]; k < end; k++) {
+        struct wall *w = world->vertex_walls[k];
+        if (w == origin)
           continue;
 
-        if (!walls_share_full_edge(origin, wl->this_wall)) {
-          push_wall_to_list(&head, wl->this_wall);
+        if (!walls_share_full_edge(origin, w)) {
+          push_wall_to_list(&head, w);
         }
       }
     }
@@ -2575,12 +3163,9 @@ find_restricted_regions_by_object(struct volume *world, struct object *obj,
     }
 
     /* find any wall that belongs to this region */
-    for (i = 0; i < obj->n_walls; i++) {
-      if (get_bit(rp->membership, i)) {
-        wall_idx = i;
-        break;
-      }
-    }
+    i = next_set_bit(rp->membership, 0);
+    if (i >= 0 && i < obj->n_walls)
+      wall_idx = i;
 
     if (wall_idx < 0)
       mcell_internal_error("Cannot find wall in the region.");
@@ -2647,12 +3232,9 @@ int are_restricted_regions_for_species_on_object(struct volume *world,
     }
 
     /* find any wall that belongs to this region */
-    for (int i = 0; i < obj->n_walls; i++) {
-      if (get_bit(rp->membership, i)) {
-        wall_idx = i;
-        break;
-      }
-    }
+    int i = next_set_bit(rp->membership, 0);
+    if (i >= 0 && i < obj->n_walls)
+      wall_idx = i;
 
     if (wall_idx < 0) {
       mcell_internal_error("Cannot find wall in the region.");
@@ -2677,50 +3259,78 @@ int are_restricted_regions_for_species_on_object(struct volume *world,
   return 0;
 }
 
+/* Bit of border_edges telling that the other bits have been looked up */
+#define BORDER_EDGES_KNOWN 0x08
+
 /***********************************************************************
-is_wall_edge_region_border:
+find_region_border_edges:
   In: wall
-      wall's edge
-  Out: 1 if the edge is a region's border, and 0 - otherwise.
-  Note: we do not specify any particular region here, any region will
-        suffice
+      list of regions of the wall
+  Out: a bit mask of the wall's edges that are a border of any of the
+       regions
 ************************************************************************/
-int is_wall_edge_region_border(struct wall *this_wall, struct edge *this_edge) {
-  struct region_list *rlp, *rlp_head;
-  struct region *rp;
-  void *key;
-  unsigned int keyhash;
-
-  int is_region_border = 0; /* flag */
-
-  rlp_head = find_region_by_wall(this_wall);
-
-  /* If this wall is not a part of any region (note that we do not consider
-     region called ALL here) */
-  if (rlp_head == NULL)
-    return is_region_border;
-
-  for (rlp = rlp_head; rlp != NULL; rlp = rlp->next) {
-    rp = rlp->reg;
+static int find_region_border_edges(struct wall *this_wall,
+                                    struct region_list *rlp_head) {
+  int border_edges = 0;
 
+  for (struct region_list *rlp = rlp_head; rlp != NULL; rlp = rlp->next) {
+    struct region *rp = rlp->reg;
     if (rp->boundaries == NULL)
       mcell_internal_error("Region '%s' of the object '%s' has no boundaries.",
                            rp->region_last_name,
                            this_wall->parent_object->sym->name);
 
-    keyhash = (unsigned int)(intptr_t)(this_edge);
-    key = (void *)(this_edge);
-
-    if (pointer_hash_lookup(rp->boundaries, key, keyhash)) {
-      is_region_border = 1;
-      break;
+    for (int i = 0; i < 3; i++) {
+      struct edge *e = this_wall->edges[i];
+      if (e != NULL &&
+          pointer_hash_lookup(rp->boundaries, (void *)e,
+                              (unsigned int)(intptr_t)e))
+        border_edges |= 1 << i;
     }
   }
 
-  if (rlp_head != NULL)
-    delete_void_list((struct void_list *)rlp_head);
+  return border_edges;
+}
 
-  return is_region_border;
+/***********************************************************************
+wall_edge_index:
+  In: wall
+      edge
+  Out: the index (0-2) of the edge in the wall, or -1 if it is not one
+       of the wall's edges
+************************************************************************/
+static int wall_edge_index(struct wall *this_wall, struct edge *this_edge) {
+  for (int i = 0; i < 3; i++) {
+    if (this_wall->edges[i] == this_edge)
+      return i;
+  }
+  return -1;
+}
+
+/***********************************************************************
+is_wall_edge_region_border:
+  In: wall
+      wall's edge
+  Out: 1 if the edge is a region's border, and 0 - otherwise.
+  Note: we do not specify any particular region here, any region will
+        suffice.  The borders of all edges of the wall are looked up
+        together the first time and kept in the wall's border_edges.
+************************************************************************/
+int is_wall_edge_region_border(struct wall *this_wall, struct edge *this_edge) {
+  int i = wall_edge_index(this_wall, this_edge);
+  if (i < 0)
+    return 0;
+
+  if ((this_wall->border_edges & BORDER_EDGES_KNOWN) == 0) {
+    /* Note that we do not consider region called ALL here */
+    struct region_list *rlp_head = find_region_by_wall(this_wall);
+    this_wall->border_edges =
+        BORDER_EDGES_KNOWN | find_region_border_edges(this_wall, rlp_head);
+    if (rlp_head != NULL)
+      delete_void_list((struct void_list *)rlp_head);
+  }
+
+  return (this_wall->border_edges >> i) & 1;
 }
 
 /***********************************************************************
@@ -2732,45 +3342,41 @@ is_wall_edge_restricted_region_border:
        0 - otherwise.
   Note: we do not specify any particular region here, any region will
         suffice for which special reactions (REFL/ABSORB) are defined.
+        The answer depends only on the species and orientation of the
+        molecule, so it is kept for all edges of the wall next to the
+        wall's surface class reactions (see trigger_intersect).
 ************************************************************************/
 int is_wall_edge_restricted_region_border(struct volume *world,
                                           struct wall *this_wall,
                                           struct edge *this_edge,
                                           struct surface_molecule *sm) {
-  struct region_list *rlp, *rlp_head;
-  struct region *rp;
-  void *key;
-  unsigned int keyhash;
-
-  int is_region_border = 0; /* flag */
-
-  rlp_head = find_restricted_regions_by_wall(world, this_wall, sm);
-
-  /* If this wall is not a part of any region (note that we do not consider
-     region called ALL here) */
-  if (rlp_head == NULL)
-    return is_region_border;
+  /* Restrictive regions always give the wall a surface class */
+  if ((sm->properties->flags & CAN_REGION_BORDER) == 0 ||
+      this_wall->surf_class_head == NULL)
+    return 0;
 
-  for (rlp = rlp_head; rlp != NULL; rlp = rlp->next) {
-    rp = rlp->reg;
-    if (rp->boundaries == NULL)
-      mcell_internal_error("Region '%s' of the object '%s' has no boundaries.",
-                           rp->region_last_name,
-                           this_wall->parent_object->sym->name);
+  int i = wall_edge_index(this_wall, this_edge);
+  if (i < 0)
+    return 0;
 
-    keyhash = (unsigned int)(intptr_t)(this_edge);
-    key = (void *)(this_edge);
+  signed char *border_edges =
+      wall_rx_cache_border_edges(this_wall, sm->properties, sm->orient);
+  if (border_edges == NULL || *border_edges < 0) {
+    struct region_list *rlp_head =
+        find_restricted_regions_by_wall(world, this_wall, sm);
+    int found = find_region_border_edges(this_wall, rlp_head);
+    if (rlp_head != NULL)
+      delete_void_list((struct void_list *)rlp_head);
 
-    if (pointer_hash_lookup(rp->boundaries, key, keyhash)) {
-      is_region_border = 1;
-      break;
-    }
+    /* find_restricted_regions_by_wall has filled in the cache entry */
+    border_edges =
+        wall_rx_cache_border_edges(this_wall, sm->properties, sm->orient);
+    if (border_edges == NULL)
+      return (found >> i) & 1;
+    *border_edges = (signed char)found;
   }
 
-  if (rlp_head != NULL)
-    delete_void_list((struct void_list *)rlp_head);
-
-  return is_region_border;
+  return (*border_edges >> i) & 1;
 }
 
 /*************************************************************************
@@ -2836,7 +3442,7 @@ void find_neighbor_wall_and_edge(struct wall *orig_wall, int orig_edge_ind,
   }
 
   for (int ii = 0; ii < 3; ii++) {
-    w = orig_wall->nb_walls[ii];
+    w = wall_neighbor(orig_wall, ii);
     if (w == NULL)
       continue;
 
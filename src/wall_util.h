@@ -27,25 +27,23 @@
 
 /* Temporary data stored about an edge of a polygon */
 struct poly_edge {
-  struct poly_edge *next; /* Next edge in a hash table. */
+  struct poly_edge *next; /* More walls sharing this edge. */
 
-  double v1x; /* X coord of starting point */
-  double v1y; /* Y coord of starting point */
-  double v1z; /* Z coord of starting point */
-  double v2x; /* X coord of ending point */
-  double v2y; /* Y coord of ending point */
-  double v2z; /* Z coord of ending point */
+  unsigned long long key; /* Vertex position ids of the edge, lower first */
 
   int face[2]; /* wall indices on side of edge */
   int edge[2]; /* which edge of wall1/2 are we? */
   int n;     /* How many walls share this edge? */
 };
 
-/* Hash table for rapid order-invariant lookup of edges. */
+/* Open-addressed hash tables for rapid order-invariant lookup of edges. */
 struct edge_hashtable {
   struct poly_edge *data; /* Array of polygon edges */
+  struct vector3 **vertices; /* Array of distinct vertex positions; the
+                                slot of a position is its id */
 
-  int nkeys;    /* Length of array */
+  int nkeys;        /* Length of edge array, a power of two */
+  int nvertex_keys; /* Length of vertex array, a power of two */
   int stored;   /* How many things do we have in the table? */
   int distinct; /* How many of those are distinct? */
 };
@@ -64,18 +62,32 @@ struct plane {
                the plane */
 };
 
-int edge_equals(struct poly_edge *e1, struct poly_edge *e2);
-int edge_hash(struct poly_edge *pe, int nkeys);
-
-int ehtable_init(struct edge_hashtable *eht, int nkeys);
-int ehtable_add(struct edge_hashtable *eht, struct poly_edge *pe);
+/***************************************************************************
+wall_neighbor:
+  In: a wall
+      which edge (0-2) of the wall to look across
+  Out: the wall sharing that edge, or NULL if the edge is not shared.  The
+       neighbor is read from the edge itself rather than stored per wall.
+***************************************************************************/
+static inline struct wall *wall_neighbor(struct wall const *w, int edge) {
+  struct edge const *e = w->edges[edge];
+  if (e == NULL)
+    return NULL;
+  return (e->forward == w) ? e->backward : e->forward;
+}
+
+int edge_hash(unsigned long long key, int nkeys);
+
+int ehtable_init(struct edge_hashtable *eht, int nfaces);
+int ehtable_add(struct edge_hashtable *eht, int i, int j, struct vector3 *v1,
+                struct vector3 *v2);
 void ehtable_kill(struct edge_hashtable *eht);
 
 int surface_net(struct wall **facelist, int nfaces);
 void init_edge_transform(struct edge *e, int edgenum);
 int sharpen_object(struct object *parent);
 
-int sharpen_world(struct volume *world);
+int sharpen_world(struct volume *world, struct thread_pool *pool);
 
 double closest_interior_point(struct vector3 *pt, struct wall *w,
                               struct vector2 *ip, double r2);
@@ -84,6 +96,10 @@ int find_edge_point(struct wall *here, struct vector2 *loc,
                     struct vector2 *disp, struct vector2 *edgept);
 struct wall *traverse_surface(struct wall *here, struct vector2 *loc, int which,
                               struct vector2 *newloc);
+struct wall *traverse_surface_pair(struct wall *here, struct vector2 *loc,
+                                   struct vector2 *end, int which,
+                                   struct vector2 *newloc,
+                                   struct vector2 *newend);
 int is_manifold(struct region *r, int count_regions_flag);
 
 void jump_away_line(struct vector3 *p, struct vector3 *v, double k,
@@ -99,19 +115,47 @@ int collide_mol(struct vector3 *point, struct vector3 *move,
                 struct abstract_molecule *a, double *t, struct vector3 *hitpt,
                 double rx_radius_3d);
 
+void collide_mol_batch(struct vector3 const *point, struct vector3 const *move,
+                       double const *px, double const *py, double const *pz,
+                       int n, double rx_radius_3d, int *hit, double *t);
+
 int intersect_box(struct vector3 *llf, struct vector3 *urb, struct wall *w);
 
+void init_wall_geometry(struct wall *w);
+
 void init_tri_wall(struct object *objp, int side, struct vector3 *v0,
                    struct vector3 *v1, struct vector3 *v2);
 
+void wall_bounding_box(struct wall *w, struct vector3 *llf,
+                       struct vector3 *urb);
+
 struct wall_list *wall_to_vol(struct wall *w, struct subvolume *sv);
 
 struct wall *localize_wall(struct wall *w, struct storage *stor);
 
 int distribute_object(struct volume *world, struct object *parent);
 
+int redistribute_wall(struct volume *world, struct wall *w);
+
 int distribute_world(struct volume *world);
 
+int build_vertex_wall_adjacency(struct volume *world, int n_vertices);
+
+int build_wall_planes(struct volume *world);
+
+void destroy_wall_planes(struct volume *world);
+
+int assign_step_multipliers(struct volume *world);
+
+int next_disk_wall_candidate(struct wall_planes const *planes, int start,
+                             struct vector3 const *loc,
+                             struct vector3 const *mv, double R2, double m2_i);
+
+int next_wall_candidate(struct wall_planes const *planes, int start,
+                        struct vector3 const *point,
+                        struct vector3 const *move, struct wall *skip,
+                        struct notifications *notify, long long *polygon_tests);
+
 void closest_pt_point_triangle(struct vector3 *p, struct vector3 *a,
                                struct vector3 *b, struct vector3 *c,
                                struct vector3 *final_result);
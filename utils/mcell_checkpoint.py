@@ -23,6 +23,7 @@
 #                                                                             #
 ###############################################################################
 
+import os
 import sys
 import struct
 import argparse
@@ -78,6 +79,9 @@ class UnmarshalBuffer(object):
     def next_cstring(self, l):
         return self.next_struct('%ds' % l)[0]
 
+    def slice(self, start, end):
+        return self.__data[start:end]
+
     def next_struct(self, tmpl):
         vals = struct.unpack_from(
             self.__endian + tmpl, self.__data, self.__offset)
@@ -92,8 +96,28 @@ CMD_MCELL_VERSION     = 5
 CMD_SPECIES_TABLE     = 6
 CMD_SCHEDULER_STATE   = 7
 CMD_BYTE_ORDER        = 8
-CMD_NUM_CHKPT_CMD     = 9
+CMD_SCHEDULER_DELTA   = 9
 CMD_CHECKPOINT_API    = 10
+CMD_SCHEDULER_FIXED   = 11
+CMD_PERIODIC_IMAGES   = 12
+
+DELTA_COPY    = 0
+DELTA_LITERAL = 1
+
+
+def encode_vint(val):
+    out = [val & 0x7f]
+    val >>= 7
+    while val != 0:
+        out.append((val & 0x7f) | 0x80)
+        val >>= 7
+    return bytes(reversed(out))
+
+
+def encode_svint(val):
+    if val < 0:
+        return encode_vint(((-val) << 1) | 1)
+    return encode_vint(val << 1)
 
 
 def read_api(ub):
@@ -171,37 +195,142 @@ def read_species(ub):
     return {'species': species}
 
 
-def read_scheduler(ub, spec):
-    num_molecules = ub.next_vint()
+def read_periodic_images(ub):
+    boxes = []
+    for i in range(ub.next_vint()):
+        boxes.append((ub.next_svint(), ub.next_svint(), ub.next_svint()))
+    runs = []
+    for i in range(ub.next_vint()):
+        box = ub.next_vint()
+        runs.append((boxes[box], ub.next_vint()))
+    return {'periodic_images': runs}
+
+
+def read_molecule(ub, spec):
+    species = ub.next_vint()
+    rest = ub.offset
+    newbie = ub.next_byte()
+    change = ub.next_byte()
+    t, t2, bday, x, y, z = ub.next_struct('dddddd')
+    orient = ub.next_svint()
+    cmplx  = ub.next_vint()
+    m = {'species':  spec[species],
+         'newbie':   newbie != 0,
+         'change':   change != 0,
+         't':        t,
+         't2':       t2,
+         'birthday': bday,
+         'pos':      (x, y, z),
+         'orient':   orient}
+    if cmplx != 0:
+        suidx = ub.next_vint()
+        m['cx_idx'] = cmplx
+        m['cx_sub'] = suidx
+        if suidx != 0:
+            nunits = ub.next_vint()
+            m['cx_cnt'] = nunits
+    # everything but the species id, which is renumbered when merging
+    m['raw'] = ub.slice(rest, ub.offset)
+    return m
+
+
+def read_scheduler(ub, spec, api_version):
+    molecules = []
+    if api_version >= 2:
+        # one chunk per storage: molecule count, byte count, molecules
+        num_chunks = ub.next_vint()
+        for i in range(num_chunks):
+            num_molecules = ub.next_vint()
+            ub.next_vint()
+            for j in range(num_molecules):
+                molecules.append(read_molecule(ub, spec))
+    else:
+        num_molecules = ub.next_vint()
+        for i in range(num_molecules):
+            molecules.append(read_molecule(ub, spec))
+    return {'molecules': molecules}
+
+
+def read_scheduler_fixed(ub, spec):
+    # padding up to an 8 byte boundary, then fixed-width records
+    pad = ub.next_byte()
+    ub.next_cstring(pad)
+    num_molecules, record_size = ub.next_struct('QQ')
     molecules = []
     for i in range(num_molecules):
-        species = ub.next_vint()
-        newbie = ub.next_byte()
-        t, t2, bday, x, y, z = ub.next_struct('dddddd')
-        orient = ub.next_svint()
-        cmplx  = ub.next_vint()
+        start = ub.offset
+        t, t2, bday, x, y, z, species, orient, newbie, change = \
+            ub.next_struct('ddddddIhBB')
+        ub.next_cstring(record_size - (ub.offset - start))
         m = {'species':  spec[species],
              'newbie':   newbie != 0,
+             'change':   change != 0,
              't':        t,
              't2':       t2,
              'birthday': bday,
              'pos':      (x, y, z),
              'orient':   orient}
-        if cmplx != 0:
-            suidx = ub.next_vint()
-            m['cx_idx'] = cmplx
-            m['cx_sub'] = suidx
-            if suidx != 0:
-                nunits = ub.next_vint()
-                m['cx_cnt'] = nunits
+        # the equivalent variable-length record, as in read_molecule
+        m['raw'] = (bytes([newbie, change]) + ub.slice(start, start + 48) +
+                    encode_svint(orient) + encode_vint(0))
         molecules.append(m)
     return {'molecules': molecules}
 
 
+def read_scheduler_delta(ub, spec):
+    base_file = ub.next_string()
+    base_iteration, = ub.next_struct('q')
+    runs = []
+    for i in range(ub.next_vint()):
+        run = ub.next_vint()
+        length = run >> 1
+        if (run & 1) == DELTA_COPY:
+            runs.append((DELTA_COPY, ub.next_vint(), length))
+        else:
+            runs.append((DELTA_LITERAL,
+                         [read_molecule(ub, spec) for j in range(length)],
+                         length))
+    return {'base_file': base_file.decode("utf-8"),
+            'base_iteration': base_iteration,
+            'delta_runs': runs}
+
+
+def resolve_base(fname, data):
+    """ Find the base checkpoint of a differential checkpoint, which is
+    named as it was when written, either relative to the working directory
+    or to the differential checkpoint. """
+    base_file = data['base_file']
+    if not os.path.exists(base_file):
+        alt = os.path.join(os.path.dirname(fname),
+                           os.path.basename(base_file))
+        if os.path.exists(alt):
+            base_file = alt
+    base = read_file(base_file)
+    if 'delta_runs' in base:
+        raise Exception('Base checkpoint %s is itself differential.'
+                        % base_file)
+    if base['start_time'] != data['base_iteration']:
+        raise Exception('Base checkpoint %s is from iteration %d, not %d.'
+                        % (base_file, base['start_time'],
+                           data['base_iteration']))
+    return base
+
+
+def apply_delta(data, base):
+    molecules = []
+    for kind, what, length in data['delta_runs']:
+        if kind == DELTA_COPY:
+            molecules.extend(base['molecules'][what:what + length])
+        else:
+            molecules.extend(what)
+    return molecules
+
+
 def read_file(fname):
     ub = UnmarshalBuffer(open(fname, 'rb').read())
     data = {}
     while not ub.at_end():
+        offset = ub.offset
         cmd = ub.next_byte()
         if cmd == CMD_CURRENT_TIME:
             d = read_current_time(ub)
@@ -216,21 +345,65 @@ def read_file(fname):
         elif cmd == CMD_SPECIES_TABLE:
             d = read_species(ub)
         elif cmd == CMD_SCHEDULER_STATE:
-            d = read_scheduler(ub, data['species'])
+            d = read_scheduler(ub, data['species'],
+                               data.get('api_version', 0))
+            d['sections_end'] = offset
+        elif cmd == CMD_SCHEDULER_FIXED:
+            d = read_scheduler_fixed(ub, data['species'])
+            d['sections_end'] = offset
+        elif cmd == CMD_SCHEDULER_DELTA:
+            d = read_scheduler_delta(ub, data['species'])
+            d['sections_end'] = offset
         elif cmd == CMD_BYTE_ORDER:
             d = read_byte_order(ub)
-        elif cmd == CMD_NUM_CHKPT_CMD:
-            print("CMD_NUM_CHKPT_CMD")
         elif cmd == CMD_CHECKPOINT_API:
             d = read_api(ub)
+        elif cmd == CMD_PERIODIC_IMAGES:
+            d = read_periodic_images(ub)
         else:
             raise Exception(
                 'Unknown command %02x in file. Perhaps the file is malformed.'
                 % cmd)
         data.update(d)
+    data['raw_file'] = ub.slice(0, ub.offset)
     return data
 
 
+def merge_file(fname, outname):
+    """ Write the full checkpoint that a differential checkpoint stands for.
+    All sections but the molecules are taken over from the differential
+    checkpoint; the molecules are written as a single chunk. """
+    data = read_file(fname)
+    if 'delta_runs' not in data:
+        raise Exception('%s is not a differential checkpoint.' % fname)
+    base = resolve_base(fname, data)
+    if base['endian'] != data['endian']:
+        raise Exception('Checkpoint %s and its base differ in byte order.'
+                        % fname)
+
+    species_ids = dict((name, i) for i, name in data['species'].items())
+    payload = bytearray()
+    molecules = apply_delta(data, base)
+    for m in molecules:
+        payload += encode_vint(species_ids[m['species']])
+        payload += m['raw']
+
+    with open(outname, 'wb') as out:
+        out.write(data['raw_file'][:data['sections_end']])
+        out.write(bytes([CMD_SCHEDULER_STATE]))
+        out.write(encode_vint(1))
+        out.write(encode_vint(len(molecules)))
+        out.write(encode_vint(len(payload)))
+        out.write(payload)
+
+
+def set_periodic_boxes(data):
+    molecules = iter(data['molecules'])
+    for box, length in data['periodic_images']:
+        for i in range(length):
+            next(molecules)['box'] = box
+
+
 def dump_data(data, annotate):
     # ORIENTS = ['-', '_', '+']
     print('  MCell version:     %s'    % data['mcell_version'].decode("utf-8"))
@@ -243,6 +416,9 @@ def dump_data(data, annotate):
     rng_keys.sort()
     for d in rng_keys:
         print('  %s: %*s         %s'    % (d, 8-len(d), '', str(data[d])))
+    if 'periodic_images' in data:
+        boxes = set(box for box, length in data['periodic_images'])
+        print('  Periodic boxes:    %d' % len(boxes))
     print('  Species:')
 
     species_table = data['species']
@@ -265,6 +441,8 @@ def dump_data(data, annotate):
                        m['pos'][1],
                        m['pos'][2],)))
                        # ORIENTS[m['orient'] + 1])),
+                if 'box' in m:
+                    print('             box: (%d, %d, %d)' % m['box'])
             else:
                 print(('           %c %18.15g %18.15g %18.15g (%18.15g, %18.15g, '
                       '%18.15g)' %
@@ -283,6 +461,10 @@ def setup_argparser():
     parser.add_argument(
         "-a", "--annotate", action='store_true',
         help="annotate checkpoint output")
+    parser.add_argument(
+        "-m", "--merge", metavar="OUTFILE",
+        help="merge a differential checkpoint and its base into a full "
+             "checkpoint")
     parser.add_argument("chkpt_file", help="name of checkpoint file")
     return parser.parse_args()
 
@@ -296,5 +478,13 @@ if __name__ == '__main__':
     except ImportError:
         pass
 
-    data = read_file(args.chkpt_file)
-    dump_data(data, args.annotate)
+    if args.merge:
+        merge_file(args.chkpt_file, args.merge)
+    else:
+        data = read_file(args.chkpt_file)
+        if 'delta_runs' in data:
+            data['molecules'] = apply_delta(
+                data, resolve_base(args.chkpt_file, data))
+        if 'periodic_images' in data:
+            set_periodic_boxes(data)
+        dump_data(data, args.annotate)
@@ -0,0 +1,165 @@
+#!/usr/bin/env python3
+
+###############################################################################
+#                                                                             #
+# Copyright (C) 2006-2017 by                                                  #
+# The Salk Institute for Biological Studies and                               #
+# Pittsburgh Supercomputing Center, Carnegie Mellon University                #
+#                                                                             #
+# This program is free software; you can redistribute it and/or               #
+# modify it under the terms of the GNU General Public License                 #
+# as published by the Free Software Foundation; either version 2              #
+# of the License, or (at your option) any later version.                      #
+#                                                                             #
+# This program is distributed in the hope that it will be useful,             #
+# but WITHOUT ANY WARRANTY; without even the implied warranty of              #
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the               #
+# GNU General Public License for more details.                                #
+#                                                                             #
+# You should have received a copy of the GNU General Public License           #
+# along with this program; if not, write to the Free Software                 #
+# Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,  #
+# USA.                                                                        #
+#                                                                             #
+###############################################################################
+
+"""Compile the vertex and element lists of MDL polygon list objects.
+
+Every POLYGON_LIST whose VERTEX_LIST and ELEMENT_CONNECTIONS hold plain
+numbers is written to a binary mesh file, and the two lists in the MDL are
+replaced by a BINARY_MESH statement naming that file. MCell reads binary mesh
+files without lexing or parsing them, which makes starting large models much
+faster. Lists that contain expressions are left alone.
+"""
+
+import os
+import re
+import sys
+import struct
+import argparse
+
+BINARY_MESH_MAGIC = b'MCELLPLY'
+BINARY_MESH_VERSION = 1
+
+NUMBER = r'[-+]?(?:\d+\.?\d*|\.\d+)(?:[eE][-+]?\d+)?'
+TRIPLET = re.compile(r'\[\s*(%s)\s*,\s*(%s)\s*,\s*(%s)\s*\]' %
+                     (NUMBER, NUMBER, NUMBER))
+POLYGON_LIST = re.compile(r'([A-Za-z_][A-Za-z0-9_]*)\s+POLYGON_LIST\s*\{')
+COMMENT = re.compile(r'/\*.*?\*/|//[^\n]*', re.S)
+
+
+def find_block(text, keyword, start):
+    """Return (begin, open, close) of 'keyword { ... }' after start."""
+    m = re.compile(r'\b%s\s*\{' % keyword).search(text, start)
+    if m is None:
+        return None
+    depth = 1
+    i = m.end()
+    while depth > 0:
+        if i >= len(text):
+            return None
+        if text[i] == '{':
+            depth += 1
+        elif text[i] == '}':
+            depth -= 1
+        i += 1
+    return m.start(), m.end(), i - 1
+
+
+def parse_triplets(body, convert):
+    """Return the [a, b, c] entries of a list, or None if it has others."""
+    body = COMMENT.sub(' ', body)
+    triplets = []
+    pos = 0
+    for m in TRIPLET.finditer(body):
+        if body[pos:m.start()].strip():
+            return None
+        triplets.append(tuple(convert(x) for x in m.groups()))
+        pos = m.end()
+    if body[pos:].strip() or not triplets:
+        return None
+    return triplets
+
+
+def write_binary_mesh(path, vertices, elements):
+    with open(path, 'wb') as f:
+        f.write(BINARY_MESH_MAGIC)
+        f.write(struct.pack('=III', BINARY_MESH_VERSION, len(vertices),
+                            len(elements)))
+        for v in vertices:
+            f.write(struct.pack('=ddd', *v))
+        for e in elements:
+            f.write(struct.pack('=III', *e))
+
+
+def compile_meshes(text, mesh_dir, mdl_dir, verbose=False):
+    out = []
+    pos = 0
+    for m in POLYGON_LIST.finditer(text):
+        if m.start() < pos:
+            continue
+        name = m.group(1)
+        vblock = find_block(text, 'VERTEX_LIST', m.end())
+        if vblock is None:
+            continue
+        eblock = find_block(text, 'ELEMENT_CONNECTIONS', vblock[2] + 1)
+        if eblock is None or text[m.end():vblock[0]].strip() or \
+                text[vblock[2] + 1:eblock[0]].strip():
+            continue
+
+        vertices = parse_triplets(text[vblock[1]:vblock[2]], float)
+        elements = parse_triplets(text[eblock[1]:eblock[2]],
+                                  lambda x: int(float(x)))
+        if vertices is None or elements is None:
+            if verbose:
+                sys.stderr.write("Skipping '%s': its lists are not plain "
+                                 "numbers.\n" % name)
+            continue
+        if any(i < 0 or i >= len(vertices) for e in elements for i in e):
+            sys.stderr.write("Skipping '%s': an element refers to a vertex "
+                             "that does not exist.\n" % name)
+            continue
+
+        mesh_path = os.path.join(mesh_dir, name + '.mcp')
+        write_binary_mesh(mesh_path, vertices, elements)
+        if verbose:
+            sys.stderr.write("Compiled '%s': %d vertices, %d elements.\n" %
+                             (name, len(vertices), len(elements)))
+
+        rel_path = os.path.relpath(mesh_path, mdl_dir)
+        out.append(text[pos:vblock[0]])
+        out.append('BINARY_MESH = "%s"' % rel_path.replace('\\', '/'))
+        pos = eblock[2] + 1
+    out.append(text[pos:])
+    return ''.join(out)
+
+
+def setup_argparser():
+    parser = argparse.ArgumentParser(
+        description="Compile the polygon lists of an MDL file into binary "
+                    "mesh files.")
+    parser.add_argument('mdl', help="MDL file with POLYGON_LIST objects")
+    parser.add_argument('-o', '--output', required=True,
+                        help="MDL file to write, using BINARY_MESH")
+    parser.add_argument('-d', '--mesh-dir',
+                        help="directory for the binary mesh files "
+                             "(default: next to the output)")
+    parser.add_argument('-v', '--verbose', action='store_true',
+                        help="report what is compiled")
+    return parser.parse_args()
+
+
+if __name__ == '__main__':
+
+    args = setup_argparser()
+    mdl_dir = os.path.dirname(os.path.abspath(args.output))
+    mesh_dir = args.mesh_dir if args.mesh_dir else mdl_dir
+    if not os.path.isdir(mesh_dir):
+        os.makedirs(mesh_dir)
+
+    with open(args.mdl) as f:
+        text = f.read()
+    text = compile_meshes(text, os.path.abspath(mesh_dir), mdl_dir,
+                          args.verbose)
+    with open(args.output, 'w') as f:
+        f.write(text)
@@ -0,0 +1,21 @@
+#!/bin/sh
+# Builds a profile-guided release of MCell: configures with the pgo-generate
+# preset, trains on the mcell_bench models and kernels, and rebuilds the same
+# directory with the pgo-use preset.  Extra arguments are passed to both
+# cmake configure runs, e.g. -DPYMCELL=OFF.
+set -e
+
+src=$(cd "$(dirname "$0")/.." && pwd)
+build="$src/build/pgo"
+jobs=$(nproc 2>/dev/null || echo 4)
+
+cd "$src"
+cmake --preset pgo-generate "$@"
+rm -rf "$build/pgo_profile"
+cmake --build "$build" --target mcell mcell_bench -j "$jobs"
+
+# training workloads
+(cd "$build" && ./mcell_bench -s 1 -i 200 && ./mcell_bench -k)
+
+cmake --preset pgo-use "$@"
+cmake --build "$build" --target mcell mcell_bench -j "$jobs"